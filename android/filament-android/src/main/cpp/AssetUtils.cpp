@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AssetUtils.h"
+
+#include <android/asset_manager_jni.h>
+
+AAsset* openAsset(JNIEnv* env, jobject assetManager, jstring path_,
+        const void** data, size_t* size) noexcept {
+    AAssetManager* manager = AAssetManager_fromJava(env, assetManager);
+    if (!manager) {
+        return nullptr;
+    }
+
+    const char* path = env->GetStringUTFChars(path_, nullptr);
+    // AASSET_MODE_BUFFER maps the asset if it's stored uncompressed in the APK, compressed
+    // assets are inflated once in native memory
+    AAsset* asset = AAssetManager_open(manager, path, AASSET_MODE_BUFFER);
+    env->ReleaseStringUTFChars(path_, path);
+    if (!asset) {
+        return nullptr;
+    }
+
+    *data = AAsset_getBuffer(asset);
+    *size = (size_t) AAsset_getLength64(asset);
+    if (!*data) {
+        AAsset_close(asset);
+        return nullptr;
+    }
+    return asset;
+}
+
+void releaseAsset(void*, size_t, void* asset) noexcept {
+    AAsset_close((AAsset*) asset);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include <jni.h>
+
+#include <android/asset_manager.h>
+
+// Opens an asset of the APK and gives direct access to its bytes: uncompressed assets are
+// memory-mapped, so the data doesn't go through the Java heap or a direct buffer.
+// Returns nullptr if the asset can't be opened, otherwise the asset must be released with
+// releaseAsset(), typically from the callback of the descriptor the data is given to.
+AAsset* openAsset(JNIEnv* env, jobject assetManager, jstring path,
+        const void** data, size_t* size) noexcept;
+
+// Has the signature of the release callbacks of buffer descriptors and material packages, the
+// asset is the user pointer.
+void releaseAsset(void* data, size_t size, void* asset) noexcept;
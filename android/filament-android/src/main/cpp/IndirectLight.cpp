@@ -65,6 +65,14 @@ Java_com_google_android_filament_IndirectLight_nIrradianceAsTexture(JNIEnv*, jcl
     builder->irradiance(texture);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_IndirectLight_nEnvironment(JNIEnv*, jclass,
+        jlong nativeBuilder, jlong nativeTexture) {
+    IndirectLight::Builder* builder = (IndirectLight::Builder*) nativeBuilder;
+    const Texture* texture = (const Texture*) nativeTexture;
+    builder->environment(texture);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_IndirectLight_nIntensity(JNIEnv*, jclass,
         jlong nativeBuilder, jfloat envIntensity) {
@@ -103,3 +111,18 @@ Java_com_google_android_filament_IndirectLight_nSetRotation(JNIEnv *env, jclass
     IndirectLight *indirectLight = (IndirectLight *) nativeIndirectLight;
     indirectLight->setRotation(math::mat3f{v0, v1, v2, v3, v4, v5, v6, v7, v8});
 }
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_IndirectLight_nRefresh(JNIEnv*, jclass,
+        jlong nativeIndirectLight, jlong nativeEngine) {
+    IndirectLight* indirectLight = (IndirectLight*) nativeIndirectLight;
+    Engine* engine = (Engine*) nativeEngine;
+    indirectLight->refresh(*engine);
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_android_filament_IndirectLight_nIsReady(JNIEnv*, jclass,
+        jlong nativeIndirectLight) {
+    IndirectLight* indirectLight = (IndirectLight*) nativeIndirectLight;
+    return (jboolean) indirectLight->isReady();
+}
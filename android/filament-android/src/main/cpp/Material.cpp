@@ -18,6 +18,7 @@
 
 #include <filament/Material.h>
 
+#include "AssetUtils.h"
 #include "NioUtils.h"
 
 using namespace filament;
@@ -39,6 +40,23 @@ Java_com_google_android_filament_Material_nBuilderBuild(JNIEnv *env, jclass,
     return (jlong) material;
 }
 
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_google_android_filament_Material_nBuilderBuildFromAsset(JNIEnv *env, jclass,
+        jlong nativeEngine, jobject assetManager, jstring path) {
+    Engine* engine = (Engine*) nativeEngine;
+    const void* data;
+    size_t size;
+    AAsset* asset = openAsset(env, assetManager, path, &data, &size);
+    if (!asset) {
+        return 0;
+    }
+    // the material references the asset's bytes, and closes it when it's destroyed
+    Material* material = Material::Builder()
+            .package(data, size, &releaseAsset, asset)
+            .build(*engine);
+    return (jlong) material;
+}
+
 extern "C" JNIEXPORT jlong JNICALL
 Java_com_google_android_filament_Material_nGetDefaultInstance(JNIEnv*, jclass,
         jlong nativeMaterial) {
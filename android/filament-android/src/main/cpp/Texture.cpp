@@ -24,6 +24,7 @@
 #include <filament/Stream.h>
 #include <filament/Texture.h>
 
+#include "AssetUtils.h"
 #include "CallbackUtils.h"
 #include "NioUtils.h"
 
@@ -195,6 +196,84 @@ Java_com_google_android_filament_Texture_nSetImage(JNIEnv *env, jclass type_, jl
     return 0;
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_Texture_nSetImageFromAsset(JNIEnv *env, jclass type_,
+        jlong nativeTexture, jlong nativeEngine, jint level, jint xoffset, jint yoffset,
+        jint width, jint height, jobject assetManager, jstring path, jint offsetInBytes,
+        jint left, jint bottom, jint type, jint alignment,
+        jint stride, jint format) {
+    Texture *texture = (Texture *) nativeTexture;
+    Engine *engine = (Engine *) nativeEngine;
+
+    size_t sizeInBytes = getTextureDataSize(texture, (size_t) level, (Texture::Format) format,
+            (Texture::Type) type, (size_t) stride, (size_t) alignment);
+
+    const void *data;
+    size_t size;
+    AAsset *asset = openAsset(env, assetManager, path, &data, &size);
+    if (!asset) {
+        // IOException
+        return -2;
+    }
+    if ((size_t) offsetInBytes + sizeInBytes > size) {
+        AAsset_close(asset);
+        // BufferOverflowException
+        return -1;
+    }
+
+    // the pixels are read from the asset's bytes, the asset is closed once they're uploaded
+    void *buffer = (uint8_t *) data + offsetInBytes;
+    Texture::PixelBufferDescriptor desc(buffer, sizeInBytes, (driver::PixelDataFormat) format,
+            (driver::PixelDataType) type, (uint8_t) alignment, (uint32_t) left, (uint32_t) bottom,
+            (uint32_t) stride, &releaseAsset, asset);
+
+    texture->setImage(*engine, (size_t) level, (uint32_t) xoffset, (uint32_t) yoffset,
+            (uint32_t) width, (uint32_t) height, std::move(desc));
+
+    return 0;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_Texture_nSetImageCompressedFromAsset(JNIEnv *env, jclass type_,
+        jlong nativeTexture, jlong nativeEngine, jint level, jint xoffset, jint yoffset,
+        jint width, jint height, jobject assetManager, jstring path, jint offsetInBytes,
+        jint compressedSizeInBytes, jint compressedFormat) {
+    Texture *texture = (Texture *) nativeTexture;
+    Engine *engine = (Engine *) nativeEngine;
+
+    const void *data;
+    size_t size;
+    AAsset *asset = openAsset(env, assetManager, path, &data, &size);
+    if (!asset) {
+        // IOException
+        return -2;
+    }
+    if ((size_t) offsetInBytes > size) {
+        AAsset_close(asset);
+        // BufferOverflowException
+        return -1;
+    }
+
+    // by default the compressed data extends to the end of the asset
+    size_t sizeInBytes = compressedSizeInBytes > 0 ?
+            (size_t) compressedSizeInBytes : size - (size_t) offsetInBytes;
+    if ((size_t) offsetInBytes + sizeInBytes > size) {
+        AAsset_close(asset);
+        // BufferOverflowException
+        return -1;
+    }
+
+    void *buffer = (uint8_t *) data + offsetInBytes;
+    Texture::PixelBufferDescriptor desc(buffer, sizeInBytes,
+            (driver::CompressedPixelDataType) compressedFormat, (uint32_t) sizeInBytes,
+            &releaseAsset, asset);
+
+    texture->setImage(*engine, (size_t) level, (uint32_t) xoffset, (uint32_t) yoffset,
+            (uint32_t) width, (uint32_t) height, std::move(desc));
+
+    return 0;
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_google_android_filament_Texture_nSetImageCompressed(JNIEnv *env, jclass type_, jlong nativeTexture,
         jlong nativeEngine, jint level, jint xoffset, jint yoffset, jint width, jint height,
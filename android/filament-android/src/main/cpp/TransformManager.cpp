@@ -20,10 +20,14 @@
 #include <utils/Entity.h>
 #include <filament/TransformManager.h>
 
+#include "NioUtils.h"
+
 using namespace utils;
 using namespace filament;
 
 static_assert(sizeof(jint) == sizeof(Entity), "jint and Entity are not compatible!!");
+static_assert(sizeof(jint) == sizeof(TransformManager::Instance),
+        "jint and TransformManager::Instance are not compatible!!");
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_android_filament_TransformManager_nHasComponent(JNIEnv*, jclass,
@@ -94,6 +98,26 @@ Java_com_google_android_filament_TransformManager_nSetTransform(JNIEnv* env,
     env->ReleaseFloatArrayElements(localTransform_, localTransform, JNI_ABORT);
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_TransformManager_nSetTransforms(JNIEnv* env,
+        jclass, jlong nativeTransformManager, jobject instances, jint instancesRemaining,
+        jobject localTransforms, jint localTransformsRemaining, jint count) {
+    TransformManager* tm = (TransformManager*) nativeTransformManager;
+    // direct buffers are used in place, no copy is made
+    AutoBuffer instancesBuffer(env, instances, 0);
+    AutoBuffer transformsBuffer(env, localTransforms, 0);
+    if (instancesBuffer.countToByte((size_t) instancesRemaining) <
+                count * sizeof(TransformManager::Instance) ||
+        transformsBuffer.countToByte((size_t) localTransformsRemaining) <
+                count * sizeof(math::mat4f)) {
+        // BufferOverflowException
+        return -1;
+    }
+    tm->setTransforms(static_cast<TransformManager::Instance const*>(instancesBuffer.getData()),
+            static_cast<math::mat4f const*>(transformsBuffer.getData()), (size_t) count);
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_TransformManager_nGetTransform(JNIEnv* env,
         jclass, jlong nativeTransformManager, jint i,
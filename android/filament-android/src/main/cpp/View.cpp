@@ -126,11 +126,12 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetDynamicResolutionOptions(JNIEnv*,
         jclass, jlong nativeView, jboolean enabled, jboolean homogeneousScaling,
         jfloat targetFrameTimeMilli, jfloat headRoomRatio, jfloat scaleRate,
-        jfloat minScale, jfloat maxScale, jint history) {
+        jfloat minScale, jfloat maxScale, jint history, jboolean temporalUpsampling) {
     View* view = (View*) nativeView;
     View::DynamicResolutionOptions options;
     options.enabled = enabled;
     options.homogeneousScaling = homogeneousScaling;
+    options.temporalUpsampling = temporalUpsampling;
     options.targetFrameTimeMilli = targetFrameTimeMilli;
     options.headRoomRatio = headRoomRatio;
     options.scaleRate = scaleRate;
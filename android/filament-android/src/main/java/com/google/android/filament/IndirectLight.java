@@ -67,6 +67,12 @@ public class IndirectLight {
             return this;
         }
 
+        @NonNull
+        public Builder environment(@NonNull Texture cubemap) {
+            nEnvironment(mNativeBuilder, cubemap.getNativeObject());
+            return this;
+        }
+
         @NonNull
         public Builder intensity(float envIntensity) {
             nIntensity(mNativeBuilder, envIntensity);
@@ -121,6 +127,14 @@ public class IndirectLight {
                 rotation[6], rotation[7], rotation[8]);
     }
 
+    public void refresh(@NonNull Engine engine) {
+        nRefresh(getNativeObject(), engine.getNativeObject());
+    }
+
+    public boolean isReady() {
+        return nIsReady(getNativeObject());
+    }
+
     long getNativeObject() {
         if (mNativeObject == 0) {
             throw new IllegalStateException("Calling method on destroyed IndirectLight");
@@ -139,11 +153,14 @@ public class IndirectLight {
     private static native void nBuilderReflections(long nativeBuilder, long nativeTexture);
     private static native void nIrradiance(long nativeBuilder, int bands, float[] sh);
     private static native void nIrradianceAsTexture(long nativeBuilder, long nativeTexture);
+    private static native void nEnvironment(long nativeBuilder, long nativeTexture);
     private static native void nIntensity(long nativeBuilder, float envIntensity);
     private static native void nRotation(long nativeBuilder, float v0, float v1, float v2, float v3, float v4, float v5, float v6, float v7, float v8) ;
 
     private static native void nSetIntensity(long nativeIndirectLight, float intensity);
     private static native float nGetIntensity(long nativeIndirectLight);
     private static native void nSetRotation(long nativeIndirectLight, float v0, float v1, float v2, float v3, float v4, float v5, float v6, float v7, float v8);
+    private static native void nRefresh(long nativeIndirectLight, long nativeEngine);
+    private static native boolean nIsReady(long nativeIndirectLight);
 
 }
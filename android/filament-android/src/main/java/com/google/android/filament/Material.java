@@ -16,6 +16,7 @@
 
 package com.google.android.filament;
 
+import android.content.res.AssetManager;
 import android.support.annotation.IntRange;
 import android.support.annotation.NonNull;
 import android.support.annotation.Size;
@@ -90,7 +91,9 @@ public class Material {
             MAT4,
             SAMPLER_2D,
             SAMPLER_CUBEMAP,
-            SAMPLER_EXTERNAL
+            SAMPLER_EXTERNAL,
+            SAMPLER_2D_ARRAY,
+            SAMPLER_3D
         }
 
         public enum Precision {
@@ -139,17 +142,38 @@ public class Material {
     public static class Builder {
         private Buffer mBuffer;
         private int mSize;
+        private AssetManager mAssets;
+        private String mPath;
 
         @NonNull
         public Builder payload(@NonNull Buffer buffer, @IntRange(from = 0) int size) {
             mBuffer = buffer;
             mSize = size;
+            mAssets = null;
+            mPath = null;
+            return this;
+        }
+
+        /**
+         * Reads the material package from an asset, typically a <code>.filamat</code> file.
+         * Unlike {@link #payload(Buffer, int)}, the package is read directly from the APK by
+         * native code: it isn't copied into the Java heap, and if the asset is stored
+         * uncompressed it is memory-mapped rather than loaded.
+         */
+        @NonNull
+        public Builder payload(@NonNull AssetManager assets, @NonNull String path) {
+            mBuffer = null;
+            mSize = 0;
+            mAssets = assets;
+            mPath = path;
             return this;
         }
 
         @NonNull
         public Material build(@NonNull Engine engine) {
-            long nativeMaterial = nBuilderBuild(engine.getNativeObject(), mBuffer, mSize);
+            long nativeMaterial = mAssets != null ?
+                    nBuilderBuildFromAsset(engine.getNativeObject(), mAssets, mPath) :
+                    nBuilderBuild(engine.getNativeObject(), mBuffer, mSize);
             if (nativeMaterial == 0) throw new IllegalStateException("Couldn't create Material");
             long nativeDefaultInstance = nGetDefaultInstance(nativeMaterial);
             return new Material(nativeMaterial, nativeDefaultInstance);
@@ -339,6 +363,8 @@ public class Material {
     }
 
     private static native long nBuilderBuild(long nativeEngine, @NonNull Buffer buffer, int size);
+    private static native long nBuilderBuildFromAsset(long nativeEngine,
+            @NonNull AssetManager assets, @NonNull String path);
     private static native long nCreateInstance(long nativeMaterial);
     private static native long nGetDefaultInstance(long nativeMaterial);
 
@@ -16,11 +16,13 @@
 
 package com.google.android.filament;
 
+import android.content.res.AssetManager;
 import android.support.annotation.IntRange;
 import android.support.annotation.NonNull;
 import android.support.annotation.Nullable;
 import android.support.annotation.Size;
 
+import java.io.IOException;
 import java.nio.Buffer;
 import java.nio.BufferOverflowException;
 import java.nio.ByteBuffer;
@@ -37,7 +39,9 @@ public class Texture {
     public enum Sampler {
         SAMPLER_2D,
         SAMPLER_CUBEMAP,
-        SAMPLER_EXTERNAL
+        SAMPLER_EXTERNAL,
+        SAMPLER_2D_ARRAY,
+        SAMPLER_3D
     }
 
     public enum InternalFormat {
@@ -427,6 +431,56 @@ public class Texture {
         }
     }
 
+    /**
+     * Specifies the image of a level from an asset, for instance a file of raw pixels (or raw
+     * compressed blocks) following a header. The pixels are read directly from the APK by native
+     * code: they are not copied into the Java heap, and if the asset is stored uncompressed they
+     * are memory-mapped rather than loaded. The asset is closed once the image is uploaded.
+     *
+     * @param offsetInBytes offset of the pixels in the asset
+     * @throws IOException if the asset can't be opened
+     * @throws BufferOverflowException if the asset is too small for the image
+     */
+    public void setImage(@NonNull Engine engine,
+            @IntRange(from = 0) int level,
+            @NonNull AssetManager assets, @NonNull String path,
+            @IntRange(from = 0) int offsetInBytes,
+            @NonNull Format format, @NonNull Type type,
+            @IntRange(from = 1, to = 8) int alignment) throws IOException {
+        int result = nSetImageFromAsset(getNativeObject(), engine.getNativeObject(), level,
+                0, 0, getWidth(level), getHeight(level), assets, path, offsetInBytes,
+                0, 0, type.ordinal(), alignment, 0, format.ordinal());
+        checkAssetResult(result, path);
+    }
+
+    /**
+     * Compressed version of {@link #setImage(Engine, int, AssetManager, String, int, Format,
+     * Type, int)}.
+     *
+     * @param compressedSizeInBytes size of the compressed data, or 0 if it extends to the end
+     *                              of the asset
+     */
+    public void setImage(@NonNull Engine engine,
+            @IntRange(from = 0) int level,
+            @NonNull AssetManager assets, @NonNull String path,
+            @IntRange(from = 0) int offsetInBytes,
+            @NonNull CompressedFormat format,
+            @IntRange(from = 0) int compressedSizeInBytes) throws IOException {
+        int result = nSetImageCompressedFromAsset(getNativeObject(), engine.getNativeObject(),
+                level, 0, 0, getWidth(level), getHeight(level), assets, path, offsetInBytes,
+                compressedSizeInBytes, format.ordinal());
+        checkAssetResult(result, path);
+    }
+
+    private static void checkAssetResult(int result, @NonNull String path) throws IOException {
+        if (result == -2) {
+            throw new IOException("Couldn't open asset " + path);
+        }
+        if (result < 0) {
+            throw new BufferOverflowException();
+        }
+    }
+
     // note: faceOffsetsInBytes are offsets in byte in the buffer relative to the current position()
     // note: use Texture CubemapFace to index the faceOffsetsInBytes array
     // note: we assume all 6 faces are tightly packed
@@ -514,6 +568,16 @@ public class Texture {
             int compressedSizeInBytes, int compressedFormat,
             Object handler, Runnable callback);
 
+    private static native int nSetImageFromAsset(long nativeTexture, long nativeEngine,
+            int level, int xoffset, int yoffset, int width, int height,
+            AssetManager assets, String path, int offsetInBytes,
+            int left, int bottom, int type, int alignment, int stride, int format);
+
+    private static native int nSetImageCompressedFromAsset(long nativeTexture, long nativeEngine,
+            int level, int xoffset, int yoffset, int width, int height,
+            AssetManager assets, String path, int offsetInBytes,
+            int compressedSizeInBytes, int compressedFormat);
+
     private static native int nSetImageCubemap(long nativeTexture, long nativeEngine,
             int level, Buffer storage, int remaining, int left, int bottom, int type,
             int alignment, int stride, int format,
@@ -16,10 +16,14 @@
 
 package com.google.android.filament;
 
+import android.support.annotation.IntRange;
 import android.support.annotation.NonNull;
 import android.support.annotation.Nullable;
 import android.support.annotation.Size;
 
+import java.nio.Buffer;
+import java.nio.BufferOverflowException;
+
 public class TransformManager {
     private long mNativeObject;
 
@@ -63,6 +67,28 @@ public class TransformManager {
         nSetTransform(mNativeObject, i, localTransform);
     }
 
+    /**
+     * Sets the local transforms of several transform components with a single call, this
+     * behaves like calling {@link #setTransform} for each of them, in order.
+     *
+     * Direct buffers are read in place, without copies, which makes this the cheapest way to
+     * update many transforms every frame.
+     *
+     * @param instances       An IntBuffer containing count transform component instances.
+     * @param localTransforms A FloatBuffer containing count 4x4 packed matrices (i.e. 16 floats
+     *                        each matrix and no gap between matrices), the i-th matrix is set
+     *                        to the i-th instance.
+     * @param count           Number of transforms to set.
+     */
+    public void setTransforms(@NonNull Buffer instances, @NonNull Buffer localTransforms,
+            @IntRange(from = 0) int count) {
+        int result = nSetTransforms(mNativeObject, instances, instances.remaining(),
+                localTransforms, localTransforms.remaining(), count);
+        if (result < 0) {
+            throw new BufferOverflowException();
+        }
+    }
+
     @NonNull
     @Size(min = 16)
     public float[] getTransform(@EntityInstance int i,
@@ -105,6 +131,7 @@ public class TransformManager {
     private static native void nDestroy(long nativeTransformManager, int entity);
     private static native void nSetParent(long nativeTransformManager, int i, int newParent);
     private static native void nSetTransform(long nativeTransformManager, int i, float[] localTransform);
+    private static native int nSetTransforms(long nativeTransformManager, Buffer instances, int instancesRemaining, Buffer localTransforms, int localTransformsRemaining, int count);
     private static native void nGetTransform(long nativeTransformManager, int i, float[] outLocalTransform);
     private static native void nGetWorldTransform(long nativeTransformManager, int i, float[] outWorldTransform);
     private static native void nOpenLocalTransformTransaction(long nativeTransformManager);
@@ -35,6 +35,7 @@ public class View {
     public static class DynamicResolutionOptions {
         public boolean enabled = false;
         public boolean homogeneousScaling = false;
+        public boolean temporalUpsampling = false;
         public float targetFrameTimeMilli = 1000.0f / 60.0f;
         public float headRoomRatio = 0.0f;
         public float scaleRate = 0.125f;
@@ -51,7 +52,8 @@ public class View {
     public enum DepthPrepass {
         DEFAULT(-1),
         DISABLED(0),
-        ENABLED(1);
+        ENABLED(1),
+        AUTOMATIC(2);
 
         final int value;
 
@@ -158,7 +160,8 @@ public class View {
                 options.scaleRate,
                 options.minScale,
                 options.maxScale,
-                options.history);
+                options.history,
+                options.temporalUpsampling);
     }
 
     @NonNull
@@ -227,7 +230,7 @@ public class View {
     private static native void nSetDynamicResolutionOptions(long nativeView,
             boolean enabled, boolean homogeneousScaling,
             float targetFrameTimeMilli, float headRoomRatio, float scaleRate,
-            float minScale, float maxScale, int history);
+            float minScale, float maxScale, int history, boolean temporalUpsampling);
     private static native void nSetDynamicLightingOptions(long nativeView, float zLightNear, float zLightFar);
     private static native void nSetDepthPrepass(long nativeView, int value);
     private static native void nSetPostProcessingEnabled(long nativeView, boolean enabled);
@@ -38,6 +38,9 @@ function print_help {
     echo "        Run all unit tests, will trigger a debug build if needed."
     echo "    -v"
     echo "        Add Vulkan support to the Android build."
+    echo "    -w"
+    echo "        Also build multi-threaded WebGL samples (web workers and WebAssembly SIMD),"
+    echo "        used by the samples when the page is served cross-origin isolated."
     echo ""
     echo "Build types:"
     echo "    release"
@@ -88,6 +91,8 @@ GENERATE_TOOLCHAINS=false
 
 VULKAN_ANDROID_OPTION="-DFILAMENT_SUPPORTS_VULKAN=OFF"
 
+ISSUE_WEBGL_PTHREADS_BUILD=false
+
 BUILD_GENERATOR=Ninja
 BUILD_COMMAND=ninja
 BUILD_CUSTOM_TARGETS=
@@ -194,9 +199,17 @@ function build_desktop {
 
 function build_webgl_with_target {
     local LC_TARGET=`echo $1 | tr '[:upper:]' '[:lower:]'`
-    echo "Building WebGL $LC_TARGET..."
-    mkdir -p out/cmake-webgl-${LC_TARGET}
-    cd out/cmake-webgl-${LC_TARGET}
+    local VARIANT=$2
+    local WEBGL_OPTIONS=
+    if [ "$VARIANT" == "mt" ]; then
+        echo "Building multi-threaded WebGL $LC_TARGET..."
+        WEBGL_OPTIONS="-DWEBGL_PTHREADS=ON -DWEBGL_SIMD=ON"
+        VARIANT=-mt
+    else
+        echo "Building WebGL $LC_TARGET..."
+    fi
+    mkdir -p out/cmake-webgl${VARIANT}-${LC_TARGET}
+    cd out/cmake-webgl${VARIANT}-${LC_TARGET}
     if [ ! "$BUILD_TARGETS" ]; then
         BUILD_TARGETS=${BUILD_CUSTOM_TARGETS}
         ISSUE_CMAKE_ALWAYS=true
@@ -207,12 +220,23 @@ function build_webgl_with_target {
             -G "$BUILD_GENERATOR" \
             -DCMAKE_TOOLCHAIN_FILE=${EMSCRIPTEN}/cmake/Modules/Platform/Emscripten.cmake \
             -DCMAKE_BUILD_TYPE=$1 \
-            -DCMAKE_INSTALL_PREFIX=../webgl-${LC_TARGET}/filament \
+            -DCMAKE_INSTALL_PREFIX=../webgl${VARIANT}-${LC_TARGET}/filament \
             -DWEBGL=1 \
+            ${WEBGL_OPTIONS} \
             ../..
         ${BUILD_COMMAND} ${BUILD_TARGETS}
     fi
 
+    if [ "$VARIANT" == "-mt" ]; then
+        # The multi-threaded samples live next to the single-threaded ones
+        if [ -d "samples/web/public" ]; then
+            mkdir -p ../cmake-webgl-${LC_TARGET}/samples/web/public
+            cp samples/web/public/*-mt.* ../cmake-webgl-${LC_TARGET}/samples/web/public
+        fi
+        cd ../..
+        return
+    fi
+
     if [ -d "samples/web/public" ]; then
         if [ "$ISSUE_ARCHIVES" == "true" ]; then
             echo "Generating out/filament-${LC_TARGET}-web.tgz..."
@@ -236,10 +260,16 @@ function build_webgl {
     ISSUE_RELEASE_BUILD=${OLD_ISSUE_RELEASE_BUILD}
 
     if [ "$ISSUE_DEBUG_BUILD" == "true" ]; then
+        if [ "$ISSUE_WEBGL_PTHREADS_BUILD" == "true" ]; then
+            build_webgl_with_target "Debug" "mt"
+        fi
         build_webgl_with_target "Debug"
     fi
 
     if [ "$ISSUE_RELEASE_BUILD" == "true" ]; then
+        if [ "$ISSUE_WEBGL_PTHREADS_BUILD" == "true" ]; then
+            build_webgl_with_target "Release" "mt"
+        fi
         build_webgl_with_target "Release"
     fi
 }
@@ -405,7 +435,7 @@ function run_tests {
 
 pushd `dirname $0` > /dev/null
 
-while getopts ":hacfijmp:tuv" opt; do
+while getopts ":hacfijmp:tuvw" opt; do
     case ${opt} in
         h)
             print_help
@@ -472,6 +502,9 @@ while getopts ":hacfijmp:tuv" opt; do
             echo "Also be sure to pass Backend::VULKAN to Engine::create."
             echo ""
             ;;
+        w)
+            ISSUE_WEBGL_PTHREADS_BUILD=true
+            ;;
         \?)
             echo "Invalid option: -$OPTARG" >&2
             echo ""
@@ -248,6 +248,17 @@ public:
      */
     void setModelMatrix(const math::mat4f& view) noexcept;
 
+    /** Sets the camera's view matrix with a double precision position.
+     *
+     * This is the same as setModelMatrix() above, with an accurate position when the
+     * TransformManager's accurate translations are enabled.
+     *
+     * @param view The camera position and orientation provided as a rigid transform matrix.
+     *
+     * @see TransformManager::setAccurateTranslationsEnabled()
+     */
+    void setModelMatrix(const math::mat4& view) noexcept;
+
     /** Sets the camera's view matrix
      *
      * @param eye       The point in world space the camera is looking at.
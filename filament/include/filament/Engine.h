@@ -21,24 +21,34 @@
 #include <filament/Fence.h>
 #include <filament/SwapChain.h>
 
+#include <filament/driver/BlobCache.h>
+#include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/Platform.h>
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 class Camera;
 class DebugRegistry;
 class Fence;
+class Impostor;
 class IndexBuffer;
 class IndirectLight;
 class Material;
 class MaterialInstance;
+class ParticleSystem;
 class Renderer;
+class RenderTarget;
 class Scene;
 class Skybox;
 class Stream;
+class Terrain;
 class Texture;
 class VertexBuffer;
 class View;
@@ -114,7 +124,9 @@ class TransformManager;
  *
  * An Engine instance is not thread-safe. The implementation makes no attempt to synchronize
  * calls to an Engine instance methods.
- * If multi-threading is needed, synchronization must be external.
+ * If multi-threading is needed, synchronization must be external. The exception are loader
+ * threads, which can create textures, buffers and materials while the engine renders, see
+ * attachLoaderThread().
  *
  * Multi-threading
  * ===============
@@ -145,6 +157,52 @@ public:
     using Platform = driver::Platform;
     using Backend = driver::Backend;
 
+    /**
+     * Sizes of the memory reserved by the Engine for recording commands.
+     *
+     * The defaults are appropriate for most applications. Smaller values save memory for
+     * simple scenes; larger values avoid the Engine having to grow these buffers (which
+     * stalls a frame) for very complex scenes.
+     *
+     * A value of zero selects the default.
+     */
+    struct Config {
+        /**
+         * Size in MiB of the buffer holding the commands sent to the render thread. This should
+         * be at least three times minCommandBufferSizeMB. Defaults to 3 MiB.
+         */
+        uint32_t commandBufferSizeMB = 0;
+
+        /**
+         * Size in MiB of the commands that can be recorded between two flushes, which happen
+         * at least once per View rendered. The Engine doubles both command buffer sizes between
+         * frames when this is nearly exhausted. Defaults to 1 MiB.
+         */
+        uint32_t minCommandBufferSizeMB = 0;
+
+        /**
+         * Initial size in MiB of the buffer holding a Renderer's draw commands, it grows as
+         * needed between frames. Defaults to 1 MiB.
+         */
+        uint32_t perFrameCommandsSizeMB = 0;
+
+        /**
+         * Where the backend saves compiled shader programs, to load them instead of compiling
+         * them again in later runs. Only used by the OpenGL backend, when the driver supports
+         * program binaries. Its methods are called from filament's render thread, and it must
+         * outlive the Engine. Defaults to nullptr, no caching.
+         */
+        driver::BlobCache* blobCache = nullptr;
+
+        /**
+         * For debugging and benchmarking: path of a file where all the commands executed by
+         * the backend are recorded, with their data, so that they can be replayed later on the
+         * backend alone with the driver_replay tool. Recording slows down the render thread
+         * and traces can be very large. Defaults to nullptr, no recording.
+         */
+        const char* commandTracePath = nullptr;
+    };
+
     /**
      * Creates an instance of Engine
      *
@@ -166,6 +224,8 @@ public:
      *                          Setting this parameter will force filament to use the OpenGL
      *                          implementation (instead of Vulkan for instance).
      *
+     *  @param config           An optional Config, to override the default sizes of the command
+     *                          buffers. If not provided (or nullptr is used), defaults are used.
      *
      * @return A pointer to the newly created Engine, or nullptr if the Engine couldn't be created.
      *
@@ -180,7 +240,8 @@ public:
      * This method is thread-safe.
      */
     static Engine* create(Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            const Config* config = nullptr);
 
     /**
      * Destroy the Engine instance and all associated resources.
@@ -216,6 +277,14 @@ public:
 
     TransformManager& getTransformManager() noexcept;
 
+    /**
+     * Returns the JobSystem of the engine, which the thread that created the engine belongs to.
+     *
+     * That thread can use it to spread its own work, e.g. the processing of the assets it loads,
+     * over the worker threads of the engine. The jobs must be waited for before the next frame.
+     */
+    utils::JobSystem& getJobSystem() noexcept;
+
     /**
      * Creates a SwapChain from the given Operating System's native window handle.
      *
@@ -229,6 +298,26 @@ public:
      */
     SwapChain* createSwapChain(void* nativeWindow, uint64_t flags = 0) noexcept;
 
+    /**
+     * Creates a headless SwapChain, rendering offscreen into buffers owned by filament.
+     *
+     * A headless SwapChain isn't tied to any window and is never presented: committing it never
+     * waits for a display. Its content can be read back with Renderer::readPixels(). This is
+     * typically used for rendering on servers, together with Renderer::setMaxFramesInFlight().
+     *
+     * @param width  Width of the SwapChain's buffers, in pixels.
+     * @param height Height of the SwapChain's buffers, in pixels.
+     * @param flags  One or more configuration flags as defined in `SwapChain`.
+     *
+     * @return A pointer to the newly created SwapChain or nullptr if it couldn't be created.
+     *
+     * @remark
+     * On OpenGL, this requires a platform supporting pbuffers (EGL or GLX).
+     *
+     * @see Renderer.beginFrame(), Renderer.readPixels()
+     */
+    SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags = 0) noexcept;
+
     /**
      * Creates a renderer associated to this engine.
      *
@@ -272,6 +361,7 @@ public:
     void destroy(const VertexBuffer* p);        //!< Destroys an VertexBuffer object.
     void destroy(const Fence* p);               //!< Destroys a Fence object.
     void destroy(const IndexBuffer* p);         //!< Destroys an IndexBuffer object.
+    void destroy(const Impostor* p);            //!< Destroys an Impostor object.
     void destroy(const IndirectLight* p);       //!< Destroys an IndirectLight object.
 
     /**
@@ -284,15 +374,40 @@ public:
      */
     void destroy(const Material* p);
     void destroy(const MaterialInstance* p);    //!< Destroys a MaterialInstance object.
+    void destroy(const ParticleSystem* p);      //!< Destroys a ParticleSystem object.
     void destroy(const Renderer* p);            //!< Destroys a Renderer object.
+    void destroy(const RenderTarget* p);        //!< Destroys a RenderTarget object.
     void destroy(const Scene* p);               //!< Destroys a Scene object.
     void destroy(const Skybox* p);              //!< Destroys a SkyBox object.
     void destroy(const SwapChain* p);           //!< Destroys a SwapChain object.
     void destroy(const Stream* p);              //!< Destroys a Stream object.
+    void destroy(const Terrain* p);             //!< Destroys a Terrain object.
     void destroy(const Texture* p);             //!< Destroys a Texture object.
     void destroy(const View* p);                //!< Destroys a View object.
     void destroy(utils::Entity e);              //!< Destroys all filament-known components from this entity
 
+    /**
+     * Destroys several objects at once, which is much faster than destroying them one at a
+     * time when there are many of them (e.g. when unloading a scene): the engine's lists are
+     * locked once, and the driver objects are all freed by a few commands.
+     *
+     * @param p     array of `count` objects to destroy, null pointers are ignored.
+     * @param count number of objects in the array.
+     */
+    void destroy(const VertexBuffer* const* p, size_t count);
+    void destroy(const IndexBuffer* const* p, size_t count);
+    void destroy(const MaterialInstance* const* p, size_t count);
+    void destroy(const Texture* const* p, size_t count);
+
+    /**
+     * Destroys all filament-known components from several entities at once, the driver objects
+     * of their renderables are all freed by a few commands.
+     *
+     * @param entities  array of `count` entities.
+     * @param count     number of entities in the array.
+     */
+    void destroy(utils::Entity const* entities, size_t count);
+
     /**
      * Returns the default Material.
      *
@@ -342,8 +457,241 @@ public:
      */
     void execute();
 
+    /**
+     * Makes the calling thread a loader thread of this Engine: it can then build and destroy
+     * Texture, VertexBuffer, IndexBuffer and Material objects, and set their data (e.g. with
+     * Texture::setImage() or VertexBuffer::setBufferAt()), while another thread renders.
+     * Decoding assets and creating their resources can then be done entirely on loader threads.
+     *
+     * The commands of a loader thread are recorded in a buffer of its own, and queued for the
+     * render thread by flushLoaderThread(). The objects it created can only be used by other
+     * threads once flushLoaderThread() has returned. Conversely, objects created by other
+     * threads can only be used by a loader thread once their commands have been flushed, e.g.
+     * after Renderer::beginFrame().
+     *
+     * Material instances, renderables, lights and streaming textures must still be created by
+     * the thread that renders.
+     *
+     * @see detachLoaderThread()
+     */
+    void attachLoaderThread();
+
+    /**
+     * Queues the commands recorded so far by the calling loader thread for the render thread.
+     * A loader thread can record at most 1 MiB of commands between two flushes, which is plenty
+     * for several hundred objects: the data given to setImage() and the like isn't copied.
+     */
+    void flushLoaderThread();
+
+    /**
+     * Flushes the calling loader thread, which becomes a regular thread again. All the loader
+     * threads must be detached before the Engine is destroyed.
+     */
+    void detachLoaderThread();
+
+    /**
+     * Loads the backend's pipeline cache with data returned by getPipelineCacheData(), typically
+     * saved by a previous run of the application. The pipelines (i.e. shaders and render states)
+     * found in the cache are created much faster, which avoids most of the hitches of the first
+     * frames. Use Material::compile() to get the shaders of known variants ready as well.
+     *
+     * Only the Vulkan backend has a pipeline cache, other backends ignore this call. Data saved
+     * on another device or with another driver version is ignored too.
+     *
+     * @param data The cache's content. Its callback is called once the data has been consumed.
+     */
+    void setPipelineCacheData(driver::BufferDescriptor&& data) noexcept;
+
+    /**
+     * Copies the content of the backend's pipeline cache, to be saved and given back to
+     * setPipelineCacheData() in a later run. The cache grows as new pipelines are used, so this
+     * is best called after the application has rendered its typical scenes, or before exiting.
+     *
+     * @param data Where to copy the cache, or nullptr to query its size.
+     * @param size Size in bytes of the buffer pointed to by data.
+     *
+     * @return The number of bytes copied into data, or the size of the cache if data is
+     *         nullptr. Always 0 on backends without a pipeline cache.
+     */
+    size_t getPipelineCacheData(void* data, size_t size) noexcept;
+
+    /**
+     * Sets the memory budget of the streaming textures, i.e. how many bytes of their levels
+     * can be resident at once. Once it is reached, finer levels are only requested after the
+     * finest levels of textures which need less resolution are evicted.
+     *
+     * Where sparse textures are supported (OpenGL with GL_ARB_sparse_texture), this bounds the
+     * GPU memory of the streaming textures regardless of their number and size: the levels
+     * which aren't resident aren't backed by memory.
+     *
+     * @param bytes Memory budget in bytes, defaults to 256 MiB.
+     *
+     * @see Texture::Builder::streaming()
+     */
+    void setTextureStreamingBudget(size_t bytes) noexcept;
+
+    /**
+     * Memory used by the engine, in bytes.
+     *
+     * GPU sizes are estimated from the dimensions and formats of the resources, the actual
+     * allocations made by the GPU driver can be larger.
+     *
+     * @see getMemoryStats()
+     */
+    struct MemoryStats {
+        // CPU memory
+        size_t heapUsed;                    //!< engine objects (views, scenes, materials...)
+        size_t heapHighWatermark;           //!< maximum of heapUsed
+        size_t heapReserved;                //!< memory reserved by the engine's heap
+        size_t perRenderPassArenaSize;      //!< per frame allocations (froxels, commands...)
+        size_t perRenderPassArenaHighWatermark; //!< only measured in debug builds
+        size_t commandBufferSize;           //!< commands waiting for the driver thread
+        size_t commandBufferHighWatermark;  //!< maximum of the commands waiting
+
+        // GPU memory
+        size_t vertexBuffers;
+        size_t indexBuffers;
+        size_t uniformBuffers;
+        size_t textures;
+        size_t renderTargets;               //!< buffers of offscreen render targets
+        size_t renderTargetPool;            //!< part of the above, owned by the frame graph
+        size_t gpuHighWatermark;            //!< maximum of getGpuTotal()
+        size_t programCount;                //!< number of compiled shader programs
+
+        //! CPU memory reserved by the engine
+        size_t getCpuTotal() const noexcept {
+            return heapReserved + perRenderPassArenaSize + commandBufferSize;
+        }
+
+        //! GPU memory used by the engine's resources
+        size_t getGpuTotal() const noexcept {
+            return vertexBuffers + indexBuffers + uniformBuffers + textures + renderTargets;
+        }
+    };
+
+    /**
+     * Returns the memory currently used by the engine. This is cheap enough to be called every
+     * frame. Resources created or destroyed by commands not yet executed by the driver thread
+     * are not accounted yet.
+     */
+    MemoryStats getMemoryStats() noexcept;
+
+    /**
+     * Called when the memory used by the engine goes over one of the budgets set with
+     * setMemoryBudget().
+     */
+    using MemoryBudgetCallback = void(*)(MemoryStats const& stats, void* user);
+
+    /**
+     * Sets memory budgets and a callback to be notified when they're exceeded. The budgets are
+     * checked once per frame, from Renderer::beginFrame(), where the callback is called each
+     * time the memory used goes from under to over a budget.
+     *
+     * @param cpuBudget Budget for MemoryStats::getCpuTotal(), 0 for no budget.
+     * @param gpuBudget Budget for MemoryStats::getGpuTotal(), 0 for no budget.
+     * @param callback  Called on the thread that calls Renderer::beginFrame(), nullptr to remove
+     *                  the budgets.
+     * @param user      Passed back to the callback.
+     */
+    void setMemoryBudget(size_t cpuBudget, size_t gpuBudget,
+            MemoryBudgetCallback callback, void* user = nullptr) noexcept;
+
+    /**
+     * What trimMemory() frees, from the cheapest to get back to the most expensive. Each level
+     * also frees what the levels before it do.
+     */
+    enum class TrimMemoryLevel : uint8_t {
+        RENDER_TARGET_POOL,     //!< render targets of the frame graph not in use
+        DRIVER_CACHES,          //!< driver objects not in use (staging buffers, pipelines...)
+        PROGRAMS,               //!< programs of the materials, compiled again when next used
+        STREAMED_TEXTURES,      //!< finest levels of the streamed textures, streamed again
+    };
+
+    /**
+     * Memory freed by trimMemory(), in bytes, for each level.
+     */
+    struct TrimMemoryStats {
+        size_t renderTargetPool;    //!< GPU memory of the render targets destroyed
+        size_t driverCaches;        //!< GPU memory freed by the driver, when it knows it
+        size_t programCount;        //!< number of programs destroyed, their size isn't known
+        size_t streamedTextures;    //!< GPU memory of the texture levels evicted
+
+        //! GPU memory freed
+        size_t getTotal() const noexcept {
+            return renderTargetPool + driverCaches + streamedTextures;
+        }
+    };
+
+    /**
+     * Frees the memory the engine can get back by itself, e.g. from Android's onTrimMemory(),
+     * instead of destroying and recreating the application's resources. The resources freed
+     * are created again when they're needed, which makes the next frames more expensive.
+     *
+     * Call this between frames, from the thread that renders. It waits for the driver thread
+     * to free its caches.
+     *
+     * @param level What to free, all of it by default.
+     * @return The memory freed by each level.
+     *
+     * @see TrimMemoryLevel
+     */
+    TrimMemoryStats trimMemory(TrimMemoryLevel level = TrimMemoryLevel::STREAMED_TEXTURES);
+
+    /**
+     * Work done by the engine during a frame, added up over all the Views rendered.
+     *
+     * The same counters are available as the INT properties of the DebugRegistry named
+     * "d.stats.<field>", e.g. "d.stats.visible_renderables".
+     *
+     * @see getLastFrameStatistics()
+     */
+    struct FrameStatistics {
+        uint32_t visibleRenderables = 0;    //!< renderables left after culling
+        uint32_t visibleShadowCasters = 0;  //!< shadow casters left after culling
+        uint32_t froxelRecords = 0;         //!< light records used by the froxels
+        uint32_t commandsGenerated = 0;     //!< commands generated and sorted, i.e. not cached
+        uint32_t commandsRecorded = 0;      //!< commands translated into draw calls
+        uint32_t uniformBytes = 0;          //!< uniforms uploaded, see below
+        uint32_t programCompiles = 0;       //!< shader programs created
+        uint32_t textureUploads = 0;        //!< images uploaded to textures
+    };
+
+    /**
+     * Returns the counters of the last frame, i.e. between the last two calls to
+     * Renderer::endFrame(). This is cheap enough to be called every frame.
+     *
+     * uniformBytes counts the uniforms of the renderables, bones, lights and material
+     * instances, which are the ones whose size grows with the scene.
+     *
+     * @param stats Receives the counters.
+     */
+    void getLastFrameStatistics(FrameStatistics* stats) const noexcept;
+
     DebugRegistry& getDebugRegistry() noexcept;
 
+    /**
+     * Time spent starting the engine, in milliseconds, to measure the time to first frame.
+     *
+     * The GPU context and driver are created on the driver thread while Engine::create() waits,
+     * the engine's own resources are then created on the calling thread with some of the work
+     * done by jobs. The default material and the shader programs are created when first needed.
+     *
+     * @see getStartupTimings()
+     */
+    struct StartupTimings {
+        float driver = 0;       //!< from create() until the platform and driver are ready
+        float init = 0;         //!< creation of the engine's resources, once the driver is ready
+        float create = 0;       //!< total time spent in create()
+        float firstFrame = 0;   //!< from create() to the first Renderer::endFrame(), 0 until then
+    };
+
+    /**
+     * Returns the startup timings of this engine.
+     *
+     * @param timings Receives the timings.
+     */
+    void getStartupTimings(StartupTimings* timings) const noexcept;
+
 protected:
     //! \privatesection
     Engine() noexcept = default;
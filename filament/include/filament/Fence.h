@@ -98,6 +98,26 @@ public:
      *          FenceStatus::ERROR otherwise.
      */
     static FenceStatus waitAndDestroy(Fence* fence, Mode mode = Mode::FLUSH);
+
+    /**
+     * Returns a file descriptor that polls readable (POLLIN) once the Fence signals, so that
+     * an event loop (poll(), epoll, ALooper, ...) can wait for it instead of a blocked thread.
+     *
+     * The file descriptor of a SOFT fence becomes readable once the commands before the Fence
+     * are issued. A HARD fence's once the GPU has completed them, which requires native fences
+     * (sync files with EGL_ANDROID_native_fence_sync), -1 is returned without them.
+     *
+     * Once the file descriptor is readable, wait() with a \p timeout of 0 returns the status of
+     * the Fence. The file descriptor belongs to the Fence and is valid until the Fence is
+     * destroyed, it must not be read from or closed.
+     *
+     * @param mode  Whether the command stream is flushed or not, it must be flushed for the
+     *              file descriptor to become readable.
+     * @return      A file descriptor, or -1 if the platform or the driver can't provide one
+     *              (only Linux and Android can).
+     * @see #Mode
+     */
+    int getFileDescriptor(Mode mode = Mode::FLUSH);
 };
 
 } // namespace filament
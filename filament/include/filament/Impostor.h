@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file
+
+#ifndef TNT_FILAMENT_IMPOSTOR_H
+#define TNT_FILAMENT_IMPOSTOR_H
+
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/vec3.h>
+
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FImpostor;
+} // namespace details
+
+class Engine;
+class Material;
+class MaterialInstance;
+class Texture;
+
+/**
+ * An Impostor draws distant renderables as camera-facing quads, textured with pictures of the
+ * renderable taken from many directions.
+ *
+ * The pictures are the frames of an octahedral atlas: frame (i, j) of an n x n atlas is the
+ * renderable seen from the direction that the octahedral mapping maps to (i, j) / (n - 1), and
+ * each quad shows the frame closest to the direction it is seen from. The `impostor` tool bakes
+ * the atlases of a mesh, a base color atlas and a normal atlas, whose normals are in the space
+ * of the frames (x right, y up, z towards the viewer).
+ *
+ * Renderables set an impostor with RenderableManager::Builder::impostor(), and are replaced by
+ * it when their screen coverage drops below the minimum coverage of their last level of
+ * detail. All the renderables replaced by an impostor are drawn by the impostor's renderable,
+ * with a single instanced draw call per pass.
+ *
+ * The entity of the impostor must be added to the Scenes of the renderables using it.
+ */
+class UTILS_PUBLIC Impostor : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    //! Use Builder to construct an Impostor object instance
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * The atlases, mandatory. The base color atlas is sampled with its alpha as coverage,
+         * the normal atlas, which can be null, replaces the normal of the quads.
+         *
+         * @param baseColor A 2D texture of frames x frames square frames.
+         * @param normal    A 2D texture laid out like baseColor, or nullptr.
+         */
+        Builder& atlas(Texture const* baseColor, Texture const* normal) noexcept;
+
+        //! Number of frames along each side of the atlas, at least 2, 8 by default.
+        Builder& frames(uint8_t frames) noexcept;
+
+        /**
+         * The bounding sphere the frames were taken of, in the space of the renderables, by
+         * default centered on the origin with a radius of 1. The frames cover the sphere
+         * exactly, as printed by the `impostor` tool.
+         */
+        Builder& sphere(math::float3 const& center, float radius) noexcept;
+
+        //! Maximum number of renderables drawn by the impostor in a pass, 4096 by default.
+        Builder& capacity(uint32_t capacity) noexcept;
+
+        /**
+         * Material of the impostor, a built-in lit material by default. A custom material must
+         * have a vertex shader and parameters like the built-in one, see impostor.mat.
+         */
+        Builder& material(Material const* material) noexcept;
+
+        //! Whether the impostor casts shadows, false by default.
+        Builder& castShadows(bool enable) noexcept;
+
+        /**
+         * Creates the Impostor object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this Impostor with.
+         *
+         * @return pointer to the newly created object, or nullptr if it couldn't be created.
+         */
+        Impostor* build(Engine& engine);
+
+    private:
+        friend class details::FImpostor;
+    };
+
+    //! The entity of the renderable drawing the impostor.
+    utils::Entity getEntity() const noexcept;
+
+    /**
+     * The material instance of the renderable, owned by the Impostor. The parameters of the
+     * built-in material are set by the Impostor.
+     */
+    MaterialInstance* getMaterialInstance() noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_IMPOSTOR_H
@@ -39,6 +39,7 @@ class UTILS_PUBLIC IndexBuffer : public FilamentAPI {
 
 public:
     using BufferDescriptor = driver::BufferDescriptor;
+    using BufferUsage = driver::BufferUsage;
 
     enum class IndexType : uint8_t {
         USHORT = uint8_t(driver::ElementType::USHORT),
@@ -58,6 +59,9 @@ public:
         Builder& indexCount(uint32_t indexCount) noexcept;
         Builder& bufferType(IndexType indexType) noexcept;
 
+        // how often the buffer is updated with setBuffer(), STATIC by default
+        Builder& bufferUsage(BufferUsage usage) noexcept;
+
         /**
          * Creates the IndexBuffer object and returns a pointer to it.
          *
@@ -19,8 +19,12 @@
 #ifndef TNT_FILAMENT_INDIRECT_LIGHT_H
 #define TNT_FILAMENT_INDIRECT_LIGHT_H
 
+#include <filament/Box.h>
 #include <filament/FilamentAPI.h>
 
+#include <filament/driver/DriverEnums.h>
+#include <filament/driver/PixelBufferDescriptor.h>
+
 #include <utils/compiler.h>
 
 #include <math/mat4.h>
@@ -85,6 +89,12 @@ class FIndirectLight;
  * The reflections on object surfaces (specular component) is calculated from a specially
  * filtered cubemap pyramid generated by the **cmgen** tool.
  *
+ * Runtime environments
+ * ====================
+ *
+ * Both the irradiance and the reflections can instead be computed on the GPU from a cubemap
+ * created at runtime, e.g. rendered by the application, see Builder::environment().
+ *
  *
  * @see Scene, Light, Texture, Skybox
  */
@@ -162,6 +172,55 @@ public:
          */
         Builder& irradiance(Texture const* cubemap) noexcept;
 
+        /**
+         * Sets a volume of irradiance probes, which replaces the irradiance SH within its
+         * bounds. This gives localized ambient lighting (e.g. indoors, or in the shade of
+         * buildings) for the cost of a few trilinear fetches per fragment, instead of more
+         * lights or more Scenes.
+         *
+         * The probes are at the centers of the cells of a regular grid dividing \p bounds. Each
+         * probe has 9 SH coefficients, pre-scaled like the ones given to irradiance(), in the
+         * coordinate system of the IndirectLight. The fragments outside of \p bounds use the
+         * irradiance SH.
+         *
+         * @param volume    3D texture (`SAMPLER_3D`) of a filterable RGB or RGBA format, e.g.
+         *                  `RGBA16F`. Its width and height are the number of probes along x and
+         *                  y, its depth is 9 times the number of probes along z: the texel
+         *                  (x, y, k * n + z) is the coefficient k of the probe (x, y, z), where
+         *                  n is the number of probes along z. It must outlive the IndirectLight.
+         * @param bounds    Box covered by the grid, in world space.
+         *
+         * @return This Builder, for chaining calls.
+         *
+         * @note
+         * The volume can be generated from the environments captured at each probe with the
+         * **cmgen** tool, see `cmgen --sh-volume`.
+         *
+         * @see IndirectLight::setIrradianceVolume()
+         */
+        Builder& irradianceVolume(Texture const* volume, Box const& bounds) noexcept;
+
+        /**
+         * Computes the reflections and the irradiance SH from an environment cubemap, on the
+         * GPU, instead of using the ones given to reflections() and irradiance().
+         *
+         * The work is spread over the next few frames rendered by the Engine, the
+         * IndirectLight has no reflections and a black irradiance until it's done.
+         *
+         * @param cubemap   Linear HDR cubemap (e.g. `RGBA16F` or `R11F_G11F_B10F`) with a
+         *                  full mipmap chain, whose faces are a power of two. Its levels
+         *                  are generated by the Engine. The cubemap must outlive the
+         *                  IndirectLight.
+         *
+         * @return This Builder, for chaining calls.
+         *
+         * @attention
+         * \p cubemap *must not* be encoded in `RGBM`
+         *
+         * @see IndirectLight::refresh(), IndirectLight::isReady()
+         */
+        Builder& environment(Texture const* cubemap) noexcept;
+
         /**
          * (optional) Environment intensity.
          *
@@ -224,6 +283,58 @@ public:
      * @param rotation 3x3 rotation matrix. Must be a rigid-body transform.
      */
     void setRotation(math::mat3f const& rotation) noexcept;
+
+    /**
+     * Replaces the volume of irradiance probes given to Builder::irradianceVolume(), e.g. when
+     * the camera moves to another area of the world.
+     *
+     * @param volume    3D texture of the probes, or nullptr to use the irradiance SH everywhere.
+     * @param bounds    Box covered by the probes, in world space.
+     */
+    void setIrradianceVolume(Texture const* volume, Box const& bounds) noexcept;
+
+    /**
+     * Computes the reflections and the irradiance again from the environment given to
+     * Builder::environment(), e.g. after its content changed. The current ones are used until
+     * the new ones are done. This does nothing if the IndirectLight has no environment.
+     *
+     * @param engine Reference to the filament::Engine this IndirectLight is associated with.
+     */
+    void refresh(Engine& engine);
+
+    /**
+     * Returns false while the reflections and the irradiance are being computed from the
+     * environment, after build() or refresh(), true otherwise.
+     */
+    bool isReady() const noexcept;
+
+    /**
+     * Copies the 9 irradiance SH coefficients computed from the environment given to
+     * Builder::environment(). They are pre-scaled for the shaders, like the ones output by
+     * `cmgen --sh-shader`. Only valid once isReady() returns true.
+     *
+     * @param sh Array of 9 float3 receiving the coefficients.
+     */
+    void getIrradianceSH(math::float3* sh) const noexcept;
+
+    /**
+     * Reads back a face of a level of the reflections computed from the environment given to
+     * Builder::environment(), e.g. to save them. The level is `256 >> level` pixels wide and
+     * encoded in RGBM, its rows are in the order of the cubemap's texels.
+     *
+     * Like Renderer::readPixels(), the callback of `buffer` is invoked once the pixels are
+     * available, after a few frames.
+     *
+     * @param engine Reference to the filament::Engine this IndirectLight is associated with.
+     * @param level  Level of the reflections, between 0 and 8.
+     * @param face   Face of the cubemap to read.
+     * @param buffer Client-side buffer, of at least `(256 >> level)^2` RGBA UBYTE pixels.
+     *
+     * @attention
+     * This can only be called once isReady() returns true.
+     */
+    void readReflections(Engine& engine, uint8_t level, driver::TextureCubemapFace face,
+            driver::PixelBufferDescriptor&& buffer);
 };
 
 } // namespace filament
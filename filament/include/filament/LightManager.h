@@ -212,6 +212,18 @@ public:
          * use the camera far distance.
          */
         float shadowFarHint = 100.0f;
+
+        /** Number of cascades the view frustum is split into, for directional lights. Each
+         * cascade gets its own mapSize x mapSize shadow map, so that shadows close to the
+         * camera keep their resolution when shadowFar is large. Must be between 1 and 4.
+         */
+        uint8_t shadowCascades = 1;
+
+        /** Blend between a logarithmic (1.0) and a uniform (0.0) distribution of the cascade
+         * splits. Logarithmic splits match the perspective aliasing better, but give a very
+         * short first cascade when the camera near plane is small. Must be between 0 and 1.
+         */
+        float shadowCascadeSplitLambda = 0.75f;
     };
 
     //! Use Builder to construct a Light object instance
@@ -238,7 +250,11 @@ public:
          * @return This Builder, for chaining calls.
          *
          * @warning
-         * - Only a Type.DIRECTIONAL or Type.SUN light can cast shadows
+         * - Only Type.DIRECTIONAL, Type.SUN, Type.SPOT and Type.FOCUSED_SPOT lights can cast
+         *   shadows.
+         * - Spot lights share a shadow atlas: the ones covering the most of the screen get the
+         *   largest shadow maps, up to ShadowOptions::mapSize. Spot lights with an outer cone
+         *   angle wider than 80 degrees don't cast shadows.
          */
         Builder& castShadows(bool enable) noexcept;
 
@@ -65,6 +65,7 @@ public:
     using CullingMode = filament::driver::CullingMode;
 
     using ShaderModel = filament::driver::ShaderModel;
+    using ParameterHandle = MaterialInstance::ParameterHandle;
 
     struct ParameterInfo {
         const char* name;
@@ -91,6 +92,26 @@ public:
         // The RAM must stay valid until build() is called.
         Builder& package(const void* payload, size_t size);
 
+        //! Called once a package given to package(const void*, size_t, ...) isn't needed anymore
+        using PackageReleaseCallback = void(*)(void* payload, size_t size, void* user);
+
+        /**
+         * Specifies the material package without copying it, typically a memory-mapped
+         * .filamat file. The Material reads its shaders from the package as their variants are
+         * needed, so the parts of the package for variants that are never used are never read.
+         *
+         * @param payload   Material package, must stay valid until \p release is called.
+         * @param size      Size of the package in bytes.
+         * @param release   Called when the Material is destroyed, or by build() if it fails.
+         * @param user      User pointer given to \p release.
+         *
+         * @return This Builder, for chaining calls.
+         *
+         * @attention A Builder given a package this way can build a single Material.
+         */
+        Builder& package(const void* payload, size_t size,
+                PackageReleaseCallback release, void* user = nullptr);
+
         /**
          * Creates the Material object and returns a pointer to it.
          *
@@ -108,6 +129,41 @@ public:
         friend class details::FMaterial;
     };
 
+    /**
+     * Flags describing a variant of the material's shaders. The variant used to draw
+     * a renderable is picked from the lights and shadows of the scene and from the renderable
+     * itself, flags can be combined.
+     */
+    struct VariantFlags {
+        static constexpr uint8_t DIRECTIONAL_LIGHTING   = 0x01; //!< a directional light is visible
+        static constexpr uint8_t DYNAMIC_LIGHTING       = 0x02; //!< point or spot lights are visible
+        static constexpr uint8_t SHADOW_RECEIVER        = 0x04; //!< the renderable receives shadows
+        static constexpr uint8_t SKINNING               = 0x08; //!< the renderable is skinned
+    };
+
+    //! Called once the shaders passed to compile() are ready to be drawn with.
+    using CompilationCallback = void(*)(Material const* material, void* user);
+
+    /**
+     * Starts compiling the shaders of the given variants now, instead of when they are first
+     * drawn. Along with Engine::setPipelineCacheData(), this avoids the hitches of compiling
+     * shaders in the middle of a frame.
+     *
+     * When the backend compiles shaders in the background, renderables whose shaders aren't
+     * ready yet are drawn with the default material's.
+     *
+     * Variants that don't apply to this material (e.g. lighting variants of an unlit material)
+     * are skipped.
+     *
+     * @param variants Array of combinations of VariantFlags.
+     * @param count    Number of elements in variants.
+     * @param callback Called on the application's thread (during Engine or Renderer calls) once
+     *                 all the shaders are compiled, can be nullptr.
+     * @param user     Passed to callback.
+     */
+    void compile(uint8_t const* variants, size_t count,
+            CompilationCallback callback = nullptr, void* user = nullptr) const noexcept;
+
     MaterialInstance* createInstance() const noexcept;
 
     const char* getName() const noexcept;
@@ -129,6 +185,16 @@ public:
     size_t getParameters(ParameterInfo* parameters, size_t count) const noexcept;
     bool hasParameter(const char* name) const noexcept;
 
+    /**
+     * Resolves a uniform parameter by name, for the name-free setters of MaterialInstance.
+     *
+     * @param name  Name of the parameter as defined by the Material. Cannot be nullptr.
+     * @return A handle valid for all the instances of this Material, or an invalid handle if
+     *         this Material has no uniform parameter of that name.
+     * @throws utils::PreConditionPanic if name doesn't exist or no-op if exceptions are disabled.
+     */
+    ParameterHandle getParameterHandle(const char* name) const noexcept;
+
     template <typename T>
     void setDefaultParameter(const char* name, T value) noexcept {
         getDefaultInstance()->setParameter(name, value);
@@ -21,8 +21,12 @@
 #include <filament/Color.h>
 #include <filament/TextureSampler.h>
 
+#include <filament/driver/DriverEnums.h>
+
 #include <utils/compiler.h>
 
+#include <stdint.h>
+
 namespace filament {
 
 class Material;
@@ -32,6 +36,19 @@ class UniformInterfaceBlock;
 
 class UTILS_PUBLIC MaterialInstance : public FilamentAPI {
 public:
+    /**
+     * A uniform parameter of a Material, resolved once by name with
+     * Material::getParameterHandle(). It can be used with all the instances of that Material
+     * to set the parameter without looking its name up on every call.
+     */
+    struct ParameterHandle {
+        uint32_t offset = 0;    //!< offset of the parameter in the uniform buffer, in bytes
+        uint32_t count = 0;     //!< size of the parameter array, 0 for an invalid handle
+        driver::UniformType type = driver::UniformType::FLOAT;  //!< type of the parameter
+
+        bool isValid() const noexcept { return count != 0; }
+    };
+
     /**
      * @return the Material associated with this instance
      */
@@ -58,6 +75,28 @@ public:
     template<typename T>
     void setParameter(const char* name, const T* values, size_t count) noexcept;
 
+    /**
+     * Set a uniform by handle
+     *
+     * @param handle    Handle of the parameter returned by getMaterial()->getParameterHandle().
+     *                  Invalid handles are ignored.
+     * @param value     Value of the parameter to set, T must match the type of the parameter.
+     */
+    template<typename T>
+    void setParameter(ParameterHandle handle, T value) noexcept;
+
+    /**
+     * Set several uniforms of the same type by handle, in a single call
+     *
+     * @param handles   Handles of the parameters returned by getMaterial()->getParameterHandle().
+     *                  Invalid handles are ignored.
+     * @param values    Values of the parameters to set, one per handle. T must match the type
+     *                  of all the parameters.
+     * @param count     Number of parameters to set.
+     */
+    template<typename T>
+    void setParameters(ParameterHandle const* handles, const T* values, size_t count) noexcept;
+
     /**
      * Set a texture as the named parameter
      *
@@ -105,6 +144,18 @@ public:
      * Returns the scissor rectangle to its default setting, which encompasses the View.
      */
     void unsetScissor() noexcept;
+
+    /**
+     * Sets the depth offset applied to the primitives of this instance when they are rendered
+     * into a shadow map, to avoid shadow acne on the surfaces facing the light. The offset is
+     * applied by the rasterizer, like glPolygonOffset(), it is ignored in the other passes.
+     *
+     * By default, both the slope and the constant factors are 1.
+     *
+     * @param slope     scale of the depth slope of the primitive, in depth units
+     * @param constant  constant offset, in multiples of the depth buffer's resolution
+     */
+    void setPolygonOffset(float slope, float constant) noexcept;
 };
 
 } // namespace filament
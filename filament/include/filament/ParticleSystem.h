@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file
+
+#ifndef TNT_FILAMENT_PARTICLESYSTEM_H
+#define TNT_FILAMENT_PARTICLESYSTEM_H
+
+#include <filament/Box.h>
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FParticleSystem;
+} // namespace details
+
+class Camera;
+class Engine;
+class MaterialInstance;
+
+/**
+ * ParticleSystem
+ *
+ * A ParticleSystem emits, simulates and sorts its particles with compute shaders, and draws
+ * them as camera facing quads with a single draw call. The CPU only decides how many
+ * particles are emitted each update, so the particles' count is only limited by the GPU.
+ *
+ * The particles are drawn by a renderable, which has to be added to a Scene:
+ *
+ * ~~~~~~~~~~~{.cpp}
+ *  filament::ParticleSystem* particles = filament::ParticleSystem::Builder()
+ *              .maxParticleCount(65536)
+ *              .emissionRate(8000.0f)
+ *              .lifetime(4.0f, 8.0f)
+ *              .velocity({ -0.5f, 2.0f, -0.5f }, { 0.5f, 4.0f, 0.5f })
+ *              .acceleration({ 0.0f, -1.0f, 0.0f })
+ *              .material(materialInstance)
+ *              .boundingBox({{ 0, 8, 0 }, { 16, 16, 16 }})
+ *              .build(*engine);
+ *
+ *  scene->addEntity(particles->getEntity());
+ *
+ *  // once per frame, before rendering
+ *  particles->update(*engine, dt, *camera);
+ *
+ *  engine->destroy(particles);
+ * ~~~~~~~~~~~
+ *
+ * The quads have a COLOR attribute, which is the particle's color, and a UV0 attribute, which
+ * goes from (0, 0) to (1, 1) across the quad. The material is typically unlit with a
+ * transparent blending mode.
+ *
+ * The particles are simulated in the local space of the renderable's entity, i.e. the emitter
+ * moves with the entity's transform, if it has one.
+ *
+ * @note
+ * Requires a backend with compute shaders (OpenGL 4.3 or OpenGL ES 3.1). Otherwise a warning is
+ * logged, the particles are never emitted, and nothing is drawn.
+ */
+class UTILS_PUBLIC ParticleSystem : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    //! Use Builder to construct a ParticleSystem object instance
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * Maximum number of live particles, rounded up to a power of two, 1024 by default and
+         * MAX_PARTICLE_COUNT at most. When the pool is full, the oldest particles are replaced by
+         * the new ones, so it should hold at least emissionRate times the maximum lifetime.
+         */
+        Builder& maxParticleCount(uint32_t count) noexcept;
+
+        //! Particles emitted per second, 0 by default.
+        Builder& emissionRate(float particlesPerSecond) noexcept;
+
+        //! Range of the lifetime of the particles in seconds, 1 by default.
+        Builder& lifetime(float min, float max) noexcept;
+
+        //! The particles are emitted at a random position in this box, the origin by default.
+        Builder& emitter(const Box& box) noexcept;
+
+        //! Range of the initial velocity of the particles, per component.
+        Builder& velocity(math::float3 min, math::float3 max) noexcept;
+
+        //! Constant acceleration of the particles, e.g. gravity.
+        Builder& acceleration(math::float3 acceleration) noexcept;
+
+        //! Width of the quads at the start and at the end of the particles' lives, 0.1 by default.
+        Builder& size(float start, float end) noexcept;
+
+        //! Linear RGBA color of the particles at the start and at the end of their lives.
+        Builder& color(math::float4 start, math::float4 end) noexcept;
+
+        //! Material drawing the quads, mandatory.
+        Builder& material(MaterialInstance const* materialInstance) noexcept;
+
+        //! Box enclosing all the particles. Without one, the renderable isn't culled.
+        Builder& boundingBox(const Box& axisAlignedBoundingBox) noexcept;
+
+        /**
+         * Creates the ParticleSystem object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this ParticleSystem with.
+         *
+         * @return pointer to the newly created object, or nullptr if it couldn't be created.
+         */
+        ParticleSystem* build(Engine& engine);
+
+    private:
+        friend class details::FParticleSystem;
+    };
+
+    static constexpr uint32_t MAX_PARTICLE_COUNT = 1u << 20u;
+
+    //! The entity of the renderable drawing the particles.
+    utils::Entity getEntity() const noexcept;
+
+    //! Changes the number of particles emitted per second.
+    void setEmissionRate(float particlesPerSecond) noexcept;
+
+    /**
+     * Emits the particles of the last dt seconds, moves all the particles, and sorts them
+     * back to front for the camera. The quads are then oriented towards it.
+     *
+     * Must be called once per frame, before Renderer::render().
+     *
+     * @param engine Engine this ParticleSystem was created with.
+     * @param dt Elapsed time since the last update, in seconds.
+     * @param camera Camera the particles are sorted and oriented for.
+     */
+    void update(Engine& engine, float dt, Camera const& camera);
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_PARTICLESYSTEM_H
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file
+
+#ifndef TNT_FILAMENT_RENDERTARGET_H
+#define TNT_FILAMENT_RENDERTARGET_H
+
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FRenderTarget;
+} // namespace details
+
+class Engine;
+class Texture;
+
+/**
+ * RenderTarget
+ *
+ * A RenderTarget lets a View render into application Textures instead of the SwapChain, see
+ * View::setRenderTarget(RenderTarget*, TargetBufferFlags). The textures can then be sampled by
+ * the materials of the Views rendered after it in the same frame, without any copy, e.g. to
+ * display a mirror or an in-world screen.
+ *
+ * Creation and destruction
+ * ========================
+ *
+ * A RenderTarget object is created using the RenderTarget::Builder and destroyed by calling
+ * Engine::destroy(const RenderTarget*).
+ *
+ * ~~~~~~~~~~~{.cpp}
+ *  filament::Engine* engine = filament::Engine::create();
+ *
+ *  filament::Texture* color = filament::Texture::Builder()
+ *              .width(512).height(512)
+ *              .format(filament::Texture::InternalFormat::RGBA8)
+ *              .usage(filament::Texture::Usage::COLOR_ATTACHMENT)
+ *              .build(*engine);
+ *
+ *  filament::RenderTarget* target = filament::RenderTarget::Builder()
+ *              .texture(filament::RenderTarget::AttachmentPoint::COLOR, color)
+ *              .build(*engine);
+ *
+ *  offscreenView->setRenderTarget(target);
+ *
+ *  // render offscreenView first, then the views whose materials sample "color"
+ *
+ *  engine->destroy(target);
+ * ~~~~~~~~~~~
+ *
+ * @note
+ * The RenderTarget doesn't own its textures, they must outlive it. A View must not sample the
+ * textures of the RenderTarget it renders into.
+ *
+ * @see View, Texture
+ */
+class UTILS_PUBLIC RenderTarget : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    //! Attachment of a RenderTarget
+    enum class AttachmentPoint : uint8_t {
+        COLOR = 0,          //!< color buffer, the Texture must have Texture::Usage::COLOR_ATTACHMENT
+        DEPTH = 1,          //!< depth buffer, the Texture must have Texture::Usage::DEPTH_ATTACHMENT
+    };
+
+    //! Number of attachment points
+    static constexpr size_t ATTACHMENT_COUNT = 2;
+
+    //! Use Builder to construct a RenderTarget object instance
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * Sets the texture of an attachment. A COLOR attachment is required.
+         *
+         * @param attachment The attachment point of the texture.
+         * @param texture A 2D Texture, with the usage matching the attachment point. The
+         *                Texture is not owned by the RenderTarget.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& texture(AttachmentPoint attachment, Texture* texture) noexcept;
+
+        /**
+         * Sets the mipmap level rendered into for an attachment. Default is 0.
+         *
+         * @param attachment The attachment point of the texture.
+         * @param level The level of the Texture, its size is the size of the RenderTarget.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& mipLevel(AttachmentPoint attachment, uint8_t level) noexcept;
+
+        /**
+         * Creates the RenderTarget object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this RenderTarget with.
+         *
+         * @return pointer to the newly created object, or nullptr if the RenderTarget couldn't
+         *         be created.
+         */
+        RenderTarget* build(Engine& engine);
+
+    private:
+        friend class details::FRenderTarget;
+    };
+
+    //! Returns the texture of an attachment, or nullptr if the attachment isn't set.
+    Texture* getTexture(AttachmentPoint attachment) const noexcept;
+
+    //! Returns the mipmap level rendered into for an attachment.
+    uint8_t getMipLevel(AttachmentPoint attachment) const noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_RENDERTARGET_H
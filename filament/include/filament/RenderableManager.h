@@ -42,6 +42,8 @@ class FRenderPrimitive;
 class FRenderableManager;
 } // namespace details
 
+class Impostor;
+
 class UTILS_PUBLIC RenderableManager : public FilamentAPI {
     struct BuilderDetails;
 
@@ -53,6 +55,9 @@ public:
 
     Instance getInstance(utils::Entity e) const noexcept;
 
+    // maximum number of levels of detail of a renderable
+    static constexpr size_t MAX_LEVEL_COUNT = 4;
+
     struct Bone {
         math::quatf unitQuaternion = { 1, 0, 0, 0 };
         math::float3 translation = { 0, 0, 0 };
@@ -73,19 +78,81 @@ public:
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices) noexcept;
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t count) noexcept;
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
+
+        /**
+         * Sets the geometry of a primitive for a level of detail. Level 0 is the most detailed,
+         * and is the one set by the other geometry() methods. All the levels have the same
+         * primitives, which use the same materials and blend orders.
+         *
+         * @param level Level of detail, smaller than MAX_LEVEL_COUNT.
+         */
+        Builder& geometry(uint8_t level, size_t index, PrimitiveType type,
+                VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t count) noexcept;
+
+        /**
+         * Sets the minimum screen coverage of a level of detail, 0 by default.
+         *
+         * The screen coverage is the fraction of the viewport's height covered by the bounding
+         * sphere of the renderable. The most detailed level whose minimum coverage is reached is
+         * used. A small hysteresis is applied to avoid switching back and forth between levels,
+         * each View selects the levels independently.
+         *
+         * @param level Level of detail, smaller than MAX_LEVEL_COUNT.
+         * @param minScreenCoverage Minimum screen coverage, should decrease with the level.
+         */
+        Builder& levelOfDetail(uint8_t level, float minScreenCoverage) noexcept;
+
+        /**
+         * Replaces the renderable by an impostor when its screen coverage is below the minimum
+         * coverage of its last level of detail, see levelOfDetail(). The renderable is then
+         * drawn by the impostor's renderable, which must be in the same Scene. The impostor
+         * must outlive the renderable.
+         *
+         * @param impostor Impostor baked from this renderable, or nullptr (the default).
+         */
+        Builder& impostor(Impostor* impostor) noexcept;
         Builder& material(size_t index, MaterialInstance const* materialInstance) noexcept;
         // The axis aligned bounding box of the Renderable. Mandatory unless culling is disabled.
         Builder& boundingBox(const Box& axisAlignedBoundingBox) noexcept;
         Builder& layerMask(uint8_t select, uint8_t values) noexcept;
         // The priority is clamped to the range [0..7], defaults to 4; 7 is lowest priority
         Builder& priority(uint8_t priority) noexcept;
+        // Orders the opaque draws of renderables with the same priority before the View's sort
+        // policy applies, lower keys first, 0 by default. E.g. known occluders can be drawn
+        // first, or renderables sharing state grouped together. Blended draws ignore it.
+        Builder& sortKey(uint8_t key) noexcept;
         Builder& culling(bool enable) noexcept; // true by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
+        // Static renderables are not expected to move or change often. Their shadows are
+        // cached, and only drawn again when the light or a static renderable changes.
+        Builder& staticGeometry(bool enable) noexcept; // false by default
         Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
         Builder& skinning(size_t boneCount, Bone const* transforms) noexcept;
         Builder& skinning(size_t boneCount, math::mat4f const* transforms) noexcept;
 
+        // Blends up to 4 morph targets in the vertex shaders, with the weights given by
+        // setMorphWeights(). The deltas of the positions and tangents of each target are the
+        // MORPH_POSITION_n and MORPH_TANGENTS_n attributes of the vertex buffers, so they're
+        // uploaded once and each change of the weights only updates 4 floats.
+        Builder& morphing(bool enable) noexcept; // false by default
+
+        // Skins the vertices with a compute shader once per update of the bones, instead of in
+        // the vertex shaders of every pass drawing the renderable (false by default). Ignored,
+        // with a warning, if the backend has no compute shaders or if the positions, tangents,
+        // bone indices or weights have an unsupported type or aren't 4 bytes aligned.
+        Builder& preSkinning(bool enable) noexcept;
+
+        // Draws every primitive instanceCount times with a single draw call (1 by default,
+        // 65535 max). Vertex shaders can use getInstanceIndex() to tell the instances apart.
+        // The bounding box must enclose all the instances.
+        Builder& instances(size_t instanceCount) noexcept;
+
+        // Layer of the SAMPLER_2D_ARRAY textures sampled by this renderable, 0 by default.
+        // Materials read it with getTextureLayer(), so that renderables sharing a texture array
+        // can share a MaterialInstance as well.
+        Builder& textureLayer(uint32_t layer) noexcept;
+
         // Sets an ordering index for blended primitives that all live at the same Z value.
         Builder& blendOrder(size_t index, uint16_t order) noexcept; // 0 by default
 
@@ -132,27 +199,39 @@ public:
     void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
     void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
     void setPriority(Instance instance, uint8_t priority) noexcept;
+    void setSortKey(Instance instance, uint8_t key) noexcept;
     void setCastShadows(Instance instance, bool enable) noexcept;
     void setReceiveShadows(Instance instance, bool enable) noexcept;
+    void setStaticGeometry(Instance instance, bool enable) noexcept;
+    void setTextureLayer(Instance instance, uint32_t layer) noexcept;
     bool isShadowCaster(Instance instance) const noexcept;
     bool isShadowReceiver(Instance instance) const noexcept;
 
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
 
+    // weights of the 4 morph targets, ignored unless the renderable was built with morphing()
+    void setMorphWeights(Instance instance, math::float4 const& weights) noexcept;
+
 
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
 
+    uint32_t getTextureLayer(Instance instance) const noexcept;
+    uint8_t getSortKey(Instance instance) const noexcept;
+
     // number of render primitives in this renderable
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
-    // set/change the material of a given render primitive
+    // number of levels of detail of this renderable
+    size_t getLevelCount(Instance instance) const noexcept;
+
+    // set/change the material of a given render primitive, at all levels of detail
     void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept;
     MaterialInstance* getMaterialInstanceAt(Instance instance, size_t primitiveIndex) const noexcept;
 
-    // set/change the geometry (vertex/index buffers) of a given primitive
+    // set/change the geometry (vertex/index buffers) of a given primitive, at level of detail 0
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
             size_t offset, size_t count) noexcept;
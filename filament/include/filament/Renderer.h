@@ -137,6 +137,48 @@ public:
      */
     void render(View const* view);
 
+    /**
+     * Render several View objects, in order, into this Renderer's window.
+     *
+     * This is equivalent to calling render() for each View, but the work that doesn't depend on
+     * the previous Views, such as culling the Scene of each View, is done concurrently.
+     *
+     * Views sharing a Scene are still prepared one after the other, so this is most
+     * effective when each View has its own Scene, see setPipelinedCulling().
+     *
+     * @param views An array of \p count pointers to the views to render. nullptr entries, and
+     *              views without a Scene, are skipped.
+     * @param count The number of entries in \p views.
+     *
+     * @attention
+     * render() must be called *after* beginFrame() and *before* endFrame().
+     *
+     * @see
+     * render(View const*)
+     */
+    void render(View const* const* views, size_t count);
+
+    /**
+     * Enables pipelined culling in render(View const* const*, size_t), which is disabled by
+     * default.
+     *
+     * Each View is then rendered as soon as its own culling is done, while the Views that
+     * follow it are still being culled. The second View of a Scene is culled in a copy of the
+     * Scene's per-frame data, concurrently with the first one, as long as both Views apply the
+     * same world origin to the Scene (i.e. they have the same IndirectLight rotation and, with
+     * accurate translations, cameras close to each other). Further Views of that Scene are
+     * culled just before they're rendered.
+     *
+     * This shortens render() when several Views are rendered, at the cost of a copy of the
+     * Scene's per-frame data for each Scene rendered by two Views or more.
+     *
+     * @param enabled Whether the culling of the Views is pipelined with their rendering.
+     *
+     * @see
+     * render(View const* const*, size_t)
+     */
+    void setPipelinedCulling(bool enabled) noexcept;
+
     /**
      * Flags used to configure the behavior of mirrorFrame().
      *
@@ -226,12 +268,13 @@ public:
      *
      * After issuing this method, the callback associated with `buffer` will be invoked on the
      * main thread, indicating that the read-back has completed. Typically, this will happen
-     * after multiple calls to beginFrame(), render(), endFrame().
-     *
-     * It is also possible to use a Fence to wait for the read-back.
+     * after multiple calls to beginFrame(), render(), endFrame(). `buffer` must not be accessed
+     * until then.
      *
      * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * The read-back doesn't stall the GPU: the pixels are copied into `buffer` once they're
+     * available, a few frames later. Reading back every frame is therefore possible, but costs
+     * memory bandwidth.
      *
      */
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -251,6 +294,9 @@ public:
      * beginFrame() attempts to detect this situation and returns false in that case, indicating
      * to the caller to skip the current frame.
      *
+     * With FramePacing::JUST_IN_TIME, beginFrame() can also block until it's time to start
+     * the frame, see setFramePacingOptions().
+     *
      * @param swapChain A pointer to the SwapChain instance to use.
      * 
      * @return
@@ -268,6 +314,98 @@ public:
      */
     bool beginFrame(SwapChain* swapChain);
 
+    /**
+     * Maximum value accepted by setMaxFramesInFlight().
+     */
+    static constexpr size_t MAX_FRAMES_IN_FLIGHT = 4;
+
+    /**
+     * Sets how many frames can be submitted to the GPU before it has finished the oldest one.
+     * Once this many frames are in flight, beginFrame() skips frames until the GPU catches up.
+     *
+     * The default of 2 keeps the latency low for interactive rendering. Offscreen rendering
+     * (e.g. with a headless SwapChain) usually prefers throughput, and can let the CPU get
+     * further ahead of the GPU.
+     *
+     * @param count Number of frames in flight, clamped to [1, MAX_FRAMES_IN_FLIGHT].
+     *
+     * @see
+     * beginFrame(), Engine::createSwapChain(uint32_t, uint32_t, uint64_t)
+     */
+    void setMaxFramesInFlight(size_t count) noexcept;
+
+    /**
+     * How beginFrame() paces the frames.
+     *
+     * @see
+     * FramePacingOptions
+     */
+    enum class FramePacing : uint8_t {
+        /**
+         * beginFrame() returns as soon as possible, and skips the frame if the GPU hasn't
+         * finished the oldest frame in flight. This is the default.
+         */
+        SKIP,
+
+        /**
+         * beginFrame() waits until just enough time is left before the next vsync to render
+         * a frame, estimated from the CPU and GPU time of the previous frames, and tells the
+         * display when the frame should be presented. This gives the lowest input-to-photon
+         * latency and an even cadence, at the cost of blocking the calling thread.
+         */
+        JUST_IN_TIME
+    };
+
+    /**
+     * Options controlling the frame pacing.
+     *
+     * @see
+     * setFramePacingOptions()
+     */
+    struct FramePacingOptions {
+        FramePacing mode = FramePacing::SKIP;   //!< how frames are paced
+        float refreshRate = 60.0f;              //!< refresh rate of the display, in Hz
+        /**
+         * Safety margin added to the estimated frame duration, as a fraction of the refresh
+         * period. Larger values produce fewer late frames but increase the latency.
+         */
+        float headRoomRatio = 0.1f;
+    };
+
+    /**
+     * Sets the frame pacing options.
+     *
+     * @param options Frame pacing options. The refresh rate is clamped to [1, 1000] Hz and
+     *                the head room ratio to [0, 1].
+     *
+     * @see
+     * beginFrame(), getFramePacingStats()
+     */
+    void setFramePacingOptions(FramePacingOptions const& options) noexcept;
+
+    /**
+     * Frame pacing statistics, accumulated since the last call to getFramePacingStats().
+     */
+    struct FramePacingStats {
+        uint32_t frameCount = 0;        //!< number of frames drawn
+        uint32_t skippedFrameCount = 0; //!< number of frames skipped by beginFrame()
+        uint32_t lateFrameCount = 0;    //!< number of frames which likely missed their vsync
+        uint32_t missedVsyncCount = 0;  //!< number of vsyncs which didn't get a new frame
+        float cpuTime = 0;              //!< estimated CPU time of a frame, in milliseconds
+        float gpuTime = 0;              //!< estimated GPU time of a frame, in milliseconds
+    };
+
+    /**
+     * Returns the frame pacing statistics accumulated since the last call, and resets them.
+     *
+     * A frame is considered late when it couldn't have made its targeted vsync given the
+     * estimated GPU time. Only the JUST_IN_TIME mode targets a vsync, so lateFrameCount and
+     * missedVsyncCount are always 0 with SKIP.
+     *
+     * @param stats Receives the statistics.
+     */
+    void getFramePacingStats(FramePacingStats* stats) noexcept;
+
     /**
      * Finishes the current frame and schedules it for display.
      *
@@ -280,6 +418,65 @@ public:
      * beginFrame()
      */
     void endFrame();
+
+    /**
+     * GPU time taken by the passes of a frame, in milliseconds.
+     *
+     * @see
+     * getLastGpuFrameTimings()
+     */
+    struct GpuFrameTimings {
+        uint32_t frameId = 0;       //!< frame these timings belong to
+        float shadowPass = 0;       //!< shadow map and shadow atlas passes
+        float colorPass = 0;        //!< depth and color passes
+        float postProcess = 0;      //!< everything after the color pass
+        float total = 0;            //!< sum of the above
+    };
+
+    /**
+     * Returns the GPU time taken by the passes of the latest frame the GPU is done with. The
+     * timings of all the Views rendered during that frame are added up.
+     *
+     * This is typically a few frames behind the frame being rendered, and is also what the
+     * dynamic resolution of Views is driven by.
+     *
+     * @param timings Receives the timings, left untouched when false is returned.
+     *
+     * @return false if no frame has been measured yet, or if the backend can't measure the
+     *         GPU time.
+     *
+     * @see
+     * View::setDynamicResolutionOptions()
+     */
+    bool getLastGpuFrameTimings(GpuFrameTimings* timings) const noexcept;
+
+    /**
+     * CPU time spent in the stages of a frame, in milliseconds.
+     *
+     * Stages run on several threads and can overlap (e.g. the lights are froxelized while the
+     * commands are generated), so their sum doesn't match the frame time.
+     *
+     * @see
+     * getLastCpuFrameTimings()
+     */
+    struct CpuFrameTimings {
+        uint32_t frameId = 0;       //!< frame these timings belong to
+        float prepare = 0;          //!< engine and views preparation, excluding the stages below
+        float cull = 0;             //!< frustum and occlusion culling
+        float froxelize = 0;        //!< assignment of the lights to froxels
+        float generate = 0;         //!< generation of the render passes' commands
+        float sort = 0;             //!< sorting of the render passes' commands
+        float record = 0;           //!< translation of the commands into driver commands
+    };
+
+    /**
+     * Returns the CPU time spent in the stages of the last frame, i.e. between the last two
+     * calls to endFrame(). The timings of all the Views rendered by the Engine during that
+     * frame are added up.
+     *
+     * @param timings Receives the timings.
+     */
+    void getLastCpuFrameTimings(CpuFrameTimings* timings) const noexcept;
 };
 
 } // namespace filament
@@ -19,11 +19,17 @@
 #ifndef TNT_FILAMENT_SCENE_H
 #define TNT_FILAMENT_SCENE_H
 
+#include <filament/Box.h>
 #include <filament/FilamentAPI.h>
+#include <filament/Frustum.h>
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
 
+#include <math/vec3.h>
+
+#include <stddef.h>
+
 namespace filament {
 
 class IndirectLight;
@@ -114,6 +120,72 @@ public:
      * @return The total number of Light objects in the Scene.
      */
     size_t getLightCount() const noexcept;
+
+    /*
+     * Spatial queries
+     *
+     * The following functions test the world-space bounding boxes of the Renderable objects of
+     * the Scene, as of the last frame it was rendered: Renderable objects added, moved or
+     * resized since aren't taken into account until the next frame. Large scenes use the
+     * same bounding volume hierarchy as the culling.
+     */
+
+    //! A ray hitting the bounding box of a Renderable, see raycast().
+    struct RaycastHit {
+        //! Renderable whose bounding box is hit first, null if there is none.
+        utils::Entity renderable;
+        //! Distance to the hit along the ray, in lengths of its direction, 0 from the inside.
+        float distance = 0.0f;
+    };
+
+    /**
+     * Finds the Renderable whose bounding box is hit first by a ray.
+     *
+     * @param origin        Origin of the ray, in world space.
+     * @param direction     Direction of the ray, in world space, it doesn't need to be normalized.
+     * @param maxDistance   Boxes further than this along the ray aren't hit, in lengths of
+     *                      \p direction.
+     * @return The Renderable hit and the distance to its box, a null Entity if no box is hit.
+     */
+    RaycastHit raycast(math::float3 const& origin, math::float3 const& direction,
+            float maxDistance) const noexcept;
+
+    /**
+     * Casts several rays, see raycast(). The rays are processed in parallel on the Engine's
+     * JobSystem, which makes this much faster than calling raycast() for each one.
+     *
+     * @param origins       Origins of the rays, in world space.
+     * @param directions    Directions of the rays, in world space.
+     * @param count         Number of rays.
+     * @param maxDistance   Boxes further than this along each ray aren't hit.
+     * @param hits          Receives the hit of each ray, \p count of them.
+     */
+    void raycast(math::float3 const* origins, math::float3 const* directions, size_t count,
+            float maxDistance, RaycastHit* hits) const noexcept;
+
+    /**
+     * Finds the Renderable objects whose bounding box overlaps a box.
+     *
+     * @param box       The box to test, in world space.
+     * @param entities  Receives the Renderable objects found, in no particular order, up to
+     *                  \p capacity of them. Can be nullptr if \p capacity is 0.
+     * @param capacity  Size of the \p entities array.
+     * @return The number of Renderable objects found, which can exceed \p capacity.
+     */
+    size_t queryBox(Box const& box, utils::Entity* entities, size_t capacity) const noexcept;
+
+    /**
+     * Finds the Renderable objects whose bounding box intersects a frustum.
+     *
+     * @param frustum   The frustum to test, in world space, e.g. built from the projection and
+     *                  view matrices of a Camera.
+     * @param entities  Receives the Renderable objects found, in no particular order, up to
+     *                  \p capacity of them. Can be nullptr if \p capacity is 0.
+     * @param capacity  Size of the \p entities array.
+     * @return The number of Renderable objects found, which can exceed \p capacity.
+     */
+    size_t queryFrustum(Frustum const& frustum, utils::Entity* entities,
+            size_t capacity) const noexcept;
 };
 
 } // namespace filament
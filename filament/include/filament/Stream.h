@@ -36,7 +36,14 @@ class UTILS_PUBLIC Stream : public FilamentAPI {
     struct BuilderDetails;
 
 public:
-    //! Use Builder to construct an Stream object instance
+    using Callback = driver::StreamCallback;
+
+    /**
+     * Use Builder to construct an Stream object instance.
+     *
+     * When neither stream() is called, the Stream is an ACQUIRED stream: it samples the images
+     * pushed with setAcquiredImage(), e.g. the AHardwareBuffers of a camera feed.
+     */
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
     public:
@@ -110,6 +117,30 @@ public:
      */
     bool isNativeStream() const noexcept;
 
+    /**
+     * Indicates whether this stream is a native, copy (external texture id) or acquired stream.
+     */
+    driver::StreamType getStreamType() const noexcept;
+
+    /**
+     * Updates an ACQUIRED stream with an image that is guaranteed to be used in the next frame.
+     *
+     * This method doesn't block: the image is handed to the driver with the frame's commands
+     * and the GPU waits for acquireFence before sampling it. It is a no-op for other streams.
+     *
+     * @param image        Pointer to the image, on Android an AHardwareBuffer*. The image must
+     *                     stay valid until the callback is called.
+     * @param acquireFence Native fence signaled once the image can be read (on Android a sync
+     *                     file descriptor), or -1. The Stream takes ownership of the fence.
+     * @param callback     Called on the application thread, when the engine flushes its
+     *                     commands (e.g. in Renderer::endFrame()), once the image is no longer
+     *                     used by filament: it has been replaced by a newer one or the Stream
+     *                     was destroyed, and the GPU is done reading from it.
+     * @param userdata     Passed to the callback.
+     */
+    void setAcquiredImage(void* image, int acquireFence,
+            Callback callback, void* userdata) noexcept;
+
     /**
      * Updates the size of the incoming stream. Whether this value is used is
      *              stream dependent. On Android, it must be set when using
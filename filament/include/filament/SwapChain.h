@@ -48,6 +48,13 @@ namespace filament {
  *
  * Otherwise, the `nativeWindow` is defined by the concrete implementation of Platform.
  *
+ * A headless SwapChain, which renders offscreen and is never presented, can be created instead
+ * by giving its size:
+ *
+ * \code
+ * SwapChain* swapChain = engine->createSwapChain(width, height);
+ * \endcode
+ *
  *
  * Examples:
  *
@@ -153,6 +160,45 @@ public:
      */
     static const uint64_t CONFIG_READABLE = driver::SWAP_CHAIN_CONFIG_READABLE;
 
+    /**
+     * Frames are presented at the vertical blank, but a new frame replaces the one waiting for
+     * it instead of queuing behind it. This lowers the latency without tearing, at the cost of
+     * rendering frames that are never displayed.
+     *
+     * This is only supported by the Vulkan backend, the swap chain falls back to the default
+     * (queuing frames until the vertical blank) when the surface doesn't support it.
+     */
+    static const uint64_t CONFIG_PRESENT_MAILBOX = driver::SWAP_CHAIN_CONFIG_PRESENT_MAILBOX;
+
+    /**
+     * Frames are presented as soon as they're rendered, without waiting for the vertical blank,
+     * which can tear. Same support as CONFIG_PRESENT_MAILBOX.
+     */
+    static const uint64_t CONFIG_PRESENT_IMMEDIATE = driver::SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE;
+
+    /**
+     * Maximum value accepted by framesInFlight().
+     */
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 15;
+
+    /**
+     * Returns the flag setting how many frames rendered into the swap chain can be in flight on
+     * the GPU, i.e. its number of buffers. More frames in flight favor throughput, fewer favor
+     * latency: e.g. CONFIG_PRESENT_MAILBOX | framesInFlight(2) for low latency interactive
+     * rendering, and framesInFlight(3) for maximum throughput. The value passed to
+     * Renderer::setMaxFramesInFlight() shouldn't exceed it.
+     *
+     * This is only supported by the Vulkan backend, and bound by what the surface supports. By
+     * default, there are 2 frames in flight (3 with CONFIG_PRESENT_MAILBOX, 4 for headless swap
+     * chains).
+     *
+     * @param count Number of frames in flight, clamped to [1, MAX_FRAMES_IN_FLIGHT].
+     */
+    static constexpr uint64_t framesInFlight(uint32_t count) noexcept {
+        return uint64_t(count < 1 ? 1 : count > MAX_FRAMES_IN_FLIGHT ? MAX_FRAMES_IN_FLIGHT :
+                count) << driver::SWAP_CHAIN_CONFIG_FRAMES_IN_FLIGHT_SHIFT;
+    }
+
     void* getNativeWindow() const noexcept;
 };
 
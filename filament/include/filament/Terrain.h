@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file
+
+#ifndef TNT_FILAMENT_TERRAIN_H
+#define TNT_FILAMENT_TERRAIN_H
+
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FTerrain;
+} // namespace details
+
+class Camera;
+class Engine;
+class Material;
+class MaterialInstance;
+
+/**
+ * Terrain renders a heightfield with geometry clipmaps centered on the camera.
+ *
+ * The terrain is a set of nested square grids, the levels, each one twice as coarse as the
+ * previous one, and all drawn by a single instanced renderable. The vertex shaders displace the
+ * grids with the heights and normals of each level, which are kept in a texture array and
+ * updated incrementally, a few rows or columns at a time, as the camera moves.
+ *
+ * The renderable is culled, sorted and casts shadows like any other. The heightfield lies in
+ * the xz plane of the entity, y up, sample (0, 0) at the origin and rows along z.
+ */
+class UTILS_PUBLIC Terrain : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    //! Use Builder to construct a Terrain object instance
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * The heights of the terrain, mandatory. The samples are copied, the terrain extends
+         * past the edges of the heightfield with the heights of its edges.
+         *
+         * @param heights   width * height heights, row by row.
+         * @param width     Number of samples along x.
+         * @param height    Number of samples along z.
+         */
+        Builder& heightfield(float const* heights, uint32_t width, uint32_t height) noexcept;
+
+        //! Distance between two samples of the heightfield, 1 by default.
+        Builder& spacing(float spacing) noexcept;
+
+        //! Number of levels, 6 by default and MAX_LEVELS at most.
+        Builder& levels(uint8_t count) noexcept;
+
+        /**
+         * Number of samples along each side of the levels, a power of two between 32 and 512,
+         * 128 by default. Each level covers resolution - 2 times its spacing, which doubles from
+         * one level to the next.
+         */
+        Builder& resolution(uint32_t resolution) noexcept;
+
+        /**
+         * Material of the terrain, a built-in lit material by default. A custom material must
+         * have a vertex shader and parameters like the built-in one, see terrain.mat.
+         */
+        Builder& material(Material const* material) noexcept;
+
+        //! Whether the terrain casts shadows, true by default.
+        Builder& castShadows(bool enable) noexcept;
+
+        //! Whether the terrain receives shadows, true by default.
+        Builder& receiveShadows(bool enable) noexcept;
+
+        /**
+         * Creates the Terrain object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this Terrain with.
+         *
+         * @return pointer to the newly created object, or nullptr if it couldn't be created.
+         */
+        Terrain* build(Engine& engine);
+
+    private:
+        friend class details::FTerrain;
+    };
+
+    static constexpr uint8_t MAX_LEVELS = 10;
+
+    //! The entity of the renderable drawing the terrain.
+    utils::Entity getEntity() const noexcept;
+
+    /**
+     * The material instance of the renderable, owned by the Terrain. Its "baseColor" and
+     * "roughness" parameters can be changed, the others are set by update().
+     */
+    MaterialInstance* getMaterialInstance() noexcept;
+
+    /**
+     * Centers the levels on the camera, and uploads the heights and normals of the parts of
+     * the levels that moved.
+     *
+     * Must be called once per frame, before Renderer::render(). Nothing is drawn before the
+     * first call.
+     *
+     * @param engine Engine this Terrain was created with.
+     * @param camera Camera the levels are centered on.
+     */
+    void update(Engine& engine, Camera const& camera);
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_TERRAIN_H
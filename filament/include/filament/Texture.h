@@ -79,6 +79,30 @@ public:
     using FaceOffsets = driver::FaceOffsets;                        //!< Cube map faces offsets
     using Usage = driver::TextureUsage;                             //!< Usage affects texel layout
 
+    /**
+     * Called by the engine when a level of a streaming Texture becomes needed.
+     *
+     * @param texture   The streaming Texture.
+     * @param level     Level needed, always one finer than the finest level currently sampled.
+     * @param user      The user pointer given to Builder::streaming().
+     *
+     * The level must eventually be uploaded with setImage(), from within the callback or
+     * later. The callback isn't invoked again for this texture until it is.
+     *
+     * @see Builder::streaming()
+     */
+    using StreamingCallback = void(*)(Texture* texture, size_t level, void* user);
+
+    /**
+     * Called by the engine once the mipmap levels of a Texture have been generated.
+     *
+     * @param texture   The Texture given to generateMipmapsAsync().
+     * @param user      The user pointer given to generateMipmapsAsync().
+     *
+     * @see generateMipmapsAsync()
+     */
+    using MipmapsCallback = void(*)(Texture* texture, void* user);
+
     static bool isTextureFormatSupported(Engine& engine, InternalFormat format) noexcept;
 
     static size_t computeTextureDataSize(Texture::Format format, Texture::Type type,
@@ -111,7 +135,9 @@ public:
 
         /**
          * Specifies the depth in texels of the texture. Doesn't need to be a power-of-two.
-         * This creates a 3D textures.
+         * This creates a 3D textures. For driver::SamplerType::SAMPLER_2D_ARRAY textures, this
+         * is the number of layers of the array. The depth of driver::SamplerType::SAMPLER_3D
+         * textures shrinks with the mipmap levels, the number of layers of an array doesn't.
          * @param depth Depth of the texture in texels (default: 1).
          * @return This Builder, for chaining calls.
          */
@@ -127,9 +153,11 @@ public:
         Builder& levels(uint8_t levels) noexcept;
 
         /**
-         * Specifies whether this texture is a cubemap
-         * @param target either driver::SamplerType::SAMPLER_2D or
-         *                      driver::SamplerType::SAMPLER_CUBEMAP
+         * Specifies whether this texture is a cubemap, an array of 2D textures or a 3D texture
+         * @param target either driver::SamplerType::SAMPLER_2D,
+         *                      driver::SamplerType::SAMPLER_CUBEMAP,
+         *                      driver::SamplerType::SAMPLER_2D_ARRAY or
+         *                      driver::SamplerType::SAMPLER_3D
          * @return This Builder, for chaining calls.
          * @see Sampler
          */
@@ -169,6 +197,25 @@ public:
          */
         Builder& rgbm(bool enabled) noexcept;
 
+        /**
+         * Makes this texture a streaming texture. Its levels are sampled only once all the
+         * coarser levels have been uploaded, which lets the application upload only its
+         * coarsest levels at first. The finer levels are then requested through \p callback
+         * as the texture covers more pixels on screen, within the budget set by
+         * Engine::setTextureStreamingBudget().
+         *
+         * Streaming textures must be 2D, and are ignored by shadow passes. Where sparse
+         * textures are supported, only their resident levels use GPU memory, which requires
+         * the size of the texture to be a multiple of the GPU's page size (e.g. a power of 2
+         * of at least 256).
+         *
+         * @param callback  Called when a finer level is needed, nullptr disables streaming.
+         * @param user      User pointer given to \p callback.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& streaming(StreamingCallback callback, void* user = nullptr) noexcept;
+
         /**
          * Creates the Texture object and returns a pointer to it.
          *
@@ -208,7 +255,8 @@ public:
     /**
      * Returns the depth of a 3D texture level
      * @param level texture level.
-     * @return Depth in texel of the specified \p level, clamped to 1.
+     * @return Depth in texel of the specified \p level, clamped to 1. For
+     *         driver::SamplerType::SAMPLER_2D_ARRAY textures, the number of layers of all levels.
      * @attention If this texture is using driver::SamplerType::SAMPLER_EXTERNAL, the dimension
      * of the texture are unknown and this method always returns whatever was set on the Builder.
      */
@@ -292,6 +340,37 @@ public:
             uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             PixelBufferDescriptor&& buffer) const noexcept;
 
+    /**
+     * Updates layers of a 2D texture array for a level.
+     *
+     * Sharing a texture array between materials lets renderables select their layer with
+     * RenderableManager::setTextureLayer() rather than binding a different texture, so that
+     * these renderables can share a MaterialInstance and their draws don't rebind samplers.
+     *
+     * @param engine    Engine this texture is associated to.
+     * @param level     Level to set the image for.
+     * @param xoffset   Left offset of the sub-region to update.
+     * @param yoffset   Bottom offset of the sub-region to update.
+     * @param zoffset   First layer to update.
+     * @param width     Width of the sub-region to update.
+     * @param height    Height of the sub-region to update.
+     * @param depth     Number of layers, or of slices of a 3D texture, to update.
+     * @param buffer    Client-side buffer containing the images to set, one layer after the
+     *                  other.
+     *
+     * @attention \p engine must be the instance passed to Builder::build()
+     * @attention \p level must be less than getLevels().
+     * @attention \p buffer's driver::PixelDataFormat must match that of getFormat().
+     * @attention This Texture instance must use driver::SamplerType::SAMPLER_2D_ARRAY or
+     *            driver::SamplerType::SAMPLER_3D or it has no effect.
+     *
+     * @see Builder::sampler(), Builder::depth()
+     */
+    void setImage(Engine& engine, size_t level,
+            uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+            uint32_t width, uint32_t height, uint32_t depth,
+            PixelBufferDescriptor&& buffer) const noexcept;
+
     /**
      * Specify all six images of a cube map level.
      *
@@ -363,6 +442,28 @@ public:
      * @attention This Texture instance must NOT use driver::SamplerType::SAMPLER_CUBEMAP or it has no effect
      */
     void generateMipmaps(Engine& engine) const noexcept;
+
+    /**
+     * Generates all the mipmap levels from level 0 on the GPU, each one from the level above
+     * with a tent filter, which aliases less than the box filter of generateMipmaps().
+     *
+     * The levels are rendered over the next frames, within a budget of texels per frame, and
+     * they're sampled as soon as they're complete. Calling this again before \p callback is
+     * invoked starts over, with the new callback.
+     *
+     * @param engine        Engine this texture is associated to.
+     * @param callback      Called once all the levels are generated, can be nullptr.
+     * @param user          User pointer given to \p callback.
+     *
+     * @return false if the levels of this texture can't be rendered, nothing is done then.
+     *
+     * @attention \p engine must be the instance passed to Builder::build()
+     * @attention This Texture instance must be 2D or a cubemap, use
+     *            Texture::Usage::COLOR_ATTACHMENT and a format that isn't compressed, and it
+     *            must not be a streaming texture
+     */
+    bool generateMipmapsAsync(Engine& engine,
+            MipmapsCallback callback = nullptr, void* user = nullptr) noexcept;
 };
 
 } // namespace filament
@@ -57,6 +57,16 @@ namespace filament {
  *  tcm.destroy(object);
  * ~~~~~~~~~~~
  *
+ * Large worlds
+ * ============
+ *
+ * Transforms are stored in single precision, which is only accurate to a few millimeters a few
+ * kilometers away from the origin. When accurate translations are enabled, the translations are
+ * kept with about double precision, they can be set with the math::mat4 versions of create() and
+ * setTransform(). Views then render their scene relative to a world origin that follows the
+ * camera, so that moving far away from the origin never requires re-setting the transforms.
+ *
+ * @see setAccurateTranslationsEnabled()
  */
 class UTILS_PUBLIC TransformManager : public FilamentAPI {
 public:
@@ -92,6 +102,12 @@ public:
      */
     void create(utils::Entity entity, Instance parent = {}, const math::mat4f& localTransform = {});
 
+    /**
+     * Creates a transform component with a double precision local transform.
+     * @see create(), setAccurateTranslationsEnabled()
+     */
+    void create(utils::Entity entity, Instance parent, const math::mat4& localTransform);
+
     /**
      * Destroys this component from the given entity, children are orphaned.
      * @param e An entity.
@@ -124,6 +140,28 @@ public:
      */
     void setTransform(Instance ci, const math::mat4f& localTransform) noexcept;
 
+    /**
+     * Set a double precision local transform of a transform component. Only the translation
+     * keeps its precision, and only when accurate translations are enabled, otherwise this is
+     * the same as setTransform(ci, math::mat4f(localTransform)).
+     * @param ci              The instance of the transform component to set the local transform to.
+     * @param localTransform  The local transform (i.e. relative to the parent).
+     * @see getTransformAccurate(), setAccurateTranslationsEnabled()
+     */
+    void setTransform(Instance ci, const math::mat4& localTransform) noexcept;
+
+    /**
+     * Sets the local transforms of several transform components at once, this behaves like
+     * calling setTransform() for each of them, in order.
+     * @param instances       Array of count instances of transform components.
+     * @param localTransforms Array of count local transforms, localTransforms[i] is set to
+     *                        instances[i].
+     * @param count           Number of transforms to set.
+     * @see setTransform()
+     */
+    void setTransforms(Instance const* instances, math::mat4f const* localTransforms,
+            size_t count) noexcept;
+
     /**
      * Returns the local transform of a transform component.
      * @param ci The instance of the transform component to query the local transform from.
@@ -143,6 +181,41 @@ public:
      */
     const math::mat4f& getWorldTransform(Instance ci) const noexcept;
 
+    /**
+     * Returns the local transform of a transform component, with the accurate translation.
+     * @see getTransform(), setAccurateTranslationsEnabled()
+     */
+    math::mat4 getTransformAccurate(Instance ci) const noexcept;
+
+    /**
+     * Returns the world transform of a transform component, with the accurate translation.
+     * @see getWorldTransform(), setAccurateTranslationsEnabled()
+     */
+    math::mat4 getWorldTransformAccurate(Instance ci) const noexcept;
+
+    /**
+     * Enables or disables accurate translations, they're disabled by default.
+     *
+     * When enabled, the translation of each transform is stored as the sum of two floats, which
+     * gives it about the precision of a double, and the world translations are composed in
+     * double precision. The float transforms returned by getTransform() and
+     * getWorldTransform() are the rounded values.
+     *
+     * Views render their scene around their camera when this is enabled, which keeps the
+     * rendering precise far away from the origin.
+     *
+     * @param enable  true to keep accurate translations. Transforms set before this is enabled
+     *                are not made more accurate, and disabling it drops the extra precision.
+     * @see setTransform(Instance, const math::mat4&)
+     */
+    void setAccurateTranslationsEnabled(bool enable) noexcept;
+
+    /**
+     * @return whether accurate translations are enabled.
+     * @see setAccurateTranslationsEnabled()
+     */
+    bool isAccurateTranslationsEnabled() const noexcept;
+
     /**
      * Opens a local transform transaction. During a transaction, getWorldTransform() can
      * return an invalid transform until commitLocalTransformTransaction() is called. However,
@@ -161,6 +234,10 @@ public:
      * Commits the currently open local transform transaction. When this returns, calls
      * to getWorldTransform() will return the proper value.
      *
+     * Only the world transforms of the components whose local transform changed during the
+     * transaction, and of their descendants, are updated. Independent hierarchies are updated
+     * on multiple threads when there are many of them.
+     *
      * @attention failing to call this method when done updating the local transform will cause
      *            a lot of rendering problems. The system never closes the transaction
      *            automatically.
@@ -39,6 +39,7 @@ class UTILS_PUBLIC VertexBuffer : public FilamentAPI {
 public:
     using AttributeType = driver::ElementType;
     using BufferDescriptor = driver::BufferDescriptor;
+    using BufferUsage = driver::BufferUsage;
 
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
@@ -53,6 +54,10 @@ public:
         Builder& vertexCount(uint32_t vertexCount) noexcept;
         Builder& bufferCount(uint8_t bufferCount) noexcept;
 
+        // how often the buffers are updated with setBufferAt(), STATIC by default. Geometry updated
+        // every frame (UI, particles) should use STREAM to avoid stalls.
+        Builder& bufferUsage(BufferUsage usage) noexcept;
+
         // no-op if attribute is an invalid enum
         // no-op if bufferIndex is out of bounds
         Builder& attribute(VertexAttribute attribute, uint8_t bufferIndex,
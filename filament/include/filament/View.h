@@ -27,6 +27,7 @@
 #include <filament/driver/DriverEnums.h>
 
 #include <utils/compiler.h>
+#include <utils/Entity.h>
 
 #include <math/vec2.h>
 #include <math/vec3.h>
@@ -35,6 +36,7 @@ namespace filament {
 
 class Camera;
 class MaterialInstance;
+class RenderTarget;
 class Scene;
 
 /**
@@ -114,12 +116,129 @@ public:
         uint8_t history = 9;                            //!< history size
         bool enabled = false;                           //!< enable or disable dynamic resolution
         bool homogeneousScaling = false;                //!< set to true to force homogeneous scaling
+        bool temporalUpsampling = false;                //!< upscale with temporal upsampling
+    };
+
+    /**
+     * Options to lower the shading rate away from a focal point, for instance the point the
+     * user looks at in a head-mounted display. The density of the shaded pixels is
+     *
+     *     1 / max(gain.x² (x - focalPoint.x)² + gain.y² (y - focalPoint.y)² - foveaArea, 1)
+     *
+     * where x and y are in normalized device coordinates of the viewport, [-1, 1]. In stereo
+     * each eye foveates around the focal point of its own half of the viewport.
+     *
+     * This works with the color pass of views with post-processing, on the OpenGL ES backend
+     * with GL_QCOM_texture_foveated, it's ignored elsewhere. It can be combined with
+     * DynamicResolutionOptions, which lowers the resolution uniformly.
+     */
+    struct FoveatedRenderingOptions {
+        math::float2 focalPoint = math::float2(0.0f);   //!< center of the fovea, in NDC
+        math::float2 gain = math::float2(2.0f);         //!< how fast the density falls off
+        float foveaArea = 0.0f;                         //!< area kept at full density
+        bool enabled = false;                           //!< enable or disable foveation
+    };
+
+    /**
+     * Options to grade the colors of the view before they're tone mapped. The grading is done
+     * in linear space, in this order: exposure, ASC CDL (slope, offset, power), contrast around
+     * middle gray and saturation:
+     *
+     *     color = pow(max(color * 2^exposure * slope + offset, 0), power)
+     *     color = 0.18 * pow(color / 0.18, contrast)
+     *     color = mix(luminance(color), color, saturation)
+     *
+     * The grading and the tone mapping are baked into a 3D lookup table, which is only
+     * rebuilt when these options change, each pixel then costs a single texture fetch. When
+     * disabled, the lookup table only does the tone mapping. This only applies to the views
+     * with post-processing.
+     */
+    struct ColorGradingOptions {
+        float exposure = 0.0f;                          //!< exposure compensation, in EV
+        math::float3 slope = math::float3(1.0f);        //!< ASC CDL slope, >= 0
+        math::float3 offset = math::float3(0.0f);       //!< ASC CDL offset
+        math::float3 power = math::float3(1.0f);        //!< ASC CDL power, > 0
+        float contrast = 1.0f;                          //!< contrast, > 0
+        float saturation = 1.0f;                        //!< saturation, 0 is grayscale
+        bool enabled = false;                           //!< enable or disable color grading
+    };
+
+    /**
+     * Options of the auto-exposure, which corrects the exposure of the camera so the geometric
+     * mean of the scene's luminance is rendered as middle gray (0.18). The luminance is
+     * metered and the exposure adapted on the GPU, there is no read-back, so the correction
+     * takes effect in the same frame. The correction adapts over time, faster when the scene
+     * gets brighter than when it gets darker by default, like the eye.
+     *
+     * The auto-exposure is applied on top of the camera's exposure, before the color grading.
+     * It is only available to the views with post-processing, and not with multi-sampling on
+     * the platforms that can't resolve it implicitly; it also disables the tone mapping in
+     * place of the color pass.
+     */
+    struct AutoExposureOptions {
+        math::float2 range = { -4.0f, 4.0f };   //!< min and max correction, in EV
+        float compensation = 0.0f;              //!< added to the correction, in EV
+        float adaptationRateUp = 1.5f;          //!< when the correction increases, per second
+        float adaptationRateDown = 3.0f;        //!< when the correction decreases, per second
+        bool enabled = false;                   //!< enable or disable the auto-exposure
+    };
+
+    /**
+     * Options controlling how the view frustum is divided into froxels (frustum voxels) for
+     * binning the point and spot lights.
+     *
+     * Fewer froxels make the binning cheaper but coarser, which means more lights evaluated
+     * per pixel. More slices improve the depth resolution at the expense of x-y resolution,
+     * since all slices share the same froxel budget.
+     *
+     * With depthBounds, the depth buffer of the previous frames is read back (like with
+     * occlusion culling) and each froxel only keeps the lights that reach the depth range of
+     * the geometry seen through it, which greatly reduces the lights evaluated per pixel in
+     * deep scenes. Like occlusion culling, this is only available with desktop OpenGL (not
+     * OpenGL ES), without MSAA and with post-processing enabled, and it is skipped while the
+     * camera moves quickly. A light may reach a disoccluded surface one frame late.
+     */
+    struct FroxelOptions {
+        uint16_t froxelCount = 8192;        //!< froxel budget, between sliceCount and 8192
+        uint8_t sliceCount = 16;            //!< slices between zLightNear and zLightFar, [2, 64]
+        uint8_t maxLightsPerFroxel = 255;   //!< lights kept per froxel, the others are dropped
+        bool depthBounds = false;           //!< cull lights with the depth of previous frames
+    };
+
+    /**
+     * Froxelization results of the last frame, useful to tune FroxelOptions.
+     */
+    struct FroxelStatistics {
+        uint32_t froxelCount = 0;           //!< froxels in use for the current viewport
+        uint32_t recordCount = 0;           //!< light records used, out of 65536
+        uint32_t truncatedFroxelCount = 0;  //!< froxels that had lights over maxLightsPerFroxel
+        uint32_t overflowFroxelCount = 0;   //!< froxels left without lights, records ran out
+    };
+
+    /**
+     * Culling and draw call counts of the last frame rendered with a view.
+     */
+    struct RenderStatistics {
+        uint32_t renderableCount = 0;           //!< renderables in the scene
+        uint32_t visibleRenderableCount = 0;    //!< renderables left after culling
+        uint32_t visibleShadowCasterCount = 0;  //!< shadow casters left after culling
+        uint32_t colorDrawCount = 0;            //!< draw calls of the depth and color passes
+        uint32_t shadowDrawCount = 0;           //!< draw calls of the shadow passes
+    };
+
+    /**
+     * How the shadows of the directional light are filtered.
+     */
+    enum class ShadowType : uint8_t {
+        PCF,    //!< percentage-closer filtering of the shadow map's depth
+        VSM,    //!< exponential variance shadows, prefiltered with a separable blur
     };
 
     enum class DepthPrepass : int8_t {
         DEFAULT = -1,
         DISABLED,
         ENABLED,
+        AUTOMATIC,
     };
 
     /**
@@ -135,12 +254,49 @@ public:
      *
      * The best strategy may depend on the scene and/or GPU.
      *
+     * With DepthPrepass::AUTOMATIC, the renderer periodically renders a few frames with the
+     * other strategy and keeps the one with the lowest GPU time for the color pass. When the
+     * depth pre-pass is used, only large occluders and objects with expensive materials are
+     * drawn in it. This requires the driver to measure GPU times and otherwise behaves like
+     * DepthPrepass::DEFAULT.
+     *
      * @param prepass   DepthPrepass::DEFAULT uses the most appropriate strategy,
      *                  DepthPrepass::DISABLED disables the depth pre-pass,
-     *                  DepthPrepass::ENABLE enables the depth pre-pass.
+     *                  DepthPrepass::ENABLE enables the depth pre-pass,
+     *                  DepthPrepass::AUTOMATIC selects the depth pre-pass from GPU timings.
      */
     void setDepthPrepass(DepthPrepass prepass) noexcept;
 
+    enum class SortPolicy : uint8_t {
+        DEFAULT,
+        FRONT_TO_BACK,
+        STATE_FIRST,
+    };
+
+    /**
+     * Sets how the opaque objects of this view are ordered when they're drawn.
+     *
+     * By default, the objects drawn in the depth pre-pass are then sorted to minimize state
+     * changes, and the other ones are bucketed by distance, front to back, then sorted to
+     * minimize state changes in each bucket.
+     *
+     * SortPolicy::FRONT_TO_BACK sorts all the opaque objects strictly front to back, which
+     * rejects the most occluded pixels with the early depth test but changes the material and
+     * program more often; it suits fill-bound scenes without a depth pre-pass.
+     * SortPolicy::STATE_FIRST sorts them by program and material only, which minimizes the
+     * state changes but increases the overdraw; it suits scenes bound by the CPU or the driver.
+     *
+     * In all cases, the renderables are first ordered by their priority, then by their sort key
+     * (see RenderableManager::Builder::sortKey()). Blended objects are always sorted back to
+     * front.
+     *
+     * @param policy    SortPolicy::DEFAULT, SortPolicy::FRONT_TO_BACK or SortPolicy::STATE_FIRST.
+     */
+    void setSortPolicy(SortPolicy policy) noexcept;
+
+    //! Returns the sort policy of the opaque objects, see setSortPolicy().
+    SortPolicy getSortPolicy() const noexcept;
+
     /**
      * Sets the View's name. Only useful for debugging.
      * @param name Pointer to the View's name. The string is copied.
@@ -212,6 +368,31 @@ public:
         return const_cast<View*>(this)->getCamera();
     }
 
+    /**
+     * Renders this View in stereo, with one Camera per eye.
+     *
+     * The scene is culled, its shadows and lights are prepared, and its draw commands are
+     * generated and sorted once per frame, with the View's Camera. The same commands are then
+     * drawn for each eye: the left eye in the left half of the viewport, the right eye in the
+     * right half.
+     *
+     * @param left      Camera of the left eye, or nullptr to render in mono.
+     * @param right     Camera of the right eye, or nullptr to render in mono.
+     *
+     * @attention The View's Camera must see everything either eye sees. For example, it can be
+     *            placed between the eyes, with a projection enclosing both of their frusta.
+     *            The lights are assigned to the froxels of the View's Camera, so the eyes'
+     *            projections should match it.
+     *
+     * @note Order-independent transparency is not available in stereo.
+     *
+     * @see setCamera()
+     */
+    void setStereoscopicCameras(Camera* left, Camera* right) noexcept;
+
+    //! Returns whether this View renders in stereo, see setStereoscopicCameras()
+    bool isStereoscopic() const noexcept;
+
     /**
      * Set this View Viewport.
      *
@@ -290,6 +471,22 @@ public:
      */
     void setShadowsEnabled(bool enabled) noexcept;
 
+    /**
+     * Sets how the shadows of the directional light are filtered. ShadowType::PCF by default.
+     *
+     * With ShadowType::VSM, the shadow map's depth is converted into exponential moments, which
+     * are blurred by a separable filter once per frame. Soft shadows are then obtained with a
+     * single filtered texture fetch per pixel instead of the several comparisons of PCF, at the
+     * cost of two RGBA16F textures of the size of the shadow map and of some light bleeding
+     * where the casters overlap. The spot lights' shadows always use PCF.
+     *
+     * @param type the shadow filtering method of this view.
+     */
+    void setShadowType(ShadowType type) noexcept;
+
+    //! Returns how the shadows of the directional light are filtered.
+    ShadowType getShadowType() const noexcept;
+
     /**
      * Specifies which buffers can be discarded before rendering.
      *
@@ -301,11 +498,33 @@ public:
      *
      * @param discard Buffers that need to be discarded before rendering.
      *
-     * @note
-     * In the future this API will also allow to set the render target.
+     * @see setRenderTarget(RenderTarget*, TargetBufferFlags)
      */
     void setRenderTarget(TargetBufferFlags discard = TargetBufferFlags::ALL) noexcept;
 
+    /**
+     * Sets the RenderTarget this View renders into, instead of the SwapChain of the Renderer.
+     *
+     * The textures of the RenderTarget can be sampled by the materials of the Views rendered
+     * after this one in the same frame (e.g. a mirror or an in-world screen), they're used
+     * directly without any copy. The viewport of this View is relative to the RenderTarget.
+     *
+     * @param renderTarget The RenderTarget to render into, or nullptr to render into the
+     *                     SwapChain again. It's not owned by the View and must outlive it, or be
+     *                     removed first.
+     * @param discard Buffers that need to be discarded before rendering.
+     *
+     * @note The materials of this View must not sample the textures of its own RenderTarget.
+     */
+    void setRenderTarget(RenderTarget* renderTarget,
+            TargetBufferFlags discard = TargetBufferFlags::ALL) noexcept;
+
+    /**
+     * Returns the RenderTarget set with setRenderTarget(RenderTarget*, TargetBufferFlags), or
+     * nullptr when this View renders into the SwapChain.
+     */
+    RenderTarget* getRenderTarget() const noexcept;
+
     /**
      * Sets how many samples are to be used for MSAA. Default is 1.
      *
@@ -347,6 +566,10 @@ public:
      * Sets the dynamic resolution options for this view. Dynamic resolution options
      * controls whether dynamic resolution is enabled, and if it is, how it behaves.
      *
+     * With temporalUpsampling, the view is rendered with a different sub-pixel offset each
+     * frame and the frames are accumulated at full resolution, instead of being stretched.
+     * This looks much better at low scales, at the cost of some ghosting on moving objects.
+     *
      * @param options The dynamic resolution options to use on this view
      */
     void setDynamicResolutionOptions(DynamicResolutionOptions const& options) noexcept;
@@ -357,6 +580,49 @@ public:
      */
     DynamicResolutionOptions getDynamicResolutionOptions() const noexcept;
 
+    /**
+     * Sets the foveated rendering options for this view. The focal point can be updated every
+     * frame, for instance with the gaze of an eye tracker.
+     *
+     * @param options The foveated rendering options to use on this view
+     */
+    void setFoveatedRenderingOptions(FoveatedRenderingOptions const& options) noexcept;
+
+    /**
+     * Returns the foveated rendering options associated with this view, after clamping.
+     * @return value set by setFoveatedRenderingOptions().
+     */
+    FoveatedRenderingOptions getFoveatedRenderingOptions() const noexcept;
+
+    /**
+     * Sets the color grading options for this view. Changing them rebuilds the lookup table
+     * of the view on the CPU during the next frame, they're not meant to be animated every
+     * frame.
+     *
+     * @param options The color grading options to use on this view
+     */
+    void setColorGradingOptions(ColorGradingOptions const& options) noexcept;
+
+    /**
+     * Returns the color grading options associated with this view, after clamping.
+     * @return value set by setColorGradingOptions().
+     */
+    ColorGradingOptions getColorGradingOptions() const noexcept;
+
+    /**
+     * Sets the auto-exposure options for this view. Enabling the auto-exposure starts without
+     * history, the first frame uses the correction of the scene right away.
+     *
+     * @param options The auto-exposure options to use on this view
+     */
+    void setAutoExposureOptions(AutoExposureOptions const& options) noexcept;
+
+    /**
+     * Returns the auto-exposure options associated with this view, after clamping.
+     * @return value set by setAutoExposureOptions().
+     */
+    AutoExposureOptions getAutoExposureOptions() const noexcept;
+
     /**
      * Sets options relative to dynamic lighting for this view.
      *
@@ -379,6 +645,34 @@ public:
      */
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
 
+    /**
+     * Sets how the frustum of this view is divided into froxels for dynamic lighting.
+     *
+     * The values are clamped to the supported ranges. Changing the options causes all lights
+     * to be binned again on the next frame.
+     *
+     * @param options The froxel options to use on this view
+     */
+    void setFroxelOptions(FroxelOptions const& options) noexcept;
+
+    /**
+     * Returns the froxel options associated with this view, after clamping.
+     * @return value set by setFroxelOptions().
+     */
+    FroxelOptions getFroxelOptions() const noexcept;
+
+    /**
+     * Returns statistics about the froxelization of the last frame rendered with this view.
+     * Non-zero truncatedFroxelCount or overflowFroxelCount mean that some lights were not
+     * applied where they should have been.
+     */
+    FroxelStatistics getFroxelStatistics() const noexcept;
+
+    /**
+     * Returns the culling and draw call counts of the last frame rendered with this view.
+     */
+    RenderStatistics getRenderStatistics() const noexcept;
+
     /**
      * Enable or disable post processing. Enabled by default.
      *
@@ -397,6 +691,84 @@ public:
 
     bool isPostProcessingEnabled() const noexcept;
 
+    /**
+     * Enable or disable occlusion culling. Disabled by default.
+     *
+     * When enabled, the depth buffer of each frame is read back and renderables entirely hidden
+     * behind it are skipped in the following frames. Because the depth buffer is always at
+     * least one frame old, an object can appear one frame late after being disoccluded; the
+     * depth buffer is ignored when the camera moves or rotates quickly.
+     *
+     * This is useful for scenes with a lot of occluders, e.g. indoor scenes, and currently
+     * requires desktop OpenGL, post-processing enabled and no MSAA. OpenGL ES can't read back
+     * depth buffers: nothing is culled there, and the Renderer logs a warning.
+     *
+     * @param enabled true enables occlusion culling, false disables it.
+     */
+    void setOcclusionCulling(bool enabled) noexcept;
+
+    //! Returns whether occlusion culling is enabled.
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Enable or disable the order-independent transparency. Disabled by default.
+     *
+     * When enabled, the objects with a TRANSPARENT or FADE blending mode aren't sorted: they're
+     * accumulated in a target of their own with weights based on their depth, and composed over
+     * the opaque objects once all of them are drawn. This avoids the popping and the artifacts
+     * of intersecting transparent objects, at the cost of an approximate result when several
+     * opaque-looking layers overlap. Objects with an ADD blending mode are still sorted, and the
+     * blend orders of the transparent objects are ignored.
+     *
+     * This requires post-processing and a backend supporting multiple render targets (currently
+     * OpenGL), the transparent objects are sorted as usual otherwise.
+     *
+     * @param enabled true enables the order-independent transparency, false disables it.
+     */
+    void setOrderIndependentTransparency(bool enabled) noexcept;
+
+    //! Returns whether the order-independent transparency is enabled.
+    bool isOrderIndependentTransparencyEnabled() const noexcept;
+
+    //! Result of a picking query, see pick().
+    struct PickingQueryResult {
+        //! Closest renderable at the pixel, null if there is none.
+        utils::Entity renderable;
+        //! Window-space depth of the renderable at the pixel, in [0, 1], 1 if there is none.
+        float depth = 1.0f;
+    };
+
+    /**
+     * Called once with the result of a picking query.
+     *
+     * @param result    The renderable found at the pixel.
+     * @param user      The user pointer given to pick().
+     */
+    using PickingQueryResultCallback = void(*)(PickingQueryResult const& result, void* user);
+
+    /**
+     * Queries the renderable visible at a pixel of this View.
+     *
+     * The query is served by the next frame rendering this View: the renderables whose bounding
+     * box covers the pixel are drawn into a few depth texels of their own, which are read back
+     * asynchronously, so that the GPU is never waited on. The callback is called on the thread
+     * of the Engine a few frames later, when the buffers the GPU is done with are released, and
+     * reports the renderable of that frame.
+     *
+     * Only the renderables writing depth can be picked, and at most the 16 closest to the
+     * camera are tested per query. This currently requires desktop OpenGL, which can read back
+     * depth buffers, the other backends (including OpenGL ES) report no renderable.
+     *
+     * @param x         Horizontal coordinate of the pixel, in pixels from the left of the
+     *                  viewport.
+     * @param y         Vertical coordinate of the pixel, in pixels from the bottom of the
+     *                  viewport.
+     * @param callback  Called with the result of the query.
+     * @param user      Passed to the callback.
+     */
+    void pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback,
+            void* user = nullptr) noexcept;
+
     // for debugging...
 
     //! debugging: allows to entirely disable culling. (culling enabled by default).
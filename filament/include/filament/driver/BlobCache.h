@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_BLOBCACHE_H
+#define TNT_FILAMENT_DRIVER_BLOBCACHE_H
+
+#include <utils/compiler.h>
+
+#include <stddef.h>
+
+namespace filament {
+namespace driver {
+
+/**
+ * A key-value store provided by the application, where the backend saves the data that's
+ * expensive to create (e.g. compiled shader programs) to get it back in later runs. This is
+ * typically backed by a file, but the Engine doesn't care how or for how long blobs are kept.
+ *
+ * Keys are opaque and already include everything the data depends on (e.g. the driver version),
+ * so stale blobs are never looked up.
+ *
+ * Both methods are called from filament's render thread.
+ */
+class UTILS_PUBLIC BlobCache {
+public:
+    virtual ~BlobCache() noexcept;
+
+    /**
+     * Looks up the blob associated with a key.
+     *
+     * @param key       The key of the blob.
+     * @param keySize   Size of the key in bytes.
+     * @param value     Where to copy the blob, ignored if valueSize is too small for it.
+     * @param valueSize Size of the buffer pointed to by value, can be 0 to query the blob's size.
+     *
+     * @return The size of the blob in bytes, or 0 if there is no blob for this key.
+     */
+    virtual size_t get(void const* key, size_t keySize, void* value, size_t valueSize) noexcept = 0;
+
+    /**
+     * Associates a blob with a key, replacing the previous blob if any. The data is only valid
+     * for the duration of the call.
+     *
+     * @param key       The key of the blob.
+     * @param keySize   Size of the key in bytes.
+     * @param value     The blob's content.
+     * @param valueSize Size of the blob in bytes.
+     */
+    virtual void put(void const* key, size_t keySize,
+            void const* value, size_t valueSize) noexcept = 0;
+};
+
+} // namespace driver
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_BLOBCACHE_H
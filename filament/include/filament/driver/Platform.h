@@ -26,6 +26,7 @@ namespace details {
 class FEngine;
 }
 
+class CommandTraceReplayer;
 class Driver;
 
 namespace driver {
@@ -51,6 +52,7 @@ protected:
 
 private:
     friend class details::FEngine;
+    friend class filament::CommandTraceReplayer;
     static Platform* create(driver::Backend* backendHint) noexcept;
     static void destroy(Platform** context) noexcept;
 };
@@ -64,6 +66,12 @@ public:
     virtual void terminate() noexcept = 0;
 
     virtual SwapChain* createSwapChain(void* nativeWindow, uint64_t& flags) noexcept = 0;
+
+    // Creates an offscreen swap chain of the given size, not tied to any window (e.g. a
+    // pbuffer). Returns null if the platform doesn't support headless rendering.
+    virtual SwapChain* createSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept = 0;
+
     virtual void destroySwapChain(SwapChain* swapChain) noexcept = 0;
 
     // Called to make the OpenGL context active on the calling thread.
@@ -80,6 +88,12 @@ public:
     virtual void destroyFence(Fence* fence) noexcept = 0;
     virtual driver::FenceStatus waitFence(Fence* fence, uint64_t timeout) noexcept = 0;
 
+    // Native fences can be exported as a file descriptor that polls readable once the fence
+    // signals (e.g. a sync file on Android). dupNativeFence() is called on the driver thread,
+    // after createFence(), it returns a new file descriptor or -1.
+    virtual bool canCreateNativeFence() noexcept { return false; }
+    virtual int dupNativeFence(Fence* fence) noexcept { return -1; }
+
     // this is called synchronously in the application thread (NOT the Driver thread)
     virtual Stream* createStream(void* nativeStream) noexcept = 0;
 
@@ -100,6 +114,26 @@ public:
             uint32_t w, uint32_t h, TextureFormat format) noexcept = 0;
 
     virtual void destroyExternalTextureStorage(ExternalTexture* ets) noexcept = 0;
+
+    // acquired images, these are called on the driver thread
+    // Wraps an image acquired by the application (e.g. an AHardwareBuffer on Android) into an
+    // image that can be used with glEGLImageTargetTexture2DOES(). Returns null if the image
+    // is not supported.
+    virtual void* createExternalImage(void* image) noexcept { return nullptr; }
+    virtual void destroyExternalImage(void* externalImage) noexcept { }
+
+    // Makes the GPU commands issued next wait for a native fence (e.g. a sync file descriptor
+    // on Android), ideally without blocking the CPU. Takes ownership of the fence.
+    virtual void waitNativeFence(int fence) noexcept { }
+
+    // Creates a second context, which shares its objects with the driver's and is used to
+    // upload the large textures and buffers on a thread of the driver's. This is called on
+    // the driver thread, the large uploads are done on it if this returns false.
+    virtual bool createUploadContext() noexcept { return false; }
+
+    // these are called on the upload thread, after createUploadContext() succeeded
+    virtual void makeUploadContextCurrent() noexcept { }
+    virtual void destroyUploadContext() noexcept { }
 };
 
 class UTILS_PUBLIC VulkanPlatform : public Platform {
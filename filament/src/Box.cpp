@@ -21,8 +21,10 @@ using namespace math;
 namespace filament {
 
 Box rigidTransform(Box const& UTILS_RESTRICT box, const math::mat4f& UTILS_RESTRICT m) noexcept {
-    const mat3f u(m.upperLeft());
-    return { u * box.center + m[3].xyz, abs(u) * box.halfExtent };
+    // the 4x4 products are vectorized, see math/mat4.h, w is ignored
+    const float4 center = m * float4{ box.center, 1.0f };
+    const float4 halfExtent = abs(m) * float4{ box.halfExtent, 0.0f };
+    return { center.xyz, halfExtent.xyz };
 }
 
 Box rigidTransform(Box const& UTILS_RESTRICT box, const math::mat3f& UTILS_RESTRICT u) noexcept {
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/Bvh.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <assert.h>
+#include <math.h>
+
+using namespace math;
+
+namespace filament {
+namespace details {
+
+void Bvh::build(float3 const* center, float3 const* extent, size_t count) {
+    SYSTRACE_CALL();
+
+    clear();
+    if (!count) {
+        return;
+    }
+
+    mBoxes.resize(count);
+    mSlots.resize(count);
+    mLeaves.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        mBoxes[i] = { center[i] - extent[i], center[i] + extent[i] };
+        mSlots[i] = uint32_t(i);
+    }
+
+    // build top-down, splitting each node in two halves along the largest axis of its
+    // centers' bounds. Children are always appended, so they come after their parent.
+    mNodes.reserve(2 * (count + LEAF_SIZE - 1) / LEAF_SIZE);
+    mNodes.push_back({ {}, 0, 0, uint32_t(count), 0 });
+    for (uint32_t n = 0; n < mNodes.size(); n++) {
+        const uint32_t first = mNodes[n].first;
+        const uint32_t c = mNodes[n].count;
+        if (c <= LEAF_SIZE) {
+            for (uint32_t i = first; i < first + c; i++) {
+                mLeaves[mSlots[i]] = n;
+            }
+            continue;
+        }
+
+        Bounds centers = { float3{ INFINITY }, float3{ -INFINITY } };
+        for (uint32_t i = first; i < first + c; i++) {
+            Bounds const& b = mBoxes[mSlots[i]];
+            const float3 ci = (b.min + b.max) * 0.5f;
+            centers.min = min(centers.min, ci);
+            centers.max = max(centers.max, ci);
+        }
+        const float3 size = centers.max - centers.min;
+        const size_t axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+
+        const uint32_t half = c / 2;
+        uint32_t* const slots = mSlots.data() + first;
+        std::nth_element(slots, slots + half, slots + c,
+                [this, axis](uint32_t lhs, uint32_t rhs) {
+                    Bounds const& l = mBoxes[lhs];
+                    Bounds const& r = mBoxes[rhs];
+                    return (l.min[axis] + l.max[axis]) < (r.min[axis] + r.max[axis]);
+                });
+
+        const uint32_t child = uint32_t(mNodes.size());
+        mNodes[n].child = child;
+        mNodes.push_back({ {}, 0, first, half, n });
+        mNodes.push_back({ {}, 0, first + half, c - half, n });
+    }
+
+    // finally compute all the bounds, children first
+    for (size_t n = mNodes.size(); n-- > 0;) {
+        Node& node = mNodes[n];
+        node.bounds = node.child ?
+                merge(mNodes[node.child].bounds, mNodes[node.child + 1].bounds) :
+                computeLeafBounds(node);
+    }
+
+    mDirty.resize(mNodes.size(), 0);
+}
+
+void Bvh::clear() noexcept {
+    mNodes.clear();
+    mSlots.clear();
+    mBoxes.clear();
+    mLeaves.clear();
+    mDirty.clear();
+    mHasDirtyNodes = false;
+}
+
+void Bvh::update(uint32_t slot, float3 const& center, float3 const& extent) noexcept {
+    assert(slot < mBoxes.size());
+    mBoxes[slot] = { center - extent, center + extent };
+    mDirty[mLeaves[slot]] = 1;
+    mHasDirtyNodes = true;
+}
+
+void Bvh::refit() noexcept {
+    if (!mHasDirtyNodes) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // children are always stored after their parent, so going backward guarantees that
+    // a node is refit after all its children.
+    uint8_t* const UTILS_RESTRICT dirty = mDirty.data();
+    for (size_t n = mNodes.size(); n-- > 0;) {
+        if (!dirty[n]) {
+            continue;
+        }
+        dirty[n] = 0;
+        Node& node = mNodes[n];
+        node.bounds = node.child ?
+                merge(mNodes[node.child].bounds, mNodes[node.child + 1].bounds) :
+                computeLeafBounds(node);
+        if (n) {
+            dirty[node.parent] = 1;
+        }
+    }
+    mHasDirtyNodes = false;
+}
+
+Bvh::Bounds Bvh::computeLeafBounds(Node const& node) const noexcept {
+    Bounds bounds = mBoxes[mSlots[node.first]];
+    for (uint32_t i = node.first + 1, e = node.first + node.count; i < e; i++) {
+        bounds = merge(bounds, mBoxes[mSlots[i]]);
+    }
+    return bounds;
+}
+
+Bvh::Bounds Bvh::merge(Bounds const& lhs, Bounds const& rhs) noexcept {
+    return { min(lhs.min, rhs.min), max(lhs.max, rhs.max) };
+}
+
+Bvh::Classification Bvh::classify(float4 const* planes, Bounds const& b) noexcept {
+    // this uses the same convention as Culler::intersects(): the box is visible if its
+    // nearest point to each plane is on the negative side of that plane.
+    const float3 center = (b.min + b.max) * 0.5f;
+    const float3 extent = (b.max - b.min) * 0.5f;
+    bool inside = true;
+    for (size_t j = 0; j < 6; j++) {
+        const float d = dot(planes[j].xyz, center) + planes[j].w;
+        const float r = dot(abs(planes[j].xyz), extent);
+        if (d - r >= 0) {
+            return Classification::OUTSIDE;
+        }
+        inside &= d + r < 0;
+    }
+    return inside ? Classification::INSIDE : Classification::INTERSECTS;
+}
+
+} // namespace details
+} // namespace filament
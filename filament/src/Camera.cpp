@@ -167,6 +167,11 @@ void UTILS_NOINLINE FCamera::setModelMatrix(const mat4f& modelMatrix) noexcept {
     transformManager.setTransform(transformManager.getInstance(mEntity), modelMatrix);
 }
 
+void UTILS_NOINLINE FCamera::setModelMatrix(const mat4& modelMatrix) noexcept {
+    FTransformManager& transformManager = mEngine.getTransformManager();
+    transformManager.setTransform(transformManager.getInstance(mEntity), modelMatrix);
+}
+
 void FCamera::lookAt(const float3& eye, const float3& center, const float3& up) noexcept {
     setModelMatrix(mat4f::lookAt(eye, center, up));
 }
@@ -176,6 +181,11 @@ mat4f const& FCamera::getModelMatrix() const noexcept {
     return transformManager.getWorldTransform(transformManager.getInstance(mEntity));
 }
 
+mat4 FCamera::getModelMatrixAccurate() const noexcept {
+    FTransformManager const& transformManager = mEngine.getTransformManager();
+    return transformManager.getWorldTransformAccurate(transformManager.getInstance(mEntity));
+}
+
 mat4f UTILS_NOINLINE FCamera::getViewMatrix() const noexcept {
     return FCamera::getViewMatrix(getModelMatrix());
 }
@@ -293,6 +303,10 @@ void Camera::setModelMatrix(const math::mat4f& modelMatrix) noexcept {
     upcast(this)->setModelMatrix(modelMatrix);
 }
 
+void Camera::setModelMatrix(const math::mat4& modelMatrix) noexcept {
+    upcast(this)->setModelMatrix(modelMatrix);
+}
+
 void Camera::lookAt(const math::float3& eye, const math::float3& center, float3 const& up) noexcept {
     upcast(this)->lookAt(eye, center, up);
 }
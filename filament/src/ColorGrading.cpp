@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColorGrading.h"
+
+#include "driver/DriverApi.h"
+
+#include <filament/driver/PixelBufferDescriptor.h>
+
+#include <math/half.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace filament {
+
+using namespace driver;
+using namespace math;
+
+static float3 pow(float3 v, float3 e) noexcept {
+    return { powf(v.x, e.x), powf(v.y, e.y), powf(v.z, e.z) };
+}
+
+static float3 tonemapACES(float3 x) noexcept {
+    // Narkowicz 2015, "ACES Filmic Tone Mapping Curve", same as Tonemap_ACES()
+    constexpr float a = 2.51f;
+    constexpr float b = 0.03f;
+    constexpr float c = 2.43f;
+    constexpr float d = 0.59f;
+    constexpr float e = 0.14f;
+    return (x * (a * x + b)) / (x * (c * x + d) + e);
+}
+
+static float OECF_sRGB(float linear) noexcept {
+    // IEC 61966-2-1:1999, same as OECF_sRGB() in conversion_functions.fs
+    const float sRGBLow = linear * 12.92f;
+    const float sRGBHigh = powf(linear, 1.0f / 2.4f) * 1.055f - 0.055f;
+    return linear <= 0.0031308f ? sRGBLow : sRGBHigh;
+}
+
+static bool operator==(View::ColorGradingOptions const& lhs,
+        View::ColorGradingOptions const& rhs) noexcept {
+    return lhs.exposure == rhs.exposure &&
+           lhs.slope == rhs.slope && lhs.offset == rhs.offset && lhs.power == rhs.power &&
+           lhs.contrast == rhs.contrast && lhs.saturation == rhs.saturation &&
+           lhs.enabled == rhs.enabled;
+}
+
+void ColorGrading::setOptions(View::ColorGradingOptions const& options) noexcept {
+    View::ColorGradingOptions clamped = options;
+    clamped.slope = max(options.slope, float3(0.0f));
+    clamped.power = max(options.power, float3(1e-3f));
+    clamped.contrast = std::max(options.contrast, 1e-3f);
+    clamped.saturation = std::max(options.saturation, 0.0f);
+    if (!(clamped == mOptions)) {
+        mOptions = clamped;
+        mDirty = true;
+    }
+}
+
+float3 ColorGrading::evaluate(View::ColorGradingOptions const& options, float3 linear) noexcept {
+    float3 c = linear;
+    if (options.enabled) {
+        c *= exp2f(options.exposure);
+        c = pow(max(c * options.slope + options.offset, float3(0.0f)), options.power);
+        constexpr float middleGray = 0.18f;
+        c = middleGray * pow(c / middleGray, float3(options.contrast));
+        const float luminance = dot(c, float3{ 0.2126f, 0.7152f, 0.0722f });
+        c = max(luminance + (c - luminance) * options.saturation, float3(0.0f));
+    }
+    c = saturate(tonemapACES(c));
+    return { OECF_sRGB(c.r), OECF_sRGB(c.g), OECF_sRGB(c.b) };
+}
+
+Handle<HwTexture> ColorGrading::update(DriverApi& driver) {
+    if (!mLut) {
+        mLut = driver.createTexture(SamplerType::SAMPLER_3D, 1, TextureFormat::RGBA16F, 1,
+                LUT_SIZE, LUT_SIZE, LUT_SIZE, TextureUsage::DEFAULT);
+    }
+    if (!mDirty) {
+        return mLut;
+    }
+    mDirty = false;
+
+    // the texels are at the log2 of the linear colors, the first one is black
+    float decode[LUT_SIZE];
+    decode[0] = 0.0f;
+    for (size_t i = 1; i < LUT_SIZE; i++) {
+        decode[i] = exp2f(LOG2_MIN + (LOG2_MAX - LOG2_MIN) * (i / float(LUT_SIZE - 1)));
+    }
+
+    const size_t size = LUT_SIZE * LUT_SIZE * LUT_SIZE * sizeof(half4);
+    half4* const data = static_cast<half4*>(malloc(size));
+    half4* p = data;
+    for (size_t b = 0; b < LUT_SIZE; b++) {
+        for (size_t g = 0; g < LUT_SIZE; g++) {
+            for (size_t r = 0; r < LUT_SIZE; r++) {
+                const float3 c = evaluate(mOptions, float3{ decode[r], decode[g], decode[b] });
+                *p++ = half4{ half(c.r), half(c.g), half(c.b), half(1.0f) };
+            }
+        }
+    }
+
+    driver.load3DImage(mLut, 0, 0, 0, 0, LUT_SIZE, LUT_SIZE, LUT_SIZE,
+            PixelBufferDescriptor(data, size, PixelDataFormat::RGBA, PixelDataType::HALF,
+                    [](void* buffer, size_t, void*) { free(buffer); }));
+    return mLut;
+}
+
+void ColorGrading::terminate(DriverApi& driver) noexcept {
+    if (mLut) {
+        driver.destroyTexture(mLut);
+        mLut.clear();
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_COLORGRADING_H
+#define TNT_FILAMENT_COLORGRADING_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/View.h>
+
+#include <math/vec3.h>
+
+#include <stddef.h>
+
+namespace filament {
+
+/*
+ * ColorGrading bakes the color grading of a view, its tone mapping and the OECF into a 3D
+ * lookup table, which the post-process shaders sample with colorGrade() (see tone_mapping.fs)
+ * instead of evaluating them per pixel. The table is indexed by the log2 of the linear,
+ * pre-exposed color, and is only rebuilt when the options change.
+ */
+class ColorGrading {
+public:
+    // size of each dimension of the lookup table
+    static constexpr size_t LUT_SIZE = 32;
+
+    // range of the table's log2 encoding, 16 stops of scene-referred values, the shader must
+    // use the same (see colorGrade() in tone_mapping.fs)
+    static constexpr float LOG2_MIN = -12.0f;
+    static constexpr float LOG2_MAX = 4.0f;
+
+    void setOptions(View::ColorGradingOptions const& options) noexcept;
+    View::ColorGradingOptions const& getOptions() const noexcept { return mOptions; }
+
+    // returns the lookup table, baked and uploaded first if the options changed since the
+    // last call
+    Handle<HwTexture> update(driver::DriverApi& driver);
+
+    void terminate(driver::DriverApi& driver) noexcept;
+
+    // the graded, tone mapped and encoded color of a linear color, what the table stores
+    static math::float3 evaluate(View::ColorGradingOptions const& options,
+            math::float3 linear) noexcept;
+
+private:
+    View::ColorGradingOptions mOptions;
+    Handle<HwTexture> mLut;
+    bool mDirty = true;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_COLORGRADING_H
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_CPUSTAGETIMINGS_H
+#define TNT_FILAMENT_CPUSTAGETIMINGS_H
+
+#include <atomic>
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * CPU time spent in each stage of a frame, added up over the views rendered during the frame.
+ * Stages can run on any thread and concurrently with each other (e.g. froxelization overlaps
+ * the command generation), so their sum can exceed the frame time.
+ */
+class CpuStageTimings {
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum Stage : uint8_t {
+        PREPARE,    // FEngine::prepare() and FView::prepare(), minus the stages below
+        CULL,       // FView::prepareVisibility()
+        FROXELIZE,  // FView::froxelize()
+        GENERATE,   // RenderPass command generation
+        SORT,       // RenderPass command sorting
+        RECORD,     // recording the driver commands
+        COUNT
+    };
+
+    // Adds the time spent in its scope to a stage.
+    class Scope {
+    public:
+        Scope(CpuStageTimings& timings, Stage stage) noexcept
+                : mTimings(timings), mStage(stage), mStart(clock::now()) { }
+        ~Scope() noexcept { mTimings.add(mStage, clock::now() - mStart); }
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+    private:
+        CpuStageTimings& mTimings;
+        Stage mStage;
+        clock::time_point mStart;
+    };
+
+    void add(Stage stage, clock::duration d) noexcept {
+        mCurrent[stage].fetch_add(int64_t(d.count()), std::memory_order_relaxed);
+    }
+
+    // Makes the timings of the frame that just finished available with getLast() and starts
+    // a new frame.
+    void endFrame() noexcept {
+        for (size_t i = 0; i < COUNT; i++) {
+            mLast[i].store(mCurrent[i].exchange(0, std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+        }
+    }
+
+    // in milliseconds
+    float getLast(Stage stage) const noexcept {
+        using milliseconds = std::chrono::duration<float, std::milli>;
+        clock::duration d(mLast[stage].load(std::memory_order_relaxed));
+        return std::chrono::duration_cast<milliseconds>(d).count();
+    }
+
+private:
+    std::atomic<int64_t> mCurrent[COUNT] = {};
+    std::atomic<int64_t> mLast[COUNT] = {};
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_CPUSTAGETIMINGS_H
@@ -16,25 +16,42 @@
 
 #include "details/Culler.h"
 
+#include <utils/architecture.h>
+
 #include <math/fast.h>
 
+#include <cmath>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define CULLER_HAS_NEON 1
+#elif defined(__wasm_simd128__)
+#   include <wasm_simd128.h>
+#   include <string.h>
+#   define CULLER_HAS_WASM_SIMD 1
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   include <immintrin.h>
+#   define CULLER_HAS_AVX2 1
+#   define CULLER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 using namespace math;
 
 namespace filament {
 namespace details {
 
-void Culler::intersects(
-        result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
+// ------------------------------------------------------------------------------------------------
+// Scalar kernels, these rely on auto-vectorization
+// ------------------------------------------------------------------------------------------------
+
+static void intersectsScalar(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
         math::float4 const* UTILS_RESTRICT b,
         size_t count) noexcept {
-
-    math::float4 const * const UTILS_RESTRICT planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allow the compiler to write 8
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -50,23 +67,19 @@ void Culler::intersects(
                               planes[j].w - sphere.w;
             visible &= fast::signbit(dot);
         }
-        results[i] = result_type(visible);
+        results[i] = Culler::result_type(visible);
     }
 }
 
-void Culler::intersects(
-        result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
+static void intersectsScalar(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
         math::float3 const* UTILS_RESTRICT center,
         math::float3 const* UTILS_RESTRICT extent,
         size_t count, size_t bit) noexcept {
-
-    math::float4 const * UTILS_RESTRICT const planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allows the compiler to write eight
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -84,10 +97,305 @@ void Culler::intersects(
             visible &= fast::signbit(dot) << bit;
         }
 
-        results[i] |= result_type(visible);
+        results[i] |= Culler::result_type(visible);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// SIMD kernels, these process 8 items per iteration.
+//
+// A box or sphere is visible if the dot products with all the planes are negative, so we
+// simply AND all the dot products together and look at the sign bit of the result.
+// ------------------------------------------------------------------------------------------------
+
+#if CULLER_HAS_NEON
+
+static inline uint8x8_t narrowSignBits(uint32x4_t lo, uint32x4_t hi) noexcept {
+    // 0 or -1 for each item
+    const int32x4_t l = vshrq_n_s32(vreinterpretq_s32_u32(lo), 31);
+    const int32x4_t h = vshrq_n_s32(vreinterpretq_s32_u32(hi), 31);
+    return vreinterpret_u8_s8(vmovn_s16(vcombine_s16(vmovn_s32(l), vmovn_s32(h))));
+}
+
+static void intersectsNEON(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
+        math::float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    for (size_t i = 0; i < count; i += 8) {
+        uint32x4_t visible[2];
+        for (size_t h = 0; h < 2; h++) {
+            const float32x4x4_t s = vld4q_f32(&b[i + h * 4].x);
+            uint32x4_t v = vdupq_n_u32(~0u);
+            for (size_t j = 0; j < 6; j++) {
+                float32x4_t dot = vmulq_n_f32(s.val[0], planes[j].x);
+                dot = vmlaq_n_f32(dot, s.val[1], planes[j].y);
+                dot = vmlaq_n_f32(dot, s.val[2], planes[j].z);
+                dot = vaddq_f32(dot, vdupq_n_f32(planes[j].w));
+                dot = vsubq_f32(dot, s.val[3]);
+                v = vandq_u32(v, vreinterpretq_u32_f32(dot));
+            }
+            visible[h] = v;
+        }
+        const uint8x8_t r = narrowSignBits(visible[0], visible[1]);
+        vst1_u8(results + i, vand_u8(r, vdup_n_u8(1)));
+    }
+}
+
+static void intersectsNEON(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const uint8x8_t mask = vdup_n_u8(uint8_t(1u << bit));
+    for (size_t i = 0; i < count; i += 8) {
+        uint32x4_t visible[2];
+        for (size_t h = 0; h < 2; h++) {
+            const float32x4x3_t c = vld3q_f32(&center[i + h * 4].x);
+            const float32x4x3_t e = vld3q_f32(&extent[i + h * 4].x);
+            uint32x4_t v = vdupq_n_u32(~0u);
+            for (size_t j = 0; j < 6; j++) {
+                float32x4_t dot = vmulq_n_f32(c.val[0], planes[j].x);
+                dot = vmlsq_n_f32(dot, e.val[0], std::abs(planes[j].x));
+                dot = vmlaq_n_f32(dot, c.val[1], planes[j].y);
+                dot = vmlsq_n_f32(dot, e.val[1], std::abs(planes[j].y));
+                dot = vmlaq_n_f32(dot, c.val[2], planes[j].z);
+                dot = vmlsq_n_f32(dot, e.val[2], std::abs(planes[j].z));
+                dot = vaddq_f32(dot, vdupq_n_f32(planes[j].w));
+                v = vandq_u32(v, vreinterpretq_u32_f32(dot));
+            }
+            visible[h] = v;
+        }
+        const uint8x8_t r = vand_u8(narrowSignBits(visible[0], visible[1]), mask);
+        vst1_u8(results + i, vorr_u8(vld1_u8(results + i), r));
     }
 }
 
+#endif // CULLER_HAS_NEON
+
+#if CULLER_HAS_WASM_SIMD
+
+static inline uint64_t narrowSignBits(v128_t lo, v128_t hi) noexcept {
+    // 0 or -1 for each item
+    const v128_t l = wasm_i32x4_shr(lo, 31);
+    const v128_t h = wasm_i32x4_shr(hi, 31);
+    const v128_t w = wasm_i16x8_narrow_i32x4(l, h);
+    return uint64_t(wasm_i64x2_extract_lane(wasm_i8x16_narrow_i16x8(w, w), 0));
+}
+
+static inline v128_t dotPlane(float4 const& plane,
+        v128_t x, v128_t y, v128_t z) noexcept {
+    v128_t dot = wasm_f32x4_mul(x, wasm_f32x4_splat(plane.x));
+    dot = wasm_f32x4_add(dot, wasm_f32x4_mul(y, wasm_f32x4_splat(plane.y)));
+    dot = wasm_f32x4_add(dot, wasm_f32x4_mul(z, wasm_f32x4_splat(plane.z)));
+    return wasm_f32x4_add(dot, wasm_f32x4_splat(plane.w));
+}
+
+static void intersectsWASM(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
+        math::float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    for (size_t i = 0; i < count; i += 8) {
+        v128_t visible[2];
+        for (size_t h = 0; h < 2; h++) {
+            float4 const* s = b + i + h * 4;
+            const v128_t x = wasm_f32x4_make(s[0].x, s[1].x, s[2].x, s[3].x);
+            const v128_t y = wasm_f32x4_make(s[0].y, s[1].y, s[2].y, s[3].y);
+            const v128_t z = wasm_f32x4_make(s[0].z, s[1].z, s[2].z, s[3].z);
+            const v128_t r = wasm_f32x4_make(s[0].w, s[1].w, s[2].w, s[3].w);
+            v128_t v = wasm_i32x4_splat(-1);
+            for (size_t j = 0; j < 6; j++) {
+                v = wasm_v128_and(v, wasm_f32x4_sub(dotPlane(planes[j], x, y, z), r));
+            }
+            visible[h] = v;
+        }
+        const uint64_t r = narrowSignBits(visible[0], visible[1]) & 0x0101010101010101llu;
+        memcpy(results + i, &r, sizeof(r));
+    }
+}
+
+static void intersectsWASM(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    float4 absPlanes[6];
+    for (size_t j = 0; j < 6; j++) {
+        absPlanes[j] = float4{ abs(planes[j].xyz), 0 };
+    }
+    const uint64_t mask = 0x0101010101010101llu << bit;
+    for (size_t i = 0; i < count; i += 8) {
+        v128_t visible[2];
+        for (size_t h = 0; h < 2; h++) {
+            float3 const* c = center + i + h * 4;
+            float3 const* e = extent + i + h * 4;
+            const v128_t cx = wasm_f32x4_make(c[0].x, c[1].x, c[2].x, c[3].x);
+            const v128_t cy = wasm_f32x4_make(c[0].y, c[1].y, c[2].y, c[3].y);
+            const v128_t cz = wasm_f32x4_make(c[0].z, c[1].z, c[2].z, c[3].z);
+            const v128_t ex = wasm_f32x4_make(e[0].x, e[1].x, e[2].x, e[3].x);
+            const v128_t ey = wasm_f32x4_make(e[0].y, e[1].y, e[2].y, e[3].y);
+            const v128_t ez = wasm_f32x4_make(e[0].z, e[1].z, e[2].z, e[3].z);
+            v128_t v = wasm_i32x4_splat(-1);
+            for (size_t j = 0; j < 6; j++) {
+                const v128_t dot = wasm_f32x4_sub(dotPlane(planes[j], cx, cy, cz),
+                        dotPlane(absPlanes[j], ex, ey, ez));
+                v = wasm_v128_and(v, dot);
+            }
+            visible[h] = v;
+        }
+        uint64_t r;
+        memcpy(&r, results + i, sizeof(r));
+        r |= narrowSignBits(visible[0], visible[1]) & mask;
+        memcpy(results + i, &r, sizeof(r));
+    }
+}
+
+#endif // CULLER_HAS_WASM_SIMD
+
+#if CULLER_HAS_AVX2
+
+CULLER_TARGET_AVX2
+static inline __m128i narrowSignBits(__m256 visible) noexcept {
+    // 0 or -1 for each item
+    const __m256i m = _mm256_srai_epi32(_mm256_castps_si256(visible), 31);
+    const __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+    return _mm_packs_epi16(w, w);
+}
+
+CULLER_TARGET_AVX2
+static inline __m256 load4x2(float4 const* p) noexcept {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&p[0].x)),
+            _mm_loadu_ps(&p[4].x), 1);
+}
+
+CULLER_TARGET_AVX2
+static void intersectsAVX2(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
+        math::float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const __m128i one = _mm_set1_epi8(1);
+    for (size_t i = 0; i < count; i += 8) {
+        // load and transpose 8 spheres
+        __m256 x = load4x2(b + i + 0);
+        __m256 y = load4x2(b + i + 1);
+        __m256 z = load4x2(b + i + 2);
+        __m256 r = load4x2(b + i + 3);
+        const __m256 t0 = _mm256_unpacklo_ps(x, y);
+        const __m256 t1 = _mm256_unpackhi_ps(x, y);
+        const __m256 t2 = _mm256_unpacklo_ps(z, r);
+        const __m256 t3 = _mm256_unpackhi_ps(z, r);
+        x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        r = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 dot = _mm256_mul_ps(x, _mm256_set1_ps(planes[j].x));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(y, _mm256_set1_ps(planes[j].y)));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(z, _mm256_set1_ps(planes[j].z)));
+            dot = _mm256_add_ps(dot, _mm256_set1_ps(planes[j].w));
+            dot = _mm256_sub_ps(dot, r);
+            visible = _mm256_and_ps(visible, dot);
+        }
+        _mm_storel_epi64((__m128i*)(results + i), _mm_and_si128(narrowSignBits(visible), one));
+    }
+}
+
+CULLER_TARGET_AVX2
+static void intersectsAVX2(
+        Culler::result_type* UTILS_RESTRICT results,
+        math::float4 const* UTILS_RESTRICT planes,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const __m256i index = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m128i mask = _mm_set1_epi8(char(1u << bit));
+    for (size_t i = 0; i < count; i += 8) {
+        float const* const c = &center[i].x;
+        float const* const e = &extent[i].x;
+        const __m256 cx = _mm256_i32gather_ps(c + 0, index, 4);
+        const __m256 cy = _mm256_i32gather_ps(c + 1, index, 4);
+        const __m256 cz = _mm256_i32gather_ps(c + 2, index, 4);
+        const __m256 ex = _mm256_i32gather_ps(e + 0, index, 4);
+        const __m256 ey = _mm256_i32gather_ps(e + 1, index, 4);
+        const __m256 ez = _mm256_i32gather_ps(e + 2, index, 4);
+
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 dot = _mm256_mul_ps(cx, _mm256_set1_ps(planes[j].x));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(ex, _mm256_set1_ps(std::abs(planes[j].x))));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(cy, _mm256_set1_ps(planes[j].y)));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(ey, _mm256_set1_ps(std::abs(planes[j].y))));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(cz, _mm256_set1_ps(planes[j].z)));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(ez, _mm256_set1_ps(std::abs(planes[j].z))));
+            dot = _mm256_add_ps(dot, _mm256_set1_ps(planes[j].w));
+            visible = _mm256_and_ps(visible, dot);
+        }
+        const __m128i r = _mm_loadl_epi64((__m128i const*)(results + i));
+        const __m128i v = _mm_and_si128(narrowSignBits(visible), mask);
+        _mm_storel_epi64((__m128i*)(results + i), _mm_or_si128(r, v));
+    }
+}
+
+static bool hasAVX2() noexcept {
+    static const bool sHasAVX2 = utils::arch::hasAVX2();
+    return sHasAVX2;
+}
+
+#endif // CULLER_HAS_AVX2
+
+// ------------------------------------------------------------------------------------------------
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    math::float4 const * const UTILS_RESTRICT planes = frustum.mPlanes;
+    count = round(count); // capacity guaranteed to be multiple of 8
+#if CULLER_HAS_NEON
+    intersectsNEON(results, planes, b, count);
+#elif CULLER_HAS_WASM_SIMD
+    intersectsWASM(results, planes, b, count);
+#else
+#   if CULLER_HAS_AVX2
+    if (hasAVX2()) {
+        intersectsAVX2(results, planes, b, count);
+        return;
+    }
+#   endif
+    intersectsScalar(results, planes, b, count);
+#endif
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    math::float4 const * UTILS_RESTRICT const planes = frustum.mPlanes;
+    count = round(count); // capacity guaranteed to be multiple of 8
+#if CULLER_HAS_NEON
+    intersectsNEON(results, planes, center, extent, count, bit);
+#elif CULLER_HAS_WASM_SIMD
+    intersectsWASM(results, planes, center, extent, count, bit);
+#else
+#   if CULLER_HAS_AVX2
+    if (hasAVX2()) {
+        intersectsAVX2(results, planes, center, extent, count, bit);
+        return;
+    }
+#   endif
+    intersectsScalar(results, planes, center, extent, count, bit);
+#endif
+}
+
 /*
  * returns whether a box intersects with the frustum
  */
@@ -135,5 +443,21 @@ void Culler::Test::intersects(
     Culler::intersects(results, frustum, b, count);
 }
 
+void Culler::Test::intersectsScalar(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float3 const* UTILS_RESTRICT c,
+        math::float3 const* UTILS_RESTRICT e,
+        size_t count) noexcept {
+    details::intersectsScalar(results, frustum.getNormalizedPlanes(), c, e, round(count), 0);
+}
+
+void Culler::Test::intersectsScalar(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float4 const* UTILS_RESTRICT b, size_t count) noexcept {
+    details::intersectsScalar(results, frustum.getNormalizedPlanes(), b, round(count));
+}
+
 } // namespace details
 } // namespace filament
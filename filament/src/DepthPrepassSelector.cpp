@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/DepthPrepassSelector.h"
+
+namespace filament {
+namespace details {
+
+// the other choice must be this much cheaper to be picked, so noise doesn't make us flip-flop
+static constexpr float HYSTERESIS = 0.05f;
+
+// smoothing of the costs, probes are rare so we rely more on each of their measurements
+static constexpr float CURRENT_FILTER = 0.1f;
+static constexpr float PROBE_FILTER = 0.5f;
+
+bool DepthPrepassSelector::select(uint32_t frameId) noexcept {
+    const uint32_t n = mFrameCount++ % PROBE_PERIOD;
+    const bool probing = n >= PROBE_PERIOD - PROBE_FRAMES;
+    mSelected = mPrepass ^ probing;
+    mHistory[frameId % HISTORY_SIZE] = { frameId, mSelected, true };
+    return mSelected;
+}
+
+void DepthPrepassSelector::addMeasurement(uint32_t frameId, duration colorPass) noexcept {
+    Decision const& decision = mHistory[frameId % HISTORY_SIZE];
+    if (frameId == mLastMeasured || !decision.valid || decision.frameId != frameId) {
+        return;
+    }
+    mLastMeasured = frameId;
+
+    const size_t i = decision.prepass;
+    const float cost = colorPass.count();
+    const float k = (decision.prepass == mPrepass) ? CURRENT_FILTER : PROBE_FILTER;
+    mCost[i] = mMeasured[i] ? mCost[i] + k * (cost - mCost[i]) : cost;
+    mMeasured[i] = true;
+
+    const size_t current = mPrepass;
+    if (mMeasured[0] && mMeasured[1] &&
+            mCost[current ^ 1u] < mCost[current] * (1.0f - HYSTERESIS)) {
+        mPrepass = !mPrepass;
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -16,6 +16,7 @@
 
 #include "details/Engine.h"
 
+#include "details/DestroyBatch.h"
 #include "details/DFG.h"
 #include "details/VertexBuffer.h"
 #include "details/Fence.h"
@@ -23,6 +24,7 @@
 #include "details/IndexBuffer.h"
 #include "details/IndirectLight.h"
 #include "details/Material.h"
+#include "details/ParticleSystem.h"
 #include "details/Renderer.h"
 #include "details/RenderPrimitive.h"
 #include "details/Scene.h"
@@ -31,6 +33,7 @@
 #include "details/SwapChain.h"
 #include "details/Texture.h"
 #include "details/View.h"
+#include "driver/CommandTrace.h"
 #include "driver/Program.h"
 
 #include "PrecompiledMaterials.h"
@@ -52,9 +55,12 @@
 #include <math/fast.h>
 #include <math/scalar.h>
 
+#include <algorithm>
 #include <functional>
+#include <vector>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 
 using namespace math;
@@ -71,8 +77,31 @@ namespace details {
 static std::unordered_map<Engine const*, std::unique_ptr<FEngine>> sEngines;
 static std::mutex sEnginesLock;
 
-FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLContext) {
-    FEngine* instance = new FEngine(backend, platform, sharedGLContext);
+UTILS_DEFINE_TLS(FEngine::LoaderThread*) FEngine::sLoaderThread(nullptr);
+
+FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLContext,
+        const Config* config) {
+    SYSTRACE_CALL();
+    const clock::time_point start = clock::now();
+
+    constexpr size_t MiB = 1024 * 1024;
+    Config resolved = config ? *config : Config{};
+    if (!resolved.minCommandBufferSizeMB) {
+        resolved.minCommandBufferSizeMB = uint32_t(CONFIG_MIN_COMMAND_BUFFERS_SIZE / MiB);
+    }
+    if (!resolved.commandBufferSizeMB) {
+        resolved.commandBufferSizeMB = std::max(uint32_t(CONFIG_COMMAND_BUFFERS_SIZE / MiB),
+                3 * resolved.minCommandBufferSizeMB);
+    }
+    if (!resolved.perFrameCommandsSizeMB) {
+        resolved.perFrameCommandsSizeMB = uint32_t(CONFIG_PER_FRAME_COMMANDS_SIZE / MiB);
+    }
+    ASSERT_PRECONDITION(resolved.commandBufferSizeMB > resolved.minCommandBufferSizeMB,
+            "commandBufferSizeMB (%u) must be larger than minCommandBufferSizeMB (%u)",
+            resolved.commandBufferSizeMB, resolved.minCommandBufferSizeMB);
+
+    FEngine* instance = new FEngine(backend, platform, sharedGLContext, resolved);
+    instance->mCreationTime = start;
 
     slog.i << "FEngine (" << sizeof(void*) * 8 << " bits) created at " << instance << " "
             << "(threading is " << (UTILS_HAS_THREADING ? "enabled)" : "disabled)") << io::endl;
@@ -90,8 +119,10 @@ FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLCont
             instance->mPlatform = platform;
         }
         instance->mDriver = platform->createDriver(sharedGLContext);
+        instance->mStartupTimings.driver = toMilliseconds(clock::now() - start);
         instance->init();
         instance->execute();
+        instance->mStartupTimings.create = toMilliseconds(clock::now() - start);
         return instance;
     }
 
@@ -110,6 +141,7 @@ FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLCont
     // now we can initialize the largest part of the engine
     instance->init();
 
+    instance->mStartupTimings.create = toMilliseconds(clock::now() - start);
     return instance;
 }
 
@@ -143,13 +175,14 @@ static const half4 sFullScreenTriangleVertices[3] = {
 // these must be static because only a pointer is copied to the render stream
 static const uint16_t sFullScreenTriangleIndices[3] = { 0, 1, 2 };
 
-FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
+FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext,
+        Config const& config) :
         mBackend(backend),
         mPlatform(platform),
         mSharedGLContext(sharedGLContext),
         mEntityManager(EntityManager::get()),
         mRenderableManager(*this),
-        mTransformManager(),
+        mTransformManager(&mJobSystem),
         mLightManager(*this),
         mCameraManager(*this),
         mPerViewUib(PerViewUib::getUib()),
@@ -157,8 +190,15 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
         mPerViewSib(PerViewSib::getSib()),
         mPostProcessUib(PostProcessingUib::getUib()),
         mPostProcessSib(PostProcessSib::getSib()),
-        mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
+        mCommandBufferQueue(config.minCommandBufferSizeMB * 1024 * 1024,
+                config.commandBufferSizeMB * 1024 * 1024),
+        mPerFrameCommandsSize(config.perFrameCommandsSizeMB * 1024 * 1024),
+        mBlobCache(config.blobCache),
+        mCommandTracePath(config.commandTracePath ? config.commandTracePath : ""),
         mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE),
+        mHeapAllocator("FEngine heap", CONFIG_HEAP_ARENA_SIZE),
+        // the main thread and the driver thread, see loop()
+        mJobSystem(0, 2),
         mEpoch(std::chrono::steady_clock::now()),
         mDriverBarrier(1)
 {
@@ -175,17 +215,36 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
  */
 
 void FEngine::init() {
+    SYSTRACE_CALL();
+    const clock::time_point start = clock::now();
+
     // this must be first.
     mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer());
+    if (!mCommandTracePath.empty()) {
+        // the recorder executes the commands with the driver's dispatcher once written
+        mCommandTrace = std::make_unique<CommandTraceRecorder>(mCommandTracePath.c_str(),
+                mBackend, mDriver->getDispatcher());
+        if (mCommandTrace->isValid()) {
+            mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer(),
+                    mCommandTrace->getDispatcher());
+        }
+    }
     DriverApi& driverApi = getDriverApi();
 
-    // Parse all post process shaders now, but create them lazily
-    mPostProcessParser = std::make_unique<filaflat::MaterialParser>(mBackend,
-            POST_PROCESS_PACKAGE, POST_PROCESS_PACKAGE_SIZE);
+    // before any program is created
+    driverApi.setBlobCache(mBlobCache);
 
-    UTILS_UNUSED_IN_RELEASE bool ppMaterialOk =
-            mPostProcessParser->parse() && mPostProcessParser->isPostProcessMaterial();
-    assert(ppMaterialOk);
+    // Parse all post process shaders on a job while the resources below are created, the
+    // programs themselves are created lazily
+    JobSystem& js = mJobSystem;
+    auto parent = js.createJob();
+    js.run(jobs::createJob(js, parent, [this]() {
+        mPostProcessParser = std::make_unique<filaflat::MaterialParser>(mBackend,
+                POST_PROCESS_PACKAGE, POST_PROCESS_PACKAGE_SIZE);
+        UTILS_UNUSED_IN_RELEASE bool ppMaterialOk =
+                mPostProcessParser->parse() && mPostProcessParser->isPostProcessMaterial();
+        assert(ppMaterialOk);
+    }), JobSystem::DONT_SIGNAL);
 
     mFullScreenTriangleVb = upcast(VertexBuffer::Builder()
             .vertexCount(3)
@@ -237,11 +296,37 @@ void FEngine::init() {
     mLightManager.init(*this);
     mDFG.reset(new DFG(*this));
 
-    // Always initialize the default material, most materials' depth shaders fallback on it.
-    mDefaultMaterial = upcast(
-            FMaterial::DefaultMaterialBuilder()
-                    .package(DEFAULT_MATERIAL_PACKAGE, DEFAULT_MATERIAL_PACKAGE_SIZE)
-                    .build(*const_cast<FEngine*>(this)));
+    // the default material is created with the first material or renderable that needs it,
+    // see getDefaultMaterial()
+
+    // read by the statistics overlay of filagui
+    mDebugRegistry.registerProperty("d.stats.overlay", &debug.stats.overlay);
+
+    // see DebugVisualization
+    mDebugRegistry.registerProperty("d.view.visualization", &debug.view.visualization);
+    mDebugRegistry.registerProperty("d.view.visualization_range", &debug.view.range);
+
+    // see getLastFrameStatistics()
+    FrameCounters& counters = mFrameCounters;
+    mDebugRegistry.registerProperty("d.stats.visible_renderables",
+            counters.getLastAddress(FrameCounters::VISIBLE_RENDERABLES));
+    mDebugRegistry.registerProperty("d.stats.visible_shadow_casters",
+            counters.getLastAddress(FrameCounters::VISIBLE_SHADOW_CASTERS));
+    mDebugRegistry.registerProperty("d.stats.froxel_records",
+            counters.getLastAddress(FrameCounters::FROXEL_RECORDS));
+    mDebugRegistry.registerProperty("d.stats.commands_generated",
+            counters.getLastAddress(FrameCounters::COMMANDS_GENERATED));
+    mDebugRegistry.registerProperty("d.stats.commands_recorded",
+            counters.getLastAddress(FrameCounters::COMMANDS_RECORDED));
+    mDebugRegistry.registerProperty("d.stats.uniform_bytes",
+            counters.getLastAddress(FrameCounters::UNIFORM_BYTES));
+    mDebugRegistry.registerProperty("d.stats.program_compiles",
+            counters.getLastAddress(FrameCounters::PROGRAM_COMPILES));
+    mDebugRegistry.registerProperty("d.stats.texture_uploads",
+            counters.getLastAddress(FrameCounters::TEXTURE_UPLOADS));
+
+    js.runAndWait(parent);
+    mStartupTimings.init = toMilliseconds(clock::now() - start);
 }
 
 FEngine::~FEngine() noexcept {
@@ -251,10 +336,13 @@ FEngine::~FEngine() noexcept {
 }
 
 void FEngine::shutdown() {
+    ASSERT_PRECONDITION(!mLoaderThreadCount.load(),
+            "Engine destroyed with %u loader threads attached", mLoaderThreadCount.load());
+
 #ifndef NDEBUG
     // print out some statistics about this run
     size_t wm = mCommandBufferQueue.getHigWatermark();
-    size_t wmpct = wm / (CONFIG_COMMAND_BUFFERS_SIZE / 100);
+    size_t wmpct = wm / (mCommandBufferQueue.getCircularBuffer().size() / 100);
     slog.d << "CircularBuffer: High watermark "
            << wm / 1024 << " KiB (" << wmpct << "%)" << io::endl;
 #endif
@@ -265,10 +353,12 @@ void FEngine::shutdown() {
      * Destroy our own state first
      */
 
+    mIblPrefilter.terminate(*this);         // free-up the IBLs being prefiltered
+    mMipmapGenerator.terminate();           // forget the textures being mipmapped
     mPostProcessManager.terminate(driver);  // free-up post-process manager resources
-    mRenderTargetPool.terminate(driver);    // free-up all offscreen render targets
     mDFG->terminate();                      // free-up the DFG
     mRenderableManager.terminate();         // free-up all renderables
+    mPreSkinning.terminate(*this);          // free-up the skinning program
     mLightManager.terminate();              // free-up all lights
     mCameraManager.terminate();             // free-up all cameras
 
@@ -289,12 +379,22 @@ void FEngine::shutdown() {
     cleanupResourceList(mRenderers);
     cleanupResourceList(mViews);
     cleanupResourceList(mScenes);
+    cleanupResourceList(mParticleSystems);
+    cleanupResourceList(mImpostors);
+    cleanupResourceList(mTerrains);
     cleanupResourceList(mSkyboxes);
+    cleanupResourceList(mRenderTargets);
 
-    // this must be done after Skyboxes and before materials
+    // this must be done after Skyboxes, Impostors and Terrains, and before materials
     for (FMaterial const* material : mSkyboxMaterials) {
         destroy(material);
     }
+    destroy(mImpostorMaterial);
+    destroy(mTerrainMaterial);
+    for (auto const& item : mDebugVisualizationInstances) {
+        destroy(item.second);
+    }
+    destroy(mDebugVisualizationMaterial);
 
     cleanupResourceList(mIndexBuffers);
     cleanupResourceList(mVertexBuffers);
@@ -305,6 +405,9 @@ void FEngine::shutdown() {
     }
     cleanupResourceList(mFences);
 
+    // this must be done after Views, they can hold render targets of the pool
+    mRenderTargetPool.terminate(driver);    // free-up all offscreen render targets
+
     for (size_t i = 0; i < POST_PROCESS_STAGES_COUNT; i++) {
         driver.destroyProgram(mPostProcessPrograms[i]);
     }
@@ -332,14 +435,207 @@ void FEngine::shutdown() {
 
 void FEngine::prepare() {
     SYSTRACE_CALL();
+    CpuStageTimings::Scope timing(mCpuStageTimings, CpuStageTimings::PREPARE);
+
+    // time this thread was blocked on the driver thread during the last frame
+    auto stallTime = mCommandBufferQueue.takeStallTime();
+    SYSTRACE_VALUE32("CommandBufferQueue::stall (us)",
+            std::chrono::duration_cast<std::chrono::microseconds>(stallTime).count());
+    (void)stallTime;
+
+    // size of the commands flushed during the last frame, which the driver thread reads back
+    const size_t flushedSize = mCommandBufferQueue.takeFlushedSize();
+    SYSTRACE_VALUE32("CommandBufferQueue::flushed (KiB)", flushedSize / 1024);
+    (void)flushedSize;
+
+    // request or evict levels of the streaming textures, based on what the last frame drew.
+    // this can call into the application, which can upload the levels right away.
+    mTextureStreamer.update(*this);
+
+    // run this frame's share of the IBL prefiltering, the IndirectLights get their reflections
+    // and SH once all their passes are done
+    mIblPrefilter.update(*this);
+
+    // render this frame's share of the mipmap levels, see Texture::generateMipmapsAsync()
+    mMipmapGenerator.update(*this);
+
     // prepare() is called once per Renderer frame. Ideally we would upload the content of
     // UBOs that are visible only. It's not such a big issue because the actual upload() is
     // skipped is the UBO hasn't changed. Still we could have a lot of these.
+    commitMaterialInstances();
+
+    if (mMemoryBudget.callback) {
+        checkMemoryBudget();
+    }
+}
+
+void FEngine::getLastFrameStatistics(FrameStatistics* stats) const noexcept {
+    FrameCounters const& counters = mFrameCounters;
+    *stats = {
+            counters.getLast(FrameCounters::VISIBLE_RENDERABLES),
+            counters.getLast(FrameCounters::VISIBLE_SHADOW_CASTERS),
+            counters.getLast(FrameCounters::FROXEL_RECORDS),
+            counters.getLast(FrameCounters::COMMANDS_GENERATED),
+            counters.getLast(FrameCounters::COMMANDS_RECORDED),
+            counters.getLast(FrameCounters::UNIFORM_BYTES),
+            counters.getLast(FrameCounters::PROGRAM_COMPILES),
+            counters.getLast(FrameCounters::TEXTURE_UPLOADS) };
+}
+
+FEngine::MemoryStats FEngine::getMemoryStats() noexcept {
+    MemoryStats stats{};
+
+    utils::TlsfAllocator::Stats const& heap = mHeapAllocator.getAllocator().getStats();
+    stats.heapUsed = heap.used;
+    stats.heapHighWatermark = heap.highWatermark;
+    stats.heapReserved = heap.poolSize;
+    stats.perRenderPassArenaSize = mPerRenderPassAllocator.getArea().getSize();
+    stats.perRenderPassArenaHighWatermark =
+            mPerRenderPassAllocator.getListener().getHighWatermark();
+    stats.commandBufferSize = mCommandBufferQueue.getCircularBuffer().size();
+    stats.commandBufferHighWatermark = mCommandBufferQueue.getHigWatermark();
+
+    using Type = Driver::GpuMemoryType;
+    const Driver::GpuMemoryStats gpu = getDriverApi().getGpuMemoryStats();
+    stats.vertexBuffers = gpu.used[size_t(Type::VERTEX_BUFFER)];
+    stats.indexBuffers = gpu.used[size_t(Type::INDEX_BUFFER)];
+    stats.uniformBuffers = gpu.used[size_t(Type::UNIFORM_BUFFER)];
+    stats.textures = gpu.used[size_t(Type::TEXTURE)];
+    stats.renderTargets = gpu.used[size_t(Type::RENDER_TARGET)];
+    stats.renderTargetPool = mRenderTargetPool.getPoolSize();
+    stats.gpuHighWatermark = gpu.highWatermark;
+    stats.programCount = gpu.count[size_t(Type::PROGRAM)];
+    return stats;
+}
+
+void FEngine::setMemoryBudget(size_t cpuBudget, size_t gpuBudget,
+        MemoryBudgetCallback callback, void* user) noexcept {
+    mMemoryBudget.cpu = cpuBudget;
+    mMemoryBudget.gpu = gpuBudget;
+    mMemoryBudget.callback = callback;
+    mMemoryBudget.user = user;
+    mMemoryBudget.exceeded = false;
+}
+
+FEngine::TrimMemoryStats FEngine::trimMemory(TrimMemoryLevel level) {
+    SYSTRACE_CALL();
+
+    TrimMemoryStats stats{};
+    stats.renderTargetPool = mRenderTargetPool.purge();
+
+    if (level >= TrimMemoryLevel::DRIVER_CACHES) {
+        // the driver writes the size it freed when it executes the command
+        size_t freed = 0;
+        getDriverApi().trimCaches({ &freed, sizeof(freed) });
+        if (UTILS_HAS_THREADING) {
+            FFence::waitAndDestroy(createFence(FFence::Type::SOFT), FFence::Mode::FLUSH);
+        } else {
+            flush();
+            execute();
+        }
+        stats.driverCaches = freed;
+    }
+
+    if (level >= TrimMemoryLevel::PROGRAMS) {
+        // the programs of the default material are kept, they're drawn with until the
+        // programs of the other materials are compiled again
+        FMaterial const* const defaultMaterial = mDefaultMaterial.load(std::memory_order_acquire);
+        mMaterials.forEach([this, defaultMaterial, &stats](FMaterial* material) {
+            if (material != defaultMaterial) {
+                stats.programCount += material->destroyPrograms(*this);
+            }
+        });
+        // the cached commands refer to the programs
+        invalidateMaterialInstances();
+    }
+
+    if (level >= TrimMemoryLevel::STREAMED_TEXTURES) {
+        stats.streamedTextures = mTextureStreamer.trim(*this);
+    }
+    return stats;
+}
+
+void FEngine::checkMemoryBudget() noexcept {
+    const MemoryStats stats = getMemoryStats();
+    const bool exceeded =
+            (mMemoryBudget.cpu && stats.getCpuTotal() > mMemoryBudget.cpu) ||
+            (mMemoryBudget.gpu && stats.getGpuTotal() > mMemoryBudget.gpu);
+    if (exceeded && !mMemoryBudget.exceeded) {
+        mMemoryBudget.callback(stats, mMemoryBudget.user);
+    }
+    mMemoryBudget.exceeded = exceeded;
+}
+
+void FEngine::commitMaterialInstances() noexcept {
+    // The modified uniforms of all material instances are packed in as few
+    // updateUniformBufferRanges() commands as possible, each one limited to MAX_BATCH_SIZE
+    // bytes of command stream.
+    constexpr size_t MAX_BATCH_SIZE = 64 * 1024;
+    DriverApi& driver = getDriverApi();
+
+    size_t remaining = 0;
+    for (auto& materialInstanceList : mMaterialInstances) {
+        for (auto& item : materialInstanceList.second) {
+            remaining += item->getUniformRangeUpdateSize();
+            item->commitSamplers(*this);
+        }
+    }
+
+    char* batch = nullptr;
+    char* current = nullptr;
+    char* end = nullptr;
+    auto flush = [&]() {
+        if (current != batch) {
+            driver.updateUniformBufferRanges({ batch, size_t(current - batch) });
+        }
+    };
+
     for (auto& materialInstanceList : mMaterialInstances) {
         for (auto& item : materialInstanceList.second) {
-            item->commit(*this);
+            const size_t size = item->getUniformRangeUpdateSize();
+            if (!size) {
+                continue;
+            }
+            if (UTILS_UNLIKELY(size_t(end - current) < size)) {
+                flush();
+                const size_t capacity = std::max(std::min(remaining, MAX_BATCH_SIZE), size);
+                batch = current = static_cast<char*>(driver.allocate(capacity, 4));
+                end = batch + capacity;
+            }
+            current = item->commitUniforms(current);
+            remaining -= size;
+            mFrameCounters.add(FrameCounters::UNIFORM_BYTES, size);
         }
     }
+    flush();
+}
+
+void FEngine::updateCommandBufferSize() noexcept {
+    CommandBufferQueue& queue = mCommandBufferQueue;
+    const size_t requiredSize = queue.getRequiredSize();
+
+    // A flush larger than the space guaranteed after the previous one corrupts the stream,
+    // grow before we get there.
+    if (UTILS_LIKELY(queue.getSliceHighWatermark() <= requiredSize / 4 * 3)) {
+        return;
+    }
+
+    if (!UTILS_HAS_THREADING) {
+        // we can't wait for the driver to consume the commands
+        slog.w << "CommandStream is " << queue.getSliceHighWatermark() / 1024
+               << " KiB, close to its limit of " << requiredSize / 1024 << " KiB" << io::endl;
+        queue.resetWatermarks();
+        return;
+    }
+
+    const size_t bufferSize = queue.getCircularBuffer().size();
+    slog.w << "CommandStream is " << queue.getSliceHighWatermark() / 1024
+           << " KiB, growing its buffers to " << 2 * requiredSize / 1024 << " KiB out of "
+           << 2 * bufferSize / 1024 << " KiB" << io::endl;
+
+    getDriver().purge();
+    mCommandStream.closePacked();
+    queue.resize(2 * requiredSize, 2 * bufferSize);
 }
 
 void FEngine::gc() {
@@ -364,6 +660,59 @@ void FEngine::flush() {
     flushCommandBuffer(mCommandBufferQueue);
 }
 
+// -----------------------------------------------------------------------------------------------
+// Loader threads
+// -----------------------------------------------------------------------------------------------
+
+void FEngine::attachLoaderThread() {
+    LoaderThread* const current = sLoaderThread;
+    ASSERT_PRECONDITION(!current, "This thread is already a loader thread");
+    LoaderThread* const loader = new LoaderThread{ this };
+    startLoaderBlock(*loader);
+    sLoaderThread = loader;
+    mLoaderThreadCount.fetch_add(1);
+}
+
+void FEngine::flushLoaderThread() {
+    LoaderThread* const loader = sLoaderThread;
+    ASSERT_PRECONDITION(loader && loader->engine == this,
+            "This thread is not a loader thread of this engine");
+    CircularBuffer& buffer = *loader->buffer;
+    if (buffer.empty()) {
+        return;
+    }
+
+    // like CommandBufferQueue::flush(), there is always room for the terminating command
+    new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    assert(uintptr_t(buffer.getHead()) - uintptr_t(loader->block) <= buffer.size());
+
+    // the driver thread executes these commands, and frees the block, after the ones flushed
+    // before by any thread
+    mCommandBufferQueue.submit(loader->block, buffer.getHead());
+    startLoaderBlock(*loader);
+}
+
+void FEngine::detachLoaderThread() {
+    flushLoaderThread();
+    LoaderThread* const loader = sLoaderThread;
+    free(loader->block);
+    delete loader;
+    sLoaderThread = nullptr;
+    mLoaderThreadCount.fetch_sub(1);
+}
+
+void FEngine::startLoaderBlock(LoaderThread& loader) noexcept {
+    const size_t size = LOADER_COMMANDS_SIZE;
+    loader.block = malloc(size);
+    loader.buffer.reset(new CircularBuffer(loader.block, size));
+    loader.stream = CommandStream(mCommandStream, *loader.buffer);
+}
+
+FEngine::DriverApi& FEngine::getLoaderDriverApi() noexcept {
+    LoaderThread* const loader = sLoaderThread;
+    return (loader && loader->engine == this) ? loader->stream : mCommandStream;
+}
+
 // -----------------------------------------------------------------------------------------------
 // Render thread / command queue
 // -----------------------------------------------------------------------------------------------
@@ -378,10 +727,12 @@ int FEngine::loop() {
         mPlatform = platform;
 #if !defined(NDEBUG)
         slog.d << "FEngine resolved backend: "
-               << (mBackend == driver::Backend::VULKAN ? "Vulkan" : "OpenGL") << io::endl;
+               << (mBackend == driver::Backend::VULKAN ? "Vulkan" :
+                   mBackend == driver::Backend::NOOP ? "Noop" : "OpenGL") << io::endl;
 #endif
     }
     mDriver = platform->createDriver(mSharedGLContext);
+    mStartupTimings.driver = toMilliseconds(clock::now() - mCreationTime);
     mDriverBarrier.latch();
     if (UTILS_UNLIKELY(!mDriver)) {
         // if we get here, it's because the driver couldn't be initialized and the problem has
@@ -392,6 +743,9 @@ int FEngine::loop() {
     JobSystem::setThreadName("FEngine::loop");
     JobSystem::setThreadPriority(JobSystem::Priority::DISPLAY);
 
+    // the driver can record the commands of a render pass on jobs, see Driver::executeSegments()
+    mJobSystem.adopt();
+
     while (true) {
 
         // FIXME: we should do this based on the CPUs we actually have
@@ -409,14 +763,33 @@ int FEngine::loop() {
 
     // terminate() is a synchronous API
     getDriverApi().terminate();
+    mJobSystem.emancipate();
     return 0;
 }
 
 void FEngine::flushCommandBuffer(CommandBufferQueue& commandQueue) {
     getDriver().purge();
+    mCommandStream.closePacked();
     commandQueue.flush();
 }
 
+UTILS_NOINLINE
+const FMaterial* FEngine::createDefaultMaterial() const noexcept {
+    // a loader thread could be building the first material at the same time
+    std::lock_guard<utils::Mutex> guard(mDefaultMaterialLock);
+    FMaterial const* material = mDefaultMaterial.load(std::memory_order_relaxed);
+    if (!material) {
+        // most materials' depth shaders, and the programs used until a material's own are
+        // compiled, come from the default material
+        material = upcast(
+                FMaterial::DefaultMaterialBuilder()
+                        .package(DEFAULT_MATERIAL_PACKAGE, DEFAULT_MATERIAL_PACKAGE_SIZE)
+                        .build(*const_cast<FEngine*>(this)));
+        mDefaultMaterial.store(material, std::memory_order_release);
+    }
+    return material;
+}
+
 const FMaterial* FEngine::getSkyboxMaterial(bool rgbm) const noexcept {
     size_t index = rgbm ? 0 : 1;
     FMaterial const* material = mSkyboxMaterials[index];
@@ -427,6 +800,64 @@ const FMaterial* FEngine::getSkyboxMaterial(bool rgbm) const noexcept {
     return material;
 }
 
+const FMaterial* FEngine::getImpostorMaterial() const noexcept {
+    if (UTILS_UNLIKELY(mImpostorMaterial == nullptr)) {
+        mImpostorMaterial = FImpostor::createMaterial(*const_cast<FEngine*>(this));
+    }
+    return mImpostorMaterial;
+}
+
+const FMaterial* FEngine::getTerrainMaterial() const noexcept {
+    if (UTILS_UNLIKELY(mTerrainMaterial == nullptr)) {
+        mTerrainMaterial = FTerrain::createMaterial(*const_cast<FEngine*>(this));
+    }
+    return mTerrainMaterial;
+}
+
+float FEngine::getDebugVisualizationRange(DebugVisualization visualization) const noexcept {
+    if (debug.view.range > 0.0f) {
+        return debug.view.range;
+    }
+    switch (visualization) {
+        case DebugVisualization::NONE:          return 1.0f;
+        case DebugVisualization::OVERDRAW:      return 8.0f;    // layers
+        case DebugVisualization::SHADER_COST:   return 2048.0f; // SPIR-V instructions
+        case DebugVisualization::FROXEL_LIGHTS: return 16.0f;   // lights
+    }
+}
+
+FMaterialInstance const* FEngine::getDebugVisualizationInstance(
+        DebugVisualization visualization, uint32_t shaderCost) const noexcept {
+    // only the shader cost needs an instance per value
+    shaderCost = visualization == DebugVisualization::SHADER_COST ?
+            std::min(shaderCost, 0x0FFFFFFFu) : 0;
+    const uint32_t key = (uint32_t(visualization) << 28u) | shaderCost;
+    auto pos = mDebugVisualizationInstances.find(key);
+    if (pos != mDebugVisualizationInstances.end()) {
+        return pos->second;
+    }
+
+    FEngine& engine = *const_cast<FEngine*>(this);
+    if (UTILS_UNLIKELY(!mDebugVisualizationMaterial)) {
+        mDebugVisualizationMaterial = upcast(Material::Builder()
+                .package(DEBUG_VISUALIZATION_PACKAGE, DEBUG_VISUALIZATION_PACKAGE_SIZE)
+                .build(engine));
+    }
+
+    // each fragment adds 1 to the overdraw, the materials without a cost are drawn in gray
+    // (see post_process.fs), the froxel lights are looked up by the material itself
+    float value = 1.0f;
+    if (visualization == DebugVisualization::SHADER_COST) {
+        value = shaderCost ? float(shaderCost) : -1.0f;
+    }
+    FMaterialInstance* const mi = mDebugVisualizationMaterial->createInstance();
+    static_cast<MaterialInstance*>(mi)->setParameter("mode", int32_t(visualization));
+    static_cast<MaterialInstance*>(mi)->setParameter("value", value);
+    // this frame's instances were committed already
+    mi->commit(engine);
+    mDebugVisualizationInstances[key] = mi;
+    return mi;
+}
 
 Handle<HwProgram> FEngine::createPostProcessProgram(MaterialParser& parser,
         ShaderModel shaderModel, PostProcessStage stage) const noexcept {
@@ -455,6 +886,7 @@ Handle<HwProgram> FEngine::createPostProcessProgram(MaterialParser& parser,
             .addSamplerBlock(BindingPoints::POST_PROCESS, &SibGenerator::getPostProcessSib());
     auto program = const_cast<DriverApi&>(mCommandStream).createProgram(std::move(pb));
     assert(program);
+    mFrameCounters.add(FrameCounters::PROGRAM_COMPILES);
     return program;
 }
 
@@ -476,39 +908,57 @@ Handle<HwProgram> FEngine::getPostProcessProgramSlow(PostProcessStage stage) con
  * Object created from a Builder
  */
 
-template <typename T>
-inline T* FEngine::create(ResourceList<T>& list, typename T::Builder const& builder) noexcept {
-    T* p = mHeapAllocator.make<T>(*this, builder);
+template <typename T, typename L>
+inline T* FEngine::create(ResourceList<T, L>& list, typename T::Builder const& builder,
+        HeapTag tag) noexcept {
+    T* p = heapMake<T>(tag, *this, builder);
     list.insert(p);
     return p;
 }
 
 FVertexBuffer* FEngine::createVertexBuffer(const VertexBuffer::Builder& builder) noexcept {
-    return create(mVertexBuffers, builder);
+    return create(mVertexBuffers, builder, HEAP_TAG_BUFFER);
+}
+
+FImpostor* FEngine::createImpostor(const Impostor::Builder& builder) noexcept {
+    return create(mImpostors, builder, HEAP_TAG_OTHER);
 }
 
 FIndexBuffer* FEngine::createIndexBuffer(const IndexBuffer::Builder& builder) noexcept {
-    return create(mIndexBuffers, builder);
+    return create(mIndexBuffers, builder, HEAP_TAG_BUFFER);
 }
 
 FTexture* FEngine::createTexture(const Texture::Builder& builder) noexcept {
-    return create(mTextures, builder);
+    return create(mTextures, builder, HEAP_TAG_TEXTURE);
 }
 
 FIndirectLight* FEngine::createIndirectLight(const IndirectLight::Builder& builder) noexcept {
-    return create(mIndirectLights, builder);
+    return create(mIndirectLights, builder, HEAP_TAG_TEXTURE);
 }
 
 FMaterial* FEngine::createMaterial(const Material::Builder& builder) noexcept {
-    return create(mMaterials, builder);
+    return create(mMaterials, builder, HEAP_TAG_MATERIAL);
+}
+
+FParticleSystem* FEngine::createParticleSystem(
+        const ParticleSystem::Builder& builder) noexcept {
+    return create(mParticleSystems, builder, HEAP_TAG_OTHER);
 }
 
 FSkybox* FEngine::createSkybox(const Skybox::Builder& builder) noexcept {
-    return create(mSkyboxes, builder);
+    return create(mSkyboxes, builder, HEAP_TAG_OTHER);
+}
+
+FRenderTarget* FEngine::createRenderTarget(const RenderTarget::Builder& builder) noexcept {
+    return create(mRenderTargets, builder, HEAP_TAG_OTHER);
 }
 
 FStream* FEngine::createStream(const Stream::Builder& builder) noexcept {
-    return create(mStreams, builder);
+    return create(mStreams, builder, HEAP_TAG_TEXTURE);
+}
+
+FTerrain* FEngine::createTerrain(const Terrain::Builder& builder) noexcept {
+    return create(mTerrains, builder, HEAP_TAG_OTHER);
 }
 
 /*
@@ -516,7 +966,7 @@ FStream* FEngine::createStream(const Stream::Builder& builder) noexcept {
  */
 
 FRenderer* FEngine::createRenderer() noexcept {
-    FRenderer* p = mHeapAllocator.make<FRenderer>(*this);
+    FRenderer* p = heapMake<FRenderer>(HEAP_TAG_RENDERER, *this);
     if (p) {
         mRenderers.insert(p);
         p->init();
@@ -525,8 +975,9 @@ FRenderer* FEngine::createRenderer() noexcept {
 }
 
 FMaterialInstance* FEngine::createMaterialInstance(const FMaterial* material) noexcept {
-    FMaterialInstance* p = mHeapAllocator.make<FMaterialInstance>(*this, material);
+    FMaterialInstance* p = heapMake<FMaterialInstance>(HEAP_TAG_MATERIAL, *this, material);
     if (p) {
+        std::lock_guard<utils::Mutex> guard(mMaterialInstancesLock);
         auto pos = mMaterialInstances.emplace(material, "MaterialInstance");
         pos.first->second.insert(p);
     }
@@ -538,7 +989,7 @@ FMaterialInstance* FEngine::createMaterialInstance(const FMaterial* material) no
  */
 
 FScene* FEngine::createScene() noexcept {
-    FScene* p = mHeapAllocator.make<FScene>(*this);
+    FScene* p = heapMake<FScene>(HEAP_TAG_SCENE, *this);
     if (p) {
         mScenes.insert(p);
     }
@@ -546,7 +997,7 @@ FScene* FEngine::createScene() noexcept {
 }
 
 FView* FEngine::createView() noexcept {
-    FView* p = mHeapAllocator.make<FView>(*this);
+    FView* p = heapMake<FView>(HEAP_TAG_VIEW, *this);
     if (p) {
         mViews.insert(p);
     }
@@ -554,7 +1005,7 @@ FView* FEngine::createView() noexcept {
 }
 
 FFence* FEngine::createFence(Fence::Type type) noexcept {
-    FFence* p = mHeapAllocator.make<FFence>(*this, type);
+    FFence* p = heapMake<FFence>(HEAP_TAG_OTHER, *this, type);
     if (p) {
         mFences.insert(p);
     }
@@ -562,7 +1013,15 @@ FFence* FEngine::createFence(Fence::Type type) noexcept {
 }
 
 FSwapChain* FEngine::createSwapChain(void* nativeWindow, uint64_t flags) noexcept {
-    FSwapChain* p = mHeapAllocator.make<FSwapChain>(*this, nativeWindow, flags);
+    FSwapChain* p = heapMake<FSwapChain>(HEAP_TAG_OTHER, *this, nativeWindow, flags);
+    if (p) {
+        mSwapChains.insert(p);
+    }
+    return p;
+}
+
+FSwapChain* FEngine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    FSwapChain* p = heapMake<FSwapChain>(HEAP_TAG_OTHER, *this, width, height, flags);
     if (p) {
         mSwapChains.insert(p);
     }
@@ -630,6 +1089,31 @@ void FEngine::terminateAndDestroy(const T* ptr, ResourceList<T, L>& list) {
     }
 }
 
+template<typename B, typename T, typename L>
+void FEngine::terminateAndDestroy(const B* const* p, size_t count, ResourceList<T, L>& list) {
+    // the list is locked once for all the objects, and their driver resources are freed by
+    // a few destroyHandles() commands
+    std::vector<T*> items(count);
+    for (size_t i = 0; i < count; i++) {
+        items[i] = const_cast<T*>(upcast(p[i]));
+    }
+    const size_t removed = list.remove(items.data(), count);
+#ifndef NDEBUG
+    const size_t nonNull = count - size_t(std::count(p, p + count, nullptr));
+    if (removed != nonNull) {
+        slog.d << (nonNull - removed) << " objects "
+               << CallStack::typeName<T>().c_str()
+               << " don't exist!"
+               << io::endl;
+    }
+#endif
+    DestroyBatch batch(getDriverApi(), removed);
+    for (size_t i = 0; i < removed; i++) {
+        items[i]->terminate(*this, batch);
+        mHeapAllocator.destroy(items[i]);
+    }
+}
+
 // -----------------------------------------------------------------------------------------------
 
 void FEngine::destroy(const FVertexBuffer* p) {
@@ -640,6 +1124,10 @@ void FEngine::destroy(const FIndexBuffer* p) {
     terminateAndDestroy(p, mIndexBuffers);
 }
 
+void FEngine::destroy(const FImpostor* p) {
+    terminateAndDestroy(p, mImpostors);
+}
+
 inline void FEngine::destroy(const FRenderer* p) {
     terminateAndDestroy(p, mRenderers);
 }
@@ -648,10 +1136,18 @@ inline void FEngine::destroy(const FScene* p) {
     terminateAndDestroy(p, mScenes);
 }
 
+inline void FEngine::destroy(const FParticleSystem* p) {
+    terminateAndDestroy(p, mParticleSystems);
+}
+
 inline void FEngine::destroy(const FSkybox* p) {
     terminateAndDestroy(p, mSkyboxes);
 }
 
+inline void FEngine::destroy(const FRenderTarget* p) {
+    terminateAndDestroy(p, mRenderTargets);
+}
+
 UTILS_NOINLINE
 void FEngine::destroy(const FTexture* p) {
     terminateAndDestroy(p, mTextures);
@@ -678,9 +1174,14 @@ void FEngine::destroy(const FStream* p) {
     terminateAndDestroy(p, mStreams);
 }
 
+void FEngine::destroy(const FTerrain* p) {
+    terminateAndDestroy(p, mTerrains);
+}
+
 
 inline void FEngine::destroy(const FMaterial* ptr) {
     if (ptr != nullptr) {
+        std::unique_lock<utils::Mutex> lock(mMaterialInstancesLock);
         auto pos = mMaterialInstances.find(ptr);
         if (pos != mMaterialInstances.cend()) {
             // we've destroyed the material before destroying all its instances
@@ -690,6 +1191,7 @@ inline void FEngine::destroy(const FMaterial* ptr) {
                 return;
             }
         }
+        lock.unlock();
         terminateAndDestroy(ptr, mMaterials);
     }
 }
@@ -711,6 +1213,44 @@ void FEngine::destroy(Entity e) {
     mCameraManager.destroy(e);
 }
 
+void FEngine::destroy(const VertexBuffer* const* p, size_t count) {
+    terminateAndDestroy(p, count, mVertexBuffers);
+}
+
+void FEngine::destroy(const IndexBuffer* const* p, size_t count) {
+    terminateAndDestroy(p, count, mIndexBuffers);
+}
+
+void FEngine::destroy(const Texture* const* p, size_t count) {
+    terminateAndDestroy(p, count, mTextures);
+}
+
+void FEngine::destroy(const MaterialInstance* const* p, size_t count) {
+    // the instances are in the lists of their materials
+    DestroyBatch batch(getDriverApi(), count * 2);
+    for (size_t i = 0; i < count; i++) {
+        FMaterialInstance* const ptr = const_cast<FMaterialInstance*>(upcast(p[i]));
+        if (ptr != nullptr) {
+            auto pos = mMaterialInstances.find(ptr->getMaterial());
+            assert(pos != mMaterialInstances.cend());
+            if (pos != mMaterialInstances.cend() && pos->second.remove(ptr)) {
+                ptr->terminate(*this, batch);
+                mHeapAllocator.destroy(ptr);
+            }
+        }
+    }
+}
+
+void FEngine::destroy(Entity const* entities, size_t count) {
+    DestroyBatch batch(getDriverApi(), count);
+    mRenderableManager.destroy(entities, count, batch);
+    for (size_t i = 0; i < count; i++) {
+        mLightManager.destroy(entities[i]);
+        mTransformManager.destroy(entities[i]);
+        mCameraManager.destroy(entities[i]);
+    }
+}
+
 void* FEngine::streamAlloc(size_t size, size_t alignment) noexcept {
     // we allow this only for small allocations
     if (size > 1024) {
@@ -772,8 +1312,9 @@ EnginePerformanceTest::PFN EnginePerformanceTest::getDestroyUniverseApi() {
 
 using namespace details;
 
-Engine* Engine::create(Backend backend, Platform* platform, void* sharedGLContext) {
-    std::unique_ptr<FEngine> engine(FEngine::create(backend, platform, sharedGLContext));
+Engine* Engine::create(Backend backend, Platform* platform, void* sharedGLContext,
+        const Config* config) {
+    std::unique_ptr<FEngine> engine(FEngine::create(backend, platform, sharedGLContext, config));
     if (UTILS_UNLIKELY(!engine)) {
         // something went wrong during the driver or engine initialization
         return nullptr;
@@ -838,6 +1379,10 @@ SwapChain* Engine::createSwapChain(void* nativeWindow, uint64_t flags) noexcept
     return upcast(this)->createSwapChain(nativeWindow, flags);
 }
 
+SwapChain* Engine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    return upcast(this)->createSwapChain(width, height, flags);
+}
+
 void Engine::destroy(const VertexBuffer* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -846,6 +1391,10 @@ void Engine::destroy(const IndexBuffer* p) {
     upcast(this)->destroy(upcast(p));
 }
 
+void Engine::destroy(const Impostor* p) {
+    upcast(this)->destroy(upcast(p));
+}
+
 void Engine::destroy(const IndirectLight* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -870,14 +1419,26 @@ void Engine::destroy(const Scene* p) {
     upcast(this)->destroy(upcast(p));
 }
 
+void Engine::destroy(const ParticleSystem* p) {
+    upcast(this)->destroy(upcast(p));
+}
+
 void Engine::destroy(const Skybox* p) {
     upcast(this)->destroy(upcast(p));
 }
 
+void Engine::destroy(const RenderTarget* p) {
+    upcast(this)->destroy(upcast(p));
+}
+
 void Engine::destroy(const Stream* p) {
     upcast(this)->destroy(upcast(p));
 }
 
+void Engine::destroy(const Terrain* p) {
+    upcast(this)->destroy(upcast(p));
+}
+
 void Engine::destroy(const Texture* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -894,6 +1455,26 @@ void Engine::destroy(Entity e) {
     upcast(this)->destroy(e);
 }
 
+void Engine::destroy(const VertexBuffer* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const IndexBuffer* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const MaterialInstance* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const Texture* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(Entity const* entities, size_t count) {
+    upcast(this)->destroy(entities, count);
+}
+
 RenderableManager& Engine::getRenderableManager() noexcept {
     return upcast(this)->getRenderableManager();
 }
@@ -906,6 +1487,10 @@ TransformManager& Engine::getTransformManager() noexcept {
     return upcast(this)->getTransformManager();
 }
 
+JobSystem& Engine::getJobSystem() noexcept {
+    return upcast(this)->getJobSystem();
+}
+
 void* Engine::streamAlloc(size_t size, size_t alignment) noexcept {
     return upcast(this)->streamAlloc(size, alignment);
 }
@@ -918,9 +1503,54 @@ void Engine::execute() {
     upcast(this)->execute();
 }
 
+void Engine::attachLoaderThread() {
+    upcast(this)->attachLoaderThread();
+}
+
+void Engine::flushLoaderThread() {
+    upcast(this)->flushLoaderThread();
+}
+
+void Engine::detachLoaderThread() {
+    upcast(this)->detachLoaderThread();
+}
+
+void Engine::setPipelineCacheData(driver::BufferDescriptor&& data) noexcept {
+    upcast(this)->getDriverApi().setPipelineCacheData(std::move(data));
+}
+
+size_t Engine::getPipelineCacheData(void* data, size_t size) noexcept {
+    return upcast(this)->getDriverApi().getPipelineCacheData(data, size);
+}
+
+void Engine::setTextureStreamingBudget(size_t bytes) noexcept {
+    upcast(this)->getTextureStreamer().setBudget(bytes);
+}
+
+Engine::MemoryStats Engine::getMemoryStats() noexcept {
+    return upcast(this)->getMemoryStats();
+}
+
+void Engine::getLastFrameStatistics(FrameStatistics* stats) const noexcept {
+    upcast(this)->getLastFrameStatistics(stats);
+}
+
+void Engine::setMemoryBudget(size_t cpuBudget, size_t gpuBudget,
+        MemoryBudgetCallback callback, void* user) noexcept {
+    upcast(this)->setMemoryBudget(cpuBudget, gpuBudget, callback, user);
+}
+
+Engine::TrimMemoryStats Engine::trimMemory(TrimMemoryLevel level) {
+    return upcast(this)->trimMemory(level);
+}
+
 DebugRegistry& Engine::getDebugRegistry() noexcept {
     return upcast(this)->getDebugRegistry();
 }
 
+void Engine::getStartupTimings(StartupTimings* timings) const noexcept {
+    *timings = upcast(this)->getStartupTimings();
+}
+
 
 } // namespace filament
@@ -20,8 +20,18 @@
 
 #include <filament/Fence.h>
 
+#include <utils/Log.h>
 #include <utils/Panic.h>
 
+#include <errno.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 namespace filament {
 
 using namespace driver;
@@ -41,9 +51,19 @@ FFence::FFence(FEngine& engine, Type type)
 
     // we have to first wait for the fence to be signaled by the command stream
     auto& fs = mFenceSignal;
-    driverApi.queueCommand([fs]() {
-        fs->signal();
-    });
+    if (type == Type::HARD && driverApi.isNativeFenceSupported()) {
+        // the GPU fence is created by the command before this one, export it for
+        // getFileDescriptor()
+        Driver& driver = engine.getDriver();
+        Handle<HwFence> fh = mFenceHandle;
+        driverApi.queueCommand([fs, &driver, fh]() {
+            fs->signal(driver, fh);
+        });
+    } else {
+        driverApi.queueCommand([fs]() {
+            fs->signal();
+        });
+    }
 }
 
 void FFence::terminate(FEngine& engine) noexcept {
@@ -92,14 +112,100 @@ FenceStatus FFence::wait(Mode mode, uint64_t timeout) noexcept {
     return status;
 }
 
+int FFence::getFileDescriptor(Mode mode) noexcept {
+    if (mode == Mode::FLUSH) {
+        mEngine.flush();
+    }
+    if (mFenceSignal->mType == Type::HARD &&
+            !mEngine.getDriverApi().isNativeFenceSupported()) {
+        // we'd have no way to know when the GPU is done
+        return -1;
+    }
+    return mFenceSignal->getFileDescriptor();
+}
+
 UTILS_NOINLINE
 void FFence::FenceSignal::signal(State s) noexcept {
     std::unique_lock<std::mutex> lock(FFence::sLock);
     mState = s;
+    if (s == SIGNALED && mPollFd >= 0) {
+        notifyFileDescriptor();
+    }
     lock.unlock();
     FFence::sCondition.notify_all();
 }
 
+UTILS_NOINLINE
+void FFence::FenceSignal::signal(Driver& driver, Handle<HwFence> fh) noexcept {
+    std::unique_lock<std::mutex> lock(FFence::sLock);
+    // terminate() destroys the h/w fence after setting DESTROYED, under the lock
+    if (mState == UNSIGNALED) {
+        mState = SIGNALED;
+        // if this fails, the file descriptor polls readable now and wait() waits for the GPU
+        mNativeFd = driver.dupNativeFence(fh);
+        if (mPollFd >= 0) {
+            notifyFileDescriptor();
+        }
+    }
+    lock.unlock();
+    FFence::sCondition.notify_all();
+}
+
+int FFence::FenceSignal::getFileDescriptor() noexcept {
+#if defined(__linux__)
+    std::unique_lock<std::mutex> lock(FFence::sLock);
+    if (mPollFd < 0) {
+        mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        mPollFd = mEventFd;
+        if (mEventFd >= 0 && mType == Type::HARD) {
+            // the native fence is added to the set once the driver has created it
+            mPollFd = epoll_create1(EPOLL_CLOEXEC);
+            struct epoll_event event = { EPOLLIN, {} };
+            if (mPollFd >= 0 && epoll_ctl(mPollFd, EPOLL_CTL_ADD, mEventFd, &event) < 0) {
+                close(mPollFd);
+                mPollFd = -1;
+            }
+        }
+        if (UTILS_UNLIKELY(mPollFd < 0)) {
+            utils::slog.e << "Fence: can't create a file descriptor (" << strerror(errno) << ")"
+                    << utils::io::endl;
+            return -1;
+        }
+        if (mState == SIGNALED) {
+            notifyFileDescriptor();
+        }
+    }
+    return mPollFd;
+#else
+    return -1;
+#endif
+}
+
+void FFence::FenceSignal::notifyFileDescriptor() noexcept {
+#if defined(__linux__)
+    if (mNativeFd >= 0) {
+        struct epoll_event event = { EPOLLIN, {} };
+        epoll_ctl(mPollFd, EPOLL_CTL_ADD, mNativeFd, &event);
+    } else {
+        eventfd_write(mEventFd, 1);
+    }
+#endif
+}
+
+FFence::FenceSignal::~FenceSignal() noexcept {
+#if defined(__linux__)
+    if (mPollFd >= 0 && mPollFd != mEventFd) {
+        close(mPollFd);
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+    if (mNativeFd >= 0) {
+        close(mNativeFd);
+    }
+#endif
+}
+
 UTILS_NOINLINE
 Fence::FenceStatus FFence::FenceSignal::wait(uint64_t timeout) noexcept {
     std::unique_lock<std::mutex> lock(FFence::sLock);
@@ -137,5 +243,9 @@ FenceStatus Fence::wait(Mode mode, uint64_t timeout) {
     return upcast(this)->wait(mode, timeout);
 }
 
+int Fence::getFileDescriptor(Mode mode) {
+    return upcast(this)->getFileDescriptor(mode);
+}
+
 
 } // namespace filament
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FRAMECOUNTERS_H
+#define TNT_FILAMENT_FRAMECOUNTERS_H
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Counters of the work done during a frame, added up over the views rendered during the frame.
+ * Like CpuStageTimings, they can be incremented from any thread.
+ */
+class FrameCounters {
+public:
+    enum Counter : uint8_t {
+        VISIBLE_RENDERABLES,        // renderables left after culling
+        VISIBLE_SHADOW_CASTERS,     // shadow casters left after culling
+        FROXEL_RECORDS,             // light records used by the froxels
+        COMMANDS_GENERATED,         // commands generated and sorted, i.e. not cached
+        COMMANDS_RECORDED,          // commands translated into draw calls
+        UNIFORM_BYTES,              // uniforms uploaded
+        PROGRAM_COMPILES,           // programs created
+        TEXTURE_UPLOADS,            // images uploaded to textures
+        COUNT
+    };
+
+    void add(Counter counter, size_t value = 1) noexcept {
+        mCurrent[counter].fetch_add(uint32_t(value), std::memory_order_relaxed);
+    }
+
+    // Makes the counters of the frame that just finished available with getLast() and starts
+    // a new frame.
+    void endFrame() noexcept {
+        for (size_t i = 0; i < COUNT; i++) {
+            mLast[i] = int(mCurrent[i].exchange(0, std::memory_order_relaxed));
+        }
+    }
+
+    uint32_t getLast(Counter counter) const noexcept {
+        return uint32_t(mLast[counter]);
+    }
+
+    // the last counters are exposed as properties of the DebugRegistry, they're overwritten at
+    // the end of each frame
+    int* getLastAddress(Counter counter) noexcept {
+        return &mLast[counter];
+    }
+
+private:
+    std::atomic<uint32_t> mCurrent[COUNT] = {};
+    int mLast[COUNT] = {};
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FRAMECOUNTERS_H
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameGraph.h"
+
+#include "driver/DriverApi.h"
+
+#include <utils/Systrace.h>
+
+#include <assert.h>
+
+namespace filament {
+
+using namespace driver;
+using namespace details;
+
+static constexpr uint16_t UNUSED = 0xFFFF;
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraphResource FrameGraph::Builder::create(const char* name,
+        FrameGraphResource::Descriptor const& desc) noexcept {
+    std::vector<ResourceNode>& resources = mFrameGraph.mResourceNodes;
+    ResourceNode node{};
+    node.name = name;
+    node.desc = desc;
+    resources.push_back(node);
+    return FrameGraphResource(uint16_t(resources.size() - 1));
+}
+
+FrameGraphResource FrameGraph::Builder::sample(FrameGraphResource r,
+        TargetBufferFlags attachments) noexcept {
+    return mFrameGraph.addAccess(mPass, r, Access::SAMPLE, attachments);
+}
+
+FrameGraphResource FrameGraph::Builder::read(FrameGraphResource r,
+        TargetBufferFlags attachments) noexcept {
+    return mFrameGraph.addAccess(mPass, r, Access::READ, attachments);
+}
+
+FrameGraphResource FrameGraph::Builder::write(FrameGraphResource r) noexcept {
+    return mFrameGraph.addAccess(mPass, r, Access::WRITE, TargetBufferFlags::ALL);
+}
+
+void FrameGraph::Builder::sideEffect() noexcept {
+    mFrameGraph.mPassNodes[mPass].sideEffect = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraphPassResources::RenderTarget FrameGraphPassResources::get(
+        FrameGraphResource r) const noexcept {
+    return mFrameGraph.getRenderTarget(mPass, r);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraph::FrameGraph(ArenaScope& arena, RenderTargetPool& pool) noexcept
+        : mArena(arena), mRenderTargetPool(pool) {
+    mPassNodes.reserve(16);
+    mResourceNodes.reserve(16);
+    mAccessNodes.reserve(32);
+}
+
+uint16_t FrameGraph::addPassNode(const char* name, PassExecutor* executor) noexcept {
+    PassNode node{};
+    node.name = name;
+    node.executor = executor;
+    mPassNodes.push_back(node);
+    return uint16_t(mPassNodes.size() - 1);
+}
+
+FrameGraphResource FrameGraph::addAccess(uint16_t pass, FrameGraphResource r, Access access,
+        TargetBufferFlags attachments) noexcept {
+    assert(r.isValid() && r.index < mResourceNodes.size());
+    mAccessNodes.push_back({ pass, r.index, access, attachments });
+    return r;
+}
+
+FrameGraphResource FrameGraph::import(const char* name,
+        FrameGraphResource::Descriptor const& desc,
+        Handle<HwRenderTarget> target, TargetBufferFlags discardStart,
+        Handle<HwTexture> texture) noexcept {
+    ResourceNode node{};
+    node.name = name;
+    node.desc = desc;
+    node.imported = true;
+    node.discardStart = discardStart;
+    node.target = target;
+    node.texture = texture;
+    mResourceNodes.push_back(node);
+    return FrameGraphResource(uint16_t(mResourceNodes.size() - 1));
+}
+
+void FrameGraph::cull() noexcept {
+    std::vector<PassNode>& passes = mPassNodes;
+    std::vector<ResourceNode>& resources = mResourceNodes;
+    std::vector<AccessNode> const& accesses = mAccessNodes;
+
+    // a pass is referenced by the resources it writes, a resource by the passes reading it
+    for (PassNode& pass : passes) {
+        pass.refCount = pass.sideEffect ? 1 : 0;
+    }
+    for (ResourceNode& resource : resources) {
+        // imported resources are used after the frame graph is done
+        resource.refCount = resource.imported ? 1 : 0;
+    }
+    for (AccessNode const& access : accesses) {
+        if (access.access == Access::WRITE) {
+            passes[access.pass].refCount++;
+        } else {
+            resources[access.resource].refCount++;
+        }
+    }
+
+    // unreferenced resources no longer need their writers, which in turn no longer need
+    // what they read
+    std::vector<uint16_t> stack;
+    for (size_t i = 0, c = resources.size(); i < c; i++) {
+        if (!resources[i].refCount) {
+            stack.push_back(uint16_t(i));
+        }
+    }
+    while (!stack.empty()) {
+        const uint16_t r = stack.back();
+        stack.pop_back();
+        for (AccessNode const& access : accesses) {
+            if (access.resource != r || access.access != Access::WRITE) {
+                continue;
+            }
+            if (--passes[access.pass].refCount) {
+                continue;
+            }
+            // this pass is culled
+            for (AccessNode const& read : accesses) {
+                if (read.pass == access.pass && read.access != Access::WRITE) {
+                    if (!--resources[read.resource].refCount) {
+                        stack.push_back(read.resource);
+                    }
+                }
+            }
+        }
+    }
+
+    // lifetimes of the resources, as seen by the remaining passes
+    for (ResourceNode& resource : resources) {
+        resource.first = UNUSED;
+        resource.last = UNUSED;
+        resource.sampled = false;
+    }
+    for (AccessNode const& access : accesses) {
+        if (passes[access.pass].refCount) {
+            ResourceNode& resource = resources[access.resource];
+            if (resource.first == UNUSED) {
+                resource.first = access.pass;
+            }
+            resource.last = access.pass;
+            resource.sampled |= access.access == Access::SAMPLE;
+        }
+    }
+}
+
+FrameGraphPassResources::RenderTarget FrameGraph::getRenderTarget(
+        uint16_t pass, FrameGraphResource r) const noexcept {
+    assert(r.isValid() && r.index < mResourceNodes.size());
+    ResourceNode const& resource = mResourceNodes[r.index];
+
+    FrameGraphPassResources::RenderTarget rt;
+    if (resource.imported) {
+        rt.target = resource.target;
+        rt.texture = resource.texture;
+        rt.width = resource.desc.width;
+        rt.height = resource.desc.height;
+    } else {
+        assert(resource.pooled);
+        rt.target = resource.pooled->target;
+        rt.texture = resource.pooled->texture;
+        rt.width = resource.pooled->w;
+        rt.height = resource.pooled->h;
+    }
+
+    bool written = false;
+    uint8_t keep = resource.imported ? resource.desc.attachments : 0;
+    for (AccessNode const& access : mAccessNodes) {
+        if (access.resource != r.index || !mPassNodes[access.pass].refCount) {
+            continue;
+        }
+        if (access.pass == pass) {
+            written |= access.access == Access::WRITE;
+        } else if (access.pass > pass) {
+            // a later write loads the content we leave, so that's a read too
+            keep |= access.attachments;
+        }
+    }
+
+    if (written) {
+        if (pass == resource.first) {
+            // nothing was rendered in this target before, there is nothing to load
+            rt.discardStart = resource.imported ? resource.discardStart : TargetBufferFlags::ALL;
+        }
+        rt.discardEnd = TargetBufferFlags(TargetBufferFlags::ALL & ~keep);
+    }
+    return rt;
+}
+
+void FrameGraph::execute(DriverApi& driver) noexcept {
+    SYSTRACE_CALL();
+
+    cull();
+
+    std::vector<PassNode>& passes = mPassNodes;
+    std::vector<ResourceNode>& resources = mResourceNodes;
+    std::vector<AccessNode> const& accesses = mAccessNodes;
+    RenderTargetPool& pool = mRenderTargetPool;
+
+    size_t begin = 0;
+    for (size_t p = 0, c = passes.size(); p < c; p++) {
+        // accesses are ordered by pass
+        size_t end = begin;
+        while (end < accesses.size() && accesses[end].pass == p) {
+            end++;
+        }
+
+        PassNode const& pass = passes[p];
+        if (pass.refCount) {
+            // allocate the transient targets used from now on...
+            for (size_t i = begin; i < end; i++) {
+                ResourceNode& resource = resources[accesses[i].resource];
+                if (!resource.imported && !resource.pooled && resource.first == p) {
+                    FrameGraphResource::Descriptor const& desc = resource.desc;
+                    resource.pooled = pool.get(desc.attachments,
+                            desc.width, desc.height, desc.samples, desc.format,
+                            resource.sampled ? uint8_t(0) : RenderTargetPool::Target::NO_TEXTURE);
+                }
+            }
+
+            driver.pushGroupMarker(pass.name);
+            pass.executor->execute(FrameGraphPassResources(*this, uint16_t(p)), driver);
+            driver.popGroupMarker();
+
+            // ...and give back the ones that are no longer needed, for the next passes to reuse
+            for (size_t i = begin; i < end; i++) {
+                ResourceNode& resource = resources[accesses[i].resource];
+                if (resource.pooled && resource.last == p) {
+                    pool.put(resource.pooled);
+                    resource.pooled = nullptr;
+                }
+            }
+        }
+        begin = end;
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FRAMEGRAPH_H
+#define TNT_FILAMENT_FRAMEGRAPH_H
+
+#include "RenderTargetPool.h"
+
+#include "details/Allocators.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace filament {
+
+class FrameGraph;
+class FrameGraphPassResources;
+
+/*
+ * A render target used by the passes of a FrameGraph.
+ */
+class FrameGraphResource {
+public:
+    struct Descriptor {
+        uint32_t width = 1;
+        uint32_t height = 1;
+        uint8_t samples = 1;
+        driver::TextureFormat format = driver::TextureFormat::RGBA8;
+        driver::TargetBufferFlags attachments = driver::TargetBufferFlags::COLOR;
+    };
+
+    FrameGraphResource() noexcept = default;
+    bool isValid() const noexcept { return index != UNINITIALIZED; }
+
+private:
+    friend class FrameGraph;
+    friend class FrameGraphPassResources;
+    static constexpr uint16_t UNINITIALIZED = 0xFFFF;
+    explicit FrameGraphResource(uint16_t index) noexcept : index(index) { }
+    uint16_t index = UNINITIALIZED;
+};
+
+/*
+ * What a pass gets to know about the resources it declared, when it's executed.
+ */
+class FrameGraphPassResources {
+public:
+    struct RenderTarget {
+        Handle<HwRenderTarget> target;
+        Handle<HwTexture> texture;      // only set for resources that are sampled
+        uint32_t width = 0;             // size of the allocated target, can be larger than
+        uint32_t height = 0;            // what the descriptor asked for
+        // attachments whose content doesn't need to be loaded or stored by this pass
+        driver::TargetBufferFlags discardStart = driver::TargetBufferFlags::NONE;
+        driver::TargetBufferFlags discardEnd = driver::TargetBufferFlags::NONE;
+    };
+
+    RenderTarget get(FrameGraphResource r) const noexcept;
+
+private:
+    friend class FrameGraph;
+    FrameGraphPassResources(FrameGraph const& fg, uint16_t pass) noexcept
+            : mFrameGraph(fg), mPass(pass) { }
+    FrameGraph const& mFrameGraph;
+    const uint16_t mPass;
+};
+
+/*
+ * FrameGraph records the passes of a frame along with the render targets they create, read and
+ * write, and executes them once all of them are known.
+ *
+ * - passes whose results are never used are culled.
+ * - transient render targets are taken from the RenderTargetPool just before the first pass
+ *   using them and returned just after the last one, so that targets with non-overlapping
+ *   lifetimes share the same memory.
+ * - the discard flags of each pass are set from what the following passes use.
+ *
+ * A FrameGraph is used for a single frame, passes are allocated in the given arena.
+ */
+class FrameGraph {
+public:
+    class Builder {
+    public:
+        // creates a transient render target
+        FrameGraphResource create(const char* name,
+                FrameGraphResource::Descriptor const& desc) noexcept;
+
+        // the pass samples the resource in a shader, which needs it to have a texture
+        FrameGraphResource sample(FrameGraphResource r,
+                driver::TargetBufferFlags attachments = driver::TargetBufferFlags::COLOR) noexcept;
+
+        // the pass reads the resource's attachments by other means (blit, read-back)
+        FrameGraphResource read(FrameGraphResource r,
+                driver::TargetBufferFlags attachments = driver::TargetBufferFlags::COLOR) noexcept;
+
+        // the pass renders into the resource
+        FrameGraphResource write(FrameGraphResource r) noexcept;
+
+        // the pass is never culled, e.g. because it has effects outside of the frame graph
+        void sideEffect() noexcept;
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph& fg, uint16_t pass) noexcept : mFrameGraph(fg), mPass(pass) { }
+        FrameGraph& mFrameGraph;
+        const uint16_t mPass;
+    };
+
+    template <typename Data, typename Execute>
+    class Pass;
+
+    FrameGraph(details::ArenaScope& arena, RenderTargetPool& pool) noexcept;
+
+    FrameGraph(FrameGraph const&) = delete;
+    FrameGraph& operator=(FrameGraph const&) = delete;
+
+    /*
+     * Adds a pass.
+     * setup(Builder&, Data&) is called immediately, to declare the resources the pass uses.
+     * execute(FrameGraphPassResources const&, Data const&, DriverApi&) is called by execute(),
+     * if the pass isn't culled.
+     */
+    template <typename Data, typename Setup, typename Execute>
+    Pass<Data, Execute>& addPass(const char* name, Setup setup, Execute&& execute) noexcept;
+
+    /*
+     * Imports a render target owned outside of the frame graph (e.g. the swap chain). Its
+     * content is kept at the end of the frame for the descriptor's attachments, and
+     * discardStart is used by the first pass writing into it. The target can only be sampled
+     * if its color texture is given.
+     */
+    FrameGraphResource import(const char* name, FrameGraphResource::Descriptor const& desc,
+            Handle<HwRenderTarget> target,
+            driver::TargetBufferFlags discardStart = driver::TargetBufferFlags::NONE,
+            Handle<HwTexture> texture = {}) noexcept;
+
+    // culls the unused passes and runs the others in the order they were added, each one in a
+    // group marker named after it
+    void execute(driver::DriverApi& driver) noexcept;
+
+private:
+    friend class FrameGraphPassResources;
+
+    class PassExecutor {
+    public:
+        virtual void execute(FrameGraphPassResources const& resources,
+                driver::DriverApi& driver) noexcept = 0;
+    protected:
+        ~PassExecutor() = default;
+    };
+
+    enum class Access : uint8_t { SAMPLE, READ, WRITE };
+
+    struct PassNode {
+        const char* name;
+        PassExecutor* executor;
+        uint32_t refCount = 0;
+        bool sideEffect = false;
+    };
+
+    struct ResourceNode {
+        const char* name;
+        FrameGraphResource::Descriptor desc;
+        uint32_t refCount = 0;
+        uint16_t first = 0;         // first and last passes using this resource, after culling
+        uint16_t last = 0;
+        bool imported = false;
+        bool sampled = false;
+        driver::TargetBufferFlags discardStart = driver::TargetBufferFlags::NONE;
+        Handle<HwRenderTarget> target;                      // imported targets only
+        Handle<HwTexture> texture;                          // imported targets only, if sampled
+        RenderTargetPool::Target const* pooled = nullptr;   // transient targets, while in use
+    };
+
+    struct AccessNode {
+        uint16_t pass;
+        uint16_t resource;
+        Access access;
+        driver::TargetBufferFlags attachments;
+    };
+
+    uint16_t addPassNode(const char* name, PassExecutor* executor) noexcept;
+    FrameGraphResource addAccess(uint16_t pass, FrameGraphResource r, Access access,
+            driver::TargetBufferFlags attachments) noexcept;
+    void cull() noexcept;
+    FrameGraphPassResources::RenderTarget getRenderTarget(
+            uint16_t pass, FrameGraphResource r) const noexcept;
+
+    details::ArenaScope& mArena;
+    RenderTargetPool& mRenderTargetPool;
+    std::vector<PassNode> mPassNodes;
+    std::vector<ResourceNode> mResourceNodes;
+    std::vector<AccessNode> mAccessNodes;   // ordered by pass
+};
+
+template <typename Data, typename Execute>
+class FrameGraph::Pass final : private FrameGraph::PassExecutor {
+public:
+    explicit Pass(Execute&& execute) noexcept : mExecute(std::forward<Execute>(execute)) { }
+
+    Data const& getData() const noexcept { return mData; }
+
+private:
+    friend class FrameGraph;
+
+    void execute(FrameGraphPassResources const& resources,
+            driver::DriverApi& driver) noexcept override {
+        mExecute(resources, mData, driver);
+    }
+
+    Data mData{};
+    typename std::decay<Execute>::type mExecute;
+};
+
+template <typename Data, typename Setup, typename Execute>
+FrameGraph::Pass<Data, Execute>& FrameGraph::addPass(const char* name,
+        Setup setup, Execute&& execute) noexcept {
+    // the arena runs the destructor of the pass (and lambda captures) when it goes out of scope
+    auto* const pass = mArena.make<Pass<Data, Execute>>(std::forward<Execute>(execute));
+    Builder builder(*this, addPassNode(name, pass));
+    setup(builder, pass->mData);
+    return *pass;
+}
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FRAMEGRAPH_H
@@ -126,6 +126,99 @@ void FrameInfoManager::finish(FrameInfo* info) noexcept {
 
 // ------------------------------------------------------------------------------------------------
 
+void FrameInfoManager::beginGpuFrame(driver::DriverApi& driver, uint32_t frameId) noexcept {
+    if (UTILS_UNLIKELY(mGpuTimingsSupported < 0)) {
+        mGpuTimingsSupported = driver.isTimerQuerySupported() ? 1 : 0;
+    }
+    if (!mGpuTimingsSupported) {
+        return;
+    }
+
+    // collect the measurements of the previous frames, oldest first
+    for (size_t i = 1; i <= GPU_FRAME_COUNT; i++) {
+        resolveGpuFrame(driver, mGpuFrames[(mCurrentGpuFrame + i) % GPU_FRAME_COUNT]);
+    }
+
+    mCurrentGpuFrame = (mCurrentGpuFrame + 1) % GPU_FRAME_COUNT;
+    GpuFrame& frame = mGpuFrames[mCurrentGpuFrame];
+    if (UTILS_UNLIKELY(frame.lapCount)) {
+        // the GPU is too late, the results of these queries would be mistaken for this frame's
+        for (size_t i = 0; i < frame.lapCount; i++) {
+            driver.destroyTimerQuery(frame.laps[i].query);
+            frame.laps[i].query.clear();
+        }
+    }
+    frame.frame = frameId;
+    frame.lapCount = 0;
+}
+
+void FrameInfoManager::beginGpuLap(driver::DriverApi& driver, FrameInfo::lap_id id) noexcept {
+    GpuFrame& frame = mGpuFrames[mCurrentGpuFrame];
+    if (!mGpuTimingsSupported || mCurrentGpuLap || frame.lapCount >= FrameInfo::MAX_LAPS_IDS) {
+        return;
+    }
+    GpuLap& lap = frame.laps[frame.lapCount++];
+    if (!lap.query) {
+        lap.query = driver.createTimerQuery();
+    }
+    lap.elapsed = 0;
+    lap.id = id;
+    driver.beginTimerQuery(lap.query);
+    mCurrentGpuLap = &lap;
+}
+
+void FrameInfoManager::endGpuLap(driver::DriverApi& driver) noexcept {
+    if (mCurrentGpuLap) {
+        driver.endTimerQuery(mCurrentGpuLap->query);
+        mCurrentGpuLap = nullptr;
+    }
+}
+
+void FrameInfoManager::resolveGpuFrame(driver::DriverApi& driver, GpuFrame& frame) noexcept {
+    if (!frame.lapCount || &frame == &mGpuFrames[mCurrentGpuFrame]) {
+        return;
+    }
+
+    bool done = true;
+    for (size_t i = 0; i < frame.lapCount; i++) {
+        GpuLap& lap = frame.laps[i];
+        if (!lap.elapsed) {
+            done &= driver.getTimerQueryValue(lap.query, &lap.elapsed);
+        }
+    }
+    if (!done) {
+        return;
+    }
+
+    GpuFrameInfo info;
+    info.frame = frame.frame;
+    for (size_t i = 0; i < frame.lapCount; i++) {
+        GpuLap const& lap = frame.laps[i];
+        const duration d = std::chrono::duration<uint64_t, std::nano>(lap.elapsed);
+        info.laps[lap.id] += d;
+        info.total += d;
+    }
+    mLastGpuFrameInfo = info;
+
+    // the queries are kept for the next time this frame is used
+    frame.lapCount = 0;
+}
+
+void FrameInfoManager::terminateGpuTimings(driver::DriverApi& driver) noexcept {
+    endGpuLap(driver);
+    for (GpuFrame& frame : mGpuFrames) {
+        for (GpuLap& lap : frame.laps) {
+            if (lap.query) {
+                driver.destroyTimerQuery(lap.query);
+                lap.query.clear();
+            }
+        }
+        frame.lapCount = 0;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+
 FrameInfoManager::SyncThread::~SyncThread() {
     if (mThread.joinable()) {
         requestExitAndWait();
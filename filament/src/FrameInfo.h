@@ -58,6 +58,11 @@ public:
         LAP_3,
         LAP_4,
         LAP_5,
+
+        // GPU time laps, see FrameInfoManager::beginGpuLap()
+        GPU_SHADOW_PASS = LAP_0,
+        GPU_COLOR_PASS = LAP_1,
+        GPU_POST_PROCESS = LAP_2,
     };
 
     void beginFrame(FrameInfoManager* mgr);
@@ -128,6 +133,35 @@ public:
         return mFrameInfoHistory;
     }
 
+    // GPU time taken by a frame, measured with timer queries
+    struct GpuFrameInfo {
+        uint32_t frame = 0;
+        duration laps[FrameInfo::MAX_LAPS_IDS] = {};    // indexed by the laps' lap_id
+        duration total = {};                            // sum of the laps
+    };
+
+    // Call once per frame before beginGpuLap(), this collects the measurements of the previous
+    // frames that the GPU is done with.
+    void beginGpuFrame(driver::DriverApi& driver, uint32_t frameId) noexcept;
+
+    // Measures the GPU time taken by the commands issued until endGpuLap(), laps can't be
+    // nested. The laps of a frame with the same id are added up.
+    void beginGpuLap(driver::DriverApi& driver, FrameInfo::lap_id id) noexcept;
+    void endGpuLap(driver::DriverApi& driver) noexcept;
+
+    // Returns false until a frame has been measured entirely, or if the driver can't measure
+    // the GPU time.
+    bool getLastGpuFrameInfo(GpuFrameInfo* info) const noexcept {
+        if (mLastGpuFrameInfo.total.count() > 0) {
+            *info = mLastGpuFrameInfo;
+            return true;
+        }
+        return false;
+    }
+
+    // Frees the timer queries, call before destroying this object.
+    void terminateGpuTimings(driver::DriverApi& driver) noexcept;
+
     // no user serviceable part below...
 
     template<typename CALLABLE, typename ... ARGS>
@@ -177,6 +211,31 @@ private:
 
     mutable std::mutex mLock;
     std::vector<FrameInfo> mFrameInfoHistory;
+
+    // frames whose timer queries may still be in flight, this must be more than the latency of
+    // the GPU or the measurements are dropped
+    static constexpr size_t GPU_FRAME_COUNT = 8;
+
+    struct GpuLap {
+        Handle<HwTimerQuery> query;
+        uint64_t elapsed = 0;   // in nanoseconds, 0 until known
+        FrameInfo::lap_id id = FrameInfo::LAP_0;
+    };
+
+    struct GpuFrame {
+        uint32_t frame = 0;
+        uint32_t lapCount = 0;
+        GpuLap laps[FrameInfo::MAX_LAPS_IDS];
+    };
+
+    void resolveGpuFrame(driver::DriverApi& driver, GpuFrame& frame) noexcept;
+
+    // these are only accessed from the application thread
+    GpuFrame mGpuFrames[GPU_FRAME_COUNT];
+    size_t mCurrentGpuFrame = 0;
+    GpuLap* mCurrentGpuLap = nullptr;
+    GpuFrameInfo mLastGpuFrameInfo;
+    int8_t mGpuTimingsSupported = -1;   // not known until the first frame
 };
 
 
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/FramePacer.h"
+
+#include <utils/compiler.h>
+#include <utils/Systrace.h>
+
+#include <math/scalar.h>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace filament {
+namespace details {
+
+// beyond this many refresh periods without a frame, we stop following the previous cadence
+static constexpr float MAX_CADENCE_GAP = 4.0f;
+
+void FramePacer::setOptions(Options const& options) noexcept {
+    mOptions = options;
+    mOptions.refreshRate = math::clamp(options.refreshRate, 1.0f, 1000.0f);
+    mOptions.headRoomRatio = math::clamp(options.headRoomRatio, 0.0f, 1.0f);
+    mLastTarget = {};
+}
+
+FramePacer::duration FramePacer::filter(duration estimate, duration sample) noexcept {
+    if (sample >= estimate) {
+        return sample;
+    }
+    return estimate + (sample - estimate) * 0.1f;
+}
+
+FramePacer::time_point FramePacer::beginFrame(duration gpuTime) noexcept {
+    mGpuTime = filter(mGpuTime, gpuTime);
+
+    time_point now = clock::now();
+    time_point target = now;
+
+    if (isJustInTime()) {
+        const duration period = getRefreshPeriod();
+        const duration work = mCpuTime + mGpuTime + period * mOptions.headRoomRatio;
+        const time_point earliest = now + std::chrono::duration_cast<clock::duration>(work);
+        const float slots = duration(earliest - mLastTarget).count() / period.count();
+
+        if (mLastTarget == time_point{} || slots > MAX_CADENCE_GAP) {
+            // no cadence to follow, start a new one from the earliest possible vsync
+            target = earliest;
+        } else {
+            // the first vsync after the last presented frame we can make
+            const float k = std::max(1.0f, std::ceil(slots));
+            mStats.missedVsyncCount += uint32_t(k) - 1;
+            target = mLastTarget + std::chrono::duration_cast<clock::duration>(period * k);
+        }
+
+        const time_point start = target - std::chrono::duration_cast<clock::duration>(work);
+        if (UTILS_HAS_THREADING && start > now) {
+            SYSTRACE_NAME("FramePacer::wait");
+            std::this_thread::sleep_until(start);
+            now = clock::now();
+        }
+    }
+
+    mFrameStart = now;
+    mTarget = target;
+    return target;
+}
+
+void FramePacer::skipFrame() noexcept {
+    mStats.skippedFrameCount++;
+}
+
+void FramePacer::endFrame() noexcept {
+    const time_point now = clock::now();
+    mCpuTime = filter(mCpuTime, now - mFrameStart);
+    if (isJustInTime()) {
+        // the GPU can't start before we're done, so the frame can't be ready before this
+        if (now + std::chrono::duration_cast<clock::duration>(mGpuTime) > mTarget) {
+            mStats.lateFrameCount++;
+        }
+        mLastTarget = mTarget;
+    }
+    mStats.frameCount++;
+}
+
+void FramePacer::getStats(Stats* stats) noexcept {
+    mStats.cpuTime = mCpuTime.count();
+    mStats.gpuTime = mGpuTime.count();
+    *stats = mStats;
+    mStats = {};
+}
+
+} // namespace details
+} // namespace filament
@@ -35,11 +35,27 @@ FrameSkipper::~FrameSkipper() noexcept {
     }
 }
 
+void FrameSkipper::setLatency(size_t latency) noexcept {
+    latency = std::max(latency, size_t(1));
+    auto& fences = mFences;
+    // forget about the oldest frames when lowering the latency, we don't wait for them
+    while (fences.size() > latency) {
+        FFence* fence = fences.front();
+        if (fence) {
+            mEngine.destroy(fence);
+        }
+        fences.pop_front();
+    }
+    while (fences.size() < latency) {
+        fences.push_front(nullptr);
+    }
+}
+
 void FrameSkipper::endFrame() noexcept {
     mFences.push_back( mEngine.createFence(Fence::Type::HARD) );
 }
 
-bool FrameSkipper::skipFrameNeeded() const noexcept {
+bool FrameSkipper::skipFrameNeeded(uint64_t timeout) const noexcept {
     if (mExtraSkipCount) {
         mExtraSkipCount--;
         return true;
@@ -52,7 +68,7 @@ bool FrameSkipper::skipFrameNeeded() const noexcept {
     auto& fences = mFences;
     FFence* fence = fences.front();
     if (fence) {
-        auto status = fence->wait(Fence::Mode::DONT_FLUSH, 0);
+        auto status = fence->wait(Fence::Mode::DONT_FLUSH, timeout);
         if (status == Fence::FenceStatus::TIMEOUT_EXPIRED) {
             // fence not ready, skip frame
             mExtraSkipCount = 0;
@@ -15,6 +15,7 @@
  */
 
 #include "details/Froxelizer.h"
+#include "details/HiZBuffer.h"
 
 #include "Intersections.h"
 
@@ -25,6 +26,7 @@
 
 #include <utils/Allocator.h>
 #include <utils/BinaryTreeArray.h>
+#include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
 #include <math/mat4.h>
@@ -80,9 +82,13 @@ constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFE
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
                                                  (FROXEL_BUFFER_ENTRY_COUNT_MAX +
                                                   FROXEL_BUFFER_ENTRY_COUNT_MAX + 3 +
-                                                  FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
+                                                  FROXEL_SLICE_COUNT_MAX / 4 + 1);
 
 
+// The depth buffer used for depth bounds is from an earlier frame, so the depth ranges found in
+// it are widened by this ratio (on top of the camera movement).
+static constexpr float DEPTH_BOUNDS_RELATIVE_MARGIN = 1.0f / 16.0f;
+
 // number of lights processed by one group (e.g. 32)
 static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8;
 
@@ -107,6 +113,8 @@ Froxelizer::Froxelizer(FEngine& engine)
     mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
     mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
+
+    mFroxelShardedData.resize(GROUP_COUNT);
 }
 
 Froxelizer::~Froxelizer() {
@@ -134,6 +142,25 @@ void Froxelizer::setOptions(float zLightNear, float zLightFar) noexcept {
     }
 }
 
+void Froxelizer::setFroxelOptions(View::FroxelOptions const& options) noexcept {
+    // we need at least two slices for the z distribution, and one froxel per slice
+    View::FroxelOptions clamped;
+    clamped.sliceCount = uint8_t(clamp(size_t(options.sliceCount),
+            size_t(2), FROXEL_SLICE_COUNT_MAX));
+    clamped.froxelCount = uint16_t(clamp(size_t(options.froxelCount),
+            size_t(clamped.sliceCount), FROXEL_BUFFER_ENTRY_COUNT_MAX));
+    clamped.maxLightsPerFroxel = std::max(options.maxLightsPerFroxel, uint8_t(1));
+    clamped.depthBounds = options.depthBounds;
+    if (UTILS_UNLIKELY(mFroxelOptions.froxelCount != clamped.froxelCount ||
+                       mFroxelOptions.sliceCount != clamped.sliceCount)) {
+        mDirtyFlags |= VIEWPORT_CHANGED;
+    }
+    if (UTILS_UNLIKELY(mFroxelOptions.maxLightsPerFroxel != clamped.maxLightsPerFroxel)) {
+        // the froxels are unchanged, but their records must be assigned again
+        mFroxelShardedDataValid = false;
+    }
+    mFroxelOptions = clamped;
+}
 
 void Froxelizer::setViewport(Viewport const& viewport) noexcept {
     if (UTILS_UNLIKELY(mViewport != viewport)) {
@@ -185,21 +212,13 @@ bool Froxelizer::prepare(
             arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // froxel thread data (~256 KiB)
-    mFroxelShardedData = {
-            arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
-            uint32_t(GROUP_COUNT)
-    };
-
     assert(mFroxelBufferUser.begin());
     assert(mRecordBufferUser.begin());
     assert(mLightRecords.begin());
-    assert(mFroxelShardedData.begin());
 
 #ifndef NDEBUG
     memset(mFroxelBufferUser.data(),    0x55, mFroxelBufferUser.sizeInBytes());
     memset(mRecordBufferUser.data(),    0xEB, mRecordBufferUser.sizeInBytes());
-    memset(mFroxelShardedData.data(),   0xFD, mFroxelShardedData.sizeInBytes());
 #endif
 
     return uniformsNeedUpdating;
@@ -207,18 +226,20 @@ bool Froxelizer::prepare(
 
 void Froxelizer::computeFroxelLayout(
         uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-        Viewport const& viewport) noexcept {
+        Viewport const& viewport) const noexcept {
 
     if (SUPPORTS_NON_SQUARE_FROXELS == false) {
-        // calculate froxel dimension from FROXEL_BUFFER_ENTRY_COUNT_MAX and viewport
+        // calculate froxel dimension from the froxel budget and viewport
         // - Start from the maximum number of froxels we can use in the x-y plane
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
-        size_t froxelPlaneCount = FROXEL_BUFFER_ENTRY_COUNT_MAX / froxelSliceCount;
+        size_t froxelSliceCount = mFroxelOptions.sliceCount;
+        size_t froxelPlaneCount = mFroxelOptions.froxelCount / froxelSliceCount;
         // - compute the number of square froxels we need in width and height, rounded down
         //   solving: |  froxelCountX * froxelCountY == froxelPlaneCount
         //            |  froxelCountX / froxelCountY == width / height
-        size_t froxelCountX = size_t(std::sqrt(froxelPlaneCount * viewport.width  / viewport.height));
-        size_t froxelCountY = size_t(std::sqrt(froxelPlaneCount * viewport.height / viewport.width));
+        size_t froxelCountX = std::max(size_t(1),
+                size_t(std::sqrt(froxelPlaneCount * viewport.width  / viewport.height)));
+        size_t froxelCountY = std::max(size_t(1),
+                size_t(std::sqrt(froxelPlaneCount * viewport.height / viewport.width)));
         // - copmute the froxels dimensions, rounded up
         size_t froxelSizeX = (viewport.width  + froxelCountX - 1) / froxelCountX;
         size_t froxelSizeY = (viewport.height + froxelCountY - 1) / froxelCountY;
@@ -241,7 +262,7 @@ void Froxelizer::computeFroxelLayout(
         if (viewport.height > viewport.width) {
             std::swap(*countX, *countY);
         }
-        *countZ = uint16_t(FEngine::CONFIG_FROXEL_SLICE_COUNT);
+        *countZ = uint16_t(mFroxelOptions.sliceCount);
          dim->x = (viewport.width  + *countX - 1) / *countX;
          dim->y = (viewport.height + *countY - 1) / *countY;
     }
@@ -265,12 +286,12 @@ bool Froxelizer::update() noexcept {
         uniformsNeedUpdating = true;
 
 #ifndef NDEBUG
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
+        size_t froxelSliceCount = froxelCountZ;
         slog.d << "Froxel: " << viewport.width << "x" << viewport.height << " / "
                << froxelDimension.x << "x" << froxelDimension.y << io::endl
                << "Froxel: " << froxelCountX << "x" << froxelCountY << "x" << froxelSliceCount
                << " = " << (froxelCountX * froxelCountY * froxelSliceCount)
-               << " (" << FROXEL_BUFFER_ENTRY_COUNT_MAX - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
+               << " (" << mFroxelOptions.froxelCount - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
                << io::endl;
 #endif
 
@@ -332,6 +353,9 @@ bool Froxelizer::update() noexcept {
         }
     }
 
+    // the froxels changed, all lights need to be binned again
+    mFroxelShardedDataValid = false;
+
     if (UTILS_UNLIKELY(mDirtyFlags & (PROJECTION_CHANGED | VIEWPORT_CHANGED))) {
         assert(mDistancesZ);
         assert(mPlanesX);
@@ -530,16 +554,31 @@ void Froxelizer::commit(driver::DriverApi& driverApi) {
 #ifndef NDEBUG
     mFroxelBufferUser.clear();
     mRecordBufferUser.clear();
-    mFroxelShardedData.clear();
 #endif
 }
 
 void Froxelizer::froxelizeLights(FEngine& engine,
         CameraInfo const& UTILS_RESTRICT camera,
-        const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
+        const FScene::LightSoa& UTILS_RESTRICT lightData,
+        HiZBuffer const* depth, float depthMargin) noexcept {
     // note: this is called asynchronously
-    froxelizeLoop(engine, camera, lightData);
-    froxelizeAssignRecordsCompress();
+    const bool lightsChanged = froxelizeLoop(engine, camera, lightData);
+    if (!lightsChanged && !depth && !mDepthBoundsApplied) {
+        // no light nor the camera moved, what's on the GPU is still valid
+        return;
+    }
+    mDepthBoundsApplied = depth != nullptr;
+
+    size_t recordCount = 0;
+    mStatistics = {};
+    mStatistics.froxelCount = uint32_t(getFroxelCount());
+    if (lightData.size() > FScene::DIRECTIONAL_LIGHTS_COUNT) {
+        recordCount = froxelizeAssignRecordsCompress(engine.getJobSystem(), depth, depthMargin);
+    } else {
+        // without point or spot lights, all froxels are empty
+        memset(mFroxelBufferUser.data(), 0, getFroxelCount() * sizeof(FroxelEntry));
+    }
+    invalidateChangedRows(recordCount);
 
 #ifndef NDEBUG
     if (lightData.size()) {
@@ -565,44 +604,86 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 #endif
 }
 
-void Froxelizer::froxelizeLoop(FEngine& engine,
+bool Froxelizer::froxelizeLoop(FEngine& engine,
         const CameraInfo& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-    memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
-
     auto& lcm = engine.getLightManager();
     auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT bounds       = lightData.data<FScene::BOUNDING_SPHERE>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
 
-    auto process = [ this, &froxelThreadData,
-                     spheres, directions, instances, &camera, &lcm ]
-            (size_t count, size_t offset, size_t stride) {
-
-        const mat4f& projection = mProjection;
-        const mat3f& vn = camera.view.upperLeft();
-
-        for (size_t i = offset; i < count; i += stride) {
+    const size_t count = lightData.size() > FScene::DIRECTIONAL_LIGHTS_COUNT ?
+            lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT : 0;
+    const size_t previousCount = mFroxelShardedDataValid ? mLightParams.size() : 0;
+    std::vector<LightParams>& lightParams = mLightParams;
+    lightParams.resize(std::max(count, previousCount));
+
+    // Find the lights that need to be binned (again), that's all of them if the froxels changed.
+    // Lights are identified by their index, so a light that went away only needs clearing.
+    std::array<bool, CONFIG_MAX_LIGHT_COUNT> changed;
+    std::array<LightGroupType, GROUP_COUNT> clearMasks{};
+    bool anyChanged = !mFroxelShardedDataValid;
+    const mat3f& vn = camera.view.upperLeft();
+    for (size_t i = 0, c = lightParams.size(); i < c; i++) {
+        LightParams light;
+        if (i < count) {
             const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
             FLightManager::Instance li = instances[j];
-            LightParams light = {
+            light = {
                     .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
                     .cosSqr = lcm.getCosOuterSquared(li),   // spot only
                     .axis = vn * directions[j],             // spot only
                     .invSin = lcm.getSinInverse(li),        // spot only
-                    .radius = spheres[j].w,
+                    .bounds = { (camera.view * float4{ bounds[j].xyz, 1 }).xyz, bounds[j].w },
             };
+        }
+        changed[i] = !mFroxelShardedDataValid || i >= previousCount || i >= count ||
+                !(lightParams[i] == light);
+        if (changed[i]) {
+            clearMasks[i % GROUP_COUNT] |= LightGroupType(1) << (i / GROUP_COUNT);
+            lightParams[i] = light;
+            anyChanged = true;
+        }
+    }
+    lightParams.resize(count);
+
+    if (!anyChanged) {
+        return false;
+    }
+
+    Slice<FroxelThreadData> froxelThreadData(mFroxelShardedData.data(), uint32_t(GROUP_COUNT));
+    if (!mFroxelShardedDataValid) {
+        memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+        mFroxelShardedDataValid = true;
+    }
+
+    auto process = [ this, &froxelThreadData, &lightParams, &changed, &clearMasks ]
+            (size_t count, size_t offset, size_t stride) {
+
+        const mat4f& projection = mProjection;
+
+        // remove the lights we're about to bin again from this group
+        FroxelThreadData& threadData = froxelThreadData[offset];
+        const LightGroupType clearMask = clearMasks[offset];
+        if (clearMask) {
+            for (LightGroupType& bits : threadData) {
+                bits &= ~clearMask;
+            }
+        }
 
-            const size_t group = i % GROUP_COUNT;
+        for (size_t i = offset; i < count; i += stride) {
+            if (!changed[i]) {
+                continue;
+            }
+            LightParams const& light = lightParams[i];
             const size_t bit   = i / GROUP_COUNT;
             assert(bit < LIGHT_PER_GROUP);
 
-            FroxelThreadData& threadData = froxelThreadData[group];
             const bool isSpot = light.invSin != std::numeric_limits<float>::infinity();
-            threadData[0] |= isSpot << bit;
+            threadData[0] |= LightGroupType(isSpot) << bit;
             froxelizePointAndSpotLight(threadData, bit, projection, light);
         }
     };
@@ -614,22 +695,23 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
     if (!SINGLE_THREADED) {
         auto parent = js.createJob();
         for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+            js.run(jobs::createJob(js, parent, std::cref(process), count, i, GROUP_COUNT));
         }
         js.runAndWait(parent);
     } else {
-        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
-        );
+        for (size_t i = 0; i < GROUP_COUNT; i++) {
+            process(count, i, GROUP_COUNT);
+        }
     }
+    return true;
 }
 
-void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
+size_t Froxelizer::froxelizeAssignRecordsCompress(JobSystem& js,
+        HiZBuffer const* depth, float depthMargin) noexcept {
 
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
+    Slice<FroxelThreadData> froxelThreadData(mFroxelShardedData.data(), uint32_t(GROUP_COUNT));
 
     // convert froxel data from N groups of M bits to LightRecord::bitset, so we can
     // easily compare adjacent froxels, for compaction. The conversion loops below get
@@ -647,114 +729,325 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
         spotLights.getBitsAt(i) = b;
     }
 
+    // The froxels are processed by Z slices, each one by a job. A slice's records are only
+    // shared among its own froxels and appended after the previous slice's ones.
+    const size_t froxelCountX = mFroxelCountX;
+    const size_t sliceSize = froxelCountX * mFroxelCountY;
+    const uint32_t sliceCount = mFroxelCountZ;
+
     // this gets very well vectorized...
     utils::Slice<LightRecord> records(mLightRecords);
-    for (size_t j = 1, jc = FROXEL_BUFFER_ENTRY_COUNT_MAX; j < jc; j++) {
-        for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
-            using container_type = LightRecord::bitset::container_type;
-            constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
-            container_type b = froxelThreadData[i * r][j];
-            for (size_t k = 0; k < r; k++) {
-                b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+    auto mergeSlices = [&froxelThreadData, &records, sliceSize](uint32_t start, uint32_t c) {
+        for (size_t j = start * sliceSize + 1, jc = (start + c) * sliceSize + 1; j < jc; j++) {
+            for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
+                using container_type = LightRecord::bitset::container_type;
+                constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
+                container_type b = froxelThreadData[i * r][j];
+                for (size_t k = 0; k < r; k++) {
+                    b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+                }
+                records[j - 1].lights.getBitsAt(i) = b;
             }
-            records[j - 1].lights.getBitsAt(i) = b;
         }
+    };
+    auto jobMerge = jobs::parallel_for(js, nullptr, 0, sliceCount,
+            std::cref(mergeSlices), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobMerge);
+
+    if (depth) {
+        applyDepthBounds(records, *depth, depthMargin);
     }
 
-    uint16_t offset = 0;
     FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
 
-    const size_t froxelCountX = mFroxelCountX;
-    auto remap = [stride = size_t(froxelCountX * mFroxelCountY)](size_t i) -> size_t {
+    auto remap = [stride = sliceSize, sliceCount = size_t(sliceCount)](size_t i) -> size_t {
         if (SUPPORTS_REMAPPED_FROXELS) {
             // TODO: with the non-square froxel change these would be mask ops instead of divide.
-            i = (i % stride) * FEngine::CONFIG_FROXEL_SLICE_COUNT + (i / stride);
+            i = (i % stride) * sliceCount + (i / stride);
         }
         return i;
     };
 
-    RecordBufferType* const UTILS_RESTRICT froxelRecords = mRecordBufferUser.data();
-
-    // how many froxel record entries were reused (for debugging)
-    UTILS_UNUSED size_t reused = 0;
+    struct SliceRecords {
+        uint32_t offset;            // of the slice's records, after the prefix sum
+        uint32_t count;             // records of the slice
+        uint32_t end;               // froxels from here on didn't fit, even in an empty buffer
+        uint32_t truncatedFroxelCount;
+        uint32_t overflowFroxelCount;
+        uint32_t recordEnd;         // end of the records that fit in the buffer
+    };
+    std::array<SliceRecords, FROXEL_SLICE_COUNT_MAX> slices;
+    const size_t maxLightsPerFroxel = mFroxelOptions.maxLightsPerFroxel;
+
+    // First, each slice finds the froxels that share their records, and their offsets relative
+    // to the slice's first record.
+    auto compactSlices = [&records, froxels, &slices, &spotLights, &remap,
+            froxelCountX, sliceSize, maxLightsPerFroxel](uint32_t start, uint32_t c) {
+        for (uint32_t s = start; s < start + c; s++) {
+            const size_t first = s * sliceSize;
+            const size_t last = first + sliceSize;
+            size_t offset = 0;
+            size_t i = first;
+            while (i < last) {
+                LightRecord b = records[i];
+                if (b.lights.none()) {
+                    froxels[remap(i++)].u32 = 0;
+                    continue;
+                }
 
-    for (size_t i = 0, c = getFroxelCount(); i < c;) {
-        LightRecord b = records[i];
-        if (b.lights.none()) {
-            froxels[remap(i++)].u32 = 0;
-            continue;
+                // We keep at most maxLightsPerFroxel lights per froxel, point lights first.
+                const size_t pointLightCount = (b.lights & ~spotLights).count();
+                const size_t spotLightCount  = (b.lights &  spotLights).count();
+                const size_t keptPointLightCount = std::min(maxLightsPerFroxel, pointLightCount);
+                FroxelEntry entry = {
+                        .offset = uint16_t(offset),
+                        .pointLightCount = (uint8_t)keptPointLightCount,
+                        .spotLightCount  = (uint8_t)std::min(
+                                maxLightsPerFroxel - keptPointLightCount, spotLightCount)
+                };
+                const size_t lightCount = entry.count[0] + entry.count[1];
+                if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
+                    break;
+                }
+                offset += lightCount;
+
+                do {
+                    froxels[remap(i++)].u32 = entry.u32;
+                    if (i >= last) break;
+
+                    if (records[i].lights != b.lights && i >= first + froxelCountX) {
+                        // if this froxel record doesn't match the previous one on its left,
+                        // we re-try with the record above it, which saves many froxel records
+                        // (north of 10% in practice).
+                        b = records[i - froxelCountX];
+                        entry.u32 = froxels[remap(i - froxelCountX)].u32;
+                    }
+                } while(records[i].lights == b.lights);
+            }
+            slices[s].count = uint32_t(offset);
+            slices[s].end = uint32_t(i);
+            for (; i < last; i++) { // this compiles to memset() when remap() is identity
+                froxels[remap(i)].u32 = 0;
+            }
         }
+    };
+    auto jobCompact = jobs::parallel_for(js, nullptr, 0, sliceCount,
+            std::cref(compactSlices), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobCompact);
+
+    // the slices' records are laid out one after the other
+    slices[0].offset = 0;
+    for (uint32_t s = 1; s < sliceCount; s++) {
+        slices[s].offset = slices[s - 1].offset + slices[s - 1].count;
+    }
 
-        // We have a limitation of 255 spot + 255 point lights per froxel.
-        FroxelEntry entry = {
-                .offset = offset,
-                .pointLightCount = (uint8_t)std::min(size_t(255), (b.lights & ~spotLights).count()),
-                .spotLightCount  = (uint8_t)std::min(size_t(255), (b.lights &  spotLights).count())
-        };
-        const size_t lightCount = entry.count[0] + entry.count[1];
+    // Then each slice writes its records, and rebases the offsets of its froxels. The froxels
+    // whose records end past the buffer are left without lights.
+    RecordBufferType* const UTILS_RESTRICT froxelRecords = mRecordBufferUser.data();
+    auto writeSlices = [&records, froxels, froxelRecords, &slices, &spotLights, &remap,
+            sliceSize](uint32_t start, uint32_t c) {
+        for (uint32_t s = start; s < start + c; s++) {
+            SliceRecords& slice = slices[s];
+            const size_t first = s * sliceSize;
+            const size_t last = first + sliceSize;
+            size_t next = 0;    // relative offset of the next froxel owning its records
+            uint32_t truncatedFroxelCount = 0;
+            uint32_t overflowFroxelCount = 0;
+            uint32_t recordEnd = 0;
+            for (size_t i = first; i < slice.end; i++) {
+                FroxelEntry& entry = froxels[remap(i)];
+                LightRecord const& b = records[i];
+                if (b.lights.none()) {
+                    continue;
+                }
 
-        if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
+                const size_t lightCount = entry.count[0] + entry.count[1];
+                const size_t offset = slice.offset + entry.offset;
+                const bool owner = entry.offset == next && lightCount;
+                next += owner ? lightCount : 0;
+                if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
+                    // note: instead of dropping froxels we could look for similar records
+                    // we've already filed up.
+                    entry.u32 = 0;
+                    overflowFroxelCount++;
+                    continue;
+                }
+                truncatedFroxelCount += lightCount < b.lights.count() ? 1 : 0;
+                entry.offset = uint16_t(offset);
+                if (!owner) {
+                    continue;
+                }
+                recordEnd = uint32_t(offset + lightCount);
+
+                // iterate the bitfield. A kind of light without any entry writes to a scratch
+                // entry, the records past this froxel's may be another slice's.
+                RecordBufferType discard;
+                auto beginPoint = entry.count[0] ? froxelRecords + offset : &discard;
+                auto beginSpot  = entry.count[1] ? froxelRecords + offset + entry.count[0] :
+                        &discard;
+                b.lights.forEachSetBit([&spotLights, &entry,
+                        point = beginPoint, spot = beginSpot, beginPoint, beginSpot]
+                        (size_t l) mutable {
+
+                    // make sure to keep this code branch-less
+                    const bool isSpot = spotLights[l];
+                    auto& p = isSpot ? spot      : point;
+                    auto  s = isSpot ? beginSpot : beginPoint;
+                    const ptrdiff_t count = entry.count[isSpot];
+
+                    const size_t word = l / LIGHT_PER_GROUP;
+                    const size_t bit  = l % LIGHT_PER_GROUP;
+                    l = (bit * GROUP_COUNT) | (word % GROUP_COUNT);
+
+                    *p = (RecordBufferType)l;
+                    // we need to "cancel" the write once we have as many spot or point lights
+                    // as the froxel keeps: the last entry is overwritten instead.
+                    p += (p - s + 1 < count) ? 1 : 0;
+                });
+            }
+            for (size_t i = slice.end; i < last; i++) {
+                overflowFroxelCount += records[i].lights.any() ? 1 : 0;
+            }
+            slice.truncatedFroxelCount = truncatedFroxelCount;
+            slice.overflowFroxelCount = overflowFroxelCount;
+            slice.recordEnd = recordEnd;
+        }
+    };
+    auto jobWrite = jobs::parallel_for(js, nullptr, 0, sliceCount,
+            std::cref(writeSlices), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobWrite);
+
+    size_t recordCount = 0;
+    for (uint32_t s = 0; s < sliceCount; s++) {
+        recordCount = std::max(recordCount, size_t(slices[s].recordEnd));
+        mStatistics.truncatedFroxelCount += slices[s].truncatedFroxelCount;
+        mStatistics.overflowFroxelCount += slices[s].overflowFroxelCount;
+    }
 #ifndef NDEBUG
-            slog.d << "out of space: " << i << ", at " << offset << io::endl;
+    if (mStatistics.overflowFroxelCount) {
+        slog.d << "out of space: " << mStatistics.overflowFroxelCount << " froxels" << io::endl;
+    }
 #endif
-            // note: instead of dropping froxels we could look for similar records we've already
-            // filed up.
-            do { // this compiles to memset() when remap() is identity
-                froxels[remap(i++)].u32 = 0;
-            } while(i < c);
-            goto out_of_memory;
-        }
-
-        // iterate the bitfield
-        auto beginPoint = froxelRecords + offset;
-        auto beginSpot  = froxelRecords + offset + entry.count[0];
-        b.lights.forEachSetBit([&spotLights,
-                point = beginPoint, spot = beginSpot, beginPoint, beginSpot]
-                (size_t l) mutable {
+    mStatistics.recordCount = uint32_t(recordCount);
+    return recordCount;
+}
 
-            // make sure to keep this code branch-less
-            const bool isSpot = spotLights[l];
-            auto& p = isSpot ? spot      : point;
-            auto  s = isSpot ? beginSpot : beginPoint;
+float Froxelizer::getDistanceAtDepth(float depth) const noexcept {
+    const float nz = depth * 2.0f - 1.0f;
+    const float Pz = mProjection[2][2];
+    const float Pw = mProjection[3][2];
+    if (mProjection[2][3] != 0) {
+        // perspective projection, see update(): vz = -Pw / (nz + Pz)
+        // the denominator reaches 0 at the far plane of infinite projections
+        const float d = nz + Pz;
+        return d < 0 ? Pw / d : std::numeric_limits<float>::infinity();
+    }
+    // orthographic projection: vz = (nz - Pw) / Pz
+    return (Pw - nz) / Pz;
+}
 
-            const size_t word = l / LIGHT_PER_GROUP;
-            const size_t bit  = l % LIGHT_PER_GROUP;
-            l = (bit * GROUP_COUNT) | (word % GROUP_COUNT);
+void Froxelizer::applyDepthBounds(Slice<LightRecord>& records,
+        HiZBuffer const& depth, float depthMargin) const noexcept {
+    SYSTRACE_CALL();
 
-            *p = (RecordBufferType)l;
-            // we need to "cancel" the write if we have more than 255 spot or point lights
-            // (this is a limitation of the data type used to store the light counts per froxel)
-            p += (p - s < 255) ? 1 : 0;
-        });
+    // view-space depth range of each point and spot light, they're all bounded by their sphere
+    std::array<float2, CONFIG_MAX_LIGHT_COUNT> lightRanges;
+    const size_t lightCount = mLightParams.size();
+    for (size_t i = 0; i < lightCount; i++) {
+        float4 const& bounds = mLightParams[i].bounds;
+        lightRanges[i] = { -bounds.z - bounds.w, -bounds.z + bounds.w };
+    }
 
-        offset += lightCount;
+    const size_t froxelCountX = mFroxelCountX;
+    const size_t froxelCountY = mFroxelCountY;
+    const size_t froxelCountZ = mFroxelCountZ;
+    const size_t sliceSize = froxelCountX * froxelCountY;
+    const float2 froxelSize{
+            (2.0f * mFroxelDimension.x) / mViewport.width,
+            (2.0f * mFroxelDimension.y) / mViewport.height };
+
+    for (size_t iy = 0; iy < froxelCountY; iy++) {
+        for (size_t ix = 0; ix < froxelCountX; ix++) {
+            // the geometry may have moved a little since the depth buffer was rendered, so we
+            // look at the neighboring froxels too.
+            const float2 ndcMin = float2{ float(ix), float(iy) } * froxelSize - froxelSize - 1.0f;
+            const float2 ndcMax = ndcMin + froxelSize * 3.0f;
+            const float2 range = depth.getDepthRange(ndcMin, ndcMax);
+            const float nearest = getDistanceAtDepth(range.x) *
+                    (1.0f - DEPTH_BOUNDS_RELATIVE_MARGIN) - depthMargin;
+            const float farthest = getDistanceAtDepth(range.y) *
+                    (1.0f + DEPTH_BOUNDS_RELATIVE_MARGIN) + depthMargin;
+
+            // lights that shine somewhere in this column's geometry
+            LightRecord::bitset lights;
+            for (size_t i = 0; i < lightCount; i++) {
+                const bool overlaps = lightRanges[i].x <= farthest && lightRanges[i].y >= nearest;
+                lights.set((i % GROUP_COUNT) * LIGHT_PER_GROUP + i / GROUP_COUNT, overlaps);
+            }
 
-#ifndef NDEBUG
-        if (lightCount) { reused--; }
-#endif
-        do {
-#ifndef NDEBUG
-            if (lightCount) { reused++; }
-#endif
-            froxels[remap(i++)].u32 = entry.u32;
-            if (i >= c) break;
-
-            if (records[i].lights != b.lights && i >= froxelCountX) {
-                // if this froxel record doesn't match the previous one on its left,
-                // we re-try with the record above it, which saves many froxel records
-                // (north of 10% in practice).
-                b = records[i - froxelCountX];
-                entry.u32 = froxels[remap(i - froxelCountX)].u32;
+            // since the lights were binned per slice already, a light which shares some depth
+            // with both the slice and the geometry also shares depth with their intersection.
+            for (size_t iz = 0; iz < froxelCountZ; iz++) {
+                const float sliceNear = mDistancesZ[iz];
+                const float sliceFar = iz + 1 < froxelCountZ ?
+                        mDistancesZ[iz + 1] : std::numeric_limits<float>::infinity();
+                LightRecord& record = records[ix + iy * froxelCountX + iz * sliceSize];
+                if (sliceNear <= farthest && sliceFar >= nearest) {
+                    record.lights &= lights;
+                } else {
+                    record.lights.reset();
+                }
             }
-        } while(records[i].lights == b.lights);
+        }
+    }
+}
+
+// invalidates the rows of 'buffer' where 'data' differs from 'shadow', and updates 'shadow'
+template<typename T>
+static void invalidateRowsDifferingFrom(GPUBuffer& buffer, T const* UTILS_RESTRICT data,
+        std::vector<T>& shadow, size_t rowSize, size_t rowCount) noexcept {
+    const size_t rowSizeInBytes = rowSize * sizeof(T);
+    if (shadow.size() < rowSize * rowCount) {
+        // this is the first upload of these rows, make sure they all appear changed
+        const size_t first = shadow.size() / rowSize;
+        shadow.resize(rowSize * rowCount);
+        memcpy(shadow.data() + first * rowSize, data + first * rowSize,
+                (rowCount - first) * rowSizeInBytes);
+        buffer.invalidate(first, rowCount - first);
+        rowCount = first;
     }
-out_of_memory:
 
-    // froxel buffer is always fully invalidated
-    mFroxelBuffer.invalidate();
+    T* const UTILS_RESTRICT copy = shadow.data();
+    for (size_t row = 0; row < rowCount;) {
+        const size_t first = row;
+        while (row < rowCount &&
+                memcmp(data + row * rowSize, copy + row * rowSize, rowSizeInBytes) != 0) {
+            memcpy(copy + row * rowSize, data + row * rowSize, rowSizeInBytes);
+            row++;
+        }
+        if (row != first) {
+            buffer.invalidate(first, row - first);
+        }
+        row++;
+    }
+}
+
+void Froxelizer::invalidateChangedRows(size_t recordCount) noexcept {
+    SYSTRACE_CALL();
 
-    // needed record buffer size may change at each frame
-    mRecordsBuffer.invalidate(0, (offset + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT);
+    // Froxels are only ever read up to getFroxelCount(), and records up to what froxels
+    // reference. Clear the end of the last rows, so that they compare equal across frames.
+    const size_t froxelRows = (getFroxelCount() + FROXEL_BUFFER_WIDTH_MASK) >> FROXEL_BUFFER_WIDTH_SHIFT;
+    const size_t recordRows = (recordCount + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT;
+    memset(mFroxelBufferUser.data() + getFroxelCount(), 0,
+            (froxelRows * FROXEL_BUFFER_WIDTH - getFroxelCount()) * sizeof(FroxelEntry));
+    memset(mRecordBufferUser.data() + recordCount, 0,
+            (recordRows * RECORD_BUFFER_WIDTH - recordCount) * sizeof(RecordBufferType));
+
+    invalidateRowsDifferingFrom(mFroxelBuffer, mFroxelBufferUser.data(), mFroxelBufferShadow,
+            FROXEL_BUFFER_WIDTH, froxelRows);
+    invalidateRowsDifferingFrom(mRecordsBuffer, mRecordBufferUser.data(), mRecordBufferShadow,
+            RECORD_BUFFER_WIDTH, recordRows);
 }
 
 static inline float2 project(mat4f const& p, float3 const& v) noexcept {
@@ -784,7 +1077,9 @@ void Froxelizer::froxelizePointAndSpotLight(
         mat4f const& UTILS_RESTRICT p,
         const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
 
-    if (UTILS_UNLIKELY(light.position.z + light.radius < -mZLightFar)) { // z values are negative
+    // the froxels are found with the bounding sphere, the spot lights' cone is tested below
+    const float4 bounds = light.bounds;
+    if (UTILS_UNLIKELY(bounds.z + bounds.w < -mZLightFar)) { // z values are negative
         // This light is fully behind LightFar, it doesn't light anything
         // (we could avoid this check if we culled lights using LightFar instead of the
         // culling camera's far plane)
@@ -792,7 +1087,7 @@ void Froxelizer::froxelizePointAndSpotLight(
     }
 
     // the code below works with radius^2
-    const float4 s = { light.position, light.radius * light.radius };
+    const float4 s = { bounds.xyz, bounds.w * bounds.w };
 
 #ifdef DEBUG_FROXEL
     const size_t x0 = 0;
@@ -804,7 +1099,7 @@ void Froxelizer::froxelizePointAndSpotLight(
 #else
     // find a reasonable bounding-box in froxel space for the sphere by projecting
     // it's (clipped) bounding-box to clip-space and converting to froxel indices.
-    Box aabb = { light.position, light.radius };
+    Box aabb = { bounds.xyz, bounds.w };
     const float znear = std::min(-mNear, aabb.center.z + aabb.halfExtent.z); // z values are negative
     const float zfar  =                  aabb.center.z - aabb.halfExtent.z;
 
@@ -22,6 +22,8 @@
 
 #include <private/filament/UibGenerator.h>
 
+#include <new>
+
 namespace filament {
 
 using namespace driver;
@@ -33,6 +35,8 @@ GpuLightBuffer::GpuLightBuffer(FEngine& engine) noexcept
     DriverApi& driverApi = engine.getDriverApi();
     mLightUbh = driverApi.createUniformBuffer(mLightsUb.getSize());
     driverApi.bindUniforms(BindingPoints::LIGHTS, mLightUbh);
+    // the buffer is created uninitialized, the first commit uploads all of it
+    invalidate(0, mLightsUb.getSize() / sizeof(LightParameters));
 }
 
 GpuLightBuffer::~GpuLightBuffer() noexcept = default;
@@ -43,16 +47,35 @@ void GpuLightBuffer::terminate(FEngine& engine) {
 }
 
 void GpuLightBuffer::commit(FEngine& engine) noexcept {
-    if (UTILS_UNLIKELY(mLightsUb.isDirty())) {
+    if (UTILS_UNLIKELY(!mDirtyRanges.isEmpty())) {
         commitSlow(engine);
     }
     engine.getDriverApi().bindUniforms(BindingPoints::LIGHTS, mLightUbh);
 }
 
 void GpuLightBuffer::commitSlow(FEngine& engine) noexcept {
+    // all the modified ranges are uploaded with a single command, so that the command stream
+    // only carries the lights that changed
+    size_t size = 0;
+    for (utils::BufferRange const& range : mDirtyRanges) {
+        size += Driver::UniformRangeUpdate::getRecordSize(
+                range.getCount() * sizeof(LightParameters));
+    }
+
     DriverApi& driverApi = engine.getDriverApi();
-    driverApi.updateUniformBuffer(mLightUbh, UniformBuffer(mLightsUb));
-    mLightsUb.clean();
+    char* const batch = static_cast<char*>(driverApi.allocate(size, 4));
+    char* p = batch;
+    for (utils::BufferRange const& range : mDirtyRanges) {
+        const uint32_t offset = uint32_t(range.start * sizeof(LightParameters));
+        const uint32_t count = uint32_t(range.getCount() * sizeof(LightParameters));
+        Driver::UniformRangeUpdate* const update = new(p) Driver::UniformRangeUpdate{
+                mLightUbh, offset, count };
+        memcpy(update + 1, static_cast<char const*>(mLightsUb.getBuffer()) + offset, count);
+        p += Driver::UniformRangeUpdate::getRecordSize(count);
+    }
+    driverApi.updateUniformBufferRanges({ batch, size });
+    engine.getFrameCounters().add(FrameCounters::UNIFORM_BYTES, size);
+    mDirtyRanges.clear();
 }
 
 } // namespace details
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/HiZBuffer.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <math.h>
+
+using namespace math;
+
+namespace filament {
+namespace details {
+
+void HiZBuffer::build(float const* depth, uint32_t width, uint32_t height,
+        mat4f const& clipFromWorld) {
+    SYSTRACE_CALL();
+
+    clear();
+    if (!width || !height) {
+        return;
+    }
+
+    mClipFromWorld = clipFromWorld;
+
+    // the base level is the depth buffer reduced by a power-of-two, so that all the levels
+    // nest exactly.
+    uint32_t scale = 1;
+    while ((width + scale - 1) / scale > MAX_BASE_SIZE ||
+           (height + scale - 1) / scale > MAX_BASE_SIZE) {
+        scale *= 2;
+    }
+
+    size_t total = 0;
+    uint32_t w = (width + scale - 1) / scale;
+    uint32_t h = (height + scale - 1) / scale;
+    while (true) {
+        mLevels.push_back({ uint32_t(total), w, h });
+        total += w * h;
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    mDepth.resize(total);
+    mMinDepth.resize(total);
+
+    Level const& base = mLevels[0];
+    float* const UTILS_RESTRICT dst = mDepth.data();
+    float* const UTILS_RESTRICT dstMin = mMinDepth.data();
+    for (uint32_t y = 0; y < base.height; y++) {
+        const uint32_t y1 = std::min(height, (y + 1) * scale);
+        for (uint32_t x = 0; x < base.width; x++) {
+            const uint32_t x1 = std::min(width, (x + 1) * scale);
+            float d = 0;
+            float dmin = 1;
+            for (uint32_t sy = y * scale; sy < y1; sy++) {
+                float const* const UTILS_RESTRICT row = depth + sy * width;
+                for (uint32_t sx = x * scale; sx < x1; sx++) {
+                    d = std::max(d, row[sx]);
+                    dmin = std::min(dmin, row[sx]);
+                }
+            }
+            dst[y * base.width + x] = d;
+            dstMin[y * base.width + x] = dmin;
+        }
+    }
+
+    for (size_t l = 1; l < mLevels.size(); l++) {
+        Level const& src = mLevels[l - 1];
+        Level const& level = mLevels[l];
+        for (uint32_t y = 0; y < level.height; y++) {
+            const uint32_t sy0 = y * 2;
+            const uint32_t sy1 = std::min(src.height - 1, sy0 + 1);
+            for (uint32_t x = 0; x < level.width; x++) {
+                const uint32_t sx0 = x * 2;
+                const uint32_t sx1 = std::min(src.width - 1, sx0 + 1);
+                dst[level.offset + y * level.width + x] = std::max(
+                        std::max(fetch(src, sx0, sy0), fetch(src, sx1, sy0)),
+                        std::max(fetch(src, sx0, sy1), fetch(src, sx1, sy1)));
+                dstMin[level.offset + y * level.width + x] = std::min(
+                        std::min(fetchMin(src, sx0, sy0), fetchMin(src, sx1, sy0)),
+                        std::min(fetchMin(src, sx0, sy1), fetchMin(src, sx1, sy1)));
+            }
+        }
+    }
+}
+
+void HiZBuffer::clear() noexcept {
+    mLevels.clear();
+    mDepth.clear();
+    mMinDepth.clear();
+}
+
+uint32_t HiZBuffer::getTexels(float2 lo, float2 hi,
+        uint32_t* ix0, uint32_t* ix1, uint32_t* iy0, uint32_t* iy1) const noexcept {
+    // texel coordinates in the base level, the top row is stored first
+    Level const& base = mLevels[0];
+    const float maxX = base.width - 1;
+    const float maxY = base.height - 1;
+    const float x0 = std::min(maxX, std::max(0.0f, (lo.x * 0.5f + 0.5f) * base.width));
+    const float x1 = std::min(maxX, std::max(0.0f, (hi.x * 0.5f + 0.5f) * base.width));
+    const float y0 = std::min(maxY, std::max(0.0f, (0.5f - hi.y * 0.5f) * base.height));
+    const float y1 = std::min(maxY, std::max(0.0f, (0.5f - lo.y * 0.5f) * base.height));
+
+    // pick the level where the bounds span at most 2x2 texels
+    const float size = std::max(x1 - x0, y1 - y0);
+    const uint32_t l = std::min(uint32_t(mLevels.size() - 1),
+            size > 1 ? uint32_t(ceilf(log2f(size))) : 0u);
+
+    Level const& level = mLevels[l];
+    *ix0 = std::min(level.width - 1, uint32_t(x0) >> l);
+    *ix1 = std::min(level.width - 1, uint32_t(x1) >> l);
+    *iy0 = std::min(level.height - 1, uint32_t(y0) >> l);
+    *iy1 = std::min(level.height - 1, uint32_t(y1) >> l);
+    return l;
+}
+
+bool HiZBuffer::isOccluded(float3 const& center, float3 const& extent) const noexcept {
+    if (UTILS_UNLIKELY(mLevels.empty())) {
+        return false;
+    }
+
+    // screen-space bounds and nearest depth of the box, as seen by the pyramid's camera
+    float3 lo{ INFINITY };
+    float3 hi{ -INFINITY };
+    for (size_t i = 0; i < 8; i++) {
+        const float3 corner = center + extent * float3{
+                (i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f };
+        const float4 p = mClipFromWorld * float4{ corner, 1 };
+        if (p.w <= 0) {
+            // the box crosses the camera plane, it can't be occluded
+            return false;
+        }
+        const float3 ndc = p.xyz * (1 / p.w);
+        lo = min(lo, ndc);
+        hi = max(hi, ndc);
+    }
+
+    if (hi.x < -1 || lo.x > 1 || hi.y < -1 || lo.y > 1 || lo.z < -1) {
+        // this is left to frustum culling
+        return false;
+    }
+
+    uint32_t ix0, ix1, iy0, iy1;
+    Level const& level = mLevels[getTexels(lo.xy, hi.xy, &ix0, &ix1, &iy0, &iy1)];
+    float farthest = 0;
+    for (uint32_t y = iy0; y <= iy1; y++) {
+        for (uint32_t x = ix0; x <= ix1; x++) {
+            farthest = std::max(farthest, fetch(level, x, y));
+        }
+    }
+
+    const float nearest = lo.z * 0.5f + 0.5f;
+    return nearest > farthest;
+}
+
+void HiZBuffer::cull(uint8_t* visibleMask, float3 const* center, float3 const* extent,
+        size_t count, uint8_t test, size_t bit) const noexcept {
+    for (size_t i = 0; i < count; i++) {
+        if ((visibleMask[i] & test) && !isOccluded(center[i], extent[i])) {
+            visibleMask[i] |= uint8_t(1u << bit);
+        }
+    }
+}
+
+float2 HiZBuffer::getDepthRange(float2 ndcMin, float2 ndcMax) const noexcept {
+    if (UTILS_UNLIKELY(mLevels.empty())) {
+        return { 0, 1 };
+    }
+
+    uint32_t ix0, ix1, iy0, iy1;
+    Level const& level = mLevels[getTexels(ndcMin, ndcMax, &ix0, &ix1, &iy0, &iy1)];
+    float2 range{ 1, 0 };
+    for (uint32_t y = iy0; y <= iy1; y++) {
+        for (uint32_t x = ix0; x <= ix1; x++) {
+            range.x = std::min(range.x, fetchMin(level, x, y));
+            range.y = std::max(range.y, fetch(level, x, y));
+        }
+    }
+    return range;
+}
+
+} // namespace details
+} // namespace filament
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IblPrefilter.h"
+
+#include "details/Engine.h"
+#include "details/IndirectLight.h"
+
+#include <filament/EngineEnums.h>
+
+#include <utils/Systrace.h>
+
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace filament {
+
+using namespace driver;
+using namespace details;
+
+static_assert(CONFIG_IBL_SIZE == 1u << (IblPrefilter::REFLECTIONS_LEVELS - 1u),
+        "the reflections must have a level per power of two");
+static_assert(CONFIG_IBL_RGBM, "the reflections are prefiltered in RGBM");
+
+// the SH pass is followed by a pass per face and level of the reflections
+static constexpr uint32_t PASS_COUNT = 1 + 6 * IblPrefilter::REFLECTIONS_LEVELS;
+
+// size of the environment's level projected on the SH, the irradiance is very low frequency
+static constexpr uint32_t SH_SIZE = 16;
+
+// must match IBL_PREFILTER_SAMPLE_COUNT in ibl_prefilter.fs
+static constexpr uint32_t SAMPLE_COUNT = 32;
+
+struct IblPrefilter::Readback {
+    math::float4 sh[9] = {};
+    std::atomic<uint32_t> refs = { 1 };     // the job and, while in flight, the readPixels()
+    std::atomic<bool> ready = { false };
+};
+
+void IblPrefilter::release(Readback* readback) noexcept {
+    if (readback->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete readback;
+    }
+}
+
+void IblPrefilter::add(FEngine& engine, FIndirectLight* light,
+        Handle<HwTexture> environment, uint32_t environmentSize) {
+    auto pos = std::find_if(mJobs.begin(), mJobs.end(),
+            [light](Job const& job) { return job.light == light; });
+    if (pos != mJobs.end()) {
+        // start over, the reflections being prefiltered are overwritten
+        release(pos->readback);
+        pos->readback = new Readback;
+        pos->environment = environment;
+        pos->environmentSize = environmentSize;
+        pos->pass = 0;
+        return;
+    }
+
+    DriverApi& driver = engine.getDriverApi();
+    Handle<HwTexture> reflections = driver.createTexture(SamplerType::SAMPLER_CUBEMAP,
+            REFLECTIONS_LEVELS, TextureFormat::RGBA8, 1, CONFIG_IBL_SIZE, CONFIG_IBL_SIZE, 1,
+            TextureUsage::COLOR_ATTACHMENT);
+    mJobs.push_back({ light, environment, environmentSize, reflections, new Readback });
+}
+
+void IblPrefilter::remove(FEngine& engine, FIndirectLight* light) noexcept {
+    auto pos = std::find_if(mJobs.begin(), mJobs.end(),
+            [light](Job const& job) { return job.light == light; });
+    if (pos != mJobs.end()) {
+        engine.getDriverApi().destroyTexture(pos->reflections);
+        release(pos->readback);
+        mJobs.erase(pos);
+    }
+}
+
+bool IblPrefilter::isPending(FIndirectLight const* light) const noexcept {
+    return std::any_of(mJobs.begin(), mJobs.end(),
+            [light](Job const& job) { return job.light == light; });
+}
+
+void IblPrefilter::terminate(FEngine& engine) noexcept {
+    DriverApi& driver = engine.getDriverApi();
+    for (Job const& job : mJobs) {
+        driver.destroyTexture(job.reflections);
+        release(job.readback);
+    }
+    mJobs.clear();
+}
+
+size_t IblPrefilter::getPassCost(Job const& job) noexcept {
+    if (job.pass == 0) {
+        const size_t size = std::min(SH_SIZE, job.environmentSize);
+        return 9 * 6 * size * size;
+    }
+    const uint32_t level = (job.pass - 1) / 6;
+    const size_t dim = CONFIG_IBL_SIZE >> level;
+    return dim * dim * (level ? SAMPLE_COUNT : 1);
+}
+
+void IblPrefilter::runPass(FEngine& engine, Job& job) {
+    DriverApi& driver = engine.getDriverApi();
+    PostProcessManager const& ppm = engine.getPostProcessManager();
+
+    if (job.pass == 0) {
+        // the passes sample the environment's levels that match their footprint
+        driver.generateMipmaps(job.environment);
+
+        Handle<HwTexture> texture = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+                TextureFormat::RGBA16F, 1, 9, 1, 1, TextureUsage::COLOR_ATTACHMENT);
+        Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+                9, 1, 1, TextureFormat::RGBA16F, { texture }, {}, {});
+
+        ppm.iblPrefilter(engine.getPostProcessProgram(PostProcessStage::IBL_PREFILTER_SH),
+                target, 9, 1, job.environment, 0.0f, 0,
+                float(std::min(SH_SIZE, job.environmentSize)));
+
+        // the SH arrive a few frames later, by then the reflections are usually done
+        Readback* const readback = job.readback;
+        readback->refs.fetch_add(1, std::memory_order_relaxed);
+        driver.readPixels(target, 0, 0, 9, 1, PixelBufferDescriptor(
+                readback->sh, sizeof(readback->sh), PixelDataFormat::RGBA, PixelDataType::FLOAT,
+                [](void*, size_t, void* user) {
+                    Readback* const readback = static_cast<Readback*>(user);
+                    readback->ready.store(true, std::memory_order_release);
+                    release(readback);
+                }, readback));
+
+        driver.destroyRenderTarget(target);
+        driver.destroyTexture(texture);
+        return;
+    }
+
+    const uint32_t level = (job.pass - 1) / 6;
+    const TextureCubemapFace face = TextureCubemapFace((job.pass - 1) % 6);
+    const uint32_t dim = CONFIG_IBL_SIZE >> level;
+    const float lod = level / float(REFLECTIONS_LEVELS - 1);
+
+    Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+            dim, dim, 1, TextureFormat::RGBA8, { job.reflections, uint8_t(level), face }, {}, {});
+
+    ppm.iblPrefilter(engine.getPostProcessProgram(PostProcessStage::IBL_PREFILTER_SPECULAR),
+            target, dim, dim, job.environment, lod * lod, uint8_t(face), float(dim));
+
+    driver.destroyRenderTarget(target);
+}
+
+void IblPrefilter::update(FEngine& engine) {
+    if (mJobs.empty()) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // the lights are prefiltered in the order they were added, with at least one pass per frame
+    size_t budget = MAX_SAMPLES_PER_FRAME;
+    bool first = true;
+    for (size_t i = 0; i < mJobs.size();) {
+        Job& job = mJobs[i];
+        while (job.pass < PASS_COUNT) {
+            const size_t cost = getPassCost(job);
+            if (!first && cost > budget) {
+                break;
+            }
+            runPass(engine, job);
+            job.pass++;
+            budget -= std::min(budget, cost);
+            first = false;
+        }
+
+        if (job.pass < PASS_COUNT) {
+            // we're out of budget for this frame
+            break;
+        }
+
+        if (job.readback->ready.load(std::memory_order_acquire)) {
+            math::float3 sh[9];
+            for (size_t j = 0; j < 9; j++) {
+                sh[j] = job.readback->sh[j].xyz;
+            }
+            // the light now owns the reflections
+            job.light->setPrefiltered(engine, job.reflections, sh);
+            release(job.readback);
+            mJobs.erase(mJobs.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_IBLPREFILTER_H
+#define TNT_FILAMENT_IBLPREFILTER_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FEngine;
+class FIndirectLight;
+} // namespace details
+
+/*
+ * IblPrefilter creates the reflections and irradiance SH of the IndirectLights built from an
+ * environment cubemap, on the GPU. Each light needs one pass for the SH, which are read back
+ * asynchronously, and one pass per face and level of the reflections. The passes are spread
+ * over several frames, within a budget of samples per frame.
+ */
+class IblPrefilter {
+    // about the cost of prefiltering the first two levels at once
+    static constexpr size_t MAX_SAMPLES_PER_FRAME = 1024 * 1024;
+
+public:
+    // the levels of the reflections, light_indirect.fs samples them with
+    // lod = IBL_MAX_MIP_LEVEL * sqrt(linear_roughness), like cmgen generates them
+    static constexpr uint8_t REFLECTIONS_LEVELS = 9;
+
+    // (re)starts prefiltering the environment of this light, the light keeps its current
+    // reflections and SH until the new ones are complete
+    void add(details::FEngine& engine, details::FIndirectLight* light,
+            Handle<HwTexture> environment, uint32_t environmentSize);
+    void remove(details::FEngine& engine, details::FIndirectLight* light) noexcept;
+
+    bool isPending(details::FIndirectLight const* light) const noexcept;
+
+    // call this once per frame, between the driver's beginFrame() and the frame's passes
+    void update(details::FEngine& engine);
+
+    void terminate(details::FEngine& engine) noexcept;
+
+private:
+    struct Readback;
+
+    struct Job {
+        details::FIndirectLight* light;
+        Handle<HwTexture> environment;
+        uint32_t environmentSize;
+        Handle<HwTexture> reflections;  // given to the light once all the passes are done
+        Readback* readback = nullptr;   // the SH, shared with the driver's callback
+        uint32_t pass = 0;              // next pass to run
+    };
+
+    static size_t getPassCost(Job const& job) noexcept;
+    void runPass(details::FEngine& engine, Job& job);
+    static void release(Readback* readback) noexcept;
+
+    std::vector<Job> mJobs;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_IBLPREFILTER_H
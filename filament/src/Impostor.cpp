@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/Impostor.h"
+
+#include "components/RenderableManager.h"
+
+#include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/RenderPrimitive.h"
+#include "details/Texture.h"
+#include "details/VertexBuffer.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <filament/Box.h>
+#include <filament/TextureSampler.h>
+
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace details;
+using namespace driver;
+
+// This package is generated with matc and contains the impostor material shader code.
+static const uint8_t IMPOSTOR_MATERIAL_PACKAGE[] = {
+#include "generated/material/impostor.inc"
+};
+
+struct Impostor::BuilderDetails {
+    Texture const* mBaseColor = nullptr;
+    Texture const* mNormal = nullptr;
+    uint8_t mFrames = 8;
+    float3 mCenter = {};
+    float mRadius = 1.0f;
+    uint32_t mCapacity = 4096;
+    Material const* mMaterial = nullptr;
+    bool mCastShadows = false;
+};
+
+using BuilderType = Impostor;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+Impostor::Builder& Impostor::Builder::atlas(
+        Texture const* baseColor, Texture const* normal) noexcept {
+    mImpl->mBaseColor = baseColor;
+    mImpl->mNormal = normal;
+    return *this;
+}
+
+Impostor::Builder& Impostor::Builder::frames(uint8_t frames) noexcept {
+    mImpl->mFrames = frames;
+    return *this;
+}
+
+Impostor::Builder& Impostor::Builder::sphere(float3 const& center, float radius) noexcept {
+    mImpl->mCenter = center;
+    mImpl->mRadius = radius;
+    return *this;
+}
+
+Impostor::Builder& Impostor::Builder::capacity(uint32_t capacity) noexcept {
+    mImpl->mCapacity = capacity;
+    return *this;
+}
+
+Impostor::Builder& Impostor::Builder::material(Material const* material) noexcept {
+    mImpl->mMaterial = material;
+    return *this;
+}
+
+Impostor::Builder& Impostor::Builder::castShadows(bool enable) noexcept {
+    mImpl->mCastShadows = enable;
+    return *this;
+}
+
+Impostor* Impostor::Builder::build(Engine& engine) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mBaseColor, "base color atlas not set")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mFrames >= 2, "frames must be at least 2")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mRadius > 0.0f, "radius must be positive")) {
+        return nullptr;
+    }
+
+    // the instance count of a primitive is 16 bits
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mCapacity > 0 &&
+            mImpl->mCapacity <= std::numeric_limits<uint16_t>::max(),
+            "capacity must be in [1, 65535]")) {
+        return nullptr;
+    }
+
+    return upcast(engine).createImpostor(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+namespace {
+
+// the corners of the quad, in units of the radius along the right and up vectors of the frame
+struct Vertex {
+    int16_t position[4];
+    int16_t tangents[4];    // unused, lit materials need them, see impostor.mat
+};
+
+void freeBuffer(void* buffer, size_t, void*) {
+    ::free(buffer);
+}
+
+} // anonymous namespace
+
+FImpostor::FImpostor(FEngine& engine, const Builder& builder)
+        : mCapacity(builder->mCapacity) {
+    constexpr int16_t one = std::numeric_limits<int16_t>::max();
+    static const Vertex vertices[4] = {
+            { { -1, -1, 0, 1 }, { 0, 0, 0, one } },
+            { {  1, -1, 0, 1 }, { 0, 0, 0, one } },
+            { {  1,  1, 0, 1 }, { 0, 0, 0, one } },
+            { { -1,  1, 0, 1 }, { 0, 0, 0, one } },
+    };
+    // counter-clockwise seen from the viewer
+    static const uint16_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+
+    mVertexBuffer = upcast(VertexBuffer::Builder()
+            .vertexCount(4)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::SHORT4,
+                    offsetof(Vertex, position), sizeof(Vertex))
+            .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::SHORT4,
+                    offsetof(Vertex, tangents), sizeof(Vertex))
+            .normalized(VertexAttribute::TANGENTS)
+            .build(engine));
+    mVertexBuffer->setBufferAt(engine, 0, { vertices, sizeof(vertices) });
+
+    mIndexBuffer = upcast(IndexBuffer::Builder()
+            .indexCount(6)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(engine));
+    mIndexBuffer->setBuffer(engine, { indices, sizeof(indices) });
+
+    // the transforms of the renderables, fetched without filtering
+    const uint32_t rows = (mCapacity + INSTANCES_PER_ROW - 1) / INSTANCES_PER_ROW;
+    mTransforms.reset(new float4[size_t(rows) * INSTANCES_PER_ROW * 3]);
+    mInstances = upcast(Texture::Builder()
+            .width(INSTANCES_PER_ROW * 3)
+            .height(rows)
+            .levels(1)
+            .sampler(Texture::Sampler::SAMPLER_2D)
+            .format(Texture::InternalFormat::RGBA32F)
+            .build(engine));
+
+    FMaterial const* material = builder->mMaterial ?
+            upcast(builder->mMaterial) : engine.getImpostorMaterial();
+    FTexture const* baseColor = upcast(builder->mBaseColor);
+    FTexture const* normal = builder->mNormal ? upcast(builder->mNormal) : baseColor;
+    const TextureSampler sampler(TextureSampler::MinFilter::LINEAR_MIPMAP_LINEAR,
+            TextureSampler::MagFilter::LINEAR);
+    mMaterialInstance = material->createInstance();
+    mMaterialInstance->setParameter("instances", mInstances,
+            TextureSampler(TextureSampler::MinFilter::NEAREST, TextureSampler::MagFilter::NEAREST));
+    mMaterialInstance->setParameter("baseColorAtlas", baseColor, sampler);
+    mMaterialInstance->setParameter("normalAtlas", normal, sampler);
+    mMaterialInstance->setParameter("hasNormalAtlas", builder->mNormal != nullptr);
+    mMaterialInstance->setParameter("frames", int32_t(builder->mFrames));
+    mMaterialInstance->setParameter("sphere", float4{ builder->mCenter, builder->mRadius });
+
+    // a single renderable, with one instance per renderable replaced by the impostor, which are
+    // anywhere in the scene
+    mEntity = engine.getEntityManager().create();
+    RenderableManager::Builder(1)
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, mVertexBuffer, mIndexBuffer)
+            .material(0, mMaterialInstance)
+            .culling(false)
+            .instances(mCapacity)
+            .castShadows(builder->mCastShadows)
+            .build(engine, mEntity);
+
+    // nothing is drawn until a renderable is replaced by the impostor
+    commit(engine);
+}
+
+void FImpostor::terminate(FEngine& engine) noexcept {
+    // use Engine::destroy because FEngine::destroy is inlined
+    Engine& e = engine;
+    e.destroy(mEntity);
+    e.destroy(mMaterialInstance);
+    e.destroy(mInstances);
+    e.destroy(mVertexBuffer);
+    e.destroy(mIndexBuffer);
+
+    engine.getEntityManager().destroy(mEntity);
+    mEntity = {};
+}
+
+void FImpostor::add(mat4f const& worldFromModel) noexcept {
+    const uint32_t index = mCount.fetch_add(1, std::memory_order_relaxed);
+    if (UTILS_LIKELY(index < mCapacity)) {
+        const mat4f rows = transpose(worldFromModel);
+        float4* const UTILS_RESTRICT texels = mTransforms.get() + index * 3;
+        texels[0] = rows[0];
+        texels[1] = rows[1];
+        texels[2] = rows[2];
+    }
+}
+
+void FImpostor::commit(FEngine& engine) noexcept {
+    const uint32_t count = std::min(mCount.load(std::memory_order_relaxed), mCapacity);
+    if (count) {
+        // only the rows holding renderables are uploaded
+        const uint32_t rows = (count + INSTANCES_PER_ROW - 1) / INSTANCES_PER_ROW;
+        const size_t size = size_t(rows) * INSTANCES_PER_ROW * 3 * sizeof(float4);
+        void* const texels = malloc(size);
+        memcpy(texels, mTransforms.get(), size);
+        mInstances->setImage(engine, 0, 0, 0, INSTANCES_PER_ROW * 3, rows,
+                { texels, size, PixelDataFormat::RGBA, PixelDataType::FLOAT, freeBuffer });
+    }
+
+    // a primitive without instances isn't drawn, see RenderPass
+    FRenderableManager& rcm = engine.getRenderableManager();
+    Slice<FRenderPrimitive> primitives = rcm.getRenderPrimitives(rcm.getInstance(mEntity), 0);
+    primitives[0].setInstanceCount(uint16_t(count));
+}
+
+FMaterial const* FImpostor::createMaterial(FEngine& engine) {
+    return upcast(Material::Builder().package(
+            (void*)IMPOSTOR_MATERIAL_PACKAGE, sizeof(IMPOSTOR_MATERIAL_PACKAGE)).build(engine));
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+Entity Impostor::getEntity() const noexcept {
+    return upcast(this)->getEntity();
+}
+
+MaterialInstance* Impostor::getMaterialInstance() noexcept {
+    return upcast(this)->getMaterialInstance();
+}
+
+} // namespace filament
@@ -16,6 +16,7 @@
 
 #include "details/IndexBuffer.h"
 
+#include "details/DestroyBatch.h"
 #include "details/Engine.h"
 
 #include "FilamentAPI-impl.h"
@@ -27,6 +28,7 @@ using namespace details;
 struct IndexBuffer::BuilderDetails {
     uint32_t mIndexCount = 0;
     IndexType mIndexType = IndexType::UINT;
+    BufferUsage mUsage = BufferUsage::STATIC;
 };
 
 using BuilderType = IndexBuffer;
@@ -47,6 +49,11 @@ IndexBuffer::Builder& IndexBuffer::Builder::bufferType(IndexType indexType) noex
     return *this;
 }
 
+IndexBuffer::Builder& IndexBuffer::Builder::bufferUsage(BufferUsage usage) noexcept {
+    mImpl->mUsage = usage;
+    return *this;
+}
+
 IndexBuffer* IndexBuffer::Builder::build(Engine& engine) {
     return upcast(engine).createIndexBuffer(*this);
 }
@@ -60,7 +67,7 @@ FIndexBuffer::FIndexBuffer(FEngine& engine, const IndexBuffer::Builder& builder)
     FEngine::DriverApi& driver = engine.getDriverApi();
     mHandle = driver.createIndexBuffer(
             (driver::ElementType)builder->mIndexType,
-            uint32_t(builder->mIndexCount));
+            uint32_t(builder->mIndexCount), builder->mUsage);
 }
 
 void FIndexBuffer::terminate(FEngine& engine) {
@@ -68,6 +75,10 @@ void FIndexBuffer::terminate(FEngine& engine) {
     driver.destroyIndexBuffer(mHandle);
 }
 
+void FIndexBuffer::terminate(FEngine& engine, DestroyBatch& batch) {
+    batch.add(mHandle);
+}
+
 void FIndexBuffer::setBuffer(FEngine& engine,
         BufferDescriptor&& buffer, uint32_t byteOffset, uint32_t byteSize) {
 
@@ -21,8 +21,13 @@
 
 #include "FilamentAPI-impl.h"
 
+#include <filament/EngineEnums.h>
+
 #include <utils/Panic.h>
 
+#include <algorithm>
+#include <cmath>
+
 #define IBL_INTEGRATION_PREFILTERED_CUBEMAP         0
 #define IBL_INTEGRATION_IMPORTANCE_SAMPLING         1
 #define IBL_INTEGRATION                             IBL_INTEGRATION_PREFILTERED_CUBEMAP
@@ -38,6 +43,9 @@ using namespace details;
 struct IndirectLight::BuilderDetails {
     Texture const* mReflectionsMap = nullptr;
     Texture const* mIrradianceMap = nullptr;
+    Texture const* mEnvironmentMap = nullptr;
+    Texture const* mIrradianceVolume = nullptr;
+    Box mIrradianceVolumeBounds;
     math::float3 mIrradianceCoefs[9] = {};
     mat3f mRotation;
     float mIntensity = 30000.0f;
@@ -72,6 +80,18 @@ IndirectLight::Builder& IndirectLight::Builder::irradiance(Texture const* cubema
     return *this;
 }
 
+IndirectLight::Builder& IndirectLight::Builder::irradianceVolume(Texture const* volume,
+        Box const& bounds) noexcept {
+    mImpl->mIrradianceVolume = volume;
+    mImpl->mIrradianceVolumeBounds = bounds;
+    return *this;
+}
+
+IndirectLight::Builder& IndirectLight::Builder::environment(Texture const* cubemap) noexcept {
+    mImpl->mEnvironmentMap = cubemap;
+    return *this;
+}
+
 IndirectLight::Builder& IndirectLight::Builder::intensity(float envIntensity) noexcept {
     mImpl->mIntensity = envIntensity;
     return *this;
@@ -116,6 +136,32 @@ IndirectLight* IndirectLight::Builder::build(Engine& engine) {
         }
     }
 
+    if (mImpl->mIrradianceVolume) {
+        if (!FIndirectLight::isValidIrradianceVolume(mImpl->mIrradianceVolume)) {
+            return nullptr;
+        }
+    }
+
+    if (mImpl->mEnvironmentMap) {
+        Texture const* environment = mImpl->mEnvironmentMap;
+        if (!ASSERT_POSTCONDITION_NON_FATAL(
+                environment->getTarget() == Texture::Sampler::SAMPLER_CUBEMAP,
+                "environment map must be a cubemap")) {
+            return nullptr;
+        }
+        if (!ASSERT_POSTCONDITION_NON_FATAL(!environment->isRgbm() &&
+                environment->getFormat() != Texture::InternalFormat::RGBM,
+                "environment map must not be RGBM")) {
+            return nullptr;
+        }
+        const size_t size = environment->getWidth();
+        if (!ASSERT_POSTCONDITION_NON_FATAL(size && !(size & (size - 1)) &&
+                environment->getLevels() == size_t(1 + std::ilogb(float(size))),
+                "environment map must be a power of two and have all its mipmap levels")) {
+            return nullptr;
+        }
+    }
+
     return upcast(engine).createIndirectLight(*this);
 }
 
@@ -134,7 +180,20 @@ FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept
             std::end(builder->mIrradianceCoefs),
             mIrradianceCoefs.begin());
 
+    if (builder->mIrradianceVolume) {
+        setIrradianceVolume(builder->mIrradianceVolume, builder->mIrradianceVolumeBounds);
+    }
+
     mIntensity = builder->mIntensity;
+    if (builder->mEnvironmentMap) {
+        mEnvironmentHandle = upcast(builder->mEnvironmentMap)->getHwHandle();
+        mEnvironmentSize = uint32_t(builder->mEnvironmentMap->getWidth());
+        // the reflections and SH given to the builder, if any, are ignored
+        mReflectionsMapHandle.clear();
+        std::fill(mIrradianceCoefs.begin(), mIrradianceCoefs.end(), math::float3{});
+        refresh(engine);
+    }
+
     if (builder->mIrradianceMap) {
         mIrradianceMapHandle = upcast(builder->mIrradianceMap)->getHwHandle();
     } else {
@@ -145,12 +204,95 @@ FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept
 }
 
 void FIndirectLight::terminate(FEngine& engine) {
+    if (mEnvironmentHandle) {
+        engine.getIblPrefilter().remove(engine, this);
+        if (mPrefilteredReflections) {
+            engine.getDriverApi().destroyTexture(mPrefilteredReflections);
+        }
+    }
     if (FEngine::CONFIG_IBL_USE_IRRADIANCE_MAP) {
         FEngine::DriverApi& driver = engine.getDriverApi();
         driver.destroyTexture(mIrradianceMapHandle);
     }
 }
 
+bool FIndirectLight::isValidIrradianceVolume(Texture const* volume) noexcept {
+    return ASSERT_POSTCONDITION_NON_FATAL(
+                    volume->getTarget() == Texture::Sampler::SAMPLER_3D,
+                    "irradiance volume must be a 3D texture") &&
+            ASSERT_POSTCONDITION_NON_FATAL(
+                    volume->getDepth() > 0 && volume->getDepth() % 9 == 0,
+                    "irradiance volume's depth must be a multiple of 9 (one slice per probe "
+                    "and SH coefficient)");
+}
+
+void FIndirectLight::setIrradianceVolume(Texture const* volume, Box const& bounds) noexcept {
+    mIrradianceVolumeHandle.clear();
+    mIrradianceVolumeDepth = 0;
+    if (volume && isValidIrradianceVolume(volume)) {
+        mIrradianceVolumeHandle = upcast(volume)->getHwHandle();
+        mIrradianceVolumeDepth = uint32_t(volume->getDepth() / 9);
+        mIrradianceVolumeBounds = bounds;
+    }
+}
+
+void FIndirectLight::refresh(FEngine& engine) {
+    if (mEnvironmentHandle) {
+        engine.getIblPrefilter().add(engine, this, mEnvironmentHandle, mEnvironmentSize);
+        mPrefiltering = true;
+    }
+}
+
+void FIndirectLight::setPrefiltered(FEngine& engine, Handle<HwTexture> reflections,
+        math::float3 const* sh) noexcept {
+    if (mPrefilteredReflections) {
+        engine.getDriverApi().destroyTexture(mPrefilteredReflections);
+    }
+    mReflectionsMapHandle = mPrefilteredReflections = reflections;
+    std::copy_n(sh, mIrradianceCoefs.size(), mIrradianceCoefs.begin());
+    mPrefiltering = false;
+}
+
+void FIndirectLight::readReflections(FEngine& engine, uint8_t level,
+        driver::TextureCubemapFace face, driver::PixelBufferDescriptor&& buffer) {
+    if (!ASSERT_POSTCONDITION_NON_FATAL(mPrefilteredReflections && !mPrefiltering,
+            "the reflections must be computed from an environment, see isReady()")) {
+        return;
+    }
+    if (!ASSERT_POSTCONDITION_NON_FATAL(level < IblPrefilter::REFLECTIONS_LEVELS,
+            "level %u out of range", unsigned(level))) {
+        return;
+    }
+    if (!ASSERT_POSTCONDITION_NON_FATAL(buffer.type != driver::PixelDataType::COMPRESSED,
+            "buffer.format cannot be COMPRESSED")) {
+        return;
+    }
+    if (!ASSERT_POSTCONDITION_NON_FATAL(
+            buffer.alignment > 0 && buffer.alignment <= 8 &&
+            !(buffer.alignment & (buffer.alignment - 1)),
+            "buffer.alignment must be 1, 2, 4 or 8")) {
+        return;
+    }
+
+    const uint32_t dim = uint32_t(CONFIG_IBL_SIZE >> level);
+    const size_t sizeNeeded = driver::PixelBufferDescriptor::computeDataSize(
+            buffer.format, buffer.type,
+            buffer.stride ? buffer.stride : dim,
+            buffer.top + dim,
+            buffer.alignment);
+    if (!ASSERT_POSTCONDITION_NON_FATAL(buffer.size >= sizeNeeded,
+            "Pixel buffer too small: has %u bytes, needs %u bytes", buffer.size, sizeNeeded)) {
+        return;
+    }
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    Handle<HwRenderTarget> target = driver.createRenderTarget(driver::TargetBufferFlags::COLOR,
+            dim, dim, 1, driver::TextureFormat::RGBA8,
+            { mPrefilteredReflections, level, face }, {}, {});
+    driver.readPixels(target, 0, 0, dim, dim, std::move(buffer));
+    driver.destroyRenderTarget(target);
+}
+
 } // namespace details
 
 // ------------------------------------------------------------------------------------------------
@@ -169,4 +311,25 @@ void IndirectLight::setRotation(math::mat3f const& rotation) noexcept {
     upcast(this)->setRotation(rotation);
 }
 
+void IndirectLight::setIrradianceVolume(Texture const* volume, Box const& bounds) noexcept {
+    upcast(this)->setIrradianceVolume(volume, bounds);
+}
+
+void IndirectLight::refresh(Engine& engine) {
+    upcast(this)->refresh(upcast(engine));
+}
+
+bool IndirectLight::isReady() const noexcept {
+    return upcast(this)->isReady();
+}
+
+void IndirectLight::getIrradianceSH(math::float3* sh) const noexcept {
+    std::copy_n(upcast(this)->getSH(), 9, sh);
+}
+
+void IndirectLight::readReflections(Engine& engine, uint8_t level,
+        driver::TextureCubemapFace face, driver::PixelBufferDescriptor&& buffer) {
+    upcast(this)->readReflections(upcast(engine), level, face, std::move(buffer));
+}
+
 } // namespace filament
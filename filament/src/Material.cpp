@@ -47,6 +47,8 @@ using namespace driver;
 struct Material::BuilderDetails {
     const void* mPayload = nullptr;
     size_t mSize = 0;
+    Material::Builder::PackageReleaseCallback mRelease = nullptr;
+    void* mReleaseUser = nullptr;
     filaflat::MaterialParser* mMaterialParser = nullptr;
     bool mDefaultMaterial = false;
 };
@@ -66,14 +68,32 @@ BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs
 Material::Builder& Material::Builder::package(const void* payload, size_t size) {
     mImpl->mPayload = payload;
     mImpl->mSize = size;
+    mImpl->mRelease = nullptr;
+    mImpl->mReleaseUser = nullptr;
+    return *this;
+}
+
+Material::Builder& Material::Builder::package(const void* payload, size_t size,
+        PackageReleaseCallback release, void* user) {
+    mImpl->mPayload = payload;
+    mImpl->mSize = size;
+    mImpl->mRelease = release;
+    mImpl->mReleaseUser = user;
     return *this;
 }
 
 Material* Material::Builder::build(Engine& engine) {
-    MaterialParser* materialParser = new MaterialParser(
-            upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
+    // without a release callback the package is copied, otherwise the parser references it
+    // (and releases it) for as long as the material exists
+    MaterialParser* materialParser = mImpl->mRelease ?
+            new MaterialParser(upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize,
+                    mImpl->mRelease, mImpl->mReleaseUser) :
+            new MaterialParser(upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
+    mImpl->mRelease = nullptr;
+
     bool materialOK = materialParser->parse() && materialParser->isShadingMaterial();
     if (!ASSERT_POSTCONDITION_NON_FATAL(materialOK, "could not parse the material package")) {
+        delete materialParser;
         return nullptr;
     }
 
@@ -91,6 +111,7 @@ Material* Material::Builder::build(Engine& engine) {
             "the material '%s' does not contain shaders compatible with this platform; "
             "need shader model %d but have 0x%02x", name.c_str_safe(), sm,
             shaderModels.getValue())) {
+        delete materialParser;
         return nullptr;
     }
 
@@ -101,6 +122,9 @@ Material* Material::Builder::build(Engine& engine) {
 
 namespace details {
 
+// lit materials with at least this many samplers are considered expensive to shade
+static constexpr size_t EXPENSIVE_SAMPLER_COUNT = 4;
+
 FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
         : mEngine(engine),
           mMaterialId(engine.getMaterialId())
@@ -124,6 +148,7 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
     parser->getShading(&mShading);
     parser->getBlendingMode(&mBlendingMode);
     parser->getInterpolation(&mInterpolation);
+    parser->getVariantFilterMask(&mVariantFilterMask);
     parser->getVertexDomain(&mVertexDomain);
     parser->getRequiredAttributes(&mRequiredAttributes);
     if (mBlendingMode == BlendingMode::MASKED) {
@@ -134,6 +159,10 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
     }
     mIsVariantLit = mShading != Shading::UNLIT || mHasShadowMultiplier;
 
+    mHasExpensiveShading = mShading == Shading::SUBSURFACE || mShading == Shading::CLOTH ||
+            (mShading == Shading::LIT &&
+                    mSamplerInterfaceBlock.getSamplerInfoList().size() >= EXPENSIVE_SAMPLER_COUNT);
+
     // create raster state
     using BlendFunction = Driver::RasterState::BlendFunction;
     using DepthFunc = Driver::RasterState::DepthFunc;
@@ -199,18 +228,9 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
 
     parser->getTransparencyMode(&mTransparencyMode);
     parser->hasCustomDepthShader(&mHasCustomDepthShader);
+    parser->getShaderCost(&mShaderCost);
     mIsDefaultMaterial = builder->mDefaultMaterial;
 
-    // pre-cache the shared variants -- these variants are shared with the default material.
-    if (UTILS_UNLIKELY(!mIsDefaultMaterial && !mHasCustomDepthShader)) {
-        auto& cachedPrograms = mCachedPrograms;
-        for (uint8_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
-            if (Variant(i).isDepthPass()) {
-                cachedPrograms[i] = engine.getDefaultMaterial()->getProgram(i);
-            }
-        }
-    }
-
     bool colorWrite;
     parser->getColorWrite(&colorWrite);
     mRasterState.colorWrite = colorWrite;
@@ -226,9 +246,20 @@ FMaterial::~FMaterial() noexcept {
 }
 
 void FMaterial::terminate(FEngine& engine) {
+    destroyPrograms(engine);
+    mDefaultInstance.terminate(engine);
+}
+
+size_t FMaterial::destroyPrograms(FEngine& engine) const noexcept {
     DriverApi& driverApi = engine.getDriverApi();
     auto& cachedPrograms = mCachedPrograms;
+    size_t count = 0;
     for (size_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
+        Handle<HwProgram> const program = cachedPrograms[i];
+        cachedPrograms[i].clear();
+        if (!program) {
+            continue;
+        }
         if (!mIsDefaultMaterial) {
             // The depth variants may be shared with the default material, in which case
             // we should not free it now.
@@ -238,9 +269,15 @@ void FMaterial::terminate(FEngine& engine) {
                 continue;
             }
         }
-        driverApi.destroyProgram(cachedPrograms[i]);
+        if (UTILS_UNLIKELY(mVariantFilterMask) &&
+                Variant::filterUserVariant(uint8_t(i), mVariantFilterMask) != i) {
+            // this entry is a copy of the program of a variant we kept, see getProgramSlow()
+            continue;
+        }
+        driverApi.destroyProgram(program);
+        count++;
     }
-    mDefaultInstance.terminate(engine);
+    return count;
 }
 
 FMaterialInstance* FMaterial::createInstance() const noexcept {
@@ -254,11 +291,37 @@ bool FMaterial::hasParameter(const char* name) const noexcept {
     return true;
 }
 
+Material::ParameterHandle FMaterial::getParameterHandle(const char* name) const noexcept {
+    UniformInterfaceBlock::UniformInfo const* info = mUniformInterfaceBlock.getUniformInfo(name);
+    if (!info) {
+        return {};
+    }
+    return { uint32_t(info->getBufferOffset()), info->size, info->type };
+}
+
 Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
     const ShaderModel sm = mEngine.getDriver().getShaderModel();
 
     assert(!Variant::isReserved(variantKey));
 
+    // the depth variants are shared with the default material, they're only created once used
+    if (!mIsDefaultMaterial && !mHasCustomDepthShader && Variant(variantKey).isDepthPass()) {
+        Handle<HwProgram> const program = mEngine.getDefaultMaterial()->getProgram(variantKey);
+        mCachedPrograms[variantKey] = program;
+        return program;
+    }
+
+    // The variant may have been filtered out when the material was built (variantFilter), in
+    // which case we use the program of the same variant without the filtered out features.
+    if (UTILS_UNLIKELY(mVariantFilterMask)) {
+        const uint8_t key = Variant::filterUserVariant(variantKey, mVariantFilterMask);
+        if (key != variantKey) {
+            Handle<HwProgram> const program = getProgram(key);
+            mCachedPrograms[variantKey] = program;
+            return program;
+        }
+    }
+
     uint8_t vertexVariantKey = Variant::filterVariantVertex(variantKey);
     uint8_t fragmentVariantKey = Variant::filterVariantFragment(variantKey);
 
@@ -282,16 +345,25 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
      * Fragment shader
      */
 
-    filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
+    // The depth variant of the materials without a custom depth shader (i.e. not masked) writes
+    // the depth only, its fragment shader does nothing. Vulkan doesn't need one at all, but
+    // OpenGL ES can't link a program without it.
+    const bool depthOnly = !mHasCustomDepthShader && Variant(variantKey).isDepthPass() &&
+            mEngine.getBackend() == Backend::VULKAN;
 
-    UTILS_UNUSED_IN_RELEASE bool fsOK = mMaterialParser->getShader(sm,
-            fragmentVariantKey, ShaderType::FRAGMENT, fsBuilder);
+    CString fs;
+    if (!depthOnly) {
+        filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
 
-    ASSERT_POSTCONDITION(fsOK && fsBuilder.size() > 0,
-            "The material '%s' has not been compiled to include the required "
-            "GLSL or SPIR-V chunks for the fragment shader (variant=0x%x, filterer=0x%x).",
-            mName.c_str(), variantKey, fragmentVariantKey);
-    CString fs(fsBuilder.getShader(), (CString::size_type) fsBuilder.size());
+        UTILS_UNUSED_IN_RELEASE bool fsOK = mMaterialParser->getShader(sm,
+                fragmentVariantKey, ShaderType::FRAGMENT, fsBuilder);
+
+        ASSERT_POSTCONDITION(fsOK && fsBuilder.size() > 0,
+                "The material '%s' has not been compiled to include the required "
+                "GLSL or SPIR-V chunks for the fragment shader (variant=0x%x, filterer=0x%x).",
+                mName.c_str(), variantKey, fragmentVariantKey);
+        fs = CString(fsBuilder.getShader(), (CString::size_type) fsBuilder.size());
+    }
 
     Program pb;
     pb      .diagnostics(mName, variantKey)
@@ -309,13 +381,62 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
         pb.addUniformBlock(BindingPoints::PER_RENDERABLE_BONES, &UibGenerator::getPerRenderableBonesUib());
     }
 
+    // until it's compiled, draw with the default material's program for the same variant
+    if (!mIsDefaultMaterial) {
+        FMaterial const* defaultMaterial = mEngine.getDefaultMaterial();
+        pb.fallback(defaultMaterial->getProgram(
+                Variant::filterVariant(variantKey, defaultMaterial->isVariantLit())));
+    }
+
     auto program = mEngine.getDriverApi().createProgram(std::move(pb));
     assert(program);
+    mEngine.getFrameCounters().add(FrameCounters::PROGRAM_COMPILES);
 
     mCachedPrograms[variantKey] = program;
     return program;
 }
 
+void FMaterial::compile(uint8_t const* variants, size_t count,
+        CompilationCallback callback, void* user) const noexcept {
+    static_assert(VariantFlags::DIRECTIONAL_LIGHTING == Variant::DIRECTIONAL_LIGHTING &&
+            VariantFlags::DYNAMIC_LIGHTING == Variant::DYNAMIC_LIGHTING &&
+            VariantFlags::SHADOW_RECEIVER == Variant::SHADOW_RECEIVER &&
+            VariantFlags::SKINNING == Variant::SKINNING,
+            "Material::VariantFlags must match the variant bits");
+
+    // the driver calls back once all these programs are ready, by destroying this array
+    struct Compilation {
+        FMaterial const* material;
+        CompilationCallback callback;
+        void* user;
+    };
+    Handle<HwProgram>* const programs = callback ? new Handle<HwProgram>[count] : nullptr;
+
+    size_t programCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t variantKey = Variant::filterVariant(
+                uint8_t(variants[i] & (VARIANT_COUNT - 1)), isVariantLit());
+        if (!Variant::isReserved(variantKey)) {
+            Handle<HwProgram> program = getProgram(variantKey);
+            if (programs) {
+                programs[programCount++] = program;
+            }
+        }
+    }
+
+    if (programs) {
+        mEngine.getDriverApi().compilePrograms({
+                programs, programCount * sizeof(Handle<HwProgram>),
+                [](void* buffer, size_t, void* user) {
+                    Compilation* const compilation = static_cast<Compilation*>(user);
+                    compilation->callback(compilation->material, compilation->user);
+                    delete compilation;
+                    delete [] static_cast<Handle<HwProgram>*>(buffer);
+                },
+                new Compilation{ this, callback, user } });
+    }
+}
+
 size_t FMaterial::getParameters(ParameterInfo* parameters, size_t count) const noexcept {
     count = std::min(count, getParameterCount());
 
@@ -426,6 +547,15 @@ bool Material::hasParameter(const char* name) const noexcept {
     return upcast(this)->hasParameter(name);
 }
 
+Material::ParameterHandle Material::getParameterHandle(const char* name) const noexcept {
+    return upcast(this)->getParameterHandle(name);
+}
+
+void Material::compile(uint8_t const* variants, size_t count,
+        CompilationCallback callback, void* user) const noexcept {
+    upcast(this)->compile(variants, count, callback, user);
+}
+
 MaterialInstance* Material::getDefaultInstance() noexcept {
     return upcast(this)->getDefaultInstance();
 }
@@ -18,10 +18,13 @@
 
 #include "RenderPass.h"
 
+#include "details/DestroyBatch.h"
 #include "details/Engine.h"
 #include "details/Material.h"
 #include "details/Texture.h"
 
+#include <utils/Hash.h>
+
 using namespace math;
 
 namespace filament {
@@ -35,31 +38,32 @@ FMaterialInstance::FMaterialInstance() noexcept = default;
 FMaterialInstance::FMaterialInstance(FEngine& engine, FMaterial const* material) {
     FEngine::DriverApi& driver = engine.getDriverApi();
     mMaterial = material;
-    mMaterialSortingKey = RenderPass::makeMaterialSortingKey(
-            material->getId(), material->generateMaterialInstanceId());
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms = UniformBuffer(upcast(material)->getDefaultInstance()->mUniforms);
+        // the default instance may have been committed already, but our buffer is brand new
+        mUniforms.invalidate();
         mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
     }
 
     if (!material->getSamplerInterfaceBlock().isEmpty()) {
         mSamplers = SamplerBuffer(material->getDefaultInstance()->getSamplerBuffer());
         mSbHandle = driver.createSamplerBuffer(mSamplers.getSize());
+        mStreamingTextures = upcast(material)->getDefaultInstance()->mStreamingTextures;
     }
 
     if (material->getBlendingMode() == BlendingMode::MASKED) {
         static_cast<MaterialInstance*>(this)->setParameter(
                 "maskThreshold", material->getMaskThreshold());
     }
+
+    updateState();
 }
 
 // This version is used to initialize the default material instance
 void FMaterialInstance::initDefaultInstance(FEngine& engine, FMaterial const* material) {
     FEngine::DriverApi& driver = engine.getDriverApi();
     mMaterial = material;
-    mMaterialSortingKey = RenderPass::makeMaterialSortingKey(
-            material->getId(), material->generateMaterialInstanceId());
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms = UniformBuffer(material->getUniformInterfaceBlock());
@@ -75,6 +79,8 @@ void FMaterialInstance::initDefaultInstance(FEngine& engine, FMaterial const* ma
         static_cast<MaterialInstance*>(this)->setParameter(
                 "maskThreshold", material->getMaskThreshold());
     }
+
+    updateState();
 }
 
 FMaterialInstance::~FMaterialInstance() noexcept = default;
@@ -85,17 +91,78 @@ void FMaterialInstance::terminate(FEngine& engine) {
     driver.destroySamplerBuffer(mSbHandle);
 }
 
+void FMaterialInstance::terminate(FEngine& engine, DestroyBatch& batch) {
+    batch.add(mUbHandle);
+    batch.add(mSbHandle);
+}
+
 void FMaterialInstance::commitSlow(FEngine& engine) const {
-    // update uniforms if needed
+    // update uniforms if needed, only the modified range is copied into the command stream
     FEngine::DriverApi& driver = engine.getDriverApi();
     if (mUniforms.isDirty()) {
-        driver.updateUniformBuffer(mUbHandle, UniformBuffer(mUniforms));
+        const size_t offset = mUniforms.getDirtyOffset();
+        const size_t size = mUniforms.getDirtySize();
+        void* const data = driver.allocate(size);
+        memcpy(data, static_cast<char const*>(mUniforms.getBuffer()) + offset, size);
+        driver.updateUniformBufferRange(mUbHandle, uint32_t(offset), { data, size });
+        engine.getFrameCounters().add(FrameCounters::UNIFORM_BYTES, size);
         mUniforms.clean();
+        updateState();
+    }
+    commitSamplers(engine);
+}
+
+char* FMaterialInstance::commitUniforms(char* p) const noexcept {
+    if (mUniforms.isDirty()) {
+        const size_t offset = mUniforms.getDirtyOffset();
+        const size_t size = mUniforms.getDirtySize();
+        Driver::UniformRangeUpdate* const update = new(p) Driver::UniformRangeUpdate{
+                mUbHandle, uint32_t(offset), uint32_t(size) };
+        memcpy(update + 1, static_cast<char const*>(mUniforms.getBuffer()) + offset, size);
+        p += Driver::UniformRangeUpdate::getRecordSize(size);
+        mUniforms.clean();
+        updateState();
+    }
+    return p;
+}
+
+void FMaterialInstance::commitSamplersSlow(FEngine& engine) const {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    driver.updateSamplerBuffer(mSbHandle, SamplerBuffer(mSamplers));
+    mSamplers.clean();
+    updateState();
+}
+
+void FMaterialInstance::updateState() const noexcept {
+    static_assert(sizeof(SamplerBuffer::Sampler) % sizeof(uint32_t) == 0,
+            "samplers are hashed as words");
+    static_assert(sizeof(mScissorRect) % sizeof(uint32_t) == 0,
+            "scissor is hashed as words");
+    static_assert(sizeof(mPolygonOffset) % sizeof(uint32_t) == 0,
+            "polygon offset is hashed as words");
+    uint32_t hash = utils::hash::murmur3(
+            reinterpret_cast<uint32_t const*>(mScissorRect), 4, mMaterial->getId());
+    hash = utils::hash::murmur3(reinterpret_cast<uint32_t const*>(mPolygonOffset), 2, hash);
+    if (mUniforms.getSize()) {
+        hash = utils::hash::murmur3(static_cast<uint32_t const*>(mUniforms.getBuffer()),
+                mUniforms.getSize() / sizeof(uint32_t), hash);
     }
-    if (mSamplers.isDirty()) {
-        driver.updateSamplerBuffer(mSbHandle, SamplerBuffer(mSamplers));
-        mSamplers.clean();
+    if (mSamplers.getSize()) {
+        hash = utils::hash::murmur3(reinterpret_cast<uint32_t const*>(mSamplers.getBuffer()),
+                mSamplers.getSize() * sizeof(SamplerBuffer::Sampler) / sizeof(uint32_t), hash);
     }
+    mStateHash = hash;
+    mMaterialSortingKey = RenderPass::makeMaterialSortingKey(mMaterial->getId(),
+            (hash ^ (hash >> 16)) & 0xFFFFu);
+    mMaterial->getEngine().invalidateMaterialInstances();
+}
+
+bool FMaterialInstance::hasSameStateSlow(FMaterialInstance const& rhs) const noexcept {
+    return !memcmp(mScissorRect, rhs.mScissorRect, sizeof(mScissorRect)) &&
+           !memcmp(mPolygonOffset, rhs.mPolygonOffset, sizeof(mPolygonOffset)) &&
+           !memcmp(mUniforms.getBuffer(), rhs.mUniforms.getBuffer(), mUniforms.getSize()) &&
+           !memcmp(mSamplers.getBuffer(), rhs.mSamplers.getBuffer(),
+                   mSamplers.getSize() * sizeof(SamplerBuffer::Sampler));
 }
 
 template <typename T>
@@ -111,10 +178,46 @@ inline void FMaterialInstance::setParameter(const char* name, const T* value, si
     }
 }
 
+template <typename T>
+inline void FMaterialInstance::setParameter(ParameterHandle handle, T value) noexcept {
+    if (handle.isValid()) {
+        // a handle of another material could point outside of our buffer
+        assert(handle.offset + sizeof(T) <= mUniforms.getSize());
+        mUniforms.setUniform<T>(handle.offset, value);
+    }
+}
+
+template <typename T>
+inline void FMaterialInstance::setParameters(ParameterHandle const* handles,
+        const T* values, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        setParameter<T>(handles[i], values[i]);
+    }
+}
+
 void FMaterialInstance::setParameter(const char* name,
         Texture const* texture, TextureSampler const& sampler) noexcept {
-    mSamplers.setSampler(mMaterial->getSamplerInterfaceBlock(), name, 0,
+    SamplerInterfaceBlock const& sib = mMaterial->getSamplerInterfaceBlock();
+    mSamplers.setSampler(sib, name, 0,
             { upcast(texture)->getHwHandle(), sampler.getSamplerParams() });
+
+    SamplerInterfaceBlock::SamplerInfo const* info = sib.getSamplerInfo(name);
+    if (info) {
+        auto& textures = mStreamingTextures;
+        textures.erase(std::remove_if(textures.begin(), textures.end(),
+                [offset = info->offset](auto const& entry) { return entry.first == offset; }),
+                textures.end());
+        if (upcast(texture)->isStreaming()) {
+            textures.emplace_back(info->offset, upcast(texture));
+        }
+    }
+}
+
+void FMaterialInstance::requestStreamingLevels(float pixels) const noexcept {
+    for (auto const& entry : mStreamingTextures) {
+        FTexture const* texture = entry.second;
+        texture->requestLevel(texture->getLevelForSize(pixels));
+    }
 }
 
 } // namespace details
@@ -175,6 +278,57 @@ template UTILS_PUBLIC void MaterialInstance::setParameter<float4>  (const char*
 template UTILS_PUBLIC void MaterialInstance::setParameter<mat3f>   (const char* name, const mat3f    *v, size_t c);
 template UTILS_PUBLIC void MaterialInstance::setParameter<mat4f>   (const char* name, const mat4f    *v, size_t c);
 
+template <typename T>
+void MaterialInstance::setParameter(ParameterHandle handle, T value) noexcept {
+    upcast(this)->setParameter<T>(handle, value);
+}
+
+// explicit template instantiation of our supported types
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool>    (ParameterHandle h, bool     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float>   (ParameterHandle h, float    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int32_t> (ParameterHandle h, int32_t  v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint32_t>(ParameterHandle h, uint32_t v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool2>   (ParameterHandle h, bool2    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool3>   (ParameterHandle h, bool3    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<bool4>   (ParameterHandle h, bool4    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int2>    (ParameterHandle h, int2     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int3>    (ParameterHandle h, int3     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<int4>    (ParameterHandle h, int4     v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint2>   (ParameterHandle h, uint2    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint3>   (ParameterHandle h, uint3    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<uint4>   (ParameterHandle h, uint4    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float2>  (ParameterHandle h, float2   v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float3>  (ParameterHandle h, float3   v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<float4>  (ParameterHandle h, float4   v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<mat3f>   (ParameterHandle h, mat3f    v);
+template UTILS_PUBLIC void MaterialInstance::setParameter<mat4f>   (ParameterHandle h, mat4f    v);
+
+template <typename T>
+void MaterialInstance::setParameters(ParameterHandle const* handles, const T* values,
+        size_t count) noexcept {
+    upcast(this)->setParameters<T>(handles, values, count);
+}
+
+// explicit template instantiation of our supported types
+template UTILS_PUBLIC void MaterialInstance::setParameters<bool>    (ParameterHandle const* h, const bool     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<float>   (ParameterHandle const* h, const float    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<int32_t> (ParameterHandle const* h, const int32_t  *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<uint32_t>(ParameterHandle const* h, const uint32_t *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<bool2>   (ParameterHandle const* h, const bool2    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<bool3>   (ParameterHandle const* h, const bool3    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<bool4>   (ParameterHandle const* h, const bool4    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<int2>    (ParameterHandle const* h, const int2     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<int3>    (ParameterHandle const* h, const int3     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<int4>    (ParameterHandle const* h, const int4     *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<uint2>   (ParameterHandle const* h, const uint2    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<uint3>   (ParameterHandle const* h, const uint3    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<uint4>   (ParameterHandle const* h, const uint4    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<float2>  (ParameterHandle const* h, const float2   *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<float3>  (ParameterHandle const* h, const float3   *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<float4>  (ParameterHandle const* h, const float4   *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<mat3f>   (ParameterHandle const* h, const mat3f    *v, size_t c);
+template UTILS_PUBLIC void MaterialInstance::setParameters<mat4f>   (ParameterHandle const* h, const mat4f    *v, size_t c);
+
 void MaterialInstance::setParameter(const char* name, Texture const* texture,
         TextureSampler const& sampler) noexcept {
     return upcast(this)->setParameter(name, texture, sampler);
@@ -197,4 +351,8 @@ void MaterialInstance::unsetScissor() noexcept {
     upcast(this)->unsetScissor();
 }
 
+void MaterialInstance::setPolygonOffset(float slope, float constant) noexcept {
+    upcast(this)->setPolygonOffset(slope, constant);
+}
+
 } // namespace filament
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MipmapGenerator.h"
+
+#include "details/Engine.h"
+#include "details/Texture.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+namespace filament {
+
+using namespace driver;
+using namespace details;
+
+bool MipmapGenerator::isSupported(FTexture const* texture) noexcept {
+    // the levels are rendered, which rules out the compressed formats, and the streaming
+    // textures have theirs uploaded by the application
+    const Texture::InternalFormat format = texture->getFormat();
+    return (texture->getTarget() == Texture::Sampler::SAMPLER_2D || texture->isCubemap()) &&
+            texture->getLevels() > 1 &&
+            texture->getUsage() == Texture::Usage::COLOR_ATTACHMENT &&
+            !texture->isMultisample() && !texture->isStreaming() &&
+            !isETC2Compression(format) && !isS3TCCompression(format) &&
+            !isASTCCompression(format) && !isBPTCCompression(format);
+}
+
+void MipmapGenerator::add(FTexture* texture, Texture::MipmapsCallback callback, void* user) {
+    auto pos = std::find_if(mJobs.begin(), mJobs.end(),
+            [texture](Job const& job) { return job.texture == texture; });
+    if (pos != mJobs.end()) {
+        // start over, level 0 may have changed
+        pos->callback = callback;
+        pos->user = user;
+        pos->pass = 0;
+        return;
+    }
+    mJobs.push_back({ texture, callback, user });
+}
+
+void MipmapGenerator::remove(FTexture* texture) noexcept {
+    auto pos = std::find_if(mJobs.begin(), mJobs.end(),
+            [texture](Job const& job) { return job.texture == texture; });
+    if (pos != mJobs.end()) {
+        mJobs.erase(pos);
+    }
+}
+
+uint32_t MipmapGenerator::getPassCount(Job const& job) noexcept {
+    FTexture const* const texture = job.texture;
+    return (texture->isCubemap() ? 6u : 1u) * uint32_t(texture->getLevels() - 1);
+}
+
+size_t MipmapGenerator::getPassCost(Job const& job) noexcept {
+    FTexture const* const texture = job.texture;
+    const size_t level = job.pass / (texture->isCubemap() ? 6u : 1u) + 1;
+    return texture->getWidth(level) * texture->getHeight(level);
+}
+
+void MipmapGenerator::runPass(FEngine& engine, Job const& job) {
+    DriverApi& driver = engine.getDriverApi();
+    FTexture const* const texture = job.texture;
+    Handle<HwTexture> handle = texture->getHwHandle();
+
+    const bool cubemap = texture->isCubemap();
+    const uint8_t level = uint8_t(job.pass / (cubemap ? 6u : 1u) + 1);
+    const int32_t face = cubemap ? int32_t(job.pass % 6u) : -1;
+    const uint32_t width = uint32_t(texture->getWidth(level));
+    const uint32_t height = uint32_t(texture->getHeight(level));
+
+    // the input is the only level sampled, so that the level rendered into isn't
+    driver.setMinMaxLevels(handle, level - 1u, level - 1u);
+
+    const Driver::TargetBufferInfo color = cubemap ?
+            Driver::TargetBufferInfo{ handle, level, TextureCubemapFace(face) } :
+            Driver::TargetBufferInfo{ handle, level };
+    Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+            width, height, 1, texture->getFormat(), color, {}, {});
+
+    engine.getPostProcessManager().mipmapDownsample(
+            engine.getPostProcessProgram(PostProcessStage::MIPMAP_DOWNSAMPLE),
+            target, width, height, handle, face);
+
+    driver.destroyRenderTarget(target);
+}
+
+void MipmapGenerator::update(FEngine& engine) {
+    if (mJobs.empty()) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // the textures are processed in the order they were added, with at least one pass per frame
+    size_t budget = MAX_TEXELS_PER_FRAME;
+    bool first = true;
+    for (size_t i = 0; i < mJobs.size();) {
+        Job& job = mJobs[i];
+        const uint32_t count = getPassCount(job);
+        const uint32_t start = job.pass;
+        while (job.pass < count) {
+            const size_t cost = getPassCost(job);
+            if (!first && cost > budget) {
+                break;
+            }
+            runPass(engine, job);
+            job.pass++;
+            budget -= std::min(budget, cost);
+            first = false;
+        }
+
+        if (job.pass != start) {
+            // sample the levels completed so far, the next ones are still undefined
+            const uint32_t levels = job.pass / (job.texture->isCubemap() ? 6u : 1u);
+            engine.getDriverApi().setMinMaxLevels(job.texture->getHwHandle(), 0, levels);
+        }
+
+        if (job.pass < count) {
+            // we're out of budget for this frame
+            break;
+        }
+
+        // the callback can add or remove textures
+        const Job done = job;
+        mJobs.erase(mJobs.begin() + i);
+        if (done.callback) {
+            done.callback(done.texture, done.user);
+        }
+    }
+}
+
+} // namespace filament
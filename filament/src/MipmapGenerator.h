@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_MIPMAPGENERATOR_H
+#define TNT_FILAMENT_MIPMAPGENERATOR_H
+
+#include <filament/Texture.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FEngine;
+class FTexture;
+} // namespace details
+
+/*
+ * MipmapGenerator renders the levels of the textures given to Texture::generateMipmapsAsync(),
+ * each one from the level above with a tent filter. There is one pass per level, and per face
+ * for the cubemaps. The passes are spread over several frames, within a budget of texels per
+ * frame, and the levels are sampled as soon as they're complete.
+ */
+class MipmapGenerator {
+    // about the cost of the first level of a 2048x2048 texture
+    static constexpr size_t MAX_TEXELS_PER_FRAME = 1024 * 1024;
+
+public:
+    // true if the levels of this texture can be rendered
+    static bool isSupported(details::FTexture const* texture) noexcept;
+
+    // (re)starts generating the levels of this texture from its level 0
+    void add(details::FTexture* texture, Texture::MipmapsCallback callback, void* user);
+    void remove(details::FTexture* texture) noexcept;
+
+    // call this once per frame, between the driver's beginFrame() and the frame's passes
+    void update(details::FEngine& engine);
+
+    void terminate() noexcept { mJobs.clear(); }
+
+private:
+    struct Job {
+        details::FTexture* texture;
+        Texture::MipmapsCallback callback;
+        void* user;
+        uint32_t pass = 0;              // next pass to run
+    };
+
+    static uint32_t getPassCount(Job const& job) noexcept;
+    static size_t getPassCost(Job const& job) noexcept;
+    static void runPass(details::FEngine& engine, Job const& job);
+
+    std::vector<Job> mJobs;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_MIPMAPGENERATOR_H
@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ParticleSystem.h"
+
+#include "components/TransformManager.h"
+
+#include "details/Camera.h"
+#include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/MaterialInstance.h"
+#include "details/VertexBuffer.h"
+
+#include "driver/Program.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <filament/EngineEnums.h>
+#include <filament/UniformInterfaceBlock.h>
+
+#include <utils/CString.h>
+#include <utils/Log.h>
+#include <utils/Panic.h>
+
+#include <math/mat4.h>
+
+#include <algorithm>
+#include <string>
+
+#include <stdlib.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace details;
+using namespace driver;
+
+struct ParticleSystem::BuilderDetails {
+    uint32_t mMaxParticleCount = 1024;
+    float mEmissionRate = 0.0f;
+    float2 mLifetime = { 1.0f, 1.0f };
+    Box mEmitter = {};
+    float3 mVelocityMin = {};
+    float3 mVelocityMax = {};
+    float3 mAcceleration = {};
+    float2 mSize = { 0.1f, 0.1f };
+    float4 mColorStart = { 1.0f };
+    float4 mColorEnd = { 1.0f };
+    MaterialInstance const* mMaterialInstance = nullptr;
+    Box mAABB = {};
+};
+
+using BuilderType = ParticleSystem;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+ParticleSystem::Builder& ParticleSystem::Builder::maxParticleCount(uint32_t count) noexcept {
+    mImpl->mMaxParticleCount = count;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::emissionRate(float particlesPerSecond) noexcept {
+    mImpl->mEmissionRate = particlesPerSecond;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::lifetime(float min, float max) noexcept {
+    mImpl->mLifetime = { min, max };
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::emitter(const Box& box) noexcept {
+    mImpl->mEmitter = box;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::velocity(float3 min, float3 max) noexcept {
+    mImpl->mVelocityMin = min;
+    mImpl->mVelocityMax = max;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::acceleration(float3 acceleration) noexcept {
+    mImpl->mAcceleration = acceleration;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::size(float start, float end) noexcept {
+    mImpl->mSize = { start, end };
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::color(float4 start, float4 end) noexcept {
+    mImpl->mColorStart = start;
+    mImpl->mColorEnd = end;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::material(
+        MaterialInstance const* materialInstance) noexcept {
+    mImpl->mMaterialInstance = materialInstance;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::boundingBox(
+        const Box& axisAlignedBoundingBox) noexcept {
+    mImpl->mAABB = axisAlignedBoundingBox;
+    return *this;
+}
+
+ParticleSystem* ParticleSystem::Builder::build(Engine& engine) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mMaterialInstance, "material not set")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mMaxParticleCount > 0 &&
+            mImpl->mMaxParticleCount <= MAX_PARTICLE_COUNT,
+            "maxParticleCount must be in [1, %u]", MAX_PARTICLE_COUNT)) {
+        return nullptr;
+    }
+
+    return upcast(engine).createParticleSystem(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+static constexpr uint32_t GROUP_SIZE = 64;
+
+// bindUniformsRange() offsets must be aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, which
+// is at most 256 bytes
+static constexpr uint32_t SORT_STEP_STRIDE = 256;
+
+// bytes per vertex: float4 position, 4 x unorm8 color, 2 x half uv
+static constexpr uint32_t VERTEX_STRIDE = 24;
+
+// shared by all the passes, the layout of ParticleUniforms is getParticleUib()
+static const char PARTICLES_CS[] = R"GLSL(
+layout(local_size_x = 64) in;
+
+layout(std140) uniform ParticleUniforms {
+    vec4 emitterMin;
+    vec4 emitterMax;
+    vec4 velocityMin;
+    vec4 velocityMax;
+    vec4 acceleration;
+    vec4 colorStart;
+    vec4 colorEnd;
+    vec4 eye;
+    vec4 right;
+    vec4 up;
+    vec4 forward;
+    vec4 sizeLifetime;      // start size, end size, min lifetime, max lifetime
+    float dt;
+    uint seed;
+    uint spawnFirst;
+    uint spawnCount;
+    uint particleCount;     // a power of two
+} params;
+
+// particle i is the position and age data[2i], followed by the velocity and lifetime data[2i + 1]
+layout(std430, binding = 0) buffer Particles { vec4 data[]; } particles;
+
+// sort key and index of each particle, the key is 0 for the dead ones
+layout(std430, binding = 1) buffer Keys { uvec2 data[]; } keys;
+)GLSL";
+
+static const char SIMULATE_CS[] = R"GLSL(
+uint hash(uint x) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+float random(inout uint state) {
+    state = hash(state);
+    return float(state >> 8u) * (1.0 / 16777216.0);
+}
+
+vec3 random3(inout uint state) {
+    float x = random(state);
+    float y = random(state);
+    return vec3(x, y, random(state));
+}
+
+// orders the floats as unsigned integers, and keeps 0 for the dead particles
+uint sortKey(float depth) {
+    uint bits = floatBitsToUint(depth);
+    return max(1u, (bits & 0x80000000u) != 0u ? ~bits : bits | 0x80000000u);
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= params.particleCount) {
+        return;
+    }
+
+    vec4 p = particles.data[2u * i];
+    vec4 v = particles.data[2u * i + 1u];
+    if (((i - params.spawnFirst) & (params.particleCount - 1u)) < params.spawnCount) {
+        uint state = hash(i ^ hash(params.seed));
+        p = vec4(mix(params.emitterMin.xyz, params.emitterMax.xyz, random3(state)), 0.0);
+        v.xyz = mix(params.velocityMin.xyz, params.velocityMax.xyz, random3(state));
+        v.w = mix(params.sizeLifetime.z, params.sizeLifetime.w, random(state));
+    } else if (p.w < v.w) {
+        v.xyz += params.acceleration.xyz * params.dt;
+        p.xyz += v.xyz * params.dt;
+        p.w += params.dt;
+    }
+    particles.data[2u * i] = p;
+    particles.data[2u * i + 1u] = v;
+
+    uint key = p.w < v.w ? sortKey(dot(p.xyz - params.eye.xyz, params.forward.xyz)) : 0u;
+    keys.data[i] = uvec2(key, i);
+}
+)GLSL";
+
+static const char SORT_CS[] = R"GLSL(
+layout(std140) uniform SortUniforms {
+    uint j;
+    uint k;
+} sortStep;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    uint l = i ^ sortStep.j;
+    if (i >= params.particleCount || l <= i) {
+        return;
+    }
+
+    // each step of the bitonic sort compares elements j apart, in blocks of k elements sorted in
+    // alternate directions, so that the keys end up in decreasing order, i.e. back to front
+    uvec2 a = keys.data[i];
+    uvec2 b = keys.data[l];
+    bool decreasing = (i & sortStep.k) == 0u;
+    if (decreasing ? a.x < b.x : a.x > b.x) {
+        keys.data[i] = b;
+        keys.data[l] = a;
+    }
+}
+)GLSL";
+
+static const char EMIT_CS[] = R"GLSL(
+// 6 words per vertex, see VERTEX_STRIDE
+layout(std430, binding = 2) writeonly buffer Vertices { uint data[]; } vertices;
+
+void main() {
+    uint s = gl_GlobalInvocationID.x;
+    if (s >= params.particleCount) {
+        return;
+    }
+
+    uvec2 key = keys.data[s];
+    vec4 p = particles.data[2u * key.y];
+    vec4 v = particles.data[2u * key.y + 1u];
+
+    // the quads of the dead particles have no area
+    float t = key.x != 0u ? p.w / v.w : 0.0;
+    float halfSize = key.x != 0u ? 0.5 * mix(params.sizeLifetime.x, params.sizeLifetime.y, t) : 0.0;
+    uint color = packUnorm4x8(clamp(mix(params.colorStart, params.colorEnd, t), 0.0, 1.0));
+    vec3 r = params.right.xyz * halfSize;
+    vec3 u = params.up.xyz * halfSize;
+
+    for (uint c = 0u; c < 4u; c++) {
+        vec2 uv = vec2(c == 1u || c == 2u ? 1.0 : 0.0, c >= 2u ? 1.0 : 0.0);
+        vec3 position = p.xyz + (uv.x * 2.0 - 1.0) * r + (uv.y * 2.0 - 1.0) * u;
+        uint w = (4u * s + c) * 6u;
+        vertices.data[w]      = floatBitsToUint(position.x);
+        vertices.data[w + 1u] = floatBitsToUint(position.y);
+        vertices.data[w + 2u] = floatBitsToUint(position.z);
+        vertices.data[w + 3u] = floatBitsToUint(1.0);
+        vertices.data[w + 4u] = color;
+        vertices.data[w + 5u] = packHalf2x16(uv);
+    }
+}
+)GLSL";
+
+UniformInterfaceBlock const& FParticleSystem::getParticleUib() noexcept {
+    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("ParticleUniforms")
+            .add("emitterMin",    1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("emitterMax",    1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("velocityMin",   1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("velocityMax",   1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("acceleration",  1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("colorStart",    1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("colorEnd",      1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("eye",           1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("right",         1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("up",            1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("forward",       1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("sizeLifetime",  1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("dt",            1, UniformInterfaceBlock::Type::FLOAT)
+            .add("seed",          1, UniformInterfaceBlock::Type::UINT)
+            .add("spawnFirst",    1, UniformInterfaceBlock::Type::UINT)
+            .add("spawnCount",    1, UniformInterfaceBlock::Type::UINT)
+            .add("particleCount", 1, UniformInterfaceBlock::Type::UINT)
+            .build();
+    return uib;
+}
+
+UniformInterfaceBlock const& FParticleSystem::getSortUib() noexcept {
+    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("SortUniforms")
+            .add("j", 1, UniformInterfaceBlock::Type::UINT)
+            .add("k", 1, UniformInterfaceBlock::Type::UINT)
+            .build();
+    return uib;
+}
+
+template<typename T>
+static void fillQuadIndices(T* indices, uint32_t quadCount) noexcept {
+    for (uint32_t q = 0; q < quadCount; q++) {
+        const T v = T(q * 4);
+        T* const i = indices + q * 6;
+        i[0] = v; i[1] = T(v + 1); i[2] = T(v + 2);
+        i[3] = v; i[4] = T(v + 2); i[5] = T(v + 3);
+    }
+}
+
+static void freeBuffer(void* buffer, size_t, void*) {
+    ::free(buffer);
+}
+
+FParticleSystem::FParticleSystem(FEngine& engine, const Builder& builder)
+        : mUniformBuffer(getParticleUib()),
+          mEmissionRate(builder->mEmissionRate) {
+    // the simulation wraps the spawn index and the bitonic sort needs a power of two
+    uint32_t count = 1;
+    while (count < builder->mMaxParticleCount) {
+        count *= 2;
+    }
+    mParticleCount = count;
+
+    DriverApi& driver = engine.getDriverApi();
+    mSupported = driver.isComputeSupported();
+    if (!mSupported) {
+        slog.w << "ParticleSystem: compute shaders are not supported, "
+                  "the particles won't be drawn" << io::endl;
+    }
+
+    const uint32_t vertexCount = count * 4;
+    mVertexBuffer = upcast(VertexBuffer::Builder()
+            .vertexCount(vertexCount)
+            .bufferCount(1)
+            .bufferUsage(BufferUsage::DYNAMIC)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT4,
+                    0, VERTEX_STRIDE)
+            .attribute(VertexAttribute::COLOR, 0, VertexBuffer::AttributeType::UBYTE4,
+                    16, VERTEX_STRIDE)
+            .attribute(VertexAttribute::UV0, 0, VertexBuffer::AttributeType::HALF2,
+                    20, VERTEX_STRIDE)
+            .normalized(VertexAttribute::COLOR)
+            .build(engine));
+
+    // degenerate quads until the first update
+    const size_t vertexSize = size_t(vertexCount) * VERTEX_STRIDE;
+    mVertexBuffer->setBufferAt(engine, 0,
+            { calloc(vertexSize, 1), vertexSize, freeBuffer });
+
+    const bool shortIndices = vertexCount <= 65536;
+    const uint32_t indexCount = count * 6;
+    mIndexBuffer = upcast(IndexBuffer::Builder()
+            .indexCount(indexCount)
+            .bufferType(shortIndices ? IndexBuffer::IndexType::USHORT : IndexBuffer::IndexType::UINT)
+            .build(engine));
+    const size_t indexSize = indexCount * (shortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+    void* indices = malloc(indexSize);
+    if (shortIndices) {
+        fillQuadIndices(static_cast<uint16_t*>(indices), count);
+    } else {
+        fillQuadIndices(static_cast<uint32_t*>(indices), count);
+    }
+    mIndexBuffer->setBuffer(engine, { indices, indexSize, freeBuffer });
+
+    // all zeroes, i.e. dead particles
+    const uint32_t particlesSize = count * uint32_t(sizeof(float4) * 2);
+    mParticles = driver.createBufferObject(particlesSize, BufferUsage::DYNAMIC);
+    driver.updateBufferObject(mParticles,
+            { calloc(particlesSize, 1), particlesSize, freeBuffer }, 0);
+    mKeys = driver.createBufferObject(count * uint32_t(sizeof(uint32_t) * 2), BufferUsage::DYNAMIC);
+
+    // the (j, k) of each step of the bitonic sort
+    uint32_t stepCount = 0;
+    for (uint32_t k = 2; k <= count; k *= 2) {
+        for (uint32_t j = k / 2; j > 0; j /= 2) {
+            stepCount++;
+        }
+    }
+    if (stepCount) {
+        UniformBuffer steps(stepCount * SORT_STEP_STRIDE);
+        size_t offset = 0;
+        for (uint32_t k = 2; k <= count; k *= 2) {
+            for (uint32_t j = k / 2; j > 0; j /= 2) {
+                steps.setUniform(offset + size_t(getSortUib().getUniformOffset("j", 0)), j);
+                steps.setUniform(offset + size_t(getSortUib().getUniformOffset("k", 0)), k);
+                offset += SORT_STEP_STRIDE;
+            }
+        }
+        mSortSteps = driver.createUniformBuffer(steps.getSize());
+        driver.updateUniformBuffer(mSortSteps, std::move(steps));
+    }
+    mSortStepCount = stepCount;
+
+    // the parameters that never change
+    UniformInterfaceBlock const& uib = getParticleUib();
+    UniformBuffer& ub = mUniformBuffer;
+    const float2 lifetime = max(builder->mLifetime, float2{ 0.0f });
+    ub.setUniform(uib, "emitterMin", 0, float4{ builder->mEmitter.getMin(), 0.0f });
+    ub.setUniform(uib, "emitterMax", 0, float4{ builder->mEmitter.getMax(), 0.0f });
+    ub.setUniform(uib, "velocityMin", 0, float4{ builder->mVelocityMin, 0.0f });
+    ub.setUniform(uib, "velocityMax", 0, float4{ builder->mVelocityMax, 0.0f });
+    ub.setUniform(uib, "acceleration", 0, float4{ builder->mAcceleration, 0.0f });
+    ub.setUniform(uib, "colorStart", 0, builder->mColorStart);
+    ub.setUniform(uib, "colorEnd", 0, builder->mColorEnd);
+    ub.setUniform(uib, "sizeLifetime", 0, float4{ builder->mSize, lifetime.x, lifetime.y });
+    ub.setUniform(uib, "particleCount", 0, count);
+    mUniforms = driver.createUniformBuffer(ub.getSize());
+
+    // a blended renderable, sorted with the others by its distance to the camera, and whose
+    // quads are drawn in the order of the keys
+    mEntity = engine.getEntityManager().create();
+    const Box& aabb = builder->mAABB;
+    RenderableManager::Builder(1)
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                    mVertexBuffer, mIndexBuffer)
+            .material(0, builder->mMaterialInstance)
+            .boundingBox(aabb)
+            .culling(!aabb.isEmpty())
+            .castShadows(false)
+            .receiveShadows(false)
+            .build(engine, mEntity);
+}
+
+void FParticleSystem::terminate(FEngine& engine) noexcept {
+    DriverApi& driver = engine.getDriverApi();
+    for (Handle<HwProgram>& program : mPrograms) {
+        if (program) {
+            driver.destroyProgram(program);
+            program.clear();
+        }
+    }
+    if (mSortSteps) {
+        driver.destroyUniformBuffer(mSortSteps);
+    }
+    driver.destroyUniformBuffer(mUniforms);
+    driver.destroyBufferObject(mKeys);
+    driver.destroyBufferObject(mParticles);
+
+    // use Engine::destroy because FEngine::destroy is inlined
+    Engine& e = engine;
+    e.destroy(mEntity);
+    e.destroy(mVertexBuffer);
+    e.destroy(mIndexBuffer);
+
+    engine.getEntityManager().destroy(mEntity);
+    mEntity = {};
+}
+
+void FParticleSystem::update(FEngine& engine, float dt, FCamera const& camera) {
+    if (!mSupported) {
+        return;
+    }
+
+    // the camera in the space of the particles, computed in double precision so that it's
+    // accurate when both are far from the origin
+    mat4 cameraModel = camera.getModelMatrixAccurate();
+    FTransformManager const& tcm = engine.getTransformManager();
+    FTransformManager::Instance ti = tcm.getInstance(mEntity);
+    if (ti) {
+        cameraModel = inverse(tcm.getWorldTransformAccurate(ti)) * cameraModel;
+    }
+    const mat4f model(cameraModel);
+
+    // the particles emitted during dt replace the oldest ones, in a ring
+    dt = std::max(dt, 0.0f);
+    const float spawn = mEmissionRate * dt + mSpawnRemainder;
+    const uint32_t spawnCount = uint32_t(std::min(spawn, float(mParticleCount)));
+    mSpawnRemainder = spawnCount < mParticleCount ? spawn - float(spawnCount) : 0.0f;
+
+    UniformInterfaceBlock const& uib = getParticleUib();
+    UniformBuffer& ub = mUniformBuffer;
+    ub.setUniform(uib, "eye", 0, float4{ model[3].xyz, 1.0f });
+    ub.setUniform(uib, "right", 0, float4{ normalize(model[0].xyz), 0.0f });
+    ub.setUniform(uib, "up", 0, float4{ normalize(model[1].xyz), 0.0f });
+    ub.setUniform(uib, "forward", 0, float4{ normalize(-model[2].xyz), 0.0f });
+    ub.setUniform(uib, "dt", 0, dt);
+    ub.setUniform(uib, "seed", 0, mSeed++);
+    ub.setUniform(uib, "spawnFirst", 0, mSpawnFirst);
+    ub.setUniform(uib, "spawnCount", 0, spawnCount);
+    mSpawnFirst = (mSpawnFirst + spawnCount) & (mParticleCount - 1);
+
+    DriverApi& driver = engine.getDriverApi();
+    driver.updateUniformBuffer(mUniforms, UniformBuffer(ub));
+
+    // the renderables' uniforms are bound again by each draw
+    const uint32_t groupCount = (mParticleCount + GROUP_SIZE - 1) / GROUP_SIZE;
+    driver.bindUniforms(BindingPoints::PER_RENDERABLE, mUniforms);
+    driver.bindStorageBuffer(0, mParticles);
+    driver.bindStorageBuffer(1, mKeys);
+    driver.dispatchCompute(getProgram(engine, SIMULATE), groupCount, 1, 1);
+
+    Handle<HwProgram> sort = getProgram(engine, SORT);
+    const uint32_t sortStepSize = uint32_t(getSortUib().getSize());
+    for (uint32_t i = 0; i < mSortStepCount; i++) {
+        driver.bindUniformsRange(BindingPoints::PER_RENDERABLE_BONES, mSortSteps,
+                i * SORT_STEP_STRIDE, sortStepSize);
+        driver.dispatchCompute(sort, groupCount, 1, 1);
+    }
+
+    driver.bindVertexStorageBuffer(2, mVertexBuffer->getHwHandle(), 0);
+    driver.dispatchCompute(getProgram(engine, EMIT), groupCount, 1, 1);
+}
+
+Handle<HwProgram> FParticleSystem::getProgram(FEngine& engine, Pass pass) {
+    Handle<HwProgram>& program = mPrograms[pass];
+    if (UTILS_UNLIKELY(!program)) {
+        static constexpr const char* NAMES[PASS_COUNT] = {
+                "ParticleSimulate", "ParticleSort", "ParticleEmit" };
+        static constexpr const char* SOURCES[PASS_COUNT] = { SIMULATE_CS, SORT_CS, EMIT_CS };
+
+        std::string source(engine.getDriver().getShaderModel() == ShaderModel::GL_ES_30 ?
+                "#version 310 es\nprecision highp float;\nprecision highp int;\n" :
+                "#version 430 core\n");
+        source += PARTICLES_CS;
+        source += SOURCES[pass];
+
+        Program pb;
+        pb.diagnostics(CString(NAMES[pass]))
+                .withComputeShader(CString(source.c_str()))
+                .addUniformBlock(BindingPoints::PER_RENDERABLE, &getParticleUib());
+        if (pass == SORT) {
+            pb.addUniformBlock(BindingPoints::PER_RENDERABLE_BONES, &getSortUib());
+        }
+        program = engine.getDriverApi().createProgram(std::move(pb));
+        engine.getFrameCounters().add(FrameCounters::PROGRAM_COMPILES);
+    }
+    return program;
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+Entity ParticleSystem::getEntity() const noexcept {
+    return upcast(this)->getEntity();
+}
+
+void ParticleSystem::setEmissionRate(float particlesPerSecond) noexcept {
+    upcast(this)->setEmissionRate(particlesPerSecond);
+}
+
+void ParticleSystem::update(Engine& engine, float dt, Camera const& camera) {
+    upcast(this)->update(upcast(engine), dt, upcast(camera));
+}
+
+} // namespace filament
@@ -15,7 +15,6 @@
  */
 
 #include "PostProcessManager.h"
-#include "RenderTargetPool.h"
 
 #include "details/Engine.h"
 
@@ -48,7 +47,8 @@ void PostProcessManager::terminate(driver::DriverApi& driver) noexcept {
 }
 
 void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeight,
-        const RenderTargetPool::Target* pos) const noexcept {
+        FrameGraphPassResources::RenderTarget const& source,
+        TemporalUpsampling const* temporal) const noexcept {
     FEngine& engine = *mEngine;
     DriverApi& driver = engine.getDriverApi();
 
@@ -58,21 +58,43 @@ void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeig
     params.filterMag = SamplerMagFilter::LINEAR;
     params.filterMin = SamplerMinFilter::LINEAR;
     SamplerBuffer sb(engine.getPostProcessSib());
-    sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, pos->texture, params);
+    sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, source.texture, params);
+    // all the samplers must be set, even the ones the pass doesn't use
+    const Handle<HwTexture> history = temporal && temporal->history ?
+            temporal->history : source.texture;
+    sb.setSampler(FEngine::PostProcessSib::HISTORY_BUFFER, history, params);
+    if (mColorGrading) {
+        sb.setSampler(FEngine::PostProcessSib::COLOR_GRADING, mColorGrading, params);
+    }
+    if (mAutoExposure) {
+        sb.setSampler(FEngine::PostProcessSib::AUTO_EXPOSURE, mAutoExposure, params);
+    }
 
     auto duration = engine.getTime();
     float fraction = (duration.count() % 1000000000) / 1000000000.0f;
 
     UniformBuffer& ub = mPostProcessUb;
     ub.setUniform(offsetof(FEngine::PostProcessingUib, time), fraction);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, autoExposure),
+            mAutoExposure ? 1.0f : 0.0f);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, heatmapRange), mHeatmapRange);
     ub.setUniform(offsetof(FEngine::PostProcessingUib, uvScale),
-            math::float2{ viewportWidth, viewportHeight } / math::float2{ pos->w, pos->h });
+            math::float2{ viewportWidth, viewportHeight } / math::float2{ source.width, source.height });
 
     // The shader may need to know the offset between the top of the texture and the top
     // of the rectangle that it actually needs to sample from.
-    const float yOffset = pos->h - viewportHeight;
+    const float yOffset = source.height - viewportHeight;
     ub.setUniform(offsetof(FEngine::PostProcessingUib, yOffset), yOffset);
 
+    if (temporal) {
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, reprojection), temporal->reprojection);
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, historySize),
+                math::float2{ temporal->width, temporal->height });
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, jitter), temporal->jitter);
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, historyWeight),
+                temporal->history ? 1.0f : 0.0f);
+    }
+
     driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
     driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
 }
@@ -85,93 +107,379 @@ void PostProcessManager::pass(driver::TextureFormat format, Handle<HwProgram> pr
     mCommands.push_back({program, format});
 }
 
-void PostProcessManager::finish(driver::TargetBufferFlags discarded,
-        Handle<HwRenderTarget> viewRenderTarget,
-        Viewport const& vp,
-        RenderTargetPool::Target const* previous,
-        Viewport const& svp) {
+void PostProcessManager::temporalUpsampling(Handle<HwProgram> program,
+        TemporalUpsampling const& params) noexcept {
+    mTemporalUpsampling = params;
+    mCommands.push_back({ program, {}, true });
+}
 
-    assert(viewRenderTarget);
-    assert(previous);
+void PostProcessManager::iblPrefilter(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+        uint32_t width, uint32_t height, Handle<HwTexture> environment,
+        float linearRoughness, uint8_t face, float size) const noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
 
+    // the samples are taken from the environment's mip levels, the other samplers are not used
+    driver::SamplerParams params;
+    params.filterMag = SamplerMagFilter::LINEAR;
+    params.filterMin = SamplerMinFilter::LINEAR_MIPMAP_LINEAR;
+    SamplerBuffer sb(engine.getPostProcessSib());
+    sb.setSampler(FEngine::PostProcessSib::ENVIRONMENT, environment, params);
+
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblRoughness), linearRoughness);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblFace), int32_t(face));
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSize), size);
+
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+    driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
+
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+    RenderPassParams renderPassParams = {};
+    renderPassParams.discardStart = TargetBufferFlags::ALL;
+    renderPassParams.width = width;
+    renderPassParams.height = height;
+
+    driver.beginRenderPass(target, renderPassParams);
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive(), 1);
+    driver.endRenderPass();
+}
+
+void PostProcessManager::mipmapDownsample(Handle<HwProgram> program,
+        Handle<HwRenderTarget> target, uint32_t width, uint32_t height,
+        Handle<HwTexture> texture, int32_t face) const noexcept {
     FEngine& engine = *mEngine;
     DriverApi& driver = engine.getDriverApi();
-    RenderTargetPool& rtp = engine.getRenderTargetPool();
-    Handle<HwRenderPrimitive> const& fullScreenRenderPrimitive = engine.getFullScreenRenderPrimitive();
-    std::vector<Command>& commands = mCommands;
 
-    if (UTILS_UNLIKELY(commands.empty())) {
-        rtp.put(previous);
-        return;
+    // the texture's levels are clamped to the input's, the taps are bilinear
+    driver::SamplerParams params;
+    params.filterMag = SamplerMagFilter::LINEAR;
+    params.filterMin = SamplerMinFilter::LINEAR;
+    SamplerBuffer sb(engine.getPostProcessSib());
+    sb.setSampler(face < 0 ? FEngine::PostProcessSib::COLOR_BUFFER :
+            FEngine::PostProcessSib::ENVIRONMENT, texture, params);
+
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, mipmapFace), face);
+
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+    driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
+
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+    RenderPassParams renderPassParams = {};
+    renderPassParams.discardStart = TargetBufferFlags::ALL;
+    renderPassParams.width = width;
+    renderPassParams.height = height;
+
+    driver.beginRenderPass(target, renderPassParams);
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive(), 1);
+    driver.endRenderPass();
+}
+
+void PostProcessManager::shadowMomentsBlur(Handle<HwProgram> program,
+        Handle<HwRenderTarget> target, Viewport const& viewport, Handle<HwTexture> input,
+        bool fromDepth, math::float2 direction, math::float4 const& bounds,
+        float exponent) const noexcept {
+    FEngine& engine = *mEngine;
+    DriverApi& driver = engine.getDriverApi();
+
+    // the taps are fetched, the depth is read without comparison
+    driver::SamplerParams params;
+    params.filterMag = SamplerMagFilter::NEAREST;
+    params.filterMin = SamplerMinFilter::NEAREST;
+    SamplerBuffer sb(engine.getPostProcessSib());
+    if (fromDepth) {
+        params.depthStencil = true;
+        sb.setSampler(FEngine::PostProcessSib::DEPTH_BUFFER, input, params);
+    } else {
+        sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, input, params);
     }
 
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, shadowBlurDirection), direction);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, vsmExponent), exponent);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, shadowBlurFromDepth),
+            int32_t(fromDepth ? 1 : 0));
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, shadowBlurBounds), bounds);
+
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+    driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
+
     Driver::RasterState rs;
     rs.culling = Driver::RasterState::CullingMode::NONE;
     rs.colorWrite = true;
+    rs.depthWrite = false;
     rs.depthFunc = Driver::RasterState::DepthFunc::A;
 
-    RenderPassParams params = {};
-    params.discardStart = TargetBufferFlags::ALL;
-    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
-    params.left = 0;
-    params.bottom = 0;
-    params.width = svp.width;
-    params.height = svp.height;
-    params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
-
-    for (size_t i = 0, c = commands.size() - 1; i < c; i++) {
-        // if the next command is a blit, it we don't need a texture
-        uint8_t flags = !commands[i + 1].program ? RenderTargetPool::Target::NO_TEXTURE : uint8_t();
-
-        // create a render target for this pass
-        RenderTargetPool::Target const* target = rtp.get(
-                TargetBufferFlags::COLOR, svp.width, svp.height, 1, commands[i].format, flags);
-
-        assert(target);
-
-        if (commands[i].program) {
-            // set the source for this pass (i.e. previous target)
-            setSource(params.width, params.height, previous);
-
-            // draw a full screen triangle
-            driver.beginRenderPass(target->target, params);
-            driver.draw(commands[i].program, rs, fullScreenRenderPrimitive);
-            driver.endRenderPass();
-        } else {
-            driver.blit(TargetBufferFlags::COLOR,
-                    target->target, 0, 0, svp.width, svp.height,
-                    previous->target, 0, 0, svp.width, svp.height);
-        }
-        // return the previous target to the pool
-        rtp.put(previous);
-        previous = target;
+    // the other tiles of the target are kept, they hold the other cascades
+    RenderPassParams renderPassParams = {};
+    renderPassParams.left = viewport.left;
+    renderPassParams.bottom = viewport.bottom;
+    renderPassParams.width = viewport.width;
+    renderPassParams.height = viewport.height;
+    renderPassParams.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+
+    driver.beginRenderPass(target, renderPassParams);
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive(), 1);
+    driver.endRenderPass();
+}
+
+void PostProcessManager::passInPlace(driver::DriverApi& driver,
+        Handle<HwProgram> program) const noexcept {
+    FEngine& engine = *mEngine;
+
+    // the program only samples the color grading and the exposure, but the samplers of the
+    // previous frame may have been destroyed since
+    SamplerBuffer sb(engine.getPostProcessSib());
+    driver::SamplerParams params;
+    params.filterMag = SamplerMagFilter::LINEAR;
+    params.filterMin = SamplerMinFilter::LINEAR;
+    if (mColorGrading) {
+        sb.setSampler(FEngine::PostProcessSib::COLOR_GRADING, mColorGrading, params);
+    }
+    if (mAutoExposure) {
+        sb.setSampler(FEngine::PostProcessSib::AUTO_EXPOSURE, mAutoExposure, params);
     }
 
-    assert(!commands.empty());
-    assert(previous);
+    auto duration = engine.getTime();
+    float fraction = (duration.count() % 1000000000) / 1000000000.0f;
 
-    // The last command is special, it always draw to the viewRenderTarget and uses
-    // the non scaled viewport.
-    if (commands.back().program) {
-        params.discardStart = discarded;
-        params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
-        params.left = vp.left;
-        params.bottom = vp.bottom;
-        params.width = vp.width;
-        params.height = vp.height;
+    UniformBuffer& ub = mPostProcessUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, time), fraction);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, autoExposure),
+            mAutoExposure ? 1.0f : 0.0f);
 
-        setSource(params.width, params.height, previous);
-        driver.beginRenderPass(viewRenderTarget, params);
-        driver.draw(commands.back().program, rs, fullScreenRenderPrimitive);
-        driver.endRenderPass();
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+    driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
 
-    } else {
-        driver.blit(TargetBufferFlags::COLOR,
-                viewRenderTarget, vp.left, vp.bottom, vp.width, vp.height,
-                previous->target, 0, 0, svp.width, svp.height);
+    // the depth buffer is left untouched, it can still be read after the color pass
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthWrite = false;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive(), 1);
+}
+
+void PostProcessManager::resolveTransparency(driver::DriverApi& driver,
+        Handle<HwProgram> program,
+        Handle<HwTexture> accumulation, Handle<HwTexture> revealage) const noexcept {
+    FEngine& engine = *mEngine;
+
+    // the program fetches the texels, the revealage takes the place of the history
+    driver::SamplerParams params;
+    params.filterMag = SamplerMagFilter::NEAREST;
+    params.filterMin = SamplerMinFilter::NEAREST;
+    SamplerBuffer sb(engine.getPostProcessSib());
+    sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, accumulation, params);
+    sb.setSampler(FEngine::PostProcessSib::HISTORY_BUFFER, revealage, params);
+    driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+
+    // color * (1 - revealage) is added to what's behind, which is attenuated by the revealage
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthWrite = false;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+    rs.blendFunctionSrcRGB = BlendFunction::ONE;
+    rs.blendFunctionSrcAlpha = BlendFunction::ONE;
+    rs.blendFunctionDstRGB = BlendFunction::ONE_MINUS_SRC_ALPHA;
+    rs.blendFunctionDstAlpha = BlendFunction::ONE_MINUS_SRC_ALPHA;
+
+    driver.draw(program, rs, engine.getFullScreenRenderPrimitive(), 1);
+}
+
+void PostProcessManager::autoExposure(FrameGraph& fg, FrameGraphResource input,
+        Viewport const& svp, AutoExposure const& params) noexcept {
+    FEngine& engine = *mEngine;
+
+    struct AutoExposurePassData {
+        FrameGraphResource input;
+    };
+
+    // The exposure is only read by the tone mapping passes, outside of the frame graph, so
+    // nothing keeps this pass alive but its side effect. The reductions and the exposure are
+    // owned by the view, they're too small to be worth recycling.
+    fg.addPass<AutoExposurePassData>("Auto Exposure",
+            [&](FrameGraph::Builder& builder, AutoExposurePassData& data) {
+                data.input = builder.sample(input);
+                builder.sideEffect();
+            },
+            [this, &engine, svp, params](FrameGraphPassResources const& resources,
+                    AutoExposurePassData const& data, DriverApi& driver) {
+                FrameGraphPassResources::RenderTarget const in = resources.get(data.input);
+
+                Driver::RasterState rs;
+                rs.culling = Driver::RasterState::CullingMode::NONE;
+                rs.colorWrite = true;
+                rs.depthWrite = false;
+                rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+                auto draw = [&](Handle<HwProgram> program, Handle<HwRenderTarget> target,
+                        uint32_t size) {
+                    RenderPassParams renderPassParams = {};
+                    renderPassParams.discardStart = TargetBufferFlags::ALL;
+                    renderPassParams.width = size;
+                    renderPassParams.height = size;
+                    driver.beginRenderPass(target, renderPassParams);
+                    driver.draw(program, rs, engine.getFullScreenRenderPrimitive(), 1);
+                    driver.endRenderPass();
+                };
+
+                // the luminance is metered with bilinear taps of the color buffer
+                driver::SamplerParams linear;
+                linear.filterMag = SamplerMagFilter::LINEAR;
+                linear.filterMin = SamplerMinFilter::LINEAR;
+                SamplerBuffer sb(engine.getPostProcessSib());
+                sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, in.texture, linear);
+                sb.setSampler(FEngine::PostProcessSib::HISTORY_BUFFER, in.texture, linear);
+                driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+
+                UniformBuffer& ub = mPostProcessUb;
+                const float yOffset = in.height - svp.height;
+                ub.setUniform(offsetof(FEngine::PostProcessingUib, yOffset), yOffset);
+                ub.setUniform(offsetof(FEngine::PostProcessingUib, autoExposureHistory),
+                        params.history ? 1.0f : 0.0f);
+                ub.setUniform(offsetof(FEngine::PostProcessingUib, autoExposureRange),
+                        params.range);
+                ub.setUniform(offsetof(FEngine::PostProcessingUib, autoExposureAdaptation),
+                        math::float4{ params.rateUp, params.rateDown, params.dt,
+                                params.compensation });
+                driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
+
+                draw(engine.getPostProcessProgram(PostProcessStage::AUTO_EXPOSURE_LUMINANCE),
+                        params.reductionTargets[0], AutoExposure::SIZE);
+
+                // the reductions and the adaptation fetch their inputs
+                driver::SamplerParams nearest;
+                nearest.filterMag = SamplerMagFilter::NEAREST;
+                nearest.filterMin = SamplerMinFilter::NEAREST;
+                uint32_t size = AutoExposure::SIZE;
+                for (size_t i = 1; i < AutoExposure::REDUCTION_COUNT; i++) {
+                    size /= 4;
+                    SamplerBuffer reduction(engine.getPostProcessSib());
+                    reduction.setSampler(FEngine::PostProcessSib::COLOR_BUFFER,
+                            params.reductionTextures[i - 1], nearest);
+                    reduction.setSampler(FEngine::PostProcessSib::HISTORY_BUFFER,
+                            params.reductionTextures[i - 1], nearest);
+                    driver.updateSamplerBuffer(mPostProcessSbh, std::move(reduction));
+                    draw(engine.getPostProcessProgram(PostProcessStage::AUTO_EXPOSURE_REDUCE),
+                            params.reductionTargets[i], size);
+                }
+
+                Handle<HwTexture> const last =
+                        params.reductionTextures[AutoExposure::REDUCTION_COUNT - 1];
+                SamplerBuffer adaptation(engine.getPostProcessSib());
+                adaptation.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, last, nearest);
+                adaptation.setSampler(FEngine::PostProcessSib::HISTORY_BUFFER,
+                        params.history ? params.history : last, nearest);
+                driver.updateSamplerBuffer(mPostProcessSbh, std::move(adaptation));
+                draw(engine.getPostProcessProgram(PostProcessStage::AUTO_EXPOSURE_ADAPTATION),
+                        params.target, 1);
+            });
+}
+
+void PostProcessManager::finish(FrameGraph& fg,
+        FrameGraphResource input, Viewport const& svp,
+        FrameGraphResource output, Viewport const& vp) noexcept {
+
+    assert(input.isValid());
+    assert(output.isValid());
+
+    FEngine& engine = *mEngine;
+    Handle<HwRenderPrimitive> const& fullScreenRenderPrimitive = engine.getFullScreenRenderPrimitive();
+    std::vector<Command>& commands = mCommands;
+
+    if (UTILS_UNLIKELY(commands.empty())) {
+        return;
     }
 
-    rtp.put(previous);
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+    struct PostProcessPassData {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    // size of the input of the current pass
+    Viewport src{ 0, 0, svp.width, svp.height };
+
+    for (size_t i = 0, c = commands.size(); i < c; i++) {
+        Command const& command = commands[i];
+
+        // The last command is special, it always draws to the output and uses the non scaled
+        // viewport. The others draw into a new target, the frame graph decides if it needs a
+        // texture (i.e. the next command isn't a blit), and reuses the memory of the targets
+        // that are no longer needed. The temporal upsampling draws into its history instead,
+        // at full resolution.
+        const bool last = i == c - 1;
+        assert(!last || !command.temporal);
+        TemporalUpsampling const* const temporal =
+                command.temporal ? &mTemporalUpsampling : nullptr;
+        const Viewport dst = last ? vp :
+                temporal ? Viewport{ 0, 0, temporal->width, temporal->height } : src;
+
+        FrameGraphResource history;
+        if (temporal) {
+            history = fg.import("Temporal Upsampling History", {
+                            .width = temporal->width, .height = temporal->height,
+                            .attachments = TargetBufferFlags::COLOR },
+                    temporal->target, TargetBufferFlags::ALL, temporal->texture);
+        }
+
+        auto& pass = fg.addPass<PostProcessPassData>(
+                temporal ? "Temporal Upsampling Pass" :
+                command.program ? "Post Process Pass" : "Post Process Blit",
+                [&](FrameGraph::Builder& builder, PostProcessPassData& data) {
+                    data.input = command.program ? builder.sample(input) : builder.read(input);
+                    data.output = builder.write(last ? output : temporal ? history :
+                            builder.create("Post Process Target", {
+                                    .width = src.width, .height = src.height,
+                                    .format = command.format }));
+                },
+                [this, program = command.program, rs, fullScreenRenderPrimitive, dst, src,
+                        temporal](FrameGraphPassResources const& resources,
+                        PostProcessPassData const& data, DriverApi& driver) {
+                    FrameGraphPassResources::RenderTarget const in = resources.get(data.input);
+                    FrameGraphPassResources::RenderTarget const out = resources.get(data.output);
+                    if (program) {
+                        RenderPassParams params = {};
+                        params.discardStart = out.discardStart;
+                        params.discardEnd = out.discardEnd;
+                        params.left = dst.left;
+                        params.bottom = dst.bottom;
+                        params.width = dst.width;
+                        params.height = dst.height;
+                        params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
+
+                        // set the source for this pass (i.e. previous target)
+                        setSource(src.width, src.height, in, temporal);
+
+                        // draw a full screen triangle
+                        driver.beginRenderPass(out.target, params);
+                        driver.draw(program, rs, fullScreenRenderPrimitive, 1);
+                        driver.endRenderPass();
+                    } else {
+                        driver.blit(TargetBufferFlags::COLOR,
+                                out.target, dst.left, dst.bottom, dst.width, dst.height,
+                                in.target, 0, 0, src.width, src.height);
+                    }
+                });
+        input = pass.getData().output;
+        src = { 0, 0, dst.width, dst.height };
+    }
 
     // clear our command buffer
     commands.clear();
@@ -17,7 +17,7 @@
 #ifndef TNT_FILAMENT_POSTPROCESS_MANAGER_H
 #define TNT_FILAMENT_POSTPROCESS_MANAGER_H
 
-#include "RenderTargetPool.h"
+#include "FrameGraph.h"
 
 #include "driver/DriverApiForward.h"
 #include "driver/UniformBuffer.h"
@@ -27,6 +27,10 @@
 
 #include <filament/driver/DriverEnums.h>
 
+#include <math/mat4.h>
+#include <math/vec2.h>
+#include <math/vec4.h>
+
 #include <vector>
 
 namespace filament {
@@ -38,10 +42,58 @@ class FView;
 
 class PostProcessManager {
 public:
+    // accumulates the jittered frames rendered at a lower resolution into a full resolution
+    // history, which is kept between frames
+    struct TemporalUpsampling {
+        Handle<HwTexture> history;          // previous frame's output, null if there is none
+        Handle<HwRenderTarget> target;      // this frame's output, at full resolution...
+        Handle<HwTexture> texture;          // ...and its color texture
+        uint32_t width = 0;                 // size of the output
+        uint32_t height = 0;
+        math::mat4f reprojection;           // from this frame's clip space to the history's
+        math::float2 jitter;                // of this frame, in pixels of the input
+    };
+
+    // meters the log2 luminance of the color buffer with a chain of reductions, then adapts the
+    // exposure of the previous frame towards it, all on the GPU
+    struct AutoExposure {
+        // size of the first reduction, each of the next ones is 4 times smaller
+        static constexpr uint32_t SIZE = 64;
+        static constexpr size_t REDUCTION_COUNT = 3;    // 64x64, 16x16 and 4x4
+
+        Handle<HwRenderTarget> reductionTargets[REDUCTION_COUNT];
+        Handle<HwTexture> reductionTextures[REDUCTION_COUNT];
+        Handle<HwTexture> history;          // previous frame's exposure, null if there is none
+        Handle<HwRenderTarget> target;      // this frame's exposure, 1x1...
+        Handle<HwTexture> texture;          // ...and its texture, read by the tone mapping
+        math::float2 range;                 // of the correction, in EV
+        float compensation = 0.0f;          // in EV
+        float rateUp = 0.0f;                // adaptation rates, per second
+        float rateDown = 0.0f;
+        float dt = 0.0f;                    // since the previous frame, in seconds
+    };
+
     void init(details::FEngine& engine) noexcept;
     void terminate(driver::DriverApi& driver) noexcept;
     void setSource(uint32_t viewportWidth, uint32_t viewportHeight,
-            const RenderTargetPool::Target* pos) const noexcept;
+            FrameGraphPassResources::RenderTarget const& source,
+            TemporalUpsampling const* temporal = nullptr) const noexcept;
+
+    // the 3D lookup table of the tone mapping passes (see ColorGrading), bound by setSource()
+    // and passInPlace()
+    void setColorGrading(Handle<HwTexture> lut) noexcept { mColorGrading = lut; }
+
+    // the exposure of the tone mapping passes (see AutoExposure::texture), bound by setSource()
+    // and passInPlace(), null to use the camera's exposure alone
+    void setAutoExposure(Handle<HwTexture> exposure) noexcept { mAutoExposure = exposure; }
+
+    // the value shown in red by PostProcessStage::DEBUG_HEATMAP, set by setSource()
+    void setHeatmapRange(float range) noexcept { mHeatmapRange = range; }
+
+    // adds the passes of the auto-exposure to the frame graph, which meter input (of size svp)
+    // and write the exposure into params.target; they're never culled
+    void autoExposure(FrameGraph& fg, FrameGraphResource input, Viewport const& svp,
+            AutoExposure const& params) noexcept;
 
     // start() is a scam, it does nothing
     void start() noexcept { }
@@ -52,11 +104,44 @@ public:
     // a blit pass, using the given format as target
     void blit(driver::TextureFormat format = driver::TextureFormat::RGBA8) noexcept;
 
-    void finish(driver::TargetBufferFlags discarded,
-            Handle<HwRenderTarget> viewRenderTarget,
-            Viewport const& vp,
-            RenderTargetPool::Target const* linearTarget,
-            Viewport const& svp);
+    // a temporal upsampling pass into params.target, it can only be followed by blits since
+    // the post-process shaders expect the input at the view's (scaled) resolution
+    void temporalUpsampling(Handle<HwProgram> program, TemporalUpsampling const& params) noexcept;
+
+    // renders a pass of the IBL prefilter (see IblPrefilter) into target, right away and outside
+    // of the frame graph
+    void iblPrefilter(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+            uint32_t width, uint32_t height, Handle<HwTexture> environment,
+            float linearRoughness, uint8_t face, float size) const noexcept;
+
+    // renders a level of a 2D texture, or a face of that level if face isn't -1, from the level
+    // above (see MipmapGenerator) into target, right away and outside of the frame graph
+    void mipmapDownsample(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+            uint32_t width, uint32_t height, Handle<HwTexture> texture,
+            int32_t face) const noexcept;
+
+    // renders one axis of the variance shadows' blur (see ShadowMap::prefilterMoments) into the
+    // tile of target at viewport, right away and outside of the frame graph. The input is either
+    // the shadow map's depth or the moments blurred along the other axis, bounds are the texels
+    // of the tile in the input (left, bottom, right, top, inclusive).
+    void shadowMomentsBlur(Handle<HwProgram> program, Handle<HwRenderTarget> target,
+            Viewport const& viewport, Handle<HwTexture> input, bool fromDepth,
+            math::float2 direction, math::float4 const& bounds, float exponent) const noexcept;
+
+    // draws program over the color attachment of the current render pass, which the program
+    // reads with framebuffer fetch
+    void passInPlace(driver::DriverApi& driver, Handle<HwProgram> program) const noexcept;
+
+    // blends the weighted-blended transparency's accumulation and revealage textures over the
+    // color attachment of the current render pass, with the TRANSPARENCY_RESOLVE program
+    void resolveTransparency(driver::DriverApi& driver, Handle<HwProgram> program,
+            Handle<HwTexture> accumulation, Handle<HwTexture> revealage) const noexcept;
+
+    // adds the passes to the frame graph, the first one reads input (of size svp), the last one
+    // writes into output (at vp)
+    void finish(FrameGraph& fg,
+            FrameGraphResource input, Viewport const& svp,
+            FrameGraphResource output, Viewport const& vp) noexcept;
 
 
 private:
@@ -65,9 +150,14 @@ private:
     struct Command {
         Handle<HwProgram> program = {};
         driver::TextureFormat format;
+        bool temporal = false;
     };
 
     std::vector<Command> mCommands;
+    TemporalUpsampling mTemporalUpsampling;
+    Handle<HwTexture> mColorGrading;
+    Handle<HwTexture> mAutoExposure;
+    float mHeatmapRange = 1.0f;
 
     // we need only one of these
     mutable UniformBuffer mPostProcessUb;
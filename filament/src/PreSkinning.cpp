@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PreSkinning.h"
+
+#include "details/DestroyBatch.h"
+#include "details/Engine.h"
+#include "details/VertexBuffer.h"
+
+#include "driver/Program.h"
+#include "driver/UniformBuffer.h"
+
+#include <filament/EngineEnums.h>
+#include <filament/UniformInterfaceBlock.h>
+
+#include <private/filament/UibGenerator.h>
+
+#include <utils/CString.h>
+
+#include <math/vec4.h>
+
+#include <string>
+
+namespace filament {
+
+using namespace driver;
+using namespace details;
+using namespace math;
+
+// the formats of the attributes the compute shader reads and writes, must match SKINNING_CS
+enum Format : int32_t {
+    FORMAT_NONE = -1,
+    FORMAT_FLOAT3,
+    FORMAT_FLOAT4,
+    FORMAT_HALF4,
+    FORMAT_SNORM16,
+    FORMAT_UNORM8,
+    FORMAT_UNORM16,
+    FORMAT_UINT8,
+    FORMAT_UINT16,
+};
+
+// all the attributes skinned or read by the compute shader, in the order of their bindings
+static constexpr VertexAttribute ATTRIBUTES[] = {
+        VertexAttribute::POSITION, VertexAttribute::TANGENTS,
+        VertexAttribute::BONE_INDICES, VertexAttribute::BONE_WEIGHTS };
+static constexpr const char* ATTRIBUTE_NAMES[] = {
+        "position", "tangents", "boneIndices", "boneWeights" };
+
+static constexpr uint32_t GROUP_SIZE = 64;
+
+static const char SKINNING_CS[] = R"GLSL(
+layout(local_size_x = 64) in;
+
+layout(std140) uniform BonesUniforms {
+    vec4 bones[MAX_BONE_COUNT * 2];
+} bonesUniforms;
+
+// offset and stride in 32 bits words, and format of each attribute
+layout(std140) uniform SkinningUniforms {
+    ivec4 position;
+    ivec4 tangents;
+    ivec4 boneIndices;
+    ivec4 boneWeights;
+    uint vertexCount;
+} skinning;
+
+layout(std430, binding = 0) buffer Positions { uint data[]; } positions;
+layout(std430, binding = 1) buffer Tangents { uint data[]; } tangents;
+layout(std430, binding = 2) readonly buffer BoneIndices { uint data[]; } boneIndices;
+layout(std430, binding = 3) readonly buffer BoneWeights { uint data[]; } boneWeights;
+
+#define FORMAT_FLOAT3   0
+#define FORMAT_FLOAT4   1
+#define FORMAT_HALF4    2
+#define FORMAT_SNORM16  3
+#define FORMAT_UNORM8   4
+#define FORMAT_UNORM16  5
+#define FORMAT_UINT8    6
+#define FORMAT_UINT16   7
+
+uint index(ivec4 attribute, uint vertex) {
+    return uint(attribute.x) + vertex * uint(attribute.y);
+}
+
+vec3 rotate(vec3 v, vec4 q) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+vec4 mulQuat(vec4 a, vec4 b) {
+    return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz), a.w * b.w - dot(a.xyz, b.xyz));
+}
+
+vec4 readPosition(uint i) {
+    int format = skinning.position.z;
+    if (format == FORMAT_HALF4) {
+        return vec4(unpackHalf2x16(positions.data[i]), unpackHalf2x16(positions.data[i + 1u]));
+    }
+    return vec4(uintBitsToFloat(positions.data[i]), uintBitsToFloat(positions.data[i + 1u]),
+            uintBitsToFloat(positions.data[i + 2u]),
+            format == FORMAT_FLOAT4 ? uintBitsToFloat(positions.data[i + 3u]) : 1.0);
+}
+
+void writePosition(uint i, vec4 p) {
+    int format = skinning.position.z;
+    if (format == FORMAT_HALF4) {
+        positions.data[i] = packHalf2x16(p.xy);
+        positions.data[i + 1u] = packHalf2x16(p.zw);
+        return;
+    }
+    positions.data[i] = floatBitsToUint(p.x);
+    positions.data[i + 1u] = floatBitsToUint(p.y);
+    positions.data[i + 2u] = floatBitsToUint(p.z);
+}
+
+vec4 readTangents(uint i) {
+    int format = skinning.tangents.z;
+    if (format == FORMAT_HALF4) {
+        return vec4(unpackHalf2x16(tangents.data[i]), unpackHalf2x16(tangents.data[i + 1u]));
+    }
+    if (format == FORMAT_SNORM16) {
+        return vec4(unpackSnorm2x16(tangents.data[i]), unpackSnorm2x16(tangents.data[i + 1u]));
+    }
+    return vec4(uintBitsToFloat(tangents.data[i]), uintBitsToFloat(tangents.data[i + 1u]),
+            uintBitsToFloat(tangents.data[i + 2u]), uintBitsToFloat(tangents.data[i + 3u]));
+}
+
+void writeTangents(uint i, vec4 t) {
+    int format = skinning.tangents.z;
+    if (format == FORMAT_HALF4) {
+        tangents.data[i] = packHalf2x16(t.xy);
+        tangents.data[i + 1u] = packHalf2x16(t.zw);
+    } else if (format == FORMAT_SNORM16) {
+        tangents.data[i] = packSnorm2x16(t.xy);
+        tangents.data[i + 1u] = packSnorm2x16(t.zw);
+    } else {
+        tangents.data[i] = floatBitsToUint(t.x);
+        tangents.data[i + 1u] = floatBitsToUint(t.y);
+        tangents.data[i + 2u] = floatBitsToUint(t.z);
+        tangents.data[i + 3u] = floatBitsToUint(t.w);
+    }
+}
+
+uvec4 readBoneIndices(uint i) {
+    uint v = boneIndices.data[i];
+    if (skinning.boneIndices.z == FORMAT_UINT16) {
+        uint w = boneIndices.data[i + 1u];
+        return uvec4(v & 0xFFFFu, v >> 16u, w & 0xFFFFu, w >> 16u);
+    }
+    return uvec4(bitfieldExtract(v, 0, 8), bitfieldExtract(v, 8, 8),
+            bitfieldExtract(v, 16, 8), bitfieldExtract(v, 24, 8));
+}
+
+vec4 readBoneWeights(uint i) {
+    int format = skinning.boneWeights.z;
+    if (format == FORMAT_UNORM8) {
+        return unpackUnorm4x8(boneWeights.data[i]);
+    }
+    if (format == FORMAT_UNORM16) {
+        return vec4(unpackUnorm2x16(boneWeights.data[i]), unpackUnorm2x16(boneWeights.data[i + 1u]));
+    }
+    if (format == FORMAT_HALF4) {
+        return vec4(unpackHalf2x16(boneWeights.data[i]), unpackHalf2x16(boneWeights.data[i + 1u]));
+    }
+    return vec4(uintBitsToFloat(boneWeights.data[i]), uintBitsToFloat(boneWeights.data[i + 1u]),
+            uintBitsToFloat(boneWeights.data[i + 2u]), uintBitsToFloat(boneWeights.data[i + 3u]));
+}
+
+void main() {
+    uint vertex = gl_GlobalInvocationID.x;
+    if (vertex >= skinning.vertexCount) {
+        return;
+    }
+
+    uvec4 ids = readBoneIndices(index(skinning.boneIndices, vertex)) * 2u;
+    vec4 weights = readBoneWeights(index(skinning.boneWeights, vertex));
+
+    // same as skinPosition() in the vertex shader, bone i is the rotation bones[2i] followed
+    // by the translation bones[2i + 1]
+    uint p = index(skinning.position, vertex);
+    vec4 position = readPosition(p);
+    vec3 skinned = vec3(0.0);
+    for (int k = 0; k < 4; k++) {
+        vec4 q = bonesUniforms.bones[ids[k]];
+        vec3 t = bonesUniforms.bones[ids[k] + 1u].xyz;
+        skinned += weights[k] * (rotate(position.xyz, q) + t);
+    }
+    writePosition(p, vec4(skinned, position.w));
+
+    if (skinning.tangents.z >= 0) {
+        // blend the rotations in the same hemisphere, the sign of w is the bitangent's direction
+        vec4 q0 = bonesUniforms.bones[ids.x];
+        vec4 q = weights.x * q0;
+        for (int k = 1; k < 4; k++) {
+            vec4 qk = bonesUniforms.bones[ids[k]];
+            q += weights[k] * (dot(qk, q0) < 0.0 ? -qk : qk);
+        }
+        uint i = index(skinning.tangents, vertex);
+        vec4 frame = readTangents(i);
+        vec4 rotated = mulQuat(normalize(q), normalize(frame));
+        writeTangents(i, (rotated.w < 0.0) == (frame.w < 0.0) ? rotated : -rotated);
+    }
+}
+)GLSL";
+
+struct PreSkinning::Primitive {
+    Handle<HwVertexBuffer> source;
+    Handle<HwVertexBuffer> vertices;        // the skinned copy of source
+    Handle<HwUniformBuffer> uniforms;       // SkinningUniforms
+    uint32_t vertexCount;
+    uint8_t buffers[4];                     // buffer index of each of the ATTRIBUTES
+};
+
+static UniformInterfaceBlock const& getSkinningUib() noexcept {
+    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("SkinningUniforms")
+            .add("position",    1, UniformInterfaceBlock::Type::INT4)
+            .add("tangents",    1, UniformInterfaceBlock::Type::INT4)
+            .add("boneIndices", 1, UniformInterfaceBlock::Type::INT4)
+            .add("boneWeights", 1, UniformInterfaceBlock::Type::INT4)
+            .add("vertexCount", 1, UniformInterfaceBlock::Type::UINT)
+            .build();
+    return uib;
+}
+
+// the compute shader reads and writes the vertex buffers as arrays of 32 bits words
+static Format getFormat(VertexAttribute attribute, Driver::Attribute const& a) noexcept {
+    if (a.buffer == 0xFF || (a.offset % 4) || (a.stride % 4)) {
+        return FORMAT_NONE;
+    }
+    const bool normalized = (a.flags & Driver::Attribute::FLAG_NORMALIZED) != 0;
+    switch (attribute) {
+        case VertexAttribute::POSITION:
+            switch (a.type) {
+                case ElementType::FLOAT3: return FORMAT_FLOAT3;
+                case ElementType::FLOAT4: return FORMAT_FLOAT4;
+                case ElementType::HALF4:  return FORMAT_HALF4;
+                default:                  return FORMAT_NONE;
+            }
+        case VertexAttribute::TANGENTS:
+            switch (a.type) {
+                case ElementType::FLOAT4: return FORMAT_FLOAT4;
+                case ElementType::HALF4:  return FORMAT_HALF4;
+                case ElementType::SHORT4: return normalized ? FORMAT_SNORM16 : FORMAT_NONE;
+                default:                  return FORMAT_NONE;
+            }
+        case VertexAttribute::BONE_INDICES:
+            switch (a.type) {
+                case ElementType::UBYTE4:  return normalized ? FORMAT_NONE : FORMAT_UINT8;
+                case ElementType::USHORT4: return normalized ? FORMAT_NONE : FORMAT_UINT16;
+                default:                   return FORMAT_NONE;
+            }
+        case VertexAttribute::BONE_WEIGHTS:
+            switch (a.type) {
+                case ElementType::FLOAT4:  return FORMAT_FLOAT4;
+                case ElementType::HALF4:   return FORMAT_HALF4;
+                case ElementType::UBYTE4:  return normalized ? FORMAT_UNORM8 : FORMAT_NONE;
+                case ElementType::USHORT4: return normalized ? FORMAT_UNORM16 : FORMAT_NONE;
+                default:                   return FORMAT_NONE;
+            }
+        default:
+            return FORMAT_NONE;
+    }
+}
+
+bool PreSkinning::isSkinnable(FVertexBuffer const* vertices) noexcept {
+    // only the tangents are optional
+    const Driver::AttributeArray attributes = vertices->getAttributeArray();
+    for (VertexAttribute attribute : ATTRIBUTES) {
+        Driver::Attribute const& a = attributes[attribute];
+        const bool optional = attribute == VertexAttribute::TANGENTS && a.buffer == 0xFF;
+        if (!optional && getFormat(attribute, a) == FORMAT_NONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PreSkinning::isSupported(FEngine& engine) noexcept {
+    if (UTILS_UNLIKELY(mSupported < 0)) {
+        mSupported = int8_t(engine.getDriverApi().isComputeSupported());
+    }
+    return mSupported != 0;
+}
+
+PreSkinning::Primitive* PreSkinning::create(FEngine& engine, FVertexBuffer const* vertices) {
+    if (!isSupported(engine) || !isSkinnable(vertices)) {
+        return nullptr;
+    }
+
+    const Driver::AttributeArray attributes = vertices->getAttributeArray();
+    UniformBuffer ub(getSkinningUib());
+    uint8_t buffers[4];
+    for (size_t i = 0; i < 4; i++) {
+        Driver::Attribute const& a = attributes[ATTRIBUTES[i]];
+        const Format format = getFormat(ATTRIBUTES[i], a);
+        // without tangents, binding 1 aliases the positions and is never accessed
+        buffers[i] = format == FORMAT_NONE ? buffers[0] : a.buffer;
+        ub.setUniform(size_t(getSkinningUib().getUniformOffset(ATTRIBUTE_NAMES[i], 0)),
+                int4{ a.offset / 4, a.stride / 4, format, 0 });
+    }
+    ub.setUniform(size_t(getSkinningUib().getUniformOffset("vertexCount", 0)),
+            uint32_t(vertices->getVertexCount()));
+
+    DriverApi& driver = engine.getDriverApi();
+    Primitive* primitive = new Primitive;
+    primitive->source = vertices->getHwHandle();
+    primitive->vertices = driver.createVertexBuffer(vertices->getBufferCount(),
+            uint8_t(vertices->getDeclaredAttributes().count()), uint32_t(vertices->getVertexCount()), attributes,
+            BufferUsage::DYNAMIC);
+    primitive->uniforms = driver.createUniformBuffer(ub.getSize());
+    driver.updateUniformBuffer(primitive->uniforms, std::move(ub));
+    primitive->vertexCount = uint32_t(vertices->getVertexCount());
+    std::copy(std::begin(buffers), std::end(buffers), primitive->buffers);
+    return primitive;
+}
+
+void PreSkinning::destroy(FEngine& engine, Primitive* primitive) noexcept {
+    if (primitive) {
+        DriverApi& driver = engine.getDriverApi();
+        driver.destroyVertexBuffer(primitive->vertices);
+        driver.destroyUniformBuffer(primitive->uniforms);
+        delete primitive;
+    }
+}
+
+void PreSkinning::destroy(Primitive* primitive, details::DestroyBatch& batch) noexcept {
+    if (primitive) {
+        batch.add(primitive->vertices);
+        batch.add(primitive->uniforms);
+        delete primitive;
+    }
+}
+
+Handle<HwVertexBuffer> PreSkinning::getVertexBuffer(Primitive const* primitive) noexcept {
+    return primitive->vertices;
+}
+
+void PreSkinning::skin(FEngine& engine, Primitive const* primitive,
+        Handle<HwUniformBuffer> bones, uint32_t bonesOffset) {
+    DriverApi& driver = engine.getDriverApi();
+
+    // start again from the bind pose, the vertices are skinned in place
+    driver.copyVertexBuffer(primitive->vertices, primitive->source);
+    for (size_t i = 0; i < 4; i++) {
+        driver.bindVertexStorageBuffer(i, primitive->vertices, primitive->buffers[i]);
+    }
+
+    // the renderables' uniforms are bound again by each draw
+    driver.bindUniformsRange(BindingPoints::PER_RENDERABLE_BONES, bones, bonesOffset,
+            UibGenerator::getPerRenderableBonesUib().getSize());
+    driver.bindUniforms(BindingPoints::PER_RENDERABLE, primitive->uniforms);
+    driver.dispatchCompute(getProgram(engine),
+            (primitive->vertexCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+}
+
+Handle<HwProgram> PreSkinning::getProgram(FEngine& engine) {
+    if (UTILS_UNLIKELY(!mProgram)) {
+        std::string source(engine.getDriver().getShaderModel() == ShaderModel::GL_ES_30 ?
+                "#version 310 es\nprecision highp float;\nprecision highp int;\n" :
+                "#version 430 core\n");
+        source += "#define MAX_BONE_COUNT " + std::to_string(CONFIG_MAX_BONE_COUNT) + "\n";
+        source += SKINNING_CS;
+
+        Program pb;
+        pb.diagnostics(utils::CString("PreSkinning"))
+                .withComputeShader(utils::CString(source.c_str()))
+                .addUniformBlock(BindingPoints::PER_RENDERABLE_BONES,
+                        &UibGenerator::getPerRenderableBonesUib())
+                .addUniformBlock(BindingPoints::PER_RENDERABLE, &getSkinningUib());
+        mProgram = engine.getDriverApi().createProgram(std::move(pb));
+        engine.getFrameCounters().add(FrameCounters::PROGRAM_COMPILES);
+    }
+    return mProgram;
+}
+
+void PreSkinning::terminate(FEngine& engine) noexcept {
+    if (mProgram) {
+        engine.getDriverApi().destroyProgram(mProgram);
+        mProgram.clear();
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_PRESKINNING_H
+#define TNT_FILAMENT_PRESKINNING_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class DestroyBatch;
+class FEngine;
+class FVertexBuffer;
+} // namespace details
+
+/*
+ * PreSkinning skins the vertices of the renderables built with
+ * RenderableManager::Builder::preSkinning() with a compute shader, once per update of the bones,
+ * into a copy of their vertex buffers. All the passes (shadows, depth pre-pass, color) then draw
+ * that copy with the non-skinned variant of their material, instead of skinning the vertices in
+ * each of their vertex shaders.
+ *
+ * The copy is refreshed from the original vertex buffer before each skinning, and its positions
+ * and tangents are then skinned in place. The tangent frames are rotated by the blend of the
+ * bones' rotations.
+ */
+class PreSkinning {
+public:
+    struct Primitive;
+
+    // false if the backend can't run compute shaders, in which case create() always fails
+    bool isSupported(details::FEngine& engine) noexcept;
+
+    // whether the positions, bone indices and weights of the vertex buffer (and its tangents,
+    // if any) have a layout the compute shader can skin, see getFormat()
+    static bool isSkinnable(details::FVertexBuffer const* vertices) noexcept;
+
+    // returns nullptr if the vertex buffer isn't skinnable or pre-skinning isn't supported
+    Primitive* create(details::FEngine& engine, details::FVertexBuffer const* vertices);
+    void destroy(details::FEngine& engine, Primitive* primitive) noexcept;
+    void destroy(Primitive* primitive, details::DestroyBatch& batch) noexcept;
+
+    // the skinned copy of the primitive's vertex buffer
+    static Handle<HwVertexBuffer> getVertexBuffer(Primitive const* primitive) noexcept;
+
+    // skins the vertices with the bones at "bonesOffset" bytes of the "bones" uniform buffer,
+    // the commands that follow see the skinned vertices
+    void skin(details::FEngine& engine, Primitive const* primitive,
+            Handle<HwUniformBuffer> bones, uint32_t bonesOffset);
+
+    void terminate(details::FEngine& engine) noexcept;
+
+private:
+    Handle<HwProgram> getProgram(details::FEngine& engine);
+
+    Handle<HwProgram> mProgram;
+    int8_t mSupported = -1;     // not known yet
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_PRESKINNING_H
@@ -33,5 +33,11 @@ const uint8_t DEFAULT_MATERIAL_PACKAGE[] = {
 };
 const size_t DEFAULT_MATERIAL_PACKAGE_SIZE = sizeof(DEFAULT_MATERIAL_PACKAGE);
 
+// This package is generated with matc and contains the material of the debug visualizations.
+const uint8_t DEBUG_VISUALIZATION_PACKAGE[] = {
+#include "generated/material/debugVisualization.inc"
+};
+const size_t DEBUG_VISUALIZATION_PACKAGE_SIZE = sizeof(DEBUG_VISUALIZATION_PACKAGE);
+
 } // namespace details
 } //namespace filament
@@ -29,6 +29,9 @@ extern const size_t POST_PROCESS_PACKAGE_SIZE;
 extern const uint8_t DEFAULT_MATERIAL_PACKAGE[];
 extern const size_t DEFAULT_MATERIAL_PACKAGE_SIZE;
 
+extern const uint8_t DEBUG_VISUALIZATION_PACKAGE[];
+extern const size_t DEBUG_VISUALIZATION_PACKAGE_SIZE;
+
 } // namespace details
 } //namespace filament
 
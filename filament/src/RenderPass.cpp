@@ -20,15 +20,22 @@
 #include "details/Material.h"
 #include "details/MaterialInstance.h"
 #include "details/RenderPrimitive.h"
+#include "details/ShadowAtlas.h"
 #include "details/ShadowMap.h"
 #include "details/View.h"
 
 // NOTE: We only need Renderer.h here because the definition of some FRenderer methods are here
 #include "details/Renderer.h"
 
+#include <utils/algorithm.h>
 #include <utils/JobSystem.h>
+#include <utils/memalign.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <memory>
+#include <numeric>
+
 using namespace utils;
 using namespace math;
 
@@ -40,49 +47,342 @@ namespace details {
 
 RenderPass::~RenderPass() noexcept = default;
 
+RenderPass::CommandChunks::CommandChunks(size_t threadCount)
+        : mChunks(static_cast<Chunk*>(
+                utils::aligned_alloc(threadCount * sizeof(Chunk), alignof(Chunk)))),
+          mChunkCount(threadCount) {
+    std::uninitialized_fill_n(mChunks, mChunkCount, Chunk{});
+}
+
+RenderPass::CommandChunks::~CommandChunks() noexcept {
+    for (size_t i = 0; i < mChunkCount; i++) {
+        utils::aligned_free(mChunks[i].data);
+    }
+    utils::aligned_free(mChunks);
+}
+
+RenderPass::Command* RenderPass::CommandChunks::reserve(size_t index, size_t count) noexcept {
+    assert(index < mChunkCount);
+    Chunk& chunk = mChunks[index];
+    if (UTILS_UNLIKELY(chunk.size + count > chunk.capacity)) {
+        // this happens only until the chunks are large enough for the scene
+        const size_t capacity = std::max(size_t(chunk.capacity) * 2, chunk.size + count);
+        Command* const data = static_cast<Command*>(
+                utils::aligned_alloc(capacity * sizeof(Command), CACHELINE_SIZE));
+        std::copy_n(chunk.data, chunk.size, data);
+        utils::aligned_free(chunk.data);
+        chunk.data = data;
+        chunk.capacity = uint32_t(capacity);
+    }
+    return chunk.data + chunk.size;
+}
+
+size_t RenderPass::CommandChunks::size() const noexcept {
+    size_t size = 0;
+    for (size_t i = 0; i < mChunkCount; i++) {
+        size += mChunks[i].size;
+    }
+    return size;
+}
+
+void RenderPass::CommandChunks::gather(Command* commands, size_t count) noexcept {
+    for (size_t i = 0; i < mChunkCount; i++) {
+        Chunk& chunk = mChunks[i];
+        const size_t n = std::min(size_t(chunk.size), count);
+        commands = std::copy_n(chunk.data, n, commands);
+        count -= n;
+        chunk.size = 0;
+    }
+}
+
+bool RenderPass::CommandCache::Inputs::operator==(Inputs const& rhs) const noexcept {
+    return scene == rhs.scene &&
+           renderableGeneration == rhs.renderableGeneration &&
+           transformGeneration == rhs.transformGeneration &&
+           materialInstanceGeneration == rhs.materialInstanceGeneration &&
+           commandTypeFlags == rhs.commandTypeFlags &&
+           renderFlags == rhs.renderFlags &&
+           visibilityMask == rhs.visibilityMask &&
+           visibilityValue == rhs.visibilityValue &&
+           all(equal(cameraPosition, rhs.cameraPosition)) &&
+           all(equal(cameraForward, rhs.cameraForward)) &&
+           pixelScale == rhs.pixelScale &&
+           minOccluderPixels == rhs.minOccluderPixels;
+}
+
+bool RenderPass::CommandCache::update(Inputs const& inputs,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr) noexcept {
+    SYSTRACE_CALL();
+
+    auto const* const UTILS_RESTRICT soaInstances   = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaUniforms    = soa.data<FScene::UNIFORMS_OFFSET>();
+    auto const* const UTILS_RESTRICT soaBones       = soa.data<FScene::BONES_OFFSET>();
+    auto const* const UTILS_RESTRICT soaVisibleMask = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT soaPrimitives  = soa.data<FScene::PRIMITIVES>();
+
+    // the rows are compared and replaced in a single pass
+    bool unchanged = inputs == mInputs && mRows.size() == vr.size();
+    mRows.resize(vr.size());
+    Row* UTILS_RESTRICT row = mRows.data();
+    for (uint32_t i : vr) {
+        const Row current = {
+                soaInstances[i].asValue(),
+                soaUniforms[i],
+                soaBones[i],
+                uint32_t(soaVisibleMask[i] & inputs.visibilityMask),
+                soaPrimitives[i].data(),
+                soaPrimitives[i].size() };
+        unchanged = unchanged && current == *row;
+        *row++ = current;
+    }
+
+    mInputs = inputs;
+    mUnchanged = unchanged;
+    if (!unchanged) {
+        mCommands.clear();
+        for (CommandBundle& bundle : mBundles) {
+            bundle.clear();
+        }
+    }
+    return unchanged && !mCommands.empty();
+}
+
+CommandBundle* RenderPass::CommandCache::getBundles(
+        Handle<HwUniformBuffer> uniforms, Handle<HwUniformBuffer> bones) noexcept {
+    if (uniforms != mBundleUniforms || bones != mBundleBones) {
+        mBundleUniforms = uniforms;
+        mBundleBones = bones;
+        for (CommandBundle& bundle : mBundles) {
+            bundle.clear();
+        }
+    }
+    return mBundles;
+}
+
+void RenderPass::CommandCache::store(Command const* first, Command const* last) {
+    if (mUnchanged && mCommands.empty()) {
+        mCommands.assign(first, last);
+    }
+}
+
 UTILS_ALWAYS_INLINE // this allows the compiler to devirtualize some calls
 inline              // this removes the code from the compilation unit
-void RenderPass::render(
+size_t RenderPass::render(
         FEngine& engine, JobSystem& js,
-        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        FScene const& scene, FScene::RenderableSoa const& soa, Range<uint32_t> vr,
         uint32_t commandTypeFlags, RenderFlags renderFlags,
         const CameraInfo& camera, Viewport const& viewport,
-        GrowingSlice<Command>& commands) noexcept {
+        CommandChunks& chunks, GrowingSlice<Command>& commands) noexcept {
 
     SYSTRACE_CONTEXT();
 
     // trace the number of visible renderables
     SYSTRACE_VALUE32("visibleRenderables", vr.size());
 
-    // up-to-date summed primitive counts needed for generateCommands()
+    const bool colorPass = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+
+    // we extract camera position/forward outside of the loop, because these are not cheap.
+    const float3 cameraPosition(camera.getPosition());
+    const float3 cameraForwardVector(camera.getForwardVector());
+    // pixels covered on screen by a unit radius at a unit distance, drives texture streaming
+    const float pixelScale = colorPass ? camera.projection[1][1] * viewport.height : 0.0f;
+    // with a selective depth pre-pass, the size in pixels of the smallest occluders drawn in it
+    const float minOccluderPixels = viewport.height * MIN_OCCLUDER_SIZE;
+
+    // The cache is bypassed with streaming textures, their levels are requested while the
+    // commands are generated, and with a debug visualization, which rewrites the commands.
+    const bool visualize = mVisualization != FEngine::DebugVisualization::NONE;
+    CommandCache* const cache = engine.getTextureStreamer().empty() && !visualize ?
+            mCommandCache : nullptr;
+    CpuStageTimings& timings = engine.getCpuStageTimings();
+    size_t required;
+    bool cached = false;
+    if (cache && cache->update({ &scene,
+                    engine.getRenderableManager().getGeneration(),
+                    engine.getTransformManager().getGeneration(),
+                    engine.getMaterialInstanceGeneration(),
+                    commandTypeFlags, renderFlags, mVisibilityMask, mVisibilityValue,
+                    cameraPosition, cameraForwardVector, pixelScale, minOccluderPixels },
+                soa, vr) && cache->size() <= commands.remain()) {
+        // nothing changed since the last frame, the commands are already sorted
+        cached = true;
+        required = commands.size() + cache->size() * 2;
+        std::copy_n(cache->data(), cache->size(), commands.grow(uint32_t(cache->size())));
+    } else {
+        required = generateAndSortCommands(engine, js, soa, vr, commandTypeFlags, renderFlags,
+                cameraPosition, cameraForwardVector, pixelScale, minOccluderPixels,
+                chunks, commands, cache);
+    }
+
+    // commands are sorted, so the commands of each pass are contiguous and the first sentinel
+    // marks the end of the last one
+    auto findPass = [&commands](Pass pass) -> Command const* {
+        return std::lower_bound(commands.cbegin(), commands.cend(), uint64_t(pass),
+                [](Command const& c, uint64_t key) { return c.key < key; });
+    };
+    Command const* const first = commands.cbegin();
+    Command const* const orderIndependent = findPass(Pass::ORDER_INDEPENDENT);
+    Command const* const blended = findPass(Pass::BLENDED);
+    Command const* const last = findPass(Pass::SENTINEL);
+    if (UTILS_UNLIKELY(visualize)) {
+        applyVisualization(engine, mVisualization,
+                commands.begin(), commands.begin() + (last - first));
+    }
+    mHasOrderIndependentPass = orderIndependent != blended;
+    mDrawCount = uint32_t(last - first) * mEyeCount; // every command is a draw call, per eye
+    engine.getFrameCounters().add(FrameCounters::COMMANDS_RECORDED, mDrawCount);
+
+    // Take care not to upload data within the render pass (synchronize can commit froxel data)
+    driver::DriverApi& driver = engine.getDriverApi();
+    beginRenderPass(driver, viewport, camera);
+
+    // Now, execute all commands. The uniforms and bones of all renderables are in a single
+    // buffer each, which commands bind by offset.
+    const PerRenderableBuffers buffers = {
+            scene.getRenderableUbh(),
+            engine.getPerRenderableUib().getSize(),
+            engine.getRenderableManager().getBonesUbh() };
+    { // scope for the timing
+        CpuStageTimings::Scope timing(timings, CpuStageTimings::RECORD);
+        // the driver commands of cached commands are encoded once, then only copied
+        CommandBundle* const bundles = cached ?
+                cache->getBundles(buffers.uniforms, buffers.bones) : nullptr;
+        auto record = [&](Command const* first, Command const* last, size_t index) {
+            if (!bundles) {
+                RenderPass::recordDriverCommands(driver, js, buffers, first, last);
+                return;
+            }
+            CommandBundle& bundle = bundles[index];
+            if (!bundle.canReplay(driver)) {
+                RenderPass::recordDriverCommands(driver, js, buffers, first, last, bundle);
+            }
+            bundle.replay(driver, js);
+        };
+        for (size_t eye = 0; eye < mEyeCount; eye++) {
+            if (UTILS_UNLIKELY(mEyeCount > 1)) {
+                // the commands are the same for all eyes, only the view changes
+                beginEye(driver, viewport, eye);
+            }
+            if (UTILS_LIKELY(!mHasOrderIndependentPass)) {
+                record(first, last, 0);
+            } else {
+                record(first, orderIndependent, 0);
+                renderOrderIndependent(driver, js, buffers, orderIndependent, blended, viewport);
+                record(blended, last, 1);
+            }
+        }
+    }
+
+    endRenderPass(driver, viewport);
+
+    // Kick the GPU since we're done with this render target
+    driver.flush();
+    // Wake-up the driver thread
+    engine.flush();
+
+    return required;
+}
+
+UTILS_NOINLINE // no need to be inlined
+void RenderPass::applyVisualization(FEngine& engine, FEngine::DebugVisualization visualization,
+        Command* first, Command* last) noexcept {
+    using DebugVisualization = FEngine::DebugVisualization;
+    for (Command* c = first; c != last; ++c) {
+        // the depth pre-pass is kept, it only makes the visualizations cheaper
+        if ((c->key & PASS_MASK) == uint64_t(Pass::DEPTH)) {
+            continue;
+        }
+        PrimitiveInfo& info = c->primitive;
+        Driver::RasterState& rs = info.rasterState;
+        info.mi = engine.getDebugVisualizationInstance(visualization,
+                info.mi->getMaterial()->getShaderCost());
+        info.materialVariant.key &= Variant::UNLIT_MASK;
+        if (visualization == DebugVisualization::OVERDRAW) {
+            // every fragment adds one, hidden or not
+            rs.depthFunc = Driver::RasterState::DepthFunc::A;
+            rs.depthWrite = false;
+            rs.blendEquationRGB = rs.blendEquationAlpha = Driver::RasterState::BlendEquation::ADD;
+            rs.blendFunctionSrcRGB = rs.blendFunctionSrcAlpha =
+                    Driver::RasterState::BlendFunction::ONE;
+            rs.blendFunctionDstRGB = rs.blendFunctionDstAlpha =
+                    Driver::RasterState::BlendFunction::ONE;
+        } else {
+            // only the visible surfaces are shown, transparent or not
+            rs.depthFunc = Driver::RasterState::DepthFunc::LE;
+            rs.depthWrite = true;
+            rs.disableBlending();
+        }
+        rs.alphaToCoverage = false;
+        if ((c->key & PASS_MASK) == uint64_t(Pass::COLOR) && (c->key & BACKGROUND_MASK)) {
+            // the skybox covers the whole screen and would hide the background value
+            rs.colorWrite = false;
+            rs.depthWrite = false;
+        }
+    }
+}
+
+UTILS_NOINLINE // no need to be inlined
+size_t RenderPass::generateAndSortCommands(FEngine& engine, JobSystem& js,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags,
+        float3 cameraPosition, float3 cameraForwardVector, float pixelScale,
+        float minOccluderPixels, CommandChunks& chunks, GrowingSlice<Command>& commands,
+        CommandCache* cache) noexcept {
+
+    // up-to-date summed primitive counts needed to size the chunks
     updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
 
-    // compute how much maximum storage we need for this pass
-    uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
+    // maximum number of commands per primitive,
     // double the color pass for transparents that need to render twice
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
-    growBy *= uint32_t(colorPass * 2 + depthPass);
-    Command* const curr = commands.grow(growBy);
+    const uint32_t commandsPerPrimitive = uint32_t(colorPass * 2 + depthPass);
 
-    // we extract camera position/forward outside of the loop, because these are not cheap.
-    const float3 cameraPosition(camera.getPosition());
-    const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
+    const uint8_t visibilityMask = mVisibilityMask;
+    const uint8_t visibilityValue = mVisibilityValue;
+    auto work = [commandTypeFlags, commandsPerPrimitive, &js, &chunks, &soa, renderFlags,
+            visibilityMask, visibilityValue, cameraPosition, cameraForwardVector, pixelScale,
+            minOccluderPixels]
             (uint32_t startIndex, uint32_t indexCount) {
-        RenderPass::generateCommands(commandTypeFlags, curr,
-                soa, { startIndex, startIndex + indexCount }, renderFlags,
-                cameraPosition, cameraForwardVector);
+        // the commands are generated at the end of this thread's chunk, which has room for
+        // the worse case, then the commands that are not issued are removed.
+        const uint32_t last = startIndex + indexCount;
+        const size_t index = js.getThreadIndex();
+        const size_t count = (FScene::getPrimitiveCount(soa, last) -
+                FScene::getPrimitiveCount(soa, startIndex)) * commandsPerPrimitive;
+        Command* const first = chunks.reserve(index, count);
+        Command* const end = RenderPass::generateCommands(commandTypeFlags, first,
+                soa, { startIndex, last }, renderFlags,
+                visibilityMask, visibilityValue, cameraPosition, cameraForwardVector, pixelScale,
+                minOccluderPixels);
+        chunks.commit(index, std::remove_if(first, end, [](Command const& command) {
+            return command.key == uint64_t(Pass::SENTINEL);
+        }));
     };
 
     auto jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
             std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT, 8>());
+    js.setCoreClass(jobCommandsParallel, JobSystem::CoreClass::BIG);
 
+    CpuStageTimings& timings = engine.getCpuStageTimings();
     { // scope for systrace
         SYSTRACE_NAME("jobCommandsParallel");
+        CpuStageTimings::Scope timing(timings, CpuStageTimings::GENERATE);
         js.runAndWait(jobCommandsParallel);
     }
 
+    // we need one more command for the sentinel, and the sort uses as much space again as
+    // scratch.
+    const size_t count = chunks.size();
+    const size_t required = commands.size() + (count + 1) * 2;
+
+    // Not enough room, drop the commands that don't fit rather than overflowing. The caller is
+    // expected to make room for 'required' commands before the next frame.
+    const size_t available = commands.remain() ? commands.remain() - 1 : 0;
+    const size_t kept = std::min(count, available);
+    chunks.gather(commands.grow(uint32_t(kept)), kept);
+    engine.getFrameCounters().add(FrameCounters::COMMANDS_GENERATED, kept);
+
     // always add an "eof" command
     // "eof" command. these commands are guaranteed to be sorted last in the
     // command buffer.
@@ -90,62 +390,287 @@ void RenderPass::render(
 
     { // sort all commands
         SYSTRACE_NAME("sort commands");
+        CpuStageTimings::Scope timing(timings, CpuStageTimings::SORT);
+        sortCommands(js, commands);
+    }
+
+    // the commands are only reused if none were dropped
+    if (cache && kept == count) {
+        cache->store(commands.cbegin(), commands.cend());
+    }
+
+    return required;
+}
+
+UTILS_NOINLINE // no need to be inlined
+void RenderPass::sortCommands(JobSystem& js, GrowingSlice<Command>& commands) noexcept {
+    const uint32_t count = commands.size();
+
+    // the unused part of the command buffer is used as scratch space for the sort
+    if (UTILS_UNLIKELY(commands.remain() < count)) {
         std::sort(commands.begin(), commands.end());
+        return;
     }
 
-    // Take care not to upload data within the render pass (synchronize can commit froxel data)
-    driver::DriverApi& driver = engine.getDriverApi();
-    beginRenderPass(driver, viewport, camera);
+    Command* const UTILS_RESTRICT data = commands.data();
+    Command* const UTILS_RESTRICT scratch = data + count;
 
-    // Now, execute all commands
-    RenderPass::recordDriverCommands(driver, commands);
+    // split the commands in a power-of-two number of chunks, each sorted on its own job
+    uint32_t chunkCount = 1;
+    while (chunkCount < SORT_COMMANDS_MAX_CHUNKS &&
+           count / (chunkCount * 2) >= SORT_COMMANDS_MIN_CHUNK_SIZE) {
+        chunkCount *= 2;
+    }
+    auto chunkBegin = [count, chunkCount](uint32_t i) -> uint32_t {
+        return uint32_t((uint64_t(count) * i) / chunkCount);
+    };
 
-    endRenderPass(driver, viewport);
+    auto sortChunks = [data, scratch, &chunkBegin](uint32_t first, uint32_t c) {
+        for (uint32_t i = first; i < first + c; i++) {
+            const uint32_t b = chunkBegin(i);
+            const uint32_t e = chunkBegin(i + 1);
+            radix_sort(data + b, data + e, scratch + b,
+                    [](Command const& command) { return command.key; });
+        }
+    };
 
-    // Kick the GPU since we're done with this render target
-    driver.flush();
-    // Wake-up the driver thread
-    engine.flush();
+    if (chunkCount == 1) {
+        sortChunks(0, 1);
+        return;
+    }
+
+    auto jobSort = jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(sortChunks), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobSort);
+
+    // then merge the sorted chunks pair-wise, ping-ponging between the two buffers
+    Command* src = data;
+    Command* dst = scratch;
+    for (uint32_t stride = 1; stride < chunkCount; stride *= 2) {
+        auto mergeChunks = [src, dst, stride, &chunkBegin](uint32_t first, uint32_t c) {
+            for (uint32_t i = first; i < first + c; i++) {
+                const uint32_t b = chunkBegin(i * stride * 2);
+                const uint32_t m = chunkBegin(i * stride * 2 + stride);
+                const uint32_t e = chunkBegin(i * stride * 2 + stride * 2);
+                std::merge(src + b, src + m, src + m, src + e, dst + b);
+            }
+        };
+        auto jobMerge = jobs::parallel_for(js, nullptr, 0, chunkCount / (stride * 2),
+                std::cref(mergeChunks), jobs::CountSplitter<1, 8>());
+        js.runAndWait(jobMerge);
+        std::swap(src, dst);
+    }
+
+    if (src != data) {
+        std::copy(src, src + count, data);
+    }
+}
+
+void RenderPass::renderOrderIndependent(FEngine::DriverApi& driver, JobSystem& js,
+        PerRenderableBuffers const& buffers, Command const* first, Command const* last,
+        Viewport const&) noexcept {
+    recordDriverCommands(driver, js, buffers, first, last);
 }
 
 UTILS_NOINLINE // no need to be inlined
+uint32_t RenderPass::getRecordChunkCount(Command const* first, Command const* last) noexcept {
+    const uint32_t count = uint32_t(last - first);
+    uint32_t chunkCount = 1;
+    while (chunkCount < RECORD_COMMANDS_MAX_CHUNKS &&
+           count / (chunkCount * 2) >= RECORD_COMMANDS_MIN_CHUNK_SIZE) {
+        chunkCount *= 2;
+    }
+    return chunkCount;
+}
+
+RenderPass::Command const* RenderPass::getRecordChunkBegin(Command const* first, Command const* last,
+        uint32_t chunkCount, uint32_t i) noexcept {
+    return first + uint32_t((uint64_t(last - first) * i) / chunkCount);
+}
+
+void RenderPass::sizeRecordChunks(JobSystem& js, Command const* first, Command const* last,
+        uint32_t chunkCount, size_t* offsets) noexcept {
+    static_assert(RECORD_COMMANDS_MAX_CHUNKS <= SegmentsCommand::MAX_SEGMENTS,
+            "too many chunks for the command stream");
+    auto sizeChunks = [offsets, first, last, chunkCount](uint32_t start, uint32_t c) {
+        for (uint32_t i = start; i < start + c; i++) {
+            offsets[i + 1] = getDriverCommandsSizeUpperBound(
+                    getRecordChunkBegin(first, last, chunkCount, i),
+                    getRecordChunkBegin(first, last, chunkCount, i + 1)) +
+                    CommandBase::align(sizeof(NoopCommand));
+        }
+    };
+    auto jobSize = jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(sizeChunks), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobSize);
+
+    offsets[0] = 0;
+    for (uint32_t i = 0; i < chunkCount; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+}
+
+void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, JobSystem& js,
+        PerRenderableBuffers const& buffers, Command const* first, Command const* last) noexcept {
+    SYSTRACE_CALL();
+
+    SYSTRACE_VALUE32("commandCount", uint32_t(last - first));
+
+    // the command stream drops the bindings that are already in place, e.g.: consecutive
+    // primitives of the same renderable or material instances sharing a scissor.
+    const uint32_t chunkCount = getRecordChunkCount(first, last);
+    if (chunkCount == 1) {
+        const uint32_t eliminated = driver.getEliminatedCommandCount();
+        recordDriverCommands(driver, buffers, first, last);
+        SYSTRACE_VALUE32("eliminatedCommands", driver.getEliminatedCommandCount() - eliminated);
+        return;
+    }
+
+    // Each chunk is recorded by its own job in a segment of the command stream. The driver
+    // executes the segments in order, or records them in parallel if it can. First, we size the
+    // segments (including the jump that terminates them).
+    size_t offsets[RECORD_COMMANDS_MAX_CHUNKS + 1];
+    sizeRecordChunks(js, first, last, chunkCount, offsets);
+
+    // then reserve all segments at once and fill them in parallel
+    char* const segments = static_cast<char*>(driver.reserveSegments(js, offsets, chunkCount));
+    uint32_t eliminated[RECORD_COMMANDS_MAX_CHUNKS];
+    auto recordChunks = [&driver, &buffers, segments, &offsets, &eliminated,
+            first, last, chunkCount](uint32_t start, uint32_t c) {
+        for (uint32_t i = start; i < start + c; i++) {
+            CircularBuffer buffer(segments + offsets[i], offsets[i + 1] - offsets[i]);
+            FEngine::DriverApi stream(driver, buffer);
+            recordDriverCommands(stream, buffers,
+                    getRecordChunkBegin(first, last, chunkCount, i),
+                    getRecordChunkBegin(first, last, chunkCount, i + 1));
+            eliminated[i] = stream.getEliminatedCommandCount();
+            // ends this segment, the unused part of it (if any) is never executed
+            stream.jump(nullptr);
+            assert(buffer.getHead() <= segments + offsets[i + 1]);
+        }
+    };
+    auto jobRecord = jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(recordChunks), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobRecord);
+
+    SYSTRACE_VALUE32("eliminatedCommands",
+            std::accumulate(eliminated, eliminated + chunkCount, 0u));
+}
+
+void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, JobSystem& js,
+        PerRenderableBuffers const& buffers, Command const* first, Command const* last,
+        CommandBundle& bundle) noexcept {
+    SYSTRACE_CALL();
+
+    // the bundle is split in the same segments as the commands recorded directly, so that a
+    // driver recording segments in parallel still does when the bundle is replayed
+    const uint32_t chunkCount = getRecordChunkCount(first, last);
+    if (chunkCount == 1) {
+        bundle.record(driver, getDriverCommandsSizeUpperBound(first, last),
+                [&buffers, first, last](FEngine::DriverApi& stream) {
+                    recordDriverCommands(stream, buffers, first, last);
+                });
+        return;
+    }
+
+    size_t offsets[RECORD_COMMANDS_MAX_CHUNKS + 1];
+    sizeRecordChunks(js, first, last, chunkCount, offsets);
+    bundle.reserveSegments(driver, offsets, chunkCount);
+    auto recordChunks = [&driver, &buffers, &bundle, first, last, chunkCount]
+            (uint32_t start, uint32_t c) {
+        for (uint32_t i = start; i < start + c; i++) {
+            bundle.recordSegment(driver, i,
+                    [&buffers, first, last, chunkCount, i](FEngine::DriverApi& stream) {
+                        recordDriverCommands(stream, buffers,
+                                getRecordChunkBegin(first, last, chunkCount, i),
+                                getRecordChunkBegin(first, last, chunkCount, i + 1));
+                    });
+        }
+    };
+    auto jobRecord = jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(recordChunks), jobs::CountSplitter<1, 8>());
+    js.runAndWait(jobRecord);
+}
+
 void RenderPass::recordDriverCommands(
         FEngine::DriverApi& UTILS_RESTRICT driver,  // using restrict here is very important
-        Slice<Command> const& commands) noexcept {
-    SYSTRACE_CALL();
+        PerRenderableBuffers const& buffers,
+        Command const* first, Command const* last) noexcept {
+    const Handle<HwUniformBuffer> uniformsUbh = buffers.uniforms;
+    const size_t uniformsSize = buffers.uniformsSize;
+    const Handle<HwUniformBuffer> bonesUbh = buffers.bones;
+    FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
+    FMaterial const* UTILS_RESTRICT ma = nullptr;
+    for (Command const* UTILS_RESTRICT c = first; c != last; ++c) {
+        /*
+         * Be careful when changing code below, this is the hot inner-loop
+         */
 
-    if (!commands.empty()) {
-        FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
-        FMaterial const* UTILS_RESTRICT ma = nullptr;
-        Command const* UTILS_RESTRICT c;
-        for (c = commands.cbegin(); c->key != -1LLU; ++c) {
-            /*
-             * Be careful when changing code below, this is the hot inner-loop
-             */
-
-            // per-renderable uniform
-            PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
-            driver.bindUniforms(BindingPoints::PER_RENDERABLE, info.perRenderableUniforms);
-            if (info.perRenderableBones) {
-                driver.bindUniforms(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
-            }
+        // per-renderable uniform
+        PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
+        driver.bindUniformsRange(BindingPoints::PER_RENDERABLE, uniformsUbh,
+                info.perRenderableUniforms, uniformsSize);
+        if (info.perRenderableBones != FRenderableManager::NO_BONES) {
+            driver.bindUniformsRange(BindingPoints::PER_RENDERABLE_BONES, bonesUbh,
+                    info.perRenderableBones, FRenderableManager::BONES_SLOT_SIZE);
+        }
 
-            FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
-            if (UTILS_UNLIKELY(mi != previousMi)) {
-                // this is always taken the first time
-                previousMi = mi;
+        FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
+        if (UTILS_UNLIKELY(mi != previousMi)) {
+            // this is always taken the first time
+            // instances with the same state are sorted together, they only need to be bound once
+            if (!previousMi || !mi->hasSameState(*previousMi)) {
                 mi->use(driver);
-                ma = mi->getMaterial();
             }
-
-            Handle<HwProgram> const ph = ma->getProgram(info.materialVariant.key);
-            driver.draw(ph, info.rasterState, info.primitiveHandle);
+            previousMi = mi;
+            ma = mi->getMaterial();
         }
 
-        SYSTRACE_VALUE32("commandCount", c - commands.cbegin());
+        Handle<HwProgram> const ph = ma->getProgram(info.materialVariant.key);
+        driver.draw(ph, info.rasterState, info.primitiveHandle, info.instanceCount);
     }
 }
 
+// This must be kept in sync with recordDriverCommands() above
+size_t RenderPass::getDriverCommandsSizeUpperBound(
+        Command const* first, Command const* last) noexcept {
+    using CS = CommandStream;
+    constexpr size_t BIND_UNIFORMS = CS::getCommandSize<
+            decltype(&Driver::bindUniforms), &Driver::bindUniforms>();
+    constexpr size_t BIND_UNIFORMS_RANGE = CS::getCommandSize<
+            decltype(&Driver::bindUniformsRange), &Driver::bindUniformsRange>();
+    constexpr size_t BIND_SAMPLERS = CS::getCommandSize<
+            decltype(&Driver::bindSamplers), &Driver::bindSamplers>();
+    constexpr size_t SET_VIEWPORT_SCISSOR = CS::getCommandSize<
+            decltype(&Driver::setViewportScissor), &Driver::setViewportScissor>();
+    constexpr size_t SET_POLYGON_OFFSET = CS::getCommandSize<
+            decltype(&Driver::setPolygonOffset), &Driver::setPolygonOffset>();
+    constexpr size_t DRAW = CS::getCommandSize<
+            decltype(&Driver::draw), &Driver::draw>();
+    // The draws and bindings take less room when they're packed, but each run of them (see
+    // PackedCommands) has a header and is padded. A new run only starts after commands that
+    // aren't packed, i.e.: the scissor and polygon offset of FMaterialInstance::use().
+    constexpr size_t PACKED_RUN = PackedCommands::getMaxOverhead();
+    // FMaterialInstance::use()
+    constexpr size_t USE_MATERIAL_INSTANCE = BIND_UNIFORMS + BIND_SAMPLERS +
+            SET_VIEWPORT_SCISSOR + SET_POLYGON_OFFSET + PACKED_RUN;
+
+    size_t size = PACKED_RUN;
+    FMaterialInstance const* previousMi = nullptr;
+    for (Command const* c = first; c != last; ++c) {
+        PrimitiveInfo const& info = c->primitive;
+        size += BIND_UNIFORMS_RANGE + DRAW;
+        if (info.perRenderableBones != FRenderableManager::NO_BONES) {
+            size += BIND_UNIFORMS_RANGE;
+        }
+        if (info.mi != previousMi) {
+            previousMi = info.mi;
+            size += USE_MATERIAL_INSTANCE;
+        }
+    }
+    return size;
+}
+
 /* static */
 UTILS_ALWAYS_INLINE // this function exists only to make the code more readable. we want it inlined.
 inline              // and we don't need it in the compilation unit
@@ -159,7 +684,7 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
     // Below, we evaluate both commands to avoid a branch
 
     uint64_t keyBlending = cmdDraw.key;
-    keyBlending &= ~(PASS_MASK | BLENDING_MASK);
+    keyBlending &= ~(PASS_MASK | BLENDING_MASK | SORT_KEY_MASK);
     keyBlending |= uint64_t(Pass::BLENDED);
     keyBlending |= makeField(ma->getBlendingMode(), BLENDING_MASK, BLENDING_SHIFT);
 
@@ -196,23 +721,17 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
 
 /* static */
 UTILS_NOINLINE
-void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const commands,
+RenderPass::Command* RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const curr,
         FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
-        math::float3 cameraPosition, math::float3 cameraForward) noexcept {
+        uint8_t visibilityMask, uint8_t visibilityValue,
+        math::float3 cameraPosition, math::float3 cameraForward, float pixelScale,
+        float minOccluderPixels) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
     // we go throw the list of renderables just once.
     // (in principle, we could have split this method into two, at the cost of going through
     // the list twice)
 
-    // compute how much maximum storage we need
-    uint32_t offset = FScene::getPrimitiveCount(soa, range.first);
-    // double the color pass for transparents that need to render twice
-    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
-    const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
-    offset *= uint32_t(colorPass * 2 + depthPass);
-    Command* const curr = commands + offset;
-
     /*
      *
      * The if {} below is to coerce the compiler into generating different versions of
@@ -232,28 +751,29 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     switch (commandTypeFlags) {
         default: // squash IDE warning -- should never happen.
         case CommandTypeFlags::COLOR:
-            generateCommandsImpl<CommandTypeFlags::COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
-            break;
+            return generateCommandsImpl<CommandTypeFlags::COLOR>(commandTypeFlags, curr,
+                    soa, range, renderFlags, visibilityMask, visibilityValue,
+                    cameraPosition, cameraForward, pixelScale, minOccluderPixels);
         case CommandTypeFlags::DEPTH_AND_COLOR:
-            generateCommandsImpl<CommandTypeFlags::DEPTH_AND_COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
-            break;
+            return generateCommandsImpl<CommandTypeFlags::DEPTH_AND_COLOR>(commandTypeFlags, curr,
+                    soa, range, renderFlags, visibilityMask, visibilityValue,
+                    cameraPosition, cameraForward, pixelScale, minOccluderPixels);
         case CommandTypeFlags::SHADOW:
-            generateCommandsImpl<CommandTypeFlags::SHADOW>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
-            break;
+            return generateCommandsImpl<CommandTypeFlags::SHADOW>(commandTypeFlags, curr,
+                    soa, range, renderFlags, visibilityMask, visibilityValue,
+                    cameraPosition, cameraForward, pixelScale, minOccluderPixels);
     }
 }
 
 /* static */
 template<uint32_t commandTypeFlags>
 UTILS_NOINLINE
-void RenderPass::generateCommandsImpl(uint32_t,
+RenderPass::Command* RenderPass::generateCommandsImpl(uint32_t,
         Command* UTILS_RESTRICT curr,
         FScene::RenderableSoa const& UTILS_RESTRICT soa, utils::Range<uint32_t> range,
-        RenderFlags renderFlags,
-        float3 cameraPosition, float3 cameraForward) noexcept {
+        RenderFlags renderFlags, uint8_t visibilityMask, uint8_t visibilityValue,
+        float3 cameraPosition, float3 cameraForward, float pixelScale,
+        float minOccluderPixels) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
     // we go throw the list of renderables just once.
@@ -265,12 +785,19 @@ void RenderPass::generateCommandsImpl(uint32_t,
     const bool shadowPass = bool(commandTypeFlags & CommandTypeFlags::SHADOW);
 
     auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT soaWorldAABBExtent = soa.data<FScene::WORLD_AABB_EXTENT>();
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
-    auto const* const UTILS_RESTRICT soaUbh             = soa.data<FScene::UBH>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaUniformsOffset  = soa.data<FScene::UNIFORMS_OFFSET>();
+    auto const* const UTILS_RESTRICT soaBonesOffset     = soa.data<FScene::BONES_OFFSET>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT soaSortKey         = soa.data<FScene::SORT_KEY>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
+    const bool selectiveDepthPass = renderFlags & SELECTIVE_DEPTH_PREPASS;
+    const bool orderIndependentTransparency = renderFlags & ORDER_INDEPENDENT_TRANSPARENCY;
+    const bool sortFrontToBack = renderFlags & SORT_FRONT_TO_BACK;
+    const bool sortStateFirst = renderFlags & SORT_STATE_FIRST;
     Variant materialVariant;
     materialVariant.setDirectionalLighting(renderFlags & HAS_DIRECTIONAL_LIGHT);
     materialVariant.setDynamicLighting(renderFlags & HAS_DYNAMIC_LIGHTING);
@@ -303,6 +830,10 @@ void RenderPass::generateCommandsImpl(uint32_t,
         // but saves a couple of instruction, because part of the math is done outside of the loop.
         float distance = dot(soaWorldAABBCenter[i], cameraForward) - dot(cameraPosition, cameraForward);
 
+        // size of the renderable on screen in pixels, for the streaming textures. Renderables
+        // closer than their radius are considered as covering the whole screen.
+        const float radius = length(soaWorldAABBExtent[i]);
+        const float pixels = pixelScale * radius / std::max(distance, radius);
 
         // We negate the distance to the camera in order to create a bit pattern that will
         // be sorted properly, this works because:
@@ -317,24 +848,37 @@ void RenderPass::generateCommandsImpl(uint32_t,
         distance = -distance;
         const uint32_t distanceBits = reinterpret_cast<uint32_t&>(distance);
 
-        cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
-        cmdColor.primitive.perRenderableUniforms = soaUbh[i];
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
+        const CommandKey order =
+                makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT) |
+                makeField(soaSortKey[i], SORT_KEY_MASK, SORT_KEY_SHIFT);
+
+        cmdColor.key = order;
+        cmdColor.primitive.perRenderableUniforms = soaUniformsOffset[i];
+        cmdColor.primitive.perRenderableBones = soaBonesOffset[i];
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning);
 
         // we're assuming we're always doing the depth (either way, it's correct)
         // this will generate front to back rendering
         cmdDepth.key = uint64_t(Pass::DEPTH);
-        cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
+        cmdDepth.key |= order;
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
-        cmdDepth.primitive.perRenderableUniforms = soaUbh[i];
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdDepth.primitive.perRenderableUniforms = soaUniformsOffset[i];
+        cmdDepth.primitive.perRenderableBones = soaBonesOffset[i];
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
 
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadows = shadowPass & shadowCaster;
 
+        // renderables not seen by this pass (e.g. outside of a shadow cascade) are skipped
+        const bool culled = (soaVisibleMask[i] & visibilityMask) != visibilityValue;
+
+        // with a selective depth pre-pass, drawing small objects twice costs more than the
+        // overdraw it saves
+        const bool largeOccluder = pixels >= minOccluderPixels;
+
+        const bool background = soaVisibility[i].background;
+
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
 
         /*
@@ -343,13 +887,48 @@ void RenderPass::generateCommandsImpl(uint32_t,
          */
         for (auto const& primitive : primitives) {
             FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            const bool prepass = depthPass & (!selectiveDepthPass | largeOccluder |
+                    mi->getMaterial()->hasExpensiveShading());
             if (colorPass) {
+                if (UTILS_UNLIKELY(mi->hasStreamingTextures() && !culled)) {
+                    mi->requestStreamingLevels(pixels);
+                }
                 cmdColor.primitive.primitiveHandle = primitive.getHwHandle();
+                cmdColor.primitive.instanceCount = primitive.getInstanceCount();
                 cmdColor.primitive.materialVariant = materialVariant;
-                RenderPass::setupColorCommand(cmdColor, depthPass, mi);
+                RenderPass::setupColorCommand(cmdColor, prepass, mi);
 
                 const bool blendPass = Pass(cmdColor.key & PASS_MASK) == Pass::BLENDED;
-                if (blendPass) {
+                const BlendingMode blendingMode = mi->getMaterial()->getBlendingMode();
+                const bool orderIndependentPass = blendPass & orderIndependentTransparency &
+                        (blendingMode == BlendingMode::TRANSPARENT |
+                         blendingMode == BlendingMode::FADE);
+                if (UTILS_UNLIKELY(orderIndependentPass)) {
+                    // weighted-blended transparency: the order doesn't matter, so these are
+                    // only sorted by material and drawn once, with additive blending into the
+                    // accumulation and revealage targets (see main.fs)
+                    cmdColor.key &= ~(PASS_MASK | BLENDING_MASK);
+                    cmdColor.key |= uint64_t(Pass::ORDER_INDEPENDENT);
+                    cmdColor.key |= mi->getSortingKey();
+                    cmdColor.key |= makeField(cmdColor.primitive.materialVariant.key,
+                            MATERIAL_VARIANT_KEY_MASK, MATERIAL_VARIANT_KEY_SHIFT);
+
+                    Driver::RasterState& rs = cmdColor.primitive.rasterState;
+                    rs.blendFunctionSrcRGB = BlendFunction::ONE;
+                    rs.blendFunctionSrcAlpha = BlendFunction::ONE;
+                    rs.blendFunctionDstRGB = BlendFunction::ONE;
+                    rs.blendFunctionDstAlpha = BlendFunction::ONE;
+                    rs.depthWrite = false;
+
+                    // TWO_PASSES_TWO_SIDES: both sides are drawn at once
+                    const TransparencyMode mode = mi->getMaterial()->getTransparencyMode();
+                    rs.culling = (mode == TransparencyMode::TWO_PASSES_TWO_SIDES) ?
+                            CullingMode::NONE : rs.culling;
+
+                    // a single command is needed
+                    curr->key = uint64_t(Pass::SENTINEL);
+                    ++curr;
+                } else if (blendPass) {
                     // TODO: at least for transparent objects, AABB should be per primitive
                     // blend pass:
                     // this will sort back-to-front for blended, and honor explicit ordering
@@ -383,11 +962,13 @@ void RenderPass::generateCommandsImpl(uint32_t,
                     // draw this command AFTER THE NEXT ONE
                     key |= makeField(1, BLEND_TWO_PASS_MASK, BLEND_TWO_PASS_SHIFT);
 
-                    // handle the case where this primitive is empty / no-op
-                    key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                    // handle the case where this primitive is empty / no-op, or has no instances
+                    key |= select((primitive.getPrimitiveType() == PrimitiveType::NONE) |
+                            (primitive.getInstanceCount() == 0));
 
                     // correct for TransparencyMode::DEFAULT -- i.e. cancel the command
                     key |= select(mode == TransparencyMode::DEFAULT);
+                    key |= select(culled);
 
                     *curr = cmdColor;
                     curr->key = key;
@@ -406,7 +987,21 @@ void RenderPass::generateCommandsImpl(uint32_t,
                             SamplerCompareFunc::LE : cmdColor.primitive.rasterState.depthFunc;
                 } else {
                     // color pass, opaque objects...
-                    if (!depthPass) {
+                    if (UTILS_UNLIKELY(background)) {
+                        // ...the background is drawn last, at the far plane and without writing
+                        // the depth, so the early depth test rejects the pixels covered by the
+                        // other opaque objects before they're shaded
+                        cmdColor.key &= ~Z_BUCKET_MASK;
+                        cmdColor.key |= makeField(1, BACKGROUND_MASK, BACKGROUND_SHIFT);
+                        cmdColor.primitive.rasterState.depthWrite = false;
+                        cmdColor.primitive.rasterState.depthFunc = SamplerCompareFunc::LE;
+                    } else if (sortFrontToBack) {
+                        // ...sorted strictly front-to-back, so that the early depth test
+                        // rejects as many pixels as possible, at the cost of state changes
+                        cmdColor.key &= ~(Z_BUCKET_MASK | MATERIAL_MASK);
+                        cmdColor.key |= makeField(distanceBits, DISTANCE_BITS_MASK,
+                                DISTANCE_BITS_SHIFT);
+                    } else if (!prepass & !sortStateFirst) {
                         // ...without depth pre-pass:
                         // this will bucket objects by Z, front-to-back and then sort by material
                         // in each buckets. We use the top 10 bits of the distance, which
@@ -415,14 +1010,16 @@ void RenderPass::generateCommandsImpl(uint32_t,
                         cmdColor.key |= makeField(distanceBits >> 22, Z_BUCKET_MASK,
                                 Z_BUCKET_SHIFT);
                     }
-                    // ...with depth pre-pass, we just sort by materials
+                    // ...with depth pre-pass or SORT_STATE_FIRST, we just sort by materials
                     curr->key = uint64_t(Pass::SENTINEL);
                     ++curr;
                 }
 
                 *curr = cmdColor;
-                // handle the case where this primitive is empty / no-op
-                curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                // handle the case where this primitive is empty / no-op, or has no instances
+                curr->key |= select((primitive.getPrimitiveType() == PrimitiveType::NONE) |
+                        (primitive.getInstanceCount() == 0));
+                curr->key |= select(culled);
                 ++curr;
             }
 
@@ -431,6 +1028,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
                 // unconditionally write the command
                 cmdDepth.primitive.primitiveHandle = primitive.getHwHandle();
+                cmdDepth.primitive.instanceCount = primitive.getInstanceCount();
                 cmdDepth.primitive.mi = mi;
                 cmdDepth.primitive.rasterState.culling = rs.culling;
                 *curr = cmdDepth;
@@ -444,14 +1042,16 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 bool issueDepth =
                         (rs.depthWrite & !(colorPass & (rs.alphaToCoverage | rs.hasBlending())))
                         | writeDepthForShadows;
-                curr->key |= select(!issueDepth);
+                curr->key |= select(!issueDepth | !prepass | culled);
 
-                // handle the case where this primitive is empty / no-op
-                curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                // handle the case where this primitive is empty / no-op, or has no instances
+                curr->key |= select((primitive.getPrimitiveType() == PrimitiveType::NONE) |
+                        (primitive.getInstanceCount() == 0));
                 ++curr;
             }
         }
     }
+    return curr;
 }
 
 void RenderPass::updateSummedPrimitiveCounts(
@@ -472,9 +1072,18 @@ void RenderPass::updateSummedPrimitiveCounts(
 // inlining and devirtualization.
 // ------------------------------------------------------------------------------------------------
 
-FRenderer::ColorPass::ColorPass(const char* name,
-        JobSystem& js, JobSystem::Job* jobFroxelize,FView* view, Handle<HwRenderTarget> const rth)
-        : RenderPass(name), js(js), jobFroxelize(jobFroxelize), view(view), rth(rth) {
+FRenderer::ColorPass::ColorPass(const char* name, FEngine& engine,
+        JobSystem& js, JobSystem::Job* jobFroxelize,FView* view, Handle<HwRenderTarget> const rth,
+        TargetBufferFlags discardStart, TargetBufferFlags discardEnd,
+        Handle<HwProgram> const toneMapping, Handle<HwProgram> const transparencyResolve)
+        : RenderPass(name), engine(engine), js(js), jobFroxelize(jobFroxelize), view(view),
+          rth(rth), discardStart(discardStart), discardEnd(discardEnd), toneMapping(toneMapping),
+          transparencyResolve(transparencyResolve) {
+    setCommandCache(&view->getColorPassCommandCache());
+    setEyeCount(view->isStereoscopic() ? uint8_t(2) : uint8_t(1));
+    // the visualizations are turned into colors by the post-process pass
+    setVisualization(view->hasPostProcessPass() ?
+            engine.getDebugVisualization() : FEngine::DebugVisualization::NONE);
 }
 
 void FRenderer::ColorPass::beginRenderPass(
@@ -484,31 +1093,36 @@ void FRenderer::ColorPass::beginRenderPass(
     js.wait(jobFroxelize);
     view->commitFroxels(driver);
 
-    // We won't need the depth or stencil buffers after this pass.
+    // what needs to be loaded and stored is decided by the frame graph, but this render pass
+    // is interrupted by the order-independent transparency, if any (see renderOrderIndependent)
     RenderPassParams params = {};
-    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+    params.discardStart = discardStart;
+    params.discardEnd = hasOrderIndependentPass() ? TargetBufferFlags::NONE : discardEnd;
     params.left = viewport.left;
     params.bottom = viewport.bottom;
     params.width = viewport.width;
     params.height = viewport.height;
     params.clearColor = view->getClearColor();
     params.clearDepth = 1.0;
+    view->getFoveation(params);
+    if (UTILS_UNLIKELY(engine.getDebugVisualization() != FEngine::DebugVisualization::NONE &&
+            view->hasPostProcessPass())) {
+        // the pixels not covered by any renderable have no overdraw, cost or lights
+        params.clearColor = {};
+    }
 
     if (view->hasPostProcessPass()) {
         // When using a post-process pass, composition of Views is done during the post-process
         // pass, which means it's NOT done here. For this reason, we need to clear the depth/stencil
         // buffers unconditionally. The color buffer must be cleared to what the user asked for,
         // since it's akin to a drawing command.
-        // Also, all buffers can be invalidated before rendering.
         if (view->getClearTargetColor()) {
             params.clear = TargetBufferFlags::ALL;
         } else {
             params.clear = TargetBufferFlags::DEPTH_AND_STENCIL;
         }
-        params.discardStart = TargetBufferFlags::ALL;
         driver.beginRenderPass(rth, params);
     } else {
-        params.discardStart = view->getDiscardedTargetBuffers();
         if (view->getClearTargetColor()) {
             params.clear |= TargetBufferFlags::COLOR;
         }
@@ -522,7 +1136,72 @@ void FRenderer::ColorPass::beginRenderPass(
     }
 }
 
+void FRenderer::ColorPass::beginEye(
+        DriverApi& driver, Viewport const& viewport, size_t eye) noexcept {
+    Viewport const vp = FView::getEyeViewport(viewport, eye);
+    driver.viewport(vp.left, vp.bottom, vp.width, vp.height);
+    driver.bindUniforms(BindingPoints::PER_VIEW, view->getEyeUbh(eye));
+}
+
+void FRenderer::ColorPass::renderOrderIndependent(DriverApi& driver, JobSystem& js,
+        PerRenderableBuffers const& buffers, Command const* first, Command const* last,
+        Viewport const& viewport) noexcept {
+    assert(transparencyResolve);
+
+    // The opaque objects are done. The translucent ones are accumulated in a target of their
+    // own, tested against the depth of the opaque objects. The target is back in the pool at
+    // the end of this pass, the frame graph's targets can reuse it.
+    RenderTargetPool& pool = engine.getRenderTargetPool();
+    RenderTargetPool::Target const* const target = pool.get(TargetBufferFlags::COLOR_AND_DEPTH,
+            viewport.width, viewport.height, 1, TextureFormat::RGBA16F,
+            RenderTargetPool::Target::REVEALAGE);
+
+    driver.endRenderPass();
+
+    // this also resolves the depth, when it's multisampled
+    driver.blit(TargetBufferFlags::DEPTH,
+            target->target, viewport.left, viewport.bottom, viewport.width, viewport.height,
+            rth, viewport.left, viewport.bottom, viewport.width, viewport.height);
+
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::COLOR | RenderPassParams::IGNORE_SCISSOR;
+    params.discardStart = TargetBufferFlags::COLOR;
+    params.discardEnd = TargetBufferFlags::DEPTH;
+    params.left = viewport.left;
+    params.bottom = viewport.bottom;
+    params.width = viewport.width;
+    params.height = viewport.height;
+    params.clearColor = {};
+    driver.beginRenderPass(target->target, params);
+    recordDriverCommands(driver, js, buffers, first, last);
+    driver.endRenderPass();
+
+    // then, the color pass resumes with their composition over the opaque objects, followed
+    // by the other blended objects
+    params = {};
+    params.discardEnd = discardEnd;
+    params.left = viewport.left;
+    params.bottom = viewport.bottom;
+    params.width = viewport.width;
+    params.height = viewport.height;
+    view->getFoveation(params);
+    driver.beginRenderPass(rth, params);
+    engine.getPostProcessManager().resolveTransparency(driver, transparencyResolve,
+            target->texture, target->revealage);
+
+    pool.put(target);
+}
+
 void FRenderer::ColorPass::endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept {
+    if (view->isStereoscopic()) {
+        // back to the whole viewport, and to the View's uniforms
+        driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+        driver.bindUniforms(BindingPoints::PER_VIEW, view->getEyeUbh(0));
+    }
+    if (toneMapping) {
+        // the HDR colors are tone mapped while they're still in tile memory
+        engine.getPostProcessManager().passInPlace(driver, toneMapping);
+    }
     driver.endRenderPass();
 
     // and we don't need the color buffer in the areas we don't use
@@ -536,40 +1215,51 @@ void FRenderer::ColorPass::endRenderPass(DriverApi& driver, Viewport const& view
     }
 }
 
-void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
-        Handle<HwRenderTarget> const rth, FView* view, Viewport const& scaledViewport,
-        GrowingSlice<Command>& commands) noexcept {
-
-    // start the froxelization immediately, it has no dependencies
-    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
-            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
-    js.run(jobFroxelize);
+size_t FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
+        JobSystem::Job* jobFroxelize, Handle<HwRenderTarget> const rth,
+        TargetBufferFlags discardStart, TargetBufferFlags discardEnd,
+        Handle<HwProgram> const toneMapping, Handle<HwProgram> const transparencyResolve,
+        FView* view, Viewport const& scaledViewport,
+        CommandChunks& chunks, GrowingSlice<Command>& commands) noexcept {
 
     CameraInfo const& cameraInfo = view->getCameraInfo();
-    auto& soa = view->getScene()->getRenderableData();
+    FScene& scene = *view->getScene();
+    auto& soa = view->getRenderableData();
     auto vr = view->getVisibleRenderables();
 
     // populate the RenderPrimitive array with the proper LOD
     view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
 
     DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, scaledViewport);
+    view->prepareOrderIndependentTransparency(bool(transparencyResolve));
+    if (UTILS_UNLIKELY(view->isStereoscopic())) {
+        // the right eye's uniforms are a copy of the View's, with the right eye's camera
+        view->prepareCamera(view->getEyeCameraInfo(1),
+                FView::getEyeViewport(scaledViewport, 1), view->getTemporalJitter());
+        view->commitRightEyeUniforms(driver);
+        view->prepareCamera(view->getEyeCameraInfo(0),
+                FView::getEyeViewport(scaledViewport, 0), view->getTemporalJitter());
+    } else {
+        view->prepareCamera(cameraInfo, scaledViewport, view->getTemporalJitter());
+    }
     view->commitUniforms(driver);
 
     RenderPass::RenderFlags flags = 0;
     if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
     if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
     if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    if (transparencyResolve)            flags |= RenderPass::ORDER_INDEPENDENT_TRANSPARENCY;
+    if (view->getSortPolicy() == View::SortPolicy::FRONT_TO_BACK) {
+        flags |= RenderPass::SORT_FRONT_TO_BACK;
+    }
+    if (view->getSortPolicy() == View::SortPolicy::STATE_FIRST) {
+        flags |= RenderPass::SORT_STATE_FIRST;
+    }
 
     CommandTypeFlags commandType;
     switch (view->getDepthPrepass()) {
         case View::DepthPrepass::DEFAULT:
-            // TODO: better default strategy (can even change on a per-frame basis)
-#ifdef ANDROID
-            commandType = COLOR;
-#else
-            commandType = DEPTH_AND_COLOR;
-#endif
+            commandType = FView::DEFAULT_DEPTH_PREPASS ? DEPTH_AND_COLOR : COLOR;
             break;
         case View::DepthPrepass::DISABLED:
             commandType = COLOR;
@@ -577,64 +1267,242 @@ void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
         case View::DepthPrepass::ENABLED:
             commandType = DEPTH_AND_COLOR;
             break;
+        case View::DepthPrepass::AUTOMATIC:
+            // selected by FRenderer from the GPU timings, and only for the renderables that
+            // are worth it
+            commandType = view->getDepthPrepassSelector().hasDepthPrepass() ?
+                    DEPTH_AND_COLOR : COLOR;
+            flags |= RenderPass::SELECTIVE_DEPTH_PREPASS;
+            break;
     }
 
-    ColorPass colorPass("ColorPass", js, jobFroxelize, view, rth);
-    driver.pushGroupMarker("Color Pass");
-    colorPass.render(engine, js, soa, vr, commandType, flags, cameraInfo, scaledViewport, commands);
-    driver.popGroupMarker();
+    ColorPass colorPass("ColorPass", engine, js, jobFroxelize, view, rth,
+            discardStart, discardEnd, toneMapping, transparencyResolve);
+    const size_t required = colorPass.render(engine, js, scene, soa, vr, commandType, flags,
+            cameraInfo, scaledViewport, chunks, commands);
+    view->getRenderStatistics().colorDrawCount += colorPass.getDrawCount();
+    return required;
 }
 
 // ------------------------------------------------------------------------------------------------
 
 FRenderer::ShadowPass::ShadowPass(const char* name,
-        ShadowMap const& shadowMap) noexcept
-        : RenderPass(name), shadowMap(shadowMap) {
+        ShadowMap const& shadowMap, size_t cascade, bool clear,
+        uint8_t visibilityMask, uint8_t visibilityValue, bool staticCache) noexcept
+        : RenderPass(name, visibilityMask, visibilityValue),
+          shadowMap(shadowMap), cascade(cascade), clear(clear), staticCache(staticCache) {
 }
 
 void FRenderer::ShadowPass::beginRenderPass(driver::DriverApi& driver, Viewport const&, const CameraInfo&) noexcept {
-    shadowMap.beginRenderPass(driver);
+    shadowMap.beginRenderPass(driver, cascade, clear, staticCache);
 }
 
-void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
-        FView* view, GrowingSlice<Command>& commands) noexcept {
+size_t FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
+        FView* view, CommandChunks& chunks, GrowingSlice<Command>& commands) noexcept {
 
-    auto& soa = view->getScene()->getRenderableData();
+    FScene& scene = *view->getScene();
+    auto& soa = view->getRenderableData();
     auto vr = view->getVisibleShadowCasters();
     ShadowMap const& shadowMap = view->getShadowMap();
-    Viewport const& viewport = shadowMap.getViewport();
-    FCamera const& camera = shadowMap.getCamera();
-
-    CameraInfo cameraInfo = {
-            .projection         = mat4f{ camera.getProjectionMatrix() },
-            .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
-            .model              = camera.getModelMatrix(),
-            .view               = camera.getViewMatrix(),
-            .zn                 = camera.getNear(),
-            .zf                 = camera.getCullingFar(),
-    };
 
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
-
-    driver::DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, viewport);
-    view->commitUniforms(driver);
+    // populate the RenderPrimitive array with the proper LOD, as seen from the viewing camera
+    // so shadows match the renderables casting them
+    view->updatePrimitivesLod(engine, view->getCameraInfo(), soa, vr);
 
     RenderPass::RenderFlags flags = 0;
     if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
     if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
     if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
 
-    ShadowPass shadowPass("ShadowPass", shadowMap);
-    driver.pushGroupMarker("Shadow map Pass");
-    shadowPass.render(engine, js, soa, vr, CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands);
-    driver.popGroupMarker();
+    driver::DriverApi& driver = engine.getDriverApi();
+    size_t required = 0;
+
+    // layer 0 is the static casters' cache, layer 1 the shadow map
+    const bool cached = shadowMap.hasStaticCache();
+    const uint8_t staticMask = cached ? view->getStaticShadowCasterMask() : uint8_t(0);
+    for (size_t layer = 0; layer < 2; layer++) {
+        const bool staticCache = layer == 0;
+        if (staticCache) {
+            if (!cached || !shadowMap.isStaticCacheDirty()) {
+                continue;
+            }
+        }
+        if (!staticCache && cached) {
+            // start from the static casters, the other casters are rendered over them
+            shadowMap.copyStaticCache(driver);
+        }
+
+        bool clear = staticCache || !cached;
+        for (size_t c = 0, n = shadowMap.getCascadeCount(); c < n; c++) {
+            if (!shadowMap.hasVisibleShadows(c)) {
+                continue;
+            }
+
+            Viewport const& viewport = shadowMap.getViewport(c);
+            FCamera const& camera = shadowMap.getCamera(c);
+
+            CameraInfo cameraInfo = {
+                    .projection         = mat4f{ camera.getProjectionMatrix() },
+                    .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
+                    .model              = camera.getModelMatrix(),
+                    .view               = camera.getViewMatrix(),
+                    .zn                 = camera.getNear(),
+                    .zf                 = camera.getCullingFar(),
+            };
+
+            view->prepareCamera(cameraInfo, viewport);
+            view->commitUniforms(driver);
+
+            // commands are generated in parallel for each cascade, for the casters it sees only
+            const uint8_t cascadeMask = view->getShadowCascadeVisibilityMask(c);
+            ShadowPass shadowPass("ShadowPass", shadowMap, c, clear,
+                    cascadeMask | staticMask,
+                    staticCache ? uint8_t(cascadeMask | staticMask) : cascadeMask,
+                    staticCache);
+            required = std::max(required, shadowPass.render(engine, js, scene, soa, vr,
+                    CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, chunks, commands));
+            view->getRenderStatistics().shadowDrawCount += shadowPass.getDrawCount();
+            commands.clear();
+            clear = false;
+        }
+    }
+    return required;
 }
 
 void FRenderer::ShadowPass::endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept {
     driver.endRenderPass();
 }
 
+// ------------------------------------------------------------------------------------------------
+
+FRenderer::ShadowAtlasPass::ShadowAtlasPass(const char* name,
+        ShadowAtlas const& shadowAtlas, size_t tile, bool clear, uint8_t visibilityMask) noexcept
+        : RenderPass(name, visibilityMask, visibilityMask),
+          shadowAtlas(shadowAtlas), tile(tile), clear(clear) {
+}
+
+void FRenderer::ShadowAtlasPass::beginRenderPass(driver::DriverApi& driver, Viewport const&, const CameraInfo&) noexcept {
+    shadowAtlas.beginRenderPass(driver, tile, clear);
+}
+
+size_t FRenderer::ShadowAtlasPass::renderShadowAtlas(FEngine& engine, JobSystem& js,
+        FView* view, CommandChunks& chunks, GrowingSlice<Command>& commands) noexcept {
+
+    FScene& scene = *view->getScene();
+    auto& soa = view->getRenderableData();
+    auto vr = view->getVisibleShadowCasters();
+    ShadowAtlas const& shadowAtlas = view->getShadowAtlas();
+
+    // populate the RenderPrimitive array with the proper LOD, as seen from the viewing camera
+    // so shadows match the renderables casting them
+    view->updatePrimitivesLod(engine, view->getCameraInfo(), soa, vr);
+
+    // the spot lights' casters are shadow casters even when the directional light isn't
+    RenderPass::RenderFlags flags = RenderPass::HAS_SHADOWING;
+    if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
+    if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+
+    driver::DriverApi& driver = engine.getDriverApi();
+    size_t required = 0;
+    for (size_t t = 0, n = shadowAtlas.getTileCount(); t < n; t++) {
+        Viewport const& viewport = shadowAtlas.getViewport(t);
+        FCamera const& camera = shadowAtlas.getCamera(t);
+
+        CameraInfo cameraInfo = {
+                .projection         = mat4f{ camera.getProjectionMatrix() },
+                .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
+                .model              = camera.getModelMatrix(),
+                .view               = camera.getViewMatrix(),
+                .zn                 = camera.getNear(),
+                .zf                 = camera.getCullingFar(),
+        };
+
+        view->prepareCamera(cameraInfo, viewport);
+        view->commitUniforms(driver);
+
+        const uint8_t visibilityMask = view->prepareShadowAtlasTile(js, soa, t);
+        ShadowAtlasPass shadowAtlasPass("ShadowAtlasPass", shadowAtlas, t, t == 0,
+                visibilityMask);
+        required = std::max(required, shadowAtlasPass.render(engine, js, scene, soa, vr,
+                CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, chunks, commands));
+        view->getRenderStatistics().shadowDrawCount += shadowAtlasPass.getDrawCount();
+        commands.clear();
+    }
+    return required;
+}
+
+void FRenderer::ShadowAtlasPass::endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept {
+    driver.endRenderPass();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FRenderer::PickingPass::PickingPass(const char* name, Handle<HwRenderTarget> target) noexcept
+        : RenderPass(name), target(target) {
+}
+
+size_t FRenderer::PickingPass::renderPicking(FEngine& engine, JobSystem& js,
+        FView* view, Handle<HwRenderTarget> target, CommandChunks& chunks,
+        GrowingSlice<Command>& commands) noexcept {
+
+    FScene& scene = *view->getScene();
+    auto& soa = view->getRenderableData();
+
+    // the renderables are drawn with the level of detail of the color pass
+    view->updatePrimitivesLod(engine, view->getCameraInfo(), soa, view->getVisibleRenderables());
+
+    // the texels of the candidates which don't cover the pixel stay at the far plane
+    driver::DriverApi& driver = engine.getDriverApi();
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::DEPTH |
+            RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
+    params.discardStart = TargetBufferFlags::DEPTH;
+    params.clearDepth = 1.0;
+    params.width = FView::PICKING_CANDIDATE_COUNT;
+    params.height = FView::PICKING_QUERY_COUNT;
+    driver.beginRenderPass(target, params);
+    driver.endRenderPass();
+
+    size_t required = 0;
+    auto const& queries = view->getServedPickingQueries();
+    for (size_t q = 0, n = queries.size(); q < n; q++) {
+        FView::PickingQuery const& query = queries[q];
+        if (!query.candidateCount) {
+            continue;
+        }
+
+        // the origin of the viewport changes with each candidate, its size doesn't
+        view->prepareCamera(query.camera, { 0, int32_t(q), 1, 1 });
+        view->commitUniforms(driver);
+
+        for (uint32_t c = 0; c < query.candidateCount; c++) {
+            const Viewport viewport{ int32_t(c), int32_t(q), 1, 1 };
+            const uint32_t i = query.candidates[c];
+            PickingPass pickingPass("PickingPass", target);
+            required = std::max(required, pickingPass.render(engine, js, scene, soa, { i, i + 1 },
+                    CommandTypeFlags::SHADOW, 0, query.camera, viewport, chunks, commands));
+            commands.clear();
+        }
+    }
+
+    view->readPicking(driver);
+    return required;
+}
+
+void FRenderer::PickingPass::beginRenderPass(driver::DriverApi& driver, Viewport const& viewport,
+        const CameraInfo&) noexcept {
+    RenderPassParams params = {};
+    params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.width = FView::PICKING_CANDIDATE_COUNT;
+    params.height = FView::PICKING_QUERY_COUNT;
+    params.clear = RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
+    driver.beginRenderPass(target, params);
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+void FRenderer::PickingPass::endRenderPass(DriverApi& driver, Viewport const&) noexcept {
+    driver.endRenderPass();
+}
+
 } // namespace details
 } // namespace filament
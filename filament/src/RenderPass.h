@@ -23,6 +23,7 @@
 #include "details/Material.h"
 #include "details/Scene.h"
 
+#include "driver/CommandStream.h"
 #include "driver/DriverApiForward.h"
 
 #include <private/filament/Variant.h>
@@ -30,6 +31,8 @@
 #include <utils/compiler.h>
 #include <utils/Slice.h>
 
+#include <vector>
+
 namespace utils {
 class JobSystem;
 }
@@ -66,12 +69,19 @@ public:
     static constexpr uint64_t Z_BUCKET_MASK                 = 0x3FF00000000llu;
     static constexpr int Z_BUCKET_SHIFT                     = 32;
 
+    static constexpr uint64_t SORT_KEY_MASK                 = 0x0003FC0000000000llu;
+    static constexpr int SORT_KEY_SHIFT                     = 42;
+
     static constexpr uint64_t PRIORITY_MASK                 = 0x001C000000000000llu;
     static constexpr int PRIORITY_SHIFT                     = 50;
 
     static constexpr uint64_t BLENDING_MASK                 = 0x00E0000000000000llu;
     static constexpr int BLENDING_SHIFT                     = 53;
 
+    // overlaps the blending bits, which the opaque commands only use for alpha masking
+    static constexpr uint64_t BACKGROUND_MASK               = 0x0080000000000000llu;
+    static constexpr int BACKGROUND_SHIFT                   = 55;
+
     static constexpr uint64_t PASS_MASK                     = 0xFF00000000000000llu;
     static constexpr int PASS_SHIFT                         = 56;
 
@@ -79,7 +89,8 @@ public:
     enum class Pass : uint64_t {    // 8-bits max
         DEPTH    = 0llu << PASS_SHIFT,
         COLOR    = 1llu << PASS_SHIFT,
-        BLENDED  = 2llu << PASS_SHIFT,
+        ORDER_INDEPENDENT = 2llu << PASS_SHIFT,
+        BLENDED  = 3llu << PASS_SHIFT,
         SENTINEL = 0xffffffffffffffffllu
     };
 
@@ -94,39 +105,57 @@ public:
     // --------------------
     //
     // a     = alpha masking
+    // s     = background (i.e. the skybox), drawn after all the other opaque commands
     // bbb   = blending
     // ppp   = priority
+    // k     = sort key (see RenderableManager::Builder::sortKey())
     // t     = two-pass transparency ordering
     // 0     = reserved, must be zero
     //
     // DEPTH command
-    // |    8   | 3 | 3 | 2|       16       |               32               |
-    // +--------+---+---+--+----------------+--------------------------------+
-    // |00000000|000|ppp|00|0000000000000000|          distanceBits          |
-    // +--------+---+---+-------------------+--------------------------------+
+    // |    8   | 3 | 3 |    8   |    10    |               32               |
+    // +--------+---+---+--------+----------+--------------------------------+
+    // |00000000|000|ppp|kkkkkkkk|0000000000|          distanceBits          |
+    // +--------+---+---+--------+----------+--------------------------------+
     // | correctness    |     optimizations (truncation allowed)             |
     //
     //
-    // COLOR command (with depth prepass)
-    // |    8   | 3 | 3 | 2|       16       |               32               |
-    // +--------+---+---+--+----------------+--------------------------------+
-    // |00000001|00a|ppp|00|0000000000000000|          material-id           |
-    // +--------+---+---+--+----------------+--------------------------------+
+    // COLOR command (with depth prepass, or with SORT_STATE_FIRST)
+    // |    8   | 3 | 3 |    8   |    10    |               32               |
+    // +--------+---+---+--------+----------+--------------------------------+
+    // |00000001|s0a|ppp|kkkkkkkk|0000000000|          material-id           |
+    // +--------+---+---+--------+----------+--------------------------------+
     // | correctness    |        optimizations (truncation allowed)          |
     //
     //
     // COLOR command (without depth prepass)
-    // |    8   | 3 | 3 | 2|  6   |   10     |               32               |
-    // +--------+---+---+--+------+----------+--------------------------------+
-    // |00000001|00a|ppp|00|000000| Z-bucket |          material-id           |
-    // +--------+---+---+--+------+----------+--------------------------------+
+    // |    8   | 3 | 3 |    8   |    10    |               32               |
+    // +--------+---+---+--------+----------+--------------------------------+
+    // |00000001|s0a|ppp|kkkkkkkk| Z-bucket |          material-id           |
+    // +--------+---+---+--------+----------+--------------------------------+
+    // | correctness    |      optimizations (truncation allowed)             |
+    //
+    //
+    // COLOR command (with SORT_FRONT_TO_BACK)
+    // |    8   | 3 | 3 |    8   |    10    |               32               |
+    // +--------+---+---+--------+----------+--------------------------------+
+    // |00000001|s0a|ppp|kkkkkkkk|0000000000|          distanceBits          |
+    // +--------+---+---+--------+----------+--------------------------------+
     // | correctness    |      optimizations (truncation allowed)             |
     //
     //
+    // ORDER_INDEPENDENT command (see ORDER_INDEPENDENT_TRANSPARENCY)
+    // |    8   | 3 | 3 | 2|       16       |               32               |
+    // +--------+---+---+--+----------------+--------------------------------+
+    // |00000010|000|ppp|00|0000000000000000|          material-id           |
+    // +--------+---+---+--+----------------+--------------------------------+
+    // | correctness    |        optimizations (truncation allowed)          |
+    //
+    //
     // BLENDED command
     // |    8   | 3 | 3 | 2|              32                |         15    |1|
     // +--------+---+---+--+--------------------------------+---------------+-+
-    // |00000010|bbb|ppp|00|         ~distanceBits          |   blendOrder  |t|
+    // |00000011|bbb|ppp|00|         ~distanceBits          |   blendOrder  |t|
     // +--------+---+---+--+--------------------------------+---------------+-+
     // | correctness                                                          |
     //
@@ -144,14 +173,16 @@ public:
     //
     // |    11     |  5  |       16       |
     // +-----------+-----+----------------+
-    // | material  | var |   instance     |
+    // | material  | var |  instance state|
     // +-----------+-----+----------------+
     //
     // The variant is inserted while building the commands, because we don't know it before that
+    // The instance state is a hash of the uniforms, samplers and scissor of the instance, so
+    // that instances with the same state are sorted together and bound only once.
     //
-    static CommandKey makeMaterialSortingKey(uint32_t materialId, uint32_t instanceId) noexcept {
+    static CommandKey makeMaterialSortingKey(uint32_t materialId, uint32_t stateId) noexcept {
         CommandKey key = ((materialId << MATERIAL_ID_SHIFT) & MATERIAL_ID_MASK) |
-                         ((instanceId << MATERIAL_INSTANCE_ID_SHIFT) & MATERIAL_INSTANCE_ID_MASK);
+                         ((stateId << MATERIAL_INSTANCE_ID_SHIFT) & MATERIAL_INSTANCE_ID_MASK);
         return (key << MATERIAL_SHIFT) & MATERIAL_MASK;
     }
 
@@ -175,11 +206,12 @@ public:
     struct PrimitiveInfo { // 28 bytes
         FMaterialInstance const* mi = nullptr;              // 8 bytes (4)
         Handle<HwRenderPrimitive> primitiveHandle;          // 4 bytes
-        Handle<HwUniformBuffer> perRenderableUniforms;      // 4 bytes
-        Handle<HwUniformBuffer> perRenderableBones;         // 4 bytes
+        uint32_t perRenderableUniforms = 0;                 // 4 bytes (ring offset)
+        uint32_t perRenderableBones = FRenderableManager::NO_BONES; // 4 bytes (arena offset)
         Driver::RasterState rasterState;                    // 4 bytes
         Variant materialVariant;                            // 1 byte
-        uint8_t reserved[3] = { };                          // 3 bytes (that helps the compiler)
+        uint8_t reserved = 0;                               // 1 byte (that helps the compiler)
+        uint16_t instanceCount = 1;                         // 2 bytes
     };
 
     struct alignas(8) Command {     // 32 bytes
@@ -200,19 +232,155 @@ public:
     static constexpr RenderFlags HAS_SHADOWING          = 0x01;
     static constexpr RenderFlags HAS_DIRECTIONAL_LIGHT  = 0x02;
     static constexpr RenderFlags HAS_DYNAMIC_LIGHTING   = 0x04;
+    // only large occluders and expensive materials are drawn in the depth pre-pass
+    static constexpr RenderFlags SELECTIVE_DEPTH_PREPASS = 0x08;
+    // TRANSPARENT and FADE materials are drawn once each, unsorted, in the ORDER_INDEPENDENT pass
+    static constexpr RenderFlags ORDER_INDEPENDENT_TRANSPARENCY = 0x10;
+    // the opaque commands are sorted strictly front to back, see View::SortPolicy
+    static constexpr RenderFlags SORT_FRONT_TO_BACK     = 0x20;
+    // the opaque commands are sorted by material only, even without depth pre-pass
+    static constexpr RenderFlags SORT_STATE_FIRST       = 0x40;
+
+
+    /*
+     * Per-thread storage for the commands of a pass, each job generates its commands in the
+     * chunk of the thread it runs on and only keeps the ones that are actually issued. The
+     * chunks are then gathered into the pass' command buffer, which only needs room for
+     * these. The chunks grow as needed and are reused from pass to pass.
+     */
+    class CommandChunks {
+    public:
+        explicit CommandChunks(size_t threadCount);
+        ~CommandChunks() noexcept;
+
+        CommandChunks(CommandChunks const&) = delete;
+        CommandChunks& operator=(CommandChunks const&) = delete;
+
+        // returns room for at least 'count' commands after the ones in the chunk of the
+        // thread 'index', which must be the calling thread.
+        Command* reserve(size_t index, size_t count) noexcept;
+
+        // the commands up to 'end' (which must be in the reserved space) are kept
+        void commit(size_t index, Command const* end) noexcept {
+            mChunks[index].size = uint32_t(end - mChunks[index].data);
+        }
+
+        // number of commands in all the chunks
+        size_t size() const noexcept;
+
+        // moves the commands in all chunks into 'commands', at most 'count' of them
+        void gather(Command* commands, size_t count) noexcept;
+
+    private:
+        struct alignas(utils::CACHELINE_SIZE) Chunk {
+            Command* data = nullptr;
+            uint32_t size = 0;
+            uint32_t capacity = 0;
+        };
+        Chunk* const mChunks;
+        const size_t mChunkCount;
+    };
 
+    /*
+     * The sorted commands of a pass and what they were generated from. When nothing changes
+     * from one frame to the next, e.g. in a static UI, they're reused instead of being
+     * generated and sorted again, and only the driver commands are recorded. The commands are
+     * only kept once the inputs are the same for two frames in a row, so that passes changing
+     * every frame just pay for the comparison.
+     */
+    class CommandCache {
+    public:
+        // what the commands are generated from, besides the visible renderables
+        struct Inputs {
+            FScene const* scene = nullptr;
+            uint32_t renderableGeneration = 0;
+            uint32_t transformGeneration = 0;
+            uint32_t materialInstanceGeneration = 0;
+            uint32_t commandTypeFlags = 0;
+            RenderFlags renderFlags = 0;
+            uint8_t visibilityMask = 0;
+            uint8_t visibilityValue = 0;
+            math::float3 cameraPosition = {};
+            math::float3 cameraForward = {};
+            float pixelScale = 0.0f;
+            float minOccluderPixels = 0.0f;
+            bool operator==(Inputs const& rhs) const noexcept;
+        };
+
+        // Records the inputs of this frame, returns true if they're the same as the previous
+        // frame's and the commands generated from them are cached.
+        bool update(Inputs const& inputs,
+                FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr) noexcept;
+
+        // keeps the commands generated from the last update()'s inputs, if these didn't change
+        void store(Command const* first, Command const* last);
+
+        // the cached commands, including the final sentinel
+        Command const* data() const noexcept { return mCommands.data(); }
+        size_t size() const noexcept { return mCommands.size(); }
+
+        // The driver commands of the opaque and the blended cached commands, recorded once and
+        // replayed by the following frames. They're dropped with the cached commands, or when
+        // the per-renderable buffers they bind change.
+        static constexpr size_t BUNDLE_COUNT = 2;
+        CommandBundle* getBundles(Handle<HwUniformBuffer> uniforms,
+                Handle<HwUniformBuffer> bones) noexcept;
+
+    private:
+        // what the commands are generated from, per visible renderable
+        struct Row {
+            uint32_t instance;
+            uint32_t uniformsOffset;
+            uint32_t bonesOffset;
+            uint32_t visibleMask;
+            FRenderPrimitive const* primitives;
+            size_t primitiveCount;
+            bool operator==(Row const& rhs) const noexcept {
+                return instance == rhs.instance && uniformsOffset == rhs.uniformsOffset &&
+                       bonesOffset == rhs.bonesOffset && visibleMask == rhs.visibleMask &&
+                       primitives == rhs.primitives && primitiveCount == rhs.primitiveCount;
+            }
+        };
+        Inputs mInputs;
+        std::vector<Row> mRows;
+        std::vector<Command> mCommands;
+        CommandBundle mBundles[BUNDLE_COUNT];
+        Handle<HwUniformBuffer> mBundleUniforms;
+        Handle<HwUniformBuffer> mBundleBones;
+        bool mUnchanged = false;
+    };
 
-    RenderPass(const char* name) noexcept : mName(name) { }
+    // only the renderables for which (VISIBLE_MASK & visibilityMask) == visibilityValue are
+    // rendered by this pass
+    explicit RenderPass(const char* name,
+            uint8_t visibilityMask = 0, uint8_t visibilityValue = 0) noexcept
+            : mName(name), mVisibilityMask(visibilityMask), mVisibilityValue(visibilityValue) { }
 
     virtual ~RenderPass() noexcept;
 
-    // appends rendering commands for the given view
-    void render(
+    // Appends rendering commands for the given view, returns the number of commands needed in
+    // total, including the space used to sort them. If that's more than the capacity of
+    // 'commands', commands that don't fit are dropped. soa is the view's snapshot of the scene.
+    size_t render(
             FEngine& engine, utils::JobSystem& js,
-            FScene::RenderableSoa const& soa, utils::Range<uint32_t> visibleRenderables,
+            FScene const& scene, FScene::RenderableSoa const& soa,
+            utils::Range<uint32_t> visibleRenderables,
             uint32_t commandTypeFlags, RenderFlags renderFlags,
             const CameraInfo& camera, Viewport const& viewport,
-            utils::GrowingSlice<Command>& commands) noexcept;
+            CommandChunks& chunks, utils::GrowingSlice<Command>& commands) noexcept;
+
+protected:
+    // the commands of this pass are reused from frame to frame when possible, see CommandCache
+    void setCommandCache(CommandCache* cache) noexcept { mCommandCache = cache; }
+
+    // the commands are drawn once per eye, see beginEye()
+    void setEyeCount(uint8_t count) noexcept { mEyeCount = count; }
+
+    // the commands are drawn with the debug material of this visualization, see
+    // FEngine::getDebugVisualizationInstance()
+    void setVisualization(FEngine::DebugVisualization visualization) noexcept {
+        mVisualization = visualization;
+    }
 
 private:
     // Called just before rendering, make sure all needed asynchronous tasks are finished.
@@ -225,6 +393,35 @@ private:
     // but at least call driver.endRenderPass().
     virtual void endRenderPass(driver::DriverApi& driver, Viewport const& viewport) noexcept = 0;
 
+    // Called before drawing the commands for each eye, with more than one eye. Set-up the
+    // eye's viewport and per-view uniforms.
+    virtual void beginEye(driver::DriverApi& driver, Viewport const& viewport,
+            size_t eye) noexcept { }
+
+protected:
+    // the buffers the per-renderable offsets of the commands refer to
+    struct PerRenderableBuffers {
+        Handle<HwUniformBuffer> uniforms;
+        size_t uniformsSize;
+        Handle<HwUniformBuffer> bones;
+    };
+
+    // Called between the opaque and the blended commands, with the commands of the
+    // ORDER_INDEPENDENT pass, if there are any. They're recorded like the others by default.
+    virtual void renderOrderIndependent(driver::DriverApi& driver, utils::JobSystem& js,
+            PerRenderableBuffers const& buffers, Command const* first, Command const* last,
+            Viewport const& viewport) noexcept;
+
+    static void recordDriverCommands(FEngine::DriverApi& driver, utils::JobSystem& js,
+            PerRenderableBuffers const& buffers, Command const* first, Command const* last) noexcept;
+
+    // true if the commands of this pass have an ORDER_INDEPENDENT pass, valid from
+    // beginRenderPass() on
+    bool hasOrderIndependentPass() const noexcept { return mHasOrderIndependentPass; }
+
+    // number of draw calls recorded by the last render()
+    uint32_t getDrawCount() const noexcept { return mDrawCount; }
+
 private:
     friend class FRenderer;
 
@@ -237,25 +434,81 @@ private:
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
-    static inline void generateCommands(uint32_t commandTypeFlags, Command* const commands,
+    // commands are sorted in chunks of at least this many commands, in parallel
+    static constexpr uint32_t SORT_COMMANDS_MIN_CHUNK_SIZE = 2048;
+    static constexpr uint32_t SORT_COMMANDS_MAX_CHUNKS = 8;
+
+    // driver commands are recorded in segments of at least this many commands, in parallel
+    static constexpr uint32_t RECORD_COMMANDS_MIN_CHUNK_SIZE = 1024;
+    static constexpr uint32_t RECORD_COMMANDS_MAX_CHUNKS = 8;
+
+    // with a selective depth pre-pass, objects smaller than this on screen, relative to the
+    // height of the viewport, are only drawn in the pre-pass if their material is expensive
+    static constexpr float MIN_OCCLUDER_SIZE = 0.25f;
+
+    // writes the commands of the renderables in 'range' and returns the end of the commands
+    static inline Command* generateCommands(uint32_t commandTypeFlags, Command* commands,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
-            math::float3 cameraPosition, math::float3 cameraForward) noexcept;
+            uint8_t visibilityMask, uint8_t visibilityValue,
+            math::float3 cameraPosition, math::float3 cameraForward, float pixelScale,
+            float minOccluderPixels) noexcept;
 
     template<uint32_t commandTypeFlags>
-    static inline void generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
-            utils::Range<uint32_t> range, RenderFlags renderFlags, math::float3 cameraPosition,
-            math::float3 cameraForward) noexcept;
+    static inline Command* generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
+            utils::Range<uint32_t> range, RenderFlags renderFlags,
+            uint8_t visibilityMask, uint8_t visibilityValue,
+            math::float3 cameraPosition, math::float3 cameraForward, float pixelScale,
+            float minOccluderPixels) noexcept;
+
+    // generates and sorts the commands of the visible renderables, returns the number of
+    // commands needed in total (see render())
+    size_t generateAndSortCommands(FEngine& engine, utils::JobSystem& js,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            uint32_t commandTypeFlags, RenderFlags renderFlags,
+            math::float3 cameraPosition, math::float3 cameraForward, float pixelScale,
+            float minOccluderPixels, CommandChunks& chunks,
+            utils::GrowingSlice<Command>& commands, CommandCache* cache) noexcept;
 
     static void setupColorCommand(Command& cmdDraw, bool hasDepthPass,
             FMaterialInstance const* const mi) noexcept;
 
+    static void sortCommands(utils::JobSystem& js, utils::GrowingSlice<Command>& commands) noexcept;
+
     static void recordDriverCommands(FEngine::DriverApi& driver,
-            utils::Slice<Command> const& commands) noexcept;
+            PerRenderableBuffers const& buffers, Command const* first, Command const* last) noexcept;
+
+    // records the driver commands into 'bundle' instead of 'driver', in the same segments
+    static void recordDriverCommands(FEngine::DriverApi& driver, utils::JobSystem& js,
+            PerRenderableBuffers const& buffers, Command const* first, Command const* last,
+            CommandBundle& bundle) noexcept;
+
+    // The commands are recorded in chunks of at least RECORD_COMMANDS_MIN_CHUNK_SIZE commands,
+    // each one in its own segment (see CommandStream::reserveSegments()).
+    static uint32_t getRecordChunkCount(Command const* first, Command const* last) noexcept;
+    static Command const* getRecordChunkBegin(Command const* first, Command const* last,
+            uint32_t chunkCount, uint32_t i) noexcept;
+    // computes the chunkCount + 1 boundaries of the segments of the chunks
+    static void sizeRecordChunks(utils::JobSystem& js, Command const* first, Command const* last,
+            uint32_t chunkCount, size_t* offsets) noexcept;
+
+    // replaces the material and the depth/blending state of the color commands
+    static void applyVisualization(FEngine& engine, FEngine::DebugVisualization visualization,
+            Command* first, Command* last) noexcept;
+
+    static size_t getDriverCommandsSizeUpperBound(
+            Command const* first, Command const* last) noexcept;
 
     static void updateSummedPrimitiveCounts(
             FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
 
     const char* const mName;
+    const uint8_t mVisibilityMask;
+    const uint8_t mVisibilityValue;
+    CommandCache* mCommandCache = nullptr;
+    uint32_t mDrawCount = 0;
+    uint8_t mEyeCount = 1;
+    FEngine::DebugVisualization mVisualization = FEngine::DebugVisualization::NONE;
+    bool mHasOrderIndependentPass = false;
 };
 
 } // namespace details
@@ -16,61 +16,85 @@
 
 #include "details/RenderPrimitive.h"
 
+#include "details/DestroyBatch.h"
 #include "details/Engine.h"
 #include "details/VertexBuffer.h"
 #include "details/IndexBuffer.h"
 #include "details/Material.h"
 
+#include <utils/Log.h>
+
+using namespace utils;
+
 namespace filament {
 namespace details {
 
-void FRenderPrimitive::init(driver::DriverApi& driver,
-        const RenderableManager::Builder::Entry& entry) noexcept {
+void FRenderPrimitive::init(FEngine& engine,
+        const RenderableManager::Builder::Entry& entry, bool preSkinning) noexcept {
 
     assert(entry.materialInstance);
 
+    FEngine::DriverApi& driver = engine.getDriverApi();
     mHandle = driver.createRenderPrimitive();
     mMaterialInstance = upcast(entry.materialInstance);
     mBlendOrder = entry.blendOrder;
 
     if (entry.indices && entry.vertices) {
-        FVertexBuffer* vertexBuffer = upcast(entry.vertices);
-        FIndexBuffer* indexBuffer = upcast(entry.indices);
-
-        AttributeBitset enabledAttributes = vertexBuffer->getDeclaredAttributes();
-
-        auto const& ebh = vertexBuffer->getHwHandle();
-        auto const& ibh = indexBuffer->getHwHandle();
-
-        driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
+        setBuffers(engine, upcast(entry.vertices), upcast(entry.indices), preSkinning);
         driver.setRenderPrimitiveRange(mHandle, entry.type,
                 (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
                 (uint32_t)entry.count);
 
         mPrimitiveType = entry.type;
-        mEnabledAttributes = enabledAttributes;
     }
 }
 
 void FRenderPrimitive::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
+    engine.getPreSkinning().destroy(engine, mPreSkinning);
+    mPreSkinning = nullptr;
     driver.destroyRenderPrimitive(mHandle);
 }
 
+void FRenderPrimitive::terminate(FEngine& engine, DestroyBatch& batch) {
+    engine.getPreSkinning().destroy(mPreSkinning, batch);
+    mPreSkinning = nullptr;
+    batch.add(mHandle);
+}
+
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type,
         FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
         size_t minIndex, size_t maxIndex, size_t count) noexcept {
-    AttributeBitset enabledAttributes = vertices->getDeclaredAttributes();
-    auto const& ebh = vertices->getHwHandle();
-    auto const& ibh = indices->getHwHandle();
+    setBuffers(engine, vertices, indices, mPreSkinning != nullptr);
 
     FEngine::DriverApi& driver = engine.getDriverApi();
-
-    driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
     driver.setRenderPrimitiveRange(mHandle, type,
             (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
 
     mPrimitiveType = type;
+}
+
+void FRenderPrimitive::setBuffers(FEngine& engine,
+        FVertexBuffer* vertices, FIndexBuffer* indices, bool preSkinning) noexcept {
+    AttributeBitset enabledAttributes = vertices->getDeclaredAttributes();
+    auto ebh = vertices->getHwHandle();
+    auto const& ibh = indices->getHwHandle();
+
+    if (preSkinning) {
+        // the skinned copy must have the layout of the vertices
+        PreSkinning& manager = engine.getPreSkinning();
+        manager.destroy(engine, mPreSkinning);
+        mPreSkinning = manager.create(engine, vertices);
+        if (mPreSkinning) {
+            ebh = PreSkinning::getVertexBuffer(mPreSkinning);
+        } else {
+            slog.w << "The vertices can't be pre-skinned, the primitive isn't skinned anymore"
+                   << io::endl;
+        }
+    }
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
     mEnabledAttributes = enabledAttributes;
 }
 
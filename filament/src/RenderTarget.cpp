@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/RenderTarget.h"
+
+#include "details/Engine.h"
+#include "details/Texture.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace filament {
+
+using namespace details;
+using namespace driver;
+
+struct RenderTarget::BuilderDetails {
+    FRenderTarget::Attachment mAttachments[RenderTarget::ATTACHMENT_COUNT];
+};
+
+using BuilderType = RenderTarget;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+RenderTarget::Builder& RenderTarget::Builder::texture(
+        AttachmentPoint attachment, Texture* texture) noexcept {
+    mImpl->mAttachments[size_t(attachment)].texture = upcast(texture);
+    return *this;
+}
+
+RenderTarget::Builder& RenderTarget::Builder::mipLevel(
+        AttachmentPoint attachment, uint8_t level) noexcept {
+    mImpl->mAttachments[size_t(attachment)].level = level;
+    return *this;
+}
+
+RenderTarget* RenderTarget::Builder::build(Engine& engine) {
+    FRenderTarget::Attachment const& color = mImpl->mAttachments[size_t(AttachmentPoint::COLOR)];
+    FRenderTarget::Attachment const& depth = mImpl->mAttachments[size_t(AttachmentPoint::DEPTH)];
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(color.texture, "color texture not set")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(color.texture->getUsage() == TextureUsage::COLOR_ATTACHMENT,
+            "color texture must have COLOR_ATTACHMENT usage")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(
+            color.texture->getTarget() == Texture::Sampler::SAMPLER_2D,
+            "color texture must be a 2D texture")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(color.level < color.texture->getLevels(),
+            "color level out of range")) {
+        return nullptr;
+    }
+
+    if (depth.texture) {
+        if (!ASSERT_PRECONDITION_NON_FATAL(
+                depth.texture->getUsage() == TextureUsage::DEPTH_ATTACHMENT,
+                "depth texture must have DEPTH_ATTACHMENT usage")) {
+            return nullptr;
+        }
+
+        if (!ASSERT_PRECONDITION_NON_FATAL(
+                depth.level < depth.texture->getLevels() &&
+                depth.texture->getWidth(depth.level) == color.texture->getWidth(color.level) &&
+                depth.texture->getHeight(depth.level) == color.texture->getHeight(color.level),
+                "depth and color attachments must have the same size")) {
+            return nullptr;
+        }
+    }
+
+    return upcast(engine).createRenderTarget(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+FRenderTarget::FRenderTarget(FEngine& engine, const RenderTarget::Builder& builder) noexcept {
+    std::copy(std::begin(builder->mAttachments), std::end(builder->mAttachments),
+            std::begin(mAttachmentInfo));
+
+    Attachment const& color = mAttachmentInfo[size_t(AttachmentPoint::COLOR)];
+    Attachment const& depth = mAttachmentInfo[size_t(AttachmentPoint::DEPTH)];
+
+    mWidth = uint32_t(color.texture->getWidth(color.level));
+    mHeight = uint32_t(color.texture->getHeight(color.level));
+    mAttachments = depth.texture ? TargetBufferFlags::COLOR_AND_DEPTH : TargetBufferFlags::COLOR;
+
+    Driver::TargetBufferInfo colorInfo{ color.texture->getHwHandle(), color.level };
+    Driver::TargetBufferInfo depthInfo{};
+    if (depth.texture) {
+        depthInfo = { depth.texture->getHwHandle(), depth.level };
+    }
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    mHandle = driver.createRenderTarget(mAttachments, mWidth, mHeight,
+            uint8_t(color.texture->getSampleCount()), color.texture->getFormat(),
+            colorInfo, depthInfo, {});
+}
+
+void FRenderTarget::terminate(FEngine& engine) noexcept {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    driver.destroyRenderTarget(mHandle);
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+Texture* RenderTarget::getTexture(AttachmentPoint attachment) const noexcept {
+    return upcast(this)->getAttachment(attachment).texture;
+}
+
+uint8_t RenderTarget::getMipLevel(AttachmentPoint attachment) const noexcept {
+    return upcast(this)->getAttachment(attachment).level;
+}
+
+} // namespace filament
@@ -90,6 +90,13 @@ RenderTargetPool::Target const* RenderTargetPool::get(
         entry.target = driver.createRenderTarget(
                 entry.attachments, target_w, target_h, samples, format,
                 { entry.texture }, {}, {});
+
+        if (flags & RenderTargetPool::Target::REVEALAGE) {
+            entry.revealage = driver.createTexture(Driver::SamplerType::SAMPLER_2D, 1,
+                    TextureFormat::R16F, samples, target_w, target_h, 1,
+                    Driver::TextureUsage::COLOR_ATTACHMENT);
+            driver.setRenderTargetColorAttachment(entry.target, 1, { entry.revealage });
+        }
     }
 
     // update last used age
@@ -181,10 +188,22 @@ void RenderTargetPool::gc() noexcept {
     mCacheAge++;
 }
 
+size_t RenderTargetPool::purge() noexcept {
+    DriverApi& driver = mEngine->getDriverApi();
+    const size_t size = mPoolSize;
+    for (Entry const* entry : mPool) {
+        destroyEntry(driver, entry);
+    }
+    mPool.clear();
+    // the entries in use are still accounted
+    return size - mPoolSize;
+}
+
 void RenderTargetPool::destroyEntry(DriverApi& driver, Entry const* entry) noexcept {
     assert(entry);
     driver.destroyRenderTarget(entry->target);
     driver.destroyTexture(entry->texture);
+    driver.destroyTexture(entry->revealage);
     mPoolSize -= getSize(entry);
     mEntryArena.destroy(entry);
     assert(mPoolSize >= 0);
@@ -204,6 +223,10 @@ size_t RenderTargetPool::getSize(Entry const* entry) noexcept {
         size += 1;
     }
 
+    if (entry->flags & RenderTargetPool::Target::REVEALAGE) {
+        size += FTexture::getFormatSize(TextureFormat::R16F);
+    }
+
     return size * entry->samples * entry->w * entry->h;
 }
 
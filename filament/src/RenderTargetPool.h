@@ -56,6 +56,7 @@ public:
     struct Target {
         Handle<HwRenderTarget> target;
         Handle<HwTexture> texture;
+        Handle<HwTexture> revealage;    // color attachment 1, with REVEALAGE only
         uint32_t w = 0;
         uint32_t h = 0;
         driver::TargetBufferFlags attachments = driver::TargetBufferFlags::NONE;
@@ -63,6 +64,8 @@ public:
         uint8_t samples = 1;
         uint8_t flags = 0;
         static constexpr uint8_t NO_TEXTURE = 0x1;
+        // adds a R16F texture as the color attachment 1, for the order-independent transparency
+        static constexpr uint8_t REVEALAGE = 0x2;
     };
 
     Target const* get(driver::TargetBufferFlags attachments,
@@ -74,6 +77,13 @@ public:
     // remove older items in the cache. call this once per frame.
     void gc() noexcept;
 
+    // destroys all the render targets not in use, regardless of their age, returns their
+    // estimated size in bytes
+    size_t purge() noexcept;
+
+    // estimated GPU memory used by all the render targets of the pool, in use or not
+    size_t getPoolSize() const noexcept { return mPoolSize; }
+
 private:
     struct Entry : public Target {
         Entry() = default;
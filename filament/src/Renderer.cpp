@@ -16,6 +16,8 @@
 
 #include "details/Renderer.h"
 
+#include "CpuStageTimings.h"
+#include "FrameGraph.h"
 #include "RenderPass.h"
 
 #include "details/Engine.h"
@@ -28,6 +30,7 @@
 
 #include <filament/driver/PixelBufferDescriptor.h>
 
+#include <utils/memalign.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
 #include <utils/vector.h>
@@ -46,11 +49,19 @@ namespace details {
 FRenderer::FRenderer(FEngine& engine) :
         mEngine(engine),
         mFrameSkipper(engine, 2),
+        mCommandChunks(engine.getJobSystem().getMaxThreadCount()),
         mFrameInfoManager(engine),
         mIsRGB16FSupported(false),
         mIsRGB8Supported(false),
+        mIsFrameBufferFetchSupported(false),
+        mIsImplicitResolveSupported(false),
+        mIsOrderIndependentTransparencySupported(false),
+        mIsDepthReadbackSupported(false),
         mPerRenderPassArena(engine.getPerRenderPassAllocator())
 {
+    mCommandsCapacity = engine.getPerFrameCommandsSize() / sizeof(Command);
+    mCommands = static_cast<Command*>(
+            utils::aligned_alloc(mCommandsCapacity * sizeof(Command), CACHELINE_SIZE));
 }
 
 void FRenderer::init() noexcept {
@@ -58,6 +69,12 @@ void FRenderer::init() noexcept {
     mRenderTarget = driver.createDefaultRenderTarget();
     mIsRGB16FSupported = driver.isRenderTargetFormatSupported(driver::TextureFormat::RGB16F);
     mIsRGB8Supported = driver.isRenderTargetFormatSupported(driver::TextureFormat::RGB8);
+    mIsFrameBufferFetchSupported = driver.isFrameBufferFetchSupported();
+    mIsImplicitResolveSupported = driver.isImplicitResolveSupported();
+    mIsOrderIndependentTransparencySupported = driver.isMultipleRenderTargetsSupported() &&
+            driver.isRenderTargetFormatSupported(driver::TextureFormat::RGBA16F) &&
+            driver.isRenderTargetFormatSupported(driver::TextureFormat::R16F);
+    mIsDepthReadbackSupported = driver.isDepthReadbackSupported();
     if (UTILS_HAS_THREADING) {
         mFrameInfoManager.run();
     }
@@ -68,12 +85,31 @@ FRenderer::~FRenderer() noexcept {
     // to free what we can (it would probably mean something when wrong).
 #ifndef NDEBUG
     size_t wm = getCommandsHighWatermark();
-    size_t wmpct = wm / (CONFIG_PER_FRAME_COMMANDS_SIZE / 100);
+    size_t wmpct = wm / (mCommandsCapacity * sizeof(Command) / 100);
     slog.d << "Renderer: Commands High watermark "
     << wm / 1024 << " KiB (" << wmpct << "%), "
     << wm / sizeof(Command) << " commands, " << sizeof(Command) << " bytes/command"
     << io::endl;
 #endif
+    utils::aligned_free(mCommands);
+}
+
+void FRenderer::updateCommandsCapacity() noexcept {
+    const size_t required = mCommandsHighWatermark;
+    if (UTILS_LIKELY(required <= mCommandsCapacity / 4 * 3)) {
+        return;
+    }
+
+    // leave some room for the scene to keep growing
+    const size_t capacity = std::max(2 * mCommandsCapacity, required + required / 2);
+    slog.w << "Renderer: " << required << " commands needed out of " << mCommandsCapacity
+           << ", growing to " << capacity * sizeof(Command) / 1024 << " KiB" << io::endl;
+
+    utils::aligned_free(mCommands);
+    mCommands = static_cast<Command*>(
+            utils::aligned_alloc(capacity * sizeof(Command), CACHELINE_SIZE));
+    mCommandsCapacity = capacity;
+    mCommandsHighWatermark = 0;
 }
 
 void FRenderer::terminate(FEngine& engine) {
@@ -81,6 +117,7 @@ void FRenderer::terminate(FEngine& engine) {
     // shut down threads if we created any.
     DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderTarget(mRenderTarget);
+    mFrameInfoManager.terminateGpuTimings(driver);
 
     // before we can destroy this Renderer's resources, we must make sure
     // that all pending commands have been executed (as they could reference data in this
@@ -96,33 +133,134 @@ void FRenderer::terminate(FEngine& engine) {
 }
 
 void FRenderer::render(FView const* view) {
+    View const* const views[] = { view };
+    render(views, 1);
+}
+
+void FRenderer::render(View const* const* views, size_t count) {
     SYSTRACE_CALL();
 
     assert(mSwapChain);
 
-    if (UTILS_LIKELY(view && view->getScene())) {
-        // per-renderpass data
-        ArenaScope rootArena(mPerRenderPassArena);
+    // per-renderpass data
+    ArenaScope rootArena(mPerRenderPassArena);
 
-        FEngine& engine = mEngine;
-        JobSystem& js = engine.getJobSystem();
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
 
-        // create a master job so no other job can escape
-        auto masterJob = js.setMasterJob(js.createJob());
+    // create a master job so no other job can escape
+    auto masterJob = js.setMasterJob(js.createJob());
+
+    // Culling doesn't use the driver and only touches a view and its snapshot of the scene, so
+    // the first view of each scene is culled concurrently with the others. The other views of a
+    // scene are culled just before they're rendered, since they overwrite the results of the
+    // previous one.
+    // With pipelined culling, the second view of a scene is culled concurrently too, in a copy
+    // of the scene, and each view is rendered as soon as its own culling is done: the views
+    // that follow are culled while the previous ones are rendered.
+    const bool pipelined = mPipelinedCulling;
+    bool* const culled = rootArena.allocate<bool>(count);
+    // the view culled in the second snapshot of the scene of each first view, or count
+    size_t* const pipelinedViews = rootArena.allocate<size_t>(count);
+    for (size_t i = 0; i < count; i++) {
+        FView* const view = const_cast<FView*>(upcast(views[i]));
+        FScene const* const scene = view ? view->getScene() : nullptr;
+        pipelinedViews[i] = count;
+        if (scene) {
+            view->setSceneSnapshot(0);
+        }
+        size_t first = i;
+        for (size_t j = 0; j < i && first == i && scene; j++) {
+            first = views[j] && upcast(views[j])->getScene() == scene ? j : i;
+        }
+        culled[i] = scene && first == i;
+        if (pipelined && !culled[i] && scene && pipelinedViews[first] == count) {
+            // the copy of the scene has the world origin of the first view
+            FView const* const firstView = upcast(views[first]);
+            if (firstView != view && FScene::isSameTransform(
+                    firstView->getWorldOriginTransform(engine),
+                    view->getWorldOriginTransform(engine))) {
+                pipelinedViews[first] = i;
+                view->setSceneSnapshot(1);
+                culled[i] = true;
+            }
+        }
+    }
 
-        // execute the render pass
-        renderJob(rootArena, const_cast<FView*>(view));
+    // culling is on the critical path, keep it on the high capacity cores
+    JobSystem::Job* const jobCulling = js.setCoreClass(js.createJob(), JobSystem::CoreClass::BIG);
+    // with pipelined culling, the views wait for their own culling job
+    JobSystem::Job** const viewCulling = rootArena.allocate<JobSystem::Job*>(count);
+    std::fill_n(viewCulling, count, nullptr);
+    for (size_t i = 0; i < count; i++) {
+        FView* const view = const_cast<FView*>(upcast(views[i]));
+        if (!culled[i] || view->getSceneSnapshot() != 0) {
+            continue;
+        }
+        if (!pipelined) {
+            js.run(js.createJob(jobCulling, [&engine, view](JobSystem&, JobSystem::Job*) {
+                view->prepareVisibility(engine);
+            }), JobSystem::DONT_SIGNAL);
+            continue;
+        }
 
-        // make sure to flush the command buffer
-        engine.flush();
+        viewCulling[i] = js.setCoreClass(js.createJob(), JobSystem::CoreClass::BIG);
+        const size_t second = pipelinedViews[i];
+        if (second == count) {
+            js.run(js.createJob(viewCulling[i], [&engine, view](JobSystem&, JobSystem::Job*) {
+                view->prepareVisibility(engine);
+            }), JobSystem::DONT_SIGNAL);
+            continue;
+        }
+
+        // the scene is prepared once in both snapshots, then both views are culled
+        FView* const secondView = const_cast<FView*>(upcast(views[second]));
+        viewCulling[second] = js.setCoreClass(js.createJob(), JobSystem::CoreClass::BIG);
+        JobSystem::Job* const cullFirst = js.createJob(viewCulling[i],
+                [&engine, view](JobSystem&, JobSystem::Job*) {
+                    view->prepareVisibility(engine, false);
+                });
+        JobSystem::Job* const cullSecond = js.createJob(viewCulling[second],
+                [&engine, secondView](JobSystem&, JobSystem::Job*) {
+                    secondView->prepareVisibility(engine, false);
+                });
+        js.run(js.createJob(viewCulling[i],
+                [&engine, view, cullFirst, cullSecond](JobSystem& js, JobSystem::Job*) {
+                    {
+                        CpuStageTimings::Scope timing(engine.getCpuStageTimings(),
+                                CpuStageTimings::CULL);
+                        view->getScene()->prepare(view->getWorldOriginTransform(engine), 2);
+                    }
+                    js.run(cullSecond);
+                    js.run(cullFirst);
+                }), JobSystem::DONT_SIGNAL);
+    }
+    js.runAndWait(jobCulling);
 
-        // and wait for all jobs to finish as a safety (this should be a no-op)
-        js.runAndWait(masterJob);
-        js.reset();
+    // the rest talks to the driver and must happen in order
+    for (size_t i = 0; i < count; i++) {
+        FView* const view = const_cast<FView*>(upcast(views[i]));
+        if (UTILS_LIKELY(view && view->getScene())) {
+            ArenaScope arena(rootArena.getAllocator());
+
+            if (viewCulling[i]) {
+                js.runAndWait(viewCulling[i]);
+            }
+
+            // execute the render pass
+            renderJob(arena, view, culled[i]);
+
+            // make sure to flush the command buffer
+            engine.flush();
+        }
     }
+
+    // and wait for all jobs to finish as a safety (this should be a no-op)
+    js.runAndWait(masterJob);
+    js.reset();
 }
 
-void FRenderer::renderJob(ArenaScope& arena, FView* view) {
+void FRenderer::renderJob(ArenaScope& arena, FView* view, bool culled) {
     FEngine& engine = getEngine();
     JobSystem& js = engine.getJobSystem();
     FEngine::DriverApi& driver = engine.getDriverApi();
@@ -132,9 +270,19 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     // DEBUG: driver commands must all happen from the same thread. Enforce that on debug builds.
     engine.getDriverApi().debugThreading();
 
+    if (view->getDepthPrepass() == View::DepthPrepass::AUTOMATIC) {
+        // without GPU timings, the selector keeps the default strategy
+        FrameInfoManager::GpuFrameInfo info;
+        if (mFrameInfoManager.getLastGpuFrameInfo(&info)) {
+            DepthPrepassSelector& selector = view->getDepthPrepassSelector();
+            selector.addMeasurement(info.frame, info.laps[FrameInfo::GPU_COLOR_PASS]);
+            selector.select(mFrameId);
+        }
+    }
+
     Viewport const& vp = view->getViewport();
     const bool hasPostProcess = view->hasPostProcessPass();
-    float2 scale = view->updateScale(mFrameInfoManager.getLastFrameTime());
+    float2 scale = view->updateScale(getLastFrameTime());
     bool useFXAA = view->getAntiAliasing() == View::AntiAliasing::FXAA;
     if (!hasPostProcess) {
         // dynamic scaling and FXAA are part of the post-process phase and can't happen if
@@ -142,6 +290,12 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
         useFXAA = false;
         scale = 1.0f;
     }
+    // the debug visualizations replace the shading of the color pass with a value per pixel,
+    // which the post-process pass shows in false colors instead of tone mapping it
+    const FEngine::DebugVisualization visualization = hasPostProcess ?
+            engine.getDebugVisualization() : FEngine::DebugVisualization::NONE;
+    const bool visualize = visualization != FEngine::DebugVisualization::NONE;
+    useFXAA = useFXAA && !visualize;
 
     const bool scaled = any(notEqual(scale, float2(1.0f)));
     Viewport svp = vp.scale(scale);
@@ -149,90 +303,349 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
         return;
     }
 
+    if (!culled) {
+        view->prepareVisibility(engine);
+    }
     view->prepare(engine, driver, arena, svp);
-    // TODO: froxelization could actually start now, instead of in ColorPass::renderColorPass()
+
+    // temporal upsampling replaces the upscaling blit, its history is reprojected with a single
+    // camera, so it's not used in stereo
+    const TextureFormat ldrFormat = getLdrFormat();
+    view->prepareTemporalUpsampling(engine,
+            scaled && view->hasTemporalUpsampling() && !view->isStereoscopic(), ldrFormat);
+
+    // start the froxelization now, it only needs the visible lights and the camera; it runs
+    // concurrently with the frame graph setup and is waited on by the color pass.
+    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
+            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
+    js.run(jobFroxelize);
 
     /*
      * Allocate command buffer.
      */
 
-    const size_t commandsSize = FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE;
-    const size_t commandsCount = commandsSize / sizeof(Command);
-    GrowingSlice<Command> commands(
-            arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
+    GrowingSlice<Command> commands(mCommands, uint32_t(mCommandsCapacity));
+
+    /*
+     * Build the frame graph, it ends with the view's render target
+     */
+
+    FrameGraph fg(arena, rtp);
+
+    // The view renders into its own RenderTarget if it has one, the views rendered after it in
+    // this frame sample its textures directly.
+    // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
+    FRenderTarget const* renderTarget = view->getRenderTarget();
+    const Handle<HwRenderTarget> viewRenderTarget = renderTarget ?
+            renderTarget->getHwHandle() : getRenderTarget();
+    const FrameGraphResource output = fg.import("View Render Target",
+            { .width = vp.width, .height = vp.height }, viewRenderTarget,
+            view->getDiscardedTargetBuffers());
 
     /*
      * Shadow pass
      */
 
+    struct ShadowPassData {
+        FrameGraphResource shadowMap;
+    };
+
+    struct ShadowMomentsPassData {
+        FrameGraphResource shadowMap;
+        FrameGraphResource moments;
+    };
+
+    FrameGraphResource shadowMap;
+    FrameGraphResource shadowMoments;
     if (view->hasShadowing()) {
-        ShadowPass::renderShadowMap(engine, js, view, commands);
-        recordHighWatermark(commands); // for debugging
-        // reset the command buffer
-        commands.clear();
+        ShadowMap const& sm = view->getShadowMap();
+        shadowMap = fg.import("Shadow Map", {
+                        .width = sm.getDimension(), .height = sm.getDimension(),
+                        .format = TextureFormat::DEPTH16,
+                        .attachments = TargetBufferFlags::DEPTH },
+                sm.getRenderTarget());
+
+        fg.addPass<ShadowPassData>("Shadow map Pass",
+                [&](FrameGraph::Builder& builder, ShadowPassData& data) {
+                    data.shadowMap = builder.write(shadowMap);
+                },
+                [&](FrameGraphPassResources const&, ShadowPassData const&, DriverApi& driver) {
+                    mFrameInfoManager.beginGpuLap(driver, FrameInfo::GPU_SHADOW_PASS);
+                    recordHighWatermark(ShadowPass::renderShadowMap(engine, js, view,
+                            mCommandChunks, commands));
+                    mFrameInfoManager.endGpuLap(driver);
+                    // reset the command buffer
+                    commands.clear();
+                });
+
+        // with variance shadows, the receivers sample the blurred moments of the shadow map
+        if (sm.getMomentsRenderTarget()) {
+            shadowMoments = fg.import("Shadow Moments", {
+                            .width = sm.getDimension(), .height = sm.getDimension(),
+                            .format = TextureFormat::RGBA16F,
+                            .attachments = TargetBufferFlags::COLOR },
+                    sm.getMomentsRenderTarget());
+
+            fg.addPass<ShadowMomentsPassData>("Shadow moments Pass",
+                    [&](FrameGraph::Builder& builder, ShadowMomentsPassData& data) {
+                        data.shadowMap = builder.sample(shadowMap, TargetBufferFlags::DEPTH);
+                        data.moments = builder.write(shadowMoments);
+                    },
+                    [&](FrameGraphPassResources const&, ShadowMomentsPassData const&,
+                            DriverApi& driver) {
+                        mFrameInfoManager.beginGpuLap(driver, FrameInfo::GPU_SHADOW_PASS);
+                        view->getShadowMap().prefilterMoments(driver);
+                        mFrameInfoManager.endGpuLap(driver);
+                    });
+        }
+    }
+
+    // the spot lights' shadows, this must come after the shadow map pass (see
+    // FView::prepareShadowAtlasTile)
+    FrameGraphResource shadowAtlas;
+    if (view->hasShadowAtlas()) {
+        ShadowAtlas const& sa = view->getShadowAtlas();
+        shadowAtlas = fg.import("Shadow Atlas", {
+                        .width = sa.getDimension(), .height = sa.getDimension(),
+                        .format = TextureFormat::DEPTH16,
+                        .attachments = TargetBufferFlags::DEPTH },
+                sa.getRenderTarget());
+
+        fg.addPass<ShadowPassData>("Shadow atlas Pass",
+                [&](FrameGraph::Builder& builder, ShadowPassData& data) {
+                    data.shadowMap = builder.write(shadowAtlas);
+                },
+                [&](FrameGraphPassResources const&, ShadowPassData const&, DriverApi& driver) {
+                    mFrameInfoManager.beginGpuLap(driver, FrameInfo::GPU_SHADOW_PASS);
+                    recordHighWatermark(
+                            ShadowAtlasPass::renderShadowAtlas(engine, js, view,
+                                    mCommandChunks, commands));
+                    mFrameInfoManager.endGpuLap(driver);
+                    // reset the command buffer
+                    commands.clear();
+                });
+    }
+
+    /*
+     * Picking pass, it changes the view's uniforms which the color pass sets back
+     */
+
+    struct PickingPassData {
+        FrameGraphResource picking;
+    };
+
+    if (UTILS_UNLIKELY(view->hasPickingQueries())) {
+        if (mIsDepthReadbackSupported) {
+            FrameGraphResource picking = fg.import("Picking", {
+                            .width = FView::PICKING_CANDIDATE_COUNT,
+                            .height = FView::PICKING_QUERY_COUNT,
+                            .format = TextureFormat::DEPTH32F,
+                            .attachments = TargetBufferFlags::DEPTH },
+                    view->preparePicking(engine));
+
+            fg.addPass<PickingPassData>("Picking Pass",
+                    [&](FrameGraph::Builder& builder, PickingPassData& data) {
+                        data.picking = builder.write(picking);
+                        builder.sideEffect();
+                    },
+                    [&](FrameGraphPassResources const& resources, PickingPassData const& data,
+                            DriverApi& driver) {
+                        recordHighWatermark(PickingPass::renderPicking(engine, js, view,
+                                resources.get(data.picking).target, mCommandChunks, commands));
+                        commands.clear();
+                    });
+        } else {
+            // the picking target's depth buffer can't be read back
+            view->cancelPickingQueries();
+        }
     }
 
     /*
      * Depth + Color passes
      */
 
+    struct ColorPassData {
+        FrameGraphResource shadowMap;
+        FrameGraphResource shadowAtlas;
+        FrameGraphResource shadowMoments;
+        FrameGraphResource color;
+    };
+
     const uint8_t useMSAA = view->getSampleCount();
-    const TextureFormat hdrFormat = getHdrFormat();
-    const TextureFormat ldrFormat = getLdrFormat();
-    RenderTargetPool::Target const* colorTarget = nullptr;
+    const bool translucent = mSwapChain->isTransparent();
+
+    // With framebuffer fetch, tone mapping is drawn at the end of the color pass, in place, which
+    // saves writing the tone mapped image to memory and reading it back for FXAA. It can only be
+    // followed by FXAA, which reads the luma from the alpha channel of the color buffer, since a
+    // float color buffer can't be blitted into a fixed-point target.
+    // The auto-exposure meters the color buffer before it's tone mapped, so it can't be tone
+    // mapped in place; it also needs to sample it, which requires it to be resolved.
+    const bool autoExposure = hasPostProcess && !visualize && view->hasAutoExposure() &&
+            (useMSAA <= 1 || mIsImplicitResolveSupported);
+    view->prepareAutoExposure(engine, autoExposure);
+    const bool toneMapInPlace = hasPostProcess && useFXAA && useMSAA <= 1 &&
+            mIsFrameBufferFetchSupported && !autoExposure;
+    // the visualizations store negative values, for unknown costs
+    const TextureFormat hdrFormat = toneMapInPlace || visualize ?
+            TextureFormat::RGBA16F : getHdrFormat();
+    if (hasPostProcess) {
+        // the tone mapping passes grade the colors with the view's lookup table, baked here
+        // when its options changed
+        ppm.setColorGrading(view->updateColorGrading(driver));
+        ppm.setAutoExposure(autoExposure ? view->getAutoExposure().texture : Handle<HwTexture>{});
+    }
+    Handle<HwProgram> inPlaceToneMappingProgram;
+    if (toneMapInPlace) {
+        inPlaceToneMappingProgram = engine.getPostProcessProgram(
+                translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT_IN_PLACE
+                            : PostProcessStage::TONE_MAPPING_OPAQUE_IN_PLACE);
+    }
+
+    // The order-independent transparency is composed over the color buffer, it needs a target
+    // of its own, which the views without post-processing don't have. It's composed over the
+    // whole viewport, so it isn't available to stereoscopic views.
+    Handle<HwProgram> transparencyResolveProgram;
+    if (view->isOrderIndependentTransparencyEnabled() && hasPostProcess && !visualize &&
+            mIsOrderIndependentTransparencySupported && !view->isStereoscopic()) {
+        transparencyResolveProgram = engine.getPostProcessProgram(
+                PostProcessStage::TRANSPARENCY_RESOLVE);
+    }
 
     if (UTILS_LIKELY(hasPostProcess)) {
-        // allocate the target we need for rendering the scene
-        colorTarget = rtp.get(TargetBufferFlags::COLOR_AND_DEPTH,
-                svp.width, svp.height, useMSAA, hdrFormat);
+        // the scene is rendered at the bottom-left of its own target
         svp.left = svp.bottom = 0;
     }
 
-    // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
-    const Handle<HwRenderTarget> viewRenderTarget = getRenderTarget();
-    ColorPass::renderColorPass(engine, js,
-            colorTarget ? colorTarget->target : viewRenderTarget, view, svp, commands);
+    // this frame's depth buffer is used for occlusion culling and light culling in the next
+    // frames, it's read back after the color pass, see below
+    const bool readOcclusionDepth = view->needsOcclusionDepth() && hasPostProcess &&
+            useMSAA <= 1 && mIsDepthReadbackSupported;
+    if (UTILS_UNLIKELY(view->needsOcclusionDepth() && !mIsDepthReadbackSupported &&
+            !mDepthReadbackWarned)) {
+        // the depth of the views then stays empty, and they skip these
+        slog.w << "Renderer: the depth buffer can't be read back on this backend, occlusion "
+               << "culling and the froxels depth bounds are disabled" << io::endl;
+        mDepthReadbackWarned = true;
+    }
+
+    auto& colorPass = fg.addPass<ColorPassData>("Color Pass",
+            [&](FrameGraph::Builder& builder, ColorPassData& data) {
+                if (shadowMap.isValid()) {
+                    data.shadowMap = builder.sample(shadowMap, TargetBufferFlags::DEPTH);
+                }
+                if (shadowAtlas.isValid()) {
+                    data.shadowAtlas = builder.sample(shadowAtlas, TargetBufferFlags::DEPTH);
+                }
+                if (shadowMoments.isValid()) {
+                    data.shadowMoments = builder.sample(shadowMoments);
+                }
+                // with post-processing, the scene is rendered into a target of its own
+                data.color = builder.write(!hasPostProcess ? output :
+                        builder.create("Color Buffer", {
+                                .width = svp.width, .height = svp.height,
+                                .samples = useMSAA, .format = hdrFormat,
+                                .attachments = TargetBufferFlags::COLOR_AND_DEPTH }));
+            },
+            [&](FrameGraphPassResources const& resources, ColorPassData const& data,
+                    DriverApi& driver) {
+                FrameGraphPassResources::RenderTarget const color = resources.get(data.color);
+                // the read-back pass already keeps the frame graph from discarding the depth,
+                // this makes sure that the color pass ends without discarding it either
+                const TargetBufferFlags discardEnd = readOcclusionDepth ?
+                        TargetBufferFlags(color.discardEnd & ~TargetBufferFlags::DEPTH) :
+                        color.discardEnd;
+                mFrameInfoManager.beginGpuLap(driver, FrameInfo::GPU_COLOR_PASS);
+                recordHighWatermark(ColorPass::renderColorPass(engine, js, jobFroxelize,
+                        color.target, color.discardStart, discardEnd,
+                        inPlaceToneMappingProgram, transparencyResolveProgram, view, svp,
+                        mCommandChunks, commands));
+                mFrameInfoManager.endGpuLap(driver);
+                if (hasPostProcess) {
+                    // ends after the frame graph is executed
+                    mFrameInfoManager.beginGpuLap(driver, FrameInfo::GPU_POST_PROCESS);
+                }
+            });
+
+    /*
+     * Occlusion culling read-back
+     */
+
+    struct OcclusionPassData {
+        FrameGraphResource depth;
+    };
+
+    if (readOcclusionDepth) {
+        // reading the depth here keeps the frame graph from discarding it
+        fg.addPass<OcclusionPassData>("Occlusion Depth Read-back",
+                [&](FrameGraph::Builder& builder, OcclusionPassData& data) {
+                    data.depth = builder.read(colorPass.getData().color, TargetBufferFlags::DEPTH);
+                    builder.sideEffect();
+                },
+                [&](FrameGraphPassResources const& resources, OcclusionPassData const& data,
+                        DriverApi& driver) {
+                    view->readOcclusionDepth(driver, resources.get(data.depth).target, svp);
+                });
+    }
 
     /*
      * Post Processing...
      */
 
     if (UTILS_LIKELY(hasPostProcess)) {
-        driver.pushGroupMarker("Post Processing");
-
         ppm.start();
 
-        if (useMSAA > 1) {
+        if (autoExposure) {
+            // the exposure of this frame is ready before the tone mapping passes
+            ppm.autoExposure(fg, colorPass.getData().color, svp, view->getAutoExposure());
+        }
+
+        if (useMSAA > 1 && !mIsImplicitResolveSupported) {
             // Note: MSAA, when used is applied before tone-mapping (which is not ideal)
             // (tone mapping currently only works without multi-sampling)
-            // this blit does a MSAA resolve
+            // this blit does a MSAA resolve, otherwise the color pass resolves into its texture
             ppm.blit(hdrFormat);
         }
 
-        const bool translucent = mSwapChain->isTransparent();
-        Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
-                translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
-                            : PostProcessStage::TONE_MAPPING_OPAQUE);
-        ppm.pass(useFXAA ? TextureFormat::RGBA8 : ldrFormat, toneMappingProgram);
-
-        if (useFXAA) {
+        // FXAA tone maps its taps when the color pass didn't, and samples its input with
+        // bilinear filtering, so a single pass takes the color buffer to the (upscaled) output
+        if (UTILS_UNLIKELY(visualize)) {
+            ppm.setHeatmapRange(engine.getDebugVisualizationRange(visualization));
+            ppm.pass(ldrFormat, engine.getPostProcessProgram(PostProcessStage::DEBUG_HEATMAP));
+        } else if (toneMapInPlace) {
             Handle<HwProgram> antiAliasingProgram = engine.getPostProcessProgram(
                     translucent ? PostProcessStage::ANTI_ALIASING_TRANSLUCENT
                                 : PostProcessStage::ANTI_ALIASING_OPAQUE);
             ppm.pass(ldrFormat, antiAliasingProgram);
+        } else if (useFXAA) {
+            Handle<HwProgram> postProcessProgram = engine.getPostProcessProgram(
+                    translucent ? PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT
+                                : PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE);
+            ppm.pass(ldrFormat, postProcessProgram);
+        } else {
+            Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
+                    translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
+                                : PostProcessStage::TONE_MAPPING_OPAQUE);
+            ppm.pass(ldrFormat, toneMappingProgram);
         }
 
         if (scaled) {
-            // because it's the last command, the TextureFormat is not relevant
-            ppm.blit();
+            if (view->hasTemporalUpsampling()) {
+                // this keeps its output for the next frame, which we copy into the view's target
+                ppm.temporalUpsampling(
+                        engine.getPostProcessProgram(PostProcessStage::TEMPORAL_UPSAMPLING),
+                        view->getTemporalUpsampling());
+                // because it's the last command, the TextureFormat is not relevant
+                ppm.blit();
+            } else if (!useFXAA) {
+                // the tone mapping fetches the texels of its input, it can't upscale
+                ppm.blit();
+            }
         }
-        ppm.finish(view->getDiscardedTargetBuffers(), viewRenderTarget, vp, colorTarget, svp);
-
-        driver.popGroupMarker();
+        ppm.finish(fg, colorPass.getData().color, svp, output, vp);
     }
 
-    // for debugging
-    recordHighWatermark(commands);
+    fg.execute(driver);
+    mFrameInfoManager.endGpuLap(driver);
 }
 
 void FRenderer::mirrorFrame(FSwapChain* dstSwapChain, Viewport const& dstViewport, Viewport const& srcViewport,
@@ -275,6 +688,9 @@ bool FRenderer::beginFrame(FSwapChain* swapChain) {
 
     assert(swapChain);
 
+    // this may wait until it's time to start the frame, so do it before anything is timed
+    const FramePacer::time_point presentationTime = mFramePacer.beginFrame(getLastGpuTime());
+
     mFrameId++;
     if (UTILS_HAS_THREADING) {
         mFrameInfoManager.beginFrame(mFrameId);
@@ -289,6 +705,10 @@ bool FRenderer::beginFrame(FSwapChain* swapChain) {
     FEngine& engine = getEngine();
     FEngine::DriverApi& driver = engine.getDriverApi();
 
+    // we're between frames, this is where the command buffers can grow
+    engine.updateCommandBufferSize();
+    updateCommandsCapacity();
+
     // NOTE: this makes synchronous calls to the driver
     driver.updateStreams(&driver);
 
@@ -297,15 +717,24 @@ bool FRenderer::beginFrame(FSwapChain* swapChain) {
 
     uint64_t monotonic_clock_ns (std::chrono::steady_clock::now().time_since_epoch().count());
     driver.beginFrame(monotonic_clock_ns, mFrameId);
-    driver.setPresentationTime(monotonic_clock_ns);
+    driver.setPresentationTime(uint64_t(presentationTime.time_since_epoch().count()));
+
+    // when pacing just in time, waiting a little for the GPU beats skipping a whole refresh
+    const uint64_t timeout = !mFramePacer.isJustInTime() ? 0 : uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    mFramePacer.getRefreshPeriod()).count());
 
-    if (mFrameSkipper.skipFrameNeeded()) {
+    if (mFrameSkipper.skipFrameNeeded(timeout)) {
+        mFramePacer.skipFrame();
         mFrameInfoManager.cancelFrame();
         driver.endFrame(mFrameId);
+    engine.recordEndFrame();
         engine.flush();
         return false;
     }
 
+    mFrameInfoManager.beginGpuFrame(driver, mFrameId);
+
     // ask the engine to do what it needs to (e.g. updates light buffer, materials...)
     engine.prepare();
 
@@ -333,6 +762,18 @@ void FRenderer::endFrame() {
 
     driver.endFrame(mFrameId);
 
+    CpuStageTimings& timings = engine.getCpuStageTimings();
+    timings.endFrame();
+    engine.getFrameCounters().endFrame();
+    mLastCpuFrameTimings = {
+            mFrameId,
+            timings.getLast(CpuStageTimings::PREPARE),
+            timings.getLast(CpuStageTimings::CULL),
+            timings.getLast(CpuStageTimings::FROXELIZE),
+            timings.getLast(CpuStageTimings::GENERATE),
+            timings.getLast(CpuStageTimings::SORT),
+            timings.getLast(CpuStageTimings::RECORD) };
+
     if (mSwapChain) {
         mSwapChain->commit(driver);
         mSwapChain = nullptr;
@@ -351,6 +792,8 @@ void FRenderer::endFrame() {
     // make sure we're done with the gcs
     js.wait(job);
 
+    mFramePacer.endFrame();
+
 
 #if EXTRA_TIMING_INFO
     if (UTILS_UNLIKELY(frameInfoManager.isLapRecordsEnabled())) {
@@ -366,6 +809,38 @@ void FRenderer::endFrame() {
 #endif
 }
 
+FrameInfo::duration FRenderer::getLastFrameTime() const noexcept {
+    // the GPU time is the most accurate, but not all backends can measure it
+    FrameInfoManager::GpuFrameInfo info;
+    if (mFrameInfoManager.getLastGpuFrameInfo(&info)) {
+        return info.total;
+    }
+    return mFrameInfoManager.getLastFrameTime();
+}
+
+FrameInfo::duration FRenderer::getLastGpuTime() const noexcept {
+    FrameInfoManager::GpuFrameInfo info;
+    if (mFrameInfoManager.getLastGpuFrameInfo(&info)) {
+        return info.total;
+    }
+    // the fence time spans the whole frame, remove the part the CPU is responsible for
+    FrameInfo::duration frameTime = mFrameInfoManager.getLastFrameTime();
+    return std::max(FrameInfo::duration{}, frameTime - mFramePacer.getCpuTime());
+}
+
+bool FRenderer::getLastGpuFrameTimings(GpuFrameTimings* timings) const noexcept {
+    FrameInfoManager::GpuFrameInfo info;
+    if (!mFrameInfoManager.getLastGpuFrameInfo(&info)) {
+        return false;
+    }
+    timings->frameId = info.frame;
+    timings->shadowPass = info.laps[FrameInfo::GPU_SHADOW_PASS].count();
+    timings->colorPass = info.laps[FrameInfo::GPU_COLOR_PASS].count();
+    timings->postProcess = info.laps[FrameInfo::GPU_POST_PROCESS].count();
+    timings->total = info.total.count();
+    return true;
+}
+
 void FRenderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) {
 
@@ -419,6 +894,10 @@ void Renderer::render(View const* view) {
     upcast(this)->render(upcast(view));
 }
 
+void Renderer::render(View const* const* views, size_t count) {
+    upcast(this)->render(views, count);
+}
+
 bool Renderer::beginFrame(SwapChain* swapChain) {
     return upcast(this)->beginFrame(upcast(swapChain));
 }
@@ -433,8 +912,32 @@ void Renderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, ui
     upcast(this)->readPixels(xoffset, yoffset, width, height, std::move(buffer));
 }
 
+void Renderer::setMaxFramesInFlight(size_t count) noexcept {
+    upcast(this)->setMaxFramesInFlight(count);
+}
+
+void Renderer::setPipelinedCulling(bool enabled) noexcept {
+    upcast(this)->setPipelinedCulling(enabled);
+}
+
+void Renderer::setFramePacingOptions(FramePacingOptions const& options) noexcept {
+    upcast(this)->setFramePacingOptions(options);
+}
+
+void Renderer::getFramePacingStats(FramePacingStats* stats) noexcept {
+    upcast(this)->getFramePacingStats(stats);
+}
+
 void Renderer::endFrame() {
     upcast(this)->endFrame();
 }
 
+bool Renderer::getLastGpuFrameTimings(GpuFrameTimings* timings) const noexcept {
+    return upcast(this)->getLastGpuFrameTimings(timings);
+}
+
+void Renderer::getLastCpuFrameTimings(CpuFrameTimings* timings) const noexcept {
+    upcast(this)->getLastCpuFrameTimings(timings);
+}
+
 } // namespace filament
@@ -23,14 +23,20 @@
 #include "details/Engine.h"
 #include "details/IndirectLight.h"
 #include "details/GpuLightBuffer.h"
+#include "details/ShadowAtlas.h"
 #include "details/Skybox.h"
 
+#include "driver/DriverApi.h"
+
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <limits>
 
 using namespace math;
 using namespace utils;
@@ -38,29 +44,132 @@ using namespace utils;
 namespace filament {
 namespace details {
 
+static inline bool isStaticCaster(FRenderableManager::Visibility v) noexcept {
+    return v.castShadows & v.staticGeometry;
+}
+
+// Transforms, in place, the object-space boxes of the given rows to world space. The rows are
+// processed 4 at a time so the independent matrix products of a group can be interleaved.
+template<typename ROW>
+static void transformBoxes(mat4f const* UTILS_RESTRICT transforms,
+        float3* UTILS_RESTRICT centers, float3* UTILS_RESTRICT extents,
+        size_t count, ROW row) noexcept {
+    auto transform = [=](size_t i) {
+        mat4f const& m = transforms[i];
+        const float4 center = m * float4{ centers[i], 1.0f };
+        const float4 halfExtent = abs(m) * float4{ extents[i], 0.0f };
+        centers[i] = center.xyz;
+        extents[i] = halfExtent.xyz;
+    };
+    size_t i = 0;
+    for (const size_t c = count & ~size_t(3); i < c; i += 4) {
+        transform(row(i + 0));
+        transform(row(i + 1));
+        transform(row(i + 2));
+        transform(row(i + 3));
+    }
+    for (; i < count; i++) {
+        transform(row(i));
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 
 FScene::FScene(FEngine& engine) :
         mEngine(engine),
         mIndirectLight(engine.getDefaultIndirectLight()),
-        mGpuLightData(engine) {
+        mGpuLightData(engine),
+        mRenderableUniforms(engine.getPerRenderableUib().getSize(),
+                engine.getDriverApi().getUniformBufferOffsetAlignment()) {
 }
 
 FScene::~FScene() noexcept = default;
 
 
-void FScene::prepare(const math::mat4f& worldOriginTansform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+// The world transform of a transform component, relative to the world origin. With accurate
+// translations it's composed in double precision, so that it stays precise near the origin however
+// far the component is from the root of the world.
+static inline mat4f getWorldTransform(FTransformManager const& tcm, FTransformManager::Instance ti,
+        mat4 const& worldOriginTansform, mat4f const& worldOrigin) noexcept {
+    return UTILS_UNLIKELY(tcm.isAccurateTranslationsEnabled()) ?
+           mat4f(worldOriginTansform * tcm.getWorldTransformAccurate(ti)) :
+           worldOrigin * tcm.getWorldTransform(ti);
+}
+
+void FScene::prepare(const math::mat4& worldOriginTansform, size_t snapshotCount) {
+    assert(snapshotCount >= 1 && snapshotCount <= SNAPSHOT_COUNT);
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+
+    // We rely on the instances stored in our SoAs staying valid, which is the case as long as
+    // the set of entities and the component managers' layouts don't change.
+    const bool rebuild = mEntitiesDirty ||
+            mRenderableLayoutGeneration != rcm.getLayoutGeneration() ||
+            mTransformLayoutGeneration != tcm.getLayoutGeneration() ||
+            mLightLayoutGeneration != lcm.getLayoutGeneration() ||
+            !isSameTransform(mWorldOriginTransform, worldOriginTansform);
+
+    if (rebuild || !updateRenderables(worldOriginTansform)) {
+        gatherEntities(worldOriginTansform);
+        mEntitiesDirty = false;
+        mRenderableLayoutGeneration = rcm.getLayoutGeneration();
+        mTransformLayoutGeneration = tcm.getLayoutGeneration();
+        mLightLayoutGeneration = lcm.getLayoutGeneration();
+        mWorldOriginTransform = worldOriginTansform;
+    }
+    mRenderableGeneration = rcm.getGeneration();
+    mTransformGeneration = tcm.getGeneration();
+
+    // the renderable data is reordered by each View, so we need to find where each BVH slot is now
+    RenderableSoa const& renderableData = mRenderableData[0];
+    if (!mBvh.empty()) {
+        uint32_t const* const UTILS_RESTRICT slots = renderableData.data<BVH_SLOT>();
+        uint32_t* const UTILS_RESTRICT rows = mBvhRows.data();
+        for (uint32_t i = 0, c = uint32_t(renderableData.size()); i < c; i++) {
+            rows[slots[i]] = i;
+        }
+    }
+
+    // the light data is modified by each View (sorted and trimmed), so we always regenerate it
+    // from our list of lights, which is cheap compared to walking all the entities.
+    prepareLights(worldOriginTansform);
+
+    // The other snapshots are copies, in the same order, so mBvhRows and the light BVH are
+    // valid for them too. They keep the capacity of the first one, padded for the SIMD loops.
+    LightSoa const& lightData = mLightData[0];
+    for (size_t i = 1; i < snapshotCount; i++) {
+        RenderableSoa& renderableCopy = mRenderableData[i];
+        renderableCopy.clear();
+        if (renderableCopy.capacity() < renderableData.capacity()) {
+            renderableCopy.setCapacity(renderableData.capacity());
+        }
+        renderableCopy.assign(renderableData);
+
+        LightSoa& lightCopy = mLightData[i];
+        lightCopy.clear();
+        if (lightCopy.capacity() < lightData.capacity()) {
+            lightCopy.setCapacity(lightData.capacity());
+        }
+        lightCopy.assign(lightData);
+    }
+}
+
+void FScene::gatherEntities(const math::mat4& worldOriginTansform) {
+    SYSTRACE_CALL();
+
+    mGatherCount++;
 
     FEngine& engine = mEngine;
     EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     FTransformManager& tcm = engine.getTransformManager();
+    const mat4f worldOrigin(worldOriginTansform);
     FLightManager& lcm = engine.getLightManager();
     // go through the list of entities, and gather the data of those that are renderables
-    auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
+    auto& sceneData = mRenderableData[0];
+    auto& lights = mLights;
     auto const& entities = mEntities;
 
 
@@ -79,16 +188,12 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
         sceneData.setCapacity(capacity);
     }
 
-    lightData.clear();
-    if (lightData.capacity() < capacity) {
-        lightData.setCapacity(capacity);
-    }
-    // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
+    lights.clear();
+    mSlotEntities.clear();
 
-
-    // find the max intensity directional light index in our local array
-    float maxIntensity = 0;
+    // we don't know what changed, assume the static casters did
+    mStaticCastersGeneration++;
+    size_t staticCasterCount = 0;
 
     for (Entity e : entities) {
         if (!em.isAlive(e))
@@ -103,51 +208,382 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
 
         // get the world transform
         auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTansform * tcm.getWorldTransform(ti);
+        const mat4f worldTransform = getWorldTransform(tcm, ti, worldOriginTansform, worldOrigin);
 
         // don't even draw this object if it doesn't have a transform (which shouldn't happen
         // because one is always created when creating a Renderable component).
         if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
+            // the object-space AABB is transformed to world space below, for all rows at once
+            const Box aabb = rcm.getAABB(ri);
+
+            staticCasterCount += isStaticCaster(rcm.getVisibility(ri));
 
             // we know there is enough space in the array
             sceneData.push_back_unsafe(
                     ri,
                     worldTransform,
                     rcm.getVisibility(ri),
-                    rcm.getUbh(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
+                    0,
+                    rcm.getBonesOffset(ri),
+                    rcm.getTextureLayer(ri),
+                    rcm.getMorphWeights(ri),
+                    rcm.getSkinningFlags(ri),
+                    rcm.getSortKey(ri),
+                    aabb.center,
                     0,
                     rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
+                    aabb.halfExtent,
+                    {}, {},
+                    ti,
+                    uint32_t(sceneData.size()));
+            mSlotEntities.push_back(e);
         }
 
         if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {});
+            lights.push_back({ e, li, ti });
+        }
+    }
+
+    mStaticCasterCount = staticCasterCount;
+
+    // compute the world AABBs so we can perform culling
+    transformBoxes(sceneData.data<WORLD_TRANSFORM>(),
+            sceneData.data<WORLD_AABB_CENTER>(), sceneData.data<WORLD_AABB_EXTENT>(),
+            sceneData.size(), [](size_t i) { return i; });
+
+    if (sceneData.size() >= BVH_CULLING_MIN_RENDERABLE_COUNT) {
+        mBvh.build(sceneData.data<WORLD_AABB_CENTER>(), sceneData.data<WORLD_AABB_EXTENT>(),
+                sceneData.size());
+        mBvhRows.resize(sceneData.size());
+    } else {
+        mBvh.clear();
+        mBvhRows.clear();
+    }
+}
+
+bool FScene::updateRenderables(const math::mat4& worldOriginTansform) {
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    const mat4f worldOrigin(worldOriginTansform);
+
+    const uint32_t renderableGeneration = mRenderableGeneration;
+    const uint32_t transformGeneration = mTransformGeneration;
+    if (renderableGeneration == rcm.getGeneration() &&
+        transformGeneration == tcm.getGeneration()) {
+        // nothing changed since the last time we were called
+        return true;
+    }
+
+    if (UTILS_UNLIKELY(renderableGeneration > rcm.getGeneration() ||
+                       transformGeneration > tcm.getGeneration())) {
+        // the generation counters wrapped around, we can't trust them anymore
+        return false;
+    }
+
+    SYSTRACE_CALL();
+
+    EntityManager& em = engine.getEntityManager();
+    Bvh& bvh = mBvh;
+    const bool hasBvh = !bvh.empty();
+    auto& sceneData = mRenderableData[0];
+    auto* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+    auto* const UTILS_RESTRICT transformInstances = sceneData.data<TRANSFORM_INSTANCE>();
+    auto& dirtyRows = mDirtyRows;
+    dirtyRows.clear();
+    bool staticCastersDirty = false;
+    for (size_t i = 0, c = sceneData.size(); i < c; i++) {
+        auto ri = instances[i];
+        auto ti = transformInstances[i];
+        const bool renderableDirty = rcm.getGeneration(ri) > renderableGeneration;
+        const bool transformDirty = tcm.getGeneration(ti) > transformGeneration;
+        if (!renderableDirty && !transformDirty) {
+            continue;
+        }
+
+        // entities can be destroyed without being removed from the scene, in which case their
+        // components stay around until they're garbage collected.
+        if (UTILS_UNLIKELY(!em.isAlive(rcm.getEntity(ri)))) {
+            return false;
+        }
+
+        if (transformDirty) {
+            sceneData.elementAt<WORLD_TRANSFORM>(i) =
+                    getWorldTransform(tcm, ti, worldOriginTansform, worldOrigin);
+        }
+
+        const FRenderableManager::Visibility visibility = rcm.getVisibility(ri);
+        const bool wasStaticCaster = isStaticCaster(sceneData.elementAt<VISIBILITY_STATE>(i));
+        if (wasStaticCaster || isStaticCaster(visibility)) {
+            staticCastersDirty = true;
+            mStaticCasterCount += isStaticCaster(visibility);
+            mStaticCasterCount -= wasStaticCaster;
+        }
+
+        if (renderableDirty) {
+            sceneData.elementAt<VISIBILITY_STATE>(i) = visibility;
+            sceneData.elementAt<BONES_OFFSET>(i)     = rcm.getBonesOffset(ri);
+            sceneData.elementAt<TEXTURE_LAYER>(i)    = rcm.getTextureLayer(ri);
+            sceneData.elementAt<MORPH_WEIGHTS>(i)    = rcm.getMorphWeights(ri);
+            sceneData.elementAt<SKINNING_FLAGS>(i)   = rcm.getSkinningFlags(ri);
+            sceneData.elementAt<SORT_KEY>(i)         = rcm.getSortKey(ri);
+            sceneData.elementAt<LAYERS>(i)           = rcm.getLayerMask(ri);
+        }
+
+        const Box aabb = rcm.getAABB(ri);
+        sceneData.elementAt<WORLD_AABB_CENTER>(i) = aabb.center;
+        sceneData.elementAt<WORLD_AABB_EXTENT>(i) = aabb.halfExtent;
+        dirtyRows.push_back(uint32_t(i));
+    }
+
+    // transform the dirty boxes in one batch, then update their BVH leaves
+    uint32_t const* const UTILS_RESTRICT rows = dirtyRows.data();
+    float3 const* const UTILS_RESTRICT centers = sceneData.data<WORLD_AABB_CENTER>();
+    float3 const* const UTILS_RESTRICT extents = sceneData.data<WORLD_AABB_EXTENT>();
+    transformBoxes(sceneData.data<WORLD_TRANSFORM>(),
+            sceneData.data<WORLD_AABB_CENTER>(), sceneData.data<WORLD_AABB_EXTENT>(),
+            dirtyRows.size(), [rows](size_t i) { return rows[i]; });
+    if (hasBvh) {
+        uint32_t const* const UTILS_RESTRICT slots = sceneData.data<BVH_SLOT>();
+        for (uint32_t i : dirtyRows) {
+            bvh.update(slots[i], centers[i], extents[i]);
+        }
+    }
+    bvh.refit();
+    mStaticCastersGeneration += staticCastersDirty;
+    return true;
+}
+
+bool FScene::cullRenderables(size_t snapshot, Frustum const& frustum, size_t bit) noexcept {
+    if (mBvh.empty()) {
+        return false;
+    }
+    SYSTRACE_CALL();
+    uint32_t const* const UTILS_RESTRICT rows = mBvhRows.data();
+    Culler::result_type* const UTILS_RESTRICT visibleArray =
+            getRenderableData(snapshot).data<VISIBLE_MASK>();
+    const Culler::result_type mask = Culler::result_type(1u << bit);
+    mBvh.cull(frustum, [rows, visibleArray, mask](uint32_t slot) {
+        visibleArray[rows[slot]] |= mask;
+    });
+    return true;
+}
+
+// The spatial queries are in world space, the renderables' world AABBs are transformed by the
+// world origin of the last prepare(). It's a rigid transform, so the distances along the rays
+// don't change.
+
+// same slab test as Bvh::raycast(), returns INFINITY if the box isn't entered before 'far'
+static inline float intersectBox(float3 const& origin, float3 const& invDirection,
+        float3 const& center, float3 const& extent, float far) noexcept {
+    const float3 t0 = (center - extent - origin) * invDirection;
+    const float3 t1 = (center + extent - origin) * invDirection;
+    const float3 tmin = min(t0, t1);
+    const float3 tmax = max(t0, t1);
+    const float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    const float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, far));
+    return enter <= exit ? enter : INFINITY;
+}
+
+// same convention as Bvh::cull()
+static inline bool intersectsFrustum(float4 const* planes,
+        float3 const& center, float3 const& extent) noexcept {
+    for (size_t j = 0; j < 6; j++) {
+        const float d = dot(planes[j].xyz, center) + planes[j].w;
+        const float r = dot(abs(planes[j].xyz), extent);
+        if (d - r >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Scene::RaycastHit FScene::raycast(float3 const& origin, float3 const& direction,
+        float maxDistance) const noexcept {
+    RaycastHit hit;
+    raycast(&origin, &direction, 1, maxDistance, &hit);
+    return hit;
+}
+
+void FScene::raycast(float3 const* origins, float3 const* directions, size_t count,
+        float maxDistance, RaycastHit* hits) const noexcept {
+    SYSTRACE_CALL();
+
+    mat4 const& worldOrigin = mWorldOriginTransform;
+    auto cast = [this, &worldOrigin, origins, directions, maxDistance, hits]
+            (uint32_t first, uint32_t c) {
+        for (uint32_t i = first, e = first + c; i < e; i++) {
+            const float3 origin{ (worldOrigin * double4{ origins[i], 1.0 }).xyz };
+            const float3 direction{ (worldOrigin * double4{ directions[i], 0.0 }).xyz };
+            hits[i] = raycastRenderables(origin, 1.0f / direction, maxDistance);
+        }
+    };
+
+    if (count > RAYCAST_MIN_JOB_SIZE) {
+        JobSystem& js = mEngine.getJobSystem();
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+                std::cref(cast), jobs::CountSplitter<RAYCAST_MIN_JOB_SIZE, 8>());
+        js.runAndWait(job);
+    } else {
+        cast(0, uint32_t(count));
+    }
+}
+
+Scene::RaycastHit FScene::raycastRenderables(float3 const& origin, float3 const& invDirection,
+        float maxDistance) const noexcept {
+    RaycastHit hit;
+    float far = maxDistance;
+    auto visit = [this, &hit, &far](uint32_t slot, float distance) {
+        if (distance < far || !hit.renderable) {
+            hit = { mSlotEntities[slot], distance };
+            far = distance;
+        }
+        return far;
+    };
+
+    if (!mBvh.empty()) {
+        mBvh.raycast(origin, invDirection, far, visit);
+        return hit;
+    }
+
+    RenderableSoa const& soa = mRenderableData[0];
+    float3 const* const UTILS_RESTRICT centers = soa.data<WORLD_AABB_CENTER>();
+    float3 const* const UTILS_RESTRICT extents = soa.data<WORLD_AABB_EXTENT>();
+    uint32_t const* const UTILS_RESTRICT slots = soa.data<BVH_SLOT>();
+    for (size_t i = 0, c = soa.size(); i < c; i++) {
+        const float t = intersectBox(origin, invDirection, centers[i], extents[i], far);
+        if (t != INFINITY) {
+            visit(slots[i], t);
+        }
+    }
+    return hit;
+}
+
+size_t FScene::queryBox(Box const& box, Entity* entities, size_t capacity) const noexcept {
+    SYSTRACE_CALL();
+
+    mat4 const& worldOrigin = mWorldOriginTransform;
+    const float3 center{ (worldOrigin * double4{ box.center, 1.0 }).xyz };
+    const float3 extent{ (abs(worldOrigin) * double4{ box.halfExtent, 0.0 }).xyz };
+
+    size_t count = 0;
+    auto found = [this, entities, capacity, &count](uint32_t slot) {
+        if (count < capacity) {
+            entities[count] = mSlotEntities[slot];
+        }
+        count++;
+    };
+
+    if (!mBvh.empty()) {
+        mBvh.query(center - extent, center + extent, found);
+        return count;
+    }
+
+    RenderableSoa const& soa = mRenderableData[0];
+    float3 const* const UTILS_RESTRICT centers = soa.data<WORLD_AABB_CENTER>();
+    float3 const* const UTILS_RESTRICT extents = soa.data<WORLD_AABB_EXTENT>();
+    uint32_t const* const UTILS_RESTRICT slots = soa.data<BVH_SLOT>();
+    for (size_t i = 0, c = soa.size(); i < c; i++) {
+        if (all(lessThanEqual(abs(centers[i] - center), extents[i] + extent))) {
+            found(slots[i]);
+        }
+    }
+    return count;
+}
+
+size_t FScene::queryFrustum(Frustum const& frustum, Entity* entities,
+        size_t capacity) const noexcept {
+    SYSTRACE_CALL();
+
+    // the planes are transformed by the inverse transpose of the world origin
+    const mat4 planesTransform = transpose(inverse(mWorldOriginTransform));
+    float4 planes[6];
+    for (size_t j = 0; j < 6; j++) {
+        planes[j] = float4{ planesTransform * double4{ frustum.getNormalizedPlanes()[j] } };
+    }
+
+    size_t count = 0;
+    auto found = [this, entities, capacity, &count](uint32_t slot) {
+        if (count < capacity) {
+            entities[count] = mSlotEntities[slot];
+        }
+        count++;
+    };
+
+    if (!mBvh.empty()) {
+        mBvh.cull(planes, found);
+        return count;
+    }
+
+    RenderableSoa const& soa = mRenderableData[0];
+    float3 const* const UTILS_RESTRICT centers = soa.data<WORLD_AABB_CENTER>();
+    float3 const* const UTILS_RESTRICT extents = soa.data<WORLD_AABB_EXTENT>();
+    uint32_t const* const UTILS_RESTRICT slots = soa.data<BVH_SLOT>();
+    for (size_t i = 0, c = soa.size(); i < c; i++) {
+        if (intersectsFrustum(planes, centers[i], extents[i])) {
+            found(slots[i]);
+        }
+    }
+    return count;
+}
+
+void FScene::prepareLights(const math::mat4& worldOriginTansform) {
+    FEngine& engine = mEngine;
+    EntityManager& em = engine.getEntityManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    const mat4f worldOrigin(worldOriginTansform);
+    FLightManager& lcm = engine.getLightManager();
+    auto& lightData = mLightData[0];
+    auto const& lights = mLights;
+
+    size_t capacity = lights.size() + DIRECTIONAL_LIGHTS_COUNT;
+    // we need the capacity to be multiple of 16 for SIMD loops
+    capacity = (capacity + 0xF) & ~0xF;
+
+    lightData.clear();
+    if (lightData.capacity() < capacity) {
+        lightData.setCapacity(capacity);
+    }
+    // the first entries are reserved for the directional lights (currently only one)
+    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
+
+
+    // find the max intensity directional light index in our local array
+    float maxIntensity = 0;
+
+    for (LightEntry const& entry : lights) {
+        if (!em.isAlive(entry.entity))
+            continue;
+
+        auto li = entry.light;
+        const mat4f worldTransform =
+                getWorldTransform(tcm, entry.transform, worldOriginTansform, worldOrigin);
+
+        // find the dominant directional light
+        if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+            // we don't store the directional lights, because we only have a single one
+            if (lcm.getIntensity(li) >= maxIntensity) {
+                float3 d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+                lightData.elementAt<FScene::BOUNDING_SPHERE>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+                lightData.elementAt<FScene::DIRECTION>(0)       = d;
+                lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
+            }
+        } else {
+            const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
+            float3 d = 0;
+            if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+                d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
             }
+            // the spot lights are culled with the bounding sphere of their cone
+            const float radius = lcm.getRadius(li);
+            const float2 bounds = lcm.getSpotParams(li).coneBounds * radius;
+            lightData.push_back_unsafe(
+                    float4{ p.xyz, radius }, d, li, {}, {}, float4{ p.xyz + d * bounds.x, bounds.y });
         }
     }
 
@@ -156,27 +592,143 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
     // (e.g. in computeLightRanges())
     for (size_t i = lightData.size(), e = (lightData.size() + 3) & ~3; i < e; i++) {
         new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+        new(lightData.data<BOUNDING_SPHERE>() + i) float4{ 0, 0, 0, 1 };
+    }
+
+    updateLightBvh();
+}
+
+void FScene::updateLightBvh() {
+    auto const& lightData = mLightData[0];
+    const size_t count = lightData.size() - DIRECTIONAL_LIGHTS_COUNT;
+    if (count < BVH_CULLING_MIN_LIGHT_COUNT) {
+        mLightBvh.clear();
+        mLightBvhSpheres.clear();
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    float4 const* const UTILS_RESTRICT spheres =
+            lightData.data<BOUNDING_SPHERE>() + DIRECTIONAL_LIGHTS_COUNT;
+
+    // the hierarchy is rebuilt when lights are added or removed, and refit when they move
+    if (mLightBvh.size() != count) {
+        std::vector<float3> centers(count);
+        std::vector<float3> extents(count);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = spheres[i].xyz;
+            extents[i] = spheres[i].w;
+        }
+        mLightBvh.build(centers.data(), extents.data(), count);
+        mLightBvhSpheres.assign(spheres, spheres + count);
+        return;
+    }
+
+    float4* const UTILS_RESTRICT previous = mLightBvhSpheres.data();
+    for (uint32_t i = 0; i < count; i++) {
+        if (any(notEqual(previous[i], spheres[i]))) {
+            previous[i] = spheres[i];
+            mLightBvh.update(i, spheres[i].xyz, float3(spheres[i].w));
+        }
+    }
+    mLightBvh.refit();
+}
+
+bool FScene::cullLights(size_t snapshot, Frustum const& frustum) noexcept {
+    if (mLightBvh.empty()) {
+        return false;
+    }
+    SYSTRACE_CALL();
+    auto& lightData = getLightData(snapshot);
+    Culler::result_type* const UTILS_RESTRICT visibleArray = lightData.data<VISIBILITY>();
+    std::fill_n(visibleArray, lightData.size(), 0);
+    // the directional light is always visible
+    std::fill_n(visibleArray, DIRECTIONAL_LIGHTS_COUNT, 1);
+    mLightBvh.cull(frustum, [visibleArray](uint32_t slot) {
+        visibleArray[slot + DIRECTIONAL_LIGHTS_COUNT] = 1;
+    });
+    return true;
+}
+
+bool FScene::isSameTransform(math::mat4 const& lhs, math::mat4 const& rhs) noexcept {
+    for (size_t i = 0; i < 4; i++) {
+        if (any(notEqual(lhs[i], rhs[i]))) {
+            return false;
+        }
     }
+    return true;
 }
 
-void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept {
-    FRenderableManager& rcm = mEngine.getRenderableManager();
-    auto& sceneData = mRenderableData;
+void FScene::updateUBOs(size_t snapshot, utils::Range<uint32_t> visibleRenderables) noexcept {
+    SYSTRACE_CALL();
+
+    UniformRing& ring = mRenderableUniforms;
+    auto& sceneData = getRenderableData(snapshot);
+    mat4f const* const UTILS_RESTRICT worldTransforms = sceneData.data<WORLD_TRANSFORM>();
+    uint32_t const* const UTILS_RESTRICT textureLayers = sceneData.data<TEXTURE_LAYER>();
+    float4 const* const UTILS_RESTRICT morphWeights = sceneData.data<MORPH_WEIGHTS>();
+    uint8_t const* const UTILS_RESTRICT skinningFlags = sceneData.data<SKINNING_FLAGS>();
+    uint32_t* const UTILS_RESTRICT offsets = sceneData.data<UNIFORMS_OFFSET>();
+
+    // The uniforms only depend on the renderables' data and order, they're not uploaded again
+    // when neither changed, so that the commands referring to them can be replayed as is
+    // (see RenderPass::CommandCache).
+    auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+    bool unchanged = mUniformsGatherCount == mGatherCount &&
+            mUniformsRenderableGeneration == mRenderableGeneration &&
+            mUniformsTransformGeneration == mTransformGeneration &&
+            mUniformsInstances.size() == visibleRenderables.size();
+    mUniformsInstances.resize(visibleRenderables.size());
     for (uint32_t i : visibleRenderables) {
-        auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(i);
-        rcm.updateLocalUBO(ri, sceneData.elementAt<WORLD_TRANSFORM>(i));
+        auto& instance = mUniformsInstances[i - visibleRenderables.first];
+        unchanged = unchanged && instance == instances[i];
+        instance = instances[i];
     }
+    mUniformsGatherCount = mGatherCount;
+    mUniformsRenderableGeneration = mRenderableGeneration;
+    mUniformsTransformGeneration = mTransformGeneration;
+    if (unchanged && ring.getUbh()) {
+        for (uint32_t i : visibleRenderables) {
+            offsets[i] = uint32_t(ring.getOffset(i - visibleRenderables.first));
+        }
+        return;
+    }
+
+    // visible renderables are packed in their order in the snapshot
+    UniformBuffer& uniforms = ring.allocate(visibleRenderables.size());
+    for (uint32_t i : visibleRenderables) {
+        const size_t offset = ring.getOffset(i - visibleRenderables.first);
+        // The transforms are affine, only their first 3 rows are uploaded. The shaders derive
+        // the normal matrix from them, see getWorldFromModelNormalMatrix().
+        const mat4f model = transpose(worldTransforms[i]);
+        uniforms.setUniformArray(offset + offsetof(FEngine::PerRenderableUib, worldFromModelRows),
+                &model[0], 3);
+
+        uniforms.setUniform(offset + offsetof(FEngine::PerRenderableUib, morphWeights),
+                morphWeights[i]);
+        uniforms.setUniform(offset + offsetof(FEngine::PerRenderableUib, textureLayer),
+                textureLayers[i]);
+        uniforms.setUniform(offset + offsetof(FEngine::PerRenderableUib, flags),
+                uint32_t(skinningFlags[i]));
+
+        offsets[i] = uint32_t(offset);
+    }
+    mEngine.getFrameCounters().add(FrameCounters::UNIFORM_BYTES, uniforms.getSize());
+    ring.commit(mEngine.getDriverApi());
 }
 
 void FScene::terminate(FEngine& engine) {
     // free-up the lights buffer
     mGpuLightData.terminate(engine);
+    mRenderableUniforms.terminate(engine.getDriverApi());
 }
 
-void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena) noexcept {
+void FScene::prepareDynamicLights(size_t snapshot, const CameraInfo& camera,
+        ArenaScope& rootArena, ShadowAtlas const& shadowAtlas) noexcept {
     FLightManager& lcm = mEngine.getLightManager();
     GpuLightBuffer& gpuLightData = mGpuLightData;
-    FScene::LightSoa& lightData = getLightData();
+    FScene::LightSoa& lightData = getLightData(snapshot);
 
     /*
      * Here we copy our lights data into the GPU buffer, some lights might be left out if there
@@ -206,21 +758,25 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
 
     // compute the light ranges (needed when building light trees)
     float2* const zrange = lightData.data<FScene::SCREEN_SPACE_Z_RANGE>();
-    computeLightRanges(zrange, camera, spheres + DIRECTIONAL_LIGHTS_COUNT, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
+    float4 const* const UTILS_RESTRICT bounds = lightData.data<FScene::BOUNDING_SPHERE>();
+    computeLightRanges(zrange, camera, bounds + DIRECTIONAL_LIGHTS_COUNT, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
 
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
         GpuLightBuffer::LightIndex gpuIndex = GpuLightBuffer::LightIndex(i - DIRECTIONAL_LIGHTS_COUNT);
-        GpuLightBuffer::LightParameters& lp = gpuLightData.getLightParameters(gpuIndex);
+        GpuLightBuffer::LightParameters lp = gpuLightData.getLightParameters(gpuIndex);
         auto li = instances[i];
         lp.positionFalloff      = { spheres[i].xyz, lcm.getSquaredFalloffInv(li) };
         lp.colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
         lp.directionIES         = { directions[i], 0 };
         lp.spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        lp.spotScaleOffset.z    = shadowAtlas.hasVisibleShadows() ?
+                float(shadowAtlas.getTileIndex(li) + 1) : 0.0f;
+        // lights that didn't move or change since the last frame are not uploaded again
+        gpuLightData.setLightParameters(gpuIndex, lp);
     }
 
-    gpuLightData.invalidate(0, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
     gpuLightData.commit(mEngine);
 }
 
@@ -278,10 +834,12 @@ void FScene::computeLightRanges(
 
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    mEntitiesDirty = true;
 }
 
 void FScene::remove(Entity entity) {
     mEntities.erase(entity);
+    mEntitiesDirty = true;
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -318,32 +876,65 @@ void FScene::setSkybox(FSkybox const* skybox) noexcept {
     }
 }
 
-void FScene::computeBounds(
+void FScene::computeBounds(size_t snapshot,
         Aabb& UTILS_RESTRICT castersBox,
         Aabb& UTILS_RESTRICT receiversBox,
         uint32_t visibleLayers) const noexcept {
+    SYSTRACE_CALL();
+
     using State = FRenderableManager::Visibility;
 
     // Compute the scene bounding volume
-    RenderableSoa const& UTILS_RESTRICT soa = mRenderableData;
+    RenderableSoa const& UTILS_RESTRICT soa = getRenderableData(snapshot);
     float3 const* const UTILS_RESTRICT worldAABBCenter = soa.data<WORLD_AABB_CENTER>();
     float3 const* const UTILS_RESTRICT worldAABBExtent = soa.data<WORLD_AABB_EXTENT>();
     uint8_t const* const UTILS_RESTRICT layers = soa.data<LAYERS>();
     State const* const UTILS_RESTRICT visibility = soa.data<VISIBILITY_STATE>();
-    size_t c = soa.size();
-    for (size_t i = 0; i < c; i++) {
-        if (layers[i] & visibleLayers) {
-            const Aabb aabb{ worldAABBCenter[i] - worldAABBExtent[i],
-                             worldAABBCenter[i] + worldAABBExtent[i] };
-            if (visibility[i].castShadows) {
-                castersBox.min = min(castersBox.min, aabb.min);
-                castersBox.max = max(castersBox.max, aabb.max);
-            }
-            if (visibility[i].receiveShadows) {
-                receiversBox.min = min(receiversBox.min, aabb.min);
-                receiversBox.max = max(receiversBox.max, aabb.max);
+    const uint32_t count = uint32_t(soa.size());
+
+    // each chunk reduces its range into its own pair of boxes, which are merged at the end
+    Aabb casters[BOUNDS_MAX_CHUNK_COUNT];
+    Aabb receivers[BOUNDS_MAX_CHUNK_COUNT];
+    const uint32_t chunkSize = std::max(BOUNDS_MIN_CHUNK_SIZE,
+            (count + BOUNDS_MAX_CHUNK_COUNT - 1) / BOUNDS_MAX_CHUNK_COUNT);
+    const uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+    auto reduce = [=, &casters, &receivers](uint32_t chunk, uint32_t c) {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        for (uint32_t k = chunk, e = chunk + c; k < e; k++) {
+            // this loop is branchless: the boxes that don't contribute are replaced by an
+            // empty box, so it can be vectorized.
+            Aabb caster, receiver;
+            for (uint32_t i = k * chunkSize, n = std::min(count, i + chunkSize); i < n; i++) {
+                const float3 lo = worldAABBCenter[i] - worldAABBExtent[i];
+                const float3 hi = worldAABBCenter[i] + worldAABBExtent[i];
+                const bool visible = (layers[i] & visibleLayers) != 0;
+                const bool casts = visible & visibility[i].castShadows;
+                const bool receives = visible & visibility[i].receiveShadows;
+                caster.min   = min(caster.min,   casts    ?  lo : float3{  inf });
+                caster.max   = max(caster.max,   casts    ?  hi : float3{ -inf });
+                receiver.min = min(receiver.min, receives ?  lo : float3{  inf });
+                receiver.max = max(receiver.max, receives ?  hi : float3{ -inf });
             }
+            casters[k] = caster;
+            receivers[k] = receiver;
         }
+    };
+
+    if (chunkCount > 1) {
+        JobSystem& js = mEngine.getJobSystem();
+        auto job = jobs::parallel_for(js, nullptr, 0, chunkCount,
+                std::cref(reduce), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+    } else {
+        reduce(0, chunkCount);
+    }
+
+    for (uint32_t k = 0; k < chunkCount; k++) {
+        castersBox.min = min(castersBox.min, casters[k].min);
+        castersBox.max = max(castersBox.max, casters[k].max);
+        receiversBox.min = min(receiversBox.min, receivers[k].min);
+        receiversBox.max = max(receiversBox.max, receivers[k].max);
     }
 }
 
@@ -379,4 +970,23 @@ size_t Scene::getLightCount() const noexcept {
     return upcast(this)->getLightCount();
 }
 
+Scene::RaycastHit Scene::raycast(math::float3 const& origin, math::float3 const& direction,
+        float maxDistance) const noexcept {
+    return upcast(this)->raycast(origin, direction, maxDistance);
+}
+
+void Scene::raycast(math::float3 const* origins, math::float3 const* directions, size_t count,
+        float maxDistance, RaycastHit* hits) const noexcept {
+    upcast(this)->raycast(origins, directions, count, maxDistance, hits);
+}
+
+size_t Scene::queryBox(Box const& box, Entity* entities, size_t capacity) const noexcept {
+    return upcast(this)->queryBox(box, entities, capacity);
+}
+
+size_t Scene::queryFrustum(Frustum const& frustum, Entity* entities,
+        size_t capacity) const noexcept {
+    return upcast(this)->queryFrustum(frustum, entities, capacity);
+}
+
 } // namespace filament
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowAtlas.h"
+
+#include "details/Engine.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <math.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace driver;
+
+namespace details {
+
+// near plane of the spot lights' shadow cameras, relative to their radius
+static constexpr float SPOT_SHADOW_NEAR_RATIO = 0.01f;
+
+// spreads the even bits of a Morton code into x, the odd ones into y
+static inline uint32_t mortonToCoordinate(uint32_t code) noexcept {
+    code &= 0x55555555u;
+    code = (code | (code >> 1u)) & 0x33333333u;
+    code = (code | (code >> 2u)) & 0x0F0F0F0Fu;
+    code = (code | (code >> 4u)) & 0x00FF00FFu;
+    code = (code | (code >> 8u)) & 0x0000FFFFu;
+    return code;
+}
+
+static inline uint32_t floorPowerOfTwo(uint32_t v) noexcept {
+    return v ? 1u << (31u - uint32_t(__builtin_clz(v))) : 0u;
+}
+
+ShadowAtlas::ShadowAtlas(FEngine& engine) noexcept
+        : mEngine(engine),
+          mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN) {
+    for (FCamera*& camera : mCameras) {
+        camera = mEngine.createCamera(EntityManager::get().create());
+    }
+}
+
+ShadowAtlas::~ShadowAtlas() {
+    for (FCamera* camera : mCameras) {
+        mEngine.destroy(camera->getEntity());
+    }
+}
+
+void ShadowAtlas::terminate(DriverApi& driverApi) noexcept {
+    if (mRenderTarget) {
+        driverApi.destroyRenderTarget(mRenderTarget);
+    }
+    if (mTexture) {
+        driverApi.destroyTexture(mTexture);
+    }
+}
+
+void ShadowAtlas::update(FScene::LightSoa const& lightData, CameraInfo const& camera) noexcept {
+    SYSTRACE_CALL();
+
+    FLightManager& lcm = mEngine.getLightManager();
+    auto const* UTILS_RESTRICT spheres   = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT instances = lightData.data<FScene::LIGHT_INSTANCE>();
+
+    // A bounding sphere of radius r covers r * p[1][1] / d of the viewport's height at a
+    // distance d, which is how important the light's shadow is.
+    const float scale = camera.projection[1][1];
+    const float3 position = camera.getPosition();
+
+    // keep the CONFIG_MAX_SHADOWED_SPOT_LIGHTS most important lights
+    mTileCount = 0;
+    uint32_t maxDimension = 0;
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        FLightManager::Instance li = instances[i];
+        if (!lcm.isShadowCaster(li) || !lcm.isSpotLight(li)) {
+            continue;
+        }
+        const float2 scaleOffset = lcm.getSpotParams(li).scaleOffset;
+        const float cosOuter = -scaleOffset.y / scaleOffset.x;
+        if (cosOuter < std::cos(MAX_SPOT_OUTER_ANGLE)) {
+            continue;
+        }
+
+        const float distance = std::max(camera.zn, length(spheres[i].xyz - position));
+        Tile tile;
+        tile.light = li;
+        tile.index = uint32_t(i);
+        tile.importance = std::min(1.0f, spheres[i].w * scale / distance);
+
+        size_t slot = mTileCount;
+        if (slot == CONFIG_MAX_SHADOWED_SPOT_LIGHTS) {
+            if (tile.importance <= mTiles[slot - 1].importance) {
+                continue;
+            }
+            slot--;
+        } else {
+            mTileCount++;
+        }
+        // insertion sort, most important first
+        while (slot > 0 && mTiles[slot - 1].importance < tile.importance) {
+            mTiles[slot] = mTiles[slot - 1];
+            slot--;
+        }
+        mTiles[slot] = tile;
+    }
+
+    for (size_t i = 0; i < mTileCount; i++) {
+        maxDimension = std::max(maxDimension, lcm.getShadowMapSize(mTiles[i].light));
+    }
+
+    // the atlas fits 4 tiles of the largest size the lights asked for
+    mDimension = std::min(MAX_DIMENSION, std::max(2 * MIN_TILE_DIMENSION, 2 * maxDimension));
+
+    // Tiles get the share of the atlas the light covers on screen, at most the size the light
+    // asked for. Treating the atlas as a grid of MIN_TILE_DIMENSION cells in Morton order, tiles
+    // of decreasing power-of-two sizes can be placed one after the other without overlapping,
+    // each one starting at a multiple of its area.
+    for (size_t i = 0; i < mTileCount; i++) {
+        Tile& tile = mTiles[i];
+        const uint32_t wanted = floorPowerOfTwo(uint32_t(tile.importance * mDimension));
+        tile.dimension = std::min(wanted, lcm.getShadowMapSize(tile.light));
+    }
+    std::stable_sort(mTiles, mTiles + mTileCount, [](Tile const& lhs, Tile const& rhs) {
+        return lhs.dimension > rhs.dimension;
+    });
+
+    const uint32_t cells = (mDimension / MIN_TILE_DIMENSION) * (mDimension / MIN_TILE_DIMENSION);
+    uint32_t cursor = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < mTileCount; i++) {
+        Tile tile = mTiles[i];
+        uint32_t side = tile.dimension / MIN_TILE_DIMENSION;
+        while (side && cursor + side * side > cells) {
+            side /= 2;
+        }
+        if (!side) {
+            // the atlas is full, or the remaining lights are too small on screen
+            break;
+        }
+        tile.dimension = side * MIN_TILE_DIMENSION;
+        const uint32_t left = mortonToCoordinate(cursor) * MIN_TILE_DIMENSION;
+        const uint32_t bottom = mortonToCoordinate(cursor >> 1u) * MIN_TILE_DIMENSION;
+        cursor += side * side;
+
+        // we set a viewport with a 1-texel border, for when we index outside of it
+        // DON'T CHANGE this unless getTextureCoordsMapping() is updated too.
+        tile.viewport = { int32_t(left + 1), int32_t(bottom + 1),
+                tile.dimension - 2, tile.dimension - 2 };
+
+        const size_t index = tile.index;
+        const float2 scaleOffset = lcm.getSpotParams(tile.light).scaleOffset;
+        computeShadowCamera(tile, *mCameras[count],
+                spheres[index].xyz, lightData.elementAt<FScene::DIRECTION>(index),
+                spheres[index].w, std::acos(-scaleOffset.y / scaleOffset.x));
+        mTiles[count++] = tile;
+    }
+    mTileCount = count;
+}
+
+void ShadowAtlas::computeShadowCamera(Tile& tile, FCamera& camera, float3 const& position,
+        float3 const& direction, float radius, float outerAngle) noexcept {
+    FLightManager& lcm = mEngine.getLightManager();
+
+    // a square frustum enclosing the cone of the light
+    const float zn = SPOT_SHADOW_NEAR_RATIO * radius;
+    const float zf = radius;
+    const float3 up = std::abs(direction.y) < 0.999f ? float3{ 0, 1, 0 } : float3{ 1, 0, 0 };
+    const mat4f Mv = FCamera::getViewMatrix(mat4f::lookAt(position, position + direction, up));
+    const mat4f Mp = mat4f::perspective(float(2.0 * outerAngle * 180.0 / M_PI), 1.0f, zn, zf);
+    const mat4f S = Mp * Mv;
+
+    // the camera renders into the tile's viewport, the shader also needs the atlas mapping
+    camera.setCustomProjection(mat4(S), zn, zf);
+    tile.lightSpace = getTextureCoordsMapping(tile) * S;
+
+    // the 2x bias is needed in opengl because the depth maps to -1/1, see FView::prepareShadowing
+    tile.constantBias = 2 * lcm.getShadowConstantBias(tile.light) / (zf - zn);
+
+    // size of a texel at 1m from the light, the shader scales it with the distance
+    tile.normalBias = lcm.getShadowNormalBias(tile.light) *
+            (2.0f * std::tan(outerAngle) / tile.dimension);
+}
+
+mat4f ShadowAtlas::getTextureCoordsMapping(Tile const& tile) const noexcept {
+    // remapping from NDC to texture coordinates (i.e. [-1,1] -> [0, 1])
+    const mat4f Mt(mClipSpaceFlipped ? mat4f::row_major_init{
+            0.5f,   0,    0,  0.5f,
+              0, -0.5f,   0,  0.5f,
+              0,    0,  0.5f, 0.5f,
+              0,    0,    0,    1
+    } : mat4f::row_major_init{
+            0.5f,   0,    0,  0.5f,
+              0,  0.5f,   0,  0.5f,
+              0,    0,  0.5f, 0.5f,
+              0,    0,    0,    1
+    });
+
+    // apply the 1-texel border viewport transform, then move to the tile
+    // (texture rows are flipped w.r.t. the viewport when the clip-space is)
+    const float dim = mDimension;
+    const float left = tile.viewport.left;
+    const float bottom = mClipSpaceFlipped ?
+            dim - float(tile.viewport.bottom + tile.viewport.height) : tile.viewport.bottom;
+    const float s = tile.viewport.width / dim;
+    const mat4f Mb(mat4f::row_major_init{
+             s, 0, 0, left / dim,
+             0, s, 0, bottom / dim,
+             0, 0, 1, 0,
+             0, 0, 0, 1
+    });
+
+    return Mb * Mt;
+}
+
+void ShadowAtlas::clear() noexcept {
+    mTileCount = 0;
+}
+
+int ShadowAtlas::getTileIndex(FLightManager::Instance light) const noexcept {
+    for (size_t i = 0; i < mTileCount; i++) {
+        if (mTiles[i].light == light) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+void ShadowAtlas::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
+    assert(mDimension);
+
+    const uint32_t dim = mDimension;
+    if (mAllocatedDimension == dim) {
+        // nothing to do here.
+        assert(mTexture);
+        return;
+    }
+
+    // destroy the current rendertarget and texture
+    if (mRenderTarget) {
+        driver.destroyRenderTarget(mRenderTarget);
+    }
+    if (mTexture) {
+        driver.destroyTexture(mTexture);
+    }
+
+    // allocate new ones...
+    mAllocatedDimension = dim;
+
+    mTexture = driver.createTexture(
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
+            TextureUsage::DEPTH_ATTACHMENT);
+
+    mRenderTarget = driver.createRenderTarget(
+            TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
+            {}, { mTexture }, {});
+
+    SamplerParams s;
+    s.filterMag = SamplerMagFilter::LINEAR;
+    s.filterMin = SamplerMinFilter::LINEAR;
+    s.compareFunc = SamplerCompareFunc::LE;
+    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
+    s.depthStencil = true;
+    sb.setSampler(FEngine::PerViewSib::SHADOW_ATLAS, { mTexture, s });
+}
+
+void ShadowAtlas::beginRenderPass(DriverApi& driver, size_t tile, bool clear) const noexcept {
+    RenderPassParams params = {};
+    if (clear) {
+        // this also clears the borders and the unused parts of the atlas
+        params.clear = TargetBufferFlags::SHADOW;
+        params.discardStart = TargetBufferFlags::DEPTH;
+    }
+    params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.clearDepth = 1.0;
+    params.width = params.height = mDimension;
+    // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is reloaded
+    // needlessly.
+    params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
+    driver.beginRenderPass(mRenderTarget, params);
+
+    Viewport const& viewport = mTiles[tile].viewport;
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+} // namespace details
+} // namespace filament
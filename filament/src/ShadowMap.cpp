@@ -24,6 +24,7 @@
 
 #include <filament/driver/DriverEnums.h>
 
+#include <algorithm>
 #include <limits>
 
 using namespace math;
@@ -43,11 +44,14 @@ static constexpr bool ENABLE_LISPSM = true;
 ShadowMap::ShadowMap(FEngine& engine) noexcept :
         mEngine(engine),
         mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN) {
-    mCamera = mEngine.createCamera(EntityManager::get().create());
+    for (Cascade& cascade : mCascades) {
+        cascade.camera = mEngine.createCamera(EntityManager::get().create());
+    }
     mDebugCamera = mEngine.createCamera(EntityManager::get().create());
     FDebugRegistry& debugRegistry = engine.getDebugRegistry();
     debugRegistry.registerProperty("d.shadowmap.focus_shadowcasters", &engine.debug.shadowmap.focus_shadowcasters);
     debugRegistry.registerProperty("d.shadowmap.far_uses_shadowcasters", &engine.debug.shadowmap.far_uses_shadowcasters);
+    debugRegistry.registerProperty("d.shadowmap.cull_with_receivers", &engine.debug.shadowmap.cull_with_receivers);
     if (ENABLE_LISPSM) {
         debugRegistry.registerProperty("d.shadowmap.lispsm", &engine.debug.shadowmap.lispsm);
         debugRegistry.registerProperty("d.shadowmap.dzn", &engine.debug.shadowmap.dzn);
@@ -56,16 +60,20 @@ ShadowMap::ShadowMap(FEngine& engine) noexcept :
 }
 
 ShadowMap::~ShadowMap() {
-    mEngine.destroy(mCamera->getEntity());
+    for (Cascade& cascade : mCascades) {
+        mEngine.destroy(cascade.camera->getEntity());
+    }
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
 void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     assert(mShadowMapDimension);
 
+    prepareStaticCache(driver);
+    prepareMoments(driver, sb);
+
     uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
+    if (mAllocatedDimension == dim) {
         // nothing to do here.
         assert(mShadowMapHandle);
         return;
@@ -80,10 +88,10 @@ void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     }
 
     // allocate new ones...
-    // we set a viewport with a 1-texel border for when we index outside of the texture
-    // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
-    // see: computeLightSpaceMatrix()
-    mViewport = { 1, 1, dim - 2, dim - 2 };
+    mAllocatedDimension = dim;
+
+    // the static casters are rendered again in the new shadow map's layout
+    mStaticCache.dirty = true;
 
     mShadowMapHandle = driver.createTexture(
             Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
@@ -102,6 +110,151 @@ void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     sb.setSampler(FEngine::PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
 }
 
+void ShadowMap::prepareStaticCache(DriverApi& driver) noexcept {
+    StaticCache& cache = mStaticCache;
+    const uint32_t dim = cache.enabled ? mShadowMapDimension : 0;
+    if (cache.dimension == dim) {
+        return;
+    }
+
+    if (cache.target) {
+        driver.destroyRenderTarget(cache.target);
+        cache.target.clear();
+    }
+    if (cache.texture) {
+        driver.destroyTexture(cache.texture);
+        cache.texture.clear();
+    }
+
+    cache.dimension = dim;
+    if (dim) {
+        // it's only copied from, never sampled
+        cache.texture = driver.createTexture(
+                Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
+                TextureUsage::DEPTH_ATTACHMENT);
+        cache.target = driver.createRenderTarget(
+                TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
+                {}, { cache.texture }, {});
+        cache.dirty = true;
+    }
+}
+
+void ShadowMap::prepareMoments(DriverApi& driver, SamplerBuffer& sb) noexcept {
+    Moments& moments = mMoments;
+    const uint32_t dim = mVsm ? mShadowMapDimension : 0;
+    if (moments.dimension == dim) {
+        return;
+    }
+
+    destroyMoments(driver);
+
+    moments.dimension = dim;
+    if (!dim) {
+        sb.setSampler(FEngine::PerViewSib::SHADOW_MOMENTS, {});
+        return;
+    }
+
+    // the exponential moments don't fit in less than 16 bits per channel (see VSM_EXPONENT)
+    moments.texture = driver.createTexture(
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::RGBA16F, 1, dim, dim, 1,
+            TextureUsage::COLOR_ATTACHMENT);
+    moments.target = driver.createRenderTarget(
+            TargetBufferFlags::COLOR, dim, dim, 1, Driver::TextureFormat::RGBA16F,
+            { moments.texture }, {}, {});
+    moments.blurTexture = driver.createTexture(
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::RGBA16F, 1, dim, dim, 1,
+            TextureUsage::COLOR_ATTACHMENT);
+    moments.blurTarget = driver.createRenderTarget(
+            TargetBufferFlags::COLOR, dim, dim, 1, Driver::TextureFormat::RGBA16F,
+            { moments.blurTexture }, {}, {});
+
+    // the moments are prefiltered, unlike the depth they can be interpolated
+    SamplerParams s;
+    s.filterMag = SamplerMagFilter::LINEAR;
+    s.filterMin = SamplerMinFilter::LINEAR;
+    sb.setSampler(FEngine::PerViewSib::SHADOW_MOMENTS, { moments.texture, s });
+}
+
+void ShadowMap::destroyMoments(DriverApi& driver) noexcept {
+    Moments& moments = mMoments;
+    if (moments.target) {
+        driver.destroyRenderTarget(moments.target);
+        driver.destroyTexture(moments.texture);
+        driver.destroyRenderTarget(moments.blurTarget);
+        driver.destroyTexture(moments.blurTexture);
+        moments = {};
+    }
+}
+
+void ShadowMap::prefilterMoments(DriverApi& driver) const noexcept {
+    assert(mMoments.target);
+
+    FEngine& engine = mEngine;
+    PostProcessManager const& ppm = engine.getPostProcessManager();
+    Handle<HwProgram> program = engine.getPostProcessProgram(PostProcessStage::SHADOW_MOMENTS_BLUR);
+
+    const uint32_t dim = mShadowMapDimension;
+    for (size_t c = 0; c < mCascadeCount; c++) {
+        if (!mCascades[c].hasVisibleShadows) {
+            continue;
+        }
+
+        // the texels of the tile, the Vulkan backend flips the viewports vertically
+        Viewport const& viewport = mCascades[c].viewport;
+        const float left = float(viewport.left);
+        const float bottom = float(mClipSpaceFlipped ?
+                int32_t(dim - viewport.height) - viewport.bottom : viewport.bottom);
+        const float4 bounds = { left, bottom,
+                left + float(viewport.width - 1), bottom + float(viewport.height - 1) };
+
+        ppm.shadowMomentsBlur(program, mMoments.blurTarget, viewport, mShadowMapHandle,
+                true, { 1, 0 }, bounds, VSM_EXPONENT);
+        ppm.shadowMomentsBlur(program, mMoments.target, viewport, mMoments.blurTexture,
+                false, { 0, 1 }, bounds, VSM_EXPONENT);
+    }
+}
+
+void ShadowMap::updateStaticCache(FScene const* scene, uint8_t visibleLayers) noexcept {
+    StaticCache& cache = mStaticCache;
+
+    // the Vulkan backend doesn't implement blit() yet
+    cache.enabled = mHasVisibleShadows && scene->hasStaticCasters() &&
+            mEngine.getBackend() != Backend::VULKAN;
+    if (!cache.enabled) {
+        // forget what the cache was made of, its content won't be up-to-date next time
+        cache.scene = nullptr;
+        return;
+    }
+
+    uint8_t visibleCascades = 0;
+    bool same = cache.scene == scene &&
+            cache.staticCastersGeneration == scene->getStaticCastersGeneration() &&
+            cache.visibleLayers == visibleLayers;
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        if (mCascades[i].hasVisibleShadows) {
+            visibleCascades |= uint8_t(1u << i);
+            for (size_t j = 0; j < 4; j++) {
+                same = same && all(equal(cache.lightSpace[i][j], mCascades[i].lightSpace[j]));
+            }
+            cache.lightSpace[i] = mCascades[i].lightSpace;
+        }
+    }
+    same = same && cache.visibleCascades == visibleCascades;
+
+    cache.dirty = !same;
+    cache.scene = scene;
+    cache.staticCastersGeneration = scene->getStaticCastersGeneration();
+    cache.visibleLayers = visibleLayers;
+    cache.visibleCascades = visibleCascades;
+}
+
+void ShadowMap::copyStaticCache(DriverApi& driver) const noexcept {
+    const uint32_t dim = mShadowMapDimension;
+    driver.blit(TargetBufferFlags::DEPTH,
+            mShadowMapRenderTarget, 0, 0, dim, dim,
+            mStaticCache.target, 0, 0, dim, dim);
+}
+
 void ShadowMap::terminate(DriverApi& driverApi) noexcept {
     if (mShadowMapRenderTarget) {
         driverApi.destroyRenderTarget(mShadowMapRenderTarget);
@@ -109,97 +262,162 @@ void ShadowMap::terminate(DriverApi& driverApi) noexcept {
     if (mShadowMapHandle) {
         driverApi.destroyTexture(mShadowMapHandle);
     }
+    if (mStaticCache.target) {
+        driverApi.destroyRenderTarget(mStaticCache.target);
+    }
+    if (mStaticCache.texture) {
+        driverApi.destroyTexture(mStaticCache.texture);
+    }
+    destroyMoments(driverApi);
 }
 
-void ShadowMap::beginRenderPass(DriverApi& driver) const noexcept {
+void ShadowMap::beginRenderPass(DriverApi& driver, size_t cascade, bool clear,
+        bool staticCache) const noexcept {
     RenderPassParams params = {};
-    params.clear = TargetBufferFlags::SHADOW;
-    params.discardStart = TargetBufferFlags::DEPTH;
+    if (clear) {
+        // this also clears the borders and the tiles of the cascades with no visible shadows
+        params.clear = TargetBufferFlags::SHADOW;
+        params.discardStart = TargetBufferFlags::DEPTH;
+    }
     params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
     params.clearDepth = 1.0;
     params.width = params.height = mShadowMapDimension;
     // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is reloaded
     // needlessly.
     params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
-    driver.beginRenderPass(mShadowMapRenderTarget, params);
+    driver.beginRenderPass(staticCache ? mStaticCache.target : mShadowMapRenderTarget, params);
+
+    Viewport const& viewport = mCascades[cascade].viewport;
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
 
-    driver.viewport(mViewport.left, mViewport.bottom,
-            mViewport.width, mViewport.height);
+void ShadowMap::setNearFar(mat4f& projection, float n, float f) noexcept {
+    if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
+        // perspective projection
+        projection[2].z =     (f + n) / (n - f);
+        projection[3].z = (2 * f * n) / (n - f);
+    } else {
+        // ortho projection
+        projection[2].z =    2.0f / (n - f);
+        projection[3].z = (f + n) / (n - f);
+    }
 }
 
 void ShadowMap::update(
-        const FScene::LightSoa& lightData, size_t index, FScene const* scene,
+        const FScene::LightSoa& lightData, size_t index,
+        FScene const* scene, size_t sceneSnapshot,
         details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
     // this is the hard part here, find a good frustum for our camera
 
     auto& lcm = mEngine.getLightManager();
 
     FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
-    mShadowMapDimension = std::max(1u, lcm.getShadowMapSize(li));
-
     FLightManager::ShadowParams params = lcm.getShadowParams(li);
-    mat4f projection(camera.cullingProjection);
-    if (params.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.shadowFar;
-        if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
-            // perspective projection
-            projection[2].z =     (f + n) / (n - f);
-            projection[3].z = (2 * f * n) / (n - f);
-        } else {
-            // ortho projection
-            projection[2].z =    2.0f / (n - f);
-            projection[3].z = (f + n) / (n - f);
-        }
+
+    // cascades are laid out as 2x2 tiles of the shadow map, each of the user's size
+    using Type = FLightManager::Type;
+    const Type type = lcm.getType(li);
+    const bool directional = type == Type::SUN || type == Type::DIRECTIONAL;
+    mCascadeCount = directional ? params.shadowCascades : 1;
+    mCascadeDimension = std::max(1u, lcm.getShadowMapSize(li));
+    mShadowMapDimension = mCascadeDimension * (mCascadeCount > 1 ? 2 : 1);
+
+    // we set a viewport with a 1-texel border in each tile, for when we index outside of it
+    // DON'T CHANGE this unless getTextureCoordsMapping() is updated too.
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        const uint32_t left = uint32_t(i % 2) * mCascadeDimension;
+        const uint32_t bottom = uint32_t(i / 2) * mCascadeDimension;
+        mCascades[i].viewport = { int32_t(left + 1), int32_t(bottom + 1),
+                mCascadeDimension - 2, mCascadeDimension - 2 };
     }
 
-    CameraInfo cameraInfo = {
-            .projection = projection,
-            .model = camera.model,
-            .view = camera.view,
-            .zn = camera.zn,
-            .zf = camera.zf,
-            .dzn = std::max(0.0f, params.shadowNearHint - camera.zn),
-            .dzf = std::max(0.0f, camera.zf - params.shadowFarHint),
-            .frustum = Frustum(projection * camera.view),
-            .worldOrigin = camera.worldOrigin
-    };
+    // Split distances, a blend of logarithmic and uniform splits. They only depend on the
+    // camera's near/far planes, so that they don't move with the camera.
+    const float zn = camera.zn;
+    const float zf = params.shadowFar > 0.0f ? std::max(zn, params.shadowFar) : camera.zf;
+    const float lambda = params.shadowCascadeSplitLambda;
+    float splits[CONFIG_MAX_SHADOW_CASCADES + 1] = { zn };
+    for (size_t i = 1; i <= mCascadeCount; i++) {
+        const float t = float(i) / mCascadeCount;
+        const float logSplit = zn * std::pow(zf / zn, t);
+        const float uniformSplit = zn + (zf - zn) * t;
+        splits[i] = lambda * logSplit + (1 - lambda) * uniformSplit;
+    }
+    splits[mCascadeCount] = zf;
+    // unused cascades end with the last one, which lets the shader find the cascade of a
+    // fragment by counting the splits in front of it
+    mCascadeSplits = zf;
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        mCascadeSplits[i] = splits[i + 1];
+    }
+
+    // scene bounds in world space
+    Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
+    if (directional) {
+        scene->computeBounds(sceneSnapshot, wsShadowCastersVolume, wsShadowReceiversVolume,
+                visibleLayers);
+    }
 
-    // debugging...
-    const float dz = cameraInfo.zf - cameraInfo.zn;
-    float& dzn = mEngine.debug.shadowmap.dzn;
-    float& dzf = mEngine.debug.shadowmap.dzf;
-    if (dzn < 0)    dzn = cameraInfo.dzn / dz;
-    else            cameraInfo.dzn = dzn * dz;
-    if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
-    else            cameraInfo.dzf =-dzf * dz;
+    mHasVisibleShadows = false;
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        mCascades[i].hasVisibleShadows = false;
 
+        float n = splits[i];
+        float f = splits[i + 1];
+        mat4f projection(camera.cullingProjection);
+        if (mCascadeCount > 1 || params.shadowFar > 0.0f) {
+            setNearFar(projection, n, f);
+        }
+        if (mCascadeCount == 1) {
+            // a single shadow map is optimized for the whole camera range
+            f = camera.zf;
+        }
 
-    using Type = FLightManager::Type;
-    switch (lcm.getType(li)) {
-        case Type::SUN:
-        case Type::DIRECTIONAL:
-            computeShadowCameraDirectional(
-                    lightData.elementAt<FScene::DIRECTION>(index), scene, cameraInfo,
-                    visibleLayers);
-            break;
-        case Type::FOCUSED_SPOT:
-        case Type::SPOT:
-            break;
-        case Type::POINT:
-            break;
+        CameraInfo cameraInfo = {
+                .projection = projection,
+                .model = camera.model,
+                .view = camera.view,
+                .zn = n,
+                .zf = f,
+                .dzn = std::max(0.0f, params.shadowNearHint - n),
+                .dzf = std::max(0.0f, f - params.shadowFarHint),
+                .frustum = Frustum(projection * camera.view),
+                .worldOrigin = camera.worldOrigin
+        };
+
+        // debugging...
+        const float dz = cameraInfo.zf - cameraInfo.zn;
+        float& dzn = mEngine.debug.shadowmap.dzn;
+        float& dzf = mEngine.debug.shadowmap.dzf;
+        if (dzn < 0)    dzn = cameraInfo.dzn / dz;
+        else            cameraInfo.dzn = dzn * dz;
+        if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
+        else            cameraInfo.dzf =-dzf * dz;
+
+        switch (type) {
+            case Type::SUN:
+            case Type::DIRECTIONAL:
+                computeShadowCameraDirectional(lightData.elementAt<FScene::DIRECTION>(index),
+                        wsShadowCastersVolume, wsShadowReceiversVolume, cameraInfo, i);
+                break;
+            case Type::FOCUSED_SPOT:
+            case Type::SPOT:
+                break;
+            case Type::POINT:
+                break;
+        }
+        mHasVisibleShadows |= mCascades[i].hasVisibleShadows;
     }
+
+    updateStaticCache(scene, visibleLayers);
 }
 
 void ShadowMap::computeShadowCameraDirectional(
-        math::float3 const& dir, FScene const* scene, CameraInfo const& camera,
-        uint8_t visibleLayers) noexcept {
+        math::float3 const& dir, Aabb const& wsShadowCastersVolume,
+        Aabb const& wsShadowReceiversVolume, CameraInfo const& camera,
+        size_t cascade) noexcept {
 
-    // scene bounds in world space
-    Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
-    scene->computeBounds(wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
     if (wsShadowCastersVolume.isEmpty() || wsShadowReceiversVolume.isEmpty()) {
-        mHasVisibleShadows = false;
         return;
     }
 
@@ -212,9 +430,13 @@ void ShadowMap::computeShadowCameraDirectional(
     size_t vertexCount = intersectFrustumWithBox(mWsClippedShadowReceiverVolume,
             camera.frustum, wsViewFrustumCorners, wsShadowReceiversVolume);
 
-    mHasVisibleShadows = vertexCount >= 2;
-    if (mHasVisibleShadows) {
-        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm;
+    Cascade& out = mCascades[cascade];
+    if (vertexCount >= 2) {
+        // With several cascades, we make the shadow maps independent of the camera's
+        // orientation, so that they don't shimmer when it rotates: each cascade covers the
+        // bounding sphere of its part of the view frustum and isn't warped.
+        const bool stable = mCascadeCount > 1;
+        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm && !stable;
 
         /*
          * Compute the light's model matrix
@@ -234,7 +456,7 @@ void ShadowMap::computeShadowCameraDirectional(
         mat4f L;
         const float3 wsCameraFwd(camera.getForwardVector());
         const float3 lsCameraFwd = mat4f::project(Mv, wsCameraFwd);
-        if (UTILS_LIKELY(std::abs(lsCameraFwd.z) < 0.9997f)) { // this is |dot(L, V)|
+        if (!stable && UTILS_LIKELY(std::abs(lsCameraFwd.z) < 0.9997f)) { // this is |dot(L, V)|
             L[0].xyz = normalize(cross(lsCameraFwd, float3{ 0, 0, 1 }));
             L[1].xyz = cross(float3{ 0, 0, 1 }, L[0].xyz);
             L[2].xyz = { 0, 0, 1 };
@@ -244,6 +466,12 @@ void ShadowMap::computeShadowCameraDirectional(
         // lights space matrix used for finding the near and far planes
         const mat4f LMv(L * Mv);
 
+        // the casters outside of the receivers swept towards the light are culled
+        out.casterVolume.planeCount = 0;
+        if (mEngine.debug.shadowmap.cull_with_receivers) {
+            computeCasterVolume(out.casterVolume, Mv, vertexCount);
+        }
+
         /*
          * Compute the light's projection matrix
          * (directional/point lights, i.e. projection to use, including znear/zfar clip planes)
@@ -322,18 +550,35 @@ void ShadowMap::computeShadowCameraDirectional(
         //   In LiPSM mode, we're using the warped space here.
 
         // disable vectorization here because vertexCount is <= 64, not worth the increased code size.
-        #pragma clang loop vectorize(disable)
-        for (size_t i = 0; i < vertexCount; ++i) {
-            const float3 v = mat4f::project(WLMpMv, mWsClippedShadowReceiverVolume[i]);
-            lsLightFrustum.min.xy = min(lsLightFrustum.min.xy, v.xy);
-            lsLightFrustum.max.xy = max(lsLightFrustum.max.xy, v.xy);
+        if (stable) {
+            float3 wsCenter = 0;
+            for (float3 const& corner : wsViewFrustumCorners) {
+                wsCenter += corner;
+            }
+            wsCenter *= 1.0f / 8.0f;
+            float radius = 0;
+            for (float3 const& corner : wsViewFrustumCorners) {
+                radius = std::max(radius, length(corner - wsCenter));
+            }
+            // round the radius so that float imprecision doesn't change the scale
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            const float2 lsCenter = mat4f::project(WLMpMv, wsCenter).xy;
+            lsLightFrustum.min.xy = lsCenter - radius;
+            lsLightFrustum.max.xy = lsCenter + radius;
+        } else {
+            #pragma clang loop vectorize(disable)
+            for (size_t i = 0; i < vertexCount; ++i) {
+                const float3 v = mat4f::project(WLMpMv, mWsClippedShadowReceiverVolume[i]);
+                lsLightFrustum.min.xy = min(lsLightFrustum.min.xy, v.xy);
+                lsLightFrustum.max.xy = max(lsLightFrustum.max.xy, v.xy);
+            }
         }
 
         // For directional lights, we further constraint the light frustum to the
         // intersection of the shadow casters & receivers in light-space.
-        // However, since this relies on the 1-texel shadow map border, this wouldn't directly
-        // work if we were storing several shadow maps in a single texture.
-        if (mEngine.debug.shadowmap.focus_shadowcasters) {
+        // This relies on the 1-texel border of each cascade's tile. Stable cascades keep their
+        // size though, the casters are only culled for each cascade.
+        if (mEngine.debug.shadowmap.focus_shadowcasters && !stable) {
             intersectWithShadowCasters(lsLightFrustum, WLMpMv, wsShadowCastersVolume);
         }
 
@@ -341,7 +586,6 @@ void ShadowMap::computeShadowCameraDirectional(
                            (lsLightFrustum.min.y >= lsLightFrustum.max.y))) {
             // this could happen if the only thing visible is a perfectly horizontal or
             // vertical thin line
-            mHasVisibleShadows = false;
             return;
         }
 
@@ -354,7 +598,7 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // temporal aliasing stabilization
         // 3) snap the light frustum (width & height) to texels, to stabilize the shadow map
-        snapLightFrustum(s, o, mShadowMapDimension);
+        snapLightFrustum(s, o, mCascadeDimension);
 
         // construct the Focus transform (scale + offset)
         const mat4f F(mat4f::row_major_init {
@@ -372,18 +616,24 @@ void ShadowMap::computeShadowCameraDirectional(
         const mat4f S = F * WLMpMv;
 
         // Compute shadow-map texture access transform
-        const mat4f MbMt = getTextureCoordsMapping();
+        const mat4f MbMt = getTextureCoordsMapping(cascade);
 
         // Final shadowmap texture transform
         const mat4f St = mat4f(MbMt * S);
 
-        mTexelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
-        mLightSpace = St;
-        mSceneRange = (zfar - znear);
-        mCamera->setCustomProjection(mat4(S), znear, zfar);
+        // the center of the cascade's tile
+        const float2 center = mat4f::project(MbMt, float3{ 0 }).xy;
 
-        // for the debug camera, we need to undo the world origin
-        mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+        out.hasVisibleShadows = true;
+        out.texelSizeWs = texelSizeWorldSpace(St, float3{ center, 0.5f });
+        out.lightSpace = St;
+        out.sceneRange = (zfar - znear);
+        out.camera->setCustomProjection(mat4(S), znear, zfar);
+
+        if (cascade == 0) {
+            // for the debug camera, we need to undo the world origin
+            mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+        }
     }
 }
 
@@ -461,7 +711,7 @@ mat4f ShadowMap::applyLISPSM(CameraInfo const& camera, float dzn, float dzf, mat
 }
 
 
-mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
+mat4f ShadowMap::getTextureCoordsMapping(size_t cascade) const noexcept {
     // Computes St the transform to use in the shader to access the shadow map texture
     // i.e. it transform a world-space vertex to a texture coordinate in the shadow-map
     // remapping from NDC to texture coordinates (i.e. [-1,1] -> [0, 1])
@@ -477,12 +727,16 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
               0,    0,    0,    1
     });
 
-    // apply the 1-texel border viewport transform
+    // apply the 1-texel border viewport transform, then move to the cascade's tile
+    // (texture rows are flipped w.r.t. the viewport when the clip-space is)
+    const float tiles = float(mShadowMapDimension / mCascadeDimension);
+    const float tx = float(cascade % 2);
+    const float ty = mClipSpaceFlipped ? tiles - 1 - float(cascade / 2) : float(cascade / 2);
     const float o = 1.0f / mShadowMapDimension;
-    const float s = 1.0f - 2.0f * o;
+    const float s = 1.0f / tiles - 2.0f * o;
     const mat4f Mb(mat4f::row_major_init{
-             s, 0, 0, o,
-             0, s, 0, o,
+             s, 0, 0, o + tx / tiles,
+             0, s, 0, o + ty / tiles,
              0, 0, 1, 0,
              0, 0, 0, 1
     });
@@ -529,6 +783,84 @@ float2 ShadowMap::computeNearFar(const mat4f& lightView,
     return nearFar;
 }
 
+// Returns the convex hull of the points in counter-clockwise order (Andrew's monotone chain),
+// hull must have room for 2*count points. The points are sorted.
+static size_t computeConvexHull(float2* UTILS_RESTRICT hull,
+        float2* UTILS_RESTRICT points, size_t count) noexcept {
+    std::sort(points, points + count, [](float2 const& a, float2 const& b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    auto turn = [](float2 const& o, float2 const& a, float2 const& b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    };
+    size_t k = 0;
+    // lower hull
+    for (size_t i = 0; i < count; i++) {
+        while (k >= 2 && turn(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    // upper hull
+    for (size_t i = count - 1, t = k + 1; i > 0; i--) {
+        while (k >= t && turn(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) {
+            k--;
+        }
+        hull[k++] = points[i - 1];
+    }
+    // the last point is the first one
+    return k > 1 ? k - 1 : k;
+}
+
+void ShadowMap::computeCasterVolume(CasterVolume& volume, mat4f const& lightView,
+        size_t vertexCount) const noexcept {
+    // In light space, the light looks down the -z axis: the volume is the 2D convex hull of the
+    // visible receivers, extruded along z, and capped by the farthest receiver.
+    float2 points[std::tuple_size<FrustumBoxIntersection>::value];
+    float2 hull[std::tuple_size<FrustumBoxIntersection>::value * 2];
+    float zmin = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const float3 v = mat4f::project(lightView, mWsClippedShadowReceiverVolume[i]);
+        points[i] = v.xy;
+        zmin = std::min(zmin, v.z);
+    }
+
+    size_t count = computeConvexHull(hull, points, vertexCount);
+    if (count < 3) {
+        // degenerate, the casters are not culled
+        volume.planeCount = 0;
+        return;
+    }
+    if (count > CasterVolume::MAX_SIDES) {
+        // too many sides to be worth testing, use the bounds of the hull instead
+        float2 lo = hull[0];
+        float2 hi = hull[0];
+        for (size_t i = 1; i < count; i++) {
+            lo = min(lo, hull[i]);
+            hi = max(hi, hull[i]);
+        }
+        hull[0] = lo;
+        hull[1] = { hi.x, lo.y };
+        hull[2] = hi;
+        hull[3] = { lo.x, hi.y };
+        count = 4;
+    }
+
+    // planes are transformed to world space by the transpose of the light's view matrix
+    const mat4f Mt(transpose(lightView));
+    size_t planeCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        // outward normal of the edge of a counter-clockwise polygon
+        const float2 a = hull[i];
+        const float2 e = hull[(i + 1) % count] - a;
+        const float2 n = normalize(float2{ e.y, -e.x });
+        volume.planes[planeCount++] = Mt * float4{ n, 0, -dot(n, a) };
+    }
+    // casters entirely behind the farthest receiver can't shadow it
+    volume.planes[planeCount++] = Mt * float4{ 0, 0, -1, zmin };
+    volume.planeCount = planeCount;
+}
+
 void ShadowMap::intersectWithShadowCasters(
         Aabb& UTILS_RESTRICT lightFrustum,
         mat4f const& lightView,
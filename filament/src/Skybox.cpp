@@ -116,6 +116,10 @@ FSkybox::FSkybox(FEngine& engine, const Builder& builder) noexcept
             .priority(0x7)
             .culling(false)
             .build(engine, mSkybox);
+
+    // the skybox covers the whole screen at the far plane, it's drawn after the other opaque
+    // renderables so the depth test rejects the pixels they cover before they're shaded
+    mRenderableManager.setBackground(mRenderableManager.getInstance(mSkybox), true);
 }
 
 FMaterial const* FSkybox::createMaterial(FEngine& engine, bool rgbm) {
@@ -89,10 +89,15 @@ FStream::FStream(FEngine& engine, const Builder& builder) noexcept
 
     if (mNativeStream) {
         // Note: this is a synchronous call. On Android, this calls back into Java.
+        mStreamType = StreamType::NATIVE;
         mStreamHandle = engine.getDriverApi().createStream(mNativeStream);
     } else if (mExternalTextureId) {
+        mStreamType = StreamType::TEXTURE_ID;
         mStreamHandle = engine.getDriverApi().createStreamFromTextureId(
                 mExternalTextureId, mWidth, mHeight);
+    } else {
+        mStreamType = StreamType::ACQUIRED;
+        mStreamHandle = engine.getDriverApi().createStreamAcquired();
     }
 }
 
@@ -112,6 +117,18 @@ void FStream::setDimensions(uint32_t width, uint32_t height) noexcept {
     mEngine.getDriverApi().setStreamDimensions(mStreamHandle, mWidth, mHeight);
 }
 
+void FStream::setAcquiredImage(void* image, int acquireFence,
+        Callback callback, void* userdata) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mStreamType == StreamType::ACQUIRED,
+            "setAcquiredImage() can only be used with an ACQUIRED stream")) {
+        return;
+    }
+    // unlike the other streams, this doesn't need a synchronous call: the image is latched by
+    // the driver thread along with the commands of the frame
+    mEngine.getDriverApi().setAcquiredImage(mStreamHandle,
+            image, acquireFence, callback, userdata);
+}
+
 void FStream::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) noexcept {
     if (isExternalTextureId()) {
@@ -146,6 +163,15 @@ bool Stream::isNativeStream() const noexcept {
     return upcast(this)->isNativeStream();
 }
 
+StreamType Stream::getStreamType() const noexcept {
+    return upcast(this)->getStreamType();
+}
+
+void Stream::setAcquiredImage(void* image, int acquireFence,
+        Callback callback, void* userdata) noexcept {
+    upcast(this)->setAcquiredImage(image, acquireFence, callback, userdata);
+}
+
 void Stream::setDimensions(uint32_t width, uint32_t height) noexcept {
     upcast(this)->setDimensions(width, height);
 }
@@ -0,0 +1,475 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/Terrain.h"
+
+#include "components/RenderableManager.h"
+#include "components/TransformManager.h"
+
+#include "details/Camera.h"
+#include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/Texture.h"
+#include "details/VertexBuffer.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <filament/Box.h>
+#include <filament/TextureSampler.h>
+
+#include <utils/Panic.h>
+
+#include <math/mat4.h>
+#include <math/scalar.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+using namespace details;
+using namespace driver;
+
+// This package is generated with matc and contains the terrain material shader code.
+static const uint8_t TERRAIN_MATERIAL_PACKAGE[] = {
+#include "generated/material/terrain.inc"
+};
+
+struct Terrain::BuilderDetails {
+    float const* mHeights = nullptr;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    float mSpacing = 1.0f;
+    uint8_t mLevelCount = 6;
+    uint32_t mResolution = 128;
+    Material const* mMaterial = nullptr;
+    bool mCastShadows = true;
+    bool mReceiveShadows = true;
+};
+
+using BuilderType = Terrain;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+Terrain::Builder& Terrain::Builder::heightfield(
+        float const* heights, uint32_t width, uint32_t height) noexcept {
+    mImpl->mHeights = heights;
+    mImpl->mWidth = width;
+    mImpl->mHeight = height;
+    return *this;
+}
+
+Terrain::Builder& Terrain::Builder::spacing(float spacing) noexcept {
+    mImpl->mSpacing = spacing;
+    return *this;
+}
+
+Terrain::Builder& Terrain::Builder::levels(uint8_t count) noexcept {
+    mImpl->mLevelCount = count;
+    return *this;
+}
+
+Terrain::Builder& Terrain::Builder::resolution(uint32_t resolution) noexcept {
+    mImpl->mResolution = resolution;
+    return *this;
+}
+
+Terrain::Builder& Terrain::Builder::material(Material const* material) noexcept {
+    mImpl->mMaterial = material;
+    return *this;
+}
+
+Terrain::Builder& Terrain::Builder::castShadows(bool enable) noexcept {
+    mImpl->mCastShadows = enable;
+    return *this;
+}
+
+Terrain::Builder& Terrain::Builder::receiveShadows(bool enable) noexcept {
+    mImpl->mReceiveShadows = enable;
+    return *this;
+}
+
+Terrain* Terrain::Builder::build(Engine& engine) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mHeights && mImpl->mWidth && mImpl->mHeight,
+            "heightfield not set")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mSpacing > 0.0f, "spacing must be positive")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mLevelCount > 0 &&
+            mImpl->mLevelCount <= MAX_LEVELS, "levels must be in [1, %u]", MAX_LEVELS)) {
+        return nullptr;
+    }
+
+    const uint32_t resolution = mImpl->mResolution;
+    if (!ASSERT_PRECONDITION_NON_FATAL(resolution >= 32 && resolution <= 512 &&
+            (resolution & (resolution - 1)) == 0,
+            "resolution must be a power of two in [32, 512]")) {
+        return nullptr;
+    }
+
+    return upcast(engine).createTerrain(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+namespace {
+
+// all the values are small integers, converted to floats by the vertex fetch
+struct Vertex {
+    uint16_t position[4];   // x, y in quads of the level, kind, 1
+    int16_t tangents[4];    // unused, lit materials need them, see terrain.mat
+};
+
+// one vertex per corner and two triangles per quad, split along the same diagonal as the
+// morphing in terrain.mat
+void addGrid(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+        uint32_t x0, uint32_t y0, uint32_t width, uint32_t height, FTerrain::Kind kind) {
+    const uint32_t first = uint32_t(vertices.size());
+    for (uint32_t y = 0; y <= height; y++) {
+        for (uint32_t x = 0; x <= width; x++) {
+            vertices.push_back({
+                    { uint16_t(x0 + x), uint16_t(y0 + y), uint16_t(kind), 1 },
+                    { 0, 0, 0, std::numeric_limits<int16_t>::max() }});
+        }
+    }
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            const uint32_t v00 = first + y * (width + 1) + x;
+            const uint32_t v10 = v00 + 1;
+            const uint32_t v01 = v00 + width + 1;
+            const uint32_t v11 = v01 + 1;
+            // counter-clockwise seen from +y
+            indices.insert(indices.end(), { v00, v11, v10, v00, v01, v11 });
+        }
+    }
+}
+
+void freeBuffer(void* buffer, size_t, void*) {
+    ::free(buffer);
+}
+
+} // anonymous namespace
+
+float FTerrain::Heightfield::get(int32_t x, int32_t y) const noexcept {
+    x = clamp(x, 0, int32_t(width) - 1);
+    y = clamp(y, 0, int32_t(height) - 1);
+    return heights[size_t(y) * width + x];
+}
+
+FTerrain::FTerrain(FEngine& engine, const Builder& builder)
+        : mSpacing(builder->mSpacing),
+          mResolution(builder->mResolution),
+          mLevelCount(builder->mLevelCount) {
+    // each level is filtered from the previous one with a tent, so that its samples stay on
+    // the samples of the finer levels
+    mHeightfields.resize(mLevelCount);
+    Heightfield& finest = mHeightfields[0];
+    finest.width = builder->mWidth;
+    finest.height = builder->mHeight;
+    finest.heights.assign(builder->mHeights,
+            builder->mHeights + size_t(finest.width) * finest.height);
+    for (size_t l = 1; l < mLevelCount; l++) {
+        Heightfield const& src = mHeightfields[l - 1];
+        Heightfield& dst = mHeightfields[l];
+        dst.width = (src.width + 1) / 2;
+        dst.height = (src.height + 1) / 2;
+        dst.heights.resize(size_t(dst.width) * dst.height);
+        for (int32_t y = 0; y < int32_t(dst.height); y++) {
+            for (int32_t x = 0; x < int32_t(dst.width); x++) {
+                float h = 0.0f;
+                for (int32_t j = -1; j <= 1; j++) {
+                    for (int32_t i = -1; i <= 1; i++) {
+                        const float w = (i ? 0.25f : 0.5f) * (j ? 0.25f : 0.5f);
+                        h += w * src.get(2 * x + i, 2 * y + j);
+                    }
+                }
+                dst.heights[size_t(y) * dst.width + x] = h;
+            }
+        }
+    }
+    auto minmax = std::minmax_element(finest.heights.begin(), finest.heights.end());
+    mMinHeight = *minmax.first;
+    mMaxHeight = *minmax.second;
+
+    // the ring of the levels, the center of the finest one, and the trims of the others, in
+    // quads (see FTerrain)
+    const uint32_t m = mResolution / 4;
+    const uint32_t blocks[4] = { 0, m - 1, 2 * m, 3 * m - 1 };
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    for (uint32_t by = 0; by < 4; by++) {
+        for (uint32_t bx = 0; bx < 4; bx++) {
+            if ((bx == 1 || bx == 2) && (by == 1 || by == 2)) {
+                continue;
+            }
+            addGrid(vertices, indices, blocks[bx], blocks[by], m - 1, m - 1, RING);
+        }
+    }
+    addGrid(vertices, indices, 2 * m - 2, 0,         2,     m - 1, RING);
+    addGrid(vertices, indices, 2 * m - 2, 3 * m - 1, 2,     m - 1, RING);
+    addGrid(vertices, indices, 0,         2 * m - 2, m - 1, 2,     RING);
+    addGrid(vertices, indices, 3 * m - 1, 2 * m - 2, m - 1, 2,     RING);
+    addGrid(vertices, indices, m - 1, m - 1, 2 * m, 2 * m, CENTER);
+    addGrid(vertices, indices, m - 1,     m - 1, 1, 2 * m, TRIM_X_LOW);
+    addGrid(vertices, indices, 3 * m - 2, m - 1, 1, 2 * m, TRIM_X_HIGH);
+    addGrid(vertices, indices, m, m - 1,     2 * m - 2, 1, TRIM_Y_LOW);
+    addGrid(vertices, indices, m, 3 * m - 2, 2 * m - 2, 1, TRIM_Y_HIGH);
+    addGrid(vertices, indices, m - 1,     m - 1,     1, 1, TRIM_Y_LOW_END_LOW);
+    addGrid(vertices, indices, 3 * m - 2, m - 1,     1, 1, TRIM_Y_LOW_END_HIGH);
+    addGrid(vertices, indices, m - 1,     3 * m - 2, 1, 1, TRIM_Y_HIGH_END_LOW);
+    addGrid(vertices, indices, 3 * m - 2, 3 * m - 2, 1, 1, TRIM_Y_HIGH_END_HIGH);
+
+    const uint32_t vertexCount = uint32_t(vertices.size());
+    mVertexBuffer = upcast(VertexBuffer::Builder()
+            .vertexCount(vertexCount)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::USHORT4,
+                    offsetof(Vertex, position), sizeof(Vertex))
+            .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::SHORT4,
+                    offsetof(Vertex, tangents), sizeof(Vertex))
+            .normalized(VertexAttribute::TANGENTS)
+            .build(engine));
+    const size_t vertexSize = vertices.size() * sizeof(Vertex);
+    void* vertexData = malloc(vertexSize);
+    memcpy(vertexData, vertices.data(), vertexSize);
+    mVertexBuffer->setBufferAt(engine, 0, { vertexData, vertexSize, freeBuffer });
+
+    const bool shortIndices = vertexCount <= 65536;
+    mIndexBuffer = upcast(IndexBuffer::Builder()
+            .indexCount(uint32_t(indices.size()))
+            .bufferType(shortIndices ? IndexBuffer::IndexType::USHORT : IndexBuffer::IndexType::UINT)
+            .build(engine));
+    const size_t indexSize = indices.size() * (shortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+    void* indexData = malloc(indexSize);
+    if (shortIndices) {
+        std::copy(indices.begin(), indices.end(), static_cast<uint16_t*>(indexData));
+    } else {
+        std::copy(indices.begin(), indices.end(), static_cast<uint32_t*>(indexData));
+    }
+    mIndexBuffer->setBuffer(engine, { indexData, indexSize, freeBuffer });
+
+    // normal and height of each sample, fetched without filtering
+    mClipmap = upcast(Texture::Builder()
+            .width(mResolution)
+            .height(mResolution)
+            .depth(mLevelCount)
+            .levels(1)
+            .sampler(Texture::Sampler::SAMPLER_2D_ARRAY)
+            .format(Texture::InternalFormat::RGBA32F)
+            .build(engine));
+
+    FMaterial const* material = builder->mMaterial ?
+            upcast(builder->mMaterial) : engine.getTerrainMaterial();
+    mMaterialInstance = material->createInstance();
+    mMaterialInstance->setParameter("clipmap", mClipmap,
+            TextureSampler(TextureSampler::MinFilter::NEAREST, TextureSampler::MagFilter::NEAREST));
+    mMaterialInstance->setParameter("levelCount", int32_t(mLevelCount));
+    // nothing is drawn until the first update()
+    const float4 levels[MAX_LEVELS] = {};
+    mMaterialInstance->setParameter("levels", levels, MAX_LEVELS);
+
+    // a single renderable, with one instance per level
+    mEntity = engine.getEntityManager().create();
+    RenderableManager::Builder(1)
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, mVertexBuffer, mIndexBuffer)
+            .material(0, mMaterialInstance)
+            .boundingBox({ float3{ 0.0f }, float3{ 0.0f } })
+            .instances(mLevelCount)
+            .castShadows(builder->mCastShadows)
+            .receiveShadows(builder->mReceiveShadows)
+            .build(engine, mEntity);
+}
+
+void FTerrain::terminate(FEngine& engine) noexcept {
+    // use Engine::destroy because FEngine::destroy is inlined
+    Engine& e = engine;
+    e.destroy(mEntity);
+    e.destroy(mMaterialInstance);
+    e.destroy(mClipmap);
+    e.destroy(mVertexBuffer);
+    e.destroy(mIndexBuffer);
+
+    engine.getEntityManager().destroy(mEntity);
+    mEntity = {};
+}
+
+void FTerrain::computeLevels(double2 viewer, uint32_t m, Level* levels, size_t count) noexcept {
+    // A level's origin is even, i.e. on a sample of the next level, and its center is within
+    // one sample of the viewer. The finer level is then 'm - 1' or 'm' quads from the origin,
+    // and the trim fills the other side of the hole.
+    int2 finer = {};
+    for (size_t l = 0; l < count; l++) {
+        const double2 v = viewer / double(1u << l);
+        const int2 g = { int32_t(std::floor(v.x * 0.5)), int32_t(std::floor(v.y * 0.5)) };
+        levels[l].origin = g * 2 - int32_t(2 * m - 2);
+        if (l == 0) {
+            levels[l].mask = (1u << RING) | (1u << CENTER);
+        } else {
+            const bool xHigh = (finer.x & 1) == 0;
+            const bool yHigh = (finer.y & 1) == 0;
+            uint32_t mask = (1u << RING) | (1u << (xHigh ? TRIM_X_HIGH : TRIM_X_LOW));
+            if (yHigh) {
+                mask |= (1u << TRIM_Y_HIGH) |
+                        (1u << (xHigh ? TRIM_Y_HIGH_END_LOW : TRIM_Y_HIGH_END_HIGH));
+            } else {
+                mask |= (1u << TRIM_Y_LOW) |
+                        (1u << (xHigh ? TRIM_Y_LOW_END_LOW : TRIM_Y_LOW_END_HIGH));
+            }
+            levels[l].mask = mask;
+        }
+        finer = g;
+    }
+}
+
+void FTerrain::uploadRegion(FEngine& engine, size_t level,
+        int32_t x, int32_t y, uint32_t width, uint32_t height) const {
+    // the region wraps around the edges of the layer at most once in each direction
+    Heightfield const& heightfield = mHeightfields[level];
+    const float twoSpacing = 2.0f * mSpacing * float(1u << level);
+    const uint32_t mask = mResolution - 1;
+    for (uint32_t j = 0; j < height;) {
+        const uint32_t ty = uint32_t(y + int32_t(j)) & mask;
+        const uint32_t h = std::min(height - j, mResolution - ty);
+        for (uint32_t i = 0; i < width;) {
+            const uint32_t tx = uint32_t(x + int32_t(i)) & mask;
+            const uint32_t w = std::min(width - i, mResolution - tx);
+            const size_t size = size_t(w) * h * sizeof(float4);
+            float4* const texels = static_cast<float4*>(malloc(size));
+            for (uint32_t r = 0; r < h; r++) {
+                for (uint32_t c = 0; c < w; c++) {
+                    const int32_t sx = x + int32_t(i + c);
+                    const int32_t sy = y + int32_t(j + r);
+                    const float3 n = normalize(float3{
+                            heightfield.get(sx - 1, sy) - heightfield.get(sx + 1, sy),
+                            twoSpacing,
+                            heightfield.get(sx, sy - 1) - heightfield.get(sx, sy + 1) });
+                    texels[r * w + c] = float4{ n, heightfield.get(sx, sy) };
+                }
+            }
+            mClipmap->setImage(engine, 0, tx, ty, uint32_t(level), w, h, 1,
+                    { texels, size, PixelDataFormat::RGBA, PixelDataType::FLOAT, freeBuffer });
+            i += w;
+        }
+        j += h;
+    }
+}
+
+void FTerrain::update(FEngine& engine, FCamera const& camera) {
+    // the camera in the space of the terrain, computed in double precision so that it's
+    // accurate when both are far from the origin
+    mat4 cameraModel = camera.getModelMatrixAccurate();
+    FTransformManager const& tcm = engine.getTransformManager();
+    FTransformManager::Instance ti = tcm.getInstance(mEntity);
+    if (ti) {
+        cameraModel = inverse(tcm.getWorldTransformAccurate(ti)) * cameraModel;
+    }
+    const double2 viewer = double2{ cameraModel[3].x, cameraModel[3].z } / double(mSpacing);
+
+    const uint32_t m = mResolution / 4;
+    Level levels[MAX_LEVELS];
+    computeLevels(viewer, m, levels, mLevelCount);
+
+    // only the rows and columns that entered the levels are uploaded
+    const int32_t size = int32_t(mResolution);
+    for (size_t l = 0; l < mLevelCount; l++) {
+        const int2 o = levels[l].origin;
+        const int2 old = mResident[l];
+        if (!mHasResidents || std::abs(o.x - old.x) >= size || std::abs(o.y - old.y) >= size) {
+            uploadRegion(engine, l, o.x, o.y, mResolution, mResolution);
+        } else {
+            if (o.x > old.x) {
+                uploadRegion(engine, l, old.x + size, o.y, uint32_t(o.x - old.x), mResolution);
+            } else if (o.x < old.x) {
+                uploadRegion(engine, l, o.x, o.y, uint32_t(old.x - o.x), mResolution);
+            }
+            // the columns that were already resident
+            const int32_t x0 = std::max(o.x, old.x);
+            const int32_t x1 = std::min(o.x, old.x) + size;
+            if (o.y > old.y) {
+                uploadRegion(engine, l, x0, old.y + size, uint32_t(x1 - x0), uint32_t(o.y - old.y));
+            } else if (o.y < old.y) {
+                uploadRegion(engine, l, x0, o.y, uint32_t(x1 - x0), uint32_t(old.y - o.y));
+            }
+        }
+        mResident[l] = o;
+    }
+    mHasResidents = true;
+
+    float4 params[MAX_LEVELS] = {};
+    for (size_t l = 0; l < mLevelCount; l++) {
+        params[l] = { float2(levels[l].origin), mSpacing * float(1u << l), float(levels[l].mask) };
+    }
+    // the levels morph into the next one over a tenth of their size, up to their outer edge
+    const float morphWidth = std::max(1.0f, float(4 * m - 2) / 10.0f);
+    mMaterialInstance->setParameter("levels", params, MAX_LEVELS);
+    mMaterialInstance->setParameter("viewer", float4{
+            float2(viewer * double(mSpacing)), float(2 * m - 2) - morphWidth, 1.0f / morphWidth });
+
+    // the coarsest level encloses the others
+    const size_t coarsest = mLevelCount - 1u;
+    const float spacing = params[coarsest].z;
+    const float2 min = float2(levels[coarsest].origin) * spacing;
+    const float2 max = min + float(4 * m - 2) * spacing;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    rcm.setAxisAlignedBoundingBox(rcm.getInstance(mEntity), Box().set(
+            { min.x, mMinHeight, min.y }, { max.x, mMaxHeight, max.y }));
+}
+
+FMaterial const* FTerrain::createMaterial(FEngine& engine) {
+    return upcast(Material::Builder().package(
+            (void*)TERRAIN_MATERIAL_PACKAGE, sizeof(TERRAIN_MATERIAL_PACKAGE)).build(engine));
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+Entity Terrain::getEntity() const noexcept {
+    return upcast(this)->getEntity();
+}
+
+MaterialInstance* Terrain::getMaterialInstance() noexcept {
+    return upcast(this)->getMaterialInstance();
+}
+
+void Terrain::update(Engine& engine, Camera const& camera) {
+    upcast(this)->update(upcast(engine), upcast(camera));
+}
+
+} // namespace filament
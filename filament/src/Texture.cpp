@@ -16,6 +16,7 @@
 
 #include "details/Texture.h"
 
+#include "details/DestroyBatch.h"
 #include "details/Engine.h"
 #include "details/Stream.h"
 
@@ -37,6 +38,8 @@ struct Texture::BuilderDetails {
     InternalFormat mFormat = InternalFormat::RGBA8;
     bool mRgbm = false;
     Usage mUsage = Usage::DEFAULT;
+    StreamingCallback mStreamingCallback = nullptr;
+    void* mStreamingUser = nullptr;
 };
 
 using BuilderType = Texture;
@@ -88,6 +91,13 @@ Texture::Builder& Texture::Builder::usage(Texture::Usage usage) noexcept {
     return *this;
 }
 
+Texture::Builder& Texture::Builder::streaming(
+        Texture::StreamingCallback callback, void* user) noexcept {
+    mImpl->mStreamingCallback = callback;
+    mImpl->mStreamingUser = user;
+    return *this;
+}
+
 Texture* Texture::Builder::build(Engine& engine) {
     if (!ASSERT_POSTCONDITION_NON_FATAL(Texture::isTextureFormatSupported(engine, mImpl->mFormat),
             "Texture format %u not supported on this platform", mImpl->mFormat)) {
@@ -112,16 +122,44 @@ FTexture::FTexture(FEngine& engine, const Builder& builder) {
             static_cast<uint8_t>(std::ilogbf(std::max(mWidth, mHeight)) + 1));
 
     FEngine::DriverApi& driver = engine.getDriverApi();
-    mHandle = driver.createTexture(
-            mTarget, mLevels, mFormat, mSampleCount, mWidth, mHeight, mDepth, mUsage);
+    const bool streaming = builder->mStreamingCallback && mTarget == Sampler::SAMPLER_2D;
+    if (streaming && mUsage == Usage::DEFAULT && mSampleCount == 1) {
+        // the levels not streamed in don't take any memory, where sparse textures are supported
+        mHandle = driver.createSparseTexture(mLevels, mFormat, mWidth, mHeight);
+    } else {
+        mHandle = driver.createTexture(
+                mTarget, mLevels, mFormat, mSampleCount, mWidth, mHeight, mDepth, mUsage);
+    }
+
+    if (streaming) {
+        mStreamingCallback = builder->mStreamingCallback;
+        mStreamingUser = builder->mStreamingUser;
+        // nothing is sampled until the coarsest level is uploaded
+        mMinLevel = uint8_t(mLevels - 1);
+        driver.setMinMaxLevels(mHandle, mMinLevel, mMinLevel);
+        commitLevels(engine, mMinLevel);
+        engine.getTextureStreamer().add(this);
+    }
 }
 
 // frees driver resources, object becomes invalid
 void FTexture::terminate(FEngine& engine) {
+    if (isStreaming()) {
+        engine.getTextureStreamer().remove(this);
+    }
+    engine.getMipmapGenerator().remove(this);
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.destroyTexture(mHandle);
 }
 
+void FTexture::terminate(FEngine& engine, DestroyBatch& batch) {
+    if (isStreaming()) {
+        engine.getTextureStreamer().remove(this);
+    }
+    engine.getMipmapGenerator().remove(this);
+    batch.add(mHandle);
+}
+
 static inline size_t valueForLevel(size_t level, size_t value) {
     return std::max(size_t(1), value >> level);
 }
@@ -135,16 +173,41 @@ size_t FTexture::getHeight(size_t level) const noexcept {
 }
 
 size_t FTexture::getDepth(size_t level) const noexcept {
-    return valueForLevel(level, mDepth);
+    // the layers of an array don't shrink with the levels
+    return mTarget == Sampler::SAMPLER_2D_ARRAY ? mDepth : valueForLevel(level, mDepth);
 }
 
 void FTexture::setImage(FEngine& engine,
         size_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         Texture::PixelBufferDescriptor&& buffer) const noexcept {
-    if (!mStream && mTarget != Sampler::SAMPLER_CUBEMAP && level < mLevels) {
+    if (!mStream && mTarget != Sampler::SAMPLER_CUBEMAP &&
+            mTarget != Sampler::SAMPLER_2D_ARRAY && mTarget != Sampler::SAMPLER_3D &&
+            level < mLevels) {
         if (buffer.buffer) {
+            if (isStreaming()) {
+                // the level must be backed by memory before it's uploaded
+                commitLevels(engine, std::min(level, size_t(mCommittedLevel)));
+            }
             engine.getDriverApi().load2DImage(mHandle,
                     uint8_t(level), xoffset, yoffset, width, height, std::move(buffer));
+            engine.getFrameCounters().add(FrameCounters::TEXTURE_UPLOADS);
+            if (isStreaming()) {
+                updateResidency(engine, level);
+            }
+        }
+    }
+}
+
+void FTexture::setImage(FEngine& engine, size_t level,
+        uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        Texture::PixelBufferDescriptor&& buffer) const noexcept {
+    if ((mTarget == Sampler::SAMPLER_2D_ARRAY || mTarget == Sampler::SAMPLER_3D) &&
+            level < mLevels && zoffset + depth <= getDepth(level)) {
+        if (buffer.buffer) {
+            engine.getDriverApi().load3DImage(mHandle, uint8_t(level),
+                    xoffset, yoffset, zoffset, width, height, depth, std::move(buffer));
+            engine.getFrameCounters().add(FrameCounters::TEXTURE_UPLOADS);
         }
     }
 }
@@ -155,8 +218,83 @@ void FTexture::setImage(FEngine& engine, size_t level,
         if (buffer.buffer) {
             engine.getDriverApi().loadCubeImage(mHandle, uint8_t(level),
                     std::move(buffer), faceOffsets);
+            engine.getFrameCounters().add(FrameCounters::TEXTURE_UPLOADS);
+        }
+    }
+}
+
+void FTexture::updateResidency(FEngine& engine, size_t level) const noexcept {
+    mResidentLevels |= 1u << level;
+    if (mPendingLevel == level) {
+        mPendingLevel = NO_LEVEL;
+    }
+
+    // sample the levels from the coarsest down to the first missing one
+    size_t minLevel = mLevels;
+    while (minLevel > 0 && (mResidentLevels & (1u << (minLevel - 1)))) {
+        minLevel--;
+    }
+    mMinLevel = uint8_t(std::min(minLevel, size_t(mLevels - 1)));
+
+    // the commands are executed in order, so the clamp is updated once the upload completes
+    engine.getDriverApi().setMinMaxLevels(mHandle, mMinLevel, mLevels - 1u);
+}
+
+size_t FTexture::getLevelForSize(float pixels) const noexcept {
+    // assumes the texture is mapped once across the renderable, which gives one texel per pixel
+    const float size = float(std::max(mWidth, mHeight));
+    if (!(pixels < size)) {
+        return 0;
+    }
+    const float level = std::log2(size / std::max(pixels, 1.0f));
+    return std::min(size_t(level), size_t(mLevels - 1));
+}
+
+void FTexture::requestLevel(size_t level) const noexcept {
+    uint8_t current = mRequestedLevel.load(std::memory_order_relaxed);
+    while (level < current && !mRequestedLevel.compare_exchange_weak(current, uint8_t(level),
+            std::memory_order_relaxed)) {
+    }
+}
+
+size_t FTexture::getLevelSize(size_t level) const noexcept {
+    // compressed formats report 0, count them as one byte per texel
+    return getWidth(level) * getHeight(level) * std::max(getFormatSize(mFormat), size_t(1));
+}
+
+size_t FTexture::getResidentSize() const noexcept {
+    size_t size = 0;
+    for (size_t level = 0; level < mLevels; level++) {
+        if (mResidentLevels & (1u << level)) {
+            size += getLevelSize(level);
         }
     }
+    return size;
+}
+
+void FTexture::streamNextLevel(FEngine& engine) noexcept {
+    assert(mMinLevel > 0 && mPendingLevel == NO_LEVEL);
+    mPendingLevel = uint8_t(mMinLevel - 1);
+    // the memory of the level is taken now, the TextureStreamer accounts for it already
+    commitLevels(engine, std::min(mPendingLevel, mCommittedLevel));
+    mStreamingCallback(this, mPendingLevel, mStreamingUser);
+}
+
+void FTexture::evictMinLevel(FEngine& engine) noexcept {
+    assert(mMinLevel < mLevels - 1);
+    mMinLevel++;
+    // the finer levels are released too, they're not sampled
+    mResidentLevels &= ~((1u << mMinLevel) - 1u);
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    driver.setMinMaxLevels(mHandle, mMinLevel, mLevels - 1u);
+    commitLevels(engine, mMinLevel);
+}
+
+void FTexture::commitLevels(FEngine& engine, size_t minLevel) const noexcept {
+    if (minLevel != mCommittedLevel) {
+        mCommittedLevel = uint8_t(minLevel);
+        engine.getDriverApi().commitTextureLevels(mHandle, uint32_t(minLevel));
+    }
 }
 
 void FTexture::setExternalImage(FEngine& engine, void* image) noexcept {
@@ -180,12 +318,22 @@ void FTexture::setExternalStream(FEngine& engine, FStream* stream) noexcept {
 }
 
 void FTexture::generateMipmaps(FEngine& engine) const noexcept {
-    if ((mTarget == Sampler::SAMPLER_2D || mTarget == Sampler::SAMPLER_CUBEMAP)
-            && mLevels > 1) {
+    if ((mTarget == Sampler::SAMPLER_2D || mTarget == Sampler::SAMPLER_CUBEMAP ||
+            mTarget == Sampler::SAMPLER_2D_ARRAY || mTarget == Sampler::SAMPLER_3D) &&
+            mLevels > 1) {
         engine.getDriverApi().generateMipmaps(mHandle);
     }
 }
 
+bool FTexture::generateMipmapsAsync(FEngine& engine,
+        MipmapsCallback callback, void* user) noexcept {
+    if (!MipmapGenerator::isSupported(this)) {
+        return false;
+    }
+    engine.getMipmapGenerator().add(this, callback, user);
+    return true;
+}
+
 bool FTexture::isTextureFormatSupported(FEngine& engine, InternalFormat format) noexcept {
     return engine.getDriverApi().isTextureFormatSupported(format);
 }
@@ -332,6 +480,14 @@ void Texture::setImage(Engine& engine,
             level, xoffset, yoffset, width, height, std::move(buffer));
 }
 
+void Texture::setImage(Engine& engine, size_t level,
+        uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& buffer) const noexcept {
+    upcast(this)->setImage(upcast(engine),
+            level, xoffset, yoffset, zoffset, width, height, depth, std::move(buffer));
+}
+
 void Texture::setImage(Engine& engine, size_t level,
         Texture::PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept {
     upcast(this)->setImage(upcast(engine), level, std::move(buffer), faceOffsets);
@@ -349,6 +505,11 @@ void Texture::generateMipmaps(Engine& engine) const noexcept {
     upcast(this)->generateMipmaps(upcast(engine));
 }
 
+bool Texture::generateMipmapsAsync(Engine& engine,
+        MipmapsCallback callback, void* user) noexcept {
+    return upcast(this)->generateMipmapsAsync(upcast(engine), callback, user);
+}
+
 bool Texture::isTextureFormatSupported(Engine& engine, InternalFormat format) noexcept {
     return FTexture::isTextureFormatSupported(upcast(engine), format);
 }
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextureStreamer.h"
+
+#include "details/Engine.h"
+#include "details/Texture.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+namespace filament {
+
+using namespace details;
+
+void TextureStreamer::add(FTexture* texture) {
+    mTextures.push_back(texture);
+}
+
+void TextureStreamer::remove(FTexture* texture) noexcept {
+    auto pos = std::find(mTextures.begin(), mTextures.end(), texture);
+    if (pos != mTextures.end()) {
+        std::swap(*pos, mTextures.back());
+        mTextures.pop_back();
+    }
+}
+
+void TextureStreamer::update(FEngine& engine) {
+    if (mTextures.empty()) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    struct Candidate {
+        FTexture* texture;
+        // number of levels between the finest level sampled and the one needed, positive
+        // when more resolution is needed, negative when the texture has too much
+        int deficit;
+    };
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(mTextures.size());
+    size_t residentSize = 0;
+    for (FTexture* texture : mTextures) {
+        residentSize += texture->getResidentSize();
+        if (texture->getPendingLevel() != FTexture::NO_LEVEL) {
+            // it'll be resident soon enough
+            residentSize += texture->getLevelSize(texture->getPendingLevel());
+        }
+        const uint8_t requested = texture->takeRequestedLevel();
+        // textures that weren't drawn during the last frame need only their coarsest level
+        const size_t needed = requested != FTexture::NO_LEVEL ?
+                requested : texture->getLevels() - 1;
+        candidates.push_back({ texture, int(texture->getMinLevel()) - int(needed) });
+    }
+
+    // the most needed first, the most in excess last
+    std::sort(candidates.begin(), candidates.end(),
+            [](Candidate const& lhs, Candidate const& rhs) {
+                return lhs.deficit > rhs.deficit;
+            });
+
+    // the textures we can reclaim memory from, starting from the end
+    auto evictable = candidates.end();
+    auto evict = [&]() -> bool {
+        while (evictable != candidates.begin()) {
+            Candidate& c = *(evictable - 1);
+            FTexture* texture = c.texture;
+            if (c.deficit >= 0) {
+                return false;
+            }
+            if (texture->getPendingLevel() == FTexture::NO_LEVEL &&
+                    texture->getMinLevel() < texture->getLevels() - 1) {
+                residentSize -= texture->getLevelSize(texture->getMinLevel());
+                texture->evictMinLevel(engine);
+                c.deficit++;
+                return true;
+            }
+            --evictable;
+        }
+        return false;
+    };
+
+    // stay within the budget, e.g. after it was lowered
+    while (residentSize > mBudget && evict()) {
+    }
+
+    // request one level at a time per texture, the next ones will follow in later frames
+    size_t requestCount = 0;
+    for (auto it = candidates.begin();
+            it != evictable && it->deficit > 0 && requestCount < MAX_REQUESTS_PER_FRAME; ++it) {
+        FTexture* texture = it->texture;
+        if (texture->getPendingLevel() != FTexture::NO_LEVEL) {
+            continue;
+        }
+        const size_t size = texture->getLevelSize(texture->getMinLevel() - 1u);
+        while (residentSize + size > mBudget && evict()) {
+        }
+        if (residentSize + size > mBudget) {
+            break;
+        }
+        residentSize += size;
+        requestCount++;
+        texture->streamNextLevel(engine);
+    }
+}
+
+size_t TextureStreamer::trim(FEngine& engine) noexcept {
+    size_t size = 0;
+    for (FTexture* texture : mTextures) {
+        // the level being streamed is evicted once resident, by the next update()
+        if (texture->getPendingLevel() != FTexture::NO_LEVEL) {
+            continue;
+        }
+        while (texture->getMinLevel() < texture->getLevels() - 1) {
+            size += texture->getLevelSize(texture->getMinLevel());
+            texture->evictMinLevel(engine);
+        }
+    }
+    return size;
+}
+
+} // namespace filament
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_TEXTURESTREAMER_H
+#define TNT_FILAMENT_TEXTURESTREAMER_H
+
+#include <vector>
+
+#include <stddef.h>
+
+namespace filament {
+
+namespace details {
+class FEngine;
+class FTexture;
+} // namespace details
+
+/*
+ * TextureStreamer decides, once per frame, which levels of the streaming textures are requested
+ * from the application and which are evicted, based on the levels the render passes asked for
+ * during the previous frame and on a memory budget.
+ */
+class TextureStreamer {
+    // the application is asked for at most this many levels per frame, to spread the uploads
+    static constexpr size_t MAX_REQUESTS_PER_FRAME = 4;
+
+    static constexpr size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+public:
+    void setBudget(size_t bytes) noexcept { mBudget = bytes; }
+    size_t getBudget() const noexcept { return mBudget; }
+
+    void add(details::FTexture* texture);
+    void remove(details::FTexture* texture) noexcept;
+
+    // true if no texture is streamed
+    bool empty() const noexcept { return mTextures.empty(); }
+
+    // call this once per frame, before the render passes record new requests
+    void update(details::FEngine& engine);
+
+    // evicts all the levels but the coarsest of each texture, they're streamed again once
+    // needed; returns their size in bytes
+    size_t trim(details::FEngine& engine) noexcept;
+
+private:
+    std::vector<details::FTexture*> mTextures;
+    size_t mBudget = DEFAULT_BUDGET;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_TEXTURESTREAMER_H
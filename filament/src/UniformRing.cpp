@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/UniformRing.h"
+
+#include "driver/DriverApi.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+namespace filament {
+
+using namespace driver;
+
+namespace details {
+
+static size_t alignSlotSize(size_t slotSize, size_t alignment) noexcept {
+    alignment = alignment ? alignment : UniformRing::DEFAULT_SLOT_ALIGNMENT;
+    return ((slotSize + alignment - 1) / alignment) * alignment;
+}
+
+UniformRing::UniformRing(size_t slotSize, size_t alignment) noexcept
+        : mSlotSize(alignSlotSize(slotSize, alignment)) {
+}
+
+void UniformRing::terminate(DriverApi& driver) {
+    for (Handle<HwUniformBuffer>& handle : mHandles) {
+        driver.destroyUniformBuffer(handle);
+        handle.clear();
+    }
+    mCapacity = 0;
+}
+
+UniformBuffer& UniformRing::allocate(size_t count) noexcept {
+    mUniforms = UniformBuffer(count * mSlotSize);
+    return mUniforms;
+}
+
+void UniformRing::commit(DriverApi& driver) noexcept {
+    const size_t size = mUniforms.getSize();
+    if (!size) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    if (UTILS_UNLIKELY(size > mCapacity)) {
+        // grow geometrically, so this doesn't happen every time a renderable becomes visible
+        mCapacity = std::max(size, mCapacity * 2);
+        for (Handle<HwUniformBuffer>& handle : mHandles) {
+            driver.destroyUniformBuffer(handle);
+            handle = driver.createUniformBuffer(mCapacity);
+        }
+    }
+
+    mCurrent = uint32_t((mCurrent + 1) % BUFFER_COUNT);
+    driver.updateUniformBuffer(mHandles[mCurrent], std::move(mUniforms));
+}
+
+} // namespace details
+} // namespace filament
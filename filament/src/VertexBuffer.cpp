@@ -16,6 +16,7 @@
 
 #include "details/VertexBuffer.h"
 
+#include "details/DestroyBatch.h"
 #include "details/Engine.h"
 
 #include "FilamentAPI-impl.h"
@@ -31,6 +32,7 @@ struct VertexBuffer::BuilderDetails {
     AttributeBitset mDeclaredAttributes;
     uint32_t mVertexCount = 0;
     uint8_t mBufferCount = 0;
+    BufferUsage mUsage = BufferUsage::STATIC;
 };
 
 static bool hasIntegerTarget(VertexAttribute attribute) {
@@ -55,6 +57,11 @@ VertexBuffer::Builder& VertexBuffer::Builder::bufferCount(uint8_t bufferCount) n
     return *this;
 }
 
+VertexBuffer::Builder& VertexBuffer::Builder::bufferUsage(BufferUsage usage) noexcept {
+    mImpl->mUsage = usage;
+    return *this;
+}
+
 VertexBuffer::Builder& VertexBuffer::Builder::attribute(VertexAttribute attribute,
         uint8_t bufferIndex,
         AttributeType attributeType,
@@ -124,6 +131,12 @@ FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& build
     mDeclaredAttributes = builder->mDeclaredAttributes;
     uint8_t attributeCount = (uint8_t) mDeclaredAttributes.count();
 
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    mHandle = driver.createVertexBuffer(
+            mBufferCount, attributeCount, mVertexCount, getAttributeArray(), builder->mUsage);
+}
+
+Driver::AttributeArray FVertexBuffer::getAttributeArray() const noexcept {
     Driver::AttributeArray attributeArray;
 
     static_assert(attributeArray.size() == MAX_ATTRIBUTE_BUFFERS_COUNT,
@@ -143,10 +156,7 @@ FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& build
             attributeArray[i].flags  = attributes[i].flags;
         }
     }
-
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    mHandle = driver.createVertexBuffer(
-            mBufferCount, attributeCount, mVertexCount, attributeArray);
+    return attributeArray;
 }
 
 void FVertexBuffer::terminate(FEngine& engine) {
@@ -154,6 +164,10 @@ void FVertexBuffer::terminate(FEngine& engine) {
     driver.destroyVertexBuffer(mHandle);
 }
 
+void FVertexBuffer::terminate(FEngine& engine, DestroyBatch& batch) {
+    batch.add(mHandle);
+}
+
 size_t FVertexBuffer::getVertexCount() const noexcept {
     return mVertexCount;
 }
@@ -27,6 +27,7 @@
 #include "details/Skybox.h"
 
 #include <filament/Exposure.h>
+#include <filament/driver/PixelBufferDescriptor.h>
 
 #include <utils/Allocator.h>
 #include <utils/Systrace.h>
@@ -36,6 +37,10 @@
 #include <math/scalar.h>
 #include <math/fast.h>
 
+#include <algorithm>
+
+#include <stdlib.h>
+
 using namespace math;
 using namespace utils;
 
@@ -52,15 +57,41 @@ static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
 static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
 static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
 
+// number of jitter positions used by the temporal upsampling
+static constexpr uint32_t TEMPORAL_JITTER_COUNT = 8;
+
+// set during culling, for renderables not hidden by the previous frame's depth buffer
+static constexpr size_t VISIBLE_OCCLUSION_BIT = 2u;
+static constexpr uint8_t VISIBLE_OCCLUSION = 1u << VISIBLE_OCCLUSION_BIT;
+static constexpr uint8_t VISIBLE_RENDERABLE_UNOCCLUDED = VISIBLE_RENDERABLE | VISIBLE_OCCLUSION;
+
+// set after partitioning, for the shadow casters seen by each cascade of the shadow map
+static constexpr size_t VISIBLE_SHADOW_CASCADE_BIT = 3u;
+static_assert(VISIBLE_SHADOW_CASCADE_BIT + CONFIG_MAX_SHADOW_CASCADES <= 8,
+        "not enough VISIBLE_MASK bits for the shadow cascades");
+
+// set after partitioning, for the shadow casters rendered in the shadow map's static cache
+static constexpr size_t VISIBLE_STATIC_BIT = 7u;
+static constexpr uint8_t VISIBLE_STATIC = 1u << VISIBLE_STATIC_BIT;
+static_assert(VISIBLE_SHADOW_CASCADE_BIT + CONFIG_MAX_SHADOW_CASCADES <= VISIBLE_STATIC_BIT,
+        "the shadow cascades and static casters VISIBLE_MASK bits overlap");
+
+// the previous frame's depth buffer is ignored if the camera moved more than this (in meters)
+// or rotated more than ~3 degrees since, because the disoccluded areas would be too large.
+static constexpr float OCCLUSION_MAX_CAMERA_TRANSLATION = 0.25f;
+static constexpr float OCCLUSION_MIN_CAMERA_ROTATION_COS = 0.9986f;
+
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(engine.getPerViewUib()),
       mPerViewSb(engine.getPerViewSib()),
       mClipSpace01(engine.getBackend() == Backend::VULKAN),
-      mDirectionalShadowMap(engine) {
+      mDirectionalShadowMap(engine),
+      mShadowAtlas(engine) {
     DriverApi& driverApi = engine.getDriverApi();
 
     mPerViewUbh = driverApi.createUniformBuffer(mPerViewUb.getSize());
+    mRightEyeUbh = driverApi.createUniformBuffer(mPerViewUb.getSize());
     mPerViewSbh = driverApi.createSamplerBuffer(mPerViewSb.getSize());
 
     mPerViewSb.setBuffer(FEngine::PerViewSib::RECORDS, mFroxelizer.getRecordBuffer());
@@ -83,9 +114,19 @@ void FView::terminate(FEngine& engine) {
     // Here we would cleanly free resources we've allocated or we own (currently none).
     DriverApi& driverApi = engine.getDriverApi();
     driverApi.destroyUniformBuffer(mPerViewUbh);
+    driverApi.destroyUniformBuffer(mRightEyeUbh);
     driverApi.destroySamplerBuffer(mPerViewSbh);
     mDirectionalShadowMap.terminate(driverApi);
+    mShadowAtlas.terminate(driverApi);
     mFroxelizer.terminate(driverApi);
+    mColorGrading.terminate(driverApi);
+    releaseTemporalTargets(engine.getRenderTargetPool());
+    releaseAutoExposure(driverApi);
+    if (mPickingTarget) {
+        driverApi.destroyRenderTarget(mPickingTarget);
+        driverApi.destroyTexture(mPickingTexture);
+    }
+    cancelPickingQueries();
 }
 
 void FView::setViewport(Viewport const& viewport) noexcept {
@@ -136,10 +177,50 @@ void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options)
     }
 }
 
+void FView::setFoveatedRenderingOptions(FoveatedRenderingOptions const& options) noexcept {
+    mFoveatedRendering = options;
+    mFoveatedRendering.focalPoint = clamp(options.focalPoint, float2(-1.0f), float2(1.0f));
+    mFoveatedRendering.gain = max(options.gain, float2(0.0f));
+    mFoveatedRendering.foveaArea = std::max(options.foveaArea, 0.0f);
+}
+
+void FView::setAutoExposureOptions(AutoExposureOptions const& options) noexcept {
+    mAutoExposureOptions = options;
+    mAutoExposureOptions.range.y = std::max(options.range.x, options.range.y);
+    mAutoExposureOptions.adaptationRateUp = std::max(options.adaptationRateUp, 0.0f);
+    mAutoExposureOptions.adaptationRateDown = std::max(options.adaptationRateDown, 0.0f);
+}
+
+void FView::getFoveation(RenderPassParams& params) const noexcept {
+    FoveatedRenderingOptions const& options = mFoveatedRendering;
+    if (!options.enabled) {
+        return;
+    }
+    params.foveaGain = options.gain;
+    params.foveaArea = options.foveaArea;
+    if (isStereoscopic()) {
+        // the eyes are side by side, each half of the viewport has its own focal point,
+        // the gain is doubled horizontally to keep the fall-off in the eye's coordinates
+        const float2 f = options.focalPoint;
+        params.focalPoints[0] = { (f.x - 1.0f) * 0.5f, f.y };
+        params.focalPoints[1] = { (f.x + 1.0f) * 0.5f, f.y };
+        params.foveaGain.x *= 2.0f;
+        params.focalPointCount = 2;
+    } else {
+        params.focalPoints[0] = options.focalPoint;
+        params.focalPointCount = 1;
+    }
+}
+
 void FView::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     mFroxelizer.setOptions(zLightNear, zLightFar);
 }
 
+void FView::setFroxelOptions(FroxelOptions const& options) noexcept {
+    mFroxelizer.setFroxelOptions(options);
+    updateOcclusionDepth();
+}
+
 
 math::float2 FView::updateScale(duration frameTime) noexcept {
     DynamicResolutionOptions const& options = mDynamicResolution;
@@ -256,8 +337,8 @@ bool FView::isSkyboxVisible() const noexcept {
     return skybox != nullptr && (skybox->getLayerMask() & mVisibleLayers);
 }
 
-void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
+void FView::prepareShadowing(FEngine& engine, FScene::RenderableSoa& renderableData,
+        FScene::LightSoa const& lightData) noexcept {
     SYSTRACE_CALL();
 
     // setup shadow mapping
@@ -273,28 +354,62 @@ void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
     if (UTILS_UNLIKELY(mHasShadowing)) {
         // compute the frustum for this light
         ShadowMap& shadowMap = mDirectionalShadowMap;
-        shadowMap.update(lightData, 0, scene, mViewingCameraInfo, mVisibleLayers);
+        shadowMap.update(lightData, 0, scene, mSceneSnapshot, mViewingCameraInfo,
+                mVisibleLayers);
         if (shadowMap.hasVisibleShadows()) {
-            // Cull shadow casters
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum);
+            const float constantBias = lcm.getShadowConstantBias(directionalLight);
+            const float normalBias = lcm.getShadowNormalBias(directionalLight);
+            float4 constantBiases = 0;
+            float4 normalBiases = 0;
+            for (size_t c = 0, n = shadowMap.getCascadeCount(); c < n; c++) {
+                if (!shadowMap.hasVisibleShadows(c)) {
+                    continue;
+                }
 
-            // allocates shadowmap driver resources
-            shadowMap.prepare(driver, getUs());
+                // Cull shadow casters, for all cascades at once
+                Frustum const& frustum = shadowMap.getCamera(c).getFrustum();
+                prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum);
 
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
+                mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix(c);
+                u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix) +
+                        c * sizeof(mat4f), lightFromWorldMatrix);
 
-            // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
-            // needed with other APIs, but at least it won't worsen the acnee there.
-            const float sceneRange = shadowMap.getSceneRange();
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
-            const float constantBias = lcm.getShadowConstantBias(directionalLight);
-            const float normalBias = lcm.getShadowNormalBias(directionalLight);
-            u.setUniform(offsetof(FEngine::PerViewUib, shadowBias),
-                    float3{ 2 * constantBias / sceneRange, normalBias * texelSizeWorldSpace, 0 });
+                // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
+                // needed with other APIs, but at least it won't worsen the acnee there.
+                const float sceneRange = shadowMap.getSceneRange(c);
+                const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace(c);
+                constantBiases[c] = 2 * constantBias / sceneRange;
+                normalBiases[c] = normalBias * texelSizeWorldSpace;
+            }
+            cullShadowCastersWithReceivers(engine.getJobSystem(), renderableData);
+
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowCascadeSplits),
+                    shadowMap.getCascadeSplits());
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowConstantBias), constantBiases);
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowNormalBias), normalBiases);
         }
     }
+    // the receivers sample the moments instead of the depth with variance shadows
+    u.setUniform(offsetof(FEngine::PerViewUib, vsmExponent),
+            mDirectionalShadowMap.isVsm() ? ShadowMap::VSM_EXPONENT : 0.0f);
+
+    // spot lights, in the shadow atlas
+    ShadowAtlas& shadowAtlas = mShadowAtlas;
+    if (mShadowingEnabled) {
+        shadowAtlas.update(lightData, mViewingCameraInfo);
+    } else {
+        shadowAtlas.clear();
+    }
+    for (size_t i = 0, c = shadowAtlas.getTileCount(); i < c; i++) {
+        // Cull shadow casters, for all the spot lights at once
+        Frustum const& frustum = shadowAtlas.getCamera(i).getFrustum();
+        prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum);
+
+        u.setUniform(offsetof(FEngine::PerViewUib, spotLightFromWorldMatrix) + i * sizeof(mat4f),
+                shadowAtlas.getLightSpaceMatrix(i));
+        u.setUniform(offsetof(FEngine::PerViewUib, spotShadowBias) + i * sizeof(float4),
+                shadowAtlas.getShadowBias(i));
+    }
 }
 
 void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena,
@@ -305,10 +420,10 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     const CameraInfo& camera = mViewingCameraInfo;
     FScene* const scene = mScene;
 
-    scene->prepareDynamicLights(camera, arena);
+    scene->prepareDynamicLights(mSceneSnapshot, camera, arena, mShadowAtlas);
 
     // here the array of visible lights has been shrunk to CONFIG_MAX_LIGHT_COUNT
-    auto const& lightData = scene->getLightData();
+    auto const& lightData = getLightData();
 
     // trace the number of visible lights
     SYSTRACE_VALUE32("visibleLights", lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
@@ -336,6 +451,29 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
                 FIndirectLight::DEFAULT_INTENSITY * exposure);
     }
 
+    // Irradiance volume. The fragments' positions include the world origin, it's removed before
+    // mapping the volume's bounds to [0, 1]. This is computed in double precision.
+    if (ibl && ibl->getIrradianceVolume()) {
+        Box const& bounds = ibl->getIrradianceVolumeBounds();
+        const double3 size{ bounds.halfExtent * 2.0f };
+        const double3 origin{ bounds.getMin() };
+        const mat4 volumeFromWorld = mat4::scale(1.0 / size) * mat4::translate(-origin) *
+                inverse(getWorldOriginTransform(engine));
+        const float depth = float(ibl->getIrradianceVolumeDepth());
+        u.setUniform(offsetof(FEngine::PerViewUib, irradianceVolumeFromWorldMatrix),
+                mat4f{ volumeFromWorld });
+        u.setUniform(offsetof(FEngine::PerViewUib, irradianceVolumeParams),
+                float4{ 1.0f, depth, 1.0f / (9.0f * depth), 0.0f });
+        SamplerParams volumeSamplerParams;
+        volumeSamplerParams.filterMag = SamplerMagFilter::LINEAR;
+        volumeSamplerParams.filterMin = SamplerMinFilter::LINEAR;
+        mPerViewSb.setSampler(FEngine::PerViewSib::IRRADIANCE_VOLUME,
+                { ibl->getIrradianceVolume(), volumeSamplerParams });
+    } else {
+        u.setUniform(offsetof(FEngine::PerViewUib, irradianceVolumeParams), float4{});
+        mPerViewSb.setSampler(FEngine::PerViewSib::IRRADIANCE_VOLUME, {});
+    }
+
     // Directional light (always at index 0)
     auto& lcm = engine.getLightManager();
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
@@ -378,30 +516,38 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     }
 }
 
-void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
-        Viewport const& viewport) noexcept {
-    JobSystem& js = engine.getJobSystem();
-
-    /*
-     * Prepare the scene -- this is where we gather all the objects added to the scene,
-     * and in particular their world-space AABB.
-     */
-
-    FScene* const scene = getScene();
-
+mat4 FView::getWorldOriginTransform(FEngine& engine) const noexcept {
     /*
      * We apply a "world origin" to "everything" in order to implement the IBL rotation.
-     * The "world origin" could also be useful for other things, like keeping the origin
-     * close to the camera position to improve fp precision in the shader for large scenes.
+     * With accurate translations, the world origin also keeps the origin close to the camera
+     * position to improve fp precision for large scenes. It's computed in double precision.
      */
-    mat4f worldOriginScene;
-    FIndirectLight const* const ibl = scene->getIndirectLight();
+    mat4 worldOriginScene;
+    FIndirectLight const* const ibl = mScene->getIndirectLight();
     if (ibl) {
         // the IBL transformation must be a rigid transform
-        mat3f rotation{ scene->getIndirectLight()->getRotation() };
+        mat3 rotation{ ibl->getRotation() };
         // for a rigid-body transform, the inverse is the transpose
-        worldOriginScene = mat4f{ transpose(rotation) };
+        worldOriginScene = mat4{ transpose(rotation) };
     }
+    if (UTILS_UNLIKELY(engine.getTransformManager().isAccurateTranslationsEnabled())) {
+        // The origin moves with the culling camera by whole steps, so the scene only needs to
+        // be re-transformed when the camera crosses a step, rather than every frame.
+        const double3 eye = mCullingCamera->getModelMatrixAccurate()[3].xyz;
+        const double3 origin = floor(eye / WORLD_ORIGIN_STEP + 0.5) * WORLD_ORIGIN_STEP;
+        worldOriginScene = worldOriginScene * mat4::translate(-origin);
+    }
+    return worldOriginScene;
+}
+
+void FView::prepareVisibility(FEngine& engine, bool prepareScene) noexcept {
+    SYSTRACE_CALL();
+    CpuStageTimings::Scope timing(engine.getCpuStageTimings(), CpuStageTimings::CULL);
+
+    JobSystem& js = engine.getJobSystem();
+
+    FScene* const scene = getScene();
+    const mat4 worldOriginScene = getWorldOriginTransform(engine);
 
     /*
      * Calculate all camera parameters needed to render this View for this frame.
@@ -411,10 +557,10 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     // Note: for debugging (i.e. visualize what the camera / objects are doing, using
     // the viewing camera), we can set worldOriginCamera to identity when mViewingCamera
     // is set: e.g.
-    //      worldOriginCamera = mViewingCamera ? mat4f{} : worldOriginScene
+    //      worldOriginCamera = mViewingCamera ? mat4{} : worldOriginScene
 
-    const mat4f worldOriginCamera = worldOriginScene;
-    const mat4f model{ worldOriginCamera * camera->getModelMatrix() };
+    const mat4 worldOriginCamera = worldOriginScene;
+    const mat4f model{ worldOriginCamera * camera->getModelMatrixAccurate() };
     mViewingCameraInfo = CameraInfo{
             // projection with infinite z-far
             .projection         = mat4f{ camera->getProjectionMatrix() },
@@ -431,42 +577,58 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
             // exposure
             .ev100              = Exposure::ev100(*camera),
             // world origin transform, use only for debugging
-            .worldOrigin        = worldOriginCamera
+            .worldOrigin        = mat4f{ worldOriginCamera }
     };
+    if (isStereoscopic()) {
+        for (size_t eye = 0; eye < 2; eye++) {
+            FCamera const* const eyeCamera = mEyeCameras[eye];
+            const mat4f eyeModel{ worldOriginCamera * eyeCamera->getModelMatrixAccurate() };
+            mEyeCameraInfos[eye] = CameraInfo{
+                    .projection         = mat4f{ eyeCamera->getProjectionMatrix() },
+                    .cullingProjection  = mat4f{ eyeCamera->getCullingProjectionMatrix() },
+                    .model              = eyeModel,
+                    .view               = FCamera::getViewMatrix(eyeModel),
+                    .zn                 = eyeCamera->getNear(),
+                    .zf                 = eyeCamera->getCullingFar(),
+                    // both eyes are exposed like the View's camera
+                    .ev100              = mViewingCameraInfo.ev100,
+                    .worldOrigin        = mat4f{ worldOriginCamera }
+            };
+        }
+    }
     mCullingFrustum = FCamera::getFrustum(
             mCullingCamera->getCullingProjectionMatrix(),
-            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
+            FCamera::getViewMatrix(
+                    mat4f{ worldOriginScene * mCullingCamera->getModelMatrixAccurate() }));
 
     /*
-     * Gather all information needed to render this scene. Apply the world origin to all
-     * objects in the scene.
+     * Prepare the scene -- this is where we gather all the objects added to the scene, and in
+     * particular their world-space AABB. Apply the world origin to all objects in the scene.
      */
-    scene->prepare(worldOriginScene);
+    if (prepareScene) {
+        scene->prepare(worldOriginScene);
+    }
 
     /*
-     * Culling: as soon as possible we perform our camera-culling
-     * (this will set the VISIBLE_RENDERABLE bit)
+     * Culling of the renderables and of the lights, followed by shadowing. See
+     * buildVisibilityGraph().
      */
 
-    FScene::RenderableSoa& renderableData = scene->getRenderableData();
-    Slice<Culler::result_type> cullingMask = renderableData.slice<FScene::VISIBLE_MASK>();
-    std::fill(cullingMask.begin(), cullingMask.end(), 0); // TODO: can we avoid this fill?
-    prepareVisibleRenderables(js, renderableData);
-
-    /*
-     * Shadowing: compute the shadow camera and cull shadow casters
-     * (this will set the VISIBLE_SHADOW_CASTER bit)
-     */
+    if (UTILS_UNLIKELY(!mVisibilityGraph.getTaskCount())) {
+        buildVisibilityGraph(engine);
+    }
+    mVisibilityGraph.runAndWait(js);
 
-    prepareShadowing(engine, driver, renderableData, scene->getLightData());
+    FScene::RenderableSoa& renderableData = getRenderableData();
+    Slice<Culler::result_type> cullingMask = renderableData.slice<FScene::VISIBLE_MASK>();
 
     /*
      * partition the array of renderable w.r.t their visibility:
      *
-     * Sort the SoA so that invisible objects are first, then renderables,
-     * then both renderable and casters, then casters only -- this operation is somewhat heavy
-     * as it sorts the whole SoA. We use std::partition instead of sort(), which gives us
-     * O(3.N) instead of O(N.log(N)) application of swap().
+     * Sort the SoA so that renderables are first, then both renderable and casters, then casters
+     * only, then invisible objects -- this operation is somewhat heavy as it swaps the whole
+     * elements of the SoA. Only the renderables that aren't already in their group are moved,
+     * once each, so this is cheap when the visibility doesn't change much from frame to frame.
      */
 
     // calculate the sorting key for all elements, based on their visibility
@@ -475,27 +637,84 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     computeVisibilityMasks(getVisibleLayers(), layers, visibility, cullingMask.begin(),
             renderableData.size());
 
-    auto const beginRenderables = renderableData.begin();
-    auto beginCasters = partition(beginRenderables, renderableData.end(), VISIBLE_RENDERABLE);
-    auto beginCastersOnly = partition(beginCasters, renderableData.end(), VISIBLE_ALL);
-    auto endCastersOnly = partition(beginCastersOnly, renderableData.end(), VISIBLE_SHADOW_CASTER);
+    uint32_t ends[3];
+    partitionByVisibility(renderableData, ends);
+    mVisibleRenderables = Range{ 0, ends[1] };
+    mVisibleShadowCasters = Range{ ends[0], ends[2] };
 
-    // convert to indices
-    uint32_t iEnd = uint32_t(endCastersOnly - beginRenderables);
-    mVisibleRenderables = Range{ 0, uint32_t(beginCastersOnly - beginRenderables) };
-    mVisibleShadowCasters = Range{ uint32_t(beginCasters - beginRenderables), iEnd };
-    Range merged = { 0, iEnd };
+    // the draw counts are added up by the passes rendering this frame
+    mRenderStatistics = {
+            .renderableCount = uint32_t(renderableData.size()),
+            .visibleRenderableCount = uint32_t(mVisibleRenderables.size()),
+            .visibleShadowCasterCount = uint32_t(mVisibleShadowCasters.size()) };
+    FrameCounters& counters = engine.getFrameCounters();
+    counters.add(FrameCounters::VISIBLE_RENDERABLES, mVisibleRenderables.size());
+    counters.add(FrameCounters::VISIBLE_SHADOW_CASTERS, mVisibleShadowCasters.size());
 
-    // update those UBOs
-    scene->updateUBOs(merged);
+    /*
+     * Shadow cascades: find which of the visible casters each cascade sees, now that they're
+     * in a contiguous range (this will set the VISIBLE_SHADOW_CASCADE bits)
+     */
+
+    prepareShadowCascades(js, renderableData);
+}
+
+void FView::buildVisibilityGraph(FEngine& engine) {
+    JobGraph& graph = mVisibilityGraph;
+    graph.setCoreClass(JobSystem::CoreClass::BIG);
 
     /*
-     * Light culling
-     *
-     * TODO: this could be done in parallel with culling above
+     * Culling: as soon as possible we perform our camera-culling
+     * (this will set the VISIBLE_RENDERABLE bit)
+     * Occlusion culling: test the visible renderables against the previous frame's depth
+     * (this will set the VISIBLE_OCCLUSION bit)
      */
 
-    prepareVisibleLights(engine.getLightManager(), js, scene->getLightData());
+    JobGraph::Task renderables = graph.add([this](JobSystem& js, JobSystem::Job*) {
+        FScene::RenderableSoa& renderableData = getRenderableData();
+        Slice<Culler::result_type> cullingMask = renderableData.slice<FScene::VISIBLE_MASK>();
+        std::fill(cullingMask.begin(), cullingMask.end(), 0); // TODO: can we avoid this fill?
+        prepareVisibleRenderables(js, renderableData);
+        prepareOcclusion(js, renderableData);
+    });
+
+    /*
+     * Light culling, the spot lights casting shadows are picked among the visible ones.
+     * This only touches the lights, so it runs concurrently with the culling above.
+     */
+
+    JobGraph::Task lights = graph.add([this, &engine](JobSystem& js, JobSystem::Job*) {
+        prepareVisibleLights(engine.getLightManager(), js, getLightData());
+    });
+
+    /*
+     * Shadowing: compute the shadow cameras and cull shadow casters
+     * (this will set the VISIBLE_SHADOW_CASTER bit)
+     */
+
+    graph.then({ renderables, lights }, [this, &engine](JobSystem&, JobSystem::Job*) {
+        prepareShadowing(engine, getRenderableData(), getLightData());
+    });
+}
+
+void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
+        Viewport const& viewport) noexcept {
+    SYSTRACE_CALL();
+    CpuStageTimings::Scope timing(engine.getCpuStageTimings(), CpuStageTimings::PREPARE);
+
+    FScene* const scene = getScene();
+
+    if (UTILS_UNLIKELY(mHasShadowing && mDirectionalShadowMap.hasVisibleShadows())) {
+        // allocates shadowmap driver resources
+        mDirectionalShadowMap.prepare(driver, getUs());
+    }
+    if (UTILS_UNLIKELY(mShadowAtlas.hasVisibleShadows())) {
+        mShadowAtlas.prepare(driver, getUs());
+    }
+
+    // update those UBOs, they're all uploaded at once
+    const Range merged = { 0, mVisibleShadowCasters.last };
+    scene->updateUBOs(mSceneSnapshot, merged);
 
     /*
      * Prepare lighting -- this is where we update the lights UBOs, set-up the IBL,
@@ -503,7 +722,9 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
      * Relies on FScene::prepare() and prepareVisibleLights()
      */
 
-    prepareLighting(engine, driver, arena, viewport);
+    // in stereo, the froxels are those of an eye's half of the viewport
+    prepareLighting(engine, driver, arena,
+            isStereoscopic() ? getEyeViewport(viewport, 0) : viewport);
 
     /*
      * Update driver state
@@ -512,9 +733,8 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     float fraction = (engine.getTime().count() % 1000000000) / 1000000000.0f;
     getUb().setUniform(offsetof(FEngine::PerViewUib, time), fraction);
 
-    // upload the renderables's dirty UBOs
-    engine.getRenderableManager().prepare(driver,
-            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+    // upload the renderables's bones
+    engine.getRenderableManager().prepare(driver);
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
@@ -533,7 +753,9 @@ void FView::computeVisibilityMasks(
         Culler::result_type mask = visibleMask[i];
         FRenderableManager::Visibility v = visibility[i];
         bool inVisibleLayer = layers[i] & visibleLayers;
-        bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE))    && inVisibleLayer;
+        bool visRenderables   = (!v.culling ||
+                (mask & VISIBLE_RENDERABLE_UNOCCLUDED) == VISIBLE_RENDERABLE_UNOCCLUDED) &&
+                inVisibleLayer;
         bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_CASTER)) && inVisibleLayer && v.castShadows;
         visibleMask[i] = Culler::result_type(visRenderables) |
                          Culler::result_type(visShadowCasters << 1);
@@ -541,22 +763,56 @@ void FView::computeVisibilityMasks(
 }
 
 UTILS_NOINLINE
-/* static */ FScene::RenderableSoa::iterator FView::partition(
-        FScene::RenderableSoa::iterator begin,
-        FScene::RenderableSoa::iterator end,
-        uint8_t mask) noexcept {
-    return std::partition(begin, end, [mask](auto it) {
-        return it.template get<FScene::VISIBLE_MASK>() == mask;
-    });
-}
-
-void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept {
-    SYSTRACE_CALL();
+/* static */ void FView::partitionByVisibility(FScene::RenderableSoa& renderableData,
+        uint32_t ends[3]) noexcept {
+    // group of each value of the visibility mask, see computeVisibilityMasks()
+    static constexpr uint8_t GROUPS[4] = {
+            3,      // invisible
+            0,      // VISIBLE_RENDERABLE
+            2,      // VISIBLE_SHADOW_CASTER
+            1,      // VISIBLE_ALL
+    };
 
-    const mat4f viewFromWorld(camera.view);
-    const mat4f worldFromView(camera.model);
-    const mat4f projectionMatrix(camera.projection);
+    Culler::result_type const* const masks = renderableData.data<FScene::VISIBLE_MASK>();
+    const uint32_t count = uint32_t(renderableData.size());
+
+    // This is vectorized.
+    uint32_t renderableCount = 0;
+    uint32_t allCount = 0;
+    uint32_t casterCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const Culler::result_type mask = masks[i];
+        renderableCount += mask == VISIBLE_RENDERABLE ? 1 : 0;
+        allCount        += mask == VISIBLE_ALL ? 1 : 0;
+        casterCount     += mask == VISIBLE_SHADOW_CASTER ? 1 : 0;
+    }
+    ends[0] = renderableCount;
+    ends[1] = ends[0] + allCount;
+    ends[2] = ends[1] + casterCount;
+
+    // In each group, everything before next[] is in place. A renderable found in the wrong group
+    // is swapped with the first misplaced one of its own group, which there is since it isn't
+    // there. Once the first three groups are in place, so is the last one.
+    uint32_t next[4] = { 0, ends[0], ends[1], ends[2] };
+    for (uint32_t group = 0; group < 3; group++) {
+        uint32_t i = next[group];
+        while (i < ends[group]) {
+            const uint8_t target = GROUPS[masks[i] & VISIBLE_ALL];
+            if (target == group) {
+                i++;
+                continue;
+            }
+            uint32_t& j = next[target];
+            while (GROUPS[masks[j] & VISIBLE_ALL] == target) {
+                j++;
+            }
+            renderableData.swap(i, j++);
+        }
+        next[group] = i;
+    }
+}
 
+mat4f FView::getClipFromView(mat4f const& projection) const noexcept {
     // In Vulkan, clip-space Z is [0,w] rather than [-w,+w] and Y is flipped.
     // See https://matthewwellings.com/blog/the-new-vulkan-coordinate-system/
     const math::mat4f correction(math::mat4f::row_major_init{
@@ -565,8 +821,23 @@ void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) co
             0.0f,  0.0f, 0.5f, 0.5f,
             0.0f,  0.0f, 0.0f, 1.0f,
     });
+    return mClipSpace01 ? correction * projection : projection;
+}
+
+void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport,
+        float2 jitter) const noexcept {
+    SYSTRACE_CALL();
+
+    const mat4f viewFromWorld(camera.view);
+    const mat4f worldFromView(camera.model);
 
-    const mat4f clipFromView(mClipSpace01 ? correction * projectionMatrix : projectionMatrix);
+    mat4f clipFromView(getClipFromView(camera.projection));
+    if (jitter.x != 0.0f || jitter.y != 0.0f) {
+        // offset the whole image, in the clip space of the backend so that the jitter is in
+        // the same direction as the post-process' texture coordinates
+        const float2 offset = 2.0f * jitter / float2{ viewport.width, viewport.height };
+        clipFromView = mat4f::translate(float3{ offset, 0.0f }) * clipFromView;
+    }
     const mat4f viewFromClip(Camera::inverseProjection(clipFromView));
     const mat4f clipFromWorld(clipFromView * viewFromWorld);
 
@@ -585,12 +856,155 @@ void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) co
     u.setUniform(offsetof(FEngine::PerViewUib, cameraPosition), float3{camera.getPosition()});
 }
 
+static float halton(uint32_t i, uint32_t base) noexcept {
+    float f = 1.0f;
+    float r = 0.0f;
+    while (i > 0) {
+        f /= float(base);
+        r += f * float(i % base);
+        i /= base;
+    }
+    return r;
+}
+
+void FView::prepareTemporalUpsampling(FEngine& engine, bool upsampled,
+        TextureFormat format) noexcept {
+    RenderTargetPool& pool = engine.getRenderTargetPool();
+    Viewport const& vp = mViewport;
+    auto& targets = mTemporalTargets;
+
+    // the history is lost when the view isn't upsampled or its output changes
+    if (targets[0] && (!upsampled ||
+            targets[0]->format != format || mTemporalUpsampling.width != vp.width ||
+            mTemporalUpsampling.height != vp.height)) {
+        releaseTemporalTargets(pool);
+    }
+    if (!upsampled) {
+        mTemporalJitter = 0.0f;
+        return;
+    }
+
+    const size_t current = mTemporalFrame & 1u;
+    for (auto& target : targets) {
+        if (!target) {
+            target = pool.get(TargetBufferFlags::COLOR, vp.width, vp.height, 1, format);
+        }
+    }
+
+    // Halton(2, 3) sequence, in [-0.5, 0.5] pixels of the scaled viewport
+    const uint32_t index = (mTemporalFrame % TEMPORAL_JITTER_COUNT) + 1;
+    mTemporalJitter = float2{ halton(index, 2), halton(index, 3) } - 0.5f;
+
+    CameraInfo const& camera = mViewingCameraInfo;
+    const mat4f clipFromView(getClipFromView(camera.projection));
+    const mat4f clipFromWorld(clipFromView * camera.view);
+    const mat4f worldFromClip(camera.model * Camera::inverseProjection(clipFromView));
+
+    PostProcessManager::TemporalUpsampling& temporal = mTemporalUpsampling;
+    temporal.history = mTemporalHistoryValid ? targets[current ^ 1u]->texture : Handle<HwTexture>{};
+    temporal.target = targets[current]->target;
+    temporal.texture = targets[current]->texture;
+    temporal.width = vp.width;
+    temporal.height = vp.height;
+    temporal.reprojection = mTemporalClipFromWorld * worldFromClip;
+    temporal.jitter = mTemporalJitter;
+
+    mTemporalClipFromWorld = clipFromWorld;
+    mTemporalHistoryValid = true;
+    mTemporalFrame++;
+}
+
+void FView::releaseTemporalTargets(RenderTargetPool& pool) noexcept {
+    for (auto& target : mTemporalTargets) {
+        if (target) {
+            pool.put(target);
+            target = nullptr;
+        }
+    }
+    mTemporalHistoryValid = false;
+}
+
+void FView::prepareAutoExposure(FEngine& engine, bool enabled) noexcept {
+    DriverApi& driver = engine.getDriverApi();
+    if (!enabled) {
+        releaseAutoExposure(driver);
+        return;
+    }
+
+    using AutoExposure = PostProcessManager::AutoExposure;
+    auto& textures = mAutoExposureTextures;
+    auto& targets = mAutoExposureTargets;
+    if (!textures[0]) {
+        // the reductions, then this frame's and the previous frame's exposures
+        uint32_t size = AutoExposure::SIZE;
+        for (size_t i = 0; i < AUTO_EXPOSURE_TARGET_COUNT; i++) {
+            textures[i] = driver.createTexture(SamplerType::SAMPLER_2D, 1, TextureFormat::R16F,
+                    1, size, size, 1, TextureUsage::COLOR_ATTACHMENT);
+            targets[i] = driver.createRenderTarget(TargetBufferFlags::COLOR, size, size, 1,
+                    TextureFormat::R16F, { textures[i] }, {}, {});
+            size = std::max(size / 4, 1u);
+        }
+    }
+
+    // the time step of the adaptation, the first frame has no history to adapt from
+    const auto now = engine.getTime();
+    const float dt = std::chrono::duration<float>(now - mAutoExposureTime).count();
+    mAutoExposureTime = now;
+
+    const size_t current = AutoExposure::REDUCTION_COUNT + (mAutoExposureFrame & 1u);
+    const size_t previous = AutoExposure::REDUCTION_COUNT + (~mAutoExposureFrame & 1u);
+    AutoExposure& params = mAutoExposure;
+    for (size_t i = 0; i < AutoExposure::REDUCTION_COUNT; i++) {
+        params.reductionTargets[i] = targets[i];
+        params.reductionTextures[i] = textures[i];
+    }
+    params.history = mAutoExposureHistoryValid ? textures[previous] : Handle<HwTexture>{};
+    params.target = targets[current];
+    params.texture = textures[current];
+    params.range = mAutoExposureOptions.range;
+    params.compensation = mAutoExposureOptions.compensation;
+    params.rateUp = mAutoExposureOptions.adaptationRateUp;
+    params.rateDown = mAutoExposureOptions.adaptationRateDown;
+    params.dt = std::max(dt, 0.0f);
+
+    mAutoExposureHistoryValid = true;
+    mAutoExposureFrame++;
+}
+
+void FView::releaseAutoExposure(DriverApi& driver) noexcept {
+    for (size_t i = 0; i < AUTO_EXPOSURE_TARGET_COUNT; i++) {
+        if (mAutoExposureTextures[i]) {
+            driver.destroyRenderTarget(mAutoExposureTargets[i]);
+            driver.destroyTexture(mAutoExposureTextures[i]);
+            mAutoExposureTargets[i].clear();
+            mAutoExposureTextures[i].clear();
+        }
+    }
+    mAutoExposureHistoryValid = false;
+}
+
+void FView::prepareOrderIndependentTransparency(bool enabled) const noexcept {
+    getUb().setUniform(offsetof(FEngine::PerViewUib, orderIndependentTransparency),
+            enabled ? 1.0f : 0.0f);
+}
+
 void FView::froxelize(FEngine& engine) const noexcept {
     SYSTRACE_CALL();
+    CpuStageTimings::Scope timing(engine.getCpuStageTimings(), CpuStageTimings::FROXELIZE);
 
     if (mHasDynamicLighting) {
-        // froxelize lights
-        mFroxelizer.froxelizeLights(engine, mViewingCameraInfo, mScene->getLightData());
+        // froxelize lights, bounded by the depth buffer read back if we can
+        HiZBuffer const* depth = nullptr;
+        float depthMargin = 0.0f;
+        if (mFroxelizer.getFroxelOptions().depthBounds && isOcclusionDepthUsable()) {
+            depth = &mOcclusionDepth->hiz;
+            depthMargin = length(mViewingCameraInfo.model[3].xyz -
+                    mOcclusionDepth->cameraModel[3].xyz);
+        }
+        mFroxelizer.froxelizeLights(engine, mViewingCameraInfo, getLightData(),
+                depth, depthMargin);
+        engine.getFrameCounters().add(FrameCounters::FROXEL_RECORDS,
+                mFroxelizer.getStatistics().recordCount);
     }
 }
 
@@ -606,6 +1020,11 @@ void FView::commitUniforms(driver::DriverApi& driverApi) const noexcept {
     }
 }
 
+void FView::commitRightEyeUniforms(driver::DriverApi& driverApi) const noexcept {
+    // this leaves the uniforms dirty, the View's buffer is updated by the next commitUniforms()
+    driverApi.updateUniformBuffer(mRightEyeUbh, UniformBuffer(mPerViewUb));
+}
+
 void FView::commitFroxels(driver::DriverApi& driverApi) const noexcept {
     if (mHasDynamicLighting) {
         mFroxelizer.commit(driverApi);
@@ -617,7 +1036,9 @@ void FView::prepareVisibleRenderables(JobSystem& js,
         FScene::RenderableSoa& renderableData) const noexcept {
     SYSTRACE_CALL();
     if (UTILS_LIKELY(isCullingEnabled())) {
-        cullRenderables(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        if (!mScene->cullRenderables(mSceneSnapshot, mCullingFrustum, VISIBLE_RENDERABLE_BIT)) {
+            cullRenderables(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        }
     } else {
         std::fill(renderableData.begin<FScene::VISIBLE_MASK>(),
                   renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
@@ -628,7 +1049,393 @@ UTILS_NOINLINE
 void FView::prepareVisibleShadowCasters(JobSystem& js,
         FScene::RenderableSoa& renderableData, Frustum const& lightFrustum) const noexcept {
     SYSTRACE_CALL();
-    cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    if (!mScene->cullRenderables(mSceneSnapshot, lightFrustum, VISIBLE_SHADOW_CASTER_BIT)) {
+        cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    }
+}
+
+void FView::cullShadowCastersWithReceivers(JobSystem& js,
+        FScene::RenderableSoa& renderableData) const noexcept {
+    SYSTRACE_CALL();
+
+    // The light frustums contain casters that can't shadow anything visible, e.g. behind the
+    // camera or off to its sides. Only those in the caster volume of a cascade are kept, this
+    // must run before the spot lights' casters are culled, since they share the bit.
+    ShadowMap const& shadowMap = mDirectionalShadowMap;
+    ShadowMap::CasterVolume const* volumes[CONFIG_MAX_SHADOW_CASCADES];
+    size_t volumeCount = 0;
+    for (size_t c = 0, n = shadowMap.getCascadeCount(); c < n; c++) {
+        if (shadowMap.hasVisibleShadows(c)) {
+            if (!shadowMap.getCasterVolume(c).planeCount) {
+                return; // this cascade doesn't cull, and the casters are in one of the frustums
+            }
+            volumes[volumeCount++] = &shadowMap.getCasterVolume(c);
+        }
+    }
+    if (!volumeCount) {
+        return;
+    }
+
+    // the static cache doesn't depend on the camera, its casters are all kept
+    const bool keepStatic = shadowMap.hasStaticCache();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // culling job (this runs on multiple threads)
+    auto functor = [&volumes, volumeCount, keepStatic, worldAABBCenter, worldAABBExtent,
+            visibility, visibleArray](uint32_t index, uint32_t c) {
+        for (uint32_t i = index; i < index + c; i++) {
+            if (!(visibleArray[i] & VISIBLE_SHADOW_CASTER) ||
+                    (keepStatic && visibility[i].staticGeometry)) {
+                continue;
+            }
+            bool visible = false;
+            for (size_t v = 0; v < volumeCount && !visible; v++) {
+                visible = volumes[v]->intersects(worldAABBCenter[i], worldAABBExtent[i]);
+            }
+            if (!visible) {
+                visibleArray[i] &= ~VISIBLE_SHADOW_CASTER;
+            }
+        }
+    };
+
+    // the ranges start on a cache line of the visibility array, so jobs don't share them
+    auto job = jobs::parallel_for(js, nullptr, renderableData,
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.setCoreClass(job, JobSystem::CoreClass::BIG);
+    js.runAndWait(job);
+}
+
+void FView::prepareShadowCascades(JobSystem& js,
+        FScene::RenderableSoa& renderableData) const noexcept {
+    ShadowMap const& shadowMap = mDirectionalShadowMap;
+    if (!hasShadowing()) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    Range const& range = mVisibleShadowCasters;
+    if (shadowMap.hasStaticCache()) {
+        auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+        uint8_t* visibleMask = renderableData.data<FScene::VISIBLE_MASK>();
+        for (uint32_t i = range.first; i < range.last; i++) {
+            visibleMask[i] |= uint8_t(visibility[i].staticGeometry << VISIBLE_STATIC_BIT);
+        }
+    }
+
+    // with a single cascade, the cascade bit is only needed to tell the directional light's
+    // casters from the spot lights' ones
+    if (shadowMap.getCascadeCount() == 1 && !hasShadowAtlas()) {
+        return;
+    }
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    const size_t cascadeCount = shadowMap.getCascadeCount();
+    const bool keepStatic = shadowMap.hasStaticCache();
+
+    // culling job (this runs on multiple threads)
+    auto functor = [&shadowMap, cascadeCount, keepStatic, worldAABBCenter, worldAABBExtent,
+            visibility, visibleArray](uint32_t index, uint32_t c) {
+        for (size_t cascade = 0; cascade < cascadeCount; cascade++) {
+            if (shadowMap.hasVisibleShadows(cascade)) {
+                Culler::intersects(
+                        visibleArray + index,
+                        shadowMap.getCamera(cascade).getFrustum(),
+                        worldAABBCenter + index,
+                        worldAABBExtent + index, c, VISIBLE_SHADOW_CASCADE_BIT + cascade);
+
+                // then only keep the casters that can shadow the cascade's visible receivers
+                ShadowMap::CasterVolume const& volume = shadowMap.getCasterVolume(cascade);
+                if (!volume.planeCount) {
+                    continue;
+                }
+                const uint8_t bit = uint8_t(1u << (VISIBLE_SHADOW_CASCADE_BIT + cascade));
+                for (uint32_t i = index; i < index + c; i++) {
+                    if ((visibleArray[i] & bit) &&
+                            !(keepStatic && visibility[i].staticGeometry) &&
+                            !volume.intersects(worldAABBCenter[i], worldAABBExtent[i])) {
+                        visibleArray[i] &= ~bit;
+                    }
+                }
+            }
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, range.first, uint32_t(range.size()),
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.setCoreClass(job, JobSystem::CoreClass::BIG);
+    js.runAndWait(job);
+}
+
+uint8_t FView::getShadowCascadeVisibilityMask(size_t cascade) const noexcept {
+    // with a single cascade, all the visible casters are in it, unless spot lights cast shadows
+    return mDirectionalShadowMap.getCascadeCount() == 1 && !hasShadowAtlas() ?
+            VISIBLE_SHADOW_CASTER :
+            uint8_t(1u << (VISIBLE_SHADOW_CASCADE_BIT + cascade));
+}
+
+uint8_t FView::getStaticShadowCasterMask() const noexcept {
+    return VISIBLE_STATIC;
+}
+
+uint8_t FView::prepareShadowAtlasTile(JobSystem& js,
+        FScene::RenderableSoa& renderableData, size_t tile) const noexcept {
+    SYSTRACE_CALL();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    Frustum const& frustum = mShadowAtlas.getCamera(tile).getFrustum();
+
+    // culling job (this runs on multiple threads)
+    auto functor = [&frustum, worldAABBCenter, worldAABBExtent, visibleArray]
+            (uint32_t index, uint32_t c) {
+        for (uint32_t i = index; i < index + c; i++) {
+            visibleArray[i] &= ~uint8_t(1u << VISIBLE_SHADOW_CASCADE_BIT);
+        }
+        Culler::intersects(visibleArray + index, frustum,
+                worldAABBCenter + index, worldAABBExtent + index, c, VISIBLE_SHADOW_CASCADE_BIT);
+    };
+
+    Range const& range = mVisibleShadowCasters;
+    auto job = jobs::parallel_for(js, nullptr, range.first, uint32_t(range.size()),
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.setCoreClass(job, JobSystem::CoreClass::BIG);
+    js.runAndWait(job);
+
+    return uint8_t(1u << VISIBLE_SHADOW_CASCADE_BIT);
+}
+
+bool FView::isOcclusionDepthUsable() const noexcept {
+    // in stereo, the depth buffer holds both eyes
+    if (mViewingCamera || isStereoscopic() || !mOcclusionDepth || mOcclusionDepth->hiz.empty()) {
+        return false;
+    }
+    // be conservative when the camera moves fast
+    mat4f const& previous = mOcclusionDepth->cameraModel;
+    mat4f const& current = mViewingCameraInfo.model;
+    return length(current[3].xyz - previous[3].xyz) <= OCCLUSION_MAX_CAMERA_TRANSLATION &&
+           dot(normalize(current[2].xyz), normalize(previous[2].xyz)) >=
+                   OCCLUSION_MIN_CAMERA_ROTATION_COS;
+}
+
+UTILS_NOINLINE
+void FView::prepareOcclusion(JobSystem& js,
+        FScene::RenderableSoa& renderableData) const noexcept {
+    SYSTRACE_CALL();
+
+    uint8_t* const visibleArray = renderableData.data<FScene::VISIBLE_MASK>();
+    if (!mOcclusionCulling || !mCulling || !isOcclusionDepthUsable()) {
+        for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+            visibleArray[i] |= VISIBLE_OCCLUSION;
+        }
+        return;
+    }
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    HiZBuffer const& hiz = mOcclusionDepth->hiz;
+
+    // only the renderables which passed frustum culling are tested (this runs on multiple threads)
+    auto functor = [&hiz, worldAABBCenter, worldAABBExtent, visibleArray]
+            (uint32_t index, uint32_t c) {
+        hiz.cull(visibleArray + index, worldAABBCenter + index, worldAABBExtent + index, c,
+                VISIBLE_RENDERABLE, VISIBLE_OCCLUSION_BIT);
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, renderableData,
+            std::ref(functor), jobs::CountSplitter<256, 8>());
+    js.setCoreClass(job, JobSystem::CoreClass::BIG);
+    js.runAndWait(job);
+}
+
+void FView::readOcclusionDepth(driver::DriverApi& driver, Handle<HwRenderTarget> target,
+        Viewport const& viewport) const noexcept {
+    struct Readback {
+        std::shared_ptr<OcclusionDepth> destination;
+        mat4f clipFromWorld;
+        mat4f cameraModel;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    if (!mOcclusionDepth) {
+        return;
+    }
+
+    const uint32_t width = viewport.width;
+    const uint32_t height = viewport.height;
+    const size_t size = width * height * sizeof(float);
+    float* const depth = (float*)malloc(size);
+    // if the read-back fails, this leaves a depth buffer that doesn't occlude anything
+    std::fill_n(depth, width * height, 1.0f);
+
+    // the callback is called when the engine purges the buffers the driver is done with, the
+    // view may not exist anymore by then, which is why the destination is shared.
+    Readback* const readback = new Readback{ mOcclusionDepth,
+            mViewingCameraInfo.projection * mViewingCameraInfo.view,
+            mViewingCameraInfo.model, width, height };
+
+    driver.readPixels(target, uint32_t(viewport.left), uint32_t(viewport.bottom), width, height,
+            PixelBufferDescriptor(depth, size,
+                    PixelDataFormat::DEPTH_COMPONENT, PixelDataType::FLOAT,
+                    [](void* buffer, size_t, void* user) {
+                        Readback* const readback = static_cast<Readback*>(user);
+                        OcclusionDepth& destination = *readback->destination;
+                        destination.hiz.build(static_cast<float const*>(buffer),
+                                readback->width, readback->height, readback->clipFromWorld);
+                        destination.cameraModel = readback->cameraModel;
+                        free(buffer);
+                        delete readback;
+                    }, readback));
+}
+
+void FView::setOcclusionCulling(bool enabled) noexcept {
+    mOcclusionCulling = enabled;
+    updateOcclusionDepth();
+}
+
+void FView::updateOcclusionDepth() noexcept {
+    // the depth buffer is read back for both occlusion culling and the froxels depth bounds
+    const bool enabled = mOcclusionCulling || mFroxelizer.getFroxelOptions().depthBounds;
+    if (enabled && !mOcclusionDepth) {
+        mOcclusionDepth = std::make_shared<OcclusionDepth>();
+    } else if (!enabled) {
+        // pending read-backs keep their own reference
+        mOcclusionDepth.reset();
+    }
+}
+
+void FView::pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback,
+        void* user) noexcept {
+    mPickingQueries.push_back({ x, y, callback, user });
+}
+
+Handle<HwRenderTarget> FView::preparePicking(FEngine& engine) noexcept {
+    SYSTRACE_CALL();
+
+    if (!mPickingTarget) {
+        DriverApi& driver = engine.getDriverApi();
+        mPickingTexture = driver.createTexture(SamplerType::SAMPLER_2D, 1,
+                TextureFormat::DEPTH32F, 1, PICKING_CANDIDATE_COUNT, PICKING_QUERY_COUNT, 1,
+                TextureUsage::DEPTH_ATTACHMENT);
+        mPickingTarget = driver.createRenderTarget(TargetBufferFlags::DEPTH,
+                PICKING_CANDIDATE_COUNT, PICKING_QUERY_COUNT, 1, TextureFormat::DEPTH32F,
+                {}, { mPickingTexture }, {});
+    }
+
+    // the other queries wait for the next frames
+    auto last = mPickingQueries.begin() + std::min(mPickingQueries.size(),
+            size_t(PICKING_QUERY_COUNT));
+    mServedPickingQueries.assign(mPickingQueries.begin(), last);
+    mPickingQueries.erase(mPickingQueries.begin(), last);
+
+    FScene::RenderableSoa const& renderableData = getRenderableData();
+    auto const* instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    FRenderableManager const& rcm = engine.getRenderableManager();
+
+    CameraInfo const& camera = mViewingCameraInfo;
+    const float3 eye = camera.model[3].xyz;
+    const float2 size{ mViewport.width, mViewport.height };
+    for (PickingQuery& query : mServedPickingQueries) {
+        query.candidateCount = 0;
+        if (query.x >= mViewport.width || query.y >= mViewport.height) {
+            continue;
+        }
+
+        // scales and moves the clip space so that the pixel covers it, the depth is unchanged
+        const float2 center = (float2{ query.x, query.y } + 0.5f) / size * 2.0f - 1.0f;
+        mat4f pixel;
+        pixel[0][0] = size.x;
+        pixel[1][1] = size.y;
+        pixel[3][0] = -center.x * size.x;
+        pixel[3][1] = -center.y * size.y;
+        query.camera = camera;
+        query.camera.projection = pixel * camera.projection;
+        query.camera.cullingProjection = pixel * camera.cullingProjection;
+        const Frustum frustum(query.camera.cullingProjection * camera.view);
+
+        // keeps the renderables closest to the camera, sorted by the distance to their box
+        float distances[PICKING_CANDIDATE_COUNT];
+        uint32_t count = 0;
+        for (uint32_t i = mVisibleRenderables.first; i < mVisibleRenderables.last; i++) {
+            if (!frustum.intersects(Box{ worldAABBCenter[i], worldAABBExtent[i] })) {
+                continue;
+            }
+            const float distance = length(worldAABBCenter[i] - eye) - length(worldAABBExtent[i]);
+            if (count == PICKING_CANDIDATE_COUNT) {
+                if (distance >= distances[count - 1]) {
+                    continue;
+                }
+                count--;
+            }
+            uint32_t j = count++;
+            for (; j > 0 && distances[j - 1] > distance; j--) {
+                distances[j] = distances[j - 1];
+                query.candidates[j] = query.candidates[j - 1];
+            }
+            distances[j] = distance;
+            query.candidates[j] = i;
+        }
+        query.candidateCount = count;
+
+        // the renderables could be destroyed before the read-back
+        for (uint32_t c = 0; c < count; c++) {
+            query.entities[c] = rcm.getEntity(instances[query.candidates[c]]);
+        }
+    }
+    return mPickingTarget;
+}
+
+void FView::readPicking(DriverApi& driver) noexcept {
+    const uint32_t width = PICKING_CANDIDATE_COUNT;
+    const uint32_t height = uint32_t(mServedPickingQueries.size());
+    const size_t size = width * height * sizeof(float);
+    float* const depth = (float*)malloc(size);
+    // if the read-back fails, the queries find no renderable
+    std::fill_n(depth, width * height, 1.0f);
+
+    // the callback is called when the engine purges the buffers the driver is done with
+    auto* const queries = new std::vector<PickingQuery>(std::move(mServedPickingQueries));
+    mServedPickingQueries.clear();
+
+    driver.readPixels(mPickingTarget, 0, 0, width, height,
+            PixelBufferDescriptor(depth, size,
+                    PixelDataFormat::DEPTH_COMPONENT, PixelDataType::FLOAT,
+                    [](void* buffer, size_t, void* user) {
+                        auto* const queries = static_cast<std::vector<PickingQuery>*>(user);
+                        float const* row = static_cast<float const*>(buffer);
+                        for (PickingQuery const& query : *queries) {
+                            PickingQueryResult result;
+                            for (uint32_t c = 0; c < query.candidateCount; c++) {
+                                if (row[c] < result.depth) {
+                                    result = { query.entities[c], row[c] };
+                                }
+                            }
+                            query.callback(result, query.user);
+                            row += PICKING_CANDIDATE_COUNT;
+                        }
+                        free(buffer);
+                        delete queries;
+                    }, queries));
+}
+
+void FView::cancelPickingQueries() noexcept {
+    // the callbacks may queue new queries
+    std::vector<PickingQuery> queries;
+    queries.swap(mPickingQueries);
+    for (PickingQuery const& query : queries) {
+        query.callback(PickingQueryResult{}, query.user);
+    }
 }
 
 void FView::cullRenderables(JobSystem& js,
@@ -649,20 +1456,26 @@ void FView::cullRenderables(JobSystem& js,
     };
 
     // launch the computation on multiple threads
-    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
+    // the ranges start on a cache line of the visibility array, so jobs don't share them
+    auto job = jobs::parallel_for(js, nullptr, renderableData,
             std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.setCoreClass(job, JobSystem::CoreClass::BIG);
     js.runAndWait(job);
 }
 
 void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::LightSoa& lightData) const {
 
     auto const* UTILS_RESTRICT sphereArray     = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT boundsArray     = lightData.data<FScene::BOUNDING_SPHERE>();
     auto const* UTILS_RESTRICT directions      = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instanceArray   = lightData.data<FScene::LIGHT_INSTANCE>();
     auto      * UTILS_RESTRICT visibleArray    = lightData.data<FScene::VISIBILITY>();
 
+    // the spot lights are tested with the bounding sphere of their cone first
     Frustum const& frustum = mCullingFrustum;
-    Culler::intersects(visibleArray, frustum, sphereArray, lightData.size());
+    if (!mScene->cullLights(mSceneSnapshot, frustum)) {
+        Culler::intersects(visibleArray, frustum, boundsArray, lightData.size());
+    }
 
     const float4* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
     // the directional light is considered visible
@@ -711,14 +1524,71 @@ void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::
     mHasDynamicLighting = visibleLightCount > FScene::DIRECTIONAL_LIGHTS_COUNT;
 }
 
-void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
+void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo& camera,
         FScene::RenderableSoa& renderableData, Range visibles) noexcept {
-    FRenderableManager const& rcm = engine.getRenderableManager();
-    for (uint32_t index : visibles) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
-        auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
-        renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
+    SYSTRACE_CALL();
+
+    FRenderableManager& rcm = engine.getRenderableManager();
+    JobSystem& js = engine.getJobSystem();
+
+    // A bounding sphere of radius r covers r * p[1][1] / d of the viewport's height at a
+    // distance d with a perspective projection, and r * p[1][1] with an orthographic one.
+    const float scale = camera.projection[1][1];
+    const bool perspective = camera.projection[3][3] == 0;
+    const float3 position = camera.getPosition();
+    const float zn = camera.zn;
+
+    auto const* const UTILS_RESTRICT instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    mat4f const* const UTILS_RESTRICT transforms = renderableData.data<FScene::WORLD_TRANSFORM>();
+    float3 const* const UTILS_RESTRICT centers = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* const UTILS_RESTRICT extents = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto* const UTILS_RESTRICT primitives = renderableData.data<FScene::PRIMITIVES>();
+    uint32_t const* const UTILS_RESTRICT slots = renderableData.data<FScene::BVH_SLOT>();
+
+    // the levels selected last are forgotten when the slots change meaning, the renderables then
+    // get the level of their coverage without hysteresis
+    FScene const& scene = *mScene;
+    if (mLodScene != &scene || mLodGatherCount != scene.getGatherCount() ||
+            mLodLevels.size() != renderableData.size()) {
+        mLodLevels.assign(renderableData.size(), 0);
+        mLodScene = &scene;
+        mLodGatherCount = scene.getGatherCount();
     }
+    uint8_t* const UTILS_RESTRICT levels = mLodLevels.data();
+
+    // the renderables replaced by their impostor are drawn by the impostor's renderable, with
+    // the transforms collected here
+    engine.resetImpostors();
+
+    auto work = [&rcm, scale, perspective, position, zn,
+            instances, transforms, centers, extents, primitives, slots, levels]
+            (uint32_t startIndex, uint32_t indexCount) {
+        for (uint32_t i = startIndex, e = startIndex + indexCount; i < e; i++) {
+            auto ri = instances[i];
+            uint8_t level = 0;
+            const size_t levelCount = rcm.getLevelCount(ri);
+            FImpostor* const impostor = rcm.getImpostor(ri);
+            if (UTILS_UNLIKELY(levelCount > 1 || impostor)) {
+                const float radius = length(extents[i]);
+                const float distance = perspective ?
+                        std::max(zn, length(centers[i] - position)) : 1.0f;
+                level = rcm.selectLevelOfDetail(ri, radius * scale / distance, levels[slots[i]]);
+                levels[slots[i]] = level;
+            }
+            if (UTILS_LIKELY(level < levelCount)) {
+                primitives[i] = rcm.getRenderPrimitives(ri, level);
+            } else {
+                primitives[i] = {};
+                impostor->add(transforms[i]);
+            }
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, visibles.first, uint32_t(visibles.size()),
+            std::cref(work), jobs::CountSplitter<128, 8>());
+    js.runAndWait(job);
+
+    engine.commitImpostors();
 }
 
 } // namespace details
@@ -746,6 +1616,14 @@ Camera& View::getCamera() noexcept {
     return upcast(this)->getCameraUser();
 }
 
+void View::setStereoscopicCameras(Camera* left, Camera* right) noexcept {
+    upcast(this)->setStereoscopicCameras(upcast(left), upcast(right));
+}
+
+bool View::isStereoscopic() const noexcept {
+    return upcast(this)->isStereoscopic();
+}
+
 
 void View::setViewport(Viewport const& viewport) noexcept {
     upcast(this)->setViewport(viewport);
@@ -776,6 +1654,27 @@ bool View::isCullingEnabled() const noexcept {
     return upcast(this)->isCullingEnabled();
 }
 
+void View::setOcclusionCulling(bool enabled) noexcept {
+    upcast(this)->setOcclusionCulling(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+void View::setOrderIndependentTransparency(bool enabled) noexcept {
+    upcast(this)->setOrderIndependentTransparency(enabled);
+}
+
+bool View::isOrderIndependentTransparencyEnabled() const noexcept {
+    return upcast(this)->isOrderIndependentTransparencyEnabled();
+}
+
+void View::pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback,
+        void* user) noexcept {
+    upcast(this)->pick(x, y, callback, user);
+}
+
 void View::setDebugCamera(Camera* camera) noexcept {
     upcast(this)->setViewingCamera(upcast(camera));
 }
@@ -800,10 +1699,26 @@ void View::setShadowsEnabled(bool enabled) noexcept {
     upcast(this)->setShadowsEnabled(enabled);
 }
 
+void View::setShadowType(ShadowType type) noexcept {
+    upcast(this)->setShadowType(type);
+}
+
+View::ShadowType View::getShadowType() const noexcept {
+    return upcast(this)->getShadowType();
+}
+
 void View::setRenderTarget(TargetBufferFlags discard) noexcept {
     upcast(this)->setRenderTarget(discard);
 }
 
+void View::setRenderTarget(RenderTarget* renderTarget, TargetBufferFlags discard) noexcept {
+    upcast(this)->setRenderTarget(upcast(renderTarget), discard);
+}
+
+RenderTarget* View::getRenderTarget() const noexcept {
+    return upcast(this)->getRenderTarget();
+}
+
 void View::setSampleCount(uint8_t count) noexcept {
     upcast(this)->setSampleCount(count);
 }
@@ -828,6 +1743,30 @@ View::DynamicResolutionOptions View::getDynamicResolutionOptions() const noexcep
     return upcast(this)->getDynamicResolutionOptions();
 }
 
+void View::setFoveatedRenderingOptions(FoveatedRenderingOptions const& options) noexcept {
+    upcast(this)->setFoveatedRenderingOptions(options);
+}
+
+View::FoveatedRenderingOptions View::getFoveatedRenderingOptions() const noexcept {
+    return upcast(this)->getFoveatedRenderingOptions();
+}
+
+void View::setColorGradingOptions(ColorGradingOptions const& options) noexcept {
+    upcast(this)->setColorGradingOptions(options);
+}
+
+View::ColorGradingOptions View::getColorGradingOptions() const noexcept {
+    return upcast(this)->getColorGradingOptions();
+}
+
+void View::setAutoExposureOptions(AutoExposureOptions const& options) noexcept {
+    upcast(this)->setAutoExposureOptions(options);
+}
+
+View::AutoExposureOptions View::getAutoExposureOptions() const noexcept {
+    return upcast(this)->getAutoExposureOptions();
+}
+
 void View::setPostProcessingEnabled(bool enabled) noexcept {
     upcast(this)->setPostProcessingEnabled(enabled);
 }
@@ -840,9 +1779,33 @@ void View::setDepthPrepass(View::DepthPrepass prepass) noexcept {
     upcast(this)->setDepthPrepass(prepass);
 }
 
+void View::setSortPolicy(View::SortPolicy policy) noexcept {
+    upcast(this)->setSortPolicy(policy);
+}
+
+View::SortPolicy View::getSortPolicy() const noexcept {
+    return upcast(this)->getSortPolicy();
+}
+
 void View::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     upcast(this)->setDynamicLightingOptions(zLightNear, zLightFar);
 }
 
+void View::setFroxelOptions(FroxelOptions const& options) noexcept {
+    upcast(this)->setFroxelOptions(options);
+}
+
+View::FroxelOptions View::getFroxelOptions() const noexcept {
+    return upcast(this)->getFroxelOptions();
+}
+
+View::FroxelStatistics View::getFroxelStatistics() const noexcept {
+    return upcast(this)->getFroxelStatistics();
+}
+
+View::RenderStatistics View::getRenderStatistics() const noexcept {
+    return upcast(this)->getRenderStatistics();
+}
+
 
 } // namespace filament
@@ -53,7 +53,7 @@ void FCameraManager::terminate() noexcept {
 
 void FCameraManager::gc(utils::EntityManager& em) noexcept {
     auto& manager = mManager;
-    manager.gc(em, 4, [this](Entity e) {
+    manager.gc(em, [this](Entity e) {
         destroy(e);
     });
 }
@@ -67,7 +67,7 @@ FCamera* FCameraManager::create(Entity entity) {
     }
     Instance i = manager.addComponent(entity);
 
-    FCamera* camera = engine.getHeapAllocator().make<FCamera>(engine, entity);
+    FCamera* camera = engine.heapMake<FCamera>(HEAP_TAG_CAMERA, engine, entity);
     manager.elementAt<CAMERA>(i) = camera;
 
     // Make sure we have a transform component
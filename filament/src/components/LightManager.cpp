@@ -173,6 +173,10 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
         shadowParams.shadowFar = std::max(builder->mShadowOptions.shadowFar, 0.0f);
         shadowParams.shadowNearHint = std::max(builder->mShadowOptions.shadowNearHint, 0.0f);
         shadowParams.shadowFarHint = std::max(builder->mShadowOptions.shadowFarHint, 0.0f);
+        shadowParams.shadowCascadeSplitLambda =
+                clamp(builder->mShadowOptions.shadowCascadeSplitLambda, 0.0f, 1.0f);
+        shadowParams.shadowCascades = uint8_t(clamp(int(builder->mShadowOptions.shadowCascades),
+                1, int(CONFIG_MAX_SHADOW_CASCADES)));
 
         // set default values by calling the setters
         setLocalPosition(i, builder->mPosition);
@@ -302,6 +306,18 @@ void FLightManager::setSpotLightCone(Instance i, float inner, float outer) noexc
         spotParams.sinInverse = 1 / std::sqrt(1 - cosOuterSquared);
         spotParams.scaleOffset = { scale, offset };
 
+        // The light is bounded by a spherical sector. Up to 45 degrees, the smallest sphere
+        // around it goes through the apex and the rim of the cap, past that it's the sphere
+        // around the rim. Past 90 degrees, it's the light's sphere. These must not be smaller
+        // than the light, so they don't use fast::cos().
+        if (outerClamped >= float(M_PI_2)) {
+            spotParams.coneBounds = { 0, 1 };
+        } else if (outerClamped > float(M_PI_4)) {
+            spotParams.coneBounds = { std::cos(outerClamped), std::sin(outerClamped) };
+        } else {
+            spotParams.coneBounds = float2{ 0.5f / std::cos(outerClamped) };
+        }
+
         // we need to recompute the luminous intensity
         Type type = getLightType(i).type;
         if (type == Type::FOCUSED_SPOT) {
@@ -63,6 +63,11 @@ public:
         mManager.gc(em);
     }
 
+    // Changes every time instances are created, destroyed or reordered.
+    uint32_t getLayoutGeneration() const noexcept {
+        return mManager.getLayoutGeneration();
+    }
+
     struct LightType {
         Type type : 3;
         uint8_t shadowMapBits : 4;
@@ -76,6 +81,9 @@ public:
         float sinInverse = std::numeric_limits<float>::infinity();
         float luminousPower = 0;
         math::float2 scaleOffset = {};
+        // bounding sphere of the cone for a unit radius: distance of its center from the light
+        // along the axis, and its radius. It's the light's sphere for the point lights.
+        math::float2 coneBounds = { 0, 1 };
     };
 
     struct ShadowParams {
@@ -84,6 +92,8 @@ public:
         float shadowFar;
         float shadowNearHint;
         float shadowFarHint;
+        float shadowCascadeSplitLambda;
+        uint8_t shadowCascades;
     };
 
     UTILS_NOINLINE void setLocalPosition(Instance i, const math::float3& position) noexcept;
@@ -219,13 +229,13 @@ private:
         FALLOFF,
     };
 
-    using Base = utils::SingleInstanceComponentManager<  // 120 bytes
+    using Base = utils::SingleInstanceComponentManager<  // 128 bytes
             LightType,      //  1
             math::float3,   // 12
             math::float3,   // 12
             math::float3,   // 12
             ShadowParams,   // 12
-            SpotParams,     // 24
+            SpotParams,     // 32
             float,          //  4
             float,          //  4
             float,          //  4
@@ -18,6 +18,7 @@
 
 #include "components/RenderableManager.h"
 
+#include "details/DestroyBatch.h"
 #include "details/Engine.h"
 #include "details/VertexBuffer.h"
 #include "details/IndexBuffer.h"
@@ -41,15 +42,25 @@ struct RenderableManager::BuilderDetails {
     Box mAABB;
     uint8_t mLayerMask = 0x1;
     uint8_t mPriority = 0x4;
+    uint8_t mSortKey = 0;
     bool mCulling : 1;
     bool mCastShadows : 1;
     bool mReceiveShadows : 1;
+    bool mStaticGeometry : 1;
+    bool mPreSkinning : 1;
+    bool mMorphing : 1;
     uint8_t mSkinningBoneCount = 0;
     Bone const* mBones = nullptr;
     math::mat4f const* mBoneMatrices = nullptr;
+    uint16_t mInstanceCount = 1;
+    uint32_t mTextureLayer = 0;
+    uint8_t mLevelCount = 1;
+    float mMinScreenCoverage[MAX_LEVEL_COUNT] = {};
+    Impostor* mImpostor = nullptr;
 
     explicit BuilderDetails(size_t count)
-            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
+            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
+              mStaticGeometry(false), mPreSkinning(false), mMorphing(false) {
     }
     // this is only needed for the explicit instantiation below
     BuilderDetails() = default;
@@ -58,7 +69,8 @@ struct RenderableManager::BuilderDetails {
 using BuilderType = RenderableManager;
 BuilderType::Builder::Builder(size_t count) noexcept
         : BuilderBase<RenderableManager::BuilderDetails>(count) {
-    mImpl->mEntries = new Entry[count];
+    // the entries of level of detail l are at [l * count, (l + 1) * count)
+    mImpl->mEntries = new Entry[count * MAX_LEVEL_COUNT];
 }
 BuilderType::Builder::~Builder() noexcept {
     delete [] mImpl->mEntries;
@@ -95,6 +107,37 @@ RenderableManager::Builder& RenderableManager::Builder::geometry(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::geometry(uint8_t level, size_t index,
+        PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
+        size_t offset, size_t count) noexcept {
+    if (level < MAX_LEVEL_COUNT && index < mImpl->mEntriesCount) {
+        Entry& entry = mImpl->mEntries[level * mImpl->mEntriesCount + index];
+        entry.vertices = vertices;
+        entry.indices = indices;
+        entry.offset = offset;
+        entry.minIndex = 0;
+        entry.maxIndex = vertices->getVertexCount() - 1;
+        entry.count = count;
+        entry.type = type;
+        mImpl->mLevelCount = std::max(mImpl->mLevelCount, uint8_t(level + 1));
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::levelOfDetail(uint8_t level,
+        float minScreenCoverage) noexcept {
+    if (level < MAX_LEVEL_COUNT) {
+        mImpl->mMinScreenCoverage[level] = std::max(0.0f, minScreenCoverage);
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::impostor(
+        Impostor* impostor) noexcept {
+    mImpl->mImpostor = impostor;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::material(size_t index,
         MaterialInstance const* materialInstance) noexcept {
     if (index < mImpl->mEntriesCount) {
@@ -118,6 +161,11 @@ RenderableManager::Builder& RenderableManager::Builder::priority(uint8_t priorit
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::sortKey(uint8_t key) noexcept {
+    mImpl->mSortKey = key;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::culling(bool enable) noexcept {
     mImpl->mCulling = enable;
     return *this;
@@ -133,6 +181,11 @@ RenderableManager::Builder& RenderableManager::Builder::receiveShadows(bool enab
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::staticGeometry(bool enable) noexcept {
+    mImpl->mStaticGeometry = enable;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::skinning(size_t boneCount) noexcept {
     mImpl->mSkinningBoneCount = (uint8_t)std::min(size_t(255), boneCount);
     return *this;
@@ -152,6 +205,26 @@ RenderableManager::Builder& RenderableManager::Builder::skinning(
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::morphing(bool enable) noexcept {
+    mImpl->mMorphing = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::preSkinning(bool enable) noexcept {
+    mImpl->mPreSkinning = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::instances(size_t instanceCount) noexcept {
+    mImpl->mInstanceCount = (uint16_t)std::max(size_t(1), std::min(size_t(65535), instanceCount));
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::textureLayer(uint32_t layer) noexcept {
+    mImpl->mTextureLayer = layer;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntriesCount) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -161,9 +234,16 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
 
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
     bool isEmpty = true;
-    for (size_t i = 0, c = mImpl->mEntriesCount; i < c; i++) {
+    for (size_t i = 0, c = mImpl->mEntriesCount * mImpl->mLevelCount; i < c; i++) {
         auto& entry = mImpl->mEntries[i];
 
+        // the other levels of detail use the materials and blend orders of level 0
+        if (i >= mImpl->mEntriesCount) {
+            Entry const& base = mImpl->mEntries[i % mImpl->mEntriesCount];
+            entry.materialInstance = base.materialInstance;
+            entry.blendOrder = base.blendOrder;
+        }
+
         // entry.materialInstance must be set to something even if indices/vertices are null
         FMaterial const* material = nullptr;
         if (!entry.materialInstance) {
@@ -248,16 +328,18 @@ void FRenderableManager::create(
     FEngine::DriverApi& driver = engine.getDriverApi();
 
     // If we already have an instance we can reuse parts of it without completely
-    // destroying it. In particular we can reuse the UBO since it's the same for
-    // all renderables
-    bool canReuse = false;
+    // destroying it. In particular we can reuse the slot in the bones arena.
     Instance ci = getInstance(entity);
     if (UTILS_UNLIKELY(ci)) {
-        canReuse = true;
         destroyComponentPrimitives(engine, manager[ci].primitives);
-        std::unique_ptr<Bones> const& bones = manager[ci].bones;
-        if (bones && !builder->mSkinningBoneCount) {
-            driver.destroyUniformBuffer(bones->handle);
+        Bones& bones = manager[ci].bones;
+        if (bones.preSkinning) {
+            bones.preSkinning = false;
+            mPreSkinnedCount--;
+        }
+        if (bones.offset != NO_BONES && !builder->mSkinningBoneCount && !builder->mMorphing) {
+            freeBones(bones.offset);
+            bones = {};
         }
     }
 
@@ -268,46 +350,77 @@ void FRenderableManager::create(
         // create and initialize all needed RenderPrimitives
         using size_type = Slice<FRenderPrimitive>::size_type;
         Builder::Entry const * const entries = builder->mEntries;
-        FRenderPrimitive* rp = new FRenderPrimitive[builder->mEntriesCount];
-        for (size_t i = 0, c = builder->mEntriesCount; i < c; ++i) {
-            rp[i].init(driver, entries[i]);
+        const size_t count = builder->mEntriesCount * builder->mLevelCount;
+
+        // pre-skinning is all or nothing, since the variant is chosen per renderable. The morph
+        // targets are blended before skinning, so they'd need to be pre-skinned as well.
+        bool preSkinning = builder->mPreSkinning && builder->mSkinningBoneCount &&
+                !builder->mMorphing && engine.getPreSkinning().isSupported(engine);
+        for (size_t i = 0; i < count && preSkinning; ++i) {
+            preSkinning = !entries[i].vertices || !entries[i].indices ||
+                    PreSkinning::isSkinnable(upcast(entries[i].vertices));
+        }
+        if (builder->mPreSkinning && builder->mSkinningBoneCount && !preSkinning) {
+            slog.w << "Pre-skinning isn't available, the renderable is skinned by the vertex "
+                      "shaders instead" << io::endl;
         }
-        setPrimitives(ci, { rp, size_type(builder->mEntriesCount) });
+
+        FRenderPrimitive* rp = new FRenderPrimitive[count];
+        for (size_t i = 0; i < count; ++i) {
+            rp[i].init(engine, entries[i], preSkinning);
+            rp[i].setInstanceCount(builder->mInstanceCount);
+        }
+        setPrimitives(ci, { rp, size_type(count) });
+
+        LevelsOfDetail& lods = manager[ci].lods;
+        lods = LevelsOfDetail{};
+        lods.count = builder->mLevelCount;
+        std::copy_n(builder->mMinScreenCoverage, lods.count, lods.minScreenCoverage);
+        lods.impostor = upcast(builder->mImpostor);
 
         setAxisAlignedBoundingBox(ci, builder->mAABB);
         setLayerMask(ci, builder->mLayerMask);
         setPriority(ci, builder->mPriority);
         setCastShadows(ci, builder->mCastShadows);
         setReceiveShadows(ci, builder->mReceiveShadows);
+        setStaticGeometry(ci, builder->mStaticGeometry);
         setCulling(ci, builder->mCulling);
-        static_cast<Visibility&>(manager[ci].visibility).skinning = builder->mSkinningBoneCount > 0;
-
-        if (!canReuse) {
-            getUniformBuffer(ci) = UniformBuffer(engine.getPerRenderableUib());
-            setUniformHandle(ci, driver.createUniformBuffer(getUniformBuffer(ci).getSize()));
-            if (builder->mSkinningBoneCount) {
-                std::unique_ptr<Bones>& bones = manager[ci].bones;
-
-                bones.reset(new Bones); // FIXME: maybe use a pool allocator
-                bones->bones = UniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-                bones->handle = driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
+        setBackground(ci, false);
+        setTextureLayer(ci, builder->mTextureLayer);
+        setSortKey(ci, builder->mSortKey);
+        static_cast<Visibility&>(manager[ci].visibility).skinning =
+                (builder->mSkinningBoneCount > 0 && !preSkinning) || builder->mMorphing;
+
+        Morphing& morphing = manager[ci].morphing;
+        morphing = Morphing{};
+        morphing.enabled = builder->mMorphing;
+
+        // the skinning variant always has the bones bound, even when it only morphs
+        if (builder->mSkinningBoneCount || builder->mMorphing) {
+            Bones& bones = manager[ci].bones;
+            if (bones.offset == NO_BONES) {
+                bones.offset = allocateBones(driver);
+            }
+            bones.count = builder->mSkinningBoneCount;
+            bones.preSkinning = preSkinning;
+            if (preSkinning) {
+                mPreSkinnedCount++;
+                mPreSkinningDirty = true;
             }
-        }
-        if (builder->mSkinningBoneCount) {
-            std::unique_ptr<Bones> const& bones = manager[ci].bones;
-            assert(bones);
-            bones->count = builder->mSkinningBoneCount;
             if (builder->mBones) {
                 setBones(ci, builder->mBones, builder->mSkinningBoneCount);
             } else if (builder->mBoneMatrices) {
                 setBones(ci, builder->mBoneMatrices, builder->mSkinningBoneCount);
             } else {
                 // initialize the bones to identity
-                Bone* UTILS_RESTRICT out =
-                        (Bone*)bones->bones.invalidateUniforms(0, bones->count * sizeof(Bone));
-                std::fill_n(out, bones->count, Bone{});
+                Bone* UTILS_RESTRICT out = (Bone*)mBonesArena.bones.invalidateUniforms(
+                        bones.offset, bones.count * sizeof(Bone));
+                std::fill_n(out, bones.count, Bone{});
             }
         }
+
+        // the skinning bit and bones handle are not set through the inline setters above
+        invalidate(ci);
     }
 }
 
@@ -320,6 +433,17 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     }
 }
 
+void FRenderableManager::destroy(utils::Entity const* entities, size_t count,
+        DestroyBatch& batch) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        Instance ci = getInstance(entities[i]);
+        if (ci) {
+            destroyComponent(ci, &batch);
+            mManager.removeComponent(entities[i]);
+        }
+    }
+}
+
 // this destroys all components in this manager
 void FRenderableManager::terminate() noexcept {
     auto& manager = mManager;
@@ -334,83 +458,132 @@ void FRenderableManager::terminate() noexcept {
             manager.removeComponent(manager.getEntity(ci));
         }
     }
+
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    for (Handle<HwUniformBuffer>& handle : mBonesArena.handles) {
+        driver.destroyUniformBuffer(handle);
+        handle.clear();
+    }
 }
 
 // This is basically a Renderable's destructor.
-void FRenderableManager::destroyComponent(Instance ci) noexcept {
+void FRenderableManager::destroyComponent(Instance ci, DestroyBatch* batch) noexcept {
     auto& manager = mManager;
     FEngine& engine = mEngine;
 
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyUniformBuffer(manager[ci].uniformsHandle);
-
     // See create(RenderableManager::Builder&, Entity)
-    destroyComponentPrimitives(engine, manager[ci].primitives);
+    destroyComponentPrimitives(engine, manager[ci].primitives, batch);
 
-    // destroy the bones structures if any
-    std::unique_ptr<Bones> const& bones = manager[ci].bones;
-    if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+    // give back our slot of the bones arena if any
+    Bones& bones = manager[ci].bones;
+    if (bones.preSkinning) {
+        mPreSkinnedCount--;
+    }
+    if (bones.offset != NO_BONES) {
+        freeBones(bones.offset);
+        bones = {};
     }
 }
 
+uint32_t FRenderableManager::allocateBones(driver::DriverApi& driver) noexcept {
+    BonesArena& arena = mBonesArena;
+    if (UTILS_UNLIKELY(arena.freeSlots.empty())) {
+        // grow the arena by doubling its size, keeping the bones already allocated.
+        const uint32_t slotCount = std::max(BONES_ARENA_MIN_SLOT_COUNT, arena.slotCount * 2);
+        UniformBuffer bones(slotCount * BONES_SLOT_SIZE);
+        if (arena.slotCount) {
+            memcpy(bones.invalidateUniforms(0, arena.slotCount * BONES_SLOT_SIZE),
+                    arena.bones.getBuffer(), arena.slotCount * BONES_SLOT_SIZE);
+        }
+        arena.bones = std::move(bones);
+
+        // the uniform buffers are recreated, a new arena is always dirty so it'll be uploaded
+        // entirely by the next prepare()
+        for (Handle<HwUniformBuffer>& handle : arena.handles) {
+            driver.destroyUniformBuffer(handle);
+            handle = driver.createUniformBuffer(slotCount * BONES_SLOT_SIZE);
+        }
+
+        // hand out the lowest slots first
+        for (uint32_t i = slotCount; i-- > arena.slotCount;) {
+            arena.freeSlots.push_back(i);
+        }
+        arena.slotCount = slotCount;
+    }
+    const uint32_t slot = arena.freeSlots.back();
+    arena.freeSlots.pop_back();
+    return uint32_t(slot * BONES_SLOT_SIZE);
+}
+
+void FRenderableManager::freeBones(uint32_t offset) noexcept {
+    mBonesArena.freeSlots.push_back(uint32_t(offset / BONES_SLOT_SIZE));
+}
+
 void FRenderableManager::destroyComponentPrimitives(
-        FEngine& engine, Slice<FRenderPrimitive>& primitives) noexcept {
+        FEngine& engine, Slice<FRenderPrimitive>& primitives, DestroyBatch* batch) noexcept {
     for (auto& primitive : primitives) {
-        primitive.terminate(engine);
+        if (batch) {
+            primitive.terminate(engine, *batch);
+        } else {
+            primitive.terminate(engine);
+        }
     }
     delete[] primitives.data();
 }
 
 
-void FRenderableManager::prepare(
-        driver::DriverApi& UTILS_RESTRICT driver,
-        Instance const* UTILS_RESTRICT instances,
-        utils::Range<uint32_t> list) const noexcept {
-    auto& manager = mManager;
-    UniformBuffer           const * const UTILS_RESTRICT uniforms = manager.raw_array<UNIFORMS>();
-    Handle<HwUniformBuffer> const * const UTILS_RESTRICT ubhs     = manager.raw_array<UNIFORMS_HANDLE>();
-    std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones    = manager.raw_array<BONES>();
-    for (uint32_t index : list) {
-        size_t i = instances[index].asValue();
-        assert(i);  // we should never get the null instance here
-        if (uniforms[i].isDirty()) {
-            // update per-renderable uniform buffer
-            driver.updateUniformBuffer(ubhs[i], UniformBuffer(uniforms[i]));
-            uniforms[i].clean(); // clean AFTER we send to the driver
-        }
-        if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.updateUniformBuffer(bones[i]->handle, UniformBuffer(bones[i]->bones));
-                bones[i]->bones.clean();
+void FRenderableManager::prepare(driver::DriverApi& driver) noexcept {
+    // all the bones are uploaded at once, regardless of their visibility
+    BonesArena& arena = mBonesArena;
+    if (UTILS_UNLIKELY(arena.bones.isDirty())) {
+        arena.current = uint32_t((arena.current + 1) % BONES_ARENA_BUFFER_COUNT);
+        mEngine.getFrameCounters().add(FrameCounters::UNIFORM_BYTES, arena.bones.getSize());
+        driver.updateUniformBuffer(arena.handles[arena.current], UniformBuffer(arena.bones));
+        arena.bones.clean();
+        mPreSkinningDirty = true;
+    }
+
+    // likewise, all the pre-skinned vertices are skinned again once, for all the views and
+    // passes that follow
+    if (UTILS_UNLIKELY(mPreSkinningDirty)) {
+        mPreSkinningDirty = false;
+        if (mPreSkinnedCount) {
+            FEngine& engine = mEngine;
+            PreSkinning& preSkinning = engine.getPreSkinning();
+            auto& manager = mManager;
+            for (Instance ci = manager.begin(), end = manager.end(); ci != end; ++ci) {
+                Bones const& bones = manager[ci].bones;
+                if (bones.preSkinning) {
+                    Slice<FRenderPrimitive> const& primitives = manager[ci].primitives;
+                    for (FRenderPrimitive const& primitive : primitives) {
+                        if (primitive.getPreSkinning()) {
+                            preSkinning.skin(engine, primitive.getPreSkinning(),
+                                    arena.handles[arena.current], bones.offset);
+                        }
+                    }
+                }
             }
         }
     }
 }
 
-void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& model) noexcept {
-    if (instance) {
-        auto& uniforms = getUniformBuffer(instance);
-
-        // update our uniform buffer
-        uniforms.setUniform(offsetof(FEngine::PerRenderableUib, worldFromModelMatrix), model);
-
-        // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
-        // the transformed normals will have unit-length, therefore they need to be normalized
-        // in the shader (that's already the case anyways, since normalization is needed after
-        // interpolation).
-        // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
-        mat3f nm = transpose(inverse(model.upperLeft()));
-        uniforms.setUniform(offsetof(FEngine::PerRenderableUib, worldFromModelNormalMatrix), nm);
-    }
+Slice<FRenderPrimitive> FRenderableManager::getRenderPrimitives(
+        Instance instance, uint8_t level) const noexcept {
+    // all the levels are stored contiguously and have the same number of primitives
+    Slice<FRenderPrimitive> const& primitives = mManager[instance].primitives;
+    const size_t count = getLevelCount(instance);
+    assert(level < count);
+    const auto size = Slice<FRenderPrimitive>::size_type(primitives.size() / count);
+    return { const_cast<FRenderPrimitive*>(primitives.data()) + level * size, size };
 }
 
 void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
+            invalidate(instance);
 #ifndef NDEBUG
             AttributeBitset required = mi->getMaterial()->getRequiredAttributes();
             AttributeBitset declared = primitives[primitiveIndex].getEnabledAttributes();
@@ -427,7 +600,7 @@ void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
 MaterialInstance* FRenderableManager::getMaterialInstanceAt(
         Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
     if (instance) {
-        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        const Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             // We store the material instance as const because we don't want to change it internally
             // but when the user queries it, we want to allow them to call setParameter()
@@ -440,9 +613,10 @@ MaterialInstance* FRenderableManager::getMaterialInstanceAt(
 void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
         size_t primitiveIndex, uint16_t order) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setBlendOrder(order);
+            invalidate(instance);
         }
     }
 }
@@ -450,7 +624,7 @@ void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
 AttributeBitset FRenderableManager::getEnabledAttributesAt(
         Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
     if (instance) {
-        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             return primitives[primitiveIndex].getEnabledAttributes();
         }
@@ -462,10 +636,12 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
         PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
         size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
                     0, vertices->getVertexCount() - 1, count);
+            mPreSkinningDirty |= primitives[primitiveIndex].getPreSkinning() != nullptr;
+            invalidate(instance);
         }
     }
 }
@@ -473,9 +649,10 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
         PrimitiveType type, size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
+            invalidate(instance);
         }
     }
 }
@@ -483,29 +660,41 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setBones(Instance ci,
         Bone const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.offset != NO_BONES && offset + boneCount <= bones.count);
+        // renderables that only morph have a slot but no bones
+        if (bones.offset != NO_BONES && offset < bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = (Bone*)mBonesArena.bones.invalidateUniforms(
+                    bones.offset + offset * sizeof(Bone),
                     boneCount * sizeof(Bone));
             std::copy_n(transforms, boneCount, out);
         }
     }
 }
 
+void FRenderableManager::setMorphWeights(Instance ci, float4 const& weights) noexcept {
+    if (ci) {
+        Morphing& morphing = mManager[ci].morphing;
+        if (morphing.enabled) {
+            morphing.weights = weights;
+            invalidate(ci);
+        }
+    }
+}
+
 void FRenderableManager::setBones(Instance ci,
         math::mat4f const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.offset != NO_BONES && offset + boneCount <= bones.count);
+        // renderables that only morph have a slot but no bones
+        if (bones.offset != NO_BONES && offset < bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = (Bone*)mBonesArena.bones.invalidateUniforms(
+                    bones.offset + offset * sizeof(Bone),
                     boneCount * sizeof(Bone));
-            for (size_t i = 0, c = bones->count; i < c; ++i) {
+            for (size_t i = 0; i < boneCount; ++i) {
                 mat4f const& m = transforms[i];
                 out[i].unitQuaternion = m.toQuaternion();
                 out[i].translation = m[3].xyz;
@@ -548,6 +737,10 @@ void RenderableManager::setPriority(Instance instance, uint8_t priority) noexcep
     upcast(this)->setPriority(instance, priority);
 }
 
+void RenderableManager::setSortKey(Instance instance, uint8_t key) noexcept {
+    upcast(this)->setSortKey(instance, key);
+}
+
 void RenderableManager::setCastShadows(Instance instance, bool enable) noexcept {
     upcast(this)->setCastShadows(instance, enable);
 }
@@ -556,6 +749,22 @@ void RenderableManager::setReceiveShadows(Instance instance, bool enable) noexce
     upcast(this)->setReceiveShadows(instance, enable);
 }
 
+void RenderableManager::setStaticGeometry(Instance instance, bool enable) noexcept {
+    upcast(this)->setStaticGeometry(instance, enable);
+}
+
+void RenderableManager::setTextureLayer(Instance instance, uint32_t layer) noexcept {
+    upcast(this)->setTextureLayer(instance, layer);
+}
+
+uint32_t RenderableManager::getTextureLayer(Instance instance) const noexcept {
+    return upcast(this)->getTextureLayer(instance);
+}
+
+uint8_t RenderableManager::getSortKey(Instance instance) const noexcept {
+    return upcast(this)->getSortKey(instance);
+}
+
 bool RenderableManager::isShadowCaster(Instance instance) const noexcept {
     return upcast(this)->isShadowCaster(instance);
 }
@@ -572,9 +781,16 @@ size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
     return upcast(this)->getPrimitiveCount(instance, 0);
 }
 
+size_t RenderableManager::getLevelCount(Instance instance) const noexcept {
+    return instance ? upcast(this)->getLevelCount(instance) : 0;
+}
+
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    for (size_t l = 0, c = getLevelCount(instance); l < c; l++) {
+        upcast(this)->setMaterialInstanceAt(instance, uint8_t(l), primitiveIndex,
+                upcast(materialInstance));
+    }
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
@@ -583,7 +799,9 @@ MaterialInstance* RenderableManager::getMaterialInstanceAt(
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    for (size_t l = 0, c = getLevelCount(instance); l < c; l++) {
+        upcast(this)->setBlendOrderAt(instance, uint8_t(l), primitiveIndex, order);
+    }
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
@@ -602,6 +820,10 @@ void RenderableManager::setGeometryAt(RenderableManager::Instance instance, size
     upcast(this)->setGeometryAt(instance, 0, primitiveIndex, type, offset, count);
 }
 
+void RenderableManager::setMorphWeights(Instance instance, float4 const& weights) noexcept {
+    upcast(this)->setMorphWeights(instance, weights);
+}
+
 void RenderableManager::setBones(Instance instance,
         RenderableManager::Bone const* transforms, size_t boneCount, size_t offset) noexcept {
     upcast(this)->setBones(instance, transforms, boneCount, offset);
@@ -24,6 +24,7 @@
 #include "driver/Handle.h"
 
 #include <filament/Box.h>
+#include <filament/EngineEnums.h>
 #include <filament/RenderableManager.h>
 
 #include <utils/Entity.h>
@@ -31,9 +32,16 @@
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
+#include <algorithm>
+#include <vector>
+
+#include <assert.h>
+
 namespace filament {
 namespace details {
 
+class DestroyBatch;
+class FImpostor;
 class FMaterialInstance;
 class FRenderPrimitive;
 
@@ -41,12 +49,24 @@ class FRenderableManager : public RenderableManager {
 public:
     using Instance = RenderableManager::Instance;
 
+    // The bones of all skinned renderables are sub-allocated in a single arena, one slot of
+    // BONES_SLOT_SIZE bytes each, which is bound with an offset when drawing.
+    static constexpr size_t BONES_SLOT_SIZE = CONFIG_MAX_BONE_COUNT * sizeof(Bone);
+    static constexpr uint32_t NO_BONES = 0xFFFFFFFFu;
+
+    // flags of getSkinningFlags(), the skinning variant of the materials is shared by the
+    // skinned and morphed renderables
+    static constexpr uint8_t SKINNING_ENABLED = 0x1;
+    static constexpr uint8_t MORPHING_ENABLED = 0x2;
+
     struct Visibility {
         uint8_t priority    : 3;
         bool castShadows    : 1;
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool staticGeometry : 1;
+        bool background     : 1;    // drawn after the other opaque draws, at the far plane
     };
 
     FRenderableManager(FEngine& engine) noexcept;
@@ -67,29 +87,24 @@ public:
         return mManager.getInstance(e);
     }
 
+    utils::Entity getEntity(Instance i) const noexcept {
+        return mManager.getEntity(i);
+    }
+
     void create(const RenderableManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
+    void destroy(utils::Entity const* entities, size_t count, DestroyBatch& batch) noexcept;
 
-    // - instances is a list of Instance (typically the list from a given scene)
-    // - list is a list of index in 'instances' (typically the visible ones)
-    void prepare(driver::DriverApi& driver,
-            RenderableManager::Instance const* instances,
-            utils::Range<uint32_t> list) const noexcept;
+    // uploads the bones arena, in a single transfer, if any bone has changed, and then skins
+    // the vertices of the pre-skinned renderables.
+    // The per-renderable uniforms are owned by the scenes, see FScene::updateUBOs().
+    void prepare(driver::DriverApi& driver) noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
         mManager.gc(em);
     }
 
-    utils::Slice<const UniformBuffer> getUniformBuffers() const noexcept {
-        return mManager.slice<UNIFORMS>();
-    }
-
-    utils::Slice<const Handle<HwUniformBuffer>> getUniformBufferHandles() const noexcept {
-        return mManager.slice<UNIFORMS_HANDLE>();
-    }
-
-    void updateLocalUBO(Instance instance, const math::mat4f& model) noexcept;
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
 
     inline void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
@@ -101,11 +116,16 @@ public:
 
     inline void setLayerMask(Instance instance, uint8_t enable) noexcept;
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
+    inline void setStaticGeometry(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
-    inline void setUniformHandle(Instance instance, Handle<HwUniformBuffer> const& handle) noexcept;
+    // only used by the skybox, see RenderPass::BACKGROUND_MASK
+    inline void setBackground(Instance instance, bool enable) noexcept;
+    inline void setTextureLayer(Instance instance, uint32_t layer) noexcept;
+    inline void setSortKey(Instance instance, uint8_t key) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
     inline void setBones(Instance instance, Bone const* transforms, size_t boneCount, size_t offset = 0) noexcept;
     inline void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount, size_t offset = 0) noexcept;
+    void setMorphWeights(Instance instance, math::float4 const& weights) noexcept;
 
 
     inline bool isShadowCaster(Instance instance) const noexcept;
@@ -117,15 +137,32 @@ public:
     inline Visibility getVisibility(Instance instance) const noexcept;
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
+    inline uint32_t getTextureLayer(Instance instance) const noexcept;
+    inline uint8_t getSortKey(Instance instance) const noexcept;
+
+    // offset in bytes of this instance's bones in the arena, or NO_BONES, which is also the case
+    // of pre-skinned instances since their vertices are skinned already
+    inline uint32_t getBonesOffset(Instance instance) const noexcept;
+
+    inline math::float4 getMorphWeights(Instance instance) const noexcept;
+    inline uint8_t getSkinningFlags(Instance instance) const noexcept;
+
+    // the uniform buffer holding the bones arena, as of the last prepare()
+    Handle<HwUniformBuffer> getBonesUbh() const noexcept {
+        return mBonesArena.handles[mBonesArena.current];
+    }
+
 
-    inline UniformBuffer const& getUniformBuffer(Instance instance) const noexcept;
-    inline UniformBuffer& getUniformBuffer(Instance instance) noexcept;
+    // Generation of the last change to the data gathered by FScene, across all instances.
+    uint32_t getGeneration() const noexcept { return mGeneration; }
 
-    inline Handle<HwUniformBuffer> getUbh(Instance instance) const noexcept;
-    inline Handle<HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
+    // Generation at which this instance's data gathered by FScene was last changed.
+    inline uint32_t getGeneration(Instance instance) const noexcept;
 
+    // Changes every time instances are created, destroyed or reordered.
+    uint32_t getLayoutGeneration() const noexcept { return mManager.getLayoutGeneration(); }
 
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
+    inline size_t getLevelCount(Instance instance) const noexcept;
     inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
     void setMaterialInstanceAt(Instance instance, uint8_t level,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
@@ -137,29 +174,72 @@ public:
             PrimitiveType type, size_t offset, size_t count) noexcept;
     void setBlendOrderAt(Instance instance, uint8_t level, size_t primitiveIndex, uint16_t blendOrder) noexcept;
     AttributeBitset getEnabledAttributesAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
-    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance, uint8_t level) noexcept;
+    utils::Slice<FRenderPrimitive> getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
+
+    // Selects the level of detail of a renderable covering 'screenCoverage' of the viewport's
+    // height, taking into account the level 'previous' selected last time by the same view.
+    // The level is getLevelCount() when the renderable is replaced by its impostor.
+    inline uint8_t selectLevelOfDetail(Instance instance, float screenCoverage,
+            uint8_t previous) const noexcept;
+
+    // the impostor drawn past the last level of detail, or null
+    inline FImpostor* getImpostor(Instance instance) const noexcept;
 
 
 private:
-    void destroyComponent(Instance ci) noexcept;
+    inline void invalidate(Instance instance) noexcept;
+    // without a batch, the driver resources are destroyed right away
+    void destroyComponent(Instance ci, DestroyBatch* batch = nullptr) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
-            utils::Slice<FRenderPrimitive>& primitives) noexcept;
+            utils::Slice<FRenderPrimitive>& primitives, DestroyBatch* batch = nullptr) noexcept;
+
+    struct LevelsOfDetail {
+        float minScreenCoverage[MAX_LEVEL_COUNT] = {};
+        FImpostor* impostor = nullptr;  // drawn past the last level, at level 'count'
+        uint8_t count = 1;
+    };
+
+    // relative margin around the coverage thresholds before switching to another level
+    static constexpr float LOD_HYSTERESIS = 0.1f;
 
     struct Bones {
-        filament::Handle<HwUniformBuffer> handle;
+        uint32_t offset = NO_BONES; // in bytes, of this renderable's slot in the arena
+        uint8_t count = 0;
+        bool preSkinning = false;   // the vertices are skinned by PreSkinning, see prepare()
+    };
+
+    struct Morphing {
+        math::float4 weights = {};
+        bool enabled = false;
+    };
+
+    // the arena is uploaded to each of these many uniform buffers in turn, so that we don't
+    // update a buffer that may still be in use by the GPU
+    static constexpr size_t BONES_ARENA_BUFFER_COUNT = 3;
+    static constexpr uint32_t BONES_ARENA_MIN_SLOT_COUNT = 4;
+
+    struct BonesArena {
         UniformBuffer bones;
-        uint8_t count;
+        Handle<HwUniformBuffer> handles[BONES_ARENA_BUFFER_COUNT];
+        std::vector<uint32_t> freeSlots;
+        uint32_t slotCount = 0;
+        uint32_t current = 0;   // index of the handle holding the latest upload
     };
 
+    uint32_t allocateBones(driver::DriverApi& driver) noexcept;
+    void freeBones(uint32_t offset) noexcept;
+
     enum {
         AABB,               // user data
         LAYERS,             // user data
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
-        UNIFORMS,           // filament data, UBO data where world-transform is stored
-        UNIFORMS_HANDLE,    // filament data, handle to the driver's UBO
-        BONES,              // filament data, UBO storing a pointer to the bones information
+        BONES,              // filament data, location of the bones in the arena
+        LODS,               // user data
+        TEXTURE_LAYER,      // user data
+        SORT_KEY,           // user data
+        MORPHING,           // user data
+        GENERATION,         // filament data, generation of the last change to the fields above
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -167,9 +247,12 @@ private:
             uint8_t,
             Visibility,
             utils::Slice<FRenderPrimitive>,
-            UniformBuffer,
-            filament::Handle<HwUniformBuffer>,
-            std::unique_ptr<Bones>
+            Bones,
+            LevelsOfDetail,
+            uint32_t,
+            uint8_t,
+            Morphing,
+            uint32_t
     >;
 
     struct Sim : public Base {
@@ -188,9 +271,12 @@ private:
                 Field<LAYERS>           layers;
                 Field<VISIBILITY>       visibility;
                 Field<PRIMITIVES>       primitives;
-                Field<UNIFORMS>         uniforms;
-                Field<UNIFORMS_HANDLE>  uniformsHandle;
                 Field<BONES>            bones;
+                Field<LODS>             lods;
+                Field<TEXTURE_LAYER>    textureLayer;
+                Field<SORT_KEY>         sortKey;
+                Field<MORPHING>         morphing;
+                Field<GENERATION>       generation;
             };
         };
 
@@ -204,6 +290,10 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    BonesArena mBonesArena;
+    uint32_t mGeneration = 0;
+    uint32_t mPreSkinnedCount = 0;
+    bool mPreSkinningDirty = false;     // some pre-skinned vertices must be skinned again
 };
 
 FILAMENT_UPCAST(RenderableManager)
@@ -211,6 +301,7 @@ FILAMENT_UPCAST(RenderableManager)
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
         mManager[instance].aabb = aabb;
+        invalidate(instance);
     }
 }
 
@@ -219,12 +310,14 @@ void FRenderableManager::setLayerMask(Instance instance,
     if (instance) {
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
+        invalidate(instance);
     }
 }
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
         mManager[instance].layers = layerMask;
+        invalidate(instance);
     }
 }
 
@@ -232,6 +325,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
+        invalidate(instance);
     }
 }
 
@@ -239,6 +333,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
+        invalidate(instance);
     }
 }
 
@@ -246,6 +341,15 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
+        invalidate(instance);
+    }
+}
+
+void FRenderableManager::setStaticGeometry(Instance instance, bool enable) noexcept {
+    if (instance) {
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.staticGeometry = enable;
+        invalidate(instance);
     }
 }
 
@@ -253,13 +357,29 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
+        invalidate(instance);
     }
 }
 
-void FRenderableManager::setUniformHandle(Instance instance,
-        Handle<HwUniformBuffer> const& handle) noexcept {
+void FRenderableManager::setBackground(Instance instance, bool enable) noexcept {
     if (instance) {
-        mManager[instance].uniformsHandle = handle;
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.background = enable;
+        invalidate(instance);
+    }
+}
+
+void FRenderableManager::setTextureLayer(Instance instance, uint32_t layer) noexcept {
+    if (instance) {
+        mManager[instance].textureLayer = layer;
+        invalidate(instance);
+    }
+}
+
+void FRenderableManager::setSortKey(Instance instance, uint8_t key) noexcept {
+    if (instance) {
+        mManager[instance].sortKey = key;
+        invalidate(instance);
     }
 }
 
@@ -270,6 +390,14 @@ void FRenderableManager::setPrimitives(Instance instance,
     }
 }
 
+void FRenderableManager::invalidate(Instance instance) noexcept {
+    mManager[instance].generation = ++mGeneration;
+}
+
+uint32_t FRenderableManager::getGeneration(Instance instance) const noexcept {
+    return mManager[instance].generation;
+}
+
 FRenderableManager::Visibility
 FRenderableManager::getVisibility(Instance instance) const noexcept {
     return mManager[instance].visibility;
@@ -295,35 +423,61 @@ uint8_t FRenderableManager::getPriority(Instance instance) const noexcept {
     return getVisibility(instance).priority;
 }
 
+uint32_t FRenderableManager::getTextureLayer(Instance instance) const noexcept {
+    return mManager[instance].textureLayer;
+}
+
+uint8_t FRenderableManager::getSortKey(Instance instance) const noexcept {
+    return mManager[instance].sortKey;
+}
+
 Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
 
-UniformBuffer const& FRenderableManager::getUniformBuffer(Instance instance) const noexcept {
-    return mManager[instance].uniforms;
+uint32_t FRenderableManager::getBonesOffset(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    return bones.preSkinning ? NO_BONES : bones.offset;
 }
 
-UniformBuffer& FRenderableManager::getUniformBuffer(Instance instance) noexcept {
-    return mManager[instance].uniforms;
+math::float4 FRenderableManager::getMorphWeights(Instance instance) const noexcept {
+    Morphing const& morphing = mManager[instance].morphing;
+    return morphing.weights;
 }
 
-Handle<HwUniformBuffer> FRenderableManager::getUbh(Instance instance) const noexcept {
-    return mManager[instance].uniformsHandle;
+uint8_t FRenderableManager::getSkinningFlags(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    Morphing const& morphing = mManager[instance].morphing;
+    return uint8_t((bones.count && !bones.preSkinning ? SKINNING_ENABLED : 0) |
+            (morphing.enabled ? MORPHING_ENABLED : 0));
 }
 
-Handle<HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
-    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : Handle<HwUniformBuffer>{};
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    return lods.count;
 }
 
-utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) const noexcept {
-    return mManager[instance].primitives;
+uint8_t FRenderableManager::selectLevelOfDetail(Instance instance,
+        float screenCoverage, uint8_t previous) const noexcept {
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    const uint8_t last = uint8_t(lods.impostor ? lods.count : lods.count - 1);
+    uint8_t level = std::min(previous, last);
+    // go to coarser levels while well below this level's threshold...
+    while (level < last &&
+            screenCoverage < lods.minScreenCoverage[level] * (1.0f - LOD_HYSTERESIS)) {
+        level++;
+    }
+    // ...and to finer levels while well above the finer level's threshold
+    while (level > 0 &&
+            screenCoverage >= lods.minScreenCoverage[level - 1] * (1.0f + LOD_HYSTERESIS)) {
+        level--;
+    }
+    return level;
 }
 
-utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) noexcept {
-    return mManager[instance].primitives;
+FImpostor* FRenderableManager::getImpostor(Instance instance) const noexcept {
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    return lods.impostor;
 }
 
 size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
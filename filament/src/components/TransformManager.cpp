@@ -16,13 +16,18 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
 using namespace utils;
 using namespace math;
 
 namespace filament {
 namespace details {
 
-FTransformManager::FTransformManager() noexcept = default;
+FTransformManager::FTransformManager(JobSystem* js) noexcept : mJobSystem(js) {
+}
 
 FTransformManager::~FTransformManager() noexcept = default;
 
@@ -30,10 +35,15 @@ void FTransformManager::terminate() noexcept {
 }
 
 void FTransformManager::create(Entity entity) {
-    create(entity, 0, {});
+    create(entity, 0, mat4f{});
 }
 
 void FTransformManager::create(Entity entity, Instance parent, const mat4f& localTransform) {
+    // converting to double is exact, this doesn't change the transform
+    create(entity, parent, mat4(localTransform));
+}
+
+void FTransformManager::create(Entity entity, Instance parent, const mat4& localTransform) {
     // this always adds at the end, so all existing instances stay valid
     auto& manager = mManager;
 
@@ -50,6 +60,7 @@ void FTransformManager::create(Entity entity, Instance parent, const mat4f& loca
         manager[i].next = 0;
         manager[i].prev = 0;
         manager[i].firstChild = 0;
+        manager[i].dirty = 0;
         insertNode(i, parent);
         setTransform(i, localTransform);
     }
@@ -101,41 +112,85 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
         auto& manager = mManager;
         // store our local transform
         manager[ci].local = model;
+        manager[ci].localTranslationLo = float3{};
         updateNodeTransform(ci);
     }
 }
 
+void FTransformManager::setTransform(Instance ci, const mat4& model) noexcept {
+    validateNode(ci);
+    if (ci) {
+        auto& manager = mManager;
+        // store the rounded local transform, and the rounding error of its translation
+        const mat4f local(model);
+        manager[ci].local = local;
+        manager[ci].localTranslationLo = mAccurateTranslations ?
+                float3(model[3].xyz - double3(local[3].xyz)) : float3{};
+        updateNodeTransform(ci);
+    }
+}
+
+void FTransformManager::setAccurateTranslationsEnabled(bool enable) noexcept {
+    if (enable != mAccurateTranslations) {
+        mAccurateTranslations = enable;
+        if (!enable) {
+            // the extra precision is dropped, so that the accurate transforms stay consistent
+            auto& manager = mManager;
+            auto& soa = manager.getSoA();
+            const size_t count = manager.end() - manager.begin();
+            std::fill_n(soa.data<LOCAL_LO>() + manager.begin(), count, float3{});
+            std::fill_n(soa.data<WORLD_LO>() + manager.begin(), count, float3{});
+        }
+    }
+}
+
+void FTransformManager::setTransforms(Instance const* instances, mat4f const* models,
+        size_t count) noexcept {
+    for (size_t j = 0; j < count; j++) {
+        setTransform(instances[j], models[j]);
+    }
+}
+
 void FTransformManager::updateNodeTransform(Instance i) noexcept {
     validateNode(i);
     auto& manager = mManager;
     assert(i);
 
     if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
-        // don't update the world transform until commitLocalTransformTransaction() is called
-        Instance ci = manager[i].firstChild;
-        while (ci) {
-            Instance child = manager[ci].firstChild;
-            ci = manager[ci].next;
-            if (child) {
-                updateNodeTransform(child);
-            }
-        }
+        // don't update the world transform until commitLocalTransformTransaction() is called,
+        // which recomputes this node and its descendants.
+        manager[i].dirty = 1;
         return;
     }
 
-    // find our parent's world transform, if any
-    // note: by using the raw_array() we don't need to check that parent is valid.
-    Instance parent = manager[i].parent;
-    mat4f const& pt = manager.raw_array<WORLD>()[parent];
-
     // compute our world transform
-    manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    const uint32_t generation = ++mGeneration;
+    computeWorldTransform(manager, i, mAccurateTranslations);
+    manager[i].generation = generation;
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(manager, child, generation, mAccurateTranslations);
+    }
+}
+
+void FTransformManager::computeWorldTransform(Sim& manager, Instance i, bool accurate) noexcept {
+    // find our parent's world transform, if any
+    // note: by using the raw_array() we don't need to check that parent is valid.
+    const Instance parent = manager[i].parent;
+    mat4f const& pt = manager.raw_array<WORLD>()[parent];
+    mat4f const& local = manager.elementAt<LOCAL>(i);
+    mat4f world = pt * local;
+    if (UTILS_UNLIKELY(accurate)) {
+        // compose the translations in double precision, assuming the parent is affine
+        const double3 lt = double3(local[3].xyz) + double3(manager.elementAt<LOCAL_LO>(i));
+        const double3 pt3 = double3(pt[3].xyz) + double3(manager.raw_array<WORLD_LO>()[parent]);
+        const double3 t = mat3(pt.upperLeft()) * lt + pt3;
+        world[3].xyz = float3(t);
+        manager.elementAt<WORLD_LO>(i) = float3(t - double3(world[3].xyz));
     }
+    manager.elementAt<WORLD>(i) = world;
 }
 
 void FTransformManager::openLocalTransformTransaction() noexcept {
@@ -144,6 +199,8 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
+        SYSTRACE_CALL();
+
         mLocalTransformTransactionOpen = false;
         auto& manager = mManager;
 
@@ -151,16 +208,73 @@ void FTransformManager::commitLocalTransformTransaction() noexcept {
         auto& soa = manager.getSoA();
         soa.ensureCapacity(soa.size() + 1);
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
+        // Ensure that children are always sorted after their parent.
         for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
             if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
                 swapNode(i, manager[i].parent);
             }
-            Instance parent = manager[i].parent;
+        }
+
+        // Propagate the dirty flags to the descendants, parents being visited first. The dirty
+        // nodes with a clean parent are the roots of independent dirty subtrees.
+        Instance const* const UTILS_RESTRICT parents = manager.raw_array<PARENT>();
+        uint8_t* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+        std::vector<Instance>& roots = mDirtyRoots;
+        roots.clear();
+        dirty[0] = 0; // the null instance is the parent of all roots
+        size_t dirtyCount = 0;
+        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+            const Instance parent = parents[i];
             assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+            if (dirty[i] && !dirty[parent]) {
+                roots.push_back(i);
+            }
+            dirty[i] |= dirty[parent];
+            dirtyCount += dirty[i];
         }
+
+        const uint32_t generation = ++mGeneration;
+        if (mJobSystem && roots.size() > 1 && dirtyCount >= PARALLEL_COMMIT_MIN_NODE_COUNT) {
+            // the subtrees are disjoint and can be updated concurrently
+            const bool accurate = mAccurateTranslations;
+            auto work = [&manager, &roots, generation, accurate](
+                    uint32_t startIndex, uint32_t count) {
+                for (uint32_t r = startIndex, e = startIndex + count; r < e; r++) {
+                    const Instance i = roots[r];
+                    computeWorldTransform(manager, i, accurate);
+                    manager[i].generation = generation;
+                    Instance child = manager[i].firstChild;
+                    if (child) {
+                        transformChildren(manager, child, generation, accurate);
+                    }
+                }
+            };
+            JobSystem& js = *mJobSystem;
+            auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(roots.size()),
+                    std::cref(work), jobs::CountSplitter<4, 8>());
+            js.runAndWait(job);
+        } else if (UTILS_UNLIKELY(mAccurateTranslations)) {
+            uint32_t* const UTILS_RESTRICT generations = soa.data<GENERATION>();
+            for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+                if (dirty[i]) {
+                    computeWorldTransform(manager, i, true);
+                    generations[i] = generation;
+                }
+            }
+        } else {
+            // a linear pass is faster than walking the subtrees
+            mat4f* const UTILS_RESTRICT world = soa.data<WORLD>();
+            mat4f const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+            uint32_t* const UTILS_RESTRICT generations = soa.data<GENERATION>();
+            for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+                if (dirty[i]) {
+                    world[i] = world[parents[i]] * local[i];
+                    generations[i] = generation;
+                }
+            }
+        }
+
+        std::fill_n(dirty + manager.begin(), manager.end() - manager.begin(), 0);
     }
 }
 
@@ -197,6 +311,10 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<GENERATION>(i), manager.elementAt<GENERATION>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
+    std::swap(manager.elementAt<LOCAL_LO>(i), manager.elementAt<LOCAL_LO>(j));
+    std::swap(manager.elementAt<WORLD_LO>(i), manager.elementAt<WORLD_LO>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -283,18 +401,17 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
+void FTransformManager::transformChildren(Sim& manager, Instance ci,
+        uint32_t generation, bool accurate) noexcept {
     while (ci) {
         // update child's world transform
-        Instance parent = manager[ci].parent;
-        mat4f const& pt = manager[parent].world;
-        mat4f const& local = manager[ci].local;
-        manager[ci].world = pt * local;
+        computeWorldTransform(manager, ci, accurate);
+        manager[ci].generation = generation;
 
         // assume we don't have a deep hierarchy
         Instance child = manager[ci].firstChild;
         if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
+            transformChildren(manager, child, generation, accurate);
         }
 
         // process our next child
@@ -346,7 +463,7 @@ void FTransformManager::validateNode(Instance i) noexcept {
 
 void FTransformManager::gc(utils::EntityManager& em) noexcept {
     auto& manager = mManager;
-    manager.gc(em, 4, [this](Entity e) {
+    manager.gc(em, [this](Entity e) {
                 destroy(e);
             });
 }
@@ -364,6 +481,10 @@ void TransformManager::create(Entity entity, Instance parent, const mat4f& world
     upcast(this)->create(entity, parent, worldTransform);
 }
 
+void TransformManager::create(Entity entity, Instance parent, const mat4& localTransform) {
+    upcast(this)->create(entity, parent, localTransform);
+}
+
 void TransformManager::destroy(Entity e) noexcept {
     upcast(this)->destroy(e);
 }
@@ -380,6 +501,15 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
+void TransformManager::setTransform(Instance ci, const mat4& model) noexcept {
+    upcast(this)->setTransform(ci, model);
+}
+
+void TransformManager::setTransforms(Instance const* instances, mat4f const* localTransforms,
+        size_t count) noexcept {
+    upcast(this)->setTransforms(instances, localTransforms, count);
+}
+
 const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
@@ -388,6 +518,22 @@ const mat4f& TransformManager::getWorldTransform(Instance ci) const noexcept {
     return upcast(this)->getWorldTransform(ci);
 }
 
+mat4 TransformManager::getTransformAccurate(Instance ci) const noexcept {
+    return upcast(this)->getTransformAccurate(ci);
+}
+
+mat4 TransformManager::getWorldTransformAccurate(Instance ci) const noexcept {
+    return upcast(this)->getWorldTransformAccurate(ci);
+}
+
+void TransformManager::setAccurateTranslationsEnabled(bool enable) noexcept {
+    upcast(this)->setAccurateTranslationsEnabled(enable);
+}
+
+bool TransformManager::isAccurateTranslationsEnabled() const noexcept {
+    return upcast(this)->isAccurateTranslationsEnabled();
+}
+
 void TransformManager::setParent(Instance i, Instance newParent) noexcept {
     upcast(this)->setParent(i, newParent);
 }
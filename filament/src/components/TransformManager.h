@@ -24,10 +24,13 @@
 #include <utils/compiler.h>
 #include <utils/SingleInstanceComponentManager.h>
 #include <utils/Entity.h>
+#include <utils/JobSystem.h>
 #include <utils/Slice.h>
 
 #include <math/mat4.h>
 
+#include <vector>
+
 namespace filament {
 namespace details {
 
@@ -35,7 +38,8 @@ class UTILS_PRIVATE FTransformManager : public TransformManager {
 public:
     using Instance = TransformManager::Instance;
 
-    FTransformManager() noexcept;
+    // when a JobSystem is given, large transactions are committed on multiple threads
+    explicit FTransformManager(utils::JobSystem* js = nullptr) noexcept;
     ~FTransformManager() noexcept;
 
     // free-up all resources
@@ -58,6 +62,8 @@ public:
 
     void create(utils::Entity entity, Instance parent, const math::mat4f& localTransform);
 
+    void create(utils::Entity entity, Instance parent, const math::mat4& localTransform);
+
     void destroy(utils::Entity e) noexcept;
 
     void setParent(Instance i, Instance newParent) noexcept;
@@ -74,6 +80,11 @@ public:
 
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
+    void setTransform(Instance ci, const math::mat4& model) noexcept;
+
+    void setTransforms(Instance const* instances, math::mat4f const* models,
+            size_t count) noexcept;
+
     const math::mat4f& getTransform(Instance ci) const noexcept {
         return mManager[ci].local;
     }
@@ -82,6 +93,36 @@ public:
         return mManager[ci].world;
     }
 
+    math::mat4 getTransformAccurate(Instance ci) const noexcept {
+        return accurate(mManager[ci].local, mManager[ci].localTranslationLo);
+    }
+
+    math::mat4 getWorldTransformAccurate(Instance ci) const noexcept {
+        return accurate(mManager[ci].world, mManager[ci].worldTranslationLo);
+    }
+
+    void setAccurateTranslationsEnabled(bool enable) noexcept;
+
+    bool isAccurateTranslationsEnabled() const noexcept {
+        return mAccurateTranslations;
+    }
+
+    // Generation of the last world transform update, across all instances. This is
+    // incremented every time any world transform changes.
+    uint32_t getGeneration() const noexcept {
+        return mGeneration;
+    }
+
+    // Generation at which this instance's world transform was last updated.
+    uint32_t getGeneration(Instance ci) const noexcept {
+        return mManager[ci].generation;
+    }
+
+    // Changes every time instances are created, destroyed or reordered.
+    uint32_t getLayoutGeneration() const noexcept {
+        return mManager.getLayoutGeneration();
+    }
+
 private:
     struct Sim;
 
@@ -91,7 +132,18 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    static void transformChildren(Sim& manager, Instance firstChild, uint32_t generation,
+            bool accurate) noexcept;
+    static void computeWorldTransform(Sim& manager, Instance i, bool accurate) noexcept;
+
+    static math::mat4 accurate(math::mat4f const& m, math::float3 const& translationLo) noexcept {
+        math::mat4 r(m);
+        r[3].xyz += translationLo;
+        return r;
+    }
+
+    // minimum number of dirty nodes for committing a transaction on multiple threads
+    static constexpr size_t PARALLEL_COMMIT_MIN_NODE_COUNT = 1024;
 
 
     enum {
@@ -101,6 +153,10 @@ private:
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        GENERATION,     // generation of the last world transform update
+        DIRTY,          // local transform changed during the current transaction
+        LOCAL_LO,       // accurate local translation minus the local transform's
+        WORLD_LO,       // accurate world translation minus the world transform's
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -109,7 +165,11 @@ private:
             Instance,
             Instance,
             Instance,
-            Instance
+            Instance,
+            uint32_t,
+            uint8_t,
+            math::float3,
+            math::float3
     >;
 
     struct Sim : public Base {
@@ -132,6 +192,10 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<GENERATION>   generation;
+                Field<DIRTY>        dirty;
+                Field<LOCAL_LO>     localTranslationLo;
+                Field<WORLD_LO>     worldTranslationLo;
             };
         };
 
@@ -144,7 +208,11 @@ private:
     };
 
     Sim mManager;
+    uint32_t mGeneration = 0;
     bool mLocalTransformTransactionOpen = false;
+    bool mAccurateTranslations = false;
+    utils::JobSystem* mJobSystem = nullptr;
+    std::vector<Instance> mDirtyRoots;  // temporary storage for commitLocalTransformTransaction()
 };
 
 FILAMENT_UPCAST(TransformManager)
@@ -23,21 +23,40 @@ namespace filament {
 namespace details {
 
 // per render pass allocations
-// Froxelization needs about 1 MiB. Command buffer needs about 1 MiB.
-static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 2 * 1024 * 1024;
+// Froxelization needs about 1 MiB.
+static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 1 * 1024 * 1024;
 
-// size of the high-level draw commands buffer (comes from the per-render pass allocator)
+// initial size of the high-level draw commands buffer (owned by each Renderer, it grows as needed)
 static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE = 1 * 1024 * 1024;
 
 // size of a command-stream buffer (comes from mmap -- not the per-engine arena)
 static constexpr size_t CONFIG_MIN_COMMAND_BUFFERS_SIZE = 1 * 1024 * 1024;
 static constexpr size_t CONFIG_COMMAND_BUFFERS_SIZE     = 3 * CONFIG_MIN_COMMAND_BUFFERS_SIZE;
 
+// initial size of the engine's heap (engine objects, cameras), it grows as needed
+static constexpr size_t CONFIG_HEAP_ARENA_SIZE = 1 * 1024 * 1024;
+
+// tags of the engine's heap allocations, see utils::TlsfAllocator::setTag()
+enum HeapTag : uint8_t {
+    HEAP_TAG_OTHER,
+    HEAP_TAG_BUFFER,
+    HEAP_TAG_TEXTURE,
+    HEAP_TAG_MATERIAL,
+    HEAP_TAG_RENDERER,
+    HEAP_TAG_SCENE,
+    HEAP_TAG_VIEW,
+    HEAP_TAG_CAMERA,
+    HEAP_TAG_COUNT
+};
+
+static_assert(HEAP_TAG_COUNT <= utils::TlsfAllocator::TAG_COUNT, "too many heap tags");
+
 #ifndef NDEBUG
 
 using HeapAllocatorArena = utils::Arena<
-        utils::HeapAllocator,
-        utils::LockingPolicy::NoLock>;
+        utils::TlsfAllocator,
+        utils::LockingPolicy::SpinLock,
+        utils::TrackingPolicy::HighWatermark>;
 
 using LinearAllocatorArena = utils::Arena<
         utils::LinearAllocator,
@@ -47,8 +66,8 @@ using LinearAllocatorArena = utils::Arena<
 #else
 
 using HeapAllocatorArena = utils::Arena<
-        utils::HeapAllocator,
-        utils::LockingPolicy::NoLock>;
+        utils::TlsfAllocator,
+        utils::LockingPolicy::SpinLock>;
 
 using LinearAllocatorArena = utils::Arena<
         utils::LinearAllocator,
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BVH_H
+#define TNT_FILAMENT_DETAILS_BVH_H
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy of axis-aligned boxes, used to accelerate frustum culling.
+ *
+ * Boxes are identified by a "slot", their index in the arrays given to build(). The tree is
+ * built once, then kept up-to-date by updating the boxes that moved and refitting the nodes
+ * that contain them, which is much cheaper than a rebuild but degrades the tree over time.
+ */
+class UTILS_PUBLIC Bvh {
+public:
+    // maximum number of boxes in a leaf
+    static constexpr uint32_t LEAF_SIZE = 8;
+
+    // rebuilds the hierarchy from scratch, slot i is the box { center[i], extent[i] }
+    void build(math::float3 const* center, math::float3 const* extent, size_t count);
+
+    void clear() noexcept;
+
+    bool empty() const noexcept { return mNodes.empty(); }
+
+    // number of slots
+    size_t size() const noexcept { return mBoxes.size(); }
+
+    // updates the box of a slot, the hierarchy is updated by refit()
+    void update(uint32_t slot, math::float3 const& center, math::float3 const& extent) noexcept;
+
+    // recomputes the bounds of all the nodes containing a slot updated since the last refit()
+    void refit() noexcept;
+
+    // calls visitor(slot) for each slot whose box intersects the frustum
+    template<typename VISITOR>
+    void cull(Frustum const& frustum, VISITOR visitor) const {
+        cull(frustum.getNormalizedPlanes(), visitor);
+    }
+
+    // same as above, with the 6 normalized planes of a frustum
+    template<typename VISITOR>
+    void cull(math::float4 const* planes, VISITOR visitor) const;
+
+    // calls visitor(slot) for each slot whose box overlaps the box [min, max]
+    template<typename VISITOR>
+    void query(math::float3 const& min, math::float3 const& max, VISITOR visitor) const;
+
+    // Calls visitor(slot, distance) for the slots whose box the ray enters before 'far', at
+    // 'distance' (0 if the origin is inside the box). The visitor returns the new 'far', which
+    // prunes the boxes further away; the nearest boxes are visited first.
+    template<typename VISITOR>
+    void raycast(math::float3 const& origin, math::float3 const& invDirection, float far,
+            VISITOR visitor) const;
+
+private:
+    struct Bounds {
+        math::float3 min;
+        math::float3 max;
+    };
+
+    struct Node {
+        Bounds bounds;
+        uint32_t child = 0;     // index of the first of the two children, 0 for leaves
+        uint32_t first = 0;     // first index in mSlots of this node's subtree
+        uint32_t count = 0;     // number of slots in this node's subtree
+        uint32_t parent = 0;
+    };
+
+    enum class Classification : uint8_t { OUTSIDE, INTERSECTS, INSIDE };
+
+    static Classification classify(math::float4 const* planes, Bounds const& b) noexcept;
+
+    static bool overlaps(Bounds const& lhs, Bounds const& rhs) noexcept {
+        return all(lessThanEqual(lhs.min, rhs.max)) && all(lessThanEqual(rhs.min, lhs.max));
+    }
+
+    static bool contains(Bounds const& outer, Bounds const& inner) noexcept {
+        return all(lessThanEqual(outer.min, inner.min)) && all(lessThanEqual(inner.max, outer.max));
+    }
+
+    // slab test, returns the distance at which the ray enters the box, or INFINITY if it
+    // doesn't before 'far'
+    static float intersect(math::float3 const& origin, math::float3 const& invDirection,
+            Bounds const& b, float far) noexcept {
+        const math::float3 t0 = (b.min - origin) * invDirection;
+        const math::float3 t1 = (b.max - origin) * invDirection;
+        const math::float3 tmin = min(t0, t1);
+        const math::float3 tmax = max(t0, t1);
+        const float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+        const float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, far));
+        return enter <= exit ? enter : INFINITY;
+    }
+    static Bounds merge(Bounds const& lhs, Bounds const& rhs) noexcept;
+    Bounds computeLeafBounds(Node const& node) const noexcept;
+
+    std::vector<Node> mNodes;           // parents are always stored before their children
+    std::vector<uint32_t> mSlots;       // slots, grouped by subtree
+    std::vector<Bounds> mBoxes;         // indexed by slot
+    std::vector<uint32_t> mLeaves;      // leaf node of each slot
+    std::vector<uint8_t> mDirty;        // indexed by node
+    bool mHasDirtyNodes = false;
+};
+
+template<typename VISITOR>
+void Bvh::cull(math::float4 const* planes, VISITOR visitor) const {
+    if (UTILS_UNLIKELY(mNodes.empty())) {
+        return;
+    }
+
+    uint32_t const* const slots = mSlots.data();
+
+    // the tree is balanced, so its depth is ~log2(size / LEAF_SIZE) + 1
+    uint32_t stack[64];
+    size_t top = 0;
+    stack[top++] = 0;
+    while (top) {
+        Node const& node = mNodes[stack[--top]];
+        const Classification c = classify(planes, node.bounds);
+        if (c == Classification::OUTSIDE) {
+            continue;
+        }
+        if (c == Classification::INSIDE) {
+            // the whole subtree is visible
+            for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+                visitor(slots[i]);
+            }
+            continue;
+        }
+        if (node.child) {
+            stack[top++] = node.child;
+            stack[top++] = node.child + 1;
+            continue;
+        }
+        for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+            if (classify(planes, mBoxes[slots[i]]) != Classification::OUTSIDE) {
+                visitor(slots[i]);
+            }
+        }
+    }
+}
+
+template<typename VISITOR>
+void Bvh::query(math::float3 const& min, math::float3 const& max, VISITOR visitor) const {
+    if (UTILS_UNLIKELY(mNodes.empty())) {
+        return;
+    }
+
+    const Bounds box = { min, max };
+    uint32_t const* const slots = mSlots.data();
+    uint32_t stack[64];
+    size_t top = 0;
+    stack[top++] = 0;
+    while (top) {
+        Node const& node = mNodes[stack[--top]];
+        if (!overlaps(box, node.bounds)) {
+            continue;
+        }
+        if (contains(box, node.bounds)) {
+            for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+                visitor(slots[i]);
+            }
+            continue;
+        }
+        if (node.child) {
+            stack[top++] = node.child;
+            stack[top++] = node.child + 1;
+            continue;
+        }
+        for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+            if (overlaps(box, mBoxes[slots[i]])) {
+                visitor(slots[i]);
+            }
+        }
+    }
+}
+
+template<typename VISITOR>
+void Bvh::raycast(math::float3 const& origin, math::float3 const& invDirection, float far,
+        VISITOR visitor) const {
+    if (UTILS_UNLIKELY(mNodes.empty())) {
+        return;
+    }
+
+    uint32_t const* const slots = mSlots.data();
+    uint32_t stack[64];
+    size_t top = 0;
+    stack[top++] = 0;
+    while (top) {
+        // the node is tested again, 'far' may have come closer since it was pushed
+        Node const& node = mNodes[stack[--top]];
+        if (intersect(origin, invDirection, node.bounds, far) == INFINITY) {
+            continue;
+        }
+        if (node.child) {
+            // the nearest child is popped first
+            const uint32_t a = node.child;
+            const uint32_t b = node.child + 1;
+            const float ta = intersect(origin, invDirection, mNodes[a].bounds, far);
+            const float tb = intersect(origin, invDirection, mNodes[b].bounds, far);
+            const bool aFirst = ta <= tb;
+            if ((aFirst ? tb : ta) != INFINITY) {
+                stack[top++] = aFirst ? b : a;
+            }
+            if ((aFirst ? ta : tb) != INFINITY) {
+                stack[top++] = aFirst ? a : b;
+            }
+            continue;
+        }
+        for (uint32_t i = node.first, e = node.first + node.count; i < e; i++) {
+            const float t = intersect(origin, invDirection, mBoxes[slots[i]], far);
+            if (t != INFINITY) {
+                far = visitor(slots[i], t);
+            }
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BVH_H
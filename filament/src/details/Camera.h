@@ -73,6 +73,7 @@ public:
 
     // sets the camera's view matrix (must be a rigid transform)
     void setModelMatrix(const math::mat4f& modelMatrix) noexcept;
+    void setModelMatrix(const math::mat4& modelMatrix) noexcept;
 
     // sets the camera's view matrix
     void lookAt(const math::float3& eye, const math::float3& center, const math::float3& up = { 0, 1, 0 })  noexcept;
@@ -80,6 +81,9 @@ public:
     // returns the view matrix
     math::mat4f const& getModelMatrix() const noexcept;
 
+    // returns the view matrix with the accurate translation, see TransformManager
+    math::mat4 getModelMatrixAccurate() const noexcept;
+
     // returns the inverse of the view matrix
     math::mat4f getViewMatrix() const noexcept;
 
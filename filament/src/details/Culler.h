@@ -33,6 +33,8 @@ namespace details {
  *
  * The implementation assumes 'count' below is multiple of 8
  *
+ * Explicit 8-wide kernels are used when available: NEON on ARM64 and WASM SIMD are selected
+ * at compile time, AVX2 is selected at runtime. Otherwise we rely on auto-vectorization.
  */
 
 class Culler {
@@ -92,6 +94,18 @@ public:
                 Frustum const& frustum,
                 math::float4 const* b,
                 size_t count) noexcept;
+
+        // reference implementations, bypassing the SIMD kernels
+        static void intersectsScalar(result_type* results,
+                Frustum const& frustum,
+                math::float3 const* c,
+                math::float3 const* e,
+                size_t count) noexcept;
+
+        static void intersectsScalar(result_type* results,
+                Frustum const& frustum,
+                math::float4 const* b,
+                size_t count) noexcept;
     };
 };
 
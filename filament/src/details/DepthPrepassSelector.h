@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_DEPTHPREPASSSELECTOR_H
+#define TNT_FILAMENT_DETAILS_DEPTHPREPASSSELECTOR_H
+
+#include "FrameInfo.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * DepthPrepassSelector picks, for View::DepthPrepass::AUTOMATIC, whether a view is rendered with
+ * a depth pre-pass.
+ *
+ * The cheapest strategy depends on the overdraw of the scene and on the GPU, and can only be
+ * known by measuring it. Most frames use the current choice, but a few frames every
+ * PROBE_PERIOD are rendered with the other one. The GPU time of each frame's color pass is
+ * attributed to the choice made for that frame, and the choice flips when the other one is
+ * measurably cheaper. Probe frames are close in time to the frames they're compared to, so
+ * they're rendering nearly the same content.
+ */
+class DepthPrepassSelector {
+public:
+    using duration = FrameInfo::duration;
+
+    explicit DepthPrepassSelector(bool prepass = true) noexcept : mPrepass(prepass) { }
+
+    // returns whether the given frame should be rendered with a depth pre-pass
+    bool select(uint32_t frameId) noexcept;
+
+    // the GPU time of the color pass of a past frame, frames not selected here are ignored
+    void addMeasurement(uint32_t frameId, duration colorPass) noexcept;
+
+    // the choice made by the last select()
+    bool hasDepthPrepass() const noexcept { return mSelected; }
+
+private:
+    static constexpr uint32_t PROBE_PERIOD = 64;
+    static constexpr uint32_t PROBE_FRAMES = 4;
+    // larger than the latency of GPU timer queries, in frames
+    static constexpr size_t HISTORY_SIZE = 16;
+
+    struct Decision {
+        uint32_t frameId = 0;
+        bool prepass = false;
+        bool valid = false;
+    };
+
+    Decision mHistory[HISTORY_SIZE];
+    float mCost[2] = {};        // color pass times in ms, indexed by the choice
+    bool mMeasured[2] = {};
+    bool mPrepass;              // current choice
+    bool mSelected = mPrepass;  // choice for the last selected frame
+    uint32_t mFrameCount = 0;
+    uint32_t mLastMeasured = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_DEPTHPREPASSSELECTOR_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_DESTROYBATCH_H
+#define TNT_FILAMENT_DETAILS_DESTROYBATCH_H
+
+#include "driver/DriverApi.h"
+#include "driver/Handle.h"
+
+#include <utils/compiler.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <stddef.h>
+#include <string.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Collects the driver handles freed by the batched Engine::destroy() calls, so that they're all
+ * destroyed by a few destroyHandles() commands instead of one command each. The handles are
+ * destroyed in the order they're added, when the batch is committed or goes out of scope.
+ *
+ * A batch writes into the DriverApi it's given, it must not outlive the call that created it.
+ */
+class DestroyBatch {
+public:
+    // keeps each command well below the size of a command buffer
+    static constexpr size_t MAX_HANDLE_COUNT = 4096;
+
+    // capacity is a hint of the number of handles that will be added
+    DestroyBatch(driver::DriverApi& driver, size_t capacity) : mDriver(driver) {
+        mHandles.reserve(std::min(capacity, MAX_HANDLE_COUNT));
+    }
+
+    ~DestroyBatch() noexcept {
+        commit();
+    }
+
+    DestroyBatch(DestroyBatch const&) = delete;
+    DestroyBatch& operator=(DestroyBatch const&) = delete;
+
+    void add(Handle<HwRenderPrimitive> h) { add(h.getId(), HandleType::RENDER_PRIMITIVE); }
+    void add(Handle<HwVertexBuffer> h) { add(h.getId(), HandleType::VERTEX_BUFFER); }
+    void add(Handle<HwIndexBuffer> h) { add(h.getId(), HandleType::INDEX_BUFFER); }
+    void add(Handle<HwTexture> h) { add(h.getId(), HandleType::TEXTURE); }
+    void add(Handle<HwUniformBuffer> h) { add(h.getId(), HandleType::UNIFORM_BUFFER); }
+    void add(Handle<HwSamplerBuffer> h) { add(h.getId(), HandleType::SAMPLER_BUFFER); }
+
+    // destroys the handles added so far
+    void commit() noexcept {
+        if (!mHandles.empty()) {
+            const size_t size = mHandles.size() * sizeof(Driver::DestroyedHandle);
+            void* const handles = mDriver.allocate(size, alignof(Driver::DestroyedHandle));
+            memcpy(handles, mHandles.data(), size);
+            mDriver.destroyHandles({ handles, size });
+            mHandles.clear();
+        }
+    }
+
+private:
+    using HandleType = Driver::HandleType;
+
+    void add(HandleBase::HandleId id, HandleType type) {
+        if (id != HandleBase::nullid) {
+            if (UTILS_UNLIKELY(mHandles.size() == MAX_HANDLE_COUNT)) {
+                commit();
+            }
+            mHandles.push_back({ id, type });
+        }
+    }
+
+    driver::DriverApi& mDriver;
+    std::vector<Driver::DestroyedHandle> mHandles;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_DESTROYBATCH_H
@@ -18,8 +18,14 @@
 #define TNT_FILAMENT_DETAILS_ENGINE_H
 
 #include "upcast.h"
+#include "CpuStageTimings.h"
+#include "FrameCounters.h"
+#include "IblPrefilter.h"
+#include "MipmapGenerator.h"
 #include "PostProcessManager.h"
+#include "PreSkinning.h"
 #include "RenderTargetPool.h"
+#include "TextureStreamer.h"
 
 #include "components/CameraManager.h"
 #include "components/LightManager.h"
@@ -29,38 +35,52 @@
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/DebugRegistry.h"
+#include "details/Impostor.h"
+#include "details/ParticleSystem.h"
+#include "details/RenderTarget.h"
 #include "details/ResourceList.h"
 #include "details/Skybox.h"
+#include "details/Terrain.h"
 
 #include "driver/CommandStream.h"
 #include "driver/CommandBufferQueue.h"
 #include "driver/DriverApi.h"
 
 #include <filament/Engine.h>
+#include <filament/Impostor.h>
 #include <filament/VertexBuffer.h>
 #include <filament/IndirectLight.h>
 #include <filament/Material.h>
+#include <filament/ParticleSystem.h>
+#include <filament/RenderTarget.h>
 #include <filament/Texture.h>
 #include <filament/Skybox.h>
 #include <filament/Stream.h>
+#include <filament/Terrain.h>
 
 #include <filaflat/MaterialParser.h>
 #include <filaflat/ShaderBuilder.h>
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/CString.h>
 #include <utils/JobSystem.h>
 #include <utils/CountDownLatch.h>
+#include <utils/Mutex.h>
+#include <utils/ThreadLocal.h>
 
 #include <math/mat4.h>
 #include <math/quat.h>
 
+#include <atomic>
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 namespace filament {
 
+class CommandTraceRecorder;
 class Renderer;
 class Driver;
 class Program;
@@ -104,6 +124,8 @@ public:
     static constexpr bool   CONFIG_IBL_USE_IRRADIANCE_MAP  = false;
 
     static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE   = details::CONFIG_PER_RENDER_PASS_ARENA_SIZE;
+
+    // defaults of the corresponding Engine::Config fields
     static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE      = details::CONFIG_PER_FRAME_COMMANDS_SIZE;
     static constexpr size_t CONFIG_MIN_COMMAND_BUFFERS_SIZE     = details::CONFIG_MIN_COMMAND_BUFFERS_SIZE;
     static constexpr size_t CONFIG_COMMAND_BUFFERS_SIZE         = details::CONFIG_COMMAND_BUFFERS_SIZE;
@@ -117,7 +139,7 @@ public:
         math::mat4f clipFromViewMatrix;
         math::mat4f viewFromClipMatrix;
         math::mat4f clipFromWorldMatrix;
-        math::mat4f lightFromWorldMatrix;
+        math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES];
 
         math::float4 resolution; // width, height, 1/width, 1/height
 
@@ -131,7 +153,9 @@ public:
         math::float3 lightDirection;
         uint32_t fParamsX; // stride-x
 
-        math::float3 shadowBias; // constant bias, normal bias, unused
+        float vsmExponent;  // exponent of the variance shadows' moments, 0 when they use PCF
+        float padding0;
+        float orderIndependentTransparency; // 1 if the color pass uses it, 0 otherwise
         float oneOverFroxelDimensionY;
 
         math::float4 zParams; // froxel Z parameters
@@ -145,13 +169,27 @@ public:
         float ev100;
 
         alignas(16) math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
+
+        math::float4 shadowCascadeSplits; // view-space distance at which each cascade ends
+        math::float4 shadowConstantBias;  // for each cascade
+        math::float4 shadowNormalBias;    // for each cascade
+
+        // spot lights, indexed by the shadow index of their LightsUib entry
+        math::mat4f spotLightFromWorldMatrix[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+        math::float4 spotShadowBias[CONFIG_MAX_SHADOWED_SPOT_LIGHTS]; // constant, normal, 0, 0
+
+        // irradiance volume, see IndirectLight::Builder::irradianceVolume()
+        math::mat4f irradianceVolumeFromWorldMatrix; // to the volume's [0, 1] texture coordinates
+        math::float4 irradianceVolumeParams; // 1 if there's a volume, probes along z, 1/depth, 0
     };
 
     struct PerRenderableUib {
         static UniformInterfaceBlock getUib() noexcept;
         // these fields are only used to call offsetof() and make it easy to visualize the UBO
-        math::mat4f worldFromModelMatrix;
-        math::mat3f worldFromModelNormalMatrix;
+        math::float4 worldFromModelRows[3]; // the last row of the transform is (0, 0, 0, 1)
+        math::float4 morphWeights;
+        uint32_t textureLayer;
+        uint32_t flags;         // FRenderableManager::SKINNING_ENABLED and MORPHING_ENABLED
     };
 
     struct PostProcessingUib {
@@ -159,6 +197,23 @@ public:
         math::float2 uvScale;
         float time;             // time in seconds, with a 1 second period, used for dithering
         float yOffset;
+        math::mat4f reprojection;   // temporal upsampling, from clip space to the history's
+        math::float2 historySize;   // temporal upsampling, size of the history texture
+        math::float2 jitter;        // temporal upsampling, of the input, in pixels
+        float historyWeight;        // temporal upsampling, 0 when there is no history
+        float iblRoughness;         // IBL prefilter, linear roughness of the level
+        int32_t iblFace;            // IBL prefilter, cubemap face being rendered
+        float iblSize;              // IBL prefilter, size of the level rendered (or projected)
+        math::float2 shadowBlurDirection;   // variance shadows, one texel along the blur's axis
+        float vsmExponent;                  // variance shadows, exponent of the moments
+        int32_t shadowBlurFromDepth;        // variance shadows, 1 if the input is the depth
+        math::float4 shadowBlurBounds;      // variance shadows, texels of the cascade's tile
+        float autoExposure;                 // tone mapping, 1 if the auto-exposure is bound
+        float autoExposureHistory;          // auto-exposure, 0 when there is no history
+        math::float2 autoExposureRange;     // auto-exposure, EV range of the correction
+        math::float4 autoExposureAdaptation;    // auto-exposure, rates up/down, dt, compensation
+        int32_t mipmapFace;                 // mipmap generation, cubemap face or -1 for 2D
+        float heatmapRange;                 // debug visualization, value shown in red
     };
 
     struct PerViewSib {
@@ -169,23 +224,37 @@ public:
         static constexpr size_t FROXELS        = 2;
         static constexpr size_t IBL_DFG_LUT    = 3;
         static constexpr size_t IBL_SPECULAR   = 4;
-        static constexpr size_t IBL_IRRADIANCE = 5;
+        static constexpr size_t SHADOW_ATLAS   = 5;
+        static constexpr size_t SHADOW_MOMENTS = 6;
+        static constexpr size_t IRRADIANCE_VOLUME = 7;
     };
 
     struct PostProcessSib {
         static SamplerInterfaceBlock getSib() noexcept;
         // indices of each samplers in this SamplerInterfaceBlock (see: getSib())
         static constexpr size_t COLOR_BUFFER   = 0;
+        static constexpr size_t HISTORY_BUFFER = 1;
+        static constexpr size_t ENVIRONMENT    = 2;
+        static constexpr size_t DEPTH_BUFFER   = 3;
+        static constexpr size_t COLOR_GRADING  = 4;
+        static constexpr size_t AUTO_EXPOSURE  = 5;
     };
 
 public:
     static FEngine* create(Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            const Config* config = nullptr);
 
     ~FEngine() noexcept;
 
     Driver& getDriver() const noexcept { return *mDriver; }
-    DriverApi& getDriverApi() noexcept { return mCommandStream; }
+
+    DriverApi& getDriverApi() noexcept {
+        // loader threads record their commands in a stream of their own
+        return UTILS_UNLIKELY(mLoaderThreadCount.load(std::memory_order_relaxed)) ?
+                getLoaderDriverApi() : mCommandStream;
+    }
+
     DFG* getDFG() const noexcept { return mDFG.get(); }
 
 
@@ -204,10 +273,47 @@ public:
     LinearAllocatorArena& getPerRenderPassAllocator() noexcept { return mPerRenderPassAllocator; }
 
     // Material IDs...
-    uint32_t getMaterialId() const noexcept { return mMaterialId++; }
+    uint32_t getMaterialId() const noexcept { return mMaterialId.fetch_add(1); }
 
-    const FMaterial* getDefaultMaterial() const noexcept { return mDefaultMaterial; }
+    const FMaterial* getDefaultMaterial() const noexcept {
+        FMaterial const* const material = mDefaultMaterial.load(std::memory_order_acquire);
+        return UTILS_LIKELY(material) ? material : createDefaultMaterial();
+    }
     const FMaterial* getSkyboxMaterial(bool rgbm) const noexcept;
+    const FMaterial* getImpostorMaterial() const noexcept;
+    const FMaterial* getTerrainMaterial() const noexcept;
+
+    // the impostors collect the renderables they replace in each pass, see
+    // FView::updatePrimitivesLod()
+    void resetImpostors() noexcept {
+        mImpostors.forEach([](FImpostor* impostor) { impostor->reset(); });
+    }
+    void commitImpostors() noexcept {
+        mImpostors.forEach([this](FImpostor* impostor) { impostor->commit(*this); });
+    }
+
+    // the debug visualizations of the color pass, selected with the "d.view.visualization"
+    // property; the commands are drawn with the debug material, which writes a value that
+    // the DEBUG_HEATMAP post-process maps to colors
+    enum class DebugVisualization : uint8_t {
+        NONE,
+        OVERDRAW,           // fragments drawn per pixel
+        SHADER_COST,        // cost of the visible materials, see FMaterial::getShaderCost()
+        FROXEL_LIGHTS,      // lights of the visible froxels
+    };
+
+    DebugVisualization getDebugVisualization() const noexcept {
+        return debug.view.visualization > 0 && debug.view.visualization <= 3 ?
+                DebugVisualization(debug.view.visualization) : DebugVisualization::NONE;
+    }
+
+    // the value of the visualization drawn with the hottest color
+    float getDebugVisualizationRange(DebugVisualization visualization) const noexcept;
+
+    // the instance of the debug material that draws the given visualization, of the given
+    // shader cost with SHADER_COST; the instances are created the first time they're used
+    FMaterialInstance const* getDebugVisualizationInstance(
+            DebugVisualization visualization, uint32_t shaderCost) const noexcept;
     const FIndirectLight* getDefaultIndirectLight() const noexcept { return mDefaultIbl; }
 
     Handle <HwProgram> getPostProcessProgramSlow(PostProcessStage stage) const noexcept;
@@ -247,6 +353,39 @@ public:
         return mRenderTargetPool;
     }
 
+    TextureStreamer& getTextureStreamer() noexcept {
+        return mTextureStreamer;
+    }
+
+    IblPrefilter& getIblPrefilter() noexcept {
+        return mIblPrefilter;
+    }
+
+    MipmapGenerator& getMipmapGenerator() noexcept {
+        return mMipmapGenerator;
+    }
+
+    PreSkinning& getPreSkinning() noexcept {
+        return mPreSkinning;
+    }
+
+    CpuStageTimings& getCpuStageTimings() noexcept {
+        return mCpuStageTimings;
+    }
+
+    FrameCounters& getFrameCounters() const noexcept {
+        return mFrameCounters;
+    }
+
+    void getLastFrameStatistics(FrameStatistics* stats) const noexcept;
+
+    // changes each time the state of a material instance changes, i.e. its uniforms, samplers
+    // or scissor, see FMaterialInstance::updateState()
+    uint32_t getMaterialInstanceGeneration() const noexcept {
+        return mMaterialInstanceGeneration;
+    }
+    void invalidateMaterialInstances() noexcept { mMaterialInstanceGeneration++; }
+
     FRenderableManager& getRenderableManager() noexcept {
         return mRenderableManager;
     }
@@ -271,6 +410,20 @@ public:
         return mHeapAllocator;
     }
 
+    // constructs an object on the engine's heap, its memory is accounted to the given tag
+    template<typename T, typename ... ARGS>
+    T* heapMake(HeapTag tag, ARGS&& ... args) noexcept {
+        void* p;
+        { // loader threads allocate too, the tag must stay the same until we're done
+            std::lock_guard<utils::LockingPolicy::SpinLock> guard(mHeapTagLock);
+            utils::TlsfAllocator& allocator = mHeapAllocator.getAllocator();
+            uint8_t previous = allocator.setTag(tag);
+            p = mHeapAllocator.alloc(sizeof(T), alignof(T));
+            allocator.setTag(previous);
+        }
+        return p ? new(p) T(std::forward<ARGS>(args)...) : nullptr;
+    }
+
     Backend getBackend() const noexcept {
         return mBackend;
     }
@@ -283,20 +436,39 @@ public:
 
     utils::JobSystem& getJobSystem() noexcept { return mJobSystem; }
 
+    // initial size in bytes of a Renderer's draw commands buffer
+    size_t getPerFrameCommandsSize() const noexcept { return mPerFrameCommandsSize; }
+
+    // grows the command buffers if the last frames got too close to overflowing them, this
+    // must be called between frames.
+    void updateCommandBufferSize() noexcept;
+
     Epoch getEpoch() const { return mEpoch; }
 
     void shutdown();
 
-    template <typename T>
-    T* create(ResourceList<T>& list, typename T::Builder const& builder) noexcept;
+    MemoryStats getMemoryStats() noexcept;
+
+    void setMemoryBudget(size_t cpuBudget, size_t gpuBudget,
+            MemoryBudgetCallback callback, void* user) noexcept;
+
+    TrimMemoryStats trimMemory(TrimMemoryLevel level);
+
+    template <typename T, typename L>
+    T* create(ResourceList<T, L>& list, typename T::Builder const& builder,
+            HeapTag tag) noexcept;
 
     FVertexBuffer* createVertexBuffer(const VertexBuffer::Builder& builder) noexcept;
     FIndexBuffer* createIndexBuffer(const IndexBuffer::Builder& builder) noexcept;
+    FImpostor* createImpostor(const Impostor::Builder& builder) noexcept;
     FIndirectLight* createIndirectLight(const IndirectLight::Builder& builder) noexcept;
     FMaterial* createMaterial(const Material::Builder& builder) noexcept;
     FTexture* createTexture(const Texture::Builder& builder) noexcept;
+    FParticleSystem* createParticleSystem(const ParticleSystem::Builder& builder) noexcept;
     FSkybox* createSkybox(const Skybox::Builder& builder) noexcept;
+    FRenderTarget* createRenderTarget(const RenderTarget::Builder& builder) noexcept;
     FStream* createStream(const Stream::Builder& builder) noexcept;
+    FTerrain* createTerrain(const Terrain::Builder& builder) noexcept;
 
     void createRenderable(const RenderableManager::Builder& builder, utils::Entity entity);
     void createLight(const LightManager::Builder& builder, utils::Entity entity);
@@ -309,25 +481,42 @@ public:
     FCamera* createCamera(utils::Entity entity) noexcept;
     FFence* createFence(Fence::Type type = Fence::Type::SOFT) noexcept;
     FSwapChain* createSwapChain(void* nativeWindow, uint64_t flags) noexcept;
+    FSwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept;
 
     void destroy(const FVertexBuffer* p);
     void destroy(const FFence* p);
     void destroy(const FIndexBuffer* p);
+    void destroy(const FImpostor* p);
     void destroy(const FIndirectLight* p);
     void destroy(const FMaterial* p);
     void destroy(const FMaterialInstance* p);
+    void destroy(const FParticleSystem* p);
     void destroy(const FRenderer* p);
+    void destroy(const FRenderTarget* p);
     void destroy(const FScene* p);
     void destroy(const FSkybox* p);
     void destroy(const FStream* p);
+    void destroy(const FTerrain* p);
     void destroy(const FTexture* p);
     void destroy(const FSwapChain* p);
     void destroy(const FView* p);
     void destroy(utils::Entity e);
 
+    // see Engine::destroy(const VertexBuffer* const*, size_t)
+    void destroy(const VertexBuffer* const* p, size_t count);
+    void destroy(const IndexBuffer* const* p, size_t count);
+    void destroy(const MaterialInstance* const* p, size_t count);
+    void destroy(const Texture* const* p, size_t count);
+    void destroy(utils::Entity const* entities, size_t count);
+
     // flush the current buffer
     void flush();
 
+    // see Engine::attachLoaderThread()
+    void attachLoaderThread();
+    void flushLoaderThread();
+    void detachLoaderThread();
+
     void prepare();
     void gc();
 
@@ -343,18 +532,36 @@ public:
         return mDebugRegistry;
     }
 
+    StartupTimings const& getStartupTimings() const noexcept {
+        return mStartupTimings;
+    }
+
+    // called at the end of each frame, completes the startup timings after the first one
+    void recordEndFrame() noexcept {
+        if (UTILS_UNLIKELY(mStartupTimings.firstFrame == 0)) {
+            mStartupTimings.firstFrame = toMilliseconds(clock::now() - mCreationTime);
+        }
+    }
+
     bool execute();
 
 private:
-    FEngine(Backend backend, Platform* platform, void* sharedGLContext);
+    FEngine(Backend backend, Platform* platform, void* sharedGLContext, Config const& config);
     void init();
 
     int loop();
+    const FMaterial* createDefaultMaterial() const noexcept;
+    DriverApi& getLoaderDriverApi() noexcept;
     void flushCommandBuffer(CommandBufferQueue& commandBufferQueue);
+    void commitMaterialInstances() noexcept;
+    void checkMemoryBudget() noexcept;
 
     template<typename T, typename L>
     void terminateAndDestroy(const T* p, ResourceList<T, L>& list);
 
+    template<typename B, typename T, typename L>
+    void terminateAndDestroy(const B* const* p, size_t count, ResourceList<T, L>& list);
+
     template<typename T, typename L>
     void cleanupResourceList(ResourceList<T, L>& list);
 
@@ -373,6 +580,13 @@ private:
 
     PostProcessManager mPostProcessManager;
     RenderTargetPool mRenderTargetPool;
+    TextureStreamer mTextureStreamer;
+    IblPrefilter mIblPrefilter;
+    MipmapGenerator mMipmapGenerator;
+    PreSkinning mPreSkinning;
+    CpuStageTimings mCpuStageTimings;
+    mutable FrameCounters mFrameCounters;
+    uint32_t mMaterialInstanceGeneration = 0;
 
     utils::EntityManager& mEntityManager;
     FRenderableManager mRenderableManager;
@@ -386,17 +600,24 @@ private:
     ResourceList<FFence, utils::LockingPolicy::SpinLock> mFences{"Fence"};
     ResourceList<FSwapChain> mSwapChains{ "SwapChain" };
     ResourceList<FStream> mStreams{ "Stream" };
-    ResourceList<FIndexBuffer> mIndexBuffers{ "IndexBuffer" };
-    ResourceList<FVertexBuffer> mVertexBuffers{ "VertexBuffer" };
+    // the buffers, materials and textures can be created and destroyed by loader threads
+    ResourceList<FIndexBuffer, utils::LockingPolicy::SpinLock> mIndexBuffers{ "IndexBuffer" };
+    ResourceList<FVertexBuffer, utils::LockingPolicy::SpinLock> mVertexBuffers{ "VertexBuffer" };
     ResourceList<FIndirectLight> mIndirectLights{ "IndirectLight" };
-    ResourceList<FMaterial> mMaterials{ "Material" };
-    ResourceList<FTexture> mTextures{ "Texture" };
+    ResourceList<FMaterial, utils::LockingPolicy::SpinLock> mMaterials{ "Material" };
+    ResourceList<FTexture, utils::LockingPolicy::SpinLock> mTextures{ "Texture" };
     ResourceList<FSkybox> mSkyboxes{ "Skybox" };
+    ResourceList<FRenderTarget> mRenderTargets{ "RenderTarget" };
+    ResourceList<FParticleSystem> mParticleSystems{ "ParticleSystem" };
+    ResourceList<FTerrain> mTerrains{ "Terrain" };
+    ResourceList<FImpostor> mImpostors{ "Impostor" };
 
-    mutable uint32_t mMaterialId = 0;
+    mutable std::atomic<uint32_t> mMaterialId = { 0 };
 
-    // FMaterialInstance are handled directly by FMaterial
+    // FMaterialInstance are handled directly by FMaterial. Only the thread that renders adds
+    // to this, but loader threads look materials up when destroying them.
     std::unordered_map<const FMaterial*, ResourceList<FMaterialInstance>> mMaterialInstances;
+    utils::Mutex mMaterialInstancesLock;
 
     std::unique_ptr<DFG> mDFG;
 
@@ -415,17 +636,60 @@ private:
 
     std::thread mDriverThread;
     CommandBufferQueue mCommandBufferQueue;
+    const size_t mPerFrameCommandsSize;
+    driver::BlobCache* const mBlobCache;
+    const utils::CString mCommandTracePath;
+    std::unique_ptr<CommandTraceRecorder> mCommandTrace;
     DriverApi mCommandStream;
 
     LinearAllocatorArena mPerRenderPassAllocator;
     HeapAllocatorArena mHeapAllocator;
+    utils::LockingPolicy::SpinLock mHeapTagLock;
+
+    // the commands a loader thread can record between two flushes, see Engine.h
+    static constexpr size_t LOADER_COMMANDS_SIZE = 1024 * 1024;
+
+    // the command stream of a loader thread, see attachLoaderThread()
+    struct LoaderThread {
+        FEngine* engine;
+        void* block = nullptr;      // malloc()'ed, holds the commands recorded since the flush
+        std::unique_ptr<CircularBuffer> buffer;
+        DriverApi stream;
+    };
+    void startLoaderBlock(LoaderThread& loader) noexcept;
+    static UTILS_DECLARE_TLS(LoaderThread*) sLoaderThread;
+    std::atomic<uint32_t> mLoaderThreadCount = { 0 };
 
     utils::JobSystem mJobSystem;
 
     Epoch mEpoch;
 
-    mutable FMaterial const* mDefaultMaterial = nullptr;
+    // see getStartupTimings(), the driver's timing is written by the driver thread before
+    // mDriverBarrier is latched
+    clock::time_point mCreationTime;
+    StartupTimings mStartupTimings;
+
+    static float toMilliseconds(duration d) noexcept {
+        return std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(d).count();
+    }
+
+    // see setMemoryBudget()
+    struct {
+        size_t cpu = 0;
+        size_t gpu = 0;
+        MemoryBudgetCallback callback = nullptr;
+        void* user = nullptr;
+        bool exceeded = false;
+    } mMemoryBudget;
+
+    mutable std::atomic<FMaterial const*> mDefaultMaterial = { nullptr };
+    mutable utils::Mutex mDefaultMaterialLock;
     mutable FMaterial const* mSkyboxMaterials[2] = { nullptr, nullptr };
+    mutable FMaterial const* mImpostorMaterial = nullptr;
+    mutable FMaterial const* mTerrainMaterial = nullptr;
+    mutable FMaterial const* mDebugVisualizationMaterial = nullptr;
+    // by visualization and shader cost
+    mutable std::unordered_map<uint32_t, FMaterialInstance*> mDebugVisualizationInstances;
 
     mutable FTexture* mDefaultIblTexture = nullptr;
     mutable FIndirectLight* mDefaultIbl = nullptr;
@@ -445,10 +709,18 @@ public:
         struct {
             bool far_uses_shadowcasters = true;
             bool focus_shadowcasters = true;
+            bool cull_with_receivers = true;
             bool lispsm = true;
             float dzn = -1.0f;
             float dzf =  1.0f;
         } shadowmap;
+        struct {
+            bool overlay = false;
+        } stats;
+        struct {
+            int32_t visualization = 0;      // see DebugVisualization
+            float range = 0.0f;             // see getDebugVisualizationRange(), 0 for default
+        } view;
     } debug;
 };
 
@@ -29,6 +29,9 @@
 #include <mutex>
 
 namespace filament {
+
+class Driver;
+
 namespace details {
 
 class FEngine;
@@ -43,6 +46,8 @@ public:
 
     static FenceStatus waitAndDestroy(FFence* fence, Mode mode) noexcept;
 
+    int getFileDescriptor(Mode mode) noexcept;
+
 private:
     // We assume we don't have a lot of contention of fence and have all of them
     // share a single lock/condition
@@ -51,13 +56,25 @@ private:
 
     struct FenceSignal {
         FenceSignal(Type type) noexcept : mType(type) { }
+        ~FenceSignal() noexcept;
         enum State : uint8_t { UNSIGNALED, SIGNALED, DESTROYED };
         // we store mType here instead of in FFence, because it allows sizeof(FFence) to be
         // much smaller (since it needs to be multiple of 8 on 64 bits architectures)
         const Type mType;
         State mState = UNSIGNALED;
+        // The file descriptors are created by getFileDescriptor() and closed with the last
+        // reference to the FenceSignal, which can be the command that signals it. mPollFd is
+        // mEventFd for SOFT fences, and for HARD fences an epoll set of mEventFd and of the
+        // native fence, once the driver has created it.
+        int mPollFd = -1;
+        int mEventFd = -1;
+        int mNativeFd = -1;
         void signal(State s = SIGNALED) noexcept;
+        // signals a HARD fence and exports the native fence, on the driver thread
+        void signal(Driver& driver, Handle<HwFence> fh) noexcept;
         FenceStatus wait(uint64_t timeout) noexcept;
+        int getFileDescriptor() noexcept;
+        void notifyFileDescriptor() noexcept;   // called with sLock held
     };
 
     FEngine& mEngine;
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_FRAMEPACER_H
+#define TNT_FILAMENT_DETAILS_FRAMEPACER_H
+
+#include "FrameInfo.h"
+
+#include <filament/Renderer.h>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * FramePacer estimates the CPU and GPU time of a frame and, in JUST_IN_TIME mode, delays the
+ * start of a frame so that it completes just before the vsync it targets.
+ *
+ * All methods must be called from the thread calling Renderer::beginFrame().
+ */
+class FramePacer {
+public:
+    using clock = FrameInfo::clock;
+    using time_point = FrameInfo::time_point;
+    using duration = FrameInfo::duration;
+    using Options = Renderer::FramePacingOptions;
+    using Stats = Renderer::FramePacingStats;
+
+    void setOptions(Options const& options) noexcept;
+
+    bool isJustInTime() const noexcept {
+        return mOptions.mode == Renderer::FramePacing::JUST_IN_TIME;
+    }
+
+    duration getRefreshPeriod() const noexcept {
+        return duration(1000.0f / mOptions.refreshRate);
+    }
+
+    duration getCpuTime() const noexcept { return mCpuTime; }
+
+    // Waits, if needed, until the frame should start and returns the time it should be
+    // presented at. gpuTime is the latest measured GPU time of a frame.
+    time_point beginFrame(duration gpuTime) noexcept;
+
+    // the frame started by beginFrame() was skipped
+    void skipFrame() noexcept;
+
+    // the frame started by beginFrame() was submitted
+    void endFrame() noexcept;
+
+    // returns the statistics accumulated since the last call
+    void getStats(Stats* stats) noexcept;
+
+private:
+    // rises immediately to avoid late frames, but decays slowly to not chase noisy frames
+    static duration filter(duration estimate, duration sample) noexcept;
+
+    Options mOptions;
+    Stats mStats;
+    duration mCpuTime{};
+    duration mGpuTime{};
+    time_point mFrameStart{};
+    time_point mTarget{};           // presentation time of the current frame
+    time_point mLastTarget{};       // presentation time of the last submitted frame
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_FRAMEPACER_H
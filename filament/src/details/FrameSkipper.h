@@ -31,9 +31,13 @@ public:
     explicit FrameSkipper(FEngine& engine, size_t latency = 2) noexcept;
     ~FrameSkipper() noexcept;
 
+    // number of frames that can be in flight before skipFrameNeeded() returns true
+    void setLatency(size_t latency) noexcept;
+
     void endFrame() noexcept;
 
-    bool skipFrameNeeded() const noexcept;
+    // timeout: how long to wait for the oldest frame in flight before skipping, in nanoseconds
+    bool skipFrameNeeded(uint64_t timeout = 0) const noexcept;
 
 private:
     FEngine& mEngine;
@@ -25,10 +25,12 @@
 #include "driver/GPUBuffer.h"
 #include "driver/UniformBuffer.h"
 
+#include <filament/View.h>
 #include <filament/Viewport.h>
 
 #include <utils/compiler.h>
 #include <utils/bitset.h>
+#include <utils/JobSystem.h>
 #include <utils/Slice.h>
 
 #include <math/mat4.h>
@@ -42,6 +44,7 @@ namespace details {
 class FEngine;
 class FCamera;
 class FTexture;
+class HiZBuffer;
 
 class Froxel {
 public:
@@ -83,6 +86,9 @@ public:
 // froxels are not used, so we can store more.
 static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 8192;
 
+// Max number of slices, a View can trade x-y resolution for z resolution up to this count.
+static constexpr size_t FROXEL_SLICE_COUNT_MAX = 64;
+
 class Froxelizer {
 public:
     explicit Froxelizer(FEngine& engine);
@@ -98,6 +104,13 @@ public:
 
     void setOptions(float zLightNear, float zLightFar) noexcept;
 
+    // options are clamped to what the froxel and record buffers can accommodate
+    void setFroxelOptions(View::FroxelOptions const& options) noexcept;
+    View::FroxelOptions const& getFroxelOptions() const noexcept { return mFroxelOptions; }
+
+    // statistics of the last froxelizeLights() that did some work
+    View::FroxelStatistics const& getStatistics() const noexcept { return mStatistics; }
+
     /*
      * Allocate per-frame data structures for froxelization.
      *
@@ -120,8 +133,11 @@ public:
     size_t getFroxelCount() const noexcept { return mFroxelCount; }
 
     // update Records and Froxels texture with lights data. this is thread-safe.
+    // depth, when provided, is an earlier depth buffer of this view used to remove lights from
+    // froxels which don't hold any geometry, depthMargin is the distance the camera moved since.
     void froxelizeLights(FEngine& engine, CameraInfo const& camera,
-            const FScene::LightSoa& lightData) noexcept;
+            const FScene::LightSoa& lightData,
+            HiZBuffer const* depth = nullptr, float depthMargin = 0.0f) noexcept;
 
     void updateUniforms(UniformBuffer& u) {
         u.setUniform(offsetof(FEngine::PerViewUib, zParams), mParamsZ);
@@ -176,8 +192,14 @@ private:
         math::float3 axis;
         // this must be initialized to indicate this is a point light
         float invSin = std::numeric_limits<float>::infinity();
-        // radius is not used in the hot loop, so leave it at the end
-        float radius;
+        // view-space bounding sphere, around the cone of the spot lights. It's not used in the
+        // hot loop, so leave it at the end
+        math::float4 bounds;
+
+        bool operator==(LightParams const& rhs) const noexcept {
+            return position == rhs.position && cosSqr == rhs.cosSqr && axis == rhs.axis &&
+                   invSin == rhs.invSin && bounds == rhs.bounds;
+        }
     };
 
     struct LightTreeNode {
@@ -199,10 +221,24 @@ private:
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
     bool update() noexcept;
 
-    void froxelizeLoop(FEngine& engine,
+    // returns false if nothing changed since the previous call
+    bool froxelizeLoop(FEngine& engine,
             const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
 
-    void froxelizeAssignRecordsCompress() noexcept;
+    // returns the number of entries used in the record buffer, the froxels are processed by
+    // Z slices in parallel
+    size_t froxelizeAssignRecordsCompress(utils::JobSystem& js,
+            HiZBuffer const* depth, float depthMargin) noexcept;
+
+    // removes the lights from the froxels they don't share any depth with the geometry in
+    void applyDepthBounds(utils::Slice<LightRecord>& records,
+            HiZBuffer const& depth, float depthMargin) const noexcept;
+
+    // converts a window-space depth to a distance from the camera, using mProjection
+    float getDistanceAtDepth(float depth) const noexcept;
+
+    // invalidates the parts of the GPU buffers that changed since the last frame
+    void invalidateChangedRows(size_t recordCount) noexcept;
 
     void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
             math::mat4f const& projection, const LightParams& light) const noexcept;
@@ -219,9 +255,9 @@ private:
 
     std::pair<size_t, size_t> clipToIndices(math::float2 const& clip) const noexcept;
 
-    static void computeFroxelLayout(
+    void computeFroxelLayout(
             math::uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-            Viewport const& viewport) noexcept;
+            Viewport const& viewport) const noexcept;
 
     // internal state dependant on the viewport and needed for froxelizing
     LinearAllocatorArena mArena;                    // ~256 KiB
@@ -231,7 +267,12 @@ private:
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
 
-    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
+    // Lights are binned in here, which we keep from frame to frame, so that only the lights that
+    // changed (as per mLightParams) need to be binned again.
+    std::vector<FroxelThreadData> mFroxelShardedData;   // 256 KiB w/  256 lights
+    std::vector<LightParams> mLightParams;              // of the last froxelizeLoop()
+    bool mFroxelShardedDataValid = false;
+    bool mDepthBoundsApplied = false;                   // by the last froxelizeLights()
     utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
 
     // max 32 KiB  (actual: resolution dependant)
@@ -253,6 +294,11 @@ private:
     GPUBuffer mRecordsBuffer;
     GPUBuffer mFroxelBuffer;
 
+    // copies of what was last uploaded to mFroxelBuffer and mRecordsBuffer, only the rows that
+    // differ from these are uploaded.
+    std::vector<FroxelEntry> mFroxelBufferShadow;
+    std::vector<RecordBufferType> mRecordBufferShadow;
+
     // needed for update()
     Viewport mViewport;
     math::float4 mParamsZ = {};
@@ -260,6 +306,8 @@ private:
     float mNear = 0.0f;        // camera near
     float mZLightFar = FEngine::CONFIG_Z_LIGHT_FAR;
     float mZLightNear = FEngine::CONFIG_Z_LIGHT_NEAR;  // light near (first slice)
+    View::FroxelOptions mFroxelOptions;
+    View::FroxelStatistics mStatistics;
 
     // track if we need to update our internal state before froxelizing
     uint8_t mDirtyFlags = 0;
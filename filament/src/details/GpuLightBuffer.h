@@ -22,6 +22,10 @@
 
 #include <math/vec4.h>
 
+#include <utils/RangeSet.h>
+
+#include <string.h>
+
 namespace filament {
 namespace details {
 
@@ -35,7 +39,7 @@ public:
         math::float4 positionFalloff;   // { float3(pos), 1/falloff^2 }
         math::float4 colorIntensity;    // { float3(col), intensity }
         math::float4 directionIES;      // { float3(dir), IES index }
-        math::float4 spotScaleOffset;   // { scale, offset, unused, unused }
+        math::float4 spotScaleOffset;   // { scale, offset, shadow atlas tile + 1, unused }
     };
 
     explicit GpuLightBuffer(FEngine& engine) noexcept;
@@ -50,21 +54,32 @@ public:
     GpuLightBuffer& operator=(GpuLightBuffer&& rhs) = delete;
     ~GpuLightBuffer() noexcept;
 
-    LightParameters& getLightParameters(LightIndex h) noexcept {
+    LightParameters const& getLightParameters(LightIndex h) const noexcept {
         // This assumes the layout of the LightsUniforms uniform buffer
         // it is defined in UibGenerator.cpp
-        LightParameters* lights = (LightParameters *)mLightsUb.getBuffer();
+        LightParameters const* lights = (LightParameters const*)mLightsUb.getBuffer();
         return lights[h];
     }
 
+    // only the lights whose parameters change are uploaded by the next commit()
+    void setLightParameters(LightIndex h, LightParameters const& lp) noexcept {
+        LightParameters* lights = (LightParameters *)mLightsUb.getBuffer();
+        if (memcmp(&lights[h], &lp, sizeof(LightParameters)) != 0) {
+            lights[h] = lp;
+            invalidate(h, 1);
+        }
+    }
+
     void invalidate(LightIndex h, size_t count) noexcept {
-        mLightsUb.invalidateUniforms(h * sizeof(LightParameters), count * sizeof(LightParameters));
+        mDirtyRanges.set(h, uint32_t(count));
     }
 
 private:
     void commitSlow(FEngine& engine) noexcept;
     Handle<HwUniformBuffer> mLightUbh;
-    mutable UniformBuffer mLightsUb;
+    UniformBuffer mLightsUb;
+    // modified lights, in LightParameters units
+    utils::RangeSet<8> mDirtyRanges;
 };
 
 } // namespace details
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_HIZBUFFER_H
+#define TNT_FILAMENT_DETAILS_HIZBUFFER_H
+
+#include <utils/compiler.h>
+
+#include <math/mat4.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * A hierarchical-Z pyramid, used for occlusion culling.
+ *
+ * Each level stores the farthest depth of the 2x2 texels of the level below it, so that a box
+ * whose nearest point is behind the depth read from the few texels covering its screen-space
+ * bounds is guaranteed to be occluded.
+ *
+ * The pyramid is built from a depth buffer rendered with a given clipFromWorld transform
+ * (typically the previous frame's), boxes are reprojected with that same transform when tested.
+ *
+ * A second pyramid stores the nearest depths, so that the depth range of the geometry in a
+ * rectangle of the screen can be queried as well.
+ */
+class UTILS_PUBLIC HiZBuffer {
+public:
+    // maximum width or height of the base level, the depth buffer is reduced to fit in it
+    static constexpr uint32_t MAX_BASE_SIZE = 256;
+
+    /*
+     * Rebuilds the pyramid.
+     * depth: window-space depth in [0, 1] (1 being the far plane), stored top row first.
+     * clipFromWorld: the transform depth was rendered with, clip-space z is in [-w, w].
+     */
+    void build(float const* depth, uint32_t width, uint32_t height,
+            math::mat4f const& clipFromWorld);
+
+    void clear() noexcept;
+
+    bool empty() const noexcept { return mLevels.empty(); }
+
+    math::mat4f const& getClipFromWorld() const noexcept { return mClipFromWorld; }
+
+    // returns true if the box is guaranteed to be hidden by the depth buffer
+    bool isOccluded(math::float3 const& center, math::float3 const& extent) const noexcept;
+
+    // sets 'bit' in visibleMask[i], for all boxes having 'test' set and not occluded
+    void cull(uint8_t* visibleMask, math::float3 const* center, math::float3 const* extent,
+            size_t count, uint8_t test, size_t bit) const noexcept;
+
+    // returns the nearest and farthest window-space depths found in the given rectangle of the
+    // pyramid's NDC space, or { 0, 1 } if the pyramid is empty.
+    math::float2 getDepthRange(math::float2 ndcMin, math::float2 ndcMax) const noexcept;
+
+private:
+    struct Level {
+        uint32_t offset;    // of the first texel in mDepth
+        uint32_t width;
+        uint32_t height;
+    };
+
+    float fetch(Level const& level, uint32_t x, uint32_t y) const noexcept {
+        return mDepth[level.offset + y * level.width + x];
+    }
+
+    float fetchMin(Level const& level, uint32_t x, uint32_t y) const noexcept {
+        return mMinDepth[level.offset + y * level.width + x];
+    }
+
+    // returns the level where the NDC rectangle spans at most 2x2 texels, and these texels
+    uint32_t getTexels(math::float2 lo, math::float2 hi,
+            uint32_t* x0, uint32_t* x1, uint32_t* y0, uint32_t* y1) const noexcept;
+
+    std::vector<Level> mLevels;
+    std::vector<float> mDepth;
+    std::vector<float> mMinDepth;
+    math::mat4f mClipFromWorld;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_HIZBUFFER_H
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_IMPOSTOR_H
+#define TNT_FILAMENT_DETAILS_IMPOSTOR_H
+
+#include "upcast.h"
+
+#include <filament/Impostor.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/mat4.h>
+#include <math/vec4.h>
+
+#include <atomic>
+#include <memory>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+class FIndexBuffer;
+class FMaterial;
+class FMaterialInstance;
+class FTexture;
+class FVertexBuffer;
+
+/*
+ * The renderables replaced by an impostor are collected by FView::updatePrimitivesLod(), which
+ * reset()s the impostors, add()s the renderables from its jobs and commit()s the impostors
+ * before the commands of the pass are generated. Each pass draws the renderables it collected.
+ *
+ * The world transforms of the renderables are stored in a texture, 3 texels per renderable
+ * holding the first 3 rows of the transform, and INSTANCES_PER_ROW renderables per row, so that
+ * the texels of renderable i are texels 3i to 3i + 2 of the texture.
+ */
+class FImpostor : public Impostor {
+public:
+    static constexpr uint32_t INSTANCES_PER_ROW = 256;
+
+    FImpostor(FEngine& engine, const Builder& builder);
+
+    void terminate(FEngine& engine) noexcept;
+
+    utils::Entity getEntity() const noexcept { return mEntity; }
+
+    FMaterialInstance* getMaterialInstance() noexcept { return mMaterialInstance; }
+
+    // forgets the renderables added so far
+    void reset() noexcept { mCount.store(0, std::memory_order_relaxed); }
+
+    // adds a renderable to draw, can be called concurrently; the renderables past the capacity
+    // are not drawn
+    void add(math::mat4f const& worldFromModel) noexcept;
+
+    // uploads the transforms of the renderables added since reset(), and draws as many instances
+    void commit(FEngine& engine) noexcept;
+
+    static FMaterial const* createMaterial(FEngine& engine);
+
+private:
+    // we own these
+    utils::Entity mEntity;
+    FVertexBuffer* mVertexBuffer = nullptr;
+    FIndexBuffer* mIndexBuffer = nullptr;
+    FTexture* mInstances = nullptr;
+    FMaterialInstance* mMaterialInstance = nullptr;
+
+    std::unique_ptr<math::float4[]> mTransforms;    // 3 texels per renderable, see above
+    std::atomic<uint32_t> mCount = { 0 };
+    uint32_t mCapacity;
+};
+
+FILAMENT_UPCAST(Impostor)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_IMPOSTOR_H
@@ -28,6 +28,7 @@
 namespace filament {
 namespace details {
 
+class DestroyBatch;
 class FEngine;
 
 class FIndexBuffer : public IndexBuffer {
@@ -36,6 +37,7 @@ public:
 
     // frees driver resources, object becomes invalid
     void terminate(FEngine& engine);
+    void terminate(FEngine& engine, DestroyBatch& batch);
 
     Handle<HwIndexBuffer> getHwHandle() const noexcept { return mHandle; }
 
@@ -48,9 +48,31 @@ public:
     void setRotation(math::mat3f const& rotation) noexcept { mRotation = rotation; }
     const math::mat3f& getRotation() const { return mRotation; }
 
+    void setIrradianceVolume(Texture const* volume, Box const& bounds) noexcept;
+    Handle<HwTexture> getIrradianceVolume() const noexcept { return mIrradianceVolumeHandle; }
+    Box const& getIrradianceVolumeBounds() const noexcept { return mIrradianceVolumeBounds; }
+    // number of probes along z, the volume's depth is 9 times larger
+    uint32_t getIrradianceVolumeDepth() const noexcept { return mIrradianceVolumeDepth; }
+    static bool isValidIrradianceVolume(Texture const* volume) noexcept;
+
+    // see IblPrefilter
+    void refresh(FEngine& engine);
+    bool isReady() const noexcept { return !mPrefiltering; }
+    void setPrefiltered(FEngine& engine, Handle<HwTexture> reflections,
+            math::float3 const* sh) noexcept;
+    void readReflections(FEngine& engine, uint8_t level, driver::TextureCubemapFace face,
+            driver::PixelBufferDescriptor&& buffer);
+
 private:
     Handle<HwTexture> mReflectionsMapHandle;
     Handle<HwTexture> mIrradianceMapHandle;
+    Handle<HwTexture> mIrradianceVolumeHandle;
+    Box mIrradianceVolumeBounds;
+    uint32_t mIrradianceVolumeDepth = 0;
+    Handle<HwTexture> mEnvironmentHandle;       // prefiltered on the GPU, see IblPrefilter
+    Handle<HwTexture> mPrefilteredReflections;  // owned, created by IblPrefilter
+    uint32_t mEnvironmentSize = 0;
+    bool mPrefiltering = false;
     std::array<math::float3, 9> mIrradianceCoefs;
     float mIntensity = DEFAULT_INTENSITY;
     math::mat3f mRotation;
@@ -67,6 +67,7 @@ public:
     FMaterialInstance* createInstance() const noexcept;
 
     bool hasParameter(const char* name) const noexcept;
+    ParameterHandle getParameterHandle(const char* name) const noexcept;
 
     FMaterialInstance const* getDefaultInstance() const noexcept { return &mDefaultInstance; }
     FMaterialInstance* getDefaultInstance() noexcept { return &mDefaultInstance; }
@@ -83,6 +84,13 @@ public:
         return UTILS_LIKELY(entry) ? entry : getProgramSlow(variantKey);
     }
 
+    void compile(uint8_t const* variants, size_t count,
+            CompilationCallback callback, void* user) const noexcept;
+
+    // destroys the programs of this material, they're created again when next used; returns
+    // how many were destroyed (the shared ones aren't)
+    size_t destroyPrograms(FEngine& engine) const noexcept;
+
     bool isVariantLit() const noexcept { return mIsVariantLit; }
 
     const utils::CString& getName() const noexcept { return mName; }
@@ -103,6 +111,11 @@ public:
     bool isDoubleSided() const noexcept { return mDoubleSided; }
     float getMaskThreshold() const noexcept { return mMaskTreshold; }
     bool hasShadowMultiplier() const noexcept { return mHasShadowMultiplier; }
+    // shading costly enough to be worth a depth pre-pass, even for small objects
+    bool hasExpensiveShading() const noexcept { return mHasExpensiveShading; }
+    // instructions of the most expensive color pass fragment shader, 0 if unknown (the
+    // material wasn't built for Vulkan)
+    uint32_t getShaderCost() const noexcept { return mShaderCost; }
     AttributeBitset getRequiredAttributes() const noexcept { return mRequiredAttributes; }
 
     size_t getParameterCount() const noexcept {
@@ -111,8 +124,6 @@ public:
     }
     size_t getParameters(ParameterInfo* parameters, size_t count) const noexcept;
 
-    uint32_t generateMaterialInstanceId() const noexcept { return mMaterialInstanceId++; }
-
 private:
     // try to order by frequency of use
     mutable std::array<Handle<HwProgram>, VARIANT_COUNT> mCachedPrograms;
@@ -130,6 +141,9 @@ private:
     bool mHasShadowMultiplier = false;
     bool mHasCustomDepthShader = false;
     bool mIsDefaultMaterial = false;
+    bool mHasExpensiveShading = false;
+    uint32_t mShaderCost = 0;
+    uint8_t mVariantFilterMask = 0;
 
     FMaterialInstance mDefaultInstance;
     SamplerInterfaceBlock mSamplerInterfaceBlock;
@@ -139,7 +153,6 @@ private:
     utils::CString mName;
     FEngine& mEngine;
     const uint32_t mMaterialId;
-    mutable uint32_t mMaterialInstanceId = 0;
     filaflat::MaterialParser* mMaterialParser = nullptr;
 };
 
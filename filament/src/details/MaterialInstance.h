@@ -27,10 +27,15 @@
 
 #include <filament/MaterialInstance.h>
 
+#include <utility>
+#include <vector>
+
 namespace filament {
 namespace details {
 
+class DestroyBatch;
 class FMaterial;
+class FTexture;
 
 class FMaterialInstance : public MaterialInstance {
 public:
@@ -41,6 +46,7 @@ public:
     ~FMaterialInstance() noexcept;
 
     void terminate(FEngine& engine);
+    void terminate(FEngine& engine, DestroyBatch& batch);
 
     void commit(FEngine& engine) const {
         if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty())) {
@@ -48,6 +54,22 @@ public:
         }
     }
 
+    // size of the record commitUniforms() writes, 0 if no uniform was modified
+    size_t getUniformRangeUpdateSize() const noexcept {
+        return mUniforms.isDirty() ?
+               Driver::UniformRangeUpdate::getRecordSize(mUniforms.getDirtySize()) : 0;
+    }
+
+    // writes the modified uniforms at p as a Driver::UniformRangeUpdate record, which must be
+    // getUniformRangeUpdateSize() bytes. Returns the end of the record.
+    char* commitUniforms(char* p) const noexcept;
+
+    void commitSamplers(FEngine& engine) const {
+        if (UTILS_UNLIKELY(mSamplers.isDirty())) {
+            commitSamplersSlow(engine);
+        }
+    }
+
     void use(FEngine::DriverApi& driver) const {
         if (mUbHandle) {
             driver.bindUniforms(BindingPoints::PER_MATERIAL_INSTANCE, mUbHandle);
@@ -58,6 +80,7 @@ public:
         driver.setViewportScissor(
                 mScissorRect[0], mScissorRect[1],
                 uint32_t(mScissorRect[2]), uint32_t(mScissorRect[3]));
+        driver.setPolygonOffset(mPolygonOffset[0], mPolygonOffset[1]);
     }
 
     template <typename T>
@@ -66,13 +89,31 @@ public:
     template <typename T>
     void setParameter(const char* name, const T* value, size_t count) noexcept;
 
+    template <typename T>
+    void setParameter(ParameterHandle handle, T value) noexcept;
+
+    template <typename T>
+    void setParameters(ParameterHandle const* handles, const T* values, size_t count) noexcept;
+
     void setParameter(const char* name,
             Texture const* texture, TextureSampler const& sampler) noexcept;
 
     FMaterial const* getMaterial() const noexcept { return mMaterial; }
 
+    bool hasStreamingTextures() const noexcept { return !mStreamingTextures.empty(); }
+
+    // records the levels the streaming textures need to cover this many pixels on screen
+    void requestStreamingLevels(float pixels) const noexcept;
+
     uint64_t getSortingKey() const noexcept { return mMaterialSortingKey; }
 
+    // true if binding this instance is the same as binding rhs, i.e. they have the same
+    // material, uniforms, samplers, scissor and polygon offset
+    bool hasSameState(FMaterialInstance const& rhs) const noexcept {
+        return mStateHash == rhs.mStateHash && mMaterial == rhs.mMaterial &&
+               hasSameStateSlow(rhs);
+    }
+
     SamplerBuffer const& getSamplerBuffer() const noexcept { return mSamplers; }
 
     void setScissor(int32_t left, int32_t bottom, uint32_t width, uint32_t height) noexcept {
@@ -80,11 +121,19 @@ public:
         mScissorRect[1] = bottom;
         mScissorRect[2] = (int32_t)std::min(width,  (uint32_t)std::numeric_limits<int32_t>::max());
         mScissorRect[3] = (int32_t)std::min(height, (uint32_t)std::numeric_limits<int32_t>::max());
+        updateState();
     }
 
     void unsetScissor() noexcept {
         mScissorRect[0] = mScissorRect[1] = 0;
         mScissorRect[2] = mScissorRect[3] = std::numeric_limits<int32_t>::max();
+        updateState();
+    }
+
+    void setPolygonOffset(float slope, float constant) noexcept {
+        mPolygonOffset[0] = slope;
+        mPolygonOffset[1] = constant;
+        updateState();
     }
 
 private:
@@ -95,6 +144,11 @@ private:
     void initDefaultInstance(FEngine& engine, FMaterial const* material);
 
     void commitSlow(FEngine& engine) const;
+    void commitSamplersSlow(FEngine& engine) const;
+
+    // updates mStateHash and the sorting key, must be called when the state changes
+    void updateState() const noexcept;
+    bool hasSameStateSlow(FMaterialInstance const& rhs) const noexcept;
 
     // keep these grouped, they're accessed together in the render-loop
     FMaterial const* mMaterial = nullptr;
@@ -104,12 +158,19 @@ private:
     UniformBuffer mUniforms;
     SamplerBuffer mSamplers;
 
-    uint64_t mMaterialSortingKey = 0;
+    mutable uint64_t mMaterialSortingKey = 0;
+    mutable uint32_t mStateHash = 0;
+
+    // streaming textures bound to this instance, with the offset of their sampler
+    std::vector<std::pair<uint8_t, FTexture const*>> mStreamingTextures;
 
     // Scissor rectangle is specified as: Left Bottom Width Height.
     int32_t mScissorRect[4] = {
         0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()
     };
+
+    // Polygon offset of the shadow pass, specified as: Slope Constant.
+    float mPolygonOffset[2] = { 1.0f, 1.0f };
 };
 
 FILAMENT_UPCAST(MaterialInstance)
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_PARTICLESYSTEM_H
+#define TNT_FILAMENT_DETAILS_PARTICLESYSTEM_H
+
+#include "upcast.h"
+
+#include "driver/Handle.h"
+#include "driver/UniformBuffer.h"
+
+#include <filament/ParticleSystem.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+namespace filament {
+
+class UniformInterfaceBlock;
+
+namespace details {
+
+class FCamera;
+class FEngine;
+class FIndexBuffer;
+class FVertexBuffer;
+
+/*
+ * Each update runs three compute passes:
+ * - simulate: emits the particles in a ring of the pool, moves the live ones, and writes their
+ *   sort keys, i.e. their depth for the camera,
+ * - sort: a bitonic sort of the keys, back to front, one dispatch per step,
+ * - emit: writes the quads of the particles into the renderable's vertex buffer, in the sorted
+ *   order, dead particles get degenerate quads.
+ * The index buffer never changes, so the renderable draws all the quads with a single call.
+ */
+class FParticleSystem : public ParticleSystem {
+public:
+    FParticleSystem(FEngine& engine, const Builder& builder);
+
+    void terminate(FEngine& engine) noexcept;
+
+    utils::Entity getEntity() const noexcept { return mEntity; }
+
+    void setEmissionRate(float particlesPerSecond) noexcept { mEmissionRate = particlesPerSecond; }
+
+    void update(FEngine& engine, float dt, FCamera const& camera);
+
+    static UniformInterfaceBlock const& getParticleUib() noexcept;
+    static UniformInterfaceBlock const& getSortUib() noexcept;
+
+private:
+    enum Pass : uint8_t { SIMULATE, SORT, EMIT, PASS_COUNT };
+
+    Handle<HwProgram> getProgram(FEngine& engine, Pass pass);
+
+    // we own these
+    utils::Entity mEntity;
+    FVertexBuffer* mVertexBuffer = nullptr;
+    FIndexBuffer* mIndexBuffer = nullptr;
+    Handle<HwBufferObject> mParticles;      // position and age, velocity and lifetime
+    Handle<HwBufferObject> mKeys;           // sort key and index
+    Handle<HwUniformBuffer> mUniforms;
+    Handle<HwUniformBuffer> mSortSteps;     // the (j, k) of each step, 256 bytes apart
+    Handle<HwProgram> mPrograms[PASS_COUNT];
+    UniformBuffer mUniformBuffer;
+
+    uint32_t mParticleCount;
+    uint32_t mSortStepCount = 0;
+    uint32_t mSpawnFirst = 0;
+    uint32_t mSeed = 0;
+    float mSpawnRemainder = 0.0f;
+    float mEmissionRate;
+    bool mSupported;
+};
+
+FILAMENT_UPCAST(ParticleSystem)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_PARTICLESYSTEM_H
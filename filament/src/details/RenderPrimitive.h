@@ -21,6 +21,8 @@
 
 #include "details/MaterialInstance.h"
 
+#include "PreSkinning.h"
+
 #include "driver/Handle.h"
 
 #include <utils/compiler.h>
@@ -28,6 +30,7 @@
 namespace filament {
 namespace details {
 
+class DestroyBatch;
 class FEngine;
 class FVertexBuffer;
 class FIndexBuffer;
@@ -37,7 +40,9 @@ class FRenderPrimitive {
 public:
     FRenderPrimitive() noexcept = default;
 
-    void init(driver::DriverApi& driver, const RenderableManager::Builder::Entry& entry) noexcept;
+    // with preSkinning, the primitive draws a copy of the vertices skinned by PreSkinning
+    void init(FEngine& engine, const RenderableManager::Builder::Entry& entry,
+            bool preSkinning = false) noexcept;
 
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
@@ -48,24 +53,33 @@ public:
 
     // frees driver resources, object becomes invalid
     void terminate(FEngine& engine);
+    void terminate(FEngine& engine, DestroyBatch& batch);
 
     const FMaterialInstance* getMaterialInstance() const noexcept { return mMaterialInstance; }
     Handle<HwRenderPrimitive> getHwHandle() const noexcept { return mHandle; }
     driver::PrimitiveType getPrimitiveType() const noexcept { return mPrimitiveType; }
     AttributeBitset getEnabledAttributes() const noexcept { return mEnabledAttributes; }
     uint16_t getBlendOrder() const noexcept { return mBlendOrder; }
+    uint16_t getInstanceCount() const noexcept { return mInstanceCount; }
+    PreSkinning::Primitive const* getPreSkinning() const noexcept { return mPreSkinning; }
 
     void setMaterialInstance(FMaterialInstance const* mi) noexcept { mMaterialInstance = mi; }
     void setBlendOrder(uint16_t order) noexcept {
         mBlendOrder = static_cast<uint16_t>(order & 0x7FFF);
     }
+    void setInstanceCount(uint16_t count) noexcept { mInstanceCount = count; }
 
 private:
+    void setBuffers(FEngine& engine, FVertexBuffer* vertices, FIndexBuffer* indices,
+            bool preSkinning) noexcept;
+
     FMaterialInstance const* mMaterialInstance = nullptr;
+    PreSkinning::Primitive* mPreSkinning = nullptr;
     Handle<HwRenderPrimitive> mHandle;
     driver::PrimitiveType mPrimitiveType = driver::PrimitiveType::NONE;
     AttributeBitset mEnabledAttributes;
     uint16_t mBlendOrder = 0;
+    uint16_t mInstanceCount = 1;
 };
 
 } // namespace details
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_RENDERTARGET_H
+#define TNT_FILAMENT_DETAILS_RENDERTARGET_H
+
+#include "upcast.h"
+
+#include "driver/Handle.h"
+
+#include <filament/RenderTarget.h>
+
+#include <filament/driver/DriverEnums.h>
+
+#include <utils/compiler.h>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+class FTexture;
+
+class FRenderTarget : public RenderTarget {
+public:
+    struct Attachment {
+        FTexture* texture = nullptr;
+        uint8_t level = 0;
+    };
+
+    FRenderTarget(FEngine& engine, const Builder& builder) noexcept;
+
+    void terminate(FEngine& engine) noexcept;
+
+    Handle<HwRenderTarget> getHwHandle() const noexcept { return mHandle; }
+
+    uint32_t getWidth() const noexcept { return mWidth; }
+    uint32_t getHeight() const noexcept { return mHeight; }
+
+    // buffers backed by a texture, which are kept after the render pass
+    driver::TargetBufferFlags getAttachments() const noexcept { return mAttachments; }
+
+    Attachment const& getAttachment(AttachmentPoint attachment) const noexcept {
+        return mAttachmentInfo[size_t(attachment)];
+    }
+
+private:
+    friend class RenderTarget;
+
+    // we don't own the textures
+    Attachment mAttachmentInfo[ATTACHMENT_COUNT];
+
+    Handle<HwRenderTarget> mHandle;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    driver::TargetBufferFlags mAttachments = driver::TargetBufferFlags::NONE;
+};
+
+FILAMENT_UPCAST(RenderTarget)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_RENDERTARGET_H
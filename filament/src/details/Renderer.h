@@ -23,6 +23,7 @@
 #include "RenderPass.h"
 
 #include "details/Allocators.h"
+#include "details/FramePacer.h"
 #include "details/FrameSkipper.h"
 #include "details/SwapChain.h"
 
@@ -36,6 +37,8 @@
 #include <utils/Allocator.h>
 #include <utils/Slice.h>
 
+#include <algorithm>
+
 namespace filament {
 
 class Driver;
@@ -45,6 +48,7 @@ namespace details {
 
 class FEngine;
 class FView;
+class ShadowAtlas;
 class ShadowMap;
 
 /*
@@ -61,7 +65,10 @@ public:
 
     // do all the work here!
     void render(FView const* view);
-    void renderJob(ArenaScope& arena, FView* view);
+    void render(View const* const* views, size_t count);
+
+    // culled: whether view->prepareVisibility() was already called for this frame
+    void renderJob(ArenaScope& arena, FView* view, bool culled);
 
     void mirrorFrame(FSwapChain* dstSwapChain, Viewport const& dstViewport, Viewport const& srcViewport,
                      MirrorFrameFlag flags);
@@ -69,9 +76,32 @@ public:
     bool beginFrame(FSwapChain* swapChain);
     void endFrame();
 
+    void setMaxFramesInFlight(size_t count) noexcept {
+        // FrameSkipper already enforces a latency of at least 1
+        mFrameSkipper.setLatency(std::min(count, size_t(MAX_FRAMES_IN_FLIGHT)));
+    }
+
+    void setPipelinedCulling(bool enabled) noexcept {
+        mPipelinedCulling = enabled;
+    }
+
+    void setFramePacingOptions(FramePacingOptions const& options) noexcept {
+        mFramePacer.setOptions(options);
+    }
+
+    void getFramePacingStats(FramePacingStats* stats) noexcept {
+        mFramePacer.getStats(stats);
+    }
+
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             driver::PixelBufferDescriptor&& buffer);
 
+    bool getLastGpuFrameTimings(GpuFrameTimings* timings) const noexcept;
+
+    void getLastCpuFrameTimings(CpuFrameTimings* timings) const noexcept {
+        *timings = mLastCpuFrameTimings;
+    }
+
     // Clean-up everything, this is typically called when the client calls Engine::destroyRenderer()
     void terminate(FEngine& engine);
 
@@ -81,41 +111,102 @@ private:
     // this class is defined in RenderPass.cpp
     class ColorPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
+        FEngine& engine;
         utils::JobSystem& js;
         utils::JobSystem::Job* jobFroxelize = nullptr;
         FView* const view;
         Handle<HwRenderTarget> const rth;
+        const driver::TargetBufferFlags discardStart;
+        const driver::TargetBufferFlags discardEnd;
+        // drawn over the color buffer before the end of the pass, may be null
+        Handle<HwProgram> const toneMapping;
+        // composes the order-independent transparency, null if the view doesn't use it
+        Handle<HwProgram> const transparencyResolve;
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
+        void renderOrderIndependent(DriverApi& driver, utils::JobSystem& js,
+                PerRenderableBuffers const& buffers, Command const* first, Command const* last,
+                Viewport const& viewport) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+        void beginEye(DriverApi& driver, Viewport const& viewport, size_t eye) noexcept override;
     public:
-        ColorPass(const char* name, utils::JobSystem& js, utils::JobSystem::Job* jobFroxelize,
-                FView* view, Handle<HwRenderTarget> rth);
-        static void renderColorPass(FEngine& engine, utils::JobSystem& js,
-                Handle<HwRenderTarget> rth,
+        ColorPass(const char* name, FEngine& engine, utils::JobSystem& js,
+                utils::JobSystem::Job* jobFroxelize, FView* view, Handle<HwRenderTarget> rth,
+                driver::TargetBufferFlags discardStart, driver::TargetBufferFlags discardEnd,
+                Handle<HwProgram> toneMapping, Handle<HwProgram> transparencyResolve);
+        static size_t renderColorPass(FEngine& engine, utils::JobSystem& js,
+                utils::JobSystem::Job* jobFroxelize, Handle<HwRenderTarget> rth,
+                driver::TargetBufferFlags discardStart, driver::TargetBufferFlags discardEnd,
+                Handle<HwProgram> toneMapping, Handle<HwProgram> transparencyResolve,
                 FView* view, Viewport const& scaledViewport,
-                utils::GrowingSlice<Command>& commands) noexcept;
+                CommandChunks& chunks, utils::GrowingSlice<Command>& commands) noexcept;
     };
 
     // this class is defined in RenderPass.cpp
     class ShadowPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
         ShadowMap const& shadowMap;
+        const size_t cascade;
+        const bool clear;
+        const bool staticCache;
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ShadowPass(const char* name, ShadowMap const& shadowMap) noexcept;
-        static void renderShadowMap(FEngine& engine, utils::JobSystem& js,
-                FView* view, utils::GrowingSlice<Command>& commands) noexcept;
+        // renders the casters whose VISIBLE_MASK bits in visibilityMask equal visibilityValue,
+        // into the shadow map or its static casters' cache
+        ShadowPass(const char* name, ShadowMap const& shadowMap, size_t cascade, bool clear,
+                uint8_t visibilityMask, uint8_t visibilityValue, bool staticCache) noexcept;
+        // renders all the cascades of the view's shadow map, one after the other
+        static size_t renderShadowMap(FEngine& engine, utils::JobSystem& js,
+                FView* view, CommandChunks& chunks,
+                utils::GrowingSlice<Command>& commands) noexcept;
+    };
+
+    class ShadowAtlasPass final : public RenderPass {
+        using DriverApi = driver::DriverApi;
+        ShadowAtlas const& shadowAtlas;
+        const size_t tile;
+        const bool clear;
+        void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
+        void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+    public:
+        ShadowAtlasPass(const char* name, ShadowAtlas const& shadowAtlas, size_t tile, bool clear,
+                uint8_t visibilityMask) noexcept;
+        // renders the shadow maps of the view's spot lights, one tile after the other
+        static size_t renderShadowAtlas(FEngine& engine, utils::JobSystem& js,
+                FView* view, CommandChunks& chunks,
+                utils::GrowingSlice<Command>& commands) noexcept;
+    };
+
+    class PickingPass final : public RenderPass {
+        using DriverApi = driver::DriverApi;
+        Handle<HwRenderTarget> const target;
+        void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
+        void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+    public:
+        PickingPass(const char* name, Handle<HwRenderTarget> target) noexcept;
+        // renders the depth of the renderables tested by the view's served picking queries,
+        // each one in a texel of the picking target, and schedules its read-back
+        static size_t renderPicking(FEngine& engine, utils::JobSystem& js,
+                FView* view, Handle<HwRenderTarget> target, CommandChunks& chunks,
+                utils::GrowingSlice<Command>& commands) noexcept;
     };
 
     Handle<HwRenderTarget> getRenderTarget() const noexcept { return mRenderTarget; }
 
-    void recordHighWatermark(utils::Slice<Command> const& commands) noexcept {
-#ifndef NDEBUG
-        mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
-#endif
+    // required: number of commands a pass needed, which can exceed the capacity of the buffer
+    void recordHighWatermark(size_t required) noexcept {
+        mCommandsHighWatermark = std::max(mCommandsHighWatermark, required);
     }
 
+    // grows the commands buffer if the last frames got close to overflowing it
+    void updateCommandsCapacity() noexcept;
+
+    // time taken by the last frame the GPU is done with, drives the dynamic resolution
+    FrameInfo::duration getLastFrameTime() const noexcept;
+
+    // estimated GPU time of the last frame the GPU is done with, drives the frame pacing
+    FrameInfo::duration getLastGpuTime() const noexcept;
+
     size_t getCommandsHighWatermark() const noexcept {
         return mCommandsHighWatermark * sizeof(RenderPass::Command);
     }
@@ -135,13 +226,25 @@ private:
     // keep a reference to our engine
     FEngine& mEngine;
     FrameSkipper mFrameSkipper;
+    FramePacer mFramePacer;
     Handle<HwRenderTarget> mRenderTarget;
     FSwapChain* mSwapChain = nullptr;
     size_t mCommandsHighWatermark = 0;
+    Command* mCommands = nullptr;
+    size_t mCommandsCapacity = 0;
+    // per-thread storage the render passes generate their commands into
+    RenderPass::CommandChunks mCommandChunks;
     uint32_t mFrameId = 0;
     FrameInfoManager mFrameInfoManager;
+    CpuFrameTimings mLastCpuFrameTimings;
     bool mIsRGB16FSupported : 1;
     bool mIsRGB8Supported : 1;
+    bool mIsFrameBufferFetchSupported : 1;
+    bool mIsImplicitResolveSupported : 1;
+    bool mIsOrderIndependentTransparencySupported : 1;
+    bool mIsDepthReadbackSupported : 1;
+    bool mPipelinedCulling = false;
+    bool mDepthReadbackWarned = false;
 
     // per-frame arena for this Renderer
     LinearAllocatorArena& mPerRenderPassArena;
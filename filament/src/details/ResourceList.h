@@ -58,6 +58,18 @@ public:
         return mList.erase(const_cast<void*>(item)) > 0;
     }
 
+    // keeps the items that were removed at the front of the array, returns how many there are
+    UTILS_NOINLINE
+    size_t remove(void** items, size_t count) {
+        size_t removed = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (items[i] && mList.erase(items[i]) > 0) {
+                items[removed++] = items[i];
+            }
+        }
+        return removed;
+    }
+
     bool empty() const noexcept {
         return mList.empty();
     }
@@ -110,6 +122,11 @@ public:
         std::lock_guard<LockingPolicy> guard(mLock);
         return ResourceListBase::remove(item);
     }
+    // removes several items with a single lock, see ResourceListBase::remove()
+    size_t remove(T** items, size_t count) {
+        std::lock_guard<LockingPolicy> guard(mLock);
+        return ResourceListBase::remove(reinterpret_cast<void**>(items), count);
+    }
     bool empty() const noexcept {
         std::lock_guard<LockingPolicy> guard(mLock);
         return ResourceListBase::empty();
@@ -119,6 +136,15 @@ public:
         return ResourceListBase::size();
     }
 
+    // calls f on each item, with the list locked
+    template<typename F>
+    void forEach(F f) const noexcept {
+        std::lock_guard<LockingPolicy> guard(mLock);
+        for (void* item : mList) {
+            f(static_cast<T*>(item));
+        }
+    }
+
     tsl::robin_set<T*> getListAndClear() noexcept {
         std::lock_guard<LockingPolicy> guard(mLock);
         tsl::robin_set<void*> list(ResourceListBase::getListAndClear());
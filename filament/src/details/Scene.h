@@ -22,8 +22,10 @@
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 
+#include "details/Bvh.h"
 #include "details/Culler.h"
 #include "details/GpuLightBuffer.h"
+#include "details/UniformRing.h"
 
 #include "Allocators.h"
 
@@ -37,6 +39,8 @@
 #include <utils/Range.h>
 
 #include <cstddef>
+#include <vector>
+
 #include <tsl/robin_set.h>
 
 namespace filament {
@@ -48,6 +52,7 @@ class FIndirectLight;
 class FRenderer;
 class FSkybox;
 class GpuLightBuffer;
+class ShadowAtlas;
 
 
 class FScene : public Scene {
@@ -69,6 +74,14 @@ public:
     size_t getRenderableCount() const noexcept;
     size_t getLightCount() const noexcept;
 
+    RaycastHit raycast(math::float3 const& origin, math::float3 const& direction,
+            float maxDistance) const noexcept;
+    void raycast(math::float3 const* origins, math::float3 const* directions, size_t count,
+            float maxDistance, RaycastHit* hits) const noexcept;
+    size_t queryBox(Box const& box, utils::Entity* entities, size_t capacity) const noexcept;
+    size_t queryFrustum(Frustum const& frustum, utils::Entity* entities,
+            size_t capacity) const noexcept;
+
 public:
     /*
      * Filaments-scope Public API
@@ -82,9 +95,49 @@ public:
     ~FScene() noexcept;
     void terminate(FEngine& engine);
 
-    void prepare(const math::mat4f& worldOriginTansform);
-    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena) noexcept;
-    void computeBounds(Aabb& castersBox, Aabb& receiversBox, uint32_t visibleLayers) const noexcept;
+    /*
+     * The per-frame renderable and light data is kept in snapshots, which each View culls,
+     * sorts and renders from. prepare() updates snapshot 0 and copies it into the following
+     * ones, so that several Views of the scene can be culled at the same time and rendered
+     * one after the other, see FRenderer::render(). The methods below work on the snapshot
+     * they're given, the spatial queries use snapshot 0.
+     */
+    static constexpr size_t SNAPSHOT_COUNT = 2;
+
+    // snapshotCount is the number of snapshots filled, between 1 and SNAPSHOT_COUNT
+    void prepare(const math::mat4& worldOriginTansform, size_t snapshotCount = 1);
+
+    // whether two world origins are exactly the same, i.e. they prepare the same scene
+    static bool isSameTransform(math::mat4 const& lhs, math::mat4 const& rhs) noexcept;
+    // shadowAtlas gives the shadow index of the spot lights, written in their GPU data
+    void prepareDynamicLights(size_t snapshot, const CameraInfo& camera, ArenaScope& arena,
+            ShadowAtlas const& shadowAtlas) noexcept;
+    void computeBounds(size_t snapshot, Aabb& castersBox, Aabb& receiversBox,
+            uint32_t visibleLayers) const noexcept;
+
+    // Sets 'bit' in VISIBLE_MASK for all renderables intersecting the frustum, using the
+    // BVH. Returns false if the scene doesn't have a BVH, in which case nothing is done.
+    // The snapshot must not have been reordered since prepare().
+    bool cullRenderables(size_t snapshot, Frustum const& frustum, size_t bit) noexcept;
+
+    // Sets VISIBILITY for all the lights whose bounding box intersects the frustum, using
+    // the lights' BVH. Returns false if the scene doesn't have one, in which case nothing is done.
+    // The snapshot must not have been sorted since prepare().
+    bool cullLights(size_t snapshot, Frustum const& frustum) noexcept;
+
+    // scenes with at least this many renderables are culled using a BVH
+    static constexpr size_t BVH_CULLING_MIN_RENDERABLE_COUNT = 1024;
+
+    // scenes with at least this many point and spot lights cull them using a BVH
+    static constexpr size_t BVH_CULLING_MIN_LIGHT_COUNT = 256;
+
+    // raycast() spreads batches of rays over the JobSystem, by jobs of at least this many
+    static constexpr size_t RAYCAST_MIN_JOB_SIZE = 64;
+
+    // computeBounds() reduces chunks of at least this many renderables in parallel, in at
+    // most BOUNDS_MAX_CHUNK_COUNT jobs
+    static constexpr uint32_t BOUNDS_MIN_CHUNK_SIZE = 4096;
+    static constexpr uint32_t BOUNDS_MAX_CHUNK_COUNT = 16;
 
     /*
      * Storage for per-frame renderable data
@@ -94,8 +147,12 @@ public:
         RENDERABLE_INSTANCE,    //  4 instance of the Renderable component
         WORLD_TRANSFORM,        // 16 instance of the Transform component
         VISIBILITY_STATE,       //  1 visibility data of the component
-        UBH,                    //  4 uniform buffer handle
-        BONES_UBH,              //  4 bones uniform buffer handle
+        UNIFORMS_OFFSET,        //  4 offset of the per-renderable uniforms in the ring
+        BONES_OFFSET,           //  4 offset of the bones in the renderable manager's arena
+        TEXTURE_LAYER,          //  4 layer of the texture arrays sampled by the renderable
+        MORPH_WEIGHTS,          // 16 weights of the morph targets
+        SKINNING_FLAGS,         //  1 whether the skinning variant skins, morphs or both
+        SORT_KEY,               //  1 sort key of the opaque commands
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
 
@@ -106,24 +163,51 @@ public:
         // These are temporaries and should be stored out of line
         PRIMITIVES,             //  8 level-of-detail'ed primitives
         SUMMED_PRIMITIVE_COUNT, //  4 summed visible primitive counts
+
+        // Only needed for updating the world transform incrementally
+        TRANSFORM_INSTANCE,     //  4 instance of the Transform component
+
+        // Only needed for BVH culling
+        BVH_SLOT,               //  4 slot of this renderable in the culling BVH
     };
 
     using RenderableSoa = utils::StructureOfArrays<
             utils::EntityInstance<RenderableManager>,
             math::mat4f,
             FRenderableManager::Visibility,
-            Handle<HwUniformBuffer>,
-            Handle<HwUniformBuffer>,
+            uint32_t,
+            uint32_t,
+            uint32_t,
+            math::float4,
+            uint8_t,
+            uint8_t,
             math::float3,
             Culler::result_type,
             uint8_t,
             math::float3,
             utils::Slice<FRenderPrimitive>,
+            uint32_t,
+            FTransformManager::Instance,
             uint32_t
     >;
 
-    RenderableSoa const& getRenderableData() const noexcept { return mRenderableData; }
-    RenderableSoa& getRenderableData() noexcept { return mRenderableData; }
+    RenderableSoa const& getRenderableData(size_t snapshot) const noexcept {
+        assert(snapshot < SNAPSHOT_COUNT);
+        return mRenderableData[snapshot];
+    }
+    RenderableSoa& getRenderableData(size_t snapshot) noexcept {
+        assert(snapshot < SNAPSHOT_COUNT);
+        return mRenderableData[snapshot];
+    }
+
+    // changes each time the entities are gathered again, the BVH_SLOT of a renderable
+    // identifies it in all the snapshots as long as this doesn't change
+    uint32_t getGatherCount() const noexcept { return mGatherCount; }
+
+    // changes each time a static shadow caster is added, removed or modified, valid after
+    // prepare(). Shadow maps of static casters are cached as long as this doesn't change.
+    uint32_t getStaticCastersGeneration() const noexcept { return mStaticCastersGeneration; }
+    bool hasStaticCasters() const noexcept { return mStaticCasterCount != 0; }
 
     static inline uint32_t getPrimitiveCount(RenderableSoa const& soa,
             uint32_t first, uint32_t last) noexcept {
@@ -146,7 +230,8 @@ public:
         DIRECTION,
         LIGHT_INSTANCE,
         VISIBILITY,
-        SCREEN_SPACE_Z_RANGE
+        SCREEN_SPACE_Z_RANGE,
+        BOUNDING_SPHERE         // smaller than POSITION_RADIUS for the spot lights
     };
 
     using LightSoa = utils::StructureOfArrays<
@@ -154,15 +239,38 @@ public:
             math::float3,
             FLightManager::Instance,
             Culler::result_type,
-            math::float2
+            math::float2,
+            math::float4
     >;
 
-    LightSoa const& getLightData() const noexcept { return mLightData; }
-    LightSoa& getLightData() noexcept { return mLightData; }
+    LightSoa const& getLightData(size_t snapshot) const noexcept {
+        assert(snapshot < SNAPSHOT_COUNT);
+        return mLightData[snapshot];
+    }
+    LightSoa& getLightData(size_t snapshot) noexcept {
+        assert(snapshot < SNAPSHOT_COUNT);
+        return mLightData[snapshot];
+    }
 
-    void updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept;
+    // writes the per-renderable uniforms of the visible renderables and uploads them all at
+    // once to the ring, this sets up UNIFORMS_OFFSET
+    void updateUBOs(size_t snapshot, utils::Range<uint32_t> visibleRenderables) noexcept;
+
+    // the uniform buffer the UNIFORMS_OFFSET refer to, as of the last updateUBOs()
+    Handle<HwUniformBuffer> getRenderableUbh() const noexcept {
+        return mRenderableUniforms.getUbh();
+    }
 
 private:
+    void gatherEntities(const math::mat4& worldOriginTansform);
+    bool updateRenderables(const math::mat4& worldOriginTansform);
+    void prepareLights(const math::mat4& worldOriginTansform);
+    void updateLightBvh();
+
+    // casts a ray in the space of the renderables' world AABBs
+    RaycastHit raycastRenderables(math::float3 const& origin, math::float3 const& invDirection,
+            float maxDistance) const noexcept;
+
     static inline void computeLightRanges(math::float2* zrange,
             CameraInfo const& camera, const math::float4* spheres, size_t count) noexcept;
 
@@ -173,13 +281,60 @@ private:
     FSkybox const* mSkybox = nullptr;
     FIndirectLight const* mIndirectLight = nullptr;
     GpuLightBuffer mGpuLightData;
+    UniformRing mRenderableUniforms;
 
     // list of Entities in the scene. We use a robin_set<> so we can do efficient removes
     // (a vector<> could work, but removes would be O(n)). robin_set<> iterates almost as
     // nicely as vector<>, which is a good compromise.
     tsl::robin_set<utils::Entity> mEntities;
-    RenderableSoa mRenderableData;
-    LightSoa mLightData;
+    RenderableSoa mRenderableData[SNAPSHOT_COUNT];
+    LightSoa mLightData[SNAPSHOT_COUNT];
+
+    // lights gathered by the last full walk of mEntities
+    struct LightEntry {
+        utils::Entity entity;
+        FLightManager::Instance light;
+        FTransformManager::Instance transform;
+    };
+    std::vector<LightEntry> mLights;
+
+    // hierarchy of the renderables' world AABBs, indexed by BVH_SLOT. It's empty for small
+    // scenes. mBvhRows maps each slot to its row in the snapshots, as of the last prepare().
+    Bvh mBvh;
+    std::vector<uint32_t> mBvhRows;
+
+    // entity of each BVH_SLOT, used by the spatial queries with or without a BVH
+    std::vector<utils::Entity> mSlotEntities;
+
+    // rows whose world AABB updateRenderables() recomputes, kept to avoid reallocations
+    std::vector<uint32_t> mDirtyRows;
+
+    // hierarchy of the point and spot lights' bounding boxes, slot i is the row
+    // i + DIRECTIONAL_LIGHTS_COUNT of mLightData, as generated by prepareLights(). It's empty
+    // for scenes with few lights. mLightBvhSpheres are the bounding spheres of the lights in the
+    // BVH.
+    Bvh mLightBvh;
+    std::vector<math::float4> mLightBvhSpheres;
+
+    // state of the world at the time of the last full walk of mEntities, prepare() only
+    // patches mRenderableData in place as long as these don't change.
+    math::mat4 mWorldOriginTransform;
+    uint32_t mRenderableLayoutGeneration = 0;
+    uint32_t mTransformLayoutGeneration = 0;
+    uint32_t mLightLayoutGeneration = 0;
+    uint32_t mRenderableGeneration = 0;
+    uint32_t mTransformGeneration = 0;
+    bool mEntitiesDirty = true;
+
+    uint32_t mStaticCastersGeneration = 0;
+    size_t mStaticCasterCount = 0;
+
+    // what the uniforms of the last updateUBOs() were written from
+    std::vector<utils::EntityInstance<RenderableManager>> mUniformsInstances;
+    uint32_t mUniformsGatherCount = 0;
+    uint32_t mUniformsRenderableGeneration = 0;
+    uint32_t mUniformsTransformGeneration = 0;
+    uint32_t mGatherCount = 0;
 };
 
 FILAMENT_UPCAST(Scene)
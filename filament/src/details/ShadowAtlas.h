@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+#define TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+
+#include "components/LightManager.h"
+
+#include "details/Camera.h"
+#include "details/Scene.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/SamplerBuffer.h"
+
+#include <filament/EngineEnums.h>
+#include <filament/Viewport.h>
+
+#include <math/mat4.h>
+#include <math/vec4.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The shadow maps of the spot lights, packed in a single texture.
+ *
+ * Each frame, the visible shadow casting spot lights get a square tile of the atlas sized after
+ * how much of the screen they cover (and at most their LightManager shadow map size). Tiles are
+ * powers of two allocated largest first, in Morton order, so they never overlap nor leave holes.
+ * When the atlas is full, the least important lights get smaller tiles, or none.
+ */
+class ShadowAtlas {
+public:
+    // smallest tile of the atlas, lights covering less of the screen than this don't cast shadows
+    static constexpr uint32_t MIN_TILE_DIMENSION = 64;
+
+    // largest atlas, lights get smaller tiles when it's full
+    static constexpr uint32_t MAX_DIMENSION = 4096;
+
+    // spot lights with a wider cone don't cast shadows, as they'd need a too wide projection
+    static constexpr float MAX_SPOT_OUTER_ANGLE = float(80.0 * M_PI / 180.0);
+
+    explicit ShadowAtlas(FEngine& engine) noexcept;
+    ~ShadowAtlas();
+
+    void terminate(driver::DriverApi& driverApi) noexcept;
+
+    // Picks the shadow casting spot lights and computes their tiles and cameras. Call once per
+    // frame, lightData must only have the visible lights.
+    void update(FScene::LightSoa const& lightData, CameraInfo const& camera) noexcept;
+
+    // No light casts shadows this frame, call instead of update().
+    void clear() noexcept;
+
+    // Do we have visible shadows. Valid after calling update().
+    bool hasVisibleShadows() const noexcept { return mTileCount > 0; }
+
+    // Allocates the atlas texture. Valid after calling update().
+    void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
+
+    // Returns the atlas' render target and its dimension. Valid after prepare().
+    Handle<HwRenderTarget> getRenderTarget() const noexcept { return mRenderTarget; }
+    uint32_t getDimension() const noexcept { return mDimension; }
+
+    // Number of lights with a tile in the atlas. Valid after calling update().
+    size_t getTileCount() const noexcept { return mTileCount; }
+
+    // Index of the light's tile, or -1 if it has none. Valid after calling update().
+    int getTileIndex(FLightManager::Instance light) const noexcept;
+
+    // Valid after calling update().
+    Viewport const& getViewport(size_t tile) const noexcept { return mTiles[tile].viewport; }
+    FCamera const& getCamera(size_t tile) const noexcept { return *mCameras[tile]; }
+
+    // Transforms a world-space position into the tile's texture coordinates and depth.
+    // Valid after calling update().
+    math::mat4f const& getLightSpaceMatrix(size_t tile) const noexcept {
+        return mTiles[tile].lightSpace;
+    }
+
+    // Constant bias (in depth units) and normal bias (in world units, at 1m from the light) of
+    // a tile. Valid after calling update().
+    math::float4 getShadowBias(size_t tile) const noexcept {
+        return { mTiles[tile].constantBias, mTiles[tile].normalBias, 0, 0 };
+    }
+
+    // Set-up the render target, call before rendering each tile. The whole atlas is cleared with
+    // the first tile rendered.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t tile, bool clear) const noexcept;
+
+private:
+    struct Tile {
+        FLightManager::Instance light;
+        math::mat4f lightSpace;
+        Viewport viewport;          // inside the tile's 1-texel border
+        float constantBias = 0;
+        float normalBias = 0;
+        uint32_t dimension = 0;
+        uint32_t index = 0;         // in the scene's light data
+        float importance = 0;
+    };
+
+    void computeShadowCamera(Tile& tile, FCamera& camera, math::float3 const& position,
+            math::float3 const& direction, float radius, float outerAngle) noexcept;
+    math::mat4f getTextureCoordsMapping(Tile const& tile) const noexcept;
+
+    FCamera* mCameras[CONFIG_MAX_SHADOWED_SPOT_LIGHTS] = {};
+    Tile mTiles[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    size_t mTileCount = 0;
+
+    // set-up in update()
+    uint32_t mDimension = 0;
+
+    // set-up in prepare()
+    Handle<HwTexture> mTexture;
+    Handle<HwRenderTarget> mRenderTarget;
+    uint32_t mAllocatedDimension = 0;
+
+    FEngine& mEngine;
+    const bool mClipSpaceFlipped;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWATLAS_H
@@ -25,6 +25,7 @@
 #include "driver/DriverApiForward.h"
 #include "driver/SamplerBuffer.h"
 
+#include <filament/EngineEnums.h>
 #include <filament/Viewport.h>
 
 #include <math/mat4.h>
@@ -35,15 +36,37 @@ namespace details {
 
 class ShadowMap {
 public:
+    // The volume of the shadow casters that can shadow the visible receivers of a cascade: the
+    // intersection of the cascade's view frustum with the receivers, swept towards the light.
+    // Its sides are parallel to the light's direction, it's capped by the farthest receiver.
+    struct CasterVolume {
+        static constexpr size_t MAX_SIDES = 16;
+        math::float4 planes[MAX_SIDES + 1];     // world space, the inside is negative
+        size_t planeCount = 0;                  // no planes means no culling
+
+        // conservative test of a world space box
+        bool intersects(math::float3 const& center, math::float3 const& extent) const noexcept {
+            for (size_t i = 0; i < planeCount; i++) {
+                math::float4 const& plane = planes[i];
+                const float d = dot(plane.xyz, center) - dot(abs(plane.xyz), extent) + plane.w;
+                if (d > 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
     explicit ShadowMap(FEngine& engine) noexcept;
     ~ShadowMap();
 
     void terminate(driver::DriverApi& driverApi) noexcept;
 
     // Call once per frame if the light, scene (or visible layers) or camera changes.
-    // This computes the light's camera.
+    // This computes the light's camera, sceneSnapshot is the snapshot lightData belongs to.
     void update(
-            const FScene::LightSoa& lightData, size_t index, FScene const* scene,
+            const FScene::LightSoa& lightData, size_t index,
+            FScene const* scene, size_t sceneSnapshot,
             details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
 
     // Do we have visible shadows. Valid after calling update().
@@ -52,24 +75,85 @@ public:
     // Allocates shadow texture based on user parameters (e.g. dimensions)
     void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
 
-    // Returns the shadow map's viewport. Valid after prepare().
-    Viewport const& getViewport() const noexcept { return mViewport; }
+    // Returns the shadow map's render target and its dimension. Valid after prepare().
+    Handle<HwRenderTarget> getRenderTarget() const noexcept { return mShadowMapRenderTarget; }
+    uint32_t getDimension() const noexcept { return mShadowMapDimension; }
+
+    // Number of cascades the view frustum is split into, each one is rendered in its own tile
+    // of the shadow map. Valid after calling update().
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    // View-space distances at which each cascade ends, unused cascades end with the last one.
+    // Valid after calling update().
+    math::float4 const& getCascadeSplits() const noexcept { return mCascadeSplits; }
+
+    // Does this cascade have visible shadows. Valid after calling update().
+    bool hasVisibleShadows(size_t cascade) const noexcept {
+        return mCascades[cascade].hasVisibleShadows;
+    }
+
+    // Returns the cascade's viewport in the shadow map. Valid after update().
+    Viewport const& getViewport(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].viewport;
+    }
 
     // Computes the transform to use in the shader to access the shadow map.
     // Valid after calling update().
-    math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
+    math::mat4f const& getLightSpaceMatrix(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].lightSpace;
+    }
 
     // return the size of a texel in world space (pre-warping)
-    float getTexelSizeWorldSpace() const noexcept { return mTexelSizeWs; }
+    float getTexelSizeWorldSpace(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].texelSizeWs;
+    }
 
     // Returns the shadow map's depth range. Valid after init().
-    float getSceneRange() const noexcept { return mSceneRange; }
+    float getSceneRange(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].sceneRange;
+    }
 
     // Returns the light's projection. Valid after calling update().
-    FCamera const& getCamera() const noexcept { return *mCamera; }
+    FCamera const& getCamera(size_t cascade = 0) const noexcept {
+        return *mCascades[cascade].camera;
+    }
+
+    // Returns the volume of the casters that can shadow the visible receivers of the cascade.
+    // Valid after calling update().
+    CasterVolume const& getCasterVolume(size_t cascade = 0) const noexcept {
+        return mCascades[cascade].casterVolume;
+    }
+
+    // Static shadow casters are rendered in their own shadow map, which is copied into this one
+    // before the other casters are rendered. It's only rendered again when the light-space
+    // transforms or the static casters change. Valid after prepare().
+    bool hasStaticCache() const noexcept { return mStaticCache.enabled; }
+    bool isStaticCacheDirty() const noexcept { return mStaticCache.dirty; }
+
+    // copies the static casters into the shadow map, call outside of a render pass
+    void copyStaticCache(driver::DriverApi& driverApi) const noexcept;
+
+    // Set-up the render target, call before rendering each cascade of the shadow map (or of the
+    // static casters' cache). The whole shadow map is cleared with the first cascade rendered.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t cascade, bool clear,
+            bool staticCache) const noexcept;
 
-    // Set-up the render target, call before rendering the shadow map.
-    void beginRenderPass(driver::DriverApi& driverApi) const noexcept;
+    // Variance shadows: the depth is converted into the moments of its exponential warp, which
+    // are blurred once per frame and sampled by the receivers instead of the depth. Takes effect
+    // with the next prepare().
+    void setVsm(bool enabled) noexcept { mVsm = enabled; }
+    bool isVsm() const noexcept { return mVsm; }
+
+    // exponent of the moments' warp, the largest whose moments fit in RGBA16F
+    static constexpr float VSM_EXPONENT = 5.54f;
+
+    // Returns the render target of the blurred moments, null without variance shadows. Valid
+    // after prepare().
+    Handle<HwRenderTarget> getMomentsRenderTarget() const noexcept { return mMoments.target; }
+
+    // converts the cascades of the shadow map into blurred moments, call outside of a render
+    // pass once all the cascades are rendered
+    void prefilterMoments(driver::DriverApi& driverApi) const noexcept;
 
     // use only for debugging
     FCamera const& getDebugCamera() const noexcept { return *mDebugCamera; }
@@ -104,9 +188,50 @@ private:
     // 8 corners, 12 segments w/ 2 intersection max -- all of this twice (8 + 12 * 2) * 2 (768 bytes)
     using FrustumBoxIntersection = std::array<math::float3, 64>;
 
+    struct Cascade {
+        FCamera* camera = nullptr;
+        math::mat4f lightSpace;
+        Viewport viewport;          // tile of the shadow map, inside its 1-texel border
+        float sceneRange = 0.0f;
+        float texelSizeWs = 0.0f;
+        CasterVolume casterVolume;
+        bool hasVisibleShadows = false;
+    };
+
     void computeShadowCameraDirectional(
-            math::float3 const& direction, FScene const* scene, CameraInfo const& camera,
-            uint8_t visibleLayers) noexcept;
+            math::float3 const& direction, Aabb const& wsShadowCastersVolume,
+            Aabb const& wsShadowReceiversVolume, CameraInfo const& camera,
+            size_t cascade) noexcept;
+
+    struct StaticCache {
+        Handle<HwTexture> texture;
+        Handle<HwRenderTarget> target;
+        uint32_t dimension = 0;     // of the allocated texture
+        // what the content of the cache depends on
+        math::mat4f lightSpace[CONFIG_MAX_SHADOW_CASCADES];
+        FScene const* scene = nullptr;
+        uint32_t staticCastersGeneration = 0;
+        uint8_t visibleLayers = 0;
+        uint8_t visibleCascades = 0;
+        bool enabled = false;
+        bool dirty = true;
+    };
+
+    void updateStaticCache(FScene const* scene, uint8_t visibleLayers) noexcept;
+    void prepareStaticCache(driver::DriverApi& driver) noexcept;
+
+    struct Moments {
+        Handle<HwTexture> texture;          // sampled by the receivers
+        Handle<HwRenderTarget> target;
+        Handle<HwTexture> blurTexture;      // blurred horizontally only
+        Handle<HwRenderTarget> blurTarget;
+        uint32_t dimension = 0;             // of the allocated textures
+    };
+
+    void prepareMoments(driver::DriverApi& driver, SamplerBuffer& sb) noexcept;
+    void destroyMoments(driver::DriverApi& driver) noexcept;
+
+    static void setNearFar(math::mat4f& projection, float n, float f) noexcept;
 
     static math::mat4f applyLISPSM(
             CameraInfo const& camera, float dzn, float dzf, const math::mat4f& LMpMv,
@@ -122,6 +247,9 @@ private:
     static inline math::float2 computeNearFar(math::mat4f const& lightView,
             Aabb const& wsShadowCastersVolume) noexcept;
 
+    void computeCasterVolume(CasterVolume& volume, const math::mat4f& lightView,
+            size_t vertexCount) const noexcept;
+
     static inline void intersectWithShadowCasters(Aabb& lightFrustum, const math::mat4f& lightView,
             Aabb const& wsShadowCastersVolume) noexcept;
 
@@ -148,7 +276,7 @@ private:
 
     static math::mat4f warpFrustum(float n, float f) noexcept;
 
-    math::mat4f getTextureCoordsMapping() const noexcept;
+    math::mat4f getTextureCoordsMapping(size_t cascade) const noexcept;
 
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix) const noexcept;
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix, math::float3 const& str) const noexcept;
@@ -167,19 +295,22 @@ private:
             { 2, 6, 7, 3 },  // top
     };
 
-    FCamera* mCamera = nullptr;
     FCamera* mDebugCamera = nullptr;
-    math::mat4f mLightSpace;
-    float mSceneRange = 0.0f;
-    float mTexelSizeWs = 0.0f;
+    Cascade mCascades[CONFIG_MAX_SHADOW_CASCADES];
 
     // set-up in prepare()
-    Viewport mViewport;
     Handle<HwTexture> mShadowMapHandle;
     Handle<HwRenderTarget> mShadowMapRenderTarget;
+    uint32_t mAllocatedDimension = 0;
+    StaticCache mStaticCache;
+    Moments mMoments;
+    bool mVsm = false;
 
     // set-up in update()
-    uint32_t mShadowMapDimension = 0;
+    uint32_t mShadowMapDimension = 0;   // of the whole texture
+    uint32_t mCascadeDimension = 0;     // of each cascade's tile
+    size_t mCascadeCount = 1;
+    math::float4 mCascadeSplits;
     bool mHasVisibleShadows = false;
 
     // use a member here (instead of stack) because we don't want to pay the
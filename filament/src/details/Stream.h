@@ -42,9 +42,16 @@ public:
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             driver::PixelBufferDescriptor&& buffer) noexcept;
 
-    bool isNativeStream() const noexcept { return mNativeStream != nullptr; }
+    void setAcquiredImage(void* image, int acquireFence,
+            Callback callback, void* userdata) noexcept;
 
-    bool isExternalTextureId() const noexcept { return !isNativeStream(); }
+    driver::StreamType getStreamType() const noexcept { return mStreamType; }
+
+    bool isNativeStream() const noexcept { return mStreamType == driver::StreamType::NATIVE; }
+
+    bool isExternalTextureId() const noexcept {
+        return mStreamType == driver::StreamType::TEXTURE_ID;
+    }
 
     uint32_t getWidth() const noexcept { return mWidth; }
 
@@ -53,6 +60,7 @@ public:
 private:
     FEngine& mEngine;
     Handle<HwStream> mStreamHandle;
+    driver::StreamType mStreamType;
     void* mNativeStream = nullptr;
     intptr_t mExternalTextureId;
     uint32_t mWidth;
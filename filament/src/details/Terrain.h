@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_TERRAIN_H
+#define TNT_FILAMENT_DETAILS_TERRAIN_H
+
+#include "upcast.h"
+
+#include <filament/Terrain.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/vec2.h>
+#include <math/vec4.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+class FCamera;
+class FEngine;
+class FIndexBuffer;
+class FMaterial;
+class FMaterialInstance;
+class FTexture;
+class FVertexBuffer;
+
+/*
+ * The levels are geometry clipmaps, as in "Terrain Rendering Using GPU-Based Geometry
+ * Clipmaps", GPU Gems 2. Each level is a square of (4m - 2) quads, m = resolution / 4, in the
+ * finest level's spacing times 2^level:
+ * - a ring of 12 blocks of (m - 1) quads and 4 fix-up strips of 2 quads, around a hole of 2m
+ *   quads, which holds the finer level and an L-shaped trim of one quad along two sides,
+ * - or, for the finest level, the ring and the filled center.
+ * The mesh has the ring, the center and every possible trim, the vertex shader collapses the
+ * triangles that don't belong to the level it draws, one per instance. The levels morph into
+ * the next one close to their outer edge, so that there are no cracks between them.
+ *
+ * The heights and normals of the levels are in a texture array, one layer per level addressed
+ * toroidally, i.e. the sample (x, y) of a level is in the texel (x, y) modulo the resolution.
+ * When the camera moves, only the rows and columns that entered a level are uploaded.
+ */
+class FTerrain : public Terrain {
+public:
+    // the triangles of the mesh, the vertex shader keeps those whose bit is set in the mask of
+    // the level (see Level)
+    enum Kind : uint8_t {
+        RING,
+        CENTER,
+        TRIM_X_LOW, TRIM_X_HIGH,                // the trims along y, at the low or high x
+        TRIM_Y_LOW, TRIM_Y_HIGH,                // the trims along x, without their ends
+        TRIM_Y_LOW_END_LOW, TRIM_Y_LOW_END_HIGH,    // the ends of the trims along x, at the
+        TRIM_Y_HIGH_END_LOW, TRIM_Y_HIGH_END_HIGH,  // corner not covered by the trim along y
+    };
+
+    struct Level {
+        math::int2 origin;      // first sample of the level, in samples of the level
+        uint32_t mask;          // the kinds of triangles drawn by the level
+    };
+
+    FTerrain(FEngine& engine, const Builder& builder);
+
+    void terminate(FEngine& engine) noexcept;
+
+    utils::Entity getEntity() const noexcept { return mEntity; }
+
+    FMaterialInstance* getMaterialInstance() noexcept { return mMaterialInstance; }
+
+    void update(FEngine& engine, FCamera const& camera);
+
+    // centers the levels on 'viewer', given in samples of the finest level
+    static void computeLevels(math::double2 viewer, uint32_t m,
+            Level* levels, size_t count) noexcept;
+
+    static FMaterial const* createMaterial(FEngine& engine);
+
+private:
+    struct Heightfield {
+        uint32_t width;
+        uint32_t height;
+        std::vector<float> heights;
+        float get(int32_t x, int32_t y) const noexcept;
+    };
+
+    // uploads the heights and normals of the samples [x, x + width) x [y, y + height)
+    void uploadRegion(FEngine& engine, size_t level,
+            int32_t x, int32_t y, uint32_t width, uint32_t height) const;
+
+    // we own these
+    utils::Entity mEntity;
+    FVertexBuffer* mVertexBuffer = nullptr;
+    FIndexBuffer* mIndexBuffer = nullptr;
+    FTexture* mClipmap = nullptr;
+    FMaterialInstance* mMaterialInstance = nullptr;
+
+    std::vector<Heightfield> mHeightfields;     // the heightfield filtered for each level
+    math::int2 mResident[MAX_LEVELS];           // first sample of the levels in mClipmap
+    float mSpacing;
+    float mMinHeight;
+    float mMaxHeight;
+    uint32_t mResolution;
+    uint8_t mLevelCount;
+    bool mHasResidents = false;
+};
+
+FILAMENT_UPCAST(Terrain)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_TERRAIN_H
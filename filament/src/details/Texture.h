@@ -25,9 +25,12 @@
 
 #include <utils/compiler.h>
 
+#include <atomic>
+
 namespace filament {
 namespace details {
 
+class DestroyBatch;
 class FEngine;
 class FStream;
 
@@ -41,6 +44,7 @@ public:
 
     // frees driver resources, object becomes invalid
     void terminate(FEngine& engine);
+    void terminate(FEngine& engine, DestroyBatch& batch);
 
     Handle<HwTexture> getHwHandle() const noexcept { return mHandle; }
 
@@ -51,11 +55,17 @@ public:
     Sampler getTarget() const noexcept { return mTarget; }
     InternalFormat getFormat() const noexcept { return mFormat; }
     bool isRgbm() const noexcept { return mRgbm; }
+    Usage getUsage() const noexcept { return mUsage; }
 
     void setImage(FEngine& engine, size_t level,
             uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             PixelBufferDescriptor&& buffer) const noexcept;
 
+    void setImage(FEngine& engine, size_t level,
+            uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+            uint32_t width, uint32_t height, uint32_t depth,
+            PixelBufferDescriptor&& buffer) const noexcept;
+
     void setImage(FEngine& engine, size_t level,
             PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept;
 
@@ -63,6 +73,7 @@ public:
     void setExternalStream(FEngine& engine, FStream* stream) noexcept;
 
     void generateMipmaps(FEngine& engine) const noexcept;
+    bool generateMipmapsAsync(FEngine& engine, MipmapsCallback callback, void* user) noexcept;
 
     void setSampleCount(size_t sampleCount) noexcept { mSampleCount = uint8_t(sampleCount); }
     size_t getSampleCount() const noexcept { return mSampleCount; }
@@ -74,7 +85,43 @@ public:
 
     static size_t getFormatSize(InternalFormat format) noexcept;
 
+    // streaming textures, see TextureStreamer
+    static constexpr uint8_t NO_LEVEL = 0xff;
+
+    bool isStreaming() const noexcept { return mStreamingCallback != nullptr; }
+
+    // level needed for this texture to cover this many pixels on screen
+    size_t getLevelForSize(float pixels) const noexcept;
+
+    // records that a render pass needs this level, can be called from several jobs at once
+    void requestLevel(size_t level) const noexcept;
+
+    // finest level requested since the last call, NO_LEVEL if none
+    uint8_t takeRequestedLevel() const noexcept {
+        return mRequestedLevel.exchange(NO_LEVEL, std::memory_order_relaxed);
+    }
+
+    // finest level sampled, all the coarser levels are resident
+    uint8_t getMinLevel() const noexcept { return mMinLevel; }
+
+    // level asked to the application and not uploaded yet, NO_LEVEL if none
+    uint8_t getPendingLevel() const noexcept { return mPendingLevel; }
+
+    size_t getLevelSize(size_t level) const noexcept;
+    size_t getResidentSize() const noexcept;
+
+    // asks the application for the level finer than getMinLevel()
+    void streamNextLevel(FEngine& engine) noexcept;
+
+    // stops sampling the finest resident level
+    void evictMinLevel(FEngine& engine) noexcept;
+
 private:
+    void updateResidency(FEngine& engine, size_t level) const noexcept;
+
+    // backs the levels [minLevel, mLevels) with memory, on sparse textures
+    void commitLevels(FEngine& engine, size_t minLevel) const noexcept;
+
     friend class Texture;
     Handle<HwTexture> mHandle;
     uint32_t mWidth = 1;
@@ -87,6 +134,14 @@ private:
     uint8_t mSampleCount = 1;
     FStream* mStream = nullptr;
     Usage mUsage = Usage::DEFAULT;
+
+    StreamingCallback mStreamingCallback = nullptr;
+    void* mStreamingUser = nullptr;
+    mutable std::atomic<uint8_t> mRequestedLevel{ NO_LEVEL };
+    mutable uint32_t mResidentLevels = 0;   // one bit per uploaded level
+    mutable uint8_t mMinLevel = 0;
+    mutable uint8_t mPendingLevel = NO_LEVEL;
+    mutable uint8_t mCommittedLevel = NO_LEVEL;
 };
 
 
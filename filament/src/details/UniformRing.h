@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_UNIFORMRING_H
+#define TNT_FILAMENT_DETAILS_UNIFORMRING_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+#include "driver/UniformBuffer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Per-frame storage for many instances of the same uniform block.
+ *
+ * Instances are written contiguously, one fixed-size slot each, uploaded in a single transfer
+ * by commit() and bound by offset with bindUniformsRange(). Each commit() goes to the next of
+ * BUFFER_COUNT uniform buffers, so that we don't update a buffer the GPU may still be reading.
+ */
+class UniformRing {
+public:
+    static constexpr size_t BUFFER_COUNT = 3;
+
+    // the largest uniform buffer offset alignment in common use, for when it's not known
+    static constexpr size_t DEFAULT_SLOT_ALIGNMENT = 256;
+
+    // slotSize is the size of the uniform block, it's rounded-up to a multiple of 'alignment',
+    // the device's DriverApi::getUniformBufferOffsetAlignment(), or DEFAULT_SLOT_ALIGNMENT if 0
+    UniformRing(size_t slotSize, size_t alignment) noexcept;
+
+    UniformRing(UniformRing const& rhs) = delete;
+    UniformRing& operator=(UniformRing const& rhs) = delete;
+
+    void terminate(driver::DriverApi& driver);
+
+    // starts a new set of 'count' slots, all set to zero, and returns the buffer to write them
+    // to. The previous set becomes unavailable.
+    UniformBuffer& allocate(size_t count) noexcept;
+
+    // uploads the slots written since allocate(), and makes them the ones getUbh() refers to
+    void commit(driver::DriverApi& driver) noexcept;
+
+    // offset in bytes of a slot, both in the buffer returned by allocate() and in getUbh()
+    size_t getOffset(size_t slot) const noexcept { return slot * mSlotSize; }
+
+    size_t getSlotSize() const noexcept { return mSlotSize; }
+
+    // the uniform buffer holding the slots, as of the last commit()
+    Handle<HwUniformBuffer> getUbh() const noexcept { return mHandles[mCurrent]; }
+
+private:
+    const size_t mSlotSize;
+    UniformBuffer mUniforms;
+    Handle<HwUniformBuffer> mHandles[BUFFER_COUNT];
+    size_t mCapacity = 0;   // size in bytes of the uniform buffers in mHandles
+    uint32_t mCurrent = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_UNIFORMRING_H
@@ -19,6 +19,7 @@
 
 #include "upcast.h"
 
+#include "driver/Driver.h"
 #include "driver/Handle.h"
 
 #include <filament/VertexBuffer.h>
@@ -32,6 +33,7 @@
 namespace filament {
 namespace details {
 
+class DestroyBatch;
 class FEngine;
 
 class FVertexBuffer : public VertexBuffer {
@@ -40,6 +42,7 @@ public:
 
     // frees driver resources, object becomes invalid
     void terminate(FEngine& engine);
+    void terminate(FEngine& engine, DestroyBatch& batch);
 
     Handle<HwVertexBuffer> getHwHandle() const noexcept { return mHandle; }
 
@@ -49,6 +52,11 @@ public:
         return mDeclaredAttributes;
     }
 
+    // the layout of the attributes, as given to the driver
+    Driver::AttributeArray getAttributeArray() const noexcept;
+
+    uint8_t getBufferCount() const noexcept { return mBufferCount; }
+
     // no-op if bufferIndex out of range
     void setBufferAt(FEngine& engine, uint8_t bufferIndex,
             driver::BufferDescriptor&& buffer,
@@ -21,9 +21,16 @@
 
 #include "upcast.h"
 
+#include "ColorGrading.h"
+#include "RenderPass.h"
+
 #include "details/Allocators.h"
 #include "details/Camera.h"
+#include "details/DepthPrepassSelector.h"
 #include "details/Froxelizer.h"
+#include "details/HiZBuffer.h"
+#include "details/RenderTarget.h"
+#include "details/ShadowAtlas.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
 
@@ -33,11 +40,14 @@
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/JobGraph.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
 #include <deque>
+#include <memory>
+#include <vector>
 
 namespace utils {
 class JobSystem;
@@ -61,6 +71,17 @@ public:
 
     void terminate(FEngine& engine);
 
+    // Culls the scene and partitions its renderables for this view, it doesn't use the driver.
+    // Views of different scenes, or of different snapshots of a scene, can be prepared
+    // concurrently. This must be called before prepare(), and the view's snapshot of the scene
+    // must not be altered (e.g. by another view) in between. When prepareScene is false, the
+    // scene must have been prepared with this view's getWorldOriginTransform() already.
+    void prepareVisibility(FEngine& engine, bool prepareScene = true) noexcept;
+
+    // the world origin applied to the scene for this frame, see prepareVisibility()
+    math::mat4 getWorldOriginTransform(FEngine& engine) const noexcept;
+
+    // prepares everything else, using the results of prepareVisibility()
     void prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
             Viewport const& viewport) noexcept;
 
@@ -68,11 +89,58 @@ public:
     FScene const* getScene() const noexcept { return mScene; }
     FScene* getScene() noexcept { return mScene; }
 
+    // the snapshot of the scene this view is culled and rendered from, set by the Renderer
+    // before prepareVisibility(), see FScene::SNAPSHOT_COUNT
+    void setSceneSnapshot(size_t snapshot) noexcept {
+        assert(snapshot < FScene::SNAPSHOT_COUNT);
+        mSceneSnapshot = uint8_t(snapshot);
+    }
+    size_t getSceneSnapshot() const noexcept { return mSceneSnapshot; }
+
+    FScene::RenderableSoa& getRenderableData() noexcept {
+        return mScene->getRenderableData(mSceneSnapshot);
+    }
+    FScene::LightSoa& getLightData() noexcept {
+        return mScene->getLightData(mSceneSnapshot);
+    }
+    FScene::RenderableSoa const& getRenderableData() const noexcept {
+        return mScene->getRenderableData(mSceneSnapshot);
+    }
+    FScene::LightSoa const& getLightData() const noexcept {
+        return mScene->getLightData(mSceneSnapshot);
+    }
+
     void setCullingCamera(FCamera* camera) noexcept { mCullingCamera = camera; }
     void setViewingCamera(FCamera* camera) noexcept { mViewingCamera = camera; }
 
     CameraInfo const& getCameraInfo() const noexcept { return mViewingCameraInfo; }
 
+    void setStereoscopicCameras(FCamera* left, FCamera* right) noexcept {
+        mEyeCameras[0] = left;
+        mEyeCameras[1] = right;
+    }
+
+    bool isStereoscopic() const noexcept { return mEyeCameras[0] && mEyeCameras[1]; }
+
+    // valid in stereo, after prepareVisibility()
+    CameraInfo const& getEyeCameraInfo(size_t eye) const noexcept { return mEyeCameraInfos[eye]; }
+
+    // the per-view uniforms of each eye, the left eye's are the View's
+    Handle<HwUniformBuffer> getEyeUbh(size_t eye) const noexcept {
+        return eye ? mRightEyeUbh : mPerViewUbh;
+    }
+
+    // uploads the current per-view uniforms to the right eye's buffer, see commitUniforms()
+    void commitRightEyeUniforms(driver::DriverApi& driverApi) const noexcept;
+
+    // the part of viewport an eye renders into
+    static Viewport getEyeViewport(Viewport const& viewport, size_t eye) noexcept {
+        const uint32_t width = viewport.width / 2;
+        return eye ? Viewport{ viewport.left + int32_t(width), viewport.bottom,
+                               viewport.width - width, viewport.height } :
+                Viewport{ viewport.left, viewport.bottom, width, viewport.height };
+    }
+
     void setViewport(Viewport const& viewport) noexcept;
     Viewport const& getViewport() const noexcept {
         return mViewport;
@@ -99,6 +167,63 @@ public:
     void setCulling(bool culling) noexcept { mCulling = culling; }
     bool isCullingEnabled() const noexcept { return mCulling; }
 
+    void setOcclusionCulling(bool enabled) noexcept;
+    bool isOcclusionCullingEnabled() const noexcept { return mOcclusionCulling; }
+
+    void setOrderIndependentTransparency(bool enabled) noexcept {
+        mOrderIndependentTransparency = enabled;
+    }
+    bool isOrderIndependentTransparencyEnabled() const noexcept {
+        return mOrderIndependentTransparency;
+    }
+
+    // the sorted commands of the last color passes, reused while nothing changes
+    RenderPass::CommandCache& getColorPassCommandCache() const noexcept {
+        return mColorPassCommandCache;
+    }
+
+    // true if this frame's depth buffer should be read back, for occlusion culling or for the
+    // depth bounds of the froxels
+    bool needsOcclusionDepth() const noexcept { return mOcclusionDepth != nullptr; }
+
+    // schedules the read-back of this frame's depth buffer, used to cull the next frames
+    void readOcclusionDepth(driver::DriverApi& driver, Handle<HwRenderTarget> target,
+            Viewport const& viewport) const noexcept;
+
+    // The picking queries served by a frame are rendered in the rows of the picking target, the
+    // renderables each one tests in the texels of its row, see FRenderer::PickingPass.
+    static constexpr uint32_t PICKING_CANDIDATE_COUNT = 16;
+    static constexpr uint32_t PICKING_QUERY_COUNT = 4;
+
+    struct PickingQuery {
+        uint32_t x;
+        uint32_t y;
+        PickingQueryResultCallback callback;
+        void* user;
+        CameraInfo camera;          // projects the queried pixel on a whole texel
+        uint32_t candidateCount = 0;
+        uint32_t candidates[PICKING_CANDIDATE_COUNT];           // indices in the scene's soa
+        utils::Entity entities[PICKING_CANDIDATE_COUNT];
+    };
+
+    void pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback, void* user) noexcept;
+
+    bool hasPickingQueries() const noexcept { return !mPickingQueries.empty(); }
+
+    // takes the queries served by this frame and finds the visible renderables covering their
+    // pixel, returns the picking target (created on first use)
+    Handle<HwRenderTarget> preparePicking(FEngine& engine) noexcept;
+
+    std::vector<PickingQuery> const& getServedPickingQueries() const noexcept {
+        return mServedPickingQueries;
+    }
+
+    // schedules the read-back of the picking target, which delivers the served queries
+    void readPicking(driver::DriverApi& driver) noexcept;
+
+    // delivers the pending queries without a renderable, e.g. when picking isn't supported
+    void cancelPickingQueries() noexcept;
+
     void setVisibleLayers(uint8_t select, uint8_t values) noexcept;
     uint8_t getVisibleLayers() const noexcept {
         return mVisibleLayers;
@@ -113,9 +238,13 @@ public:
         return mName.c_str();
     }
 
-    void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
-    void prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
+    // jitter: sub-pixel offset of the whole image, in pixels
+    void prepareCamera(const CameraInfo& camera, const Viewport& viewport,
+            math::float2 jitter = {}) const noexcept;
+    // whether the color pass accumulates the transparent objects without sorting them
+    void prepareOrderIndependentTransparency(bool enabled) const noexcept;
+    void prepareShadowing(FEngine& engine, FScene::RenderableSoa& renderableData,
+            FScene::LightSoa const& lightData) noexcept;
     void prepareLighting(
             FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena, Viewport const& viewport) noexcept;
     void froxelize(FEngine& engine) const noexcept;
@@ -125,12 +254,32 @@ public:
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
     bool hasShadowing() const noexcept { return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows(); }
+    bool hasShadowAtlas() const noexcept { return mShadowAtlas.hasVisibleShadows(); }
 
     void prepareVisibleRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData) const noexcept;
 
     void prepareVisibleShadowCasters(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
                                      Frustum const& lightFrustum) const noexcept;
 
+    // culls the directional light's casters that can't shadow visible receivers
+    void cullShadowCastersWithReceivers(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData) const noexcept;
+
+    void prepareShadowCascades(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData) const noexcept;
+
+    // VISIBLE_MASK bits of the shadow casters a cascade of the shadow map sees
+    uint8_t getShadowCascadeVisibilityMask(size_t cascade) const noexcept;
+
+    // VISIBLE_MASK bit of the shadow casters in the shadow map's static cache
+    uint8_t getStaticShadowCasterMask() const noexcept;
+
+    // Finds which of the visible casters a tile of the shadow atlas sees, and returns their
+    // VISIBLE_MASK bits. This reuses the bits of the shadow cascades, call after rendering the
+    // directional shadow map.
+    uint8_t prepareShadowAtlasTile(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData, size_t tile) const noexcept;
+
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
             FScene::RenderableSoa& renderableData, Range visibles) noexcept;
@@ -140,7 +289,15 @@ public:
 
     void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
+    void setShadowType(View::ShadowType type) noexcept {
+        mDirectionalShadowMap.setVsm(type == View::ShadowType::VSM);
+    }
+    View::ShadowType getShadowType() const noexcept {
+        return mDirectionalShadowMap.isVsm() ? View::ShadowType::VSM : View::ShadowType::PCF;
+    }
+
     ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
+    ShadowAtlas const& getShadowAtlas() const { return mShadowAtlas; }
 
     FCamera const* getDirectionalLightCamera() const noexcept {
         return &mDirectionalShadowMap.getDebugCamera();
@@ -150,6 +307,13 @@ public:
         mDiscardedTargetBuffers = discard;
     }
 
+    void setRenderTarget(FRenderTarget* renderTarget, TargetBufferFlags discard) noexcept {
+        mRenderTarget = renderTarget;
+        mDiscardedTargetBuffers = discard;
+    }
+
+    FRenderTarget* getRenderTarget() const noexcept { return mRenderTarget; }
+
     void setSampleCount(uint8_t count) noexcept {
         mSampleCount = uint8_t(count < 1u ? 1u : count);
     }
@@ -180,13 +344,90 @@ public:
         return mDynamicResolution;
     }
 
+    void setFoveatedRenderingOptions(FoveatedRenderingOptions const& options) noexcept;
+
+    FoveatedRenderingOptions getFoveatedRenderingOptions() const noexcept {
+        return mFoveatedRendering;
+    }
+
+    // fills the foveation of the color pass' RenderPassParams
+    void getFoveation(driver::RenderPassParams& params) const noexcept;
+
+    void setColorGradingOptions(ColorGradingOptions const& options) noexcept {
+        mColorGrading.setOptions(options);
+    }
+
+    ColorGradingOptions getColorGradingOptions() const noexcept {
+        return mColorGrading.getOptions();
+    }
+
+    // the lookup table of the tone mapping passes, rebaked if the options changed
+    Handle<HwTexture> updateColorGrading(driver::DriverApi& driver) {
+        return mColorGrading.update(driver);
+    }
+
+    void setAutoExposureOptions(AutoExposureOptions const& options) noexcept;
+
+    AutoExposureOptions getAutoExposureOptions() const noexcept {
+        return mAutoExposureOptions;
+    }
+
+    bool hasAutoExposure() const noexcept { return mAutoExposureOptions.enabled; }
+
+    // Swaps the auto-exposure's history with this frame's exposure and updates the time step
+    // of the adaptation, or frees its targets if it isn't used this frame. Call once per frame.
+    void prepareAutoExposure(FEngine& engine, bool enabled) noexcept;
+
+    // Valid after calling prepareAutoExposure().
+    PostProcessManager::AutoExposure const& getAutoExposure() const noexcept {
+        return mAutoExposure;
+    }
+
+    bool hasTemporalUpsampling() const noexcept {
+        return mDynamicResolution.enabled && mDynamicResolution.temporalUpsampling;
+    }
+
+    // Picks this frame's jitter and swaps the temporal upsampling's history targets, or frees
+    // them if the view isn't upsampled this frame. Call once per frame, after prepare().
+    void prepareTemporalUpsampling(FEngine& engine, bool upsampled,
+            driver::TextureFormat format) noexcept;
+
+    // Valid after calling prepareTemporalUpsampling().
+    math::float2 getTemporalJitter() const noexcept { return mTemporalJitter; }
+    PostProcessManager::TemporalUpsampling const& getTemporalUpsampling() const noexcept {
+        return mTemporalUpsampling;
+    }
+
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
 
+    void setFroxelOptions(FroxelOptions const& options) noexcept;
+
+    FroxelOptions getFroxelOptions() const noexcept {
+        return mFroxelizer.getFroxelOptions();
+    }
+
+    FroxelStatistics getFroxelStatistics() const noexcept {
+        return mFroxelizer.getStatistics();
+    }
+
+    // the culling counts are set by prepareVisibility(), the draw counts by the passes
+    RenderStatistics const& getRenderStatistics() const noexcept {
+        return mRenderStatistics;
+    }
+
+    RenderStatistics& getRenderStatistics() noexcept {
+        return mRenderStatistics;
+    }
+
     void setPostProcessingEnabled(bool enabled) noexcept {
         mHasPostProcessPass = enabled;
     }
 
     void setDepthPrepass(DepthPrepass prepass) noexcept {
+        if (prepass == DepthPrepass::AUTOMATIC && mDepthPrepass != prepass) {
+            // start from the default strategy
+            mDepthPrepassSelector = DepthPrepassSelector(DEFAULT_DEPTH_PREPASS);
+        }
         mDepthPrepass = prepass;
     }
 
@@ -194,6 +435,25 @@ public:
         return mDepthPrepass;
     }
 
+    void setSortPolicy(SortPolicy policy) noexcept {
+        mSortPolicy = policy;
+    }
+
+    SortPolicy getSortPolicy() const noexcept {
+        return mSortPolicy;
+    }
+
+    // strategy used for DepthPrepass::DEFAULT
+#ifdef ANDROID
+    static constexpr bool DEFAULT_DEPTH_PREPASS = false;
+#else
+    static constexpr bool DEFAULT_DEPTH_PREPASS = true;
+#endif
+
+    DepthPrepassSelector& getDepthPrepassSelector() noexcept {
+        return mDepthPrepassSelector;
+    }
+
     Range const& getVisibleRenderables() const noexcept {
         return mVisibleRenderables;
     }
@@ -206,9 +466,28 @@ public:
     void setCameraUser(FCamera* camera) noexcept { setCullingCamera(camera); }
 
 private:
+    // With accurate translations, the world origin follows the camera by steps of this size, in
+    // world units. Floats are still precise to a fraction of a millimeter this far from it.
+    static constexpr double WORLD_ORIGIN_STEP = 1024.0;
+
+    // builds mVisibilityGraph, the parts of prepareVisibility() that can run concurrently
+    void buildVisibilityGraph(FEngine& engine);
+
     void prepareVisibleLights(
             FLightManager& lcm, utils::JobSystem& js, FScene::LightSoa& lightData) const;
 
+    void prepareOcclusion(utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData) const noexcept;
+
+    bool isOcclusionDepthUsable() const noexcept;
+
+    void updateOcclusionDepth() noexcept;
+
+    math::mat4f getClipFromView(math::mat4f const& projection) const noexcept;
+
+    void releaseTemporalTargets(RenderTargetPool& pool) noexcept;
+    void releaseAutoExposure(driver::DriverApi& driver) noexcept;
+
     void computeVisibilityMasks(
             uint8_t visibleLayers, uint8_t const* layers,
             FRenderableManager::Visibility const* visibility, uint8_t* visibleMask,
@@ -219,10 +498,12 @@ private:
         driver.bindSamplers(BindingPoints::PER_VIEW, getUsh());
     }
 
-    // we don't inline this one, because the function is quite large and there is not much to
-    // gain from inlining.
-    static FScene::RenderableSoa::iterator partition(
-            FScene::RenderableSoa::iterator begin, FScene::RenderableSoa::iterator end, uint8_t mask) noexcept;
+    // Sorts the renderables by their VISIBLE_MASK: renderables only, then both renderables and
+    // shadow casters, then shadow casters only, then the invisible ones. Fills the end of the
+    // first three groups. We don't inline this one, because the function is quite large and
+    // there is not much to gain from inlining.
+    static void partitionByVisibility(FScene::RenderableSoa& renderableData,
+            uint32_t ends[3]) noexcept;
 
 
     // these are accessed in the render loop, keep together
@@ -236,10 +517,14 @@ private:
     Handle<HwSamplerBuffer> getUsh() const noexcept { return mPerViewSbh; }
 
     FScene* mScene = nullptr;
+    uint8_t mSceneSnapshot = 0;
     FCamera* mCullingCamera = nullptr;
     FCamera* mViewingCamera = nullptr;
+    FCamera* mEyeCameras[2] = {};
 
     CameraInfo mViewingCameraInfo;
+    CameraInfo mEyeCameraInfos[2];
+    Handle<HwUniformBuffer> mRightEyeUbh;
     Frustum mCullingFrustum;
 
     mutable Froxelizer mFroxelizer;
@@ -247,26 +532,40 @@ private:
     Viewport mViewport;
     LinearColorA mClearColor;
     bool mCulling = true;
+    bool mOcclusionCulling = false;
+    bool mOrderIndependentTransparency = false;
     bool mClearTargetColor = true;
     bool mClearTargetDepth = true;
     bool mClearTargetStencil = false;
     TargetBufferFlags mDiscardedTargetBuffers = TargetBufferFlags::ALL;
+    FRenderTarget* mRenderTarget = nullptr;     // we don't own it
     uint8_t mVisibleLayers = 0x1;
     uint8_t mSampleCount = 1;
     AntiAliasing mAntiAliasing = AntiAliasing::FXAA;
     bool mShadowingEnabled = true;
     bool mHasPostProcessPass = true;
     DepthPrepass mDepthPrepass = DepthPrepass::DEFAULT;
+    DepthPrepassSelector mDepthPrepassSelector;
+    SortPolicy mSortPolicy = SortPolicy::DEFAULT;
 
     using duration = std::chrono::duration<float, std::milli>;
     DynamicResolutionOptions mDynamicResolution;
+    FoveatedRenderingOptions mFoveatedRendering;
+    ColorGrading mColorGrading;
     std::deque<duration> mFrameTimeHistory;
 
     math::float2 mScale = 1.0f;
     float mDynamicWorkloadScale = 1.0f;
     bool mIsDynamicResolutionSupported = false;
 
+    // level of detail selected last for each renderable of mLodScene, indexed by BVH_SLOT, so
+    // that the hysteresis of a view doesn't depend on the levels selected by the other views
+    std::vector<uint8_t> mLodLevels;
+    FScene const* mLodScene = nullptr;
+    uint32_t mLodGatherCount = 0;
+
     mutable UniformBuffer mPerViewUb;
+    mutable RenderPass::CommandCache mColorPassCommandCache;
     mutable SamplerBuffer mPerViewSb;
 
     utils::CString mName;
@@ -275,10 +574,47 @@ private:
     // the following values are set by prepare()
     Range mVisibleRenderables;
     Range mVisibleShadowCasters;
+    RenderStatistics mRenderStatistics;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
     mutable bool mHasShadowing = false;
     mutable ShadowMap mDirectionalShadowMap;
+    ShadowAtlas mShadowAtlas;
+
+    // Hi-Z pyramid of the last depth buffer read back, shared with the pending read-backs
+    struct OcclusionDepth {
+        HiZBuffer hiz;
+        math::mat4f cameraModel;    // of the camera which rendered the depth buffer
+    };
+    std::shared_ptr<OcclusionDepth> mOcclusionDepth;
+
+    // the queries waiting for a frame, and the ones served by the current frame
+    std::vector<PickingQuery> mPickingQueries;
+    std::vector<PickingQuery> mServedPickingQueries;
+    Handle<HwTexture> mPickingTexture;
+    Handle<HwRenderTarget> mPickingTarget;
+
+    // culling stages, built on first use and run every frame
+    utils::JobGraph mVisibilityGraph;
+
+    // temporal upsampling, each frame's output is the next frame's history
+    RenderTargetPool::Target const* mTemporalTargets[2] = {};
+    uint32_t mTemporalFrame = 0;
+    bool mTemporalHistoryValid = false;
+    math::mat4f mTemporalClipFromWorld;     // of the history, without the jitter
+    math::float2 mTemporalJitter = {};
+    PostProcessManager::TemporalUpsampling mTemporalUpsampling;
+
+    // auto-exposure, the reductions followed by the exposures of this frame and the previous
+    static constexpr size_t AUTO_EXPOSURE_TARGET_COUNT =
+            PostProcessManager::AutoExposure::REDUCTION_COUNT + 2;
+    AutoExposureOptions mAutoExposureOptions;
+    Handle<HwTexture> mAutoExposureTextures[AUTO_EXPOSURE_TARGET_COUNT];
+    Handle<HwRenderTarget> mAutoExposureTargets[AUTO_EXPOSURE_TARGET_COUNT];
+    uint32_t mAutoExposureFrame = 0;
+    bool mAutoExposureHistoryValid = false;
+    std::chrono::steady_clock::duration mAutoExposureTime = {};
+    PostProcessManager::AutoExposure mAutoExposure;
 };
 
 FILAMENT_UPCAST(View)
@@ -46,7 +46,43 @@ CircularBuffer::CircularBuffer(size_t size) {
     mHead = mData;
 }
 
+CircularBuffer::CircularBuffer(void* data, size_t size) noexcept
+        : mSize(size), mTail(data), mHead(data) {
+    // mData stays null, we don't own this memory
+}
+
+CircularBuffer::CircularBuffer(int fd, size_t size) {
+#if HAS_MMAP
+    mData = map(fd, size);
+#endif
+    ASSERT_POSTCONDITION(mData, "couldn't map the shared CircularBuffer (%u KiB)",
+            unsigned(size / 1024));
+    mUsesAshmem = fd;
+    mSize = size;
+    mTail = mData;
+    mHead = mData;
+}
+
 CircularBuffer::~CircularBuffer() noexcept {
+    dealloc();
+}
+
+void CircularBuffer::resize(size_t size) {
+    // only buffers we own can be resized
+    assert(mData);
+    dealloc();
+#if HAS_MMAP
+    mUsesAshmem = -1;
+    mData = alloc(size);
+#else
+    mData = malloc(2 * size);
+#endif
+    mSize = size;
+    mTail = mData;
+    mHead = mData;
+}
+
+void CircularBuffer::dealloc() noexcept {
 #if HAS_MMAP
     if (mData) {
         munmap(mData, mSize * 2 + BLOCK_SIZE);
@@ -57,6 +93,7 @@ CircularBuffer::~CircularBuffer() noexcept {
 #else
     free(mData);
 #endif
+    mData = nullptr;
 }
 
 // If the system support mmap(), use it for creating a "hard circular buffer" where two virtual
@@ -73,75 +110,91 @@ void* CircularBuffer::alloc(size_t size) noexcept {
     return nullptr;
 #else
     void* data = nullptr;
-    void* vaddr = MAP_FAILED;
-    void* vaddr_shadow = MAP_FAILED;
-    void* vaddr_guard = MAP_FAILED;
     int fd = ashmem_create_region("filament::CircularBuffer", size + BLOCK_SIZE);
     if (fd >= 0) {
-        // reserve/find enough address space
-        void* reserve_vaddr = mmap(nullptr, size * 2 + BLOCK_SIZE,
-                PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (reserve_vaddr != MAP_FAILED) {
-            munmap(reserve_vaddr, size * 2 + BLOCK_SIZE);
-            // map the circular buffer once...
-            vaddr = mmap(reserve_vaddr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-            if (vaddr != MAP_FAILED) {
-                // and map the circular buffer again, behind the previous copy...
-                vaddr_shadow = mmap((char*)vaddr + size, size,
-                        PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-                if (vaddr_shadow != MAP_FAILED && (vaddr_shadow == (char*)vaddr + size)) {
-                    // finally map the guard page, to make sure we never corrupt memory
-                    vaddr_guard = mmap((char*)vaddr_shadow + size, BLOCK_SIZE, PROT_NONE,
-                            MAP_PRIVATE, fd, (off_t)size);
-                    if (vaddr_guard != MAP_FAILED && (vaddr_guard == (char*)vaddr_shadow + size)) {
-                        // woo-hoo success!
-                        mUsesAshmem = fd;
-                        data = vaddr;
-                    }
-                }
-            }
+        data = map(fd, size);
+        if (data) {
+            // woo-hoo success!
+            mUsesAshmem = fd;
+        } else {
+            close(fd);
         }
     }
 
     if (UTILS_UNLIKELY(mUsesAshmem < 0)) {
         // ashmem failed
-        if (vaddr_guard != MAP_FAILED)
-            munmap(vaddr_guard, size);
+        data = mmap(nullptr, size * 2 + BLOCK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-        if (vaddr_shadow != MAP_FAILED)
-            munmap(vaddr_shadow, size);
-
-        if (vaddr != MAP_FAILED)
-            munmap(vaddr, size);
-
-        if (fd >= 0)
-            close(fd);
-
-        data = mmap(nullptr, size * 2 + BLOCK_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-
-        ASSERT_POSTCONDITION(mData,
+        ASSERT_POSTCONDITION(data != MAP_FAILED,
                 "couldn't allocate %u KiB of memory for the command buffer",
-                (size * 2 / 1024));
+                unsigned(size * 2 / 1024));
 
         slog.d << "WARNING: Using soft CircularBuffer (" << (size*2 / 1024) << " KiB)" << io::endl;
 
         // guard page at the end
-        void* guard = (void*)(uintptr_t(mData) + size * 2);
+        void* guard = (void*)(uintptr_t(data) + size * 2);
         mprotect(guard, BLOCK_SIZE, PROT_NONE);
     }
     return data;
 #endif
 }
 
+// Maps the shared memory 'fd' twice, back to back, followed by a guard page. The mappings are
+// shared so that both alias the same pages, in this process and the ones sharing 'fd'.
+void* CircularBuffer::map(int fd, size_t size) noexcept {
+#if !HAS_MMAP
+    return nullptr;
+#else
+    // reserve/find enough address space
+    void* reserve_vaddr = mmap(nullptr, size * 2 + BLOCK_SIZE,
+            PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserve_vaddr == MAP_FAILED) {
+        return nullptr;
+    }
+    munmap(reserve_vaddr, size * 2 + BLOCK_SIZE);
+
+    void* vaddr = MAP_FAILED;
+    void* vaddr_shadow = MAP_FAILED;
+    void* vaddr_guard = MAP_FAILED;
+
+    // map the circular buffer once...
+    vaddr = mmap(reserve_vaddr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (vaddr != MAP_FAILED) {
+        // and map the circular buffer again, behind the previous copy...
+        vaddr_shadow = mmap((char*)vaddr + size, size,
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (vaddr_shadow != MAP_FAILED && (vaddr_shadow == (char*)vaddr + size)) {
+            // finally map the guard page, to make sure we never corrupt memory
+            vaddr_guard = mmap((char*)vaddr_shadow + size, BLOCK_SIZE, PROT_NONE,
+                    MAP_SHARED, fd, (off_t)size);
+            if (vaddr_guard != MAP_FAILED && (vaddr_guard == (char*)vaddr_shadow + size)) {
+                return vaddr;
+            }
+        }
+    }
+
+    if (vaddr_guard != MAP_FAILED)
+        munmap(vaddr_guard, BLOCK_SIZE);
+
+    if (vaddr_shadow != MAP_FAILED)
+        munmap(vaddr_shadow, size);
+
+    if (vaddr != MAP_FAILED)
+        munmap(vaddr, size);
+
+    return nullptr;
+#endif
+}
+
 void CircularBuffer::circularize() noexcept {
-    if (mUsesAshmem > 0) {
+    if (mUsesAshmem >= 0) {
         intptr_t overflow = intptr_t(mHead) - (intptr_t(mData) + ssize_t(mSize));
         if (overflow >= 0) {
+            // the overflow was written through the second mapping, it's already at the
+            // beginning of the first one (and still to be read)
             assert(size_t(overflow) <= mSize);
             mHead = (void *) (intptr_t(mData) + overflow);
-            #ifndef NDEBUG
-            memset(mData, 0xA5, size_t(overflow));
-            #endif
         }
     } else {
         // Only circularize if mHead if in the second buffer.
@@ -37,6 +37,14 @@ public:
     //      to set it to 3*requiredSize to avoid blocking the render thread (usually the UI thread).
     explicit CircularBuffer(size_t bufferSize);
 
+    // wraps 'size' bytes of linear memory owned by someone else, typically a range reserved
+    // in another CircularBuffer. Such a buffer is never circularized.
+    CircularBuffer(void* data, size_t size) noexcept;
+
+    // maps the shared memory of a CircularBuffer created by another process, see
+    // getFileDescriptor(); 'size' must be the size of that buffer. Takes ownership of 'fd'.
+    CircularBuffer(int fd, size_t size);
+
     // can't be moved or copy-constructed
     CircularBuffer(CircularBuffer const& rhs) = delete;
     CircularBuffer(CircularBuffer&& rhs) noexcept = delete;
@@ -63,17 +71,30 @@ public:
 
     void* getTail() const noexcept { return mTail; }
 
+    // Beginning of the first mapping of the buffer. The same offsets from it designate the same
+    // bytes in every process sharing the buffer.
+    void* getData() const noexcept { return mData; }
+
+    // file descriptor of the shared memory behind the buffer, which can be sent to another
+    // process (e.g. over a UNIX domain socket), or -1 if it isn't backed by shared memory
+    int getFileDescriptor() const noexcept { return mUsesAshmem; }
+
     // call at least once every getRequiredSize() bytes allocated from the buffer
     void circularize() noexcept;
 
+    // reallocates the buffer with a new size, its content is lost
+    void resize(size_t bufferSize);
+
 private:
     void* alloc(size_t size) noexcept;
+    static void* map(int fd, size_t size) noexcept;
+    void dealloc() noexcept;
 
-    // pointer to the beginning of the circular buffer (constant)
+    // pointer to the beginning of the circular buffer (constant, unless resized)
     void* mData = nullptr;
     int mUsesAshmem = -1;
 
-    // size of the circular buffer (constant)
+    // size of the circular buffer (constant, unless resized)
     size_t mSize = 0;
 
     // pointer to the beginning of recorded data
@@ -16,7 +16,10 @@
 
 #include "driver/CommandBufferQueue.h"
 
+#include <algorithm>
+
 #include <assert.h>
+#include <stdlib.h>
 
 #include <utils/Log.h>
 #include <utils/Systrace.h>
@@ -35,13 +38,47 @@ CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize)
 }
 
 CommandBufferQueue::~CommandBufferQueue() {
-    assert(!mCommandBuffersToExecute.size());
+    assert(mWriteIndex.load() == mReadIndex.load());
 }
 
-void CommandBufferQueue::requestExit() {
+void CommandBufferQueue::wake(bool waiting) const noexcept {
+    // This pairs with the waiting thread setting its flag before re-checking its predicate:
+    // either it sees our update, or we see its flag. When we do, taking the lock guarantees
+    // it's either inside wait() or hasn't checked its predicate yet.
+    if (UTILS_UNLIKELY(waiting)) {
+        std::lock_guard<utils::Mutex> lock(mLock);
+        mCondition.notify_all();
+    }
+}
+
+template<typename P>
+void CommandBufferQueue::waitProducer(P&& pred) noexcept {
     std::unique_lock<utils::Mutex> lock(mLock);
-    mExitRequested = true;
-    mCondition.notify_one();
+    mProducersWaiting.fetch_add(1);
+    mCondition.wait(lock, std::forward<P>(pred));
+    mProducersWaiting.fetch_sub(1);
+}
+
+void CommandBufferQueue::requestExit() {
+    mExitRequested.store(true);
+    wake(mConsumerWaiting.load());
+}
+
+void CommandBufferQueue::push(Slice const& slice) noexcept {
+    std::lock_guard<utils::Mutex> guard(mProducerLock);
+    if (UTILS_UNLIKELY(!hasFreeSlice())) {
+        // only the slices submitted by other threads can get us here
+        SYSTRACE_NAME("waiting: CommandBufferQueue::push()");
+        waitProducer([this]() -> bool { return hasFreeSlice(); });
+    }
+    const uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    mSlices[writeIndex % SLICE_COUNT] = slice;
+    mWriteIndex.store(writeIndex + 1);
+}
+
+void CommandBufferQueue::submit(void* block, void* end) noexcept {
+    push({ block, end, block });
+    wake(mConsumerWaiting.load());
 }
 
 void CommandBufferQueue::flush() noexcept {
@@ -67,56 +104,90 @@ void CommandBufferQueue::flush() noexcept {
 
     circularBuffer.circularize();
 
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mCommandBuffersToExecute.push_back({ tail, head });
-
     // circular buffer is too small, we corrupted the stream
-    assert(used <= mFreeSpace);
+    assert(used <= mFreeSpace.load());
+
+    // the space is taken before the Slice can be seen, and released, by the consumer
+    const size_t freeSpace = mFreeSpace.fetch_sub(used) - used;
+    push({ tail, head, nullptr });
+    wake(mConsumerWaiting.load());
 
-    // wait until there is enough space in the buffer
-    mFreeSpace -= used;
-    const size_t requiredSize = mRequiredSize;
+    mSliceHighWatermark = std::max(mSliceHighWatermark, size_t(used));
+    mFlushedSize += used;
 
 #ifndef NDEBUG
-    size_t totalUsed = circularBuffer.size() - mFreeSpace;
+    size_t totalUsed = circularBuffer.size() - freeSpace;
     mHighWatermark = std::max(mHighWatermark, totalUsed);
-    if (UTILS_UNLIKELY(totalUsed > requiredSize)) {
+    if (UTILS_UNLIKELY(totalUsed > mRequiredSize)) {
         slog.d << "CommandStream used too much space: " << totalUsed
-            << ", out of " << requiredSize << " (will block)" << io::endl;
+            << ", out of " << mRequiredSize << " (will block)" << io::endl;
     }
+#else
+    (void)freeSpace;
 #endif
 
-    if (UTILS_LIKELY(mFreeSpace >= requiredSize)) {
-        // ideally (and usually) we don't have to wait, this is the common case, so special case
-        // the unlock-before-notify, optimization.
-        lock.unlock();
-        mCondition.notify_one();
-    } else {
-        // unfortunately, there is not enough space left, we'll have to wait.
-        mCondition.notify_one(); // too bad there isn't a notify-and-wait
+    if (UTILS_LIKELY(canFlush())) {
+        // ideally (and usually) we don't have to wait, this is the common case
+        return;
+    }
+
+    { // unfortunately, there is not enough space left, we'll have to wait.
         SYSTRACE_NAME("waiting: CircularBuffer::flush()");
-        mCondition.wait(lock, [this, requiredSize]() -> bool {
-            return mFreeSpace >= requiredSize;
-        });
+        const auto start = std::chrono::steady_clock::now();
+        waitProducer([this]() -> bool { return canFlush(); });
+        mStallTime += std::chrono::steady_clock::now() - start;
+    }
+}
+
+void CommandBufferQueue::resize(size_t requiredSize, size_t bufferSize) {
+    SYSTRACE_CALL();
+
+    flush();
+
+    { // wait until all the buffers are released
+        SYSTRACE_NAME("waiting: CommandBufferQueue::resize()");
+        const size_t size = mCircularBuffer.size();
+        waitProducer([this, size]() -> bool { return mFreeSpace.load() == size; });
     }
+
+    mRequiredSize = (requiredSize + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK;
+    mCircularBuffer.resize(bufferSize);
+    assert(mCircularBuffer.size() > mRequiredSize);
+    mFreeSpace.store(mCircularBuffer.size());
+    resetWatermarks();
 }
 
 std::vector<CommandBufferQueue::Slice> CommandBufferQueue::waitForCommands() const {
-    if (!UTILS_HAS_THREADING) {
-        return std::move(mCommandBuffersToExecute);
+    if (UTILS_HAS_THREADING && !hasCommands()) {
+        SYSTRACE_NAME("waiting: CommandBufferQueue::waitForCommands()");
+        std::unique_lock<utils::Mutex> lock(mLock);
+        mConsumerWaiting.store(true);
+        mCondition.wait(lock, [this]() -> bool { return hasCommands(); });
+        mConsumerWaiting.store(false);
     }
-    std::unique_lock<utils::Mutex> lock(mLock);
-    while (mCommandBuffersToExecute.empty() && !mExitRequested) {
-        mCondition.wait(lock);
+
+    const uint32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+    const uint32_t writeIndex = mWriteIndex.load();
+    std::vector<Slice> slices;
+    slices.reserve(writeIndex - readIndex);
+    for (uint32_t i = readIndex; i != writeIndex; i++) {
+        slices.push_back(mSlices[i % SLICE_COUNT]);
     }
-    return std::move(mCommandBuffersToExecute);
+
+    // the Slices are copied, the producers can reuse their entries
+    mReadIndex.store(writeIndex);
+    wake(mProducersWaiting.load() != 0);
+    return slices;
 }
 
 void CommandBufferQueue::releaseBuffer(CommandBufferQueue::Slice const& buffer) {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mFreeSpace += uintptr_t(buffer.end) - uintptr_t(buffer.begin);
-    lock.unlock();
-    mCondition.notify_one();
+    if (buffer.block) {
+        // submitted, this wasn't in the CircularBuffer
+        free(buffer.block);
+        return;
+    }
+    mFreeSpace.fetch_add(uintptr_t(buffer.end) - uintptr_t(buffer.begin));
+    wake(mProducersWaiting.load() != 0);
 }
 
 } // namespace filament
@@ -23,31 +23,98 @@
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 
 namespace filament {
 
 /*
- * A producer-consumer command queue that uses a CircularBuffer as main storage
+ * A single-producer / single-consumer command queue that uses a CircularBuffer as main storage.
+ *
+ * The producer (flush()) and the consumer (waitForCommands() / releaseBuffer()) only communicate
+ * through atomics, there is no lock on the fast path. The lock and condition are only used to
+ * sleep, and are only touched by the other side when it knows a thread is sleeping on them;
+ * this way a thread descheduled while in the queue can never stall the other one.
+ */
+/*
+ * CommandBufferQueue hands the commands written to its CircularBuffer over to the consumer (the
+ * driver thread), in Slices delimited by flush().
+ *
+ * The CircularBuffer has a single producer, but commands recorded elsewhere -- e.g. by a loader
+ * thread, see FEngine::attachLoaderThread() -- can be queued with submit() from any thread.
+ * The consumer gets all the Slices in the order they were flushed or submitted.
  */
 class CommandBufferQueue {
     struct Slice {
         void* begin;
         void* end;
+        void* block;    // memory of a submitted Slice, freed once released, null otherwise
     };
 
-    const size_t mRequiredSize;
+    // maximum number of Slices flushed but not yet picked up by waitForCommands(), the
+    // producer waits when there are this many.
+    static constexpr size_t SLICE_COUNT = 64;
+
+    size_t mRequiredSize;
 
     CircularBuffer mCircularBuffer;
 
+    // ring of Slices not yet picked up by the consumer. mWriteIndex is only written with
+    // mProducerLock held, mReadIndex only by the consumer, both increase monotonically.
+    Slice mSlices[SLICE_COUNT];
+    std::atomic<uint32_t> mWriteIndex = { 0 };
+    mutable std::atomic<uint32_t> mReadIndex = { 0 };
+
     // space available in the circular buffer
+    std::atomic<size_t> mFreeSpace = { 0 };
+
+    std::atomic<bool> mExitRequested = { false };
+
+    // set while the respective threads are (about to be) sleeping on mCondition, there can be
+    // several producers waiting: the one of the CircularBuffer and those calling submit()
+    std::atomic<uint32_t> mProducersWaiting = { 0 };
+    mutable std::atomic<bool> mConsumerWaiting = { false };
+
+    // serializes the writes of mSlices and mWriteIndex
+    utils::Mutex mProducerLock;
 
     mutable utils::Mutex mLock;
     mutable utils::Condition mCondition;
-    mutable std::vector<Slice> mCommandBuffersToExecute;
-    size_t mFreeSpace = 0;
+
     size_t mHighWatermark = 0;
-    bool mExitRequested = false;
+
+    // size of the largest flush() so far
+    size_t mSliceHighWatermark = 0;
+
+    // time the producer spent waiting for space, since the last call to takeStallTime()
+    std::chrono::steady_clock::duration mStallTime{};
+
+    // bytes flushed by the producer since the last call to takeFlushedSize()
+    size_t mFlushedSize = 0;
+
+    bool hasFreeSlice() const noexcept {
+        return mWriteIndex.load() - mReadIndex.load() < SLICE_COUNT;
+    }
+
+    bool canFlush() const noexcept {
+        return mFreeSpace.load() >= mRequiredSize && hasFreeSlice();
+    }
+
+    // queues a Slice, waits for a free entry first if needed
+    void push(Slice const& slice) noexcept;
+
+    // waits until pred() is true, on a producer thread
+    template<typename P>
+    void waitProducer(P&& pred) noexcept;
+
+    bool hasCommands() const noexcept {
+        return mWriteIndex.load() != mReadIndex.load(std::memory_order_relaxed) ||
+               mExitRequested.load();
+    }
+
+    // wakes-up the other side, if it's waiting
+    void wake(bool waiting) const noexcept;
 
 public:
     // requiredSize: guaranteed available space after flush()
@@ -58,6 +125,35 @@ public:
 
     size_t getHigWatermark() noexcept { return mHighWatermark; }
 
+    size_t getSliceHighWatermark() const noexcept { return mSliceHighWatermark; }
+
+    size_t getRequiredSize() const noexcept { return mRequiredSize; }
+
+    void resetWatermarks() noexcept {
+        mHighWatermark = 0;
+        mSliceHighWatermark = 0;
+    }
+
+    // Flushes, waits for the consumer to release all the buffers and reallocates the
+    // CircularBuffer, which must not be written to by anyone else during this call.
+    // This can only be called from the producer when the consumer runs on its own thread.
+    void resize(size_t requiredSize, size_t bufferSize);
+
+    // returns the time flush() spent blocked since the last call, must be called by the producer
+    std::chrono::steady_clock::duration takeStallTime() noexcept {
+        auto stallTime = mStallTime;
+        mStallTime = {};
+        return stallTime;
+    }
+
+    // returns the size of the commands flush() queued since the last call, must be called by
+    // the producer
+    size_t takeFlushedSize() noexcept {
+        const size_t size = mFlushedSize;
+        mFlushedSize = 0;
+        return size;
+    }
+
     // wait for commands to be available and returns an array containing these commands
     std::vector<Slice> waitForCommands() const;
 
@@ -70,6 +166,11 @@ public:
     // call blocks until the CircularBuffer has at least mRequiredSize bytes available.
     void flush() noexcept;
 
+    // Queues the commands of 'block' up to 'end', they must end with a NoopCommand(nullptr).
+    // 'block' must have been allocated with malloc(), it's freed once the commands have been
+    // executed. This can be called from any thread.
+    void submit(void* block, void* end) noexcept;
+
     // returns from waitForcommands() immediately.
     void requestExit();
 };
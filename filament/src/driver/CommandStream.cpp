@@ -18,11 +18,15 @@
 
 #include <utils/CallStack.h>
 #include <utils/Log.h>
+#include <utils/memalign.h>
 #include <utils/Profiler.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
 #include <functional>
 
+#include <string.h>
+
 namespace filament {
 
 using namespace utils;
@@ -60,6 +64,27 @@ CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer) noexcept
 {
 }
 
+CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer,
+        Dispatcher* dispatcher) noexcept
+        : mDispatcher(dispatcher),
+          mDriver(&driver),
+          mCurrentBuffer(&buffer)
+#ifndef NDEBUG
+          , mThreadId(std::this_thread::get_id())
+#endif
+{
+}
+
+CommandStream::CommandStream(CommandStream const& parent, CircularBuffer& buffer) noexcept
+        : mDispatcher(parent.mDispatcher),
+          mDriver(parent.mDriver),
+          mCurrentBuffer(&buffer)
+#ifndef NDEBUG
+          , mThreadId(std::this_thread::get_id())
+#endif
+{
+}
+
 void CommandStream::execute(void* buffer) {
     SYSTRACE_CALL();
     Profiler::Counters c0;
@@ -95,8 +120,66 @@ void CommandStream::execute(void* buffer) {
     }
 }
 
-void CommandStream::queueCommand(std::function<void()> command) {
-    new(allocateCommand(CustomCommand::align(sizeof(CustomCommand)))) CustomCommand(command);
+void* CommandStream::reserveSegments(JobSystem& js, size_t const* offsets,
+        size_t count) noexcept {
+    assert(count <= SegmentsCommand::MAX_SEGMENTS);
+    // we can't know what will be bound after the segments have executed
+    mState.reset();
+    // Commands dispatched elsewhere than to the driver (e.g. recorded) must run in order.
+    JobSystem* const jobSystem = mDispatcher == &mDriver->getDispatcher() ? &js : nullptr;
+    const size_t size = CommandBase::align(sizeof(SegmentsCommand));
+    char* const p = (char*)allocateCommand(size + CommandBase::align(offsets[count]));
+    new(p) SegmentsCommand(jobSystem, offsets, count);
+    return p + size;
+}
+
+CommandBundle::~CommandBundle() noexcept {
+    utils::aligned_free(mData);
+}
+
+void* CommandBundle::reserve(size_t capacity) noexcept {
+    mSize = 0;
+    mSegmentCount = 0;
+    if (capacity > mCapacity) {
+        utils::aligned_free(mData);
+        mCapacity = std::max(capacity, mCapacity * 2);
+        mData = utils::aligned_alloc(mCapacity, alignof(std::max_align_t));
+    }
+    return mData;
+}
+
+void CommandBundle::reserveSegments(CommandStream const& parent, size_t const* offsets,
+        size_t count) noexcept {
+    assert(count && count <= SegmentsCommand::MAX_SEGMENTS);
+    reserve(offsets[count]);
+    mDispatcher = parent.mDispatcher;
+    std::copy_n(offsets, count + 1, mOffsets);
+    mSegmentCount = count;
+    mSize = offsets[count];
+}
+
+void CommandBundle::replay(CommandStream& stream, JobSystem& js) const noexcept {
+    if (!mSize) {
+        return;
+    }
+    if (mSegmentCount) {
+        // The segments are handed to the driver by the SegmentsCommand preceding them, e.g. to
+        // be executed in parallel. Each one ends with a jump(nullptr), which is relative to its
+        // own address, so it's written after the copy.
+        char* const p = static_cast<char*>(stream.reserveSegments(js, mOffsets, mSegmentCount));
+        for (size_t i = 0; i < mSegmentCount; i++) {
+            char* const segment = p + mOffsets[i];
+            memcpy(segment, static_cast<char const*>(mData) + mOffsets[i], mSegmentSizes[i]);
+            new(segment + mSegmentSizes[i]) NoopCommand(nullptr);
+        }
+        return;
+    }
+    // the commands only refer to each other by relative offsets, so they can be moved
+    // around, then the copy resumes after itself
+    const size_t size = mSize + CommandBase::align(sizeof(NoopCommand));
+    char* const p = static_cast<char*>(stream.reserve(size));
+    memcpy(p, mData, mSize);
+    new(p + mSize) NoopCommand(p + size);
 }
 
 template<typename... ARGS>
@@ -134,10 +217,30 @@ void CommandType<void (Driver::*)(ARGS...)>::Command<METHOD>::log() noexcept  {
 
 // ------------------------------------------------------------------------------------------------
 
-void CustomCommand::execute(Driver&, CommandBase* base, intptr_t* next) noexcept {
-    *next = CustomCommand::align(sizeof(CustomCommand));
-    static_cast<CustomCommand*>(base)->mCommand();
-    static_cast<CustomCommand*>(base)->~CustomCommand();
+SegmentsCommand::SegmentsCommand(JobSystem* js, size_t const* offsets, size_t count) noexcept
+        : CommandBase(execute), mJobSystem(js), mCount(uint32_t(count)) {
+    for (size_t i = 0; i < count; i++) {
+        mOffsets[i] = uint32_t(offsets[i]);
+    }
+    mNext = intptr_t(align(sizeof(SegmentsCommand)) + align(offsets[count]));
+}
+
+void SegmentsCommand::execute(Driver& driver, CommandBase* base, intptr_t* next) noexcept {
+    SegmentsCommand* self = static_cast<SegmentsCommand*>(base);
+    *next = self->mNext;
+    char* const first = reinterpret_cast<char*>(self) + align(sizeof(SegmentsCommand));
+    CommandBase* segments[MAX_SEGMENTS];
+    for (size_t i = 0; i < self->mCount; i++) {
+        segments[i] = reinterpret_cast<CommandBase*>(first + self->mOffsets[i]);
+    }
+    if (self->mJobSystem) {
+        driver.executeSegments(*self->mJobSystem, segments, self->mCount);
+    } else {
+        // executes the segments like Driver's default executeSegments()
+        for (size_t i = 0; i < self->mCount; i++) {
+            for (CommandBase* c = segments[i]; c; c = c->execute(driver)) { }
+        }
+    }
 }
 
 } // namespace filament
@@ -210,10 +313,11 @@ io::ostream& operator<<(io::ostream& out, ElementType type) {
     return out;
 }
 
-io::ostream& operator<<(io::ostream& out, Usage usage) {
+io::ostream& operator<<(io::ostream& out, BufferUsage usage) {
     switch (usage) {
-        CASE(Usage, STATIC)
-        CASE(Usage, DYNAMIC)
+        CASE(BufferUsage, STATIC)
+        CASE(BufferUsage, DYNAMIC)
+        CASE(BufferUsage, STREAM)
     }
     return out;
 }
@@ -234,6 +338,8 @@ io::ostream& operator<<(io::ostream& out, SamplerType type) {
         CASE(SamplerType, SAMPLER_2D)
         CASE(SamplerType, SAMPLER_CUBEMAP)
         CASE(SamplerType, SAMPLER_EXTERNAL)
+        CASE(SamplerType, SAMPLER_2D_ARRAY)
+        CASE(SamplerType, SAMPLER_3D)
     }
     return out;
 }
@@ -364,6 +470,10 @@ io::ostream& operator<<(io::ostream& out, TextureFormat format) {
         CASE(TextureFormat, DXT1_RGBA)
         CASE(TextureFormat, DXT3_RGBA)
         CASE(TextureFormat, DXT5_RGBA)
+        CASE(TextureFormat, RGBA_BPTC_UNORM)
+        CASE(TextureFormat, SRGB_ALPHA_BPTC_UNORM)
+        CASE(TextureFormat, RGB_BPTC_SIGNED_FLOAT)
+        CASE(TextureFormat, RGB_BPTC_UNSIGNED_FLOAT)
     }
     return out;
 }
@@ -557,7 +667,9 @@ io::ostream& operator<<(io::ostream& out, filament::driver::RenderPassParams con
         << ", height=" << params.height
         << ", clearColor=" << params.clearColor
         << ", clearDepth=" << params.clearDepth
-        << ", clearStencil=" << params.clearStencil << "}";
+        << ", clearStencil=" << params.clearStencil
+        << ", foveaGain=" << params.foveaGain
+        << ", focalPointCount=" << params.focalPointCount << "}";
     return out;
 }
 
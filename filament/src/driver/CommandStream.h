@@ -19,17 +19,20 @@
 
 #include "driver/CircularBuffer.h"
 #include "driver/Driver.h"
+#include "driver/Program.h"
 
 #include <utils/compiler.h>
 
 #include <functional>
 #include <tuple>
 #include <thread>
+#include <type_traits>
 #include <utility>
 
 #include <assert.h>
 #include <cstddef>
 #include <stdint.h>
+#include <string.h>
 
 // Set to true to print every commands out on log.d. This requires RTTI and DEBUG
 #define DEBUG_COMMAND_STREAM false
@@ -56,6 +59,9 @@ public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                     Execute methodName##_;
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     Execute methodName##_;
 #include "driver/DriverAPI.inc"
+
+    // executes a PackedCommands run, the commands aren't packed if this is null
+    Execute packed_ = nullptr;
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -80,7 +86,9 @@ public:
         // of return value -- it allows the compiler to perform the tail call optimization.
         intptr_t next;
         mExecute(driver, this, &next);
-        return reinterpret_cast<CommandBase*>(reinterpret_cast<char*>(this) + next);
+        // The offset is added to the address as an integer: a jump to nullptr gives back null,
+        // which the compiler could otherwise assume pointer arithmetic never does.
+        return reinterpret_cast<CommandBase*>(reinterpret_cast<intptr_t>(this) + next);
     }
 
     inline ~CommandBase() noexcept = default;
@@ -127,6 +135,12 @@ struct CommandType<void (Driver::*)(ARGS...)> {
         void log() noexcept;
         template<std::size_t... I> void log(std::index_sequence<I...>) noexcept;
 
+        template<typename W, std::size_t... I>
+        inline void record(W& writer, std::index_sequence<I...>) const noexcept {
+            using expand = int[];
+            (void)expand{ 0, (writer.write(std::get<I>(mArgs)), 0)... };
+        }
+
     public:
         template<typename M, typename D>
         static inline void execute(M&& method, D&& driver, CommandBase* base, intptr_t* next) noexcept {
@@ -140,6 +154,12 @@ struct CommandType<void (Driver::*)(ARGS...)> {
             self->~Command();
         }
 
+        // writes each argument of this command with writer.write(), see CommandTraceRecorder
+        template<typename W>
+        inline void record(W& writer) const noexcept {
+            record(writer, std::make_index_sequence<std::tuple_size<SavedParameters>::value>{});
+        }
+
         // A command can be moved
         inline explicit Command(Command&& rhs) = default;
 
@@ -158,13 +178,23 @@ struct CommandType<void (Driver::*)(ARGS...)> {
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+ * CustomCommand runs a callable stored in place in the command stream, so its captures don't
+ * need an allocation. Its size depends on the callable, see CommandStream::queueCommand().
+ */
+template<typename F>
 class CustomCommand : public CommandBase {
-    std::function<void()> mCommand;
-    static void execute(Driver&, CommandBase* self, intptr_t* next) noexcept;
+    F mCommand;
+    static void execute(Driver&, CommandBase* base, intptr_t* next) noexcept {
+        *next = CommandBase::align(sizeof(CustomCommand));
+        CustomCommand* const self = static_cast<CustomCommand*>(base);
+        self->mCommand();
+        self->~CustomCommand();
+    }
 public:
-    inline explicit CustomCommand(CustomCommand&& rhs) = default;
-    inline CustomCommand(const std::function<void()>& cmd)
-            : CommandBase(execute), mCommand(cmd) { }
+    template<typename T>
+    inline explicit CustomCommand(T&& command)
+            : CommandBase(execute), mCommand(std::forward<T>(command)) { }
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -181,6 +211,120 @@ public:
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+ * SegmentsCommand precedes segments of the stream filled concurrently by secondary streams (see
+ * CommandStream::reserveSegments()) and hands them to Driver::executeSegments(), which may
+ * execute them in parallel. Execution resumes after the last segment.
+ */
+class SegmentsCommand : public CommandBase {
+public:
+    static constexpr size_t MAX_SEGMENTS = 8;
+
+    // 'offsets' are the count + 1 boundaries of the segments, relative to the end of this command
+    SegmentsCommand(utils::JobSystem* js, size_t const* offsets, size_t count) noexcept;
+
+private:
+    static void execute(Driver& driver, CommandBase* self, intptr_t* next) noexcept;
+
+    // null if the segments must be executed in order on the driver thread
+    utils::JobSystem* mJobSystem;
+    uint32_t mCount;
+    uint32_t mOffsets[MAX_SEGMENTS];
+    intptr_t mNext;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * PackedCommands holds a run of the most frequent commands -- draws and bindings -- in a compact
+ * encoding: each one is an 8-bit opcode followed by its arguments, without padding and with
+ * 32-bit handle ids. The RasterStates of the draws are stored once in the header of the run and
+ * referred to by index. The whole run is a single command of the stream, executed by the
+ * dispatcher's packed_ function, and it grows until something else is written to the stream
+ * (see CommandStream::openPacked()).
+ */
+class PackedCommands : public CommandBase {
+public:
+    enum class Op : uint8_t {
+        BIND_UNIFORMS,          // index:8, ubh:32
+        BIND_UNIFORMS_RANGE,    // index:8, ubh:32, offset:32, size:32
+        BIND_SAMPLERS,          // index:8, sbh:32
+        DRAW,                   // rs index:8, ph:32, rph:32, [rs:32]
+        DRAW_INSTANCED,         // rs index:8, ph:32, rph:32, [rs:32], instanceCount:32
+    };
+
+    static constexpr size_t MAX_RASTER_STATES = 4;
+
+    // index of a RasterState that isn't in the table, it follows the handles of the draw
+    static constexpr uint8_t INLINE_RASTER_STATE = 0xFF;
+
+    // upper bound of the size of a run, on top of the commands it holds
+    static constexpr size_t getMaxOverhead() noexcept {
+        return sizeof(PackedCommands) + align(1) - 1;
+    }
+
+    explicit PackedCommands(Execute execute) noexcept : CommandBase(execute) { }
+
+    // size of this run in the stream
+    size_t getSize() const noexcept { return align(sizeof(PackedCommands) + mSize); }
+
+    // reserves 'size' bytes at the end of the run, the stream must be grown accordingly
+    uint8_t* append(size_t size) noexcept {
+        uint8_t* const p = data() + mSize;
+        mSize += uint32_t(size);
+        return p;
+    }
+
+    uint8_t const* begin() const noexcept { return data(); }
+    uint8_t const* end() const noexcept { return data() + mSize; }
+
+    // returns the index of 'rs' in the table, adding it if there is room
+    uint8_t getRasterStateIndex(Driver::RasterState rs) noexcept {
+        for (size_t i = 0; i < mRasterStateCount; i++) {
+            if (mRasterStates[i] == rs) {
+                return uint8_t(i);
+            }
+        }
+        if (mRasterStateCount < MAX_RASTER_STATES) {
+            mRasterStates[mRasterStateCount] = rs;
+            return mRasterStateCount++;
+        }
+        return INLINE_RASTER_STATE;
+    }
+
+    Driver::RasterState getRasterState(uint8_t index) const noexcept {
+        assert(index < mRasterStateCount);
+        return mRasterStates[index];
+    }
+
+    // the commands are written and read unaligned
+    template<typename T>
+    static uint8_t* write(uint8_t* p, T const& v) noexcept {
+        memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+
+    template<typename T>
+    static uint8_t const* read(uint8_t const* p, T& v) noexcept {
+        memcpy(&v, p, sizeof(T));
+        return p + sizeof(T);
+    }
+
+private:
+    uint8_t* data() noexcept {
+        return reinterpret_cast<uint8_t*>(this) + sizeof(PackedCommands);
+    }
+    uint8_t const* data() const noexcept {
+        return reinterpret_cast<uint8_t const*>(this) + sizeof(PackedCommands);
+    }
+
+    uint32_t mSize = 0;     // bytes of commands following this header
+    uint8_t mRasterStateCount = 0;
+    Driver::RasterState mRasterStates[MAX_RASTER_STATES];
+};
+
+// ------------------------------------------------------------------------------------------------
+
 template<typename ConcreteDriver>
 class ConcreteDispatcher final : public Dispatcher {
 public:
@@ -190,8 +334,61 @@ public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                 methodName##_ = methodName;
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) methodName##_ = methodName;
 #include "driver/DriverAPI.inc"
+        packed_ = packed;
     }
 private:
+    static void packed(Driver& driver, CommandBase* base, intptr_t* next) {
+        using Op = PackedCommands::Op;
+        using HandleId = HandleBase::HandleId;
+        ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);
+        PackedCommands const* const self = static_cast<PackedCommands const*>(base);
+        *next = self->getSize();
+        uint8_t const* p = self->begin();
+        uint8_t const* const end = self->end();
+        while (p != end) {
+            Op op;
+            uint8_t index;
+            HandleId id;
+            p = PackedCommands::read(p, op);
+            p = PackedCommands::read(p, index);
+            p = PackedCommands::read(p, id);
+            switch (op) {
+                case Op::BIND_UNIFORMS:
+                    concreteDriver.bindUniforms(index, Driver::UniformBufferHandle(id));
+                    break;
+                case Op::BIND_UNIFORMS_RANGE: {
+                    uint32_t offset, size;
+                    p = PackedCommands::read(p, offset);
+                    p = PackedCommands::read(p, size);
+                    concreteDriver.bindUniformsRange(index, Driver::UniformBufferHandle(id),
+                            offset, size);
+                    break;
+                }
+                case Op::BIND_SAMPLERS:
+                    concreteDriver.bindSamplers(index, Driver::SamplerBufferHandle(id));
+                    break;
+                case Op::DRAW:
+                case Op::DRAW_INSTANCED: {
+                    HandleId rph;
+                    Driver::RasterState rs;
+                    uint32_t instanceCount = 1;
+                    p = PackedCommands::read(p, rph);
+                    if (index == PackedCommands::INLINE_RASTER_STATE) {
+                        p = PackedCommands::read(p, rs);
+                    } else {
+                        rs = self->getRasterState(index);
+                    }
+                    if (op == Op::DRAW_INSTANCED) {
+                        p = PackedCommands::read(p, instanceCount);
+                    }
+                    concreteDriver.draw(Driver::ProgramHandle(id), rs,
+                            Driver::RenderPrimitiveHandle(rph), instanceCount);
+                    break;
+                }
+            }
+        }
+    }
+
 #define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
     static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
@@ -220,13 +417,207 @@ private:
     #define DEBUG_COMMAND(methodName, params...) mDriver->debugCommand(#methodName)
 #endif
 
+/*
+ * CommandStreamState tracks the bindings recorded in a CommandStream, so that binding commands
+ * that wouldn't change anything are dropped before they're even encoded.
+ *
+ * This is conservative: everything is forgotten by the commands after which the driver's
+ * bindings could be different from what was recorded (e.g. starting a render pass or
+ * destroying a buffer whose handle could then be reused), and when a range of the stream is
+ * reserved to be recorded by a secondary stream.
+ */
+class CommandStreamState {
+public:
+    // each of these returns false if the command is redundant
+    bool bindUniforms(size_t index, Driver::UniformBufferHandle ubh) noexcept {
+        return bindUniformsRange(index, ubh, 0, WHOLE_BUFFER);
+    }
+
+    bool bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+            size_t offset, size_t size) noexcept {
+        if (UTILS_UNLIKELY(!ubh || index >= Program::NUM_UNIFORM_BINDINGS)) {
+            return true;
+        }
+        UniformBinding& binding = mUniforms[index];
+        if (binding.id == ubh.getId() && binding.offset == offset && binding.size == size) {
+            mEliminatedCount++;
+            return false;
+        }
+        binding = { ubh.getId(), offset, size };
+        return true;
+    }
+
+    bool bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) noexcept {
+        if (UTILS_UNLIKELY(!sbh || index >= Program::NUM_SAMPLER_BINDINGS)) {
+            return true;
+        }
+        SamplerBinding& binding = mSamplers[index];
+        if (binding.id == sbh.getId()) {
+            mEliminatedCount++;
+            return false;
+        }
+        binding.id = sbh.getId();
+        return true;
+    }
+
+    bool setViewportScissor(int32_t left, int32_t bottom,
+            uint32_t width, uint32_t height) noexcept {
+        Scissor& s = mScissor;
+        if (s.known && s.left == left && s.bottom == bottom &&
+                s.width == width && s.height == height) {
+            mEliminatedCount++;
+            return false;
+        }
+        s = { left, bottom, width, height, true };
+        return true;
+    }
+
+    bool setPolygonOffset(float slope, float constant) noexcept {
+        PolygonOffset& o = mPolygonOffset;
+        if (o.known && o.slope == slope && o.constant == constant) {
+            mEliminatedCount++;
+            return false;
+        }
+        o = { slope, constant, true };
+        return true;
+    }
+
+    // forget all bindings
+    void reset() noexcept {
+        *this = CommandStreamState{ mEliminatedCount };
+    }
+
+    // number of commands dropped so far
+    uint32_t getEliminatedCount() const noexcept { return mEliminatedCount; }
+
+    CommandStreamState() noexcept = default;
+
+private:
+    static constexpr size_t WHOLE_BUFFER = ~size_t(0);
+    static constexpr HandleBase::HandleId UNKNOWN = HandleBase::nullid;
+
+    explicit CommandStreamState(uint32_t eliminatedCount) noexcept
+            : mEliminatedCount(eliminatedCount) { }
+
+    struct UniformBinding {
+        HandleBase::HandleId id = UNKNOWN;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    struct SamplerBinding {
+        HandleBase::HandleId id = UNKNOWN;
+    };
+
+    struct Scissor {
+        int32_t left = 0;
+        int32_t bottom = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool known = false;
+    };
+
+    struct PolygonOffset {
+        float slope = 0.0f;
+        float constant = 0.0f;
+        bool known = false;
+    };
+
+    UniformBinding mUniforms[Program::NUM_UNIFORM_BINDINGS];
+    SamplerBinding mSamplers[Program::NUM_SAMPLER_BINDINGS];
+    Scissor mScissor;
+    PolygonOffset mPolygonOffset;
+    uint32_t mEliminatedCount = 0;
+};
+
+/*
+ * CommandFilter<> lets CommandStreamState see the commands it tracks before they're recorded.
+ * By default commands are always recorded and don't affect the state.
+ */
+template<typename M, M METHOD>
+struct CommandFilter {
+    template<typename... ARGS>
+    static constexpr bool keep(CommandStreamState&, ARGS const& ...) noexcept { return true; }
+};
+
+// the command is dropped if it doesn't change the state
+#define FILTER_COMMAND(methodName)                                                              \
+    template<> struct CommandFilter<decltype(&Driver::methodName), &Driver::methodName> {       \
+        template<typename... ARGS>                                                              \
+        static bool keep(CommandStreamState& state, ARGS const& ... args) noexcept {            \
+            return state.methodName(args...);                                                   \
+        }                                                                                       \
+    };
+
+// the command is always recorded but invalidates the state
+#define RESET_ON_COMMAND(methodName)                                                            \
+    template<> struct CommandFilter<decltype(&Driver::methodName), &Driver::methodName> {       \
+        template<typename... ARGS>                                                              \
+        static bool keep(CommandStreamState& state, ARGS const& ...) noexcept {                 \
+            state.reset();                                                                      \
+            return true;                                                                        \
+        }                                                                                       \
+    };
+
+FILTER_COMMAND(bindUniforms)
+FILTER_COMMAND(bindUniformsRange)
+FILTER_COMMAND(bindSamplers)
+FILTER_COMMAND(setViewportScissor)
+FILTER_COMMAND(setPolygonOffset)
+RESET_ON_COMMAND(beginFrame)
+RESET_ON_COMMAND(endFrame)
+RESET_ON_COMMAND(beginRenderPass)
+RESET_ON_COMMAND(endRenderPass)
+RESET_ON_COMMAND(viewport)
+RESET_ON_COMMAND(destroyUniformBuffer)
+RESET_ON_COMMAND(destroySamplerBuffer)
+RESET_ON_COMMAND(destroyHandles)
+
+#undef FILTER_COMMAND
+#undef RESET_ON_COMMAND
+
+/*
+ * CommandPacker<> records the commands it's specialized for in a PackedCommands run, if the
+ * stream can. By default commands are recorded as they are.
+ */
+template<typename M, M METHOD>
+struct CommandPacker {
+    template<typename S, typename... ARGS>
+    static constexpr bool pack(S&, ARGS const& ...) noexcept { return false; }
+};
+
+// the command is packed by CommandStream::methodNamePacked(), which returns false if it can't be
+#define PACK_COMMAND(methodName)                                                                \
+    template<> struct CommandPacker<decltype(&Driver::methodName), &Driver::methodName> {       \
+        template<typename S, typename... ARGS>                                                  \
+        static bool pack(S& stream, ARGS const& ... args) noexcept {                            \
+            return stream.methodName##Packed(args...);                                          \
+        }                                                                                       \
+    };
+
+PACK_COMMAND(bindUniforms)
+PACK_COMMAND(bindUniformsRange)
+PACK_COMMAND(bindSamplers)
+PACK_COMMAND(draw)
+
+#undef PACK_COMMAND
+
 class CommandStream {
 public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
     inline void methodName(paramsDecl) {                                                        \
         DEBUG_COMMAND(methodName, params);                                                      \
+        using Filter = CommandFilter<decltype(&Driver::methodName), &Driver::methodName>;       \
+        if (!Filter::keep(mState, params)) {                                                    \
+            return;                                                                             \
+        }                                                                                       \
+        using Packer = CommandPacker<decltype(&Driver::methodName), &Driver::methodName>;       \
+        if (Packer::pack(*this, params)) {                                                      \
+            return;                                                                             \
+        }                                                                                       \
         using CmdType = CommandType<decltype(&Driver::methodName)>;                             \
         using Cmd = CmdType::Command<&Driver::methodName>;                                      \
+        assert(!mRetained || std::is_trivially_destructible<Cmd>::value);                       \
         void* const p = allocateCommand(CommandBase::align(sizeof(Cmd)));                       \
         new(p) Cmd(mDispatcher->methodName##_, params);                                         \
     }
@@ -261,6 +652,15 @@ public:
     CommandStream() noexcept { }
     CommandStream(Driver& driver, CircularBuffer& buffer) noexcept;
 
+    // Creates a stream whose commands are executed by 'dispatcher' instead of the driver's own
+    // Dispatcher, e.g. to record them (see CommandTraceRecorder).
+    CommandStream(Driver& driver, CircularBuffer& buffer, Dispatcher* dispatcher) noexcept;
+
+    // Creates a secondary stream, using the same driver as 'parent', that records into 'buffer'.
+    // This is typically used to fill a range obtained with parent.reserve() from another
+    // thread. A secondary stream can only be used by the thread that created it.
+    CommandStream(CommandStream const& parent, CircularBuffer& buffer) noexcept;
+
     // This is for debugging only. Currently CircularBuffer can only be written from a
     // single thread. In debug builds we assert this condition.
     // Call this first in the render loop.
@@ -272,11 +672,60 @@ public:
 
     void execute(void* buffer);
 
+    /*
+     * Reserves 'size' bytes in this stream, to be filled later -- possibly concurrently -- by a
+     * secondary stream. Commands recorded in the reserved range must end with a jump() to
+     * the end of the range.
+     */
+    inline void* reserve(size_t size) noexcept {
+        // we can't know what will be bound after the reserved range has executed
+        mState.reset();
+        return allocateCommand(CommandBase::align(size));
+    }
+
+    /*
+     * Reserves 'count' consecutive segments, to be filled later -- possibly concurrently -- by
+     * secondary streams, and executed with Driver::executeSegments(). 'offsets' are the count + 1
+     * boundaries of the segments, starting at 0. Commands recorded in a segment must end with
+     * a jump(nullptr). Returns the address of the first segment.
+     *
+     * The segments are executed in order if this stream's commands must be executed in order
+     * on the driver thread, e.g. when they're recorded.
+     */
+    void* reserveSegments(utils::JobSystem& js, size_t const* offsets, size_t count) noexcept;
+
+    // Records a command that resumes execution at 'next', which must be a command boundary.
+    // A jump to nullptr ends the execution of the commands.
+    inline void jump(void* next) noexcept {
+        void* const p = allocateCommand(CommandBase::align(sizeof(NoopCommand)));
+        new(p) NoopCommand(next);
+    }
+
+    // Stops appending commands to the current PackedCommands run. This must be called before
+    // handing the commands recorded so far to the driver, if they were written to the buffer
+    // directly (e.g. by CommandBufferQueue::flush()), since the buffer's head could then come
+    // back to the end of the run.
+    void closePacked() noexcept { mPacked = nullptr; }
+
+    // Number of binding commands dropped by this stream because they were redundant
+    uint32_t getEliminatedCommandCount() const noexcept { return mState.getEliminatedCount(); }
+
+    // Size in the stream of the command recording driver method METHOD
+    template<typename M, M METHOD>
+    static constexpr size_t getCommandSize() noexcept {
+        return CommandBase::align(sizeof(typename CommandType<M>::template Command<METHOD>));
+    }
+
+    // largest callable accepted by queueCommand(), captures included
+    static constexpr size_t MAX_CUSTOM_COMMAND_SIZE = 256;
+
     /*
      * queueCommand() allows to queue a lambda function as a command.
-     * This is much less efficient than using the Driver* API.
+     * The lambda is moved into the command stream, it must be callable as void() and its captures
+     * must fit in MAX_CUSTOM_COMMAND_SIZE. This is less efficient than using the Driver* API.
      */
-    void queueCommand(std::function<void()> command);
+    template<typename F>
+    inline void queueCommand(F&& command);
 
     /*
      * Allocates memory associated to the current CommandStreamBuffer.
@@ -299,24 +748,151 @@ private:
     Dispatcher* mDispatcher = nullptr;
     Driver* mDriver = nullptr;
     CircularBuffer* UTILS_RESTRICT mCurrentBuffer = nullptr;
+    CommandStreamState mState;
 
 #ifndef NDEBUG
     // just for debugging...
     std::thread::id mThreadId;
+    // true if the commands are recorded in a CommandBundle
+    bool mRetained = false;
 #endif
 
+    // the run the packed commands are appended to, as long as mCurrentBuffer's head is still
+    // mPackedHead, i.e.: nothing else was written after it.
+    PackedCommands* mPacked = nullptr;
+    void* mPackedHead = nullptr;
+
+    friend class CommandBundle;
+    template<typename M, M METHOD> friend struct CommandPacker;
+
     inline void* allocateCommand(size_t size) {
         assert(mThreadId == std::this_thread::get_id());
         return mCurrentBuffer->allocate(size);
     }
+
+    // returns the current PackedCommands run, starting one if needed, or nullptr if this
+    // stream's dispatcher can't execute them
+    inline PackedCommands* openPacked() noexcept;
+
+    // returns where to write a packed command of 'size' bytes at the end of 'run'
+    inline uint8_t* appendPacked(PackedCommands* run, size_t size) noexcept;
+
+    inline bool bindUniformsPacked(size_t index, Driver::UniformBufferHandle ubh) noexcept;
+    inline bool bindUniformsRangePacked(size_t index, Driver::UniformBufferHandle ubh,
+            size_t offset, size_t size) noexcept;
+    inline bool bindSamplersPacked(size_t index, Driver::SamplerBufferHandle sbh) noexcept;
+    inline bool drawPacked(Driver::ProgramHandle ph, Driver::RasterState rs,
+            Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) noexcept;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * A CommandBundle retains commands recorded once, and copies them into a stream each time it's
+ * replayed, which is much cheaper than encoding them again. The copies are executed like any
+ * other commands, the bundle itself never is.
+ *
+ * The commands can be recorded in segments, which are replayed like those of
+ * CommandStream::reserveSegments(): a driver executing segments in parallel (e.g. Vulkan, which
+ * records each one into a secondary command buffer) does so with the replayed ones too.
+ * Otherwise, the commands are replayed inline and the driver executes them on its thread.
+ *
+ * Only commands with trivially destructible parameters can be bundled (e.g. bindings and
+ * draws, but not buffer updates), and the handles they refer to must outlive the bundle, or
+ * at least its replays.
+ */
+class CommandBundle {
+public:
+    CommandBundle() noexcept = default;
+    ~CommandBundle() noexcept;
+
+    CommandBundle(CommandBundle const& rhs) = delete;
+    CommandBundle& operator=(CommandBundle const& rhs) = delete;
+
+    // Records the commands written by record(stream), at most 'capacity' bytes of them, with
+    // a secondary stream of 'parent'. The bundle's previous commands are dropped.
+    template<typename F>
+    void record(CommandStream const& parent, size_t capacity, F&& record);
+
+    // Drops the bundle's previous commands and makes room for 'count' segments, then recorded
+    // with recordSegment(). 'offsets' are the count + 1 boundaries of the segments, as given to
+    // CommandStream::reserveSegments().
+    void reserveSegments(CommandStream const& parent, size_t const* offsets,
+            size_t count) noexcept;
+
+    // Records the commands written by record(stream) in segment 'index', with a secondary
+    // stream of 'parent'. Each segment needs room for the jump that ends it once replayed.
+    // The segments can be recorded concurrently.
+    template<typename F>
+    void recordSegment(CommandStream const& parent, size_t index, F&& record);
+
+    // appends a copy of the commands of this bundle to 'stream', its segments are reserved
+    // with stream.reserveSegments(js, ...)
+    void replay(CommandStream& stream, utils::JobSystem& js) const noexcept;
+
+    // drops the commands of this bundle
+    void clear() noexcept { mSize = 0; }
+
+    bool empty() const noexcept { return mSize == 0; }
+
+    // true if this bundle has commands and they can be replayed in 'stream', i.e. they're
+    // dispatched the same way
+    bool canReplay(CommandStream const& stream) const noexcept {
+        return mSize && mDispatcher == stream.mDispatcher;
+    }
+
+    // size in bytes of the commands of this bundle
+    size_t size() const noexcept { return mSize; }
+
+private:
+    void* reserve(size_t capacity) noexcept;
+
+    Dispatcher const* mDispatcher = nullptr;
+    void* mData = nullptr;
+    size_t mCapacity = 0;
+    size_t mSize = 0;
+    // the commands aren't in segments if this is 0
+    size_t mSegmentCount = 0;
+    size_t mOffsets[SegmentsCommand::MAX_SEGMENTS + 1] = {};
+    size_t mSegmentSizes[SegmentsCommand::MAX_SEGMENTS] = {};
 };
 
+template<typename F>
+void CommandBundle::record(CommandStream const& parent, size_t capacity, F&& record) {
+    CircularBuffer buffer(reserve(capacity), capacity);
+    CommandStream stream(parent, buffer);
+    mDispatcher = parent.mDispatcher;
+#ifndef NDEBUG
+    stream.mRetained = true;
+#endif
+    record(stream);
+    mSize = size_t(static_cast<char*>(buffer.getHead()) - static_cast<char*>(mData));
+    assert(mSize <= capacity);
+}
+
+template<typename F>
+void CommandBundle::recordSegment(CommandStream const& parent, size_t index, F&& record) {
+    assert(index < mSegmentCount);
+    char* const segment = static_cast<char*>(mData) + mOffsets[index];
+    const size_t capacity = mOffsets[index + 1] - mOffsets[index];
+    CircularBuffer buffer(segment, capacity);
+    CommandStream stream(parent, buffer);
+#ifndef NDEBUG
+    stream.mRetained = true;
+#endif
+    record(stream);
+    mSegmentSizes[index] = size_t(static_cast<char*>(buffer.getHead()) - segment);
+    assert(mSegmentSizes[index] + CommandBase::align(sizeof(NoopCommand)) <= capacity);
+}
+
+// ------------------------------------------------------------------------------------------------
+
 void* CommandStream::allocate(size_t size, size_t alignment) noexcept {
     // make sure alignment is a power of two
     assert(alignment && !(alignment & alignment-1));
 
     // pad the requested size to accommodate NoopCommand and alignment
-    const size_t s = CustomCommand::align(sizeof(NoopCommand) + size + alignment - 1);
+    const size_t s = CommandBase::align(sizeof(NoopCommand) + size + alignment - 1);
 
     // allocate space in the command stream and insert a NoopCommand
     char* const p = (char *)allocateCommand(s);
@@ -328,6 +904,111 @@ void* CommandStream::allocate(size_t size, size_t alignment) noexcept {
     return data;
 }
 
+template<typename F>
+void CommandStream::queueCommand(F&& command) {
+    using Command = CustomCommand<typename std::decay<F>::type>;
+    static_assert(sizeof(Command) <= MAX_CUSTOM_COMMAND_SIZE,
+            "the lambda's captures are too large, capture a pointer to its data instead");
+    static_assert(alignof(Command) <= alignof(std::max_align_t),
+            "the lambda's captures are over-aligned");
+    // we don't know what the command does
+    mState.reset();
+    new(allocateCommand(CommandBase::align(sizeof(Command)))) Command(std::forward<F>(command));
+}
+
+PackedCommands* CommandStream::openPacked() noexcept {
+    if (UTILS_LIKELY(mPacked && mCurrentBuffer->getHead() == mPackedHead)) {
+        return mPacked;
+    }
+    // the commands are logged one by one, they can't be packed
+    if (DEBUG_COMMAND_STREAM || !mDispatcher->packed_) {
+        return nullptr;
+    }
+    void* const p = allocateCommand(CommandBase::align(sizeof(PackedCommands)));
+    mPacked = new(p) PackedCommands(mDispatcher->packed_);
+    mPackedHead = mCurrentBuffer->getHead();
+    return mPacked;
+}
+
+uint8_t* CommandStream::appendPacked(PackedCommands* run, size_t size) noexcept {
+    // the stream only grows when the commands don't fit in the padding of the run anymore
+    const size_t current = run->getSize();
+    uint8_t* const p = run->append(size);
+    allocateCommand(run->getSize() - current);
+    mPackedHead = mCurrentBuffer->getHead();
+    return p;
+}
+
+bool CommandStream::bindUniformsPacked(size_t index, Driver::UniformBufferHandle ubh) noexcept {
+    using PC = PackedCommands;
+    PackedCommands* const run = (index <= UINT8_MAX && ubh) ? openPacked() : nullptr;
+    if (UTILS_UNLIKELY(!run)) {
+        return false;
+    }
+    uint8_t* p = appendPacked(run, sizeof(PC::Op) + sizeof(uint8_t) + sizeof(HandleBase::HandleId));
+    p = PC::write(p, PC::Op::BIND_UNIFORMS);
+    p = PC::write(p, uint8_t(index));
+    PC::write(p, ubh.getId());
+    return true;
+}
+
+bool CommandStream::bindUniformsRangePacked(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) noexcept {
+    using PC = PackedCommands;
+    PackedCommands* const run = (index <= UINT8_MAX && ubh &&
+            offset <= UINT32_MAX && size <= UINT32_MAX) ? openPacked() : nullptr;
+    if (UTILS_UNLIKELY(!run)) {
+        return false;
+    }
+    uint8_t* p = appendPacked(run,
+            sizeof(PC::Op) + sizeof(uint8_t) + sizeof(HandleBase::HandleId) + 2 * sizeof(uint32_t));
+    p = PC::write(p, PC::Op::BIND_UNIFORMS_RANGE);
+    p = PC::write(p, uint8_t(index));
+    p = PC::write(p, ubh.getId());
+    p = PC::write(p, uint32_t(offset));
+    PC::write(p, uint32_t(size));
+    return true;
+}
+
+bool CommandStream::bindSamplersPacked(size_t index, Driver::SamplerBufferHandle sbh) noexcept {
+    using PC = PackedCommands;
+    PackedCommands* const run = (index <= UINT8_MAX && sbh) ? openPacked() : nullptr;
+    if (UTILS_UNLIKELY(!run)) {
+        return false;
+    }
+    uint8_t* p = appendPacked(run, sizeof(PC::Op) + sizeof(uint8_t) + sizeof(HandleBase::HandleId));
+    p = PC::write(p, PC::Op::BIND_SAMPLERS);
+    p = PC::write(p, uint8_t(index));
+    PC::write(p, sbh.getId());
+    return true;
+}
+
+bool CommandStream::drawPacked(Driver::ProgramHandle ph, Driver::RasterState rs,
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) noexcept {
+    using PC = PackedCommands;
+    PackedCommands* const run = (ph && rph) ? openPacked() : nullptr;
+    if (UTILS_UNLIKELY(!run)) {
+        return false;
+    }
+    const uint8_t index = run->getRasterStateIndex(rs);
+    const bool instanced = instanceCount != 1;
+    size_t size = sizeof(PC::Op) + sizeof(uint8_t) + 2 * sizeof(HandleBase::HandleId);
+    size += index == PC::INLINE_RASTER_STATE ? sizeof(rs) : 0;
+    size += instanced ? sizeof(uint32_t) : 0;
+    uint8_t* p = appendPacked(run, size);
+    p = PC::write(p, instanced ? PC::Op::DRAW_INSTANCED : PC::Op::DRAW);
+    p = PC::write(p, index);
+    p = PC::write(p, ph.getId());
+    p = PC::write(p, rph.getId());
+    if (index == PC::INLINE_RASTER_STATE) {
+        p = PC::write(p, rs);
+    }
+    if (instanced) {
+        PC::write(p, instanceCount);
+    }
+    return true;
+}
+
 template<typename PodType, typename>
 PodType* CommandStream::allocatePod(size_t count, size_t alignment) noexcept {
     return static_cast<PodType*>(allocate(count * sizeof(PodType), alignment));
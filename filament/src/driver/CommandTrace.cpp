@@ -0,0 +1,831 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandTrace.h"
+
+#include "driver/CommandBufferQueue.h"
+
+#include <filament/driver/Platform.h>
+
+#include <utils/Log.h>
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+
+using namespace driver;
+
+// ------------------------------------------------------------------------------------------------
+// CommandTraceRecorder
+// ------------------------------------------------------------------------------------------------
+
+CommandTraceRecorder* CommandTraceRecorder::sRecorder = nullptr;
+
+/*
+ * The dispatch table of the recorder. Each function writes its command, then executes it with
+ * the function of the driver's own Dispatcher.
+ */
+struct CommandTraceRecorder::Record {
+#define RECORD_COMMAND(methodName)                                                              \
+    static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
+        using Cmd = CommandType<decltype(&Driver::methodName)>::Command<&Driver::methodName>;   \
+        CommandTraceRecorder& recorder = *sRecorder;                                            \
+        recorder.mCommand = CommandId::methodName;                                              \
+        recorder.writeRaw(CommandId::methodName);                                               \
+        static_cast<Cmd const*>(base)->record(recorder);                                        \
+        recorder.mTarget.methodName##_(driver, base, next);                                     \
+    }
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                 RECORD_COMMAND(methodName)
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) RECORD_COMMAND(methodName)
+#include "driver/DriverAPI.inc"
+#undef RECORD_COMMAND
+};
+
+CommandTraceRecorder::CommandTraceRecorder(const char* path, Backend backend,
+        Dispatcher const& target) noexcept
+        : mOut(path, std::ios::out | std::ios::binary | std::ios::trunc),
+          mTarget(target) {
+    ASSERT_PRECONDITION(!sRecorder, "only one CommandTraceRecorder can be active at a time");
+    sRecorder = this;
+
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                 \
+        mDispatcher.methodName##_ = Record::methodName;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) \
+        mDispatcher.methodName##_ = Record::methodName;
+#include "driver/DriverAPI.inc"
+
+    if (!mOut) {
+        slog.e << "couldn't create the command trace " << path << io::endl;
+        return;
+    }
+    mOut.write(COMMAND_TRACE_MAGIC, sizeof(COMMAND_TRACE_MAGIC));
+    writeRaw(COMMAND_TRACE_VERSION);
+    writeRaw(uint32_t(backend));
+}
+
+CommandTraceRecorder::~CommandTraceRecorder() noexcept {
+    sRecorder = nullptr;
+}
+
+void CommandTraceRecorder::writeBytes(void const* data, size_t size) noexcept {
+    if (size) {
+        mOut.write(static_cast<const char*>(data), size);
+    }
+}
+
+void CommandTraceRecorder::write(const char* string) noexcept {
+    const size_t length = string ? strlen(string) : 0;
+    write(length);
+    writeBytes(string, length);
+}
+
+void CommandTraceRecorder::write(CString const& string) noexcept {
+    write(string.size());
+    writeBytes(string.c_str(), string.size());
+}
+
+void CommandTraceRecorder::write(Driver::AttributeArray const& attributes) noexcept {
+    for (Driver::Attribute const& attribute : attributes) {
+        write(attribute.offset);
+        write(attribute.stride);
+        write(attribute.buffer);
+        write(attribute.type);
+        write(attribute.flags);
+    }
+}
+
+void CommandTraceRecorder::write(Driver::FaceOffsets const& offsets) noexcept {
+    for (size_t offset : offsets.offsets) {
+        write(offset);
+    }
+}
+
+void CommandTraceRecorder::write(Driver::RasterState const& rs) noexcept {
+    write(rs.u);
+}
+
+void CommandTraceRecorder::write(Driver::RenderPassParams const& params) noexcept {
+    write(params.flags);
+    write(params.left);
+    write(params.bottom);
+    write(params.width);
+    write(params.height);
+    writeRaw(params.clearColor);
+    writeRaw(params.clearDepth);
+    write(params.clearStencil);
+    writeRaw(params.focalPoints);
+    writeRaw(params.foveaGain);
+    writeRaw(params.foveaArea);
+    write(params.focalPointCount);
+}
+
+void CommandTraceRecorder::write(Driver::TargetBufferInfo const& info) noexcept {
+    write(info.handle);
+    write(info.level);
+    write(info.layer);
+}
+
+void CommandTraceRecorder::write(Driver::BufferDescriptor const& data) noexcept {
+    write(data.size);
+    // the destinations of readPixels() and trimCaches() are only written by the driver
+    if (mCommand != CommandId::readPixels && mCommand != CommandId::trimCaches) {
+        writeBytes(data.buffer, data.size);
+    }
+}
+
+void CommandTraceRecorder::write(Driver::PixelBufferDescriptor const& data) noexcept {
+    write(static_cast<Driver::BufferDescriptor const&>(data));
+    const Driver::PixelDataType type = data.type;
+    write(type);
+    write(uint8_t(data.alignment));
+    write(data.left);
+    write(data.top);
+    if (type == Driver::PixelDataType::COMPRESSED) {
+        write(data.imageSize);
+        write(data.compressedFormat);
+    } else {
+        write(data.stride);
+        write(data.format);
+    }
+}
+
+void CommandTraceRecorder::write(Program const& program) noexcept {
+    write(program.getName());
+    write(program.getVariant());
+    for (CString const& source : program.getShadersSource()) {
+        write(source);
+    }
+
+    for (UniformInterfaceBlock const* uib : program.getUniformInterfaceBlocks()) {
+        write(uib != nullptr);
+        if (uib) {
+            write(uib->getName());
+            write(uib->getUniformInfoList().size());
+            for (auto const& info : uib->getUniformInfoList()) {
+                write(info.name);
+                write(info.size);
+                write(info.type);
+                write(info.precision);
+            }
+        }
+    }
+
+    for (SamplerInterfaceBlock const* sib : program.getSamplerInterfaceBlocks()) {
+        write(sib != nullptr);
+        if (sib) {
+            write(sib->getName());
+            write(sib->getSamplerInfoList().size());
+            for (auto const& info : sib->getSamplerInfoList()) {
+                write(info.name);
+                write(info.type);
+                write(info.format);
+                write(info.precision);
+                write(info.multisample);
+            }
+        }
+    }
+
+    SamplerBindingMap const* bindings = program.getSamplerBindings();
+    write(bindings != nullptr);
+    if (bindings) {
+        write(bindings->getBindingList().size());
+        for (SamplerBindingInfo const& info : bindings->getBindingList()) {
+            write(info.blockIndex);
+            write(info.localOffset);
+            write(info.globalOffset);
+            write(info.groupIndex);
+        }
+    }
+
+    write(program.getFallback());
+}
+
+void CommandTraceRecorder::write(UniformBuffer const& uniformBuffer) noexcept {
+    write(uniformBuffer.getSize());
+    write(uniformBuffer.getDirtyOffset());
+    write(uniformBuffer.getDirtySize());
+    writeBytes(uniformBuffer.getBuffer(), uniformBuffer.getSize());
+}
+
+void CommandTraceRecorder::write(SamplerBuffer const& samplerBuffer) noexcept {
+    write(samplerBuffer.getSize());
+    for (size_t i = 0, c = samplerBuffer.getSize(); i < c; i++) {
+        SamplerBuffer::Sampler const& sampler = samplerBuffer.getBuffer()[i];
+        write(sampler.t);
+        write(sampler.s.u);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// CommandTraceReplayer
+// ------------------------------------------------------------------------------------------------
+
+// commands are executed at least every REQUIRED_SIZE / 2 bytes
+static constexpr size_t REQUIRED_SIZE = 16 * 1024 * 1024;
+
+static constexpr size_t HEADER_SIZE = sizeof(COMMAND_TRACE_MAGIC) + 2 * sizeof(uint32_t);
+
+template<typename F, typename T, std::size_t... I>
+static auto applyTuple(F&& f, T&& t, std::index_sequence<I...>) {
+    return f(std::get<I>(std::move(t))...);
+}
+
+// calls f with the elements of the tuple t
+template<typename F, typename T>
+static auto applyTuple(F&& f, T&& t) {
+    return applyTuple(std::forward<F>(f), std::forward<T>(t),
+            std::make_index_sequence<std::tuple_size<std::decay_t<T>>::value>{});
+}
+
+// commands that can't be replayed, their native objects don't exist in the replay
+static bool isReplayed(CommandId command) noexcept {
+    switch (command) {
+        case CommandId::createStreamFromTextureId:
+        case CommandId::setExternalImage:
+        case CommandId::setExternalStream:
+        case CommandId::setAcquiredImage:
+        case CommandId::readStreamPixels:
+        case CommandId::setBlobCache:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static bool isDestroy(CommandId command) noexcept {
+    switch (command) {
+        case CommandId::destroyVertexBuffer:
+        case CommandId::destroyIndexBuffer:
+        case CommandId::destroyRenderPrimitive:
+        case CommandId::destroyProgram:
+        case CommandId::destroySamplerBuffer:
+        case CommandId::destroyUniformBuffer:
+        case CommandId::destroyBufferObject:
+        case CommandId::destroyTexture:
+        case CommandId::destroyRenderTarget:
+        case CommandId::destroySwapChain:
+        case CommandId::destroyStream:
+        case CommandId::destroyTimerQuery:
+            return true;
+        default:
+            return false;
+    }
+}
+
+CommandTraceReplayer::CommandTraceReplayer() noexcept = default;
+
+CommandTraceReplayer::~CommandTraceReplayer() noexcept = default;
+
+bool CommandTraceReplayer::load(const char* path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in) {
+        slog.e << "couldn't open the command trace " << path << io::endl;
+        return false;
+    }
+    mTrace.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+    uint32_t version = 0;
+    uint32_t backend = 0;
+    if (mTrace.size() < HEADER_SIZE ||
+            memcmp(mTrace.data(), COMMAND_TRACE_MAGIC, sizeof(COMMAND_TRACE_MAGIC)) != 0) {
+        slog.e << path << " is not a command trace" << io::endl;
+        return false;
+    }
+    memcpy(&version, mTrace.data() + sizeof(COMMAND_TRACE_MAGIC), sizeof(version));
+    memcpy(&backend, mTrace.data() + sizeof(COMMAND_TRACE_MAGIC) + sizeof(version),
+            sizeof(backend));
+    if (version != COMMAND_TRACE_VERSION) {
+        slog.e << path << ": unsupported command trace version " << version << io::endl;
+        return false;
+    }
+    mTraceBackend = Backend(backend);
+    return true;
+}
+
+HandleBase::HandleId CommandTraceReplayer::translate(HandleBase::HandleId id) const noexcept {
+    auto pos = mHandles.find(id);
+    return pos != mHandles.end() ? pos->second.id : HandleBase::nullid;
+}
+
+void CommandTraceReplayer::addHandle(HandleBase::HandleId recorded, HandleBase::HandleId id,
+        CommandId creator) {
+    mHandles[recorded] = { id, creator, mHandleSerial++ };
+}
+
+void CommandTraceReplayer::removeHandle(HandleBase::HandleId recorded) noexcept {
+    mHandles.erase(recorded);
+}
+
+void* CommandTraceReplayer::allocateFrameData(size_t size) {
+    mFrameData.emplace_back(new uint8_t[size]);
+    return mFrameData.back().get();
+}
+
+const uint8_t* CommandTraceReplayer::readBytes(size_t size) noexcept {
+    if (UTILS_UNLIKELY(size > size_t(mEnd - mCursor))) {
+        mError = true;
+        mCursor = mEnd;
+        return nullptr;
+    }
+    const uint8_t* data = mCursor;
+    mCursor += size;
+    return data;
+}
+
+const char* CommandTraceReplayer::read(Tag<const char*>) noexcept {
+    const size_t length = read(Tag<size_t>{});
+    const uint8_t* data = readBytes(length);
+    char* string = static_cast<char*>(allocateFrameData(length + 1));
+    if (data) {
+        memcpy(string, data, length);
+    }
+    string[data ? length : 0] = 0;
+    return string;
+}
+
+CString CommandTraceReplayer::read(Tag<CString>) noexcept {
+    const size_t length = read(Tag<size_t>{});
+    const uint8_t* data = readBytes(length);
+    return data ? CString(reinterpret_cast<const char*>(data), length) : CString();
+}
+
+Driver::AttributeArray CommandTraceReplayer::read(Tag<Driver::AttributeArray>) noexcept {
+    Driver::AttributeArray attributes;
+    for (Driver::Attribute& attribute : attributes) {
+        attribute.offset = read(Tag<uint32_t>{});
+        attribute.stride = read(Tag<uint8_t>{});
+        attribute.buffer = read(Tag<uint8_t>{});
+        attribute.type = read(Tag<Driver::ElementType>{});
+        attribute.flags = read(Tag<uint8_t>{});
+    }
+    return attributes;
+}
+
+Driver::FaceOffsets CommandTraceReplayer::read(Tag<Driver::FaceOffsets>) noexcept {
+    Driver::FaceOffsets offsets;
+    for (size_t& offset : offsets.offsets) {
+        offset = read(Tag<size_t>{});
+    }
+    return offsets;
+}
+
+Driver::RasterState CommandTraceReplayer::read(Tag<Driver::RasterState>) noexcept {
+    Driver::RasterState rs;
+    rs.u = read(Tag<uint32_t>{});
+    return rs;
+}
+
+Driver::RenderPassParams CommandTraceReplayer::read(Tag<Driver::RenderPassParams>) noexcept {
+    Driver::RenderPassParams params;
+    params.flags = read(Tag<uint32_t>{});
+    params.left = read(Tag<int32_t>{});
+    params.bottom = read(Tag<int32_t>{});
+    params.width = read(Tag<uint32_t>{});
+    params.height = read(Tag<uint32_t>{});
+    params.clearColor = readRaw<math::float4>();
+    params.clearDepth = readRaw<double>();
+    params.clearStencil = read(Tag<uint32_t>{});
+    params.focalPoints[0] = readRaw<math::float2>();
+    params.focalPoints[1] = readRaw<math::float2>();
+    params.foveaGain = readRaw<math::float2>();
+    params.foveaArea = readRaw<float>();
+    params.focalPointCount = read(Tag<uint8_t>{});
+    return params;
+}
+
+Driver::TargetBufferInfo CommandTraceReplayer::read(Tag<Driver::TargetBufferInfo>) noexcept {
+    Driver::TargetBufferInfo info;
+    info.handle = read(Tag<Driver::TextureHandle>{});
+    info.level = read(Tag<uint8_t>{});
+    info.layer = read(Tag<uint16_t>{});
+    return info;
+}
+
+void* CommandTraceReplayer::readBuffer(size_t* outSize,
+        Driver::BufferDescriptor::Callback* outCallback) noexcept {
+    const size_t size = read(Tag<size_t>{});
+    *outSize = size;
+    *outCallback = nullptr;
+
+    if (mCommand == CommandId::readPixels || mCommand == CommandId::trimCaches) {
+        // the driver can write the pixels after the frame, the buffer is freed by the callback
+        *outCallback = [](void* buffer, size_t, void*) { free(buffer); };
+        return malloc(size);
+    }
+
+    const uint8_t* data = readBytes(size);
+    if (UTILS_UNLIKELY(!data)) {
+        *outSize = 0;
+        return nullptr;
+    }
+
+    if (mCommand == CommandId::compilePrograms) {
+        // an array of program handles
+        void* copy = allocateFrameData(size);
+        memcpy(copy, data, size);
+        auto* programs = static_cast<Driver::ProgramHandle*>(copy);
+        for (size_t i = 0, c = size / sizeof(Driver::ProgramHandle); i < c; i++) {
+            programs[i] = translate(programs[i]);
+        }
+        return programs;
+    }
+
+    if (mCommand == CommandId::destroyHandles) {
+        // an array of Driver::DestroyedHandle, the handles are gone once they're translated
+        void* copy = allocateFrameData(size);
+        memcpy(copy, data, size);
+        auto* handles = static_cast<Driver::DestroyedHandle*>(copy);
+        for (size_t i = 0, c = size / sizeof(Driver::DestroyedHandle); i < c; i++) {
+            const HandleBase::HandleId recorded = handles[i].id;
+            handles[i].id = translate(recorded);
+            removeHandle(recorded);
+        }
+        return handles;
+    }
+
+    if (mCommand == CommandId::updateUniformBufferRanges) {
+        // records starting with a uniform buffer handle, see Driver::UniformRangeUpdate
+        uint8_t* records = static_cast<uint8_t*>(allocateFrameData(size));
+        memcpy(records, data, size);
+        for (size_t offset = 0; offset + sizeof(Driver::UniformRangeUpdate) <= size;) {
+            auto* record = reinterpret_cast<Driver::UniformRangeUpdate*>(records + offset);
+            record->ubh = translate(record->ubh);
+            offset += Driver::UniformRangeUpdate::getRecordSize(record->size);
+        }
+        return records;
+    }
+
+    // the driver only reads the data, which stays in the trace
+    return const_cast<uint8_t*>(data);
+}
+
+Driver::BufferDescriptor CommandTraceReplayer::read(Tag<Driver::BufferDescriptor>) noexcept {
+    size_t size;
+    Driver::BufferDescriptor::Callback callback;
+    void* data = readBuffer(&size, &callback);
+    return Driver::BufferDescriptor(data, size, callback);
+}
+
+Driver::PixelBufferDescriptor CommandTraceReplayer::read(
+        Tag<Driver::PixelBufferDescriptor>) noexcept {
+    size_t size;
+    Driver::BufferDescriptor::Callback callback;
+    void* data = readBuffer(&size, &callback);
+    const auto type = read(Tag<Driver::PixelDataType>{});
+    const auto alignment = read(Tag<uint8_t>{});
+    const auto left = read(Tag<uint32_t>{});
+    const auto top = read(Tag<uint32_t>{});
+    if (type == Driver::PixelDataType::COMPRESSED) {
+        const auto imageSize = read(Tag<uint32_t>{});
+        const auto format = read(Tag<CompressedPixelDataType>{});
+        return Driver::PixelBufferDescriptor(data, size, format, imageSize, callback);
+    }
+    const auto stride = read(Tag<uint32_t>{});
+    const auto format = read(Tag<Driver::PixelDataFormat>{});
+    return Driver::PixelBufferDescriptor(data, size,
+            format, type, alignment, left, top, stride, callback);
+}
+
+Program CommandTraceReplayer::read(Tag<Program>) noexcept {
+    Program program;
+    CString name = read(Tag<CString>{});
+    const auto variant = read(Tag<uint8_t>{});
+    program.diagnostics(name, variant);
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        program.shader(Program::Shader(i), read(Tag<CString>{}));
+    }
+
+    for (size_t i = 0; i < Program::NUM_UNIFORM_BINDINGS; i++) {
+        if (read(Tag<bool>{})) {
+            UniformInterfaceBlock::Builder builder;
+            builder.name(read(Tag<CString>{}).c_str());
+            for (size_t j = 0, c = read(Tag<size_t>{}); j < c && !mError; j++) {
+                CString uniform = read(Tag<CString>{});
+                const auto size = read(Tag<uint32_t>{});
+                const auto type = read(Tag<UniformInterfaceBlock::Type>{});
+                const auto precision = read(Tag<UniformInterfaceBlock::Precision>{});
+                builder.add(uniform.c_str(), size, type, precision);
+            }
+            mUniformBlocks.push_back(builder.build());
+            program.addUniformBlock(i, &mUniformBlocks.back());
+        }
+    }
+
+    for (size_t i = 0; i < Program::NUM_SAMPLER_BINDINGS; i++) {
+        if (read(Tag<bool>{})) {
+            SamplerInterfaceBlock::Builder builder;
+            builder.name(read(Tag<CString>{}).c_str());
+            for (size_t j = 0, c = read(Tag<size_t>{}); j < c && !mError; j++) {
+                CString sampler = read(Tag<CString>{});
+                const auto type = read(Tag<SamplerInterfaceBlock::Type>{});
+                const auto format = read(Tag<SamplerInterfaceBlock::Format>{});
+                const auto precision = read(Tag<SamplerInterfaceBlock::Precision>{});
+                const auto multisample = read(Tag<bool>{});
+                builder.add(sampler.c_str(), type, format, precision, multisample);
+            }
+            mSamplerBlocks.push_back(builder.build());
+            program.addSamplerBlock(i, &mSamplerBlocks.back());
+        }
+    }
+
+    if (read(Tag<bool>{})) {
+        mSamplerBindings.emplace_back();
+        SamplerBindingMap& bindings = mSamplerBindings.back();
+        for (size_t i = 0, c = read(Tag<size_t>{}); i < c && !mError; i++) {
+            SamplerBindingInfo info;
+            info.blockIndex = read(Tag<uint8_t>{});
+            info.localOffset = read(Tag<uint8_t>{});
+            info.globalOffset = read(Tag<uint8_t>{});
+            info.groupIndex = read(Tag<uint8_t>{});
+            bindings.addSampler(info);
+        }
+        program.withSamplerBindings(&bindings);
+    }
+
+    program.fallback(read(Tag<Driver::ProgramHandle>{}));
+    return program;
+}
+
+UniformBuffer CommandTraceReplayer::read(Tag<UniformBuffer>) noexcept {
+    const size_t size = read(Tag<size_t>{});
+    const size_t dirtyOffset = read(Tag<size_t>{});
+    const size_t dirtySize = read(Tag<size_t>{});
+    const uint8_t* data = readBytes(size);
+    if (UTILS_UNLIKELY(!data || !size || dirtyOffset + dirtySize > size)) {
+        return UniformBuffer();
+    }
+    UniformBuffer uniformBuffer(size);
+    memcpy(uniformBuffer.invalidateUniforms(0, size), data, size);
+    // only what was dirty when recorded is uploaded
+    uniformBuffer.clean();
+    if (dirtySize) {
+        uniformBuffer.invalidateUniforms(dirtyOffset, dirtySize);
+    }
+    return uniformBuffer;
+}
+
+SamplerBuffer CommandTraceReplayer::read(Tag<SamplerBuffer>) noexcept {
+    const size_t count = std::min(read(Tag<size_t>{}), size_t(16));
+    SamplerBuffer samplerBuffer(count);
+    for (size_t i = 0; i < count; i++) {
+        const Driver::TextureHandle t = read(Tag<Driver::TextureHandle>{});
+        Driver::SamplerParams s;
+        s.u = read(Tag<uint32_t>{});
+        samplerBuffer.setSampler(i, t, s);
+    }
+    return samplerBuffer;
+}
+
+void CommandTraceReplayer::replayCommand(CommandId command, CommandStream& stream) {
+    mCommand = command;
+
+    if (command == CommandId::createSwapChain) {
+        // there is no window to render into
+        const auto recorded = readRaw<HandleBase::HandleId>();
+        auto args = readCreateArgs(&Driver::createSwapChain);
+        Driver::SwapChainHandle sch = stream.createSwapChainHeadless(
+                mOptions.width, mOptions.height, std::get<1>(args));
+        addHandle(recorded, sch.getId(), command);
+        return;
+    }
+
+    // the handle destroyed is the first argument
+    const bool destroy = isDestroy(command);
+    const auto destroyed = destroy ? readRaw<HandleBase::HandleId>() : HandleBase::nullid;
+    if (destroy) {
+        mCursor -= sizeof(HandleBase::HandleId);
+    }
+
+    switch (command) {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+        case CommandId::methodName: {                                                           \
+            auto args = readArgs(&Driver::methodName);                                          \
+            if (!mError && isReplayed(command)) {                                               \
+                applyTuple([&](auto&& ... a) { stream.methodName(std::move(a)...); }, args);        \
+            }                                                                                   \
+            break;                                                                              \
+        }
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+        case CommandId::methodName: {                                                           \
+            const auto recorded = readRaw<HandleBase::HandleId>();                              \
+            auto args = readCreateArgs(&Driver::methodName);                                    \
+            if (!mError && isReplayed(command)) {                                               \
+                RetType h = applyTuple([&](auto&& ... a) {                                          \
+                    return stream.methodName(std::move(a)...);                                  \
+                }, args);                                                                       \
+                addHandle(recorded, h.getId(), command);                                        \
+            }                                                                                   \
+            break;                                                                              \
+        }
+#include "driver/DriverAPI.inc"
+        default:
+            mError = true;
+            break;
+    }
+
+    if (destroy) {
+        removeHandle(destroyed);
+    }
+}
+
+void CommandTraceReplayer::destroyLiveHandles(CommandStream& stream) {
+    // in the reverse order of their creation
+    std::vector<LiveHandle> handles;
+    handles.reserve(mHandles.size());
+    for (auto const& item : mHandles) {
+        handles.push_back(item.second);
+    }
+    std::sort(handles.begin(), handles.end(), [](LiveHandle const& lhs, LiveHandle const& rhs) {
+        return lhs.serial > rhs.serial;
+    });
+    mHandles.clear();
+
+    for (LiveHandle const& h : handles) {
+        switch (h.creator) {
+            case CommandId::createVertexBuffer:
+                stream.destroyVertexBuffer(Driver::VertexBufferHandle(h.id));
+                break;
+            case CommandId::createIndexBuffer:
+                stream.destroyIndexBuffer(Driver::IndexBufferHandle(h.id));
+                break;
+            case CommandId::createTexture:
+            case CommandId::createSparseTexture:
+                stream.destroyTexture(Driver::TextureHandle(h.id));
+                break;
+            case CommandId::createSamplerBuffer:
+                stream.destroySamplerBuffer(Driver::SamplerBufferHandle(h.id));
+                break;
+            case CommandId::createUniformBuffer:
+                stream.destroyUniformBuffer(Driver::UniformBufferHandle(h.id));
+                break;
+            case CommandId::createBufferObject:
+                stream.destroyBufferObject(Driver::BufferObjectHandle(h.id));
+                break;
+            case CommandId::createRenderPrimitive:
+                stream.destroyRenderPrimitive(Driver::RenderPrimitiveHandle(h.id));
+                break;
+            case CommandId::createProgram:
+                stream.destroyProgram(Driver::ProgramHandle(h.id));
+                break;
+            case CommandId::createDefaultRenderTarget:
+            case CommandId::createRenderTarget:
+                stream.destroyRenderTarget(Driver::RenderTargetHandle(h.id));
+                break;
+            case CommandId::createFence:
+                // synchronous, the fence was created by the commands already executed
+                stream.destroyFence(Driver::FenceHandle(h.id));
+                break;
+            case CommandId::createTimerQuery:
+                stream.destroyTimerQuery(Driver::TimerQueryHandle(h.id));
+                break;
+            case CommandId::createSwapChain:
+            case CommandId::createSwapChainHeadless:
+                stream.destroySwapChain(Driver::SwapChainHandle(h.id));
+                break;
+            case CommandId::createStreamAcquired:
+                stream.destroyStream(Driver::StreamHandle(h.id));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool CommandTraceReplayer::replay(Options const& options, Results* results) {
+    using clock = std::chrono::steady_clock;
+    using milliseconds = std::chrono::duration<double, std::milli>;
+
+    mOptions = options;
+    Backend backend = options.backend == Backend::DEFAULT ? mTraceBackend : options.backend;
+    if (backend != mTraceBackend && backend != Backend::NOOP) {
+        // the programs are only valid for the backend they were recorded with
+        slog.e << "a command trace can only be replayed with its own backend or the noop backend"
+               << io::endl;
+        return false;
+    }
+
+    Platform* platform = Platform::create(&backend);
+    if (!platform) {
+        slog.e << "this backend is not supported" << io::endl;
+        return false;
+    }
+    mDriver = platform->createDriver(nullptr);
+    if (!mDriver) {
+        Platform::destroy(&platform);
+        return false;
+    }
+
+    bool success = true;
+    {
+        CommandBufferQueue queue(REQUIRED_SIZE, 3 * REQUIRED_SIZE);
+        CircularBuffer& buffer = queue.getCircularBuffer();
+        CommandStream stream(*mDriver, buffer);
+
+        // executes the commands recorded so far, returns the time it took
+        auto execute = [&]() -> double {
+            mDriver->purge();
+            queue.flush();
+            const clock::time_point start = clock::now();
+            for (auto& item : queue.waitForCommands()) {
+                if (item.begin) {
+                    stream.execute(item.begin);
+                    queue.releaseBuffer(item);
+                }
+            }
+            const double ms = milliseconds(clock::now() - start).count();
+            mFrameData.clear();
+            return ms;
+        };
+
+        std::vector<double> frames;
+        uint64_t commands = 0;
+        double totalMs = 0;
+        double frameMs = 0;
+        bool inFrame = false;
+
+        mEnd = mTrace.data() + mTrace.size();
+        for (uint32_t i = 0; i < options.iterations && success; i++) {
+            mCursor = mTrace.data() + HEADER_SIZE;
+            mError = false;
+            while (mCursor < mEnd) {
+                const auto command = readRaw<CommandId>();
+                if (command == CommandId::beginFrame) {
+                    // what happened in between frames is not counted in the next one
+                    totalMs += execute();
+                    inFrame = true;
+                    frameMs = 0;
+                }
+
+                replayCommand(command, stream);
+                if (UTILS_UNLIKELY(mError)) {
+                    slog.e << "the command trace is corrupted" << io::endl;
+                    success = false;
+                    break;
+                }
+                commands++;
+
+                if (command == CommandId::endFrame && inFrame) {
+                    frameMs += execute();
+                    totalMs += frameMs;
+                    frames.push_back(frameMs);
+                    inFrame = false;
+                } else if (uintptr_t(buffer.getHead()) - uintptr_t(buffer.getTail()) >
+                           REQUIRED_SIZE / 2) {
+                    const double ms = execute();
+                    (inFrame ? frameMs : totalMs) += ms;
+                }
+            }
+
+            totalMs += execute();
+            destroyLiveHandles(stream);
+            execute();
+            mUniformBlocks.clear();
+            mSamplerBlocks.clear();
+            mSamplerBindings.clear();
+        }
+
+        if (results) {
+            *results = {};
+            results->frames = uint32_t(frames.size());
+            results->commands = commands;
+            results->totalMs = totalMs;
+            if (!frames.empty()) {
+                std::sort(frames.begin(), frames.end());
+                results->minFrameMs = frames.front();
+                results->medianFrameMs = frames[frames.size() / 2];
+                results->maxFrameMs = frames.back();
+            }
+        }
+    }
+
+    mDriver->terminate();
+    delete mDriver;
+    mDriver = nullptr;
+    Platform::destroy(&platform);
+    return success;
+}
+
+} // namespace filament
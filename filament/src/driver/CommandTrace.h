@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDTRACE_H
+#define TNT_FILAMENT_DRIVER_COMMANDTRACE_H
+
+#include "driver/CommandStream.h"
+#include "driver/Driver.h"
+#include "driver/Program.h"
+#include "driver/SamplerBuffer.h"
+#include "driver/UniformBuffer.h"
+
+#include <filament/SamplerBindingMap.h>
+#include <filament/SamplerInterfaceBlock.h>
+#include <filament/UniformInterfaceBlock.h>
+
+#include <utils/CString.h>
+
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace filament {
+
+/*
+ * A command trace is the list of the commands executed by a driver, with all their arguments
+ * and payloads (buffers, images, shaders...), so that they can be replayed later on a driver
+ * alone, without the engine, to measure the cost of the backend in isolation.
+ *
+ * File format (native byte order):
+ *
+ *     char[8] : magic identifier "FILTRACE"
+ *     uint32  : version number
+ *     uint32  : driver::Backend the trace was recorded with
+ *     for each command:
+ *         uint8 : CommandId
+ *         the command's arguments, see CommandTraceRecorder::write()
+ *
+ * Integers and enums are widened to 64 bits, floats are stored as is and handles are stored as
+ * their id.
+ */
+
+enum class CommandId : uint8_t {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     methodName,
+#include "driver/DriverAPI.inc"
+    COUNT
+};
+
+static constexpr char COMMAND_TRACE_MAGIC[8] = { 'F', 'I', 'L', 'T', 'R', 'A', 'C', 'E' };
+static constexpr uint32_t COMMAND_TRACE_VERSION = 6;
+
+/*
+ * Records the commands executed by a driver into a trace file.
+ *
+ * The recorder provides a Dispatcher that writes each command before handing it to the driver's
+ * own Dispatcher, so commands are recorded by the driver thread as they are executed. Commands
+ * queued with CommandStream::queueCommand() can't be recorded. Only one recorder can be active
+ * at a time.
+ */
+class CommandTraceRecorder {
+public:
+    CommandTraceRecorder(const char* path, driver::Backend backend,
+            Dispatcher const& target) noexcept;
+    ~CommandTraceRecorder() noexcept;
+
+    CommandTraceRecorder(CommandTraceRecorder const&) = delete;
+    CommandTraceRecorder& operator=(CommandTraceRecorder const&) = delete;
+
+    // false if the trace file couldn't be created
+    bool isValid() const noexcept { return bool(mOut); }
+
+    // to be used by the CommandStream in place of the driver's Dispatcher
+    Dispatcher* getDispatcher() noexcept { return &mDispatcher; }
+
+    // these are called by CommandType<>::Command<>::record() for each argument of a command
+    template<typename T, typename = typename std::enable_if<
+            std::is_integral<T>::value || std::is_enum<T>::value>::type>
+    void write(T v) noexcept {
+        using W = typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type;
+        writeRaw(W(v));
+    }
+
+    void write(float v) noexcept { writeRaw(v); }
+
+    template<typename T>
+    void write(Handle<T> const& h) noexcept { writeRaw(h.getId()); }
+
+    // native pointers (windows, external images, caches) can't be replayed
+    template<typename T>
+    void write(T* const) noexcept { }
+
+    void write(const char* string) noexcept;
+    void write(utils::CString const& string) noexcept;
+    void write(Driver::AttributeArray const& attributes) noexcept;
+    void write(Driver::FaceOffsets const& offsets) noexcept;
+    void write(Driver::RasterState const& rs) noexcept;
+    void write(Driver::RenderPassParams const& params) noexcept;
+    void write(Driver::TargetBufferInfo const& info) noexcept;
+    void write(Driver::BufferDescriptor const& data) noexcept;
+    void write(Driver::PixelBufferDescriptor const& data) noexcept;
+    void write(Program const& program) noexcept;
+    void write(UniformBuffer const& uniformBuffer) noexcept;
+    void write(SamplerBuffer const& samplerBuffer) noexcept;
+
+private:
+    struct Record;
+
+    template<typename T>
+    void writeRaw(T const& v) noexcept {
+        mOut.write(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    void writeBytes(void const* data, size_t size) noexcept;
+
+    std::ofstream mOut;
+    Dispatcher mDispatcher;
+    Dispatcher mTarget;
+    CommandId mCommand = CommandId::COUNT;
+
+    static CommandTraceRecorder* sRecorder;
+};
+
+/*
+ * Replays a command trace on a driver created for the occasion, on the calling thread.
+ *
+ * Each iteration replays the whole trace, then destroys the objects it left alive. The commands
+ * of each frame are encoded first and only their execution is timed, so the timings only
+ * include the cost of the driver. Swap chains are replayed headless, external images and
+ * streams are ignored.
+ */
+class CommandTraceReplayer {
+public:
+    struct Options {
+        driver::Backend backend = driver::Backend::DEFAULT; // DEFAULT: the trace's backend
+        uint32_t iterations = 1;
+        uint32_t width = 1280;  // size of the swap chains
+        uint32_t height = 720;
+    };
+
+    struct Results {
+        uint32_t frames = 0;
+        uint64_t commands = 0;
+        double totalMs = 0;     // time spent executing commands, all frames
+        double minFrameMs = 0;
+        double medianFrameMs = 0;
+        double maxFrameMs = 0;
+    };
+
+    CommandTraceReplayer() noexcept;
+    ~CommandTraceReplayer() noexcept;
+
+    CommandTraceReplayer(CommandTraceReplayer const&) = delete;
+    CommandTraceReplayer& operator=(CommandTraceReplayer const&) = delete;
+
+    // loads the trace in memory, returns false if it's not a valid trace
+    bool load(const char* path);
+
+    driver::Backend getTraceBackend() const noexcept { return mTraceBackend; }
+
+    // returns false if the backend couldn't be initialized, or can't replay this trace
+    bool replay(Options const& options, Results* results);
+
+private:
+    template<typename T> struct Tag { };
+
+    struct LiveHandle {
+        HandleBase::HandleId id;
+        CommandId creator;
+        uint64_t serial;
+    };
+
+    template<typename T>
+    T readRaw() noexcept {
+        T v{};
+        if (UTILS_LIKELY(sizeof(T) <= size_t(mEnd - mCursor))) {
+            memcpy(&v, mCursor, sizeof(T));
+            mCursor += sizeof(T);
+        } else {
+            mError = true;
+            mCursor = mEnd;
+        }
+        return v;
+    }
+
+    template<typename T, typename = typename std::enable_if<
+            std::is_integral<T>::value || std::is_enum<T>::value>::type>
+    T read(Tag<T>) noexcept {
+        using W = typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type;
+        return T(readRaw<W>());
+    }
+
+    float read(Tag<float>) noexcept { return readRaw<float>(); }
+
+    template<typename T>
+    Handle<T> read(Tag<Handle<T>>) noexcept {
+        return translate(Handle<T>(HandleBase::NO_INIT), readRaw<HandleBase::HandleId>());
+    }
+
+    template<typename T>
+    T* read(Tag<T*>) noexcept { return nullptr; }
+
+    const char* read(Tag<const char*>) noexcept;
+    utils::CString read(Tag<utils::CString>) noexcept;
+    Driver::AttributeArray read(Tag<Driver::AttributeArray>) noexcept;
+    Driver::FaceOffsets read(Tag<Driver::FaceOffsets>) noexcept;
+    Driver::RasterState read(Tag<Driver::RasterState>) noexcept;
+    Driver::RenderPassParams read(Tag<Driver::RenderPassParams>) noexcept;
+    Driver::TargetBufferInfo read(Tag<Driver::TargetBufferInfo>) noexcept;
+    Driver::BufferDescriptor read(Tag<Driver::BufferDescriptor>) noexcept;
+    Driver::PixelBufferDescriptor read(Tag<Driver::PixelBufferDescriptor>) noexcept;
+    Program read(Tag<Program>) noexcept;
+    UniformBuffer read(Tag<UniformBuffer>) noexcept;
+    SamplerBuffer read(Tag<SamplerBuffer>) noexcept;
+
+    template<typename... ARGS>
+    std::tuple<typename std::decay<ARGS>::type...> readArgs(void (Driver::*)(ARGS...)) noexcept {
+        // the order of evaluation of a braced-init-list is guaranteed
+        return std::tuple<typename std::decay<ARGS>::type...>{
+                read(Tag<typename std::decay<ARGS>::type>{})... };
+    }
+
+    // same as readArgs() for the commands creating a handle, without that handle
+    template<typename R, typename... ARGS>
+    std::tuple<typename std::decay<ARGS>::type...> readCreateArgs(
+            void (Driver::*)(R, ARGS...)) noexcept {
+        return std::tuple<typename std::decay<ARGS>::type...>{
+                read(Tag<typename std::decay<ARGS>::type>{})... };
+    }
+
+    HandleBase::HandleId translate(HandleBase::HandleId id) const noexcept;
+
+    template<typename T>
+    Handle<T> translate(Handle<T> const&, HandleBase::HandleId recorded) const noexcept {
+        const HandleBase::HandleId id = translate(recorded);
+        return id != HandleBase::nullid ? Handle<T>(id) : Handle<T>();
+    }
+
+    template<typename T>
+    Handle<T> translate(Handle<T> const& recorded) const noexcept {
+        return translate(recorded, recorded.getId());
+    }
+    void addHandle(HandleBase::HandleId recorded, HandleBase::HandleId id, CommandId creator);
+    void removeHandle(HandleBase::HandleId recorded) noexcept;
+
+    // returns the data of a BufferDescriptor and the callback freeing it, if any
+    void* readBuffer(size_t* size, Driver::BufferDescriptor::Callback* callback) noexcept;
+
+    void* allocateFrameData(size_t size);
+    const uint8_t* readBytes(size_t size) noexcept;
+
+    // decodes the next command and records it into the stream
+    void replayCommand(CommandId command, CommandStream& stream);
+    void destroyLiveHandles(CommandStream& stream);
+
+    std::vector<uint8_t> mTrace;
+    const uint8_t* mCursor = nullptr;
+    const uint8_t* mEnd = nullptr;
+    bool mError = false;
+    driver::Backend mTraceBackend = driver::Backend::DEFAULT;
+    CommandId mCommand = CommandId::COUNT;
+    Options mOptions;
+    Driver* mDriver = nullptr;
+
+    // recorded handle id -> handle id in the replay
+    std::unordered_map<HandleBase::HandleId, LiveHandle> mHandles;
+    uint64_t mHandleSerial = 0;
+
+    // data that must live until the commands of the current frame have executed
+    std::vector<std::unique_ptr<uint8_t[]>> mFrameData;
+
+    // interface blocks of the programs, they must outlive the programs
+    std::deque<UniformInterfaceBlock> mUniformBlocks;
+    std::deque<SamplerInterfaceBlock> mSamplerBlocks;
+    std::deque<SamplerBindingMap> mSamplerBindings;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDTRACE_H
@@ -18,6 +18,8 @@
 #include "driver/Driver.h"
 #include "driver/CommandStream.h"
 
+#include <details/Texture.h> // for FTexture::getFormatSize
+
 #include <math/half.h>
 #include <math/quat.h>
 #include <math/vec2.h>
@@ -27,6 +29,8 @@
 #include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/PixelBufferDescriptor.h>
 
+#include <algorithm>
+
 using namespace utils;
 
 namespace filament {
@@ -45,9 +49,14 @@ DriverBase::~DriverBase() noexcept {
 
 void DriverBase::purge() noexcept {
     std::vector<BufferDescriptor> buffersToPurge;
+    std::vector<AcquiredImage> imagesToRelease;
     std::unique_lock<std::mutex> lock(mPurgeLock);
     std::swap(buffersToPurge, mBufferToPurge);
+    std::swap(imagesToRelease, mImagesToRelease);
     lock.unlock(); // don't remove this, it ensures mBufferToPurge is destroyed without lock held
+    for (AcquiredImage const& image : imagesToRelease) {
+        image.callback(image.image, image.userData);
+    }
 }
 
 void DriverBase::scheduleDestroySlow(BufferDescriptor&& buffer) noexcept {
@@ -55,6 +64,13 @@ void DriverBase::scheduleDestroySlow(BufferDescriptor&& buffer) noexcept {
     mBufferToPurge.push_back(std::move(buffer));
 }
 
+void DriverBase::scheduleRelease(AcquiredImage const& image) noexcept {
+    if (image.callback) {
+        std::lock_guard<std::mutex> lock(mPurgeLock);
+        mImagesToRelease.push_back(image);
+    }
+}
+
 // ------------------------------------------------------------------------------------------------
 // Texture format data...
 // ------------------------------------------------------------------------------------------------
@@ -167,10 +183,111 @@ Driver::SamplerFormat DriverBase::getSamplerFormat(TextureFormat format) noexcep
     return findTextureInfo(format)->samplerFormat;
 }
 
+size_t DriverBase::getTextureMemorySize(TextureFormat format, SamplerType target, uint8_t levels,
+        uint8_t samples, uint32_t width, uint32_t height, uint32_t depth) noexcept {
+    if (target == SamplerType::SAMPLER_EXTERNAL) {
+        // the storage belongs to the stream
+        return 0;
+    }
+
+    // compressed formats are stored in blocks of 4x4 texels, ASTC is accounted as its
+    // largest variant (4x4 blocks), BPTC blocks are always 16 bytes.
+    size_t blockSize = 0;
+    if (isETC2Compression(format) || isS3TCCompression(format)) {
+        switch (format) {
+            case TextureFormat::EAC_R11:
+            case TextureFormat::EAC_R11_SIGNED:
+            case TextureFormat::ETC2_RGB8:
+            case TextureFormat::ETC2_SRGB8:
+            case TextureFormat::ETC2_RGB8_A1:
+            case TextureFormat::ETC2_SRGB8_A1:
+            case TextureFormat::DXT1_RGB:
+            case TextureFormat::DXT1_RGBA:
+                blockSize = 8;
+                break;
+            default:
+                blockSize = 16;
+                break;
+        }
+    } else if (isASTCCompression(format) || isBPTCCompression(format)) {
+        blockSize = 16;
+    }
+
+    const size_t texelSize = std::max(details::FTexture::getFormatSize(format), size_t(1));
+    // the depth of 3D textures shrinks with the levels, unlike the layers of arrays
+    const bool volume = target == SamplerType::SAMPLER_3D;
+    size_t size = 0;
+    for (size_t level = 0, c = std::max(levels, uint8_t(1)); level < c; level++) {
+        const size_t w = std::max(width >> level, 1u);
+        const size_t h = std::max(height >> level, 1u);
+        const size_t d = volume ? std::max(depth >> level, 1u) : 1;
+        size += (blockSize ? ((w + 3) / 4) * ((h + 3) / 4) * blockSize : w * h * texelSize) * d;
+    }
+
+    const size_t faces = target == SamplerType::SAMPLER_CUBEMAP ? 6 : 1;
+    const size_t layers = volume ? 1 : std::max(depth, 1u);
+    return size * faces * layers * std::max(samples, uint8_t(1));
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void GpuMemoryTracker::track(Type type, HandleBase::HandleId id, size_t size) noexcept {
+    Counters& counters = mCounters[size_t(type)];
+    auto pos = mSizes.find(key(type, id));
+    if (pos == mSizes.end()) {
+        mSizes.insert({ key(type, id), size });
+        counters.count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        counters.used.fetch_sub(pos->second, std::memory_order_relaxed);
+        mTotal -= pos->second;
+        pos.value() = size;
+    }
+    counters.used.fetch_add(size, std::memory_order_relaxed);
+    mTotal += size;
+    // the driver thread is the only writer, the high watermark doesn't need a CAS loop
+    if (mTotal > mHighWatermark.load(std::memory_order_relaxed)) {
+        mHighWatermark.store(mTotal, std::memory_order_relaxed);
+    }
+}
+
+void GpuMemoryTracker::untrack(Type type, HandleBase::HandleId id) noexcept {
+    auto pos = mSizes.find(key(type, id));
+    if (pos != mSizes.end()) {
+        Counters& counters = mCounters[size_t(type)];
+        counters.used.fetch_sub(pos->second, std::memory_order_relaxed);
+        counters.count.fetch_sub(1, std::memory_order_relaxed);
+        mTotal -= pos->second;
+        mSizes.erase(pos);
+    }
+}
+
+Driver::GpuMemoryStats GpuMemoryTracker::getStats() const noexcept {
+    Driver::GpuMemoryStats stats;
+    for (size_t i = 0; i < Driver::GPU_MEMORY_TYPE_COUNT; i++) {
+        stats.used[i] = mCounters[i].used.load(std::memory_order_relaxed);
+        stats.count[i] = mCounters[i].count.load(std::memory_order_relaxed);
+    }
+    stats.highWatermark = mHighWatermark.load(std::memory_order_relaxed);
+    return stats;
+}
+
 // ------------------------------------------------------------------------------------------------
 
 Driver::~Driver() noexcept = default;
 
+void Driver::executeSegments(JobSystem&, CommandBase* const* segments, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        executeCommands(segments[i]);
+    }
+}
+
+void Driver::executeCommands(CommandBase* base) {
+    UTILS_ALIGN_LOOP
+    while (UTILS_LIKELY(base)) {
+        base = base->execute(*this);
+    }
+}
+
 // forward to DriverBase, where the implementation really is
 Driver::SamplerPrecision Driver::getSamplerPrecision(TextureFormat format) noexcept {
     return DriverBase::getSamplerPrecision(format);
@@ -26,6 +26,7 @@
 #include <utils/compiler.h>
 #include <utils/Log.h>
 
+#include <filament/driver/BlobCache.h>
 #include <filament/driver/PixelBufferDescriptor.h>
 #include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/Platform.h>
@@ -37,10 +38,15 @@
 #include "driver/SamplerBuffer.h"
 #include "driver/UniformBuffer.h"
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 template<typename T>
 class ConcreteDispatcher;
+class CommandBase;
 class Dispatcher;
 
 /* ------------------------------------------------------------------------------------------------
@@ -51,7 +57,9 @@ class Dispatcher;
 class Driver {
 public:
     // constants
-    static constexpr size_t MAX_ATTRIBUTE_BUFFER_COUNT = 8;
+    static constexpr size_t MAX_ATTRIBUTE_BUFFER_COUNT = 16;
+    // GLES 3.0 guarantees 4 draw buffers
+    static constexpr size_t MAX_COLOR_ATTACHMENT_COUNT = 4;
 
     /*
      * Driver types...
@@ -62,7 +70,7 @@ public:
     using PrimitiveType = driver::PrimitiveType;
     using UniformType = driver::UniformType;
     using ElementType = driver::ElementType;
-    using Usage = driver::Usage;
+    using BufferUsage = driver::BufferUsage;
     using TextureFormat = driver::TextureFormat;
     using TextureUsage = driver::TextureUsage;
     using TextureCubemapFace = driver::TextureCubemapFace;
@@ -82,6 +90,8 @@ public:
     using FenceStatus = driver::FenceStatus;
     using TargetBufferFlags = driver::TargetBufferFlags;
     using RenderPassParams = driver::RenderPassParams;
+    using DrawIndirectCommand = driver::DrawIndirectCommand;
+    using ImageAccess = driver::ImageAccess;
 
     static constexpr uint64_t FENCE_WAIT_FOR_EVER = driver::FENCE_WAIT_FOR_EVER;
 
@@ -93,11 +103,13 @@ public:
     using ProgramHandle         = Handle<HwProgram>;
     using SamplerBufferHandle   = Handle<HwSamplerBuffer>;
     using UniformBufferHandle   = Handle<HwUniformBuffer>;
+    using BufferObjectHandle    = Handle<HwBufferObject>;
     using TextureHandle         = Handle<HwTexture>;
     using RenderTargetHandle    = Handle<HwRenderTarget>;
     using FenceHandle           = Handle<HwFence>;
     using SwapChainHandle       = Handle<HwSwapChain>;
     using StreamHandle          = Handle<HwStream>;
+    using TimerQueryHandle      = Handle<HwTimerQuery>;
 
     struct Attribute {
         static constexpr uint8_t FLAG_NORMALIZED     = 0x1;
@@ -120,6 +132,27 @@ public:
         SHADOW = 3,
     };
 
+    // kinds of GPU resources whose memory is accounted, see getGpuMemoryStats()
+    enum class GpuMemoryType : uint8_t {
+        VERTEX_BUFFER,
+        INDEX_BUFFER,
+        UNIFORM_BUFFER,
+        TEXTURE,
+        RENDER_TARGET,      // buffers owned by render targets, i.e. not attached textures
+        PROGRAM,            // only counted, the size of programs isn't known
+        BUFFER_OBJECT,      // storage buffers
+    };
+
+    static constexpr size_t GPU_MEMORY_TYPE_COUNT = 7;
+
+    // GPU memory used by the resources of each GpuMemoryType, in bytes. Sizes are estimated
+    // from the dimensions and formats of the resources, the actual allocations can be larger.
+    struct GpuMemoryStats {
+        size_t used[GPU_MEMORY_TYPE_COUNT] = {};
+        size_t count[GPU_MEMORY_TYPE_COUNT] = {};
+        size_t highWatermark = 0;           // maximum of the sum of used[]
+    };
+
     struct TargetBufferInfo {
         // ctor for 2D textures
         TargetBufferInfo(TextureHandle h, uint8_t level = 0) noexcept
@@ -144,6 +177,35 @@ public:
         TargetBufferInfo() noexcept { }
     };
 
+    // header of a record in the buffer given to updateUniformBufferRanges(). It is immediately
+    // followed by 'size' bytes of uniform data, and the next record starts at the following
+    // multiple of 4 bytes.
+    struct UniformRangeUpdate {
+        UniformBufferHandle ubh;
+        uint32_t offset;
+        uint32_t size;
+
+        static constexpr size_t getRecordSize(size_t size) noexcept {
+            return sizeof(UniformRangeUpdate) + ((size + 3u) & ~size_t(3u));
+        }
+    };
+
+    // kinds of the handles that can be destroyed with destroyHandles()
+    enum class HandleType : uint8_t {
+        RENDER_PRIMITIVE,
+        VERTEX_BUFFER,
+        INDEX_BUFFER,
+        TEXTURE,
+        UNIFORM_BUFFER,
+        SAMPLER_BUFFER,
+    };
+
+    // an element of the array given to destroyHandles()
+    struct DestroyedHandle {
+        HandleBase::HandleId id;
+        HandleType type;
+    };
+
     struct RasterState {
         using CullingMode = driver::CullingMode;
         using DepthFunc = driver::SamplerCompareFunc;
@@ -203,6 +265,16 @@ public:
             };
             uint32_t u = 0;
         };
+
+        // the bits of each group of fields in u, so that the fields that changed between two
+        // states can be found with a XOR; the bitfields above are allocated from the least
+        // significant bit on.
+        static constexpr uint32_t CULLING_MASK              = 0x00000003u;
+        static constexpr uint32_t BLENDING_MASK             = 0x00FFFFFCu;
+        static constexpr uint32_t DEPTH_WRITE_MASK          = 0x01000000u;
+        static constexpr uint32_t DEPTH_FUNC_MASK           = 0x0E000000u;
+        static constexpr uint32_t COLOR_WRITE_MASK          = 0x10000000u;
+        static constexpr uint32_t ALPHA_TO_COVERAGE_MASK    = 0x20000000u;
     };
 
     static SamplerFormat getSamplerFormat(TextureFormat format) noexcept;
@@ -210,7 +282,8 @@ public:
     static size_t getElementTypeSize(ElementType type) noexcept;
 
     // This is here to be compatible with CommandStream (nice for debugging)
-    inline void queueCommand(const std::function<void()>& command) {
+    template<typename F>
+    inline void queueCommand(F&& command) {
         command();
     }
 
@@ -229,6 +302,14 @@ public:
 
     virtual Dispatcher& getDispatcher() noexcept = 0;
 
+    // Executes 'count' segments of the command stream recorded by secondary streams, each ending
+    // with a jump to nullptr (see CommandStream::reserveSegments()). Segments are executed in
+    // order on the calling thread by default. Drivers that can record commands from several
+    // threads can execute them concurrently on the jobs of 'js' instead, as long as the result
+    // is the same.
+    virtual void executeSegments(utils::JobSystem& js, CommandBase* const* segments,
+            size_t count);
+
 #ifndef NDEBUG
     virtual void debugCommand(const char* methodName) {}
 #endif
@@ -253,6 +334,10 @@ public:
     void methodName(RetType, paramsDecl) {}
 
 #include "driver/DriverAPI.inc"
+
+protected:
+    // executes the commands starting at 'base' until a jump to nullptr
+    void executeCommands(CommandBase* base);
 };
 
 } // namespace filament
@@ -266,7 +351,7 @@ utils::io::ostream& operator<<(utils::io::ostream& out, const filament::Driver::
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::ShaderModel model);
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::PrimitiveType type);
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::ElementType type);
-utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::Usage usage);
+utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::BufferUsage usage);
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::CullingMode mode);
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::SamplerType type);
 utils::io::ostream& operator<<(utils::io::ostream& out, filament::driver::SamplerFormat format);
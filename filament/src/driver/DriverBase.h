@@ -18,16 +18,24 @@
 #define TNT_FILAMENT_DRIVER_DRIVERBASE_H
 
 #include <array>
+#include <atomic>
 #include <mutex>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
 #include <assert.h>
 #include <stdint.h>
 
 #include <utils/compiler.h>
 #include <utils/CString.h>
+#include <utils/Log.h>
+
+#include <tsl/robin_map.h>
 
 #include <filament/driver/DriverEnums.h>
 
 #include "driver/Driver.h"
+#include "driver/HandleAllocator.h"
 #include "driver/SamplerBuffer.h"
 #include "driver/UniformBuffer.h"
 
@@ -104,6 +112,12 @@ struct HwUniformBuffer : public HwBase {
     UniformBuffer ub;
 };
 
+struct HwBufferObject : public HwBase {
+    HwBufferObject() noexcept = default;
+    explicit HwBufferObject(uint32_t byteCount) noexcept : byteCount(byteCount) { }
+    uint32_t byteCount = 0;
+};
+
 struct HwTexture : public HwBase {
     HwTexture(driver::SamplerType target, uint8_t levels, uint8_t samples,
               uint32_t width, uint32_t height, uint32_t depth) noexcept
@@ -136,11 +150,59 @@ struct HwSwapChain : public HwBase {
 struct HwStream : public HwBase {
     HwStream() = default;
     explicit HwStream(driver::Platform::Stream* stream) : stream(stream) { }
+    explicit HwStream(driver::StreamType streamType) : streamType(streamType) { }
     driver::Platform::Stream* stream = nullptr;
+    driver::StreamType streamType = driver::StreamType::NATIVE;
     uint32_t width = 0;
     uint32_t height = 0;
 };
 
+struct HwTimerQuery : public HwBase {
+    // GPU time elapsed between beginTimerQuery() and endTimerQuery(), in nanoseconds. Set by the
+    // driver thread once the GPU is done, 0 until then or once getTimerQueryValue() read it.
+    std::atomic<uint64_t> elapsed{ 0 };
+};
+
+// an image pushed to an ACQUIRED stream, and how to give it back to its owner
+struct AcquiredImage {
+    void* image = nullptr;
+    driver::StreamCallback callback = nullptr;
+    void* userData = nullptr;
+};
+
+/*
+ * Keeps track of the GPU memory used by a driver, per type of resource.
+ * track() and untrack() must be called from the driver thread, getStats() from any thread.
+ */
+class GpuMemoryTracker {
+public:
+    using Type = Driver::GpuMemoryType;
+
+    // records the size of a new resource, or the new size of a resized one
+    void track(Type type, HandleBase::HandleId id, size_t size) noexcept;
+
+    // forgets a destroyed resource, does nothing if it wasn't tracked
+    void untrack(Type type, HandleBase::HandleId id) noexcept;
+
+    Driver::GpuMemoryStats getStats() const noexcept;
+
+private:
+    static uint64_t key(Type type, HandleBase::HandleId id) noexcept {
+        return (uint64_t(type) << 32u) | id;
+    }
+
+    // size of each resource, only accessed by the driver thread
+    tsl::robin_map<uint64_t, size_t> mSizes;
+
+    struct Counters {
+        std::atomic<size_t> used = { 0 };
+        std::atomic<size_t> count = { 0 };
+    };
+    Counters mCounters[Driver::GPU_MEMORY_TYPE_COUNT];
+    size_t mTotal = 0;      // only accessed by the driver thread
+    std::atomic<size_t> mHighWatermark = { 0 };
+};
+
 /*
  * Base class of all Driver implementations
  */
@@ -154,6 +216,10 @@ public:
     static SamplerFormat getSamplerFormat(TextureFormat format) noexcept;
     static SamplerPrecision getSamplerPrecision(TextureFormat format) noexcept;
 
+    // estimated size in bytes of a texture's storage, including all its levels and faces
+    static size_t getTextureMemorySize(TextureFormat format, SamplerType target, uint8_t levels,
+            uint8_t samples, uint32_t width, uint32_t height, uint32_t depth) noexcept;
+
     void purge() noexcept final;
 
     Dispatcher& getDispatcher() noexcept final { return *mDispatcher; }
@@ -173,6 +239,64 @@ protected:
 
     void scheduleDestroySlow(BufferDescriptor&& buffer) noexcept;
 
+    // the image's callback is called on the user thread, at the next purge()
+    void scheduleRelease(AcquiredImage const& image) noexcept;
+
+    GpuMemoryTracker mGpuMemory;
+
+    // Handles are allocated on the application thread and destroyed on the driver thread,
+    // see HandleAllocator.
+    HandleAllocator mHandleAllocator;
+
+    HandleBase::HandleId allocateHandle(size_t size) noexcept {
+        return mHandleAllocator.alloc(size);
+    }
+
+    template<typename D, typename B, typename ... ARGS>
+    typename std::enable_if<std::is_base_of<B, D>::value, D>::type*
+    construct(Handle<B> const& handle, ARGS&& ... args) noexcept {
+        assert(handle);
+        static_assert(sizeof(D) <= HandleAllocator::MAX_HANDLE_SIZE, "Handle<> too large");
+        D* addr = handle_cast<D*>(handle);
+        new(addr) D(std::forward<ARGS>(args)...);
+#if !defined(NDEBUG) && UTILS_HAS_RTTI
+        addr->typeId = typeid(D).name();
+#endif
+        return addr;
+    }
+
+    template<typename B, typename D,
+            typename = typename std::enable_if<std::is_base_of<B, D>::value, D>::type>
+    void destruct(Handle<B> const& handle, D const* p) noexcept {
+        // allow to destroy the nullptr, similarly to operator delete
+        if (p) {
+#if !defined(NDEBUG) && UTILS_HAS_RTTI
+            if (UTILS_UNLIKELY(p->typeId != typeid(D).name())) {
+                utils::slog.e << "Destroying handle " << handle.getId() << ", type "
+                        << typeid(D).name() << ", but handle's actual type is " << p->typeId
+                        << utils::io::endl;
+                std::terminate();
+            }
+            const_cast<D*>(p)->typeId = "(deleted)";
+#endif
+            p->~D();
+            mHandleAllocator.free(handle.getId());
+        }
+    }
+
+    /*
+     * handle_cast
+     *
+     * casts a Handle<> to a pointer to the data it refers to.
+     */
+    template<typename Dp, typename B>
+    typename std::enable_if<
+            std::is_pointer<Dp>::value &&
+            std::is_base_of<B, typename std::remove_pointer<Dp>::type>::value, Dp>::type
+    handle_cast(Handle<B> const& handle) const noexcept {
+        return static_cast<Dp>(mHandleAllocator.handleToPointer(handle.getId()));
+    }
+
 private:
     using TF = Driver::TextureFormat;
     using SF = Driver::SamplerFormat;
@@ -194,6 +318,7 @@ private:
 
     std::mutex mPurgeLock;
     std::vector<BufferDescriptor> mBufferToPurge;
+    std::vector<AcquiredImage> mImagesToRelease;
 };
 
 
@@ -129,8 +129,12 @@ void GPUBuffer::commitSlow(driver::DriverApi& driverApi, void const* begin, void
     const driver::PixelDataType type = mType;
     const uint32_t w = mWidth;
     for (auto const& range : mDirtyRanges) {
-        // we need a new PixelBufferDescriptor for each range (std:move)
-        PixelBufferDescriptor desc(begin, sizeInBytes, format, type);
+        // we need a new PixelBufferDescriptor for each range (std:move), which only
+        // covers the rows of that range
+        const size_t offset = range.start * mRowSizeInBytes;
+        const size_t size = std::min(size_t(sizeInBytes),
+                size_t(range.end) * mRowSizeInBytes) - std::min(size_t(sizeInBytes), offset);
+        PixelBufferDescriptor desc(static_cast<char const*>(begin) + offset, size, format, type);
         driverApi.load2DImage(texture, 0,
                 0, range.start,
                 w, range.getCount(), std::move(desc));
@@ -59,11 +59,13 @@ template io::ostream& operator<<(io::ostream& out, const Handle<HwRenderPrimitiv
 template io::ostream& operator<<(io::ostream& out, const Handle<HwProgram>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwSamplerBuffer>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwUniformBuffer>& h) noexcept;
+template io::ostream& operator<<(io::ostream& out, const Handle<HwBufferObject>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwTexture>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwRenderTarget>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwFence>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwSwapChain>& h) noexcept;
 template io::ostream& operator<<(io::ostream& out, const Handle<HwStream>& h) noexcept;
+template io::ostream& operator<<(io::ostream& out, const Handle<HwTimerQuery>& h) noexcept;
 #endif
 
 } // namespace filament
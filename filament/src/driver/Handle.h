@@ -38,8 +38,10 @@ struct HwRenderTarget;
 struct HwSamplerBuffer;
 struct HwTexture;
 struct HwUniformBuffer;
+struct HwBufferObject;
 struct HwSwapChain;
 struct HwStream;
+struct HwTimerQuery;
 
 /*
  * A type handle to a h/w resource
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/HandleAllocator.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include <utils/Log.h>
+#include <utils/memalign.h>
+#include <utils/Panic.h>
+
+using namespace utils;
+
+namespace filament {
+
+static size_t getSizeClass(size_t size) noexcept {
+    size_t sizeClass = 0;
+    while ((size_t(16) << sizeClass) < size) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+HandleAllocator::HandleAllocator() noexcept {
+    std::fill(std::begin(mCache), std::end(mCache), EMPTY);
+}
+
+HandleAllocator::~HandleAllocator() noexcept {
+#ifndef NDEBUG
+    slog.d << "Handles: " << mSlabCount << " slabs of " << SLAB_SIZE / 1024 << " KiB"
+           << io::endl;
+#endif
+    for (size_t i = 0; i < mSlabCount; i++) {
+        utils::aligned_free(mSlabs[i]);
+    }
+}
+
+HandleBase::HandleId HandleAllocator::alloc(size_t size) noexcept {
+    assert(size <= MAX_HANDLE_SIZE);
+    const size_t sizeClass = getSizeClass(size);
+    std::lock_guard<LockingPolicy::SpinLock> guard(mAllocLock);
+    HandleId id = mCache[sizeClass];
+    if (UTILS_UNLIKELY(id == EMPTY)) {
+        // take all the slots freed so far, or make new ones
+        id = mFreeLists[sizeClass].head.exchange(EMPTY, std::memory_order_acquire);
+        if (id == EMPTY) {
+            id = grow(sizeClass);
+        }
+    }
+    mCache[sizeClass] = next(id);
+    return id;
+}
+
+void HandleAllocator::free(HandleId id) noexcept {
+    FreeList& list = mFreeLists[mSlabSizeClass[id >> SLOT_BITS]];
+    HandleId& head = next(id);
+    head = list.head.load(std::memory_order_relaxed);
+    while (!list.head.compare_exchange_weak(head, id,
+            std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+UTILS_NOINLINE
+HandleBase::HandleId HandleAllocator::grow(size_t sizeClass) noexcept {
+    ASSERT_POSTCONDITION(mSlabCount < MAX_SLAB_COUNT, "Out of driver handles");
+    const size_t slab = mSlabCount;
+    mSlabs[slab] = static_cast<char*>(utils::aligned_alloc(SLAB_SIZE, size_t(1) << MIN_ALIGNMENT_SHIFT));
+    mSlabSizeClass[slab] = uint8_t(sizeClass);
+    mSlabCount++;
+
+    // link all the slots of the slab, in order
+    const HandleId first = HandleId(slab << SLOT_BITS);
+    const HandleId stride = HandleId(1u << sizeClass);
+    const HandleId last = first + HandleId(SLAB_SIZE >> MIN_ALIGNMENT_SHIFT) - stride;
+    for (HandleId id = first; id < last; id += stride) {
+        next(id) = id + stride;
+    }
+    next(last) = EMPTY;
+    return first;
+}
+
+} // namespace filament
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
+#define TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Allocator.h>
+#include <utils/compiler.h>
+
+#include "driver/Handle.h"
+
+namespace filament {
+
+/*
+ * Allocates the memory of the drivers' handles, and maps the handle ids to it.
+ *
+ * Handles are allocated by the application thread when the commands creating them are queued,
+ * and freed by the driver thread when the commands destroying them execute, so both can happen
+ * at the same time:
+ * - free() pushes the slot on an atomic free list of its size class, without a lock,
+ * - alloc() pops from a cache shared by the allocating threads, which takes the whole free
+ *   list at once when it runs out, so a single atomic operation covers many allocations and
+ *   there is no ABA problem,
+ * - when there are no free slots left, a new slab is added.
+ *
+ * The allocating threads are the application thread and the loader threads, if any (see
+ * FEngine::attachLoaderThread()), alloc() serializes them with a spin lock which is almost
+ * never contended. The ids can be used on any thread once they were handed over through the
+ * command stream, and the memory of a handle never moves.
+ */
+class HandleAllocator {
+public:
+    using HandleId = HandleBase::HandleId;
+
+    static constexpr size_t MAX_HANDLE_SIZE = 1024;
+
+    HandleAllocator() noexcept;
+    ~HandleAllocator() noexcept;
+
+    HandleAllocator(HandleAllocator const&) = delete;
+    HandleAllocator& operator=(HandleAllocator const&) = delete;
+
+    // returns a handle of at least size bytes, aligned to 16 bytes
+    HandleId alloc(size_t size) noexcept;
+
+    // gives back the memory of a handle, which must be destroyed already
+    void free(HandleId id) noexcept;
+
+    void* handleToPointer(HandleId id) const noexcept {
+        return mSlabs[id >> SLOT_BITS] + ((id & SLOT_MASK) << MIN_ALIGNMENT_SHIFT);
+    }
+
+    size_t getSlabCount() const noexcept { return mSlabCount; }
+
+private:
+    static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+    static constexpr size_t SLOT_BITS = 12;         // 16 bytes slots in a slab
+    static constexpr HandleId SLOT_MASK = (1u << SLOT_BITS) - 1u;
+    static constexpr size_t MAX_SLAB_COUNT = 1024;  // i.e. 64 MiB of handles
+    static constexpr size_t SIZE_CLASS_COUNT = 7;   // 16 to 1024 bytes
+    static constexpr HandleId EMPTY = HandleBase::nullid;
+
+    static_assert((SLAB_SIZE >> MIN_ALIGNMENT_SHIFT) == (1u << SLOT_BITS), "SLOT_BITS mismatch");
+    static_assert((16u << (SIZE_CLASS_COUNT - 1)) == MAX_HANDLE_SIZE, "SIZE_CLASS_COUNT mismatch");
+
+    // the first bytes of a free slot link it to the next one
+    HandleId& next(HandleId id) const noexcept {
+        return *static_cast<HandleId*>(handleToPointer(id));
+    }
+
+    HandleId grow(size_t sizeClass) noexcept;
+
+    // written by the allocating threads only, before the ids they cover are handed over
+    char* mSlabs[MAX_SLAB_COUNT] = {};
+    uint8_t mSlabSizeClass[MAX_SLAB_COUNT] = {};
+    size_t mSlabCount = 0;
+
+    // the free slots of the allocating threads, per size class
+    HandleId mCache[SIZE_CLASS_COUNT];
+
+    // held by alloc()
+    utils::LockingPolicy::SpinLock mAllocLock;
+
+    // the slots freed since the cache was last refilled, on their own cache line since they're
+    // written by the other thread
+    struct FreeList {
+        std::atomic<HandleId> head = { EMPTY };
+        uint8_t padding[64 - sizeof(std::atomic<HandleId>)];
+    };
+    uint8_t mPadding[64];
+    FreeList mFreeLists[SIZE_CLASS_COUNT];
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <filament/driver/BlobCache.h>
 #include <filament/driver/Platform.h>
 
 #if defined(ANDROID)
@@ -52,6 +53,10 @@
     #endif
 #endif
 
+#if defined(FILAMENT_DRIVER_SUPPORTS_NOOP)
+    #include "driver/noop/PlatformNoop.h"
+#endif
+
 namespace filament {
 namespace driver {
 
@@ -62,6 +67,8 @@ OpenGLPlatform::~OpenGLPlatform() noexcept = default;
 
 VulkanPlatform::~VulkanPlatform() noexcept = default;
 
+BlobCache::~BlobCache() noexcept = default;
+
 // Creates the platform-specific Platform object. The caller takes ownership and is
 // responsible for destroying it. Initialization of the backend API is deferred until
 // createDriver(). The passed-in backend hint is replaced with the resolved backend.
@@ -70,6 +77,13 @@ Platform* Platform::create(Backend* backend) noexcept {
     if (*backend == Backend::DEFAULT) {
         *backend = Backend::OPENGL;
     }
+    if (*backend == Backend::NOOP) {
+        #if defined(FILAMENT_DRIVER_SUPPORTS_NOOP)
+            return new PlatformNoop();
+        #else
+            return nullptr;
+        #endif
+    }
     if (*backend == Backend::VULKAN) {
         #if defined(FILAMENT_DRIVER_SUPPORTS_VULKAN)
             #if defined(ANDROID)
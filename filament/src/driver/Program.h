@@ -29,18 +29,22 @@
 #include <filament/SamplerBindingMap.h>
 #include <filament/UniformInterfaceBlock.h>
 
+#include "driver/Handle.h"
+
 namespace filament {
 
 class Program {
 public:
 
-    static constexpr size_t NUM_SHADER_TYPES = 2;
+    static constexpr size_t NUM_SHADER_TYPES = 3;
     static constexpr size_t NUM_UNIFORM_BINDINGS = filament::BindingPoints::COUNT;
     static constexpr size_t NUM_SAMPLER_BINDINGS = filament::BindingPoints::COUNT;
 
+    // a program has either a vertex and a fragment shader, or only a compute shader
     enum class Shader : uint8_t {
         VERTEX = 0,
-        FRAGMENT = 1
+        FRAGMENT = 1,
+        COMPUTE = 2
     };
 
     Program() noexcept;
@@ -72,9 +76,18 @@ public:
         return shader(Shader::FRAGMENT, std::forward<T>(source));
     }
 
+    template <typename T>
+    Program& withComputeShader(T source) {
+        return shader(Shader::COMPUTE, std::forward<T>(source));
+    }
+
     // sets up sampler bindings for this program
     Program& withSamplerBindings(const SamplerBindingMap* bindings);
 
+    // sets the program drawn instead of this one until it's compiled, if the backend compiles
+    // programs in the background. Without a fallback, the first draw waits for the compilation.
+    Program& fallback(Handle<HwProgram> program);
+
     // in order to workaround certain driver bugs, we need to be able to modify the
     // shader string (this happens in OpenGLProgram.cpp)
     std::array<utils::CString, NUM_SHADER_TYPES>&
@@ -113,6 +126,10 @@ public:
         return mSamplerCount > 0;
     }
 
+    Handle<HwProgram> getFallback() const noexcept {
+        return mFallback;
+    }
+
 private:
 #if !defined(NDEBUG)
     friend utils::io::ostream& operator<< (utils::io::ostream& out, const Program& builder);
@@ -124,7 +141,8 @@ private:
     std::array<utils::CString, NUM_SHADER_TYPES> mShadersSource;
     size_t mSamplerCount = 0;
     utils::CString mName;
-    uint8_t mVariant;
+    uint8_t mVariant = 0;
+    Handle<HwProgram> mFallback;
 };
 
 } // namespace filament;
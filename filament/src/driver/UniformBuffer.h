@@ -62,9 +62,18 @@ public:
     }
 
     // invalidate a range of uniforms and return a pointer to it. offset and size given in bytes
+    // the invalidated range is merged into a single dirty range, which is what gets uploaded.
     void* invalidateUniforms(size_t offset, size_t size) {
         assert(offset + size <= mSize);
-        mSomethingDirty = true;
+        const uint32_t begin = uint32_t(offset);
+        const uint32_t end = uint32_t(offset + size);
+        if (mDirtyBegin >= mDirtyEnd) {
+            mDirtyBegin = begin;
+            mDirtyEnd = end;
+        } else {
+            mDirtyBegin = std::min(mDirtyBegin, begin);
+            mDirtyEnd = std::max(mDirtyEnd, end);
+        }
         return static_cast<char*>(mBuffer) + offset;
     }
 
@@ -75,10 +84,19 @@ public:
     size_t getSize() const noexcept { return mSize; }
 
     // return if any uniform has been changed
-    bool isDirty() const noexcept { return mSomethingDirty; }
+    bool isDirty() const noexcept { return mDirtyBegin < mDirtyEnd; }
+
+    // offset in bytes of the smallest range covering all the modified uniforms
+    size_t getDirtyOffset() const noexcept { return mDirtyBegin; }
+
+    // size in bytes of the smallest range covering all the modified uniforms, 0 if clean
+    size_t getDirtySize() const noexcept { return isDirty() ? mDirtyEnd - mDirtyBegin : 0; }
 
     // mark the whole buffer as clean (no modified uniforms)
-    void clean() const noexcept { mSomethingDirty = false; }
+    void clean() const noexcept { mDirtyBegin = mDirtyEnd = 0; }
+
+    // mark the whole buffer as dirty
+    void invalidate() const noexcept { mDirtyBegin = 0; mDirtyEnd = mSize; }
 
     /*
      * -----------------------------------------------
@@ -157,11 +175,14 @@ private:
 
     // TODO: we need a better to calculate this local storage.
     // Probably the better thing to do would be to use a special allocator.
-    // Local storage is limited by the total size of a handle (128 byte for GL)
-    char mStorage[96];
+    // Local storage is limited by the total size of a handle (128 byte for GL), what's left
+    // after the dirty range bookkeeping below.
+    char mStorage[88];
     void *mBuffer = nullptr;
     uint32_t mSize = 0;
-    mutable bool mSomethingDirty = false;
+    // modified range [mDirtyBegin, mDirtyEnd) in bytes, empty when clean
+    mutable uint32_t mDirtyBegin = 0;
+    mutable uint32_t mDirtyEnd = 0;
 };
 
 // specialization for float3 (which has a different alignment)
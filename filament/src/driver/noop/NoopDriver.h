@@ -32,7 +32,14 @@ public:
     static Driver* create();
 
 private:
-    virtual ShaderModel getShaderModel() const noexcept override final { return ShaderModel::UNKNOWN; }
+    // the materials are parsed and their programs "created" like they are with OpenGL
+    virtual ShaderModel getShaderModel() const noexcept override final {
+#if defined(ANDROID) || defined(__EMSCRIPTEN__)
+        return ShaderModel::GL_ES_30;
+#else
+        return ShaderModel::GL_CORE_41;
+#endif
+    }
 
     /*
      * Driver interface
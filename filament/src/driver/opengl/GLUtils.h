@@ -122,6 +122,18 @@ constexpr inline GLenum getComponentType(filament::driver::ElementType type) noe
     }
 }
 
+constexpr inline GLenum getBufferUsage(filament::driver::BufferUsage usage) noexcept {
+    using BufferUsage = filament::driver::BufferUsage;
+    switch (usage) {
+        case BufferUsage::STATIC:
+            return GL_STATIC_DRAW;
+        case BufferUsage::DYNAMIC:
+            return GL_DYNAMIC_DRAW;
+        case BufferUsage::STREAM:
+            return GL_STREAM_DRAW;
+    }
+}
+
 constexpr inline GLenum getCubemapTarget(filament::driver::TextureCubemapFace face) noexcept {
     return GL_TEXTURE_CUBE_MAP_POSITIVE_X + GLenum(face);
 }
@@ -421,6 +433,25 @@ constexpr /* inline */ GLenum getInternalFormat(filament::driver::TextureFormat
             // this should not happen
             return 0;
 #endif
+
+#if defined(GL_ARB_texture_compression_bptc)
+        case TextureFormat::RGBA_BPTC_UNORM:         return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+        case TextureFormat::SRGB_ALPHA_BPTC_UNORM:   return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB;
+        case TextureFormat::RGB_BPTC_SIGNED_FLOAT:   return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB;
+        case TextureFormat::RGB_BPTC_UNSIGNED_FLOAT: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB;
+#elif defined(GL_EXT_texture_compression_bptc)
+        case TextureFormat::RGBA_BPTC_UNORM:         return GL_COMPRESSED_RGBA_BPTC_UNORM_EXT;
+        case TextureFormat::SRGB_ALPHA_BPTC_UNORM:   return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_EXT;
+        case TextureFormat::RGB_BPTC_SIGNED_FLOAT:   return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_EXT;
+        case TextureFormat::RGB_BPTC_UNSIGNED_FLOAT: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_EXT;
+#else
+        case TextureFormat::RGBA_BPTC_UNORM:
+        case TextureFormat::SRGB_ALPHA_BPTC_UNORM:
+        case TextureFormat::RGB_BPTC_SIGNED_FLOAT:
+        case TextureFormat::RGB_BPTC_UNSIGNED_FLOAT:
+            // this should not happen
+            return 0;
+#endif
     }
 }
 
@@ -16,6 +16,7 @@
 
 #include "driver/opengl/OpenGLDriver.h"
 
+#include <algorithm>
 #include <set>
 
 #include <utils/compiler.h>
@@ -27,6 +28,7 @@
 #include "driver/CommandStream.h"
 #include "driver/opengl/OpenGLProgram.h"
 #include "driver/opengl/OpenGLBlitter.h"
+#include "driver/opengl/OpenGLUploader.h"
 
 #include <filament/driver/Platform.h>
 
@@ -98,7 +100,6 @@ Driver* OpenGLDriver::create(
 
 OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
         : DriverBase(new ConcreteDispatcher<OpenGLDriver>(this)),
-          mHandleArena("Handles", 2U * 1024U * 1024U), // TODO: set the amount in configuration
           mSamplerMap(32),
           mPlatform(*platform) {
     state.enables.caps.set(getIndexForCap(GL_DITHER));
@@ -128,6 +129,7 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
     glGetIntegerv(GL_MAJOR_VERSION, &major);
     glGetIntegerv(GL_MINOR_VERSION, &minor);
     glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &mMaxRenderBufferSize);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &mUniformBufferOffsetAlignment);
 
     if (strstr(renderer, "Adreno")) {
         bugs.clears_hurt_performance = true;
@@ -167,6 +169,8 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
         }
         if (major == 3 && minor >= 1) {
             features.multisample_texture = true;
+            features.draw_indirect = true;
+            features.compute = true;
         }
         initExtensionsGLES(major, minor, exts);
     } else if (GL41_HEADERS) {
@@ -175,9 +179,24 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
         }
         initExtensionsGL(major, minor, exts);
         features.multisample_texture = true;
+        features.draw_indirect = true;
+        features.multi_draw_indirect = (major == 4 && minor >= 3) ||
+                hasExtension(exts, "GL_ARB_multi_draw_indirect");
+        features.compute = (major == 4 && minor >= 3) ||
+                (hasExtension(exts, "GL_ARB_compute_shader") &&
+                 hasExtension(exts, "GL_ARB_shader_storage_buffer_object") &&
+                 hasExtension(exts, "GL_ARB_shader_image_load_store"));
     };
     mShaderModel = shaderModel;
 
+    // program binaries are only usable if the driver has at least one format for them
+    GLint programBinaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormats);
+    features.program_binary = programBinaryFormats > 0;
+
+    // program binaries created by another driver can't be loaded, they're keyed on this
+    mDriverVersion = std::string(vendor) + renderer + version;
+
     /*
      * Set our default state
      */
@@ -185,6 +204,9 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
     disable(GL_DITHER);
     enable(GL_DEPTH_TEST);
 
+    // the raster state is only updated where it changes, so GL must start from mRasterState
+    setRasterStateSlow(mRasterState, ~0u);
+
     // TODO: Don't enable scissor when it is not necessary. This optimization could be done here in
     // the driver by simply deferring the enable until the scissor rect is smaller than the window.
     enable(GL_SCISSOR_TEST);
@@ -207,8 +229,8 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
     glHint(GL_FRAGMENT_SHADER_DERIVATIVE_HINT, GL_NICEST);
 #endif
 
-    // For the shadow pass
-    glPolygonOffset(1.0f, 1.0f);
+    // For the shadow pass, this is changed by setPolygonOffset()
+    glPolygonOffset(state.raster.polygonOffset[0], state.raster.polygonOffset[1]);
 
     // On some implementation we need to clear the viewport with a triangle, for performance
     // reasons
@@ -219,10 +241,19 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
         mOpenGLBlitter = new OpenGLBlitter(*this);
         mOpenGLBlitter->init();
     }
+
+    // the large uploads are done on a thread of their own if the platform can share a context
+    // with it
+    mUploader = new OpenGLUploader(*this, mPlatform);
+    if (!mUploader->init()) {
+        delete mUploader;
+        mUploader = nullptr;
+    }
 }
 
 OpenGLDriver::~OpenGLDriver() noexcept {
     delete mOpenGLBlitter;
+    delete mUploader;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -236,25 +267,61 @@ bool OpenGLDriver::hasExtension(std::set<StaticString> const& map, const char* e
 void OpenGLDriver::initExtensionsGLES(GLint major, GLint minor, std::set<StaticString> const& exts) {
     // figure out and initialize the extensions we need
     ext.texture_filter_anisotropic = hasExtension(exts, "GL_EXT_texture_filter_anisotropic");
+#if defined(__EMSCRIPTEN__)
+    // ETC2 is core in GLES 3.0 but not in WebGL 2.0
+    ext.texture_compression_etc2 = hasExtension(exts, "WEBGL_compressed_texture_etc");
+    ext.texture_compression_astc = hasExtension(exts, "WEBGL_compressed_texture_astc");
+    ext.texture_compression_bptc = hasExtension(exts, "EXT_texture_compression_bptc");
+#else
     ext.texture_compression_etc2 = true;
+    ext.texture_compression_astc = hasExtension(exts, "GL_KHR_texture_compression_astc_ldr");
+    ext.texture_compression_bptc = hasExtension(exts, "GL_EXT_texture_compression_bptc");
+#endif
     ext.QCOM_tiled_rendering = hasExtension(exts, "GL_QCOM_tiled_rendering");
+    ext.QCOM_texture_foveated = hasExtension(exts, "GL_QCOM_texture_foveated");
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = hasExtension(exts, "GL_EXT_color_buffer_half_float");
     ext.texture_compression_s3tc = hasExtension(exts, "WEBGL_compressed_texture_s3tc");
     ext.EXT_multisampled_render_to_texture = hasExtension(exts, "GL_EXT_multisampled_render_to_texture");
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
+    ext.EXT_disjoint_timer_query = hasExtension(exts, "GL_EXT_disjoint_timer_query");
+    ext.EXT_shader_framebuffer_fetch = hasExtension(exts, "GL_EXT_shader_framebuffer_fetch");
 }
 
 void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, std::set<StaticString> const& exts) {
     ext.texture_filter_anisotropic = hasExtension(exts, "GL_EXT_texture_filter_anisotropic");
     ext.texture_compression_etc2 = hasExtension(exts, "GL_ARB_ES3_compatibility");
     ext.texture_compression_s3tc = hasExtension(exts, "GL_EXT_texture_compression_s3tc");
+    ext.texture_compression_astc = hasExtension(exts, "GL_KHR_texture_compression_astc_ldr");
+    ext.texture_compression_bptc = (major == 4 && minor >= 2) || major > 4 ||
+            hasExtension(exts, "GL_ARB_texture_compression_bptc");
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = true;  // Assumes core profile.
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile") ||
+            hasExtension(exts, "GL_ARB_parallel_shader_compile");
+    ext.EXT_disjoint_timer_query = true;  // GL_TIME_ELAPSED queries are core since GL 3.3
+    ext.ARB_sparse_texture = hasExtension(exts, "GL_ARB_sparse_texture");
 }
 
 void OpenGLDriver::terminate() {
+    if (mUploader) {
+        mUploader->terminate();
+    }
+    updatePendingReadPixels(true);
+    updatePendingImageReleases(true);
+    updatePendingUploadStages(true);
+    glDeleteBuffers(GLsizei(mFreePixelPackBuffers.size()), mFreePixelPackBuffers.data());
+    mFreePixelPackBuffers.clear();
+    for (UploadStage const& stage : mFreeUploadStages) {
+        glDeleteBuffers(1, &stage.pbo);
+    }
+    mFreeUploadStages.clear();
+    if (mDrawIndirectBuffer) {
+        glDeleteBuffers(1, &mDrawIndirectBuffer);
+        mDrawIndirectBuffer = 0;
+    }
     for (auto& item : mSamplerMap) {
         unbindSampler(item.second);
         glDeleteSamplers(1, &item.second);
@@ -417,14 +484,32 @@ void OpenGLDriver::bindBuffer(GLenum target, GLuint buffer) noexcept {
 void OpenGLDriver::bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept {
     size_t targetIndex = getIndexForBufferTarget(target);
     // this ALSO sets the generic binding
-    if (state.buffers.targets[targetIndex].buffers[index] != buffer
-            || state.buffers.targets[targetIndex].genericBinding != buffer) {
-        state.buffers.targets[targetIndex].buffers[index] = buffer;
-        state.buffers.targets[targetIndex].genericBinding = buffer;
+    auto& t = state.buffers.targets[targetIndex];
+    if (t.buffers[index] != buffer || t.offsets[index] != 0 || t.sizes[index] != 0
+            || t.genericBinding != buffer) {
+        t.buffers[index] = buffer;
+        t.offsets[index] = 0;
+        t.sizes[index] = 0;
+        t.genericBinding = buffer;
         glBindBufferBase(target, index, buffer);
     }
 }
 
+void OpenGLDriver::bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+        GLintptr offset, GLsizeiptr size) noexcept {
+    size_t targetIndex = getIndexForBufferTarget(target);
+    // this ALSO sets the generic binding
+    auto& t = state.buffers.targets[targetIndex];
+    if (t.buffers[index] != buffer || t.offsets[index] != offset || t.sizes[index] != size
+            || t.genericBinding != buffer) {
+        t.buffers[index] = buffer;
+        t.offsets[index] = offset;
+        t.sizes[index] = size;
+        t.genericBinding = buffer;
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+}
+
 void OpenGLDriver::bindFramebuffer(GLenum target, GLuint buffer) noexcept {
     switch (target) {
         case GL_FRAMEBUFFER:
@@ -480,6 +565,34 @@ void OpenGLDriver::useProgram(GLuint program) noexcept {
     });
 }
 
+OpenGLProgram* OpenGLDriver::getFallbackProgram(OpenGLProgram* p) noexcept {
+    Driver::ProgramHandle fallback = p->getFallback();
+    if (fallback) {
+        OpenGLProgram* f = handle_cast<OpenGLProgram*>(fallback);
+        if (f->isReady(this)) {
+            return f;
+        }
+    }
+    p->wait(this);
+    return p;
+}
+
+void OpenGLDriver::updatePendingCompilations() noexcept {
+    auto& compilations = mPendingCompilations;
+    compilations.erase(std::remove_if(compilations.begin(), compilations.end(),
+            [this](BufferDescriptor& compilation) {
+                Driver::ProgramHandle* programs =
+                        static_cast<Driver::ProgramHandle*>(compilation.buffer);
+                for (size_t i = 0, c = compilation.size / sizeof(*programs); i < c; i++) {
+                    if (programs[i] && !handle_cast<OpenGLProgram*>(programs[i])->isReady(this)) {
+                        return false;
+                    }
+                }
+                scheduleDestroy(std::move(compilation));
+                return true;
+            }), compilations.end());
+}
+
 void OpenGLDriver::useProgram(OpenGLProgram* p) noexcept {
     useProgram(p->gl.program);
     // set-up textures and samplers in the proper TMUs (as specified in setSamplers)
@@ -572,57 +685,69 @@ void OpenGLDriver::depthFunc(GLenum func) noexcept {
     });
 }
 
-void OpenGLDriver::setRasterStateSlow(Driver::RasterState rs) noexcept {
+void OpenGLDriver::setRasterStateSlow(Driver::RasterState rs, uint32_t changed) noexcept {
     mRasterState = rs;
 
     // culling state
-    switch (rs.culling) {
-        case CullingMode::NONE:
-            disable(GL_CULL_FACE);
-            break;
-        case CullingMode::FRONT:
-            cullFace(GL_FRONT);
-            break;
-        case CullingMode::BACK:
-            cullFace(GL_BACK);
-            break;
-        case CullingMode::FRONT_AND_BACK:
-            cullFace(GL_FRONT_AND_BACK);
-            break;
-    }
+    if (changed & RasterState::CULLING_MASK) {
+        switch (rs.culling) {
+            case CullingMode::NONE:
+                disable(GL_CULL_FACE);
+                break;
+            case CullingMode::FRONT:
+                cullFace(GL_FRONT);
+                break;
+            case CullingMode::BACK:
+                cullFace(GL_BACK);
+                break;
+            case CullingMode::FRONT_AND_BACK:
+                cullFace(GL_FRONT_AND_BACK);
+                break;
+        }
 
-    if (rs.culling != CullingMode::NONE) {
-        enable(GL_CULL_FACE);
+        if (rs.culling != CullingMode::NONE) {
+            enable(GL_CULL_FACE);
+        }
     }
 
     // blending state
-    if (!rs.hasBlending()) {
-        disable(GL_BLEND);
-    } else {
-        enable(GL_BLEND);
-        blendEquation(
-                getBlendEquationMode(rs.blendEquationRGB),
-                getBlendEquationMode(rs.blendEquationAlpha));
-
-        blendFunction(
-                getBlendFunctionMode(rs.blendFunctionSrcRGB),
-                getBlendFunctionMode(rs.blendFunctionSrcAlpha),
-                getBlendFunctionMode(rs.blendFunctionDstRGB),
-                getBlendFunctionMode(rs.blendFunctionDstAlpha));
+    if (changed & RasterState::BLENDING_MASK) {
+        if (!rs.hasBlending()) {
+            disable(GL_BLEND);
+        } else {
+            enable(GL_BLEND);
+            blendEquation(
+                    getBlendEquationMode(rs.blendEquationRGB),
+                    getBlendEquationMode(rs.blendEquationAlpha));
+
+            blendFunction(
+                    getBlendFunctionMode(rs.blendFunctionSrcRGB),
+                    getBlendFunctionMode(rs.blendFunctionSrcAlpha),
+                    getBlendFunctionMode(rs.blendFunctionDstRGB),
+                    getBlendFunctionMode(rs.blendFunctionDstAlpha));
+        }
     }
 
     // depth test
-    depthFunc(getDepthFunc(rs.depthFunc));
+    if (changed & RasterState::DEPTH_FUNC_MASK) {
+        depthFunc(getDepthFunc(rs.depthFunc));
+    }
 
     // write masks
-    colorMask(GLboolean(rs.colorWrite));
-    depthMask(GLboolean(rs.depthWrite));
+    if (changed & RasterState::COLOR_WRITE_MASK) {
+        colorMask(GLboolean(rs.colorWrite));
+    }
+    if (changed & RasterState::DEPTH_WRITE_MASK) {
+        depthMask(GLboolean(rs.depthWrite));
+    }
 
     // AA
-    if (rs.alphaToCoverage) {
-        enable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-    } else {
-        disable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+    if (changed & RasterState::ALPHA_TO_COVERAGE_MASK) {
+        if (rs.alphaToCoverage) {
+            enable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        } else {
+            disable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        }
     }
 }
 
@@ -673,6 +798,7 @@ default_case:
 //    GLFence                   :  8
 //    GLIndexBuffer             : 12        moderate
 //    GLSamplerBuffer           : 16        moderate
+//    GLBufferObject            : 12        few
 // -- less than 16 bytes
 
 //    GLRenderPrimitive         : 40        many
@@ -682,88 +808,11 @@ default_case:
 // -- less than 64 bytes
 
 //    GLVertexBuffer            : 80        moderate
-//    GLStream                  : 120       few
+//    GLStream                  : 128       few
 //    GLUniformBuffer           : 128       many
 // -- less than 128 bytes
 
 
-OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
-        : mPool0(area.begin(),
-                  pointermath::add(area.begin(), (1 * area.getSize()) / 16)),
-          mPool1( pointermath::add(area.begin(), (1 * area.getSize()) / 16),
-                  pointermath::add(area.begin(), (6 * area.getSize()) / 16)),
-          mPool2( pointermath::add(area.begin(), (6 * area.getSize()) / 16),
-                  area.end()) {
-
-#ifndef NDEBUG
-    slog.d << "HwFence: " << sizeof(HwFence) << io::endl;
-    slog.d << "GLIndexBuffer: " << sizeof(GLIndexBuffer) << io::endl;
-    slog.d << "GLSamplerBuffer: " << sizeof(GLSamplerBuffer) << io::endl;
-    slog.d << "GLRenderPrimitive: " << sizeof(GLRenderPrimitive) << io::endl;
-    slog.d << "GLTexture: " << sizeof(GLTexture) << io::endl;
-    slog.d << "OpenGLProgram: " << sizeof(OpenGLProgram) << io::endl;
-    slog.d << "GLRenderTarget: " << sizeof(GLRenderTarget) << io::endl;
-    slog.d << "GLVertexBuffer: " << sizeof(GLVertexBuffer) << io::endl;
-    slog.d << "GLUniformBuffer: " << sizeof(GLUniformBuffer) << io::endl;
-    slog.d << "GLStream: " << sizeof(GLStream) << io::endl;
-#endif
-}
-
-void* OpenGLDriver::HandleAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
-    assert(size <= mPool2.getSize());
-    if (size <= mPool0.getSize()) return mPool0.alloc(size, 16, extra);
-    if (size <= mPool1.getSize()) return mPool1.alloc(size, 32, extra);
-    if (size <= mPool2.getSize()) return mPool2.alloc(size, 32, extra);
-    return nullptr;
-}
-
-void OpenGLDriver::HandleAllocator::free(void* p, size_t size) noexcept {
-    if (size <= mPool0.getSize()) { mPool0.free(p); return; }
-    if (size <= mPool1.getSize()) { mPool1.free(p); return; }
-    if (size <= mPool2.getSize()) { mPool2.free(p); return; }
-}
-
-
-// This is "NOINLINE" because it ends-up generating more code than we'd like because of
-// the locking (unfortunately, mHandleArena is accessed from 2 threads)
-UTILS_NOINLINE
-HandleBase::HandleId OpenGLDriver::allocateHandle(size_t size) noexcept {
-    void* addr = mHandleArena.alloc(size);
-    char* const base = (char *)mHandleArena.getArea().begin();
-    size_t offset = (char*)addr - base;
-    return HandleBase::HandleId(offset >> HandleAllocator::MIN_ALIGNMENT_SHIFT);
-}
-
-template<typename D, typename B, typename ... ARGS>
-typename std::enable_if<std::is_base_of<B, D>::value, D>::type*
-OpenGLDriver::construct(Handle<B> const& handle, ARGS&& ... args) noexcept {
-    assert(handle);
-    static_assert(sizeof(D) <= 128, "Handle<> too large");
-    D* addr = handle_cast<D *>(const_cast<Handle<B>&>(handle));
-    new(addr) D(std::forward<ARGS>(args)...);
-#if !defined(NDEBUG) && UTILS_HAS_RTTI
-    addr->typeId = typeid(D).name();
-#endif
-    return addr;
-}
-
-template <typename B, typename D, typename>
-void OpenGLDriver::destruct(Handle<B>& handle, D const* p) noexcept {
-    // allow to destroy the nullptr, similarly to operator delete
-    if (p) {
-#if !defined(NDEBUG) && UTILS_HAS_RTTI
-        if (UTILS_UNLIKELY(p->typeId != typeid(D).name())) {
-            slog.e << "Destroying handle " << handle.getId() << ", type " << typeid(D).name()
-                   << ", but handle's actual type is " << p->typeId << io::endl;
-            std::terminate();
-        }
-        const_cast<D *>(p)->typeId = "(deleted)";
-#endif
-        p->~D();
-        mHandleArena.free(const_cast<D*>(p), sizeof(D));
-    }
-}
-
 Handle<HwVertexBuffer> OpenGLDriver::createVertexBufferSynchronous() noexcept {
     return Handle<HwVertexBuffer>( allocateHandle(sizeof(GLVertexBuffer)) );
 }
@@ -788,10 +837,18 @@ Handle<HwUniformBuffer> OpenGLDriver::createUniformBufferSynchronous() noexcept
     return Handle<HwUniformBuffer>( allocateHandle(sizeof(GLUniformBuffer)) );
 }
 
+Handle<HwBufferObject> OpenGLDriver::createBufferObjectSynchronous() noexcept {
+    return Handle<HwBufferObject>( allocateHandle(sizeof(GLBufferObject)) );
+}
+
 Handle<HwTexture> OpenGLDriver::createTextureSynchronous() noexcept {
     return Handle<HwTexture>( allocateHandle(sizeof(GLTexture)) );
 }
 
+Handle<HwTexture> OpenGLDriver::createSparseTextureSynchronous() noexcept {
+    return Handle<HwTexture>( allocateHandle(sizeof(GLTexture)) );
+}
+
 Handle<HwRenderTarget> OpenGLDriver::createDefaultRenderTargetSynchronous() noexcept {
     return Handle<HwRenderTarget>( allocateHandle(sizeof(GLRenderTarget)) );
 }
@@ -804,55 +861,79 @@ Handle<HwFence> OpenGLDriver::createFenceSynchronous() noexcept {
     return Handle<HwFence>( allocateHandle(sizeof(HwFence)) );
 }
 
+Handle<HwTimerQuery> OpenGLDriver::createTimerQuerySynchronous() noexcept {
+    return Handle<HwTimerQuery>( allocateHandle(sizeof(GLTimerQuery)) );
+}
+
 Handle<HwSwapChain> OpenGLDriver::createSwapChainSynchronous() noexcept {
     return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
 }
 
+Handle<HwSwapChain> OpenGLDriver::createSwapChainHeadlessSynchronous() noexcept {
+    return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
+}
+
 Handle<HwStream> OpenGLDriver::createStreamFromTextureIdSynchronous() noexcept {
     return Handle<HwStream>( allocateHandle(sizeof(GLStream)) );
 }
 
+Handle<HwStream> OpenGLDriver::createStreamAcquiredSynchronous() noexcept {
+    return Handle<HwStream>( allocateHandle(sizeof(GLStream)) );
+}
+
+// figure out the size needed for a buffer of a vertex buffer
+static size_t getBufferSize(HwVertexBuffer const* vb, size_t index) noexcept {
+    size_t size = 0;
+    for (auto const& item : vb->attributes) {
+        if (item.buffer == index) {
+            size_t end = item.offset + vb->vertexCount * item.stride;
+            size = std::max(size, end);
+        }
+    }
+    return size;
+}
+
 void OpenGLDriver::createVertexBuffer(
     Driver::VertexBufferHandle vbh,
     uint8_t bufferCount,
     uint8_t attributeCount,
     uint32_t elementCount,
-    Driver::AttributeArray attributes) {
+    Driver::AttributeArray attributes,
+    Driver::BufferUsage usage) {
     DEBUG_MARKER()
 
     GLVertexBuffer* vb = construct<GLVertexBuffer>(vbh,
             bufferCount, attributeCount, elementCount, attributes);
+    vb->gl.usage = getBufferUsage(usage);
 
     GLsizei n = GLsizei(vb->bufferCount);
     glGenBuffers(n, vb->gl.buffers.data());
 
+    size_t memorySize = 0;
     for (GLsizei i = 0; i < n; i++) {
-        // figure out the size needed for each buffer
-        size_t size = 0;
-        for (auto const& item : attributes) {
-            if (item.buffer == i) {
-                size_t end = item.offset + elementCount * item.stride;
-                size = std::max(size, end);
-            }
-        }
+        const size_t size = getBufferSize(vb, size_t(i));
         bindBuffer(GL_ARRAY_BUFFER, vb->gl.buffers[i]);
-        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, vb->gl.usage);
+        memorySize += size;
     }
+    mGpuMemory.track(GpuMemoryType::VERTEX_BUFFER, vbh.getId(), memorySize);
 
     CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
-        uint32_t indexCount) {
+        uint32_t indexCount, Driver::BufferUsage usage) {
     DEBUG_MARKER()
 
     uint8_t elementSize = static_cast<uint8_t>(getElementTypeSize(elementType));
     GLIndexBuffer* ib = construct<GLIndexBuffer>(ibh, elementSize, indexCount);
+    ib->gl.usage = getBufferUsage(usage);
     glGenBuffers(1, &ib->gl.buffer);
     GLsizeiptr size = elementSize * indexCount;
     bindVertexArray(nullptr);
     bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, ib->gl.usage);
+    mGpuMemory.track(GpuMemoryType::INDEX_BUFFER, ibh.getId(), size_t(size));
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -867,7 +948,8 @@ void OpenGLDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int)
 void OpenGLDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
     DEBUG_MARKER()
 
-    construct<OpenGLProgram>(ph, this, program);
+    construct<OpenGLProgram>(ph, this, std::move(program));
+    mGpuMemory.track(GpuMemoryType::PROGRAM, ph.getId(), 0);
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -884,6 +966,20 @@ void OpenGLDriver::createUniformBuffer(Driver::UniformBufferHandle ubh, size_t s
     glGenBuffers(1, &ub->gl.ubo);
     bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
     glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    mGpuMemory.track(GpuMemoryType::UNIFORM_BUFFER, ubh.getId(), size);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::createBufferObject(Driver::BufferObjectHandle boh,
+        uint32_t byteCount, Driver::BufferUsage usage) {
+    DEBUG_MARKER()
+
+    GLBufferObject* bo = construct<GLBufferObject>(boh, byteCount);
+    bo->gl.usage = getBufferUsage(usage);
+    glGenBuffers(1, &bo->gl.id);
+    bindBuffer(GL_SHADER_STORAGE_BUFFER, bo->gl.id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, byteCount, nullptr, bo->gl.usage);
+    mGpuMemory.track(GpuMemoryType::BUFFER_OBJECT, boh.getId(), byteCount);
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -901,7 +997,8 @@ void OpenGLDriver::textureStorage(OpenGLDriver::GLTexture* t,
             glTexStorage2D(t->gl.target, GLsizei(t->levels), t->gl.internalFormat,
                     GLsizei(width), GLsizei(height));
             break;
-        case GL_TEXTURE_3D: {
+        case GL_TEXTURE_3D:
+        case GL_TEXTURE_2D_ARRAY: {
             glTexStorage3D(t->gl.target, GLsizei(t->levels), t->gl.internalFormat,
                     GLsizei(width), GLsizei(height), GLsizei(depth));
             break;
@@ -966,9 +1063,18 @@ void OpenGLDriver::createTexture(Driver::TextureHandle th, SamplerType target, u
                 t->gl.targetIndex = (uint8_t)
                         getIndexForTextureTarget(t->gl.target = GL_TEXTURE_CUBE_MAP);
                 break;
+            case SamplerType::SAMPLER_2D_ARRAY:
+                t->gl.targetIndex = (uint8_t)
+                        getIndexForTextureTarget(t->gl.target = GL_TEXTURE_2D_ARRAY);
+                break;
+            case SamplerType::SAMPLER_3D:
+                t->gl.targetIndex = (uint8_t)
+                        getIndexForTextureTarget(t->gl.target = GL_TEXTURE_3D);
+                break;
         }
 
-        if (t->samples > 1) {
+        if (t->samples > 1 && (target == SamplerType::SAMPLER_2D ||
+                target == SamplerType::SAMPLER_CUBEMAP)) {
             if (features.multisample_texture) {
                 // multi-sample texture on GL 3.2 / GLES 3.1 and above
                 t->gl.targetIndex = (uint8_t)
@@ -986,15 +1092,79 @@ void OpenGLDriver::createTexture(Driver::TextureHandle th, SamplerType target, u
         textureStorage(t, w, h, depth);
     }
 
+    mGpuMemory.track(GpuMemoryType::TEXTURE, th.getId(),
+            getTextureMemorySize(format, target, levels, t->samples, w, h, depth));
+
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::createSparseTexture(Driver::TextureHandle th, uint8_t levels,
+        TextureFormat format, uint32_t w, uint32_t h) {
+    DEBUG_MARKER()
+
+#ifdef GL_ARB_sparse_texture
+    const GLenum internalFormat = getInternalFormat(format);
+    GLint pageSizeCount = 0;
+    GLint pageWidth = 0;
+    GLint pageHeight = 0;
+    if (ext.ARB_sparse_texture) {
+        glGetInternalformativ(GL_TEXTURE_2D, internalFormat,
+                GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &pageSizeCount);
+        if (pageSizeCount > 0) {
+            glGetInternalformativ(GL_TEXTURE_2D, internalFormat,
+                    GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &pageWidth);
+            glGetInternalformativ(GL_TEXTURE_2D, internalFormat,
+                    GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &pageHeight);
+        }
+    }
+
+    // the first level must be made of whole pages
+    if (pageWidth > 0 && pageHeight > 0 && w % pageWidth == 0 && h % pageHeight == 0) {
+        GLTexture* t = construct<GLTexture>(th, SamplerType::SAMPLER_2D, levels, 1, w, h, 1);
+        glGenTextures(1, &t->gl.texture_id);
+        t->gl.internalFormat = internalFormat;
+        t->gl.targetIndex = (uint8_t)getIndexForTextureTarget(t->gl.target = GL_TEXTURE_2D);
+        t->gl.format = format;
+
+        bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t, t->gl.targetIndex);
+        activeTexture(MAX_TEXTURE_UNITS - 1);
+        glTexParameteri(t->gl.target, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+        glTexParameteri(t->gl.target, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+        textureStorage(t, w, h, 1);
+
+        GLint sparseLevels = 0;
+        glGetTexParameteriv(t->gl.target, GL_NUM_SPARSE_LEVELS_ARB, &sparseLevels);
+        t->gl.sparse = true;
+        t->gl.sparseLevels = uint8_t(std::min(GLint(levels), sparseLevels));
+        t->gl.committedLevel = levels;
+
+        // nothing is committed yet
+        mGpuMemory.track(GpuMemoryType::TEXTURE, th.getId(), 0);
+
+        CHECK_GL_ERROR(utils::slog.e)
+        return;
+    }
+#endif
+
+    // all the levels are allocated up front
+    createTexture(th, SamplerType::SAMPLER_2D, levels, format, 1, w, h, 1, TextureUsage::DEFAULT);
+}
+
+void OpenGLDriver::commitTextureLevel(GLTexture const* t, uint32_t level, bool commit) noexcept {
+#ifdef GL_ARB_sparse_texture
+    glTexPageCommitmentARB(t->gl.target, GLint(level), 0, 0, 0,
+            GLsizei(std::max(1u, t->width >> level)), GLsizei(std::max(1u, t->height >> level)), 1,
+            commit ? GL_TRUE : GL_FALSE);
+#endif
+}
+
 void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
         GLRenderTarget* rt, GLenum attachment) noexcept {
     GLTexture const* t = handle_cast<const GLTexture*>(binfo.handle);
 
     assert(t->target != SamplerType::SAMPLER_EXTERNAL);
 
+    waitUpload(t);
     bindFramebuffer(GL_FRAMEBUFFER, rt->gl.fbo);
     switch (t->target) {
         case SamplerType::SAMPLER_2D:
@@ -1022,6 +1192,9 @@ void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
                     target, t->gl.texture_id, binfo.level);
             break;
         }
+        case SamplerType::SAMPLER_2D_ARRAY:
+        case SamplerType::SAMPLER_3D:
+            // rendering into a layer is not supported
         case SamplerType::SAMPLER_EXTERNAL:
             // cannot happen by construction
             break;
@@ -1103,6 +1276,9 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
     rt->height = height;
     rt->gl.samples = samples;
 
+    // bytes per pixel of the renderbuffers we allocate below, for GPU memory accounting
+    size_t renderBufferSize = 0;
+
     if (targets & TargetBufferFlags::COLOR) {
         // TODO: handle multiple color attachments
         if (color.handle) {
@@ -1112,6 +1288,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
             GLenum internalFormat = getInternalFormat(format);
             framebufferRenderbuffer(&rt->gl.color, GL_COLOR_ATTACHMENT0, internalFormat,
                     width, height, samples, rt->gl.fbo);
+            renderBufferSize += getTextureMemorySize(format, SamplerType::SAMPLER_2D, 1, 1, 1, 1, 1);
         }
     }
 
@@ -1123,6 +1300,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
             specialCased = true;
             framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8,
                     width, height, samples, rt->gl.fbo);
+            renderBufferSize += 4;
 
         } else if (depth.handle == stencil.handle) {
             // special case: depth & stencil requested, and both provided as the same texture
@@ -1140,6 +1318,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
             } else {
                 framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24,
                         width, height, samples, rt->gl.fbo);
+                renderBufferSize += 4; // DEPTH_COMPONENT24 is usually padded to 32 bits
             }
         }
         if (targets & TargetBufferFlags::STENCIL) {
@@ -1149,6 +1328,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
             } else {
                 framebufferRenderbuffer(&rt->gl.stencil, GL_STENCIL_ATTACHMENT, GL_STENCIL_INDEX8,
                         width, height, samples, rt->gl.fbo);
+                renderBufferSize += 1;
             }
         }
     }
@@ -1158,6 +1338,10 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
     }
 
+    rt->gl.renderBufferSize = uint16_t(renderBufferSize * samples);
+    mGpuMemory.track(GpuMemoryType::RENDER_TARGET, rth.getId(),
+            size_t(rt->gl.renderBufferSize) * width * height);
+
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -1168,6 +1352,15 @@ void OpenGLDriver::createFence(Driver::FenceHandle fh, int) {
     f->fence = mPlatform.createFence();
 }
 
+void OpenGLDriver::createTimerQuery(Driver::TimerQueryHandle tqh, int) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = construct<GLTimerQuery>(tqh);
+    if (ext.EXT_disjoint_timer_query) {
+        glGenQueries(1, &tq->gl.query);
+    }
+}
+
 void OpenGLDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWindow, uint64_t flags) {
     DEBUG_MARKER()
 
@@ -1175,11 +1368,19 @@ void OpenGLDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
     sc->swapChain = mPlatform.createSwapChain(nativeWindow, flags);
 }
 
+void OpenGLDriver::createSwapChainHeadless(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    DEBUG_MARKER()
+
+    HwSwapChain* sc = construct<HwSwapChain>(sch);
+    sc->swapChain = mPlatform.createSwapChain(width, height, flags);
+}
+
 void OpenGLDriver::createStreamFromTextureId(Driver::StreamHandle sh,
         intptr_t externalTextureId, uint32_t width, uint32_t height) {
     DEBUG_MARKER()
 
-    GLStream* s = construct<GLStream>(sh);
+    GLStream* s = construct<GLStream>(sh, StreamType::TEXTURE_ID);
     // It would be better if we could query the externalTextureId size, unfortunately
     // this is not supported in GL for GL_TEXTURE_EXTERNAL_OES targets
     s->width = width;
@@ -1192,6 +1393,13 @@ void OpenGLDriver::createStreamFromTextureId(Driver::StreamHandle sh,
     }
 }
 
+void OpenGLDriver::createStreamAcquired(Driver::StreamHandle sh, int) {
+    DEBUG_MARKER()
+
+    GLStream* s = construct<GLStream>(sh, StreamType::ACQUIRED);
+    s->acquired.reset(new GLStream::Acquired);
+}
+
 // ------------------------------------------------------------------------------------------------
 // Destroying driver objects
 // ------------------------------------------------------------------------------------------------
@@ -1201,6 +1409,7 @@ void OpenGLDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
 
     if (vbh) {
         GLVertexBuffer const* eb = handle_cast<const GLVertexBuffer*>(vbh);
+        waitUpload(eb);
         GLsizei n = GLsizei(eb->bufferCount);
         glDeleteBuffers(n, eb->gl.buffers.data());
         // bindings of bound buffers are reset to 0
@@ -1211,6 +1420,7 @@ void OpenGLDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
                 target.genericBinding = 0;
             }
         }
+        mGpuMemory.untrack(GpuMemoryType::VERTEX_BUFFER, vbh.getId());
         destruct(vbh, eb);
     }
 }
@@ -1227,6 +1437,7 @@ void OpenGLDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
         if (target.genericBinding == ib->gl.buffer) {
             target.genericBinding = 0;
         }
+        mGpuMemory.untrack(GpuMemoryType::INDEX_BUFFER, ibh.getId());
         destruct(ibh, ib);
     }
 }
@@ -1249,7 +1460,18 @@ void OpenGLDriver::destroyProgram(Driver::ProgramHandle ph) {
     DEBUG_MARKER()
 
     if (ph) {
+        // this program is no longer waited for
+        for (BufferDescriptor const& compilation : mPendingCompilations) {
+            Driver::ProgramHandle* programs =
+                    static_cast<Driver::ProgramHandle*>(compilation.buffer);
+            for (size_t i = 0, c = compilation.size / sizeof(*programs); i < c; i++) {
+                if (programs[i] == ph) {
+                    programs[i].clear();
+                }
+            }
+        }
         OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+        mGpuMemory.untrack(GpuMemoryType::PROGRAM, ph.getId());
         destruct(ph, p);
     }
 }
@@ -1280,15 +1502,39 @@ void OpenGLDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
         if (target.genericBinding == ub->gl.ubo) {
             target.genericBinding = 0;
         }
+        mGpuMemory.untrack(GpuMemoryType::UNIFORM_BUFFER, ubh.getId());
         destruct(ubh, ub);
     }
 }
 
+void OpenGLDriver::destroyBufferObject(Driver::BufferObjectHandle boh) {
+    DEBUG_MARKER()
+
+    if (boh) {
+        GLBufferObject const* bo = handle_cast<const GLBufferObject*>(boh);
+        glDeleteBuffers(1, &bo->gl.id);
+        // bindings of bound buffers are reset to 0
+        const size_t targetIndex = getIndexForBufferTarget(GL_SHADER_STORAGE_BUFFER);
+        auto& target = state.buffers.targets[targetIndex];
+        for (auto& buffer : target.buffers) {
+            if (buffer == bo->gl.id) {
+                buffer = 0;
+            }
+        }
+        if (target.genericBinding == bo->gl.id) {
+            target.genericBinding = 0;
+        }
+        mGpuMemory.untrack(GpuMemoryType::BUFFER_OBJECT, boh.getId());
+        destruct(boh, bo);
+    }
+}
+
 void OpenGLDriver::destroyTexture(Driver::TextureHandle th) {
     DEBUG_MARKER()
 
     if (th) {
         GLTexture* t = handle_cast<GLTexture*>(th);
+        waitUpload(t);
         unbindTexture(t->gl.target, t->gl.texture_id);
         if (UTILS_UNLIKELY(t->hwStream)) {
             detachStream(t);
@@ -1297,6 +1543,7 @@ void OpenGLDriver::destroyTexture(Driver::TextureHandle th) {
             glDeleteSync(t->gl.fence);
         }
         glDeleteTextures(1, &t->gl.texture_id);
+        mGpuMemory.untrack(GpuMemoryType::TEXTURE, th.getId());
         destruct(th, t);
     }
 }
@@ -1326,6 +1573,7 @@ void OpenGLDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
             // finally delete the framebuffer object
             glDeleteFramebuffers(1, &rt->gl.fbo);
         }
+        mGpuMemory.untrack(GpuMemoryType::RENDER_TARGET, rth.getId());
         destruct(rth, rt);
     }
 }
@@ -1353,8 +1601,10 @@ void OpenGLDriver::destroyStream(Driver::StreamHandle sh) {
         if (pos != externalStreams.end()) {
             detachStream(*pos);
         }
-        if (s->isNativeStream()) {
+        if (s->streamType == StreamType::NATIVE) {
             mPlatform.destroyStream(s->stream);
+        } else if (s->streamType == StreamType::ACQUIRED) {
+            releaseAcquiredImage(s);
         } else {
             glDeleteTextures(GLStream::ROUND_ROBIN_TEXTURE_COUNT, s->user_thread.read);
             glDeleteTextures(GLStream::ROUND_ROBIN_TEXTURE_COUNT, s->user_thread.write);
@@ -1369,6 +1619,50 @@ void OpenGLDriver::destroyStream(Driver::StreamHandle sh) {
     }
 }
 
+void OpenGLDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    if (tqh) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        auto& pending = mPendingTimerQueries;
+        pending.erase(std::remove(pending.begin(), pending.end(), tq), pending.end());
+        if (mCurrentTimerQuery == tq) {
+            endTimerQuery(tqh);
+        }
+        glDeleteQueries(1, &tq->gl.query);
+        destruct(tqh, tq);
+    }
+}
+
+void OpenGLDriver::destroyHandles(Driver::BufferDescriptor&& handles) {
+    DEBUG_MARKER()
+
+    auto const* p = static_cast<Driver::DestroyedHandle const*>(handles.buffer);
+    for (size_t i = 0, c = handles.size / sizeof(Driver::DestroyedHandle); i < c; i++) {
+        switch (p[i].type) {
+            case HandleType::RENDER_PRIMITIVE:
+                destroyRenderPrimitive(Driver::RenderPrimitiveHandle(p[i].id));
+                break;
+            case HandleType::VERTEX_BUFFER:
+                destroyVertexBuffer(Driver::VertexBufferHandle(p[i].id));
+                break;
+            case HandleType::INDEX_BUFFER:
+                destroyIndexBuffer(Driver::IndexBufferHandle(p[i].id));
+                break;
+            case HandleType::TEXTURE:
+                destroyTexture(Driver::TextureHandle(p[i].id));
+                break;
+            case HandleType::UNIFORM_BUFFER:
+                destroyUniformBuffer(Driver::UniformBufferHandle(p[i].id));
+                break;
+            case HandleType::SAMPLER_BUFFER:
+                destroySamplerBuffer(Driver::SamplerBufferHandle(p[i].id));
+                break;
+        }
+    }
+    scheduleDestroy(std::move(handles));
+}
+
 // ------------------------------------------------------------------------------------------------
 // Synchronous APIs
 // These are called on the application's thread
@@ -1386,7 +1680,7 @@ void OpenGLDriver::updateStreams(driver::DriverApi* driver) {
         OpenGLBlitter::State state;
         for (GLTexture* t : mExternalStreams) {
             assert(t && t->hwStream);
-            if (!static_cast<GLStream*>(t->hwStream)->isNativeStream()) {
+            if (t->hwStream->streamType == StreamType::TEXTURE_ID) {
                 state.setup();
                 updateStream(t, driver);
             }
@@ -1418,6 +1712,18 @@ Driver::FenceStatus OpenGLDriver::wait(Driver::FenceHandle fh, uint64_t timeout)
     return FenceStatus::ERROR;
 }
 
+bool OpenGLDriver::isNativeFenceSupported() {
+    return mPlatform.canCreateNativeFence();
+}
+
+int OpenGLDriver::dupNativeFence(Driver::FenceHandle fh) {
+    if (fh) {
+        HwFence* f = handle_cast<HwFence*>(fh);
+        return mPlatform.dupNativeFence(f->fence);
+    }
+    return -1;
+}
+
 bool OpenGLDriver::isTextureFormatSupported(Driver::TextureFormat format) {
     if (driver::isETC2Compression(format)) {
         return ext.texture_compression_etc2;
@@ -1425,6 +1731,12 @@ bool OpenGLDriver::isTextureFormatSupported(Driver::TextureFormat format) {
     if (driver::isS3TCCompression(format)) {
         return ext.texture_compression_s3tc;
     }
+    if (driver::isASTCCompression(format)) {
+        return ext.texture_compression_astc;
+    }
+    if (driver::isBPTCCompression(format)) {
+        return ext.texture_compression_bptc;
+    }
     return getInternalFormat(format) != 0;
 }
 
@@ -1488,8 +1800,59 @@ bool OpenGLDriver::isRenderTargetFormatSupported(Driver::TextureFormat format) {
 }
 
 bool OpenGLDriver::isFrameTimeSupported() {
-    // TODO: Measuring the frame time is currently only done using fences
-    return mPlatform.canCreateFence();
+    return ext.EXT_disjoint_timer_query || mPlatform.canCreateFence();
+}
+
+bool OpenGLDriver::isTimerQuerySupported() {
+    return ext.EXT_disjoint_timer_query;
+}
+
+bool OpenGLDriver::isComputeSupported() {
+    return features.compute;
+}
+
+bool OpenGLDriver::isImplicitResolveSupported() {
+    // TODO: EXT_multisampled_render_to_texture resolves implicitly, but our multisampled
+    //       renderbuffers are not allocated with it yet.
+    return false;
+}
+
+bool OpenGLDriver::isFrameBufferFetchSupported() {
+    return ext.EXT_shader_framebuffer_fetch;
+}
+
+bool OpenGLDriver::isMultipleRenderTargetsSupported() {
+    // GL 4.1 and GLES 3.0 have at least 4 draw buffers
+    return true;
+}
+
+bool OpenGLDriver::isDepthReadbackSupported() {
+    // glReadPixels() only reads color buffers on GLES 3.x
+    return GL41_HEADERS;
+}
+
+size_t OpenGLDriver::getUniformBufferOffsetAlignment() {
+    return size_t(mUniformBufferOffsetAlignment);
+}
+
+bool OpenGLDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    // this is called from the application thread, the result is published by the driver thread
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    const uint64_t elapsed = tq->elapsed.exchange(0, std::memory_order_relaxed);
+    if (!elapsed) {
+        return false;
+    }
+    *elapsedTime = elapsed;
+    return true;
+}
+
+Driver::GpuMemoryStats OpenGLDriver::getGpuMemoryStats() {
+    return mGpuMemory.getStats();
+}
+
+size_t OpenGLDriver::getPipelineCacheData(void* data, size_t size) {
+    // GL has no pipeline cache
+    return 0;
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -1520,6 +1883,18 @@ void OpenGLDriver::makeCurrent(Driver::SwapChainHandle schDraw, Driver::SwapChai
 // Updating driver objects
 // ------------------------------------------------------------------------------------------------
 
+// Updates the bound buffer. glBufferSubData() stalls until the GPU is done with the previous
+// content, so a dynamic buffer fully replaced is orphaned instead: the driver then gives it new
+// storage, while the draws in flight keep using the old one.
+static void updateBuffer(GLenum target, void const* data, uint32_t byteOffset,
+        uint32_t byteSize, size_t bufferSize, GLenum usage) noexcept {
+    if (usage != GL_STATIC_DRAW && byteOffset == 0 && byteSize == bufferSize) {
+        glBufferData(target, bufferSize, data, usage);
+    } else {
+        glBufferSubData(target, byteOffset, byteSize, data);
+    }
+}
+
 void OpenGLDriver::loadVertexBuffer(
         Driver::VertexBufferHandle vbh,
         size_t index,
@@ -1531,14 +1906,50 @@ void OpenGLDriver::loadVertexBuffer(
 
     GLVertexBuffer* eb = handle_cast<GLVertexBuffer *>(vbh);
 
+    if (isUploadAsync(eb->gl.upload, byteSize)) {
+        OpenGLUploader::Upload upload;
+        upload.type = OpenGLUploader::Upload::Type::BUFFER;
+        upload.target = GL_ARRAY_BUFFER;
+        upload.name = eb->gl.buffers[index];
+        upload.byteOffset = GLintptr(byteOffset);
+        upload.byteSize = GLsizeiptr(byteSize);
+        upload.bufferSize = GLsizeiptr(getBufferSize(eb, index));
+        upload.usage = eb->gl.usage;
+        upload.data = std::move(p);
+        mPendingBufferUploads += eb->gl.upload ? 0 : 1;
+        eb->gl.upload = mUploader->push(std::move(upload));
+        return;
+    }
+
     bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index]);
-    glBufferSubData(GL_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    updateBuffer(GL_ARRAY_BUFFER, p.buffer, byteOffset, byteSize,
+            getBufferSize(eb, index), eb->gl.usage);
 
     scheduleDestroy(std::move(p));
 
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::copyVertexBuffer(Driver::VertexBufferHandle dst, Driver::VertexBufferHandle src) {
+    DEBUG_MARKER()
+
+    GLVertexBuffer const* d = handle_cast<const GLVertexBuffer *>(dst);
+    GLVertexBuffer const* s = handle_cast<const GLVertexBuffer *>(src);
+    assert(d->bufferCount == s->bufferCount);
+    waitUpload(d);
+    waitUpload(s);
+
+    for (size_t i = 0, n = s->bufferCount; i < n; i++) {
+        const size_t size = getBufferSize(s, i);
+        assert(getBufferSize(d, i) == size);
+        bindBuffer(GL_COPY_READ_BUFFER, s->gl.buffers[i]);
+        bindBuffer(GL_COPY_WRITE_BUFFER, d->gl.buffers[i]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, GLsizeiptr(size));
+    }
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::loadIndexBuffer(
         Driver::IndexBufferHandle ibh,
         BufferDescriptor&& p, uint32_t byteOffset, uint32_t byteSize) {
@@ -1550,7 +1961,24 @@ void OpenGLDriver::loadIndexBuffer(
 
     bindVertexArray(nullptr);
     bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    updateBuffer(GL_ELEMENT_ARRAY_BUFFER, p.buffer, byteOffset, byteSize,
+            ib->elementSize * ib->count, ib->gl.usage);
+
+    scheduleDestroy(std::move(p));
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::updateBufferObject(Driver::BufferObjectHandle boh,
+        BufferDescriptor&& p, uint32_t byteOffset) {
+    DEBUG_MARKER()
+
+    GLBufferObject* bo = handle_cast<GLBufferObject *>(boh);
+    assert(byteOffset + p.size <= bo->byteCount);
+
+    bindBuffer(GL_SHADER_STORAGE_BUFFER, bo->gl.id);
+    updateBuffer(GL_SHADER_STORAGE_BUFFER, p.buffer, byteOffset, uint32_t(p.size),
+            bo->byteCount, bo->gl.usage);
 
     scheduleDestroy(std::move(p));
 
@@ -1562,7 +1990,52 @@ void OpenGLDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
     DEBUG_MARKER()
 
     GLSamplerBuffer* sb = handle_cast<GLSamplerBuffer *>(sbh);
+    assert(samplerBuffer.getSize() == sb->sb->getSize());
     *sb->sb = std::move(samplerBuffer);
+
+    // the sampler objects are shared by all the sampler buffers with the same parameters
+    SamplerBuffer::Sampler const* const samplers = sb->sb->getBuffer();
+    GLuint* const UTILS_RESTRICT glSamplers = sb->gl.samplers.get();
+    for (size_t i = 0, n = sb->sb->getSize(); i < n; i++) {
+        // the parameters of the samplers without a texture may not be initialized
+        glSamplers[i] = samplers[i].t ? getSampler(samplers[i].s) : 0;
+    }
+}
+
+void OpenGLDriver::setFoveation(GLRenderTarget* rt,
+        Driver::RenderPassParams const& params) noexcept {
+#ifdef GL_QCOM_texture_foveated
+    // only textures can be foveated, not our renderbuffers nor the default framebuffer
+    GLTexture* const t = rt->gl.color.id ? nullptr : rt->gl.color.texture;
+    if (!t) {
+        return;
+    }
+
+    const bool foveate = params.focalPointCount &&
+            (params.foveaGain.x > 0.0f || params.foveaGain.y > 0.0f);
+    if (!foveate && !t->gl.foveated) {
+        return;
+    }
+
+    if (!t->gl.foveated) {
+        t->gl.foveated = true;
+        bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t, t->gl.targetIndex);
+        activeTexture(MAX_TEXTURE_UNITS - 1);
+        glTexParameteri(t->gl.target,
+                GL_TEXTURE_FOVEATED_FEATURE_BITS_QCOM, GL_FOVEATION_ENABLE_BIT_QCOM);
+    }
+
+    // The foveation of a texture can't be disabled, textures are recycled between passes so
+    // a zero gain is used to render at full resolution everywhere.
+    const size_t count = foveate ? std::min(size_t(params.focalPointCount), size_t(2)) : 1;
+    for (size_t i = 0; i < count; i++) {
+        glTextureFoveationParametersQCOM(t->gl.texture_id, 0, GLuint(i),
+                params.focalPoints[i].x, params.focalPoints[i].y,
+                foveate ? params.foveaGain.x : 0.0f, foveate ? params.foveaGain.y : 0.0f,
+                foveate ? params.foveaArea : 0.0f);
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
 }
 
 void OpenGLDriver::beginRenderPass(Driver::RenderTargetHandle rth,
@@ -1638,6 +2111,12 @@ void OpenGLDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     }
 #endif
 
+#ifdef GL_QCOM_texture_foveated
+    if (ext.QCOM_texture_foveated) {
+        setFoveation(rt, params);
+    }
+#endif
+
     const bool respectScissor = !(clearFlags & RenderPassParams::IGNORE_SCISSOR);
     const bool clearColor = clearFlags & TargetBufferFlags::COLOR;
     const bool clearDepth = clearFlags & TargetBufferFlags::DEPTH;
@@ -1794,10 +2273,44 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
         textureStorage(rt->gl.stencil.texture, width, height, rt->gl.stencil.texture->depth);
     }
 
+    for (GLTexture* texture : rt->gl.colors) {
+        if (texture) {
+            textureStorage(texture, width, height, texture->depth);
+        }
+    }
+
     // unbind the renderbuffer, to avoid any later confusion
     if (rt->gl.color.id || rt->gl.depth.id || rt->gl.stencil.id) {
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
     }
+
+    // note: the sizes of attached textures are still accounted at their original dimensions
+    mGpuMemory.track(GpuMemoryType::RENDER_TARGET, rth.getId(),
+            size_t(rt->gl.renderBufferSize) * width * height);
+}
+
+void OpenGLDriver::setRenderTargetColorAttachment(Driver::RenderTargetHandle rth,
+        uint8_t index, Driver::TargetBufferInfo color) {
+    DEBUG_MARKER()
+
+    GLRenderTarget* rt = handle_cast<GLRenderTarget*>(rth);
+    assert(rt->gl.fbo);
+    assert(index > 0 && index < MAX_COLOR_ATTACHMENT_COUNT);
+
+    rt->gl.colors[index - 1] = handle_cast<GLTexture*>(color.handle);
+    framebufferTexture(color, rt, GLenum(GL_COLOR_ATTACHMENT0 + index));
+
+    // the draw buffers are part of the framebuffer's state, the outputs of the shaders without
+    // an attachment are dropped
+    GLenum buffers[MAX_COLOR_ATTACHMENT_COUNT] = { GL_COLOR_ATTACHMENT0 };
+    GLsizei count = 1;
+    for (size_t i = 1; i < MAX_COLOR_ATTACHMENT_COUNT; i++) {
+        buffers[i] = rt->gl.colors[i - 1] ? GLenum(GL_COLOR_ATTACHMENT0 + i) : GLenum(GL_NONE);
+        count = rt->gl.colors[i - 1] ? GLsizei(i + 1) : count;
+    }
+    glDrawBuffers(count, buffers);
+
+    CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
@@ -1816,6 +2329,7 @@ void OpenGLDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
         CHECK_GL_ERROR(utils::slog.e)
 
         rp->gl.indicesType = ib->elementSize == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        rp->gl.vertexBuffer = eb;
         rp->maxVertexCount = eb->vertexCount;
         for (size_t i = 0, n = eb->attributes.size(); i < n; i++) {
             if (enabledAttributes & (1U << i)) {
@@ -1864,6 +2378,16 @@ void OpenGLDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
     }
 }
 
+void OpenGLDriver::setPolygonOffset(float slope, float constant) {
+    DEBUG_MARKER()
+
+    // GL_POLYGON_OFFSET_FILL is only enabled in the shadow passes, see beginRenderPass()
+    const math::float2 offset = { slope, constant };
+    update_state(state.raster.polygonOffset, offset, [offset]() {
+        glPolygonOffset(offset[0], offset[1]);
+    });
+}
+
 void OpenGLDriver::setViewportScissor(
         int32_t left, int32_t bottom, uint32_t width, uint32_t height) {
     DEBUG_MARKER()
@@ -1901,16 +2425,56 @@ void OpenGLDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
     assert(ub);
 
     if (UTILS_UNLIKELY(uniformBuffer.isDirty())) {
-        // TODO: upload only the dirty parts
         assert(ub->gl.ubo);
+        const size_t offset = uniformBuffer.getDirtyOffset();
         bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, uniformBuffer.getSize(), uniformBuffer.getBuffer());
+        glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(offset),
+                GLsizeiptr(uniformBuffer.getDirtySize()),
+                static_cast<char const*>(uniformBuffer.getBuffer()) + offset);
         CHECK_GL_ERROR(utils::slog.e)
     }
     ub->ub = std::move(uniformBuffer);
 }
 
-void OpenGLDriver::load2DImage(Driver::TextureHandle th,
+void OpenGLDriver::updateUniformBufferRange(Driver::UniformBufferHandle ubh,
+        uint32_t offset, Driver::BufferDescriptor&& data) {
+    DEBUG_MARKER()
+
+    loadUniformBufferRange(handle_cast<GLUniformBuffer *>(ubh),
+            offset, data.buffer, uint32_t(data.size));
+    scheduleDestroy(std::move(data));
+}
+
+void OpenGLDriver::updateUniformBufferRanges(Driver::BufferDescriptor&& data) {
+    DEBUG_MARKER()
+
+    char const* p = static_cast<char const*>(data.buffer);
+    char const* const end = p + data.size;
+    while (p < end) {
+        UniformRangeUpdate update = *reinterpret_cast<UniformRangeUpdate const*>(p);
+        loadUniformBufferRange(handle_cast<GLUniformBuffer *>(update.ubh),
+                update.offset, p + sizeof(UniformRangeUpdate), update.size);
+        p += UniformRangeUpdate::getRecordSize(update.size);
+    }
+    scheduleDestroy(std::move(data));
+}
+
+void OpenGLDriver::loadUniformBufferRange(GLUniformBuffer* ub,
+        uint32_t offset, void const* data, uint32_t size) noexcept {
+    assert(ub);
+    assert(ub->gl.ubo);
+    assert(offset + size <= ub->ub.getSize());
+
+    // keep our copy of the buffer in sync with the GPU
+    memcpy(ub->ub.invalidateUniforms(offset, size), data, size);
+    ub->ub.clean();
+
+    bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(offset), GLsizeiptr(size), data);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::load2DImage(Driver::TextureHandle th,
         uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& data) {
     DEBUG_MARKER()
@@ -1925,6 +2489,22 @@ void OpenGLDriver::load2DImage(Driver::TextureHandle th,
     }
 }
 
+void OpenGLDriver::load3DImage(Driver::TextureHandle th,
+        uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& data) {
+    DEBUG_MARKER()
+
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    if (data.type == driver::PixelDataType::COMPRESSED) {
+        setCompressedTextureData(t,
+                level, xoffset, yoffset, zoffset, width, height, depth, std::move(data), nullptr);
+    } else {
+        setTextureData(t,
+                level, xoffset, yoffset, zoffset, width, height, depth, std::move(data), nullptr);
+    }
+}
+
 void OpenGLDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
     DEBUG_MARKER()
@@ -1937,6 +2517,40 @@ void OpenGLDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
     }
 }
 
+void OpenGLDriver::compilePrograms(BufferDescriptor&& programs) {
+    DEBUG_MARKER()
+    mPendingCompilations.push_back(std::move(programs));
+    updatePendingCompilations();
+}
+
+void OpenGLDriver::setBlobCache(BlobCache* cache) {
+    DEBUG_MARKER()
+    mBlobCache = features.program_binary ? cache : nullptr;
+}
+
+void OpenGLDriver::setPipelineCacheData(BufferDescriptor&& data) {
+    DEBUG_MARKER()
+    scheduleDestroy(std::move(data));
+}
+
+void OpenGLDriver::trimCaches(BufferDescriptor&& freed) {
+    DEBUG_MARKER()
+
+    // the pixel buffers not in use, the uploads and read-backs create new ones as needed
+    size_t size = 0;
+    glDeleteBuffers(GLsizei(mFreePixelPackBuffers.size()), mFreePixelPackBuffers.data());
+    mFreePixelPackBuffers.clear();
+    for (UploadStage const& stage : mFreeUploadStages) {
+        size += stage.capacity;
+        glDeleteBuffers(1, &stage.pbo);
+    }
+    mFreeUploadStages.clear();
+
+    assert(freed.size >= sizeof(size_t));
+    *static_cast<size_t*>(freed.buffer) = size;
+    scheduleDestroy(std::move(freed));
+}
+
 void OpenGLDriver::generateMipmaps(Driver::TextureHandle th) {
     DEBUG_MARKER()
 
@@ -1957,6 +2571,58 @@ void OpenGLDriver::generateMipmaps(Driver::TextureHandle th) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::setMinMaxLevels(Driver::TextureHandle th,
+        uint32_t minLevel, uint32_t maxLevel) {
+    DEBUG_MARKER()
+
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    assert(minLevel <= maxLevel && maxLevel < t->levels);
+    bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t, t->gl.targetIndex);
+    activeTexture(MAX_TEXTURE_UNITS - 1);
+
+    // uploading a level outside of this range will widen it again, see setTextureData()
+    t->gl.baseLevel = uint8_t(minLevel);
+    t->gl.maxLevel = uint8_t(maxLevel);
+
+    glTexParameteri(t->gl.target, GL_TEXTURE_BASE_LEVEL, t->gl.baseLevel);
+    glTexParameteri(t->gl.target, GL_TEXTURE_MAX_LEVEL, t->gl.maxLevel);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::commitTextureLevels(Driver::TextureHandle th, uint32_t minLevel) {
+    DEBUG_MARKER()
+
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    if (!t->gl.sparse) {
+        return;
+    }
+
+    // the mip tail can only be committed as a whole, it's never released
+    const uint32_t first = std::min(minLevel, uint32_t(t->gl.sparseLevels));
+    const uint32_t committed = t->gl.committedLevel;
+    if (first == committed) {
+        return;
+    }
+
+    bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t, t->gl.targetIndex);
+    activeTexture(MAX_TEXTURE_UNITS - 1);
+    for (uint32_t level = first; level < committed; level++) {
+        commitTextureLevel(t, level, true);
+    }
+    for (uint32_t level = committed; level < first; level++) {
+        commitTextureLevel(t, level, false);
+    }
+    t->gl.committedLevel = uint8_t(first);
+
+    const size_t size = first < t->levels ? getTextureMemorySize(t->gl.format, t->target,
+            uint8_t(t->levels - first), 1, std::max(1u, t->width >> first),
+            std::max(1u, t->height >> first), 1) : 0;
+    mGpuMemory.track(GpuMemoryType::TEXTURE, th.getId(), size);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::setTextureData(GLTexture* t,
         uint32_t level,
         uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
@@ -1974,6 +2640,12 @@ void OpenGLDriver::setTextureData(GLTexture* t,
         return;
     }
 
+    if (isUploadAsync(t->gl.upload, p.size)) {
+        uploadTextureAsync(t, level, xoffset, yoffset, zoffset, width, height, depth,
+                std::move(p), faceOffsets);
+        return;
+    }
+
     GLenum glFormat = getFormat(p.format);
     GLenum glType = getType(p.type);
 
@@ -1982,6 +2654,8 @@ void OpenGLDriver::setTextureData(GLTexture* t,
     pixelStore(GL_UNPACK_SKIP_PIXELS, p.left);
     pixelStore(GL_UNPACK_SKIP_ROWS, p.top);
 
+    void const* const buffer = beginStagedUpload(p);
+
     switch (t->target) {
         case SamplerType::SAMPLER_EXTERNAL:
             // if we get there, it's because the user is trying to use an external texture
@@ -1994,7 +2668,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             activeTexture(MAX_TEXTURE_UNITS - 1);
             glTexSubImage2D(GL_TEXTURE_2D,
                     GLint(level), GLint(xoffset), GLint(yoffset),
-                    width, height, glFormat, glType, p.buffer);
+                    width, height, glFormat, glType, buffer);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(t->gl.target == GL_TEXTURE_CUBE_MAP);
@@ -2006,12 +2680,23 @@ void OpenGLDriver::setTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, glFormat, glType,
-                        static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        static_cast<uint8_t const*>(buffer) + offsets[face]);
             }
             break;
         }
+        case SamplerType::SAMPLER_2D_ARRAY:
+        case SamplerType::SAMPLER_3D:
+            assert(t->gl.target == GL_TEXTURE_2D_ARRAY || t->gl.target == GL_TEXTURE_3D);
+            bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t);
+            activeTexture(MAX_TEXTURE_UNITS - 1);
+            glTexSubImage3D(t->gl.target,
+                    GLint(level), GLint(xoffset), GLint(yoffset), GLint(zoffset),
+                    width, height, depth, glFormat, glType, buffer);
+            break;
     }
 
+    endStagedUpload();
+
     // update the base/max LOD so we don't access undefined LOD. this allows the app to
     // specify levels as they become available.
 
@@ -2046,9 +2731,16 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
         return;
     }
 
+    if (isUploadAsync(t->gl.upload, p.size)) {
+        uploadTextureAsync(t, level, xoffset, yoffset, zoffset, width, height, depth,
+                std::move(p), faceOffsets);
+        return;
+    }
+
     // TODO: maybe assert that the CompressedPixelDataType is the same than the internalFormat
 
     GLsizei imageSize = GLsizei(p.imageSize);
+    void const* const buffer = beginStagedUpload(p);
 
     //  TODO: maybe assert the size is right (b/c we can compute it ourselves)
 
@@ -2064,7 +2756,7 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
             activeTexture(MAX_TEXTURE_UNITS - 1);
             glCompressedTexSubImage2D(GL_TEXTURE_2D,
                     GLint(level), GLint(xoffset), GLint(yoffset),
-                    width, height, t->gl.internalFormat, imageSize, p.buffer);
+                    width, height, t->gl.internalFormat, imageSize, buffer);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(faceOffsets);
@@ -2077,12 +2769,23 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glCompressedTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, t->gl.internalFormat,
-                        imageSize, static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        imageSize, static_cast<uint8_t const*>(buffer) + offsets[face]);
             }
             break;
         }
+        case SamplerType::SAMPLER_2D_ARRAY:
+        case SamplerType::SAMPLER_3D:
+            assert(t->gl.target == GL_TEXTURE_2D_ARRAY || t->gl.target == GL_TEXTURE_3D);
+            bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t);
+            activeTexture(MAX_TEXTURE_UNITS - 1);
+            glCompressedTexSubImage3D(t->gl.target,
+                    GLint(level), GLint(xoffset), GLint(yoffset), GLint(zoffset),
+                    width, height, depth, t->gl.internalFormat, imageSize, buffer);
+            break;
     }
 
+    endStagedUpload();
+
     // update the base/max LOD so we don't access undefined LOD. this allows the app to
     // specify levels as they become available.
 
@@ -2100,6 +2803,149 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+bool OpenGLDriver::isUploadAsync(uint32_t pending, size_t size) const noexcept {
+    return mUploader && (pending || size >= OpenGLUploader::MIN_SIZE);
+}
+
+void const* OpenGLDriver::beginStagedUpload(PixelBufferDescriptor const& p) noexcept {
+    if (p.size == 0 || p.size > MAX_STAGED_UPLOAD_SIZE) {
+        return p.buffer;
+    }
+
+    if (!mPendingUploadStages.empty()) {
+        updatePendingUploadStages(false);
+    }
+
+    // take the smallest free stage the pixels fit in, or make a new one
+    auto& stages = mFreeUploadStages;
+    auto pos = stages.end();
+    for (auto it = stages.begin(); it != stages.end(); ++it) {
+        if (it->capacity >= p.size && (pos == stages.end() || it->capacity < pos->capacity)) {
+            pos = it;
+        }
+    }
+    UploadStage stage{};
+    if (pos != stages.end()) {
+        stage = *pos;
+        stages.erase(pos);
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, stage.pbo);
+    } else {
+        // round up, so that the stages can be reused by uploads of slightly different sizes
+        stage.capacity = (p.size + 0xFFFFu) & ~size_t(0xFFFFu);
+        glGenBuffers(1, &stage.pbo);
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, stage.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, stage.capacity, nullptr, GL_STREAM_DRAW);
+    }
+
+    // the GPU is done with a free stage, so it doesn't need to synchronize the mapping
+    void* const data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, p.size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (UTILS_UNLIKELY(!data)) {
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &stage.pbo);
+        return p.buffer;
+    }
+    memcpy(data, p.buffer, p.size);
+    if (UTILS_UNLIKELY(!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))) {
+        // the content of the stage was lost
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &stage.pbo);
+        return p.buffer;
+    }
+
+    mBoundUploadStage = stage;
+    // the pixels are read from the bound buffer, at this offset
+    return nullptr;
+}
+
+void OpenGLDriver::endStagedUpload() noexcept {
+    UploadStage& stage = mBoundUploadStage;
+    if (stage.pbo) {
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        stage.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mPendingUploadStages.push_back(stage);
+        stage = {};
+    }
+}
+
+void OpenGLDriver::updatePendingUploadStages(bool wait) noexcept {
+    auto& pending = mPendingUploadStages;
+    auto end = pending.begin();
+    for (; end != pending.end(); ++end) {
+        UploadStage& stage = *end;
+        // fences signal in order, so we can stop at the first one that didn't
+        GLenum status = wait ?
+                glClientWaitSync(stage.sync, GL_SYNC_FLUSH_COMMANDS_BIT, ~GLuint64(0)) :
+                glClientWaitSync(stage.sync, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(stage.sync);
+        stage.sync = nullptr;
+        if (mFreeUploadStages.size() < MAX_FREE_UPLOAD_STAGES) {
+            mFreeUploadStages.push_back(stage);
+        } else {
+            glDeleteBuffers(1, &stage.pbo);
+        }
+    }
+    pending.erase(pending.begin(), end);
+}
+
+void OpenGLDriver::uploadTextureAsync(GLTexture* t,
+        uint32_t level,
+        uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& p, FaceOffsets const* faceOffsets) noexcept {
+    using Upload = OpenGLUploader::Upload;
+    Upload upload;
+    upload.compressed = p.type == driver::PixelDataType::COMPRESSED;
+    upload.target = t->gl.target;
+    upload.name = t->gl.texture_id;
+    upload.level = GLint(level);
+    if (t->target == SamplerType::SAMPLER_CUBEMAP) {
+        assert(faceOffsets);
+        upload.type = Upload::Type::TEXTURE_CUBEMAP;
+        upload.width = t->width >> level;
+        upload.height = t->height >> level;
+        upload.faceOffsets = *faceOffsets;
+    } else {
+        upload.xoffset = GLint(xoffset);
+        upload.yoffset = GLint(yoffset);
+        upload.zoffset = GLint(zoffset);
+        upload.width = width;
+        upload.height = height;
+        upload.depth = depth;
+    }
+    if (upload.compressed) {
+        upload.format = t->gl.internalFormat;
+        upload.imageSize = GLsizei(p.imageSize);
+    } else {
+        upload.format = getFormat(p.format);
+        upload.dataType = getType(p.type);
+        upload.rowLength = p.stride;
+        upload.alignment = p.alignment;
+        upload.skipPixels = p.left;
+        upload.skipRows = p.top;
+    }
+
+    // the levels are widened by the upload thread, but tracked here
+    if (uint8_t(level) < t->gl.baseLevel) {
+        t->gl.baseLevel = uint8_t(level);
+        upload.baseLevel = t->gl.baseLevel;
+    }
+    if (uint8_t(level) > t->gl.maxLevel) {
+        t->gl.maxLevel = uint8_t(level);
+        upload.maxLevel = t->gl.maxLevel;
+    }
+
+    upload.data = std::move(p);
+    t->gl.upload = mUploader->push(std::move(upload));
+}
+
+void OpenGLDriver::waitUploadSlow(uint32_t id) noexcept {
+    mUploader->wait(id);
+}
+
 void OpenGLDriver::setExternalImage(Driver::TextureHandle th, void* image) {
     if (ext.OES_EGL_image_external_essl3) {
         DEBUG_MARKER()
@@ -2141,18 +2987,98 @@ void OpenGLDriver::setExternalStream(Driver::TextureHandle th, Driver::StreamHan
     }
 }
 
+void OpenGLDriver::setAcquiredImage(Driver::StreamHandle sh, void* image, int acquireFence,
+        driver::StreamCallback callback, void* userData) {
+    DEBUG_MARKER()
+
+    const AcquiredImage acquired{ image, callback, userData };
+    GLStream* s = handle_cast<GLStream*>(sh);
+    assert(s->streamType == StreamType::ACQUIRED);
+
+    // the GPU must not sample the image before its producer is done with it
+    if (acquireFence >= 0) {
+        mPlatform.waitNativeFence(acquireFence);
+    }
+
+    void* externalImage = ext.OES_EGL_image_external_essl3 ?
+            mPlatform.createExternalImage(image) : nullptr;
+    if (UTILS_UNLIKELY(!externalImage)) {
+        // we can't use this image, give it back right away so its producer doesn't starve
+        scheduleRelease(acquired);
+        return;
+    }
+
+    releaseAcquiredImage(s);
+    s->acquired->image = acquired;
+    s->acquired->externalImage = externalImage;
+    for (GLTexture* t : mExternalStreams) {
+        if (t->hwStream == s) {
+            bindAcquiredImage(t, s);
+        }
+    }
+}
+
+void OpenGLDriver::bindAcquiredImage(GLTexture* t, GLStream* hwStream) noexcept {
+    if (hwStream->acquired->externalImage) {
+        assert(t->target == SamplerType::SAMPLER_EXTERNAL);
+        bindTexture(MAX_TEXTURE_UNITS - 1, GL_TEXTURE_EXTERNAL_OES, t);
+        activeTexture(MAX_TEXTURE_UNITS - 1);
+#ifdef GL_OES_EGL_image
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                static_cast<GLeglImageOES>(hwStream->acquired->externalImage));
+#endif
+    }
+}
+
+void OpenGLDriver::releaseAcquiredImage(GLStream* hwStream) noexcept {
+    if (hwStream->acquired->externalImage) {
+        // the commands already issued may still sample from this image
+        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mPendingImageReleases.push_back(
+                { hwStream->acquired->image, hwStream->acquired->externalImage, sync });
+        hwStream->acquired->image = {};
+        hwStream->acquired->externalImage = nullptr;
+    }
+}
+
+void OpenGLDriver::updatePendingImageReleases(bool wait) noexcept {
+    auto& pending = mPendingImageReleases;
+    auto end = pending.begin();
+    for (; end != pending.end(); ++end) {
+        PendingImageRelease& r = *end;
+        // fences signal in order, so we can stop at the first one that didn't
+        GLenum status = wait ?
+                glClientWaitSync(r.sync, GL_SYNC_FLUSH_COMMANDS_BIT, ~GLuint64(0)) :
+                glClientWaitSync(r.sync, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(r.sync);
+        mPlatform.destroyExternalImage(r.externalImage);
+        scheduleRelease(r.image);
+    }
+    pending.erase(pending.begin(), end);
+}
+
 UTILS_NOINLINE
 void OpenGLDriver::attachStream(GLTexture* t, GLStream* hwStream) noexcept {
     mExternalStreams.push_back(t);
 
-    if (hwStream->isNativeStream()) {
-        mPlatform.attach(hwStream->stream, t->gl.texture_id);
-    } else {
-        assert(t->target == SamplerType::SAMPLER_EXTERNAL);
-        // The texture doesn't need a texture name anymore, get rid of it
-        unbindTexture(t->gl.target, t->gl.texture_id);
-        glDeleteTextures(1, &t->gl.texture_id);
-        t->gl.texture_id = hwStream->user_thread.read[hwStream->user_thread.cur];
+    switch (hwStream->streamType) {
+        case StreamType::NATIVE:
+            mPlatform.attach(hwStream->stream, t->gl.texture_id);
+            break;
+        case StreamType::TEXTURE_ID:
+            assert(t->target == SamplerType::SAMPLER_EXTERNAL);
+            // The texture doesn't need a texture name anymore, get rid of it
+            unbindTexture(t->gl.target, t->gl.texture_id);
+            glDeleteTextures(1, &t->gl.texture_id);
+            t->gl.texture_id = hwStream->user_thread.read[hwStream->user_thread.cur];
+            break;
+        case StreamType::ACQUIRED:
+            // the texture keeps its name, the acquired images are bound to it
+            bindAcquiredImage(t, hwStream);
+            break;
     }
     t->hwStream = hwStream;
 }
@@ -2166,9 +3092,13 @@ void OpenGLDriver::detachStream(GLTexture* t) noexcept {
     }
 
     GLStream* s = static_cast<GLStream*>(t->hwStream);
-    if (s->isNativeStream()) {
+    if (s->streamType == StreamType::NATIVE) {
         mPlatform.detach(t->hwStream->stream);
         // this deletes the texture id
+    } else if (s->streamType == StreamType::ACQUIRED) {
+        // the texture name still references the last image
+        unbindTexture(t->gl.target, t->gl.texture_id);
+        glDeleteTextures(1, &t->gl.texture_id);
     }
     glGenTextures(1, &t->gl.texture_id);
     t->hwStream = nullptr;
@@ -2177,17 +3107,27 @@ void OpenGLDriver::detachStream(GLTexture* t) noexcept {
 UTILS_NOINLINE
 void OpenGLDriver::replaceStream(GLTexture* t, GLStream* hwStream) noexcept {
     GLStream* s = static_cast<GLStream*>(t->hwStream);
-    if (s->isNativeStream()) {
+    if (s->streamType == StreamType::NATIVE) {
         mPlatform.detach(t->hwStream->stream);
         // this deletes the texture id
+    } else if (s->streamType == StreamType::ACQUIRED) {
+        unbindTexture(t->gl.target, t->gl.texture_id);
+        glDeleteTextures(1, &t->gl.texture_id);
     }
 
-    if (hwStream->isNativeStream()) {
-        glGenTextures(1, &t->gl.texture_id);
-        mPlatform.attach(hwStream->stream, t->gl.texture_id);
-    } else {
-        assert(t->target == SamplerType::SAMPLER_EXTERNAL);
-        t->gl.texture_id = hwStream->user_thread.read[hwStream->user_thread.cur];
+    switch (hwStream->streamType) {
+        case StreamType::NATIVE:
+            glGenTextures(1, &t->gl.texture_id);
+            mPlatform.attach(hwStream->stream, t->gl.texture_id);
+            break;
+        case StreamType::TEXTURE_ID:
+            assert(t->target == SamplerType::SAMPLER_EXTERNAL);
+            t->gl.texture_id = hwStream->user_thread.read[hwStream->user_thread.cur];
+            break;
+        case StreamType::ACQUIRED:
+            glGenTextures(1, &t->gl.texture_id);
+            bindAcquiredImage(t, hwStream);
+            break;
     }
     t->hwStream = hwStream;
 }
@@ -2299,7 +3239,7 @@ void OpenGLDriver::readStreamPixels(Driver::StreamHandle sh,
     DEBUG_MARKER()
 
     GLStream* s = handle_cast<GLStream*>(sh);
-    if (UTILS_LIKELY(!s->isNativeStream())) {
+    if (UTILS_LIKELY(s->streamType == StreamType::TEXTURE_ID)) {
         GLuint tid = s->gl.externalTexture2DId;
         if (tid == 0) {
             return;
@@ -2391,6 +3331,17 @@ void OpenGLDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) {
+    DEBUG_MARKER()
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    assert(offset + size <= ub->ub.getSize());
+    bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo,
+            GLintptr(offset), GLsizeiptr(size));
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     DEBUG_MARKER()
 
@@ -2400,6 +3351,44 @@ void OpenGLDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::bindStorageBuffer(size_t index, Driver::BufferObjectHandle boh) {
+    DEBUG_MARKER()
+
+    GLBufferObject* bo = handle_cast<GLBufferObject *>(boh);
+    bindBufferBase(GL_SHADER_STORAGE_BUFFER, GLuint(index), bo->gl.id);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::bindVertexStorageBuffer(size_t index, Driver::VertexBufferHandle vbh,
+        uint8_t bufferIndex) {
+    DEBUG_MARKER()
+
+    GLVertexBuffer const* vb = handle_cast<const GLVertexBuffer *>(vbh);
+    assert(bufferIndex < vb->bufferCount);
+    waitUpload(vb);
+    bindBufferBase(GL_SHADER_STORAGE_BUFFER, GLuint(index), vb->gl.buffers[bufferIndex]);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::bindImage(size_t unit, Driver::TextureHandle th, uint8_t level,
+        Driver::ImageAccess access) {
+    DEBUG_MARKER()
+
+    GLTexture const* t = handle_cast<const GLTexture *>(th);
+    waitUpload(t);
+    GLenum glAccess = GL_READ_WRITE;
+    switch (access) {
+        case ImageAccess::READ_ONLY:  glAccess = GL_READ_ONLY;  break;
+        case ImageAccess::WRITE_ONLY: glAccess = GL_WRITE_ONLY; break;
+        case ImageAccess::READ_WRITE: glAccess = GL_READ_WRITE; break;
+    }
+    // all the layers of arrays and cubemaps are bound
+    const GLboolean layered = GLboolean(t->gl.target != GL_TEXTURE_2D);
+    glBindImageTexture(GLuint(unit), t->gl.texture_id, level, layered, 0, glAccess,
+            t->gl.internalFormat);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 
 GLuint OpenGLDriver::getSamplerSlow(driver::SamplerParams params) const noexcept {
     assert(mSamplerMap.find(params.u) == mSamplerMap.end());
@@ -2449,10 +3438,109 @@ void OpenGLDriver::popGroupMarker(int) {
 #endif
 }
 
+void OpenGLDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    tq->elapsed.store(0, std::memory_order_relaxed);
+    if (ext.EXT_disjoint_timer_query && !mCurrentTimerQuery) {
+        // a query that's being reused is no longer pending
+        auto& pending = mPendingTimerQueries;
+        pending.erase(std::remove(pending.begin(), pending.end(), tq), pending.end());
+        glBeginQuery(GL_TIME_ELAPSED_EXT, tq->gl.query);
+        mCurrentTimerQuery = tq;
+    }
+}
+
+void OpenGLDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    if (mCurrentTimerQuery == tq) {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        mPendingTimerQueries.push_back(tq);
+        mCurrentTimerQuery = nullptr;
+    }
+}
+
+void OpenGLDriver::updatePendingTimerQueries() noexcept {
+    // on GLES, the results are meaningless if something (e.g. a frequency change) happened
+    // while they were measured, this also resets the disjoint flag
+    GLint disjoint = 0;
+    if (GLES31_HEADERS) {
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    }
+
+    // queries complete in order, so we can stop at the first one that's not
+    auto& pending = mPendingTimerQueries;
+    auto it = pending.begin();
+    for (; it != pending.end(); ++it) {
+        GLTimerQuery* tq = *it;
+        GLuint available = 0;
+        glGetQueryObjectuiv(tq->gl.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint elapsed = 0;
+        glGetQueryObjectuiv(tq->gl.query, GL_QUERY_RESULT, &elapsed);
+        if (!disjoint) {
+            // 0 means "not known", a query can't really take no time at all
+            tq->elapsed.store(std::max(uint64_t(elapsed), uint64_t(1)), std::memory_order_relaxed);
+        }
+    }
+    pending.erase(pending.begin(), it);
+}
+
 // ------------------------------------------------------------------------------------------------
 // Read-back ops
 // ------------------------------------------------------------------------------------------------
 
+// Copies the pixels read by glReadPixels() from the pixel pack buffer, which has the layout of
+// the client's buffer, flipping them vertically to match our API. Only the pixels read are
+// written, like glReadPixels() would have.
+static void copyPixelsFlipped(PixelBufferDescriptor const& p, void const* pixels,
+        uint32_t width, uint32_t height) {
+    size_t stride = p.stride ? p.stride : width;
+    size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
+    size_t bpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
+    char const* src = (char const*)pixels + p.left * bpp + bpr * p.top;
+    char* dst = (char*)p.buffer + p.left * bpp + bpr * (p.top + height - 1);
+    for (uint32_t i = 0; i < height; i++) {
+        memcpy(dst, src, bpp * width);
+        src += bpr;
+        dst -= bpr;
+    }
+}
+
+void OpenGLDriver::updatePendingReadPixels(bool wait) noexcept {
+    auto& pending = mPendingReadPixels;
+    auto end = pending.begin();
+    for (; end != pending.end(); ++end) {
+        PendingReadPixels& r = *end;
+        // fences signal in order, so we can stop at the first one that didn't
+        GLenum status = wait ?
+                glClientWaitSync(r.sync, GL_SYNC_FLUSH_COMMANDS_BIT, ~GLuint64(0)) :
+                glClientWaitSync(r.sync, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(r.sync);
+
+        bindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+        void const* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, r.p.size, GL_MAP_READ_BIT);
+        if (pixels) {
+            copyPixelsFlipped(r.p, pixels, r.width, r.height);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        mFreePixelPackBuffers.push_back(r.pbo);
+        scheduleDestroy(std::move(r.p));
+    }
+    pending.erase(pending.begin(), end);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
         uint32_t x, uint32_t y, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& p) {
@@ -2494,23 +3582,23 @@ void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
     GLRenderTarget const* s = handle_cast<GLRenderTarget const*>(src);
     bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
 
-    // TODO: we could use a PBO to make this asynchronous
-    glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, p.buffer);
-
-    // now we need to flip the buffer vertically to match our API
-    size_t stride = p.stride ? p.stride : width;
-    size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
-    size_t bpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
-    char* head = (char*)p.buffer + p.left * bpp + bpr * p.top;
-    char* tail = (char*)p.buffer + p.left * bpp + bpr * (p.top + height - 1);
-    // clang vectorizes this loop
-    while (head < tail) {
-        std::swap_ranges(head, head + bpp * width, tail);
-        head += bpr;
-        tail -= bpr;
+    // The pixels are read into a pixel pack buffer, with the layout of the client's buffer, which
+    // doesn't wait for the GPU to be done with the frame. They're copied to the client's buffer
+    // a few frames later, once the fence tells they've arrived, see updatePendingReadPixels().
+    GLuint pbo;
+    if (mFreePixelPackBuffers.empty()) {
+        glGenBuffers(1, &pbo);
+    } else {
+        pbo = mFreePixelPackBuffers.back();
+        mFreePixelPackBuffers.pop_back();
     }
+    bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, p.size, nullptr, GL_STREAM_READ);
+    glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, nullptr);
+    bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-    scheduleDestroy(std::move(p));
+    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mPendingReadPixels.push_back({ pbo, sync, width, height, std::move(p) });
 
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -2545,6 +3633,21 @@ void OpenGLDriver::endFrame(uint32_t frameId) {
     //SYSTRACE_NAME("glFinish");
     //glFinish();
     insertEventMarker("endFrame");
+    if (UTILS_UNLIKELY(!mPendingCompilations.empty())) {
+        updatePendingCompilations();
+    }
+    if (UTILS_UNLIKELY(!mPendingReadPixels.empty())) {
+        updatePendingReadPixels(false);
+    }
+    if (!mPendingUploadStages.empty()) {
+        updatePendingUploadStages(false);
+    }
+    if (!mPendingTimerQueries.empty()) {
+        updatePendingTimerQueries();
+    }
+    if (UTILS_UNLIKELY(!mPendingImageReleases.empty())) {
+        updatePendingImageReleases(false);
+    }
 }
 
 void OpenGLDriver::flush(int) {
@@ -2653,10 +3756,13 @@ void OpenGLDriver::blit(TargetBufferFlags buffers,
         bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
         bindFramebuffer(GL_DRAW_FRAMEBUFFER, d->gl.fbo);
         disable(GL_SCISSOR_TEST);
+        // depth and stencil can only be blitted with GL_NEAREST
+        const GLenum filter = (mask & (GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)) ?
+                GL_NEAREST : GL_LINEAR;
         glBlitFramebuffer(
                 srcLeft, srcBottom, srcLeft + srcWidth, srcBottom + srcHeight,
                 dstLeft, dstBottom, dstLeft + dstWidth, dstBottom + dstHeight,
-                mask, GL_LINEAR);
+                mask, filter);
         enable(GL_SCISSOR_TEST);
         CHECK_GL_ERROR(utils::slog.e)
     }
@@ -2665,20 +3771,115 @@ void OpenGLDriver::blit(TargetBufferFlags buffers,
 void OpenGLDriver::draw(
         Driver::ProgramHandle ph,
         Driver::RasterState rs,
-        Driver::RenderPrimitiveHandle rph) {
+        Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
+    DEBUG_MARKER()
+
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        p = getFallbackProgram(p);
+    }
+    useProgram(p);
+
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    if (UTILS_UNLIKELY(mPendingBufferUploads && rp->gl.vertexBuffer)) {
+        waitUpload(rp->gl.vertexBuffer);
+    }
+    bindVertexArray(rp);
+
+    setRasterState(rs);
+
+    if (UTILS_LIKELY(instanceCount <= 1)) {
+        glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    } else {
+        glDrawElementsInstanced(GLenum(rp->type), rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset),
+                GLsizei(instanceCount));
+    }
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::drawIndirect(
+        Driver::ProgramHandle ph,
+        Driver::RasterState rs,
+        Driver::RenderPrimitiveHandle rph,
+        Driver::BufferDescriptor&& commands) {
     DEBUG_MARKER()
 
+    const GLsizei count = GLsizei(commands.size / sizeof(DrawIndirectCommand));
+    if (UTILS_UNLIKELY(!count)) {
+        scheduleDestroy(std::move(commands));
+        return;
+    }
+
     OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        p = getFallbackProgram(p);
+    }
     useProgram(p);
 
     const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    if (UTILS_UNLIKELY(mPendingBufferUploads && rp->gl.vertexBuffer)) {
+        waitUpload(rp->gl.vertexBuffer);
+    }
     bindVertexArray(rp);
 
     setRasterState(rs);
 
-    glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
-            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    const GLenum mode = GLenum(rp->type);
+    if (features.draw_indirect) {
+        if (UTILS_UNLIKELY(!mDrawIndirectBuffer)) {
+            glGenBuffers(1, &mDrawIndirectBuffer);
+        }
+        // the buffer is orphaned at each upload, so we never wait on the previous draws
+        bindBuffer(GL_DRAW_INDIRECT_BUFFER, mDrawIndirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, GLsizeiptr(count * sizeof(DrawIndirectCommand)),
+                commands.buffer, GL_STREAM_DRAW);
+#if GL41_HEADERS
+        if (features.multi_draw_indirect) {
+            glMultiDrawElementsIndirect(mode, rp->gl.indicesType, nullptr, count, 0);
+        } else
+#endif
+        {
+            for (GLsizei i = 0; i < count; i++) {
+                glDrawElementsIndirect(mode, rp->gl.indicesType,
+                        reinterpret_cast<const void*>(i * sizeof(DrawIndirectCommand)));
+            }
+        }
+    } else {
+        // OpenGL ES 3.0 has no indirect draws and no base vertex
+        const size_t indexSize = rp->gl.indicesType == GL_UNSIGNED_INT ? 4 : 2;
+        DrawIndirectCommand const* c = static_cast<DrawIndirectCommand const*>(commands.buffer);
+        for (GLsizei i = 0; i < count; i++) {
+            assert(c[i].baseVertex == 0 && c[i].baseInstance == 0);
+            glDrawElementsInstanced(mode, GLsizei(c[i].count), rp->gl.indicesType,
+                    reinterpret_cast<const void*>(c[i].firstIndex * indexSize),
+                    GLsizei(c[i].instanceCount));
+        }
+    }
+
+    scheduleDestroy(std::move(commands));
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::dispatchCompute(Driver::ProgramHandle ph,
+        uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    DEBUG_MARKER()
+
+    assert(features.compute);
+
+    // there is nothing to dispatch instead of a compute program that isn't ready
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    p->wait(this);
+    useProgram(p);
+
+    glDispatchCompute(groupCountX, groupCountY, groupCountZ);
 
+    // the results can be consumed in any way (storage or vertex buffers, indirect commands,
+    // images or textures, readbacks), which the driver doesn't know ahead of time
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
     CHECK_GL_ERROR(utils::slog.e)
 }
 
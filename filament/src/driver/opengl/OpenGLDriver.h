@@ -29,6 +29,7 @@
 #include <tsl/robin_map.h>
 
 #include <set>
+#include <string>
 
 #include <assert.h>
 
@@ -41,6 +42,7 @@ class PixelBufferDescriptor;
 
 class OpenGLProgram;
 class OpenGLBlitter;
+class OpenGLUploader;
 
 class OpenGLDriver final : public DriverBase {
     inline explicit OpenGLDriver(driver::OpenGLPlatform* platform) noexcept;
@@ -53,7 +55,9 @@ public:
     struct GLVertexBuffer : public HwVertexBuffer {
         using HwVertexBuffer::HwVertexBuffer;
         struct {
-            std::array<GLuint, MAX_ATTRIBUTE_BUFFER_COUNT> buffers;  // 4*6 bytes
+            std::array<GLuint, MAX_ATTRIBUTE_BUFFER_COUNT> buffers;  // 4*16 bytes
+            GLenum usage;
+            mutable uint32_t upload = 0;    // last pending OpenGLUploader upload, or 0
         } gl;
     };
 
@@ -61,6 +65,15 @@ public:
         using HwIndexBuffer::HwIndexBuffer;
         struct {
             GLuint buffer;
+            GLenum usage;
+        } gl;
+    };
+
+    struct GLBufferObject : public HwBufferObject {
+        using HwBufferObject::HwBufferObject;
+        struct {
+            GLuint id;
+            GLenum usage;
         } gl;
     };
 
@@ -71,6 +84,7 @@ public:
             GLenum indicesType = GL_UNSIGNED_INT;
             GLuint elementArray = 0;
             utils::bitset32 vertexAttribArray;
+            GLVertexBuffer const* vertexBuffer = nullptr;
         } gl;
     };
 
@@ -81,12 +95,21 @@ public:
             GLenum target;
             GLenum internalFormat;
             mutable GLsync fence = nullptr;
+            mutable uint32_t upload = 0;    // last pending OpenGLUploader upload, or 0
 
             // texture parameters go here too
             GLfloat anisotropy = 1.0;
             uint8_t baseLevel = 255;
             uint8_t maxLevel = 0;
             uint8_t targetIndex = 0;
+            bool foveated = false;  // GL_FOVEATION_ENABLE_BIT_QCOM set, it can't be cleared
+
+            // sparse textures only back the levels [committedLevel, levels) with memory, the
+            // levels from sparseLevels on are the mip tail, which is committed as a whole
+            bool sparse = false;
+            uint8_t sparseLevels = 0;
+            uint8_t committedLevel = 0;
+            TextureFormat format = TextureFormat::RGBA8;
         } gl;
     };
 
@@ -106,7 +129,7 @@ public:
     struct GLStream : public HwStream {
         static constexpr size_t ROUND_ROBIN_TEXTURE_COUNT = 3;      // 3 maximum
         using HwStream::HwStream;
-        bool isNativeStream() const { return gl.externalTextureId == 0; }
+        bool isNativeStream() const { return streamType == driver::StreamType::NATIVE; }
         struct Info {
             // storage for the read/write textures below
             driver::Platform::ExternalTexture* ets = nullptr;
@@ -139,11 +162,25 @@ public:
             Info infos[ROUND_ROBIN_TEXTURE_COUNT];
             uint8_t cur = 0;
         } user_thread;
+
+        /*
+         * ACQUIRED streams: the image currently sampled, only accessed from the GL thread
+         */
+        struct Acquired {
+            AcquiredImage image;
+            void* externalImage = nullptr;  // e.g. the EGLImage wrapping image
+        };
+        // NOTE: out-of-line allocation because the size of a Handle<> is limited
+        std::unique_ptr<Acquired> acquired;
     };
 
     struct GLSamplerBuffer : public HwSamplerBuffer {
-        using HwSamplerBuffer::HwSamplerBuffer;
+        explicit GLSamplerBuffer(size_t size) noexcept
+                : HwSamplerBuffer(size), gl{ std::unique_ptr<GLuint[]>(new GLuint[size]()) } { }
         struct {
+            // the sampler objects of the samplers in sb, looked up by updateSamplerBuffer() so
+            // that binding them for a draw is just a glBindSampler()
+            std::unique_ptr<GLuint[]> samplers;
         } gl;
     };
 
@@ -167,9 +204,18 @@ public:
             RenderBuffer color;
             RenderBuffer depth;
             RenderBuffer stencil;
+            // color attachments 1 and above, see setRenderTargetColorAttachment()
+            GLTexture* colors[Driver::MAX_COLOR_ATTACHMENT_COUNT - 1] = {};
             GLuint fbo = 0;
             uint8_t samples = 1;
             bool useQCOMTiledRendering = false;
+            uint16_t renderBufferSize = 0;  // bytes per pixel of our renderbuffers
+        } gl;
+    };
+
+    struct GLTimerQuery : public HwTimerQuery {
+        struct {
+            GLuint query = 0;
         } gl;
     };
 
@@ -201,62 +247,10 @@ private:
 #include "driver/DriverAPI.inc"
 
 
-    // Memory management...
-
-    class HandleAllocator {
-        utils::PoolAllocator< 16, 16>   mPool0;
-        utils::PoolAllocator< 64, 32>   mPool1;
-        utils::PoolAllocator<128, 32>   mPool2;
-    public:
-        static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
-        explicit HandleAllocator(const utils::HeapArea& area);
-        void* alloc(size_t size, size_t alignment, size_t extra = 0) noexcept;
-        void free(void* p, size_t size) noexcept;
-    };
-
-    // the arenas for handle allocation needs to be thread-safe
-#ifndef NDEBUG
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock,
-            utils::TrackingPolicy::HighWatermark>;
-#else
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock>;
-#endif
-
-    HandleArena mHandleArena;
-
-    HandleBase::HandleId allocateHandle(size_t size) noexcept;
-
-    template<typename D, typename B, typename ... ARGS>
-    typename std::enable_if<std::is_base_of<B, D>::value, D>::type*
-            construct(Handle<B> const& handle, ARGS&& ... args) noexcept;
-
-    template<typename B, typename D,
-            typename = typename std::enable_if<std::is_base_of<B, D>::value, D>::type>
-    void destruct(Handle<B>& handle, D const* p) noexcept;
-
-
-    /*
-     * handle_cast
-     *
-     * casts a Handle<> to a pointer to the data it refers to.
-     */
-
-    template<typename Dp, typename B>
-    inline
-    typename std::enable_if<
-            std::is_pointer<Dp>::value &&
-            std::is_base_of<B, typename std::remove_pointer<Dp>::type>::value, Dp>::type
-    handle_cast(Handle<B>& handle) noexcept {
-        char* const base = (char *)mHandleArena.getArea().begin();
-        size_t offset = handle.getId() << HandleAllocator::MIN_ALIGNMENT_SHIFT;
-        return static_cast<Dp>(static_cast<void *>(base + offset));
-    }
-
     typedef math::details::TVec4<GLint> vec4gli;
 
     friend class OpenGLProgram;
+    friend class OpenGLUploader;
 
     /* Extension management... */
 
@@ -279,10 +273,14 @@ private:
     GLuint framebufferRenderbuffer(uint32_t width, uint32_t height, uint8_t samples,
             GLenum attachment, GLenum internalformat, GLuint fbo) noexcept;
 
-    void setRasterStateSlow(RasterState rs) noexcept;
+    void setFoveation(GLRenderTarget* rt, Driver::RenderPassParams const& params) noexcept;
+
+    // only updates the GL state of the fields in the "changed" bits, see RasterState::*_MASK
+    void setRasterStateSlow(RasterState rs, uint32_t changed) noexcept;
     void setRasterState(RasterState rs) noexcept {
-        if (UTILS_UNLIKELY(rs != mRasterState)) {
-            setRasterStateSlow(rs);
+        const uint32_t changed = rs.u ^ mRasterState.u;
+        if (UTILS_UNLIKELY(changed)) {
+            setRasterStateSlow(rs, changed);
         }
     }
     void setTextureData(GLTexture* t,
@@ -297,12 +295,37 @@ private:
             uint32_t width, uint32_t height, uint32_t depth,
             PixelBufferDescriptor&& data, FaceOffsets const* faceOffsets);
 
+    // queues the upload of a texture's level on the upload thread
+    void uploadTextureAsync(GLTexture* t,
+            uint32_t level,
+            uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+            uint32_t width, uint32_t height, uint32_t depth,
+            PixelBufferDescriptor&& data, FaceOffsets const* faceOffsets) noexcept;
+
+    // uploads of at least OpenGLUploader::MIN_SIZE are done on the upload thread, then all the
+    // uploads into the same object until it's used
+    bool isUploadAsync(uint32_t pending, size_t size) const noexcept;
+
+    // copies the pixels into an upload stage left bound to GL_PIXEL_UNPACK_BUFFER and returns
+    // the address to give to glTexSubImage*(), or p.buffer if they can't be staged
+    void const* beginStagedUpload(PixelBufferDescriptor const& p) noexcept;
+
+    // fences the upload stage bound by beginStagedUpload(), if any
+    void endStagedUpload() noexcept;
+
+    // make the GPU wait for the pending upload of an object before it's used
+    inline void waitUpload(GLTexture const* t) noexcept;
+    inline void waitUpload(GLVertexBuffer const* vb) noexcept;
+    void waitUploadSlow(uint32_t id) noexcept;
+
     void renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
             uint32_t height, uint8_t samples) const noexcept;
 
     void textureStorage(GLTexture* t,
             uint32_t width, uint32_t height, uint32_t depth) noexcept;
 
+    void commitTextureLevel(GLTexture const* t, uint32_t level, bool commit) noexcept;
+
     /* State tracking GL wrappers... */
 
     constexpr inline size_t getIndexForCap(GLenum cap) noexcept;
@@ -322,8 +345,33 @@ private:
 
     inline void useProgram(OpenGLProgram* p) noexcept;
 
+    // returns what to draw with instead of a program that isn't ready
+    OpenGLProgram* getFallbackProgram(OpenGLProgram* p) noexcept;
+
+    // calls the callbacks of compilePrograms() whose programs are all ready
+    void updatePendingCompilations() noexcept;
+
+    // completes the readPixels() whose pixels have arrived, or all of them if "wait" is set
+    void updatePendingReadPixels(bool wait) noexcept;
+
+    // recycles the upload stages the GPU is done reading from, or all of them if "wait" is set
+    void updatePendingUploadStages(bool wait) noexcept;
+
+    // publishes the results of the timer queries the GPU is done with
+    void updatePendingTimerQueries() noexcept;
+
+    // gives the acquired images the GPU is done with back to their owner, or all of them if
+    // "wait" is set
+    void updatePendingImageReleases(bool wait) noexcept;
+
+    // uploads size bytes of data at offset into a uniform buffer
+    void loadUniformBufferRange(GLUniformBuffer* ub,
+            uint32_t offset, void const* data, uint32_t size) noexcept;
+
     inline void bindBuffer(GLenum target, GLuint buffer) noexcept;
     inline void bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept;
+    inline void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+            GLintptr offset, GLsizeiptr size) noexcept;
 
     inline void bindFramebuffer(GLenum target, GLuint buffer) noexcept;
 
@@ -368,6 +416,7 @@ private:
 
     GLRenderPrimitive mDefaultVAO;
     GLint mMaxRenderBufferSize = 0;
+    GLint mUniformBufferOffsetAlignment = 0;
 
     template <typename T, typename F>
     inline void update_state(T& state, T const& expected, F functor, bool force = false) noexcept {
@@ -401,6 +450,7 @@ private:
             GLboolean colorMask         = GL_TRUE;
             GLboolean depthMask         = GL_TRUE;
             GLenum depthFunc            = GL_LESS;
+            math::float2 polygonOffset  = { 1.0f, 1.0f };   // slope, constant
         } raster;
 
         struct {
@@ -410,8 +460,11 @@ private:
         struct {
             struct {
                 GLuint buffers[MAX_BUFFER_BINDINGS] = { 0 };
+                // range of the indexed bindings, a size of 0 is the whole buffer
+                GLintptr offsets[MAX_BUFFER_BINDINGS] = { 0 };
+                GLsizeiptr sizes[MAX_BUFFER_BINDINGS] = { 0 };
                 GLuint genericBinding = 0;
-            } targets[8];
+            } targets[10];
         } buffers;
 
         struct {
@@ -420,7 +473,7 @@ private:
                 GLuint sampler = 0;
                 struct {
                     GLuint texture_id = 0;
-                } targets[5];
+                } targets[6];
             } units[MAX_TEXTURE_UNITS];
         } textures;
 
@@ -459,6 +512,52 @@ private:
     GLfloat mMaxAnisotropy = 0.0f;
     ShaderModel mShaderModel;
 
+    // where programs binaries are saved, null if they're not supported
+    driver::BlobCache* mBlobCache = nullptr;
+    std::string mDriverVersion;
+
+    // arrays of programs given to compilePrograms(), whose callbacks are pending
+    std::vector<BufferDescriptor> mPendingCompilations;
+
+    // readPixels() whose pixels are on their way to a pixel pack buffer, in submission order
+    struct PendingReadPixels {
+        GLuint pbo;
+        GLsync sync;
+        uint32_t width;
+        uint32_t height;
+        PixelBufferDescriptor p;
+    };
+    std::vector<PendingReadPixels> mPendingReadPixels;
+    std::vector<GLuint> mFreePixelPackBuffers;
+
+    // pixel unpack buffers the texture uploads are staged through, so that glTexSubImage*()
+    // doesn't copy the client's pixels synchronously. The pending ones are in submission order.
+    struct UploadStage {
+        GLuint pbo;
+        size_t capacity;
+        GLsync sync;
+    };
+    static constexpr size_t MAX_STAGED_UPLOAD_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t MAX_FREE_UPLOAD_STAGES = 8;
+    std::vector<UploadStage> mPendingUploadStages;
+    std::vector<UploadStage> mFreeUploadStages;
+    UploadStage mBoundUploadStage = {};
+
+    // holds the commands of drawIndirect(), created on first use
+    GLuint mDrawIndirectBuffer = 0;
+
+    // acquired images replaced or destroyed, that the GPU may still be reading from
+    struct PendingImageRelease {
+        AcquiredImage image;
+        void* externalImage;
+        GLsync sync;
+    };
+    std::vector<PendingImageRelease> mPendingImageReleases;
+
+    // ended timer queries whose results are not known yet
+    std::vector<GLTimerQuery*> mPendingTimerQueries;
+    GLTimerQuery* mCurrentTimerQuery = nullptr;
+
     // state required to represent the current render pass
     Driver::RenderTargetHandle mRenderPassTarget;
     Driver::RenderPassParams mRenderPassParams;
@@ -488,18 +587,29 @@ private:
     // features supported by this version of GL or GLES
     struct {
         bool multisample_texture = false;
+        bool program_binary = false;
+        bool draw_indirect = false;
+        bool multi_draw_indirect = false;
+        bool compute = false;
     } features;
 
     // supported extensions detected at runtime
     struct {
         bool texture_compression_s3tc = false;
         bool texture_compression_etc2 = false;
+        bool texture_compression_astc = false;
+        bool texture_compression_bptc = false;
         bool texture_filter_anisotropic = false;
         bool QCOM_tiled_rendering = false;
+        bool QCOM_texture_foveated = false;
         bool OES_EGL_image_external_essl3 = false;
         bool EXT_debug_marker = false;
         bool EXT_color_buffer_half_float = false;
         bool EXT_multisampled_render_to_texture = false;
+        bool KHR_parallel_shader_compile = false;
+        bool EXT_disjoint_timer_query = false;
+        bool EXT_shader_framebuffer_fetch = false;
+        bool ARB_sparse_texture = false;
     } ext;
 
     struct {
@@ -530,10 +640,16 @@ private:
     void attachStream(GLTexture* t, GLStream* stream) noexcept;
     void detachStream(GLTexture* t) noexcept;
     void replaceStream(GLTexture* t, GLStream* stream) noexcept;
+    void bindAcquiredImage(GLTexture* t, GLStream* stream) noexcept;
+    void releaseAcquiredImage(GLStream* stream) noexcept;
 
     driver::OpenGLPlatform& mPlatform;
 
     OpenGLBlitter* mOpenGLBlitter = nullptr;
+
+    // null if the platform has no upload context
+    OpenGLUploader* mUploader = nullptr;
+    uint32_t mPendingBufferUploads = 0;     // vertex buffers with a pending upload
     void updateStream(GLTexture* t, driver::DriverApi* driver) noexcept;
 };
 
@@ -546,6 +662,7 @@ constexpr size_t OpenGLDriver::getIndexForTextureTarget(GLuint target) noexcept
         case GL_TEXTURE_CUBE_MAP:       return 2;
         case GL_TEXTURE_2D_MULTISAMPLE: return 3;
         case GL_TEXTURE_EXTERNAL_OES:   return 4;
+        case GL_TEXTURE_2D_ARRAY:       return 5;
         default:                        return 0;
     }
 }
@@ -584,9 +701,11 @@ constexpr size_t OpenGLDriver::getIndexForBufferTarget(GLenum target) noexcept {
         case GL_PIXEL_UNPACK_BUFFER:        index = 5; break;
         case GL_TRANSFORM_FEEDBACK_BUFFER:  index = 6; break;
         case GL_UNIFORM_BUFFER:             index = 7; break;
-        default: index = 8; break; // should never happen
+        case GL_DRAW_INDIRECT_BUFFER:       index = 8; break;
+        case GL_SHADER_STORAGE_BUFFER:      index = 9; break;
+        default: index = 10; break; // should never happen
     }
-    assert(index < 8 && index < sizeof(state.buffers.targets)/sizeof(state.buffers.targets[0])); // NOLINT(misc-redundant-expression)
+    assert(index < 10 && index < sizeof(state.buffers.targets)/sizeof(state.buffers.targets[0])); // NOLINT(misc-redundant-expression)
     return index;
 }
 
@@ -603,9 +722,25 @@ void OpenGLDriver::bindTexture(GLuint unit, GLuint target, GLTexture const* t) n
 
 void OpenGLDriver::bindTexture(GLuint unit, GLuint target, GLTexture const* t, size_t targetIndex) noexcept {
     assert(t != nullptr);
+    waitUpload(t);
     bindTexture(unit, target, t->gl.texture_id, targetIndex);
 }
 
+void OpenGLDriver::waitUpload(GLTexture const* t) noexcept {
+    if (UTILS_UNLIKELY(t->gl.upload)) {
+        waitUploadSlow(t->gl.upload);
+        t->gl.upload = 0;
+    }
+}
+
+void OpenGLDriver::waitUpload(GLVertexBuffer const* vb) noexcept {
+    if (UTILS_UNLIKELY(vb->gl.upload)) {
+        waitUploadSlow(vb->gl.upload);
+        vb->gl.upload = 0;
+        mPendingBufferUploads--;
+    }
+}
+
 void UTILS_UNUSED OpenGLDriver::bindTexture(GLuint unit, GLuint target, GLuint texId) noexcept {
     bindTexture(unit, target, texId, getIndexForTextureTarget(target));
 }
@@ -30,168 +30,229 @@ namespace filament {
 using namespace math;
 using namespace utils;
 
-OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) noexcept
-        :  HwProgram(programBuilder.getName()), mIsValid(false) {
+OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, Program&& programBuilder) noexcept
+        :  HwProgram(programBuilder.getName()), mFallback(programBuilder.getFallback()) {
 
     using Shader = Program::Shader;
 
     const auto& shadersSource = programBuilder.getShadersSource();
 
-    // build all shaders
-    #pragma nounroll
-    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
-        GLenum glShaderType;
-        Shader type = (Shader)i;
-        switch (type) {
-            case Shader::VERTEX:
-                glShaderType = GL_VERTEX_SHADER;
-                break;
-            case Shader::FRAGMENT:
-                glShaderType = GL_FRAGMENT_SHADER;
-                break;
-        }
-
-        if (shadersSource[i].length()) {
-            GLint status;
-            char const* const source = shadersSource[i].c_str();
-
-            GLuint shaderId = glCreateShader(glShaderType);
-            glShaderSource(shaderId, 1, &source, nullptr);
-            glCompileShader(shaderId);
-
-            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
-            if (UTILS_UNLIKELY(status != GL_TRUE)) {
-                logCompilationError(slog.e, shaderId, source);
-                glDeleteShader(shaderId);
-                return;
-            }
-            this->gl.shaders[i] = shaderId;
-            mValidShaderSet |= 1U << i;
+    // a program binary saved by a previous run skips both compilation and link
+    driver::BlobCache* const blobCache = gl->mBlobCache;
+    std::string key;
+    GLuint program = 0;
+    if (blobCache) {
+        key = getProgramBinaryKey(gl, programBuilder);
+        program = loadProgramBinary(*blobCache, key);
+        if (program) {
+            key.clear();
         }
     }
 
-    // we need at least a vertex and fragment program
-    const uint8_t validShaderSet = mValidShaderSet;
-    const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
-    if (UTILS_LIKELY((mValidShaderSet & mask) == mask)) {
-        GLint status;
-        GLuint program = glCreateProgram();
+    if (!program) {
+        // build all shaders, errors are only checked by initialize() since that waits for the
+        // compilation to finish
+        #pragma nounroll
         for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
-            if (validShaderSet & (1U << i)) {
-                glAttachShader(program, this->gl.shaders[i]);
+            GLenum glShaderType;
+            Shader type = (Shader)i;
+            switch (type) {
+                case Shader::VERTEX:
+                    glShaderType = GL_VERTEX_SHADER;
+                    break;
+                case Shader::FRAGMENT:
+                    glShaderType = GL_FRAGMENT_SHADER;
+                    break;
+                case Shader::COMPUTE:
+                    glShaderType = GL_COMPUTE_SHADER;
+                    break;
             }
-        }
-        glLinkProgram(program);
-
-        glGetProgramiv(program, GL_LINK_STATUS, &status);
-        if (UTILS_UNLIKELY(status != GL_TRUE)) {
-            char error[512];
-            glGetProgramInfoLog(program, sizeof(error), nullptr, error);
-
-            slog.e << "LINKING: " << error << io::endl;
-            glDeleteProgram(program);
-            return;
-        }
-        this->gl.program = program;
 
-        // Associate each UniformBlock in the program to a known binding.
-        auto const& uniformInterfaceBlocks = programBuilder.getUniformInterfaceBlocks();
-        size_t n = uniformInterfaceBlocks.size();
-        #pragma nounroll
-        for (GLuint binding = 0; binding < n; binding++) {
-            auto const& uib = uniformInterfaceBlocks[binding];
-            if (uib != nullptr) {
-                GLint index = glGetUniformBlockIndex(program, uib->getName().c_str());
-                if (index >= 0) {
-                    glUniformBlockBinding(program, GLuint(index), binding);
-                }
+            if (shadersSource[i].length()) {
+                char const* const source = shadersSource[i].c_str();
+                GLuint shaderId = glCreateShader(glShaderType);
+                glShaderSource(shaderId, 1, &source, nullptr);
+                glCompileShader(shaderId);
+                this->gl.shaders[i] = shaderId;
+                mValidShaderSet |= 1U << i;
             }
         }
 
-        if (programBuilder.hasSamplers()) {
-            // if we have samplers, we need to do a bit of extra work
-            // activate this program so we can set all its samplers once and for all (glUniform1i)
-            gl->useProgram(program);
-
-            auto const& samplerInterfaceBlocks = programBuilder.getSamplerInterfaceBlocks();
-            auto& indicesRun = mIndicesRuns;
-            uint8_t numUsedBindings = 0;
-            uint8_t tmu = 0;
-            #pragma nounroll
-            for (size_t i = 0, c = samplerInterfaceBlocks.size(); i < c; i++) {
-                auto const& sib = samplerInterfaceBlocks[i];
-                if (sib != nullptr) {
-                    // Cache the sampler uniform locations for each interface block
-                    auto const& infos(sib->getSamplerInfoList());
-                    if (!infos.empty()) {
-                        BlockInfo& info = mBlockInfos[numUsedBindings];
-                        info.binding = uint8_t(i);
-
-                        // sampler interface block name
-                        std::string sib_name(sib->getName().c_str());
-                        sib_name.front() = char(std::tolower(sib_name.front()));
-
-                        uint8_t count = 0;
-                        for (uint8_t j = 0, m = uint8_t(infos.size()); j < m; ++j) {
-                            // build unique name for this uniform (sampler)
-                            auto const& e = infos[j];
-                            std::string e_name(e.name.c_str());
-                            std::string uniformSamplerName(sib_name + "_" + e_name);
-
-                            // find its location and associate a TMU to it
-                            GLint loc = glGetUniformLocation(program, uniformSamplerName.c_str());
-                            if (loc >= 0) {
-                                glUniform1i(loc, tmu);
-                                indicesRun[tmu] = j;
-                                count++;
-                                tmu++;
-                            } else {
-                                // glGetUniformLocation could fail if the uniform is not used
-                                // in the program. We should just ignore the error in that case.
-                            }
-                        }
-
-                        if (count > 0) {
-                            numUsedBindings++;
-                            info.count = uint8_t(count - 1);
-                        }
-                    }
+        // we need at least a vertex and fragment program, or a compute program
+        const uint8_t validShaderSet = mValidShaderSet;
+        const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
+        if (UTILS_LIKELY((validShaderSet & mask) == mask) ||
+                validShaderSet == COMPUTE_SHADER_BIT) {
+            program = glCreateProgram();
+            for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+                if (validShaderSet & (1U << i)) {
+                    glAttachShader(program, this->gl.shaders[i]);
                 }
             }
-            mUsedBindingsCount = numUsedBindings;
+            if (blobCache) {
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+            glLinkProgram(program);
         }
-        mIsValid = true;
     }
+    this->gl.program = program;
 
-    // failing to compile a program can't be fatal, because this will happen a lot in
-    // the material tools. We need to have a better way to handle these errors and
-    // return to the editor.
-    if (UTILS_UNLIKELY(!isValid())) {
-        PANIC_LOG("failed to compile glsl program");
+    if (program && mValidShaderSet && gl->ext.KHR_parallel_shader_compile) {
+        // the driver compiles and links in the background, keep what initialize() needs
+        // until isReady() finds it done
+        mPending.reset(new Pending{ std::move(programBuilder), std::move(key) });
+        return;
     }
+
+    initialize(gl, programBuilder, key);
 }
 
 OpenGLProgram::~OpenGLProgram() noexcept {
     const size_t validShaderSet = mValidShaderSet;
-    const bool isValid = mIsValid;
     GLuint program = gl.program;
     if (validShaderSet) {
         #pragma nounroll
         for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
             if (validShaderSet & (1U << i)) {
                 const GLuint shader = gl.shaders[i];
-                if (isValid) {
+                if (program) {
                     glDetachShader(program, shader);
                 }
                 glDeleteShader(shader);
             }
         }
     }
-    if (isValid) {
+    if (program) {
         glDeleteProgram(program);
     }
 }
 
+bool OpenGLProgram::isReadySlow(OpenGLDriver* gl, bool wait) noexcept {
+    assert(mPending);
+    if (!wait) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(this->gl.program, GL_COMPLETION_STATUS_KHR, &completed);
+        if (!completed) {
+            return false;
+        }
+    }
+    std::unique_ptr<Pending> pending(std::move(mPending));
+    initialize(gl, pending->program, pending->key);
+    return true;
+}
+
+void OpenGLProgram::initialize(OpenGLDriver* gl, const Program& programBuilder,
+        std::string const& key) noexcept {
+    GLuint program = this->gl.program;
+
+    if (mValidShaderSet || !program) {
+        // this program wasn't loaded from a binary, check how the compilation went
+        bool valid = program != 0;
+        const auto& shadersSource = programBuilder.getShadersSource();
+        for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+            if (mValidShaderSet & (1U << i)) {
+                GLint status;
+                glGetShaderiv(this->gl.shaders[i], GL_COMPILE_STATUS, &status);
+                if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                    logCompilationError(slog.e, this->gl.shaders[i], shadersSource[i].c_str());
+                    valid = false;
+                }
+            }
+        }
+
+        if (valid) {
+            GLint status;
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+            if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                char error[512];
+                glGetProgramInfoLog(program, sizeof(error), nullptr, error);
+                slog.e << "LINKING: " << error << io::endl;
+                valid = false;
+            }
+        }
+
+        if (UTILS_UNLIKELY(!valid)) {
+            // failing to compile a program can't be fatal, because this will happen a lot in
+            // the material tools. We need to have a better way to handle these errors and
+            // return to the editor.
+            PANIC_LOG("failed to compile glsl program");
+            return;
+        }
+
+        if (!key.empty()) {
+            saveProgramBinary(*gl->mBlobCache, key, program);
+        }
+    }
+
+    // Associate each UniformBlock in the program to a known binding.
+    auto const& uniformInterfaceBlocks = programBuilder.getUniformInterfaceBlocks();
+    size_t n = uniformInterfaceBlocks.size();
+    #pragma nounroll
+    for (GLuint binding = 0; binding < n; binding++) {
+        auto const& uib = uniformInterfaceBlocks[binding];
+        if (uib != nullptr) {
+            GLint index = glGetUniformBlockIndex(program, uib->getName().c_str());
+            if (index >= 0) {
+                glUniformBlockBinding(program, GLuint(index), binding);
+            }
+        }
+    }
+
+    if (programBuilder.hasSamplers()) {
+        // if we have samplers, we need to do a bit of extra work
+        // activate this program so we can set all its samplers once and for all (glUniform1i)
+        gl->useProgram(program);
+
+        auto const& samplerInterfaceBlocks = programBuilder.getSamplerInterfaceBlocks();
+        auto& indicesRun = mIndicesRuns;
+        uint8_t numUsedBindings = 0;
+        uint8_t tmu = 0;
+        #pragma nounroll
+        for (size_t i = 0, c = samplerInterfaceBlocks.size(); i < c; i++) {
+            auto const& sib = samplerInterfaceBlocks[i];
+            if (sib != nullptr) {
+                // Cache the sampler uniform locations for each interface block
+                auto const& infos(sib->getSamplerInfoList());
+                if (!infos.empty()) {
+                    BlockInfo& info = mBlockInfos[numUsedBindings];
+                    info.binding = uint8_t(i);
+
+                    // sampler interface block name
+                    std::string sib_name(sib->getName().c_str());
+                    sib_name.front() = char(std::tolower(sib_name.front()));
+
+                    uint8_t count = 0;
+                    for (uint8_t j = 0, m = uint8_t(infos.size()); j < m; ++j) {
+                        // build unique name for this uniform (sampler)
+                        auto const& e = infos[j];
+                        std::string e_name(e.name.c_str());
+                        std::string uniformSamplerName(sib_name + "_" + e_name);
+
+                        // find its location and associate a TMU to it
+                        GLint loc = glGetUniformLocation(program, uniformSamplerName.c_str());
+                        if (loc >= 0) {
+                            glUniform1i(loc, tmu);
+                            indicesRun[tmu] = j;
+                            count++;
+                            tmu++;
+                        } else {
+                            // glGetUniformLocation could fail if the uniform is not used
+                            // in the program. We should just ignore the error in that case.
+                        }
+                    }
+
+                    if (count > 0) {
+                        numUsedBindings++;
+                        info.count = uint8_t(count - 1);
+                    }
+                }
+            }
+        }
+        mUsedBindingsCount = numUsedBindings;
+    }
+    mIsValid = true;
+}
+
 void OpenGLProgram::updateSamplers(OpenGLDriver* gl) noexcept {
     using GLTexture = OpenGLDriver::GLTexture;
 
@@ -203,9 +264,12 @@ void OpenGLProgram::updateSamplers(OpenGLDriver* gl) noexcept {
     UTILS_ASSUME(mUsedBindingsCount > 0);
     for (uint8_t i = 0, tmu = 0, n = mUsedBindingsCount; i < n; i++) {
         BlockInfo blockInfo = blockInfos[i];
-        HwSamplerBuffer const * const UTILS_RESTRICT hwsb = samplerBindings[blockInfo.binding];
+        OpenGLDriver::GLSamplerBuffer const * const UTILS_RESTRICT hwsb =
+                static_cast<OpenGLDriver::GLSamplerBuffer const*>(
+                        samplerBindings[blockInfo.binding]);
         SamplerBuffer const& UTILS_RESTRICT sb = *(hwsb->sb);
         SamplerBuffer::Sampler const* const UTILS_RESTRICT samplers = sb.getBuffer();
+        GLuint const* const UTILS_RESTRICT glSamplers = hwsb->gl.samplers.get();
         for (uint8_t j = 0, m = blockInfo.count ; j <= m; ++j, ++tmu) { // "<=" on purpose here
             const uint8_t index = indicesRun[tmu];
             assert(index < sb.getSize());
@@ -224,14 +288,75 @@ void OpenGLProgram::updateSamplers(OpenGLDriver* gl) noexcept {
 
             gl->bindTexture(tmu, t->gl.target, t, t->gl.targetIndex);
 
-            // FIXME: getSampler() is expensive because it's a hashmap lookup
-            GLuint sampler = gl->getSampler(samplers[index].s);
-            gl->bindSampler(tmu, sampler);
+            gl->bindSampler(tmu, glSamplers[index]);
         }
     }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+std::string OpenGLProgram::getProgramBinaryKey(
+        OpenGLDriver const* gl, const Program& programBuilder) noexcept {
+    // The sources depend on the material and the variant, hash them so that a material that was
+    // rebuilt doesn't load a stale binary (FNV-1a). The name and variant are just there to make
+    // the keys readable.
+    uint64_t hash = 0xcbf29ce484222325u;
+    for (utils::CString const& source : programBuilder.getShadersSource()) {
+        char const* const c = source.c_str();
+        for (size_t i = 0, n = source.length(); i < n; i++) {
+            hash = (hash ^ uint8_t(c[i])) * 0x100000001b3u;
+        }
+    }
+    std::string key(programBuilder.getName().c_str());
+    key.push_back('\0');
+    key.push_back(char(programBuilder.getVariant()));
+    key.append((char const*) &hash, sizeof(hash));
+    key.append(gl->mDriverVersion);
+    return key;
+}
+
+GLuint OpenGLProgram::loadProgramBinary(driver::BlobCache& cache, std::string const& key) noexcept {
+    // the blob is the binary's format followed by the binary itself
+    const size_t size = cache.get(key.data(), key.size(), nullptr, 0);
+    if (size <= sizeof(GLenum)) {
+        return 0;
+    }
+    std::vector<char> blob(size);
+    if (cache.get(key.data(), key.size(), blob.data(), size) != size) {
+        return 0;
+    }
+
+    GLenum format;
+    memcpy(&format, blob.data(), sizeof(format));
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, blob.data() + sizeof(format), GLsizei(size - sizeof(format)));
+
+    // the driver can reject binaries at any time (e.g. after an update that kept its version)
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (UTILS_UNLIKELY(status != GL_TRUE)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void OpenGLProgram::saveProgramBinary(driver::BlobCache& cache, std::string const& key,
+        GLuint program) noexcept {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> blob(sizeof(GLenum) + length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, blob.data() + sizeof(format));
+    if (written > 0) {
+        memcpy(blob.data(), &format, sizeof(format));
+        cache.put(key.data(), key.size(), blob.data(), sizeof(format) + size_t(written));
+    }
+}
+
 void UTILS_NOINLINE OpenGLProgram::logCompilationError(
         io::ostream& out, GLuint shaderId, char const* source) noexcept {
     char error[512];
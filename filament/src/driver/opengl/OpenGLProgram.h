@@ -20,6 +20,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <utils/compiler.h>
@@ -38,11 +40,27 @@ class Program;
 class OpenGLProgram : public HwProgram {
 public:
 
-    OpenGLProgram(OpenGLDriver* gl, const Program& builder) noexcept;
+    OpenGLProgram(OpenGLDriver* gl, Program&& builder) noexcept;
     ~OpenGLProgram() noexcept;
 
     bool isValid() const noexcept { return mIsValid; }
 
+    // Returns whether the background compilation of this program is done, and finishes its
+    // set-up if so. Programs are always ready without GL_KHR_parallel_shader_compile.
+    bool isReady(OpenGLDriver* const gl) noexcept {
+        return UTILS_LIKELY(!mPending) || isReadySlow(gl, false);
+    }
+
+    // Waits for the background compilation of this program to be done.
+    void wait(OpenGLDriver* const gl) noexcept {
+        if (UTILS_UNLIKELY(mPending)) {
+            isReadySlow(gl, true);
+        }
+    }
+
+    // program to draw with while this one isn't ready, can be null
+    Handle<HwProgram> getFallback() const noexcept { return mFallback; }
+
     void use(OpenGLDriver* const gl) noexcept {
         if (UTILS_UNLIKELY(mUsedBindingsCount)) {
             // We rely on GL state tracking to avoid unnecessary glBindTexture / glBindSampler
@@ -64,7 +82,7 @@ public:
     struct {
         GLuint shaders[Program::NUM_SHADER_TYPES];
         GLuint program;
-    } gl; // 12 bytes
+    } gl; // 16 bytes
 
     static void logCompilationError(utils::io::ostream& out, GLuint shaderId, char const* source) noexcept;
 
@@ -72,6 +90,7 @@ private:
     static constexpr uint8_t NUM_TEXTURE_UNITS = OpenGLDriver::MAX_TEXTURE_UNITS;
     static constexpr uint8_t VERTEX_SHADER_BIT   = uint8_t(1) << size_t(Program::Shader::VERTEX);
     static constexpr uint8_t FRAGMENT_SHADER_BIT = uint8_t(1) << size_t(Program::Shader::FRAGMENT);
+    static constexpr uint8_t COMPUTE_SHADER_BIT  = uint8_t(1) << size_t(Program::Shader::COMPUTE);
 
     struct BlockInfo {
         uint8_t binding : 3;    // binding (i.e.: index in mSamplerBindings)
@@ -85,9 +104,17 @@ private:
         static_assert(Program::NUM_SAMPLER_BINDINGS <= 8, "NUM_SAMPLER_BINDINGS must be <= 8");
     };
 
+    // what's needed to finish the set-up of a program compiled in the background
+    struct Pending {
+        Program program;
+        std::string key;    // of the program binary to save, if any
+    };
+
     uint8_t mUsedBindingsCount = 0;
     uint8_t mValidShaderSet = 0;
     bool mIsValid = false;
+    Handle<HwProgram> mFallback;
+    std::unique_ptr<Pending> mPending;
 
     // information about each USED sampler buffer (no gaps)
     std::array<BlockInfo, Program::NUM_SAMPLER_BINDINGS> mBlockInfos;   // 8 bytes
@@ -96,6 +123,16 @@ private:
     std::array<uint8_t, NUM_TEXTURE_UNITS> mIndicesRuns;    // 16 bytes
 
     void updateSamplers(OpenGLDriver* gl) noexcept;
+    bool isReadySlow(OpenGLDriver* gl, bool wait) noexcept;
+    void initialize(OpenGLDriver* gl, const Program& programBuilder,
+            std::string const& key) noexcept;
+
+    // program binaries, see Engine::Config::blobCache
+    static std::string getProgramBinaryKey(
+            OpenGLDriver const* gl, const Program& programBuilder) noexcept;
+    static GLuint loadProgramBinary(driver::BlobCache& cache, std::string const& key) noexcept;
+    static void saveProgramBinary(driver::BlobCache& cache, std::string const& key,
+            GLuint program) noexcept;
 };
 
 
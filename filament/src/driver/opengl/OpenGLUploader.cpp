@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/opengl/OpenGLUploader.h"
+
+#include "driver/opengl/OpenGLDriver.h"
+#include "driver/opengl/GLUtils.h"
+
+#include <filament/driver/Platform.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Log.h>
+
+namespace filament {
+
+using namespace driver;
+using namespace utils;
+
+bool OpenGLUploader::init() noexcept {
+    if (!mPlatform.createUploadContext()) {
+        return false;
+    }
+    mThread = std::thread(&OpenGLUploader::loop, this);
+    return true;
+}
+
+void OpenGLUploader::terminate() noexcept {
+    std::unique_lock<std::mutex> lock(mLock);
+    mExitRequested = true;
+    lock.unlock();
+    mCondition.notify_all();
+    mThread.join();
+}
+
+uint32_t OpenGLUploader::push(Upload&& upload) noexcept {
+    // The object was created by the driver's context, the upload context can only use it once
+    // these commands are done; the flush makes the fence visible to the other context.
+    GLsync ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    const uint32_t id = mNextId++;
+    std::unique_lock<std::mutex> lock(mLock);
+    mQueue.push_back({ id, ready, std::move(upload) });
+    lock.unlock();
+    mCondition.notify_all();
+    return id;
+}
+
+void OpenGLUploader::wait(uint32_t id) noexcept {
+    std::unique_lock<std::mutex> lock(mLock);
+    mCondition.wait(lock, [this, id]() -> bool { return mCompletedId >= id; });
+    // the fences of a context signal in order, the last one covers all the uploads before it
+    if (mCompleted) {
+        glWaitSync(mCompleted, 0, GL_TIMEOUT_IGNORED);
+    }
+}
+
+void OpenGLUploader::loop() noexcept {
+    JobSystem::setThreadName("UploadThread");
+    mPlatform.makeUploadContextCurrent();
+
+    auto& queue = mQueue;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCondition.wait(lock, [this, &queue]() -> bool {
+            return mExitRequested || !queue.empty();
+        });
+        if (queue.empty()) {
+            break;
+        }
+        Job job(std::move(queue.front()));
+        queue.pop_front();
+        lock.unlock();
+
+        glWaitSync(job.ready, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(job.ready);
+        upload(job.upload);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        // the data was copied by GL, it can be released
+        mDriver.scheduleDestroy(std::move(job.upload.data));
+
+        lock.lock();
+        if (mCompleted) {
+            glDeleteSync(mCompleted);
+        }
+        mCompleted = fence;
+        mCompletedId = job.id;
+        lock.unlock();
+        mCondition.notify_all();
+
+        CHECK_GL_ERROR(utils::slog.e)
+    }
+
+    // nothing can wait on the last fence anymore, the driver is terminating
+    if (mCompleted) {
+        glDeleteSync(mCompleted);
+        mCompleted = nullptr;
+    }
+    mPlatform.destroyUploadContext();
+}
+
+void OpenGLUploader::upload(Upload const& u) noexcept {
+    void const* const data = u.data.buffer;
+
+    if (u.type == Upload::Type::BUFFER) {
+        // like updateBuffer() in OpenGLDriver, the dynamic buffers fully replaced are orphaned
+        glBindBuffer(u.target, u.name);
+        if (u.usage != GL_STATIC_DRAW && u.byteOffset == 0 && u.byteSize == u.bufferSize) {
+            glBufferData(u.target, u.bufferSize, data, u.usage);
+        } else {
+            glBufferSubData(u.target, u.byteOffset, u.byteSize, data);
+        }
+        glBindBuffer(u.target, 0);
+        return;
+    }
+
+    glBindTexture(u.target, u.name);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, u.rowLength);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, u.alignment);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, u.skipPixels);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, u.skipRows);
+
+    if (u.type == Upload::Type::TEXTURE_CUBEMAP) {
+        #pragma nounroll
+        for (size_t face = 0; face < 6; face++) {
+            const GLenum target = GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face);
+            void const* const faceData =
+                    static_cast<uint8_t const*>(data) + u.faceOffsets[face];
+            if (u.compressed) {
+                glCompressedTexSubImage2D(target, u.level, 0, 0, u.width, u.height,
+                        u.format, u.imageSize, faceData);
+            } else {
+                glTexSubImage2D(target, u.level, 0, 0, u.width, u.height,
+                        u.format, u.dataType, faceData);
+            }
+        }
+    } else if (u.target == GL_TEXTURE_2D) {
+        if (u.compressed) {
+            glCompressedTexSubImage2D(u.target, u.level, u.xoffset, u.yoffset,
+                    u.width, u.height, u.format, u.imageSize, data);
+        } else {
+            glTexSubImage2D(u.target, u.level, u.xoffset, u.yoffset,
+                    u.width, u.height, u.format, u.dataType, data);
+        }
+    } else {
+        if (u.compressed) {
+            glCompressedTexSubImage3D(u.target, u.level, u.xoffset, u.yoffset, u.zoffset,
+                    u.width, u.height, u.depth, u.format, u.imageSize, data);
+        } else {
+            glTexSubImage3D(u.target, u.level, u.xoffset, u.yoffset, u.zoffset,
+                    u.width, u.height, u.depth, u.format, u.dataType, data);
+        }
+    }
+
+    // the levels are widened as they become available, see OpenGLDriver::setTextureData()
+    if (u.baseLevel >= 0) {
+        glTexParameteri(u.target, GL_TEXTURE_BASE_LEVEL, u.baseLevel);
+    }
+    if (u.maxLevel >= 0) {
+        glTexParameteri(u.target, GL_TEXTURE_MAX_LEVEL, u.maxLevel);
+    }
+    glBindTexture(u.target, 0);
+}
+
+} // namespace filament
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_OPENGLUPLOADER_H
+#define TNT_FILAMENT_DRIVER_OPENGLUPLOADER_H
+
+#include "driver/opengl/gl_headers.h"
+
+#include <filament/driver/BufferDescriptor.h>
+#include <filament/driver/DriverEnums.h>
+
+#include <utils/compiler.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <stdint.h>
+
+namespace filament {
+
+class OpenGLDriver;
+
+namespace driver {
+class OpenGLPlatform;
+} // namespace driver
+
+/*
+ * OpenGLUploader uploads the large textures and buffers on a thread of its own, with a context
+ * sharing its objects with the driver's (see OpenGLPlatform::createUploadContext()), so that
+ * the driver thread doesn't stall while the data is copied.
+ *
+ * Each upload gets an id, which the driver keeps with the object it writes into. Before using
+ * that object, the driver calls wait() with it: this only blocks the driver thread if the
+ * upload hasn't been issued yet, the GPU of the driver's context then waits for it to
+ * complete. The uploads are done in order.
+ */
+class OpenGLUploader {
+public:
+    // uploads smaller than this are done right away on the driver thread, unless the object
+    // already has an upload pending
+    static constexpr size_t MIN_SIZE = 256 * 1024;
+
+    struct Upload {
+        enum class Type : uint8_t {
+            TEXTURE,                // a level of a 2D, 3D or array texture
+            TEXTURE_CUBEMAP,        // a level of the 6 faces of a cubemap
+            BUFFER                  // a range of a buffer object
+        };
+
+        Type type = Type::TEXTURE;
+        bool compressed = false;
+        GLenum target = 0;          // of the texture or the buffer
+        GLuint name = 0;
+
+        // textures
+        GLint level = 0;
+        GLint xoffset = 0, yoffset = 0, zoffset = 0;
+        GLsizei width = 0, height = 0, depth = 0;
+        GLenum format = 0;          // the internal format for compressed textures
+        GLenum dataType = 0;
+        GLsizei imageSize = 0;      // compressed textures only, per face
+        GLint rowLength = 0, alignment = 1, skipPixels = 0, skipRows = 0;
+        GLint baseLevel = -1;       // new base and max levels of the texture, -1 if unchanged
+        GLint maxLevel = -1;
+        driver::FaceOffsets faceOffsets;
+
+        // buffers
+        GLintptr byteOffset = 0;
+        GLsizeiptr byteSize = 0;
+        GLsizeiptr bufferSize = 0;
+        GLenum usage = GL_STATIC_DRAW;
+
+        driver::BufferDescriptor data;
+    };
+
+    OpenGLUploader(OpenGLDriver& driver, driver::OpenGLPlatform& platform) noexcept
+            : mDriver(driver), mPlatform(platform) { }
+
+    // starts the upload thread, returns false if the platform doesn't have an upload context
+    bool init() noexcept;
+
+    // finishes the pending uploads and stops the upload thread
+    void terminate() noexcept;
+
+    // queues an upload, called on the driver thread after the object was created; returns its
+    // id, which is never 0
+    uint32_t push(Upload&& upload) noexcept;
+
+    // makes the GPU commands of the calling (driver) thread wait for the upload id and the
+    // ones before it, blocks until they're issued
+    void wait(uint32_t id) noexcept;
+
+private:
+    void loop() noexcept;
+    void upload(Upload const& upload) noexcept;
+
+    struct Job {
+        uint32_t id;
+        GLsync ready;               // signaled when the driver is done creating the object
+        Upload upload;
+    };
+
+    OpenGLDriver& mDriver;
+    driver::OpenGLPlatform& mPlatform;
+    std::thread mThread;
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::deque<Job> mQueue;
+    uint32_t mNextId = 1;           // only accessed by the driver thread
+    uint32_t mCompletedId = 0;
+    GLsync mCompleted = nullptr;    // fence of the upload mCompletedId
+    bool mExitRequested = false;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_OPENGLUPLOADER_H
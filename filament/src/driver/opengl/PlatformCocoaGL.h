@@ -35,6 +35,9 @@ public:
     void terminate() noexcept final;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final;
+    // headless swap chains are not supported
+    SwapChain* createSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept final { return nullptr; }
     void destroySwapChain(SwapChain* swapChain) noexcept final;
     void makeCurrent(SwapChain* drawSwapChain, SwapChain* readSwapChain) noexcept final;
     void commit(SwapChain* swapChain) noexcept final;
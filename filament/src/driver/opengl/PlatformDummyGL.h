@@ -34,6 +34,11 @@ public:
         flags = 0;
         return nullptr;
     }
+    SwapChain* createSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept final override {
+        flags = 0;
+        return nullptr;
+    }
     void destroySwapChain(SwapChain* swapChain) noexcept final override {}
     void makeCurrent(SwapChain* drawSwapChain, SwapChain* readSwapChain) noexcept final override {}
     void commit(SwapChain* swapChain) noexcept final override {}
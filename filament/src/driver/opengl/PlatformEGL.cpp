@@ -36,7 +36,9 @@
 #include "driver/opengl/OpenGLDriver.h"
 
 #include <android/api-level.h>
+#include <poll.h>
 #include <sys/system_properties.h>
+#include <unistd.h>
 
 // We require filament to be built with a API 21 toolchain, before that, OpenGLES 3.0 didn't exist
 #if __ANDROID_API__ < 21
@@ -53,10 +55,12 @@ namespace glext {
 UTILS_PRIVATE PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;
 UTILS_PRIVATE PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
 UTILS_PRIVATE PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
+UTILS_PRIVATE PFNEGLWAITSYNCKHRPROC eglWaitSyncKHR;
 UTILS_PRIVATE PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC eglGetNativeClientBufferANDROID;
 UTILS_PRIVATE PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 UTILS_PRIVATE PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 UTILS_PRIVATE PFNEGLPRESENTATIONTIMEANDROIDPROC eglPresentationTimeANDROID;
+UTILS_PRIVATE PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 }
 using namespace glext;
 
@@ -143,10 +147,15 @@ Driver* PlatformEGL::createDriver(void* sharedContext) noexcept {
     eglCreateSyncKHR = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
     eglDestroySyncKHR = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
     eglClientWaitSyncKHR = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+    eglWaitSyncKHR = (PFNEGLWAITSYNCKHRPROC) eglGetProcAddress("eglWaitSyncKHR");
     eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
     eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
     eglGetNativeClientBufferANDROID = (PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC) eglGetProcAddress("eglGetNativeClientBufferANDROID");
     eglPresentationTimeANDROID = (PFNEGLPRESENTATIONTIMEANDROIDPROC) eglGetProcAddress("eglPresentationTimeANDROID");
+    eglDupNativeFenceFDANDROID = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC) eglGetProcAddress("eglDupNativeFenceFDANDROID");
+
+    mNativeFenceSync = extensions.has("EGL_ANDROID_native_fence_sync") &&
+            eglDupNativeFenceFDANDROID != nullptr;
 
     EGLint configsCount;
     EGLint configAttribs[] = {
@@ -313,6 +322,25 @@ Platform::SwapChain* PlatformEGL::createSwapChain(
     return (SwapChain*)sur;
 }
 
+Platform::SwapChain* PlatformEGL::createSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    EGLint attribs[] = {
+            EGL_WIDTH,  EGLint(width),
+            EGL_HEIGHT, EGLint(height),
+            EGL_NONE
+    };
+    EGLSurface sur = eglCreatePbufferSurface(mEGLDisplay,
+            (flags & driver::SWAP_CHAIN_CONFIG_TRANSPARENT) ? mEGLTransparentConfig : mEGLConfig,
+            attribs);
+    if (UTILS_UNLIKELY(sur == EGL_NO_SURFACE)) {
+        logEglError("eglCreatePbufferSurface");
+        return nullptr;
+    }
+    // eglSwapBuffers() has no effect on a pbuffer, so committing a headless swap chain never
+    // waits for a display
+    return (SwapChain*)sur;
+}
+
 void PlatformEGL::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
     EGLSurface sur = (EGLSurface) swapChain;
     if (sur != EGL_NO_SURFACE) {
@@ -348,12 +376,37 @@ void PlatformEGL::commit(Platform::SwapChain* swapChain) noexcept {
 
 Platform::Fence* PlatformEGL::createFence() noexcept {
     Fence* f = nullptr;
+#ifdef EGL_ANDROID_native_fence_sync
+    if (mNativeFenceSync) {
+        // native fences are waited on like the others, and can also be exported as a sync file
+        f = (Fence*) eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+        if (f) {
+            // the sync file only exists once the fence has been flushed
+            glFlush();
+            return f;
+        }
+    }
+#endif
 #ifdef EGL_KHR_reusable_sync
     f = (Fence*) eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_FENCE_KHR, nullptr);
 #endif
     return f;
 }
 
+int PlatformEGL::dupNativeFence(Platform::Fence* fence) noexcept {
+#ifdef EGL_ANDROID_native_fence_sync
+    EGLSyncKHR sync = (EGLSyncKHR) fence;
+    if (mNativeFenceSync && sync != EGL_NO_SYNC_KHR) {
+        int fd = eglDupNativeFenceFDANDROID(mEGLDisplay, sync);
+        if (fd != EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+            return fd;
+        }
+        logEglError("eglDupNativeFenceFDANDROID");
+    }
+#endif
+    return -1;
+}
+
 void PlatformEGL::destroyFence(Platform::Fence* fence) noexcept {
 #ifdef EGL_KHR_reusable_sync
     EGLSyncKHR sync = (EGLSyncKHR) fence;
@@ -452,6 +505,106 @@ void PlatformEGL::destroyExternalTextureStorage(
     }
 }
 
+void* PlatformEGL::createExternalImage(void* image) noexcept {
+    // eglGetNativeClientBufferANDROID() only exists since API 26
+    if (UTILS_UNLIKELY(!image || !eglGetNativeClientBufferANDROID)) {
+        return nullptr;
+    }
+    EGLClientBuffer clientBuffer = eglGetNativeClientBufferANDROID((AHardwareBuffer const*)image);
+    if (UTILS_UNLIKELY(!clientBuffer)) {
+        logEglError("eglGetNativeClientBufferANDROID");
+        return nullptr;
+    }
+    const EGLint attr[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+    EGLImageKHR eglImage = eglCreateImageKHR(mEGLDisplay,
+            EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, clientBuffer, attr);
+    if (UTILS_UNLIKELY(eglImage == EGL_NO_IMAGE_KHR)) {
+        logEglError("eglCreateImageKHR");
+        return nullptr;
+    }
+    return eglImage;
+}
+
+void PlatformEGL::destroyExternalImage(void* externalImage) noexcept {
+    if (externalImage) {
+        eglDestroyImageKHR(mEGLDisplay, (EGLImageKHR)externalImage);
+    }
+}
+
+void PlatformEGL::waitNativeFence(int fence) noexcept {
+#if defined(EGL_ANDROID_native_fence_sync) && defined(EGL_KHR_wait_sync)
+    if (eglWaitSyncKHR) {
+        // on success, the EGLSync takes ownership of the file descriptor
+        const EGLint attr[] = { EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence, EGL_NONE };
+        EGLSyncKHR sync = eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, attr);
+        if (sync != EGL_NO_SYNC_KHR) {
+            // the GPU waits, not us
+            eglWaitSyncKHR(mEGLDisplay, sync, 0);
+            eglDestroySyncKHR(mEGLDisplay, sync);
+            return;
+        }
+    }
+#endif
+    // native fences can't be waited on by the GPU, wait on the CPU instead
+    struct pollfd fd = { fence, POLLIN, 0 };
+    poll(&fd, 1, -1);
+    close(fence);
+}
+
+bool PlatformEGL::createUploadContext() noexcept {
+    EGLint contextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 3,
+            EGL_NONE, EGL_NONE, // reserved for EGL_CONTEXT_OPENGL_NO_ERROR_KHR below
+            EGL_NONE
+    };
+    const EGLint pbufferAttribs[] = {
+            EGL_WIDTH,  1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+    };
+
+    // like the dummy surface, the transparent config is compatible with our context
+    mEGLUploadSurface = eglCreatePbufferSurface(mEGLDisplay, mEGLTransparentConfig, pbufferAttribs);
+    if (mEGLUploadSurface == EGL_NO_SURFACE) {
+        logEglError("eglCreatePbufferSurface");
+        return false;
+    }
+
+    mEGLUploadContext = eglCreateContext(mEGLDisplay, mEGLTransparentConfig, mEGLContext,
+            contextAttribs);
+    if (mEGLUploadContext == EGL_NO_CONTEXT) {
+        // our context could have been created with EGL_CONTEXT_OPENGL_NO_ERROR_KHR, which the
+        // shared context must match
+        contextAttribs[2] = EGL_CONTEXT_OPENGL_NO_ERROR_KHR;
+        contextAttribs[3] = EGL_TRUE;
+        mEGLUploadContext = eglCreateContext(mEGLDisplay, mEGLTransparentConfig, mEGLContext,
+                contextAttribs);
+    }
+    if (UTILS_UNLIKELY(mEGLUploadContext == EGL_NO_CONTEXT)) {
+        // not fatal, the uploads are done by our context instead
+        logEglError("eglCreateContext");
+        eglDestroySurface(mEGLDisplay, mEGLUploadSurface);
+        mEGLUploadSurface = EGL_NO_SURFACE;
+        return false;
+    }
+    return true;
+}
+
+void PlatformEGL::makeUploadContextCurrent() noexcept {
+    if (!eglMakeCurrent(mEGLDisplay, mEGLUploadSurface, mEGLUploadSurface, mEGLUploadContext)) {
+        logEglError("eglMakeCurrent");
+    }
+}
+
+void PlatformEGL::destroyUploadContext() noexcept {
+    eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(mEGLDisplay, mEGLUploadContext);
+    eglDestroySurface(mEGLDisplay, mEGLUploadSurface);
+    mEGLUploadContext = EGL_NO_CONTEXT;
+    mEGLUploadSurface = EGL_NO_SURFACE;
+    eglReleaseThread();
+}
+
 int PlatformEGL::getOSVersion() const noexcept {
     return mOSVersion;
 }
@@ -42,6 +42,7 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final;
+    SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t& flags) noexcept final;
     void destroySwapChain(SwapChain* swapChain) noexcept final;
     void makeCurrent(SwapChain* drawSwapChain, SwapChain* readSwapChain) noexcept final;
     void commit(SwapChain* swapChain) noexcept final;
@@ -52,6 +53,8 @@ public:
     Fence* createFence() noexcept final;
     void destroyFence(Fence* fence) noexcept final;
     driver::FenceStatus waitFence(Fence* fence, uint64_t timeout) noexcept final;
+    bool canCreateNativeFence() noexcept final { return mNativeFenceSync; }
+    int dupNativeFence(Fence* fence) noexcept final;
 
     Stream* createStream(void* nativeStream) noexcept final;
     void destroyStream(Stream* stream) noexcept final;
@@ -64,6 +67,14 @@ public:
             uint32_t w, uint32_t h, driver::TextureFormat format) noexcept final;
     void destroyExternalTextureStorage(ExternalTexture* ets) noexcept final;
 
+    void* createExternalImage(void* image) noexcept final;
+    void destroyExternalImage(void* externalImage) noexcept final;
+    void waitNativeFence(int fence) noexcept final;
+
+    bool createUploadContext() noexcept final;
+    void makeUploadContextCurrent() noexcept final;
+    void destroyUploadContext() noexcept final;
+
     int getOSVersion() const noexcept final;
 
 private:
@@ -76,7 +87,10 @@ private:
     EGLSurface mEGLDummySurface = EGL_NO_SURFACE;
     EGLConfig mEGLConfig;
     EGLConfig mEGLTransparentConfig;
+    EGLContext mEGLUploadContext = EGL_NO_CONTEXT;
+    EGLSurface mEGLUploadSurface = EGL_NO_SURFACE;
     int mOSVersion;
+    bool mNativeFenceSync = false;
 
     ExternalStreamManagerAndroid& mExternalStreamManager;
     ExternalTextureManagerAndroid& mExternalTextureManager;
@@ -27,6 +27,7 @@
 
 #include <dlfcn.h>
 
+#include <algorithm>
 #include <iostream>
 
 #define LIBRARY_GLX "libGL.so.1"
@@ -167,7 +168,31 @@ Platform::SwapChain* PlatformGLX::createSwapChain(
     return (SwapChain*) nativeWindow;
 }
 
-void PlatformGLX::destroySwapChain(Platform::SwapChain* /*swapChain*/) noexcept {
+Platform::SwapChain* PlatformGLX::createSwapChain(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    int pbufferAttribs[] = {
+            GLX_PBUFFER_WIDTH,  int(width),
+            GLX_PBUFFER_HEIGHT, int(height),
+            GL_NONE
+    };
+
+    // Transparent swap chain is not supported
+    flags &= ~driver::SWAP_CHAIN_CONFIG_TRANSPARENT;
+    GLXPbuffer sur = g_glx.createPbuffer(mGLXDisplay, mGLXConfig[0], pbufferAttribs);
+    if (sur) {
+        mPBuffers.push_back(sur);
+    }
+    return (SwapChain*) sur;
+}
+
+void PlatformGLX::destroySwapChain(Platform::SwapChain* swapChain) noexcept {
+    // we only own the pbuffers, windows belong to the application
+    auto it = std::find(mPBuffers.begin(), mPBuffers.end(), (GLXPbuffer) swapChain);
+    if (it != mPBuffers.end()) {
+        g_glx.setCurrentContext(mGLXDisplay, mDummySurface, mDummySurface, mGLXContext);
+        g_glx.destroyPbuffer(mGLXDisplay, *it);
+        mPBuffers.erase(it);
+    }
 }
 
 void PlatformGLX::makeCurrent(
@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include <bluegl/BlueGL.h>
 #include <GL/glx.h>
 
@@ -35,6 +37,7 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept override;
+    SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t& flags) noexcept override;
     void destroySwapChain(SwapChain* swapChain) noexcept override;
     void makeCurrent(SwapChain* drawSwapChain, SwapChain* readSwapChain) noexcept override;
     void commit(SwapChain* swapChain) noexcept override;
@@ -63,6 +66,7 @@ private:
     GLXContext mGLXContext;
     GLXFBConfig* mGLXConfig;
     GLXPbuffer mDummySurface;
+    std::vector<GLXPbuffer> mPBuffers;  // headless swap chains
 };
 
 } // namespace filament
@@ -33,6 +33,9 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept override;
+    // headless swap chains are not supported
+    SwapChain* createSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept override { return nullptr; }
     void destroySwapChain(SwapChain* swapChain) noexcept override;
     void makeCurrent(SwapChain* drawSwapChain, SwapChain* readSwapChain) noexcept override;
     void commit(SwapChain* swapChain) noexcept override;
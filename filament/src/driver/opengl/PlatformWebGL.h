@@ -34,6 +34,9 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final override;
+    // headless swap chains are not supported
+    SwapChain* createSwapChain(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept final override { return nullptr; }
     void destroySwapChain(SwapChain* swapChain) noexcept final override;
     void makeCurrent(SwapChain* drawSwapChain, SwapChain* readSwapChain) noexcept final override;
     void commit(SwapChain* swapChain) noexcept final override;
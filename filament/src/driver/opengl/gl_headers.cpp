@@ -25,6 +25,9 @@ namespace glext {
 PFNGLSTARTTILINGQCOMPROC glStartTilingQCOM;
 PFNGLENDTILINGQCOMPROC glEndTilingQCOM;
 #endif
+#ifdef GL_QCOM_texture_foveated
+PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC glTextureFoveationParametersQCOM;
+#endif
 #ifdef GL_OES_EGL_image
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 #endif
@@ -54,6 +57,12 @@ public:
                         "glEndTilingQCOM");
 #endif
 
+#ifdef GL_QCOM_texture_foveated
+        glTextureFoveationParametersQCOM =
+                (PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC)eglGetProcAddress(
+                        "glTextureFoveationParametersQCOM");
+#endif
+
 #ifdef GL_OES_EGL_image
         glEGLImageTargetTexture2DOES =
                 (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress(
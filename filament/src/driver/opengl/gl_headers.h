@@ -28,6 +28,9 @@
         extern PFNGLSTARTTILINGQCOMPROC glStartTilingQCOM;
         extern PFNGLENDTILINGQCOMPROC glEndTilingQCOM;
 #endif
+#ifdef GL_QCOM_texture_foveated
+        extern PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC glTextureFoveationParametersQCOM;
+#endif
 #ifdef GL_OES_EGL_image
         extern PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 #endif
@@ -52,6 +55,18 @@
 #define GL_TEXTURE_EXTERNAL_OES           0x8D65
 #endif
 
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_COMPLETION_STATUS_KHR          0x91B1
+#endif
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT               0x88BF
+#endif
+
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT               0x8FBB
+#endif
+
 #include "driver/opengl/NullGLES.h"
 
 #if (!defined(GL_ES_VERSION_3_1) && !defined(GL_VERSION_4_1))
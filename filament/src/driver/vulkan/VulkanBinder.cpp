@@ -16,9 +16,12 @@
 
 #include "driver/vulkan/VulkanBinder.h"
 
+#include <utils/Log.h>
 #include <utils/Panic.h>
 #include <utils/trap.h>
 
+#include <algorithm>
+
 #define FILAMENT_VULKAN_VERBOSE 0
 
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
@@ -33,16 +36,13 @@ namespace driver {
 // allocator by passing in a null pointer, and we pinpoint the argument by using the VKALLOC macro.
 static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 
-// Maximum number of descriptor sets that can be allocated by the pool.
-// TODO: Make VulkanBinder robust against a large number of descriptors.
-// There are several approaches we could take to deal with too many descriptors:
-// - Create another pool after hitting the limit of the first pool.
-// - Allow multiple descriptors to bind simultaneously; organize binding points into groups.
+// Number of descriptor sets in each descriptor pool. A frame that needs more gets more pools.
 static constexpr uint32_t MAX_NUM_DESCRIPTORS = 1000;
 
 static VulkanBinder::RasterState createDefaultRasterState();
 
 VulkanBinder::VulkanBinder() : mDefaultRasterState(createDefaultRasterState()) {
+    mPipelineKey.specialization = 0;
     mColorBlendState = VkPipelineColorBlendStateCreateInfo{};
     mColorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     mColorBlendState.attachmentCount = 1;
@@ -55,6 +55,14 @@ VulkanBinder::VulkanBinder() : mDefaultRasterState(createDefaultRasterState()) {
     mShaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     mShaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     mShaderStages[1].pName = "main";
+    for (uint32_t i = 0; i < MAX_SPECIALIZATION_CONSTANTS; i++) {
+        // the entries of constants that a shader doesn't declare are ignored
+        mSpecializationEntries[i] = { i, uint32_t(i * sizeof(VkBool32)), sizeof(VkBool32) };
+    }
+    mSpecializationInfo.mapEntryCount = MAX_SPECIALIZATION_CONSTANTS;
+    mSpecializationInfo.pMapEntries = mSpecializationEntries;
+    mSpecializationInfo.dataSize = sizeof(mSpecializationData);
+    mSpecializationInfo.pData = mSpecializationData;
     resetBindings();
 
     mDescriptorKey = {};
@@ -71,30 +79,19 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
         createLayoutsAndDescriptors();
     }
 
-    // If no bindings have been dirtied, update the timestamp (most recent access) and return false
-    // to indicate there's no need to re-bind.
+    // If no bindings have been dirtied, return false to indicate there's no need to re-bind.
     if (!mDirtyDescriptor) {
-        assert(mCurrentDescriptor && mCurrentDescriptor->bound);
-        *descriptor = mCurrentDescriptor->handle;
-        mCurrentDescriptor->timestamp = mCurrentTime;
+        assert(mCurrentDescriptor);
+        *descriptor = mCurrentDescriptor;
         return false;
     }
 
-    // Release the previously bound descriptor and update its time stamp.
-    if (mCurrentDescriptor) {
-        mCurrentDescriptor->timestamp = mCurrentTime;
-        mCurrentDescriptor->bound = false;
-    }
-
-    // If a cached object exists, update the timestamp (most recent access) and return true to
-    // indicate that the caller should call vmCmdBind. Note that robin_map iterators proffer a
-    // value method for obtaining a stable reference.
+    // If this frame already has a descriptor set for these bindings, return true to indicate that
+    // the caller should call vmCmdBind.
     auto iter = mDescriptorSets.find(mDescriptorKey);
     if (UTILS_LIKELY(iter != mDescriptorSets.end())) {
-        mCurrentDescriptor = &iter.value();
-        *descriptor = mCurrentDescriptor->handle;
-        mCurrentDescriptor->timestamp = mCurrentTime;
-        mCurrentDescriptor->bound = true;
+        mCurrentDescriptor = iter->second;
+        *descriptor = mCurrentDescriptor;
         mDirtyDescriptor = false;
         *pipelineLayout = mPipelineLayout;
         if (changes) {
@@ -103,24 +100,12 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
         return true;
     }
 
-    // If we reach this point, we need to create and stash a brand new descriptor set.
-    ASSERT_POSTCONDITION(mDescriptorSets.size() < MAX_NUM_DESCRIPTORS, "Too many descriptors.");
-
-    // Allocate descriptor (does not need explicit destruction)
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = mDescriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &mDescriptorSetLayout;
-    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptor);
-    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    // If we reach this point, we need to allocate a brand new descriptor set from this frame's
+    // pools, it's freed along with them.
+    *descriptor = allocateDescriptor();
     *pipelineLayout = mPipelineLayout;
-
-    // Here we construct a DescriptorVal in place, then stash its pointer to allow fast subsequent
-    // calls to getOrCreateDescriptor when nothing has been dirtied. Note that the robin_map
-    // iterator type proffers a "value" method, which returns a stable reference.
-    mCurrentDescriptor = &mDescriptorSets.emplace(std::make_pair(mDescriptorKey, DescriptorVal {
-        *descriptor, mCurrentTime, true })).first.value();
+    mCurrentDescriptor = *descriptor;
+    mDescriptorSets.emplace(mDescriptorKey, mCurrentDescriptor);
     mDirtyDescriptor = false;
 
     // Mutate the descriptor by setting all non-null bindings.
@@ -136,7 +121,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
             VkWriteDescriptorSet& writeInfo = writes[nwrites++];
             writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptor->handle;
+            writeInfo.dstSet = mCurrentDescriptor;
             writeInfo.dstBinding = binding;
             writeInfo.dstArrayElement = 0;
             writeInfo.descriptorCount = 1;
@@ -153,7 +138,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
             VkWriteDescriptorSet& writeInfo = writes[nwrites++];
             writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptor->handle;
+            writeInfo.dstSet = mCurrentDescriptor;
             writeInfo.dstBinding = NUM_UBUFFER_BINDINGS + binding;
             writeInfo.dstArrayElement = 0;
             writeInfo.descriptorCount = 1;
@@ -206,6 +191,11 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     // If we reach this point, we need to create and stash a brand new pipeline object.
     mShaderStages[0].module = mPipelineKey.shaders[0];
     mShaderStages[1].module = mPipelineKey.shaders[1];
+    for (uint32_t i = 0; i < MAX_SPECIALIZATION_CONSTANTS; i++) {
+        mSpecializationData[i] = (mPipelineKey.specialization >> i) & 1u;
+    }
+    mShaderStages[1].pSpecializationInfo =
+            mPipelineKey.specialization ? &mSpecializationInfo : nullptr;
 
     // We don't store array sizes to save space, but it's quick to count all non-zero
     // entries because these arrays have a small fixed-size capacity.
@@ -239,11 +229,12 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     VkDynamicState dynamicStateEnables[] = {
         VK_DYNAMIC_STATE_VIEWPORT,
         VK_DYNAMIC_STATE_SCISSOR,
+        VK_DYNAMIC_STATE_DEPTH_BIAS,
     };
     VkPipelineDynamicStateCreateInfo dynamicState = {};
     dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
     dynamicState.pDynamicStates = dynamicStateEnables;
-    dynamicState.dynamicStateCount = 2;
+    dynamicState.dynamicStateCount = sizeof(dynamicStateEnables) / sizeof(dynamicStateEnables[0]);
 
     const bool hasFragmentShader = mShaderStages[1].module != VK_NULL_HANDLE;
 
@@ -262,15 +253,16 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     pipelineCreateInfo.pDepthStencilState = &mPipelineKey.rasterState.depthStencil;
     pipelineCreateInfo.pDynamicState = &dynamicState;
 
-    // There are no color attachments if there is no bound fragment shader.  (e.g. shadow map gen)
-    mColorBlendState.attachmentCount = hasFragmentShader ? 1 : 0;
+    // The blend state matches the attachments of the render pass, even without a fragment shader
+    // (e.g. depth-only programs in a depth pre-pass).
+    mColorBlendState.attachmentCount = mColorAttachmentCount;
 
     #if FILAMENT_VULKAN_VERBOSE
     utils::slog.d << "vkCreateGraphicsPipelines with shaders = ("
             << mShaderStages[0].module << ", " << mShaderStages[1].module << ")" << utils::io::endl;
     #endif
 
-    VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+    VkResult err = vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipelineCreateInfo,
             VKALLOC, pipeline);
     if (err) {
         utils::slog.e << "vkCreateGraphicsPipelines error " << err << utils::io::endl;
@@ -294,6 +286,10 @@ void VulkanBinder::bindProgramBundle(const ProgramBundle& bundle) noexcept {
             mPipelineKey.shaders[ssi] = shaders[ssi];
         }
     }
+    if (mPipelineKey.specialization != bundle.specialization) {
+        mDirtyPipeline = true;
+        mPipelineKey.specialization = bundle.specialization;
+    }
 }
 
 void VulkanBinder::bindRasterState(const RasterState& rasterState) noexcept {
@@ -323,10 +319,11 @@ void VulkanBinder::bindRasterState(const RasterState& rasterState) noexcept {
     }
 }
 
-void VulkanBinder::bindRenderPass(VkRenderPass renderPass) noexcept {
+void VulkanBinder::bindRenderPass(VkRenderPass renderPass, bool hasColor) noexcept {
     if (mPipelineKey.renderPass != renderPass) {
         mDirtyPipeline = true;
         mPipelineKey.renderPass = renderPass;
+        mColorAttachmentCount = hasColor ? 1 : 0;
     }
 }
 
@@ -370,16 +367,10 @@ void VulkanBinder::unbindUniformBuffer(VkBuffer uniformBuffer) noexcept {
             mDirtyDescriptor = true;
         }
     }
-    // This function is often called before deleting a uniform buffer. For safety, we need to evict
-    // all descriptors that refer to the extinct uniform buffer, regardless of the binding offsets.
-    evictDescriptors([uniformBuffer] (const DescriptorKey& key) {
-        for (VkBuffer buf : key.uniformBuffers) {
-            if (buf == uniformBuffer) {
-                return true;
-            }
-        }
-        return false;
-    });
+    // This function is often called before deleting a uniform buffer, whose handle could then be
+    // reused by a new buffer. Sets allocated this frame stay valid for the commands using them,
+    // but must no longer be found, regardless of the binding offsets.
+    invalidateDescriptors();
 }
 
 void VulkanBinder::unbindImageView(VkImageView imageView) noexcept {
@@ -391,33 +382,58 @@ void VulkanBinder::unbindImageView(VkImageView imageView) noexcept {
             mDirtyDescriptor = true;
         }
     }
-    evictDescriptors([imageView] (const DescriptorKey& key) {
-        for (const auto& binding : key.samplers) {
-            if (binding.imageView == imageView) {
-                return true;
-            }
-        }
-        return false;
-    });
+    invalidateDescriptors();
 }
 
-// Discards all descriptor sets that pass the given filter. Immediately removes the cache entries,
-// but defers calling vkFreeDescriptorSets until the next eviction cycle.
-void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept {
-    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
-    decltype(mDescriptorSets)::const_iterator iter;
-    for (iter = mDescriptorSets.begin(); iter != mDescriptorSets.end();) {
-        auto& pair = *iter;
-        if (filter(pair.first)) {
-            auto& cacheEntry = iter->second;
-            mDescriptorGraveyard.push_back({ cacheEntry.handle, cacheEntry.timestamp, false });
-            iter = mDescriptorSets.erase(iter);
-        } else {
-            ++iter;
+// Makes all the descriptor sets allocated so far unreachable, in constant time: the generation is
+// part of the key they're found with. They're freed with the pools of their frame.
+void VulkanBinder::invalidateDescriptors() noexcept {
+    mDescriptorKey.generation++;
+    mDirtyDescriptor = true;
+}
+
+VkDescriptorSet VulkanBinder::allocateDescriptor() noexcept {
+    DescriptorPools& frame = mDescriptorPools[mCurrentPools];
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &mDescriptorSetLayout;
+    VkDescriptorSet descriptor = VK_NULL_HANDLE;
+    while (true) {
+        if (frame.current == frame.pools.size()) {
+            frame.pools.push_back(createDescriptorPool());
         }
+        allocInfo.descriptorPool = frame.pools[frame.current];
+        VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, &descriptor);
+        if (UTILS_LIKELY(!err)) {
+            return descriptor;
+        }
+        // This pool is full, move on to the next one. Pools are never fragmented since their sets
+        // are never freed individually, but some drivers return VK_ERROR_FRAGMENTED_POOL anyway.
+        ASSERT_POSTCONDITION(err == VK_ERROR_OUT_OF_POOL_MEMORY_KHR ||
+                err == VK_ERROR_FRAGMENTED_POOL, "Unable to allocate descriptor set.");
+        frame.current++;
     }
 }
 
+VkDescriptorPool VulkanBinder::createDescriptorPool() const noexcept {
+    VkDescriptorPoolSize poolSizes[2] = {};
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 2,
+        .pPoolSizes = &poolSizes[0],
+        .maxSets = MAX_NUM_DESCRIPTORS
+    };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = poolInfo.maxSets * NUM_UBUFFER_BINDINGS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = poolInfo.maxSets * NUM_SAMPLER_BINDINGS;
+    VkDescriptorPool pool;
+    VkResult err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
+    return pool;
+}
+
 void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
         VkDeviceSize offset, VkDeviceSize size) noexcept {
     assert(bindingIndex < NUM_UBUFFER_BINDINGS);
@@ -455,58 +471,143 @@ void VulkanBinder::destroyCache() noexcept {
     mDirtyPipeline = true;
 }
 
+void VulkanBinder::createPipelineCache() noexcept {
+    assert(mPipelineCache == VK_NULL_HANDLE);
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    VkResult err = vkCreatePipelineCache(mDevice, &createInfo, VKALLOC, &mPipelineCache);
+    ASSERT_POSTCONDITION(!err, "Unable to create pipeline cache.");
+}
+
+void VulkanBinder::destroyPipelineCache() noexcept {
+    std::lock_guard<std::mutex> lock(mPipelineCacheLock);
+    vkDestroyPipelineCache(mDevice, mPipelineCache, VKALLOC);
+    mPipelineCache = VK_NULL_HANDLE;
+}
+
+void VulkanBinder::loadPipelineCache(const void* data, size_t size) noexcept {
+    assert(mPipelineCache != VK_NULL_HANDLE);
+    if (!data || !size) {
+        return;
+    }
+
+    // An incompatible header makes the driver create an empty cache, in which case the merge is
+    // a no-op.
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = size;
+    createInfo.pInitialData = data;
+    VkPipelineCache cache;
+    VkResult err = vkCreatePipelineCache(mDevice, &createInfo, VKALLOC, &cache);
+    if (err) {
+        utils::slog.w << "Unable to load the pipeline cache (" << err << ")" << utils::io::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPipelineCacheLock);
+    err = vkMergePipelineCaches(mDevice, mPipelineCache, 1, &cache);
+    if (err) {
+        utils::slog.w << "Unable to merge the pipeline cache (" << err << ")" << utils::io::endl;
+    }
+    vkDestroyPipelineCache(mDevice, cache, VKALLOC);
+}
+
+size_t VulkanBinder::getPipelineCacheData(void* data, size_t size) noexcept {
+    std::lock_guard<std::mutex> lock(mPipelineCacheLock);
+    if (mPipelineCache == VK_NULL_HANDLE) {
+        return 0;
+    }
+    // when data isn't null, size is updated to the number of bytes written, VK_INCOMPLETE
+    // is returned if the cache didn't fit.
+    VkResult err = vkGetPipelineCacheData(mDevice, mPipelineCache, &size, data);
+    return (err == VK_SUCCESS || err == VK_INCOMPLETE) ? size : 0;
+}
+
 void VulkanBinder::resetBindings() noexcept {
     mDirtyPipeline = true;
     mDirtyDescriptor = true;
 }
 
+void VulkanBinder::copyBindings(VulkanBinder const& other) noexcept {
+    mPipelineKey = other.mPipelineKey;
+    mDescriptorKey = other.mDescriptorKey;
+    mColorAttachmentCount = other.mColorAttachmentCount;
+    resetBindings();
+}
+
 // Frees up old descriptor sets and pipelines, then nulls out their key.
 void VulkanBinder::gc() noexcept {
     // This method is designed to be called once per frame, and our notion of "time" is actually a
     // frame counter. Frames are a better metric than wall clock because we know with certainty that
     // objects last bound more than n frames ago are no longer in use (due to existing fences).
     mCurrentTime++;
+
+    // Descriptor sets only live for a frame: the pools of the frame that was n frames ago are
+    // reset all at once and reused for this one.
+    mCurrentPools = uint32_t((mCurrentPools + 1) % mDescriptorPools.size());
+    DescriptorPools& frame = mDescriptorPools[mCurrentPools];
+    const uint32_t usedPools = std::min(frame.current + 1, uint32_t(frame.pools.size()));
+    for (uint32_t i = 0; i < usedPools; i++) {
+        vkResetDescriptorPool(mDevice, frame.pools[i], 0);
+    }
+    frame.current = 0;
+    mDescriptorSets.clear();
+    mCurrentDescriptor = VK_NULL_HANDLE;
+    mDirtyDescriptor = true;
+
     // If this is one of the first few frames, return early to avoid wrapping unsigned integers.
-    if (mCurrentTime <= TIME_BEFORE_EVICTION) {
+    if (mCurrentTime <= mTimeBeforeEviction) {
         return;
     }
-    const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
-    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
-    for (decltype(mDescriptorSets)::const_iterator iter = mDescriptorSets.begin();
-            iter != mDescriptorSets.end();) {
+    const uint32_t evictTime = mCurrentTime - mTimeBeforeEviction;
+    for (decltype(mPipelines)::const_iterator iter = mPipelines.begin();
+            iter != mPipelines.end();) {
         auto& cacheEntry = iter->second;
         if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
-            vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &cacheEntry.handle);
-            iter = mDescriptorSets.erase(iter);
+            vkDestroyPipeline(mDevice, cacheEntry.handle, VKALLOC);
+            iter = mPipelines.erase(iter);
         } else {
             ++iter;
         }
     }
+}
+
+void VulkanBinder::trim() noexcept {
+    for (DescriptorPools& frame : mDescriptorPools) {
+        if (frame.pools.empty()) {
+            continue;
+        }
+        for (size_t i = 1, n = frame.pools.size(); i < n; i++) {
+            vkDestroyDescriptorPool(mDevice, frame.pools[i], VKALLOC);
+        }
+        frame.pools.resize(1);
+        vkResetDescriptorPool(mDevice, frame.pools[0], 0);
+        frame.current = 0;
+    }
+    mDescriptorSets.clear();
+    mCurrentDescriptor = VK_NULL_HANDLE;
+    mDirtyDescriptor = true;
+
     for (decltype(mPipelines)::const_iterator iter = mPipelines.begin();
             iter != mPipelines.end();) {
-        auto& cacheEntry = iter->second;
-        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
-            vkDestroyPipeline(mDevice, cacheEntry.handle, VKALLOC);
+        if (!iter->second.bound) {
+            vkDestroyPipeline(mDevice, iter->second.handle, VKALLOC);
             iter = mPipelines.erase(iter);
         } else {
             ++iter;
         }
     }
-    // The graveyard is composed of descriptors that contain references to extinct objects. We
-    // take care only to free the ones that are old enough to be evicted, since they might be
-    // referenced in a command buffer that hasn't finished executing.
-    decltype(mDescriptorGraveyard) graveyard;
-    graveyard.swap(mDescriptorGraveyard);
-    for (auto& val : graveyard) {
-        if (val.timestamp < evictTime) {
-           vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &val.handle);
-        } else {
-            mDescriptorGraveyard.emplace_back(DescriptorVal {
-                .handle = val.handle,
-                .timestamp = val.timestamp
-            });
-        }
+}
+
+void VulkanBinder::setFramesInFlight(uint32_t count) noexcept {
+    if (count <= mTimeBeforeEviction) {
+        return;
     }
+    // The new pools go right after the current ones, so that they're used first: the pools
+    // of the previous frames are still reused in the order they were used.
+    const uint32_t added = count - mTimeBeforeEviction;
+    mDescriptorPools.insert(mDescriptorPools.begin() + mCurrentPools + 1, added, {});
+    mTimeBeforeEviction = count;
 }
 
 void VulkanBinder::createLayoutsAndDescriptors() noexcept {
@@ -544,22 +645,6 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     pPipelineLayoutCreateInfo.pSetLayouts = &mDescriptorSetLayout;
     err = vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, VKALLOC, &mPipelineLayout);
     ASSERT_POSTCONDITION(!err, "Unable to create pipeline layout.");
-
-    // Create the VkDescriptorPool.
-    VkDescriptorPoolSize poolSizes[2] = {};
-    VkDescriptorPoolCreateInfo poolInfo {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .poolSizeCount = 2,
-        .pPoolSizes = &poolSizes[0],
-        .maxSets = MAX_NUM_DESCRIPTORS,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
-    };
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = poolInfo.maxSets * NUM_UBUFFER_BINDINGS;
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = poolInfo.maxSets * NUM_SAMPLER_BINDINGS;
-    err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &mDescriptorPool);
-    ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
 }
 
 void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
@@ -579,9 +664,14 @@ void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
     mPipelineLayout = VK_NULL_HANDLE;
     vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, VKALLOC);
     mDescriptorSetLayout = VK_NULL_HANDLE;
-    vkDestroyDescriptorPool(mDevice, mDescriptorPool, VKALLOC);
-    mDescriptorPool = VK_NULL_HANDLE;
-    mCurrentDescriptor = nullptr;
+    for (DescriptorPools& frame : mDescriptorPools) {
+        for (VkDescriptorPool pool : frame.pools) {
+            vkDestroyDescriptorPool(mDevice, pool, VKALLOC);
+        }
+        frame.pools.clear();
+        frame.current = 0;
+    }
+    mCurrentDescriptor = VK_NULL_HANDLE;
     mDirtyDescriptor = true;
 }
 
@@ -592,6 +682,9 @@ bool VulkanBinder::PipelineEqual::operator()(const VulkanBinder::PipelineKey& k1
 
 bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
         const VulkanBinder::DescriptorKey& k2) const {
+    if (k1.generation != k2.generation) {
+        return false;
+    }
     for (uint32_t i = 0; i < NUM_UBUFFER_BINDINGS; i++) {
         if (k1.uniformBuffers[i] != k2.uniformBuffers[i] ||
             k1.uniformBufferOffsets[i] != k2.uniformBufferOffsets[i] ||
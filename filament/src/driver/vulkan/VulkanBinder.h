@@ -23,6 +23,7 @@
 #include <utils/Hash.h>
 
 #include <tsl/robin_map.h>
+#include <mutex>
 #include <vector>
 
 namespace filament {
@@ -70,7 +71,8 @@ namespace driver {
 class VulkanBinder {
 public:
     static constexpr uint32_t NUM_UBUFFER_BINDINGS = filament::BindingPoints::COUNT;
-    static constexpr uint32_t NUM_SAMPLER_BINDINGS = 8;
+    // the samplers of all the blocks (see SamplerBindingMap) share these bindings
+    static constexpr uint32_t NUM_SAMPLER_BINDINGS = 24;
     static constexpr uint32_t NUM_SHADER_MODULES = 2;
     static constexpr uint32_t MAX_VERTEX_ATTRIBUTES = filament::ATTRIBUTE_INDEX_COUNT;
 
@@ -84,11 +86,16 @@ public:
     };
 
     // The ProgramBundle contains weak references to the compiled vertex and fragment shaders.
+    // Bit i of specialization is the value of the fragment shader's boolean specialization
+    // constant whose constant_id is i.
     struct ProgramBundle {
         VkShaderModule vertex;
         VkShaderModule fragment;
+        uint32_t specialization;
     };
 
+    static constexpr uint32_t MAX_SPECIALIZATION_CONSTANTS = 8;
+
     // The RasterState POD contains standard graphics-related state like blending, culling, etc.
     // Note that several fields are unused (sType etc) so we could shrink this by avoiding the Vk
     // structures. However it's super convenient just to use standard Vulkan structs here.
@@ -114,6 +121,26 @@ public:
     ~VulkanBinder();
     void setDevice(VkDevice device) { mDevice = device; }
 
+    // The pipeline cache outlives destroyCache(), it must be destroyed explicitly before the
+    // VkDevice is. Pipelines are created from it, so the data of a previous run (see
+    // getPipelineCacheData) makes their creation much faster.
+    void createPipelineCache() noexcept;
+    void destroyPipelineCache() noexcept;
+
+    // Creates pipelines from the cache of 'owner' instead, which must not be destroyed before
+    // this binder stops creating pipelines. Pipelines can be created from several threads at once.
+    void sharePipelineCache(VulkanBinder const& owner) noexcept {
+        mPipelineCache = owner.mPipelineCache;
+    }
+
+    // Merges data returned by getPipelineCacheData(), possibly in a previous run, into the
+    // pipeline cache. Vulkan ignores data created by other devices or driver versions.
+    void loadPipelineCache(const void* data, size_t size) noexcept;
+
+    // Copies up to "size" bytes of the pipeline cache into "data" and returns the number of
+    // bytes written, or returns the size of the cache if "data" is null. Thread-safe.
+    size_t getPipelineCacheData(void* data, size_t size) noexcept;
+
     // Clients should initialize their copy of the raster state using this method. They can then
     // mutate their copy and pass it back through bindRasterState().
     const RasterState& getDefaultRasterState() const { return mDefaultRasterState; }
@@ -129,7 +156,7 @@ public:
     // Each bind method is fast and does not make Vulkan calls.
     void bindProgramBundle(const ProgramBundle& bundle) noexcept;
     void bindRasterState(const RasterState& rasterState) noexcept;
-    void bindRenderPass(VkRenderPass renderPass) noexcept;
+    void bindRenderPass(VkRenderPass renderPass, bool hasColor) noexcept;
     void bindPrimitiveTopology(VkPrimitiveTopology topology) noexcept;
     void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
             VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) noexcept;
@@ -157,9 +184,21 @@ public:
     // be called after every swap if the VulkanBinder is shared amongst command buffers.
     void resetBindings() noexcept;
 
+    // Binds everything that is bound to 'other', which may be using a different command buffer.
+    // The cached Vulkan objects aren't shared, so the next calls to getOrCreate return true.
+    void copyBindings(VulkanBinder const& other) noexcept;
+
     // Evicts old unused Vulkan objects. Call this once per frame.
     void gc() noexcept;
 
+    // Evicts all the unbound pipelines, and the descriptor pools beyond the first one of each
+    // frame, regardless of their age. Call this between frames, once the GPU is idle.
+    void trim() noexcept;
+
+    // Keeps the objects of a frame until this many frames later, i.e. the number of frames that
+    // can be in flight. This can only grow.
+    void setFramesInFlight(uint32_t count) noexcept;
+
 private:
     // The pipeline key is a POD that represents all currently bound states that form the immutable
     // VkPipeline object. We apply a hash function to its contents only if has been mutated since
@@ -169,8 +208,9 @@ private:
         RasterState rasterState; // 248 bytes
         VkRenderPass renderPass; // 8 bytes
         VkPrimitiveTopology topology; // 4 bytes
-        VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTES]; // 16*5 bytes
-        VkVertexInputBindingDescription vertexBuffers[MAX_VERTEX_ATTRIBUTES]; // 12*5 bytes
+        VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTES]; // 16*16 bytes
+        VkVertexInputBindingDescription vertexBuffers[MAX_VERTEX_ATTRIBUTES]; // 12*16 bytes
+        uint32_t specialization; // 4 bytes
     };
 
     static_assert(sizeof(PipelineKey) ==
@@ -179,7 +219,8 @@ private:
         sizeof(PipelineKey::renderPass) +
         sizeof(PipelineKey::topology) +
         sizeof(PipelineKey::vertexAttributes) +
-        sizeof(PipelineKey::vertexBuffers),
+        sizeof(PipelineKey::vertexBuffers) +
+        sizeof(PipelineKey::specialization),
         "Implicit padding is not allowed for fast hashing");
 
     static_assert(std::is_pod<PipelineKey>::value, "PipelineKey must be a POD for fast hashing.");
@@ -209,13 +250,17 @@ private:
         VkDescriptorImageInfo samplers[NUM_SAMPLER_BINDINGS];
         VkDeviceSize uniformBufferOffsets[NUM_UBUFFER_BINDINGS];
         VkDeviceSize uniformBufferSizes[NUM_UBUFFER_BINDINGS];
+        // incremented when a buffer or image view is unbound, so that the sets referencing it
+        // (whose handle could be reused) are no longer found
+        uint64_t generation;
     };
 
     static_assert(sizeof(DescriptorKey) ==
         sizeof(DescriptorKey::uniformBuffers) +
         sizeof(DescriptorKey::samplers) +
         sizeof(DescriptorKey::uniformBufferOffsets) +
-        sizeof(DescriptorKey::uniformBufferSizes),
+        sizeof(DescriptorKey::uniformBufferSizes) +
+        sizeof(DescriptorKey::generation),
         "Implicit padding is not allowed for fast hashing");
 
     static_assert(std::is_pod<DescriptorKey>::value, "DescriptorKey must be a POD.");
@@ -226,27 +271,34 @@ private:
         bool operator()(const DescriptorKey& k1, const DescriptorKey& k2) const;
     };
 
-    struct DescriptorVal {
-        VkDescriptorSet handle;
-        uint32_t timestamp;
-        bool bound;
-        // move-only (disallow copy) to allow keeping a pointer to the "current" value in the map.
-        DescriptorVal(DescriptorVal const&) = delete;
-        DescriptorVal& operator=(DescriptorVal const&) = delete;
-        DescriptorVal(DescriptorVal &&) = default;
-        DescriptorVal& operator=(DescriptorVal &&) = default;
+    // Descriptor sets are allocated linearly from the pools of the current frame, and freed all at
+    // once when these pools are reset, mTimeBeforeEviction frames later.
+    struct DescriptorPools {
+        std::vector<VkDescriptorPool> pools;
+        uint32_t current = 0;
     };
 
     void createLayoutsAndDescriptors() noexcept;
     void destroyLayoutsAndDescriptors() noexcept;
-    void evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept;
+    void invalidateDescriptors() noexcept;
+    VkDescriptorSet allocateDescriptor() noexcept;
+    VkDescriptorPool createDescriptorPool() const noexcept;
 
     VkDevice mDevice = nullptr;
     const RasterState mDefaultRasterState;
 
+    // Pipelines are created from this cache. Merging into it must be synchronized with reading it
+    // back, which happens from the application's thread.
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+    std::mutex mPipelineCacheLock;
+
     // Info structs used only in a transient way but they are stored for convenience.
     VkPipelineShaderStageCreateInfo mShaderStages[NUM_SHADER_MODULES];
+    VkSpecializationMapEntry mSpecializationEntries[MAX_SPECIALIZATION_CONSTANTS];
+    VkBool32 mSpecializationData[MAX_SPECIALIZATION_CONSTANTS];
+    VkSpecializationInfo mSpecializationInfo = {};
     VkPipelineColorBlendStateCreateInfo mColorBlendState;
+    uint32_t mColorAttachmentCount = 1; // of the bound render pass
     VkDescriptorBufferInfo mDescriptorBuffers[NUM_UBUFFER_BINDINGS];
     VkDescriptorImageInfo mDescriptorSamplers[NUM_SAMPLER_BINDINGS];
     DescriptorUpdateOp mDescriptorUpdateOp;
@@ -259,7 +311,7 @@ private:
 
     // Weak references to the currently bound pipeline and descriptor set.
     PipelineVal* mCurrentPipeline = nullptr;
-    DescriptorVal* mCurrentDescriptor = nullptr;
+    VkDescriptorSet mCurrentDescriptor = VK_NULL_HANDLE;
 
     // If one of these dirty flags is set, then one or more its contituent bindings have changed, so
     // a new pipeline or descriptor set needs to be retrieved from the cache or created.
@@ -270,13 +322,16 @@ private:
     VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
     tsl::robin_map<PipelineKey, PipelineVal, PipelineHashFn, PipelineEqual> mPipelines;
-    tsl::robin_map<DescriptorKey, DescriptorVal, DescHashFn, DescEqual> mDescriptorSets;
-    VkDescriptorPool mDescriptorPool;
-    std::vector<DescriptorVal> mDescriptorGraveyard;
+    tsl::robin_map<DescriptorKey, VkDescriptorSet, DescHashFn, DescEqual> mDescriptorSets;
 
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint32_t mCurrentTime = 0;
-    static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    uint32_t mTimeBeforeEviction = 2;
+
+    // The sets of a frame can be in use until mTimeBeforeEviction frames later, there is one more
+    // set of pools than that.
+    std::vector<DescriptorPools> mDescriptorPools = std::vector<DescriptorPools>(3);
+    uint32_t mCurrentPools = 0;
 };
 
 } // namespace filament
@@ -29,6 +29,12 @@ VulkanBuffer::VulkanBuffer(VulkanContext& context, VulkanStagePool& stagePool,
         .size = numBytes,
         .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT
     };
+    uint32_t queueFamilies[2];
+    if (getUploadQueueFamilies(context, queueFamilies) > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+    }
     VmaAllocationCreateInfo allocInfo {
         .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
@@ -44,11 +50,22 @@ void VulkanBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_
     assert(byteOffset == 0);
     VkDevice device = mContext.device;
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, byteOffset, numBytes);
+    memcpy(stage->mapped, cpuData, numBytes);
+    vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numBytes);
+    VkBufferCopy region { .srcOffset = stage->offset, .size = numBytes };
+
+    // The first upload is submitted to the transfer queue, so that streamed meshes load while
+    // rendering. Later updates may overwrite content still used by the frames in flight, so they
+    // stay on the graphics queue to remain ordered with them.
+    if (!mUploaded) {
+        mUploaded = true;
+        submitTransfer(mContext, [this, stage, region] (VkCommandBuffer cmdbuffer) {
+            vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
+        }, [this, stage] () {
+            mStagePool.releaseStage(stage);
+        });
+        return;
+    }
 
     // Create and submit a one-off command buffer to allow uploading outside a frame.
     VkCommandBuffer cmdbuffer;
@@ -61,7 +78,6 @@ void VulkanBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_
         .commandBufferCount = 1
     };
     VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VkBufferCopy region { .size = numBytes };
     vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
     vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
     vkBeginCommandBuffer(cmdbuffer, &beginInfo);
@@ -21,13 +21,20 @@
 #include "VulkanBuffer.h"
 #include "VulkanHandles.h"
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/CString.h>
 #include <utils/trap.h>
 
+#include <algorithm>
 #include <csignal>
+#include <iterator>
 #include <set>
 
+#if defined(ANDROID)
+#include <unistd.h>
+#endif
+
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
 // to a stack-allocated variable.
 #pragma clang diagnostic push
@@ -39,12 +46,33 @@ static constexpr bool SWAPCHAIN_HAS_DEPTH = true;
 namespace filament {
 namespace driver {
 
+// size of all the buffers of a vertex buffer, for GPU memory accounting
+static size_t getVertexBufferSize(HwVertexBuffer const* vb) noexcept {
+    size_t total = 0;
+    for (size_t index = 0; index < vb->bufferCount; index++) {
+        size_t size = 0;
+        for (auto const& item : vb->attributes) {
+            if (item.buffer == index) {
+                size = std::max(size, size_t(item.offset + vb->vertexCount * item.stride));
+            }
+        }
+        total += size;
+    }
+    return total;
+}
+
+static_assert(MAX_RECORDING_THREADS == SegmentsCommand::MAX_SEGMENTS + 1,
+        "a secondary command buffer pool is needed per segment");
+
+thread_local VulkanDriver::SegmentRecorder* VulkanDriver::sSegmentRecorder = nullptr;
+
 VulkanDriver::VulkanDriver(VulkanPlatform* platform,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept :
         DriverBase(new ConcreteDispatcher<VulkanDriver>(this)),
         mContextManager(*platform), mStagePool(mContext), mFramebufferCache(mContext),
         mSamplerCache(mContext) {
     mContext.rasterState = mBinder.getDefaultRasterState();
+    mContext.polygonOffset[0] = mContext.polygonOffset[1] = 1.0f;
 
     // Load Vulkan entry points.
     ASSERT_POSTCONDITION(bluevk::initialize(), "BlueVK is unable to load entry points.");
@@ -145,9 +173,14 @@ VulkanDriver::VulkanDriver(VulkanPlatform* platform,
     // physicalDeviceFeatures, graphicsQueueFamilyIndex.
     selectPhysicalDevice(mContext);
 
-    // Initialize device and graphicsQueue.
+    // Initialize device, graphicsQueue and transferQueue.
     createVirtualDevice(mContext);
     mBinder.setDevice(mContext.device);
+    mBinder.createPipelineCache();
+    for (SegmentRecorder& recorder : mSegmentRecorders) {
+        recorder.binder.setDevice(mContext.device);
+        recorder.binder.sharePipelineCache(mBinder);
+    }
 
     // Choose a depth format that meets our requirements. Take care not to include stencil formats
     // just yet, since that would require a corollary change to the "aspect" flags for the VkImage.
@@ -179,12 +212,29 @@ void VulkanDriver::terminate() {
         return;
     }
     waitForIdle(mContext);
+    for (SegmentRecorder& recorder : mSegmentRecorders) {
+        recorder.binder.destroyCache();
+    }
     mBinder.destroyCache();
+    mBinder.destroyPipelineCache();
     mStagePool.reset();
     mFramebufferCache.reset();
     mSamplerCache.reset();
+
+    // Buffers and textures are sub-allocated from the allocator's blocks. Report what's left of
+    // them, any remaining allocation is a leak.
+    #ifndef NDEBUG
+    VmaStats stats;
+    vmaCalculateStats(mContext.allocator, &stats);
+    utils::slog.i << "Vulkan memory: " << stats.total.blockCount << " blocks, "
+            << stats.total.allocationCount << " allocations, "
+            << stats.total.unusedRangeCount << " free ranges, "
+            << stats.total.unusedBytes << " bytes unused." << utils::io::endl;
+    #endif
+
     vmaDestroyAllocator(mContext.allocator);
     vkDestroyCommandPool(mContext.device, mContext.commandPool, VKALLOC);
+    vkDestroyCommandPool(mContext.device, mContext.transferCommandPool, VKALLOC);
     vkDestroyDevice(mContext.device, VKALLOC);
     if (mDebugCallback) {
         vkDestroyDebugReportCallbackEXT(mContext.instance, mDebugCallback, VKALLOC);
@@ -226,6 +276,18 @@ void VulkanDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
     mStagePool.gc();
     mFramebufferCache.gc();
     mBinder.gc();
+    for (SegmentRecorder& recorder : mSegmentRecorders) {
+        recorder.binder.gc();
+    }
+}
+
+void VulkanDriver::setFramesInFlight(uint32_t count) noexcept {
+    mStagePool.setFramesInFlight(count);
+    mFramebufferCache.setFramesInFlight(count);
+    mBinder.setFramesInFlight(count);
+    for (SegmentRecorder& recorder : mSegmentRecorders) {
+        recorder.binder.setFramesInFlight(count);
+    }
 }
 
 void VulkanDriver::setPresentationTime(uint64_t monotonic_clock_ns) {
@@ -240,84 +302,134 @@ void VulkanDriver::flush(int) {
 }
 
 void VulkanDriver::createVertexBuffer(Driver::VertexBufferHandle vbh, uint8_t bufferCount,
-        uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes) {
-    construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool, bufferCount,
-            attributeCount, elementCount, attributes);
+        uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes,
+        Driver::BufferUsage usage) {
+    auto vb = construct<VulkanVertexBuffer>(vbh, mContext, mStagePool,
+            bufferCount, attributeCount, elementCount, attributes);
+    mGpuMemory.track(GpuMemoryType::VERTEX_BUFFER, vbh.getId(), getVertexBufferSize(vb));
 }
 
 void VulkanDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
-        uint32_t indexCount) {
+        uint32_t indexCount, Driver::BufferUsage usage) {
     auto elementSize = (uint8_t) getElementTypeSize(elementType);
-    construct_handle<VulkanIndexBuffer>(mHandleMap, ibh, mContext, mStagePool, elementSize,
+    construct<VulkanIndexBuffer>(ibh, mContext, mStagePool, elementSize,
             indexCount);
+    mGpuMemory.track(GpuMemoryType::INDEX_BUFFER, ibh.getId(), size_t(elementSize) * indexCount);
 }
 
 void VulkanDriver::createTexture(Driver::TextureHandle th, SamplerType target, uint8_t levels,
         TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
         TextureUsage usage) {
-    construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels, format, samples,
+    construct<VulkanTexture>(th, mContext, target, levels, format, samples,
             w, h, depth, usage, mStagePool);
+    mGpuMemory.track(GpuMemoryType::TEXTURE, th.getId(),
+            getTextureMemorySize(format, target, levels, samples, w, h, depth));
+}
+
+void VulkanDriver::createSparseTexture(Driver::TextureHandle th, uint8_t levels,
+        TextureFormat format, uint32_t w, uint32_t h) {
+    // TODO: use sparse residency, this needs a queue with VK_QUEUE_SPARSE_BINDING_BIT
+    createTexture(th, SamplerType::SAMPLER_2D, levels, format, 1, w, h, 1, TextureUsage::DEFAULT);
 }
 
 void VulkanDriver::createSamplerBuffer(Driver::SamplerBufferHandle sbh, size_t count) {
-    construct_handle<VulkanSamplerBuffer>(mHandleMap, sbh, mContext, count);
+    construct<VulkanSamplerBuffer>(sbh, mContext, count);
 }
 
 void VulkanDriver::createUniformBuffer(Driver::UniformBufferHandle ubh, size_t size) {
-    construct_handle<VulkanUniformBuffer>(mHandleMap, ubh, mContext, mStagePool, size);
+    construct<VulkanUniformBuffer>(ubh, mContext, mStagePool, size);
+    mGpuMemory.track(GpuMemoryType::UNIFORM_BUFFER, ubh.getId(), size);
+}
+
+void VulkanDriver::createBufferObject(Driver::BufferObjectHandle boh, uint32_t byteCount,
+        Driver::BufferUsage usage) {
+    construct<VulkanBufferObject>(boh, mContext, mStagePool, byteCount);
+    mGpuMemory.track(GpuMemoryType::BUFFER_OBJECT, boh.getId(), byteCount);
 }
 
 void VulkanDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int) {
-    construct_handle<VulkanRenderPrimitive>(mHandleMap, rph, mContext);
+    construct<VulkanRenderPrimitive>(rph, mContext);
 }
 
 void VulkanDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
-    construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
+    construct<VulkanProgram>(ph, mContext, program);
+    mGpuMemory.track(GpuMemoryType::PROGRAM, ph.getId(), 0);
 }
 
 void VulkanDriver::createDefaultRenderTarget(Driver::RenderTargetHandle rth, int) {
-    construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext);
+    construct<VulkanRenderTarget>(rth, mContext);
 }
 
 void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         Driver::TargetBufferFlags targets, uint32_t width, uint32_t height, uint8_t samples,
         TextureFormat format, Driver::TargetBufferInfo color, Driver::TargetBufferInfo depth,
         Driver::TargetBufferInfo stencil) {
-    auto& renderTarget = *construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext,
+    auto& renderTarget = *construct<VulkanRenderTarget>(rth, mContext,
             width, height);
+
+    // Multisampling is done with transient attachments resolved at the end of each render pass,
+    // like GL's EXT_multisampled_render_to_texture. A depth texture can't be resolved though, so
+    // those render targets aren't multisampled.
+    const VkSampleCountFlags supportedSamples =
+            mContext.physicalDeviceProperties.limits.framebufferColorSampleCounts &
+            mContext.physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+    if (depth.handle) {
+        samples = 1;
+    }
+    while (samples > 1 && ((samples & (samples - 1)) || !(supportedSamples & samples))) {
+        samples--;
+    }
+
+    // the transient attachments are not accounted for, they're not backed by memory on tilers
+    size_t memorySize = 0;
     if (color.handle) {
-        auto colorTexture = handle_cast<VulkanTexture>(mHandleMap, color.handle);
+        auto colorTexture = handle_cast<VulkanTexture*>(color.handle);
         renderTarget.setColorImage({
             .view = colorTexture->imageView,
             .format = colorTexture->format
         });
     } else if (targets & TargetBufferFlags::COLOR) {
         renderTarget.createColorImage(getVkFormat(format));
+        memorySize += getTextureMemorySize(format, SamplerType::SAMPLER_2D, 1, 1,
+                width, height, 1);
+    }
+    if (samples > 1 && (color.handle || (targets & TargetBufferFlags::COLOR))) {
+        renderTarget.createMsaaColorImage(samples);
     }
     if (depth.handle) {
-        auto depthTexture = handle_cast<VulkanTexture>(mHandleMap, depth.handle);
+        auto depthTexture = handle_cast<VulkanTexture*>(depth.handle);
         renderTarget.setDepthImage({
             .view = depthTexture->imageView,
             .format = depthTexture->format
         });
     } else if (targets & TargetBufferFlags::DEPTH) {
-        renderTarget.createDepthImage(mContext.depthFormat);
+        renderTarget.createDepthImage(mContext.depthFormat, samples);
+        if (samples <= 1) {
+            memorySize += size_t(4) * width * height;
+        }
     }
+    mGpuMemory.track(GpuMemoryType::RENDER_TARGET, rth.getId(), memorySize);
 }
 
 void VulkanDriver::createFence(Driver::FenceHandle fh, int) {
 }
 
+void VulkanDriver::createTimerQuery(Driver::TimerQueryHandle tqh, int) {
+    construct<VulkanTimerQuery>(tqh, mContext);
+}
+
 void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWindow,
         uint64_t flags) {
-    auto* swapChain = construct_handle<VulkanSwapChain>(mHandleMap, sch);
+    auto* swapChain = construct<VulkanSwapChain>(sch);
     VulkanSurfaceContext& sc = swapChain->surfaceContext;
+    sc.headless = false;
     sc.surface = (VkSurfaceKHR) mContextManager.createVkSurfaceKHR(nativeWindow,
             mContext.instance, &sc.clientSize.width, &sc.clientSize.height);
     getPresentationQueue(mContext, sc);
     getSurfaceCaps(mContext, sc);
-    createSwapChainAndImages(mContext, sc);
+    createSwapChainAndImages(mContext, sc, flags);
     createCommandBuffersAndFences(mContext, sc);
+    setFramesInFlight(uint32_t(sc.swapContexts.size()));
 
     // TODO: move the following line into makeCurrent.
     mContext.currentSurface = &sc;
@@ -327,83 +439,127 @@ void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
     }
 }
 
+void VulkanDriver::createSwapChainHeadless(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    auto* swapChain = construct<VulkanSwapChain>(sch);
+    VulkanSurfaceContext& sc = swapChain->surfaceContext;
+    sc.headless = true;
+    sc.surface = VK_NULL_HANDLE;
+    sc.presentQueue = VK_NULL_HANDLE;
+    createHeadlessImages(mContext, sc, width, height, flags);
+    createCommandBuffersAndFences(mContext, sc);
+    setFramesInFlight(uint32_t(sc.swapContexts.size()));
+
+    mContext.currentSurface = &sc;
+
+    if (SWAPCHAIN_HAS_DEPTH) {
+        transitionDepthBuffer(mContext, sc, mContext.depthFormat);
+    }
+}
+
 void VulkanDriver::createStreamFromTextureId(Driver::StreamHandle sh, intptr_t externalTextureId,
         uint32_t width, uint32_t height) {
 }
 
+void VulkanDriver::createStreamAcquired(Driver::StreamHandle sh, int) {
+}
+
 Handle<HwVertexBuffer> VulkanDriver::createVertexBufferSynchronous() noexcept {
-    return alloc_handle<VulkanVertexBuffer, HwVertexBuffer>();
+    return Handle<HwVertexBuffer>(allocateHandle(sizeof(VulkanVertexBuffer)));
 }
 
 Handle<HwIndexBuffer> VulkanDriver::createIndexBufferSynchronous() noexcept {
-    return alloc_handle<VulkanIndexBuffer, HwIndexBuffer>();
+    return Handle<HwIndexBuffer>(allocateHandle(sizeof(VulkanIndexBuffer)));
 }
 
 Handle<HwTexture> VulkanDriver::createTextureSynchronous() noexcept {
-    return alloc_handle<VulkanTexture, HwTexture>();
+    return Handle<HwTexture>(allocateHandle(sizeof(VulkanTexture)));
+}
+
+Handle<HwTexture> VulkanDriver::createSparseTextureSynchronous() noexcept {
+    return Handle<HwTexture>(allocateHandle(sizeof(VulkanTexture)));
 }
 
 Handle<HwSamplerBuffer> VulkanDriver::createSamplerBufferSynchronous() noexcept {
-    return alloc_handle<VulkanSamplerBuffer, HwSamplerBuffer>();
+    return Handle<HwSamplerBuffer>(allocateHandle(sizeof(VulkanSamplerBuffer)));
 }
 
 Handle<HwUniformBuffer> VulkanDriver::createUniformBufferSynchronous() noexcept {
-    return alloc_handle<VulkanUniformBuffer, HwUniformBuffer>();
+    return Handle<HwUniformBuffer>(allocateHandle(sizeof(VulkanUniformBuffer)));
+}
+
+Handle<HwBufferObject> VulkanDriver::createBufferObjectSynchronous() noexcept {
+    return Handle<HwBufferObject>(allocateHandle(sizeof(VulkanBufferObject)));
 }
 
 Handle<HwRenderPrimitive> VulkanDriver::createRenderPrimitiveSynchronous() noexcept {
-    return alloc_handle<VulkanRenderPrimitive, HwRenderPrimitive>();
+    return Handle<HwRenderPrimitive>(allocateHandle(sizeof(VulkanRenderPrimitive)));
 }
 
 Handle<HwProgram> VulkanDriver::createProgramSynchronous() noexcept {
-    return alloc_handle<VulkanProgram, HwProgram>();
+    return Handle<HwProgram>(allocateHandle(sizeof(VulkanProgram)));
 }
 
 Handle<HwRenderTarget> VulkanDriver::createDefaultRenderTargetSynchronous() noexcept {
-    return alloc_handle<VulkanRenderTarget, HwRenderTarget>();
+    return Handle<HwRenderTarget>(allocateHandle(sizeof(VulkanRenderTarget)));
 }
 
 Handle<HwRenderTarget> VulkanDriver::createRenderTargetSynchronous() noexcept {
-    return alloc_handle<VulkanRenderTarget, HwRenderTarget>();
+    return Handle<HwRenderTarget>(allocateHandle(sizeof(VulkanRenderTarget)));
 }
 
 Handle<HwFence> VulkanDriver::createFenceSynchronous() noexcept {
     return {};
 }
 
+Handle<HwTimerQuery> VulkanDriver::createTimerQuerySynchronous() noexcept {
+    return Handle<HwTimerQuery>(allocateHandle(sizeof(VulkanTimerQuery)));
+}
+
 Handle<HwSwapChain> VulkanDriver::createSwapChainSynchronous() noexcept {
-    return alloc_handle<VulkanSwapChain, HwSwapChain>();
+    return Handle<HwSwapChain>(allocateHandle(sizeof(VulkanSwapChain)));
+}
+
+Handle<HwSwapChain> VulkanDriver::createSwapChainHeadlessSynchronous() noexcept {
+    return Handle<HwSwapChain>(allocateHandle(sizeof(VulkanSwapChain)));
 }
 
 Handle<HwStream> VulkanDriver::createStreamFromTextureIdSynchronous() noexcept {
     return {};
 }
 
+Handle<HwStream> VulkanDriver::createStreamAcquiredSynchronous() noexcept {
+    return {};
+}
+
 void VulkanDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
     if (vbh) {
         waitForIdle(mContext);
-        destruct_handle<VulkanVertexBuffer>(mHandleMap, vbh);
+        mGpuMemory.untrack(GpuMemoryType::VERTEX_BUFFER, vbh.getId());
+        destruct(vbh, handle_cast<VulkanVertexBuffer*>(vbh));
     }
 }
 
 void VulkanDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
     if (ibh) {
         waitForIdle(mContext);
-        destruct_handle<VulkanIndexBuffer>(mHandleMap, ibh);
+        mGpuMemory.untrack(GpuMemoryType::INDEX_BUFFER, ibh.getId());
+        destruct(ibh, handle_cast<VulkanIndexBuffer*>(ibh));
     }
 }
 
 void VulkanDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
     if (rph) {
         waitForIdle(mContext);
-        destruct_handle<VulkanRenderPrimitive>(mHandleMap, rph);
+        destruct(rph, handle_cast<VulkanRenderPrimitive*>(rph));
     }
 }
 
 void VulkanDriver::destroyProgram(Driver::ProgramHandle ph) {
     if (ph) {
         waitForIdle(mContext);
-        destruct_handle<VulkanProgram>(mHandleMap, ph);
+        mGpuMemory.untrack(GpuMemoryType::PROGRAM, ph.getId());
+        destruct(ph, handle_cast<VulkanProgram*>(ph));
     }
 }
 
@@ -413,47 +569,64 @@ void VulkanDriver::destroySamplerBuffer(Driver::SamplerBufferHandle sbh) {
         // not map to any Vulkan objects. To handle destruction, the only thing we need to do is
         // ensure that the next draw call doesn't try to access a zombie sampler buffer. Therefore,
         // simply replace all weak references with null.
-        auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+        auto* hwsb = handle_cast<VulkanSamplerBuffer*>(sbh);
         for (auto& binding : mSamplerBindings) {
             if (binding == hwsb) {
                 binding = nullptr;
             }
         }
-        destruct_handle<VulkanSamplerBuffer>(mHandleMap, sbh);
+        destruct(sbh, handle_cast<VulkanSamplerBuffer*>(sbh));
     }
 }
 
 void VulkanDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     if (ubh) {
-        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        auto* buffer = handle_cast<VulkanUniformBuffer*>(ubh);
         mBinder.unbindUniformBuffer(buffer->getGpuBuffer());
+        for (SegmentRecorder& recorder : mSegmentRecorders) {
+            recorder.binder.unbindUniformBuffer(buffer->getGpuBuffer());
+        }
         waitForIdle(mContext);
-        destruct_handle<VulkanUniformBuffer>(mHandleMap, ubh);
+        mGpuMemory.untrack(GpuMemoryType::UNIFORM_BUFFER, ubh.getId());
+        destruct(ubh, handle_cast<VulkanUniformBuffer*>(ubh));
+    }
+}
+
+void VulkanDriver::destroyBufferObject(Driver::BufferObjectHandle boh) {
+    if (boh) {
+        waitForIdle(mContext);
+        mGpuMemory.untrack(GpuMemoryType::BUFFER_OBJECT, boh.getId());
+        destruct(boh, handle_cast<VulkanBufferObject*>(boh));
     }
 }
 
 void VulkanDriver::destroyTexture(Driver::TextureHandle th) {
     if (th) {
-        auto* tex = handle_cast<VulkanTexture>(mHandleMap, th);
+        auto* tex = handle_cast<VulkanTexture*>(th);
         mBinder.unbindImageView(tex->imageView);
+        for (SegmentRecorder& recorder : mSegmentRecorders) {
+            recorder.binder.unbindImageView(tex->imageView);
+        }
         waitForIdle(mContext);
-        destruct_handle<VulkanTexture>(mHandleMap, th);
+        mGpuMemory.untrack(GpuMemoryType::TEXTURE, th.getId());
+        destruct(th, handle_cast<VulkanTexture*>(th));
     }
 }
 
 void VulkanDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
     if (rth) {
         waitForIdle(mContext);
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
+        mGpuMemory.untrack(GpuMemoryType::RENDER_TARGET, rth.getId());
+        destruct(rth, handle_cast<VulkanRenderTarget*>(rth));
     }
 }
 
 void VulkanDriver::destroySwapChain(Driver::SwapChainHandle sch) {
     if (sch) {
         waitForIdle(mContext);
-        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain*>(sch)->surfaceContext;
         destroySurfaceContext(mContext, sc);
-        destruct_handle<VulkanSwapChain>(mHandleMap, sch);
+        destruct(sch, handle_cast<VulkanSwapChain*>(sch));
     }
 }
 
@@ -473,10 +646,54 @@ void VulkanDriver::updateStreams(CommandStream* driver) {
 void VulkanDriver::destroyFence(Driver::FenceHandle fh) {
 }
 
+void VulkanDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    if (tqh) {
+        // the query pool might still be written by the GPU, or read by a pending task
+        waitForIdle(mContext);
+        destruct(tqh, handle_cast<VulkanTimerQuery*>(tqh));
+    }
+}
+
+void VulkanDriver::destroyHandles(Driver::BufferDescriptor&& handles) {
+    auto const* p = static_cast<Driver::DestroyedHandle const*>(handles.buffer);
+    for (size_t i = 0, c = handles.size / sizeof(Driver::DestroyedHandle); i < c; i++) {
+        switch (p[i].type) {
+            case HandleType::RENDER_PRIMITIVE:
+                destroyRenderPrimitive(Driver::RenderPrimitiveHandle(p[i].id));
+                break;
+            case HandleType::VERTEX_BUFFER:
+                destroyVertexBuffer(Driver::VertexBufferHandle(p[i].id));
+                break;
+            case HandleType::INDEX_BUFFER:
+                destroyIndexBuffer(Driver::IndexBufferHandle(p[i].id));
+                break;
+            case HandleType::TEXTURE:
+                destroyTexture(Driver::TextureHandle(p[i].id));
+                break;
+            case HandleType::UNIFORM_BUFFER:
+                destroyUniformBuffer(Driver::UniformBufferHandle(p[i].id));
+                break;
+            case HandleType::SAMPLER_BUFFER:
+                destroySamplerBuffer(Driver::SamplerBufferHandle(p[i].id));
+                break;
+        }
+    }
+    scheduleDestroy(std::move(handles));
+}
+
 Driver::FenceStatus VulkanDriver::wait(Driver::FenceHandle fh, uint64_t timeout) {
     return FenceStatus::ERROR;
 }
 
+bool VulkanDriver::isNativeFenceSupported() {
+    // TODO: export the fences with VK_KHR_external_fence_fd, once there are fences
+    return false;
+}
+
+int VulkanDriver::dupNativeFence(Driver::FenceHandle fh) {
+    return -1;
+}
+
 // We create all textures using VK_IMAGE_TILING_OPTIMAL, so our definition of "supported" is that
 // the GPU supports the given texture format with non-zero optimal tiling features.
 bool VulkanDriver::isTextureFormatSupported(Driver::TextureFormat format) {
@@ -502,36 +719,147 @@ bool VulkanDriver::isRenderTargetFormatSupported(Driver::TextureFormat format) {
 }
 
 bool VulkanDriver::isFrameTimeSupported() {
+    return mContext.physicalDeviceProperties.limits.timestampComputeAndGraphics;
+}
+
+bool VulkanDriver::isTimerQuerySupported() {
+    return mContext.physicalDeviceProperties.limits.timestampComputeAndGraphics;
+}
+
+bool VulkanDriver::isComputeSupported() {
+    // TODO: the binder only creates graphics pipelines, and has no storage buffer or image
+    //       descriptors yet
     return false;
 }
 
+bool VulkanDriver::isImplicitResolveSupported() {
+    // see createRenderTarget()
+    return true;
+}
+
+bool VulkanDriver::isFrameBufferFetchSupported() {
+    // this would require input attachments in a second subpass of the color pass
+    return false;
+}
+
+bool VulkanDriver::isMultipleRenderTargetsSupported() {
+    // TODO: the render passes and framebuffers of VulkanFboCache have a single color attachment
+    return false;
+}
+
+bool VulkanDriver::isDepthReadbackSupported() {
+    // TODO: readPixels() isn't implemented yet
+    return false;
+}
+
+size_t VulkanDriver::getUniformBufferOffsetAlignment() {
+    return size_t(mContext.physicalDeviceProperties.limits.minUniformBufferOffsetAlignment);
+}
+
+bool VulkanDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    // this is called from the application thread, the result is published by the driver thread
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery*>(tqh);
+    const uint64_t elapsed = tq->elapsed.exchange(0, std::memory_order_relaxed);
+    if (!elapsed) {
+        return false;
+    }
+    *elapsedTime = elapsed;
+    return true;
+}
+
+Driver::GpuMemoryStats VulkanDriver::getGpuMemoryStats() {
+    return mGpuMemory.getStats();
+}
+
+size_t VulkanDriver::getPipelineCacheData(void* data, size_t size) {
+    return mBinder.getPipelineCacheData(data, size);
+}
+
+void VulkanDriver::compilePrograms(BufferDescriptor&& programs) {
+    // shader modules are ready as soon as they're created
+    scheduleDestroy(std::move(programs));
+}
+
+void VulkanDriver::setBlobCache(BlobCache* cache) {
+    // the pipeline cache, see setPipelineCacheData(), takes care of the SPIR-V compilation
+}
+
+void VulkanDriver::setPipelineCacheData(BufferDescriptor&& data) {
+    mBinder.loadPipelineCache(data.buffer, data.size);
+    scheduleDestroy(std::move(data));
+}
+
+void VulkanDriver::trimCaches(BufferDescriptor&& freed) {
+    // the free stages aren't used by the GPU anymore
+    const size_t size = mStagePool.trim();
+
+    // the other objects can be used by the frames in flight, or by the one being recorded
+    if (!mContext.cmdbuffer) {
+        vkDeviceWaitIdle(mContext.device);
+        mFramebufferCache.trim();
+        mBinder.trim();
+        for (SegmentRecorder& recorder : mSegmentRecorders) {
+            recorder.binder.trim();
+        }
+    }
+
+    assert(freed.size >= sizeof(size_t));
+    *static_cast<size_t*>(freed.buffer) = size;
+    scheduleDestroy(std::move(freed));
+}
+
 void VulkanDriver::loadVertexBuffer(Driver::VertexBufferHandle vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset, uint32_t byteSize) {
-    auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
+    auto& vb = *handle_cast<VulkanVertexBuffer*>(vbh);
     vb.buffers[index]->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
 
 void VulkanDriver::loadIndexBuffer(Driver::IndexBufferHandle ibh, BufferDescriptor&& p,
         uint32_t byteOffset, uint32_t byteSize) {
-    auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
+    auto& ib = *handle_cast<VulkanIndexBuffer*>(ibh);
     ib.buffer->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
 
+void VulkanDriver::copyVertexBuffer(Driver::VertexBufferHandle dst,
+        Driver::VertexBufferHandle src) {
+    // only used by the compute passes, which this backend doesn't support yet
+    utils::slog.e << "copyVertexBuffer is not supported by the Vulkan backend." << utils::io::endl;
+}
+
+void VulkanDriver::updateBufferObject(Driver::BufferObjectHandle boh, BufferDescriptor&& p,
+        uint32_t byteOffset) {
+    auto& bo = *handle_cast<VulkanBufferObject*>(boh);
+    bo.buffer->loadFromCpu(p.buffer, byteOffset, uint32_t(p.size));
+    scheduleDestroy(std::move(p));
+}
+
 void VulkanDriver::load2DImage(Driver::TextureHandle th,
         uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& data) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
     assert(xoffset == 0 && yoffset == 0 && "Offsets not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->load2DImage(std::move(data), width, height, level);
+    handle_cast<VulkanTexture*>(th)->load2DImage(std::move(data), width, height, level);
+    scheduleDestroy(std::move(data));
+}
+
+void VulkanDriver::load3DImage(Driver::TextureHandle th,
+        uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& data) {
+    assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
+    assert(xoffset == 0 && yoffset == 0 && zoffset == 0 && "Offsets not yet supported.");
+    VulkanTexture* texture = handle_cast<VulkanTexture*>(th);
+    assert(depth == texture->depth && "All the layers must be uploaded at once.");
+    texture->load2DImage(std::move(data), width, height, level);
     scheduleDestroy(std::move(data));
 }
 
 void VulkanDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->loadCubeImage(std::move(data), faceOffsets, level);
+    handle_cast<VulkanTexture*>(th)->loadCubeImage(std::move(data), faceOffsets, level);
     scheduleDestroy(std::move(data));
 }
 
@@ -541,21 +869,77 @@ void VulkanDriver::setExternalImage(Driver::TextureHandle th, void* image) {
 void VulkanDriver::setExternalStream(Driver::TextureHandle th, Driver::StreamHandle sh) {
 }
 
+void VulkanDriver::setAcquiredImage(Driver::StreamHandle sh, void* image, int acquireFence,
+        driver::StreamCallback callback, void* userData) {
+    // external images are not supported yet, give the image back so its producer doesn't starve
+#if defined(ANDROID)
+    if (acquireFence >= 0) {
+        close(acquireFence);
+    }
+#endif
+    scheduleRelease({ image, callback, userData });
+}
+
 void VulkanDriver::generateMipmaps(Driver::TextureHandle th) {
 }
 
+void VulkanDriver::commitTextureLevels(Driver::TextureHandle th, uint32_t minLevel) {
+    // the textures created by createSparseTexture() have all their levels allocated
+}
+
+void VulkanDriver::setMinMaxLevels(Driver::TextureHandle th, uint32_t minLevel,
+        uint32_t maxLevel) {
+    auto* tex = handle_cast<VulkanTexture*>(th);
+    VkImageView previous = tex->setMinMaxLevels(minLevel, maxLevel);
+    mBinder.unbindImageView(previous);
+    for (SegmentRecorder& recorder : mSegmentRecorders) {
+        recorder.binder.unbindImageView(previous);
+    }
+    // the commands of this frame can still sample from the old view
+    VkDevice device = mContext.device;
+    getSwapContext(mContext).pendingWork.emplace_back([device, previous] (VkCommandBuffer) {
+        vkDestroyImageView(device, previous, VKALLOC);
+    });
+}
+
 void VulkanDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
         UniformBuffer&& uniformBuffer) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    auto* buffer = handle_cast<VulkanUniformBuffer*>(ubh);
     if (uniformBuffer.isDirty()) {
-        buffer->loadFromCpu(uniformBuffer.getBuffer(), (uint32_t) uniformBuffer.getSize());
+        const size_t offset = uniformBuffer.getDirtyOffset();
+        buffer->loadFromCpu(static_cast<char const*>(uniformBuffer.getBuffer()) + offset,
+                (uint32_t) offset, (uint32_t) uniformBuffer.getDirtySize());
     }
     buffer->ub = std::move(uniformBuffer);
 }
 
+void VulkanDriver::updateUniformBufferRange(Driver::UniformBufferHandle ubh,
+        uint32_t offset, Driver::BufferDescriptor&& data) {
+    auto* buffer = handle_cast<VulkanUniformBuffer*>(ubh);
+    memcpy(buffer->ub.invalidateUniforms(offset, data.size), data.buffer, data.size);
+    buffer->ub.clean();
+    buffer->loadFromCpu(data.buffer, offset, (uint32_t) data.size);
+    scheduleDestroy(std::move(data));
+}
+
+void VulkanDriver::updateUniformBufferRanges(Driver::BufferDescriptor&& data) {
+    char const* p = static_cast<char const*>(data.buffer);
+    char const* const end = p + data.size;
+    while (p < end) {
+        UniformRangeUpdate update = *reinterpret_cast<UniformRangeUpdate const*>(p);
+        auto* buffer = handle_cast<VulkanUniformBuffer*>(update.ubh);
+        char const* const bytes = p + sizeof(UniformRangeUpdate);
+        memcpy(buffer->ub.invalidateUniforms(update.offset, update.size), bytes, update.size);
+        buffer->ub.clean();
+        buffer->loadFromCpu(bytes, update.offset, update.size);
+        p += UniformRangeUpdate::getRecordSize(update.size);
+    }
+    scheduleDestroy(std::move(data));
+}
+
 void VulkanDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
         SamplerBuffer&& samplerBuffer) {
-    auto* sb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+    auto* sb = handle_cast<VulkanSamplerBuffer*>(sbh);
     *sb->sb = samplerBuffer;
 }
 
@@ -566,7 +950,7 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     assert(mContext.currentSurface);
     VulkanSurfaceContext& surface = *mContext.currentSurface;
     const SwapContext& swapContext = surface.swapContexts[surface.currentSwapIndex];
-    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
+    mCurrentRenderTarget = handle_cast<VulkanRenderTarget*>(rth);
     VulkanRenderTarget* rt = mCurrentRenderTarget;
     const VkExtent2D extent = rt->getExtent();
     assert(extent.width > 0 && extent.height > 0);
@@ -579,29 +963,37 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
 
     VkImageLayout finalLayout;
     if (!rt->isOffscreen()) {
-        finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // headless swap chains are only ever read back
+        finalLayout = surface.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL :
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
     } else if (depthOnly) {
         finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
     } else {
         finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
 
+    const uint8_t samples = rt->getSamples();
     VkRenderPass renderPass = mFramebufferCache.getRenderPass({
         .finalLayout = finalLayout,
         .colorFormat = color.format,
         .depthFormat = depth.format,
         .flags.value = params.flags,
+        .samples = samples,
     });
-    mBinder.bindRenderPass(renderPass);
+    mBinder.bindRenderPass(renderPass, hasColor);
 
+    // With multisampling, we render into the transient attachment and resolve into the color one.
     VulkanFboCache::FboKey fbo { .renderPass = renderPass };
     int numAttachments = 0;
     if (hasColor) {
-      fbo.attachments[numAttachments++] = color.view;
+      fbo.attachments[numAttachments++] = samples > 1 ? rt->getMsaaColor().view : color.view;
     }
     if (hasDepth) {
       fbo.attachments[numAttachments++] = depth.view;
     }
+    if (hasColor && samples > 1) {
+      fbo.attachments[numAttachments++] = color.view;
+    }
 
     VkRenderPassBeginInfo renderPassInfo {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
@@ -629,23 +1021,110 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     }
     renderPassInfo.pClearValues = &clearValues[0];
 
-    vkCmdBeginRenderPass(swapContext.cmdbuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // The commands of the pass can be recorded on several threads, see executeSegments().
+    vkCmdBeginRenderPass(swapContext.cmdbuffer, &renderPassInfo,
+            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    mContext.currentRenderPass = renderPassInfo;
+    beginRenderPassCommands();
     if (!(params.clear & RenderPassParams::IGNORE_VIEWPORT)) {
         viewport(params.left, params.bottom, params.width, params.height);
     }
-
-    mContext.currentRenderPass = renderPassInfo;
 }
 
 void VulkanDriver::endRenderPass(int) {
     assert(mContext.cmdbuffer);
     assert(mContext.currentSurface);
     assert(mCurrentRenderTarget);
+    VkCommandBuffer cmdbuffer = endRenderPassCommands();
+    vkCmdExecuteCommands(mContext.cmdbuffer, 1, &cmdbuffer);
     vkCmdEndRenderPass(mContext.cmdbuffer);
     mCurrentRenderTarget = VK_NULL_HANDLE;
     mContext.currentRenderPass.renderPass = VK_NULL_HANDLE;
 }
 
+void VulkanDriver::beginRenderPassCommands() {
+    SwapContext& swapContext = getSwapContext(mContext);
+    mContext.cmdbuffer = beginSecondaryCommandBuffer(mContext, swapContext.secondaries[0]);
+
+    // Nothing is inherited from the primary command buffer, but the render pass.
+    mBinder.resetBindings();
+    VkViewport viewport = mContext.viewport;
+    mCurrentRenderTarget->transformClientRectToPlatform(&viewport);
+    vkCmdSetViewport(mContext.cmdbuffer, 0, 1, &viewport);
+    vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &mContext.scissor);
+    vkCmdSetDepthBias(mContext.cmdbuffer, mContext.polygonOffset[1], 0.0f,
+            mContext.polygonOffset[0]);
+}
+
+VkCommandBuffer VulkanDriver::endRenderPassCommands() {
+    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+    VkResult result = vkEndCommandBuffer(cmdbuffer);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
+    mContext.cmdbuffer = getSwapContext(mContext).cmdbuffer;
+    return cmdbuffer;
+}
+
+void VulkanDriver::executeSegments(utils::JobSystem& js, CommandBase* const* segments, size_t count) {
+    // Only the commands of a render pass can be recorded into secondary command buffers, and
+    // there is nothing to gain from recording a single segment on another thread.
+    if (!mCurrentRenderTarget || count < 2) {
+        Driver::executeSegments(js, segments, count);
+        return;
+    }
+    assert(count <= SegmentsCommand::MAX_SEGMENTS);
+
+    // The commands recorded so far by the driver thread execute first.
+    VkCommandBuffer cmdbuffers[MAX_RECORDING_THREADS];
+    cmdbuffers[0] = endRenderPassCommands();
+
+    // Each segment starts with the state left by the driver thread, as if they executed in order.
+    SwapContext& swapContext = getSwapContext(mContext);
+    VkViewport viewport = mContext.viewport;
+    mCurrentRenderTarget->transformClientRectToPlatform(&viewport);
+    for (size_t i = 0; i < count; i++) {
+        SegmentRecorder& recorder = mSegmentRecorders[i];
+        recorder.cmdbuffer = beginSecondaryCommandBuffer(mContext, swapContext.secondaries[i + 1]);
+        recorder.binder.copyBindings(mBinder);
+        std::copy(std::begin(mSamplerBindings), std::end(mSamplerBindings),
+                recorder.samplerBindings);
+        recorder.rasterState = mContext.rasterState;
+        recorder.scissor = mContext.scissor;
+        std::copy(std::begin(mContext.polygonOffset), std::end(mContext.polygonOffset),
+                recorder.polygonOffset);
+        vkCmdSetViewport(recorder.cmdbuffer, 0, 1, &viewport);
+        vkCmdSetScissor(recorder.cmdbuffer, 0, 1, &recorder.scissor);
+        vkCmdSetDepthBias(recorder.cmdbuffer, recorder.polygonOffset[1], 0.0f,
+                recorder.polygonOffset[0]);
+        cmdbuffers[i + 1] = recorder.cmdbuffer;
+    }
+
+    auto recordSegments = [this, segments](uint32_t first, uint32_t c) {
+        for (uint32_t i = first; i < first + c; i++) {
+            sSegmentRecorder = &mSegmentRecorders[i];
+            executeCommands(segments[i]);
+            sSegmentRecorder = nullptr;
+        }
+    };
+    auto job = utils::jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(recordSegments), utils::jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+
+    for (size_t i = 0; i < count; i++) {
+        VkResult result = vkEndCommandBuffer(mSegmentRecorders[i].cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
+    }
+    vkCmdExecuteCommands(mContext.cmdbuffer, uint32_t(count + 1), cmdbuffers);
+
+    // The driver thread resumes with the state left by the last segment.
+    SegmentRecorder const& last = mSegmentRecorders[count - 1];
+    mBinder.copyBindings(last.binder);
+    std::copy(std::begin(last.samplerBindings), std::end(last.samplerBindings),
+            mSamplerBindings);
+    mContext.rasterState = last.rasterState;
+    mContext.scissor = last.scissor;
+    beginRenderPassCommands();
+}
+
 void VulkanDriver::discardSubRenderTargetBuffers(Driver::RenderTargetHandle rth,
         Driver::TargetBufferFlags buffers,
         uint32_t left, uint32_t bottom, uint32_t width, uint32_t height) {
@@ -655,18 +1134,24 @@ void VulkanDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
         uint32_t width, uint32_t height) {
 }
 
+void VulkanDriver::setRenderTargetColorAttachment(Driver::RenderTargetHandle rth,
+        uint8_t index, Driver::TargetBufferInfo color) {
+    utils::slog.e << "Multiple render targets are not supported by the Vulkan backend."
+            << utils::io::endl;
+}
+
 void VulkanDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
         Driver::VertexBufferHandle vbh, Driver::IndexBufferHandle ibh,
         uint32_t enabledAttributes) {
-    auto primitive = handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
-    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(mHandleMap, vbh),
-            handle_cast<VulkanIndexBuffer>(mHandleMap, ibh), enabledAttributes);
+    auto primitive = handle_cast<VulkanRenderPrimitive*>(rph);
+    primitive->setBuffers(handle_cast<VulkanVertexBuffer*>(vbh),
+            handle_cast<VulkanIndexBuffer*>(ibh), enabledAttributes);
 }
 
 void VulkanDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
         Driver::PrimitiveType pt, uint32_t offset,
         uint32_t minIndex, uint32_t maxIndex, uint32_t count) {
-    auto& primitive = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    auto& primitive = *handle_cast<VulkanRenderPrimitive*>(rph);
     primitive.setPrimitiveType(pt);
     primitive.offset = offset * primitive.indexBuffer->elementSize;
     primitive.count = count;
@@ -674,9 +1159,22 @@ void VulkanDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
     primitive.maxIndex = maxIndex > minIndex ? maxIndex : primitive.maxVertexCount - 1;
 }
 
+void VulkanDriver::setPolygonOffset(float slope, float constant) {
+    SegmentRecorder* const recorder = sSegmentRecorder;
+    float* const polygonOffset = recorder ? recorder->polygonOffset : mContext.polygonOffset;
+    polygonOffset[0] = slope;
+    polygonOffset[1] = constant;
+    // the depth bias is only enabled in the shadow maps, see draw()
+    if (mCurrentRenderTarget) {
+        VkCommandBuffer cmdbuffer = recorder ? recorder->cmdbuffer : mContext.cmdbuffer;
+        vkCmdSetDepthBias(cmdbuffer, constant, 0.0f, slope);
+    }
+}
+
 void VulkanDriver::setViewportScissor(
         int32_t left, int32_t bottom, uint32_t width, uint32_t height) {
     assert(mContext.cmdbuffer && mCurrentRenderTarget);
+    SegmentRecorder* const recorder = sSegmentRecorder;
     // Compute the intersection of the requested scissor rectangle with the current viewport.
     int32_t x = std::max(left, (int32_t) mContext.viewport.x);
     int32_t y = std::max(bottom, (int32_t) mContext.viewport.y);
@@ -690,13 +1188,19 @@ void VulkanDriver::setViewportScissor(
     };
 
     mCurrentRenderTarget->transformClientRectToPlatform(&scissor);
-    vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+    if (recorder) {
+        recorder->scissor = scissor;
+        vkCmdSetScissor(recorder->cmdbuffer, 0, 1, &scissor);
+    } else {
+        mContext.scissor = scissor;
+        vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+    }
 }
 
 void VulkanDriver::makeCurrent(Driver::SwapChainHandle drawSch, Driver::SwapChainHandle readSch) {
     ASSERT_PRECONDITION_NON_FATAL(drawSch == readSch,
                                   "Vulkan driver does not support distinct draw/read swap chains.");
-    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(mHandleMap, drawSch)->surfaceContext;
+    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain*>(drawSch)->surfaceContext;
     mContext.currentSurface = &sContext;
 }
 
@@ -706,8 +1210,11 @@ void VulkanDriver::commit(Driver::SwapChainHandle sch) {
             "Vulkan driver requires at least one frame before a commit.");
     releaseCommandBuffer(mContext);
 
-    // Present the backbuffer.
-    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+    // Present the backbuffer, unless there is nowhere to present it.
+    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain*>(sch)->surfaceContext;
+    if (surface.headless) {
+        return;
+    }
     VkPresentInfoKHR presentInfo {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
@@ -724,6 +1231,7 @@ void VulkanDriver::commit(Driver::SwapChainHandle sch) {
 
 void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t height) {
     assert(mContext.cmdbuffer && mCurrentRenderTarget);
+    assert(!sSegmentRecorder);
     VkViewport viewport = mContext.viewport = {
         .x = (float) left,
         .y = (float) bottom,
@@ -738,6 +1246,7 @@ void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t h
     };
 
     mCurrentRenderTarget->transformClientRectToPlatform(&scissor);
+    mContext.scissor = scissor;
     vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
 
     mCurrentRenderTarget->transformClientRectToPlatform(&viewport);
@@ -745,16 +1254,41 @@ void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t h
 }
 
 void VulkanDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-    // The driver API does not currently expose offset / range, but it will do so in the future.
+    auto* buffer = handle_cast<VulkanUniformBuffer*>(ubh);
+    // the whole buffer is bound, see bindUniformsRange() for binding a range of it
     const VkDeviceSize offset = 0;
     const VkDeviceSize size = VK_WHOLE_SIZE;
-    mBinder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer(), offset, size);
+    VulkanBinder& binder = sSegmentRecorder ? sSegmentRecorder->binder : mBinder;
+    binder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer(), offset, size);
+}
+
+void VulkanDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) {
+    auto* buffer = handle_cast<VulkanUniformBuffer*>(ubh);
+    VulkanBinder& binder = sSegmentRecorder ? sSegmentRecorder->binder : mBinder;
+    binder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer(),
+            VkDeviceSize(offset), VkDeviceSize(size));
 }
 
 void VulkanDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
-    auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
-    mSamplerBindings[index] = hwsb;
+    auto* hwsb = handle_cast<VulkanSamplerBuffer*>(sbh);
+    VulkanSamplerBuffer** samplerBindings = sSegmentRecorder ?
+            sSegmentRecorder->samplerBindings : mSamplerBindings;
+    samplerBindings[index] = hwsb;
+}
+
+void VulkanDriver::bindStorageBuffer(size_t index, Driver::BufferObjectHandle boh) {
+    utils::slog.e << "Storage buffers are not supported by the Vulkan backend." << utils::io::endl;
+}
+
+void VulkanDriver::bindVertexStorageBuffer(size_t index, Driver::VertexBufferHandle vbh,
+        uint8_t bufferIndex) {
+    utils::slog.e << "Storage buffers are not supported by the Vulkan backend." << utils::io::endl;
+}
+
+void VulkanDriver::bindImage(size_t unit, Driver::TextureHandle th, uint8_t level,
+        Driver::ImageAccess access) {
+    utils::slog.e << "Images are not supported by the Vulkan backend." << utils::io::endl;
 }
 
 void VulkanDriver::insertEventMarker(char const* string, size_t len) {
@@ -782,6 +1316,41 @@ void VulkanDriver::popGroupMarker(int) {
     }
 }
 
+void VulkanDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery*>(tqh);
+    tq->elapsed.store(0, std::memory_order_relaxed);
+    if (tq->pool) {
+        // queries can't be reset within a render pass, which timer queries never are in
+        vkCmdResetQueryPool(mContext.cmdbuffer, tq->pool, 0, 2);
+        vkCmdWriteTimestamp(mContext.cmdbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, tq->pool, 0);
+    }
+}
+
+void VulkanDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery*>(tqh);
+    if (!tq->pool) {
+        return;
+    }
+    vkCmdWriteTimestamp(mContext.cmdbuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, tq->pool, 1);
+
+    // the timestamps are available once this command buffer's fence has been waited on
+    getSwapContext(mContext).pendingWork.emplace_back([tq, device = mContext.device,
+            period = mContext.physicalDeviceProperties.limits.timestampPeriod] (VkCommandBuffer) {
+        uint64_t timestamps[2] = {};
+        VkResult result = vkGetQueryPoolResults(device, tq->pool, 0, 2, sizeof(timestamps),
+                timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS && timestamps[1] >= timestamps[0]) {
+            // 0 means "not known", a query can't really take no time at all
+            const uint64_t elapsed = uint64_t((timestamps[1] - timestamps[0]) * double(period));
+            tq->elapsed.store(std::max(elapsed, uint64_t(1)), std::memory_order_relaxed);
+        }
+    });
+}
+
 void VulkanDriver::readPixels(Driver::RenderTargetHandle src,
         uint32_t x, uint32_t y, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& p) {
@@ -800,22 +1369,29 @@ void VulkanDriver::blit(TargetBufferFlags buffers,
         int32_t srcLeft, int32_t srcBottom, uint32_t srcWidth, uint32_t srcHeight) {
 }
 
-void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterState,
-        Driver::RenderPrimitiveHandle rph) {
-    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
+VkCommandBuffer VulkanDriver::bindDrawState(Driver::ProgramHandle ph,
+        Driver::RasterState rasterState, Driver::RenderPrimitiveHandle rph) {
+    // Segments executed in parallel record into their own command buffer, with their own state.
+    SegmentRecorder* const recorder = sSegmentRecorder;
+    VkCommandBuffer cmdbuffer = recorder ? recorder->cmdbuffer : mContext.cmdbuffer;
     ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
-    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    VulkanBinder& binder = recorder ? recorder->binder : mBinder;
+    VulkanBinder::RasterState& vkRasterState =
+            recorder ? recorder->rasterState : mContext.rasterState;
+    VulkanSamplerBuffer* const* samplerBindings =
+            recorder ? recorder->samplerBindings : mSamplerBindings;
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive*>(rph);
 
     // If this is a debug build, validate the current shader.
-    auto* program = handle_cast<VulkanProgram>(mHandleMap, ph);
+    auto* program = handle_cast<VulkanProgram*>(ph);
 #if !defined(NDEBUG)
-    if (program->bundle.vertex == VK_NULL_HANDLE || program->bundle.fragment == VK_NULL_HANDLE) {
+    if (program->bundle.vertex == VK_NULL_HANDLE) {
         utils::slog.e << "Binding missing shader: " << program->name.c_str() << utils::io::endl;
     }
 #endif
 
     // Update the VK raster state.
-    mContext.rasterState.depthStencil = {
+    vkRasterState.depthStencil = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .depthTestEnable = VK_TRUE,
         .depthWriteEnable = (VkBool32) rasterState.depthWrite,
@@ -823,7 +1399,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
     };
-    mContext.rasterState.blending = {
+    vkRasterState.blending = {
         .blendEnable = rasterState.hasBlending(),
         .srcColorBlendFactor = getBlendFactor(rasterState.blendFunctionSrcRGB),
         .dstColorBlendFactor = getBlendFactor(rasterState.blendFunctionDstRGB),
@@ -834,29 +1410,29 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
         .colorWriteMask = (VkColorComponentFlags) (rasterState.colorWrite ? 0xf : 0x0),
     };
 
-    // Remove the fragment shader from depth-only passes to avoid a validation warning.
-    VulkanBinder::ProgramBundle shaderHandles = program->bundle;
+    // The depth-only passes are the shadow maps, their primitives are offset by the depth bias
+    // (see setPolygonOffset). The programs of the opaque casters have no fragment shader, those
+    // of the masked ones keep theirs to discard the fragments.
     VulkanRenderTarget* rt = mCurrentRenderTarget;
     const auto color = rt->getColor();
     const auto depth = rt->getDepth();
     const bool hasColor = color.format != VK_FORMAT_UNDEFINED;
     const bool hasDepth = depth.format != VK_FORMAT_UNDEFINED;
     const bool depthOnly = hasDepth && !hasColor;
-    if (depthOnly) {
-        shaderHandles.fragment = VK_NULL_HANDLE;
-    }
+    vkRasterState.rasterization.depthBiasEnable = VkBool32(depthOnly);
+    vkRasterState.multisampling.rasterizationSamples = (VkSampleCountFlagBits) rt->getSamples();
 
     // Push state changes to the VulkanBinder instance. This is fast and does not make VK calls.
-    mBinder.bindProgramBundle(shaderHandles);
-    mBinder.bindRasterState(mContext.rasterState);
-    mBinder.bindPrimitiveTopology(prim.primitiveTopology);
-    mBinder.bindVertexArray(prim.varray);
+    binder.bindProgramBundle(program->bundle);
+    binder.bindRasterState(vkRasterState);
+    binder.bindPrimitiveTopology(prim.primitiveTopology);
+    binder.bindVertexArray(prim.varray);
 
     // Query the program for the mapping from (SamplerBufferBinding,Offset) to (SamplerBinding),
     // where "SamplerBinding" is the integer in the GLSL, and SamplerBufferBinding is the abstract
     // Filament concept used to form groups of samplers.
     for (uint8_t bufferIdx = 0; bufferIdx < VulkanBinder::NUM_SAMPLER_BINDINGS; bufferIdx++) {
-        VulkanSamplerBuffer* vksb = mSamplerBindings[bufferIdx];
+        VulkanSamplerBuffer* vksb = samplerBindings[bufferIdx];
         if (!vksb) {
             continue;
         }
@@ -871,8 +1447,8 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
                     &group)) {
                 const SamplerParams& samplerParams = sampler->s;
                 VkSampler vksampler = mSamplerCache.getSampler(samplerParams);
-                const auto* tex = handle_const_cast<VulkanTexture>(mHandleMap, sampler->t);
-                mBinder.bindSampler(binding, {
+                const auto* tex = handle_cast<const VulkanTexture*>(sampler->t);
+                binder.bindSampler(binding, {
                     .sampler = vksampler,
                     .imageView = tex->imageView,
                     .imageLayout = samplerParams.depthStencil ?
@@ -886,7 +1462,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     // Bind a new descriptor set if it needs to change.
     VkDescriptorSet descriptor;
     VkPipelineLayout pipelineLayout;
-    if (mBinder.getOrCreateDescriptor(&descriptor, &pipelineLayout)) {
+    if (binder.getOrCreateDescriptor(&descriptor, &pipelineLayout)) {
         vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
                 &descriptor, 0, nullptr);
     }
@@ -894,7 +1470,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     // Bind the pipeline if it changed. This can happen, for example, if the raster state changed.
     // Creating a new pipeline is slow, so we should consider using pipeline cache objects.
     VkPipeline pipeline;
-    if (mBinder.getOrCreatePipeline(&pipeline)) {
+    if (binder.getOrCreatePipeline(&pipeline)) {
         vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
     }
 
@@ -905,23 +1481,54 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
             prim.buffers.data(), prim.offsets.data());
     vkCmdBindIndexBuffer(cmdbuffer, prim.indexBuffer->buffer->getGpuBuffer(), 0,
             prim.indexBuffer->indexType);
+    return cmdbuffer;
+}
+
+void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    VkCommandBuffer cmdbuffer = bindDrawState(ph, rasterState, rph);
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive*>(rph);
 
     // Finally, make the actual draw call. TODO: support subranges
     const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
     const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
     const int32_t vertexOffset = 0;
     const uint32_t firstInstId = 1;
     vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
 }
 
+void VulkanDriver::drawIndirect(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+        Driver::RenderPrimitiveHandle rph, Driver::BufferDescriptor&& commands) {
+    const size_t count = commands.size / sizeof(DrawIndirectCommand);
+    if (count) {
+        // The commands are written by the CPU and known when recording, so they are recorded as
+        // direct draws rather than staged into an indirect buffer that would live for the frame.
+        VkCommandBuffer cmdbuffer = bindDrawState(ph, rasterState, rph);
+        DrawIndirectCommand const* c = static_cast<DrawIndirectCommand const*>(commands.buffer);
+        for (size_t i = 0; i < count; i++) {
+            // the instance ids start at 1, like in draw()
+            vkCmdDrawIndexed(cmdbuffer, c[i].count, c[i].instanceCount, c[i].firstIndex,
+                    c[i].baseVertex, c[i].baseInstance + 1);
+        }
+    }
+    scheduleDestroy(std::move(commands));
+}
+
+void VulkanDriver::dispatchCompute(Driver::ProgramHandle ph,
+        uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    utils::slog.e << "Compute is not supported by the Vulkan backend." << utils::io::endl;
+}
+
 #ifndef NDEBUG
 void VulkanDriver::debugCommand(const char* methodName) {
     static const std::set<utils::StaticString> OUTSIDE_COMMANDS = {
         "updateUniformBuffer",
+        "updateUniformBufferRange",
+        "updateUniformBufferRanges",
         "loadVertexBuffer",
         "loadIndexBuffer",
         "load2DImage",
+        "load3DImage",
         "loadCubeImage",
     };
     static const utils::StaticString BEGIN_COMMAND = "beginRenderPass";
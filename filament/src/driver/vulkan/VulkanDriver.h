@@ -29,7 +29,6 @@
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
 
-#include <unordered_map>
 #include <vector>
 
 namespace filament {
@@ -56,6 +55,10 @@ private:
 
     virtual ShaderModel getShaderModel() const noexcept override final;
 
+    // Records each segment into a secondary command buffer, on its own job.
+    void executeSegments(utils::JobSystem& js, CommandBase* const* segments,
+            size_t count) override;
+
     template<typename T>
     friend class ::filament::ConcreteDispatcher;
 
@@ -75,58 +78,32 @@ private:
     VulkanDriver(VulkanDriver const&) = delete;
     VulkanDriver& operator = (VulkanDriver const&) = delete;
 
-    driver::VulkanPlatform& mContextManager;
+    // Render passes only execute secondary command buffers: the driver thread records the
+    // commands of the current render pass into one of its own, which these begin and end.
+    void beginRenderPassCommands();
+    VkCommandBuffer endRenderPassCommands();
+
+    // Binds the pipeline, descriptors and buffers of a draw() or drawIndirect(), and returns the
+    // command buffer to draw with.
+    VkCommandBuffer bindDrawState(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+            Driver::RenderPrimitiveHandle rph);
+
+    // The caches are shared by all swap chains, they keep their unused objects for as many
+    // frames as the swap chain with the most frames in flight.
+    void setFramesInFlight(uint32_t count) noexcept;
+
+    // Bindings and dynamic state of a segment of the command stream recorded by a job, which
+    // starts with those of the driver thread, see executeSegments().
+    struct SegmentRecorder {
+        VkCommandBuffer cmdbuffer = VK_NULL_HANDLE;
+        VulkanBinder binder;
+        VulkanSamplerBuffer* samplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
+        VulkanBinder::RasterState rasterState;
+        VkRect2D scissor = {};
+        float polygonOffset[2] = {};
+    };
 
-    // For now we're not bothering to store handles in pools, just simple on-demand allocation.
-    // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
-    using Blob = std::vector<uint8_t>;
-    using HandleMap = std::unordered_map<HandleBase::HandleId, Blob>;
-    HandleMap mHandleMap;
-    HandleBase::HandleId mNextId = 1;
-
-    template<typename Dp, typename B>
-    Handle<B> alloc_handle() {
-        mHandleMap[mNextId] = Blob(sizeof(Dp));
-        return Handle<B>(mNextId++);
-    }
-
-    template<typename Dp, typename B>
-    Dp* handle_cast(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<Dp*>(blob.data());
-    }
-
-    template<typename Dp, typename B>
-    const Dp* handle_const_cast(HandleMap& handleMap, const Handle<B>& handle) noexcept {
-        assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<const Dp*>(blob.data());
-    }
-
-    template<typename Dp, typename B, typename ... ARGS>
-    Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        Dp* addr = reinterpret_cast<Dp*>(blob.data());
-        new(addr) Dp(std::forward<ARGS>(args)...);
-        return addr;
-    }
-
-    template<typename Dp, typename B>
-    void destruct_handle(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        // Call the destructor, remove the blob, don't bother reclaiming the integer id.
-        handle_cast<Dp>(handleMap, handle)->~Dp();
-        handleMap.erase(handle.getId());
-    }
+    driver::VulkanPlatform& mContextManager;
 
     VulkanContext mContext = {};
     VulkanBinder mBinder;
@@ -135,6 +112,10 @@ private:
     VulkanSamplerCache mSamplerCache;
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
     VulkanSamplerBuffer* mSamplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
+    SegmentRecorder mSegmentRecorders[MAX_RECORDING_THREADS - 1];
+
+    // the segment recorded by the calling thread, null on the driver thread
+    static thread_local SegmentRecorder* sSegmentRecorder;
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
 };
 
@@ -33,6 +33,8 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace driver {
 
@@ -78,6 +80,22 @@ void selectPhysicalDevice(VulkanContext& context) {
         }
         if (context.graphicsQueueFamilyIndex == 0xffff) continue;
 
+        // Uploads use a queue family dedicated to transfers if there is one, they can then overlap
+        // with rendering. Some of these families can only copy whole mip levels, which we don't
+        // always do.
+        context.transferQueueFamilyIndex = context.graphicsQueueFamilyIndex;
+        for (uint32_t j = 0; j < queueFamiliesCount; ++j) {
+            VkQueueFamilyProperties props = queueFamiliesProperties[j];
+            const VkExtent3D granularity = props.minImageTransferGranularity;
+            if (props.queueCount == 0 || !(props.queueFlags & VK_QUEUE_TRANSFER_BIT) ||
+                    (props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                continue;
+            }
+            if (granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+                context.transferQueueFamilyIndex = j;
+            }
+        }
+
         // Does the device support the VK_KHR_swapchain extension?
         uint32_t extensionCount;
         result = vkEnumerateDeviceExtensionProperties(physicalDevice, /*pLayerName = */ nullptr,
@@ -138,7 +156,7 @@ void selectPhysicalDevice(VulkanContext& context) {
 }
 
 void createVirtualDevice(VulkanContext& context) {
-    VkDeviceQueueCreateInfo deviceQueueCreateInfo[1] = {};
+    VkDeviceQueueCreateInfo deviceQueueCreateInfo[2] = {};
     static const float queuePriority[] = {1.0f};
     VkDeviceCreateInfo deviceCreateInfo = {};
     std::vector<const char*> deviceExtensionNames = {
@@ -151,8 +169,13 @@ void createVirtualDevice(VulkanContext& context) {
     deviceQueueCreateInfo->queueFamilyIndex = context.graphicsQueueFamilyIndex;
     deviceQueueCreateInfo->queueCount = 1;
     deviceQueueCreateInfo->pQueuePriorities = &queuePriority[0];
-    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.queueCreateInfoCount = 1;
+    if (context.transferQueueFamilyIndex != context.graphicsQueueFamilyIndex) {
+        deviceQueueCreateInfo[1] = deviceQueueCreateInfo[0];
+        deviceQueueCreateInfo[1].queueFamilyIndex = context.transferQueueFamilyIndex;
+        deviceCreateInfo.queueCreateInfoCount = 2;
+    }
+    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfo;
     deviceCreateInfo.pEnabledFeatures = nullptr;
     deviceCreateInfo.enabledExtensionCount = deviceExtensionNames.size();
@@ -160,8 +183,11 @@ void createVirtualDevice(VulkanContext& context) {
     VkResult result = vkCreateDevice(context.physicalDevice, &deviceCreateInfo, VKALLOC,
             &context.device);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateDevice error.");
+    bluevk::bindDevice(context.device);
     vkGetDeviceQueue(context.device, context.graphicsQueueFamilyIndex, 0,
             &context.graphicsQueue);
+    vkGetDeviceQueue(context.device, context.transferQueueFamilyIndex, 0,
+            &context.transferQueue);
     VkCommandPoolCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     createInfo.flags =
@@ -169,6 +195,11 @@ void createVirtualDevice(VulkanContext& context) {
     createInfo.queueFamilyIndex = context.graphicsQueueFamilyIndex;
     result = vkCreateCommandPool(context.device, &createInfo, VKALLOC, &context.commandPool);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+    createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    createInfo.queueFamilyIndex = context.transferQueueFamilyIndex;
+    result = vkCreateCommandPool(context.device, &createInfo, VKALLOC,
+            &context.transferCommandPool);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
 
     const VmaVulkanFunctions funcs {
         .vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
@@ -245,16 +276,63 @@ void getSurfaceCaps(VulkanContext& context, VulkanSurfaceContext& sc) {
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkGetPhysicalDeviceSurfaceFormatsKHR error.");
 }
 
-void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
-    // Pick an image count and format.  According to section 30.5 of VK 1.1, maxImageCount of zero
-    // apparently means "that there is no limit on the number of images, though there may be limits
-    // related to the total amount of memory used by presentable images."
-    uint32_t desiredImageCount = 2;
+static uint32_t getFramesInFlight(uint64_t flags) {
+    return uint32_t((flags & SWAP_CHAIN_CONFIG_FRAMES_IN_FLIGHT_MASK) >>
+            SWAP_CHAIN_CONFIG_FRAMES_IN_FLIGHT_SHIFT);
+}
+
+static VkPresentModeKHR selectPresentMode(VulkanContext& context,
+        VulkanSurfaceContext& surfaceContext, uint64_t flags) {
+    // FIFO is the only mode that's always supported.
+    VkPresentModeKHR desiredMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (flags & SWAP_CHAIN_CONFIG_PRESENT_MAILBOX) {
+        desiredMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (flags & SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE) {
+        desiredMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    if (desiredMode == VK_PRESENT_MODE_FIFO_KHR) {
+        return desiredMode;
+    }
+    uint32_t modeCount;
+    VkResult result = vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice,
+            surfaceContext.surface, &modeCount, nullptr);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkGetPhysicalDeviceSurfacePresentModesKHR error.");
+    std::vector<VkPresentModeKHR> modes(modeCount);
+    result = vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice,
+            surfaceContext.surface, &modeCount, modes.data());
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkGetPhysicalDeviceSurfacePresentModesKHR error.");
+    if (std::find(modes.begin(), modes.end(), desiredMode) == modes.end()) {
+        utils::slog.w << "Swap chain does not support present mode " << desiredMode
+                << ", using FIFO." << utils::io::endl;
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+    return desiredMode;
+}
+
+void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surfaceContext,
+        uint64_t flags) {
+    const VkPresentModeKHR presentMode = selectPresentMode(context, surfaceContext, flags);
+
+    // Pick an image count and format. Each image has its own command buffer and fence, so this
+    // is also how many frames can be in flight. A mailbox needs a third image, for the frame
+    // rendered while one is displayed and another one waits for the vertical blank.
+    // According to section 30.5 of VK 1.1, maxImageCount of zero apparently means "that there is
+    // no limit on the number of images, though there may be limits related to the total amount
+    // of memory used by presentable images."
+    uint32_t desiredImageCount = getFramesInFlight(flags);
+    if (!desiredImageCount) {
+        desiredImageCount = presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+    }
+    const uint32_t minImageCount = surfaceContext.surfaceCapabilities.minImageCount;
     const uint32_t maxImageCount = surfaceContext.surfaceCapabilities.maxImageCount;
-    if (desiredImageCount < surfaceContext.surfaceCapabilities.minImageCount ||
+    if (desiredImageCount < minImageCount ||
             (maxImageCount != 0 && desiredImageCount > maxImageCount)) {
-        utils::slog.e << "Swap chain does not support " << desiredImageCount << " images.\n";
-        desiredImageCount = surfaceContext.surfaceCapabilities.minImageCount;
+        utils::slog.w << "Swap chain does not support " << desiredImageCount << " images."
+                << utils::io::endl;
+        desiredImageCount = std::max(desiredImageCount, minImageCount);
+        if (maxImageCount != 0) {
+            desiredImageCount = std::min(desiredImageCount, maxImageCount);
+        }
     }
     surfaceContext.surfaceFormat = surfaceContext.surfaceFormats[0];
     for (const VkSurfaceFormatKHR& format : surfaceContext.surfaceFormats) {
@@ -280,7 +358,7 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
         .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
         .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
         .compositeAlpha = compositeAlpha,
-        .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+        .presentMode = presentMode,
         .clipped = VK_TRUE
     };
     VkSwapchainKHR swapchain;
@@ -309,6 +387,7 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
             << ", " << surfaceContext.surfaceFormat.format
             << ", " << surfaceContext.surfaceFormat.colorSpace
             << ", " << imageCount
+            << ", " << presentMode
             << utils::io::endl;
 
     // Create image views.
@@ -332,6 +411,77 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
     surfaceContext.depth = {};
 }
 
+void createHeadlessImages(VulkanContext& context, VulkanSurfaceContext& surfaceContext,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    // Without a VkSurfaceKHR there is nothing to query, the "surface" is exactly what was asked.
+    surfaceContext.surfaceCapabilities = {};
+    surfaceContext.surfaceCapabilities.currentExtent = { width, height };
+    surfaceContext.clientSize = { width, height };
+    surfaceContext.surfaceFormat = {
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
+    };
+    surfaceContext.swapchain = VK_NULL_HANDLE;
+
+    // Each image has its own command buffer and fence, so this is also how many frames can be
+    // in flight.
+    const uint32_t imageCount = getFramesInFlight(flags);
+    surfaceContext.swapContexts.resize(imageCount ? imageCount : HEADLESS_IMAGE_COUNT);
+    for (SwapContext& swapContext : surfaceContext.swapContexts) {
+        VulkanAttachment& attachment = swapContext.attachment;
+        attachment.format = surfaceContext.surfaceFormat.format;
+        VkImageCreateInfo imageInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .extent = { width, height, 1 },
+            .format = attachment.format,
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+        };
+        VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &attachment.image);
+        ASSERT_POSTCONDITION(!error, "Unable to create headless image.");
+
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements(context.device, attachment.image, &memReqs);
+        VkMemoryAllocateInfo allocInfo {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = memReqs.size,
+            .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        };
+        error = vkAllocateMemory(context.device, &allocInfo, VKALLOC, &attachment.memory);
+        ASSERT_POSTCONDITION(!error, "Unable to allocate headless image memory.");
+        error = vkBindImageMemory(context.device, attachment.image, attachment.memory, 0);
+        ASSERT_POSTCONDITION(!error, "Unable to bind headless image memory.");
+
+        VkImageViewCreateInfo viewInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = attachment.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = attachment.format,
+            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .subresourceRange.levelCount = 1,
+            .subresourceRange.layerCount = 1,
+        };
+        error = vkCreateImageView(context.device, &viewInfo, VKALLOC, &attachment.view);
+        ASSERT_POSTCONDITION(!error, "Unable to create headless image view.");
+    }
+    utils::slog.i
+            << "Headless swap chain"
+            << ": " << width << "x" << height
+            << ", " << surfaceContext.surfaceFormat.format
+            << ", " << surfaceContext.swapContexts.size()
+            << utils::io::endl;
+
+    surfaceContext.currentSwapIndex = 0;
+    surfaceContext.imageAvailable = VK_NULL_HANDLE;
+    surfaceContext.renderingFinished = VK_NULL_HANDLE;
+    surfaceContext.depth = {};
+}
+
 void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& surfaceContext,
         VkFormat depthFormat) {
     assert(context.cmdbuffer);
@@ -466,15 +616,26 @@ void createCommandBuffersAndFences(VulkanContext& context, VulkanSurfaceContext&
 void destroySurfaceContext(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
     for (SwapContext& swapContext : surfaceContext.swapContexts) {
         vkFreeCommandBuffers(context.device, context.commandPool, 1, &swapContext.cmdbuffer);
+        for (SecondaryCommandBuffers& secondaries : swapContext.secondaries) {
+            // this frees their command buffers
+            vkDestroyCommandPool(context.device, secondaries.pool, VKALLOC);
+            secondaries = {};
+        }
         vkDestroyFence(context.device, swapContext.fence, VKALLOC);
         vkDestroyImageView(context.device, swapContext.attachment.view, VKALLOC);
+        if (surfaceContext.headless) {
+            vkDestroyImage(context.device, swapContext.attachment.image, VKALLOC);
+            vkFreeMemory(context.device, swapContext.attachment.memory, VKALLOC);
+        }
         swapContext.fence = VK_NULL_HANDLE;
         swapContext.attachment.view = VK_NULL_HANDLE;
     }
-    vkDestroySwapchainKHR(context.device, surfaceContext.swapchain, VKALLOC);
-    vkDestroySemaphore(context.device, surfaceContext.imageAvailable, VKALLOC);
-    vkDestroySemaphore(context.device, surfaceContext.renderingFinished, VKALLOC);
-    vkDestroySurfaceKHR(context.instance, surfaceContext.surface, VKALLOC);
+    if (!surfaceContext.headless) {
+        vkDestroySwapchainKHR(context.device, surfaceContext.swapchain, VKALLOC);
+        vkDestroySemaphore(context.device, surfaceContext.imageAvailable, VKALLOC);
+        vkDestroySemaphore(context.device, surfaceContext.renderingFinished, VKALLOC);
+        vkDestroySurfaceKHR(context.instance, surfaceContext.surface, VKALLOC);
+    }
     vkDestroyImageView(context.device, surfaceContext.depth.view, VKALLOC);
     vkDestroyImage(context.device, surfaceContext.depth.image, VKALLOC);
     vkFreeMemory(context.device, surfaceContext.depth.memory, VKALLOC);
@@ -709,24 +870,25 @@ void waitForIdle(VulkanContext& context) {
         return;
     }
 
+    waitForTransfers(context);
+
     // If there's no surface, then there's no command buffer.
     if (!context.currentSurface) {
         return;
     }
 
-    // First, wait for submitted command buffer(s) to finish.
-    VkFence fences[2];
-    uint32_t nfences = 0;
+    // First, wait for submitted command buffer(s) to finish. Headless swap chains can have more
+    // than a couple of them in flight.
+    std::vector<VkFence> fences;
     auto& surfaceContext = *context.currentSurface;
     for (auto& swapContext : surfaceContext.swapContexts) {
-        assert(nfences < 2);
         if (swapContext.submitted && swapContext.fence) {
-            fences[nfences++] = swapContext.fence;
+            fences.push_back(swapContext.fence);
             swapContext.submitted = false;
         }
     }
-    if (nfences > 0) {
-        vkWaitForFences(context.device, nfences, fences, VK_FALSE, ~0ull);
+    if (!fences.empty()) {
+        vkWaitForFences(context.device, uint32_t(fences.size()), fences.data(), VK_TRUE, ~0ull);
     }
 
     // If we don't have any pending work, we're done.
@@ -784,13 +946,20 @@ void waitForIdle(VulkanContext& context) {
 
 void acquireCommandBuffer(VulkanContext& context) {
     // Ask Vulkan for the next image in the swap chain and update the currentSwapIndex.
+    // Headless swap chains simply cycle through their images.
     VulkanSurfaceContext& surface = *context.currentSurface;
-    VkResult result = vkAcquireNextImageKHR(context.device, surface.swapchain,
-            UINT64_MAX, surface.imageAvailable, VK_NULL_HANDLE, &surface.currentSwapIndex);
-    ASSERT_POSTCONDITION(result != VK_ERROR_OUT_OF_DATE_KHR,
-            "Stale / resized swap chain not yet supported.");
-    ASSERT_POSTCONDITION(result == VK_SUBOPTIMAL_KHR || result == VK_SUCCESS,
-            "vkAcquireNextImageKHR error.");
+    VkResult result;
+    if (surface.headless) {
+        surface.currentSwapIndex = uint32_t(
+                (surface.currentSwapIndex + 1) % surface.swapContexts.size());
+    } else {
+        result = vkAcquireNextImageKHR(context.device, surface.swapchain,
+                UINT64_MAX, surface.imageAvailable, VK_NULL_HANDLE, &surface.currentSwapIndex);
+        ASSERT_POSTCONDITION(result != VK_ERROR_OUT_OF_DATE_KHR,
+                "Stale / resized swap chain not yet supported.");
+        ASSERT_POSTCONDITION(result == VK_SUBOPTIMAL_KHR || result == VK_SUCCESS,
+                "vkAcquireNextImageKHR error.");
+    }
     SwapContext& swap = getSwapContext(context);
 
     // Ensure that the previous submission of this command buffer has finished.
@@ -803,6 +972,13 @@ void acquireCommandBuffer(VulkanContext& context) {
     VkCommandBuffer cmdbuffer = swap.cmdbuffer;
     VkResult error = vkResetCommandBuffer(cmdbuffer, 0);
     ASSERT_POSTCONDITION(not error, "vkResetCommandBuffer error.");
+    for (SecondaryCommandBuffers& secondaries : swap.secondaries) {
+        if (secondaries.used) {
+            error = vkResetCommandPool(context.device, secondaries.pool, 0);
+            ASSERT_POSTCONDITION(not error, "vkResetCommandPool error.");
+            secondaries.used = 0;
+        }
+    }
     VkCommandBufferBeginInfo beginInfo {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
@@ -813,29 +989,99 @@ void acquireCommandBuffer(VulkanContext& context) {
     swap.submitted = false;
 }
 
+VkCommandBuffer beginSecondaryCommandBuffer(VulkanContext& context,
+        SecondaryCommandBuffers& secondaries) {
+    VkResult result;
+    if (!secondaries.pool) {
+        VkCommandPoolCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = context.graphicsQueueFamilyIndex,
+        };
+        result = vkCreateCommandPool(context.device, &createInfo, VKALLOC, &secondaries.pool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+    }
+
+    // Command buffers are kept from one frame to the next, only the pool is reset.
+    if (secondaries.used == secondaries.cmdbuffers.size()) {
+        VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = secondaries.pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1,
+        };
+        VkCommandBuffer cmdbuffer;
+        result = vkAllocateCommandBuffers(context.device, &allocateInfo, &cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
+        secondaries.cmdbuffers.push_back(cmdbuffer);
+    }
+    VkCommandBuffer cmdbuffer = secondaries.cmdbuffers[secondaries.used++];
+
+    // Secondary command buffers continue the current render pass.
+    VkCommandBufferInheritanceInfo inheritanceInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = context.currentRenderPass.renderPass,
+        .subpass = 0,
+        .framebuffer = context.currentRenderPass.framebuffer,
+    };
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritanceInfo,
+    };
+    result = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkBeginCommandBuffer error.");
+    return cmdbuffer;
+}
+
 void releaseCommandBuffer(VulkanContext& context) {
     // Finalize the command buffer and set the cmdbuffer pointer to null.
     VkResult result = vkEndCommandBuffer(context.cmdbuffer);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
     context.cmdbuffer = nullptr;
 
-    // Submit the command buffer.
-    VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    // Submit the command buffer. Besides the swap chain image, it waits for the uploads submitted
+    // to the transfer queue since the previous frame, before the first use of their resources.
     VulkanSurfaceContext& surfaceContext = *context.currentSurface;
     SwapContext& swapContext = getSwapContext(context);
+    // Headless swap chains are never presented, there is no image to wait for nor to signal.
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitDestStageMasks;
+    if (!surfaceContext.headless) {
+        waitSemaphores.push_back(surfaceContext.imageAvailable);
+        waitDestStageMasks.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+    for (VkSemaphore semaphore : context.transferSemaphores) {
+        waitSemaphores.push_back(semaphore);
+        waitDestStageMasks.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT |
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
     VkSubmitInfo submitInfo {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1u,
-        .pWaitSemaphores = &surfaceContext.imageAvailable,
-        .pWaitDstStageMask = &waitDestStageMask,
+        .waitSemaphoreCount = uint32_t(waitSemaphores.size()),
+        .pWaitSemaphores = waitSemaphores.data(),
+        .pWaitDstStageMask = waitDestStageMasks.data(),
         .commandBufferCount = 1,
         .pCommandBuffers = &swapContext.cmdbuffer,
-        .signalSemaphoreCount = 1u,
+        .signalSemaphoreCount = surfaceContext.headless ? 0u : 1u,
         .pSignalSemaphores = &surfaceContext.renderingFinished,
     };
     result = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, swapContext.fence);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
     swapContext.submitted = true;
+
+    // The transfer semaphores can be destroyed once this command buffer has completed.
+    if (!context.transferSemaphores.empty()) {
+        swapContext.pendingWork.emplace_back([device = context.device,
+                semaphores = std::move(context.transferSemaphores)] (VkCommandBuffer) {
+            for (VkSemaphore semaphore : semaphores) {
+                vkDestroySemaphore(device, semaphore, VKALLOC);
+            }
+        });
+        context.transferSemaphores.clear();
+    }
 }
 
 void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkCommandBuffer cmdbuf) {
@@ -861,7 +1107,8 @@ void flushCommandBuffer(VulkanContext& context) {
     VulkanSurfaceContext& surface = *context.currentSurface;
     const SwapContext& sc = surface.swapContexts[surface.currentSwapIndex];
 
-    // Submit the command buffer.
+    // Submit the command buffer, after all the uploads.
+    waitForTransfers(context);
     VkResult error = vkEndCommandBuffer(context.cmdbuffer);
     ASSERT_POSTCONDITION(!error, "vkEndCommandBuffer error.");
     VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
@@ -889,6 +1136,87 @@ void flushCommandBuffer(VulkanContext& context) {
     ASSERT_POSTCONDITION(!error, "vkBeginCommandBuffer error.");
 }
 
+// Records a one-off command buffer with the given function and submits it to the transfer queue,
+// which doesn't wait for the previous frames. The next frame's submission to the graphics queue
+// waits for it. Once it has completed, "done" is called and the command buffer is freed.
+//
+// Since the transfer queue may not support graphics stages, the recorded barriers must not use
+// any, the semaphore the graphics queue waits on already makes the transfer writes visible.
+void submitTransfer(VulkanContext& context, VulkanTask const& record, std::function<void()> done) {
+    VkDevice device = context.device;
+    VkCommandBuffer cmdbuffer;
+    VkFence fence;
+    VkSemaphore semaphore;
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkCommandBufferAllocateInfo allocateInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context.transferCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
+    vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
+    createSemaphore(device, &semaphore);
+    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    record(cmdbuffer);
+    vkEndCommandBuffer(cmdbuffer);
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdbuffer,
+        .signalSemaphoreCount = 1u,
+        .pSignalSemaphores = &semaphore,
+    };
+    VkResult result = vkQueueSubmit(context.transferQueue, 1, &submitInfo, fence);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
+    context.transferSemaphores.push_back(semaphore);
+
+    // The fence is polled rather than waited for, so that a large upload doesn't stall the next
+    // frames. The task re-adds itself until the fence is signaled.
+    struct Completion {
+        VulkanContext& context;
+        VkCommandBuffer cmdbuffer;
+        VkFence fence;
+        std::function<void()> done;
+        void operator()(VkCommandBuffer) const {
+            if (vkGetFenceStatus(context.device, fence) == VK_NOT_READY) {
+                context.pendingWork.emplace_back(*this);
+                return;
+            }
+            vkFreeCommandBuffers(context.device, context.transferCommandPool, 1, &cmdbuffer);
+            vkDestroyFence(context.device, fence, VKALLOC);
+            done();
+        }
+    };
+    context.pendingWork.emplace_back(Completion { context, cmdbuffer, fence, std::move(done) });
+}
+
+// Waits for all the uploads submitted to the transfer queue, after which the graphics queue no
+// longer needs to wait for them.
+void waitForTransfers(VulkanContext& context) {
+    if (context.transferSemaphores.empty()) {
+        return;
+    }
+    vkQueueWaitIdle(context.transferQueue);
+    for (VkSemaphore semaphore : context.transferSemaphores) {
+        vkDestroySemaphore(context.device, semaphore, VKALLOC);
+    }
+    context.transferSemaphores.clear();
+}
+
+// Buffers and images uploaded with submitTransfer() are shared by the transfer and graphics queue
+// families, which saves the ownership transfers. Returns the number of families, to be used with
+// VK_SHARING_MODE_CONCURRENT if there are two of them.
+uint32_t getUploadQueueFamilies(VulkanContext const& context, uint32_t families[2]) {
+    families[0] = context.graphicsQueueFamilyIndex;
+    families[1] = context.transferQueueFamilyIndex;
+    return families[0] == families[1] ? 1 : 2;
+}
+
 VkFormat findSupportedFormat(VulkanContext& context, const std::vector<VkFormat>& candidates,
         VkImageTiling tiling, VkFormatFeatureFlags features) {
     for (VkFormat format : candidates) {
@@ -37,6 +37,10 @@ namespace driver {
 // passing in a null pointer, and we highlight the argument by using the VKALLOC constant.
 static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 
+// Number of images of a headless swap chain, i.e. how many frames rendered into it can be in
+// flight at once, unless its flags say otherwise.
+static constexpr uint32_t HEADLESS_IMAGE_COUNT = 4;
+
 using VulkanTask = std::function<void(VkCommandBuffer)>;
 using VulkanTaskQueue = std::vector<VulkanTask>;
 
@@ -54,6 +58,12 @@ struct VulkanContext {
     VkCommandPool commandPool;
     uint32_t graphicsQueueFamilyIndex;
     VkQueue graphicsQueue;
+    // Uploads are submitted to a dedicated transfer queue when the device has one, otherwise these
+    // are the graphics queue family and queue. See submitTransfer().
+    uint32_t transferQueueFamilyIndex;
+    VkQueue transferQueue;
+    VkCommandPool transferCommandPool;
+    std::vector<VkSemaphore> transferSemaphores;
     bool debugMarkersSupported;
     VulkanTaskQueue pendingWork;
     VulkanBinder::RasterState rasterState;
@@ -61,6 +71,8 @@ struct VulkanContext {
     VulkanSurfaceContext* currentSurface;
     VkRenderPassBeginInfo currentRenderPass;
     VkViewport viewport;
+    VkRect2D scissor; // as given to vkCmdSetScissor, i.e. in the platform's coordinates
+    float polygonOffset[2]; // slope and constant factors of the depth bias of the shadow maps
     VkFormat depthFormat;
     VmaAllocator allocator;
 };
@@ -72,6 +84,18 @@ struct VulkanAttachment {
     VkDeviceMemory memory;
 };
 
+// Number of threads that can record secondary command buffers at once: the driver thread and
+// one per segment of the command stream executed in parallel (see SegmentsCommand).
+static constexpr uint32_t MAX_RECORDING_THREADS = 9;
+
+// Secondary command buffers recorded by a single thread in a frame. They come from a pool of
+// their own, since a pool can't be used by several threads at once, which is reset at each frame.
+struct SecondaryCommandBuffers {
+    VkCommandPool pool;
+    std::vector<VkCommandBuffer> cmdbuffers;
+    size_t used;
+};
+
 // The SwapContext is the set of objects that gets "swapped" at each beginFrame().
 // Typically there are only 2 or 3 instances of the SwapContext per SwapChain.
 struct SwapContext {
@@ -80,11 +104,15 @@ struct SwapContext {
     VkFence fence;
     VulkanTaskQueue pendingWork;
     bool submitted;
+    SecondaryCommandBuffers secondaries[MAX_RECORDING_THREADS];
 };
 
 // The SurfaceContext stores various state (including the swap chain) that we tightly associate
 // with VkSurfaceKHR, which is basically one-to-one with a platform-specific window.
+// Headless surface contexts have no VkSurfaceKHR nor VkSwapchainKHR, their images are owned by
+// the driver and are never presented.
 struct VulkanSurfaceContext {
+    bool headless;
     VkSurfaceKHR surface;
     VkSwapchainKHR swapchain;
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
@@ -104,7 +132,9 @@ void createVirtualDevice(VulkanContext& context);
 void createSemaphore(VkDevice device, VkSemaphore* semaphore);
 void getPresentationQueue(VulkanContext& context, VulkanSurfaceContext& sc);
 void getSurfaceCaps(VulkanContext& context, VulkanSurfaceContext& sc);
-void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& sc);
+void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& sc, uint64_t flags);
+void createHeadlessImages(VulkanContext& context, VulkanSurfaceContext& sc, uint32_t width,
+        uint32_t height, uint64_t flags);
 void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
 void transitionDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
 void createCommandBuffersAndFences(VulkanContext& context, VulkanSurfaceContext& sc);
@@ -121,8 +151,13 @@ VkBlendFactor getBlendFactor(BlendFunction mode);
 void waitForIdle(VulkanContext& context);
 void acquireCommandBuffer(VulkanContext& context);
 void releaseCommandBuffer(VulkanContext& context);
+VkCommandBuffer beginSecondaryCommandBuffer(VulkanContext& context,
+        SecondaryCommandBuffers& secondaries);
 void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkCommandBuffer cmdbuf);
 void flushCommandBuffer(VulkanContext& context);
+void submitTransfer(VulkanContext& context, VulkanTask const& record, std::function<void()> done);
+void waitForTransfers(VulkanContext& context);
+uint32_t getUploadQueueFamilies(VulkanContext const& context, uint32_t families[2]);
 VkFormat findSupportedFormat(VulkanContext& context, const std::vector<VkFormat>& candidates,
         VkImageTiling tiling, VkFormatFeatureFlags features);
 
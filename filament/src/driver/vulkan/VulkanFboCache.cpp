@@ -18,6 +18,8 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace driver {
 
@@ -27,7 +29,8 @@ bool VulkanFboCache::RenderPassEq::operator()(const RenderPassKey& k1,
             k1.finalLayout == k2.finalLayout &&
             k1.colorFormat == k2.colorFormat &&
             k1.depthFormat == k2.depthFormat &&
-            k1.flags.value == k2.flags.value;
+            k1.flags.value == k2.flags.value &&
+            k1.samples == k2.samples;
 }
 
 bool VulkanFboCache::FboKeyEqualFn::operator()(const FboKey& k1, const FboKey& k2) const {
@@ -84,6 +87,8 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     const bool hasColor = config.colorFormat != VK_FORMAT_UNDEFINED;
     const bool hasDepth = config.depthFormat != VK_FORMAT_UNDEFINED;
     const bool depthOnly = hasDepth && !hasColor;
+    const auto samples = (VkSampleCountFlagBits) std::max(config.samples, 1u);
+    const bool hasResolve = hasColor && samples != VK_SAMPLE_COUNT_1_BIT;
 
     // The subpass specifies the layout to transition to at the START of the render pass.
     uint32_t numAttachments = 0;
@@ -97,35 +102,53 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
       depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
       depthAttachmentRef.attachment = numAttachments++;
     }
+    VkAttachmentReference resolveAttachmentRef = {};
+    if (hasResolve) {
+      resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+      resolveAttachmentRef.attachment = numAttachments++;
+    }
     VkSubpassDescription subpass {
         .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
         .colorAttachmentCount = hasColor ? 1u : 0u,
         .pColorAttachments = hasColor ? &colorAttachmentRef : nullptr,
+        .pResolveAttachments = hasResolve ? &resolveAttachmentRef : nullptr,
         .pDepthStencilAttachment = hasDepth ? &depthAttachmentRef : nullptr
     };
 
   // The attachment description specifies the layout to transition to at the END of the render pass.
+    // The multisampled attachments only live within the render pass, only the resolved color is
+    // written back to memory.
     VkAttachmentDescription colorAttachment {
         .format = config.colorFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .samples = samples,
         .loadOp = (config.flags.clear & TargetBufferFlags::COLOR) ?
                 VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .storeOp = hasResolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .finalLayout = config.finalLayout
+        .finalLayout = hasResolve ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : config.finalLayout
     };
     VkAttachmentDescription depthAttachment {
         .format = config.depthFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .samples = samples,
         .loadOp = (config.flags.clear & TargetBufferFlags::DEPTH) ?
                 VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .storeOp = samples != VK_SAMPLE_COUNT_1_BIT ?
+                VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .finalLayout = depthOnly ? config.finalLayout :
                 VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
     };
+    VkAttachmentDescription resolveAttachment {
+        .format = config.colorFormat,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .finalLayout = config.finalLayout
+    };
 
     // We define dependencies only when the framebuffer local hint is applied.
     // NOTE: It's likely that VK_DEPENDENCY_BY_REGION_BIT and VK_ACCESS_COLOR_ATTACHMENT_READ do
@@ -150,7 +173,7 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     }};
 
     // Finally, create the VkRenderPass.
-    VkAttachmentDescription attachments[2];
+    VkAttachmentDescription attachments[3];
     VkRenderPassCreateInfo renderPassInfo {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         .attachmentCount = 0u,
@@ -166,6 +189,9 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     if (hasDepth) {
         attachments[renderPassInfo.attachmentCount++] = depthAttachment;
     }
+    if (hasResolve) {
+        attachments[renderPassInfo.attachmentCount++] = resolveAttachment;
+    }
     VkRenderPass renderPass;
     VkResult error = vkCreateRenderPass(mContext.device, &renderPassInfo, VKALLOC, &renderPass);
     ASSERT_POSTCONDITION(!error, "Unable to create render pass.");
@@ -185,11 +211,36 @@ void VulkanFboCache::reset() noexcept {
     mRenderPassCache.clear();
 }
 
+void VulkanFboCache::trim() noexcept {
+    for (auto pair : mFramebufferCache) {
+        if (pair.second.handle != VK_NULL_HANDLE) {
+            mRenderPassRefCount[pair.first.renderPass]--;
+            vkDestroyFramebuffer(mContext.device, pair.second.handle, VKALLOC);
+        }
+    }
+    mFramebufferCache.clear();
+    for (auto iter = mRenderPassCache.begin(); iter != mRenderPassCache.end();) {
+        VkRenderPass handle = iter->second.handle;
+        if (handle == VK_NULL_HANDLE || mRenderPassRefCount[handle] == 0) {
+            if (handle != VK_NULL_HANDLE) {
+                mRenderPassRefCount.erase(handle);
+                vkDestroyRenderPass(mContext.device, handle, VKALLOC);
+            }
+            iter = mRenderPassCache.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
 // Frees up old framebuffers and render passes, then nulls out their key.  Doesn't bother removing
 // the actual map entry since it is fairly small.
 void VulkanFboCache::gc() noexcept {
     mCurrentTime++;
-    const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
+    if (mCurrentTime <= mTimeBeforeEviction) {
+        return;
+    }
+    const uint32_t evictTime = mCurrentTime - mTimeBeforeEviction;
     for (auto iter = mFramebufferCache.begin(); iter != mFramebufferCache.end(); ++iter) {
         if (iter->second.timestamp < evictTime) {
             vkDestroyFramebuffer(mContext.device, iter->second.handle, VKALLOC);
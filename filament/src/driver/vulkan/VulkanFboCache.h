@@ -23,6 +23,8 @@
 
 #include <tsl/robin_map.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace driver {
 
@@ -50,21 +52,24 @@ public:
             };
             uint32_t value; // 4 bytes
         } flags;
+        uint32_t samples; // 4 bytes, the color attachment is resolved at the end if > 1
+        uint32_t padding; // 4 bytes, must be zero
     };
     struct RenderPassVal {
         VkRenderPass handle;
         uint32_t timestamp;
     };
     static_assert(sizeof(VkFormat) == 4, "VkFormat has unexpected size.");
-    static_assert(sizeof(RenderPassKey) == 16, "RenderPassKey has unexpected size.");
+    static_assert(sizeof(RenderPassKey) == 24, "RenderPassKey has unexpected size.");
     using RenderPassHash = utils::hash::MurmurHashFn<RenderPassKey>;
     struct RenderPassEq {
         bool operator()(const RenderPassKey& k1, const RenderPassKey& k2) const;
     };
 
     // FboKey is a small POD representing the immutable state that we wish to configure
-    // in VkFramebuffer. It is hashed and used as a lookup key. There are 1-3 attachments, but
-    // rather than storing a count, we simply zero out the unused slots. We do not bother storing
+    // in VkFramebuffer. It is hashed and used as a lookup key. There are 1-3 attachments (color,
+    // depth, then the resolve target of multisampled color), but rather than storing a count, we
+    // simply zero out the unused slots at the end. We do not bother storing
     // width and height in the key since they are immutable aspects of the image views.
     struct alignas(8) FboKey {
         VkRenderPass renderPass; // 8 bytes
@@ -95,6 +100,16 @@ public:
     // Evicts old unused Vulkan objects. Call this once per frame.
     void gc() noexcept;
 
+    // Keeps the unused objects for at least this many frames, i.e. the number of frames that can
+    // be in flight. This can only grow.
+    void setFramesInFlight(uint32_t count) noexcept {
+        mTimeBeforeEviction = std::max(mTimeBeforeEviction, count);
+    }
+
+    // Evicts all the framebuffers, and the render passes they don't use, regardless of their age.
+    // Call this between frames, once the GPU is idle.
+    void trim() noexcept;
+
     // Frees all Vulkan objects. Call this during shutdown before the device is destroyed.
     void reset() noexcept;
 
@@ -104,7 +119,7 @@ private:
     tsl::robin_map<RenderPassKey, RenderPassVal, RenderPassHash, RenderPassEq> mRenderPassCache;
     tsl::robin_map<VkRenderPass, uint32_t> mRenderPassRefCount;
     uint32_t mCurrentTime = 0;
-    static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    uint32_t mTimeBeforeEviction = 2;
 };
 
 } // namespace filament
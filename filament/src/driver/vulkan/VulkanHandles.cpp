@@ -20,6 +20,8 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 #define FILAMENT_VULKAN_VERBOSE 0
 
 namespace filament {
@@ -44,16 +46,33 @@ static void clampToFramebuffer(VkRect2D* rect, uint32_t fbWidth, uint32_t fbHeig
     rect->extent.height = top - y;
 }
 
+// Transient attachments are never stored, so on tiled GPUs lazily allocated memory is never
+// actually committed.
+static uint32_t selectTransientMemoryType(VulkanContext& context, uint32_t flags) {
+    const VkFlags lazy = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+            VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
+        if ((flags & (1u << i)) &&
+                (context.memoryProperties.memoryTypes[i].propertyFlags & lazy) == lazy) {
+            return i;
+        }
+    }
+    return selectMemoryType(context, flags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
 VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noexcept :
         HwProgram(builder.getName()), context(context) {
     auto const& blobs = builder.getShadersSource();
+    // compute shaders are not supported, see VulkanDriver::isComputeSupported()
     VkShaderModule* modules[2] = { &bundle.vertex, &bundle.fragment };
-    bool missing = false;
-    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+    // the constant_id of a variant's specialization constant is the index of its bit
+    bundle.specialization = filament::Variant::filterVariantSpecialization(builder.getVariant());
+    // the depth-only programs have no fragment shader, see FMaterial::getProgramSlow()
+    const bool missing = blobs[0].empty();
+    for (size_t i = 0; i < 2; i++) {
         const auto& blob = blobs[i];
         VkShaderModule* module = modules[i];
         if (blob.empty()) {
-            missing = true;
             continue;
         }
         VkShaderModuleCreateInfo moduleInfo = {};
@@ -93,6 +112,27 @@ VulkanProgram::~VulkanProgram() {
     vkDestroyShaderModule(context.device, bundle.fragment, VKALLOC);
 }
 
+VulkanTimerQuery::VulkanTimerQuery(VulkanContext& context) : mContext(context) {
+    if (!context.physicalDeviceProperties.limits.timestampComputeAndGraphics) {
+        return;
+    }
+    VkQueryPoolCreateInfo info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2
+    };
+    VkResult result = vkCreateQueryPool(context.device, &info, VKALLOC, &pool);
+    if (result != VK_SUCCESS) {
+        pool = VK_NULL_HANDLE;
+    }
+}
+
+VulkanTimerQuery::~VulkanTimerQuery() {
+    if (pool) {
+        vkDestroyQueryPool(mContext.device, pool, VKALLOC);
+    }
+}
+
 VulkanRenderTarget::~VulkanRenderTarget() {
     if (!mSharedColorImage) {
         vkDestroyImageView(mContext.device, mColor.view, VKALLOC);
@@ -104,6 +144,11 @@ VulkanRenderTarget::~VulkanRenderTarget() {
         vkDestroyImage(mContext.device, mDepth.image, VKALLOC);
         vkFreeMemory(mContext.device, mDepth.memory, VKALLOC);
     }
+    if (mMsaaColor.image) {
+        vkDestroyImageView(mContext.device, mMsaaColor.view, VKALLOC);
+        vkDestroyImage(mContext.device, mMsaaColor.image, VKALLOC);
+        vkFreeMemory(mContext.device, mMsaaColor.memory, VKALLOC);
+    }
 }
 
 void VulkanRenderTarget::transformClientRectToPlatform(VkRect2D* bounds) const {
@@ -231,10 +276,12 @@ void VulkanRenderTarget::createColorImage(VkFormat format) {
     ASSERT_POSTCONDITION(!error, "Unable to create color attachment view.");
 }
 
-void VulkanRenderTarget::createDepthImage(VkFormat format) {
+void VulkanRenderTarget::createDepthImage(VkFormat format, uint8_t samples) {
     assert(mOffscreen);
     this->mDepth.format = format;
     mSharedDepthImage = false;
+    mSamples = samples;
+    const bool transient = samples > 1;
     // Create an appropriately-sized device-only VkImage for the depth attachment.
     // TODO: for depth, can we re-use the image associated with the swap chain?
     VkImageCreateInfo depthImageInfo {
@@ -244,8 +291,9 @@ void VulkanRenderTarget::createDepthImage(VkFormat format) {
         .format = mDepth.format,
         .mipLevels = 1,
         .arrayLayers = 1,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                (transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0u),
+        .samples = (VkSampleCountFlagBits) samples,
     };
     VkResult error = vkCreateImage(mContext.device, &depthImageInfo, VKALLOC, &mDepth.image);
     ASSERT_POSTCONDITION(!error, "Unable to create depth attachment.");
@@ -256,8 +304,10 @@ void VulkanRenderTarget::createDepthImage(VkFormat format) {
     VkMemoryAllocateInfo depthAllocInfo {
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        .memoryTypeIndex = transient ?
+                selectTransientMemoryType(mContext, memReqs.memoryTypeBits) :
+                selectMemoryType(mContext, memReqs.memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
     };
     error = vkAllocateMemory(mContext.device, &depthAllocInfo, nullptr, &mDepth.memory);
     ASSERT_POSTCONDITION(!error, "Unable to allocate depth memory.");
@@ -294,6 +344,51 @@ void VulkanRenderTarget::createDepthImage(VkFormat format) {
     ASSERT_POSTCONDITION(!error, "Unable to create depth attachment view.");
 }
 
+void VulkanRenderTarget::createMsaaColorImage(uint8_t samples) {
+    assert(mOffscreen);
+    assert(samples > 1);
+    mMsaaColor.format = mColor.format;
+    mSamples = samples;
+    VkImageCreateInfo imageInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .extent = { width, height, 1 },
+        .format = mMsaaColor.format,
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+        .samples = (VkSampleCountFlagBits) samples,
+    };
+    VkResult error = vkCreateImage(mContext.device, &imageInfo, VKALLOC, &mMsaaColor.image);
+    ASSERT_POSTCONDITION(!error, "Unable to create multisampled color attachment.");
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(mContext.device, mMsaaColor.image, &memReqs);
+    VkMemoryAllocateInfo allocInfo {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memReqs.size,
+        .memoryTypeIndex = selectTransientMemoryType(mContext, memReqs.memoryTypeBits)
+    };
+    error = vkAllocateMemory(mContext.device, &allocInfo, VKALLOC, &mMsaaColor.memory);
+    ASSERT_POSTCONDITION(!error, "Unable to allocate multisampled color memory.");
+    error = vkBindImageMemory(mContext.device, mMsaaColor.image, mMsaaColor.memory, 0);
+    ASSERT_POSTCONDITION(!error, "Unable to bind multisampled color memory.");
+
+    // No layout transition is needed, the render passes start from an undefined layout since the
+    // contents of this image never outlive a render pass.
+    VkImageViewCreateInfo viewInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = mMsaaColor.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = mMsaaColor.format,
+        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .subresourceRange.levelCount = 1,
+        .subresourceRange.layerCount = 1,
+    };
+    error = vkCreateImageView(mContext.device, &viewInfo, VKALLOC, &mMsaaColor.view);
+    ASSERT_POSTCONDITION(!error, "Unable to create multisampled color attachment view.");
+}
+
 void VulkanRenderTarget::setColorImage(VulkanAttachment c) {
     assert(mOffscreen);
     mColor = c;
@@ -336,14 +431,13 @@ VulkanUniformBuffer::VulkanUniformBuffer(VulkanContext& context, VulkanStagePool
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mGpuBuffer, &mGpuMemory, 0);
 }
 
-void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
+void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset,
+        uint32_t numBytes) {
+    assert(byteOffset + numBytes <= ub.getSize());
     VkDevice device = mContext.device;
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
+    memcpy(stage->mapped, cpuData, numBytes);
+    vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numBytes);
 
     // Create and submit a one-off command buffer to allow uploading outside a frame.
     VkCommandBuffer cmdbuffer;
@@ -356,7 +450,11 @@ void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
         .commandBufferCount = 1
     };
     VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VkBufferCopy region { .size = numBytes };
+    VkBufferCopy region {
+        .srcOffset = stage->offset,
+        .dstOffset = byteOffset,
+        .size = numBytes
+    };
     vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
     vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
     vkBeginCommandBuffer(cmdbuffer, &beginInfo);
@@ -370,7 +468,8 @@ void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
         .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
         .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
         .buffer = mGpuBuffer,
-        .size = VK_WHOLE_SIZE
+        .offset = byteOffset,
+        .size = numBytes
     };
     vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
@@ -423,6 +522,14 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
         imageInfo.arrayLayers = 6;
         imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
     }
+    if (target == SamplerType::SAMPLER_2D_ARRAY) {
+        imageInfo.arrayLayers = depth;
+        imageInfo.extent.depth = 1;
+    } else if (target == SamplerType::SAMPLER_3D) {
+        imageInfo.imageType = VK_IMAGE_TYPE_3D;
+    } else {
+        imageInfo.extent.depth = 1;
+    }
     if (usage == TextureUsage::COLOR_ATTACHMENT) {
         imageInfo.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     } else if (usage == TextureUsage::DEPTH_ATTACHMENT) {
@@ -430,6 +537,13 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     } else {
         imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     }
+    uint32_t queueFamilies[2];
+    if (imageInfo.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT &&
+            getUploadQueueFamilies(context, queueFamilies) > 1) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = 2;
+        imageInfo.pQueueFamilyIndices = queueFamilies;
+    }
     VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &textureImage);
     if (error) {
         utils::slog.d << "vkCreateImage: "
@@ -440,47 +554,64 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     }
     ASSERT_POSTCONDITION(!error, "Unable to create image.");
 
-    // Allocate memory for the VkImage and bind it.
-    VkMemoryRequirements memReqs = {};
-    vkGetImageMemoryRequirements(context.device, textureImage, &memReqs);
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    // Allocate memory for the VkImage and bind it. The allocator sub-allocates it from large
+    // blocks, which keeps the number of VkDeviceMemory objects low when streaming many textures.
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
-    error = vkAllocateMemory(context.device, &allocInfo, nullptr, &textureImageMemory);
+    error = vmaAllocateMemoryForImage(context.allocator, textureImage, &allocInfo,
+            &textureImageMemory, nullptr);
     ASSERT_POSTCONDITION(!error, "Unable to allocate image memory.");
-    error = vkBindImageMemory(context.device, textureImage, textureImageMemory, 0);
+    error = vmaBindImageMemory(context.allocator, textureImageMemory, textureImage);
     ASSERT_POSTCONDITION(!error, "Unable to bind image.");
 
     // Create a VkImageView so that shaders can sample from the image.
+    if (usage == TextureUsage::DEPTH_ATTACHMENT) {
+        mAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+    imageView = createImageView(0, levels);
+}
+
+VkImageView VulkanTexture::createImageView(uint32_t baseLevel, uint32_t levelCount) const {
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = textureImage;
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
     viewInfo.format = format;
-    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = levels;
+    viewInfo.subresourceRange.aspectMask = mAspect;
+    viewInfo.subresourceRange.baseMipLevel = baseLevel;
+    viewInfo.subresourceRange.levelCount = levelCount;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
         viewInfo.subresourceRange.layerCount = 6;
     }
-    if (usage == TextureUsage::DEPTH_ATTACHMENT) {
-        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (target == SamplerType::SAMPLER_2D_ARRAY) {
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.subresourceRange.layerCount = depth;
     }
-    error = vkCreateImageView(context.device, &viewInfo, VKALLOC, &imageView);
+    if (target == SamplerType::SAMPLER_3D) {
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_3D;
+    }
+    VkImageView view;
+    VkResult error = vkCreateImageView(mContext.device, &viewInfo, VKALLOC, &view);
     ASSERT_POSTCONDITION(!error, "Unable to create image view.");
+    return view;
+}
+
+VkImageView VulkanTexture::setMinMaxLevels(uint32_t minLevel, uint32_t maxLevel) {
+    assert(minLevel <= maxLevel && maxLevel < levels);
+    VkImageView previous = imageView;
+    imageView = createImageView(minLevel, maxLevel - minLevel + 1);
+    return previous;
 }
 
 VulkanTexture::~VulkanTexture() {
     assert(!hasPendingWork(mContext) && "Texture destroyed while work is pending.");
     vkDestroyImage(mContext.device, textureImage, VKALLOC);
     vkDestroyImageView(mContext.device, imageView, VKALLOC);
-    vkFreeMemory(mContext.device, textureImageMemory, VKALLOC);
+    vmaFreeMemory(mContext.allocator, textureImageMemory);
 }
 
 void VulkanTexture::load2DImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height,
@@ -492,14 +623,27 @@ void VulkanTexture::load2DImage(PixelBufferDescriptor&& data, uint32_t width, ui
     // TODO: Here we should invoke a dumb CPU blitter that can reshape the data (e.g. adding dummy
     // alpha) if format conversion is required. Currently we are not honoring left / top / stride.
 
-    // Create and populate the staging buffer.
-    VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
+    // Create and populate the staging buffer. Copies to images need it to start at offset 0.
+    VulkanStage const* stage = mStagePool.acquireDedicatedStage(numBytes);
+    memcpy(stage->mapped, cpuData, numBytes);
     vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
 
+    // The first upload of a level is submitted to the transfer queue, so that streamed textures
+    // load while rendering.
+    if (markLevelUploaded(miplevel)) {
+        submitTransfer(mContext, [this, stage, width, height, miplevel] (VkCommandBuffer cmd) {
+            transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, true);
+            copyBufferToImage(cmd, stage->buffer, textureImage, width, height, nullptr,
+                    miplevel);
+            transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel, true);
+        }, [this, stage] () {
+            mStagePool.releaseStage(stage);
+        });
+        return;
+    }
+
     // Create a copy-to-device functor because we might need to defer it.
     auto copyToDevice = [this, stage, width, height, miplevel] (VkCommandBuffer cmd) {
         transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
@@ -525,14 +669,25 @@ void VulkanTexture::loadCubeImage(PixelBufferDescriptor&& data,  const FaceOffse
     const void* cpuData = data.buffer;
     const uint32_t numBytes = data.size;
     assert(this->target == SamplerType::SAMPLER_CUBEMAP);
-    // Create and populate the staging buffer.
-    VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
+    // Create and populate the staging buffer. Copies to images need it to start at offset 0.
+    VulkanStage const* stage = mStagePool.acquireDedicatedStage(numBytes);
+    memcpy(stage->mapped, cpuData, numBytes);
     vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
 
+    if (markLevelUploaded(miplevel)) {
+        submitTransfer(mContext, [this, faceOffsets, stage, miplevel] (VkCommandBuffer cmd) {
+            transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, true);
+            copyBufferToImage(cmd, stage->buffer, textureImage, width, height, &faceOffsets,
+                    miplevel);
+            transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel, true);
+        }, [this, stage] () {
+            mStagePool.releaseStage(stage);
+        });
+        return;
+    }
+
     // Create a copy-to-device functor because we might need to defer it.
     auto copyToDevice = [this, faceOffsets, stage, miplevel] (VkCommandBuffer cmd) {
         transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
@@ -553,8 +708,25 @@ void VulkanTexture::loadCubeImage(PixelBufferDescriptor&& data,  const FaceOffse
     }
 }
 
+uint32_t VulkanTexture::getLayerCount() const noexcept {
+    switch (target) {
+        case SamplerType::SAMPLER_CUBEMAP:  return 6;
+        case SamplerType::SAMPLER_2D_ARRAY: return depth;
+        default:                            return 1;
+    }
+}
+
+// Returns true if the level had never been uploaded. Later updates of a level are recorded in the
+// graphics command buffer, to remain ordered with the frames in flight that sample its content.
+bool VulkanTexture::markLevelUploaded(int miplevel) {
+    const uint32_t bit = 1u << miplevel;
+    const bool first = !(mUploadedLevels & bit);
+    mUploadedLevels |= bit;
+    return first;
+}
+
 void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
-        VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel) {
+        VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel, bool transferQueue) {
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -566,7 +738,7 @@ void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
     barrier.subresourceRange.baseMipLevel = miplevel;
     barrier.subresourceRange.levelCount = 1;
     barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = this->target == SamplerType::SAMPLER_CUBEMAP ? 6 : 1;
+    barrier.subresourceRange.layerCount = getLayerCount();
     VkPipelineStageFlags sourceStage;
     VkPipelineStageFlags destinationStage;
     if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
@@ -581,6 +753,12 @@ void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
         sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        // The transfer queue may not have a fragment stage, the semaphore waited for by the
+        // graphics queue orders the sampling after the transition.
+        if (transferQueue) {
+            barrier.dstAccessMask = 0;
+            destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
     } else {
         PANIC_POSTCONDITION("Unsupported layout transition.");
     }
@@ -611,11 +789,11 @@ void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkIm
     VkBufferImageCopy region = {};
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.mipLevel = miplevel;
-    region.imageSubresource.layerCount = 1;
+    region.imageSubresource.layerCount = getLayerCount();
     region.imageExtent = {
         .width = width >> miplevel,
         .height = height >> miplevel,
-        .depth = 1,
+        .depth = target == SamplerType::SAMPLER_3D ? std::max(depth >> miplevel, 1u) : 1,
     };
     vkCmdCopyBufferToImage(cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 }
@@ -31,7 +31,7 @@ struct VulkanProgram : public HwProgram {
     VulkanProgram(VulkanContext& context, const Program& builder) noexcept;
     ~VulkanProgram();
     VulkanContext& context;
-    VulkanBinder::ProgramBundle bundle;
+    VulkanBinder::ProgramBundle bundle = {};
     SamplerBindingMap samplerBindings;
 };
 
@@ -65,22 +65,39 @@ struct VulkanRenderTarget : private HwRenderTarget {
     VulkanAttachment getColor() const;
     VulkanAttachment getDepth() const;
     void createColorImage(VkFormat format);
-    void createDepthImage(VkFormat format);
+    void createDepthImage(VkFormat format, uint8_t samples = 1);
     void setColorImage(VulkanAttachment c);
     void setDepthImage(VulkanAttachment d);
+
+    // Multisampled render targets render into a transient color attachment that is resolved into
+    // the color image at the end of each render pass; their depth attachment is never stored.
+    void createMsaaColorImage(uint8_t samples);
+    VulkanAttachment getMsaaColor() const { return mMsaaColor; }
+    uint8_t getSamples() const { return mSamples; }
 private:
     VulkanAttachment mColor = {};
     VulkanAttachment mDepth = {};
+    VulkanAttachment mMsaaColor = {};
     VulkanContext& mContext;
     bool mOffscreen;
     bool mSharedColorImage = true;
     bool mSharedDepthImage = true;
+    uint8_t mSamples = 1;
 };
 
 struct VulkanSwapChain : public HwSwapChain {
     VulkanSurfaceContext surfaceContext;
 };
 
+struct VulkanTimerQuery : public HwTimerQuery {
+    explicit VulkanTimerQuery(VulkanContext& context);
+    ~VulkanTimerQuery();
+    // Holds the two timestamps written at the beginning and the end of the measurement, null if
+    // the device can't write timestamps from the graphics queue.
+    VkQueryPool pool = VK_NULL_HANDLE;
+    VulkanContext& mContext;
+};
+
 struct VulkanVertexBuffer : public HwVertexBuffer {
     VulkanVertexBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint8_t bufferCount,
             uint8_t attributeCount, uint32_t elementCount,
@@ -98,10 +115,18 @@ struct VulkanIndexBuffer : public HwIndexBuffer {
     const std::unique_ptr<VulkanBuffer> buffer;
 };
 
+struct VulkanBufferObject : public HwBufferObject {
+    VulkanBufferObject(VulkanContext& context, VulkanStagePool& stagePool, uint32_t byteCount) :
+            HwBufferObject(byteCount),
+            buffer(new VulkanBuffer(context, stagePool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            byteCount)) {}
+    const std::unique_ptr<VulkanBuffer> buffer;
+};
+
 struct VulkanUniformBuffer : public HwUniformBuffer {
     VulkanUniformBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint32_t numBytes);
     ~VulkanUniformBuffer();
-    void loadFromCpu(const void* cpuData, uint32_t numBytes);
+    void loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_t numBytes);
     VkBuffer getGpuBuffer() const { return mGpuBuffer; }
 private:
     VulkanContext& mContext;
@@ -119,20 +144,29 @@ struct VulkanTexture : public HwTexture {
             TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
             TextureUsage usage, VulkanStagePool& stagePool);
     ~VulkanTexture();
+    // for SAMPLER_2D_ARRAY textures, uploads all the layers of the level
     void load2DImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height, int miplevel);
     void loadCubeImage(PixelBufferDescriptor&& data, const FaceOffsets& faceOffsets, int miplevel);
+    // replaces imageView with a view of the levels [minLevel, maxLevel], returns the old view
+    VkImageView setMinMaxLevels(uint32_t minLevel, uint32_t maxLevel);
     VkFormat format;
     VkImageView imageView = VK_NULL_HANDLE;
     VkImage textureImage = VK_NULL_HANDLE;
-    VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+    VmaAllocation textureImageMemory = VK_NULL_HANDLE;
 private:
     void transitionImageLayout(VkCommandBuffer cmdbuffer, VkImage image,
-            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel);
+            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel,
+            bool transferQueue = false);
+    bool markLevelUploaded(int miplevel);
+    uint32_t getLayerCount() const noexcept;
+    VkImageView createImageView(uint32_t baseLevel, uint32_t levelCount) const;
     void copyBufferToImage(VkCommandBuffer cmdbuffer, VkBuffer buffer, VkImage image,
             uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel);
     VulkanContext& mContext;
     VulkanStagePool& mStagePool;
     uint32_t mByteCount;
+    uint32_t mUploadedLevels = 0;
+    VkImageAspectFlags mAspect = VK_IMAGE_ASPECT_COLOR_BIT;
 };
 
 struct VulkanRenderPrimitive : public HwRenderPrimitive {
@@ -98,6 +98,8 @@ constexpr inline VkBool32 getCompareEnable(SamplerCompareMode mode) noexcept {
 VulkanSamplerCache::VulkanSamplerCache(VulkanContext& context) : mContext(context) {}
 
 VkSampler VulkanSamplerCache::getSampler(driver::SamplerParams params) noexcept {
+    // segments of the command stream can be recorded concurrently, see VulkanDriver
+    std::lock_guard<std::mutex> lock(mLock);
     auto iter = mCache.find(params.u);
     if (UTILS_LIKELY(iter != mCache.end())) {
         return iter->second;
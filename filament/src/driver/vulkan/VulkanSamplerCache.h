@@ -21,10 +21,12 @@
 
 #include <tsl/robin_map.h>
 
+#include <mutex>
+
 namespace filament {
 namespace driver {
 
-// Simple manager for VkSampler objects.
+// Simple manager for VkSampler objects. getSampler() can be called from several threads at once.
 class VulkanSamplerCache {
 public:
     explicit VulkanSamplerCache(VulkanContext&);
@@ -32,6 +34,7 @@ public:
     void reset() noexcept;
 private:
     VulkanContext& mContext;
+    std::mutex mLock;
     tsl::robin_map<uint32_t, VkSampler> mCache;
 };
 
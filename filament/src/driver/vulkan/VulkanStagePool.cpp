@@ -22,6 +22,39 @@ namespace filament {
 namespace driver {
 
 VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) noexcept {
+    if (numBytes > MAX_BLOCK_STAGE_SIZE) {
+        return acquireDedicatedStage(numBytes);
+    }
+
+    // Sub-allocate the stage from the current block, or from a new one if it doesn't fit.
+    const uint32_t alignment = std::max(uint32_t(1), uint32_t(
+            mContext.physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment));
+    uint32_t offset = 0;
+    if (mCurrentBlock) {
+        offset = (mCurrentBlock->size + alignment - 1) / alignment * alignment;
+    }
+    if (!mCurrentBlock || offset + numBytes > BLOCK_CAPACITY) {
+        closeCurrentBlock();
+        mCurrentBlock = acquireBlock();
+        offset = 0;
+    }
+    VulkanStageBlock* block = mCurrentBlock;
+    block->size = offset + numBytes;
+    block->stageCount++;
+    VulkanStage* stage = new VulkanStage({
+        .memory = block->memory,
+        .buffer = block->buffer,
+        .offset = offset,
+        .capacity = numBytes,
+        .mapped = block->mapped + offset,
+        .lastAccessed = mCurrentFrame,
+        .block = block,
+    });
+    mUsedStages.insert(stage);
+    return stage;
+}
+
+VulkanStage const* VulkanStagePool::acquireDedicatedStage(uint32_t numBytes) noexcept {
     // First check if a stage exists whose capacity is greater than or equal to the requested size.
     auto iter = mFreeStages.lower_bound(numBytes);
     if (iter != mFreeStages.end()) {
@@ -34,20 +67,14 @@ VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) noexcept {
     VulkanStage* stage = new VulkanStage({
         .memory = VK_NULL_HANDLE,
         .buffer = VK_NULL_HANDLE,
-        .lastAccessed = mCurrentFrame,
+        .offset = 0,
         .capacity = numBytes,
+        .mapped = nullptr,
+        .lastAccessed = mCurrentFrame,
+        .block = nullptr,
     });
-    // Create the VkBuffer.
     mUsedStages.insert(stage);
-    VkBufferCreateInfo bufferInfo {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = numBytes,
-        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    };
-    VmaAllocationCreateInfo allocInfo {
-        .usage = VMA_MEMORY_USAGE_CPU_ONLY
-    };
-    vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &stage->buffer, &stage->memory, 0);
+    createBuffer(numBytes, &stage->buffer, &stage->memory, &stage->mapped);
     return stage;
 }
 
@@ -57,31 +84,145 @@ void VulkanStagePool::releaseStage(VulkanStage const* stage) noexcept {
         utils::slog.e << "Unknown stage: " << stage->capacity << " bytes" << utils::io::endl;
         return;
     }
-    stage->lastAccessed = mCurrentFrame;
     mUsedStages.erase(iter);
+
+    // The block of a sub-allocated stage is freed with its last stage, unless stages are still
+    // sub-allocated from it.
+    if (VulkanStageBlock* block = stage->block) {
+        delete stage;
+        if (--block->stageCount == 0 && block != mCurrentBlock) {
+            auto closed = std::find(mClosedBlocks.begin(), mClosedBlocks.end(), block);
+            assert(closed != mClosedBlocks.end());
+            std::swap(*closed, mClosedBlocks.back());
+            mClosedBlocks.pop_back();
+            freeBlock(block);
+        }
+        return;
+    }
+
+    stage->lastAccessed = mCurrentFrame;
     mFreeStages.insert(std::make_pair(stage->capacity, stage));
 }
 
 void VulkanStagePool::gc() noexcept {
     mCurrentFrame++;
+
+    // The next frame sub-allocates its stages from another block.
+    closeCurrentBlock();
+
+    if (mCurrentFrame <= mTimeBeforeEviction) {
+        return;
+    }
     decltype(mFreeStages) stages;
     stages.swap(mFreeStages);
-    const uint64_t evictionTime = mCurrentFrame - TIME_BEFORE_EVICTION;
+    const uint64_t evictionTime = mCurrentFrame - mTimeBeforeEviction;
     for (auto pair : stages) {
         if (pair.second->lastAccessed < evictionTime) {
             vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
+            delete pair.second;
         } else {
             mFreeStages.insert(pair);
         }
     }
+
+    // the blocks are freed in order, the oldest ones are first
+    auto last = std::find_if(mFreeBlocks.begin(), mFreeBlocks.end(),
+            [evictionTime](VulkanStageBlock const* block) {
+                return block->lastAccessed >= evictionTime;
+            });
+    for (auto iter = mFreeBlocks.begin(); iter != last; ++iter) {
+        vmaDestroyBuffer(mContext.allocator, (*iter)->buffer, (*iter)->memory);
+        delete *iter;
+    }
+    mFreeBlocks.erase(mFreeBlocks.begin(), last);
+}
+
+size_t VulkanStagePool::trim() noexcept {
+    size_t size = 0;
+    for (auto pair : mFreeStages) {
+        size += pair.second->capacity;
+        vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
+        delete pair.second;
+    }
+    mFreeStages.clear();
+
+    for (VulkanStageBlock* block : mFreeBlocks) {
+        size += BLOCK_CAPACITY;
+        vmaDestroyBuffer(mContext.allocator, block->buffer, block->memory);
+        delete block;
+    }
+    mFreeBlocks.clear();
+    return size;
 }
 
 void VulkanStagePool::reset() noexcept {
     assert(mUsedStages.empty());
     for (auto pair : mFreeStages) {
         vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
+        delete pair.second;
     }
     mFreeStages.clear();
+
+    closeCurrentBlock();
+    assert(mClosedBlocks.empty());
+    for (VulkanStageBlock* block : mFreeBlocks) {
+        vmaDestroyBuffer(mContext.allocator, block->buffer, block->memory);
+        delete block;
+    }
+    mFreeBlocks.clear();
+}
+
+void VulkanStagePool::createBuffer(uint32_t numBytes, VkBuffer* buffer, VmaAllocation* memory,
+        uint8_t** mapped) noexcept {
+    VkBufferCreateInfo bufferInfo {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = numBytes,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    };
+    uint32_t queueFamilies[2];
+    if (getUploadQueueFamilies(mContext, queueFamilies) > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    VmaAllocationCreateInfo allocInfo {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_CPU_ONLY
+    };
+    VmaAllocationInfo info = {};
+    vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, buffer, memory, &info);
+    *mapped = static_cast<uint8_t*>(info.pMappedData);
+}
+
+VulkanStageBlock* VulkanStagePool::acquireBlock() noexcept {
+    // the most recently freed block is the most likely to still be in the caches
+    if (!mFreeBlocks.empty()) {
+        VulkanStageBlock* block = mFreeBlocks.back();
+        mFreeBlocks.pop_back();
+        return block;
+    }
+    VulkanStageBlock* block = new VulkanStageBlock({});
+    createBuffer(BLOCK_CAPACITY, &block->buffer, &block->memory, &block->mapped);
+    return block;
+}
+
+void VulkanStagePool::closeCurrentBlock() noexcept {
+    VulkanStageBlock* block = mCurrentBlock;
+    if (!block) {
+        return;
+    }
+    mCurrentBlock = nullptr;
+    if (block->stageCount) {
+        mClosedBlocks.push_back(block);
+    } else {
+        freeBlock(block);
+    }
+}
+
+void VulkanStagePool::freeBlock(VulkanStageBlock* block) noexcept {
+    block->size = 0;
+    block->lastAccessed = mCurrentFrame;
+    mFreeBlocks.push_back(block);
 }
 
 } // namespace filament
@@ -19,38 +19,87 @@
 
 #include "VulkanDriverImpl.h"
 
+#include <algorithm>
 #include <map>
 #include <unordered_set>
+#include <vector>
 
 namespace filament {
 namespace driver {
 
-// Immutable POD representing a shared CPU-GPU staging area.
+struct VulkanStageBlock;
+
+// Immutable POD representing a shared CPU-GPU staging area: a range of a persistently mapped
+// buffer, which is either dedicated to the stage or shared by the stages of a block.
 struct VulkanStage {
     VmaAllocation memory;
     VkBuffer buffer;
+    uint32_t offset;            // of the stage in the buffer, 0 for dedicated stages
     uint32_t capacity;
+    uint8_t* mapped;            // CPU address of the stage, i.e. at offset in the buffer
     mutable uint64_t lastAccessed;
+    VulkanStageBlock* block;    // null for dedicated stages
+};
+
+// A large buffer the small stages are sub-allocated from, linearly. Each frame fills a block of
+// its own (or more), which is recycled once all its stages are released, so in practice there is
+// one block per frame in flight.
+struct VulkanStageBlock {
+    VmaAllocation memory;
+    VkBuffer buffer;
+    uint8_t* mapped;
+    uint32_t size;              // bytes sub-allocated so far
+    uint32_t stageCount;        // stages not released yet
+    uint64_t lastAccessed;      // frame at which the block was last freed
 };
 
 // Manages a pool of stages, periodically releasing stages that have been unused for a while.
 class VulkanStagePool {
 public:
+    // Stages up to this size are sub-allocated from blocks, larger ones are dedicated buffers.
+    static constexpr uint32_t BLOCK_CAPACITY = 1024 * 1024;
+    static constexpr uint32_t MAX_BLOCK_STAGE_SIZE = BLOCK_CAPACITY / 4;
+
     explicit VulkanStagePool(VulkanContext& context) noexcept : mContext(context) {}
 
-    // Finds or creates a stage whose capacity is at least the given number of bytes.
+    // Finds or creates a stage whose capacity is at least the given number of bytes. Its offset
+    // is aligned to optimalBufferCopyOffsetAlignment, but not necessarily to a texel.
     VulkanStage const* acquireStage(uint32_t numBytes) noexcept;
 
+    // Same as acquireStage(), but the stage is a whole buffer, i.e. its offset is 0. This is
+    // what copies to images need.
+    VulkanStage const* acquireDedicatedStage(uint32_t numBytes) noexcept;
+
     // Returns the given stage back to the pool.
     void releaseStage(VulkanStage const* stage) noexcept;
 
     // Evicts old unused stages and bumps the current frame number.
     void gc() noexcept;
 
+    // Keeps the unused stages for at least this many frames, i.e. the number of frames that can
+    // be in flight. This can only grow.
+    void setFramesInFlight(uint32_t count) noexcept {
+        mTimeBeforeEviction = std::max(mTimeBeforeEviction, count);
+    }
+
+    // Destroys all unused stages and blocks, regardless of their age. Returns their size in bytes.
+    size_t trim() noexcept;
+
     // Destroys all unused stages and asserts that there are no stages currently in use.
     // This should be called while the context's VkDevice is still alive.
     void reset() noexcept;
 private:
+    // Creates a persistently mapped buffer for staging.
+    void createBuffer(uint32_t numBytes, VkBuffer* buffer, VmaAllocation* memory,
+            uint8_t** mapped) noexcept;
+
+    VulkanStageBlock* acquireBlock() noexcept;
+
+    // No more stages are sub-allocated from the current block.
+    void closeCurrentBlock() noexcept;
+
+    void freeBlock(VulkanStageBlock* block) noexcept;
+
     VulkanContext& mContext;
 
     // Use an ordered multimap for quick (capacity => stage) lookups using lower_bound().
@@ -60,9 +109,15 @@ private:
     // In theory this need not exist, but is useful for validation and ensuring no leaks.
     std::unordered_set<VulkanStage const*> mUsedStages;
 
+    // The block of the current frame, the blocks of the previous frames some stages of which
+    // are still in use, and the blocks ready to be reused.
+    VulkanStageBlock* mCurrentBlock = nullptr;
+    std::vector<VulkanStageBlock*> mClosedBlocks;
+    std::vector<VulkanStageBlock*> mFreeBlocks;
+
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint64_t mCurrentFrame = 0;
-    static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    uint32_t mTimeBeforeEviction = 2;
 };
 
 } // namespace filament
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a command trace recorded with Engine::Config::commandTracePath on a backend alone,
+ * without the engine, and reports the time the driver took to execute the frames.
+ *
+ *  driver_replay [--json] [--iterations=N] [--size=WxH] [--noop] trace
+ *
+ * By default the trace is replayed with the backend it was recorded with, --noop replays it
+ * with the no-op backend instead (to measure the cost of the command stream itself).
+ */
+
+#include "driver/CommandTrace.h"
+
+#include <iostream>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament;
+
+static bool parseUint(char const* arg, char const* name, uint32_t* value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+        *value = uint32_t(strtoul(arg + len + 1, nullptr, 10));
+        return true;
+    }
+    return false;
+}
+
+static bool parseSize(char const* arg, uint32_t* width, uint32_t* height) {
+    if (strncmp(arg, "--size=", 7) == 0) {
+        char* end = nullptr;
+        *width = uint32_t(strtoul(arg + 7, &end, 10));
+        if (*end == 'x') {
+            *height = uint32_t(strtoul(end + 1, nullptr, 10));
+            return *width && *height;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    CommandTraceReplayer::Options options;
+    bool json = false;
+    char const* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        char const* arg = argv[i];
+        if (!strcmp(arg, "--json")) {
+            json = true;
+        } else if (!strcmp(arg, "--noop")) {
+            options.backend = driver::Backend::NOOP;
+        } else if (arg[0] != '-' && !path) {
+            path = arg;
+        } else if (!parseUint(arg, "--iterations", &options.iterations) &&
+                !parseSize(arg, &options.width, &options.height)) {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        std::cerr << "usage: " << argv[0] << " [--json] [--iterations=N] [--size=WxH] [--noop] "
+                  << "trace" << std::endl;
+        return 1;
+    }
+
+    CommandTraceReplayer replayer;
+    if (!replayer.load(path)) {
+        return 1;
+    }
+
+    CommandTraceReplayer::Results results;
+    if (!replayer.replay(options, &results)) {
+        return 1;
+    }
+
+    const double average = results.frames ? results.totalMs / results.frames : 0;
+    if (json) {
+        std::cout << "{ \"frames\": " << results.frames
+                  << ", \"commands\": " << results.commands
+                  << ", \"total_ms\": " << results.totalMs
+                  << ", \"min_frame_ms\": " << results.minFrameMs
+                  << ", \"median_frame_ms\": " << results.medianFrameMs
+                  << ", \"max_frame_ms\": " << results.maxFrameMs
+                  << " }" << std::endl;
+    } else {
+        std::cout << results.frames << " frames, " << results.commands << " commands" << std::endl
+                  << "total:  " << results.totalMs << " ms (" << average << " ms per frame)"
+                  << std::endl
+                  << "frames: min " << results.minFrameMs
+                  << " ms, median " << results.medianFrameMs
+                  << " ms, max " << results.maxFrameMs << " ms" << std::endl;
+    }
+    return 0;
+}
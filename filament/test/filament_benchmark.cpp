@@ -24,8 +24,9 @@
 #include <math/scalar.h>
 
 #include <iostream>
-#include <vector>
 #include <random>
+#include <string>
+#include <vector>
 
 using namespace filament;
 using namespace filament::details;
@@ -127,6 +128,40 @@ int main(void) {
 
     free(visibles);
 
+    // compare the SIMD kernels to the scalar ones on larger sets of boxes and spheres
+    for (size_t count : { 1000u, 10000u, 100000u }) {
+        count = Culler::round(count);
+        std::vector<float3> centers(count);
+        std::vector<float3> extents(count);
+        std::vector<float4> bounds(count);
+        std::vector<Culler::result_type> results(count);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = boxesCenter[i % batch];
+            extents[i] = boxesExtent[i % batch];
+            bounds[i] = spheres[i % batch];
+        }
+
+        std::string suffix = " (" + std::to_string(count) + ")";
+
+        benchmark(p, ("Box Culling Scalar" + suffix).c_str(), [&]() {
+            Culler::Test::intersectsScalar(results.data(), frustum,
+                    centers.data(), extents.data(), count);
+        });
+
+        benchmark(p, ("Box Culling SIMD" + suffix).c_str(), [&]() {
+            Culler::Test::intersects(results.data(), frustum,
+                    centers.data(), extents.data(), count);
+        });
+
+        benchmark(p, ("Sphere Culling Scalar" + suffix).c_str(), [&]() {
+            Culler::Test::intersectsScalar(results.data(), frustum, bounds.data(), count);
+        });
+
+        benchmark(p, ("Sphere Culling SIMD" + suffix).c_str(), [&]() {
+            Culler::Test::intersects(results.data(), frustum, bounds.data(), count);
+        });
+    }
+
 
     benchmark(p, "cos", [&]() {
         for (size_t i = 0; i < batch; i++) {
@@ -169,6 +204,42 @@ int main(void) {
         }
     });
 
+    // the generic matrix products against their SIMD specializations, see math/mat4.h
+    std::vector<mat4f> transforms(batch);
+    std::vector<mat4f> products(batch);
+    std::vector<Box> boxes(batch);
+    for (size_t i = 0; i < batch; i++) {
+        transforms[i] = mat4f::translate(spheres[i].xyz) *
+                mat4f::rotate(spheres[i].w, float3{ 0, 1, 0 });
+        boxes[i] = { boxesCenter[i], boxesExtent[i] };
+    }
+    const mat4f worldOrigin = mat4f::translate(float3{ 1, 2, 3 });
+
+    benchmark(p, "mat4f * mat4f Scalar", [&]() {
+        for (size_t i = 0; i < batch; i++) {
+            products[i] = math::details::matrix::multiply<mat4f>(worldOrigin, transforms[i]);
+        }
+    });
+
+    benchmark(p, "mat4f * mat4f SIMD", [&]() {
+        for (size_t i = 0; i < batch; i++) {
+            products[i] = worldOrigin * transforms[i];
+        }
+    });
+
+    benchmark(p, "rigidTransform Scalar", [&]() {
+        for (size_t i = 0; i < batch; i++) {
+            const mat3f u(transforms[i].upperLeft());
+            boxes[i] = { u * boxesCenter[i] + transforms[i][3].xyz, abs(u) * boxesExtent[i] };
+        }
+    });
+
+    benchmark(p, "rigidTransform SIMD", [&]() {
+        for (size_t i = 0; i < batch; i++) {
+            boxes[i] = rigidTransform(Box{ boxesCenter[i], boxesExtent[i] }, transforms[i]);
+        }
+    });
+
     return 0;
 }
 
@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Renders synthetic scenes with the no-op backend and reports the CPU time spent in each stage
+ * of the frames, see Renderer::getLastCpuFrameTimings(). Cycles and instructions are those of
+ * the calling thread (the culling and command generation jobs are not counted).
+ *
+ *  filament_scene_benchmark [--json] [--frames=N] [--renderables=N --lights=N [--shadows]
+ *          [--skinning]]
+ *
+ * Without --renderables, a fixed set of scenes is benchmarked. With --json, each scene prints
+ * one JSON object per line.
+ */
+
+#include <filament/Box.h>
+#include <filament/Camera.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/LightManager.h>
+#include <filament/Material.h>
+#include <filament/RenderableManager.h>
+#include <filament/Renderer.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+#include <filament/Viewport.h>
+
+#include <utils/Entity.h>
+#include <utils/EntityManager.h>
+#include <utils/Profiler.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament;
+using namespace math;
+using namespace utils;
+
+struct SceneConfig {
+    size_t renderables;
+    size_t lights;
+    bool shadows;
+    bool skinning;
+};
+
+struct Results {
+    size_t frames = 0;
+    double frame = 0;
+    double prepare = 0;
+    double cull = 0;
+    double froxelize = 0;
+    double generate = 0;
+    double sort = 0;
+    double record = 0;
+    Profiler::Counters counters;
+};
+
+static constexpr uint32_t WIDTH = 1920;
+static constexpr uint32_t HEIGHT = 1080;
+static constexpr size_t BONE_COUNT = 4;
+static constexpr size_t WARMUP_FRAMES = 5;
+
+// a unit cube, only the corners are needed by the unlit default material
+static const float3 CUBE_VERTICES[8] = {
+        { -1, -1, -1 }, {  1, -1, -1 }, { -1,  1, -1 }, {  1,  1, -1 },
+        { -1, -1,  1 }, {  1, -1,  1 }, { -1,  1,  1 }, {  1,  1,  1 },
+};
+
+static const uint16_t CUBE_INDICES[36] = {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 1, 4,  1, 5, 4,
+        2, 6, 3,  3, 6, 7,  0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5,
+};
+
+static const uint8_t CUBE_BONE_INDICES[8 * 4] = {
+        0, 1, 2, 3,  0, 1, 2, 3,  0, 1, 2, 3,  0, 1, 2, 3,
+        0, 1, 2, 3,  0, 1, 2, 3,  0, 1, 2, 3,  0, 1, 2, 3,
+};
+
+static const float4 CUBE_BONE_WEIGHTS[8] = {
+        { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 },
+        { 0.5f, 0.5f, 0, 0 }, { 0, 0.5f, 0.5f, 0 }, { 0, 0, 0.5f, 0.5f }, { 0.25f, 0.25f, 0.25f, 0.25f },
+};
+
+static void printResults(SceneConfig const& config, Results const& r, bool json) {
+    const double n = r.frames ? double(r.frames) : 1.0;
+    const double cycles = r.counters.getCpuCycles() / n;
+    const double instructions = r.counters.getInstructions() / n;
+    if (json) {
+        std::cout << "{"
+                << "\"renderables\": " << config.renderables << ", "
+                << "\"lights\": " << config.lights << ", "
+                << "\"shadows\": " << (config.shadows ? "true" : "false") << ", "
+                << "\"skinning\": " << (config.skinning ? "true" : "false") << ", "
+                << "\"frames\": " << r.frames << ", "
+                << "\"frame_ms\": " << r.frame / n << ", "
+                << "\"prepare_ms\": " << r.prepare / n << ", "
+                << "\"cull_ms\": " << r.cull / n << ", "
+                << "\"froxelize_ms\": " << r.froxelize / n << ", "
+                << "\"generate_ms\": " << r.generate / n << ", "
+                << "\"sort_ms\": " << r.sort / n << ", "
+                << "\"record_ms\": " << r.record / n << ", "
+                << "\"cycles\": " << cycles << ", "
+                << "\"instructions\": " << instructions
+                << "}" << std::endl;
+        return;
+    }
+    std::cout << config.renderables << " renderables, " << config.lights << " lights"
+              << (config.shadows ? ", shadows" : "") << (config.skinning ? ", skinning" : "")
+              << ":" << std::endl;
+    std::cout << "frame:        " << r.frame / n << " ms" << std::endl;
+    std::cout << "prepare:      " << r.prepare / n << " ms" << std::endl;
+    std::cout << "cull:         " << r.cull / n << " ms" << std::endl;
+    std::cout << "froxelize:    " << r.froxelize / n << " ms" << std::endl;
+    std::cout << "generate:     " << r.generate / n << " ms" << std::endl;
+    std::cout << "sort:         " << r.sort / n << " ms" << std::endl;
+    std::cout << "record:       " << r.record / n << " ms" << std::endl;
+    std::cout << "cycles:       " << cycles << std::endl;
+    std::cout << "instructions: " << instructions << std::endl;
+    std::cout << "CPI:          " << r.counters.getCPI() << std::endl;
+    std::cout << std::endl;
+}
+
+static Results runScene(Engine* engine, SceneConfig const& config, size_t frameCount) {
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> rand(-1.0f, 1.0f);
+
+    EntityManager& em = EntityManager::get();
+    TransformManager& tcm = engine->getTransformManager();
+    RenderableManager& rcm = engine->getRenderableManager();
+
+    SwapChain* swapChain = engine->createSwapChain(WIDTH, HEIGHT);
+    Renderer* renderer = engine->createRenderer();
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    Camera* camera = engine->createCamera();
+    camera->setProjection(45.0, double(WIDTH) / HEIGHT, 0.1, 1000.0);
+    camera->lookAt({ 0, 50, 100 }, { 0, 0, -200 }, { 0, 1, 0 });
+    view->setCamera(camera);
+    view->setScene(scene);
+    view->setViewport({ 0, 0, WIDTH, HEIGHT });
+    view->setShadowsEnabled(config.shadows);
+
+    VertexBuffer::Builder vbb;
+    vbb.vertexCount(8)
+            .bufferCount(config.skinning ? 3 : 1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3);
+    if (config.skinning) {
+        vbb.attribute(VertexAttribute::BONE_INDICES, 1, VertexBuffer::AttributeType::UBYTE4)
+                .attribute(VertexAttribute::BONE_WEIGHTS, 2, VertexBuffer::AttributeType::FLOAT4);
+    }
+    VertexBuffer* vb = vbb.build(*engine);
+    vb->setBufferAt(*engine, 0,
+            VertexBuffer::BufferDescriptor(CUBE_VERTICES, sizeof(CUBE_VERTICES), nullptr));
+    if (config.skinning) {
+        vb->setBufferAt(*engine, 1, VertexBuffer::BufferDescriptor(
+                CUBE_BONE_INDICES, sizeof(CUBE_BONE_INDICES), nullptr));
+        vb->setBufferAt(*engine, 2, VertexBuffer::BufferDescriptor(
+                CUBE_BONE_WEIGHTS, sizeof(CUBE_BONE_WEIGHTS), nullptr));
+    }
+    IndexBuffer* ib = IndexBuffer::Builder()
+            .indexCount(36)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(*engine);
+    ib->setBuffer(*engine,
+            IndexBuffer::BufferDescriptor(CUBE_INDICES, sizeof(CUBE_INDICES), nullptr));
+
+    // the renderables are spread over a volume larger than the frustum, so that about half of
+    // them are culled
+    std::vector<Entity> renderables(config.renderables);
+    em.create(renderables.size(), renderables.data());
+    for (Entity e : renderables) {
+        RenderableManager::Builder builder(1);
+        builder.boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+                .material(0, engine->getDefaultMaterial()->getDefaultInstance())
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .castShadows(config.shadows)
+                .receiveShadows(config.shadows);
+        if (config.skinning) {
+            builder.skinning(BONE_COUNT);
+        }
+        builder.build(*engine, e);
+        const float3 position{ rand(gen) * 400.0f, rand(gen) * 50.0f, rand(gen) * 300.0f - 200.0f };
+        tcm.create(e, {}, mat4f::translate(position));
+        scene->addEntity(e);
+    }
+
+    std::vector<Entity> lights(config.lights + 1);
+    em.create(lights.size(), lights.data());
+    LightManager::Builder(LightManager::Type::SUN)
+            .direction({ 0.3f, -1, -0.5f })
+            .intensity(110000)
+            .castShadows(config.shadows)
+            .build(*engine, lights[0]);
+    scene->addEntity(lights[0]);
+    for (size_t i = 1; i < lights.size(); i++) {
+        LightManager::Builder(LightManager::Type::POINT)
+                .position({ rand(gen) * 200.0f, rand(gen) * 20.0f, rand(gen) * 150.0f - 100.0f })
+                .falloff(20.0f)
+                .intensity(10000)
+                .build(*engine, lights[i]);
+        scene->addEntity(lights[i]);
+    }
+
+    std::vector<mat4f> bones(BONE_COUNT);
+    Results results;
+    Profiler& profiler = Profiler::get();
+    profiler.resetEvents(Profiler::EV_CPU_CYCLES | Profiler::EV_BPU_MISSES);
+
+    for (size_t frame = 0; frame < WARMUP_FRAMES + frameCount; frame++) {
+        const bool measured = frame >= WARMUP_FRAMES;
+        if (frame == WARMUP_FRAMES) {
+            profiler.start();
+            profiler.reset();
+        }
+        auto start = std::chrono::steady_clock::now();
+
+        // animate the skinned renderables, like an application would
+        if (config.skinning) {
+            for (size_t i = 0; i < BONE_COUNT; i++) {
+                bones[i] = mat4f::rotate(float(frame) * 0.01f * (i + 1), float3{ 0, 1, 0 });
+            }
+            for (Entity e : renderables) {
+                rcm.setBones(rcm.getInstance(e), bones.data(), BONE_COUNT);
+            }
+        }
+
+        if (renderer->beginFrame(swapChain)) {
+            renderer->render(view);
+            renderer->endFrame();
+            if (measured) {
+                Renderer::CpuFrameTimings timings;
+                renderer->getLastCpuFrameTimings(&timings);
+                results.frames++;
+                results.prepare += timings.prepare;
+                results.cull += timings.cull;
+                results.froxelize += timings.froxelize;
+                results.generate += timings.generate;
+                results.sort += timings.sort;
+                results.record += timings.record;
+                results.frame += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+            }
+        }
+    }
+    profiler.stop();
+    profiler.readCounters(&results.counters);
+
+    for (Entity e : lights) {
+        engine->destroy(e);
+    }
+    em.destroy(lights.size(), lights.data());
+    for (Entity e : renderables) {
+        engine->destroy(e);
+        tcm.destroy(e);
+    }
+    em.destroy(renderables.size(), renderables.data());
+    engine->destroy(ib);
+    engine->destroy(vb);
+    engine->destroy(camera);
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    return results;
+}
+
+static bool parseSize(char const* arg, char const* name, size_t* value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+        *value = size_t(strtoul(arg + len + 1, nullptr, 10));
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    std::vector<SceneConfig> configs = {
+            {   1000,   0, false, false },
+            {  10000,   0, false, false },
+            {  10000,  64, true,  false },
+            {  10000, 512, true,  false },
+            {  10000,  64, true,  true  },
+            {  50000, 128, true,  false },
+            { 200000,   0, false, false },
+            { 200000, 512, true,  false },
+    };
+
+    bool json = false;
+    size_t frames = 30;
+    SceneConfig custom = { 0, 0, false, false };
+    for (int i = 1; i < argc; i++) {
+        char const* arg = argv[i];
+        if (!strcmp(arg, "--json")) {
+            json = true;
+        } else if (!strcmp(arg, "--shadows")) {
+            custom.shadows = true;
+        } else if (!strcmp(arg, "--skinning")) {
+            custom.skinning = true;
+        } else if (!parseSize(arg, "--frames", &frames) &&
+                !parseSize(arg, "--renderables", &custom.renderables) &&
+                !parseSize(arg, "--lights", &custom.lights)) {
+            std::cerr << "usage: " << argv[0] << " [--json] [--frames=N] "
+                      << "[--renderables=N --lights=N [--shadows] [--skinning]]" << std::endl;
+            return 1;
+        }
+    }
+    if (custom.renderables) {
+        configs = { custom };
+    }
+
+    // the largest scenes record a lot of commands per frame
+    Engine::Config config;
+    config.commandBufferSizeMB = 96;
+    config.minCommandBufferSizeMB = 32;
+    config.perFrameCommandsSizeMB = 32;
+    Engine* engine = Engine::create(Engine::Backend::NOOP, nullptr, nullptr, &config);
+    if (!engine) {
+        std::cerr << "The no-op backend is not available, see FILAMENT_SUPPORTS_NOOP" << std::endl;
+        return 1;
+    }
+
+    for (SceneConfig const& scene : configs) {
+        printResults(scene, runScene(engine, scene, frames), json);
+    }
+
+    Engine::destroy(&engine);
+    return 0;
+}
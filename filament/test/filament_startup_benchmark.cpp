@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the stages of the time to first frame on a headless swap chain, for each backend:
+ * Engine::create() (see Engine::getStartupTimings()), the parsing of materials, the first
+ * compilation of each of their variants, and texture uploads.
+ *
+ *  filament_startup_benchmark [--json] [--runs=N] [--backend=opengl|vulkan|noop]
+ *          [material.filamat ...]
+ *
+ * Each run creates and destroys its own Engine, the first run of each backend is the cold
+ * start of the process. The default material is always measured, along with the materials
+ * given on the command line. Backends that aren't available are skipped. With --json, each
+ * stage of each run prints one JSON object per line.
+ */
+
+#include <filament/Engine.h>
+#include <filament/Fence.h>
+#include <filament/Material.h>
+#include <filament/Renderer.h>
+#include <filament/SwapChain.h>
+#include <filament/Texture.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament;
+
+using Backend = Engine::Backend;
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint32_t WIDTH = 640;
+static constexpr uint32_t HEIGHT = 480;
+
+// compilations that don't complete within this many frames are reported as failed
+static constexpr size_t MAX_COMPILATION_FRAMES = 1000;
+
+struct Stage {
+    std::string name;
+    double ms;
+};
+
+struct MaterialFile {
+    std::string name;
+    std::vector<char> package;
+};
+
+static double since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static char const* toString(Backend backend) {
+    switch (backend) {
+        case Backend::OPENGL: return "opengl";
+        case Backend::VULKAN: return "vulkan";
+        case Backend::NOOP:   return "noop";
+        default:              return "default";
+    }
+}
+
+static bool fromString(char const* name, Backend* backend) {
+    for (Backend b : { Backend::OPENGL, Backend::VULKAN, Backend::NOOP }) {
+        if (!strcmp(name, toString(b))) {
+            *backend = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compiles each variant of the material, one at a time, and returns the time spent in
+// compile() (extracting the shaders and creating the programs, on the calling thread) and
+// until the program is ready to draw with.
+static void compileVariants(Engine* engine, Renderer* renderer, SwapChain* swapChain,
+        Material const* material, std::string const& name, std::vector<Stage>& stages) {
+    using VariantFlags = Material::VariantFlags;
+    const bool unlit = material->getShading() == Shading::UNLIT;
+    for (uint8_t variant = 0; variant <= 0xF; variant++) {
+        if (unlit && (variant & ~VariantFlags::SKINNING)) {
+            // unlit materials don't have lighting variants
+            continue;
+        }
+
+        bool ready = false;
+        Clock::time_point start = Clock::now();
+        material->compile(&variant, 1, [](Material const*, void* user) {
+            *static_cast<bool*>(user) = true;
+        }, &ready);
+        const double extract = since(start);
+
+        // the callbacks are called when the engine flushes, once the driver has seen the
+        // programs are ready; the OpenGL driver only checks the programs compiled in the
+        // background at the end of frames
+        size_t frames = 0;
+        Fence::waitAndDestroy(engine->createFence());
+        while (!ready && frames < MAX_COMPILATION_FRAMES) {
+            Fence::waitAndDestroy(engine->createFence());
+            if (!ready && renderer->beginFrame(swapChain)) {
+                renderer->endFrame();
+                frames++;
+            }
+        }
+        const double total = ready ? since(start) : -1.0;
+
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), " variant 0x%x", variant);
+        stages.push_back({ name + " shaders" + suffix, extract });
+        stages.push_back({ name + " compile" + suffix, total });
+    }
+}
+
+static void uploadTexture(Engine* engine, uint32_t size, bool mipmaps,
+        std::vector<Stage>& stages) {
+    const uint8_t levels = mipmaps ? uint8_t(std::log2(size) + 1) : uint8_t(1);
+    const size_t bytes = size_t(size) * size * 4;
+    uint8_t* pixels = static_cast<uint8_t*>(malloc(bytes));
+    for (size_t i = 0; i < bytes; i++) {
+        pixels[i] = uint8_t(i * 31);
+    }
+
+    Clock::time_point start = Clock::now();
+    Texture* texture = Texture::Builder()
+            .width(size)
+            .height(size)
+            .levels(levels)
+            .format(Texture::InternalFormat::RGBA8)
+            .build(*engine);
+    texture->setImage(*engine, 0, Texture::PixelBufferDescriptor(pixels, bytes,
+            Texture::Format::RGBA, Texture::Type::UBYTE,
+            [](void* buffer, size_t, void*) { free(buffer); }));
+    if (mipmaps) {
+        texture->generateMipmaps(*engine);
+    }
+    Fence::waitAndDestroy(engine->createFence(Fence::Type::HARD));
+
+    std::string name = "texture " + std::to_string(size) + "x" + std::to_string(size) + " RGBA8";
+    stages.push_back({ name + (mipmaps ? " with mipmaps" : ""), since(start) });
+    engine->destroy(texture);
+}
+
+// returns false if the backend isn't available
+static bool run(Backend backend, std::vector<MaterialFile> const& materials,
+        std::vector<Stage>& stages) {
+    Clock::time_point start = Clock::now();
+    Engine* engine = Engine::create(backend);
+    if (!engine) {
+        return false;
+    }
+    const double create = since(start);
+
+    Engine::StartupTimings timings;
+    engine->getStartupTimings(&timings);
+    stages.push_back({ "engine driver", timings.driver });
+    stages.push_back({ "engine init", timings.init });
+    stages.push_back({ "engine create", create });
+
+    start = Clock::now();
+    SwapChain* swapChain = engine->createSwapChain(WIDTH, HEIGHT);
+    Renderer* renderer = engine->createRenderer();
+    Fence::waitAndDestroy(engine->createFence());
+    stages.push_back({ "swap chain and renderer", since(start) });
+
+    // the other materials share the depth programs of the default material
+    start = Clock::now();
+    Material const* defaultMaterial = engine->getDefaultMaterial();
+    stages.push_back({ "default material parse", since(start) });
+    compileVariants(engine, renderer, swapChain, defaultMaterial, "default material", stages);
+
+    for (MaterialFile const& file : materials) {
+        start = Clock::now();
+        Material* material = Material::Builder()
+                .package(file.package.data(), file.package.size())
+                .build(*engine);
+        if (!material) {
+            std::cerr << file.name << " is not a valid material" << std::endl;
+            continue;
+        }
+        stages.push_back({ file.name + " parse", since(start) });
+        compileVariants(engine, renderer, swapChain, material, file.name, stages);
+        engine->destroy(material);
+    }
+
+    for (uint32_t size : { 256u, 1024u, 2048u }) {
+        uploadTexture(engine, size, false, stages);
+    }
+    uploadTexture(engine, 1024, true, stages);
+
+    start = Clock::now();
+    if (renderer->beginFrame(swapChain)) {
+        renderer->endFrame();
+    }
+    Fence::waitAndDestroy(engine->createFence());
+    stages.push_back({ "first frame", since(start) });
+
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+
+    start = Clock::now();
+    Engine::destroy(&engine);
+    stages.push_back({ "engine destroy", since(start) });
+    return true;
+}
+
+static void printResults(Backend backend, std::vector<std::vector<Stage>> const& runs,
+        bool json) {
+    if (json) {
+        for (size_t i = 0; i < runs.size(); i++) {
+            for (Stage const& stage : runs[i]) {
+                std::cout << "{"
+                        << "\"backend\": \"" << toString(backend) << "\", "
+                        << "\"run\": " << i << ", "
+                        << "\"stage\": \"" << stage.name << "\", "
+                        << "\"ms\": " << stage.ms
+                        << "}" << std::endl;
+            }
+        }
+        return;
+    }
+
+    // one column per run, the stages are the same in all the runs
+    std::cout << toString(backend) << " (ms, " << runs.size() << " runs):" << std::endl;
+    for (size_t s = 0; s < runs[0].size(); s++) {
+        std::string name = runs[0][s].name + ":";
+        name.resize(std::max(name.size() + 1, size_t(48)), ' ');
+        std::cout << name;
+        for (std::vector<Stage> const& stages : runs) {
+            if (s < stages.size()) {
+                std::cout << " " << stages[s].ms;
+            }
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+static bool parseSize(char const* arg, char const* name, size_t* value) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+        *value = size_t(strtoul(arg + len + 1, nullptr, 10));
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    std::vector<Backend> backends = { Backend::OPENGL, Backend::VULKAN, Backend::NOOP };
+    std::vector<MaterialFile> materials;
+    bool json = false;
+    size_t runCount = 3;
+    for (int i = 1; i < argc; i++) {
+        char const* arg = argv[i];
+        Backend backend;
+        if (!strcmp(arg, "--json")) {
+            json = true;
+        } else if (!strncmp(arg, "--backend=", 10) && fromString(arg + 10, &backend)) {
+            backends = { backend };
+        } else if (parseSize(arg, "--runs", &runCount)) {
+            runCount = std::max(runCount, size_t(1));
+        } else if (arg[0] != '-') {
+            std::ifstream in(arg, std::ifstream::binary);
+            if (!in) {
+                std::cerr << "Unable to open " << arg << std::endl;
+                return 1;
+            }
+            materials.push_back({ arg, { std::istreambuf_iterator<char>(in), {} } });
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--json] [--runs=N] "
+                      << "[--backend=opengl|vulkan|noop] [material.filamat ...]" << std::endl;
+            return 1;
+        }
+    }
+
+    for (Backend backend : backends) {
+        std::vector<std::vector<Stage>> runs(runCount);
+        bool available = true;
+        for (size_t i = 0; i < runCount && available; i++) {
+            available = run(backend, materials, runs[i]);
+        }
+        if (!available) {
+            std::cerr << "The " << toString(backend) << " backend is not available" << std::endl;
+            continue;
+        }
+        printResults(backend, runs, json);
+    }
+    return 0;
+}
@@ -18,25 +18,51 @@
 
 #include <gtest/gtest.h>
 
+#if defined(__linux__)
+#include <poll.h>
+#endif
+
 #include <math/vec3.h>
 #include <math/vec4.h>
 #include <math/mat4.h>
 
 #include <filament/Camera.h>
 #include <filament/Color.h>
+#include <filament/Fence.h>
 #include <filament/Frustum.h>
+#include <filament/LightManager.h>
 #include <filament/Material.h>
+#include <filament/MaterialInstance.h>
 #include <filament/Engine.h>
-
+#include <filament/Scene.h>
+#include <filament/Texture.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+
+#include "driver/CommandBufferQueue.h"
+#include "driver/CommandStream.h"
+#include "driver/DriverBase.h"
 #include "driver/UniformBuffer.h"
+#include "driver/noop/NoopDriver.h"
 #include <filament/UniformInterfaceBlock.h>
 
 #include "details/Allocators.h"
+#include "details/Bvh.h"
+#include "details/Culler.h"
+#include "details/DepthPrepassSelector.h"
+#include "details/DestroyBatch.h"
 #include "details/Material.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/HiZBuffer.h"
 #include "details/Engine.h"
+#include "details/Scene.h"
+#include "details/Terrain.h"
+#include "details/Texture.h"
 #include "components/TransformManager.h"
+#include "ColorGrading.h"
+#include "FrameGraph.h"
+#include "RenderPass.h"
 #include "utils/RangeSet.h"
 
 using namespace filament;
@@ -144,6 +170,125 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
 }
 
+TEST(FilamentTest, TransformManagerParallelCommit) {
+    JobSystem js;
+    js.adopt();
+    EntityManager& em = EntityManager::get();
+
+    // many independent chains, so that the transaction is committed on multiple threads
+    const size_t rootCount = 64;
+    const size_t depth = 32;
+    std::vector<Entity> entities(rootCount * depth);
+    em.create(entities.size(), entities.data());
+
+    filament::details::FTransformManager tcm(&js);
+    for (size_t r = 0; r < rootCount; r++) {
+        tcm.create(entities[r * depth]);
+        for (size_t d = 1; d < depth; d++) {
+            tcm.create(entities[r * depth + d], tcm.getInstance(entities[r * depth + d - 1]),
+                    mat4f::translate(float3{ 0, 1, 0 }));
+        }
+    }
+
+    tcm.openLocalTransformTransaction();
+    for (size_t r = 0; r < rootCount; r++) {
+        tcm.setTransform(tcm.getInstance(entities[r * depth]),
+                mat4f::translate(float3{ float(r), 0, 0 }));
+        // a dirty node inside an already dirty subtree
+        tcm.setTransform(tcm.getInstance(entities[r * depth + depth / 2]),
+                mat4f::translate(float3{ 0, 2, 0 }));
+    }
+    // untouched during the transaction
+    const mat4f before = tcm.getWorldTransform(tcm.getInstance(entities[depth - 1]));
+    tcm.commitLocalTransformTransaction();
+    EXPECT_NE(before, tcm.getWorldTransform(tcm.getInstance(entities[depth - 1])));
+
+    for (size_t r = 0; r < rootCount; r++) {
+        for (size_t d = 0; d < depth; d++) {
+            const float y = float(d + (d >= depth / 2 ? 1 : 0));
+            EXPECT_EQ(mat4f::translate(float3{ float(r), y, 0 }),
+                    tcm.getWorldTransform(tcm.getInstance(entities[r * depth + d])));
+        }
+    }
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+    js.emancipate();
+}
+
+TEST(FilamentTest, TransformManagerSetTransforms) {
+    filament::details::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 3> entities;
+    em.create(entities.size(), entities.data());
+
+    tcm.create(entities[0]);
+    tcm.create(entities[1], tcm.getInstance(entities[0]), mat4f{});
+    tcm.create(entities[2]);
+
+    const TransformManager::Instance instances[] = {
+            tcm.getInstance(entities[0]), tcm.getInstance(entities[2]) };
+    const mat4f transforms[] = {
+            mat4f::translate(float3{ 1, 0, 0 }), mat4f::translate(float3{ 0, 2, 0 }) };
+    tcm.setTransforms(instances, transforms, 2);
+
+    EXPECT_EQ(transforms[0], tcm.getTransform(instances[0]));
+    EXPECT_EQ(transforms[1], tcm.getTransform(instances[1]));
+    // world transforms are propagated to the children
+    EXPECT_EQ(transforms[0], tcm.getWorldTransform(tcm.getInstance(entities[1])));
+    EXPECT_EQ(transforms[1], tcm.getWorldTransform(instances[1]));
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+}
+
+TEST(FilamentTest, TransformManagerAccurateTranslations) {
+    filament::details::FTransformManager tcm;
+    tcm.setAccurateTranslationsEnabled(true);
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 2> entities;
+    em.create(entities.size(), entities.data());
+
+    // a float can't represent these translations, the parent is rotated about y
+    const mat3 rotation{ double3{ 0, 0, -1 }, double3{ 0, 1, 0 }, double3{ 1, 0, 0 }};
+    const mat4 parentTransform{ rotation, double3{ 10000000.125, 0, -20000000.0625 }};
+    const mat4 childTransform = mat4::translate(double3{ 0.001, 0, 0 });
+    tcm.create(entities[0], {}, parentTransform);
+    tcm.create(entities[1], tcm.getInstance(entities[0]), childTransform);
+    const TransformManager::Instance parent = tcm.getInstance(entities[0]);
+    const TransformManager::Instance child = tcm.getInstance(entities[1]);
+
+    auto expectNear = [](double3 expected, mat4 const& m) {
+        EXPECT_NEAR(expected.x, m[3].x, 1e-6);
+        EXPECT_NEAR(expected.y, m[3].y, 1e-6);
+        EXPECT_NEAR(expected.z, m[3].z, 1e-6);
+    };
+    expectNear(parentTransform[3].xyz, tcm.getTransformAccurate(parent));
+    expectNear(parentTransform[3].xyz, tcm.getWorldTransformAccurate(parent));
+    expectNear(double3{ 10000000.125, 0, -20000000.0635 }, tcm.getWorldTransformAccurate(child));
+    // the float transforms are the rounded ones
+    EXPECT_EQ(mat4f(parentTransform), tcm.getWorldTransform(parent));
+
+    // transactions compose the translations the same way
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(parent, mat4::translate(double3{ -30000000.25, 0, 0 }));
+    tcm.commitLocalTransformTransaction();
+    expectNear(double3{ -30000000.249, 0, 0 }, tcm.getWorldTransformAccurate(child));
+
+    // disabling accurate translations drops the extra precision
+    tcm.setAccurateTranslationsEnabled(false);
+    EXPECT_EQ(mat4(tcm.getWorldTransform(child)), tcm.getWorldTransformAccurate(child));
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+}
+
 TEST(FilamentTest, UniformInterfaceBlock) {
 
     UniformInterfaceBlock::Builder b;
@@ -209,6 +354,13 @@ TEST(FilamentTest, UniformInterfaceBlock) {
     EXPECT_EQ(60, info[14].offset);
     EXPECT_EQ(12, info[14].stride);
     EXPECT_EQ(3, info[14].size);
+
+    // lookup by name, as used by parameter handles
+    UniformInterfaceBlock::UniformInfo const* vec3 = ib.getUniformInfo("a_vec3_0");
+    ASSERT_NE(nullptr, vec3);
+    EXPECT_EQ(&info[8], vec3);
+    EXPECT_EQ(UniformInterfaceBlock::Type::FLOAT3, vec3->type);
+    EXPECT_EQ(size_t(ib.getUniformOffset("a_vec3_0", 0)), vec3->getBufferOffset());
 }
 
 TEST(FilamentTest, UniformBuffer) {
@@ -328,6 +480,52 @@ TEST(FilamentTest, UniformBuffer) {
     //buffer.log(std::cout, ib);
 }
 
+TEST(FilamentTest, UniformBufferDirtyRange) {
+    UniformBuffer buffer(64);
+
+    // a new buffer needs to be uploaded entirely
+    EXPECT_TRUE(buffer.isDirty());
+    EXPECT_EQ(0, buffer.getDirtyOffset());
+    EXPECT_EQ(64, buffer.getDirtySize());
+
+    buffer.clean();
+    EXPECT_FALSE(buffer.isDirty());
+    EXPECT_EQ(0, buffer.getDirtySize());
+
+    buffer.setUniform(16, 1.0f);
+    EXPECT_TRUE(buffer.isDirty());
+    EXPECT_EQ(16, buffer.getDirtyOffset());
+    EXPECT_EQ(4, buffer.getDirtySize());
+
+    // modified ranges are coalesced
+    buffer.setUniform(32, float4{ 1, 2, 3, 4 });
+    buffer.setUniform(8, 2.0f);
+    EXPECT_EQ(8, buffer.getDirtyOffset());
+    EXPECT_EQ(40, buffer.getDirtySize());
+
+    // copies keep the dirty range
+    UniformBuffer copy(buffer);
+    EXPECT_EQ(8, copy.getDirtyOffset());
+    EXPECT_EQ(40, copy.getDirtySize());
+
+    // batched records keep their data 4-bytes aligned
+    EXPECT_EQ(sizeof(Driver::UniformRangeUpdate) + 8, Driver::UniformRangeUpdate::getRecordSize(5));
+}
+
+TEST(FilamentTest, PerRenderableUib) {
+    // the struct used for offsetof() must follow the std140 layout of the shaders
+    UniformInterfaceBlock uib(FEngine::PerRenderableUib::getUib());
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, worldFromModelRows)),
+            uib.getUniformOffset("worldFromModelRows", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, morphWeights)),
+            uib.getUniformOffset("morphWeights", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, textureLayer)),
+            uib.getUniformOffset("textureLayer", 0));
+    EXPECT_EQ(ssize_t(offsetof(FEngine::PerRenderableUib, flags)),
+            uib.getUniformOffset("flags", 0));
+    EXPECT_EQ(sizeof(FEngine::PerRenderableUib), uib.getSize());
+}
+
 TEST(FilamentTest, BoxCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -408,6 +606,408 @@ TEST(FilamentTest, SphereCulling) {
     EXPECT_TRUE(frustum.intersects({ 0, 200 }));
 }
 
+TEST(FilamentTest, CullerKernels) {
+    using namespace filament::details;
+
+    // the SIMD kernels must produce the same results as the scalar ones
+    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+
+    const size_t count = 1024;
+    std::vector<float3> centers(count);
+    std::vector<float3> extents(count);
+    std::vector<float4> spheres(count);
+    for (size_t i = 0; i < count; i++) {
+        const float x = float(i % 32) * 8.0f - 128.0f;
+        const float y = float((i / 32) % 8) * 8.0f - 32.0f;
+        const float z = -float(i / 256) * 40.0f + 10.0f;
+        centers[i] = float3{ x, y, z };
+        extents[i] = float3{ 1.0f + float(i % 5), 1.0f + float(i % 3), 2.0f };
+        spheres[i] = float4{ x, y, z, 1.0f + float(i % 7) };
+    }
+
+    // box results are or'ed into the existing ones
+    std::vector<Culler::result_type> expected(count, 0x80);
+    std::vector<Culler::result_type> results(count, 0x80);
+    Culler::Test::intersectsScalar(expected.data(), frustum,
+            centers.data(), extents.data(), count);
+    Culler::Test::intersects(results.data(), frustum,
+            centers.data(), extents.data(), count);
+    EXPECT_EQ(expected, results);
+
+    Culler::Test::intersectsScalar(expected.data(), frustum, spheres.data(), count);
+    Culler::Test::intersects(results.data(), frustum, spheres.data(), count);
+    EXPECT_EQ(expected, results);
+}
+
+TEST(FilamentTest, BvhCulling) {
+    using namespace filament::details;
+
+    Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
+
+    // a grid of boxes, some inside, some across, and some outside the frustum
+    std::vector<float3> centers;
+    std::vector<float3> extents;
+    for (int z = 0; z < 32; z++) {
+        for (int y = -16; y < 16; y++) {
+            for (int x = -16; x < 16; x++) {
+                centers.push_back(float3{ x * 8.0f, y * 8.0f, z * -4.0f });
+                extents.push_back(float3{ 0.5f + float(x & 3) });
+            }
+        }
+    }
+    const size_t count = centers.size();
+
+    Bvh bvh;
+    bvh.build(centers.data(), extents.data(), count);
+    EXPECT_EQ(count, bvh.size());
+
+    auto check = [&]() {
+        std::vector<Culler::result_type> expected(Culler::round(count));
+        Culler::Test::intersects(expected.data(), frustum,
+                centers.data(), extents.data(), count);
+
+        std::vector<Culler::result_type> results(count);
+        bvh.cull(frustum, [&results](uint32_t slot) { results[slot]++; });
+
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(expected[i] ? 1 : 0, results[i]) << "slot " << i;
+        }
+    };
+    check();
+
+    // move some boxes across the frustum boundary and refit
+    for (size_t i = 0; i < count; i += 7) {
+        centers[i] = -centers[i];
+        bvh.update(uint32_t(i), centers[i], extents[i]);
+    }
+    bvh.refit();
+    check();
+}
+
+TEST(FilamentTest, BvhQueries) {
+    using namespace filament::details;
+
+    std::vector<float3> centers;
+    std::vector<float3> extents;
+    for (int z = 0; z < 16; z++) {
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                centers.push_back(float3{ x * 4.0f, y * 4.0f, z * 4.0f });
+                extents.push_back(float3{ 0.5f + float(x & 1) });
+            }
+        }
+    }
+    const size_t count = centers.size();
+
+    Bvh bvh;
+    bvh.build(centers.data(), extents.data(), count);
+
+    // boxes overlapping a box, compared to testing all of them
+    const float3 lo{ 5.0f, -1.0f, 10.0f };
+    const float3 hi{ 14.0f, 30.0f, 11.0f };
+    std::vector<int> results(count);
+    bvh.query(lo, hi, [&results](uint32_t slot) { results[slot]++; });
+    for (size_t i = 0; i < count; i++) {
+        const bool overlaps = all(lessThanEqual(lo, centers[i] + extents[i])) &&
+                all(lessThanEqual(centers[i] - extents[i], hi));
+        EXPECT_EQ(overlaps ? 1 : 0, results[i]) << "slot " << i;
+    }
+
+    // nearest box along rays, compared to testing all of them
+    auto nearest = [&](float3 origin, float3 direction) {
+        uint32_t best = uint32_t(-1);
+        float far = 1000.0f;
+        bvh.raycast(origin, 1.0f / direction, far, [&](uint32_t slot, float t) {
+            if (t < far) {
+                far = t;
+                best = slot;
+            }
+            return far;
+        });
+        return best;
+    };
+    auto expected = [&](float3 origin, float3 direction) {
+        uint32_t best = uint32_t(-1);
+        float far = 1000.0f;
+        for (uint32_t i = 0; i < count; i++) {
+            const float3 t0 = (centers[i] - extents[i] - origin) / direction;
+            const float3 t1 = (centers[i] + extents[i] - origin) / direction;
+            const float3 tmin = min(t0, t1);
+            const float3 tmax = max(t0, t1);
+            const float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+            const float exit = std::min(std::min(tmax.x, tmax.y), tmax.z);
+            if (enter <= exit && enter < far) {
+                far = enter;
+                best = i;
+            }
+        }
+        return best;
+    };
+    const float3 origin{ -10.0f, 31.0f, 29.0f };
+    for (int i = 0; i < 64; i++) {
+        const float3 direction{ 1.0f, cosf(i * 0.1f) - 0.5f, sinf(i * 0.37f) };
+        EXPECT_EQ(expected(origin, direction), nearest(origin, direction)) << "ray " << i;
+    }
+
+    // a ray starting inside a box hits it at distance 0
+    bvh.raycast(centers[42], float3{ 1.0f }, 1.0f, [&](uint32_t slot, float t) {
+        if (slot == 42) {
+            EXPECT_EQ(0.0f, t);
+        }
+        return 1.0f;
+    });
+}
+
+TEST(FilamentTest, HiZOcclusion) {
+    using namespace filament::details;
+
+    const mat4f clipFromWorld = mat4f::frustum(-1, 1, -1, 1, 1, 100);
+    const float4 wall = clipFromWorld * float4{ 0, 0, -10, 1 };
+    const float wallDepth = (wall.z / wall.w) * 0.5f + 0.5f;
+
+    // a wall at 10m covering the left half of the screen, nothing on the right half
+    const uint32_t width = 1000;
+    const uint32_t height = 600;
+    std::vector<float> depth(width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            depth[y * width + x] = x < width / 2 ? wallDepth : 1.0f;
+        }
+    }
+
+    HiZBuffer hiz;
+    EXPECT_FALSE(hiz.isOccluded(float3{ -5, 0, -20 }, float3{ 1 }));
+    hiz.build(depth.data(), width, height, clipFromWorld);
+    EXPECT_FALSE(hiz.empty());
+
+    EXPECT_TRUE(hiz.isOccluded(float3{ -5, 0, -20 }, float3{ 1 }));     // behind the wall
+    EXPECT_TRUE(hiz.isOccluded(float3{ -14, 4, -40 }, float3{ 2 }));    // far behind the wall
+    EXPECT_FALSE(hiz.isOccluded(float3{ 5, 0, -20 }, float3{ 1 }));     // nothing in front
+    EXPECT_FALSE(hiz.isOccluded(float3{ -2, 0, -5 }, float3{ 1 }));     // in front of the wall
+    EXPECT_FALSE(hiz.isOccluded(float3{ -1, 0, -10 }, float3{ 2 }));    // across the wall
+    EXPECT_FALSE(hiz.isOccluded(float3{ 0, 0, -20 }, float3{ 1 }));     // partially hidden
+    EXPECT_FALSE(hiz.isOccluded(float3{ -1, 0, 0 }, float3{ 2 }));      // around the camera
+
+    float3 centers[] = { { -5, 0, -20 }, { 5, 0, -20 }, { -5, 0, -20 } };
+    float3 extents[] = { float3{ 1 }, float3{ 1 }, float3{ 1 } };
+    uint8_t masks[] = { 0x1, 0x1, 0x0 };
+    hiz.cull(masks, centers, extents, 3, 0x1, 2);
+    EXPECT_EQ(0x1, masks[0]);
+    EXPECT_EQ(0x5, masks[1]);
+    EXPECT_EQ(0x0, masks[2]);
+
+    // the depth ranges are conservative, the rectangles are small enough to not be rounded up
+    // past the wall's edge
+    EXPECT_FLOAT_EQ(wallDepth, hiz.getDepthRange({ -1.0f, -0.2f }, { -0.6f, 0.2f }).x);
+    EXPECT_FLOAT_EQ(wallDepth, hiz.getDepthRange({ -1.0f, -0.2f }, { -0.6f, 0.2f }).y);
+    EXPECT_FLOAT_EQ(1.0f, hiz.getDepthRange({ 0.6f, -0.2f }, { 1.0f, 0.2f }).x);
+    EXPECT_FLOAT_EQ(wallDepth, hiz.getDepthRange({ -1.0f, -1.0f }, { 1.0f, 1.0f }).x);
+    EXPECT_FLOAT_EQ(1.0f, hiz.getDepthRange({ -1.0f, -1.0f }, { 1.0f, 1.0f }).y);
+}
+
+TEST(FilamentTest, CommandStreamState) {
+    CommandStreamState state;
+    Driver::UniformBufferHandle ub0(0);
+    Driver::UniformBufferHandle ub1(1);
+    Driver::SamplerBufferHandle sb0(0);
+
+    // the first binding is always needed
+    EXPECT_TRUE(state.bindUniforms(1, ub0));
+    EXPECT_FALSE(state.bindUniforms(1, ub0));
+    EXPECT_TRUE(state.bindUniforms(2, ub0));
+    EXPECT_TRUE(state.bindUniforms(1, ub1));
+
+    // ranges of the same buffer are different bindings
+    EXPECT_TRUE(state.bindUniformsRange(1, ub1, 0, 256));
+    EXPECT_FALSE(state.bindUniformsRange(1, ub1, 0, 256));
+    EXPECT_TRUE(state.bindUniformsRange(1, ub1, 256, 256));
+    EXPECT_TRUE(state.bindUniforms(1, ub1));
+
+    EXPECT_TRUE(state.bindSamplers(5, sb0));
+    EXPECT_FALSE(state.bindSamplers(5, sb0));
+
+    EXPECT_TRUE(state.setViewportScissor(0, 0, 640, 480));
+    EXPECT_FALSE(state.setViewportScissor(0, 0, 640, 480));
+    EXPECT_TRUE(state.setViewportScissor(0, 0, 640, 240));
+
+    EXPECT_TRUE(state.setPolygonOffset(1.0f, 1.0f));
+    EXPECT_FALSE(state.setPolygonOffset(1.0f, 1.0f));
+    EXPECT_TRUE(state.setPolygonOffset(2.0f, 1.0f));
+
+    EXPECT_EQ(5u, state.getEliminatedCount());
+
+    // nothing is known after a reset, but the count is kept
+    state.reset();
+    EXPECT_TRUE(state.bindUniforms(2, ub0));
+    EXPECT_TRUE(state.bindSamplers(5, sb0));
+    EXPECT_TRUE(state.setViewportScissor(0, 0, 640, 240));
+    EXPECT_TRUE(state.setPolygonOffset(2.0f, 1.0f));
+    EXPECT_EQ(5u, state.getEliminatedCount());
+}
+
+TEST(FilamentTest, PackedCommands) {
+    alignas(std::max_align_t) uint8_t storage[256];
+    PackedCommands* const run = new(storage) PackedCommands(nullptr);
+    const size_t header = CommandBase::align(sizeof(PackedCommands));
+    EXPECT_EQ(header, run->getSize());
+    EXPECT_LE(run->getSize(), PackedCommands::getMaxOverhead());
+
+    // the RasterStates are stored once, until the table is full
+    Driver::RasterState states[PackedCommands::MAX_RASTER_STATES + 1];
+    for (size_t i = 0; i < PackedCommands::MAX_RASTER_STATES + 1; i++) {
+        states[i].u = uint32_t(i + 1);
+    }
+    for (size_t i = 0; i < PackedCommands::MAX_RASTER_STATES; i++) {
+        EXPECT_EQ(i, run->getRasterStateIndex(states[i]));
+        EXPECT_EQ(i, run->getRasterStateIndex(states[i]));
+        EXPECT_EQ(states[i], run->getRasterState(uint8_t(i)));
+    }
+    EXPECT_EQ(uint8_t(PackedCommands::INLINE_RASTER_STATE),
+            run->getRasterStateIndex(states[PackedCommands::MAX_RASTER_STATES]));
+
+    // the commands are written unaligned, the run is padded as a whole
+    uint8_t* p = run->append(sizeof(uint8_t) + sizeof(uint32_t));
+    p = PackedCommands::write(p, uint8_t(7));
+    PackedCommands::write(p, uint32_t(0x12345678));
+    EXPECT_EQ(header + CommandBase::align(1), run->getSize());
+    run->append(CommandBase::align(1) - 5);
+    EXPECT_EQ(header + CommandBase::align(1), run->getSize());
+    EXPECT_EQ(run->begin() + CommandBase::align(1), run->end());
+
+    uint8_t a;
+    uint32_t b;
+    uint8_t const* q = PackedCommands::read(run->begin(), a);
+    q = PackedCommands::read(q, b);
+    EXPECT_EQ(7u, a);
+    EXPECT_EQ(0x12345678u, b);
+    EXPECT_EQ(run->begin() + 5, q);
+}
+
+// counts the draws executed by CommandBundleSegments, instead of executing them
+static uint32_t sExecutedDrawCount = 0;
+static void countDraw(Driver&, CommandBase*, intptr_t* next) noexcept {
+    sExecutedDrawCount++;
+    *next = intptr_t(CommandStream::getCommandSize<decltype(&Driver::draw), &Driver::draw>());
+}
+
+TEST(FilamentTest, CommandBundleSegments) {
+    Driver* const driver = NoopDriver::create();
+    JobSystem js;
+    js.adopt();
+
+    // the draws aren't packed, so that each one is a command
+    Dispatcher dispatcher = driver->getDispatcher();
+    dispatcher.draw_ = countDraw;
+    dispatcher.packed_ = nullptr;
+    std::vector<std::max_align_t> storage(CircularBuffer::BLOCK_SIZE / sizeof(std::max_align_t));
+    CircularBuffer buffer(storage.data(), CircularBuffer::BLOCK_SIZE);
+    CommandStream stream(*driver, buffer, &dispatcher);
+
+    // two segments of 1 and 2 draws, each with room for the jump that ends it
+    constexpr size_t DRAW = CommandStream::getCommandSize<
+            decltype(&Driver::draw), &Driver::draw>();
+    constexpr size_t JUMP = CommandBase::align(sizeof(NoopCommand));
+    const size_t offsets[] = { 0, DRAW + JUMP, 4 * DRAW + 2 * JUMP };
+    CommandBundle bundle;
+    bundle.reserveSegments(stream, offsets, 2);
+    for (size_t i = 0; i < 2; i++) {
+        bundle.recordSegment(stream, i, [i](CommandStream& segment) {
+            for (size_t d = 0; d <= i; d++) {
+                segment.draw({}, {}, {}, 1);
+            }
+        });
+    }
+    EXPECT_TRUE(bundle.canReplay(stream));
+    EXPECT_EQ(offsets[2], bundle.size());
+
+    // The segments are replayed like the segments of a pass recorded directly, the driver
+    // executes them with executeSegments(), e.g. in secondary command buffers with Vulkan.
+    // Here they're executed in order, since the commands aren't dispatched to the driver.
+    // Nothing is known of the bindings after they've executed.
+    Driver::UniformBufferHandle ub(0);
+    void* const begin = buffer.getHead();
+    stream.bindUniforms(0, ub);
+    bundle.replay(stream, js);
+    stream.bindUniforms(0, ub);
+    bundle.replay(stream, js);
+    stream.jump(nullptr);
+    EXPECT_EQ(0u, stream.getEliminatedCommandCount());
+
+    // the copies end where they are, the second one at a different offset from the first
+    sExecutedDrawCount = 0;
+    stream.execute(begin);
+    EXPECT_EQ(6u, sExecutedDrawCount);
+
+    // a bundle can't be replayed with another dispatcher, e.g. the driver's own
+    CircularBuffer otherBuffer(storage.data(), CircularBuffer::BLOCK_SIZE);
+    CommandStream other(*driver, otherBuffer);
+    EXPECT_FALSE(bundle.canReplay(other));
+
+    js.emancipate();
+    delete driver;
+}
+
+TEST(FilamentTest, CommandBufferQueueSubmit) {
+    CommandBufferQueue queue(CircularBuffer::BLOCK_SIZE, 4 * CircularBuffer::BLOCK_SIZE);
+    CircularBuffer& buffer = queue.getCircularBuffer();
+
+    // a slice flushed by the producer, then commands submitted by another thread
+    new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    queue.flush();
+    void* const block = malloc(sizeof(NoopCommand));
+    new(block) NoopCommand(nullptr);
+    queue.submit(block, static_cast<char*>(block) + sizeof(NoopCommand));
+
+    // the slices come in the order they were queued
+    auto slices = queue.waitForCommands();
+    ASSERT_EQ(2u, slices.size());
+    EXPECT_NE(block, slices[0].begin);
+    EXPECT_EQ(block, slices[1].begin);
+
+    // the submitted block is freed, the space of the flushed slice is given back
+    for (auto const& slice : slices) {
+        queue.releaseBuffer(slice);
+    }
+}
+
+TEST(FilamentTest, GpuMemoryTracker) {
+    using Type = Driver::GpuMemoryType;
+    using TextureFormat = Driver::TextureFormat;
+    using SamplerType = Driver::SamplerType;
+
+    // 64 + 16 + 4 + 2 + 1 texels of 4 bytes, 6 faces
+    EXPECT_EQ(87 * 4 * 6, DriverBase::getTextureMemorySize(TextureFormat::RGBA8,
+            SamplerType::SAMPLER_CUBEMAP, 5, 1, 16, 4, 1));
+    // 4x4 blocks of 8 bytes, the smallest levels still use a whole block
+    EXPECT_EQ((16 + 4 + 1 + 1) * 8, DriverBase::getTextureMemorySize(TextureFormat::ETC2_RGB8,
+            SamplerType::SAMPLER_2D, 4, 1, 16, 16, 1));
+    EXPECT_EQ(0, DriverBase::getTextureMemorySize(TextureFormat::RGBA8,
+            SamplerType::SAMPLER_EXTERNAL, 1, 1, 16, 16, 1));
+
+    GpuMemoryTracker tracker;
+    tracker.track(Type::TEXTURE, 1, 1000);
+    tracker.track(Type::TEXTURE, 2, 500);
+    tracker.track(Type::VERTEX_BUFFER, 1, 200);
+    tracker.track(Type::PROGRAM, 3, 0);
+
+    Driver::GpuMemoryStats stats = tracker.getStats();
+    EXPECT_EQ(1500, stats.used[size_t(Type::TEXTURE)]);
+    EXPECT_EQ(2, stats.count[size_t(Type::TEXTURE)]);
+    EXPECT_EQ(200, stats.used[size_t(Type::VERTEX_BUFFER)]);
+    EXPECT_EQ(1, stats.count[size_t(Type::PROGRAM)]);
+    EXPECT_EQ(1700, stats.highWatermark);
+
+    // resize, then destroy
+    tracker.track(Type::TEXTURE, 1, 100);
+    tracker.untrack(Type::TEXTURE, 2);
+    tracker.untrack(Type::TEXTURE, 42);
+    stats = tracker.getStats();
+    EXPECT_EQ(100, stats.used[size_t(Type::TEXTURE)]);
+    EXPECT_EQ(1, stats.count[size_t(Type::TEXTURE)]);
+    EXPECT_EQ(200, stats.used[size_t(Type::VERTEX_BUFFER)]);
+    EXPECT_EQ(1700, stats.highWatermark);
+}
+
 TEST(FilamentTest, ColorConversion) {
     // Linear to Gamma
     // 0.0 stays 0.0
@@ -517,8 +1117,8 @@ TEST(FilamentTest, FroxelData) {
     LightManager::Instance instance = engine->getLightManager().getInstance(e);
 
     FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {});
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, float4{ 0, 0, -5, 1 });
 
     {
         froxelData.froxelizeLights(*engine, {}, lights);
@@ -537,6 +1137,7 @@ TEST(FilamentTest, FroxelData) {
     {
         // light doesn't cross any froxel near or far plane
         lights.elementAt<FScene::POSITION_RADIUS>(1) = float4{ 0, 0, -3, 1 };
+        lights.elementAt<FScene::BOUNDING_SPHERE>(1) = float4{ 0, 0, -3, 1 };
 
         auto pos = lights.elementAt<FScene::POSITION_RADIUS>(1);
         EXPECT_TRUE(pos == float4( 0, 0, -3, 1 ));
@@ -558,6 +1159,488 @@ TEST(FilamentTest, FroxelData) {
     delete engine;
 }
 
+TEST(FilamentTest, FroxelOptions) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+
+    LinearAllocatorArena arena("FRenderer: per-frame allocator", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    utils::ArenaScope<LinearAllocatorArena> scope(arena);
+
+    Viewport vp(0, 0, 1280, 640);
+    mat4f p = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+
+    Froxelizer froxelData(*engine);
+    froxelData.setOptions(5, 100);
+
+    // out of range options are clamped
+    froxelData.setFroxelOptions({ .froxelCount = 1, .sliceCount = 255, .maxLightsPerFroxel = 0 });
+    EXPECT_EQ(FROXEL_SLICE_COUNT_MAX, froxelData.getFroxelOptions().sliceCount);
+    EXPECT_EQ(FROXEL_SLICE_COUNT_MAX, froxelData.getFroxelOptions().froxelCount);
+    EXPECT_EQ(1, froxelData.getFroxelOptions().maxLightsPerFroxel);
+
+    froxelData.setFroxelOptions({ .froxelCount = 2048, .sliceCount = 8, .maxLightsPerFroxel = 1 });
+    froxelData.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100);
+    EXPECT_EQ(8, froxelData.getFroxelCountZ());
+    EXPECT_LE(froxelData.getFroxelCount(), 2048);
+    EXPECT_EQ(froxelData.getFroxelCountX(), 2 * froxelData.getFroxelCountY());
+
+    // the farthest slice still ends at zLightFar
+    Froxel l = froxelData.getFroxelAt(0, 0, froxelData.getFroxelCountZ()-1);
+    EXPECT_FLOAT_EQ(        100,-l.planes[Froxel::FAR].w);
+
+    // two overlapping point lights, only one of which fits in each froxel
+    Entity e = engine->getEntityManager().create();
+    LightManager::Builder(LightManager::Type::POINT).build(*engine, e);
+    LightManager::Instance instance = engine->getLightManager().getInstance(e);
+
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -3, 1 }, {}, instance, 1, {}, float4{ 0, 0, -3, 1 });
+    lights.push_back(float4{ 0, 0, -3, 1 }, {}, instance, 1, {}, float4{ 0, 0, -3, 1 });
+
+    froxelData.froxelizeLights(*engine, {}, lights);
+    for (const auto& entry : froxelData.getFroxelBufferUser()) {
+        EXPECT_LE(entry.pointLightCount, 1);
+    }
+    View::FroxelStatistics const& stats = froxelData.getStatistics();
+    EXPECT_EQ(froxelData.getFroxelCount(), stats.froxelCount);
+    EXPECT_GT(stats.truncatedFroxelCount, 0);
+    EXPECT_EQ(0, stats.overflowFroxelCount);
+    EXPECT_GT(stats.recordCount, 0);
+
+    froxelData.terminate(engine->getDriverApi());
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, FrameGraphCulling) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    ASSERT_NE(engine, nullptr);
+    FEngine& fengine = *upcast(engine);
+    DriverApi& driver = fengine.getDriverApi();
+    RenderTargetPool pool;
+    pool.init(fengine);
+    LinearAllocatorArena arena("FrameGraph test", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::details::ArenaScope scope(arena);
+
+    struct Data {
+        FrameGraphResource rt;
+    };
+
+    bool executed[5] = {};
+    auto execute = [&executed](size_t i) {
+        return [&executed, i](FrameGraphPassResources const&, Data const&, DriverApi&) {
+            executed[i] = true;
+        };
+    };
+
+    const FrameGraphResource::Descriptor desc{ 64, 64 };
+    FrameGraph fg(scope, pool);
+    FrameGraphResource output = fg.import("output", desc, {});
+
+    // nothing reads what these two passes render, the second one is culled first
+    auto& unusedSource = fg.addPass<Data>("unused source",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                data.rt = builder.write(builder.create("a", desc));
+            }, execute(0));
+    fg.addPass<Data>("unused",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                builder.sample(unusedSource.getData().rt);
+                data.rt = builder.write(builder.create("b", desc));
+            }, execute(1));
+
+    // a source of the output is kept
+    auto& source = fg.addPass<Data>("source",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                data.rt = builder.write(builder.create("c", desc));
+            }, execute(2));
+    fg.addPass<Data>("output",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                builder.sample(source.getData().rt);
+                data.rt = builder.write(output);
+            }, execute(3));
+
+    // e.g. a read-back, never culled even though nothing reads its target
+    fg.addPass<Data>("side effect",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                data.rt = builder.write(builder.create("d", desc));
+                builder.sideEffect();
+            }, execute(4));
+
+    fg.execute(driver);
+    EXPECT_FALSE(executed[0]);
+    EXPECT_FALSE(executed[1]);
+    EXPECT_TRUE(executed[2]);
+    EXPECT_TRUE(executed[3]);
+    EXPECT_TRUE(executed[4]);
+
+    // the culled passes didn't allocate their targets
+    EXPECT_EQ(2 * 64 * 64 * FTexture::getFormatSize(TextureFormat::RGBA8), pool.getPoolSize());
+
+    pool.terminate(driver);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, FrameGraphAliasing) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    ASSERT_NE(engine, nullptr);
+    FEngine& fengine = *upcast(engine);
+    DriverApi& driver = fengine.getDriverApi();
+    RenderTargetPool pool;
+    pool.init(fengine);
+    LinearAllocatorArena arena("FrameGraph test", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::details::ArenaScope scope(arena);
+
+    struct Data {
+        FrameGraphResource input;
+        FrameGraphResource rt;
+    };
+
+    // a chain of passes each sampling the target of the previous one: "a" isn't used anymore
+    // when "c" is needed, so they share a render target of the pool
+    const FrameGraphResource::Descriptor desc{ 60, 60 };
+    FrameGraph fg(scope, pool);
+    FrameGraphResource output = fg.import("output", desc, {});
+    FrameGraphResource previous;
+    size_t widths[4] = {};
+    const char* const names[3] = { "a", "b", "c" };
+    for (size_t i = 0; i < 4; i++) {
+        fg.addPass<Data>("chain",
+                [&](FrameGraph::Builder& builder, Data& data) {
+                    if (previous.isValid()) {
+                        data.input = builder.sample(previous);
+                    }
+                    data.rt = builder.write(i < 3 ? builder.create(names[i], desc) : output);
+                    previous = data.rt;
+                },
+                [&widths, i](FrameGraphPassResources const& resources, Data const& data,
+                        DriverApi&) {
+                    widths[i] = resources.get(data.rt).width;
+                });
+    }
+    fg.execute(driver);
+
+    // the transient targets are rounded to 32 pixels, not the imported one
+    EXPECT_EQ(64u, widths[0]);
+    EXPECT_EQ(64u, widths[1]);
+    EXPECT_EQ(64u, widths[2]);
+    EXPECT_EQ(60u, widths[3]);
+    EXPECT_EQ(2 * 64 * 64 * FTexture::getFormatSize(TextureFormat::RGBA8), pool.getPoolSize());
+
+    pool.terminate(driver);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, FrameGraphDiscardFlags) {
+    using namespace filament;
+    using namespace filament::details;
+    using namespace filament::driver;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    ASSERT_NE(engine, nullptr);
+    FEngine& fengine = *upcast(engine);
+    DriverApi& driver = fengine.getDriverApi();
+    RenderTargetPool pool;
+    pool.init(fengine);
+    LinearAllocatorArena arena("FrameGraph test", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::details::ArenaScope scope(arena);
+
+    struct Data {
+        FrameGraphResource color;
+        FrameGraphResource output;
+    };
+
+    FrameGraphPassResources::RenderTarget targets[4];
+    auto execute = [&targets](size_t i, bool color, bool output) {
+        return [&targets, i, color, output](FrameGraphPassResources const& resources,
+                Data const& data, DriverApi&) {
+            targets[i] = resources.get(color ? data.color : data.output);
+            if (color && output) {
+                targets[i + 1] = resources.get(data.output);
+            }
+        };
+    };
+
+    FrameGraphResource::Descriptor desc{ 64, 64 };
+    desc.attachments = TargetBufferFlags::COLOR_AND_DEPTH;
+    FrameGraph fg(scope, pool);
+    FrameGraphResource output = fg.import("output", { 64, 64 }, {}, TargetBufferFlags::COLOR);
+
+    // the color pass, its depth is read back by a later pass
+    auto& colorPass = fg.addPass<Data>("color",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                data.color = builder.write(builder.create("color", desc));
+            }, execute(0, true, false));
+    fg.addPass<Data>("resolve",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                data.color = builder.sample(colorPass.getData().color);
+                data.output = builder.write(output);
+            }, execute(1, true, true));
+    fg.addPass<Data>("depth read-back",
+            [&](FrameGraph::Builder& builder, Data& data) {
+                data.color = builder.read(colorPass.getData().color, TargetBufferFlags::DEPTH);
+                builder.sideEffect();
+            }, execute(3, true, false));
+
+    fg.execute(driver);
+
+    // first write: nothing to load, the color is sampled and the depth read later
+    EXPECT_EQ(TargetBufferFlags::ALL, targets[0].discardStart);
+    EXPECT_EQ(TargetBufferFlags::STENCIL, targets[0].discardEnd);
+    // a pass that only reads a target doesn't discard anything in it
+    EXPECT_EQ(TargetBufferFlags::NONE, targets[1].discardStart);
+    EXPECT_EQ(TargetBufferFlags::NONE, targets[1].discardEnd);
+    EXPECT_EQ(TargetBufferFlags::NONE, targets[3].discardStart);
+    EXPECT_EQ(TargetBufferFlags::NONE, targets[3].discardEnd);
+    // the imported target starts with its own discard flags, and keeps its attachments
+    EXPECT_EQ(TargetBufferFlags::COLOR, targets[2].discardStart);
+    EXPECT_EQ(TargetBufferFlags::DEPTH_AND_STENCIL, targets[2].discardEnd);
+
+    pool.terminate(driver);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, FenceFileDescriptor) {
+    using namespace filament;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    ASSERT_NE(engine, nullptr);
+
+    Fence* fence = engine->createFence(Fence::Type::SOFT);
+    int fd = fence->getFileDescriptor();
+#if defined(__linux__)
+    ASSERT_GE(fd, 0);
+    // the same file descriptor is returned each time, and polls readable once flushed
+    EXPECT_EQ(fd, fence->getFileDescriptor(Fence::Mode::DONT_FLUSH));
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    EXPECT_EQ(1, poll(&pfd, 1, 5000));
+    EXPECT_TRUE(pfd.revents & POLLIN);
+    EXPECT_EQ(Fence::FenceStatus::CONDITION_SATISFIED, fence->wait(Fence::Mode::DONT_FLUSH, 0));
+#else
+    EXPECT_EQ(-1, fd);
+#endif
+    engine->destroy(fence);
+
+    // the noop driver doesn't have native fences
+    fence = engine->createFence(Fence::Type::HARD);
+    EXPECT_EQ(-1, fence->getFileDescriptor());
+    engine->destroy(fence);
+
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, BatchDestroy) {
+    using namespace filament;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    ASSERT_NE(engine, nullptr);
+    const size_t heapUsed = engine->getMemoryStats().heapUsed;
+
+    constexpr size_t COUNT = 16;
+    VertexBuffer* vertexBuffers[COUNT + 1] = {};    // the last one stays null
+    Texture* textures[COUNT] = {};
+    MaterialInstance* instances[COUNT] = {};
+    utils::Entity entities[COUNT];
+    utils::EntityManager::get().create(COUNT, entities);
+    for (size_t i = 0; i < COUNT; i++) {
+        vertexBuffers[i] = VertexBuffer::Builder()
+                .vertexCount(3)
+                .bufferCount(1)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .build(*engine);
+        textures[i] = Texture::Builder().width(4).height(4).build(*engine);
+        instances[i] = engine->getDefaultMaterial()->createInstance();
+        engine->getTransformManager().create(entities[i]);
+    }
+
+    engine->destroy(vertexBuffers, COUNT + 1);
+    engine->destroy(textures, COUNT);
+    engine->destroy(instances, COUNT);
+    engine->destroy(entities, COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        EXPECT_FALSE(engine->getTransformManager().hasComponent(entities[i]));
+    }
+    EXPECT_EQ(heapUsed, engine->getMemoryStats().heapUsed);
+
+    // runs the destroyHandles() commands
+    Fence::waitAndDestroy(engine->createFence());
+    utils::EntityManager::get().destroy(COUNT, entities);
+
+    // A buffer created after destroyHandles() can get the id of a destroyed one (the NOOP backend
+    // gives the same id to all of them), binding it isn't dropped as redundant.
+    {
+        using namespace filament::details;
+        FEngine::DriverApi& driver = upcast(engine)->getDriverApi();
+        Driver::UniformBufferHandle ub = driver.createUniformBuffer(16);
+        Driver::SamplerBufferHandle sb = driver.createSamplerBuffer(1);
+        driver.bindUniforms(0, ub);
+        driver.bindSamplers(0, sb);
+        const uint32_t eliminated = driver.getEliminatedCommandCount();
+        {
+            DestroyBatch batch(driver, 2);
+            batch.add(ub);
+            batch.add(sb);
+        }
+        Driver::UniformBufferHandle recreatedUb = driver.createUniformBuffer(16);
+        Driver::SamplerBufferHandle recreatedSb = driver.createSamplerBuffer(1);
+        EXPECT_EQ(ub.getId(), recreatedUb.getId());
+        EXPECT_EQ(sb.getId(), recreatedSb.getId());
+        driver.bindUniforms(0, recreatedUb);
+        driver.bindSamplers(0, recreatedSb);
+        EXPECT_EQ(eliminated, driver.getEliminatedCommandCount());
+        driver.destroyUniformBuffer(recreatedUb);
+        driver.destroySamplerBuffer(recreatedSb);
+    }
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, SceneSnapshots) {
+    using namespace filament;
+    using namespace filament::details;
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    ASSERT_NE(engine, nullptr);
+    Scene* scene = engine->createScene();
+
+    constexpr size_t COUNT = 8;
+    utils::Entity entities[COUNT];
+    utils::EntityManager::get().create(COUNT, entities);
+    for (size_t i = 0; i < COUNT; i++) {
+        engine->getTransformManager().create(entities[i]);
+        LightManager::Builder(LightManager::Type::POINT)
+                .position({ float(i), 0, 0 })
+                .falloff(1.0f)
+                .build(*engine, entities[i]);
+        scene->addEntity(entities[i]);
+    }
+
+    // the second snapshot is a copy of the first one, in the same order
+    FScene* const s = upcast(scene);
+    s->prepare(math::mat4{}, 2);
+    FScene::LightSoa const& lights = s->getLightData(0);
+    FScene::LightSoa const& copy = s->getLightData(1);
+    ASSERT_EQ(COUNT + FScene::DIRECTIONAL_LIGHTS_COUNT, lights.size());
+    ASSERT_EQ(lights.size(), copy.size());
+    EXPECT_NE(lights.data<FScene::POSITION_RADIUS>(), copy.data<FScene::POSITION_RADIUS>());
+    for (size_t i = 0; i < lights.size(); i++) {
+        EXPECT_EQ(lights.elementAt<FScene::LIGHT_INSTANCE>(i),
+                copy.elementAt<FScene::LIGHT_INSTANCE>(i));
+        EXPECT_EQ(lights.elementAt<FScene::POSITION_RADIUS>(i),
+                copy.elementAt<FScene::POSITION_RADIUS>(i));
+    }
+    EXPECT_EQ(s->getRenderableData(0).size(), s->getRenderableData(1).size());
+
+    // a view trimming its snapshot doesn't affect the other one
+    s->getLightData(1).resize(FScene::DIRECTIONAL_LIGHTS_COUNT);
+    EXPECT_EQ(COUNT + FScene::DIRECTIONAL_LIGHTS_COUNT, lights.size());
+    s->prepare(math::mat4{}, 2);
+    EXPECT_EQ(lights.size(), copy.size());
+
+    engine->destroy(entities, COUNT);
+    engine->destroy(scene);
+    utils::EntityManager::get().destroy(COUNT, entities);
+    Engine::destroy(&engine);
+}
+
+TEST(FilamentTest, DepthPrepassSelector) {
+    using filament::details::DepthPrepassSelector;
+    using duration = DepthPrepassSelector::duration;
+    DepthPrepassSelector selector(true);
+
+    // renders frames with the given color pass costs, the GPU timings are 3 frames late
+    uint32_t frame = 0;
+    bool choices[256];
+    auto run = [&](float prepassCost, float noPrepassCost, size_t count) {
+        size_t withPrepass = 0;
+        for (size_t i = 0; i < count; i++, frame++) {
+            choices[frame % 256] = selector.select(frame);
+            EXPECT_EQ(choices[frame % 256], selector.hasDepthPrepass());
+            if (frame >= 3) {
+                const bool prepass = choices[(frame - 3) % 256];
+                selector.addMeasurement(frame - 3,
+                        duration(prepass ? prepassCost : noPrepassCost));
+            }
+            withPrepass += choices[frame % 256];
+        }
+        return withPrepass;
+    };
+
+    // the other strategy is probed, but most frames keep the cheapest one
+    size_t withPrepass = run(8.0f, 10.0f, 256);
+    EXPECT_GT(withPrepass, 256 - 32);
+    EXPECT_LT(withPrepass, 256);
+
+    // less than the hysteresis doesn't switch
+    withPrepass = run(8.0f, 7.9f, 256);
+    EXPECT_GT(withPrepass, 256 - 32);
+
+    // the first probes that measure a better strategy switch to it
+    run(8.0f, 6.0f, 128);
+    withPrepass = run(8.0f, 6.0f, 256);
+    EXPECT_LT(withPrepass, 32);
+    EXPECT_GT(withPrepass, 0);
+}
+
+TEST(FilamentTest, RenderPassCommandCache) {
+    using filament::details::FScene;
+    using filament::details::RenderPass;
+    using Command = RenderPass::Command;
+
+    FScene::RenderableSoa soa;
+    soa.setCapacity(4);
+    soa.resize(3);
+    for (uint32_t i = 0; i < 3; i++) {
+        soa.elementAt<FScene::RENDERABLE_INSTANCE>(i) = EntityInstance<RenderableManager>(i + 1);
+        soa.elementAt<FScene::UNIFORMS_OFFSET>(i) = i * 256;
+        soa.elementAt<FScene::BONES_OFFSET>(i) = 0;
+        soa.elementAt<FScene::VISIBLE_MASK>(i) = 1;
+        soa.elementAt<FScene::PRIMITIVES>(i) = {};
+    }
+    const Range<uint32_t> vr{ 0, 3 };
+
+    Command commands[2];
+    commands[0].key = 1;
+    commands[1].key = uint64_t(RenderPass::Pass::SENTINEL);
+
+    RenderPass::CommandCache cache;
+    RenderPass::CommandCache::Inputs inputs;
+    inputs.cameraPosition = { 1, 2, 3 };
+
+    // the commands are only kept once the inputs didn't change for two frames
+    EXPECT_FALSE(cache.update(inputs, soa, vr));
+    cache.store(commands, commands + 2);
+    EXPECT_EQ(0, cache.size());
+    EXPECT_FALSE(cache.update(inputs, soa, vr));
+    cache.store(commands, commands + 2);
+    EXPECT_EQ(2, cache.size());
+    EXPECT_TRUE(cache.update(inputs, soa, vr));
+    EXPECT_EQ(1, cache.data()[0].key);
+
+    // any change of the renderables drops them
+    soa.elementAt<FScene::UNIFORMS_OFFSET>(1) = 1024;
+    EXPECT_FALSE(cache.update(inputs, soa, vr));
+    EXPECT_EQ(0, cache.size());
+    cache.store(commands, commands + 2);
+    EXPECT_TRUE(cache.update(inputs, soa, vr));
+
+    // and so does a change of the visible renderables or of the camera
+    EXPECT_FALSE(cache.update(inputs, soa, { 0, 2 }));
+    cache.store(commands, commands + 2);
+    EXPECT_TRUE(cache.update(inputs, soa, { 0, 2 }));
+    inputs.cameraForward = { 0, 0, -1 };
+    EXPECT_FALSE(cache.update(inputs, soa, { 0, 2 }));
+}
+
 TEST(FilamentTest, RangeSet) {
 
     utils::RangeSet<4> rs;
@@ -806,6 +1889,98 @@ TEST(FilamentTest, RangeSet) {
     EXPECT_EQ(250, b[2].end);
 }
 
+TEST(FilamentTest, ColorGrading) {
+    using filament::ColorGrading;
+    View::ColorGradingOptions options;
+
+    // without grading, only the tone mapping and the OECF: black stays black, white saturates
+    EXPECT_EQ(0.0f, ColorGrading::evaluate(options, float3(0.0f)).r);
+    EXPECT_NEAR(1.0f, ColorGrading::evaluate(options, float3(100.0f)).g, 1e-5f);
+    const float3 gray = ColorGrading::evaluate(options, float3(0.18f));
+    EXPECT_GT(gray.b, 0.5f);
+    EXPECT_LT(gray.b, 0.6f);
+
+    // the options are ignored until enabled
+    options.exposure = 1.0f;
+    EXPECT_EQ(gray.r, ColorGrading::evaluate(options, float3(0.18f)).r);
+    options.enabled = true;
+    EXPECT_NEAR(ColorGrading::evaluate(options, float3(0.18f)).r,
+            ColorGrading::evaluate({}, float3(0.36f)).r, 1e-5f);
+
+    // no saturation, gray
+    options.exposure = 0.0f;
+    options.saturation = 0.0f;
+    const float3 red = ColorGrading::evaluate(options, float3{ 0.5f, 0.0f, 0.0f });
+    EXPECT_NEAR(red.r, red.g, 1e-5f);
+    EXPECT_NEAR(red.r, red.b, 1e-5f);
+    EXPECT_GT(red.r, 0.0f);
+}
+
+TEST(FilamentTest, RasterStateMasks) {
+    using RasterState = filament::Driver::RasterState;
+
+    // each field only changes the bits of its mask, and all of them
+    auto bitsOf = [](void(*set)(RasterState&)) {
+        RasterState zero;
+        zero.u = 0;
+        RasterState rs(zero);
+        set(rs);
+        return rs.u ^ zero.u;
+    };
+    EXPECT_EQ(uint32_t(RasterState::CULLING_MASK), bitsOf([](RasterState& rs) {
+        rs.culling = RasterState::CullingMode::FRONT_AND_BACK; }));
+    EXPECT_EQ(uint32_t(RasterState::BLENDING_MASK), bitsOf([](RasterState& rs) {
+        rs.blendEquationRGB = RasterState::BlendEquation(0x7);
+        rs.blendEquationAlpha = RasterState::BlendEquation(0x7);
+        rs.blendFunctionSrcRGB = RasterState::BlendFunction(0xF);
+        rs.blendFunctionSrcAlpha = RasterState::BlendFunction(0xF);
+        rs.blendFunctionDstRGB = RasterState::BlendFunction(0xF);
+        rs.blendFunctionDstAlpha = RasterState::BlendFunction(0xF); }));
+    EXPECT_EQ(uint32_t(RasterState::DEPTH_WRITE_MASK), bitsOf([](RasterState& rs) {
+        rs.depthWrite = true; }));
+    EXPECT_EQ(uint32_t(RasterState::DEPTH_FUNC_MASK), bitsOf([](RasterState& rs) {
+        rs.depthFunc = RasterState::DepthFunc(0x7); }));
+    EXPECT_EQ(uint32_t(RasterState::COLOR_WRITE_MASK), bitsOf([](RasterState& rs) {
+        rs.colorWrite = true; }));
+    EXPECT_EQ(uint32_t(RasterState::ALPHA_TO_COVERAGE_MASK), bitsOf([](RasterState& rs) {
+        rs.alphaToCoverage = true; }));
+}
+
+TEST(FilamentTest, TerrainLevels) {
+    constexpr int32_t m = 32;
+    constexpr size_t count = 6;
+    const double2 viewers[] = { { 0, 0 }, { 0.5, -0.5 }, { 17.25, 3 }, { -1000.75, 123.5 } };
+    for (double2 viewer : viewers) {
+        FTerrain::Level levels[count];
+        FTerrain::computeLevels(viewer, uint32_t(m), levels, count);
+        for (size_t l = 0; l < count; l++) {
+            // the levels are centered on the viewer, within one sample
+            const double2 center =
+                    (double2(levels[l].origin) + double(2 * m - 1)) * double(1u << l);
+            EXPECT_LE(std::abs(center.x - viewer.x), double(1u << l));
+            EXPECT_LE(std::abs(center.y - viewer.y), double(1u << l));
+            EXPECT_TRUE(levels[l].mask & (1u << FTerrain::RING));
+            EXPECT_EQ(l == 0, bool(levels[l].mask & (1u << FTerrain::CENTER)));
+            if (l == 0) {
+                continue;
+            }
+
+            // the finer level is on the samples of this one, in its hole, on the other side of
+            // the trims
+            const int2 finer = levels[l - 1].origin;
+            EXPECT_EQ(0, finer.x & 1);
+            EXPECT_EQ(0, finer.y & 1);
+            const int2 offset = finer / 2 - levels[l].origin;
+            EXPECT_TRUE(offset.x == m - 1 || offset.x == m);
+            EXPECT_TRUE(offset.y == m - 1 || offset.y == m);
+            EXPECT_EQ(offset.x == m - 1, bool(levels[l].mask & (1u << FTerrain::TRIM_X_HIGH)));
+            EXPECT_EQ(offset.x == m, bool(levels[l].mask & (1u << FTerrain::TRIM_X_LOW)));
+            EXPECT_EQ(offset.y == m - 1, bool(levels[l].mask & (1u << FTerrain::TRIM_Y_HIGH)));
+            EXPECT_EQ(offset.y == m, bool(levels[l].mask & (1u << FTerrain::TRIM_Y_LOW)));
+        }
+    }
+}
+
 
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
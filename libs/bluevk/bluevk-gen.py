@@ -88,8 +88,16 @@ namespace bluevk {
     // Returns false if BlueGL could not find the Vulkan shared library.
     bool initialize();
 
+    // Loads the instance-level entry points. Must be called after vkCreateInstance().
     void bindInstance(VkInstance instance);
 
+    // Loads the device-level entry points directly from the device's driver with
+    // vkGetDeviceProcAddr, which bypasses the loader's dispatch. Must be called after
+    // vkCreateDevice() and before any device-level entry point is used. Only the functions of the
+    // core API and of the extensions enabled on the device are available, the others are null.
+    // The entry points are global, so BlueVK supports a single device at a time.
+    void bindDevice(VkDevice device);
+
 }; // namespace bluevk
 
 %(FUNCTION_POINTERS)s
@@ -133,7 +141,10 @@ bool bluevk::initialize() {
 
 void bluevk::bindInstance(VkInstance instance) {
     loadInstanceFunctions(instance, vkGetInstanceProcAddrWrapper);
-    loadDeviceFunctions(instance, vkGetInstanceProcAddrWrapper);
+}
+
+void bluevk::bindDevice(VkDevice device) {
+    loadDeviceFunctions(device, vkGetDeviceProcAddrWrapper);
 }
 
 static PFN_vkVoidFunction vkGetInstanceProcAddrWrapper(void* context, const char* name) {
@@ -52,7 +52,10 @@ bool bluevk::initialize() {
 
 void bluevk::bindInstance(VkInstance instance) {
     loadInstanceFunctions(instance, vkGetInstanceProcAddrWrapper);
-    loadDeviceFunctions(instance, vkGetInstanceProcAddrWrapper);
+}
+
+void bluevk::bindDevice(VkDevice device) {
+    loadDeviceFunctions(device, vkGetDeviceProcAddrWrapper);
 }
 
 static PFN_vkVoidFunction vkGetInstanceProcAddrWrapper(void* context, const char* name) {
@@ -31,6 +31,15 @@ enum VertexAttribute : uint8_t {
     UV1             = 4, // texture coordinates (float2)
     BONE_INDICES    = 5, // indices of 4 bones, as unsigned integers (uvec4)
     BONE_WEIGHTS    = 6, // weights of the 4 bones (normalized float4)
+    // -- 7 is unused --
+    MORPH_POSITION_0 = 8,   // XYZ position delta of the morph targets (float3)
+    MORPH_POSITION_1 = 9,
+    MORPH_POSITION_2 = 10,
+    MORPH_POSITION_3 = 11,
+    MORPH_TANGENTS_0 = 12,  // tangents delta of the morph targets, added to TANGENTS (float4)
+    MORPH_TANGENTS_1 = 13,
+    MORPH_TANGENTS_2 = 14,
+    MORPH_TANGENTS_3 = 15,
 };
 
 // Binding points for uniform buffers and sampler buffers.
@@ -49,8 +58,11 @@ namespace BindingPoints {
 static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
         "Dynamically sized sampler buffer must be the last binding point.");
 
-constexpr uint32_t ATTRIBUTE_INDEX_COUNT = 7;
-constexpr size_t MAX_ATTRIBUTE_BUFFERS_COUNT = 8; // FIXME: should match Driver::MAX_ATTRIBUTE_BUFFER_COUNT
+constexpr uint32_t ATTRIBUTE_INDEX_COUNT = 16;
+constexpr size_t MAX_ATTRIBUTE_BUFFERS_COUNT = 16; // FIXME: should match Driver::MAX_ATTRIBUTE_BUFFER_COUNT
+
+// Morph targets blended by the vertex shaders, their deltas are the MORPH_* attributes.
+constexpr size_t CONFIG_MAX_MORPH_TARGETS = 4;
 
 // This value is limited by UBO size, ES3.0 only guarantees 16 KiB.
 // Values <= 256, use less CPU and GPU resources.
@@ -61,6 +73,14 @@ constexpr size_t CONFIG_MAX_LIGHT_INDEX = CONFIG_MAX_LIGHT_COUNT - 1;
 // 256 is enough, but we could use 512 if needed
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// Cascades of the directional light's shadow map, they're laid out as 2x2 tiles of the
+// shadow map texture.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
+// Spot lights casting shadows, their shadow maps are tiles of the shadow atlas. The lights UBO
+// is full, so their transforms are in the per-view UBO.
+constexpr size_t CONFIG_MAX_SHADOWED_SPOT_LIGHTS = 8;
+
 // can't really use std::underlying_type<AttributeIndex>::type because the driver takes a uint32_t
 using AttributeBitset = utils::bitset32;
 
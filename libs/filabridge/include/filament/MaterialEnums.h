@@ -84,12 +84,26 @@ namespace filament {
         // when adding more entries, make sure to update VERTEX_DOMAIN_COUNT
     };
 
-    static constexpr size_t POST_PROCESS_STAGES_COUNT = 4;
+    static constexpr size_t POST_PROCESS_STAGES_COUNT = 18;
     enum class PostProcessStage : uint8_t {
         TONE_MAPPING_OPAQUE,           // Tone mapping post-process
         TONE_MAPPING_TRANSLUCENT,      // Tone mapping post-process
         ANTI_ALIASING_OPAQUE,          // Anti-aliasing stage
         ANTI_ALIASING_TRANSLUCENT,     // Anti-aliasing stage
+        TEMPORAL_UPSAMPLING,           // Temporal upsampling stage, for dynamic resolution
+        IBL_PREFILTER_SPECULAR,        // GGX prefiltering of a cubemap face, for IndirectLight
+        IBL_PREFILTER_SH,              // Irradiance SH projection of a cubemap, for IndirectLight
+        TONE_MAPPING_OPAQUE_IN_PLACE,      // Tone mapping of the color attachment, with
+        TONE_MAPPING_TRANSLUCENT_IN_PLACE, // framebuffer fetch, at the end of the color pass
+        TRANSPARENCY_RESOLVE,          // Composition of the order-independent transparency
+        SHADOW_MOMENTS_BLUR,           // Separable blur of the variance shadows' moments
+        TONE_MAPPING_ANTI_ALIASING_OPAQUE,      // Tone mapping, FXAA and upscaling fused in a
+        TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT, // single pass
+        AUTO_EXPOSURE_LUMINANCE,       // Log2 of the luminance, downsampled, for auto-exposure
+        AUTO_EXPOSURE_REDUCE,          // Average of 4x4 blocks of log2 luminance
+        AUTO_EXPOSURE_ADAPTATION,      // Temporal adaptation of the auto-exposure
+        MIPMAP_DOWNSAMPLE,             // Tent filtered level of a texture, from the level above
+        DEBUG_HEATMAP,                 // False colors of the debug visualizations, see Engine
     };
 
     static constexpr size_t MATERIAL_VARIABLES_COUNT = 4;
@@ -94,6 +94,10 @@ public:
     // negative value if name doesn't exist or Panic if exceptions are enabled
     ssize_t getUniformOffset(const char* name, size_t index) const;
 
+    // information record for the uniform of the given name, nullptr if it doesn't exist or
+    // Panic if exceptions are enabled
+    UniformInfo const* getUniformInfo(const char* name) const;
+
     bool hasUniform(const char* name) const noexcept {
         return mInfoMap.find(name) != mInfoMap.end();
     }
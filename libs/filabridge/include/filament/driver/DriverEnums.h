@@ -42,6 +42,7 @@ enum class Backend : uint8_t {
     DEFAULT = 0,  //!< Automatically selects an appropriate driver for the platform.
     OPENGL = 1,   //!< Selects the OpenGL driver (which supports OpenGL ES as well).
     VULKAN = 2,   //!< Selects the Vulkan driver if the platform supports it.
+    NOOP = 3,     //!< Selects the no-op driver, for testing and benchmarking the CPU side.
 };
 
 /**
@@ -86,11 +87,29 @@ struct RenderPassParams {
     double clearDepth = 1.0;
     uint32_t clearStencil = 0;
     uint32_t reserved1 = 0;
+    // Foveation of the color attachment (28 bytes), only honored by some backends.
+    // The focal points are in normalized device coordinates, a foveaGain of 0 disables it.
+    math::float2 focalPoints[2] = {};
+    math::float2 foveaGain = {};
+    float foveaArea = 0.0f;
+    uint8_t focalPointCount = 0;
     // Extra RenderPass-only flags stashed in the "clear" field.
     static const uint8_t IGNORE_SCISSOR = 0x10;
     static const uint8_t IGNORE_VIEWPORT = 0x20;
 };
 
+/**
+ * One draw of DriverApi::drawIndirect(), laid out like the commands of
+ * glMultiDrawElementsIndirect and vkCmdDrawIndexedIndirect (20 bytes).
+ */
+struct DrawIndirectCommand {
+    uint32_t count;             // number of indices
+    uint32_t instanceCount;
+    uint32_t firstIndex;        // from the start of the index buffer
+    int32_t baseVertex;
+    uint32_t baseInstance;      // must be 0, OpenGL ES doesn't support it
+};
+
 /**
  * Error codes for Fence::wait()
  * @see Fence, Fence::wait()
@@ -103,6 +122,22 @@ enum class FenceStatus : int8_t {
 
 static constexpr uint64_t FENCE_WAIT_FOR_EVER = uint64_t(-1);
 
+/**
+ * Type of a Stream
+ * @see Stream
+ */
+enum class StreamType {
+    NATIVE,     //!< Not synchronized but copy-free, e.g. a SurfaceTexture. Good for video.
+    TEXTURE_ID, //!< Synchronized but incurs a copy every frame, GL only.
+    ACQUIRED,   //!< Synchronized and copy-free, frames are pushed with Stream::setAcquiredImage().
+};
+
+/**
+ * Called once an image pushed to an ACQUIRED Stream is no longer in use by the GPU.
+ * @see Stream::setAcquiredImage()
+ */
+using StreamCallback = void(*)(void* image, void* user);
+
 static constexpr size_t SHADER_MODEL_COUNT = 3;
 enum class ShaderModel : uint8_t {
     // For testing
@@ -154,6 +189,8 @@ enum class SamplerType : uint8_t {
     SAMPLER_2D,         //!< 2D texture
     SAMPLER_CUBEMAP,    //!< Cube map texture
     SAMPLER_EXTERNAL,   //!< External texture
+    SAMPLER_2D_ARRAY,   //!< Array of 2D textures, the depth of the texture is the number of layers
+    SAMPLER_3D,         //!< 3D texture
 };
 
 enum class SamplerFormat : uint8_t {
@@ -193,9 +230,18 @@ enum class ElementType : uint8_t {
     HALF4,
 };
 
-enum class Usage : uint8_t {
-    STATIC,
-    DYNAMIC
+//! How often the content of a vertex or index buffer is updated
+enum class BufferUsage : uint8_t {
+    STATIC,     //!< content is set once, or rarely
+    DYNAMIC,    //!< content is updated often, and drawn several times between updates
+    STREAM      //!< content is updated every time it's drawn, e.g. every frame
+};
+
+//! How a compute shader accesses a texture level bound as an image
+enum class ImageAccess : uint8_t {
+    READ_ONLY,
+    WRITE_ONLY,
+    READ_WRITE
 };
 
 enum class CullingMode : uint8_t {
@@ -272,6 +318,10 @@ enum class CompressedPixelDataType : uint16_t {
     SRGB8_ALPHA8_ASTC_10x10,
     SRGB8_ALPHA8_ASTC_12x10,
     SRGB8_ALPHA8_ASTC_12x12,
+
+    // BPTC formats are available on desktop, and with a GLES extension
+    RGBA_BPTC_UNORM, SRGB_ALPHA_BPTC_UNORM,
+    RGB_BPTC_SIGNED_FLOAT, RGB_BPTC_UNSIGNED_FLOAT,
 };
 
 /** Supported texel formats
@@ -425,6 +475,10 @@ enum class TextureFormat : uint16_t {
     SRGB8_ALPHA8_ASTC_10x10,
     SRGB8_ALPHA8_ASTC_12x10,
     SRGB8_ALPHA8_ASTC_12x12,
+
+    // BPTC formats are available on desktop, and with a GLES extension
+    RGBA_BPTC_UNORM, SRGB_ALPHA_BPTC_UNORM,
+    RGB_BPTC_SIGNED_FLOAT, RGB_BPTC_UNSIGNED_FLOAT,
 };
 
 enum class TextureUsage : uint8_t {
@@ -442,6 +496,16 @@ static constexpr bool isS3TCCompression(TextureFormat format) noexcept {
     return format >= TextureFormat::DXT1_RGB && format <= TextureFormat::DXT5_RGBA;
 }
 
+static constexpr bool isASTCCompression(TextureFormat format) noexcept {
+    return format >= TextureFormat::RGBA_ASTC_4x4 &&
+            format <= TextureFormat::SRGB8_ALPHA8_ASTC_12x12;
+}
+
+static constexpr bool isBPTCCompression(TextureFormat format) noexcept {
+    return format >= TextureFormat::RGBA_BPTC_UNORM &&
+            format <= TextureFormat::RGB_BPTC_UNSIGNED_FLOAT;
+}
+
 //! TextureCubemapFace
 enum class TextureCubemapFace : uint8_t {
     // don't change the enums values
@@ -577,6 +641,12 @@ enum ShaderType : uint8_t {
 
 static constexpr uint64_t SWAP_CHAIN_CONFIG_TRANSPARENT = 0x1;
 static constexpr uint64_t SWAP_CHAIN_CONFIG_READABLE = 0x2;
+static constexpr uint64_t SWAP_CHAIN_CONFIG_PRESENT_MAILBOX = 0x4;
+static constexpr uint64_t SWAP_CHAIN_CONFIG_PRESENT_IMMEDIATE = 0x8;
+
+// bits 8 to 11 of the flags hold the number of frames in flight, 0 lets the backend choose
+static constexpr uint64_t SWAP_CHAIN_CONFIG_FRAMES_IN_FLIGHT_SHIFT = 8;
+static constexpr uint64_t SWAP_CHAIN_CONFIG_FRAMES_IN_FLIGHT_MASK = 0xf00;
 
 } // namespace driver
 } // namespace filament
@@ -73,6 +73,11 @@ namespace filament {
         // this mask filters out the lighting variants
         static constexpr uint8_t UNLIT_MASK    = SKINNING;
 
+        // Vulkan shaders read these variant bits from boolean specialization constants, whose
+        // constant_id is the index of the bit, instead of being generated for each value. The
+        // variants that differ only by these bits share the same SPIR-V.
+        static constexpr uint8_t SPECIALIZATION_MASK = DYNAMIC_LIGHTING;
+
         static_assert((VERTEX_MASK | FRAGMENT_MASK) == VARIANT_COUNT - 1,
                 "inconsistency between vertex/fragment masks and variant count");
 
@@ -107,6 +112,16 @@ namespace filament {
             return variantKey & FRAGMENT_MASK;
         }
 
+        static constexpr uint8_t filterVariantSpecialization(uint8_t variantKey) noexcept {
+            // the specialization constants of the variant, see SPECIALIZATION_MASK
+            return variantKey & SPECIALIZATION_MASK;
+        }
+
+        static constexpr uint32_t getSpecializationConstantId(uint8_t variantBit) noexcept {
+            // the index of the bit
+            return variantBit <= 1 ? 0 : 1 + getSpecializationConstantId(uint8_t(variantBit >> 1u));
+        }
+
         static constexpr uint8_t filterVariant(uint8_t variantKey, bool isLit) noexcept {
             // special case for depth variant
             if ((variantKey & DEPTH_MASK) == DEPTH_VARIANT) {
@@ -116,6 +131,22 @@ namespace filament {
             return isLit ? variantKey : (variantKey & UNLIT_MASK);
         }
 
+        // Returns the variant to use in place of variantKey when the variants in variantFilter
+        // were filtered out of the material, i.e.: the same variant without those features.
+        static inline uint8_t filterUserVariant(
+                uint8_t variantKey, uint8_t variantFilter) noexcept {
+            // the depth variant itself can't be filtered out, only skinning can
+            if ((variantKey & DEPTH_MASK) == DEPTH_VARIANT) {
+                return variantKey & ~(variantFilter & ~DEPTH_MASK);
+            }
+            variantKey &= ~variantFilter;
+            // receiving shadows requires directional lighting, see isReserved()
+            if (!(variantKey & DIRECTIONAL_LIGHTING)) {
+                variantKey &= ~SHADOW_RECEIVER;
+            }
+            return variantKey;
+        }
+
     private:
         inline void set(bool v, uint8_t mask) noexcept {
             key = (key & ~mask) | (v ? mask : uint8_t(0));
@@ -31,6 +31,9 @@ SamplerInterfaceBlock& SibGenerator::getPerViewSib() noexcept {
             .add("froxels",       Type::SAMPLER_2D,      Format::UINT,  Precision::MEDIUM)
             .add("iblDFG",        Type::SAMPLER_2D,      Format::FLOAT, Precision::MEDIUM)
             .add("iblSpecular",   Type::SAMPLER_CUBEMAP, Format::FLOAT, Precision::MEDIUM)
+            .add("shadowAtlas",   Type::SAMPLER_2D,      Format::SHADOW,Precision::LOW)
+            .add("shadowMoments", Type::SAMPLER_2D,      Format::FLOAT, Precision::HIGH)
+            .add("irradianceVolume", Type::SAMPLER_3D,   Format::FLOAT, Precision::MEDIUM)
             .build();
     return sib;
 }
@@ -41,7 +44,12 @@ SamplerInterfaceBlock& SibGenerator::getPostProcessSib() noexcept {
     using Precision = SamplerInterfaceBlock::Precision;
     static SamplerInterfaceBlock sib = SamplerInterfaceBlock::Builder()
             .name("PostProcess")
-            .add("colorBuffer", Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
+            .add("colorBuffer",   Type::SAMPLER_2D,      Format::FLOAT, Precision::MEDIUM, false)
+            .add("historyBuffer", Type::SAMPLER_2D,      Format::FLOAT, Precision::MEDIUM, false)
+            .add("environment",   Type::SAMPLER_CUBEMAP, Format::FLOAT, Precision::HIGH,   false)
+            .add("depthBuffer",   Type::SAMPLER_2D,      Format::FLOAT, Precision::HIGH,   false)
+            .add("colorGrading",  Type::SAMPLER_3D,      Format::FLOAT, Precision::MEDIUM, false)
+            .add("autoExposure",  Type::SAMPLER_2D,      Format::FLOAT, Precision::MEDIUM, false)
             .build();
     return sib;
 }
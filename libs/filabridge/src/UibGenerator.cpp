@@ -32,7 +32,7 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("clipFromViewMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             // camera
@@ -44,8 +44,9 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("sun",                     1, UniformInterfaceBlock::Type::FLOAT4)
             .add("lightDirection",          1, UniformInterfaceBlock::Type::FLOAT3)
             .add("fParamsX",                1, UniformInterfaceBlock::Type::UINT)
-            // shadow
-            .add("shadowBias",              1, UniformInterfaceBlock::Type::FLOAT3)
+            .add("vsmExponent",             1, UniformInterfaceBlock::Type::FLOAT)
+            .add("padding0",                1, UniformInterfaceBlock::Type::FLOAT)
+            .add("orderIndependentTransparency", 1, UniformInterfaceBlock::Type::FLOAT)
             .add("oneOverFroxelDimensionY", 1, UniformInterfaceBlock::Type::FLOAT)
             // froxels
             .add("zParams",                 1, UniformInterfaceBlock::Type::FLOAT4)
@@ -60,6 +61,15 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("ev100",                   1, UniformInterfaceBlock::Type::FLOAT)
             // ibl
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
+            // shadow
+            .add("shadowCascadeSplits",     1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("shadowConstantBias",      1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("shadowNormalBias",        1, UniformInterfaceBlock::Type::FLOAT4)
+            .add("spotLightFromWorldMatrix", CONFIG_MAX_SHADOWED_SPOT_LIGHTS, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("spotShadowBias",          CONFIG_MAX_SHADOWED_SPOT_LIGHTS, UniformInterfaceBlock::Type::FLOAT4)
+            // irradiance volume
+            .add("irradianceVolumeFromWorldMatrix", 1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("irradianceVolumeParams",  1, UniformInterfaceBlock::Type::FLOAT4)
             .build();
     return uib;
 }
@@ -67,8 +77,11 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
 UniformInterfaceBlock& UibGenerator::getPerRenderableUib() noexcept {
     static UniformInterfaceBlock uib =  UniformInterfaceBlock::Builder()
             .name("ObjectUniforms")
-            .add("worldFromModelMatrix",       1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("worldFromModelNormalMatrix", 1, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
+            // the rows of an affine transform, the normal matrix is derived from it by the shaders
+            .add("worldFromModelRows",         3, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("morphWeights",               1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("textureLayer",               1, UniformInterfaceBlock::Type::UINT)
+            .add("flags",                      1, UniformInterfaceBlock::Type::UINT)
             .build();
     return uib;
 }
@@ -84,9 +97,26 @@ UniformInterfaceBlock& UibGenerator::getLightsUib() noexcept {
 UniformInterfaceBlock& UibGenerator::getPostProcessingUib() noexcept {
     static UniformInterfaceBlock uib =  UniformInterfaceBlock::Builder()
             .name("PostProcessUniforms")
-            .add("uvScale", 1, UniformInterfaceBlock::Type::FLOAT2)
-            .add("time",    1, UniformInterfaceBlock::Type::FLOAT)
-            .add("yOffset", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("uvScale",         1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("time",            1, UniformInterfaceBlock::Type::FLOAT)
+            .add("yOffset",         1, UniformInterfaceBlock::Type::FLOAT)
+            .add("reprojection",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("historySize",     1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("jitter",          1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("historyWeight",   1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblRoughness",    1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblFace",         1, UniformInterfaceBlock::Type::INT)
+            .add("iblSize",         1, UniformInterfaceBlock::Type::FLOAT)
+            .add("shadowBlurDirection", 1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("vsmExponent",     1, UniformInterfaceBlock::Type::FLOAT)
+            .add("shadowBlurFromDepth", 1, UniformInterfaceBlock::Type::INT)
+            .add("shadowBlurBounds", 1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("autoExposure",    1, UniformInterfaceBlock::Type::FLOAT)
+            .add("autoExposureHistory", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("autoExposureRange", 1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("autoExposureAdaptation", 1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("mipmapFace",      1, UniformInterfaceBlock::Type::INT)
+            .add("heatmapRange",    1, UniformInterfaceBlock::Type::FLOAT)
             .build();
     return uib;
 }
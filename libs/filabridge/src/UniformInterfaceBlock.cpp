@@ -97,6 +97,15 @@ ssize_t UniformInterfaceBlock::getUniformOffset(const char* name, size_t index)
     return mUniformsInfoList[pos->second].getBufferOffset(index);
 }
 
+UniformInterfaceBlock::UniformInfo const* UniformInterfaceBlock::getUniformInfo(
+        const char* name) const {
+    auto const& pos = mInfoMap.find(name);
+    if (!ASSERT_PRECONDITION_NON_FATAL(pos != mInfoMap.end(), "uniform named \"%s\" not found", name)) {
+        return nullptr;
+    }
+    return &mUniformsInfoList[pos->second];
+}
+
 
 uint8_t UTILS_NOINLINE UniformInterfaceBlock::baseAlignmentForType(UniformInterfaceBlock::Type type) noexcept {
     switch (type) {
@@ -77,16 +77,25 @@ enum UTILS_PUBLIC ChunkType : uint64_t {
     MaterialCullingMode = charTo64bitNum("MAT_CUMO"),
 
     MaterialHasCustomDepthShader =charTo64bitNum("MAT_CSDP"),
+    MaterialShaderCost = charTo64bitNum("MAT_COST"),
 
     MaterialVertexDomain =charTo64bitNum("MAT_VEDO"),
     MaterialInterpolation= charTo64bitNum("MAT_INTR"),
+    MaterialVariantFilterMask = charTo64bitNum("MAT_VFLT"),
 
     PostProcessVersion = charTo64bitNum("POSP_VER"),
 
     DictionaryGlsl = charTo64bitNum("DIC_GLSL"),
+    DictionaryGlslCompressed = charTo64bitNum("DIC_GLSZ"),
     DictionarySpirv = charTo64bitNum("DIC_SPIR"),
 };
 
+// Compression applied to the payload of a dictionary chunk.
+enum class CompressionScheme : uint32_t {
+    NONE = 0,
+    LZ4 = 1,        // LZ4 block format, preceded by the uncompressed size
+};
+
 } // namespace filamat
 
 // Custom specialization of std::hash can be injected in namespace std.
@@ -42,7 +42,17 @@ struct MaterialParserDetails;
 
 class UTILS_PUBLIC MaterialParser {
 public:
+    // called once the parser no longer needs a package it doesn't own
+    using ReleaseCallback = void(*)(void* data, size_t size, void* user);
+
+    // parses a copy of the package, data can be freed as soon as this returns
     MaterialParser(filament::driver::Backend backend, const void* data, size_t size);
+
+    // parses the package in place, e.g. from a memory-mapped file, so that only the parts that
+    // are accessed are read. data must stay valid until release is called by the destructor.
+    MaterialParser(filament::driver::Backend backend, const void* data, size_t size,
+            ReleaseCallback release, void* user);
+
     ~MaterialParser();
 
     MaterialParser(MaterialParser const& rhs) noexcept = delete;
@@ -68,6 +78,7 @@ public:
     bool getColorWrite(bool* value) const noexcept;
     bool getDepthTest(bool* value) const noexcept;
     bool getInterpolation(filament::Interpolation* value) const noexcept;
+    bool getVariantFilterMask(uint8_t* value) const noexcept;
     bool getVertexDomain(filament::VertexDomain* value) const noexcept;
 
     bool getShading(filament::Shading*) const noexcept;
@@ -76,6 +87,7 @@ public:
     bool hasShadowMultiplier(bool*) const noexcept;
     bool getRequiredAttributes(filament::AttributeBitset*) const noexcept;
     bool hasCustomDepthShader(bool* value) const noexcept;
+    bool getShaderCost(uint32_t* value) const noexcept;
 
     bool getShader(
             filament::driver::ShaderModel shaderModel, uint8_t variant,
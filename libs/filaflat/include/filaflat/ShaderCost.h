@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAFLAT_SHADERCOST_H
+#define TNT_FILAFLAT_SHADERCOST_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace filaflat {
+
+struct ShaderCost {
+    uint32_t instructions = 0;  // all instructions in function bodies
+    uint32_t alu = 0;           // arithmetic, logical, conversion and extended instructions
+    uint32_t texture = 0;       // image samples, fetches, gathers and reads
+    uint32_t branches = 0;      // conditional branches and switches
+};
+
+// Returns a static estimate of the cost of a SPIR-V module, computed from the instructions of its
+// functions only, the declarations (types, constants, variables, decorations) are ignored. Loops
+// are not unrolled and calls are not inlined, so the counts are only meaningful to compare
+// variants and materials with each other.
+ShaderCost computeSpirvCost(uint32_t const* words, size_t count) noexcept;
+
+} // namespace filaflat
+
+#endif // TNT_FILAFLAT_SHADERCOST_H
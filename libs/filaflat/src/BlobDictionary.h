@@ -17,6 +17,7 @@
 #ifndef TNT_FILAFLAT_BLOBDICTIONARY_H
 #define TNT_FILAFLAT_BLOBDICTIONARY_H
 
+#include <memory>
 #include <vector>
 
 #include <stddef.h>
@@ -51,6 +52,12 @@ public:
         return getBlob(index, &size);
     }
 
+    // Storage for blobs that don't live in the package itself, e.g. when the dictionary chunk
+    // is compressed. Must be called before any blob pointing into it is added.
+    inline char* allocateStorage(size_t size) {
+        mStorage.reset(new char[size]);
+        return mStorage.get();
+    }
 
 private:
     struct Blob {
@@ -58,6 +65,7 @@ private:
         size_t size;
     };
     std::vector<Blob> mBlobs;
+    std::unique_ptr<char[]> mStorage;
 };
 
 } // namespace filaflat
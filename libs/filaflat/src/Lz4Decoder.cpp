@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Lz4Decoder.h"
+
+#include <utils/compiler.h>
+
+#include <string.h>
+
+namespace filaflat {
+
+static constexpr size_t MIN_MATCH = 4;
+
+// Adds the extra length bytes following a saturated token nibble.
+static inline bool readLength(const uint8_t*& ip, const uint8_t* iend, size_t* length) noexcept {
+    uint8_t b;
+    do {
+        if (UTILS_UNLIKELY(ip == iend)) {
+            return false;
+        }
+        b = *ip++;
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+bool Lz4Decoder::decode(const uint8_t* src, size_t srcSize,
+        uint8_t* dst, size_t dstSize) noexcept {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + srcSize;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dstSize;
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+
+        // literals
+        size_t literals = token >> 4u;
+        if (literals == 15 && !readLength(ip, iend, &literals)) {
+            return false;
+        }
+        if (UTILS_UNLIKELY(size_t(iend - ip) < literals || size_t(oend - op) < literals)) {
+            return false;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        // the last sequence has no match
+        if (ip == iend) {
+            break;
+        }
+
+        // match
+        if (UTILS_UNLIKELY(iend - ip < 2)) {
+            return false;
+        }
+        const size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8u);
+        ip += 2;
+        if (UTILS_UNLIKELY(offset == 0 || size_t(op - dst) < offset)) {
+            return false;
+        }
+        size_t length = token & 0xfu;
+        if (length == 15 && !readLength(ip, iend, &length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (UTILS_UNLIKELY(size_t(oend - op) < length)) {
+            return false;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // overlapping match, this is how runs are encoded
+            for (uint8_t* const end = op + length; op < end;) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == oend;
+}
+
+bool Lz4Decoder::unflatten(Unflattener& f, BlobDictionary& dictionary,
+        const uint8_t** data, size_t* size) noexcept {
+    uint32_t uncompressedSize;
+    if (!f.read(&uncompressedSize)) {
+        return false;
+    }
+
+    const char* compressed;
+    size_t compressedSize;
+    if (!f.read(&compressed, &compressedSize)) {
+        return false;
+    }
+
+    uint8_t* storage = (uint8_t*) dictionary.allocateStorage(uncompressedSize);
+    if (!decode((const uint8_t*) compressed, compressedSize, storage, uncompressedSize)) {
+        return false;
+    }
+
+    *data = storage;
+    *size = uncompressedSize;
+    return true;
+}
+
+} // namespace filaflat
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAFLAT_LZ4DECODER_H
+#define TNT_FILAFLAT_LZ4DECODER_H
+
+#include <filaflat/Unflattener.h>
+
+#include "BlobDictionary.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filaflat {
+
+// Decoder for the LZ4 block format, used by compressed dictionary chunks.
+struct Lz4Decoder {
+    // Decompresses an LZ4 block into dst, which must be exactly the uncompressed size. Returns
+    // false if the block is malformed or doesn't decompress to dstSize bytes.
+    static bool decode(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) noexcept;
+
+    // Reads the uncompressed size and the compressed blob of a dictionary chunk and decompresses
+    // it into storage owned by the dictionary, so blobs can point directly into it.
+    static bool unflatten(Unflattener& f, BlobDictionary& dictionary,
+            const uint8_t** data, size_t* size) noexcept;
+};
+
+} // namespace filaflat
+
+#endif // TNT_FILAFLAT_LZ4DECODER_H
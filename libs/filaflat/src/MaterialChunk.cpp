@@ -125,8 +125,10 @@ bool MaterialChunk::getTextShader(Unflattener unflattener, BlobDictionary& dicti
         if (!unflattener.read(&lineIndex)) {
             return false;
         }
-        const char* string = dictionary.getString(lineIndex);
-        shader.appendPart(string, strlen(string));
+        // the dictionary already knows the length of the lines
+        size_t size;
+        const char* string = dictionary.getBlob(lineIndex, &size);
+        shader.appendPart(string, size);
         shader.appendPart("\n", 1);
     }
 
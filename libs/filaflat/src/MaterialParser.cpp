@@ -42,22 +42,37 @@ using namespace filamat;
 
 namespace filaflat {
 
-// Make a copy of content and own the allocated memory.
+// Either makes a copy of content and owns the allocated memory, or references content until
+// it's released with the given callback.
 class ManagedBuffer  {
     void* mStart = nullptr;
     size_t mSize = 0;
+    MaterialParser::ReleaseCallback mRelease = nullptr;
+    void* mUser = nullptr;
 public:
     explicit ManagedBuffer(const void* start, size_t size)
             : mStart(malloc(size)), mSize(size) {
         memcpy(mStart, start, size);
     }
 
+    ManagedBuffer(const void* start, size_t size,
+            MaterialParser::ReleaseCallback release, void* user) noexcept
+            : mStart(const_cast<void*>(start)), mSize(size), mRelease(release), mUser(user) {
+    }
+
+    ManagedBuffer(ManagedBuffer const& rhs) = delete;
+    ManagedBuffer& operator=(ManagedBuffer const& rhs) = delete;
+
     void* begin() const noexcept { return mStart; }
     void* end() const noexcept { return (uint8_t*)mStart + mSize; }
     size_t size() const noexcept { return mSize; }
 
     ~ManagedBuffer() noexcept {
-        free(mStart);
+        if (mRelease) {
+            mRelease(mStart, mSize, mUser);
+        } else {
+            free(mStart);
+        }
     }
 };
 
@@ -67,6 +82,12 @@ struct MaterialParserDetails {
               mChunkContainer(mUnflattenable.begin(), mUnflattenable.size()),
               mBackend(backend) {
     }
+    MaterialParserDetails(filament::driver::Backend backend, const void* data, size_t size,
+            MaterialParser::ReleaseCallback release, void* user)
+            : mUnflattenable(data, size, release, user),
+              mChunkContainer(mUnflattenable.begin(), mUnflattenable.size()),
+              mBackend(backend) {
+    }
     ManagedBuffer mUnflattenable;
     ChunkContainer mChunkContainer;
 
@@ -100,6 +121,11 @@ MaterialParser::MaterialParser(filament::driver::Backend backend, const void* da
         : mImpl(new MaterialParserDetails(backend, data, size)) {
 }
 
+MaterialParser::MaterialParser(filament::driver::Backend backend, const void* data, size_t size,
+        ReleaseCallback release, void* user)
+        : mImpl(new MaterialParserDetails(backend, data, size, release, user)) {
+}
+
 MaterialParser::~MaterialParser() {
     delete mImpl;
 }
@@ -131,7 +157,8 @@ bool MaterialParser::isPostProcessMaterial() const noexcept {
     ChunkContainer const& cc = getChunkContainer();
     return cc.hasChunk(PostProcessVersion) &&
            ((cc.hasChunk(MaterialSpirv) && cc.hasChunk(DictionarySpirv)) ||
-            (cc.hasChunk(MaterialGlsl) && cc.hasChunk(DictionaryGlsl)));
+            (cc.hasChunk(MaterialGlsl) &&
+                    (cc.hasChunk(DictionaryGlsl) || cc.hasChunk(DictionaryGlslCompressed))));
 }
 
 // Accessors
@@ -240,6 +267,10 @@ bool MaterialParser::getBlendingMode(BlendingMode* value) const noexcept {
     return mImpl->getFromSimpleChunk(ChunkType::MaterialBlendingMode, reinterpret_cast<uint8_t*>(value));
 }
 
+bool MaterialParser::getVariantFilterMask(uint8_t* value) const noexcept {
+    return mImpl->getFromSimpleChunk(ChunkType::MaterialVariantFilterMask, value);
+}
+
 bool MaterialParser::getMaskThreshold(float* value) const noexcept {
     return mImpl->getFromSimpleChunk(ChunkType::MaterialMaskThreshold, value);
 }
@@ -257,6 +288,10 @@ bool MaterialParser::hasCustomDepthShader(bool* value) const noexcept {
     return mImpl->getFromSimpleChunk(ChunkType::MaterialHasCustomDepthShader, value);
 }
 
+bool MaterialParser::getShaderCost(uint32_t* value) const noexcept {
+    return mImpl->getFromSimpleChunk(ChunkType::MaterialShaderCost, value);
+}
+
 bool MaterialParser::getRequiredAttributes(AttributeBitset* value) const noexcept {
     uint32_t rawAttributes = 0;
     if (!mImpl->getFromSimpleChunk(ChunkType::MaterialRequiredAttributes, &rawAttributes)) {
@@ -301,7 +336,8 @@ bool MaterialParserDetails::getGlShader(filament::driver::ShaderModel shaderMode
 
     ChunkContainer const& container = mChunkContainer;
     if (!container.hasChunk(ChunkType::MaterialGlsl) ||
-        !container.hasChunk(ChunkType::DictionaryGlsl)) {
+        (!container.hasChunk(ChunkType::DictionaryGlsl) &&
+         !container.hasChunk(ChunkType::DictionaryGlslCompressed))) {
         return false;
     }
 
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filaflat/ShaderCost.h>
+
+namespace filaflat {
+
+// The opcodes of the SPIR-V specification, filaflat doesn't depend on its headers
+enum SpirvOp : uint32_t {
+    OpExtInst = 12,
+    OpFunction = 54,
+    OpFunctionEnd = 56,
+    OpImageSampleImplicitLod = 87,
+    OpImageRead = 98,
+    OpConvertFToU = 109,
+    OpBitcast = 124,
+    OpSNegate = 126,
+    OpFMod = 141,
+    OpVectorTimesScalar = 142,
+    OpFOrdGreaterThanEqual = 190,
+    OpShiftRightLogical = 194,
+    OpBitCount = 205,
+    OpDPdx = 207,
+    OpFwidthCoarse = 215,
+    OpBranchConditional = 250,
+    OpSwitch = 251,
+    OpImageSparseSampleImplicitLod = 305,
+    OpImageSparseDrefGather = 315,
+};
+
+ShaderCost computeSpirvCost(uint32_t const* words, size_t count) noexcept {
+    constexpr uint32_t HEADER_SIZE = 5;
+    ShaderCost cost;
+    bool inFunction = false;
+    for (size_t i = HEADER_SIZE; i < count; ) {
+        const uint32_t opcode = words[i] & 0xFFFFu;
+        const uint32_t wordCount = words[i] >> 16u;
+        if (wordCount == 0) {
+            break; // malformed module
+        }
+        i += wordCount;
+
+        if (opcode == OpFunction) {
+            inFunction = true;
+            continue;
+        }
+        if (opcode == OpFunctionEnd) {
+            inFunction = false;
+            continue;
+        }
+        if (!inFunction) {
+            continue;
+        }
+
+        cost.instructions++;
+        if ((opcode >= OpImageSampleImplicitLod && opcode <= OpImageRead) ||
+                (opcode >= OpImageSparseSampleImplicitLod && opcode <= OpImageSparseDrefGather)) {
+            cost.texture++;
+        } else if (opcode == OpBranchConditional || opcode == OpSwitch) {
+            cost.branches++;
+        } else if (opcode == OpExtInst ||
+                (opcode >= OpConvertFToU && opcode <= OpBitcast) ||
+                (opcode >= OpSNegate && opcode <= OpFMod) ||
+                (opcode >= OpVectorTimesScalar && opcode <= OpFOrdGreaterThanEqual) ||
+                (opcode >= OpShiftRightLogical && opcode <= OpBitCount) ||
+                (opcode >= OpDPdx && opcode <= OpFwidthCoarse)) {
+            cost.alu++;
+        }
+    }
+    return cost;
+}
+
+} // namespace filaflat
@@ -16,19 +16,36 @@
 
 #include "SpirvDictionaryReader.h"
 
-#include <assert.h>
+#include "Lz4Decoder.h"
 
 namespace filaflat {
 
+using namespace filamat;
+
 bool SpirvDictionaryReader::unflatten(Unflattener& f, BlobDictionary& dictionary) {
     uint32_t compressionScheme;
     if (!f.read(&compressionScheme)) {
         return false;
     }
 
-    // TODO: support compression
-    assert(compressionScheme == 0);
+    switch (CompressionScheme(compressionScheme)) {
+        case CompressionScheme::NONE:
+            return unflattenBlobs(f, dictionary);
+        case CompressionScheme::LZ4: {
+            // the compressed payload holds the blob count and the blobs
+            const uint8_t* data;
+            size_t size;
+            if (!Lz4Decoder::unflatten(f, dictionary, &data, &size)) {
+                return false;
+            }
+            Unflattener blobs(data, data + size);
+            return unflattenBlobs(blobs, dictionary);
+        }
+    }
+    return false;
+}
 
+bool SpirvDictionaryReader::unflattenBlobs(Unflattener& f, BlobDictionary& dictionary) {
     uint32_t numBlobs;
     if (!f.read(&numBlobs)) {
         return false;
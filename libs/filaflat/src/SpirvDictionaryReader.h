@@ -33,6 +33,9 @@ struct SpirvDictionaryReader {
         SpirvDictionaryReader dictionary;
         return dictionary.unflatten(dictionaryUnflattener, blobDictionary);
     }
+
+private:
+    static bool unflattenBlobs(Unflattener& unflattener, BlobDictionary& dictionary);
 };
 
 } // namespace filaflat
@@ -16,6 +16,8 @@
 
 #include "TextDictionaryReader.h"
 
+#include "Lz4Decoder.h"
+
 #include <utils/Log.h>
 
 namespace filaflat {
@@ -37,4 +39,30 @@ bool TextDictionaryReader::unflatten(Unflattener& f, BlobDictionary& dictionary)
     return true;
 }
 
+bool TextDictionaryReader::unflatten(ChunkContainer const& container,
+        BlobDictionary& blobDictionary) {
+    using namespace filamat;
+    TextDictionaryReader dictionary;
+    if (!container.hasChunk(ChunkType::DictionaryGlslCompressed)) {
+        Unflattener dictionaryUnflattener(container, ChunkType::DictionaryGlsl);
+        return dictionary.unflatten(dictionaryUnflattener, blobDictionary);
+    }
+
+    // The compressed chunk holds the payload of a DictionaryGlsl chunk.
+    Unflattener compressedUnflattener(container, ChunkType::DictionaryGlslCompressed);
+    uint32_t compressionScheme;
+    if (!compressedUnflattener.read(&compressionScheme) ||
+            CompressionScheme(compressionScheme) != CompressionScheme::LZ4) {
+        return false;
+    }
+
+    const uint8_t* data;
+    size_t size;
+    if (!Lz4Decoder::unflatten(compressedUnflattener, blobDictionary, &data, &size)) {
+        return false;
+    }
+    Unflattener dictionaryUnflattener(data, data + size);
+    return dictionary.unflatten(dictionaryUnflattener, blobDictionary);
+}
+
 }
@@ -31,11 +31,8 @@ namespace filaflat {
 struct TextDictionaryReader {
     bool unflatten(Unflattener& unflattener, BlobDictionary& dictionary);
 
-    static bool unflatten(ChunkContainer const& container, BlobDictionary& blobDictionary) {
-        Unflattener dictionaryUnflattener(container, filamat::ChunkType::DictionaryGlsl);
-        TextDictionaryReader dictionary;
-        return dictionary.unflatten(dictionaryUnflattener, blobDictionary);
-    }
+    // Reads either the DictionaryGlsl or the DictionaryGlslCompressed chunk.
+    static bool unflatten(ChunkContainer const& container, BlobDictionary& blobDictionary);
 };
 
 } // namespace filaflat
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILAGUI_SPRITEBATCH_H_
+#define FILAGUI_SPRITEBATCH_H_
+
+#include <vector>
+
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/Scene.h>
+#include <filament/Texture.h>
+#include <filament/TextureSampler.h>
+#include <filament/VertexBuffer.h>
+
+#include <math/vec4.h>
+
+#include <utils/Entity.h>
+
+namespace filagui {
+
+// Draws many small textured quads (sprites, glyphs) with a few draw calls. The quads of a frame
+// are accumulated between begin() and end(), grouped by layer and page, and written into a
+// single streaming vertex buffer. Each group of quads is one primitive of a single Renderable,
+// instead of one Renderable, one set of uniforms and one draw per quad.
+//
+// The Renderable is added to the given Scene, which is typically drawn by a View dedicated to
+// the UI: with an orthographic camera in the units of the quads, without post-processing, and
+// rendered after the 3D View.
+class SpriteBatch {
+public:
+    // A quad, in the coordinates of the camera of the View drawing the batch.
+    struct Quad {
+        math::float4 rect;      // left, bottom, right, top
+        math::float4 uv;        // left, bottom, right, top, in the page's texture
+        math::ubyte4 color = { 255, 255, 255, 255 };    // RGBA, multiplies the texture
+    };
+
+    // How the texture of a page is sampled, see createPage().
+    enum class PageType : uint8_t {
+        COLOR,  // RGBA sprites
+        ALPHA,  // glyphs, or any coverage mask stored in the first channel of the texture
+    };
+
+    // The constructor adds the batch's Renderable to the given Scene.
+    SpriteBatch(filament::Engine* engine, filament::Scene* scene);
+    ~SpriteBatch();
+
+    SpriteBatch(SpriteBatch const&) = delete;
+    SpriteBatch& operator=(SpriteBatch const&) = delete;
+
+    // Creates a page from a texture, e.g. a page of a texture atlas. The page is a material
+    // instance owned by the batch, the texture must outlive it.
+    // Pages can also be created by the application, from any material that requires the uv0 and
+    // color attributes, as long as it's blended.
+    filament::MaterialInstance* createPage(filament::Texture const* texture, PageType type,
+            filament::TextureSampler const& sampler = filament::TextureSampler(
+                    filament::TextureSampler::MinFilter::LINEAR,
+                    filament::TextureSampler::MagFilter::LINEAR));
+
+    // Destroys a page created by createPage(), it must not be used by the current frame.
+    void destroyPage(filament::MaterialInstance* page);
+
+    // Starts a new frame, the quads of the previous one are discarded.
+    void begin();
+
+    // Adds quads drawn with the given page. Layers are drawn in increasing order, and so are the
+    // quads of a layer using the same page. The quads of a layer using different pages are drawn
+    // in any order: quads that overlap must be in different layers if the order matters.
+    void add(Quad const& quad, filament::MaterialInstance const* page, uint16_t layer = 0);
+    void add(Quad const* quads, size_t count, filament::MaterialInstance const* page,
+            uint16_t layer = 0);
+
+    // Uploads the quads added since begin() and updates the Renderable. This should be called
+    // once per frame, before the View is rendered.
+    void end();
+
+    // number of quads and draw calls of the last end()
+    size_t getQuadCount() const noexcept { return mQuadCount; }
+    size_t getDrawCount() const noexcept { return mPrimitiveCount; }
+
+private:
+    struct Entry {
+        uint64_t key;       // layer, then the order of the page in this frame
+        uint32_t quad;      // index in mQuads
+    };
+
+    struct Group {
+        filament::MaterialInstance const* page;
+        uint32_t firstQuad;
+        uint32_t quadCount;
+    };
+
+    uint32_t getPageOrder(filament::MaterialInstance const* page);
+    void createBuffers(size_t quadCount);
+    void buildRenderable();
+
+    filament::Engine* mEngine;
+    filament::Scene* mScene;
+    filament::Material* mMaterial = nullptr;
+    std::vector<filament::MaterialInstance*> mPages;
+    filament::VertexBuffer* mVertexBuffer = nullptr;
+    filament::IndexBuffer* mIndexBuffer = nullptr;
+    size_t mQuadCapacity = 0;
+    utils::Entity mRenderable;
+
+    // the quads of the current frame, and the pages they use in order of first use
+    std::vector<Quad> mQuads;
+    std::vector<Entry> mEntries;
+    std::vector<filament::MaterialInstance const*> mFramePages;
+    std::vector<Group> mGroups;
+    filament::MaterialInstance const* mLastPage = nullptr;
+    uint32_t mLastPageOrder = 0;
+
+    // whether the Renderable's primitives must be created again, rather than updated
+    bool mRenderableDirty = true;
+    size_t mPrimitiveCount = 0;
+    size_t mQuadCount = 0;
+};
+
+} // namespace filagui
+
+#endif /* FILAGUI_SPRITEBATCH_H_ */
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILAGUI_STATISTICSOVERLAY_H_
+#define FILAGUI_STATISTICSOVERLAY_H_
+
+#include <filament/Engine.h>
+#include <filament/Renderer.h>
+#include <filament/View.h>
+
+#include <stddef.h>
+
+namespace filagui {
+
+// Draws an ImGui window with the statistics of the last frames: the CPU time of the frame's
+// stages, the GPU time of the passes, the culling and draw call counts of a View, its
+// froxelization results and the memory used by the Engine.
+//
+// The overlay is toggled at runtime with the "d.stats.overlay" property of the Engine's
+// DebugRegistry, it is hidden by default.
+class StatisticsOverlay {
+public:
+    explicit StatisticsOverlay(filament::Engine* engine);
+
+    // Call from the ImGuiHelper::render() callback. The statistics are those of the given
+    // Renderer and View, which must have been rendered at least once.
+    void draw(filament::Renderer* renderer, filament::View* view);
+
+    void setVisible(bool visible);
+    bool isVisible() const;
+
+private:
+    static constexpr size_t HISTORY_COUNT = 120;
+
+    filament::Engine* mEngine;
+    float mFrameHistory[HISTORY_COUNT] = {};    // time between frames, in milliseconds
+    float mGpuHistory[HISTORY_COUNT] = {};      // GPU time of the frames
+    size_t mHistoryIndex = 0;
+    uint32_t mLastGpuFrameId = 0;
+};
+
+} // namespace filagui
+
+#endif /* FILAGUI_STATISTICSOVERLAY_H_ */
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filagui/SpriteBatch.h>
+
+#include <algorithm>
+
+#include <stdlib.h>
+
+#include <filament/RenderableManager.h>
+
+#include <math/vec2.h>
+
+#include <utils/EntityManager.h>
+
+using namespace math;
+using namespace filament;
+using namespace utils;
+
+namespace filagui {
+
+static const uint8_t UI_SPRITE_PACKAGE[] = {
+    #include "generated/material/uiSprite.inc"
+};
+
+namespace {
+
+// same layout as ImGui's vertices, see ImGuiHelper
+struct Vertex {
+    float2 position;
+    float2 uv;
+    ubyte4 color;
+};
+
+} // anonymous namespace
+
+// the buffers start with room for this many quads, and double in size when they're too small
+static constexpr size_t MIN_QUAD_CAPACITY = 256;
+
+SpriteBatch::SpriteBatch(Engine* engine, Scene* scene) : mEngine(engine), mScene(scene) {
+    mMaterial = Material::Builder()
+            .package((void*)UI_SPRITE_PACKAGE, sizeof(UI_SPRITE_PACKAGE))
+            .build(*engine);
+    mRenderable = EntityManager::get().create();
+    scene->addEntity(mRenderable);
+}
+
+SpriteBatch::~SpriteBatch() {
+    mScene->remove(mRenderable);
+    mEngine->destroy(mRenderable);
+    EntityManager::get().destroy(mRenderable);
+    for (MaterialInstance* page : mPages) {
+        mEngine->destroy(page);
+    }
+    mEngine->destroy(mMaterial);
+    mEngine->destroy(mVertexBuffer);
+    mEngine->destroy(mIndexBuffer);
+}
+
+MaterialInstance* SpriteBatch::createPage(Texture const* texture, PageType type,
+        TextureSampler const& sampler) {
+    MaterialInstance* page = mMaterial->createInstance();
+    page->setParameter("page", texture, sampler);
+    page->setParameter("alphaOnly", type == PageType::ALPHA);
+    mPages.push_back(page);
+    return page;
+}
+
+void SpriteBatch::destroyPage(MaterialInstance* page) {
+    auto pos = std::find(mPages.begin(), mPages.end(), page);
+    if (pos != mPages.end()) {
+        mPages.erase(pos);
+        mEngine->destroy(page);
+    }
+}
+
+void SpriteBatch::begin() {
+    mQuads.clear();
+    mEntries.clear();
+    mFramePages.clear();
+    mLastPage = nullptr;
+}
+
+uint32_t SpriteBatch::getPageOrder(MaterialInstance const* page) {
+    // the quads of a page usually come in a row, and a frame only uses a few pages
+    if (page != mLastPage) {
+        auto pos = std::find(mFramePages.begin(), mFramePages.end(), page);
+        if (pos == mFramePages.end()) {
+            pos = mFramePages.insert(pos, page);
+        }
+        mLastPage = page;
+        mLastPageOrder = uint32_t(pos - mFramePages.begin());
+    }
+    return mLastPageOrder;
+}
+
+void SpriteBatch::add(Quad const& quad, MaterialInstance const* page, uint16_t layer) {
+    add(&quad, 1, page, layer);
+}
+
+void SpriteBatch::add(Quad const* quads, size_t count, MaterialInstance const* page,
+        uint16_t layer) {
+    const uint64_t key = uint64_t(layer) << 32u | getPageOrder(page);
+    const uint32_t first = uint32_t(mQuads.size());
+    mQuads.insert(mQuads.end(), quads, quads + count);
+    for (uint32_t i = 0; i < count; i++) {
+        mEntries.push_back({ key, first + i });
+    }
+}
+
+void SpriteBatch::createBuffers(size_t quadCount) {
+    // the Renderable refers to the old buffers, it's created again below
+    mEngine->getRenderableManager().destroy(mRenderable);
+    mEngine->destroy(mVertexBuffer);
+    mEngine->destroy(mIndexBuffer);
+    mRenderableDirty = true;
+
+    mQuadCapacity = std::max({ quadCount, 2 * mQuadCapacity, MIN_QUAD_CAPACITY });
+    mVertexBuffer = VertexBuffer::Builder()
+            .vertexCount(uint32_t(mQuadCapacity * 4))
+            .bufferCount(1)
+            .bufferUsage(VertexBuffer::BufferUsage::STREAM)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT2,
+                    offsetof(Vertex, position), sizeof(Vertex))
+            .attribute(VertexAttribute::UV0, 0, VertexBuffer::AttributeType::FLOAT2,
+                    offsetof(Vertex, uv), sizeof(Vertex))
+            .attribute(VertexAttribute::COLOR, 0, VertexBuffer::AttributeType::UBYTE4,
+                    offsetof(Vertex, color), sizeof(Vertex))
+            .normalized(VertexAttribute::COLOR)
+            .build(*mEngine);
+
+    // The indices of the quads never change, they're only uploaded when the buffers grow. Each
+    // primitive draws a range of them.
+    mIndexBuffer = IndexBuffer::Builder()
+            .indexCount(uint32_t(mQuadCapacity * 6))
+            .bufferType(IndexBuffer::IndexType::UINT)
+            .build(*mEngine);
+    const size_t size = mQuadCapacity * 6 * sizeof(uint32_t);
+    uint32_t* const indices = static_cast<uint32_t*>(malloc(size));
+    for (uint32_t i = 0, c = uint32_t(mQuadCapacity); i < c; i++) {
+        const uint32_t v = i * 4;
+        uint32_t* const quad = indices + i * 6;
+        quad[0] = v + 0; quad[1] = v + 1; quad[2] = v + 2;
+        quad[3] = v + 2; quad[4] = v + 1; quad[5] = v + 3;
+    }
+    mIndexBuffer->setBuffer(*mEngine, IndexBuffer::BufferDescriptor(indices, size,
+            [](void* buffer, size_t, void*) { free(buffer); }));
+}
+
+void SpriteBatch::end() {
+    auto& rcm = mEngine->getRenderableManager();
+    mQuadCount = mQuads.size();
+    if (mQuads.empty()) {
+        if (mPrimitiveCount) {
+            rcm.destroy(mRenderable);
+            mRenderableDirty = true;
+            mPrimitiveCount = 0;
+        }
+        return;
+    }
+
+    if (mQuads.size() > mQuadCapacity) {
+        createBuffers(mQuads.size());
+    }
+
+    // Group the quads by layer, then page. Ties are broken by the index of the quad, so that the
+    // quads of a group stay in the order they were added. They usually are already sorted.
+    auto byKey = [](Entry const& lhs, Entry const& rhs) {
+        return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.quad < rhs.quad);
+    };
+    if (!std::is_sorted(mEntries.begin(), mEntries.end(), byKey)) {
+        std::sort(mEntries.begin(), mEntries.end(), byKey);
+    }
+
+    // The vertices are written in the order of the groups. The whole buffer is uploaded, so
+    // that the GL backend orphans it instead of waiting for the previous frame's draws.
+    const size_t size = mQuadCapacity * 4 * sizeof(Vertex);
+    Vertex* const vertices = static_cast<Vertex*>(malloc(size));
+    mGroups.clear();
+    for (uint32_t i = 0, c = uint32_t(mEntries.size()); i < c; i++) {
+        Entry const& entry = mEntries[i];
+        if (i == 0 || entry.key != mEntries[i - 1].key) {
+            mGroups.push_back({ mFramePages[entry.key & 0xFFFFFFFFu], i, 0 });
+        }
+        mGroups.back().quadCount++;
+
+        Quad const& quad = mQuads[entry.quad];
+        Vertex* const v = vertices + i * 4;
+        v[0] = { quad.rect.xy, quad.uv.xy, quad.color };
+        v[1] = { { quad.rect.z, quad.rect.y }, { quad.uv.z, quad.uv.y }, quad.color };
+        v[2] = { { quad.rect.x, quad.rect.w }, { quad.uv.x, quad.uv.w }, quad.color };
+        v[3] = { quad.rect.zw, quad.uv.zw, quad.color };
+    }
+    mVertexBuffer->setBufferAt(*mEngine, 0, VertexBuffer::BufferDescriptor(vertices, size,
+            [](void* buffer, size_t, void*) { free(buffer); }));
+
+    if (mRenderableDirty || mGroups.size() != mPrimitiveCount) {
+        buildRenderable();
+        return;
+    }
+
+    // same number of draws as the last frame, only their ranges and pages change
+    auto ri = rcm.getInstance(mRenderable);
+    for (size_t i = 0, c = mGroups.size(); i < c; i++) {
+        Group const& group = mGroups[i];
+        rcm.setGeometryAt(ri, i, RenderableManager::PrimitiveType::TRIANGLES,
+                group.firstQuad * 6, group.quadCount * 6);
+        if (rcm.getMaterialInstanceAt(ri, i) != group.page) {
+            rcm.setMaterialInstanceAt(ri, i, group.page);
+        }
+    }
+}
+
+void SpriteBatch::buildRenderable() {
+    auto& rcm = mEngine->getRenderableManager();
+    rcm.destroy(mRenderable);
+
+    RenderableManager::Builder builder(mGroups.size());
+    builder.boundingBox({{ 0, 0, 0 }, { 10000, 10000, 10000 }})
+            .culling(false)
+            .castShadows(false)
+            .receiveShadows(false);
+    for (size_t i = 0, c = mGroups.size(); i < c; i++) {
+        Group const& group = mGroups[i];
+        // blended primitives are drawn in the order of the groups
+        builder.geometry(i, RenderableManager::PrimitiveType::TRIANGLES,
+                        mVertexBuffer, mIndexBuffer, group.firstQuad * 6, group.quadCount * 6)
+                .material(i, group.page)
+                .blendOrder(i, uint16_t(i));
+    }
+    builder.build(*mEngine, mRenderable);
+    mPrimitiveCount = mGroups.size();
+    mRenderableDirty = false;
+}
+
+} // namespace filagui
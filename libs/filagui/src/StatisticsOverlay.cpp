@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filagui/StatisticsOverlay.h>
+
+#include <imgui.h>
+
+#include <filament/DebugRegistry.h>
+
+using namespace filament;
+
+namespace filagui {
+
+static constexpr const char* OVERLAY_PROPERTY = "d.stats.overlay";
+
+static float toMiB(size_t bytes) {
+    return float(bytes) / (1024.0f * 1024.0f);
+}
+
+StatisticsOverlay::StatisticsOverlay(Engine* engine) : mEngine(engine) {
+}
+
+void StatisticsOverlay::setVisible(bool visible) {
+    mEngine->getDebugRegistry().setProperty(OVERLAY_PROPERTY, visible);
+}
+
+bool StatisticsOverlay::isVisible() const {
+    bool visible = false;
+    mEngine->getDebugRegistry().getProperty(OVERLAY_PROPERTY, &visible);
+    return visible;
+}
+
+void StatisticsOverlay::draw(Renderer* renderer, View* view) {
+    Renderer::GpuFrameTimings gpu;
+    const bool hasGpuTimings = renderer->getLastGpuFrameTimings(&gpu);
+
+    // the history is kept while the overlay is hidden, so it's complete when it's shown
+    const size_t previous = (mHistoryIndex + HISTORY_COUNT - 1) % HISTORY_COUNT;
+    mFrameHistory[mHistoryIndex] = ImGui::GetIO().DeltaTime * 1000.0f;
+    mGpuHistory[mHistoryIndex] = (hasGpuTimings && gpu.frameId != mLastGpuFrameId) ?
+            gpu.total : mGpuHistory[previous];
+    mHistoryIndex = (mHistoryIndex + 1) % HISTORY_COUNT;
+    if (hasGpuTimings) {
+        mLastGpuFrameId = gpu.frameId;
+    }
+
+    bool* visible = mEngine->getDebugRegistry().getPropertyAddress<bool>(OVERLAY_PROPERTY);
+    if (!visible || !*visible) {
+        return;
+    }
+
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    if (!ImGui::Begin("Statistics", visible, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::End();
+        return;
+    }
+
+    const int count = int(HISTORY_COUNT);
+    const int offset = int(mHistoryIndex);
+    ImGui::PlotLines("frame (ms)", mFrameHistory, count, offset, nullptr, 0.0f, 50.0f,
+            ImVec2(0.0f, 40.0f));
+
+    if (ImGui::CollapsingHeader("CPU (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+        Renderer::CpuFrameTimings cpu;
+        renderer->getLastCpuFrameTimings(&cpu);
+        ImGui::Text("prepare   %6.2f", cpu.prepare);
+        ImGui::Text("cull      %6.2f", cpu.cull);
+        ImGui::Text("froxelize %6.2f", cpu.froxelize);
+        ImGui::Text("generate  %6.2f", cpu.generate);
+        ImGui::Text("sort      %6.2f", cpu.sort);
+        ImGui::Text("record    %6.2f", cpu.record);
+    }
+
+    if (ImGui::CollapsingHeader("GPU (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+        if (hasGpuTimings) {
+            ImGui::PlotLines("total", mGpuHistory, count, offset, nullptr, 0.0f, 50.0f,
+                    ImVec2(0.0f, 40.0f));
+            ImGui::Text("shadows   %6.2f", gpu.shadowPass);
+            ImGui::Text("color     %6.2f", gpu.colorPass);
+            ImGui::Text("post      %6.2f", gpu.postProcess);
+            ImGui::Text("total     %6.2f", gpu.total);
+        } else {
+            ImGui::Text("not measured by this backend");
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Rendering", ImGuiTreeNodeFlags_DefaultOpen)) {
+        const View::RenderStatistics stats = view->getRenderStatistics();
+        ImGui::Text("renderables     %u", stats.renderableCount);
+        ImGui::Text("visible         %u", stats.visibleRenderableCount);
+        ImGui::Text("shadow casters  %u", stats.visibleShadowCasterCount);
+        ImGui::Text("color draws     %u", stats.colorDrawCount);
+        ImGui::Text("shadow draws    %u", stats.shadowDrawCount);
+
+        Engine::FrameStatistics frame;
+        mEngine->getLastFrameStatistics(&frame);
+        ImGui::Text("uniform bytes   %u", frame.uniformBytes);
+        ImGui::Text("texture uploads %u", frame.textureUploads);
+        ImGui::Text("programs built  %u", frame.programCompiles);
+
+        const View::FroxelStatistics froxels = view->getFroxelStatistics();
+        ImGui::Text("froxels         %u", froxels.froxelCount);
+        ImGui::Text("light records   %u", froxels.recordCount);
+        // lights are missing from the truncated and overflowed froxels
+        const ImVec4 warning(1.0f, 0.5f, 0.0f, 1.0f);
+        const ImVec4 normal = ImGui::GetStyle().Colors[ImGuiCol_Text];
+        ImGui::TextColored(froxels.truncatedFroxelCount ? warning : normal,
+                "truncated       %u", froxels.truncatedFroxelCount);
+        ImGui::TextColored(froxels.overflowFroxelCount ? warning : normal,
+                "overflows       %u", froxels.overflowFroxelCount);
+    }
+
+    if (ImGui::CollapsingHeader("Memory (MiB)")) {
+        const Engine::MemoryStats memory = mEngine->getMemoryStats();
+        ImGui::Text("heap            %7.2f", toMiB(memory.heapUsed));
+        ImGui::Text("frame arena     %7.2f", toMiB(memory.perRenderPassArenaSize));
+        ImGui::Text("commands        %7.2f", toMiB(memory.commandBufferSize));
+        ImGui::Text("CPU total       %7.2f", toMiB(memory.getCpuTotal()));
+        ImGui::Separator();
+        ImGui::Text("vertex buffers  %7.2f", toMiB(memory.vertexBuffers));
+        ImGui::Text("index buffers   %7.2f", toMiB(memory.indexBuffers));
+        ImGui::Text("uniforms        %7.2f", toMiB(memory.uniformBuffers));
+        ImGui::Text("textures        %7.2f", toMiB(memory.textures));
+        ImGui::Text("render targets  %7.2f", toMiB(memory.renderTargets));
+        ImGui::Text("GPU total       %7.2f", toMiB(memory.getGpuTotal()));
+        ImGui::Text("programs        %zu", memory.programCount);
+    }
+
+    ImGui::End();
+}
+
+} // namespace filagui
@@ -33,6 +33,10 @@
 #include <utils/compiler.h>
 #include <utils/CString.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filamat {
 
 // Shader postprocessor, called after generation of a shader but before writing it to the package.
@@ -46,6 +50,7 @@ using PostProcessCallBack = std::function<bool(
         std::vector<uint32_t>* /* outputSpirv */ )>;
 
 struct MaterialInfo;
+class ShaderGenerator;
 
 class UTILS_PUBLIC MaterialBuilderBase {
 public:
@@ -79,6 +84,7 @@ protected:
     };
     std::vector<CodeGenParams> mCodeGenPermutations;
     uint8_t mVariantFilter = 0;
+    bool mCompressDictionaries = false;
 };
 
 class UTILS_PUBLIC MaterialBuilder : public MaterialBuilderBase {
@@ -97,6 +103,7 @@ public:
     using SamplerType = filament::driver::SamplerType;
     using SamplerFormat = filament::driver::SamplerFormat;
     using SamplerPrecision = filament::driver::Precision;
+    using ShaderPrecision = filament::driver::Precision;
     using CullingMode = filament::driver::CullingMode;
 
     // Each shader generated while building the package content can be post-processed via this
@@ -178,6 +185,11 @@ public:
     // specifies how transparent objects should be rendered (default is DEFAULT)
     MaterialBuilder& transparencyMode(TransparencyMode mode) noexcept;
 
+    // default precision of the fragment shader's floats and ints. DEFAULT uses medium on mobile
+    // and high on desktop. MEDIUM lets GPUs with fast fp16 ALUs use them on all platforms, the
+    // values that need it (positions, depth, light space coordinates...) are always highp.
+    MaterialBuilder& precision(ShaderPrecision precision) noexcept;
+
     // specifies desktop vs mobile; works in concert with TargetApi to determine the shader models
     // (used to generate code) and final output representations (spirv and/or text).
     MaterialBuilder& platform(Platform platform) noexcept;
@@ -194,6 +206,15 @@ public:
     // specifies a list of variants that should be filtered out during code generation.
     MaterialBuilder& variantFilter(uint8_t variantFilter) noexcept;
 
+    // compresses the shader dictionaries (LZ4). This makes the package smaller at the cost of
+    // decompressing the dictionary when the first shader of the material is requested.
+    MaterialBuilder& compressDictionaries(bool enabled) noexcept;
+
+    // generates and post-processes the shaders in parallel using the given JobSystem. The calling
+    // thread must be adopted by the JobSystem and the post-processor callback must be thread-safe.
+    // The package is identical to the one built serially (the default, nullptr).
+    MaterialBuilder& jobSystem(utils::JobSystem* jobSystem) noexcept;
+
     // build the material
     Package build() noexcept;
 
@@ -246,9 +267,24 @@ public:
 
     uint8_t getVariantFilter() const { return mVariantFilter; }
 
+    ShaderPrecision getPrecision() const { return mPrecision; }
+
 private:
+    // A single shader to generate, results are stored in place.
+    struct ShaderTask {
+        size_t permutation;                 // index in mCodeGenPermutations
+        uint8_t variant;
+        filament::driver::ShaderType stage;
+        std::string shader;
+        std::vector<uint32_t> spirv;
+        bool ok = true;
+    };
+
     void prepareToBuild(MaterialInfo& info) noexcept;
 
+    void generateShader(ShaderGenerator const& sg, MaterialInfo const& info,
+            ShaderTask& task) const noexcept;
+
     bool isLit() const noexcept { return mShading != filament::Shading::UNLIT; }
 
     utils::CString mMaterialName;
@@ -268,6 +304,7 @@ private:
     Interpolation mInterpolation = Interpolation::SMOOTH;
     VertexDomain mVertexDomain = VertexDomain::OBJECT;
     TransparencyMode mTransparencyMode = TransparencyMode::DEFAULT;
+    ShaderPrecision mPrecision = ShaderPrecision::DEFAULT;
 
     filament::AttributeBitset mRequiredAttributes;
 
@@ -284,6 +321,7 @@ private:
     bool mDepthWriteSet = false;
 
     PostProcessCallBack mPostprocessorCallback = nullptr;
+    utils::JobSystem* mJobSystem = nullptr;
 };
 
 } // namespace filamat
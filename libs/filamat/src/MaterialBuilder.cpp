@@ -16,8 +16,10 @@
 
 #include "filamat/MaterialBuilder.h"
 
+#include <algorithm>
 #include <vector>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Log.h>
 
@@ -26,6 +28,8 @@
 
 #include <private/filament/Variant.h>
 
+#include <filaflat/ShaderCost.h>
+
 #include "shaders/MaterialInfo.h"
 #include "shaders/ShaderGenerator.h"
 
@@ -244,6 +248,11 @@ MaterialBuilder& MaterialBuilder::transparencyMode(TransparencyMode mode) noexce
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::precision(ShaderPrecision precision) noexcept {
+    mPrecision = precision;
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::platform(Platform platform) noexcept {
     mPlatform = platform;
     return *this;
@@ -265,6 +274,16 @@ MaterialBuilder& MaterialBuilder::variantFilter(uint8_t variantFilter) noexcept
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::compressDictionaries(bool enabled) noexcept {
+    mCompressDictionaries = enabled;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::jobSystem(utils::JobSystem* jobSystem) noexcept {
+    mJobSystem = jobSystem;
+    return *this;
+}
+
 bool MaterialBuilder::hasExternalSampler() const noexcept {
     for (size_t i = 0, c = mParameterCount; i < c; i++) {
         auto const& param = mParameters[i];
@@ -311,9 +330,31 @@ void MaterialBuilder::prepareToBuild(MaterialInfo& info) noexcept {
     info.blendingMode = mBlendingMode;
     info.shading = mShading;
     info.hasShadowMultiplier = mShadowMultiplier;
+    info.precision = mPrecision;
     info.samplerBindings.populate(&info.sib);
 }
 
+void MaterialBuilder::generateShader(ShaderGenerator const& sg, MaterialInfo const& info,
+        ShaderTask& task) const noexcept {
+    const CodeGenParams& params = mCodeGenPermutations[task.permutation];
+    const ShaderModel shaderModel = ShaderModel(params.shaderModel);
+    const TargetApi targetApi = params.targetApi;
+    const TargetApi codeGenTargetApi = params.codeGenTargetApi;
+    std::vector<uint32_t>* pSpirv = (targetApi == TargetApi::VULKAN) ? &task.spirv : nullptr;
+
+    if (task.stage == filament::driver::ShaderType::VERTEX) {
+        task.shader = sg.createVertexProgram(shaderModel, targetApi, codeGenTargetApi, info,
+                task.variant, mInterpolation, mVertexDomain);
+    } else {
+        task.shader = sg.createFragmentProgram(shaderModel, targetApi, codeGenTargetApi, info,
+                task.variant, mInterpolation);
+    }
+    if (mPostprocessorCallback != nullptr) {
+        task.ok = mPostprocessorCallback(task.shader, task.stage, shaderModel,
+                &task.shader, pSpirv);
+    }
+}
+
 static void showErrorMessage(const char* materialName, uint8_t variant,
         MaterialBuilder::TargetApi targetApi, filament::driver::ShaderType shaderType,
         const std::string& shaderCode) {
@@ -411,6 +452,11 @@ Package MaterialBuilder::build() noexcept {
             static_cast<uint8_t>(mInterpolation));
     container.addChild(&matInterpolation);
 
+    // Used at runtime to substitute the variants that were filtered out.
+    SimpleFieldChunk<uint8_t> matVariantFilterMask(ChunkType::MaterialVariantFilterMask,
+            mVariantFilter);
+    container.addChild(&matVariantFilterMask);
+
     // In order to generate SPIR-V, we must run the GLSL through the post-processor.
     if (mCodeGenTargetApi != TargetApi::OPENGL && mPostprocessorCallback == nullptr) {
         utils::slog.e << "SPIR-V requested for " << mMaterialName.c_str()
@@ -426,7 +472,6 @@ Package MaterialBuilder::build() noexcept {
     std::vector<SpirvEntry> spirvEntries;
     LineDictionary glslDictionary;
     BlobDictionary spirvDictionary;
-    std::vector<uint32_t> spirv;
 
     ShaderGenerator sg(mProperties, mVariables,
             mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
@@ -437,19 +482,11 @@ Package MaterialBuilder::build() noexcept {
     SimpleFieldChunk<bool> hasCustomDepth(ChunkType::MaterialHasCustomDepthShader, customDepth);
     container.addChild(&hasCustomDepth);
 
-    bool errorOccured = false;
-    for (const auto& params : mCodeGenPermutations) {
-        const ShaderModel shaderModel = ShaderModel(params.shaderModel);
-        const TargetApi targetApi = params.targetApi;
-        const TargetApi codeGenTargetApi = params.codeGenTargetApi;
-        std::vector<uint32_t>* pSpirv = (targetApi == TargetApi::VULKAN) ? &spirv : nullptr;
-
-        GlslEntry glslEntry;
-        SpirvEntry spirvEntry;
-
-        glslEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-        spirvEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-
+    // Shaders are generated in two steps: every (permutation, variant, stage) is first generated
+    // and post-processed, possibly in parallel, then the results are added to the package in a
+    // fixed order, so that the output doesn't depend on how the work was scheduled.
+    std::vector<ShaderTask> tasks;
+    for (size_t i = 0; i < mCodeGenPermutations.size(); i++) {
         // apply custom variants filters
         uint8_t variantMask = ~mVariantFilter;
 
@@ -459,79 +496,89 @@ Package MaterialBuilder::build() noexcept {
                 continue;
             }
 
-            glslEntry.variant = k;
-            spirvEntry.variant = k;
-
             // Remove variants for unlit materials
             uint8_t v = filament::Variant::filterVariant(k & variantMask, isLit() || mShadowMultiplier);
 
             if (filament::Variant::filterVariantVertex(v) == k) {
-                // Vertex Shader
-                std::string vs = sg.createVertexProgram(
-                        shaderModel, targetApi, codeGenTargetApi, info, k,
-                        mInterpolation, mVertexDomain);
-                if (mPostprocessorCallback != nullptr) {
-                    bool ok = mPostprocessorCallback(vs, filament::driver::ShaderType::VERTEX,
-                            shaderModel, &vs, pSpirv);
-                    if (!ok) {
-                        showErrorMessage(mMaterialName.c_str_safe(), k, targetApi,
-                                filament::driver::ShaderType::VERTEX, vs);
-                        errorOccured = true;
-                        break;
-                    }
-                }
-                if (targetApi == TargetApi::OPENGL) {
-                    glslEntry.stage = filament::driver::ShaderType::VERTEX;
-                    glslEntry.shaderSize = vs.size();
-                    glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
-                    strcpy(glslEntry.shader, vs.c_str());
-                    glslDictionary.addText(glslEntry.shader);
-                    glslEntries.push_back(glslEntry);
-                }
-                if (targetApi == TargetApi::VULKAN) {
-                    assert(spirv.size() > 0);
-                    spirvEntry.stage = filament::driver::ShaderType::VERTEX;
-                    spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                    spirv.clear();
-                    spirvEntries.push_back(spirvEntry);
-                }
+                tasks.push_back({ i, k, filament::driver::ShaderType::VERTEX });
             }
-
             if (filament::Variant::filterVariantFragment(v) == k) {
-                // Fragment Shader
-                std::string fs = sg.createFragmentProgram(
-                        shaderModel, targetApi, codeGenTargetApi, info, k, mInterpolation);
-                if (mPostprocessorCallback != nullptr) {
-                    bool ok = mPostprocessorCallback(fs, filament::driver::ShaderType::FRAGMENT,
-                            shaderModel, &fs, pSpirv);
-                    if (!ok) {
-                        showErrorMessage(mMaterialName.c_str_safe(), k, targetApi,
-                                filament::driver::ShaderType::FRAGMENT, fs);
-                        errorOccured = true;
-                        break;
-                    }
-                }
-                if (targetApi == TargetApi::OPENGL) {
-                    glslEntry.stage = filament::driver::ShaderType::FRAGMENT;
-                    glslEntry.shaderSize = fs.size();
-                    glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
-                    strcpy(glslEntry.shader, fs.c_str());
-                    glslDictionary.addText(glslEntry.shader);
-                    glslEntries.push_back(glslEntry);
-                }
-                if (targetApi == TargetApi::VULKAN) {
-                    assert(spirv.size() > 0);
-                    spirvEntry.stage = filament::driver::ShaderType::FRAGMENT;
-                    spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                    spirv.clear();
-                    spirvEntries.push_back(spirvEntry);
-                }
+                tasks.push_back({ i, k, filament::driver::ShaderType::FRAGMENT });
+            }
+        }
+    }
+
+    auto generate = [this, &sg, &info](ShaderTask* tasks, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            generateShader(sg, info, tasks[i]);
+        }
+    };
+    if (mJobSystem) {
+        JobSystem& js = *mJobSystem;
+        JobSystem::Job* job = jobs::parallel_for(js, nullptr, tasks.data(), uint32_t(tasks.size()),
+                std::cref(generate), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+    } else {
+        generate(tasks.data(), tasks.size());
+    }
+
+    bool errorOccured = false;
+    std::vector<bool> failedPermutations(mCodeGenPermutations.size(), false);
+    uint32_t shaderCost = 0;
+    for (ShaderTask& task : tasks) {
+        // like a serial build, stop at the first error of each permutation
+        if (failedPermutations[task.permutation]) {
+            continue;
+        }
+
+        const CodeGenParams& params = mCodeGenPermutations[task.permutation];
+        const TargetApi targetApi = params.targetApi;
+        if (!task.ok) {
+            showErrorMessage(mMaterialName.c_str_safe(), task.variant, targetApi, task.stage,
+                    task.shader);
+            failedPermutations[task.permutation] = true;
+            errorOccured = true;
+            continue;
+        }
+
+        if (targetApi == TargetApi::OPENGL) {
+            GlslEntry glslEntry;
+            glslEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
+            glslEntry.variant = task.variant;
+            glslEntry.stage = task.stage;
+            glslEntry.shaderSize = task.shader.size();
+            glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
+            strcpy(glslEntry.shader, task.shader.c_str());
+            glslDictionary.addText(glslEntry.shader);
+            glslEntries.push_back(glslEntry);
+        }
+        if (targetApi == TargetApi::VULKAN) {
+            assert(task.spirv.size() > 0);
+            SpirvEntry spirvEntry;
+            spirvEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
+            spirvEntry.variant = task.variant;
+            spirvEntry.stage = task.stage;
+            spirvEntry.dictionaryIndex = spirvDictionary.addBlob(task.spirv);
+            spirvEntries.push_back(spirvEntry);
+
+            // the cost of the material is the one of its most expensive color pass fragment
+            // shader, estimated like matinfo does from the SPIR-V
+            if (task.stage == filament::driver::ShaderType::FRAGMENT &&
+                    !filament::Variant(task.variant).isDepthPass()) {
+                shaderCost = std::max(shaderCost, filaflat::computeSpirvCost(
+                        task.spirv.data(), task.spirv.size()).instructions);
             }
         }
     }
 
+    // only the materials built for Vulkan have a cost
+    SimpleFieldChunk<uint32_t> matShaderCost(ChunkType::MaterialShaderCost, shaderCost);
+    if (shaderCost) {
+        container.addChild(&matShaderCost);
+    }
+
     // Emit GLSL chunks (TextDictionaryReader and MaterialGlslChunk).
-    filamat::DictionaryGlslChunk dicGlslChunk(glslDictionary);
+    filamat::DictionaryGlslChunk dicGlslChunk(glslDictionary, mCompressDictionaries);
     MaterialGlslChunk glslChunk(glslEntries, glslDictionary);
     if (!glslEntries.empty()) {
         container.addChild(&dicGlslChunk);
@@ -539,7 +586,7 @@ Package MaterialBuilder::build() noexcept {
     }
 
     // Emit SPIRV chunks (SpirvDictionaryReader and MaterialSpirvChunk).
-    filamat::DictionarySpirvChunk dicSpirvChunk(spirvDictionary);
+    filamat::DictionarySpirvChunk dicSpirvChunk(spirvDictionary, mCompressDictionaries);
     MaterialSpirvChunk spirvChunk(spirvEntries);
     if (!spirvEntries.empty()) {
         container.addChild(&dicSpirvChunk);
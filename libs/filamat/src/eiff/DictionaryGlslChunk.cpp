@@ -16,13 +16,37 @@
 
 #include "DictionaryGlslChunk.h"
 
+#include "Lz4Encoder.h"
+
 namespace filamat {
 
-DictionaryGlslChunk::DictionaryGlslChunk(LineDictionary& dictionary) :
-        Chunk(ChunkType::DictionaryGlsl), mDictionary(dictionary){
+DictionaryGlslChunk::DictionaryGlslChunk(LineDictionary& dictionary, bool compressed) :
+        Chunk(compressed ? ChunkType::DictionaryGlslCompressed : ChunkType::DictionaryGlsl),
+        mDictionary(dictionary), mCompressed(compressed) {
 }
 
 void DictionaryGlslChunk::flatten(Flattener& f) {
+    if (!mCompressed) {
+        flattenDictionary(f);
+        return;
+    }
+
+    if (mUncompressedSize == 0) {
+        Flattener sizer(nullptr);
+        flattenDictionary(sizer);
+        std::vector<uint8_t> data(sizer.getBytesWritten());
+        Flattener writer(data.data());
+        flattenDictionary(writer);
+        mUncompressedSize = data.size();
+        mCompressedData = Lz4Encoder::encode(data.data(), data.size());
+    }
+
+    f.writeUint32(static_cast<uint32_t>(CompressionScheme::LZ4));
+    f.writeUint32(static_cast<uint32_t>(mUncompressedSize));
+    f.writeBlob((const char*) mCompressedData.data(), mCompressedData.size());
+}
+
+void DictionaryGlslChunk::flattenDictionary(Flattener& f) {
     // NumStrings
     f.writeUint32(mDictionary.getLineCount());
 
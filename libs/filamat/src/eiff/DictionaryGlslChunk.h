@@ -28,11 +28,18 @@ namespace filamat {
 
 class DictionaryGlslChunk : public Chunk {
 public:
-    DictionaryGlslChunk(LineDictionary& dictionary);
+    // When compressed, the chunk is emitted as DictionaryGlslCompressed instead.
+    DictionaryGlslChunk(LineDictionary& dictionary, bool compressed = false);
     ~DictionaryGlslChunk() = default;
     virtual void flatten(Flattener& f);
 private:
+    void flattenDictionary(Flattener& f);
+
     LineDictionary& mDictionary;
+    bool mCompressed;
+    // compressed once and reused by both the dry run and the actual flattening
+    std::vector<uint8_t> mCompressedData;
+    size_t mUncompressedSize = 0;
 };
 
 } // namespace filamat
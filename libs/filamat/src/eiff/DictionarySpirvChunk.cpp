@@ -16,15 +16,37 @@
 
 #include "DictionarySpirvChunk.h"
 
+#include "Lz4Encoder.h"
+
 namespace filamat {
 
-DictionarySpirvChunk::DictionarySpirvChunk(BlobDictionary& dictionary) :
-        Chunk(ChunkType::DictionarySpirv), mDictionary(dictionary){
+DictionarySpirvChunk::DictionarySpirvChunk(BlobDictionary& dictionary, bool compressed) :
+        Chunk(ChunkType::DictionarySpirv), mDictionary(dictionary), mCompressed(compressed) {
 }
 
 void DictionarySpirvChunk::flatten(Flattener& f) {
-    // TODO: for now the compression option is always 0, fix this.
-    f.writeUint32(0);
+    if (!mCompressed) {
+        f.writeUint32(static_cast<uint32_t>(CompressionScheme::NONE));
+        flattenBlobs(f);
+        return;
+    }
+
+    if (mUncompressedSize == 0) {
+        Flattener sizer(nullptr);
+        flattenBlobs(sizer);
+        std::vector<uint8_t> data(sizer.getBytesWritten());
+        Flattener writer(data.data());
+        flattenBlobs(writer);
+        mUncompressedSize = data.size();
+        mCompressedData = Lz4Encoder::encode(data.data(), data.size());
+    }
+
+    f.writeUint32(static_cast<uint32_t>(CompressionScheme::LZ4));
+    f.writeUint32(static_cast<uint32_t>(mUncompressedSize));
+    f.writeBlob((const char*) mCompressedData.data(), mCompressedData.size());
+}
+
+void DictionarySpirvChunk::flattenBlobs(Flattener& f) {
     f.writeUint32(mDictionary.getBlobCount());
     for (size_t i = 0 ; i < mDictionary.getBlobCount() ; i++) {
         const std::string& blob = mDictionary.getBlob(i);
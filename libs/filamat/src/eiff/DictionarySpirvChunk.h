@@ -28,11 +28,17 @@ namespace filamat {
 
 class DictionarySpirvChunk : public Chunk {
 public:
-    DictionarySpirvChunk(BlobDictionary& dictionary);
+    DictionarySpirvChunk(BlobDictionary& dictionary, bool compressed = false);
     ~DictionarySpirvChunk() = default;
     virtual void flatten(Flattener& f);
 private:
+    void flattenBlobs(Flattener& f);
+
     BlobDictionary& mDictionary;
+    bool mCompressed;
+    // compressed once and reused by both the dry run and the actual flattening
+    std::vector<uint8_t> mCompressedData;
+    size_t mUncompressedSize = 0;
 };
 
 } // namespace filamat
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Lz4Encoder.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace filamat {
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t LAST_LITERALS = 5;  // the last 5 bytes are always literals
+static constexpr size_t MF_LIMIT = 12;      // the last match starts at least 12 bytes from the end
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr size_t HASH_BITS = 16;
+static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+static inline uint32_t read32(const uint8_t* p) noexcept {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash(uint32_t v) noexcept {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void writeLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(uint8_t(length));
+}
+
+// A matchLength of 0 writes the last sequence, which only has literals.
+static void writeSequence(std::vector<uint8_t>& out,
+        const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    const size_t extraMatch = matchLength ? matchLength - MIN_MATCH : 0;
+    out.push_back(uint8_t((std::min(literalCount, size_t(15)) << 4u) |
+            (matchLength ? std::min(extraMatch, size_t(15)) : 0)));
+    if (literalCount >= 15) {
+        writeLength(out, literalCount - 15);
+    }
+    out.insert(out.end(), literals, literals + literalCount);
+    if (matchLength) {
+        out.push_back(uint8_t(offset & 0xffu));
+        out.push_back(uint8_t(offset >> 8u));
+        if (extraMatch >= 15) {
+            writeLength(out, extraMatch - 15);
+        }
+    }
+}
+
+std::vector<uint8_t> Lz4Encoder::encode(const uint8_t* src, size_t size) {
+    std::vector<uint8_t> out;
+    out.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > MF_LIMIT) {
+        std::vector<uint32_t> table(1u << HASH_BITS, NO_ENTRY);
+        const size_t matchLimit = size - LAST_LITERALS;
+        size_t i = 0;
+        while (i <= size - MF_LIMIT) {
+            const uint32_t v = read32(src + i);
+            uint32_t& entry = table[hash(v)];
+            const uint32_t candidate = entry;
+            entry = uint32_t(i);
+            if (candidate == NO_ENTRY || i - candidate > MAX_OFFSET ||
+                    read32(src + candidate) != v) {
+                i++;
+                continue;
+            }
+
+            // extend the match forward, then backward over pending literals
+            size_t start = i;
+            size_t ref = candidate;
+            size_t length = MIN_MATCH;
+            while (start + length < matchLimit && src[ref + length] == src[start + length]) {
+                length++;
+            }
+            while (start > anchor && ref > 0 && src[start - 1] == src[ref - 1]) {
+                start--;
+                ref--;
+                length++;
+            }
+
+            writeSequence(out, src + anchor, start - anchor, start - ref, length);
+            i = start + length;
+            anchor = i;
+        }
+    }
+    writeSequence(out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+} // namespace filamat
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_FILAMAT_LZ4ENCODER_H
+#define TNT_FILAMAT_LZ4ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace filamat {
+
+// Encoder for the LZ4 block format, used to compress the shader dictionaries. This favors a
+// simple greedy parse: materials are compressed once offline, while the runtime only pays for
+// the (very fast) decoding.
+class Lz4Encoder {
+public:
+    static std::vector<uint8_t> encode(const uint8_t* src, size_t size);
+};
+
+} // namespace filamat
+
+#endif // TNT_FILAMAT_LZ4ENCODER_H
@@ -20,6 +20,7 @@
 
 #include <cctype>
 #include <iomanip>
+#include <string>
 
 namespace filamat {
 
@@ -34,7 +35,7 @@ std::ostream& CodeGenerator::generateSeparator(std::ostream& out) const {
 }
 
 std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
-        bool hasExternalSamplers) const {
+        bool hasExternalSamplers, bool hasFramebufferFetch) const {
     assert(mShaderModel != ShaderModel::UNKNOWN);
     switch (mShaderModel) {
         case ShaderModel::UNKNOWN:
@@ -51,6 +52,10 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
             if (hasExternalSamplers) {
                 out << "#extension GL_OES_EGL_image_external_essl3 : require\n\n";
             }
+            if (hasFramebufferFetch && mCodeGenTargetApi != TargetApi::VULKAN) {
+                // optional, the shader falls back to sampling the color attachment
+                out << "#extension GL_EXT_shader_framebuffer_fetch : enable\n\n";
+            }
             out << "#define TARGET_MOBILE\n";
             break;
         case ShaderModel::GL_CORE_41:
@@ -76,6 +81,12 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
     out << "precision " << precision << " float;\n";
     out << "precision " << precision << " int;\n";
 
+    if (type == ShaderType::FRAGMENT && mPrecision != Precision::DEFAULT) {
+        // the shader library's HIGHP and MEDIUMP qualifiers must be honored for the default
+        // precision to be safe, desktop shader models included
+        out << "#define SHADER_HAS_PRECISION_QUALIFIERS\n";
+    }
+
     if (type == ShaderType::VERTEX) {
         out << "\n";
         out << "invariant gl_Position;\n";
@@ -91,6 +102,9 @@ Precision CodeGenerator::getDefaultPrecision(ShaderType type) const {
     if (type == ShaderType::VERTEX) {
         return Precision::HIGH;
     } else if (type == ShaderType::FRAGMENT) {
+        if (mPrecision != Precision::DEFAULT) {
+            return mPrecision;
+        }
         if (mShaderModel < ShaderModel::GL_CORE_41) {
             return Precision::MEDIUM;
         } else {
@@ -131,6 +145,8 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
         switch (variant) {
             case PostProcessStage::TONE_MAPPING_OPAQUE:
             case PostProcessStage::TONE_MAPPING_TRANSLUCENT:
+            case PostProcessStage::TONE_MAPPING_OPAQUE_IN_PLACE:
+            case PostProcessStage::TONE_MAPPING_TRANSLUCENT_IN_PLACE:
                 out << filament::shaders::tone_mapping_fs;
                 out << filament::shaders::conversion_functions_fs;
                 out << filament::shaders::dithering_fs;
@@ -139,6 +155,28 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
             case PostProcessStage::ANTI_ALIASING_TRANSLUCENT:
                 out << filament::shaders::fxaa_fs;
                 break;
+            case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE:
+            case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT:
+                // fxaa.fs tone maps its taps with these
+                out << filament::shaders::tone_mapping_fs;
+                out << filament::shaders::conversion_functions_fs;
+                out << filament::shaders::dithering_fs;
+                out << filament::shaders::fxaa_fs;
+                break;
+            case PostProcessStage::TEMPORAL_UPSAMPLING:
+            case PostProcessStage::TRANSPARENCY_RESOLVE:
+            case PostProcessStage::SHADOW_MOMENTS_BLUR:
+            case PostProcessStage::AUTO_EXPOSURE_LUMINANCE:
+            case PostProcessStage::AUTO_EXPOSURE_REDUCE:
+            case PostProcessStage::AUTO_EXPOSURE_ADAPTATION:
+            case PostProcessStage::DEBUG_HEATMAP:
+                break;
+            case PostProcessStage::IBL_PREFILTER_SPECULAR:
+            case PostProcessStage::IBL_PREFILTER_SH:
+            case PostProcessStage::MIPMAP_DOWNSAMPLE:
+                // the mipmap generation uses its cubemap utilities
+                out << filament::shaders::ibl_prefilter_fs;
+                break;
         }
         out << filament::shaders::post_process_fs;
     }
@@ -184,6 +222,13 @@ std::ostream& CodeGenerator::generateVariables(std::ostream& out, ShaderType typ
     bool hasBoneWeights = attributes.test(VertexAttribute::BONE_WEIGHTS);
     generateDefine(out, "HAS_ATTRIBUTE_BONE_WEIGHTS", hasBoneWeights);
 
+    // all the morph targets are declared together
+    bool hasMorphPositions = attributes.test(VertexAttribute::MORPH_POSITION_0);
+    generateDefine(out, "HAS_ATTRIBUTE_MORPH_POSITIONS", hasMorphPositions);
+
+    bool hasMorphTangents = attributes.test(VertexAttribute::MORPH_TANGENTS_0);
+    generateDefine(out, "HAS_ATTRIBUTE_MORPH_TANGENTS", hasMorphTangents);
+
     if (type == ShaderType::VERTEX) {
         out << "\n";
         generateDefine(out, "LOCATION_POSITION", uint32_t(VertexAttribute::POSITION));
@@ -205,6 +250,17 @@ std::ostream& CodeGenerator::generateVariables(std::ostream& out, ShaderType typ
         if (hasBoneWeights) {
             generateDefine(out, "LOCATION_BONE_WEIGHTS", uint32_t(VertexAttribute::BONE_WEIGHTS));
         }
+        for (uint32_t i = 0; i < CONFIG_MAX_MORPH_TARGETS; i++) {
+            const std::string index = std::to_string(i);
+            if (hasMorphPositions) {
+                generateDefine(out, ("LOCATION_MORPH_POSITION_" + index).c_str(),
+                        uint32_t(VertexAttribute::MORPH_POSITION_0 + i));
+            }
+            if (hasMorphTangents) {
+                generateDefine(out, ("LOCATION_MORPH_TANGENTS_" + index).c_str(),
+                        uint32_t(VertexAttribute::MORPH_TANGENTS_0 + i));
+            }
+        }
 
         out << filament::shaders::variables_vs;
     } else if (type == ShaderType::FRAGMENT) {
@@ -325,6 +381,14 @@ std::ostream& CodeGenerator::generateDefine(std::ostream& out, const char* name,
     return out;
 }
 
+std::ostream& CodeGenerator::generateSpecializationConstant(std::ostream& out, const char* name,
+        uint32_t id, bool value) const {
+    assert(mTargetApi == TargetApi::VULKAN);
+    out << "layout (constant_id = " << id << ") const bool " << name << " = "
+        << (value ? "true" : "false") << ";\n";
+    return out;
+}
+
 std::ostream& CodeGenerator::generateFunction(std::ostream& out, const char* returnType,
         const char* name, const char* body) const {
     out << "\n" << returnType << " " << name << "()";
@@ -382,7 +446,8 @@ std::ostream& CodeGenerator::generateShaderLit(std::ostream& out, ShaderType typ
     if (type == ShaderType::VERTEX) {
     } else if (type == ShaderType::FRAGMENT) {
         out << filament::shaders::common_lighting_fs;
-        if (variant.hasShadowReceiver()) {
+        // spot lights sample the shadow atlas
+        if (variant.hasShadowReceiver() || variant.hasDynamicLighting()) {
             out << filament::shaders::shadowing_fs;
         }
 
@@ -512,6 +577,23 @@ char const* CodeGenerator::getSamplerTypeName(SamplerType type, SamplerFormat fo
             // are created via VK_ANDROID_external_memory_android_hardware_buffer, but they are
             // backed by VkImage just like a normal texture, and sampled from normally.
             return (mCodeGenTargetApi == TargetApi::VULKAN) ? "sampler2D" : "samplerExternalOES";
+        case SamplerType::SAMPLER_2D_ARRAY:
+            assert(!multisample);
+            switch (format) {
+                case SamplerFormat::INT:    return "isampler2DArray";
+                case SamplerFormat::UINT:   return "usampler2DArray";
+                case SamplerFormat::FLOAT:  return "sampler2DArray";
+                case SamplerFormat::SHADOW: return "sampler2DArrayShadow";
+            }
+        case SamplerType::SAMPLER_3D:
+            assert(!multisample);
+            assert(format != SamplerFormat::SHADOW);
+            switch (format) {
+                case SamplerFormat::INT:    return "isampler3D";
+                case SamplerFormat::UINT:   return "usampler3D";
+                case SamplerFormat::FLOAT:  return "sampler3D";
+                case SamplerFormat::SHADOW: return "sampler3D";
+            }
     }
 }
 
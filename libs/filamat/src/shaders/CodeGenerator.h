@@ -39,9 +39,12 @@ class UTILS_PRIVATE CodeGenerator {
     using ShaderType = filament::driver::ShaderType;
     using TargetApi = MaterialBuilder::TargetApi;
 public:
+    // precision is the default precision of fragment shaders, DEFAULT picks the shader model's
     CodeGenerator(filament::driver::ShaderModel shaderModel,
-            TargetApi targetApi, TargetApi codeGenTargetApi) noexcept
-            : mShaderModel(shaderModel), mTargetApi(targetApi), mCodeGenTargetApi(codeGenTargetApi) {
+            TargetApi targetApi, TargetApi codeGenTargetApi,
+            filament::driver::Precision precision = filament::driver::Precision::DEFAULT) noexcept
+            : mShaderModel(shaderModel), mTargetApi(targetApi), mCodeGenTargetApi(codeGenTargetApi),
+              mPrecision(precision) {
         if (targetApi == TargetApi::ALL) {
             utils::slog.e << "Must resolve target API before codegen." << utils::io::endl;
             std::terminate();
@@ -54,7 +57,8 @@ public:
     std::ostream& generateSeparator(std::ostream& out) const;
 
     // generate prolog for the given shader
-    std::ostream& generateProlog(std::ostream& out, ShaderType type, bool hasExternalSamplers) const;
+    std::ostream& generateProlog(std::ostream& out, ShaderType type, bool hasExternalSamplers,
+            bool hasFramebufferFetch = false) const;
 
     std::ostream& generateEpilog(std::ostream& out) const;
 
@@ -106,6 +110,10 @@ public:
     std::ostream& generateDefine(std::ostream& out, const char* name, uint32_t value) const;
     std::ostream& generateDefine(std::ostream& out, const char* name, const char* string) const;
 
+    // generate a boolean specialization constant (Vulkan only)
+    std::ostream& generateSpecializationConstant(std::ostream& out, const char* name,
+            uint32_t id, bool value) const;
+
     std::ostream& generateGetters(std::ostream& out, ShaderType type) const;
     std::ostream& generateParameters(std::ostream& out, ShaderType type) const;
 
@@ -131,6 +139,7 @@ private:
     filament::driver::ShaderModel mShaderModel;
     TargetApi mTargetApi;
     TargetApi mCodeGenTargetApi;
+    filament::driver::Precision mPrecision;
 
     // return type name of uniform  (e.g.: "vec3", "vec4", "float")
     static char const* getUniformTypeName(filament::UniformInterfaceBlock::Type uniformType) noexcept;
@@ -40,6 +40,7 @@ struct UTILS_PUBLIC MaterialInfo {
     filament::AttributeBitset requiredAttributes;
     filament::BlendingMode blendingMode;
     filament::Shading shading;
+    filament::driver::Precision precision;      // default precision of the fragment shader
     filament::UniformInterfaceBlock uib;
     filament::SamplerInterfaceBlock sib;
     filament::SamplerBindingMap samplerBindings;
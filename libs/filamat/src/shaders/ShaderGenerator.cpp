@@ -169,6 +169,13 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     if (variant.hasSkinning()) {
         attributes.set(VertexAttribute::BONE_INDICES);
         attributes.set(VertexAttribute::BONE_WEIGHTS);
+        // the skinning variant also blends the morph targets
+        for (size_t i = 0; i < CONFIG_MAX_MORPH_TARGETS; i++) {
+            attributes.set(VertexAttribute::MORPH_POSITION_0 + i);
+            if (attributes.test(VertexAttribute::TANGENTS)) {
+                attributes.set(VertexAttribute::MORPH_TANGENTS_0 + i);
+            }
+        }
     }
     cg.generateVariables(vs, ShaderType::VERTEX, attributes, interpolation);
 
@@ -235,7 +242,7 @@ const std::string ShaderGenerator::createFragmentProgram(filament::driver::Shade
         MaterialInfo const& material, uint8_t variantKey,
         filament::Interpolation interpolation) const noexcept {
 
-    const CodeGenerator cg(shaderModel, targetApi, codeGenTargetApi);
+    const CodeGenerator cg(shaderModel, targetApi, codeGenTargetApi, material.precision);
     const bool lit = material.isLit;
     const filament::Variant variant(variantKey);
 
@@ -251,7 +258,17 @@ const std::string ShaderGenerator::createFragmentProgram(filament::driver::Shade
     // lighting variants
     bool litVariants = lit || (!lit && material.hasShadowMultiplier);
     cg.generateDefine(fs, "HAS_DIRECTIONAL_LIGHTING", litVariants && variant.hasDirectionalLighting());
-    cg.generateDefine(fs, "HAS_DYNAMIC_LIGHTING", litVariants && variant.hasDynamicLighting());
+    if (targetApi == MaterialBuilder::TargetApi::VULKAN && litVariants) {
+        // the same SPIR-V is used with and without dynamic lighting, see
+        // Variant::SPECIALIZATION_MASK
+        cg.generateDefine(fs, "HAS_DYNAMIC_LIGHTING_SPECIALIZATION", true);
+        cg.generateSpecializationConstant(fs, "SPECIALIZATION_DYNAMIC_LIGHTING",
+                filament::Variant::getSpecializationConstantId(
+                        filament::Variant::DYNAMIC_LIGHTING), false);
+    } else {
+        cg.generateDefine(fs, "HAS_DYNAMIC_LIGHTING",
+                litVariants && variant.hasDynamicLighting());
+    }
     cg.generateDefine(fs, "HAS_SHADOWING", litVariants && variant.hasShadowReceiver());
     cg.generateDefine(fs, "HAS_SHADOW_MULTIPLIER", material.hasShadowMultiplier);
 
@@ -366,7 +383,7 @@ const std::string ShaderPostProcessGenerator::createPostProcessFragmentProgram(
         uint8_t firstSampler) noexcept {
     const CodeGenerator cg(sm, targetApi, codeGenTargetApi);
     std::stringstream fs;
-    cg.generateProlog(fs, ShaderType::FRAGMENT, false);
+    cg.generateProlog(fs, ShaderType::FRAGMENT, false, isInPlace(variant));
     generatePostProcessStageDefines(fs, cg, variant);
 
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
@@ -392,32 +409,222 @@ void ShaderPostProcessGenerator::generatePostProcessStageDefines(std::stringstre
             uint32_t(PostProcessStage::ANTI_ALIASING_OPAQUE));
     cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING_TRANSLUCENT",
             uint32_t(PostProcessStage::ANTI_ALIASING_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING_STAGE",
+            uint32_t(PostProcessStage::TEMPORAL_UPSAMPLING));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_PREFILTER_SPECULAR",
+            uint32_t(PostProcessStage::IBL_PREFILTER_SPECULAR));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_PREFILTER_SH",
+            uint32_t(PostProcessStage::IBL_PREFILTER_SH));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_OPAQUE_IN_PLACE",
+            uint32_t(PostProcessStage::TONE_MAPPING_OPAQUE_IN_PLACE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_TRANSLUCENT_IN_PLACE",
+            uint32_t(PostProcessStage::TONE_MAPPING_TRANSLUCENT_IN_PLACE));
+    cg.generateDefine(vs, "POST_PROCESS_TRANSPARENCY_RESOLVE_STAGE",
+            uint32_t(PostProcessStage::TRANSPARENCY_RESOLVE));
+    cg.generateDefine(vs, "POST_PROCESS_SHADOW_MOMENTS_BLUR_STAGE",
+            uint32_t(PostProcessStage::SHADOW_MOMENTS_BLUR));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_OPAQUE",
+            uint32_t(PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT",
+            uint32_t(PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_AUTO_EXPOSURE_LUMINANCE_STAGE",
+            uint32_t(PostProcessStage::AUTO_EXPOSURE_LUMINANCE));
+    cg.generateDefine(vs, "POST_PROCESS_AUTO_EXPOSURE_REDUCE_STAGE",
+            uint32_t(PostProcessStage::AUTO_EXPOSURE_REDUCE));
+    cg.generateDefine(vs, "POST_PROCESS_AUTO_EXPOSURE_ADAPTATION_STAGE",
+            uint32_t(PostProcessStage::AUTO_EXPOSURE_ADAPTATION));
+    cg.generateDefine(vs, "POST_PROCESS_MIPMAP_DOWNSAMPLE_STAGE",
+            uint32_t(PostProcessStage::MIPMAP_DOWNSAMPLE));
+    cg.generateDefine(vs, "POST_PROCESS_DEBUG_HEATMAP_STAGE",
+            uint32_t(PostProcessStage::DEBUG_HEATMAP));
     switch (variant) {
         case PostProcessStage::TONE_MAPPING_OPAQUE:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TONE_MAPPING_OPAQUE");
-            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
-            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
-            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
             break;
         case PostProcessStage::TONE_MAPPING_TRANSLUCENT:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TONE_MAPPING_TRANSLUCENT");
-            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
-            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
-            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
             break;
         case PostProcessStage::ANTI_ALIASING_OPAQUE:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_ANTI_ALIASING_OPAQUE");
-            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
-            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
-            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       1u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
             break;
         case PostProcessStage::ANTI_ALIASING_TRANSLUCENT:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_ANTI_ALIASING_TRANSLUCENT");
-            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
-            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
-            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       1u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::TEMPORAL_UPSAMPLING:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TEMPORAL_UPSAMPLING_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 1u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::IBL_PREFILTER_SPECULAR:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_PREFILTER_SPECULAR");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::IBL_PREFILTER_SH:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_PREFILTER_SH");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              1u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_OPAQUE_IN_PLACE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_OPAQUE_IN_PLACE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_TRANSLUCENT_IN_PLACE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_TRANSLUCENT_IN_PLACE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::TRANSPARENCY_RESOLVE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TRANSPARENCY_RESOLVE_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::SHADOW_MOMENTS_BLUR:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_SHADOW_MOMENTS_BLUR_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_OPAQUE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       1u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       1u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::AUTO_EXPOSURE_LUMINANCE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_AUTO_EXPOSURE_LUMINANCE_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::AUTO_EXPOSURE_REDUCE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_AUTO_EXPOSURE_REDUCE_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::AUTO_EXPOSURE_ADAPTATION:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_AUTO_EXPOSURE_ADAPTATION_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
+            break;
+        case PostProcessStage::MIPMAP_DOWNSAMPLE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_MIPMAP_DOWNSAMPLE_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              0u);
+            break;
+        case PostProcessStage::DEBUG_HEATMAP:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_DEBUG_HEATMAP_STAGE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING",       0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SPECULAR",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL_SH",              0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",              1u);
             break;
     }
+    cg.generateDefine(vs, "POST_PROCESS_TRANSPARENCY_RESOLVE",
+            variant == PostProcessStage::TRANSPARENCY_RESOLVE ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_SHADOW_MOMENTS_BLUR",
+            variant == PostProcessStage::SHADOW_MOMENTS_BLUR ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_AUTO_EXPOSURE_LUMINANCE",
+            variant == PostProcessStage::AUTO_EXPOSURE_LUMINANCE ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_AUTO_EXPOSURE_REDUCE",
+            variant == PostProcessStage::AUTO_EXPOSURE_REDUCE ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_AUTO_EXPOSURE_ADAPTATION",
+            variant == PostProcessStage::AUTO_EXPOSURE_ADAPTATION ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_MIPMAP_DOWNSAMPLE",
+            variant == PostProcessStage::MIPMAP_DOWNSAMPLE ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_DEBUG_HEATMAP",
+            variant == PostProcessStage::DEBUG_HEATMAP ? 1u : 0u);
+    cg.generateDefine(vs, "POST_PROCESS_IN_PLACE", isInPlace(variant) ? 1u : 0u);
+}
+
+bool ShaderPostProcessGenerator::isInPlace(PostProcessStage variant) noexcept {
+    return variant == PostProcessStage::TONE_MAPPING_OPAQUE_IN_PLACE ||
+           variant == PostProcessStage::TONE_MAPPING_TRANSLUCENT_IN_PLACE;
 }
 
 } // namespace filament
@@ -71,6 +71,8 @@ struct ShaderPostProcessGenerator {
             filament::PostProcessStage variant, uint8_t firstSampler) noexcept;
     static void generatePostProcessStageDefines(std::stringstream& vs, CodeGenerator const& cg,
             filament::PostProcessStage variant) noexcept;
+    // true for the stages reading the color attachment they write to with framebuffer fetch
+    static bool isInPlace(filament::PostProcessStage variant) noexcept;
 };
 
 } // namespace filament
@@ -35,6 +35,7 @@ extern const char dithering_fs[];
 extern const char fxaa_fs[];
 extern const char getters_fs[];
 extern const char getters_vs[];
+extern const char ibl_prefilter_fs[];
 extern const char light_directional_fs[];
 extern const char light_indirect_fs[];
 extern const char light_punctual_fs[];
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMESHIO_MESHREADER_H
+#define TNT_FILAMESHIO_MESHREADER_H
+
+#include <map>
+#include <string>
+
+#include <stddef.h>
+
+#include <utils/Entity.h>
+
+namespace filament {
+    class Engine;
+    class VertexBuffer;
+    class IndexBuffer;
+    class MaterialInstance;
+}
+
+namespace utils {
+    class Path;
+}
+
+namespace filamesh {
+
+/*
+ * Loads meshes in the FILAMESH format (see tools/filamesh).
+ *
+ * The file is memory-mapped and its vertex and index data are handed to the engine as they are,
+ * without intermediate copies. The mapping is released once the driver has consumed the data.
+ */
+class MeshReader {
+public:
+    using MaterialRegistry = std::map<std::string, filament::MaterialInstance*>;
+
+    struct Mesh {
+        utils::Entity renderable;
+        filament::VertexBuffer* vertexBuffer = nullptr;
+        filament::IndexBuffer* indexBuffer = nullptr;
+    };
+
+    // Loads the whole mesh at once. Parts whose material is not in the registry use
+    // "DefaultMaterial". The returned renderable is null if the file couldn't be loaded.
+    static Mesh loadMeshFromFile(filament::Engine* engine, const utils::Path& path,
+            const MaterialRegistry& materials);
+
+    /*
+     * Loads a mesh over several frames, by handing at most chunkSize bytes of data to the
+     * engine per call to update(). This bounds the amount of data uploaded per frame for very
+     * large meshes. The renderable is created once all the data has been handed to the engine.
+     *
+     *  MeshReader::AsyncLoader loader(engine, path, materials);
+     *  // once per frame
+     *  if (loader.update() && loader.isValid()) {
+     *      scene->addEntity(loader.getMesh().renderable);
+     *  }
+     *
+     * The mesh belongs to the caller once it's complete, destroying the loader before that
+     * destroys the buffers created so far.
+     */
+    class AsyncLoader {
+    public:
+        AsyncLoader(filament::Engine* engine, const utils::Path& path,
+                const MaterialRegistry& materials, size_t chunkSize = 4 * 1024 * 1024);
+        ~AsyncLoader();
+
+        AsyncLoader(AsyncLoader const&) = delete;
+        AsyncLoader& operator=(AsyncLoader const&) = delete;
+
+        // false if the file couldn't be read or isn't a FILAMESH file
+        bool isValid() const noexcept;
+
+        // hands the next chunk to the engine, returns true once the mesh is complete or if
+        // the loader is not valid
+        bool update();
+
+        bool isComplete() const noexcept { return mComplete; }
+
+        // between 0 and 1
+        float getProgress() const noexcept;
+
+        // the renderable is only valid once the mesh is complete
+        Mesh const& getMesh() const noexcept { return mMesh; }
+
+    private:
+        struct State;
+        State* mState = nullptr;
+        Mesh mMesh;
+        bool mComplete = false;
+    };
+};
+
+} // namespace filamesh
+
+#endif // TNT_FILAMESHIO_MESHREADER_H
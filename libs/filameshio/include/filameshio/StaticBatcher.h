@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMESHIO_STATICBATCHER_H
+#define TNT_FILAMESHIO_STATICBATCHER_H
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Entity.h>
+
+#include <math/mat4.h>
+#include <math/quat.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+#include <filament/Box.h>
+
+namespace filament {
+    class Engine;
+    class VertexBuffer;
+    class IndexBuffer;
+    class MaterialInstance;
+}
+
+namespace filamesh {
+
+/*
+ * Merges static meshes which share a material into a few large renderables, so that levels made
+ * of thousands of small static objects are drawn with a few draw calls.
+ *
+ * The vertices are transformed to world space when the batches are built, the renderables are
+ * meant to be used without a transform. The meshes of a material are grouped spatially, each
+ * group (batch) is a single renderable with a single primitive and its own bounding box, so
+ * that culling still happens per batch. The index range and the bounds of each mesh within its
+ * batch are returned as well, so that applications can draw only some of the meshes of a batch
+ * with RenderableManager::setGeometryAt().
+ *
+ *  StaticBatcher batcher;
+ *  for (auto const& object : level) {
+ *      batcher.add({ object.positions, object.tangents, object.uv0, object.vertexCount,
+ *              object.indices, object.indexCount }, object.transform, object.material);
+ *  }
+ *  for (auto const& batch : batcher.build(engine)) {
+ *      scene->addEntity(batch.renderable);
+ *  }
+ */
+class StaticBatcher {
+public:
+    // Triangle list, referenced until build(). Only the positions and indices are mandatory, the
+    // meshes sharing a material are only merged if they have the same optional attributes.
+    struct Mesh {
+        math::float3 const* positions = nullptr;
+        math::quatf const* tangents = nullptr;  // tangent frames, see mat3f::packTangentFrame()
+        math::float2 const* uv0 = nullptr;
+        uint32_t vertexCount = 0;
+        uint32_t const* indices = nullptr;
+        uint32_t indexCount = 0;
+    };
+
+    struct Config {
+        // vertices per batch, batches of at most 65536 vertices use 16-bit indices
+        uint32_t maxVertexCount = 65536;
+        // size of a batch's bounding box along any axis, in world units, so that batches
+        // are small enough to be culled
+        float maxExtent = 50.0f;
+        bool castShadows = true;
+        bool receiveShadows = true;
+    };
+
+    // where a mesh ended up in its batch
+    struct Piece {
+        size_t mesh = 0;            // as returned by add()
+        uint32_t offset = 0;        // of the first index in the batch's index buffer
+        uint32_t count = 0;         // of indices
+        filament::Box aabb;         // in world space
+    };
+
+    // the caller owns the renderable and the buffers
+    struct Batch {
+        utils::Entity renderable;
+        filament::VertexBuffer* vertexBuffer = nullptr;
+        filament::IndexBuffer* indexBuffer = nullptr;
+        filament::MaterialInstance const* material = nullptr;
+        filament::Box aabb;             // in world space
+        std::vector<Piece> pieces;      // in the order of the index buffer, without gaps
+    };
+
+    StaticBatcher() noexcept;
+    explicit StaticBatcher(Config const& config) noexcept;
+
+    // Adds a mesh to the next build(), the transform must not contain a non-uniform scale or
+    // a mirroring because the tangent frames are only rotated. Returns the index of the mesh.
+    size_t add(Mesh const& mesh, math::mat4f const& transform,
+            filament::MaterialInstance const* material);
+
+    // Creates the batches, and forgets the meshes added so far.
+    std::vector<Batch> build(filament::Engine* engine);
+
+private:
+    struct Entry {
+        Mesh mesh;
+        math::mat4f transform;
+        filament::MaterialInstance const* material;
+        filament::Aabb aabb;            // in world space
+    };
+
+    Config mConfig;
+    std::vector<Entry> mEntries;
+};
+
+} // namespace filamesh
+
+#endif // TNT_FILAMESHIO_STATICBATCHER_H
@@ -0,0 +1,521 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filameshio/MeshReader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(WIN32)
+#    include <sys/mman.h>
+#    include <unistd.h>
+#else
+#    include <io.h>
+#endif
+
+#include <utils/EntityManager.h>
+#include <utils/Log.h>
+#include <utils/Path.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <filament/Box.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+
+using namespace filament;
+using namespace math;
+
+namespace filamesh {
+
+namespace {
+
+struct Header {
+    uint32_t version;
+    uint32_t parts;
+    Box      aabb;
+    uint32_t interleaved;
+    uint32_t offsetPosition;
+    uint32_t stridePosition;
+    uint32_t offsetTangents;
+    uint32_t strideTangents;
+    uint32_t offsetColor;
+    uint32_t strideColor;
+    uint32_t offsetUV0;
+    uint32_t strideUV0;
+    uint32_t offsetUV1;
+    uint32_t strideUV1;
+    uint32_t vertexCount;
+    uint32_t vertexSize;
+    uint32_t indexType;
+    uint32_t indexCount;
+    uint32_t indexSize;
+};
+
+// follows the header in version 2
+struct HeaderExtension {
+    enum Flags : uint32_t {
+        QUANTIZED       = 0x1,
+        NORMALIZED_UV0  = 0x2,
+        CLUSTERS        = 0x4,
+        LODS            = 0x8
+    };
+    uint32_t flags;
+    float3   positionOffset;
+    float3   positionScale;
+    uint32_t clusterCount;
+};
+
+struct Part {
+    uint32_t offset;
+    uint32_t indexCount;
+    uint32_t minIndex;
+    uint32_t maxIndex;
+    uint32_t materialID;
+    Box      aabb;
+};
+
+// the clusters' bounds, only skipped here
+struct Cluster {
+    uint32_t offset;
+    uint32_t indexCount;
+    float3   center;
+    float    radius;
+    float3   coneAxis;
+    float    coneCutoff;
+};
+
+static constexpr uint32_t ABSENT = std::numeric_limits<uint32_t>::max();
+
+// A read-only mapping of a file, shared by all the buffer descriptors that point into it. The
+// last one released (on the filament thread, once the driver has consumed the data) unmaps it.
+class MappedFile {
+public:
+    static MappedFile* map(const utils::Path& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        size_t size = (size_t) lseek(fd, 0, SEEK_END);
+        lseek(fd, 0, SEEK_SET);
+
+        void* data = nullptr;
+        if (size) {
+#if !defined(WIN32)
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                data = nullptr;
+            } else {
+                // the data is only read once, in order
+                madvise(data, size, MADV_SEQUENTIAL);
+            }
+#else
+            data = malloc(size);
+            if (data && read(fd, data, (unsigned int) size) != (int) size) {
+                free(data);
+                data = nullptr;
+            }
+#endif
+        }
+        close(fd);
+
+        return data ? new MappedFile(data, size) : nullptr;
+    }
+
+    char const* data() const noexcept { return static_cast<char const*>(mData); }
+    size_t size() const noexcept { return mSize; }
+
+    void acquire() noexcept {
+        mRefCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept {
+        if (mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    // returns a descriptor that keeps the mapping alive until the driver is done with it
+    driver::BufferDescriptor descriptor(char const* p, size_t size) noexcept {
+        acquire();
+        return driver::BufferDescriptor(p, size, &MappedFile::onBufferConsumed, this);
+    }
+
+private:
+    MappedFile(void* data, size_t size) noexcept : mData(data), mSize(size) { }
+
+    ~MappedFile() noexcept {
+#if !defined(WIN32)
+        munmap(mData, mSize);
+#else
+        free(mData);
+#endif
+    }
+
+    static void onBufferConsumed(void*, size_t, void* user) {
+        static_cast<MappedFile*>(user)->release();
+    }
+
+    void* const mData;
+    size_t const mSize;
+    std::atomic<uint32_t> mRefCount = { 1 };
+};
+
+// Where everything is in a mapped FILAMESH file
+struct MeshData {
+    Header const* header = nullptr;
+    HeaderExtension extension = {};
+    char const* vertexData = nullptr;
+    char const* indexData = nullptr;
+    Part const* parts = nullptr;
+    std::vector<std::string> materialNames;
+    // levels of detail, including the parts above as level 0
+    uint32_t levelCount = 1;
+    float const* minScreenCoverages = nullptr;
+    Part const* levelParts = nullptr;   // of the levels after the first, level by level
+};
+
+static bool parse(char const* data, size_t size, MeshData& mesh) {
+    char const* p = data;
+    char const* const end = data + size;
+
+    auto available = [&p, end](size_t count) { return size_t(end - p) >= count; };
+
+    if (!available(8) || memcmp("FILAMESH", p, 8) != 0) {
+        return false;
+    }
+    p += 8;
+
+    if (!available(sizeof(Header))) {
+        return false;
+    }
+    mesh.header = (Header const*) p;
+    p += sizeof(Header);
+
+    mesh.extension.positionScale = float3(1.0f);
+    if (mesh.header->version >= 2) {
+        if (!available(sizeof(HeaderExtension))) {
+            return false;
+        }
+        memcpy(&mesh.extension, p, sizeof(HeaderExtension));
+        p += sizeof(HeaderExtension);
+    }
+
+    Header const& header = *mesh.header;
+    if (!available(size_t(header.vertexSize) + header.indexSize +
+            header.parts * sizeof(Part) + sizeof(uint32_t))) {
+        return false;
+    }
+
+    mesh.vertexData = p;
+    p += header.vertexSize;
+
+    mesh.indexData = p;
+    p += header.indexSize;
+
+    mesh.parts = (Part const*) p;
+    p += header.parts * sizeof(Part);
+
+    uint32_t materialCount;
+    memcpy(&materialCount, p, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+
+    mesh.materialNames.resize(materialCount);
+    for (size_t i = 0; i < materialCount; i++) {
+        uint32_t nameLength;
+        if (!available(sizeof(uint32_t))) {
+            return false;
+        }
+        memcpy(&nameLength, p, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+
+        if (!available(size_t(nameLength) + 1)) {
+            return false;
+        }
+        mesh.materialNames[i].assign(p, nameLength);
+        p += nameLength + 1; // null terminated
+    }
+
+    if (mesh.extension.flags & HeaderExtension::LODS) {
+        const size_t clusterSize = (mesh.extension.flags & HeaderExtension::CLUSTERS) ?
+                mesh.extension.clusterCount * sizeof(Cluster) : 0;
+        if (!available(clusterSize + sizeof(uint32_t))) {
+            return false;
+        }
+        p += clusterSize;
+
+        uint32_t levelCount;
+        memcpy(&levelCount, p, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        if (levelCount < 1 || levelCount > RenderableManager::MAX_LEVEL_COUNT ||
+                !available(levelCount * sizeof(float) +
+                        (levelCount - 1) * header.parts * sizeof(Part))) {
+            return false;
+        }
+        mesh.levelCount = levelCount;
+        mesh.minScreenCoverages = (float const*) p;
+        p += levelCount * sizeof(float);
+        mesh.levelParts = (Part const*) p;
+    }
+    return true;
+}
+
+static void createBuffers(Engine& engine, MeshData const& data, MeshReader::Mesh& mesh) {
+    Header const& header = *data.header;
+    const bool quantized = bool(data.extension.flags & HeaderExtension::QUANTIZED);
+    const bool normalizedUV0 = bool(data.extension.flags & HeaderExtension::NORMALIZED_UV0);
+
+    mesh.indexBuffer = IndexBuffer::Builder()
+            .indexCount(header.indexCount)
+            .bufferType(header.indexType ? IndexBuffer::IndexType::USHORT
+                                         : IndexBuffer::IndexType::UINT)
+            .build(engine);
+
+    VertexBuffer::Builder vbb;
+    vbb.vertexCount(header.vertexCount)
+        .bufferCount(1)
+        .normalized(VertexAttribute::TANGENTS)
+        .attribute(VertexAttribute::POSITION, 0,
+                quantized ? VertexBuffer::AttributeType::USHORT4
+                          : VertexBuffer::AttributeType::HALF4,
+                header.offsetPosition, uint8_t(header.stridePosition))
+        .attribute(VertexAttribute::TANGENTS, 0,
+                quantized ? VertexBuffer::AttributeType::BYTE4
+                          : VertexBuffer::AttributeType::SHORT4,
+                header.offsetTangents, uint8_t(header.strideTangents))
+        .attribute(VertexAttribute::UV0,      0,
+                normalizedUV0 ? VertexBuffer::AttributeType::USHORT2
+                              : VertexBuffer::AttributeType::HALF2,
+                header.offsetUV0, uint8_t(header.strideUV0));
+
+    if (quantized) {
+        vbb.normalized(VertexAttribute::POSITION);
+    }
+    if (normalizedUV0) {
+        vbb.normalized(VertexAttribute::UV0);
+    }
+
+    // quantized meshes don't have colors if the source didn't
+    if (header.offsetColor != ABSENT) {
+        vbb.normalized(VertexAttribute::COLOR)
+            .attribute(VertexAttribute::COLOR,    0, VertexBuffer::AttributeType::UBYTE4,
+                header.offsetColor, uint8_t(header.strideColor));
+    }
+
+    if (header.offsetUV1 != ABSENT && header.strideUV1 != ABSENT) {
+        vbb.attribute(VertexAttribute::UV1,   0, VertexBuffer::AttributeType::HALF2,
+                header.offsetUV1, uint8_t(header.strideUV1));
+    }
+
+    mesh.vertexBuffer = vbb.build(engine);
+}
+
+static void createRenderable(Engine& engine, MeshData const& data,
+        MeshReader::MaterialRegistry const& materials, MeshReader::Mesh& mesh) {
+    Header const& header = *data.header;
+    HeaderExtension const& extension = data.extension;
+
+    // the bounding boxes are in model space, quantized positions are decoded by the
+    // renderable's transform
+    auto toVertexSpace = [&extension](Box const& box) {
+        return Box{ (box.center - extension.positionOffset) / extension.positionScale,
+                box.halfExtent / extension.positionScale };
+    };
+
+    RenderableManager::Builder builder(header.parts);
+    builder.boundingBox(toVertexSpace(header.aabb));
+    for (uint8_t level = 0; data.minScreenCoverages && level < data.levelCount; level++) {
+        builder.levelOfDetail(level, data.minScreenCoverages[level]);
+    }
+
+    for (size_t i = 0; i < header.parts; i++) {
+        Part const& part = data.parts[i];
+        builder.geometry(i, RenderableManager::PrimitiveType::TRIANGLES,
+                mesh.vertexBuffer, mesh.indexBuffer, part.offset,
+                part.minIndex, part.maxIndex, part.indexCount);
+        for (uint8_t level = 1; level < data.levelCount; level++) {
+            Part const& levelPart = data.levelParts[(level - 1) * header.parts + i];
+            builder.geometry(level, i, RenderableManager::PrimitiveType::TRIANGLES,
+                    mesh.vertexBuffer, mesh.indexBuffer, levelPart.offset, levelPart.indexCount);
+        }
+        auto m = part.materialID < data.materialNames.size() ?
+                materials.find(data.materialNames[part.materialID]) : materials.end();
+        if (m != materials.end()) {
+            builder.material(i, m->second);
+        } else {
+            builder.material(i, materials.at("DefaultMaterial"));
+        }
+    }
+
+    mesh.renderable = utils::EntityManager::get().create();
+    builder.build(engine, mesh.renderable);
+
+    // always give the mesh a transform so it can be placed in the scene
+    engine.getTransformManager().create(mesh.renderable, {},
+            mat4f::translate(extension.positionOffset) * mat4f::scale(extension.positionScale));
+}
+
+} // anonymous namespace
+
+MeshReader::Mesh MeshReader::loadMeshFromFile(Engine* engine, const utils::Path& path,
+        const MaterialRegistry& materials) {
+    Mesh mesh;
+
+    MappedFile* file = MappedFile::map(path);
+    if (!file) {
+        utils::slog.e << "Unable to read " << path.c_str() << utils::io::endl;
+        return mesh;
+    }
+
+    MeshData data;
+    if (parse(file->data(), file->size(), data)) {
+        createBuffers(*engine, data, mesh);
+        mesh.indexBuffer->setBuffer(*engine,
+                file->descriptor(data.indexData, data.header->indexSize));
+        mesh.vertexBuffer->setBufferAt(*engine, 0,
+                file->descriptor(data.vertexData, data.header->vertexSize));
+        createRenderable(*engine, data, materials, mesh);
+    } else {
+        utils::slog.e << path.c_str() << " is not a valid filamesh file" << utils::io::endl;
+    }
+
+    // the mapping stays alive until the driver has consumed the buffers
+    file->release();
+    return mesh;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+struct MeshReader::AsyncLoader::State {
+    Engine* engine = nullptr;
+    MappedFile* file = nullptr;
+    MeshData data;
+    MaterialRegistry materials;
+    size_t chunkSize = 0;
+    // the index data is uploaded first, then the vertex data
+    size_t uploadedIndices = 0;
+    size_t uploadedVertices = 0;
+};
+
+MeshReader::AsyncLoader::AsyncLoader(Engine* engine, const utils::Path& path,
+        const MaterialRegistry& materials, size_t chunkSize) {
+    MappedFile* file = MappedFile::map(path);
+    if (!file) {
+        utils::slog.e << "Unable to read " << path.c_str() << utils::io::endl;
+        return;
+    }
+
+    State* state = new State;
+    if (!parse(file->data(), file->size(), state->data)) {
+        utils::slog.e << path.c_str() << " is not a valid filamesh file" << utils::io::endl;
+        file->release();
+        delete state;
+        return;
+    }
+
+    state->engine = engine;
+    state->file = file;
+    state->materials = materials;
+    // keep index chunks made of whole indices
+    state->chunkSize = std::max(chunkSize & ~size_t(3), size_t(4));
+    mState = state;
+
+    createBuffers(*engine, state->data, mMesh);
+}
+
+MeshReader::AsyncLoader::~AsyncLoader() {
+    State* const state = mState;
+    if (state) {
+        if (!mComplete) {
+            // the caller never got the mesh
+            state->engine->destroy(mMesh.vertexBuffer);
+            state->engine->destroy(mMesh.indexBuffer);
+        }
+        if (state->file) {
+            state->file->release();
+        }
+        delete state;
+    }
+}
+
+bool MeshReader::AsyncLoader::isValid() const noexcept {
+    return mState != nullptr;
+}
+
+float MeshReader::AsyncLoader::getProgress() const noexcept {
+    State const* const state = mState;
+    if (!state || mComplete) {
+        return mComplete ? 1.0f : 0.0f;
+    }
+    Header const& header = *state->data.header;
+    size_t total = size_t(header.indexSize) + header.vertexSize;
+    return total ? float(state->uploadedIndices + state->uploadedVertices) / total : 1.0f;
+}
+
+bool MeshReader::AsyncLoader::update() {
+    State* const state = mState;
+    if (!state || mComplete) {
+        return true;
+    }
+
+    Engine& engine = *state->engine;
+    MeshData const& data = state->data;
+    Header const& header = *data.header;
+
+    if (state->uploadedIndices < header.indexSize) {
+        size_t offset = state->uploadedIndices;
+        size_t size = std::min(state->chunkSize, header.indexSize - offset);
+        mMesh.indexBuffer->setBuffer(engine,
+                state->file->descriptor(data.indexData + offset, size),
+                uint32_t(offset), uint32_t(size));
+        state->uploadedIndices += size;
+        return false;
+    }
+
+    if (state->uploadedVertices < header.vertexSize) {
+        size_t offset = state->uploadedVertices;
+        size_t size = std::min(state->chunkSize, header.vertexSize - offset);
+        mMesh.vertexBuffer->setBufferAt(engine, 0,
+                state->file->descriptor(data.vertexData + offset, size),
+                uint32_t(offset), uint32_t(size));
+        state->uploadedVertices += size;
+        if (state->uploadedVertices < header.vertexSize) {
+            return false;
+        }
+    }
+
+    createRenderable(engine, data, state->materials, mMesh);
+
+    // the buffers still in flight hold their own reference to the mapping
+    state->file->release();
+    state->file = nullptr;
+    mComplete = true;
+    return true;
+}
+
+} // namespace filamesh
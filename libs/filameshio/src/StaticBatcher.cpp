@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filameshio/StaticBatcher.h>
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+#include <stdlib.h>
+
+#include <utils/EntityManager.h>
+
+#include <math/mat3.h>
+
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/VertexBuffer.h>
+
+using namespace filament;
+using namespace math;
+
+namespace filamesh {
+
+namespace {
+
+// spreads the 10 low bits of v, 2 bits apart
+uint32_t expandBits(uint32_t v) noexcept {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// 30 bits Morton code of p, normalized in [0, 1]
+uint32_t morton(float3 p) noexcept {
+    p = clamp(p * 1024.0f, float3(0.0f), float3(1023.0f));
+    return (expandBits(uint32_t(p.x)) << 2) | (expandBits(uint32_t(p.y)) << 1) |
+            expandBits(uint32_t(p.z));
+}
+
+Aabb merge(Aabb const& a, Aabb const& b) noexcept {
+    return { min(a.min, b.min), max(a.max, b.max) };
+}
+
+Box toBox(Aabb const& aabb) noexcept {
+    return Box().set(aabb.min, aabb.max);
+}
+
+template<typename T>
+driver::BufferDescriptor descriptor(T* data, size_t count) noexcept {
+    return driver::BufferDescriptor(data, count * sizeof(T),
+            [](void* buffer, size_t, void*) { free(buffer); });
+}
+
+template<typename T>
+T* allocate(size_t count) noexcept {
+    return static_cast<T*>(malloc(count * sizeof(T)));
+}
+
+} // anonymous namespace
+
+StaticBatcher::StaticBatcher() noexcept = default;
+
+StaticBatcher::StaticBatcher(Config const& config) noexcept : mConfig(config) {
+}
+
+size_t StaticBatcher::add(Mesh const& mesh, mat4f const& transform,
+        MaterialInstance const* material) {
+    Aabb aabb;
+    for (size_t i = 0; i < mesh.vertexCount; i++) {
+        const float3 p = (transform * float4{ mesh.positions[i], 1 }).xyz;
+        aabb.min = min(aabb.min, p);
+        aabb.max = max(aabb.max, p);
+    }
+    mEntries.push_back({ mesh, transform, material, aabb });
+    return mEntries.size() - 1;
+}
+
+std::vector<StaticBatcher::Batch> StaticBatcher::build(Engine* engine) {
+    std::vector<Batch> batches;
+    if (mEntries.empty()) {
+        return batches;
+    }
+
+    // sort the meshes by material and attributes first, then spatially so that consecutive
+    // meshes are close to each other
+    Aabb bounds;
+    for (Entry const& entry : mEntries) {
+        bounds = merge(bounds, entry.aabb);
+    }
+    const float3 origin = bounds.min;
+    const float3 scale = 1.0f / max(bounds.max - bounds.min, float3(std::numeric_limits<float>::min()));
+
+    struct Key {
+        MaterialInstance const* material;
+        bool tangents;
+        bool uv0;
+        uint32_t code;
+        size_t index;
+        bool operator<(Key const& rhs) const noexcept {
+            return std::tie(material, tangents, uv0, code, index) <
+                    std::tie(rhs.material, rhs.tangents, rhs.uv0, rhs.code, rhs.index);
+        }
+        bool isCompatible(Key const& rhs) const noexcept {
+            return material == rhs.material && tangents == rhs.tangents && uv0 == rhs.uv0;
+        }
+    };
+    std::vector<Key> keys(mEntries.size());
+    for (size_t i = 0, c = mEntries.size(); i < c; i++) {
+        Entry const& entry = mEntries[i];
+        keys[i] = { entry.material, entry.mesh.tangents != nullptr, entry.mesh.uv0 != nullptr,
+                morton((entry.aabb.center() - origin) * scale), i };
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // cut the sorted meshes in batches, a mesh larger than a batch gets a batch of its own
+    auto createBatch = [this, engine, &keys, &batches](size_t first, size_t last,
+            size_t vertexCount, size_t indexCount, Aabb const& aabb) {
+        Key const& key = keys[first];
+        float3* const positions = allocate<float3>(vertexCount);
+        quatf* const tangents = key.tangents ? allocate<quatf>(vertexCount) : nullptr;
+        float2* const uv0 = key.uv0 ? allocate<float2>(vertexCount) : nullptr;
+        uint16_t* const indices16 = vertexCount <= 65536 ? allocate<uint16_t>(indexCount) : nullptr;
+        uint32_t* const indices32 = indices16 ? nullptr : allocate<uint32_t>(indexCount);
+
+        Batch batch;
+        batch.material = key.material;
+        batch.aabb = toBox(aabb);
+        batch.pieces.reserve(last - first);
+
+        uint32_t baseVertex = 0;
+        uint32_t offset = 0;
+        for (size_t k = first; k < last; k++) {
+            const size_t index = keys[k].index;
+            Entry const& entry = mEntries[index];
+            Mesh const& mesh = entry.mesh;
+
+            for (size_t i = 0; i < mesh.vertexCount; i++) {
+                positions[baseVertex + i] = (entry.transform * float4{ mesh.positions[i], 1 }).xyz;
+            }
+            if (tangents) {
+                // the tangent frames are rotated, the sign of w holds the bitangent's direction
+                const mat3f m = entry.transform.upperLeft();
+                const quatf r = mat3f{ normalize(m[0]), normalize(m[1]), normalize(m[2]) }
+                        .toQuaternion();
+                for (size_t i = 0; i < mesh.vertexCount; i++) {
+                    const quatf q = mesh.tangents[i];
+                    const quatf t = r * q;
+                    tangents[baseVertex + i] = (t.w < 0) == (q.w < 0) ? t : -t;
+                }
+            }
+            if (uv0) {
+                std::copy_n(mesh.uv0, mesh.vertexCount, uv0 + baseVertex);
+            }
+            for (size_t i = 0; i < mesh.indexCount; i++) {
+                const uint32_t v = baseVertex + mesh.indices[i];
+                if (indices16) {
+                    indices16[offset + i] = uint16_t(v);
+                } else {
+                    indices32[offset + i] = v;
+                }
+            }
+
+            batch.pieces.push_back({ index, offset, mesh.indexCount, toBox(entry.aabb) });
+            baseVertex += mesh.vertexCount;
+            offset += mesh.indexCount;
+        }
+
+        uint8_t bufferCount = 0;
+        VertexBuffer::Builder vb;
+        vb.vertexCount(uint32_t(vertexCount))
+                .attribute(VertexAttribute::POSITION, bufferCount++,
+                        VertexBuffer::AttributeType::FLOAT3);
+        if (tangents) {
+            vb.attribute(VertexAttribute::TANGENTS, bufferCount++,
+                    VertexBuffer::AttributeType::FLOAT4);
+        }
+        if (uv0) {
+            vb.attribute(VertexAttribute::UV0, bufferCount++,
+                    VertexBuffer::AttributeType::FLOAT2);
+        }
+        batch.vertexBuffer = vb.bufferCount(bufferCount).build(*engine);
+
+        bufferCount = 0;
+        batch.vertexBuffer->setBufferAt(*engine, bufferCount++,
+                descriptor(positions, vertexCount));
+        if (tangents) {
+            batch.vertexBuffer->setBufferAt(*engine, bufferCount++,
+                    descriptor(tangents, vertexCount));
+        }
+        if (uv0) {
+            batch.vertexBuffer->setBufferAt(*engine, bufferCount++,
+                    descriptor(uv0, vertexCount));
+        }
+
+        batch.indexBuffer = IndexBuffer::Builder()
+                .indexCount(uint32_t(indexCount))
+                .bufferType(indices16 ? IndexBuffer::IndexType::USHORT
+                                      : IndexBuffer::IndexType::UINT)
+                .build(*engine);
+        batch.indexBuffer->setBuffer(*engine, indices16 ?
+                descriptor(indices16, indexCount) : descriptor(indices32, indexCount));
+
+        batch.renderable = utils::EntityManager::get().create();
+        RenderableManager::Builder(1)
+                .boundingBox(batch.aabb)
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                        batch.vertexBuffer, batch.indexBuffer, 0, indexCount)
+                .material(0, key.material)
+                .castShadows(mConfig.castShadows)
+                .receiveShadows(mConfig.receiveShadows)
+                .staticGeometry(true)
+                .build(*engine, batch.renderable);
+
+        batches.push_back(std::move(batch));
+    };
+
+    size_t first = 0;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    Aabb aabb;
+    for (size_t k = 0, c = keys.size(); k < c; k++) {
+        Entry const& entry = mEntries[keys[k].index];
+        const Aabb merged = merge(aabb, entry.aabb);
+        const float3 extent = merged.max - merged.min;
+        const bool fits = keys[k].isCompatible(keys[first]) &&
+                vertexCount + entry.mesh.vertexCount <= mConfig.maxVertexCount &&
+                std::max(extent.x, std::max(extent.y, extent.z)) <= mConfig.maxExtent;
+        if (k > first && !fits) {
+            createBatch(first, k, vertexCount, indexCount, aabb);
+            first = k;
+            vertexCount = 0;
+            indexCount = 0;
+            aabb = entry.aabb;
+        } else {
+            aabb = merged;
+        }
+        vertexCount += entry.mesh.vertexCount;
+        indexCount += entry.mesh.indexCount;
+    }
+    createBatch(first, keys.size(), vertexCount, indexCount, aabb);
+
+    mEntries.clear();
+    return batches;
+}
+
+} // namespace filamesh
@@ -20,6 +20,14 @@
 #include <image/LinearImage.h>
 
 #include <initializer_list>
+#include <limits>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+}
 
 namespace image {
 
@@ -56,6 +64,27 @@ LinearImage cropRegion(const LinearImage& image, uint32_t l, uint32_t t, uint32_
 // Lexicographically compares two images, similar to memcmp.
 int compare(const LinearImage& a, const LinearImage& b, float epsilon = 0.0f);
 
+// Counts the pixels that differ by more than epsilon in at least one channel. The images are
+// compared in tiles, in parallel if a JobSystem is given (the calling thread must be adopted by
+// it), and the comparison stops once more than maxFailures pixels differ, in which case the
+// returned count is only a lower bound. Returns SIZE_MAX if the dimensions don't match.
+size_t countDifferences(const LinearImage& a, const LinearImage& b, float epsilon = 0.0f,
+        size_t maxFailures = std::numeric_limits<size_t>::max(),
+        utils::JobSystem* js = nullptr);
+
+// Same as above for tightly packed 8-bit images, compared without conversion to float.
+size_t countDifferences(uint8_t const* a, uint8_t const* b,
+        uint32_t width, uint32_t height, uint32_t channels, uint8_t epsilon = 0,
+        size_t maxFailures = std::numeric_limits<size_t>::max(),
+        utils::JobSystem* js = nullptr);
+
+// Creates a single-channel image holding the largest channel difference of each pixel, meant to
+// be saved next to a golden image after a failed comparison. 8-bit differences are mapped to
+// [0, 1]. The images must have the same dimensions.
+LinearImage diffHeatmap(const LinearImage& a, const LinearImage& b);
+LinearImage diffHeatmap(uint8_t const* a, uint8_t const* b,
+        uint32_t width, uint32_t height, uint32_t channels);
+
 } // namespace image
 
 #endif /* IMAGE_LINEARIMAGE_H */
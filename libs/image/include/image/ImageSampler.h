@@ -19,6 +19,10 @@
 
 #include <image/LinearImage.h>
 
+namespace utils {
+class JobSystem;
+}
+
 namespace image {
 
 /**
@@ -96,6 +100,10 @@ struct ImageSampler {
     Boundary north;
     Boundary west;
     Boundary south;
+
+    // Optional JobSystem used to filter bands of rows in parallel. The calling thread must be
+    // adopted by the JobSystem.
+    utils::JobSystem* jobSystem = nullptr;
 };
 
 /**
@@ -135,9 +143,10 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
  *
  * Source image need not be power-of-two. In the result vector, the half-size image is returned at
  * index 0, the quarter-size image is at index 1, etc. Please note that the original-sized image is
- * not included.
+ * not included. If a JobSystem is given each level is filtered in parallel, see ImageSampler.
  */
-void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount);
+void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount,
+        utils::JobSystem* jobSystem = nullptr);
 
 /**
  * Returns the number of miplevels it would take to downsample the given image down to 1x1. This
@@ -62,6 +62,14 @@ struct KtxMetadata;
 class KtxBundle {
 public:
 
+    /**
+     * Specifies whether a deserialized bundle copies its blobs or references them in place.
+     */
+    enum class Storage : uint8_t {
+        COPY,       //!< the blobs are copied into storage owned by the bundle
+        IN_PLACE,   //!< the blobs point into the serialized data, which must outlive the bundle
+    };
+
     ~KtxBundle();
 
     /**
@@ -72,9 +80,13 @@ public:
     /**
      * Creates a new bundle by deserializing the given data.
      *
-     * Typically, this constructor is used to consume the contents of a KTX file.
+     * Typically, this constructor is used to consume the contents of a KTX file. With
+     * Storage::IN_PLACE the blobs are not copied, which is useful for large files that are
+     * memory-mapped or already loaded: getBlob() returns pointers into the given data, which must
+     * stay valid and unchanged until the bundle is destroyed. Such blobs are read-only, calling
+     * setBlob() or allocateBlob() first copies all the blobs into storage owned by the bundle.
      */
-    KtxBundle(uint8_t const* bytes, uint32_t nbytes);
+    KtxBundle(uint8_t const* bytes, uint32_t nbytes, Storage storage = Storage::COPY);
 
     /**
      * Serializes the bundle into the given target memory. Returns false if there's not enough
@@ -158,6 +170,11 @@ public:
     static constexpr uint32_t RGBA_S3TC_DXT3 = 0x83F2;
     static constexpr uint32_t RGBA_S3TC_DXT5 = 0x83F3;
 
+    static constexpr uint32_t RGBA_BPTC_UNORM = 0x8E8C;
+    static constexpr uint32_t SRGB_ALPHA_BPTC_UNORM = 0x8E8D;
+    static constexpr uint32_t RGB_BPTC_SIGNED_FLOAT = 0x8E8E;
+    static constexpr uint32_t RGB_BPTC_UNSIGNED_FLOAT = 0x8E8F;
+
     static constexpr uint32_t RGBA_ASTC_4x4 = 0x93B0;
     static constexpr uint32_t RGBA_ASTC_5x4 = 0x93B1;
     static constexpr uint32_t RGBA_ASTC_5x5 = 0x93B2;
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXTRANSCODER_H
+#define IMAGE_KTXTRANSCODER_H
+
+#include <image/KtxBundle.h>
+
+#include <memory>
+
+#include <stdint.h>
+
+namespace image {
+
+/**
+ * Formats an ETC2 bundle can be transcoded to, in order of preference.
+ */
+enum class TranscodeTarget : uint8_t {
+    DXT1,   //!< S3TC DXT1, same size as ETC2 (8 bytes per 4x4 block)
+    RGB8,   //!< uncompressed, for GPUs that support neither ETC2 nor S3TC
+};
+
+/**
+ * Transcodes an RGB8_ETC2 or SRGB8_ETC2 bundle to a format the GPU supports.
+ *
+ * ETC2 is core in OpenGL ES 3.0, which makes it a good distribution format, but WebGL 2.0 and
+ * desktop GPUs often lack it. A client can ship ETC2 textures only and transcode them at load
+ * time when Texture::isTextureFormatSupported() rejects them, rather than downloading a copy of
+ * each texture per compressed format.
+ *
+ * Returns a bundle with the same mip levels, array elements and cubemap faces, or nullptr if the
+ * source isn't an ETC2 RGB bundle. DXT1 has no sRGB variant, the caller is responsible for the
+ * color space of DXT1 and RGB8 results.
+ */
+std::unique_ptr<KtxBundle> transcodeEtc2(KtxBundle const& source, TranscodeTarget target);
+
+/**
+ * Decodes a block of ETC2 RGB8 (all modes, including ETC1) into 4x4 RGB texels, in row-major
+ * order.
+ */
+void decodeEtc2Block(uint8_t const* block, uint8_t* rgb);
+
+/**
+ * Encodes 4x4 RGB texels, in row-major order, into a DXT1 block without alpha.
+ */
+void encodeDxt1Block(uint8_t const* rgb, uint8_t* block);
+
+} // namespace image
+
+#endif /* IMAGE_KTXTRANSCODER_H */
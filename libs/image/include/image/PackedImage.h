@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_PACKEDIMAGE_H
+#define IMAGE_PACKEDIMAGE_H
+
+#include <image/LinearImage.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace image {
+
+/**
+ * PackedImage holds pixels in a compact storage format, to keep large images in memory at a
+ * fraction of the cost of a LinearImage: an 8K RGBA image takes 256 MB as half floats and 128 MB
+ * as 8-bit values, instead of 512 MB as floats.
+ *
+ * The algorithms of this library work on LinearImage, a PackedImage is converted to and from it
+ * as a whole or by bands of rows. Processing a large image one band at a time, e.g. with
+ * unpackRows(), a row-wise operation and packRows(), only keeps one band of floats in memory.
+ *
+ * Like LinearImage, the pixels have shared ownership semantics and are stored in row-major order
+ * without padding.
+ */
+class PackedImage {
+public:
+
+    enum class Format : uint8_t {
+        HALF,       // 16-bit floats
+        UNORM8,     // 8-bit values in [0, 1], clamped when packed
+    };
+
+    /**
+     * Allocates a zeroed-out image.
+     */
+    PackedImage(uint32_t width, uint32_t height, uint32_t channels, Format format);
+
+    /**
+     * Converts a LinearImage.
+     */
+    PackedImage(const LinearImage& image, Format format);
+
+    /**
+     * Creates an empty (invalid) image.
+     */
+    PackedImage() = default;
+
+    /**
+     * Converts the whole image to floats.
+     */
+    LinearImage unpack() const { return unpackRows(0, mHeight); }
+
+    /**
+     * Converts "count" rows to floats, starting at "first".
+     */
+    LinearImage unpackRows(uint32_t first, uint32_t count) const;
+
+    /**
+     * Converts the rows of "rows" and stores them starting at row "first". The source must have
+     * the same width and channel count.
+     */
+    void packRows(const LinearImage& rows, uint32_t first);
+
+    /**
+     * Gets a pointer to the underlying packed data.
+     */
+    uint8_t* getData() { return mData.get(); }
+    uint8_t const* getData() const { return mData.get(); }
+
+    size_t getBytesPerPixel() const { return getBytesPerChannel(mFormat) * mChannels; }
+    size_t getRowStride() const { return getBytesPerPixel() * mWidth; }
+    size_t getSize() const { return getRowStride() * mHeight; }
+
+    static size_t getBytesPerChannel(Format format) { return format == Format::HALF ? 2 : 1; }
+
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+    uint32_t getChannels() const { return mChannels; }
+    Format getFormat() const { return mFormat; }
+    void reset() { *this = PackedImage(); }
+    bool isValid() const { return bool(mData); }
+
+private:
+
+    std::shared_ptr<uint8_t> mData;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mChannels = 0;
+    Format mFormat = Format::HALF;
+};
+
+} // namespace image
+
+#endif /* IMAGE_PACKEDIMAGE_H */
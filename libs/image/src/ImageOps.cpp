@@ -17,15 +17,97 @@
 #include <image/ImageOps.h>
 
 #include <math/vec3.h>
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <memory>
 
 using namespace math;
 
 namespace image {
 
+namespace {
+
+// Tiles are small enough to spread a single image over all the worker threads and to stop
+// shortly after the failure threshold is reached.
+constexpr uint32_t TILE_SIZE = 64;
+
+inline float absDiff(float a, float b) { return std::abs(a - b); }
+inline uint8_t absDiff(uint8_t a, uint8_t b) { return uint8_t(a > b ? a - b : b - a); }
+
+template<typename T>
+size_t countDifferencesTiled(T const* a, T const* b, uint32_t width, uint32_t height,
+        uint32_t channels, T epsilon, size_t maxFailures, utils::JobSystem* js) {
+    const uint32_t tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t stride = size_t(width) * channels;
+    std::atomic<size_t> failures{ 0 };
+
+    auto countTiles = [=, &failures](uint32_t first, uint32_t count) {
+        for (uint32_t tile = first; tile < first + count; ++tile) {
+            if (failures.load(std::memory_order_relaxed) > maxFailures) {
+                return;
+            }
+            const uint32_t x0 = (tile % tilesX) * TILE_SIZE;
+            const uint32_t y0 = (tile / tilesX) * TILE_SIZE;
+            const uint32_t x1 = std::min(x0 + TILE_SIZE, width);
+            const uint32_t y1 = std::min(y0 + TILE_SIZE, height);
+            const size_t rowLength = size_t(x1 - x0) * channels;
+            size_t tileFailures = 0;
+            for (uint32_t y = y0; y < y1; ++y) {
+                T const* ra = a + y * stride + x0 * channels;
+                T const* rb = b + y * stride + x0 * channels;
+                // identical rows are by far the most common case
+                if (!memcmp(ra, rb, rowLength * sizeof(T))) {
+                    continue;
+                }
+                for (size_t i = 0; i < rowLength; i += channels) {
+                    T d = 0;
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        d = std::max(d, absDiff(ra[i + c], rb[i + c]));
+                    }
+                    tileFailures += d > epsilon ? 1 : 0;
+                }
+            }
+            if (tileFailures) {
+                failures.fetch_add(tileFailures, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    const uint32_t tileCount = tilesX * tilesY;
+    if (js && tileCount > 1) {
+        auto job = utils::jobs::parallel_for(*js, nullptr, 0, tileCount,
+                std::ref(countTiles), utils::jobs::CountSplitter<1, 8>());
+        js->runAndWait(job);
+    } else {
+        countTiles(0, tileCount);
+    }
+    return failures.load();
+}
+
+template<typename T>
+LinearImage diffHeatmap(T const* a, T const* b, uint32_t width, uint32_t height,
+        uint32_t channels, float scale) {
+    LinearImage result(width, height, 1);
+    float* dst = result.getPixelRef();
+    for (size_t i = 0, n = size_t(width) * height; i < n; ++i, a += channels, b += channels) {
+        T d = 0;
+        for (uint32_t c = 0; c < channels; ++c) {
+            d = std::max(d, absDiff(a[c], b[c]));
+        }
+        dst[i] = float(d) * scale;
+    }
+    return result;
+}
+
+} // anonymous namespace
+
 LinearImage horizontalStack(std::initializer_list<LinearImage> images) {
     size_t count = images.end() - images.begin();
     return horizontalStack(images.begin(), count);
@@ -236,4 +318,34 @@ int compare(const LinearImage& a, const LinearImage& b, float epsilon) {
             [epsilon](float x, float y) { return x < y - epsilon; });
 }
 
+size_t countDifferences(const LinearImage& a, const LinearImage& b, float epsilon,
+        size_t maxFailures, utils::JobSystem* js) {
+    auto w = a.getWidth();
+    auto h = a.getHeight();
+    auto c = a.getChannels();
+    if (b.getWidth() != w || b.getHeight() != h || b.getChannels() != c) {
+        return std::numeric_limits<size_t>::max();
+    }
+    return countDifferencesTiled(a.getPixelRef(), b.getPixelRef(), w, h, c, epsilon,
+            maxFailures, js);
+}
+
+size_t countDifferences(uint8_t const* a, uint8_t const* b,
+        uint32_t width, uint32_t height, uint32_t channels, uint8_t epsilon,
+        size_t maxFailures, utils::JobSystem* js) {
+    return countDifferencesTiled(a, b, width, height, channels, epsilon, maxFailures, js);
+}
+
+LinearImage diffHeatmap(const LinearImage& a, const LinearImage& b) {
+    ASSERT_PRECONDITION(a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() &&
+            a.getChannels() == b.getChannels(), "Images must have the same dimensions.");
+    return diffHeatmap(a.getPixelRef(), b.getPixelRef(), a.getWidth(), a.getHeight(),
+            a.getChannels(), 1.0f);
+}
+
+LinearImage diffHeatmap(uint8_t const* a, uint8_t const* b,
+        uint32_t width, uint32_t height, uint32_t channels) {
+    return diffHeatmap(a, b, width, height, channels, 1.0f / 255.0f);
+}
+
 } // namespace image
@@ -18,9 +18,14 @@
 #include <image/ImageOps.h>
 
 #include <math/vec3.h>
-#include <utils/Panic.h>
+#include <utils/compiler.h>
 #include <utils/CString.h>
+#include <utils/JobSystem.h>
+#include <utils/Panic.h>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -35,7 +40,7 @@ struct FilterFunction {
     bool rejectExternalSamples = true;
 };
 
-constexpr float M_PIf = float(M_PI);
+constexpr float F_PI = float(M_PI);
 
 const FilterFunction Box {
     .fn = [](float t) { return t <= 0.5f ? 1.0f : 0.0f; },
@@ -47,7 +52,7 @@ const FilterFunction Nearest { Box.fn, 0.0f };
 const FilterFunction Gaussian {
     .fn = [](float t) {
         if (t >= 2.0) return 0.0f;
-        const float scale = 1.0f / std::sqrt(0.5f * M_PIf);
+        const float scale = 1.0f / std::sqrt(0.5f * F_PI);
         return std::exp(-2.0f * t * t) * scale;
     },
     .boundingRadius = 2
@@ -83,7 +88,7 @@ const FilterFunction Mitchell {
 // Not bothering with a fast approximation since we cache results for each row.
 float sinc(float t) {
     if (t <= 0.00001f) return 1.0f;
-    return std::sin(M_PIf * t) / (M_PIf * t);
+    return std::sin(F_PI * t) / (F_PI * t);
 }
 
 const FilterFunction Lanczos {
@@ -94,21 +99,25 @@ const FilterFunction Lanczos {
     .boundingRadius = 1
 };
 
-// Describes a Multiply-Add operation: target[targetIndex] += source[sourceIndex] * weight.
-// This allows us to cache the weights computed by evaluation of the filter function, as well as
-// the indices that are generated from careful alignment of sample and target samples.
-// We allow signed source indices to accommodate external source samples whose values depend
-// on the wrap-mode configuration in the sampler.
-struct MadInstruction {
-    uint32_t targetIndex;
-    int32_t sourceIndex;
-    float weight;
+// For each target sample, the filter weights of a contiguous range of source samples. The weights
+// are computed once per pass and shared by all the rows (or columns) of the image, which lets the
+// inner loops run over contiguous memory.
+//
+// Source samples that don't contribute to a target sample, but lie between two that do, have a
+// weight of zero.
+struct FilterSpan {
+    uint32_t first;  // index of the first source sample
+    uint32_t count;  // number of source samples
+    uint32_t offset; // index of the first weight in WeightTable::weights
 };
 
-using MadProgram = std::vector<MadInstruction>;
+struct WeightTable {
+    std::vector<FilterSpan> spans;
+    std::vector<float> weights;
+};
 
-// Generates a list of MAD instructions that transforms a row of samples of length "nsource"
-// into a sequence of length "ntarget" using the given filter function.
+// Generates the table of weights that transforms a row of samples of length "nsource" into a
+// sequence of length "ntarget" using the given filter function.
 //
 // The given left / right floats define a source range within [0,1] such that 0 is at the left edge
 // of the the left-most pixel and 1 is at the right edge of the right-most pixel.
@@ -118,8 +127,8 @@ using MadProgram = std::vector<MadInstruction>;
 //    d....delta (i.e. the normalized width of a single pixel square)
 //    x....normalized coord in [0..1] where 0/1 are the outer edges of the range.
 //    i....integer index where 0 is the left-most pixel and n-1 is the right-most pixel.
-void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float right,
-        FilterFunction filter, float radiusMultiplier, MadProgram* result) {
+void generateWeightTable(uint32_t ntarget, uint32_t nsource, float left, float right,
+        FilterFunction filter, float radiusMultiplier, WeightTable* result) {
     const float dtarget = 1.0f / ntarget;
     const float fnsource = float(nsource) * (right - left);
     const bool minifying = float(ntarget) < fnsource;
@@ -128,65 +137,66 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
     // As an optimization, compute the "filterBound", which is the half-width of the filter within
     // the [0,1] domain. If this were a huge number, the filtered results would look the same, but
     // the filter would perform very poorly because it would be iterating over a lot more samples
-    // than necessary.
-    const float filterBounds = domainScale * std::abs(filter.boundingRadius);
+    // than necessary. NEAREST has a radius of zero and only looks at the samples around the
+    // center of the target pixel.
+    const float filterBounds = std::abs(filter.boundingRadius) / domainScale;
+    const float sourceScale = (right - left) * nsource;
+
+    result->spans.resize(ntarget);
+    result->weights.clear();
 
     // Iterate through target samples. "xtarget" points to the center of each target pixel.
     float xtarget = dtarget / 2.0f;
     for (uint32_t itarget = 0; itarget < ntarget; ++itarget, xtarget += dtarget) {
 
-        // For this particular target pixel, we'll be accumulating a count and sum so that we can
-        // adjust the weights afterwards. This allows us to reject some of the source samples.
-        uint32_t count = 0;
+        // For this particular target pixel, we'll be accumulating a sum so that we can adjust the
+        // weights afterwards. This allows us to reject some of the source samples.
+        FilterSpan& span = result->spans[itarget];
+        span = { 0, 0, uint32_t(result->weights.size()) };
         float sum = 0;
 
-        // Iterate through source samples that lie within the bounded region.
-        const auto isource_lower = int32_t((xtarget - filterBounds) * nsource);
-        const auto isource_upper = int32_t(std::ceil((xtarget + filterBounds) * nsource));
+        // Iterate through source samples that lie within the bounded region, with one sample of
+        // margin on each side.
+        int32_t isource_lower = int32_t(xtarget * nsource);
+        int32_t isource_upper = int32_t(std::ceil(xtarget * nsource));
+        if (filterBounds != 0) {
+            const float lower = left * nsource + (xtarget - filterBounds) * sourceScale - 0.5f;
+            const float upper = left * nsource + (xtarget + filterBounds) * sourceScale - 0.5f;
+            isource_lower = std::max(int32_t(std::floor(lower)) - 1, 0);
+            isource_upper = std::min(int32_t(std::ceil(upper)) + 1, int32_t(nsource) - 1);
+        }
         for (int32_t isource = isource_lower; isource <= isource_upper; ++isource) {
             const float xsource = (((isource + 0.5f) / nsource) - left) / (right - left);
             const bool outside_image = isource < 0 || isource >= int32_t(nsource);
             const bool outside_range = xsource < 0 || xsource >= 1.0f;
-            if (filter.rejectExternalSamples && (outside_image || outside_range)) {
+            if (outside_image || (filter.rejectExternalSamples && outside_range)) {
                 continue;
             }
             const float t = domainScale * std::abs(xsource - xtarget);
             const float weight = filter.fn(t);
             if (weight != 0) {
-                result->push_back({itarget, isource, weight});
+                if (span.count == 0) {
+                    span.first = uint32_t(isource);
+                }
+                // pad the span with zeros up to this sample
+                const uint32_t count = uint32_t(isource) - span.first + 1;
+                result->weights.resize(span.offset + count, 0.0f);
+                result->weights.back() = weight;
+                span.count = count;
                 sum += weight;
-                ++count;
             }
         }
 
-        // Normalize the set of weights that were recently appended to the MAD program.
+        // Normalize the set of weights that were recently appended to the table.
         if (sum != 0) {
-            MadInstruction* mad = result->data() + result->size() - count;
-            for (uint32_t i = 0; i < count; ++i, ++mad) {
-                mad->weight /= sum;
+            float* weights = result->weights.data() + span.offset;
+            for (uint32_t i = 0; i < span.count; ++i) {
+                weights[i] /= sum;
             }
         }
     }
 }
 
-// Transforms a MAD program intended for single-channel data into a program intended for
-// multi-channel data.
-void expandMadProgram(uint32_t nchannels, MadProgram* program) {
-    if (nchannels == 1) {
-        return;
-    }
-    MadProgram result;
-    result.reserve(program->size() * nchannels);
-    for (auto mad : *program) {
-        mad.sourceIndex *= nchannels;
-        mad.targetIndex *= nchannels;
-        for (uint32_t j = 0; j < nchannels; ++j, ++mad.sourceIndex, ++mad.targetIndex) {
-            result.push_back(mad);
-        }
-    }
-    program->swap(result);
-}
-
 FilterFunction createFilterFunction(Filter ftype) {
     FilterFunction fn;
     switch (ftype) {
@@ -204,67 +214,206 @@ FilterFunction createFilterFunction(Filter ftype) {
     return fn;
 }
 
-void normalize(LinearImage& image) {
-    ASSERT_PRECONDITION(image.getChannels() == 3, "Must be a 3-channel image.");
-    const uint32_t width = image.getWidth(), height = image.getHeight();
-    auto vecs = (math::float3*) image.getPixelRef();
-    for (uint32_t n = 0; n < width * height; ++n) {
+void normalize(math::float3* UTILS_RESTRICT vecs, size_t count) {
+    for (size_t n = 0; n < count; ++n) {
         vecs[n] = normalize(vecs[n]);
     }
 }
 
-LinearImage resampleImage1D(const LinearImage& source, MadProgram* program,
-        uint32_t twidth, Filter filter, float left, float right, float filterRadiusMultiplier) {
-    const uint32_t swidth = source.getWidth();
-    const uint32_t sheight = source.getHeight();
-    const uint32_t nchan = source.getChannels();
-    const bool mag = twidth > swidth;
-    if (filter == Filter::DEFAULT) filter = mag ? Filter::MITCHELL : Filter::LANCZOS;
-    const FilterFunction hfn = createFilterFunction(filter);
-
-    // Generate a flat list of multiply-add (MAD) instructions.
-    program->clear();
-    generateMadProgram(twidth, swidth, left, right, hfn, filterRadiusMultiplier, program);
-    expandMadProgram(nchan, program);
+// ------------------------------------------------------------------------------------------------
+// Kernels, these rely on auto-vectorization: the horizontal kernels keep one accumulator per
+// channel, while the vertical kernels scale and add whole rows.
+// ------------------------------------------------------------------------------------------------
+
+// Filters one row of pixels with N channels.
+template<size_t N>
+void filterRow(float* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src,
+        WeightTable const& table) {
+    float const* const weights = table.weights.data();
+    for (FilterSpan const& span : table.spans) {
+        float acc[N] = {};
+        float const* UTILS_RESTRICT s = src + span.first * N;
+        float const* UTILS_RESTRICT w = weights + span.offset;
+        for (uint32_t k = 0; k < span.count; ++k, s += N) {
+            for (size_t c = 0; c < N; ++c) {
+                acc[c] += s[c] * w[k];
+            }
+        }
+        for (size_t c = 0; c < N; ++c) {
+            dst[c] = acc[c];
+        }
+        dst += N;
+    }
+}
 
-    // Allocate the target image.
-    LinearImage result(twidth, sheight, nchan);
-    float const* sourceRow = source.getPixelRef();
-    float* targetRow = result.getPixelRef();
+// Filters one row of pixels with any number of channels, dst must be zeroed.
+void filterRow(float* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src,
+        WeightTable const& table, uint32_t nchan) {
+    float const* const weights = table.weights.data();
+    for (FilterSpan const& span : table.spans) {
+        float const* UTILS_RESTRICT s = src + span.first * nchan;
+        float const* UTILS_RESTRICT w = weights + span.offset;
+        for (uint32_t k = 0; k < span.count; ++k, s += nchan) {
+            for (uint32_t c = 0; c < nchan; ++c) {
+                dst[c] += s[c] * w[k];
+            }
+        }
+        dst += nchan;
+    }
+}
 
-    // The MIN filter is special because it starts with non-zero values and ignores filter weights.
-    if (filter == Filter::MINIMUM) {
-        for (uint32_t n = 0; n < twidth * sheight * nchan; ++n) {
-            targetRow[n] = std::numeric_limits<float>::max();
+// The MIN filter is special because it starts with non-zero values and ignores filter weights.
+void minimumRow(float* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src,
+        WeightTable const& table, uint32_t nchan) {
+    float const* const weights = table.weights.data();
+    for (FilterSpan const& span : table.spans) {
+        for (uint32_t c = 0; c < nchan; ++c) {
+            dst[c] = std::numeric_limits<float>::max();
         }
-        for (uint32_t row = 0; row < sheight; ++row) {
-            for (auto mad : *program) {
-                const float a = sourceRow[mad.sourceIndex];
-                const float b = targetRow[mad.targetIndex];
-                targetRow[mad.targetIndex] = std::min(a, b);
+        float const* UTILS_RESTRICT s = src + span.first * nchan;
+        float const* UTILS_RESTRICT w = weights + span.offset;
+        for (uint32_t k = 0; k < span.count; ++k, s += nchan) {
+            if (w[k] != 0) {
+                for (uint32_t c = 0; c < nchan; ++c) {
+                    dst[c] = std::min(s[c], dst[c]);
+                }
             }
-            targetRow += twidth * nchan;
-            sourceRow += swidth * nchan;
         }
-        return result;
+        dst += nchan;
     }
+}
 
-    // Resize the image horizontally by executing the MAD instructions over each row.
-    for (uint32_t row = 0; row < sheight; ++row) {
-        for (auto mad : *program) {
-            targetRow[mad.targetIndex] += sourceRow[mad.sourceIndex] * mad.weight;
+// Computes one target row as a weighted sum of "span.count" source rows, dst must be zeroed.
+void filterColumns(float* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src, size_t stride,
+        FilterSpan const& span, float const* UTILS_RESTRICT weights) {
+    src += span.first * stride;
+    for (uint32_t k = 0; k < span.count; ++k, src += stride) {
+        const float w = weights[span.offset + k];
+        for (size_t i = 0; i < stride; ++i) {
+            dst[i] += src[i] * w;
         }
-        targetRow += twidth * nchan;
-        sourceRow += swidth * nchan;
     }
+}
 
-    // Perform post processing for the current pass.
-    if (filter == Filter::GAUSSIAN_NORMALS) {
-        normalize(result);
+void minimumColumns(float* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src, size_t stride,
+        FilterSpan const& span, float const* UTILS_RESTRICT weights) {
+    for (size_t i = 0; i < stride; ++i) {
+        dst[i] = std::numeric_limits<float>::max();
+    }
+    src += span.first * stride;
+    for (uint32_t k = 0; k < span.count; ++k, src += stride) {
+        if (weights[span.offset + k] != 0) {
+            for (size_t i = 0; i < stride; ++i) {
+                dst[i] = std::min(src[i], dst[i]);
+            }
+        }
     }
+}
+
+// Calls fn(first, count) over bands of rows, in parallel if a JobSystem is given.
+template<typename F>
+void forEachBand(utils::JobSystem* js, uint32_t rowCount, F& fn) {
+    if (js && rowCount > 1) {
+        auto job = utils::jobs::parallel_for(*js, nullptr, 0, rowCount,
+                std::ref(fn), utils::jobs::CountSplitter<4, 8>());
+        js->runAndWait(job);
+    } else {
+        fn(0, rowCount);
+    }
+}
+
+Filter resolveFilter(Filter filter, uint32_t ntarget, uint32_t nsource) {
+    if (filter == Filter::DEFAULT) {
+        return ntarget > nsource ? Filter::MITCHELL : Filter::LANCZOS;
+    }
+    return filter;
+}
+
+// Resizes the image horizontally.
+LinearImage resampleRows(const LinearImage& source, WeightTable* table, uint32_t twidth,
+        Filter filter, float left, float right, float filterRadiusMultiplier,
+        utils::JobSystem* js) {
+    const uint32_t swidth = source.getWidth();
+    const uint32_t sheight = source.getHeight();
+    const uint32_t nchan = source.getChannels();
+    filter = resolveFilter(filter, twidth, swidth);
+    generateWeightTable(twidth, swidth, left, right, createFilterFunction(filter),
+            filterRadiusMultiplier, table);
+
+    LinearImage result(twidth, sheight, nchan);
+    float const* const sourceData = source.getPixelRef();
+    float* const targetData = result.getPixelRef();
+
+    auto band = [&](uint32_t first, uint32_t count) {
+        for (uint32_t row = first; row < first + count; ++row) {
+            float const* sourceRow = sourceData + size_t(row) * swidth * nchan;
+            float* targetRow = targetData + size_t(row) * twidth * nchan;
+            if (filter == Filter::MINIMUM) {
+                minimumRow(targetRow, sourceRow, *table, nchan);
+                continue;
+            }
+            switch (nchan) {
+                case 1:  filterRow<1>(targetRow, sourceRow, *table); break;
+                case 3:  filterRow<3>(targetRow, sourceRow, *table); break;
+                case 4:  filterRow<4>(targetRow, sourceRow, *table); break;
+                default: filterRow(targetRow, sourceRow, *table, nchan); break;
+            }
+            if (filter == Filter::GAUSSIAN_NORMALS) {
+                normalize((math::float3*) targetRow, twidth);
+            }
+        }
+    };
+    forEachBand(js, sheight, band);
     return result;
 }
 
+// Resizes the image vertically.
+LinearImage resampleColumns(const LinearImage& source, WeightTable* table, uint32_t theight,
+        Filter filter, float top, float bottom, float filterRadiusMultiplier,
+        utils::JobSystem* js) {
+    const uint32_t width = source.getWidth();
+    const uint32_t sheight = source.getHeight();
+    const uint32_t nchan = source.getChannels();
+    filter = resolveFilter(filter, theight, sheight);
+    generateWeightTable(theight, sheight, top, bottom, createFilterFunction(filter),
+            filterRadiusMultiplier, table);
+
+    LinearImage result(width, theight, nchan);
+    const size_t stride = size_t(width) * nchan;
+    float const* const sourceData = source.getPixelRef();
+    float* const targetData = result.getPixelRef();
+
+    auto band = [&](uint32_t first, uint32_t count) {
+        for (uint32_t row = first; row < first + count; ++row) {
+            float* targetRow = targetData + row * stride;
+            FilterSpan const& span = table->spans[row];
+            if (filter == Filter::MINIMUM) {
+                minimumColumns(targetRow, sourceData, stride, span, table->weights.data());
+                continue;
+            }
+            filterColumns(targetRow, sourceData, stride, span, table->weights.data());
+            if (filter == Filter::GAUSSIAN_NORMALS) {
+                normalize((math::float3*) targetRow, width);
+            }
+        }
+    };
+    forEachBand(js, theight, band);
+    return result;
+}
+
+LinearImage resample(const LinearImage& source, uint32_t width, uint32_t height,
+        Filter hfilter, Filter vfilter, Region const& region, float radius,
+        utils::JobSystem* js) {
+    if (hfilter == Filter::GAUSSIAN_NORMALS || vfilter == Filter::GAUSSIAN_NORMALS) {
+        ASSERT_PRECONDITION(source.getChannels() == 3, "Must be a 3-channel image.");
+    }
+    WeightTable table;
+    LinearImage result = resampleRows(source, &table, width, hfilter,
+            region.left, region.right, radius, js);
+    return resampleColumns(result, &table, height, vfilter,
+            region.top, region.bottom, radius, js);
+}
+
 } // anonymous namespace
 
 namespace image {
@@ -280,18 +429,8 @@ LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t he
         sampler.north.mode == Boundary::EXCLUDE &&
         sampler.west.mode == Boundary::EXCLUDE &&
         sampler.south.mode == Boundary::EXCLUDE, "Not yet implemented.");
-    const auto hfilter = sampler.horizontalFilter;
-    const auto vfilter = sampler.verticalFilter;
-    const float radius = sampler.filterRadiusMultiplier;
-    const float left = sampler.sourceRegion.left;
-    const float top = sampler.sourceRegion.top;
-    const float right = sampler.sourceRegion.right;
-    const float bottom = sampler.sourceRegion.bottom;
-    MadProgram program;
-    LinearImage result;
-    result = transpose(resampleImage1D(source, &program, width, hfilter, left, right, radius));
-    result = transpose(resampleImage1D(result, &program, height, vfilter, top, bottom, radius));
-    return result;
+    return resample(source, width, height, sampler.horizontalFilter, sampler.verticalFilter,
+            sampler.sourceRegion, sampler.filterRadiusMultiplier, sampler.jobSystem);
 }
 
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
@@ -309,9 +448,8 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
     const float top = y - radius / source.getHeight();
     const float right = x + radius / source.getWidth();
     const float bottom = y + radius / source.getHeight();
-    MadProgram program;
-    LinearImage row = transpose(resampleImage1D(source, &program, 1, filter, left, right, radius));
-    row = resampleImage1D(row, &program, 1, filter, top, bottom, radius);
+    LinearImage row = resample(source, 1, 1, filter, filter, { left, top, right, bottom }, radius,
+            nullptr);
     if (!result->data) {
         result->data = new float[source.getChannels()];
     }
@@ -324,14 +462,19 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
 
 // Unlike traditional mipmap generation, our implementation generates all levels from the original
 // image, under the premise that this produces a higher quality result.
-void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips) {
+void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips,
+        utils::JobSystem* jobSystem) {
     mips = std::min(mips, getMipmapCount(source));
     uint32_t width = source.getWidth();
     uint32_t height = source.getHeight();
     for (uint32_t n = 0; n < mips; ++n) {
        width = std::max(width >> 1, 1u);
        height = std::max(height >> 1, 1u);
-       result[n] = resampleImage(source, width, height, filter);
+       result[n] = resampleImage(source, width, height, ImageSampler {
+           .horizontalFilter = filter,
+           .verticalFilter = filter,
+           .jobSystem = jobSystem
+       });
     }
 }
 
@@ -60,8 +60,14 @@ struct KtxBlobList {
     std::vector<uint8_t> blobs;
     std::vector<uint32_t> sizes;
 
+    // Address of each blob when the blobs are referenced in place, empty otherwise.
+    std::vector<uint8_t const*> references;
+
     // Obtains a pointer to the given blob.
     uint8_t* get(uint32_t blobIndex) {
+        if (!references.empty()) {
+            return const_cast<uint8_t*>(references[blobIndex]);
+        }
         uint8_t* result = blobs.data();
         for (uint32_t i = 0; i < blobIndex; ++i) {
             result += sizes[i];
@@ -69,8 +75,27 @@ struct KtxBlobList {
         return result;
     }
 
+    // Copies the blobs referenced in place into the contiguous array, so they can be modified.
+    void detach() {
+        if (references.empty()) {
+            return;
+        }
+        size_t totalSize = 0;
+        for (uint32_t size : sizes) {
+            totalSize += size;
+        }
+        blobs.resize(totalSize);
+        uint8_t* dst = blobs.data();
+        for (uint32_t i = 0; i < sizes.size(); ++i) {
+            memcpy(dst, references[i], sizes[i]);
+            dst += sizes[i];
+        }
+        references.clear();
+    }
+
     // Resizes the blob at the given index by building a new contiguous array and swapping.
     void resize(uint32_t blobIndex, uint32_t newSize) {
+        detach();
         uint32_t preSize = 0;
         uint32_t postSize = 0;
         for (uint32_t i = 0; i < sizes.size(); ++i) {
@@ -106,7 +131,7 @@ KtxBundle::KtxBundle(uint32_t numMipLevels, uint32_t arrayLength, bool isCubemap
     mBlobs->sizes.resize(numMipLevels * arrayLength * mNumCubeFaces);
 }
 
-KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
+KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes, Storage storage) :
         mBlobs(new KtxBlobList), mMetadata(new KtxMetadata) {
     ASSERT_PRECONDITION(sizeof(SerializationHeader) <= nbytes, "KTX buffer is too small");
 
@@ -149,18 +174,33 @@ KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
     const bool isNonArrayCube = mNumCubeFaces > 1 && mArrayLength == 1;
     const uint32_t facesPerMip = mArrayLength * mNumCubeFaces;
 
-    // Extract blobs from the serialized byte stream.
+    // Extract blobs from the serialized byte stream, or index them in place.
+    const bool inPlace = storage == Storage::IN_PLACE;
     const uint32_t totalSize = nbytes - (pdata - bytes);
-    mBlobs->blobs.resize(totalSize);
+    if (inPlace) {
+        mBlobs->references.resize(mBlobs->sizes.size());
+    } else {
+        mBlobs->blobs.resize(totalSize);
+    }
+    uint8_t* dst = mBlobs->blobs.data();
     for (uint32_t mipmap = 0; mipmap < mNumMipLevels; ++mipmap) {
+        ASSERT_PRECONDITION(pdata + sizeof(uint32_t) <= bytes + nbytes, "KTX buffer is truncated");
         const uint32_t imageSize = *((uint32_t const*) pdata);
         const uint32_t faceSize = isNonArrayCube ? imageSize : (imageSize / facesPerMip);
         const uint32_t levelSize = faceSize * mNumCubeFaces * mArrayLength;
         pdata += sizeof(uint32_t);
-        memcpy(mBlobs->get(flatten(this, {mipmap, 0, 0})), pdata, levelSize);
+        ASSERT_PRECONDITION(levelSize <= size_t(bytes + nbytes - pdata), "KTX buffer is truncated");
+        if (!inPlace) {
+            memcpy(dst, pdata, levelSize);
+            dst += levelSize;
+        }
         for (uint32_t layer = 0; layer < mArrayLength; ++layer) {
             for (uint32_t face = 0; face < mNumCubeFaces; ++face) {
-                mBlobs->sizes[flatten(this, {mipmap, layer, face})] = faceSize;
+                const size_t flatIndex = flatten(this, {mipmap, layer, face});
+                mBlobs->sizes[flatIndex] = faceSize;
+                if (inPlace) {
+                    mBlobs->references[flatIndex] = pdata;
+                }
                 pdata += faceSize;
                 pdata += cubePadding;
             }
@@ -308,6 +348,7 @@ bool KtxBundle::setBlob(KtxBlobIndex index, uint8_t const* data, uint32_t size)
     }
     uint32_t flatIndex = flatten(this, index);
     uint32_t blobSize = mBlobs->sizes[flatIndex];
+    mBlobs->detach();
     if (blobSize != size) {
         mBlobs->resize(flatIndex, size);
     }
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/KtxTranscoder.h>
+
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+
+namespace image {
+
+namespace {
+
+// ETC1 intensity modifiers, indexed by the table codeword
+const int ETC_MODIFIERS[8][2] = {
+        { 2,  8 }, { 5,  17 }, { 9,  29 }, { 13, 42 },
+        { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+// distances of the T and H modes
+const int ETC_DISTANCES[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+inline int clamp255(int v) {
+    return std::min(255, std::max(0, v));
+}
+
+inline int extend4(int v) { return (v << 4) | v; }
+inline int extend5(int v) { return (v << 3) | (v >> 2); }
+inline int extend6(int v) { return (v << 2) | (v >> 4); }
+inline int extend7(int v) { return (v << 1) | (v >> 6); }
+
+// sign-extends the 3-bit deltas of the differential mode
+inline int delta3(int v) { return ((v & 7) ^ 4) - 4; }
+
+inline void setTexel(uint8_t* rgb, int x, int y, int r, int g, int b) {
+    uint8_t* p = rgb + (y * 4 + x) * 3;
+    p[0] = uint8_t(clamp255(r));
+    p[1] = uint8_t(clamp255(g));
+    p[2] = uint8_t(clamp255(b));
+}
+
+// the 2-bit index of texel (x, y), texels are stored column-major
+inline int texelIndex(uint8_t const* block, int x, int y) {
+    const uint32_t bits = (uint32_t(block[4]) << 24) | (uint32_t(block[5]) << 16) |
+            (uint32_t(block[6]) << 8) | uint32_t(block[7]);
+    const int i = x * 4 + y;
+    return int(((bits >> (i + 16)) & 1) << 1 | ((bits >> i) & 1));
+}
+
+void decodePaintColors(uint8_t const* block, int const paint[4][3], uint8_t* rgb) {
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int const* c = paint[texelIndex(block, x, y)];
+            setTexel(rgb, x, y, c[0], c[1], c[2]);
+        }
+    }
+}
+
+void decodeT(uint8_t const* b, uint8_t* rgb) {
+    const int r1 = extend4((((b[0] >> 3) & 3) << 2) | (b[0] & 3));
+    const int g1 = extend4(b[1] >> 4);
+    const int b1 = extend4(b[1] & 0xf);
+    const int r2 = extend4(b[2] >> 4);
+    const int g2 = extend4(b[2] & 0xf);
+    const int b2 = extend4(b[3] >> 4);
+    const int d = ETC_DISTANCES[(((b[3] >> 2) & 3) << 1) | (b[3] & 1)];
+    const int paint[4][3] = {
+            { r1, g1, b1 },
+            { r2 + d, g2 + d, b2 + d },
+            { r2, g2, b2 },
+            { r2 - d, g2 - d, b2 - d }
+    };
+    decodePaintColors(b, paint, rgb);
+}
+
+void decodeH(uint8_t const* b, uint8_t* rgb) {
+    const int r1 = (b[0] >> 3) & 0xf;
+    const int g1 = ((b[0] & 7) << 1) | ((b[1] >> 4) & 1);
+    const int b1 = (b[1] & 8) | ((b[1] & 3) << 1) | (b[2] >> 7);
+    const int r2 = (b[2] >> 3) & 0xf;
+    const int g2 = ((b[2] & 7) << 1) | (b[3] >> 7);
+    const int b2 = (b[3] >> 3) & 0xf;
+    // the last bit of the distance index is given by the order of the base colors
+    const int order = ((r1 << 8) | (g1 << 4) | b1) >= ((r2 << 8) | (g2 << 4) | b2) ? 1 : 0;
+    const int d = ETC_DISTANCES[(b[3] & 4) | ((b[3] & 1) << 1) | order];
+    const int c1[3] = { extend4(r1), extend4(g1), extend4(b1) };
+    const int c2[3] = { extend4(r2), extend4(g2), extend4(b2) };
+    const int paint[4][3] = {
+            { c1[0] + d, c1[1] + d, c1[2] + d },
+            { c1[0] - d, c1[1] - d, c1[2] - d },
+            { c2[0] + d, c2[1] + d, c2[2] + d },
+            { c2[0] - d, c2[1] - d, c2[2] - d }
+    };
+    decodePaintColors(b, paint, rgb);
+}
+
+void decodePlanar(uint8_t const* b, uint8_t* rgb) {
+    const int ro = extend6((b[0] >> 1) & 0x3f);
+    const int go = extend7(((b[0] & 1) << 6) | ((b[1] >> 1) & 0x3f));
+    const int bo = extend6(((b[1] & 1) << 5) | (b[2] & 0x18) | ((b[2] & 3) << 1) | (b[3] >> 7));
+    const int rh = extend6((((b[3] >> 2) & 0x1f) << 1) | (b[3] & 1));
+    const int gh = extend7(b[4] >> 1);
+    const int bh = extend6(((b[4] & 1) << 5) | (b[5] >> 3));
+    const int rv = extend6(((b[5] & 7) << 3) | (b[6] >> 5));
+    const int gv = extend7(((b[6] & 0x1f) << 2) | (b[7] >> 6));
+    const int bv = extend6(b[7] & 0x3f);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            setTexel(rgb, x, y,
+                    (x * (rh - ro) + y * (rv - ro) + 4 * ro + 2) >> 2,
+                    (x * (gh - go) + y * (gv - go) + 4 * go + 2) >> 2,
+                    (x * (bh - bo) + y * (bv - bo) + 4 * bo + 2) >> 2);
+        }
+    }
+}
+
+inline uint16_t toRgb565(float r, float g, float b) {
+    const int r5 = std::min(31, std::max(0, int(r * (31.0f / 255.0f) + 0.5f)));
+    const int g6 = std::min(63, std::max(0, int(g * (63.0f / 255.0f) + 0.5f)));
+    const int b5 = std::min(31, std::max(0, int(b * (31.0f / 255.0f) + 0.5f)));
+    return uint16_t((r5 << 11) | (g6 << 5) | b5);
+}
+
+inline void fromRgb565(uint16_t c, int* rgb) {
+    rgb[0] = extend5(c >> 11);
+    rgb[1] = extend6((c >> 5) & 0x3f);
+    rgb[2] = extend5(c & 0x1f);
+}
+
+} // anonymous namespace
+
+void decodeEtc2Block(uint8_t const* b, uint8_t* rgb) {
+    int base[2][3];
+    if ((b[3] & 2) == 0) {
+        // individual mode, two 4-bit colors
+        base[0][0] = extend4(b[0] >> 4);
+        base[1][0] = extend4(b[0] & 0xf);
+        base[0][1] = extend4(b[1] >> 4);
+        base[1][1] = extend4(b[1] & 0xf);
+        base[0][2] = extend4(b[2] >> 4);
+        base[1][2] = extend4(b[2] & 0xf);
+    } else {
+        // differential mode, a 5-bit color and a 3-bit delta, the ETC2 modes are encoded with
+        // the deltas that overflow
+        const int r = b[0] >> 3, dr = delta3(b[0]);
+        const int g = b[1] >> 3, dg = delta3(b[1]);
+        const int bl = b[2] >> 3, db = delta3(b[2]);
+        if (r + dr < 0 || r + dr > 31) {
+            decodeT(b, rgb);
+            return;
+        }
+        if (g + dg < 0 || g + dg > 31) {
+            decodeH(b, rgb);
+            return;
+        }
+        if (bl + db < 0 || bl + db > 31) {
+            decodePlanar(b, rgb);
+            return;
+        }
+        base[0][0] = extend5(r);
+        base[1][0] = extend5(r + dr);
+        base[0][1] = extend5(g);
+        base[1][1] = extend5(g + dg);
+        base[0][2] = extend5(bl);
+        base[1][2] = extend5(bl + db);
+    }
+
+    const int* table[2] = { ETC_MODIFIERS[b[3] >> 5], ETC_MODIFIERS[(b[3] >> 2) & 7] };
+    const bool flip = (b[3] & 1) != 0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            // the two sub-blocks are 2x4 side by side, or 4x2 on top of each other when flipped
+            const int s = flip ? (y >> 1) : (x >> 1);
+            const int index = texelIndex(b, x, y);
+            const int modifier = table[s][index & 1];
+            const int m = (index & 2) ? -modifier : modifier;
+            setTexel(rgb, x, y, base[s][0] + m, base[s][1] + m, base[s][2] + m);
+        }
+    }
+}
+
+void encodeDxt1Block(uint8_t const* rgb, uint8_t* block) {
+    // the endpoints are the extremes of the texels along their principal axis
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            mean[c] += rgb[i * 3 + c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        mean[c] *= 1.0f / 16.0f;
+    }
+
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        const float r = rgb[i * 3 + 0] - mean[0];
+        const float g = rgb[i * 3 + 1] - mean[1];
+        const float b = rgb[i * 3 + 2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // a few power iterations are enough to find the principal axis
+    float axis[3] = { 1, 1, 1 };
+    for (int iteration = 0; iteration < 4; iteration++) {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float length = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+        if (length == 0) {
+            break;
+        }
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    float minProjection = 0, maxProjection = 0;
+    for (int i = 0; i < 16; i++) {
+        const float p = (rgb[i * 3 + 0] - mean[0]) * axis[0] +
+                (rgb[i * 3 + 1] - mean[1]) * axis[1] +
+                (rgb[i * 3 + 2] - mean[2]) * axis[2];
+        minProjection = std::min(minProjection, p);
+        maxProjection = std::max(maxProjection, p);
+    }
+
+    const float l = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    const float scaleMax = l > 0 ? maxProjection / l : 0;
+    const float scaleMin = l > 0 ? minProjection / l : 0;
+    uint16_t c0 = toRgb565(mean[0] + axis[0] * scaleMax, mean[1] + axis[1] * scaleMax,
+            mean[2] + axis[2] * scaleMax);
+    uint16_t c1 = toRgb565(mean[0] + axis[0] * scaleMin, mean[1] + axis[1] * scaleMin,
+            mean[2] + axis[2] * scaleMin);
+
+    // c0 > c1 selects the 4-color mode, which has no transparent texels
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        fromRgb565(c0, palette[0]);
+        fromRgb565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestDistance = 0x7fffffff;
+            for (int p = 0; p < 4; p++) {
+                const int dr = rgb[i * 3 + 0] - palette[p][0];
+                const int dg = rgb[i * 3 + 1] - palette[p][1];
+                const int db = rgb[i * 3 + 2] - palette[p][2];
+                const int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (i * 2);
+        }
+    }
+
+    block[0] = uint8_t(c0);
+    block[1] = uint8_t(c0 >> 8);
+    block[2] = uint8_t(c1);
+    block[3] = uint8_t(c1 >> 8);
+    block[4] = uint8_t(indices);
+    block[5] = uint8_t(indices >> 8);
+    block[6] = uint8_t(indices >> 16);
+    block[7] = uint8_t(indices >> 24);
+}
+
+std::unique_ptr<KtxBundle> transcodeEtc2(KtxBundle const& source, TranscodeTarget target) {
+    KtxInfo info = source.getInfo();
+    if (info.glFormat != 0 || (info.glInternalFormat != KtxBundle::RGB8_ETC2 &&
+            info.glInternalFormat != KtxBundle::SRGB8_ETC2)) {
+        return nullptr;
+    }
+
+    const uint32_t nmips = source.getNumMipLevels();
+    const uint32_t nlayers = source.getArrayLength();
+    const uint32_t nfaces = source.isCubemap() ? 6 : 1;
+    std::unique_ptr<KtxBundle> result(new KtxBundle(nmips, nlayers, source.isCubemap()));
+
+    info.glBaseInternalFormat = KtxBundle::RGB;
+    if (target == TranscodeTarget::DXT1) {
+        info.glTypeSize = 1;
+        info.glInternalFormat = KtxBundle::RGB_S3TC_DXT1;
+    } else {
+        info.glType = KtxBundle::UNSIGNED_BYTE;
+        info.glTypeSize = 3;
+        info.glFormat = KtxBundle::RGB;
+        info.glInternalFormat = KtxBundle::RGB;
+    }
+    result->info() = info;
+
+    uint8_t texels[16 * 3];
+    for (uint32_t level = 0; level < nmips; level++) {
+        const uint32_t width = std::max(1u, info.pixelWidth >> level);
+        const uint32_t height = std::max(1u, info.pixelHeight >> level);
+        const uint32_t columns = (width + 3) / 4;
+        const uint32_t rows = (height + 3) / 4;
+        const uint32_t size = target == TranscodeTarget::DXT1 ?
+                columns * rows * 8 : width * height * 3;
+        for (uint32_t layer = 0; layer < nlayers; layer++) {
+            for (uint32_t face = 0; face < nfaces; face++) {
+                uint8_t* src;
+                uint32_t srcSize;
+                if (!source.getBlob({ level, layer, face }, &src, &srcSize) ||
+                        srcSize < columns * rows * 8) {
+                    return nullptr;
+                }
+                result->allocateBlob({ level, layer, face }, size);
+                uint8_t* dst;
+                uint32_t dstSize;
+                result->getBlob({ level, layer, face }, &dst, &dstSize);
+                for (uint32_t row = 0; row < rows; row++) {
+                    for (uint32_t column = 0; column < columns; column++) {
+                        uint8_t const* block = src + (row * columns + column) * 8;
+                        decodeEtc2Block(block, texels);
+                        if (target == TranscodeTarget::DXT1) {
+                            encodeDxt1Block(texels, dst + (row * columns + column) * 8);
+                            continue;
+                        }
+                        // blocks at the edges of the image are partially outside of it
+                        const uint32_t x0 = column * 4, y0 = row * 4;
+                        const uint32_t w = std::min(4u, width - x0);
+                        const uint32_t h = std::min(4u, height - y0);
+                        for (uint32_t y = 0; y < h; y++) {
+                            memcpy(dst + ((y0 + y) * width + x0) * 3, texels + y * 4 * 3, w * 3);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace image
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/PackedImage.h>
+
+#include <math/half.h>
+
+#include <utils/compiler.h>
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace math;
+
+namespace {
+
+// These loops have no dependencies between iterations and rely on auto-vectorization.
+
+void packHalf(uint16_t* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = getBits(half(src[i]));
+    }
+}
+
+void unpackHalf(float* UTILS_RESTRICT dst, uint16_t const* UTILS_RESTRICT src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = float(makeHalf(src[i]));
+    }
+}
+
+void packUnorm8(uint8_t* UTILS_RESTRICT dst, float const* UTILS_RESTRICT src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const float v = std::min(std::max(src[i], 0.0f), 1.0f);
+        dst[i] = uint8_t(v * 255.0f + 0.5f);
+    }
+}
+
+void unpackUnorm8(float* UTILS_RESTRICT dst, uint8_t const* UTILS_RESTRICT src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = src[i] * (1.0f / 255.0f);
+    }
+}
+
+} // anonymous namespace
+
+namespace image {
+
+PackedImage::PackedImage(uint32_t width, uint32_t height, uint32_t channels, Format format) :
+        mWidth(width), mHeight(height), mChannels(channels), mFormat(format) {
+    const size_t size = getSize();
+    uint8_t* data = new uint8_t[size];
+    memset(data, 0, size);
+    mData = std::shared_ptr<uint8_t>(data, std::default_delete<uint8_t[]>());
+}
+
+PackedImage::PackedImage(const LinearImage& image, Format format) :
+        PackedImage(image.getWidth(), image.getHeight(), image.getChannels(), format) {
+    packRows(image, 0);
+}
+
+LinearImage PackedImage::unpackRows(uint32_t first, uint32_t count) const {
+    ASSERT_PRECONDITION(first + count <= mHeight, "Rows out of range.");
+    LinearImage result(mWidth, count, mChannels);
+    const size_t n = size_t(mWidth) * count * mChannels;
+    uint8_t const* src = mData.get() + first * getRowStride();
+    if (mFormat == Format::HALF) {
+        unpackHalf(result.getPixelRef(), (uint16_t const*) src, n);
+    } else {
+        unpackUnorm8(result.getPixelRef(), src, n);
+    }
+    return result;
+}
+
+void PackedImage::packRows(const LinearImage& rows, uint32_t first) {
+    ASSERT_PRECONDITION(rows.getWidth() == mWidth && rows.getChannels() == mChannels,
+            "Rows must have the same width and number of channels.");
+    ASSERT_PRECONDITION(first + rows.getHeight() <= mHeight, "Rows out of range.");
+    const size_t n = size_t(mWidth) * rows.getHeight() * mChannels;
+    uint8_t* dst = mData.get() + first * getRowStride();
+    if (mFormat == Format::HALF) {
+        packHalf((uint16_t*) dst, rows.getPixelRef(), n);
+    } else {
+        packUnorm8(dst, rows.getPixelRef(), n);
+    }
+}
+
+} // namespace image
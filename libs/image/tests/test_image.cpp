@@ -16,19 +16,24 @@
 
 #include <image/ColorTransform.h>
 #include <image/KtxBundle.h>
+#include <image/KtxTranscoder.h>
 #include <image/ImageOps.h>
 #include <image/ImageSampler.h>
 #include <image/LinearImage.h>
+#include <image/PackedImage.h>
 
+#include <imageio/BlockCompression.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageDiffer.h>
 #include <imageio/ImageEncoder.h>
 
 #include <gtest/gtest.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Path.h>
 
+#include <math/half.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
@@ -207,6 +212,31 @@ TEST_F(ImageTest, DepthFilters) { // NOLINT
     updateOrCompare(atlas, "depths.png");
 }
 
+TEST_F(ImageTest, ParallelFilters) { // NOLINT
+    utils::JobSystem js;
+    js.adopt();
+    auto normals = createNormalMap(256);
+    for (Filter filter : { Filter::DEFAULT, Filter::BOX, Filter::GAUSSIAN_NORMALS,
+            Filter::MINIMUM }) {
+        ImageSampler sampler;
+        sampler.horizontalFilter = sampler.verticalFilter = filter;
+        auto serial = resampleImage(normals, 100, 37, sampler);
+        sampler.jobSystem = &js;
+        auto parallel = resampleImage(normals, 100, 37, sampler);
+        EXPECT_EQ(0, memcmp(serial.getPixelRef(), parallel.getPixelRef(),
+                100 * 37 * 3 * sizeof(float)));
+    }
+    vector<LinearImage> serial(getMipmapCount(normals));
+    vector<LinearImage> parallel(serial.size());
+    generateMipmaps(normals, Filter::DEFAULT, serial.data(), uint32_t(serial.size()));
+    generateMipmaps(normals, Filter::DEFAULT, parallel.data(), uint32_t(parallel.size()), &js);
+    for (size_t i = 0; i < serial.size(); i++) {
+        const size_t size = serial[i].getWidth() * serial[i].getHeight() * 3 * sizeof(float);
+        EXPECT_EQ(0, memcmp(serial[i].getPixelRef(), parallel[i].getPixelRef(), size));
+    }
+    js.emancipate();
+}
+
 TEST_F(ImageTest, ImageOps) { // NOLINT
     auto finalize = [] (LinearImage image) {
         return resampleImage(image, 100, 100, Filter::NEAREST);
@@ -233,6 +263,88 @@ TEST_F(ImageTest, ImageOps) { // NOLINT
     updateOrCompare(atlas, "imageops.png");
 }
 
+TEST_F(ImageTest, CountDifferences) { // NOLINT
+    utils::JobSystem js;
+    js.adopt();
+    const uint32_t width = 300, height = 200;
+    vector<uint8_t> a(width * height * 4);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = uint8_t(i * 7);
+    }
+    vector<uint8_t> b(a);
+    EXPECT_EQ(0, countDifferences(a.data(), b.data(), width, height, 4));
+    EXPECT_EQ(0, countDifferences(a.data(), b.data(), width, height, 4, 0, 0, &js));
+
+    // Two channels of the same pixel only count once.
+    b[0] += 1;
+    b[1] += 3;
+    b[(width * 150 + 299) * 4 + 3] += 2;
+    EXPECT_EQ(2, countDifferences(a.data(), b.data(), width, height, 4));
+    EXPECT_EQ(2, countDifferences(a.data(), b.data(), width, height, 4, 0, 10, &js));
+    EXPECT_EQ(1, countDifferences(a.data(), b.data(), width, height, 4, 2, 10, &js));
+    EXPECT_EQ(0, countDifferences(a.data(), b.data(), width, height, 4, 3, 10, &js));
+
+    auto heatmap = diffHeatmap(a.data(), b.data(), width, height, 4);
+    EXPECT_EQ(1, heatmap.getChannels());
+    EXPECT_FLOAT_EQ(3.0f / 255.0f, *heatmap.getPixelRef(0, 0));
+    EXPECT_FLOAT_EQ(0.0f, *heatmap.getPixelRef(1, 0));
+
+    // Past the threshold the count is only a lower bound.
+    for (size_t i = 0; i < b.size(); i++) {
+        b[i] = ~a[i];
+    }
+    size_t failures = countDifferences(a.data(), b.data(), width, height, 4, 0, 100, &js);
+    EXPECT_GT(failures, 100);
+    EXPECT_LE(failures, width * height);
+
+    auto normals = createNormalMap(256);
+    auto flipped = horizontalFlip(normals);
+    EXPECT_EQ(0, countDifferences(normals, normals, 0.0f, 0, &js));
+    EXPECT_EQ(countDifferences(normals, flipped), countDifferences(normals, flipped, 0.0f,
+            std::numeric_limits<size_t>::max(), &js));
+    EXPECT_EQ(std::numeric_limits<size_t>::max(),
+            countDifferences(normals, createNormalMap(128)));
+    js.emancipate();
+}
+
+TEST_F(ImageTest, PackedImage) { // NOLINT
+    LinearImage src(4, 3, 2);
+    float* data = src.getPixelRef();
+    for (uint32_t i = 0; i < 4 * 3 * 2; ++i) {
+        data[i] = i / 23.0f;
+    }
+    data[0] = -1.0f;
+    data[1] = 2.0f;
+
+    PackedImage half(src, PackedImage::Format::HALF);
+    ASSERT_EQ(half.getSize(), 4 * 3 * 2 * 2);
+    LinearImage h = half.unpack();
+    EXPECT_EQ(h.getPixelRef()[0], -1.0f);
+    EXPECT_EQ(h.getPixelRef()[1], 2.0f);
+    for (uint32_t i = 2; i < 4 * 3 * 2; ++i) {
+        EXPECT_NEAR(h.getPixelRef()[i], data[i], 1.0f / 1024.0f);
+    }
+
+    PackedImage unorm(src, PackedImage::Format::UNORM8);
+    ASSERT_EQ(unorm.getSize(), 4 * 3 * 2);
+    LinearImage u = unorm.unpack();
+    EXPECT_EQ(u.getPixelRef()[0], 0.0f);
+    EXPECT_EQ(u.getPixelRef()[1], 1.0f);
+    for (uint32_t i = 2; i < 4 * 3 * 2; ++i) {
+        EXPECT_NEAR(u.getPixelRef()[i], data[i], 0.5f / 255.0f);
+    }
+
+    // Rows can be processed one band at a time.
+    LinearImage band = unorm.unpackRows(1, 2);
+    ASSERT_EQ(band.getHeight(), 2);
+    EXPECT_EQ(band.getPixelRef()[0], u.getPixelRef(0, 1)[0]);
+    const uint8_t lastOfRow0 = unorm.getData()[4 * 2 - 1];
+    std::fill_n(band.getPixelRef(), 4 * 2 * 2, 1.0f);
+    unorm.packRows(band, 1);
+    EXPECT_EQ(unorm.getData()[4 * 2 - 1], lastOfRow0);
+    EXPECT_EQ(unorm.getData()[4 * 2], 255);
+}
+
 TEST_F(ImageTest, ColorTransformRGB) { // NOLINT
     constexpr size_t w = 2;
     constexpr size_t h = 3;
@@ -375,6 +487,262 @@ TEST_F(ImageTest, Ktx) { // NOLINT
     }
 }
 
+TEST_F(ImageTest, KtxInPlace) { // NOLINT
+    KtxBundle original(2, 1, true);
+    for (uint32_t mip = 0; mip < 2; ++mip) {
+        for (uint32_t face = 0; face < 6; ++face) {
+            vector<uint8_t> blob(16 >> mip, uint8_t(mip * 6 + face));
+            ASSERT_TRUE(original.setBlob({mip, 0, face}, blob.data(), blob.size()));
+        }
+    }
+    vector<uint8_t> buffer(original.getSerializedLength());
+    ASSERT_TRUE(original.serialize(buffer.data(), buffer.size()));
+    const vector<uint8_t> copy = buffer;
+
+    // The blobs of the bundle point into the serialized data.
+    KtxBundle mapped(buffer.data(), buffer.size(), KtxBundle::Storage::IN_PLACE);
+    ASSERT_EQ(mapped.getNumMipLevels(), 2);
+    ASSERT_TRUE(mapped.isCubemap());
+    uint8_t* data;
+    uint32_t size;
+    for (uint32_t mip = 0; mip < 2; ++mip) {
+        for (uint32_t face = 0; face < 6; ++face) {
+            ASSERT_TRUE(mapped.getBlob({mip, 0, face}, &data, &size));
+            ASSERT_EQ(size, 16 >> mip);
+            ASSERT_GE(data, buffer.data());
+            ASSERT_LE(data + size, buffer.data() + buffer.size());
+            ASSERT_EQ(data[0], mip * 6 + face);
+        }
+    }
+    vector<uint8_t> reserialized(mapped.getSerializedLength());
+    ASSERT_TRUE(mapped.serialize(reserialized.data(), reserialized.size()));
+    ASSERT_EQ(reserialized, buffer);
+
+    // Modifying a blob copies the blobs instead of writing to the serialized data.
+    uint8_t foo[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    ASSERT_TRUE(mapped.setBlob({1, 0, 0}, foo, sizeof(foo)));
+    ASSERT_EQ(buffer, copy);
+    ASSERT_TRUE(mapped.getBlob({1, 0, 0}, &data, &size));
+    ASSERT_EQ(size, sizeof(foo));
+    ASSERT_EQ(data[7], 8);
+    ASSERT_TRUE(mapped.getBlob({1, 0, 5}, &data, &size));
+    ASSERT_EQ(data[0], 11);
+    ASSERT_TRUE(data < buffer.data() || data >= buffer.data() + buffer.size());
+}
+
+TEST_F(ImageTest, KtxTranscoder) { // NOLINT
+    // A smooth 12x12 gradient, which is not a multiple of the block size at the second level.
+    // DXT1 blocks interpolate between two colors, so the colors of the gradient lie on a line.
+    const uint32_t size = 12;
+    LinearImage source(size, size, 3);
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            const float t = float(x + y) / (2 * (size - 1));
+            float* texel = source.getPixelRef(x, y);
+            texel[0] = 0.25f + 0.5f * t;
+            texel[1] = 0.75f - 0.5f * t;
+            texel[2] = 0.5f;
+        }
+    }
+    const uint32_t nmips = 2;
+    const LinearImage mips[nmips] = { source, resampleImage(source, size / 2, size / 2) };
+
+    KtxBundle etc(nmips, 1, false);
+    etc.info() = {
+        .endianness = KtxBundle::ENDIAN_DEFAULT,
+        .glType = 0,
+        .glTypeSize = 1,
+        .glFormat = 0,
+        .glInternalFormat = KtxBundle::RGB8_ETC2,
+        .glBaseInternalFormat = KtxBundle::RGB,
+        .pixelWidth = size,
+        .pixelHeight = size,
+        .pixelDepth = 0,
+    };
+    for (uint32_t level = 0; level < nmips; ++level) {
+        CompressedTexture tex = etcCompress(mips[level],
+                { CompressedFormat::RGB8_ETC2, EtcErrorMetric::RGBX, 50 });
+        ASSERT_TRUE(etc.setBlob({level}, tex.data.get(), tex.size));
+    }
+
+    // Only ETC2 RGB textures can be transcoded.
+    KtxBundle uncompressed(1, 1, false);
+    ASSERT_EQ(transcodeEtc2(uncompressed, TranscodeTarget::RGB8), nullptr);
+
+    auto rgb = transcodeEtc2(etc, TranscodeTarget::RGB8);
+    ASSERT_NE(rgb, nullptr);
+    ASSERT_EQ(rgb->getInfo().glFormat, uint32_t(KtxBundle::RGB));
+    ASSERT_EQ(rgb->getInfo().glTypeSize, 3);
+    auto dxt = transcodeEtc2(etc, TranscodeTarget::DXT1);
+    ASSERT_NE(dxt, nullptr);
+    ASSERT_EQ(dxt->getInfo().glFormat, 0);
+    ASSERT_EQ(dxt->getInfo().glInternalFormat, uint32_t(KtxBundle::RGB_S3TC_DXT1));
+
+    // Decodes a DXT1 block without alpha into RGB texels.
+    auto decodeDxt1 = [](uint8_t const* block, int texels[16][3]) {
+        int palette[4][3];
+        for (int i = 0; i < 2; ++i) {
+            const int c = block[i * 2] | (block[i * 2 + 1] << 8);
+            palette[i][0] = ((c >> 11) << 3) | (c >> 13);
+            palette[i][1] = (((c >> 5) & 0x3f) << 2) | ((c >> 9) & 3);
+            palette[i][2] = ((c & 0x1f) << 3) | ((c >> 2) & 7);
+        }
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            const int index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+            memcpy(texels[i], palette[index], sizeof(texels[i]));
+        }
+    };
+
+    for (uint32_t level = 0; level < nmips; ++level) {
+        const uint32_t width = size >> level;
+        const uint32_t columns = (width + 3) / 4;
+        uint8_t* pixels;
+        uint32_t nbytes;
+        ASSERT_TRUE(rgb->getBlob({level}, &pixels, &nbytes));
+        ASSERT_EQ(nbytes, width * width * 3);
+        uint8_t* blocks;
+        ASSERT_TRUE(dxt->getBlob({level}, &blocks, &nbytes));
+        ASSERT_EQ(nbytes, columns * columns * 8);
+
+        int maxError = 0;
+        int maxDxtError = 0;
+        for (uint32_t y = 0; y < width; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                int texels[16][3];
+                decodeDxt1(blocks + ((y / 4) * columns + x / 4) * 8, texels);
+                float const* expected = mips[level].getPixelRef(x, y);
+                uint8_t const* actual = pixels + (y * width + x) * 3;
+                for (int c = 0; c < 3; ++c) {
+                    const int e = int(expected[c] * 255.0f + 0.5f);
+                    maxError = std::max(maxError, std::abs(actual[c] - e));
+                    maxDxtError = std::max(maxDxtError,
+                            std::abs(texels[(y % 4) * 4 + x % 4][c] - actual[c]));
+                }
+            }
+        }
+        EXPECT_LT(maxError, 16);
+        EXPECT_LT(maxDxtError, 24);
+    }
+}
+
+TEST_F(ImageTest, BptcCompression) { // NOLINT
+    // A 6x6 gradient, which is not a multiple of the block size. The HDR version goes well above 1.
+    const uint32_t size = 6;
+    LinearImage ldr(size, size, 4);
+    LinearImage hdr(size, size, 3);
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            const float t = float(x + y) / (2 * (size - 1));
+            float* texel = ldr.getPixelRef(x, y);
+            texel[0] = 0.25f + 0.5f * t;
+            texel[1] = 0.75f - 0.5f * t;
+            texel[2] = 0.5f;
+            texel[3] = 1.0f - 0.25f * t;
+            texel = hdr.getPixelRef(x, y);
+            texel[0] = 1.0f + 3.0f * t;
+            texel[1] = 4.0f;
+            texel[2] = 2.0f + t;
+        }
+    }
+
+    CompressionConfig config {};
+    ASSERT_TRUE(parseOptionString("bptc_bc6h", &config));
+    ASSERT_EQ(config.type, CompressionConfig::BPTC);
+    ASSERT_TRUE(isHdrConfig(config));
+    ASSERT_TRUE(parseOptionString("bptc_bc7", &config));
+    ASSERT_FALSE(isHdrConfig(config));
+    ASSERT_FALSE(parseOptionString("bptc_bc8", &config));
+
+    auto readBits = [](uint8_t const* block, uint32_t& bit, uint32_t count) {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < count; ++i, ++bit) {
+            value |= ((block[bit / 8] >> (bit % 8)) & 1u) << i;
+        }
+        return value;
+    };
+    const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // Decodes a BC7 mode 6 block into RGBA texels.
+    auto decodeBc7 = [&](uint8_t const* block, int texels[16][4]) {
+        uint32_t bit = 0;
+        ASSERT_EQ(readBits(block, bit, 7), 0x40u);
+        uint32_t ends[2][4];
+        for (int c = 0; c < 4; ++c) {
+            ends[0][c] = readBits(block, bit, 7) << 1;
+            ends[1][c] = readBits(block, bit, 7) << 1;
+        }
+        const uint32_t p0 = readBits(block, bit, 1);
+        const uint32_t p1 = readBits(block, bit, 1);
+        for (int i = 0; i < 16; ++i) {
+            const uint32_t w = weights[readBits(block, bit, i ? 4 : 3)];
+            for (int c = 0; c < 4; ++c) {
+                texels[i][c] = ((64 - w) * (ends[0][c] | p0) + w * (ends[1][c] | p1) + 32) >> 6;
+            }
+        }
+    };
+
+    // Decodes a BC6H mode 11 block into RGB texels.
+    auto decodeBc6h = [&](uint8_t const* block, float texels[16][3]) {
+        auto unquantize = [](uint32_t q) {
+            return q == 0 ? 0 : q == 1023 ? 0xffff : ((q << 16) + 0x8000) >> 10;
+        };
+        uint32_t bit = 0;
+        ASSERT_EQ(readBits(block, bit, 5), 0x03u);
+        uint32_t ends[2][3];
+        for (auto& end : ends) {
+            for (uint32_t& channel : end) {
+                channel = unquantize(readBits(block, bit, 10));
+            }
+        }
+        for (int i = 0; i < 16; ++i) {
+            const uint32_t w = weights[readBits(block, bit, i ? 4 : 3)];
+            for (int c = 0; c < 3; ++c) {
+                const uint32_t value = ((64 - w) * ends[0][c] + w * ends[1][c] + 32) >> 6;
+                texels[i][c] = float(math::makeHalf(uint16_t((value * 31) >> 6)));
+            }
+        }
+    };
+
+    const uint32_t columns = (size + 3) / 4;
+    utils::JobSystem js;
+    js.adopt();
+    CompressedTexture bc7 = bptcCompress(ldr, { CompressedFormat::RGBA_BPTC_UNORM }, &js);
+    CompressedTexture bc6h = bptcCompress(hdr, { CompressedFormat::RGB_BPTC_UNSIGNED_FLOAT });
+    js.emancipate();
+    ASSERT_EQ(bc7.format, CompressedFormat::RGBA_BPTC_UNORM);
+    ASSERT_EQ(bc7.size, columns * columns * 16);
+    ASSERT_EQ(bc6h.format, CompressedFormat::RGB_BPTC_UNSIGNED_FLOAT);
+    ASSERT_EQ(bc6h.size, columns * columns * 16);
+
+    int maxError = 0;
+    float maxRelativeError = 0.0f;
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            const uint32_t offset = ((y / 4) * columns + x / 4) * 16;
+            const uint32_t index = (y % 4) * 4 + x % 4;
+            int texels[16][4];
+            decodeBc7(bc7.data.get() + offset, texels);
+            float hdrTexels[16][3];
+            decodeBc6h(bc6h.data.get() + offset, hdrTexels);
+            for (int c = 0; c < 4; ++c) {
+                const int e = int(ldr.getPixelRef(x, y)[c] * 255.0f + 0.5f);
+                maxError = std::max(maxError, std::abs(texels[index][c] - e));
+            }
+            for (int c = 0; c < 3; ++c) {
+                const float e = hdr.getPixelRef(x, y)[c];
+                maxRelativeError = std::max(maxRelativeError,
+                        std::abs(hdrTexels[index][c] - e) / e);
+            }
+        }
+    }
+    EXPECT_LT(maxError, 8);
+    EXPECT_LT(maxRelativeError, 0.05f);
+}
+
 static void printUsage(const char* name) {
     string exec_name(utils::Path(name).getName());
     string usage(
@@ -28,6 +28,10 @@
 
 #include <stdint.h>
 
+namespace utils {
+class JobSystem;
+}
+
 namespace image {
 
 enum class CompressedFormat {
@@ -53,6 +57,11 @@ enum class CompressedFormat {
     SRGB_ALPHA_S3TC_DXT3 = 0x8C4E,
     SRGB_ALPHA_S3TC_DXT5 = 0x8C4F,
 
+    RGBA_BPTC_UNORM = 0x8E8C,
+    SRGB_ALPHA_BPTC_UNORM = 0x8E8D,
+    RGB_BPTC_SIGNED_FLOAT = 0x8E8E,
+    RGB_BPTC_UNSIGNED_FLOAT = 0x8E8F,
+
     RGBA_ASTC_4x4 = 0x93B0,
     RGBA_ASTC_5x4 = 0x93B1,
     RGBA_ASTC_5x5 = 0x93B2,
@@ -119,8 +128,11 @@ struct AstcConfig {
 };
 
 // Uses the CPU to compress a linear image (1 to 4 channels) into an ASTC texture. The 16-byte
-// header block that ARM uses in their file format is not included.
-CompressedTexture astcCompress(const LinearImage& source, AstcConfig config);
+// header block that ARM uses in their file format is not included. If a JobSystem is given,
+// bands of blocks are compressed in parallel with it (the calling thread must be adopted by the
+// JobSystem), otherwise the encoder creates its own threads. The output is the same either way.
+CompressedTexture astcCompress(const LinearImage& source, AstcConfig config,
+        utils::JobSystem* jobSystem = nullptr);
 
 // Parses a simple underscore-delimited string to produce an ASTC compression configuration. This
 // makes it easy to incorporate the compression API into command-line tools. If the string is
@@ -146,7 +158,8 @@ struct EtcConfig {
     int effort;
 };
 
-// Uses the CPU to compress a linear image (1 to 4 channels) into an ETC texture.
+// Uses the CPU to compress a linear image (1 to 4 channels) into an ETC texture. The encoder
+// creates its own threads.
 CompressedTexture etcCompress(const LinearImage& source, EtcConfig config);
 
 // Converts a string into an ETC compression configuration where the string has the form
@@ -165,26 +178,62 @@ struct S3tcConfig {
     bool srgb;
 };
 
-// Uses the CPU to compress a linear image (1 to 4 channels) into an S3TC texture.
-CompressedTexture s3tcCompress(const LinearImage& source, S3tcConfig config);
+// Uses the CPU to compress a linear image (1 to 4 channels) into an S3TC texture. If a JobSystem
+// is given, rows of blocks are compressed in parallel with it.
+CompressedTexture s3tcCompress(const LinearImage& source, S3tcConfig config,
+        utils::JobSystem* jobSystem = nullptr);
 
 // Parses an underscore-delimited string to produce an S3TC compression configuration. Currently
 // this only accepts "rgb_dxt1" and "rgba_dxt5". If the string is malformed, this returns a config
 // with an invalid format.
 S3tcConfig s3tcParseOptionString(const std::string& options);
 
+// BPTC ////////////////////////////////////////////////////////////////////////////////////////////
+
+// Informs the BPTC encoder of the desired output: BC6H (RGB_BPTC_UNSIGNED_FLOAT) keeps the range
+// of HDR images, BC7 (RGBA_BPTC_UNORM or SRGB_ALPHA_BPTC_UNORM) is for LDR images with alpha.
+struct BptcConfig {
+    CompressedFormat format;
+};
+
+// Uses the CPU to compress a linear image (1 to 4 channels) into a BC6H or BC7 texture. BC6H drops
+// the alpha channel and clamps to [0, 65504], BC7 clamps to [0, 1] and applies the sRGB transfer
+// function to the colors of SRGB_ALPHA_BPTC_UNORM. Only the modes with a single subset are used
+// (BC6H mode 11 and BC7 mode 6). If a JobSystem is given, rows of blocks are compressed in
+// parallel with it.
+CompressedTexture bptcCompress(const LinearImage& source, BptcConfig config,
+        utils::JobSystem* jobSystem = nullptr);
+
+// Parses a string to produce a BPTC compression configuration, one of "bc6h", "bc7" and
+// "bc7_srgb". If the string is malformed, this returns a config with an invalid format.
+BptcConfig bptcParseOptionString(const std::string& options);
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 struct CompressionConfig {
-    enum { INVALID, ASTC, S3TC, ETC } type;
+    enum { INVALID, ASTC, S3TC, ETC, BPTC } type;
     AstcConfig astc;
     S3tcConfig s3tc;
     EtcConfig etc;
+    BptcConfig bptc;
 };
 
 bool parseOptionString(const std::string& options, CompressionConfig* config);
 
-CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image);
+// Returns the given configuration with the fastest quality settings of its encoder, for builds
+// where compression time matters more than quality (e.g. continuous integration). The format
+// doesn't change: ASTC uses the VERYFAST preset and ETC an effort of 0. S3TC and BPTC are
+// unaffected.
+CompressionConfig getFastestConfig(CompressionConfig config);
+
+// Returns true if the configuration keeps values above 1, i.e. BC6H and HDR ASTC. The images given
+// to the other configurations must be in [0, 1], e.g. encoded in RGBM.
+bool isHdrConfig(const CompressionConfig& config);
+
+// See astcCompress(), s3tcCompress(), etcCompress() and bptcCompress() for the use of the
+// JobSystem.
+CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image,
+        utils::JobSystem* jobSystem = nullptr);
 
 } // namespace image
 
@@ -17,9 +17,13 @@
 #ifndef IMAGE_IMAGEDECODER_H_
 #define IMAGE_IMAGEDECODER_H_
 
+#include <functional>
 #include <iosfwd>
+#include <memory>
 #include <string>
 
+#include <stdint.h>
+
 #include <image/LinearImage.h>
 
 namespace image {
@@ -35,6 +39,22 @@ public:
     static LinearImage decode(std::istream& stream, const std::string& sourceName,
             ColorSpace sourceSpace = ColorSpace::SRGB);
 
+    // Returns the tightly packed 8-bit pixels of a PNG file, as they are stored (no color space
+    // conversion), expanded or stripped to RGB (channels = 3) or RGBA (channels = 4). Returns
+    // null if the stream isn't a valid PNG file.
+    static std::unique_ptr<uint8_t[]> decodePNG8(std::istream& stream, uint32_t channels,
+            uint32_t* width, uint32_t* height);
+
+    // Returns the memory for "size" bytes of pixels, or null.
+    using Allocator = std::function<void*(size_t size)>;
+
+    // Like decodePNG8(), but the rows are decoded straight into memory returned by "allocate",
+    // which is called once with the size of the image, e.g. to fill the buffer of a
+    // PixelBufferDescriptor without a copy. That memory is owned by the caller, even if the
+    // decoding fails afterwards. Returns false if the stream isn't a valid PNG file.
+    static bool decodePNG8(std::istream& stream, uint32_t channels,
+            uint32_t* width, uint32_t* height, Allocator const& allocate);
+
     class Decoder {
     public:
         virtual LinearImage decode() = 0;
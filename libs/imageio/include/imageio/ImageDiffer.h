@@ -18,6 +18,13 @@
 
 #include <utils/Path.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+}
+
 namespace image {
 
 enum class ComparisonMode {
@@ -29,6 +36,15 @@ enum class ComparisonMode {
 // Saves an image to disk or does a load-and-compare, depending on comparison mode.
 // This makes it easy for unit tests to have compare / update commands.
 // The passed-in image is the "result image" and the expected image is the "golden image".
+// On mismatch, a heatmap of the differences is saved next to the golden, as <golden>_diff.png.
 void updateOrCompare(LinearImage result, const utils::Path& golden, ComparisonMode, float epsilon);
 
+// Same as above for tightly packed 8-bit RGB or RGBA pixels (e.g. a render target read back as
+// RGBA8) and an 8-bit PNG golden, compared without conversion to float. Up to maxFailures pixels
+// may differ by more than epsilon. The comparison runs in tiles, in parallel if a JobSystem is
+// given, and stops as soon as the threshold is exceeded.
+void updateOrCompare(uint8_t const* result, uint32_t width, uint32_t height, uint32_t channels,
+        const utils::Path& golden, ComparisonMode, uint8_t epsilon, size_t maxFailures = 0,
+        utils::JobSystem* js = nullptr);
+
 }  // namespace image
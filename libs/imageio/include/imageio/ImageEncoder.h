@@ -20,6 +20,8 @@
 #include <iosfwd>
 #include <string>
 
+#include <stdint.h>
+
 #include <image/LinearImage.h>
 
 namespace image {
@@ -46,6 +48,11 @@ public:
     static bool encode(std::ostream& stream, Format format, const LinearImage& image,
             const std::string& compression, const std::string& destName);
 
+    // Writes tightly packed 8-bit RGB (channels = 3) or RGBA (channels = 4) pixels as they are
+    // to a PNG file, returns false if unable to encode.
+    static bool encodePNG8(std::ostream& stream, uint8_t const* data,
+            uint32_t width, uint32_t height, uint32_t channels);
+
     static Format chooseFormat(const std::string& name, bool forceLinear = false);
     static std::string chooseExtension(Format format);
 
@@ -16,10 +16,19 @@
 
 #include <imageio/BlockCompression.h>
 
+#include <image/ColorTransform.h>
 #include <image/ImageOps.h>
 
+#include <math/half.h>
+
+#include <utils/JobSystem.h>
+
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
 #include <thread>
+#include <vector>
 
 #include <astcenc.h>
 #include <Etc.h>
@@ -31,11 +40,46 @@ using namespace image;
 
 using std::string;
 
+// defined by the ARM encoder, but not in its public header
+extern int suppress_progress_counter;
+
 namespace image {
 
 static LinearImage extendToFourChannels(LinearImage source);
 
-CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
+// Encodes the image in bands of block rows, one job per band. Blocks are compressed
+// independently of each other, so the output doesn't depend on how the image is split.
+static void astcEncodeBands(utils::JobSystem& js, astc_codec_image* image, int xdim, int ydim,
+        const error_weighting_params* ewp, astc_decode_mode decode_mode,
+        swizzlepattern swz_encode, swizzlepattern swz_decode, uint8_t* buffer) {
+    const int xblocks = (image->xsize + xdim - 1) / xdim;
+    const int yblocks = (image->ysize + ydim - 1) / ydim;
+
+    // a band is a view of some rows of the source image and encodes the blocks they contain
+    auto encode = [=](uint32_t first, uint32_t count) {
+        astc_codec_image band = *image;
+        uint16_t** rows = image->imagedata16[0] + first * ydim;
+        band.imagedata16 = &rows;
+        band.ysize = std::min(int(count) * ydim, image->ysize - int(first) * ydim);
+        encode_astc_image(&band, nullptr, xdim, ydim, 1, ewp, decode_mode,
+                swz_encode, swz_decode, buffer + first * xblocks * 16, 0, 1);
+    };
+
+    // The progress counters of concurrent bands can't be combined. The first band is encoded
+    // before the others because the encoder lazily creates its tables for each block size.
+    const int suppressProgress = suppress_progress_counter;
+    suppress_progress_counter = 1;
+    encode(0, 1);
+    if (yblocks > 1) {
+        auto job = utils::jobs::parallel_for(js, nullptr, 1, uint32_t(yblocks - 1),
+                std::cref(encode), utils::jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+    }
+    suppress_progress_counter = suppressProgress;
+}
+
+CompressedTexture astcCompress(const LinearImage& original, AstcConfig config,
+        utils::JobSystem* jobSystem) {
 
     // If this is the first time, initialize the ARM encoder tables.
 
@@ -304,8 +348,13 @@ CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
     uint32_t size = xblocks * yblocks * zblocks * 16;
     uint8_t* buffer = new uint8_t[size];
 
-    encode_astc_image(input_image, nullptr, xdim, ydim, zdim, &ewp, decode_mode,
-            swz_encode, swz_decode, buffer, 0, threadcount);
+    if (jobSystem) {
+        astcEncodeBands(*jobSystem, input_image, xdim, ydim, &ewp, decode_mode,
+                swz_encode, swz_decode, buffer);
+    } else {
+        encode_astc_image(input_image, nullptr, xdim, ydim, zdim, &ewp, decode_mode,
+                swz_encode, swz_decode, buffer, 0, threadcount);
+    }
 
     destroy_image(input_image);
 
@@ -385,21 +434,34 @@ static void extract4x4RGBA(uint8_t* dst, const LinearImage& source, uint32_t x0,
 //  - DXT5 with alpha (16 input pixels into 128 bits of output, 4:1)
 //
 // TODO: investigate using something more capable than STB (eg AMD Compressenator, bimg, libsquish)
-CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config) {
+CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config,
+        utils::JobSystem* jobSystem) {
     const bool dxt5 = config.format == CompressedFormat::RGBA_S3TC_DXT5;
     LinearImage source = extendToFourChannels(original);
-    uint8_t block[64];
-    uint32_t xblocks = (source.getWidth() + 3) / 4;
-    uint32_t yblocks = (source.getHeight() + 3) / 4;
-    uint32_t size = xblocks * yblocks * (dxt5 ? 16 : 8);
+    const uint32_t blockSize = dxt5 ? 16 : 8;
+    const uint32_t xblocks = (source.getWidth() + 3) / 4;
+    const uint32_t yblocks = (source.getHeight() + 3) / 4;
+    uint32_t size = xblocks * yblocks * blockSize;
     uint8_t* buffer = new uint8_t[size];
-    uint8_t* dst = buffer;
-    for (int y = 0, h = source.getHeight(); y < h; y += 4) {
-        for (int x = 0, w = source.getWidth(); x < w; x += 4) {
-            extract4x4RGBA(block, source, x, y);
-            stb_compress_dxt_block(dst, block, dxt5, 8);
-            dst += dxt5 ? 16 : 8;
+
+    // each block row is written to its own part of the buffer
+    auto compressRows = [&](uint32_t first, uint32_t count) {
+        uint8_t block[64];
+        uint8_t* dst = buffer + first * xblocks * blockSize;
+        for (uint32_t by = first; by < first + count; ++by) {
+            for (uint32_t bx = 0; bx < xblocks; ++bx) {
+                extract4x4RGBA(block, source, bx * 4, by * 4);
+                stb_compress_dxt_block(dst, block, dxt5, 8);
+                dst += blockSize;
+            }
         }
+    };
+    if (jobSystem) {
+        auto job = utils::jobs::parallel_for(*jobSystem, nullptr, 0, yblocks,
+                std::ref(compressRows), utils::jobs::CountSplitter<4, 8>());
+        jobSystem->runAndWait(job);
+    } else {
+        compressRows(0, yblocks);
     }
     return {
         .format = config.format,
@@ -515,6 +577,384 @@ EtcConfig etcParseOptionString(const std::string& options) {
     return result;
 }
 
+// BPTC ////////////////////////////////////////////////////////////////////////////////////////////
+
+// Our BC6H and BC7 encoders only use the modes with a single subset and 4-bit indices, which don't
+// need a partition search: BC6H mode 11 (10-bit endpoints) and BC7 mode 6 (RGBA 7-bit endpoints
+// with a shared low bit each). The endpoints are the ends of the principal axis of the texels,
+// refined by least squares, and each texel takes the closest of the 16 interpolated colors.
+
+static constexpr uint32_t BPTC_WEIGHTS[16] = {
+        0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Appends fields to a 128-bit block, least significant bit first.
+class BptcBlockWriter {
+public:
+    explicit BptcBlockWriter(uint8_t* dst) : mDst(dst) {
+        std::fill(dst, dst + 16, 0);
+    }
+
+    void write(uint32_t value, uint32_t bits) {
+        for (uint32_t i = 0; i < bits; ++i, ++mBit) {
+            mDst[mBit >> 3u] |= uint8_t(((value >> i) & 1u) << (mBit & 7u));
+        }
+    }
+
+private:
+    uint8_t* mDst;
+    uint32_t mBit = 0;
+};
+
+// Places the two endpoints at the ends of the principal axis of the texels.
+template<size_t N>
+static void bptcFitEndpoints(const float (&texels)[16][N], float (&ends)[2][N]) {
+    float mean[N] = {};
+    float lo[N];
+    float hi[N];
+    for (size_t c = 0; c < N; ++c) {
+        lo[c] = hi[c] = texels[0][c];
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        for (size_t c = 0; c < N; ++c) {
+            mean[c] += texels[i][c] * (1.0f / 16.0f);
+            lo[c] = std::min(lo[c], texels[i][c]);
+            hi[c] = std::max(hi[c], texels[i][c]);
+        }
+    }
+
+    float covariance[N][N] = {};
+    for (size_t i = 0; i < 16; ++i) {
+        for (size_t a = 0; a < N; ++a) {
+            for (size_t b = 0; b < N; ++b) {
+                covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // power iterations, from the diagonal of the bounding box
+    float axis[N];
+    for (size_t c = 0; c < N; ++c) {
+        axis[c] = hi[c] - lo[c];
+    }
+    for (size_t iteration = 0; iteration < 8; ++iteration) {
+        float next[N] = {};
+        float length = 0.0f;
+        for (size_t a = 0; a < N; ++a) {
+            for (size_t b = 0; b < N; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length = std::max(length, std::abs(next[a]));
+        }
+        if (length < 1e-12f) {
+            break;
+        }
+        for (size_t c = 0; c < N; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float tmin = 0.0f;
+    float tmax = 0.0f;
+    float norm = 0.0f;
+    for (size_t c = 0; c < N; ++c) {
+        norm += axis[c] * axis[c];
+    }
+    if (norm > 0.0f) {
+        tmin = std::numeric_limits<float>::max();
+        tmax = -tmin;
+        for (size_t i = 0; i < 16; ++i) {
+            float t = 0.0f;
+            for (size_t c = 0; c < N; ++c) {
+                t += (texels[i][c] - mean[c]) * axis[c];
+            }
+            tmin = std::min(tmin, t / norm);
+            tmax = std::max(tmax, t / norm);
+        }
+    }
+    for (size_t c = 0; c < N; ++c) {
+        ends[0][c] = mean[c] + tmin * axis[c];
+        ends[1][c] = mean[c] + tmax * axis[c];
+    }
+}
+
+// Solves for the endpoints which minimize the squared error with the given indices, returns false
+// if all the texels use the same weight.
+template<size_t N>
+static bool bptcRefitEndpoints(const float (&texels)[16][N], const uint8_t (&indices)[16],
+        float (&ends)[2][N]) {
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float r0[N] = {};
+    float r1[N] = {};
+    for (size_t i = 0; i < 16; ++i) {
+        const float t = BPTC_WEIGHTS[indices[i]] * (1.0f / 64.0f);
+        a += (1.0f - t) * (1.0f - t);
+        b += (1.0f - t) * t;
+        c += t * t;
+        for (size_t k = 0; k < N; ++k) {
+            r0[k] += (1.0f - t) * texels[i][k];
+            r1[k] += t * texels[i][k];
+        }
+    }
+    const float det = a * c - b * b;
+    if (std::abs(det) < 1e-6f) {
+        return false;
+    }
+    for (size_t k = 0; k < N; ++k) {
+        ends[0][k] = (c * r0[k] - b * r1[k]) / det;
+        ends[1][k] = (a * r1[k] - b * r0[k]) / det;
+    }
+    return true;
+}
+
+// Picks the closest color of the palette for each texel and returns the total squared error.
+template<size_t N>
+static float bptcSelectIndices(const float (&texels)[16][N], const float (&palette)[16][N],
+        uint8_t (&indices)[16]) {
+    float total = 0.0f;
+    for (size_t i = 0; i < 16; ++i) {
+        float best = std::numeric_limits<float>::max();
+        for (uint8_t j = 0; j < 16; ++j) {
+            float error = 0.0f;
+            for (size_t c = 0; c < N; ++c) {
+                const float d = palette[j][c] - texels[i][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                indices[i] = j;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// Encodes a block with the endpoints found by fitting and a couple of least squares refinements,
+// keeping the best candidate. C provides the quantization and the palette of the encoded format.
+template<typename C, size_t N>
+static void bptcEncodeBlock(const C& codec, const float (&texels)[16][N], uint8_t* dst) {
+    float ends[2][N];
+    bptcFitEndpoints(texels, ends);
+
+    typename C::Endpoints best;
+    uint8_t bestIndices[16];
+    float bestError = std::numeric_limits<float>::max();
+    for (size_t attempt = 0; attempt < 3; ++attempt) {
+        typename C::Endpoints endpoints = codec.quantize(ends);
+        float palette[16][N];
+        codec.palette(endpoints, palette);
+        uint8_t indices[16];
+        const float error = bptcSelectIndices(texels, palette, indices);
+        if (error < bestError) {
+            bestError = error;
+            best = endpoints;
+            std::copy(indices, indices + 16, bestIndices);
+        }
+        if (error == 0.0f || !bptcRefitEndpoints(texels, indices, ends)) {
+            break;
+        }
+    }
+
+    // the most significant bit of the first index is implicitly 0
+    if (bestIndices[0] >= 8) {
+        std::swap(best.values[0], best.values[1]);
+        for (uint8_t& index : bestIndices) {
+            index = uint8_t(15 - index);
+        }
+    }
+
+    BptcBlockWriter writer(dst);
+    codec.writeEndpoints(writer, best);
+    writer.write(bestIndices[0], 3);
+    for (size_t i = 1; i < 16; ++i) {
+        writer.write(bestIndices[i], 4);
+    }
+}
+
+// BC6H mode 11, unsigned. The texels are the bits of their half-float values, the decoder
+// interpolates them linearly, which is close to interpolating logarithms.
+struct Bc6hCodec {
+    struct Endpoints {
+        uint32_t values[2][3];
+    };
+
+    static uint32_t unquantize(uint32_t q) {
+        if (q == 0) {
+            return 0;
+        }
+        if (q == 1023) {
+            return 0xffff;
+        }
+        return ((q << 16u) + 0x8000u) >> 10u;
+    }
+
+    Endpoints quantize(const float (&ends)[2][3]) const {
+        Endpoints result;
+        for (size_t e = 0; e < 2; ++e) {
+            for (size_t c = 0; c < 3; ++c) {
+                // inverse of the final scale by 31/64 and of unquantize()
+                const float u = ends[e][c] * (64.0f / 31.0f);
+                const float q = std::round((u - 32.0f) * (1.0f / 64.0f));
+                result.values[e][c] = uint32_t(std::min(std::max(q, 0.0f), 1023.0f));
+            }
+        }
+        return result;
+    }
+
+    void palette(const Endpoints& endpoints, float (&palette)[16][3]) const {
+        for (size_t c = 0; c < 3; ++c) {
+            const uint32_t e0 = unquantize(endpoints.values[0][c]);
+            const uint32_t e1 = unquantize(endpoints.values[1][c]);
+            for (size_t j = 0; j < 16; ++j) {
+                const uint32_t w = BPTC_WEIGHTS[j];
+                const uint32_t value = ((64u - w) * e0 + w * e1 + 32u) >> 6u;
+                palette[j][c] = float((value * 31u) >> 6u);
+            }
+        }
+    }
+
+    void writeEndpoints(BptcBlockWriter& writer, const Endpoints& endpoints) const {
+        writer.write(0x03, 5);
+        for (size_t e = 0; e < 2; ++e) {
+            for (size_t c = 0; c < 3; ++c) {
+                writer.write(endpoints.values[e][c], 10);
+            }
+        }
+    }
+};
+
+// BC7 mode 6, the texels are RGBA values in [0, 255].
+struct Bc7Codec {
+    struct Endpoints {
+        uint32_t values[2][4];      // 7 bits per channel
+        uint32_t pbits[2];
+    };
+
+    Endpoints quantize(const float (&ends)[2][4]) const {
+        Endpoints result;
+        for (size_t e = 0; e < 2; ++e) {
+            // the low bit is shared by the channels, keep the one with the smallest error
+            float bestError = std::numeric_limits<float>::max();
+            for (uint32_t p = 0; p < 2; ++p) {
+                uint32_t values[4];
+                float error = 0.0f;
+                for (size_t c = 0; c < 4; ++c) {
+                    const float v = std::round((ends[e][c] - p) * 0.5f);
+                    values[c] = uint32_t(std::min(std::max(v, 0.0f), 127.0f));
+                    const float d = float((values[c] << 1u) | p) - ends[e][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    std::copy(values, values + 4, result.values[e]);
+                    result.pbits[e] = p;
+                }
+            }
+        }
+        return result;
+    }
+
+    void palette(const Endpoints& endpoints, float (&palette)[16][4]) const {
+        for (size_t c = 0; c < 4; ++c) {
+            const uint32_t e0 = (endpoints.values[0][c] << 1u) | endpoints.pbits[0];
+            const uint32_t e1 = (endpoints.values[1][c] << 1u) | endpoints.pbits[1];
+            for (size_t j = 0; j < 16; ++j) {
+                const uint32_t w = BPTC_WEIGHTS[j];
+                palette[j][c] = float(((64u - w) * e0 + w * e1 + 32u) >> 6u);
+            }
+        }
+    }
+
+    void writeEndpoints(BptcBlockWriter& writer, Endpoints endpoints) const {
+        writer.write(1u << 6u, 7);
+        for (size_t c = 0; c < 4; ++c) {
+            writer.write(endpoints.values[0][c], 7);
+            writer.write(endpoints.values[1][c], 7);
+        }
+        writer.write(endpoints.pbits[0], 1);
+        writer.write(endpoints.pbits[1], 1);
+    }
+};
+
+CompressedTexture bptcCompress(const LinearImage& original, BptcConfig config,
+        utils::JobSystem* jobSystem) {
+    const bool bc6h = config.format == CompressedFormat::RGB_BPTC_UNSIGNED_FLOAT;
+    const bool srgb = config.format == CompressedFormat::SRGB_ALPHA_BPTC_UNORM;
+    if (!bc6h && !srgb && config.format != CompressedFormat::RGBA_BPTC_UNORM) {
+        return {};
+    }
+
+    LinearImage source = extendToFourChannels(original);
+    const uint32_t maxx = source.getWidth() - 1;
+    const uint32_t maxy = source.getHeight() - 1;
+    const uint32_t xblocks = (source.getWidth() + 3) / 4;
+    const uint32_t yblocks = (source.getHeight() + 3) / 4;
+    const uint32_t size = xblocks * yblocks * 16;
+    uint8_t* buffer = new uint8_t[size];
+
+    // each block row is written to its own part of the buffer
+    auto compressRows = [&](uint32_t first, uint32_t count) {
+        const Bc6hCodec bc6hCodec;
+        const Bc7Codec bc7Codec;
+        float rgb[16][3];
+        float rgba[16][4];
+        uint8_t* dst = buffer + first * xblocks * 16;
+        for (uint32_t by = first; by < first + count; ++by) {
+            for (uint32_t bx = 0; bx < xblocks; ++bx, dst += 16) {
+                for (uint32_t i = 0; i < 16; ++i) {
+                    float const* texel = source.getPixelRef(
+                            imin(maxx, bx * 4 + i % 4), imin(maxy, by * 4 + i / 4));
+                    for (size_t c = 0; c < 4; ++c) {
+                        if (bc6h) {
+                            if (c < 3) {
+                                // NaNs become 0
+                                const float v = texel[c] > 0.0f ? std::min(texel[c], 65504.0f) : 0;
+                                rgb[i][c] = getBits(math::half(v));
+                            }
+                        } else {
+                            float v = std::min(std::max(texel[c], 0.0f), 1.0f);
+                            if (srgb && c < 3) {
+                                v = linearTosRGB(v);
+                            }
+                            rgba[i][c] = v * 255.0f;
+                        }
+                    }
+                }
+                if (bc6h) {
+                    bptcEncodeBlock(bc6hCodec, rgb, dst);
+                } else {
+                    bptcEncodeBlock(bc7Codec, rgba, dst);
+                }
+            }
+        }
+    };
+    if (jobSystem) {
+        auto job = utils::jobs::parallel_for(*jobSystem, nullptr, 0, yblocks,
+                std::ref(compressRows), utils::jobs::CountSplitter<4, 8>());
+        jobSystem->runAndWait(job);
+    } else {
+        compressRows(0, yblocks);
+    }
+    return {
+        .format = config.format,
+        .size = size,
+        .data = decltype(CompressedTexture::data)(buffer)
+    };
+}
+
+BptcConfig bptcParseOptionString(const std::string& options) {
+    if (options == "bc6h") {
+        return { CompressedFormat::RGB_BPTC_UNSIGNED_FLOAT };
+    }
+    if (options == "bc7") {
+        return { CompressedFormat::RGBA_BPTC_UNORM };
+    }
+    if (options == "bc7_srgb") {
+        return { CompressedFormat::SRGB_ALPHA_BPTC_UNORM };
+    }
+    return {};
+}
+
 bool parseOptionString(const string& options, CompressionConfig* config) {
     config->type = CompressionConfig::INVALID;
     if (options.substr(0, 5) == "astc_") {
@@ -532,20 +972,45 @@ bool parseOptionString(const string& options, CompressionConfig* config) {
         if (config->etc.format != CompressedFormat::INVALID) {
             config->type = CompressionConfig::ETC;
         }
+    } else if (options.substr(0, 5) == "bptc_") {
+        config->bptc = bptcParseOptionString(options.substr(5));
+        if (config->bptc.format != CompressedFormat::INVALID) {
+            config->type = CompressionConfig::BPTC;
+        }
     }
     return config->type != CompressionConfig::INVALID;
 }
 
-CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image) {
+CompressionConfig getFastestConfig(CompressionConfig config) {
+    config.astc.quality = AstcPreset::VERYFAST;
+    config.etc.effort = 0;
+    return config;
+}
+
+bool isHdrConfig(const CompressionConfig& config) {
     if (config.type == CompressionConfig::ASTC) {
-        return astcCompress(image, config.astc);
+        return config.astc.semantic == AstcSemantic::COLORS_HDR;
+    }
+    if (config.type == CompressionConfig::BPTC) {
+        return config.bptc.format == CompressedFormat::RGB_BPTC_UNSIGNED_FLOAT;
+    }
+    return false;
+}
+
+CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image,
+        utils::JobSystem* jobSystem) {
+    if (config.type == CompressionConfig::ASTC) {
+        return astcCompress(image, config.astc, jobSystem);
     }
     if (config.type == CompressionConfig::S3TC) {
-        return s3tcCompress(image, config.s3tc);
+        return s3tcCompress(image, config.s3tc, jobSystem);
     }
     if (config.type == CompressionConfig::ETC) {
         return etcCompress(image, config.etc);
     }
+    if (config.type == CompressionConfig::BPTC) {
+        return bptcCompress(image, config.bptc, jobSystem);
+    }
     return {};
 }
 
@@ -565,11 +1030,13 @@ static LinearImage extendToFourChannels(LinearImage original) {
             auto l = image::extractChannel(source, 0);
             auto a = createEmptyImage(1.0f);
             source = image::combineChannels({l, l, l, a});
+            break;
         }
         case 2: {
             auto l = image::extractChannel(source, 0);
             auto a = image::extractChannel(source, 1);
             source = image::combineChannels({l, l, l, a});
+            break;
         }
         case 3: {
             auto r = image::extractChannel(source, 0);
@@ -577,6 +1044,7 @@ static LinearImage extendToFourChannels(LinearImage original) {
             auto b = image::extractChannel(source, 2);
             auto a = createEmptyImage(1.0f);
             source = image::combineChannels({r, g, b, a});
+            break;
         }
         default: {
             auto r = image::extractChannel(source, 0);
@@ -18,6 +18,7 @@
 
 #include <imageio/ImageDecoder.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring> // for memcmp
 #include <istream>
@@ -37,6 +38,8 @@
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <utils/compiler.h>
+
 #include <tinyexr.h>
 
 #include <vector>
@@ -63,6 +66,14 @@ private:
     // ImageDecoder::Decoder interface
     virtual LinearImage decode() override;
 
+    bool decode8(uint32_t channels, uint32_t* width, uint32_t* height,
+            ImageDecoder::Allocator const& allocate);
+
+    // number of rows decoded at a time by decode()
+    static constexpr uint32_t BAND_HEIGHT = 64;
+
+    friend class ImageDecoder;
+
     static void cb_error(png_structp, png_const_charp);
     static void cb_stream(png_structp png, png_bytep buffer, png_size_t size);
 
@@ -191,6 +202,30 @@ LinearImage ImageDecoder::decode(std::istream& stream, const std::string& source
     return decoder->decode();
 }
 
+std::unique_ptr<uint8_t[]> ImageDecoder::decodePNG8(std::istream& stream, uint32_t channels,
+        uint32_t* width, uint32_t* height) {
+    std::unique_ptr<uint8_t[]> imageData;
+    bool success = decodePNG8(stream, channels, width, height, [&imageData](size_t size) {
+        imageData.reset(new uint8_t[size]);
+        return imageData.get();
+    });
+    return success ? std::move(imageData) : nullptr;
+}
+
+bool ImageDecoder::decodePNG8(std::istream& stream, uint32_t channels,
+        uint32_t* width, uint32_t* height, Allocator const& allocate) {
+    std::streampos pos = stream.tellg();
+    char buf[8];
+    stream.read(buf, sizeof(buf));
+    stream.seekg(pos);
+    if (!stream || !PNGDecoder::checkSignature(buf)) {
+        return false;
+    }
+    PNGDecoder* decoder = PNGDecoder::create(stream);
+    std::unique_ptr<Decoder> owner(decoder);
+    return decoder->decode8(channels, width, height, allocate);
+}
+
 // -----------------------------------------------------------------------------------------------
 
 static inline float read32(std::istream& istream) {
@@ -232,8 +267,24 @@ PNGDecoder::~PNGDecoder() {
     png_destroy_read_struct(&mPNG, &mInfo, NULL);
 }
 
+// Converts rows of 16-bit big endian pixels to floats and applies "transform" to each pixel.
+template<typename VEC, typename TRANSFORM>
+static void decodeRows16(VEC* UTILS_RESTRICT dst, uint8_t const* UTILS_RESTRICT src,
+        size_t width, size_t height, size_t bpr, TRANSFORM transform) {
+    constexpr size_t N = sizeof(VEC) / sizeof(float);
+    for (size_t y = 0; y < height; ++y) {
+        uint16_t const* p = reinterpret_cast<uint16_t const*>(src + y * bpr);
+        for (size_t x = 0; x < width; ++x, p += N) {
+            VEC v;
+            for (size_t c = 0; c < N; ++c) {
+                v[c] = ntohs(p[c]);
+            }
+            *dst++ = transform(v / float(std::numeric_limits<uint16_t>::max()));
+        }
+    }
+}
+
 LinearImage PNGDecoder::decode() {
-    std::unique_ptr<uint8_t[]> imageData;
     try {
         mInfo = png_create_info_struct(mPNG);
         png_read_info(mPNG, mInfo);
@@ -255,51 +306,117 @@ LinearImage PNGDecoder::decode() {
         if (bitDepth < 16) {
             png_set_expand_16(mPNG);
         }
+        const int passes = png_set_interlace_handling(mPNG);
 
         png_read_update_info(mPNG, mInfo);
         uint32_t width  = png_get_image_width(mPNG, mInfo);
         uint32_t height = png_get_image_height(mPNG, mInfo);
         size_t rowBytes = png_get_rowbytes(mPNG, mInfo);
 
-        imageData = std::make_unique<uint8_t[]>(height * rowBytes);
-        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[height]);
-        for (size_t y = 0 ; y < height ; y++) {
-            rowPointers[y] = &imageData[y * rowBytes];
+        // The rows are decoded and converted to floats one band at a time, so that only one band
+        // of 16-bit pixels is in memory. Interlaced images are decoded as a whole.
+        const uint32_t bandHeight = passes > 1 ? height : std::min(height, BAND_HEIGHT);
+        std::unique_ptr<uint8_t[]> bandData(new uint8_t[bandHeight * rowBytes]);
+        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[bandHeight]);
+        for (size_t y = 0 ; y < bandHeight ; y++) {
+            rowPointers[y] = &bandData[y * rowBytes];
         }
-        png_read_image(mPNG, rowPointers.get());
-        png_read_end(mPNG, mInfo);
 
-        if (colorType == PNG_COLOR_TYPE_RGBA) {
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear<math::float4>);
+        const bool alpha = colorType == PNG_COLOR_TYPE_RGBA;
+        const bool sRGB = getColorSpace() == ImageDecoder::ColorSpace::SRGB;
+        LinearImage image(width, height, alpha ? 4 : 3);
+        for (uint32_t y = 0; y < height; y += bandHeight) {
+            const uint32_t count = std::min(bandHeight, height - y);
+            if (passes > 1) {
+                png_read_image(mPNG, rowPointers.get());
             } else {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [ ](const math::float4& color) -> math::float4 { return color; });
+                png_read_rows(mPNG, rowPointers.get(), nullptr, count);
             }
-        } else {
-            // Convert to linear float (PNG 16 stores data in network order (big endian).
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear<math::float3>);
+            if (alpha) {
+                math::float4* dst = image.get<math::float4>(0, y);
+                if (sRGB) {
+                    decodeRows16(dst, bandData.get(), width, count, rowBytes,
+                            sRGBToLinear<math::float4>);
+                } else {
+                    decodeRows16(dst, bandData.get(), width, count, rowBytes,
+                            [ ](const math::float4& color) -> math::float4 { return color; });
+                }
             } else {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [ ](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [ ](const math::float3& color) -> math::float3 { return color; });
+                math::float3* dst = image.get<math::float3>(0, y);
+                if (sRGB) {
+                    decodeRows16(dst, bandData.get(), width, count, rowBytes,
+                            sRGBToLinear<math::float3>);
+                } else {
+                    decodeRows16(dst, bandData.get(), width, count, rowBytes,
+                            [ ](const math::float3& color) -> math::float3 { return color; });
+                }
             }
         }
+        png_read_end(mPNG, mInfo);
+        return image;
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
         mStream.seekg(mStreamStartPos);
-        imageData.release();
     }
     return LinearImage();
 }
 
+bool PNGDecoder::decode8(uint32_t channels, uint32_t* width, uint32_t* height,
+        ImageDecoder::Allocator const& allocate) {
+    try {
+        mInfo = png_create_info_struct(mPNG);
+        png_read_info(mPNG, mInfo);
+
+        int colorType = png_get_color_type(mPNG, mInfo);
+        int bitDepth = png_get_bit_depth(mPNG, mInfo);
+
+        if (colorType == PNG_COLOR_TYPE_PALETTE) {
+            png_set_palette_to_rgb(mPNG);
+        }
+        if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
+            if (bitDepth < 8) {
+                png_set_expand_gray_1_2_4_to_8(mPNG);
+            }
+            png_set_gray_to_rgb(mPNG);
+        }
+        if (bitDepth == 16) {
+            png_set_strip_16(mPNG);
+        }
+        if (channels == 4) {
+            png_set_tRNS_to_alpha(mPNG);
+            png_set_add_alpha(mPNG, 0xff, PNG_FILLER_AFTER);
+        } else {
+            png_set_strip_alpha(mPNG);
+        }
+
+        png_read_update_info(mPNG, mInfo);
+        *width  = png_get_image_width(mPNG, mInfo);
+        *height = png_get_image_height(mPNG, mInfo);
+        size_t rowBytes = png_get_rowbytes(mPNG, mInfo);
+        if (rowBytes != size_t(*width) * channels) {
+            throw std::runtime_error("Unexpected PNG row size.");
+        }
+
+        // the rows are decoded in place, there is no intermediate copy
+        uint8_t* imageData = static_cast<uint8_t*>(allocate(*height * rowBytes));
+        if (!imageData) {
+            throw std::runtime_error("Could not allocate the PNG pixels.");
+        }
+        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[*height]);
+        for (size_t y = 0 ; y < *height ; y++) {
+            rowPointers[y] = &imageData[y * rowBytes];
+        }
+        png_read_image(mPNG, rowPointers.get());
+        png_read_end(mPNG, mInfo);
+        return true;
+    } catch(std::runtime_error& e) {
+        std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
+        mStream.seekg(mStreamStartPos);
+    }
+    return false;
+}
+
 void PNGDecoder::cb_stream(png_structp png, png_bytep buffer, png_size_t size) {
     PNGDecoder* that = static_cast<PNGDecoder*>(png_get_io_ptr(png));
     that->stream(buffer, size);
@@ -560,13 +677,24 @@ EXRDecoder::~EXRDecoder() = default;
 
 LinearImage EXRDecoder::decode() {
     try {
-        // copy the EXR data in memory
+        // copy the EXR data in memory, with a single read when the size of the stream is known
         std::vector<unsigned char> src;
-        unsigned char buffer[4096];
-        while (mStream.read(reinterpret_cast<char*>(buffer), sizeof(buffer))) {
-            src.insert(src.end(), &buffer[0], &buffer[4096]);
+        mStream.seekg(0, std::istream::end);
+        const std::streampos end = mStream.tellg();
+        mStream.seekg(mStreamStartPos);
+        if (mStreamStartPos >= 0 && end > mStreamStartPos) {
+            src.resize(size_t(end - mStreamStartPos));
+            mStream.read(reinterpret_cast<char*>(src.data()), src.size());
+            src.resize(size_t(mStream.gcount()));
+        } else {
+            mStream.clear();
+            mStream.seekg(mStreamStartPos);
+            unsigned char buffer[4096];
+            while (mStream.read(reinterpret_cast<char*>(buffer), sizeof(buffer))) {
+                src.insert(src.end(), &buffer[0], &buffer[4096]);
+            }
+            src.insert(src.end(), &buffer[0], &buffer[mStream.gcount()]);
         }
-        src.insert(src.end(), &buffer[0], &buffer[mStream.gcount()]);
 
         int width;
         int height;
@@ -26,6 +26,16 @@
 
 namespace image {
 
+static utils::Path getHeatmapPath(const utils::Path& golden) {
+    return golden.getParent() + (golden.getNameWithoutExtension() + "_diff.png");
+}
+
+static void saveHeatmap(const LinearImage& heatmap, const utils::Path& golden) {
+    utils::Path path = getHeatmapPath(golden);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    ImageEncoder::encode(out, ImageEncoder::Format::PNG_LINEAR, heatmap, "", path);
+}
+
 // TODO: Remove special treatment of 1-channel data.
 void updateOrCompare(LinearImage limgResult, const utils::Path& fnameGolden,
         ComparisonMode mode, float epsilon) {
@@ -66,8 +76,47 @@ void updateOrCompare(LinearImage limgResult, const utils::Path& fnameGolden,
         limgResult = combineChannels({limgResult, limgResult, limgResult});
     }
 
-    // Perform a simple comparison of the two images.
-    ASSERT_PRECONDITION(compare(limgResult, limgGolden, epsilon) == 0, "Image mismatch.");
+    // Perform a simple comparison of the two images, only pay for the heatmap on failure.
+    bool matches = compare(limgResult, limgGolden, epsilon) == 0;
+    if (!matches && limgResult.getWidth() == limgGolden.getWidth() &&
+            limgResult.getHeight() == limgGolden.getHeight() &&
+            limgResult.getChannels() == limgGolden.getChannels()) {
+        saveHeatmap(diffHeatmap(limgResult, limgGolden), fnameGolden);
+    }
+    ASSERT_PRECONDITION(matches, "Image mismatch.");
+}
+
+void updateOrCompare(uint8_t const* result, uint32_t width, uint32_t height, uint32_t channels,
+        const utils::Path& fnameGolden, ComparisonMode mode, uint8_t epsilon, size_t maxFailures,
+        utils::JobSystem* js) {
+    ASSERT_PRECONDITION(channels == 3 || channels == 4, "Only RGB8 and RGBA8 are supported.");
+    if (mode == ComparisonMode::SKIP) {
+        return;
+    }
+
+    // Regenerate the PNG file at the given path, the 8-bit data is stored as it is.
+    if (mode == ComparisonMode::UPDATE) {
+        std::ofstream out(fnameGolden, std::ios::binary | std::ios::trunc);
+        ImageEncoder::encodePNG8(out, result, width, height, channels);
+        return;
+    }
+
+    std::ifstream in(fnameGolden, std::ios::binary);
+    ASSERT_PRECONDITION(in, "Unable to open: %s", fnameGolden.c_str());
+    uint32_t goldenWidth = 0;
+    uint32_t goldenHeight = 0;
+    auto golden = ImageDecoder::decodePNG8(in, channels, &goldenWidth, &goldenHeight);
+    ASSERT_PRECONDITION(golden, "Unable to decode: %s", fnameGolden.c_str());
+    ASSERT_PRECONDITION(goldenWidth == width && goldenHeight == height,
+            "Image size mismatch: %ux%u, expected %ux%u.", width, height,
+            goldenWidth, goldenHeight);
+
+    size_t failures = countDifferences(result, golden.get(), width, height, channels, epsilon,
+            maxFailures, js);
+    if (failures > maxFailures) {
+        saveHeatmap(diffHeatmap(result, golden.get(), width, height, channels), fnameGolden);
+    }
+    ASSERT_PRECONDITION(failures <= maxFailures, "Image mismatch.");
 }
 
 }
@@ -67,6 +67,10 @@ private:
     // ImageEncoder::Encoder interface
     virtual bool encode(const LinearImage& image) override;
 
+    bool encode8(uint8_t const* data, uint32_t width, uint32_t height, uint32_t channels);
+
+    friend class ImageEncoder;
+
     int chooseColorType(const LinearImage& image) const;
     uint32_t getChannelsCount() const;
 
@@ -217,6 +221,13 @@ bool ImageEncoder::encode(std::ostream& stream, Format format, const LinearImage
     return encoder->encode(image);
 }
 
+bool ImageEncoder::encodePNG8(std::ostream& stream, uint8_t const* data,
+        uint32_t width, uint32_t height, uint32_t channels) {
+    PNGEncoder* encoder = PNGEncoder::create(stream);
+    std::unique_ptr<Encoder> owner(encoder);
+    return encoder->encode8(data, width, height, channels);
+}
+
 ImageEncoder::Format ImageEncoder::chooseFormat(const std::string& name, bool forceLinear) {
     std::string ext;
     size_t index = name.rfind(".");
@@ -372,6 +383,38 @@ bool PNGEncoder::encode(const LinearImage& image) {
     return true;
 }
 
+bool PNGEncoder::encode8(uint8_t const* data, uint32_t width, uint32_t height,
+        uint32_t channels) {
+    if (channels != 3 && channels != 4) {
+        std::cerr << "Cannot encode PNG: " << channels << " channels." << std::endl;
+        return false;
+    }
+
+    try {
+        mInfo = png_create_info_struct(mPNG);
+
+        png_set_IHDR(mPNG, mInfo, width, height,
+              8, channels == 4 ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+              PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+        png_write_info(mPNG, mInfo);
+
+        std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
+        for (size_t y = 0; y < height; y++) {
+            row_pointers[y] = const_cast<png_bytep>(data + y * width * channels);
+        }
+
+        png_write_image(mPNG, row_pointers.get());
+        png_write_end(mPNG, mInfo);
+        mStream.flush();
+    } catch (std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while encoding PNG: " << e.what() << std::endl;
+        mStream.seekp(mStreamStartPos);
+        return false;
+    }
+    return true;
+}
+
 void PNGEncoder::cb_stream(png_structp png, png_bytep buffer, png_size_t size) {
     PNGEncoder* that = static_cast<PNGEncoder*>(png_get_io_ptr(png));
     that->stream(buffer, size);
@@ -27,6 +27,14 @@
 #include <sys/types.h>
 #include <limits>
 
+#if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define MATH_MAT4_HAS_NEON 1
+#elif defined(__SSE__)
+#   include <xmmintrin.h>
+#   define MATH_MAT4_HAS_SSE 1
+#endif
+
 #define PURE __attribute__((pure))
 
 namespace math {
@@ -587,6 +595,77 @@ operator *(U lhs, const TMat44<T>& rhs) {
 
 // ----------------------------------------------------------------------------------------
 
+#if defined(MATH_MAT4_HAS_NEON) || defined(MATH_MAT4_HAS_SSE)
+
+/* SIMD specializations of the float products above, which are used to transform every
+ * renderable every frame. These overloads are picked over the templates, but they're not
+ * constexpr.
+ */
+
+namespace simd {
+
+#if defined(MATH_MAT4_HAS_NEON)
+
+using float4 = float32x4_t;
+
+inline float4 load(float const* p) noexcept { return vld1q_f32(p); }
+
+inline void store(float* p, float4 v) noexcept { vst1q_f32(p, v); }
+
+// c0 * v.x + c1 * v.y + c2 * v.z + c3 * v.w
+inline float4 transform(float4 c0, float4 c1, float4 c2, float4 c3, float4 v) noexcept {
+    float4 r = vmulq_n_f32(c0, vgetq_lane_f32(v, 0));
+    r = vmlaq_n_f32(r, c1, vgetq_lane_f32(v, 1));
+    r = vmlaq_n_f32(r, c2, vgetq_lane_f32(v, 2));
+    return vmlaq_n_f32(r, c3, vgetq_lane_f32(v, 3));
+}
+
+#else
+
+using float4 = __m128;
+
+inline float4 load(float const* p) noexcept { return _mm_loadu_ps(p); }
+
+inline void store(float* p, float4 v) noexcept { _mm_storeu_ps(p, v); }
+
+// c0 * v.x + c1 * v.y + c2 * v.z + c3 * v.w
+inline float4 transform(float4 c0, float4 c1, float4 c2, float4 c3, float4 v) noexcept {
+    float4 r = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+    return _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+}
+
+#endif
+
+} // namespace simd
+
+// mat4f * float4
+inline TVec4<float> PURE operator *(const TMat44<float>& lhs, const TVec4<float>& rhs) noexcept {
+    TVec4<float> result;
+    simd::store(&result.x, simd::transform(
+            simd::load(&lhs[0].x), simd::load(&lhs[1].x),
+            simd::load(&lhs[2].x), simd::load(&lhs[3].x), simd::load(&rhs.x)));
+    return result;
+}
+
+// mat4f * mat4f, the columns of lhs are loaded once
+inline TMat44<float> PURE operator *(const TMat44<float>& lhs, const TMat44<float>& rhs) noexcept {
+    const simd::float4 c0 = simd::load(&lhs[0].x);
+    const simd::float4 c1 = simd::load(&lhs[1].x);
+    const simd::float4 c2 = simd::load(&lhs[2].x);
+    const simd::float4 c3 = simd::load(&lhs[3].x);
+    TMat44<float> result(TMat44<float>::NO_INIT);
+    for (size_t col = 0; col < TMat44<float>::NUM_COLS; ++col) {
+        simd::store(&result[col].x, simd::transform(c0, c1, c2, c3, simd::load(&rhs[col].x)));
+    }
+    return result;
+}
+
+#endif
+
+// ----------------------------------------------------------------------------------------
+
 /* FIXME: this should go into TMatSquareFunctions<> but for some reason
  * BASE<T>::col_type is not accessible from there (???)
  */
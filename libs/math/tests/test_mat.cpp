@@ -160,6 +160,34 @@ TEST_F(MatTest, ElementAccess) {
     EXPECT_FLOAT_EQ(m(3, 2), 100);
 }
 
+TEST_F(MatTest, FloatProducts) {
+    // the float products may be specialized, they must match the double ones
+    mat4 m1(double4(1, 2, 3, 4), double4(5, 6, 7, 8), double4(9, 10, 11, 12), double4(13, 14, 15, 16));
+    mat4 m2(mat4::translate(double3(1, -2, 3)) * mat4::scale(double3(2, 3, 4)));
+    mat4f m1f(m1);
+    mat4f m2f(m2);
+
+    mat4 p(m1 * m2);
+    mat4f pf(m1f * m2f);
+    for (size_t c=0 ; c<4 ; c++) {
+        for (size_t r=0 ; r<4 ; r++) {
+            EXPECT_FLOAT_EQ(p[c][r], pf[c][r]);
+        }
+    }
+
+    m1f *= m2f;
+    EXPECT_EQ(pf, m1f);
+
+    double4 v(m1 * double4(1, -2, 3, -4));
+    float4 vf(mat4f(m1) * float4(1, -2, 3, -4));
+    for (size_t i=0 ; i<4 ; i++) {
+        EXPECT_FLOAT_EQ(v[i], vf[i]);
+    }
+
+    float4 tf(m2f * float3(1, 2, 3));
+    EXPECT_EQ(float4(3, 4, 15, 1), tf);
+}
+
 //------------------------------------------------------------------------------
 // MAT 3
 //------------------------------------------------------------------------------
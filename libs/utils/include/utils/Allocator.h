@@ -168,6 +168,102 @@ public:
     void swap(HeapAllocator& rhs) noexcept { }
 };
 
+/* ------------------------------------------------------------------------------------------------
+ * TlsfAllocator
+ *
+ * + Two-Level Segregated Fit allocator, O(1) alloc() and free()
+ * + allocates from its area, adds pools from the heap when the area is exhausted
+ * + good-fit, immediate coalescing, bounded fragmentation
+ * + each allocation is labeled with the current tag, see setTag()
+ * + not thread-safe
+ * ------------------------------------------------------------------------------------------------
+ */
+class TlsfAllocator {
+public:
+    static constexpr size_t TAG_COUNT = 16;
+
+    struct Stats {
+        size_t poolSize;                    // size of all the pools, including the area
+        size_t poolCount;                   // number of pools
+        size_t used;                        // bytes currently allocated (incl. rounding)
+        size_t highWatermark;               // maximum of used
+        size_t tagUsed[TAG_COUNT];          // bytes currently allocated, per tag
+        size_t tagHighWatermark[TAG_COUNT]; // maximum of tagUsed, per tag
+    };
+
+    TlsfAllocator() noexcept = default;
+
+    // growSize is the minimum size of the pools added when the area is full, 0 uses the size
+    // of the area.
+    TlsfAllocator(void* begin, void* end, size_t growSize = 0) noexcept;
+
+    template <typename AREA>
+    explicit TlsfAllocator(const AREA& area, size_t growSize = 0) noexcept
+            : TlsfAllocator(area.begin(), area.end(), growSize) {
+    }
+
+    ~TlsfAllocator() noexcept;
+
+    // our allocator concept
+    void* alloc(size_t size, size_t alignment = alignof(std::max_align_t), size_t extra = 0) noexcept;
+
+    void free(void* p) noexcept;
+
+    void free(void* p, size_t) noexcept { free(p); }
+
+    // Allocators can't be copied
+    TlsfAllocator(const TlsfAllocator& rhs) = delete;
+    TlsfAllocator& operator=(const TlsfAllocator& rhs) = delete;
+
+    // Allocators can be moved
+    TlsfAllocator(TlsfAllocator&& rhs) noexcept;
+    TlsfAllocator& operator=(TlsfAllocator&& rhs) noexcept;
+
+    void swap(TlsfAllocator& rhs) noexcept;
+
+    // API specific to this allocator
+
+    // actual size of an allocation, this is reported to the arena's TrackingPolicy
+    static size_t getAllocationSize(void const* p) noexcept;
+
+    // tag new allocations with the given tag (< TAG_COUNT), returns the previous tag
+    uint8_t setTag(uint8_t tag) noexcept {
+        assert(tag < TAG_COUNT);
+        uint8_t previous = mTag;
+        mTag = tag;
+        return previous;
+    }
+
+    Stats const& getStats() const noexcept { return mStats; }
+
+private:
+    static constexpr size_t ALIGN_SHIFT = 4;
+    static constexpr size_t ALIGN = 1u << ALIGN_SHIFT;
+    static constexpr size_t SL_SHIFT = 4;                           // 16 second level lists
+    static constexpr size_t SL_COUNT = 1u << SL_SHIFT;
+    static constexpr size_t FL_SHIFT = SL_SHIFT + ALIGN_SHIFT;      // first level of large blocks
+    static constexpr size_t SMALL_BLOCK_SIZE = 1u << FL_SHIFT;
+    static constexpr size_t FL_COUNT = 32 - FL_SHIFT + 1;           // block sizes are 32 bits
+
+    struct Block;
+    struct Pool;
+
+    void addPool(void* begin, void* end) noexcept;
+    void* grow(size_t size) noexcept;
+    Block* findFreeBlock(size_t size) noexcept;
+    void insertFreeBlock(Block* block) noexcept;
+    void removeFreeBlock(Block* block) noexcept;
+    Block* split(Block* block, size_t size) noexcept;
+
+    uint32_t mFlBitmap = 0;
+    uint32_t mSlBitmap[FL_COUNT] = {};
+    Block* mFreeBlocks[FL_COUNT][SL_COUNT] = {};
+    Pool* mPools = nullptr;         // pools we allocated, the area isn't one of them
+    size_t mGrowSize = 0;
+    uint8_t mTag = 0;
+    Stats mStats = {};
+};
+
 // ------------------------------------------------------------------------------------------------
 
 class FreeListBase {
@@ -420,6 +516,8 @@ struct Untracked {
     void onFree(void* p, size_t = 0) noexcept { }
     void onReset() noexcept { }
     void onRewind(void* addr) noexcept { }
+    size_t getCurrent() const noexcept { return 0; }
+    size_t getHighWatermark() const noexcept { return 0; }
 };
 
 // This high watermark tracker works only with allocator that either implement
@@ -438,6 +536,8 @@ struct HighWatermark {
     void onFree(void* p, size_t size) noexcept { mCurrent -= uint32_t(size); }
     void onReset() noexcept {  mCurrent = 0; }
     void onRewind(void const* addr) noexcept { mCurrent = uint32_t(uintptr_t(addr) - uintptr_t(mBase)); }
+    size_t getCurrent() const noexcept { return mCurrent; }
+    size_t getHighWatermark() const noexcept { return mHighWaterMark; }
 
 private:
     const char* mName = nullptr;
@@ -474,7 +574,7 @@ public:
     void* alloc(size_t size, size_t alignment = alignof(std::max_align_t), size_t extra = 0) noexcept {
         std::lock_guard<LockingPolicy> guard(mLock);
         void* p = mAllocator.alloc(size, alignment, extra);
-        mListener.onAlloc(p, size, alignment, extra);
+        mListener.onAlloc(p, getAllocationSize<AllocatorPolicy>(p, size, 0), alignment, extra);
         return p;
     }
 
@@ -493,7 +593,7 @@ public:
     void free(void* p) noexcept {
         if (p) {
             std::lock_guard<LockingPolicy> guard(mLock);
-            mListener.onFree(p);
+            trackFree<AllocatorPolicy>(p, 0);
             mAllocator.free(p);
         }
     }
@@ -564,6 +664,29 @@ public:
     Arena& operator=(Arena const& rhs) noexcept = delete;
 
 private:
+    // allocators that know the size of their allocations (e.g. TlsfAllocator) report it to
+    // the TrackingPolicy, which then works with free(void*).
+    template<typename A>
+    auto getAllocationSize(void* p, size_t, int) const noexcept
+            -> decltype(A::getAllocationSize(p)) {
+        return p ? A::getAllocationSize(p) : 0;
+    }
+
+    template<typename A>
+    size_t getAllocationSize(void*, size_t size, long) const noexcept {
+        return size;
+    }
+
+    template<typename A>
+    auto trackFree(void* p, int) noexcept -> decltype(A::getAllocationSize(p), void()) {
+        mListener.onFree(p, A::getAllocationSize(p));
+    }
+
+    template<typename A>
+    void trackFree(void* p, long) noexcept {
+        mListener.onFree(p);
+    }
+
     HeapArea mArea; // We might want to make that a template parameter too eventually.
     AllocatorPolicy mAllocator;
     LockingPolicy mLock;
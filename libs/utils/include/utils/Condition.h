@@ -17,8 +17,12 @@
 #ifndef UTILS_CONDITION_H
 #define UTILS_CONDITION_H
 
-#if defined(__linux__)
-#include <utils/linux/Condition.h>
+#include <utils/Futex.h>
+
+#if UTILS_HAS_FUTEX
+#include <utils/futex/Condition.h>
+#elif defined(__APPLE__)
+#include <utils/darwin/Condition.h>
 #else
 #include <utils/generic/Condition.h>
 #endif
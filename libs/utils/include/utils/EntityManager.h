@@ -20,6 +20,8 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <atomic>
+
 #include <utils/Entity.h>
 
 namespace utils {
@@ -65,12 +67,26 @@ public:
     }
 
     // return whether the given Entity has been destroyed (false) or not (true).
-    // Thread safe.
+    // Thread safe, lock-free.
     bool isAlive(Entity e) const noexcept {
         assert(getIndex(e) < RAW_INDEX_COUNT);
-        return (!e.isNull()) && (getGeneration(e) == mGens[getIndex(e)]);
+        return (!e.isNull()) &&
+                (getGeneration(e) == mGens[getIndex(e)].load(std::memory_order_relaxed));
     }
 
+    // position in the list of destroyed entities, see getDestroyedEntities()
+    using Cursor = uint64_t;
+
+    // Copies up to 'count' of the entities destroyed after 'cursor' into 'entities', advances
+    // 'cursor' past them and returns how many were copied; a cursor initialized to 0 starts
+    // with the oldest entities the list has. This lets component managers find their dead
+    // components incrementally.
+    // Only the most recently destroyed entities are kept, if some were dropped since 'cursor'
+    // (or clear() was called), 'lost' is set to true, the cursor jumps to the end of the list
+    // and the caller must check all its entities with isAlive() instead. Thread safe.
+    size_t getDestroyedEntities(Cursor& cursor, Entity* entities, size_t count,
+            bool& lost) const noexcept;
+
     // registers a listener to be called when an entity is destroyed. thread safe.
     // if the listener is already register, this method has no effect.
     void registerListener(Listener* l) noexcept;
@@ -87,7 +103,7 @@ public:
 
     // current generation of the given index. Use for debugging and testing.
     uint8_t getGenerationForIndex(size_t index) const noexcept {
-        return mGens[index];
+        return mGens[index].load(std::memory_order_relaxed);
     }
     // singleton, can't be copied
     EntityManager(const EntityManager& rhs) = delete;
@@ -114,8 +130,9 @@ private:
         return (g << GENERATION_SHIFT) | (i & INDEX_MASK);
     }
 
-    // stores the generation of each index.
-    uint8_t * const mGens;
+    // stores the generation of each index, these are atomic so that isAlive() doesn't need
+    // to take a lock while entities are destroyed.
+    std::atomic<uint8_t>* const mGens;
 };
 
 } // namespace utils
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTILS_FUTEX_H
+#define UTILS_FUTEX_H
+
+#include <atomic>
+
+#include <stdint.h>
+
+// Platforms that can block a thread on the value of a 32-bit word: futex() on Linux and Android,
+// WaitOnAddress() on Windows 8 and later.
+#if defined(__linux__) || defined(WIN32)
+#   define UTILS_HAS_FUTEX 1
+#else
+#   define UTILS_HAS_FUTEX 0
+#endif
+
+namespace utils {
+namespace futex {
+
+/*
+ * Number of times Mutex and Condition check their state before parking the thread in the OS.
+ * A lock is usually held and a condition signaled for a short time in this code base (e.g. by
+ * the JobSystem and the CommandBufferQueue), spinning a little avoids paying for a sleep and a
+ * wake-up, which cost several microseconds each. About 100ns per iteration.
+ */
+static constexpr uint32_t MUTEX_SPIN_COUNT = 64;
+static constexpr uint32_t CONDITION_SPIN_COUNT = 256;
+
+#if UTILS_HAS_FUTEX
+
+// Blocks the calling thread as long as *word == value, or until a wake(). May return spuriously.
+void wait(std::atomic<uint32_t>* word, uint32_t value) noexcept;
+
+// Wakes up at most count threads blocked in wait() on this word.
+void wake(std::atomic<uint32_t>* word, int count) noexcept;
+
+#endif
+
+} // namespace futex
+} // namespace utils
+
+#endif // UTILS_FUTEX_H
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_UTILS_JOBGRAPH_H
+#define TNT_UTILS_JOBGRAPH_H
+
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+#include <utils/JobSystem.h>
+
+namespace utils {
+
+/*
+ * A JobGraph is a set of tasks and of the dependencies between them, which runs on a JobSystem.
+ * A task starts as soon as all of its predecessors are done, without waiting for unrelated
+ * tasks, and tasks without predecessors start immediately. A graph is typically built once and
+ * run every frame.
+ *
+ *  JobGraph graph;
+ *  JobGraph::Task cull   = graph.add([&](JobSystem& js, JobSystem::Job* parent) { ... });
+ *  JobGraph::Task lights = graph.add([&](JobSystem& js, JobSystem::Job* parent) { ... });
+ *  graph.then({ cull, lights }, [&](JobSystem& js, JobSystem::Job* parent) { ... });
+ *  graph.runAndWait(js);
+ *
+ * Jobs created by a task as children of 'parent' are part of the task: its successors don't
+ * start until they're finished. The graph must be acyclic.
+ */
+class JobGraph {
+public:
+    using Task = uint32_t;
+    using TaskFunction = std::function<void(JobSystem&, JobSystem::Job*)>;
+
+    JobGraph() noexcept;
+    ~JobGraph() noexcept;
+
+    JobGraph(JobGraph const&) = delete;
+    JobGraph& operator=(JobGraph const&) = delete;
+
+    // adds a task to the graph
+    Task add(TaskFunction function);
+
+    // 'after' won't start before 'before' is done, a task can have any number of predecessors
+    void precede(Task before, Task after);
+
+    // adds a continuation, i.e. a task that starts when 'before' is done
+    Task then(Task before, TaskFunction function) {
+        Task task = add(std::move(function));
+        precede(before, task);
+        return task;
+    }
+
+    // adds a task that starts when all the tasks in 'before' are done
+    Task then(std::initializer_list<Task> before, TaskFunction function) {
+        Task task = add(std::move(function));
+        for (Task t : before) {
+            precede(t, task);
+        }
+        return task;
+    }
+
+    size_t getTaskCount() const noexcept { return mTasks.size(); }
+
+    // removes all tasks, the graph must not be running
+    void clear() noexcept;
+
+    // Class of cores the tasks of this graph run on, see JobSystem::setCoreClass().
+    void setCoreClass(JobSystem::CoreClass coreClass) noexcept { mCoreClass = coreClass; }
+
+    // Starts the graph and returns a job that finishes with its last task, to be used with
+    // JobSystem::wait(). The graph can't be modified or run again until then. Returns nullptr
+    // if the JobSystem is out of jobs, in which case the graph already ran on this thread.
+    // Must be called from a thread owned by the JobSystem.
+    JobSystem::Job* run(JobSystem& js, JobSystem::Job* parent = nullptr);
+
+    void runAndWait(JobSystem& js) {
+        JobSystem::Job* job = run(js);
+        if (job) {
+            js.wait(job);
+        }
+    }
+
+private:
+    struct TaskInfo {
+        TaskFunction function;
+        std::vector<Task> successors;
+        uint32_t predecessorCount = 0;
+    };
+
+    bool isAcyclic() const noexcept;
+    void launch(JobSystem& js, Task task) noexcept;
+    void execute(JobSystem& js, JobSystem::Job* job, Task task) noexcept;
+    void launchSuccessors(JobSystem& js, Task task) noexcept;
+
+    std::vector<TaskInfo> mTasks;
+    // # of predecessors not finished yet, for each task of the running graph
+    std::unique_ptr<std::atomic<uint32_t>[]> mPendingCounts;
+    size_t mPendingCountsSize = 0;
+    JobSystem::Job* mRoot = nullptr;
+    JobSystem::CoreClass mCoreClass = JobSystem::CoreClass::ANY;
+};
+
+} // namespace utils
+
+#endif // TNT_UTILS_JOBGRAPH_H
@@ -19,8 +19,11 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
+#include <memory>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -44,10 +47,29 @@
 
 namespace utils {
 
+template<typename Allocator, typename ... Elements>
+class StructureOfArraysBase;
+
 class JobSystem {
-    static constexpr size_t MAX_JOB_COUNT = 4096;
-    static_assert(MAX_JOB_COUNT <= 0x7FFE, "MAX_JOB_COUNT must be <= 0x7FFE");
-    using WorkQueue = WorkStealingDequeue<uint16_t, MAX_JOB_COUNT>;
+    // Jobs are allocated in segments of JOBS_PER_SEGMENT jobs (the first slot of each segment
+    // is reserved), new segments are added as needed, up to MAX_SEGMENT_COUNT.
+    static constexpr size_t SEGMENT_SHIFT = 12;
+    static constexpr size_t JOBS_PER_SEGMENT = 1u << SEGMENT_SHIFT;
+    static constexpr size_t MAX_SEGMENT_COUNT = 256;
+    static constexpr size_t MAX_JOB_COUNT = JOBS_PER_SEGMENT * MAX_SEGMENT_COUNT;
+    static_assert(MAX_JOB_COUNT < 0x7FFFFFFF, "MAX_JOB_COUNT must be < 0x7FFFFFFF");
+
+    // jobs are moved between the per-thread and the global free lists in chunks of this size
+    static constexpr size_t FREE_LIST_CHUNK_SIZE = 64;
+
+    // when a thread's work queue is full, jobs are run immediately instead
+    static constexpr size_t WORK_QUEUE_SIZE = 4096;
+    using WorkQueue = WorkStealingDequeue<uint32_t, WORK_QUEUE_SIZE>;
+
+    // an idle thread looks for new jobs this many times before going to sleep on mCondition: the
+    // jobs of a frame come in bursts (e.g. consecutive parallel_for) and the wake-up latency
+    // would dominate the short ones
+    static constexpr uint32_t IDLE_SPIN_COUNT = 1024;
 
 public:
     class Job;
@@ -64,10 +86,13 @@ public:
         void const* getData() const { return padding; }
     private:
         friend class JobSystem;
-        JobFunc function;
-        uint16_t parent;
-        std::atomic<uint16_t> runningJobCount = { 0 };
-        // on 64-bits systems, there is an extra 32-bits lost here
+        union {
+            JobFunc function;
+            uint32_t nextFree;          // next job in the free list, when this one isn't used
+        };
+        uint32_t parent : 31;
+        uint32_t bigCoresOnly : 1;      // CoreClass::BIG, inherited by children
+        std::atomic<uint32_t> runningJobCount = { 0 };
         void* padding[JOB_PADDING];
     };
 
@@ -76,7 +101,12 @@ public:
             (CACHELINE_SIZE % sizeof(Job) == 0),
             "A Job must be N cache-lines long or N Jobs must fit in a cache line exactly.");
 
-    explicit JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1) noexcept;
+    static_assert(!(sizeof(Job) & (sizeof(Job) - 1)), "sizeof(Job) must be a power of two");
+
+    // bigThreadCount is the number of worker threads allowed to run CoreClass::BIG jobs, by
+    // default (0) it's derived from the core classes of the CPU, see getCoreClasses().
+    explicit JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1,
+            size_t bigThreadCount = 0) noexcept;
 
     ~JobSystem();
 
@@ -232,10 +262,32 @@ public:
         wait(job);
     }
 
+    // Runs the job once all its children are done, instead of waiting for them: the job is the
+    // continuation of its children. The calling thread doesn't block and picks up other work,
+    // and the waits don't nest when jobs spawn jobs. All the children must be created before
+    // this call, they can be run before or after it.
+    // Current thread must be owned by JobSystem's thread pool. See adopt().
+    void runAfterChildren(Job* job) noexcept;
+
     // jobs are normally finished automatically, this can be used to cancel a job
     // before it is run.
     void finish(Job* job) noexcept;
 
+    // Class of CPU cores a job is allowed to run on. On heterogeneous CPUs (e.g. big.LITTLE),
+    // worker threads are pinned to either the high or the low capacity cores.
+    enum class CoreClass : uint8_t {
+        ANY,    // the job can run on any thread
+        BIG     // latency-critical job, only runs on high capacity cores and adopted threads
+    };
+
+    // Sets the class of cores a job can run on, this must be called before run().
+    // Jobs created as children of this job inherit its class.
+    Job* setCoreClass(Job* job, CoreClass coreClass) noexcept {
+        assert(job);
+        job->bigCoresOnly = (coreClass == CoreClass::BIG);
+        return job;
+    }
+
     // for debugging
     friend utils::io::ostream& operator << (utils::io::ostream& out, JobSystem const& js);
 
@@ -254,10 +306,79 @@ public:
     static void setThreadPriority(Priority priority) noexcept;
     static void setThreadAffinity(uint32_t mask) noexcept;
 
+    // Returns the CPUs (as a bit mask) with a high and a low capacity, respectively. On
+    // homogeneous CPUs, or when this can't be determined, all CPUs are considered "big".
+    static void getCoreClasses(uint32_t* bigCores, uint32_t* littleCores) noexcept;
+
     size_t getParallelSplitCount() const noexcept {
         return mParallelSplitCount;
     }
 
+    // number of worker threads that can run CoreClass::BIG jobs (not counting adopted threads)
+    size_t getBigThreadCount() const noexcept {
+        return mBigThreadCount;
+    }
+
+    // maximum number of threads running jobs, including adopted threads: the upper bound of
+    // getThreadIndex()
+    size_t getMaxThreadCount() const noexcept {
+        return mThreadStates.size();
+    }
+
+    // Index of the calling thread, between 0 and getMaxThreadCount(). Jobs can use it to
+    // access per-thread data without synchronization. The calling thread must be owned or
+    // adopted by this JobSystem.
+    size_t getThreadIndex() const noexcept;
+
+    // --------------------------------------------------------------------------------------------
+    // Instrumentation
+
+    // Counters of a thread of the pool, see getThreadStats(). Times are in nanoseconds.
+    struct ThreadStats {
+        uint64_t jobCount;          // # of jobs executed
+        uint64_t stealAttempts;     // # of times the thread looked for a job in another queue
+        uint64_t stealCount;        // # of jobs actually stolen
+        uint64_t busyTime;          // time spent executing jobs (excluding nested waits)
+        uint64_t idleTime;          // time spent in wait() with nothing to execute
+        uint64_t sleepTime;         // time spent sleeping, waiting for jobs to be queued
+        bool big;                   // the thread can run CoreClass::BIG jobs
+        bool adopted;               // this is an adoptable thread's slot
+    };
+
+    // A job executed by a thread of the pool. Times are in nanoseconds, on the steady clock.
+    struct JobEvent {
+        uint64_t begin;
+        uint64_t end;
+        uint32_t thread;            // index of the thread in getThreadStats()
+        uint32_t job;               // index of the job (indices are reused)
+    };
+
+    // number of JobEvents kept per thread, older events are overwritten
+    static constexpr size_t TIMELINE_SIZE = 4096;
+
+    // Instrumentation is disabled by default. When enabled, each thread updates its
+    // ThreadStats and records a JobEvent for each job it executes. This has a small cost
+    // per job and allocates the timelines the first time it's enabled.
+    // This must not be called concurrently with itself or resetInstrumentation().
+    void setInstrumentationEnabled(bool enabled) noexcept;
+
+    bool isInstrumentationEnabled() const noexcept {
+        return mInstrumentation.load(std::memory_order_acquire);
+    }
+
+    // Clears all counters and timelines, this should be called while no jobs are running.
+    void resetInstrumentation() noexcept;
+
+    // Returns the counters of all the threads (including the adoptable slots).
+    std::vector<ThreadStats> getThreadStats() const noexcept;
+
+    // Returns the last TIMELINE_SIZE events of each thread, sorted by begin time.
+    // This should be called while no jobs are running, otherwise some events may be torn.
+    std::vector<JobEvent> getJobTimeline() const noexcept;
+
+    // Returns getJobTimeline() as a chrome://tracing (Trace Event Format) JSON document.
+    std::string getChromeTrace() const;
+
 private:
     // this is just to avoid using std::default_random_engine, since we're in a public header.
     class default_random_engine {
@@ -275,6 +396,8 @@ private:
     struct alignas(CACHELINE_SIZE) ThreadState {    // this causes 40-bytes padding
         // make sure storage is cache-line aligned
         WorkQueue workQueue;
+        WorkQueue bigWorkQueue;     // CoreClass::BIG jobs
+
 
         // these are not accessed by the worker threads
         alignas(CACHELINE_SIZE)     // this causes 56-bytes padding
@@ -282,6 +405,20 @@ private:
         std::thread thread;
         default_random_engine rndGen;
         uint32_t mask;
+        bool big;                   // can run CoreClass::BIG jobs
+        uint32_t freeList;          // index of the first job of our free list
+        uint32_t freeCount;         // # of jobs in our free list
+
+        // instrumentation, only written by the thread owning this state (and reset)
+        alignas(CACHELINE_SIZE)
+        std::atomic<uint64_t> jobCount = { 0 };
+        std::atomic<uint64_t> stealAttempts = { 0 };
+        std::atomic<uint64_t> stealCount = { 0 };
+        std::atomic<uint64_t> busyTime = { 0 };
+        std::atomic<uint64_t> idleTime = { 0 };
+        std::atomic<uint64_t> sleepTime = { 0 };
+        std::atomic<uint32_t> eventCount = { 0 };   // # of events recorded, wraps around
+        std::unique_ptr<JobEvent[]> timeline;       // TIMELINE_SIZE events, or nullptr
     };
 
     static_assert(sizeof(ThreadState) % CACHELINE_SIZE == 0,
@@ -290,7 +427,11 @@ private:
     static ThreadState& getState() noexcept;
 
     Job* create(Job* parent, JobFunc func) noexcept;
-    Job* allocateJob() noexcept;
+    Job* allocateJob(ThreadState& state) noexcept;
+    void freeJob(ThreadState& state, Job* job) noexcept;
+    bool refillFreeList(ThreadState& state) noexcept;
+    void releaseFreeList(ThreadState& state) noexcept;
+    bool addSegment() noexcept;
     JobSystem::ThreadState& getStateToStealFrom(JobSystem::ThreadState& state) noexcept;
     bool hasJobCompleted(Job const* job) noexcept;
 
@@ -298,31 +439,53 @@ private:
     bool exitRequested() const noexcept;
 
     void loop(ThreadState* threadState) noexcept;
+    // true if there are jobs this thread can run, or the exit was requested
+    bool spin(JobSystem::ThreadState const& state) const noexcept;
     bool execute(JobSystem::ThreadState& state) noexcept;
+    inline bool hasRunnableJobs(JobSystem::ThreadState const& state) const noexcept;
+    void call(JobSystem::ThreadState& state, Job* job) noexcept;
+    void callInstrumented(JobSystem::ThreadState& state, Job* job) noexcept;
+
+    static constexpr uint32_t NULL_INDEX = 0x7FFFFFFF;
+    // set in the running job count of a job waiting for its children, see runAfterChildren()
+    static constexpr uint32_t DEFERRED = 0x40000000;
+    static constexpr size_t SEGMENT_SIZE = JOBS_PER_SEGMENT * sizeof(Job);
+
+    Job* getJob(uint32_t index) const noexcept {
+        assert(index < MAX_JOB_COUNT && (index >> SEGMENT_SHIFT) < mSegmentCount);
+        return mSegments[index >> SEGMENT_SHIFT] + (index & (JOBS_PER_SEGMENT - 1));
+    }
+
+    static uint32_t getIndex(Job const* job) noexcept {
+        // segments are aligned to their size, and their first slot holds their index
+        const uintptr_t base = uintptr_t(job) & ~uintptr_t(SEGMENT_SIZE - 1);
+        const uint32_t segment = *reinterpret_cast<uint32_t const*>(base);
+        return uint32_t(segment << SEGMENT_SHIFT) | uint32_t((uintptr_t(job) - base) / sizeof(Job));
+    }
 
     void put(WorkQueue& workQueue, Job* job) noexcept {
-        size_t index = job - mJobStorageBase;
-        assert(index >= 0 && index < MAX_JOB_COUNT);
-        workQueue.push(uint16_t(index + 1));
+        workQueue.push(getIndex(job) + 1);
     }
 
     Job* pop(WorkQueue& workQueue) noexcept {
-        size_t index = workQueue.pop();
-        assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : (mJobStorageBase - 1) + index;
+        uint32_t index = workQueue.pop();
+        return !index ? nullptr : getJob(index - 1);
     }
 
     Job* steal(WorkQueue& workQueue) noexcept {
-        size_t index = workQueue.steal();
-        assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : (mJobStorageBase - 1) + index;
+        uint32_t index = workQueue.steal();
+        return !index ? nullptr : getJob(index - 1);
     }
 
     // these have thread contention, keep them together
     utils::Mutex mLock;
     utils::Condition mCondition;
-    std::atomic<uint32_t> mActiveJobs = { 0 };
-    utils::Arena<utils::ThreadSafeObjectPoolAllocator<Job>, LockingPolicy::NoLock> mJobPool;
+    std::atomic<uint32_t> mActiveJobs = { 0 };      // queued CoreClass::ANY jobs
+    std::atomic<uint32_t> mActiveBigJobs = { 0 };   // queued CoreClass::BIG jobs
+
+    // job storage, only accessed when a thread's free list is empty or too large
+    utils::Mutex mJobStorageLock;
+    std::vector<std::pair<uint32_t, uint32_t>> mFreeChunks;     // first index and count
 
     template <typename T>
     using aligned_vector = std::vector<T, utils::STLAlignedAllocator<T>>;
@@ -337,9 +500,15 @@ private:
     aligned_vector<ThreadState> mThreadStates;          // actual data is stored offline
     std::atomic<bool> mExitRequested = { 0 };           // this one is almost never written
     std::atomic<uint16_t> mAdoptedThreads = { 0 };      // this one is almost never written
-    Job* const mJobStorageBase;                         // Base for conversion to indices
+    std::atomic<bool> mInstrumentation = { false };     // this one is almost never written
+    uint64_t mEpoch = 0;                                // instrumentation start time
+    Job* mSegments[MAX_SEGMENT_COUNT] = {};             // job storage, grows as needed
+    uint32_t mSegmentCount = 0;                         // almost never written
     uint16_t mThreadCount = 0;                          // total # of threads in the pool
+    uint16_t mBigThreadCount = 0;                       // # of threads on high capacity cores
     uint8_t mParallelSplitCount = 0;                    // # of split allowable in parallel_for
+    uint32_t mBigCoreMask = 0;                          // affinity of "big" threads
+    uint32_t mLittleCoreMask = 0;                       // affinity of "little" threads, or 0
     Job* mMasterJob = nullptr;
 
     static UTILS_DECLARE_TLS(ThreadState *) sThreadState;
@@ -558,6 +727,31 @@ JobSystem::Job* parallel_for(JobSystem& js, JobSystem::Job* parent,
     return parallel_for(js, parent, slice.data(), slice.size(), functor, splitter, finish);
 }
 
+// parallel jobs over all the elements of a StructureOfArrays, the ranges given to the functor
+// start on a cache line in every array, so that jobs writing to their own range don't share
+// cache lines.
+template<typename A, typename ... E, typename S, typename F>
+JobSystem::Job* parallel_for(JobSystem& js, JobSystem::Job* parent,
+        StructureOfArraysBase<A, E...> const& soa, F functor, const S& splitter) noexcept {
+    // we split the ranges of getCacheLineGranularity() elements, the splitter sees elements
+    constexpr uint32_t granularity =
+            uint32_t(StructureOfArraysBase<A, E...>::getCacheLineGranularity());
+    struct Splitter {
+        S splitter;
+        bool split(size_t splits, size_t count) const noexcept {
+            return splitter.split(splits, count * granularity);
+        }
+    };
+    const uint32_t size = uint32_t(soa.size());
+    auto user = [size, f = std::move(functor)](uint32_t s, uint32_t c) {
+        const uint32_t start = s * granularity;
+        f(start, std::min(c * granularity, size - start));
+    };
+    using JobData = details::ParallelForJobData<Splitter, decltype(user)>;
+    JobData jobData(0, (size + granularity - 1) / granularity, 0, std::move(user),
+            Splitter{ splitter });
+    return js.createJob<JobData, &JobData::parallelWithJobs>(parent, std::move(jobData));
+}
 
 template <size_t COUNT, size_t MAX_SPLITS = 12>
 class CountSplitter {
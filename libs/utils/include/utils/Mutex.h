@@ -17,8 +17,12 @@
 #ifndef UTILS_MUTEX_H
 #define UTILS_MUTEX_H
 
-#if defined(__linux__)
-#include <utils/linux/Mutex.h>
+#include <utils/Futex.h>
+
+#if UTILS_HAS_FUTEX
+#include <utils/futex/Mutex.h>
+#elif defined(__APPLE__)
+#include <utils/darwin/Mutex.h>
 #else
 #include <utils/generic/Mutex.h>
 #endif
@@ -28,6 +28,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
 namespace utils {
 
 class EntityManager;
@@ -45,17 +47,6 @@ class EntityManager;
  */
 template <typename ... Elements>
 class SingleInstanceComponentManager {
-private:
-
-    // this is just to avoid using std::default_random_engine, since we're in a public header.
-    class default_random_engine {
-        uint32_t mState = 1u; // must be 0 < seed < 0x7fffffff
-    public:
-        inline uint32_t operator()() noexcept {
-            return mState = uint32_t((uint64_t(mState) * 48271u) % 0x7fffffffu);
-        }
-    };
-
 protected:
     static constexpr size_t ENTITY_INDEX = sizeof ... (Elements);
 
@@ -104,6 +95,12 @@ public:
         return getComponentCount() == 0;
     }
 
+    // returns a counter that changes every time a component is added, removed or moved, i.e.
+    // every time previously returned Instances may have been invalidated.
+    uint32_t getLayoutGeneration() const noexcept {
+        return mLayoutGeneration;
+    }
+
     // returns a pointer to the Entity array. This is basically the list
     // of entities this component manager handles.
     // The pointer becomes invalid when adding or removing a component.
@@ -125,9 +122,10 @@ public:
     inline Instance removeComponent(Entity e);
 
     // trigger one round of garbage collection. this is intended to be called on a regular
-    // basis. This gc gives up after it cannot randomly free 'ratio' component in a row.
-    void gc(const EntityManager& em, size_t ratio = 4) noexcept {
-        gc(em, ratio, [this](Entity e) {
+    // basis. This removes the components of the entities destroyed since the previous round,
+    // the ratio is not used anymore.
+    void gc(const EntityManager& em, size_t = 4) noexcept {
+        gc(em, [this](Entity e) {
                     removeComponent(e);
                 });
     }
@@ -227,27 +225,37 @@ protected:
             if (ej) {
                 map[ej] = j;
             }
+            mLayoutGeneration++;
         }
     }
 
     template<typename REMOVE>
-    void gc(const EntityManager& em, size_t ratio,
-            REMOVE removeComponent) noexcept {
-        Entity const* entities = getEntities();
-        size_t count = getComponentCount();
-        size_t aliveInARow = 0;
-        default_random_engine& rng = mRng;
-        #pragma nounroll
-        while (count && aliveInARow < ratio) {
-            // note: using the modulo favorizes lower number
-            size_t i = rng() % count;
-            if (UTILS_LIKELY(em.isAlive(entities[i]))) {
-                ++aliveInARow;
-                continue;
+    void gc(const EntityManager& em, REMOVE removeComponent) noexcept {
+        // consume the entities destroyed since the last time, this only costs a lookup per
+        // destroyed entity, regardless of how many components we have.
+        Entity destroyed[256];
+        bool lost = false;
+        size_t n;
+        while ((n = em.getDestroyedEntities(mDestroyedCursor, destroyed, 256, lost)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                if (hasComponent(destroyed[i])) {
+                    removeComponent(destroyed[i]);
+                }
+            }
+        }
+        if (UTILS_UNLIKELY(lost)) {
+            // too many entities were destroyed since the last time to know which, check
+            // them all. Removing components reorders them, so we find the dead ones first.
+            std::vector<Entity> dead;
+            Entity const* const entities = getEntities();
+            for (size_t i = 0, c = getComponentCount(); i < c; i++) {
+                if (!em.isAlive(entities[i])) {
+                    dead.push_back(entities[i]);
+                }
+            }
+            for (Entity e : dead) {
+                removeComponent(e);
             }
-            aliveInARow = 0;
-            count--;
-            removeComponent(entities[i]);
         }
     }
 
@@ -257,7 +265,9 @@ protected:
 private:
     // maps an entity to an instance index
     tsl::robin_map<Entity, Instance> mInstanceMap;
-    default_random_engine mRng;
+    // where this manager is in the EntityManager's list of destroyed entities
+    EntityManager::Cursor mDestroyedCursor = 0;
+    uint32_t mLayoutGeneration = 0;
 };
 
 // Keep these outside of the class because CLion has trouble parsing them
@@ -272,6 +282,7 @@ SingleInstanceComponentManager<Elements ...>::addComponent(Entity e) {
             // index 0 is used when the component doesn't exist
             ci = Instance(mData.size() - 1);
             mInstanceMap[e] = ci;
+            mLayoutGeneration++;
         } else {
             // if the entity already has this component, just return its instance
             ci = mInstanceMap[e];
@@ -303,6 +314,7 @@ SingleInstanceComponentManager<Elements ... >::removeComponent(Entity e) {
         }
         mData.pop_back();
         map.erase(pos);
+        mLayoutGeneration++;
         return last;
     }
     return 0;
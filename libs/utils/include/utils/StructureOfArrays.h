@@ -20,13 +20,16 @@
 #include <array>        // note: this is safe, see how std::array is used below (inline / private)
 #include <cstddef>
 #include <functional>
+#include <type_traits>
 #include <utility>
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <utils/Allocator.h>
+#include <utils/architecture.h>
 #include <utils/compiler.h>
 #include <utils/EntityInstance.h>
 #include <utils/Slice.h>
@@ -48,9 +51,30 @@ public:
     // Number of arrays
     static constexpr size_t getArrayCount() noexcept { return kArrayCount; }
 
+    // Each array starts on a cache line and its storage is padded to a whole number of cache
+    // lines, so SIMD loops can be written against data<I>() with aligned loads, and can read
+    // (but not write) past end<I>() up to the next multiple of COLUMN_ALIGNMENT bytes.
+    static constexpr size_t COLUMN_ALIGNMENT = CACHELINE_SIZE;
+
     // Size needed to store "size" array elements
     static size_t getNeededSize(size_t size) noexcept {
-        return getOffset(kArrayCount - 1, size) + sizeof(TypeAt<kArrayCount - 1>) * size;
+        return getOffset(kArrayCount - 1, size) +
+                alignUp(sizeof(TypeAt<kArrayCount - 1>) * size);
+    }
+
+    // Number of elements that span a whole number of cache lines in every array. Ranges of
+    // elements starting at multiples of this never share a cache line, see the
+    // jobs::parallel_for() overload taking a StructureOfArrays.
+    static constexpr size_t getCacheLineGranularity() noexcept {
+        const size_t sizes[] = { sizeof(Elements)... };
+        size_t granularity = 1;
+        for (size_t size : sizes) {
+            // the largest power of two dividing the size (COLUMN_ALIGNMENT is a power of two)
+            const size_t lowest = size & (~size + 1);
+            const size_t n = COLUMN_ALIGNMENT / (lowest < COLUMN_ALIGNMENT ? lowest : COLUMN_ALIGNMENT);
+            granularity = n > granularity ? n : granularity;
+        }
+        return granularity;
     }
 
     // --------------------------------------------------------------------------------------------
@@ -269,7 +293,7 @@ public:
         // capacity cannot change when optional storage is specified
         if (capacity >= mSize) {
             const size_t sizeNeeded = getNeededSize(capacity);
-            void* buffer = mAllocator.alloc(sizeNeeded);
+            void* buffer = mAllocator.alloc(sizeNeeded, COLUMN_ALIGNMENT);
 
             // move all the items (one array at a time) from the old allocation to the new
             // this also update the array pointers
@@ -309,6 +333,70 @@ public:
         resizeNoCheck(0);
     }
 
+    // replace the elements with copies of those of rhs, the arrays are only reallocated if they
+    // don't have enough capacity. Arrays of trivially copyable types are copied in bulk.
+    UTILS_NOINLINE
+    void assign(StructureOfArraysBase const& rhs) {
+        if (UTILS_UNLIKELY(this == &rhs)) {
+            return;
+        }
+        clear();
+        ensureCapacity(rhs.mSize);
+        const size_t size = rhs.mSize;
+        size_t index = 0;
+        forEach([&rhs, &index, size](auto p) {
+            using T = typename std::decay<decltype(*p)>::type;
+            T const* const UTILS_RESTRICT src = rhs.template getArray<T>(index++);
+            if (std::is_trivially_copyable<T>::value) {
+                if (size) {
+                    memcpy(p, src, size * sizeof(T));
+                }
+            } else {
+                for (size_t i = 0; i < size; i++) {
+                    new(p + i) T(src[i]);
+                }
+            }
+        });
+        mSize = size;
+    }
+
+    // insert 'count' elements constructed with their default constructor before 'index', the
+    // elements after are moved. Arrays of trivial types are moved and zero-initialized in bulk.
+    UTILS_NOINLINE
+    void insert(size_t index, size_t count) {
+        assert(index <= mSize);
+        if (UTILS_UNLIKELY(count == 0)) {
+            return;
+        }
+        ensureCapacity(mSize + count);
+        const size_t size = mSize;
+        forEach([index, count, size](auto p) {
+            using T = typename std::decay<decltype(*p)>::type;
+            if (isBulkConstructible<T>()) {
+                memmove(p + index + count, p + index, (size - index) * sizeof(T));
+                memset(p + index, 0, count * sizeof(T));
+            } else {
+                // move the elements after 'index', those landing past the end are constructed
+                for (size_t i = size; i-- > index;) {
+                    if (i + count >= size) {
+                        new(p + i + count) T(std::move(p[i]));
+                    } else {
+                        p[i + count] = std::move(p[i]);
+                    }
+                }
+                // the moved-from elements are reset, the others are constructed
+                for (size_t i = index; i < index + count; i++) {
+                    if (i < size) {
+                        p[i] = T();
+                    } else {
+                        new(p + i) T();
+                    }
+                }
+            }
+        });
+        mSize = size + count;
+    }
+
 
     inline void swap(size_t i, size_t j) noexcept {
         forEach([i, j](auto p) {
@@ -508,6 +596,19 @@ private:
         mSize = needed;
     }
 
+    // arrays of these types are constructed with memset() and moved with memcpy(), which is
+    // equivalent to value initialization and moving for them
+    template<typename T>
+    static constexpr bool isBulkConstructible() noexcept {
+        return std::is_trivially_default_constructible<T>::value &&
+               std::is_trivially_copyable<T>::value &&
+               std::is_trivially_destructible<T>::value;
+    }
+
+    static constexpr size_t alignUp(size_t size) noexcept {
+        return (size + COLUMN_ALIGNMENT - 1) & ~(COLUMN_ALIGNMENT - 1);
+    }
+
     // this calculate the offset adjusted for all data alignment of a given array
     static inline constexpr size_t getOffset(size_t index, size_t capacity) noexcept {
         auto offsets = getOffsets(capacity);
@@ -518,17 +619,13 @@ private:
         // compute the required size of each array
         const size_t sizes[] = { (sizeof(Elements) * capacity)... };
 
-        // we align each array to the same alignment guaranteed by malloc
-        const size_t align = alignof(std::max_align_t);
-
+        // each array starts on a cache line, see COLUMN_ALIGNMENT
         // hopefully most of this gets unrolled and inlined
         std::array<size_t, kArrayCount> offsets;
         offsets[0] = 0;
         #pragma unroll
         for (size_t i = 1; i < kArrayCount; i++) {
-            size_t unalignment = sizes[i - 1] % align;
-            size_t alignment = unalignment ? (align - unalignment) : 0;
-            offsets[i] = offsets[i - 1] + (sizes[i - 1] + alignment);
+            offsets[i] = offsets[i - 1] + alignUp(sizes[i - 1]);
         }
         return offsets;
     }
@@ -537,8 +634,12 @@ private:
         forEach([from, to](auto p) {
             using T = typename std::decay<decltype(*p)>::type;
             // note: scalar types like int/float get initialized to zero
-            for (size_t i = from; i < to; i++) {
-                new(p + i) T();
+            if (isBulkConstructible<T>()) {
+                memset(p + from, 0, (to - from) * sizeof(T));
+            } else {
+                for (size_t i = from; i < to; i++) {
+                    new(p + i) T();
+                }
             }
         });
     }
@@ -546,8 +647,10 @@ private:
     void destroy_each(size_t from, size_t to) noexcept {
         forEach([from, to](auto p) {
             using T = typename std::decay<decltype(*p)>::type;
-            for (size_t i = from; i < to; i++) {
-                p[i].~T();
+            if (!std::is_trivially_destructible<T>::value) {
+                for (size_t i = from; i < to; i++) {
+                    p[i].~T();
+                }
             }
         });
     }
@@ -597,6 +700,9 @@ private:
     Allocator mAllocator;
 };
 
+template<typename Allocator, typename... Elements>
+constexpr size_t StructureOfArraysBase<Allocator, Elements...>::COLUMN_ALIGNMENT;
+
 template<typename Allocator, typename... Elements>
 inline
 typename StructureOfArraysBase<Allocator, Elements...>::StructureRef&
@@ -222,15 +222,34 @@ private:
 #else // !ANDROID
 // ------------------------------------------------------------------------------------------------
 
-#define SYSTRACE_ENABLE()
-#define SYSTRACE_DISABLE()
+/*
+ * Without atrace, the events are recorded in-process by utils::TraceRecorder, while it's started.
+ */
+
+#include <utils/TraceRecorder.h>
+
+#ifndef SYSTRACE_TAG
+#define SYSTRACE_TAG (SYSTRACE_TAG_ALWAYS)
+#endif
+
+#define SYSTRACE_ENABLE() utils::TraceRecorder::enable(SYSTRACE_TAG)
+#define SYSTRACE_DISABLE() utils::TraceRecorder::disable(SYSTRACE_TAG)
+
+// there is no context needed here
 #define SYSTRACE_CONTEXT()
-#define SYSTRACE_NAME(name)
-#define SYSTRACE_CALL()
-#define SYSTRACE_ASYNC_BEGIN(name, cookie)
-#define SYSTRACE_ASYNC_END(name, cookie)
-#define SYSTRACE_VALUE32(name, val)
-#define SYSTRACE_VALUE64(name, val)
+
+#define SYSTRACE_NAME(name) utils::TraceRecorder::Scope ___tracer(SYSTRACE_TAG, name)
+#define SYSTRACE_CALL() SYSTRACE_NAME(__FUNCTION__)
+
+#define SYSTRACE_ASYNC_BEGIN(name, cookie) \
+        utils::TraceRecorder::asyncBegin(SYSTRACE_TAG, name, int32_t(cookie))
+#define SYSTRACE_ASYNC_END(name, cookie) \
+        utils::TraceRecorder::asyncEnd(SYSTRACE_TAG, name, int32_t(cookie))
+
+#define SYSTRACE_VALUE32(name, val) \
+        utils::TraceRecorder::value(SYSTRACE_TAG, name, int64_t(int32_t(val)))
+#define SYSTRACE_VALUE64(name, val) \
+        utils::TraceRecorder::value(SYSTRACE_TAG, name, int64_t(val))
 
 #endif // ANDROID
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_UTILS_TRACERECORDER_H
+#define TNT_UTILS_TRACERECORDER_H
+
+#include <atomic>
+#include <string>
+
+#include <stdint.h>
+
+#include <utils/compiler.h>
+#include <utils/ThreadLocal.h>
+
+namespace utils {
+
+/*
+ * An in-process trace recorder, used by the SYSTRACE_ macros on platforms without atrace.
+ *
+ * Between start() and stop(), events of the enabled tags are recorded, without locking, in
+ * a ring buffer owned by the calling thread. The recorded events can then be exported in the
+ * chrome://tracing JSON format or as a Perfetto protobuf trace. Profiler counters reach the
+ * recorder through SYSTRACE_VALUE32/64.
+ *
+ * Each thread's buffer is allocated the first time the thread records an event, and is kept
+ * until the process exits.
+ */
+class TraceRecorder {
+public:
+    // number of events kept per thread, older events are overwritten
+    static constexpr size_t EVENTS_PER_THREAD = 8192;
+
+    // event names are copied, and truncated to this length
+    static constexpr size_t MAX_NAME_LENGTH = 47;
+
+    // Enables or disables tags, this is what SYSTRACE_ENABLE() and SYSTRACE_DISABLE() call.
+    // SYSTRACE_TAG_ALWAYS is always enabled.
+    static void enable(uint32_t tags) noexcept;
+    static void disable(uint32_t tags) noexcept;
+
+    // Starts and stops recording the events of the enabled tags.
+    static void start() noexcept;
+    static void stop() noexcept;
+
+    // Discards all recorded events. This should be called while recording is stopped.
+    static void clear() noexcept;
+
+    static bool isRecording(uint32_t tag) noexcept {
+        return bool(sActiveTags.load(std::memory_order_relaxed) & tag);
+    }
+
+    // Exports the recorded events. These should be called while recording is stopped,
+    // otherwise the most recent events may be torn.
+    static std::string getChromeTrace();
+    static std::string getPerfettoTrace();  // binary, "perfetto.protos.Trace"
+
+    static inline void begin(uint32_t tag, const char* name) noexcept {
+        if (tag && UTILS_UNLIKELY(isRecording(tag))) {
+            record(Type::BEGIN, name, 0);
+        }
+    }
+
+    static inline void end(uint32_t tag) noexcept {
+        if (tag && UTILS_UNLIKELY(isRecording(tag))) {
+            record(Type::END, nullptr, 0);
+        }
+    }
+
+    static inline void asyncBegin(uint32_t tag, const char* name, int32_t cookie) noexcept {
+        if (tag && UTILS_UNLIKELY(isRecording(tag))) {
+            record(Type::ASYNC_BEGIN, name, cookie);
+        }
+    }
+
+    static inline void asyncEnd(uint32_t tag, const char* name, int32_t cookie) noexcept {
+        if (tag && UTILS_UNLIKELY(isRecording(tag))) {
+            record(Type::ASYNC_END, name, cookie);
+        }
+    }
+
+    static inline void value(uint32_t tag, const char* name, int64_t value) noexcept {
+        if (tag && UTILS_UNLIKELY(isRecording(tag))) {
+            record(Type::COUNTER, name, value);
+        }
+    }
+
+    // Records the beginning and end of the current scope, see SYSTRACE_NAME().
+    class Scope {
+    public:
+        Scope(uint32_t tag, const char* name) noexcept
+                : mRecording(tag && UTILS_UNLIKELY(isRecording(tag))) {
+            if (mRecording) {
+                record(Type::BEGIN, name, 0);
+            }
+        }
+
+        ~Scope() noexcept {
+            // we always close a slice we opened, even if recording was stopped since
+            if (mRecording) {
+                record(Type::END, nullptr, 0);
+            }
+        }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+    private:
+        const bool mRecording;
+    };
+
+private:
+    enum class Type : uint8_t {
+        BEGIN, END, ASYNC_BEGIN, ASYNC_END, COUNTER
+    };
+
+    // these are defined in TraceRecorder.cpp
+    struct Event;
+    struct ThreadBuffer;
+    struct Registry;
+    struct Collector;
+
+    static void record(Type type, const char* name, int64_t value) noexcept;
+    static ThreadBuffer* createThreadBuffer() noexcept;
+    static void updateActiveTags() noexcept;
+
+    // enabled tags while recording, 0 otherwise
+    static std::atomic<uint32_t> sActiveTags;
+
+    static UTILS_DECLARE_TLS(ThreadBuffer*) sThreadBuffer;
+};
+
+} // namespace utils
+
+#endif // TNT_UTILS_TRACERECORDER_H
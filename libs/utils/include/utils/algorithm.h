@@ -20,8 +20,11 @@
 #include <utils/compiler.h>
 
 #include <functional>
+#include <type_traits>
+#include <utility>
 
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace utils {
@@ -255,6 +258,68 @@ RandomAccessIterator partition_point(
     return first;
 }
 
+/*
+ * Stable LSD radix-sort of [first, last) on the unsigned integer key returned by getKey().
+ *
+ * The key is processed 8 bits at a time, and 8-bits digits that have the same value for all
+ * items are skipped entirely, which is common when only a few fields of the key are in use.
+ * scratch must point to storage for at least (last - first) items and must not overlap the
+ * range being sorted. The sorted result is always in [first, last) when this returns.
+ */
+template<typename T, typename KEY>
+inline UTILS_PUBLIC
+void radix_sort(T* first, T* last, T* scratch, KEY getKey) noexcept {
+    using key_type = decltype(getKey(*first));
+    static_assert(std::is_integral<key_type>::value && std::is_unsigned<key_type>::value,
+            "radix_sort() requires an unsigned integer key");
+    constexpr size_t DIGIT_COUNT = sizeof(key_type);
+
+    const size_t count = size_t(last - first);
+    if (count < 2) {
+        return;
+    }
+
+    // build the histograms of all the digits at once
+    uint32_t histograms[DIGIT_COUNT][256] = {};
+    for (T const* p = first; p != last; ++p) {
+        const key_type key = getKey(*p);
+        for (size_t d = 0; d < DIGIT_COUNT; d++) {
+            histograms[d][(key >> (d * 8u)) & 0xFFu]++;
+        }
+    }
+
+    T* src = first;
+    T* dst = scratch;
+    for (size_t d = 0; d < DIGIT_COUNT; d++) {
+        uint32_t* const UTILS_RESTRICT histogram = histograms[d];
+        const size_t shift = d * 8u;
+
+        // if all the items fall in the same bucket, this digit doesn't change the order
+        if (histogram[(getKey(*src) >> shift) & 0xFFu] == count) {
+            continue;
+        }
+
+        // convert the histogram to starting offsets
+        uint32_t sum = 0;
+        for (size_t i = 0; i < 256; i++) {
+            const uint32_t c = histogram[i];
+            histogram[i] = sum;
+            sum += c;
+        }
+
+        for (T const* p = src, *e = src + count; p != e; ++p) {
+            dst[histogram[(getKey(*p) >> shift) & 0xFFu]++] = *p;
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != first) {
+        for (size_t i = 0; i < count; i++) {
+            first[i] = src[i];
+        }
+    }
+}
+
 } // namespace utils
 
 #endif // TNT_UTILS_ALGORITHM_H
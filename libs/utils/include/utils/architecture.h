@@ -29,6 +29,20 @@ constexpr size_t CACHELINE_SIZE = 32;
 constexpr size_t CACHELINE_SIZE = 64;
 #endif
 
+namespace arch {
+
+// Returns whether the CPU we're running on supports AVX2. Always false on non-x86 CPUs.
+inline bool hasAVX2() noexcept {
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init(); // needed if we're called from a static initializer
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+} // namespace arch
+
 } // namespace utils
 
 #endif // TNT_UTILS_ARCHITECTURE_H
@@ -78,6 +78,17 @@
 #   define UTILS_HAS_THREADING 1
 #endif
 
+// Maximum number of JobSystem worker threads. Without UTILS_HAS_THREADING, the engine and its
+// driver run on the main thread, but pthreads builds on the web can still run jobs on a fixed
+// pool of web workers.
+#if UTILS_HAS_THREADING
+#   define UTILS_MAX_WORKER_THREADS 32
+#elif defined(__EMSCRIPTEN_PTHREADS__) && defined(UTILS_WEB_WORKER_COUNT)
+#   define UTILS_MAX_WORKER_THREADS UTILS_WEB_WORKER_COUNT
+#else
+#   define UTILS_MAX_WORKER_THREADS 0
+#endif
+
 #if __has_attribute(noinline)
 #define UTILS_NOINLINE __attribute__((noinline))
 #else
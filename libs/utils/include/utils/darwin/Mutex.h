@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTILS_DARWIN_MUTEX_H
+#define UTILS_DARWIN_MUTEX_H
+
+#include <os/lock.h>
+
+#include <utils/compiler.h>
+#include <utils/Futex.h>
+
+namespace utils {
+
+/*
+ * A mutex based on os_unfair_lock, which parks the contended threads in the kernel and boosts
+ * the priority of the owner. A contended lock() spins for a little while first.
+ */
+class Mutex {
+public:
+    Mutex() noexcept = default;
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+
+    void lock() noexcept {
+        if (UTILS_UNLIKELY(!os_unfair_lock_trylock(&mLock))) {
+            wait();
+        }
+    }
+
+    bool try_lock() noexcept {
+        return os_unfair_lock_trylock(&mLock);
+    }
+
+    void unlock() noexcept {
+        os_unfair_lock_unlock(&mLock);
+    }
+
+private:
+    os_unfair_lock mLock = OS_UNFAIR_LOCK_INIT;
+
+    UTILS_NOINLINE
+    void wait() noexcept {
+        for (uint32_t i = 0; i < futex::MUTEX_SPIN_COUNT; i++) {
+            UTILS_PAUSE();
+            if (os_unfair_lock_trylock(&mLock)) {
+                return;
+            }
+        }
+        os_unfair_lock_lock(&mLock);
+    }
+};
+
+} // namespace utils
+
+#endif // UTILS_DARWIN_MUTEX_H
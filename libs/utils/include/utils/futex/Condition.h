@@ -14,12 +14,12 @@
  * limitations under the License.
  */
 
-#ifndef UTILS_LINUX_CONDITION_H
-#define UTILS_LINUX_CONDITION_H
+#ifndef UTILS_FUTEX_CONDITION_H
+#define UTILS_FUTEX_CONDITION_H
 
 #include <limits>
 #include <mutex>
-#include <utils/linux/Mutex.h>
+#include <utils/futex/Mutex.h>
 
 namespace utils {
 
@@ -28,6 +28,9 @@ namespace utils {
  * A very simple condition variable class that can be used as an (almost) drop-in replacement
  * for std::condition_variable (doesn't have the timed wait() though).
  * It is very low overhead as most of it is inlined.
+ *
+ * wait() spins for a little while before parking the thread, and the notifications only call
+ * into the OS when a thread is parked.
  */
 
 class Condition {
@@ -46,9 +49,19 @@ public:
 
     UTILS_NOINLINE
     void wait(std::unique_lock<Mutex>& lock) noexcept {
-        uint32_t old_state = mState.load(std::memory_order_relaxed);
+        const uint32_t old_state = mState.load(std::memory_order_relaxed);
         lock.unlock();
-        linuxutil::futex_wait_ex(&mState, false, old_state, false, nullptr);
+        for (uint32_t i = 0; i < futex::CONDITION_SPIN_COUNT; i++) {
+            if (mState.load(std::memory_order_relaxed) != old_state) {
+                lock.lock();
+                return;
+            }
+            UTILS_PAUSE();
+        }
+        // either pulse() sees this thread as parked, or the OS sees that mState has changed
+        mParkedCount.fetch_add(1, std::memory_order_seq_cst);
+        futex::wait(&mState, old_state);
+        mParkedCount.fetch_sub(1, std::memory_order_relaxed);
         lock.lock();
     }
 
@@ -61,13 +74,16 @@ public:
 
 private:
     std::atomic<uint32_t> mState = { 0 };
+    std::atomic<uint32_t> mParkedCount = { 0 };
 
     inline void pulse(int threadCount) noexcept {
-        mState.fetch_add(1, std::memory_order_relaxed);
-        linuxutil::futex_wake_ex(&mState, false, threadCount);
+        mState.fetch_add(1, std::memory_order_seq_cst);
+        if (mParkedCount.load(std::memory_order_seq_cst)) {
+            futex::wake(&mState, threadCount);
+        }
     }
 };
 
 } // namespace utils
 
-#endif // UTILS_LINUX_CONDITION_H
+#endif // UTILS_FUTEX_CONDITION_H
@@ -14,14 +14,13 @@
  * limitations under the License.
  */
 
-#ifndef UTILS_LINUX_MUTEX_H
-#define UTILS_LINUX_MUTEX_H
+#ifndef UTILS_FUTEX_MUTEX_H
+#define UTILS_FUTEX_MUTEX_H
 
 #include <atomic>
 
-#include <utils/linux/futex.h>
-
 #include <utils/compiler.h>
+#include <utils/Futex.h>
 
 namespace utils {
 
@@ -30,7 +29,8 @@ namespace utils {
  * for std::mutex.
  * It is very low overhead as most of it is inlined.
  *
- * Uses the same implementation
+ * Uses the same implementation as bionic: a contended lock() spins for a little while before
+ * parking the thread on the state word, see futex::wait().
  */
 
 class Mutex {
@@ -49,7 +49,7 @@ public:
 
     void unlock() noexcept {
         if (UTILS_UNLIKELY(mState.exchange(UNLOCKED, std::memory_order_release) == LOCKED_CONTENDED)) {
-            linuxutil::futex_wake_ex(&mState, false, LOCKED);
+            futex::wake(&mState, 1);
         }
     }
 
@@ -59,12 +59,21 @@ private:
 
     UTILS_NOINLINE
     void wait() noexcept {
+        for (uint32_t i = 0; i < futex::MUTEX_SPIN_COUNT; i++) {
+            UTILS_PAUSE();
+            uint32_t old_state = UNLOCKED;
+            if (mState.load(std::memory_order_relaxed) == UNLOCKED &&
+                    mState.compare_exchange_weak(old_state,
+                            LOCKED, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return;
+            }
+        }
         while (UTILS_UNLIKELY(mState.exchange(LOCKED_CONTENDED, std::memory_order_acquire) != UNLOCKED)) {
-            linuxutil::futex_wait_ex(&mState, false, LOCKED_CONTENDED, false, nullptr);
+            futex::wait(&mState, LOCKED_CONTENDED);
         }
     }
 };
 
 } // namespace utils
 
-#endif // UTILS_LINUX_MUTEX_H
+#endif // UTILS_FUTEX_MUTEX_H
@@ -21,6 +21,8 @@
 
 #include <algorithm>
 
+#include <utils/algorithm.h>
+
 #include <utils/Log.h>
 
 namespace utils {
@@ -51,6 +53,311 @@ void LinearAllocator::swap(LinearAllocator& rhs) noexcept {
     std::swap(mCurrent, rhs.mCurrent);
 }
 
+// ------------------------------------------------------------------------------------------------
+// TlsfAllocator
+// ------------------------------------------------------------------------------------------------
+
+struct TlsfAllocator::Block {
+    static constexpr size_t HEADER_SIZE = ALIGN;
+
+    Block* prevPhysical;        // only valid when the previous block is free
+    uint32_t size;              // size of the payload, multiple of ALIGN
+    uint8_t isFree;
+    uint8_t isPrevFree;
+    uint8_t tag;
+
+    // these are only valid in free blocks, they live in the payload
+    alignas(ALIGN) Block* nextFree;
+    Block* prevFree;
+
+    void* payload() noexcept {
+        return pointermath::add(this, HEADER_SIZE);
+    }
+
+    Block* next() noexcept {
+        return pointermath::add(this, HEADER_SIZE + size);
+    }
+
+    static Block* fromPayload(void const* p) noexcept {
+        return (Block*)(uintptr_t(p) - HEADER_SIZE);
+    }
+};
+
+// pools allocated when the area is full, the first block starts ALIGN bytes after this
+struct TlsfAllocator::Pool {
+    Pool* next;
+};
+
+// smallest payload, large enough for the free list links
+static constexpr size_t TLSF_MIN_BLOCK = 16;
+static constexpr size_t TLSF_MAX_BLOCK = size_t(1) << 31;
+static constexpr size_t TLSF_DEFAULT_GROW_SIZE = 1024 * 1024;
+
+static inline void tlsfMapping(size_t size, uint32_t* fl, uint32_t* sl) noexcept {
+    // this is the TLSF mapping function, small blocks are all in the first level
+    constexpr uint32_t SL_SHIFT = 4, ALIGN_SHIFT = 4, FL_SHIFT = SL_SHIFT + ALIGN_SHIFT;
+    if (size < (1u << FL_SHIFT)) {
+        *fl = 0;
+        *sl = uint32_t(size) >> ALIGN_SHIFT;
+    } else {
+        const uint32_t msb = 31 - clz(uint32_t(size));
+        *sl = (uint32_t(size) >> (msb - SL_SHIFT)) ^ (1u << SL_SHIFT);
+        *fl = msb - (FL_SHIFT - 1);
+    }
+}
+
+TlsfAllocator::TlsfAllocator(void* begin, void* end, size_t growSize) noexcept
+        : mGrowSize(growSize ? growSize : uintptr_t(end) - uintptr_t(begin)) {
+    static_assert(offsetof(Block, nextFree) == Block::HEADER_SIZE,
+            "the payload must start right after the block header");
+    static_assert(sizeof(Block) == Block::HEADER_SIZE + TLSF_MIN_BLOCK,
+            "the free list links must fit in the smallest payload");
+    if (begin && end) {
+        addPool(begin, end);
+    }
+}
+
+TlsfAllocator::~TlsfAllocator() noexcept {
+    Pool* pool = mPools;
+    while (pool) {
+        Pool* const next = pool->next;
+        aligned_free(pool);
+        pool = next;
+    }
+}
+
+TlsfAllocator::TlsfAllocator(TlsfAllocator&& rhs) noexcept {
+    this->swap(rhs);
+}
+
+TlsfAllocator& TlsfAllocator::operator=(TlsfAllocator&& rhs) noexcept {
+    if (this != &rhs) {
+        this->swap(rhs);
+    }
+    return *this;
+}
+
+void TlsfAllocator::swap(TlsfAllocator& rhs) noexcept {
+    std::swap(mFlBitmap, rhs.mFlBitmap);
+    std::swap(mSlBitmap, rhs.mSlBitmap);
+    std::swap(mFreeBlocks, rhs.mFreeBlocks);
+    std::swap(mPools, rhs.mPools);
+    std::swap(mGrowSize, rhs.mGrowSize);
+    std::swap(mTag, rhs.mTag);
+    std::swap(mStats, rhs.mStats);
+}
+
+size_t TlsfAllocator::getAllocationSize(void const* p) noexcept {
+    return p ? Block::fromPayload(p)->size : 0;
+}
+
+void TlsfAllocator::addPool(void* begin, void* end) noexcept {
+    constexpr size_t HEADER_SIZE = Block::HEADER_SIZE;
+    begin = pointermath::align(begin, ALIGN);
+    end = (void*)(uintptr_t(end) & ~uintptr_t(ALIGN - 1));
+    size_t size = uintptr_t(end) > uintptr_t(begin) ? uintptr_t(end) - uintptr_t(begin) : 0;
+    size = std::min(size, TLSF_MAX_BLOCK + 2 * HEADER_SIZE);
+    if (size < 2 * HEADER_SIZE + TLSF_MIN_BLOCK) {
+        return;
+    }
+
+    // a single free block, followed by a used empty block which stops coalescing
+    Block* const block = static_cast<Block*>(begin);
+    block->prevPhysical = nullptr;
+    block->size = uint32_t(size - 2 * HEADER_SIZE);
+    block->isFree = true;
+    block->isPrevFree = false;
+    block->tag = 0;
+
+    Block* const sentinel = block->next();
+    sentinel->prevPhysical = block;
+    sentinel->size = 0;
+    sentinel->isFree = false;
+    sentinel->isPrevFree = true;
+    sentinel->tag = 0;
+
+    insertFreeBlock(block);
+    mStats.poolSize += size;
+    mStats.poolCount++;
+}
+
+UTILS_NOINLINE
+void* TlsfAllocator::grow(size_t size) noexcept {
+    // room for the pool header, the block header and the sentinel
+    const size_t poolSize = std::max(std::max(mGrowSize, TLSF_DEFAULT_GROW_SIZE),
+            size + ALIGN + 2 * Block::HEADER_SIZE);
+    void* const p = aligned_alloc(poolSize, ALIGN);
+    if (UTILS_UNLIKELY(!p)) {
+        return nullptr;
+    }
+    Pool* const pool = static_cast<Pool*>(p);
+    pool->next = mPools;
+    mPools = pool;
+    addPool(pointermath::add(p, ALIGN), pointermath::add(p, poolSize));
+    return findFreeBlock(size);
+}
+
+TlsfAllocator::Block* TlsfAllocator::findFreeBlock(size_t size) noexcept {
+    // round the size up to the next list, so that any block of that list is large enough
+    if (size >= SMALL_BLOCK_SIZE) {
+        const uint32_t msb = 31 - clz(uint32_t(size));
+        size += (size_t(1) << (msb - SL_SHIFT)) - 1;
+    }
+    uint32_t fl, sl;
+    tlsfMapping(size, &fl, &sl);
+    if (fl >= FL_COUNT) {
+        return nullptr;
+    }
+
+    uint32_t slMap = mSlBitmap[fl] & (~0u << sl);
+    if (!slMap) {
+        // no block in this first level, look for a larger one
+        const uint32_t flMap = fl + 1 < 32 ? mFlBitmap & (~0u << (fl + 1)) : 0;
+        if (!flMap) {
+            return nullptr;
+        }
+        fl = ctz(flMap);
+        slMap = mSlBitmap[fl];
+    }
+    sl = ctz(slMap);
+    return mFreeBlocks[fl][sl];
+}
+
+void TlsfAllocator::insertFreeBlock(Block* block) noexcept {
+    uint32_t fl, sl;
+    tlsfMapping(block->size, &fl, &sl);
+    Block* const head = mFreeBlocks[fl][sl];
+    block->nextFree = head;
+    block->prevFree = nullptr;
+    if (head) {
+        head->prevFree = block;
+    }
+    mFreeBlocks[fl][sl] = block;
+    mFlBitmap |= 1u << fl;
+    mSlBitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::removeFreeBlock(Block* block) noexcept {
+    uint32_t fl, sl;
+    tlsfMapping(block->size, &fl, &sl);
+    if (block->prevFree) {
+        block->prevFree->nextFree = block->nextFree;
+    }
+    if (block->nextFree) {
+        block->nextFree->prevFree = block->prevFree;
+    }
+    if (mFreeBlocks[fl][sl] == block) {
+        mFreeBlocks[fl][sl] = block->nextFree;
+        if (!block->nextFree) {
+            mSlBitmap[fl] &= ~(1u << sl);
+            if (!mSlBitmap[fl]) {
+                mFlBitmap &= ~(1u << fl);
+            }
+        }
+    }
+}
+
+TlsfAllocator::Block* TlsfAllocator::split(Block* block, size_t size) noexcept {
+    // returns the remaining (free) block, if the block was large enough to be split
+    if (block->size < size + sizeof(Block)) {
+        return nullptr;
+    }
+    Block* const remaining = pointermath::add(block, Block::HEADER_SIZE + size);
+    remaining->size = uint32_t(block->size - size - Block::HEADER_SIZE);
+    remaining->isFree = true;
+    remaining->isPrevFree = block->isFree;
+    remaining->prevPhysical = block;
+    remaining->tag = 0;
+    remaining->next()->prevPhysical = remaining;
+    remaining->next()->isPrevFree = true;
+    block->size = uint32_t(size);
+    return remaining;
+}
+
+void* TlsfAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
+    // this allocator doesn't support 'extra'
+    assert(extra == 0);
+    assert(alignment && !(alignment & (alignment - 1)));
+
+    size = std::max((size + ALIGN - 1) & ~(ALIGN - 1), TLSF_MIN_BLOCK);
+    alignment = std::max(alignment, size_t(ALIGN));
+
+    // with a larger alignment, we need enough room to split a free block before ours
+    const size_t searchSize = size + (alignment > ALIGN ? alignment + sizeof(Block) : 0);
+    if (UTILS_UNLIKELY(searchSize > TLSF_MAX_BLOCK)) {
+        return nullptr;
+    }
+
+    Block* block = findFreeBlock(searchSize);
+    if (UTILS_UNLIKELY(!block)) {
+        block = static_cast<Block*>(grow(searchSize));
+        if (UTILS_UNLIKELY(!block)) {
+            return nullptr;
+        }
+    }
+    removeFreeBlock(block);
+
+    if (alignment > ALIGN) {
+        const uintptr_t payload = uintptr_t(block->payload());
+        uintptr_t aligned = (payload + alignment - 1) & ~(alignment - 1);
+        if (aligned != payload && aligned - payload < sizeof(Block)) {
+            // the gap is too small for a free block
+            aligned = (payload + sizeof(Block) + alignment - 1) & ~(alignment - 1);
+        }
+        if (aligned != payload) {
+            // the front of the block becomes a free block of its own
+            Block* const front = block;
+            block = split(front, aligned - payload - Block::HEADER_SIZE);
+            assert(block && block->payload() == (void*)aligned);
+            insertFreeBlock(front);
+        }
+    }
+
+    Block* const remaining = split(block, size);
+    if (remaining) {
+        insertFreeBlock(remaining);
+    }
+
+    block->isFree = false;
+    block->next()->isPrevFree = false;
+    block->tag = mTag;
+
+    mStats.used += block->size;
+    mStats.highWatermark = std::max(mStats.highWatermark, mStats.used);
+    mStats.tagUsed[mTag] += block->size;
+    mStats.tagHighWatermark[mTag] = std::max(mStats.tagHighWatermark[mTag], mStats.tagUsed[mTag]);
+    return block->payload();
+}
+
+void TlsfAllocator::free(void* p) noexcept {
+    if (!p) {
+        return;
+    }
+    Block* block = Block::fromPayload(p);
+    assert(!block->isFree);     // double free?
+
+    mStats.used -= block->size;
+    mStats.tagUsed[block->tag] -= block->size;
+
+    // coalesce with the neighbors
+    block->isFree = true;
+    if (block->isPrevFree) {
+        Block* const prev = block->prevPhysical;
+        removeFreeBlock(prev);
+        prev->size += uint32_t(Block::HEADER_SIZE + block->size);
+        block = prev;
+    }
+    Block* next = block->next();
+    if (next->isFree) {
+        removeFreeBlock(next);
+        block->size += uint32_t(Block::HEADER_SIZE + next->size);
+        next = block->next();
+    }
+    next->prevPhysical = block;
+    next->isPrevFree = true;
+    insertFreeBlock(block);
+}
+
 // ------------------------------------------------------------------------------------------------
 // FreeList
 // ------------------------------------------------------------------------------------------------
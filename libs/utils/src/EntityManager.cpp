@@ -19,9 +19,9 @@
 namespace utils {
 
 EntityManager::EntityManager()
-        : mGens(new uint8_t[RAW_INDEX_COUNT]) {
+        : mGens(new std::atomic<uint8_t>[RAW_INDEX_COUNT]) {
     // initialize all the generations to 0
-    std::fill_n(mGens, RAW_INDEX_COUNT, 0);
+    std::fill_n(mGens, RAW_INDEX_COUNT, uint8_t(0));
 }
 
 EntityManager::~EntityManager() {
@@ -43,6 +43,11 @@ void EntityManager::destroy(size_t n, Entity* entities) noexcept {
     static_cast<EntityManagerImpl *>(this)->destroy(n, entities);
 }
 
+size_t EntityManager::getDestroyedEntities(Cursor& cursor, Entity* entities, size_t count,
+        bool& lost) const noexcept {
+    return static_cast<EntityManagerImpl const *>(this)->getDestroyedEntities(
+            cursor, entities, count, lost);
+}
 
 void EntityManager::clear() noexcept {
     static_cast<EntityManagerImpl *>(this)->clear();
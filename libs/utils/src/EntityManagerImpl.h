@@ -25,7 +25,9 @@
 
 #include <tsl/robin_set.h>
 
+#include <algorithm>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <set>
 
@@ -34,6 +36,9 @@ namespace utils {
 
 static constexpr const size_t MIN_FREE_INDICES = 1024;
 
+// number of destroyed entities remembered for the component managers' gc, must be a power of two
+static constexpr const size_t DESTROYED_LIST_SIZE = 65536;
+
 class UTILS_PRIVATE EntityManagerImpl : public EntityManager {
 public:
 
@@ -46,7 +51,7 @@ public:
     void create(size_t n, Entity* entities) {
         Entity::Type index;
         auto& freeList = mFreeList;
-        uint8_t* const gens = mGens;
+        std::atomic<uint8_t>* const gens = mGens;
 
         // this must be thread-safe, acquire the free-list mutex
         std::lock_guard<Mutex> lock(mFreeListLock);
@@ -73,14 +78,17 @@ public:
                 // that it doesn't happen in practice.
                 index = currentIndex++;
             }
-            entities[i] = Entity{ makeIdentity(gens[index], index) };
+            entities[i] = Entity{
+                    makeIdentity(gens[index].load(std::memory_order_relaxed), index) };
         }
         mCurrentIndex = currentIndex;
     }
 
     void destroy(size_t n, Entity* entities) noexcept {
         auto& freeList = mFreeList;
-        uint8_t* const gens = mGens;
+        std::atomic<uint8_t>* const gens = mGens;
+        Entity* const destroyed = mDestroyed.get();
+        uint64_t destroyedCount = mDestroyedCount;
 
         std::unique_lock<Mutex> lock(mFreeListLock);
         for (size_t i = 0; i < n; i++) {
@@ -103,9 +111,13 @@ public:
                 // and entities work as weak references -- it just means that isAlive() could return
                 // true a little longer than expected in some other threads.
                 // We do need a memory fence though, it is provided by the mFreeListLock.unlock() below.
-                gens[index]++;
+                gens[index].fetch_add(1, std::memory_order_relaxed);
+
+                // remember it for the component managers, this overwrites the oldest entry
+                destroyed[destroyedCount++ & (DESTROYED_LIST_SIZE - 1)] = entities[i];
             }
         }
+        mDestroyedCount = destroyedCount;
         lock.unlock();
 
         // notify our listeners that some entities are being destroyed
@@ -116,16 +128,38 @@ public:
     }
 
 
+    size_t getDestroyedEntities(Cursor& cursor, Entity* entities, size_t count,
+            bool& lost) const noexcept {
+        std::lock_guard<Mutex> lock(mFreeListLock);
+        const uint64_t end = mDestroyedCount;
+        if (UTILS_UNLIKELY(end - cursor > DESTROYED_LIST_SIZE)) {
+            // the entities destroyed since 'cursor' are not all in the list anymore
+            lost = true;
+            cursor = end;
+            return 0;
+        }
+        count = std::min(count, size_t(end - cursor));
+        Entity const* const destroyed = mDestroyed.get();
+        for (size_t i = 0; i < count; i++) {
+            entities[i] = destroyed[(cursor + i) & (DESTROYED_LIST_SIZE - 1)];
+        }
+        cursor += count;
+        return count;
+    }
+
     void clear() noexcept {
-        uint8_t* const gens = mGens;
+        std::atomic<uint8_t>* const gens = mGens;
 
         std::unique_lock<Mutex> lock(mFreeListLock);
 
         // make all indices that were ever used invalid
         for (size_t i = 0, c = mCurrentIndex; i < c; i++) {
-            gens[i]++;
+            gens[i].fetch_add(1, std::memory_order_relaxed);
         }
 
+        // all the cursors fall out of the destroyed list, so that everything gets collected
+        mDestroyedCount += DESTROYED_LIST_SIZE + 1;
+
         // clear the free-list entirely.
         mCurrentIndex = 1;
         mFreeList.clear();
@@ -161,6 +195,10 @@ private:
     mutable Mutex mFreeListLock;
     std::deque<Entity::Type> mFreeList;
 
+    // ring buffer of the most recently destroyed entities, protected by mFreeListLock
+    std::unique_ptr<Entity[]> mDestroyed{ new Entity[DESTROYED_LIST_SIZE] };
+    uint64_t mDestroyedCount = 0;
+
     mutable Mutex mListenerLock;
     std::set<Listener*> mListeners;
 };
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Futex.h>
+
+#if defined(__linux__)
+#   include <utils/linux/futex.h>
+#elif defined(WIN32)
+#   include <windows.h>
+#   include <utils/unwindows.h>
+#endif
+
+namespace utils {
+namespace futex {
+
+#if defined(__linux__)
+
+void wait(std::atomic<uint32_t>* word, uint32_t value) noexcept {
+    linuxutil::futex_wait_ex(word, false, int(value), false, nullptr);
+}
+
+void wake(std::atomic<uint32_t>* word, int count) noexcept {
+    linuxutil::futex_wake_ex(word, false, count);
+}
+
+#elif defined(WIN32)
+
+void wait(std::atomic<uint32_t>* word, uint32_t value) noexcept {
+    WaitOnAddress(word, &value, sizeof(uint32_t), INFINITE);
+}
+
+void wake(std::atomic<uint32_t>* word, int count) noexcept {
+    if (count == 1) {
+        WakeByAddressSingle(word);
+    } else {
+        WakeByAddressAll(word);
+    }
+}
+
+#endif
+
+} // namespace futex
+} // namespace utils
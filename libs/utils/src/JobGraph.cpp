@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <utils/JobGraph.h>
+
+#include <utils/compiler.h>
+
+#include <assert.h>
+
+namespace utils {
+
+JobGraph::JobGraph() noexcept = default;
+
+JobGraph::~JobGraph() noexcept = default;
+
+JobGraph::Task JobGraph::add(TaskFunction function) {
+    mTasks.push_back({ std::move(function), {}, 0 });
+    return Task(mTasks.size() - 1);
+}
+
+void JobGraph::precede(Task before, Task after) {
+    assert(before < mTasks.size() && after < mTasks.size() && before != after);
+    mTasks[before].successors.push_back(after);
+    mTasks[after].predecessorCount++;
+}
+
+void JobGraph::clear() noexcept {
+    mTasks.clear();
+    mRoot = nullptr;
+}
+
+bool JobGraph::isAcyclic() const noexcept {
+    // Kahn's algorithm: all tasks are visited if and only if there is no cycle
+    const size_t count = mTasks.size();
+    std::vector<uint32_t> remaining(count);
+    std::vector<Task> ready;
+    for (size_t i = 0; i < count; i++) {
+        remaining[i] = mTasks[i].predecessorCount;
+        if (!remaining[i]) {
+            ready.push_back(Task(i));
+        }
+    }
+    size_t visited = 0;
+    while (!ready.empty()) {
+        Task task = ready.back();
+        ready.pop_back();
+        visited++;
+        for (Task successor : mTasks[task].successors) {
+            if (!--remaining[successor]) {
+                ready.push_back(successor);
+            }
+        }
+    }
+    return visited == count;
+}
+
+JobSystem::Job* JobGraph::run(JobSystem& js, JobSystem::Job* parent) {
+    const size_t count = mTasks.size();
+    assert(isAcyclic());
+
+    if (mPendingCountsSize < count) {
+        mPendingCounts.reset(new std::atomic<uint32_t>[count]);
+        mPendingCountsSize = count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        mPendingCounts[i].store(mTasks[i].predecessorCount, std::memory_order_relaxed);
+    }
+
+    // all the tasks are children of this job, so waiting on it waits for the whole graph
+    mRoot = js.createJob(parent);
+    if (mRoot && mCoreClass == JobSystem::CoreClass::BIG) {
+        js.setCoreClass(mRoot, JobSystem::CoreClass::BIG);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!mTasks[i].predecessorCount) {
+            launch(js, Task(i));
+        }
+    }
+
+    // the root job must only be started once it has children, or it could finish right away
+    JobSystem::Job* const root = mRoot;
+    if (root) {
+        js.run(root);
+    }
+    return root;
+}
+
+void JobGraph::launch(JobSystem& js, Task task) noexcept {
+    JobSystem::Job* job = nullptr;
+    if (UTILS_LIKELY(mRoot)) {
+        job = js.createJob(mRoot, [this, task](JobSystem& js, JobSystem::Job* job) {
+            execute(js, job, task);
+        });
+    }
+    if (UTILS_LIKELY(job)) {
+        js.run(job);
+    } else {
+        // we ran out of jobs, run the task right away
+        execute(js, nullptr, task);
+    }
+}
+
+void JobGraph::execute(JobSystem& js, JobSystem::Job* job, Task task) noexcept {
+    TaskInfo const& info = mTasks[task];
+
+    // The jobs created by the task are children of this job, which starts our successors once
+    // they're all done. This thread doesn't wait for them and moves on to other work.
+    JobSystem::Job* const group = js.createJob(job, [this, task](JobSystem& js, JobSystem::Job*) {
+        launchSuccessors(js, task);
+    });
+    if (info.function) {
+        info.function(js, group ? group : job);
+    }
+    if (group) {
+        js.runAfterChildren(group);
+    } else {
+        // we ran out of jobs
+        launchSuccessors(js, task);
+    }
+}
+
+void JobGraph::launchSuccessors(JobSystem& js, Task task) noexcept {
+    TaskInfo const& info = mTasks[task];
+    for (Task successor : info.successors) {
+        // std::memory_order_acq_rel so the successor sees the work of all its predecessors
+        if (mPendingCounts[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            launch(js, successor);
+        }
+    }
+}
+
+} // namespace utils
@@ -24,9 +24,15 @@
 
 #include <utils/JobSystem.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <limits>
 #include <random>
 
+#include <stdio.h>
+
+#include <utils/algorithm.h>
 #include <utils/compiler.h>
 #include <utils/memalign.h>
 #include <utils/Panic.h>
@@ -57,6 +63,11 @@
 
 namespace utils {
 
+static inline uint64_t now() noexcept {
+    using namespace std::chrono;
+    return uint64_t(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
 UTILS_DEFINE_TLS(JobSystem::ThreadState *) JobSystem::sThreadState(nullptr);
 
 void JobSystem::setThreadName(const char* name) noexcept {
@@ -103,12 +114,69 @@ void JobSystem::setThreadAffinity(uint32_t mask) noexcept {
 #endif
 }
 
-JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
-    : mJobPool("JobSystem Job pool", MAX_JOB_COUNT * sizeof(Job)),
-      mJobStorageBase(static_cast<Job *>(mJobPool.getAllocator().getCurrent()))
-{
+#if defined(__linux__)
+static uint32_t readCpuValue(size_t cpu, const char* name) noexcept {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/%s", cpu, name);
+    uint32_t value = 0;
+    FILE* file = fopen(path, "r");
+    if (file) {
+        if (fscanf(file, "%u", &value) != 1) {
+            value = 0;
+        }
+        fclose(file);
+    }
+    return value;
+}
+#endif
+
+void JobSystem::getCoreClasses(uint32_t* bigCores, uint32_t* littleCores) noexcept {
+    const size_t cpuCount = std::min(size_t(32), size_t(std::thread::hardware_concurrency()));
+    const uint32_t allCores = cpuCount < 32 ? (1u << cpuCount) - 1u : 0xFFFFFFFFu;
+    *bigCores = allCores;
+    *littleCores = 0;
+
+#if defined(__linux__)
+    // cpu_capacity is what the kernel's energy aware scheduler uses, when it's not available
+    // the maximum frequency is a good enough approximation.
+    uint32_t capacities[32];
+    uint32_t minCapacity = std::numeric_limits<uint32_t>::max();
+    uint32_t maxCapacity = 0;
+    for (size_t i = 0; i < cpuCount; i++) {
+        uint32_t capacity = readCpuValue(i, "cpu_capacity");
+        if (!capacity) {
+            capacity = readCpuValue(i, "cpufreq/cpuinfo_max_freq");
+        }
+        if (!capacity) {
+            // we can't tell, assume all cores are the same
+            return;
+        }
+        capacities[i] = capacity;
+        minCapacity = std::min(minCapacity, capacity);
+        maxCapacity = std::max(maxCapacity, capacity);
+    }
+
+    // cores with less than half the capacity of the fastest ones are "little" cores
+    if (cpuCount && minCapacity < maxCapacity / 2) {
+        uint32_t big = 0;
+        for (size_t i = 0; i < cpuCount; i++) {
+            if (capacities[i] >= maxCapacity / 2) {
+                big |= 1u << i;
+            }
+        }
+        *bigCores = big;
+        *littleCores = allCores & ~big;
+    }
+#endif
+}
+
+JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount,
+        size_t bigThreadCount) noexcept {
     SYSTRACE_ENABLE();
 
+    // start with a single segment, that's enough for most workloads
+    addSegment();
+
     if (threadCount == 0) {
         // default value, system dependant
         size_t hwThreads = std::thread::hardware_concurrency();
@@ -120,7 +188,7 @@ JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
             threadCount = hwThreads - 1;
         }
     }
-    threadCount = std::min(size_t(UTILS_HAS_THREADING ? 32 : 0), threadCount);
+    threadCount = std::min(size_t(UTILS_MAX_WORKER_THREADS), threadCount);
 
     mThreadStates = aligned_vector<ThreadState>(threadCount + adoptableThreadsCount);
     mThreadCount = uint16_t(threadCount);
@@ -130,6 +198,21 @@ JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
     assert(mExitRequested.is_lock_free());
     assert(Job().runningJobCount.is_lock_free());
 
+    // On heterogeneous CPUs, leave one big core to the (adopted) thread that feeds us and
+    // put the remaining worker threads on the little cores. There is always at least one big
+    // thread, so that CoreClass::BIG jobs make progress.
+    getCoreClasses(&mBigCoreMask, &mLittleCoreMask);
+    if (bigThreadCount) {
+        bigThreadCount = std::min(threadCount, bigThreadCount);
+    } else if (mLittleCoreMask) {
+        const size_t bigCoreCount = size_t(utils::popcount(mBigCoreMask));
+        bigThreadCount = std::min(threadCount,
+                std::max(size_t(1), bigCoreCount - std::min(bigCoreCount, adoptableThreadsCount)));
+    } else {
+        bigThreadCount = threadCount;
+    }
+    mBigThreadCount = uint16_t(bigThreadCount);
+
     std::random_device rd;
     const size_t hardwareThreadCount = mThreadCount;
     auto& states = mThreadStates;
@@ -140,6 +223,10 @@ JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
         state.rndGen = default_random_engine(rd());
         state.mask = uint32_t(1UL << i);
         state.js = this;
+        // adopted threads are always allowed to run big jobs
+        state.big = i < bigThreadCount || i >= hardwareThreadCount;
+        state.freeList = NULL_INDEX;
+        state.freeCount = 0;
         if (i < hardwareThreadCount) {
             // don't start a thread of adoptable thread slots
             state.thread = std::thread(&JobSystem::loop, this, &state);
@@ -157,6 +244,10 @@ JobSystem::~JobSystem() {
             state.thread.join();
         }
     }
+
+    for (size_t i = 0; i < mSegmentCount; i++) {
+        aligned_free(mSegments[i]);
+    }
 }
 
 JobSystem* JobSystem::getJobSystem() noexcept {
@@ -190,8 +281,93 @@ inline JobSystem::ThreadState& JobSystem::getState() noexcept {
     return *sThreadState;
 }
 
-JobSystem::Job* JobSystem::allocateJob() noexcept {
-    return mJobPool.make<Job>();
+size_t JobSystem::getThreadIndex() const noexcept {
+    ThreadState const& state = getState();
+    assert(state.js == this);
+    return size_t(&state - mThreadStates.data());
+}
+
+JobSystem::Job* JobSystem::allocateJob(ThreadState& state) noexcept {
+    if (UTILS_UNLIKELY(state.freeList == NULL_INDEX)) {
+        if (UTILS_UNLIKELY(!refillFreeList(state))) {
+            return nullptr;
+        }
+    }
+    Job* const job = getJob(state.freeList);
+    state.freeList = job->nextFree;
+    state.freeCount--;
+    return new(job) Job;
+}
+
+void JobSystem::freeJob(ThreadState& state, Job* job) noexcept {
+    job->~Job();
+    job->nextFree = state.freeList;
+    state.freeList = getIndex(job);
+    state.freeCount++;
+    if (UTILS_UNLIKELY(state.freeCount >= FREE_LIST_CHUNK_SIZE * 2)) {
+        releaseFreeList(state);
+    }
+}
+
+UTILS_NOINLINE
+bool JobSystem::refillFreeList(ThreadState& state) noexcept {
+    std::lock_guard<Mutex> lock(mJobStorageLock);
+    if (mFreeChunks.empty() && !addSegment()) {
+        // we've reached MAX_JOB_COUNT
+        return false;
+    }
+    state.freeList = mFreeChunks.back().first;
+    state.freeCount = mFreeChunks.back().second;
+    mFreeChunks.pop_back();
+    return true;
+}
+
+UTILS_NOINLINE
+void JobSystem::releaseFreeList(ThreadState& state) noexcept {
+    // give the first FREE_LIST_CHUNK_SIZE jobs of our list back to the JobSystem, so they can
+    // be used by other threads (jobs are often created and finished on different threads).
+    const uint32_t first = state.freeList;
+    Job* last = getJob(first);
+    for (size_t i = 1; i < FREE_LIST_CHUNK_SIZE; i++) {
+        last = getJob(last->nextFree);
+    }
+    state.freeList = last->nextFree;
+    state.freeCount -= FREE_LIST_CHUNK_SIZE;
+    last->nextFree = NULL_INDEX;
+
+    std::lock_guard<Mutex> lock(mJobStorageLock);
+    mFreeChunks.emplace_back(first, uint32_t(FREE_LIST_CHUNK_SIZE));
+}
+
+bool JobSystem::addSegment() noexcept {
+    // must be called with mJobStorageLock held (or from the constructor)
+    if (UTILS_UNLIKELY(mSegmentCount == MAX_SEGMENT_COUNT)) {
+        return false;
+    }
+
+    // the segment is aligned to its size, so getIndex() can find the segment's index,
+    // which we store in its first slot.
+    Job* const segment = static_cast<Job*>(aligned_alloc(SEGMENT_SIZE, SEGMENT_SIZE));
+    if (UTILS_UNLIKELY(!segment)) {
+        return false;
+    }
+    const uint32_t segmentIndex = mSegmentCount;
+    *reinterpret_cast<uint32_t*>(segment) = segmentIndex;
+
+    // chain the remaining slots into chunks of free jobs
+    const uint32_t base = uint32_t(segmentIndex << SEGMENT_SHIFT);
+    for (uint32_t first = 1; first < JOBS_PER_SEGMENT; first += FREE_LIST_CHUNK_SIZE) {
+        const uint32_t end = std::min(first + uint32_t(FREE_LIST_CHUNK_SIZE),
+                uint32_t(JOBS_PER_SEGMENT));
+        for (uint32_t i = first; i < end; i++) {
+            segment[i].nextFree = (i + 1 < end) ? base + i + 1 : NULL_INDEX;
+        }
+        mFreeChunks.emplace_back(base + first, end - first);
+    }
+
+    mSegments[segmentIndex] = segment;
+    mSegmentCount = segmentIndex + 1;
+    return true;
 }
 
 inline JobSystem::ThreadState& JobSystem::getStateToStealFrom(JobSystem::ThreadState& state) noexcept {
@@ -204,47 +380,128 @@ inline JobSystem::ThreadState& JobSystem::getStateToStealFrom(JobSystem::ThreadS
 
 bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
 
-    Job* job = pop(state.workQueue);
+    // big jobs are latency-critical, so they're always looked at first
+    Job* job = state.big ? pop(state.bigWorkQueue) : nullptr;
+    if (job == nullptr) {
+        job = pop(state.workQueue);
+    }
     if (job == nullptr) {
-        // our queue is empty, try to steal a job
+        // our queues are empty, try to steal a job
         ThreadState& stateToStealFrom = getStateToStealFrom(state);
         if (&stateToStealFrom != &state) {
-            // don't steal from our own queue
-            job = steal(stateToStealFrom.workQueue);
+            // don't steal from our own queue, and little threads never steal big jobs
+            if (state.big) {
+                job = steal(stateToStealFrom.bigWorkQueue);
+            }
+            if (job == nullptr) {
+                job = steal(stateToStealFrom.workQueue);
+            }
             // nullptr -> nothing to steal in that queue either
+            if (UTILS_UNLIKELY(isInstrumentationEnabled())) {
+                state.stealAttempts.fetch_add(1, std::memory_order_relaxed);
+                state.stealCount.fetch_add(job ? 1 : 0, std::memory_order_relaxed);
+            }
         }
     }
 
     if (job) {
         SYSTRACE_CALL();
 
-        UTILS_UNUSED uint32_t activeJobs = mActiveJobs.fetch_sub(1, std::memory_order_acq_rel);
+        std::atomic<uint32_t>& counter = job->bigCoresOnly ? mActiveBigJobs : mActiveJobs;
+        UTILS_UNUSED uint32_t activeJobs = counter.fetch_sub(1, std::memory_order_acq_rel);
         assert(activeJobs); // whoops, we were already at 0
         
         SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs - 1);
 
-        if (UTILS_LIKELY(job->function)) {
-            SYSTRACE_NAME("job->function");
-            job->function(job->padding, *this, job);
-        }
+        call(state, job);
         finish(job);
     }
     return job != nullptr;
 }
 
+inline void JobSystem::call(JobSystem::ThreadState& state, Job* job) noexcept {
+    if (UTILS_UNLIKELY(isInstrumentationEnabled())) {
+        callInstrumented(state, job);
+        return;
+    }
+    if (UTILS_LIKELY(job->function)) {
+        SYSTRACE_NAME("job->function");
+        job->function(job->padding, *this, job);
+    }
+}
+
+UTILS_NOINLINE
+void JobSystem::callInstrumented(JobSystem::ThreadState& state, Job* job) noexcept {
+    // time spent in nested jobs and waits is accounted for by them, not by this job
+    const uint64_t accounted = state.busyTime.load(std::memory_order_relaxed) +
+                               state.idleTime.load(std::memory_order_relaxed);
+    const uint32_t index = getIndex(job);
+    const uint64_t begin = now();
+    if (UTILS_LIKELY(job->function)) {
+        SYSTRACE_NAME("job->function");
+        job->function(job->padding, *this, job);
+    }
+    const uint64_t end = now();
+    const uint64_t nested = state.busyTime.load(std::memory_order_relaxed) +
+                            state.idleTime.load(std::memory_order_relaxed) - accounted;
+
+    state.jobCount.fetch_add(1, std::memory_order_relaxed);
+    state.busyTime.fetch_add((end - begin) - std::min(nested, end - begin),
+            std::memory_order_relaxed);
+
+    // the timeline is allocated before instrumentation is enabled and never freed
+    if (UTILS_LIKELY(state.timeline)) {
+        const uint32_t count = state.eventCount.load(std::memory_order_relaxed);
+        state.timeline[count % TIMELINE_SIZE] = {
+                begin, end, uint32_t(&state - mThreadStates.data()), index };
+        state.eventCount.store(count + 1, std::memory_order_release);
+    }
+}
+
+// Little threads can't run the CoreClass::BIG jobs, they must sleep while only those are queued
+bool JobSystem::hasRunnableJobs(JobSystem::ThreadState const& state) const noexcept {
+    return mActiveJobs.load(std::memory_order_relaxed) ||
+           (state.big && mActiveBigJobs.load(std::memory_order_relaxed));
+}
+
+bool JobSystem::spin(JobSystem::ThreadState const& state) const noexcept {
+    for (uint32_t i = 0; i < IDLE_SPIN_COUNT; i++) {
+        if (hasRunnableJobs(state) || exitRequested()) {
+            return true;
+        }
+        UTILS_PAUSE();
+    }
+    return false;
+}
+
 void JobSystem::loop(ThreadState* threadState) noexcept {
     setThreadName("JobSystem::loop");
     setThreadPriority(Priority::DISPLAY);
 
+    // on heterogeneous CPUs, keep each thread on its class of cores
+    if (mLittleCoreMask) {
+        setThreadAffinity(threadState->big ? mBigCoreMask : mLittleCoreMask);
+    }
+
     // record our work queue to thread-local storage
     sThreadState = threadState;
 
     // run our main loop...
     do {
         if (!execute(*threadState)) {
-            std::unique_lock<Mutex> lock(mLock);
-            while (!exitRequested() && !(mActiveJobs.load(std::memory_order_relaxed))) {
-                mCondition.wait(lock);
+            if (spin(*threadState)) {
+                continue;
+            }
+            const bool instrumented = isInstrumentationEnabled();
+            const uint64_t begin = instrumented ? now() : 0;
+            {
+                std::unique_lock<Mutex> lock(mLock);
+                while (!exitRequested() && !hasRunnableJobs(*threadState)) {
+                    mCondition.wait(lock);
+                }
+            }
+            if (UTILS_UNLIKELY(instrumented)) {
+                threadState->sleepTime.fetch_add(now() - begin, std::memory_order_relaxed);
             }
         }
     } while (!exitRequested());
@@ -256,19 +513,20 @@ void JobSystem::loop(ThreadState* threadState) noexcept {
 
 JobSystem::Job* JobSystem::create(JobSystem::Job* parent, JobFunc func) noexcept {
     parent = (parent == nullptr) ? mMasterJob : parent;
-    Job* const job = allocateJob();
+    Job* const job = allocateJob(getState());
     if (UTILS_LIKELY(job)) {
-        size_t index = 0x7FFF;
+        uint32_t index = NULL_INDEX;
         if (parent) {
             // can't create a child job of a terminated parent
             assert(parent->runningJobCount.load(std::memory_order_relaxed) > 0);
 
             parent->runningJobCount.fetch_add(1, std::memory_order_relaxed);
-            index = parent - mJobStorageBase;
+            index = getIndex(parent);
             assert(index < MAX_JOB_COUNT);
         }
         job->function = func;
-        job->parent = uint16_t(index);
+        job->parent = index;
+        job->bigCoresOnly = parent ? parent->bigCoresOnly : 0;
         job->runningJobCount.store(1, std::memory_order_relaxed);
     }
     return job;
@@ -278,20 +536,27 @@ void JobSystem::finish(Job* job) noexcept {
     SYSTRACE_CALL();
 
     // terminate this job and notify its parent
-    auto& jobPool = mJobPool;
-    Job* const storage = mJobStorageBase;
+    ThreadState& state(getState());
     do {
         // std::memory_order_release here is needed to synchronize with JobSystem::wait()
         // which needs to "see" all changes that happened before the job terminated.
         int32_t runningJobCount = job->runningJobCount.fetch_sub(1, std::memory_order_release) - 1;
         assert(runningJobCount >= 0);
+        if (runningJobCount == DEFERRED) {
+            // this was the last child of a continuation, which runs now; it notifies its own
+            // parent when it finishes. The fence pairs with the release of its other children.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            job->runningJobCount.store(1, std::memory_order_relaxed);
+            run(job);
+            break;
+        }
         if (runningJobCount >= 1) {
             // there is still work (e.g.: children), we're done.
             break;
         }
-        Job* const parent = job->parent == 0x7FFF ? nullptr : &storage[job->parent];
+        Job* const parent = job->parent == NULL_INDEX ? nullptr : getJob(job->parent);
         // destroy this job...
-        jobPool.destroy(job);
+        freeJob(state, job);
         // ... and check the parent
         job = parent;
     } while (job);
@@ -310,32 +575,69 @@ void JobSystem::run(JobSystem::Job* job, uint32_t flags) noexcept {
 
     ThreadState& state(getState());
 
+    const bool bigCoresOnly = job->bigCoresOnly;
+    WorkQueue& workQueue = bigCoresOnly ? state.bigWorkQueue : state.workQueue;
+    if (UTILS_UNLIKELY(size_t(workQueue.getCount()) >= WORK_QUEUE_SIZE)) {
+        // our queue is full, just run the job right away
+        call(state, job);
+        finish(job);
+        return;
+    }
+
     // increase the active job count before we add the job to the queue, because otherwise
     // the job could run and finish before the counter is incremented, which would trigger
     // an assert() in execute(). Either way, it's not "wrong", but the assert() is useful.
-    uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_relaxed);
+    std::atomic<uint32_t>& counter = bigCoresOnly ? mActiveBigJobs : mActiveJobs;
+    uint32_t activeJobs = counter.fetch_add(1, std::memory_order_relaxed);
 
-    put(state.workQueue, job);
+    put(workQueue, job);
 
     SYSTRACE_CONTEXT();
     SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs + 1);
 
     // wake-up a thread if needed...
-    if (!(flags & DONT_SIGNAL)) {
+    if (UTILS_UNLIKELY(bigCoresOnly && !state.big)) {
+        // we can't run this job ourselves, and we don't know which threads are big ones
+        { std::lock_guard<Mutex> lock(mLock); }
+        mCondition.notify_all();
+    } else if (!(flags & DONT_SIGNAL)) {
         // if it was busy before, try to wake-up another sleeping thread
         if (activeJobs) {
-            // wake-up a queue
+            // wake-up a queue, all of them for a big job if some threads can't run it
             { std::lock_guard<Mutex> lock(mLock); }
-            mCondition.notify_one();
+            if (UTILS_UNLIKELY(bigCoresOnly && mBigThreadCount < mThreadCount)) {
+                mCondition.notify_all();
+            } else {
+                mCondition.notify_one();
+            }
         }
     }
 }
 
+void JobSystem::runAfterChildren(JobSystem::Job* job) noexcept {
+    // drop the reference the job holds on itself and let its last child run it, the count never
+    // reaches 0 in between so the job isn't seen as completed
+    const uint32_t count = job->runningJobCount.fetch_add(DEFERRED - 1, std::memory_order_acq_rel);
+    if (count == 1) {
+        // the children are all done already
+        job->runningJobCount.store(1, std::memory_order_relaxed);
+        run(job);
+    }
+}
+
 void JobSystem::wait(JobSystem::Job const* job) noexcept {
     SYSTRACE_CALL();
 
     assert(job);
     ThreadState& state(getState());
+
+    // time spent executing jobs while we wait is accounted for by the jobs
+    const bool instrumented = isInstrumentationEnabled();
+    const uint64_t begin = instrumented ? now() : 0;
+    const uint64_t accounted = instrumented ?
+            state.busyTime.load(std::memory_order_relaxed) +
+            state.idleTime.load(std::memory_order_relaxed) : 0;
+
     do {
         if (!execute(state)) {
             // we're a waiter so we spin!!!
@@ -343,6 +645,13 @@ void JobSystem::wait(JobSystem::Job const* job) noexcept {
         }
     } while (!hasJobCompleted(job) && !exitRequested());
 
+    if (UTILS_UNLIKELY(instrumented)) {
+        const uint64_t elapsed = now() - begin;
+        const uint64_t nested = state.busyTime.load(std::memory_order_relaxed) +
+                                state.idleTime.load(std::memory_order_relaxed) - accounted;
+        state.idleTime.fetch_add(elapsed - std::min(nested, elapsed), std::memory_order_relaxed);
+    }
+
     // std::memory_order_acquire here is needed to synchronize with JobSystem::finish()
     // this guarantees we "see" all the changes performed by the job that just finished.
     std::atomic_thread_fence(std::memory_order_acquire);
@@ -381,9 +690,122 @@ void JobSystem::emancipate() {
     sThreadState = nullptr;
 }
 
+void JobSystem::setInstrumentationEnabled(bool enabled) noexcept {
+    if (enabled) {
+        if (!mEpoch) {
+            mEpoch = now();
+        }
+        for (auto& state : mThreadStates) {
+            if (!state.timeline) {
+                state.timeline.reset(new JobEvent[TIMELINE_SIZE]);
+            }
+        }
+    }
+    // the release here guarantees the timelines are visible to threads that see the flag set
+    mInstrumentation.store(enabled, std::memory_order_release);
+}
+
+void JobSystem::resetInstrumentation() noexcept {
+    mEpoch = now();
+    for (auto& state : mThreadStates) {
+        state.jobCount.store(0, std::memory_order_relaxed);
+        state.stealAttempts.store(0, std::memory_order_relaxed);
+        state.stealCount.store(0, std::memory_order_relaxed);
+        state.busyTime.store(0, std::memory_order_relaxed);
+        state.idleTime.store(0, std::memory_order_relaxed);
+        state.sleepTime.store(0, std::memory_order_relaxed);
+        state.eventCount.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<JobSystem::ThreadStats> JobSystem::getThreadStats() const noexcept {
+    std::vector<ThreadStats> stats;
+    stats.reserve(mThreadStates.size());
+    for (size_t i = 0, n = mThreadStates.size(); i < n; i++) {
+        ThreadState const& state = mThreadStates[i];
+        stats.push_back({
+                state.jobCount.load(std::memory_order_relaxed),
+                state.stealAttempts.load(std::memory_order_relaxed),
+                state.stealCount.load(std::memory_order_relaxed),
+                state.busyTime.load(std::memory_order_relaxed),
+                state.idleTime.load(std::memory_order_relaxed),
+                state.sleepTime.load(std::memory_order_relaxed),
+                state.big,
+                i >= mThreadCount });
+    }
+    return stats;
+}
+
+std::vector<JobSystem::JobEvent> JobSystem::getJobTimeline() const noexcept {
+    std::vector<JobEvent> events;
+    for (auto const& state : mThreadStates) {
+        if (!state.timeline) {
+            continue;
+        }
+        // synchronizes with callInstrumented()
+        const uint32_t count = state.eventCount.load(std::memory_order_acquire);
+        const uint32_t n = std::min(count, uint32_t(TIMELINE_SIZE));
+        for (uint32_t i = count - n; i != count; i++) {
+            events.push_back(state.timeline[i % TIMELINE_SIZE]);
+        }
+    }
+    std::sort(events.begin(), events.end(), [](JobEvent const& lhs, JobEvent const& rhs) {
+        return lhs.begin < rhs.begin;
+    });
+    return events;
+}
+
+std::string JobSystem::getChromeTrace() const {
+    // see the "Trace Event Format" specification, times are in microseconds
+    std::vector<JobEvent> const events = getJobTimeline();
+    std::string trace("{\"traceEvents\":[");
+    char buffer[256];
+    const char* separator = "";
+    for (size_t i = 0, n = mThreadStates.size(); i < n; i++) {
+        snprintf(buffer, sizeof(buffer),
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,"
+                "\"args\":{\"name\":\"%s %zu%s\"}}",
+                separator, i, i < mThreadCount ? "JobSystem::loop" : "adopted", i,
+                mThreadStates[i].big ? " (big)" : "");
+        trace += buffer;
+        separator = ",";
+    }
+    for (JobEvent const& event : events) {
+        const uint64_t begin = event.begin > mEpoch ? event.begin - mEpoch : 0;
+        snprintf(buffer, sizeof(buffer),
+                "%s{\"name\":\"job\",\"cat\":\"JobSystem\",\"ph\":\"X\",\"pid\":0,"
+                "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"job\":%u}}",
+                separator, event.thread, double(begin) * 1e-3,
+                double(event.end - event.begin) * 1e-3, event.job);
+        trace += buffer;
+        separator = ",";
+    }
+    trace += "]}";
+    return trace;
+}
+
 io::ostream& operator<<(io::ostream& out, JobSystem const& js) {
     for (auto const& item : js.mThreadStates) {
-        out << size_t(std::log2f(item.mask)) << ": " << item.workQueue.getCount() << io::endl;
+        out << size_t(std::log2f(item.mask)) << (item.big ? " (big): " : ": ")
+            << item.workQueue.getCount() << ", " << item.bigWorkQueue.getCount() << io::endl;
+    }
+    if (js.isInstrumentationEnabled()) {
+        // utilization is relative to the time elapsed since instrumentation was enabled or reset
+        const double elapsed = double(now() - js.mEpoch);
+        auto const stats = js.getThreadStats();
+        for (size_t i = 0, n = stats.size(); i < n; i++) {
+            JobSystem::ThreadStats const& s = stats[i];
+            if (s.adopted && !s.jobCount && !s.idleTime) {
+                // unused adoptable slot
+                continue;
+            }
+            out << i << ": jobs=" << s.jobCount
+                << ", steals=" << s.stealCount << "/" << s.stealAttempts
+                << ", busy=" << float(100.0 * double(s.busyTime) / elapsed)
+                << "%, idle=" << float(100.0 * double(s.idleTime) / elapsed)
+                << "%, sleep=" << float(100.0 * double(s.sleepTime) / elapsed)
+                << "%" << io::endl;
+        }
     }
     return out;
 }
@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <utils/TraceRecorder.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#   include <pthread.h>
+#endif
+
+#include <utils/Mutex.h>
+#include <utils/Systrace.h>
+#include <utils/ThreadLocal.h>
+
+namespace utils {
+
+struct TraceRecorder::Event {
+    uint64_t time;                      // steady clock, in nanoseconds
+    int64_t value;                      // counter value or async cookie
+    Type type;
+    char name[MAX_NAME_LENGTH];         // not used by END events
+};
+
+static_assert(TraceRecorder::EVENTS_PER_THREAD &&
+        !(TraceRecorder::EVENTS_PER_THREAD & (TraceRecorder::EVENTS_PER_THREAD - 1)),
+        "EVENTS_PER_THREAD must be a power of two");
+
+struct TraceRecorder::ThreadBuffer {
+    // only written by the owning thread
+    std::atomic<uint32_t> head = { 0 };
+    std::unique_ptr<Event[]> events{ new Event[EVENTS_PER_THREAD] };
+    uint32_t index = 0;
+    char name[32] = {};
+};
+
+struct TraceRecorder::Registry {
+    Mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    uint32_t enabledTags = SYSTRACE_TAG_ALWAYS;
+    bool recording = false;
+    uint64_t startTime = 0;
+
+    static Registry& get() noexcept {
+        // never destroyed, threads may still record events while the process exits
+        static Registry* const registry = new Registry;
+        return *registry;
+    }
+};
+
+std::atomic<uint32_t> TraceRecorder::sActiveTags = { 0 };
+
+UTILS_DEFINE_TLS(TraceRecorder::ThreadBuffer*) TraceRecorder::sThreadBuffer(nullptr);
+
+namespace {
+
+inline uint64_t now() noexcept {
+    using namespace std::chrono;
+    return uint64_t(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void appendJsonString(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; s++) {
+        const char c = *s;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (uint8_t(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", unsigned(c));
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// minimal protobuf encoding, see https://developers.google.com/protocol-buffers/docs/encoding
+class ProtoWriter {
+public:
+    explicit ProtoWriter(std::string& out) noexcept : mOut(out) { }
+
+    void field(uint32_t number, uint64_t value) {
+        varint((uint64_t(number) << 3) | 0);
+        varint(value);
+    }
+
+    void field(uint32_t number, const char* data, size_t size) {
+        varint((uint64_t(number) << 3) | 2);
+        varint(size);
+        mOut.append(data, size);
+    }
+
+    void field(uint32_t number, const char* string) {
+        field(number, string, strlen(string));
+    }
+
+    void field(uint32_t number, std::string const& message) {
+        field(number, message.data(), message.size());
+    }
+
+private:
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            mOut += char(uint8_t(value) | 0x80);
+            value >>= 7;
+        }
+        mOut += char(value);
+    }
+
+    std::string& mOut;
+};
+
+} // anonymous namespace
+
+void TraceRecorder::updateActiveTags() noexcept {
+    // must be called with the registry lock held
+    Registry& registry = Registry::get();
+    sActiveTags.store(registry.recording ? registry.enabledTags : 0, std::memory_order_relaxed);
+}
+
+void TraceRecorder::enable(uint32_t tags) noexcept {
+    Registry& registry = Registry::get();
+    std::lock_guard<Mutex> lock(registry.lock);
+    registry.enabledTags |= tags;
+    updateActiveTags();
+}
+
+void TraceRecorder::disable(uint32_t tags) noexcept {
+    Registry& registry = Registry::get();
+    std::lock_guard<Mutex> lock(registry.lock);
+    registry.enabledTags = (registry.enabledTags & ~tags) | SYSTRACE_TAG_ALWAYS;
+    updateActiveTags();
+}
+
+void TraceRecorder::start() noexcept {
+    Registry& registry = Registry::get();
+    std::lock_guard<Mutex> lock(registry.lock);
+    if (!registry.recording) {
+        registry.recording = true;
+        registry.startTime = now();
+        updateActiveTags();
+    }
+}
+
+void TraceRecorder::stop() noexcept {
+    Registry& registry = Registry::get();
+    std::lock_guard<Mutex> lock(registry.lock);
+    registry.recording = false;
+    updateActiveTags();
+}
+
+void TraceRecorder::clear() noexcept {
+    Registry& registry = Registry::get();
+    std::lock_guard<Mutex> lock(registry.lock);
+    for (auto& buffer : registry.buffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+    registry.startTime = now();
+}
+
+UTILS_NOINLINE
+TraceRecorder::ThreadBuffer* TraceRecorder::createThreadBuffer() noexcept {
+    Registry& registry = Registry::get();
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+#if defined(__linux__) || defined(__APPLE__)
+    pthread_getname_np(pthread_self(), buffer->name, sizeof(buffer->name));
+#endif
+    std::lock_guard<Mutex> lock(registry.lock);
+    buffer->index = uint32_t(registry.buffers.size());
+    if (!buffer->name[0]) {
+        snprintf(buffer->name, sizeof(buffer->name), "thread %u", buffer->index);
+    }
+    registry.buffers.push_back(std::move(buffer));
+    return registry.buffers.back().get();
+}
+
+void TraceRecorder::record(Type type, const char* name, int64_t value) noexcept {
+    ThreadBuffer* buffer = sThreadBuffer;
+    if (UTILS_UNLIKELY(!buffer)) {
+        buffer = createThreadBuffer();
+        sThreadBuffer = buffer;
+    }
+    const uint32_t head = buffer->head.load(std::memory_order_relaxed);
+    Event& event = buffer->events[head & (EVENTS_PER_THREAD - 1)];
+    event.time = now();
+    event.value = value;
+    event.type = type;
+    if (name) {
+        strncpy(event.name, name, sizeof(event.name) - 1);
+        event.name[sizeof(event.name) - 1] = 0;
+    }
+    // synchronizes with collect()
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+struct TraceRecorder::Collector {
+    struct Entry {
+        Event const* event;
+        uint32_t thread;
+    };
+
+    // All the events of all threads, sorted by time. END events without a matching BEGIN
+    // (because the ring buffer wrapped around) are skipped.
+    static std::vector<Entry> collect(std::vector<ThreadBuffer const*>& threads,
+            uint64_t* startTime) {
+        Registry& registry = Registry::get();
+        std::vector<Entry> entries;
+        {
+            std::lock_guard<Mutex> lock(registry.lock);
+            *startTime = registry.startTime;
+            for (auto const& buffer : registry.buffers) {
+                threads.push_back(buffer.get());
+            }
+        }
+        for (ThreadBuffer const* buffer : threads) {
+            const uint32_t head = buffer->head.load(std::memory_order_acquire);
+            const uint32_t count = std::min(head, uint32_t(TraceRecorder::EVENTS_PER_THREAD));
+            uint32_t depth = 0;
+            for (uint32_t i = head - count; i != head; i++) {
+                Event const& event = buffer->events[i & (TraceRecorder::EVENTS_PER_THREAD - 1)];
+                if (event.type == Type::BEGIN) {
+                    depth++;
+                } else if (event.type == Type::END) {
+                    if (!depth) {
+                        continue;
+                    }
+                    depth--;
+                }
+                entries.push_back({ &event, buffer->index });
+            }
+        }
+        // events of a given thread are already in order, keep it that way for equal times
+        std::stable_sort(entries.begin(), entries.end(), [](Entry const& lhs, Entry const& rhs) {
+            return lhs.event->time < rhs.event->time;
+        });
+        return entries;
+    }
+};
+
+std::string TraceRecorder::getChromeTrace() {
+    // see the "Trace Event Format" specification, times are in microseconds
+    std::vector<ThreadBuffer const*> threads;
+    uint64_t startTime;
+    auto const entries = Collector::collect(threads, &startTime);
+
+    std::string trace("{\"traceEvents\":[");
+    char buffer[128];
+    const char* separator = "";
+    for (ThreadBuffer const* thread : threads) {
+        snprintf(buffer, sizeof(buffer),
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                separator, thread->index);
+        trace += buffer;
+        appendJsonString(trace, thread->name);
+        trace += "}}";
+        separator = ",";
+    }
+
+    for (auto const& entry : entries) {
+        Event const& event = *entry.event;
+        const double ts = double(event.time > startTime ? event.time - startTime : 0) * 1e-3;
+        trace += separator;
+        switch (event.type) {
+            case Type::BEGIN:
+                trace += "{\"ph\":\"B\",\"name\":";
+                appendJsonString(trace, event.name);
+                break;
+            case Type::END:
+                trace += "{\"ph\":\"E\"";
+                break;
+            case Type::ASYNC_BEGIN:
+            case Type::ASYNC_END:
+                trace += event.type == Type::ASYNC_BEGIN ? "{\"ph\":\"b\"" : "{\"ph\":\"e\"";
+                trace += ",\"cat\":\"async\",\"name\":";
+                appendJsonString(trace, event.name);
+                snprintf(buffer, sizeof(buffer), ",\"id\":%lld", (long long)event.value);
+                trace += buffer;
+                break;
+            case Type::COUNTER:
+                trace += "{\"ph\":\"C\",\"name\":";
+                appendJsonString(trace, event.name);
+                snprintf(buffer, sizeof(buffer), ",\"args\":{\"value\":%lld}",
+                        (long long)event.value);
+                trace += buffer;
+                break;
+        }
+        snprintf(buffer, sizeof(buffer), ",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", entry.thread, ts);
+        trace += buffer;
+    }
+    trace += "]}";
+    return trace;
+}
+
+std::string TraceRecorder::getPerfettoTrace() {
+    // field numbers from perfetto's trace_packet.proto, track_event.proto and
+    // track_descriptor.proto
+    enum : uint32_t {
+        TRACE_PACKET = 1,
+        PACKET_TIMESTAMP = 8, PACKET_SEQUENCE_ID = 10, PACKET_TRACK_EVENT = 11,
+        PACKET_SEQUENCE_FLAGS = 13, PACKET_TRACK_DESCRIPTOR = 60,
+        TRACK_UUID = 1, TRACK_NAME = 2, TRACK_THREAD = 4, TRACK_COUNTER = 8,
+        THREAD_PID = 1, THREAD_TID = 2, THREAD_NAME = 5,
+        EVENT_TYPE = 9, EVENT_TRACK_UUID = 11, EVENT_NAME = 23, EVENT_COUNTER_VALUE = 30,
+    };
+    enum : uint64_t {
+        TYPE_SLICE_BEGIN = 1, TYPE_SLICE_END = 2, TYPE_COUNTER = 4,
+        SEQ_INCREMENTAL_STATE_CLEARED = 1,
+        SEQUENCE_ID = 1, PID = 1
+    };
+
+    std::vector<ThreadBuffer const*> threads;
+    uint64_t startTime;
+    auto const entries = Collector::collect(threads, &startTime);
+
+    std::string trace;
+    ProtoWriter out(trace);
+    bool first = true;
+    auto writePacket = [&](uint64_t time, uint32_t number, std::string const& payload) {
+        std::string packet;
+        ProtoWriter p(packet);
+        if (time) {
+            p.field(PACKET_TIMESTAMP, time);
+        }
+        p.field(PACKET_SEQUENCE_ID, uint64_t(SEQUENCE_ID));
+        if (first) {
+            p.field(PACKET_SEQUENCE_FLAGS, uint64_t(SEQ_INCREMENTAL_STATE_CLEARED));
+            first = false;
+        }
+        p.field(number, payload);
+        out.field(TRACE_PACKET, packet);
+    };
+
+    // one track per thread, uuids are the thread index + 1
+    for (ThreadBuffer const* thread : threads) {
+        std::string descriptor, threadDescriptor;
+        ProtoWriter t(threadDescriptor);
+        t.field(THREAD_PID, uint64_t(PID));
+        t.field(THREAD_TID, uint64_t(thread->index + 1));
+        t.field(THREAD_NAME, thread->name);
+        ProtoWriter d(descriptor);
+        d.field(TRACK_UUID, uint64_t(thread->index + 1));
+        d.field(TRACK_THREAD, threadDescriptor);
+        writePacket(0, PACKET_TRACK_DESCRIPTOR, descriptor);
+    }
+
+    // counters and async slices get a track per name (and cookie), created on first use
+    std::map<std::pair<std::string, int64_t>, uint64_t> tracks;
+    auto getTrack = [&](Event const& event, bool counter) -> uint64_t {
+        auto key = std::make_pair(std::string(event.name), counter ? 0 : event.value);
+        key.first += counter ? "" : " (async)";
+        auto pos = tracks.find(key);
+        if (pos != tracks.end()) {
+            return pos->second;
+        }
+        const uint64_t uuid = threads.size() + tracks.size() + 1;
+        tracks.emplace(key, uuid);
+        std::string descriptor;
+        ProtoWriter d(descriptor);
+        d.field(TRACK_UUID, uuid);
+        d.field(TRACK_NAME, event.name);
+        if (counter) {
+            d.field(TRACK_COUNTER, std::string());
+        }
+        writePacket(0, PACKET_TRACK_DESCRIPTOR, descriptor);
+        return uuid;
+    };
+
+    for (auto const& entry : entries) {
+        Event const& event = *entry.event;
+        std::string trackEvent;
+        ProtoWriter e(trackEvent);
+        switch (event.type) {
+            case Type::BEGIN:
+                e.field(EVENT_TYPE, uint64_t(TYPE_SLICE_BEGIN));
+                e.field(EVENT_TRACK_UUID, uint64_t(entry.thread + 1));
+                e.field(EVENT_NAME, event.name);
+                break;
+            case Type::END:
+                e.field(EVENT_TYPE, uint64_t(TYPE_SLICE_END));
+                e.field(EVENT_TRACK_UUID, uint64_t(entry.thread + 1));
+                break;
+            case Type::ASYNC_BEGIN:
+                e.field(EVENT_TYPE, uint64_t(TYPE_SLICE_BEGIN));
+                e.field(EVENT_TRACK_UUID, getTrack(event, false));
+                e.field(EVENT_NAME, event.name);
+                break;
+            case Type::ASYNC_END:
+                e.field(EVENT_TYPE, uint64_t(TYPE_SLICE_END));
+                e.field(EVENT_TRACK_UUID, getTrack(event, false));
+                break;
+            case Type::COUNTER:
+                e.field(EVENT_TYPE, uint64_t(TYPE_COUNTER));
+                e.field(EVENT_TRACK_UUID, getTrack(event, true));
+                e.field(EVENT_COUNTER_VALUE, uint64_t(event.value));
+                break;
+        }
+        writePacket(event.time, PACKET_TRACK_EVENT, trackEvent);
+    }
+    return trace;
+}
+
+} // namespace utils
@@ -319,3 +319,82 @@ TEST(AllocatorTest, STLAllocator) {
 
     EXPECT_EQ(0, arena.getListener().allocations.size());
 }
+
+TEST(AllocatorTest, TlsfAllocator) {
+    alignas(16) static char scratch[64 * 1024];
+    TlsfAllocator tlsf(scratch, scratch + sizeof(scratch));
+    EXPECT_EQ(1, tlsf.getStats().poolCount);
+
+    // allocations come from the area and are aligned
+    void* p = tlsf.alloc(100);
+    EXPECT_GE(p, (void*)scratch);
+    EXPECT_LT(p, (void*)(scratch + sizeof(scratch)));
+    EXPECT_EQ(0, uintptr_t(p) % alignof(std::max_align_t));
+    EXPECT_EQ(112, TlsfAllocator::getAllocationSize(p));
+
+    for (size_t alignment : { 32, 64, 256, 4096 }) {
+        void* q = tlsf.alloc(24, alignment);
+        EXPECT_EQ(0, uintptr_t(q) % alignment);
+        tlsf.free(q);
+    }
+
+    // freeing everything coalesces back into a single block, which we can allocate again
+    tlsf.free(p);
+    EXPECT_EQ(0, tlsf.getStats().used);
+    void* all = tlsf.alloc(32 * 1024);
+    EXPECT_NE(nullptr, all);
+    tlsf.free(all);
+
+    // random allocations, with tags
+    std::vector<std::pair<void*, size_t>> allocations;
+    srand(42);
+    for (size_t i = 0; i < 4096; i++) {
+        if (allocations.empty() || rand() % 3) {
+            size_t size = size_t(rand() % 1024) + 1;
+            tlsf.setTag(uint8_t(size % TlsfAllocator::TAG_COUNT));
+            char* q = (char*)tlsf.alloc(size);
+            ASSERT_NE(nullptr, q);
+            memset(q, int(i), size);
+            allocations.emplace_back(q, size);
+        } else {
+            size_t index = size_t(rand()) % allocations.size();
+            tlsf.free(allocations[index].first);
+            allocations[index] = allocations.back();
+            allocations.pop_back();
+        }
+    }
+    // the area was too small, pools were added
+    EXPECT_GT(tlsf.getStats().poolCount, 1);
+
+    size_t used = 0;
+    for (auto const& allocation : allocations) {
+        used += TlsfAllocator::getAllocationSize(allocation.first);
+        EXPECT_GE(TlsfAllocator::getAllocationSize(allocation.first), allocation.second);
+    }
+    EXPECT_EQ(used, tlsf.getStats().used);
+    EXPECT_LE(used, tlsf.getStats().highWatermark);
+
+    size_t tagUsed = 0;
+    for (size_t tag = 0; tag < TlsfAllocator::TAG_COUNT; tag++) {
+        tagUsed += tlsf.getStats().tagUsed[tag];
+    }
+    EXPECT_EQ(used, tagUsed);
+
+    for (auto const& allocation : allocations) {
+        tlsf.free(allocation.first);
+    }
+    EXPECT_EQ(0, tlsf.getStats().used);
+}
+
+TEST(AllocatorTest, TlsfArena) {
+    // the arena's tracking policy sees the actual allocation sizes, which makes
+    // TrackingPolicy::HighWatermark work with free(void*).
+    using TlsfArena = Arena<TlsfAllocator, LockingPolicy::NoLock, TrackingPolicy::HighWatermark>;
+    TlsfArena arena("tlsf", 64 * 1024);
+    struct Foo { char data[40]; };
+    Foo* foo = arena.make<Foo>();
+    EXPECT_NE(nullptr, foo);
+    EXPECT_EQ(48, arena.getAllocator().getStats().used);
+    arena.destroy(foo);
+    EXPECT_EQ(0, arena.getAllocator().getStats().used);
+}
@@ -176,3 +176,59 @@ TEST(EntityTest, NameComponent) {
 
     cm.gc(em);
 }
+
+TEST(EntityTest, DestroyedEntities) {
+    EntityManagerImpl em;
+
+    Entity entities[8];
+    em.create(8, entities);
+
+    EntityManager::Cursor cursor = 0;
+    Entity destroyed[8];
+    bool lost = false;
+    EXPECT_EQ(0, em.getDestroyedEntities(cursor, destroyed, 8, lost));
+
+    em.destroy(4, entities);
+    EXPECT_EQ(3, em.getDestroyedEntities(cursor, destroyed, 3, lost));
+    EXPECT_EQ(1, em.getDestroyedEntities(cursor, destroyed + 3, 8, lost));
+    EXPECT_EQ(0, em.getDestroyedEntities(cursor, destroyed, 8, lost));
+    EXPECT_FALSE(lost);
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(entities[i], destroyed[i]);
+    }
+
+    // after clear() the list can't tell what was destroyed
+    em.clear();
+    EXPECT_EQ(0, em.getDestroyedEntities(cursor, destroyed, 8, lost));
+    EXPECT_TRUE(lost);
+    lost = false;
+    EXPECT_EQ(0, em.getDestroyedEntities(cursor, destroyed, 8, lost));
+    EXPECT_FALSE(lost);
+}
+
+TEST(EntityTest, ComponentGc) {
+    EntityManagerImpl em;
+    NameComponentManager cm(em);
+
+    const size_t n = EntityManager::getMaxEntityCount();
+    std::unique_ptr<Entity[]> entities(new Entity[n]);
+    em.create(n, entities.get());
+    for (size_t i = 0; i < 16; i++) {
+        cm.addComponent(entities[i]);
+    }
+
+    // the components of the destroyed entities are found from the destroyed list
+    em.destroy(4, entities.get());
+    cm.gc(em);
+    EXPECT_EQ(12, cm.getComponentCount());
+    EXPECT_FALSE(cm.hasComponent(entities[0]));
+    EXPECT_TRUE(cm.hasComponent(entities[4]));
+
+    // more entities than the list can hold, all components are checked
+    em.destroy(n - 8, entities.get() + 8);
+    cm.gc(em);
+    EXPECT_EQ(4, cm.getComponentCount());
+    for (size_t i = 4; i < 8; i++) {
+        EXPECT_TRUE(cm.hasComponent(entities[i]));
+    }
+}
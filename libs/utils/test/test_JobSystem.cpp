@@ -16,13 +16,16 @@
 
 #include <gtest/gtest.h>
 
+#include <utils/JobGraph.h>
 #include <utils/JobSystem.h>
+#include <utils/StructureOfArrays.h>
 #include <utils/WorkStealingDequeue.h>
 
 #include <math/vec3.h>
 #include <math/mat3.h>
 
 #include <array>
+#include <chrono>
 #include <thread>
 #include <utils/Allocator.h>
 
@@ -219,6 +222,87 @@ TEST(JobSystem, JobSystemParallelChildren) {
 }
 
 
+TEST(JobSystem, JobSystemBigCoreChildren) {
+    JobSystem js;
+    js.adopt();
+
+    std::atomic_int calls = { 0 };
+    JobSystem::Job* root = js.setCoreClass(js.createJob(), JobSystem::CoreClass::BIG);
+    for (int i = 0; i < 256; i++) {
+        // children inherit the core class of their parent
+        js.run(js.createJob(root, [&calls](JobSystem&, JobSystem::Job*) {
+            calls++;
+        }));
+    }
+    js.runAndWait(root);
+    EXPECT_EQ(256, calls.load());
+
+    uint32_t bigCores, littleCores;
+    JobSystem::getCoreClasses(&bigCores, &littleCores);
+    EXPECT_NE(0u, bigCores);
+    EXPECT_EQ(0u, bigCores & littleCores);
+
+    js.emancipate();
+}
+
+
+TEST(JobSystem, LittleThreadsSleepWithBigJobs) {
+    // one big worker, three little ones
+    JobSystem js(4, 1, 1);
+    js.adopt();
+    EXPECT_EQ(1u, js.getBigThreadCount());
+    js.setInstrumentationEnabled(true);
+
+    // wakes up the workers, so that they go back to sleep instrumented
+    auto wakeUpWorkers = [&js]() {
+        JobSystem::Job* root = js.createJob();
+        for (size_t i = 0; i < 16; i++) {
+            js.run(jobs::createJob(js, root, []() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }));
+        }
+        js.runAndWait(root);
+    };
+    wakeUpWorkers();
+    js.resetInstrumentation();
+
+    // the big worker is kept busy while big jobs are queued, that only it and we can run
+    std::atomic_bool started = { false };
+    std::atomic_bool release = { false };
+    std::atomic_int calls = { 0 };
+    JobSystem::Job* root = js.setCoreClass(js.createJob(), JobSystem::CoreClass::BIG);
+    js.run(jobs::createJob(js, root, [&started, &release]() {
+        started = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+    }));
+    for (size_t i = 0; i < 8; i++) {
+        js.run(jobs::createJob(js, root, [&calls]() { calls++; }));
+    }
+    while (!started) {
+        std::this_thread::yield();
+    }
+    const auto window = std::chrono::milliseconds(100);
+    std::this_thread::sleep_for(window);
+    release = true;
+    js.runAndWait(root);
+    EXPECT_EQ(8, calls.load());
+
+    // the little threads slept instead of spinning, their sleep time is recorded as they wake up
+    wakeUpWorkers();
+    uint64_t littleSleepTime = 0;
+    for (auto const& s : js.getThreadStats()) {
+        if (!s.big && !s.adopted) {
+            littleSleepTime += s.sleepTime;
+        }
+    }
+    EXPECT_GE(littleSleepTime, uint64_t(std::chrono::nanoseconds(window).count()));
+
+    js.emancipate();
+}
+
+
 TEST(JobSystem, JobSystemSequentialChildren) {
     JobSystem js;
     js.adopt();
@@ -283,6 +367,36 @@ TEST(JobSystem, JobSystemParallelFor) {
     js.emancipate();
 }
 
+TEST(JobSystem, JobSystemParallelForSoa) {
+    JobSystem js;
+    js.adopt();
+
+    StructureOfArrays<uint8_t, float> soa;
+    soa.resize(1000);
+    const uint32_t granularity = uint32_t(decltype(soa)::getCacheLineGranularity());
+
+    std::atomic<uint32_t> total{ 0 };
+    auto functor = [&soa, &total, granularity](uint32_t start, uint32_t count) {
+        EXPECT_EQ(0, start % granularity);
+        for (uint32_t i = start; i < start + count; i++) {
+            soa.elementAt<0>(i)++;
+            soa.elementAt<1>(i) = float(i);
+        }
+        total += count;
+    };
+    JobSystem::Job* job = parallel_for(js, nullptr, soa, std::cref(functor),
+            CountSplitter<64>());
+    js.runAndWait(job);
+
+    EXPECT_EQ(1000, total);
+    for (size_t i = 0; i < soa.size(); i++) {
+        EXPECT_EQ(1, soa.elementAt<0>(i));
+        EXPECT_EQ(float(i), soa.elementAt<1>(i));
+    }
+
+    js.emancipate();
+}
+
 TEST(JobSystem, JobSystemDelegates) {
     JobSystem js;
     js.adopt();
@@ -341,5 +455,155 @@ TEST(JobSystem, JobSystemDelegates) {
     EXPECT_EQ(4, functor.result);
 
 
+    js.emancipate();
+}
+
+TEST(JobSystem, JobGraph) {
+    JobSystem js;
+    js.adopt();
+
+    std::array<float, 4096> data;
+    std::atomic_int processed = { 0 };
+    int first = 0;
+    int last = 0;
+    int runs = 0;
+
+    JobGraph graph;
+    JobGraph::Task process = graph.add([&](JobSystem& js, JobSystem::Job* parent) {
+        // children of the task must finish before its successors start
+        js.run(parallel_for(js, parent, data.data(), uint32_t(data.size()),
+                [&processed](float* d, uint32_t c) {
+                    std::fill_n(d, c, 1.0f);
+                    processed += c;
+                }, CountSplitter<64>()));
+    });
+    JobGraph::Task other = graph.add([&](JobSystem&, JobSystem::Job*) { first = 1; });
+    JobGraph::Task join = graph.then({ process, other }, [&](JobSystem&, JobSystem::Job*) {
+        EXPECT_EQ(data.size(), processed.load());
+        EXPECT_EQ(1, first);
+        last = 1;
+    });
+    graph.then(join, [&](JobSystem&, JobSystem::Job*) {
+        EXPECT_EQ(1, last);
+        runs++;
+    });
+    EXPECT_EQ(4, graph.getTaskCount());
+
+    // the same graph can be run several times
+    for (size_t i = 0; i < 16; i++) {
+        processed = 0;
+        first = last = 0;
+        graph.runAndWait(js);
+    }
+    EXPECT_EQ(16, runs);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, Instrumentation) {
+    JobSystem js(4);
+    js.adopt();
+    js.setInstrumentationEnabled(true);
+    EXPECT_TRUE(js.isInstrumentationEnabled());
+
+    std::atomic_int count = { 0 };
+    JobSystem::Job* root = js.createJob();
+    for (size_t i = 0; i < 256; i++) {
+        js.run(jobs::createJob(js, root, [&count]() { count++; }));
+    }
+    js.runAndWait(root);
+    EXPECT_EQ(256, count.load());
+
+    // the root job and its children
+    auto const stats = js.getThreadStats();
+    uint64_t jobCount = 0;
+    for (auto const& s : stats) {
+        EXPECT_LE(s.stealCount, s.stealAttempts);
+        jobCount += s.jobCount;
+    }
+    EXPECT_EQ(257, jobCount);
+
+    auto const timeline = js.getJobTimeline();
+    EXPECT_EQ(257, timeline.size());
+    for (size_t i = 1; i < timeline.size(); i++) {
+        EXPECT_LE(timeline[i - 1].begin, timeline[i].begin);
+        EXPECT_LE(timeline[i].begin, timeline[i].end);
+    }
+
+    std::string const trace = js.getChromeTrace();
+    EXPECT_EQ(0, trace.find("{\"traceEvents\":["));
+    EXPECT_EQ(trace.size() - 2, trace.rfind("]}"));
+
+    js.resetInstrumentation();
+    EXPECT_TRUE(js.getJobTimeline().empty());
+
+    js.setInstrumentationEnabled(false);
+    js.runAndWait(js.createJob());
+    EXPECT_TRUE(js.getJobTimeline().empty());
+
+    js.emancipate();
+}
+
+TEST(JobSystem, ThreadIndex) {
+    JobSystem js(4);
+    js.adopt();
+
+    // per-thread counters, written without synchronization
+    const size_t threadCount = js.getMaxThreadCount();
+    std::vector<uint32_t> counts(threadCount * 16);
+    JobSystem::Job* root = js.createJob();
+    for (size_t i = 0; i < 256; i++) {
+        js.run(jobs::createJob(js, root, [&js, &counts, threadCount]() {
+            const size_t index = js.getThreadIndex();
+            ASSERT_LT(index, threadCount);
+            counts[index * 16]++;   // one cache-line per thread
+        }));
+    }
+    js.runAndWait(root);
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < threadCount; i++) {
+        total += counts[i * 16];
+    }
+    EXPECT_EQ(256, total);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, RunAfterChildren) {
+    JobSystem js(4);
+    js.adopt();
+
+    // each node of a binary tree computes the size of its subtree in a continuation of its
+    // children, no job waits
+    struct Tree {
+        std::vector<uint32_t> sizes;
+        void visit(JobSystem& js, JobSystem::Job* parent, uint32_t i) {
+            js.run(js.createJob(parent, [this, i](JobSystem& js, JobSystem::Job* job) {
+                if (2 * i + 1 >= sizes.size()) {
+                    sizes[i] = 1;
+                    return;
+                }
+                JobSystem::Job* sum = js.createJob(job, [this, i](JobSystem&, JobSystem::Job*) {
+                    sizes[i] = sizes[2 * i + 1] + sizes[2 * i + 2] + 1;
+                });
+                visit(js, sum, 2 * i + 1);
+                visit(js, sum, 2 * i + 2);
+                js.runAfterChildren(sum);
+            }));
+        }
+    } tree;
+    tree.sizes.resize((1 << 12) - 1);
+
+    std::atomic<uint32_t> count = { 0 };
+    JobSystem::Job* root = js.createJob();
+    tree.visit(js, root, 0);
+    // a continuation without children runs right away
+    js.runAfterChildren(jobs::createJob(js, root, [&count]() { count++; }));
+    js.runAndWait(root);
+
+    EXPECT_EQ(tree.sizes.size(), tree.sizes[0]);
+    EXPECT_EQ(1, count);
+
     js.emancipate();
 }
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace utils;
+
+TEST(MutexTest, Contended) {
+    Mutex lock;
+    size_t counter = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; i++) {
+        threads.emplace_back([&lock, &counter]() {
+            for (size_t j = 0; j < 100000; j++) {
+                std::lock_guard<Mutex> guard(lock);
+                counter++;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(400000, counter);
+}
+
+TEST(ConditionTest, PingPong) {
+    Mutex lock;
+    Condition condition;
+    size_t turn = 0;
+    constexpr size_t COUNT = 10000;
+
+    // each thread waits for its turn, the notifications must never be lost
+    auto player = [&](size_t parity) {
+        for (size_t i = parity; i < COUNT; i += 2) {
+            std::unique_lock<Mutex> guard(lock);
+            condition.wait(guard, [&turn, i]() { return turn == i; });
+            turn++;
+            guard.unlock();
+            condition.notify_one();
+        }
+    };
+    std::thread ping(player, 0);
+    std::thread pong(player, 1);
+    ping.join();
+    pong.join();
+    EXPECT_EQ(COUNT, turn);
+}
+
+TEST(ConditionTest, NotifyAll) {
+    Mutex lock;
+    Condition condition;
+    bool ready = false;
+    size_t woken = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; i++) {
+        threads.emplace_back([&]() {
+            std::unique_lock<Mutex> guard(lock);
+            condition.wait(guard, [&ready]() { return ready; });
+            woken++;
+        });
+    }
+
+    // give the threads time to park, past their spinning
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    {
+        std::lock_guard<Mutex> guard(lock);
+        ready = true;
+    }
+    condition.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(4, woken);
+}
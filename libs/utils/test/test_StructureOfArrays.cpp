@@ -170,3 +170,88 @@ TEST(StructureOfArraysTest, Simple) {
     soa.push_back(0.0f, 1.0, std::move(destroyedFloat4));
 }
 
+
+TEST(StructureOfArraysTest, ColumnAlignment) {
+    using Soa = utils::StructureOfArrays<uint8_t, float, double>;
+    EXPECT_EQ(Soa::COLUMN_ALIGNMENT, Soa::getCacheLineGranularity());
+
+    Soa soa(13);
+    EXPECT_EQ(0, uintptr_t(soa.data<0>()) % Soa::COLUMN_ALIGNMENT);
+    EXPECT_EQ(0, uintptr_t(soa.data<1>()) % Soa::COLUMN_ALIGNMENT);
+    EXPECT_EQ(0, uintptr_t(soa.data<2>()) % Soa::COLUMN_ALIGNMENT);
+
+    // each array is padded to a whole cache line
+    EXPECT_GE(uintptr_t(soa.data<1>()), uintptr_t(soa.data<0>()) + Soa::COLUMN_ALIGNMENT);
+    EXPECT_GE(Soa::getNeededSize(13), Soa::COLUMN_ALIGNMENT * 3);
+}
+
+TEST(StructureOfArraysTest, BulkInsert) {
+    SoA soa;
+    soa.resize(4);
+    for (size_t i = 0; i < 4; i++) {
+        soa.elementAt<0>(i) = i;
+        soa.elementAt<1>(i) = i * 2;
+        soa.elementAt<2>(i) = TestFloat4(i * 4);
+    }
+    soa.elementAt<0>(1) = 1;
+
+    // insert in the middle, some elements land past the old end
+    soa.insert(1, 6);
+    EXPECT_EQ(10, soa.size());
+    EXPECT_EQ(0, soa.elementAt<0>(0));
+    for (size_t i = 1; i < 7; i++) {
+        EXPECT_EQ(0, soa.elementAt<0>(i));
+        EXPECT_EQ(0, soa.elementAt<1>(i));
+        EXPECT_EQ(float4{ 0 }, soa.elementAt<2>(i));
+    }
+    for (size_t i = 1; i < 4; i++) {
+        EXPECT_EQ(i    , soa.elementAt<0>(i + 6));
+        EXPECT_EQ(i * 2, soa.elementAt<1>(i + 6));
+        EXPECT_EQ(float4(i * 4), soa.elementAt<2>(i + 6));
+    }
+
+    // insert at the end
+    soa.insert(soa.size(), 2);
+    EXPECT_EQ(12, soa.size());
+    EXPECT_EQ(3, soa.elementAt<0>(9));
+    EXPECT_EQ(0, soa.elementAt<0>(11));
+}
+
+TEST(StructureOfArraysTest, Assign) {
+    SoA src;
+    src.resize(5);
+    for (size_t i = 0; i < 5; i++) {
+        src.elementAt<0>(i) = i;
+        src.elementAt<1>(i) = i * 2;
+        src.elementAt<2>(i) = TestFloat4(i * 4);
+    }
+
+    // the destination is reallocated to fit the source
+    SoA dst;
+    dst.resize(2);
+    dst.assign(src);
+    EXPECT_EQ(5, dst.size());
+    EXPECT_GE(dst.capacity(), 5);
+    EXPECT_NE(src.data<0>(), dst.data<0>());
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(i, dst.elementAt<0>(i));
+        EXPECT_EQ(i * 2, dst.elementAt<1>(i));
+        EXPECT_EQ(float4(i * 4), dst.elementAt<2>(i));
+    }
+
+    // the copies are independent of the source
+    src.elementAt<0>(0) = 42;
+    EXPECT_EQ(0, dst.elementAt<0>(0));
+
+    // a smaller source reuses the storage
+    float const* const storage = dst.data<0>();
+    src.resize(3);
+    dst.assign(src);
+    EXPECT_EQ(3, dst.size());
+    EXPECT_EQ(storage, dst.data<0>());
+    EXPECT_EQ(42, dst.elementAt<0>(0));
+
+    src.clear();
+    dst.assign(src);
+    EXPECT_EQ(0, dst.size());
+}
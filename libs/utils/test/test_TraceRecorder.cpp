@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include <utils/TraceRecorder.h>
+
+#include <string>
+#include <thread>
+
+using namespace utils;
+
+static size_t count(std::string const& s, const char* what) {
+    size_t n = 0;
+    for (size_t pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+TEST(TraceRecorderTest, ChromeTrace) {
+    const uint32_t tag = 1u << 31;
+    TraceRecorder::clear();
+
+    // nothing is recorded until we start, or for disabled tags
+    TraceRecorder::begin(tag, "before");
+    TraceRecorder::end(tag);
+    TraceRecorder::start();
+    TraceRecorder::value(tag, "disabled", 1);
+    TraceRecorder::enable(tag);
+
+    {
+        TraceRecorder::Scope scope(tag, "scope");
+        TraceRecorder::value(tag, "counter", 42);
+        std::thread([tag]() {
+            TraceRecorder::Scope scope(tag, "other \"thread\"");
+            TraceRecorder::asyncBegin(tag, "async", 7);
+        }).join();
+        TraceRecorder::asyncEnd(tag, "async", 7);
+    }
+
+    TraceRecorder::stop();
+    TraceRecorder::value(tag, "after", 1);
+    TraceRecorder::disable(tag);
+    EXPECT_FALSE(TraceRecorder::isRecording(tag));
+
+    std::string const trace = TraceRecorder::getChromeTrace();
+    EXPECT_EQ(0, trace.find("{\"traceEvents\":["));
+    EXPECT_EQ(trace.size() - 2, trace.rfind("]}"));
+    EXPECT_EQ(std::string::npos, trace.find("before"));
+    EXPECT_EQ(std::string::npos, trace.find("disabled"));
+    EXPECT_EQ(std::string::npos, trace.find("after"));
+    EXPECT_EQ(2, count(trace, "\"ph\":\"B\""));
+    EXPECT_EQ(2, count(trace, "\"ph\":\"E\""));
+    EXPECT_EQ(1, count(trace, "\"ph\":\"b\""));
+    EXPECT_EQ(1, count(trace, "\"ph\":\"e\""));
+    EXPECT_EQ(1, count(trace, "\"value\":42"));
+    EXPECT_NE(std::string::npos, trace.find("other \\\"thread\\\""));
+
+    EXPECT_FALSE(TraceRecorder::getPerfettoTrace().empty());
+
+    TraceRecorder::clear();
+    EXPECT_EQ(std::string::npos, TraceRecorder::getChromeTrace().find("\"ph\":\"B\""));
+}
+
+TEST(TraceRecorderTest, RingBuffer) {
+    const uint32_t tag = 1u << 31;
+    TraceRecorder::clear();
+    TraceRecorder::enable(tag);
+    TraceRecorder::start();
+    {
+        // the begin of this scope is overwritten, its end must be dropped
+        TraceRecorder::Scope scope(tag, "outer");
+        for (size_t i = 0; i < TraceRecorder::EVENTS_PER_THREAD; i++) {
+            TraceRecorder::Scope inner(tag, "inner");
+        }
+    }
+    TraceRecorder::stop();
+    TraceRecorder::disable(tag);
+
+    std::string const trace = TraceRecorder::getChromeTrace();
+    EXPECT_EQ(std::string::npos, trace.find("outer"));
+    EXPECT_EQ(count(trace, "\"ph\":\"B\""), count(trace, "\"ph\":\"E\""));
+    TraceRecorder::clear();
+}
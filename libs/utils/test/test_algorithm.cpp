@@ -18,7 +18,9 @@
 
 #include <utils/algorithm.h>
 
+#include <algorithm>
 #include <array>
+#include <vector>
 
 using namespace utils;
 
@@ -235,3 +237,39 @@ TEST(AlgorithmTest, Partition) {
     r = utils::partition_point(std::begin(array), std::end(array), [](int i) { return i < 2; });
     EXPECT_EQ(std::begin(array), r);
 }
+
+TEST(AlgorithmTest, RadixSort) {
+    struct Item {
+        uint64_t key;
+        uint32_t index;
+    };
+    auto getKey = [](Item const& item) { return item.key; };
+
+    // keys with only a few varying digits, and lots of duplicates to check stability
+    std::vector<Item> items(1000);
+    std::vector<Item> scratch(items.size());
+    uint32_t state = 1;
+    for (uint32_t i = 0; i < items.size(); i++) {
+        state = state * 1664525u + 1013904223u;
+        items[i] = { (uint64_t(state >> 28) << 56) | ((state >> 8) & 0x3Fu), i };
+    }
+    std::vector<Item> expected(items);
+    std::stable_sort(expected.begin(), expected.end(),
+            [](Item const& lhs, Item const& rhs) { return lhs.key < rhs.key; });
+
+    utils::radix_sort(items.data(), items.data() + items.size(), scratch.data(), getKey);
+    for (size_t i = 0; i < items.size(); i++) {
+        EXPECT_EQ(expected[i].key, items[i].key);
+        EXPECT_EQ(expected[i].index, items[i].index);
+    }
+
+    // all identical keys, nothing should move
+    std::vector<Item> same(16, Item{ ~0llu, 0 });
+    for (uint32_t i = 0; i < same.size(); i++) {
+        same[i].index = i;
+    }
+    utils::radix_sort(same.data(), same.data() + same.size(), scratch.data(), getKey);
+    for (uint32_t i = 0; i < same.size(); i++) {
+        EXPECT_EQ(i, same[i].index);
+    }
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the throughput and latency of the JobSystem, the WorkStealingDequeue, parallel_for
+ * with various CountSplitters, and of the thread-safe allocators under contention.
+ *
+ *  utils_benchmark [--json] [--repeat=N] [--threads=N]
+ *
+ * Each benchmark runs --repeat times (9 by default) and reports the median run. --threads sets
+ * the number of worker threads of the JobSystem (0, the default, lets the JobSystem decide) and
+ * the maximum number of threads contending for the allocators. With --json, each benchmark
+ * prints one JSON object per line.
+ */
+
+#include <utils/Allocator.h>
+#include <utils/compiler.h>
+#include <utils/JobSystem.h>
+#include <utils/WorkStealingDequeue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace utils;
+using namespace jobs;
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string name;
+    std::string config;         // parameters of the benchmark, e.g. the splitter
+    size_t threads;             // threads doing the work
+    size_t ops;                 // operations per run (jobs, allocations, elements...)
+    double ns;                  // median time of a run
+};
+
+static void printResult(Result const& r, bool json) {
+    const double nsPerOp = r.ns / double(r.ops);
+    const double mopsPerSecond = 1e3 / nsPerOp;
+    if (json) {
+        std::cout << "{"
+                << "\"name\": \"" << r.name << "\", "
+                << "\"config\": \"" << r.config << "\", "
+                << "\"threads\": " << r.threads << ", "
+                << "\"ops\": " << r.ops << ", "
+                << "\"run_us\": " << r.ns * 1e-3 << ", "
+                << "\"ns_per_op\": " << nsPerOp << ", "
+                << "\"mops_per_s\": " << mopsPerSecond
+                << "}" << std::endl;
+        return;
+    }
+    std::string title = r.name + (r.config.empty() ? "" : " (" + r.config + ")");
+    title.resize(std::max(title.size() + 1, size_t(48)), ' ');
+    std::cout << title << r.threads << " threads, "
+              << r.ns * 1e-3 << " us, "
+              << nsPerOp << " ns/op, "
+              << mopsPerSecond << " Mop/s" << std::endl;
+}
+
+// runs f() repeat times, after a warm-up run, and returns the median time in nanoseconds
+template<typename F>
+static double measure(size_t repeat, F f) {
+    std::vector<double> times(repeat);
+    f();
+#pragma nounroll
+    for (size_t i = 0; i < repeat; i++) {
+        Clock::time_point begin = Clock::now();
+        f();
+        Clock::time_point end = Clock::now();
+        times[i] = std::chrono::duration<double, std::nano>(end - begin).count();
+    }
+    std::nth_element(times.begin(), times.begin() + repeat / 2, times.end());
+    return times[repeat / 2];
+}
+
+// the work of each element of the parallel_for benchmarks, sized so that a few hundred elements
+// are needed to amortize the cost of a job
+UTILS_NOINLINE
+static void work(float* data, uint32_t count) noexcept {
+    for (uint32_t i = 0; i < count; i++) {
+        float v = data[i];
+        for (size_t j = 0; j < 16; j++) {
+            v = v * 0.999f + 0.5f;
+        }
+        data[i] = v;
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// WorkStealingDequeue
+// ------------------------------------------------------------------------------------------------
+
+static void benchmarkDequeue(std::vector<Result>& results, size_t repeat, size_t maxThreads) {
+    constexpr size_t SIZE = 4096;
+    constexpr size_t COUNT = 1u << 20u;
+    using Queue = WorkStealingDequeue<uint32_t, SIZE>;
+
+    { // the owner alone, in LIFO order, as a thread running its own jobs
+        Queue queue;
+        double ns = measure(repeat, [&queue]() {
+            for (size_t i = 0; i < COUNT; i += SIZE) {
+                for (uint32_t j = 0; j < SIZE; j++) {
+                    queue.push(j + 1);
+                }
+                for (size_t j = 0; j < SIZE; j++) {
+                    queue.pop();
+                }
+            }
+        });
+        results.push_back({ "dequeue push/pop", "", 1, COUNT, ns });
+    }
+
+    // the owner keeps pushing and popping while the other threads steal all they can
+    for (size_t thieves = 1; thieves < maxThreads; thieves *= 2) {
+        Queue queue;
+        std::atomic<bool> running = { true };
+        std::atomic<size_t> stolen = { 0 };
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < thieves; t++) {
+            threads.emplace_back([&]() {
+                size_t count = 0;
+                while (running.load(std::memory_order_relaxed)) {
+                    count += queue.steal() ? 1 : 0;
+                }
+                stolen.fetch_add(count, std::memory_order_relaxed);
+            });
+        }
+        double ns = measure(repeat, [&queue]() {
+            for (size_t i = 0; i < COUNT; i += 16) {
+                for (uint32_t j = 0; j < 16; j++) {
+                    queue.push(j + 1);
+                }
+                while (queue.pop()) {
+                }
+            }
+        });
+        running = false;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        results.push_back({ "dequeue push/pop vs steal",
+                std::to_string(stolen.load() / (repeat + 1)) + " stolen per run",
+                thieves + 1, COUNT, ns });
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// JobSystem
+// ------------------------------------------------------------------------------------------------
+
+// runs f() once with the instrumentation enabled, and returns the percentage of the jobs
+// executed that were stolen
+template<typename F>
+static std::string stealRatio(JobSystem& js, F f) {
+    js.resetInstrumentation();
+    js.setInstrumentationEnabled(true);
+    f();
+    js.setInstrumentationEnabled(false);
+    uint64_t jobs = 0;
+    uint64_t steals = 0;
+    for (JobSystem::ThreadStats const& stats : js.getThreadStats()) {
+        jobs += stats.jobCount;
+        steals += stats.stealCount;
+    }
+    js.resetInstrumentation();
+    return std::to_string(jobs ? (steals * 100 + jobs / 2) / jobs : 0) + "%";
+}
+
+static void benchmarkJobs(std::vector<Result>& results, size_t repeat, JobSystem& js) {
+    const size_t threads = js.getMaxThreadCount();
+
+    { // the round trip of an empty job run by the calling thread
+        constexpr size_t COUNT = 4096;
+        double ns = measure(repeat, [&js]() {
+            for (size_t i = 0; i < COUNT; i++) {
+                js.runAndWait(js.createJob());
+            }
+        });
+        results.push_back({ "empty job latency", "runAndWait", 1, COUNT, ns });
+    }
+
+    // jobs spawned by the calling thread, the workers steal what they can
+    for (size_t count : { 256u, 1024u, 4096u }) {
+        auto spawn = [&js, count]() {
+            JobSystem::Job* root = js.createJob();
+            for (size_t i = 0; i < count; i++) {
+                js.run(js.createJob(root));
+            }
+            js.runAndWait(root);
+        };
+        double ns = measure(repeat, spawn);
+        results.push_back({ "job spawn",
+                std::to_string(count) + " children, " + stealRatio(js, spawn) + " stolen",
+                threads, count, ns });
+    }
+
+    { // jobs spawning jobs, so that all the threads create jobs and steal from each other
+        constexpr size_t FANOUT = 16;
+        constexpr size_t COUNT = FANOUT + FANOUT * FANOUT + FANOUT * FANOUT * FANOUT;
+        auto spawn = [&js]() {
+            JobSystem::Job* root = js.createJob();
+            for (size_t i = 0; i < FANOUT; i++) {
+                js.run(js.createJob(root, [](JobSystem& s, JobSystem::Job* p) {
+                    for (size_t j = 0; j < FANOUT; j++) {
+                        s.run(s.createJob(p, [](JobSystem& t, JobSystem::Job* q) {
+                            for (size_t k = 0; k < FANOUT; k++) {
+                                t.run(t.createJob(q));
+                            }
+                        }));
+                    }
+                }));
+            }
+            js.runAndWait(root);
+        };
+        double ns = measure(repeat, spawn);
+        results.push_back({ "job spawn",
+                "nested, fan-out 16, " + stealRatio(js, spawn) + " stolen",
+                threads, COUNT, ns });
+    }
+}
+
+template<size_t COUNT, size_t MAX_SPLITS>
+static void benchmarkParallelFor(std::vector<Result>& results, size_t repeat, JobSystem& js,
+        std::vector<float>& data) {
+    const uint32_t size = uint32_t(data.size());
+    double ns = measure(repeat, [&js, &data, size]() {
+        js.runAndWait(parallel_for(js, nullptr, data.data(), size,
+                [](float* d, uint32_t c) { work(d, c); },
+                CountSplitter<COUNT, MAX_SPLITS>()));
+    });
+    results.push_back({ "parallel_for",
+            "CountSplitter<" + std::to_string(COUNT) + ", " + std::to_string(MAX_SPLITS) + ">",
+            js.getMaxThreadCount(), size, ns });
+}
+
+static void benchmarkParallelFor(std::vector<Result>& results, size_t repeat, JobSystem& js) {
+    for (size_t size : { 4096u, 65536u, 1048576u }) {
+        std::vector<float> data(size, 1.0f);
+
+        // the baseline: the same work on the calling thread
+        double ns = measure(repeat, [&data]() {
+            work(data.data(), uint32_t(data.size()));
+        });
+        results.push_back({ "parallel_for", "serial", 1, size, ns });
+
+        benchmarkParallelFor<16, 12>(results, repeat, js, data);
+        benchmarkParallelFor<64, 12>(results, repeat, js, data);
+        benchmarkParallelFor<256, 12>(results, repeat, js, data);
+        benchmarkParallelFor<1024, 12>(results, repeat, js, data);
+        benchmarkParallelFor<4096, 12>(results, repeat, js, data);
+        benchmarkParallelFor<64, 4>(results, repeat, js, data);
+        benchmarkParallelFor<64, 6>(results, repeat, js, data);
+        benchmarkParallelFor<64, 8>(results, repeat, js, data);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Allocators
+// ------------------------------------------------------------------------------------------------
+
+// each thread keeps a few allocations alive, as the users of the arenas typically do
+template<typename A>
+static void allocFree(A& allocator, size_t count) noexcept {
+    constexpr size_t LIVE = 16;
+    void* live[LIVE];
+    for (size_t i = 0; i < count; i += LIVE) {
+        for (size_t j = 0; j < LIVE; j++) {
+            live[j] = allocator.alloc(64, 16);
+        }
+        for (size_t j = 0; j < LIVE; j++) {
+            allocator.free(live[j]);
+        }
+    }
+}
+
+struct Malloc {
+    void* alloc(size_t size, size_t) noexcept { return ::malloc(size); }
+    void free(void* p) noexcept { ::free(p); }
+};
+
+template<typename A>
+static void benchmarkAllocator(std::vector<Result>& results, size_t repeat, size_t maxThreads,
+        char const* name, A& allocator) {
+    constexpr size_t COUNT = 1u << 16u;     // per thread
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        double ns = measure(repeat, [&allocator, threads]() {
+            std::vector<std::thread> workers;
+            std::atomic<size_t> ready = { 0 };
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&allocator, &ready, threads]() {
+                    // wait for all the threads to start, so they actually contend
+                    ready.fetch_add(1, std::memory_order_relaxed);
+                    while (ready.load(std::memory_order_relaxed) != threads) {
+                    }
+                    allocFree(allocator, COUNT);
+                });
+            }
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+        });
+        results.push_back({ "alloc/free", name, threads, COUNT * threads, ns });
+    }
+}
+
+static void benchmarkAllocators(std::vector<Result>& results, size_t repeat, size_t maxThreads) {
+    // large enough for 16 live allocations per thread
+    const size_t size = std::max(maxThreads, size_t(1)) * 16 * 64 * 2;
+
+    Arena<PoolAllocator<64, 16>, LockingPolicy::SpinLock> spinLock("SpinLock", size);
+    benchmarkAllocator(results, repeat, maxThreads, "PoolAllocator, SpinLock", spinLock);
+
+    Arena<PoolAllocator<64, 16>, LockingPolicy::Mutex> mutex("Mutex", size);
+    benchmarkAllocator(results, repeat, maxThreads, "PoolAllocator, Mutex", mutex);
+
+    Arena<PoolAllocator<64, 16, 0, AtomicFreeList>, LockingPolicy::NoLock> atomic(
+            "AtomicFreeList", size);
+    benchmarkAllocator(results, repeat, maxThreads, "PoolAllocator, AtomicFreeList", atomic);
+
+    Arena<TlsfAllocator, LockingPolicy::SpinLock> tlsf("Tlsf", size * 4);
+    benchmarkAllocator(results, repeat, maxThreads, "TlsfAllocator, SpinLock", tlsf);
+
+    Malloc heap;
+    benchmarkAllocator(results, repeat, maxThreads, "malloc", heap);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static bool parseSize(char const* arg, char const* name, size_t* value) {
+    const size_t len = strlen(name);
+    if (!strncmp(arg, name, len) && arg[len] == '=') {
+        *value = size_t(strtoul(arg + len + 1, nullptr, 10));
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    size_t repeat = 9;
+    size_t threadCount = 0;
+    for (int i = 1; i < argc; i++) {
+        char const* arg = argv[i];
+        if (!strcmp(arg, "--json")) {
+            json = true;
+        } else if (!parseSize(arg, "--repeat", &repeat) &&
+                !parseSize(arg, "--threads", &threadCount)) {
+            std::cerr << "usage: " << argv[0] << " [--json] [--repeat=N] [--threads=N]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    repeat = std::max(repeat, size_t(1));
+
+    // results are printed as each group of benchmarks completes
+    std::vector<Result> results;
+    auto flush = [&results, json]() {
+        for (Result const& result : results) {
+            printResult(result, json);
+        }
+        results.clear();
+    };
+
+    {
+        JobSystem js(threadCount);
+        js.adopt();
+        benchmarkJobs(results, repeat, js);
+        flush();
+        benchmarkParallelFor(results, repeat, js);
+        flush();
+        js.emancipate();
+        if (!threadCount) {
+            // the worker threads and the calling thread
+            threadCount = js.getMaxThreadCount();
+        }
+    }
+    benchmarkDequeue(results, repeat, std::max(threadCount, size_t(2)));
+    flush();
+    benchmarkAllocators(results, repeat, std::max(threadCount, size_t(1)));
+    flush();
+    return 0;
+}
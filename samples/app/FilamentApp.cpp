@@ -40,6 +40,7 @@
 #include <filament/View.h>
 
 #include <filagui/ImGuiHelper.h>
+#include <filagui/StatisticsOverlay.h>
 
 #include "Cube.h"
 #include "NativeWindowHelper.h"
@@ -163,6 +164,7 @@ void FilamentApp::run(const Config& config, SetupCallback setupCallback,
     if (imguiCallback) {
         mImGuiHelper = std::make_unique<ImGuiHelper>(mEngine, window->mUiView->getView(),
             getRootPath() + "assets/fonts/Roboto-Medium.ttf");
+        mStatisticsOverlay = std::make_unique<StatisticsOverlay>(mEngine);
         ImGuiIO& io = ImGui::GetIO();
         #ifdef WIN32
             SDL_SysWMinfo wmInfo;
@@ -270,6 +272,10 @@ void FilamentApp::run(const Config& config, SetupCallback setupCallback,
                     if (event.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
                         mClosed = true;
                     }
+                    // F1 toggles the statistics overlay
+                    if (event.key.keysym.scancode == SDL_SCANCODE_F1 && mStatisticsOverlay) {
+                        mStatisticsOverlay->setVisible(!mStatisticsOverlay->isVisible());
+                    }
                     break;
                 case SDL_MOUSEWHEEL:
                     if (!io || !io->WantCaptureMouse)
@@ -337,7 +343,12 @@ void FilamentApp::run(const Config& config, SetupCallback setupCallback,
             float timeStep = mTime > 0 ? (float)((double)(now - mTime) / frequency) :
                     (float)(1.0f / 60.0f);
             mTime = now;
-            mImGuiHelper->render(timeStep, imguiCallback);
+            mImGuiHelper->render(timeStep,
+                    [this, &imguiCallback, &window](Engine* engine, View* view) {
+                        imguiCallback(engine, view);
+                        mStatisticsOverlay->draw(window->getRenderer(),
+                                window->mMainView->getView());
+                    });
         }
 
         window->mMainCameraMan.updateCameraTransform();
@@ -372,6 +383,7 @@ void FilamentApp::run(const Config& config, SetupCallback setupCallback,
     }
 
     if (mImGuiHelper) {
+        mStatisticsOverlay.reset();
         mImGuiHelper.reset();
     }
 
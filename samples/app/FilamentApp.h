@@ -41,6 +41,7 @@ class View;
 
 namespace filagui {
 class ImGuiHelper;
+class StatisticsOverlay;
 } // namespace filagui
 
 class IBL;
@@ -199,6 +200,7 @@ private:
     filament::Material const* mDepthMaterial = nullptr;
     filament::MaterialInstance* mDepthMI = nullptr;
     std::unique_ptr<filagui::ImGuiHelper> mImGuiHelper;
+    std::unique_ptr<filagui::StatisticsOverlay> mStatisticsOverlay;
     AnimCallback mAnimation;
 };
 
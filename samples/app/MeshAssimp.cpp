@@ -30,6 +30,8 @@
 
 #include <math/norm.h>
 
+#include <utils/JobSystem.h>
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
@@ -234,29 +236,23 @@ bool MeshAssimp::setFromFile(const Path& file,
     //      aiProcess_OptimizeGraph
     //      aiProcess_PreTransformVertices
 
-    const std::function<void(aiNode const* node, size_t& totalVertexCount, size_t& totalIndexCount)>
-            countVertices = [scene, &countVertices]
-            (aiNode const* node, size_t& totalVertexCount, size_t& totalIndexCount) {
-        for (size_t i = 0; i < node->mNumMeshes; i++) {
-            aiMesh const* mesh = scene->mMeshes[node->mMeshes[i]];
-            totalVertexCount += mesh->mNumVertices;
-
-            const aiFace* faces = mesh->mFaces;
-            const size_t numFaces = mesh->mNumFaces;
-            totalIndexCount += numFaces * faces[0].mNumIndices;
-        }
-
-        for (size_t i = 0; i < node->mNumChildren; i++) {
-            countVertices(node->mChildren[i], totalVertexCount, totalIndexCount);
-        }
+    // The nodes are traversed in order to lay out the vertices and indices of each aiMesh, then
+    // the meshes are converted in parallel: the result doesn't depend on the scheduling.
+    struct Task {
+        aiMesh const* mesh;
+        size_t vertexOffset;
+        size_t indexOffset;
     };
+    std::vector<Task> tasks;
+    size_t vertexCount = outPositions.size();
+    size_t indexCount = outIndices.size();
 
     size_t deep = 0;
     size_t depth = 0;
 
     const std::function<void(aiNode const* node, int parentIndex)> processNode =
-            [scene, &processNode, &outParents, &deep, &depth,
-                    &outIndices, &outPositions, &outTangents, &outTexCoords, &outMeshes]
+            [scene, &processNode, &outParents, &deep, &depth, &tasks, &vertexCount, &indexCount,
+                    &outMeshes]
             (aiNode const* node, int parentIndex) {
 
         mat4f const& current = transpose(*reinterpret_cast<mat4f const*>(&node->mTransformation));
@@ -264,48 +260,26 @@ bool MeshAssimp::setFromFile(const Path& file,
         size_t totalIndices = 0;
         outParents.push_back(parentIndex);
         outMeshes.push_back(Mesh{});
-        outMeshes.back().offset = outIndices.size();
+        outMeshes.back().offset = indexCount;
         outMeshes.back().transform = current;
 
-        // Bias and scale factor when storing tangent frames in normalized short4
-        const float bias = 1.0f / 32767.0f;
-        const float factor = (float) (sqrt(1.0 - (double) bias * (double) bias));
-
         for (size_t i = 0; i < node->mNumMeshes; i++) {
             aiMesh const* mesh = scene->mMeshes[node->mMeshes[i]];
 
-            float3 const* positions  = reinterpret_cast<float3 const*>(mesh->mVertices);
-            float3 const* tangents   = reinterpret_cast<float3 const*>(mesh->mTangents);
-            float3 const* bitangents = reinterpret_cast<float3 const*>(mesh->mBitangents);
-            float3 const* normals    = reinterpret_cast<float3 const*>(mesh->mNormals);
-            float3 const* texCoords  = reinterpret_cast<const float3*>(mesh->mTextureCoords[0]);
-
             const size_t numVertices = mesh->mNumVertices;
             if (numVertices > 0) {
                 const aiFace* faces = mesh->mFaces;
                 const size_t numFaces = mesh->mNumFaces;
 
                 if (numFaces > 0) {
-                    size_t indicesOffset = outPositions.size();
-
-                    for (size_t j = 0; j < numVertices; j++) {
-                        quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
-                        outTangents.push_back(packSnorm16(q.xyzw));
-                        outTexCoords.emplace_back(texCoords[j].xy);
-                        outPositions.emplace_back(positions[j], 1.0_h);
-                    }
-
                     // all faces should be triangles since we configure assimp to triangulate faces
                     size_t indicesCount = numFaces * faces[0].mNumIndices;
-                    size_t indexBufferOffset = outIndices.size();
+                    size_t indexBufferOffset = indexCount;
                     totalIndices += indicesCount;
 
-                    for (size_t j = 0; j < numFaces; ++j) {
-                        const aiFace& face = faces[j];
-                        for (size_t k = 0; k < face.mNumIndices; ++k) {
-                            outIndices.push_back(uint32_t(face.mIndices[k] + indicesOffset));
-                        }
-                    }
+                    tasks.push_back({ mesh, vertexCount, indexCount });
+                    vertexCount += numVertices;
+                    indexCount += indicesCount;
 
                     uint32_t materialId = mesh->mMaterialIndex;
                     aiMaterial const* material = scene->mMaterials[materialId];
@@ -383,27 +357,72 @@ bool MeshAssimp::setFromFile(const Path& file,
     if (scene) {
         aiNode const* node = scene->mRootNode;
 
-        size_t totalVertexCount = 0;
-        size_t totalIndexCount = 0;
-
-        countVertices(node, totalVertexCount, totalIndexCount);
-
-        outPositions.reserve(outPositions.size() + totalVertexCount);
-        outTangents.reserve(outTangents.size() + totalVertexCount);
-        outTexCoords.reserve(outTexCoords.size() + totalVertexCount);
-        outIndices.reserve(outIndices.size() + totalIndexCount);
-
+        const size_t firstMesh = outMeshes.size();
         processNode(node, -1);
 
         std::cout << "Hierarchy depth = " << depth << std::endl;
 
+        outPositions.resize(vertexCount);
+        outTangents.resize(vertexCount);
+        outTexCoords.resize(vertexCount);
+        outIndices.resize(indexCount);
+
+        // the main thread belongs to the engine's JobSystem
+        JobSystem& js = mEngine.getJobSystem();
+
+        // pack the tangent frames, convert the attributes to half floats and offset the indices
+        auto convertMeshes = [&](uint32_t first, uint32_t count) {
+            // Bias and scale factor when storing tangent frames in normalized short4
+            const float bias = 1.0f / 32767.0f;
+            const float factor = (float) (sqrt(1.0 - (double) bias * (double) bias));
+
+            for (size_t t = first; t < first + count; t++) {
+                Task const& task = tasks[t];
+                aiMesh const* mesh = task.mesh;
+
+                float3 const* positions  = reinterpret_cast<float3 const*>(mesh->mVertices);
+                float3 const* tangents   = reinterpret_cast<float3 const*>(mesh->mTangents);
+                float3 const* bitangents = reinterpret_cast<float3 const*>(mesh->mBitangents);
+                float3 const* normals    = reinterpret_cast<float3 const*>(mesh->mNormals);
+                float3 const* texCoords  = reinterpret_cast<const float3*>(mesh->mTextureCoords[0]);
+
+                half4*  const dstPositions = outPositions.data() + task.vertexOffset;
+                short4* const dstTangents  = outTangents.data()  + task.vertexOffset;
+                half2*  const dstTexCoords = outTexCoords.data() + task.vertexOffset;
+                for (size_t j = 0, c = mesh->mNumVertices; j < c; j++) {
+                    quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
+                    dstTangents[j] = packSnorm16(q.xyzw);
+                    dstTexCoords[j] = half2(texCoords[j].xy);
+                    dstPositions[j] = half4(positions[j], 1.0_h);
+                }
+
+                uint32_t* dstIndices = outIndices.data() + task.indexOffset;
+                for (size_t j = 0, c = mesh->mNumFaces; j < c; ++j) {
+                    const aiFace& face = mesh->mFaces[j];
+                    for (size_t k = 0; k < face.mNumIndices; ++k) {
+                        *dstIndices++ = uint32_t(face.mIndices[k] + task.vertexOffset);
+                    }
+                }
+            }
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(tasks.size()),
+                std::ref(convertMeshes), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+
         // compute the aabb
-        for (auto& mesh : outMeshes) {
-            mesh.aabb = RenderableManager::computeAABB(
-                    outPositions.data(),
-                    outIndices.data() + mesh.offset,
-                    mesh.count);
-        }
+        auto computeBounds = [&](uint32_t first, uint32_t count) {
+            for (size_t i = first; i < first + count; i++) {
+                Mesh& mesh = outMeshes[i];
+                mesh.aabb = RenderableManager::computeAABB(
+                        outPositions.data(),
+                        outIndices.data() + mesh.offset,
+                        mesh.count);
+            }
+        };
+        job = jobs::parallel_for(js, nullptr, uint32_t(firstMesh),
+                uint32_t(outMeshes.size() - firstMesh),
+                std::ref(computeBounds), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
 
         return true;
     }
@@ -36,23 +36,26 @@
 
 #include "app/Config.h"
 #include "app/FilamentApp.h"
-#include "app/MeshIO.h"
 
 #include <stb_image.h>
 #include <utils/EntityManager.h>
 
 #include <filamat/MaterialBuilder.h>
+
 #include <filament/LightManager.h>
 
+#include <filameshio/MeshReader.h>
+
 using namespace math;
 using namespace filament;
 using namespace filamat;
+using namespace filamesh;
 using namespace utils;
 
 static std::vector<Path> g_filenames;
 
 static std::map<std::string, MaterialInstance*> g_materialInstances;
-static std::vector<MeshIO::Mesh> g_meshes;
+static std::vector<MeshReader::Mesh> g_meshes;
 static const Material* g_material;
 static Entity g_light;
 static Texture* g_opacityMaskMap = nullptr;
@@ -226,7 +229,7 @@ static void setup(Engine* engine, View* view, Scene* scene) {
     auto& rcm = engine->getRenderableManager();
     auto& tcm = engine->getTransformManager();
     for (auto filename : g_filenames) {
-        MeshIO::Mesh mesh  = MeshIO::loadMeshFromFile(engine, filename, g_materialInstances);
+        MeshReader::Mesh mesh = MeshReader::loadMeshFromFile(engine, filename, g_materialInstances);
         if (mesh.renderable) {
             auto ti = tcm.getInstance(mesh.renderable);
             tcm.setTransform(ti, mat4f{ mat3f(g_config.scale), float3(0.0f, 0.0f, -4.0f) } *
@@ -178,9 +178,11 @@ static Asset getPngTexture(const Asset& rawfile) {
 
 }
 
-static Asset getKtxTexture(const Asset& rawfile) {
-    Asset result = {};
-    result.texture.reset(new KtxBundle(rawfile.rawData.get(), rawfile.rawSize));
+// The bundle references the blobs of the raw file in place, so the asset keeps the raw data.
+static Asset getKtxTexture(Asset rawfile) {
+    Asset result = std::move(rawfile);
+    result.texture.reset(new KtxBundle(result.rawData.get(), result.rawSize,
+            KtxBundle::Storage::IN_PLACE));
     return result;
 }
 
@@ -192,7 +194,7 @@ Asset getTexture(const char* name) {
         return getPngTexture(rawfile);
     }
     // Do not check for KTX here, sometimes we use an alternate file extension.
-    return getKtxTexture(rawfile);
+    return getKtxTexture(std::move(rawfile));
 }
 
 Asset getCubemap(const char* name) {
@@ -233,7 +235,23 @@ SkyLight getSkyLight(Engine& engine, const char* name) {
         shReader >> result.bands[i].r >> result.bands[i].g >> result.bands[i].b;
     }
 
-    // Copy over the miplevels for the indirect light.
+    // The miplevels are uploaded straight from the KTX data, which is freed once the driver has
+    // consumed all of them.
+    struct Uploader {
+        filaweb::Asset* asset;
+        uint32_t refcount;
+    };
+
+    const auto release = [](void* buffer, size_t size, void* user) {
+        auto uploader = (Uploader*) user;
+        if (--uploader->refcount == 0) {
+            uploader->asset->texture.reset();
+            uploader->asset->rawData.reset();
+            delete uploader;
+        }
+    };
+
+    // Upload the miplevels for the indirect light.
     auto info = asset.envIBL->texture->getInfo();
     uint32_t nmips = asset.envIBL->texture->getNumMipLevels();
     Texture* texture = Texture::Builder()
@@ -245,7 +263,7 @@ SkyLight getSkyLight(Engine& engine, const char* name) {
         .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
         .build(engine);
     size_t size = info.pixelWidth;
-    uint32_t i = 0;
+    Uploader* uploader = new Uploader {asset.envIBL.get(), nmips};
     for (uint32_t mip = 0; mip < nmips; ++mip, size >>= 1) {
         const size_t faceSize = size * size * 4;
         Texture::FaceOffsets offsets;
@@ -255,20 +273,14 @@ SkyLight getSkyLight(Engine& engine, const char* name) {
         offsets.ny = faceSize * 3;
         offsets.pz = faceSize * 4;
         offsets.nz = faceSize * 5;
-        Texture::PixelBufferDescriptor buffer(
-                malloc(faceSize * 6), faceSize * 6,
-                Texture::Format::RGBM, Texture::Type::UBYTE,
-                [](void* buffer, size_t size, void* user) {
-                    free(buffer);
-                }, /* user = */ nullptr);
-        uint8_t* pbdPixels = static_cast<uint8_t*>(buffer.buffer);
+        // The six faces of a miplevel are contiguous in KTX.
         uint8_t* ktxPixels;
         uint32_t ktxSize;
         asset.envIBL->texture->getBlob({mip}, &ktxPixels, &ktxSize);
-        memcpy(pbdPixels, ktxPixels, faceSize * 6);
+        Texture::PixelBufferDescriptor buffer(ktxPixels, faceSize * 6,
+                Texture::Format::RGBM, Texture::Type::UBYTE, release, uploader);
         texture->setImage(engine, mip, std::move(buffer), offsets);
     }
-    asset.envIBL->texture.reset();
 
     result.indirectLight = IndirectLight::Builder()
         .reflections(texture)
@@ -276,7 +288,7 @@ SkyLight getSkyLight(Engine& engine, const char* name) {
         .intensity(30000.0f)
         .build(engine);
 
-    // Copy a single miplevel for the blurry skybox
+    // Upload a single miplevel for the blurry skybox
     info = asset.envSky->texture->getInfo();
     size = info.pixelWidth;
     Texture* skybox = Texture::Builder()
@@ -296,20 +308,14 @@ SkyLight getSkyLight(Engine& engine, const char* name) {
         offsets.ny = faceSize * 3;
         offsets.pz = faceSize * 4;
         offsets.nz = faceSize * 5;
-        Texture::PixelBufferDescriptor buffer(
-                malloc(faceSize * 6), faceSize * 6,
-                Texture::Format::RGBA, Texture::Type::UBYTE,
-                [](void* buffer, size_t size, void* user) {
-                    free(buffer);
-                }, /* user = */ nullptr);
-        uint8_t* pbdPixels = static_cast<uint8_t*>(buffer.buffer);
         uint8_t* ktxPixels;
         uint32_t ktxSize;
         asset.envSky->texture->getBlob({}, &ktxPixels, &ktxSize);
-        memcpy(pbdPixels, ktxPixels, faceSize * 6);
+        Texture::PixelBufferDescriptor buffer(ktxPixels, faceSize * 6,
+                Texture::Format::RGBA, Texture::Type::UBYTE, release,
+                new Uploader {asset.envSky.get(), 1});
         skybox->setImage(engine, 0, std::move(buffer), offsets);
     }
-    asset.envSky->texture.reset();
     result.skybox = Skybox::Builder().environment(skybox).build(engine);
 
     return result;
@@ -322,6 +328,10 @@ T toFilamentEnum(uint32_t format) {
         case KtxBundle::RGBA_S3TC_DXT1: return T::DXT1_RGBA;
         case KtxBundle::RGBA_S3TC_DXT3: return T::DXT3_RGBA;
         case KtxBundle::RGBA_S3TC_DXT5: return T::DXT5_RGBA;
+        case KtxBundle::RGBA_BPTC_UNORM: return T::RGBA_BPTC_UNORM;
+        case KtxBundle::SRGB_ALPHA_BPTC_UNORM: return T::SRGB_ALPHA_BPTC_UNORM;
+        case KtxBundle::RGB_BPTC_SIGNED_FLOAT: return T::RGB_BPTC_SIGNED_FLOAT;
+        case KtxBundle::RGB_BPTC_UNSIGNED_FLOAT: return T::RGB_BPTC_UNSIGNED_FLOAT;
         case KtxBundle::RGBA_ASTC_4x4: return T::RGBA_ASTC_4x4;
         case KtxBundle::RGBA_ASTC_5x4: return T::RGBA_ASTC_5x4;
         case KtxBundle::RGBA_ASTC_5x5: return T::RGBA_ASTC_5x5;
@@ -28,6 +28,8 @@
 #include <filament/VertexBuffer.h>
 #include <filament/View.h>
 
+#include <image/KtxTranscoder.h>
+
 #include <utils/Entity.h>
 #include <utils/EntityManager.h>
 
@@ -59,6 +61,22 @@ static SuzanneApp app;
 
 static Texture* setTextureParameter(Engine& engine, filaweb::Asset& asset, string name, bool linear,
         TextureSampler const &sampler) {
+    // WebGL only exposes ETC2 with an extension, transcode the ETC2 textures the browser can't
+    // sample to the best format it supports.
+    if (asset.texture->getInfo().glFormat == 0) {
+        const auto format = filaweb::toTextureFormat(asset.texture->getInfo().glInternalFormat);
+        if (!Texture::isTextureFormatSupported(engine, format)) {
+            const image::TranscodeTarget target =
+                    Texture::isTextureFormatSupported(engine, Format::DXT1_RGB) ?
+                    image::TranscodeTarget::DXT1 : image::TranscodeTarget::RGB8;
+            auto transcoded = image::transcodeEtc2(*asset.texture, target);
+            if (transcoded) {
+                asset.texture = std::move(transcoded);
+                asset.rawData.reset();
+            }
+        }
+    }
+
     const auto& info = asset.texture->getInfo();
     const uint32_t nmips = asset.texture->getNumMipLevels();
 
@@ -75,6 +93,7 @@ static Texture* setTextureParameter(Engine& engine, filaweb::Asset& asset, strin
         auto uploader = (Uploader*) user;
         if (--uploader->refcount == 0) {
             uploader->asset->texture.reset();
+            uploader->asset->rawData.reset();
             delete uploader;
         }
     };
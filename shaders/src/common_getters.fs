@@ -51,3 +51,28 @@ float getExposure() {
 float getEV100() {
     return frameUniforms.ev100;
 }
+
+#if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
+/**
+ * Computes the light space position of the specified world space point, in the
+ * given shadow cascade. The returned point may contain a bias to attempt to
+ * eliminate common shadowing artifacts such as "acne". To achieve this, the
+ * world space normal at the point must also be passed to this function.
+ */
+HIGHP vec4 computeLightSpacePosition(HIGHP vec3 p, const vec3 n, const uint cascade) {
+    float NoL = saturate(dot(n, frameUniforms.lightDirection));
+
+#ifdef TARGET_MOBILE
+    float normalBias = 1.0 - NoL * NoL;
+#else
+    float normalBias = sqrt(1.0 - NoL * NoL);
+#endif
+
+    HIGHP vec3 offsetPosition = p + n * (normalBias * frameUniforms.shadowNormalBias[cascade]);
+    HIGHP vec4 lightSpacePosition =
+            frameUniforms.lightFromWorldMatrix[cascade] * vec4(offsetPosition, 1.0);
+    lightSpacePosition.z -= frameUniforms.shadowConstantBias[cascade];
+
+    return lightSpacePosition;
+}
+#endif
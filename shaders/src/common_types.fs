@@ -1,4 +1,4 @@
-#if defined(TARGET_MOBILE)
+#if defined(TARGET_MOBILE) || defined(SHADER_HAS_PRECISION_QUALIFIERS)
 #define HIGHP highp
 #define MEDIUMP mediump
 #else
@@ -415,7 +415,21 @@ NOTE the other tuning knobs are now in the shader function inputs!
     #endif
 #endif
 /*--------------------------------------------------------------------------*/
-#if (FXAA_GLSL_130 == 1)
+#if (FXAA_GLSL_130 == 1) && POST_PROCESS_TONE_MAPPING
+    // Fused with tone mapping: the input is the HDR color buffer, each filtered tap is tone
+    // mapped and, when opaque, gets its luma in alpha like the output of the tone mapping pass
+    vec4 fxaaToneMappedTap(sampler2D t, HIGHP vec2 p) {
+        vec4 color = textureLod(t, p, 0.0);
+    #if POST_PROCESS_OPAQUE
+        color.rgb = colorGrade(color.rgb);
+        color.a   = luminance(color.rgb);
+    #else
+        color.rgb = colorGrade(color.rgb / (color.a + FLT_EPS)) * (color.a + FLT_EPS);
+    #endif
+        return color;
+    }
+    #define FxaaTexTop(t, p) fxaaToneMappedTap(t, p)
+#elif (FXAA_GLSL_130 == 1)
     // Requires "#version 130" or better
     #define FxaaTexTop(t, p) textureLod(t, p, 0.0)
     #define FxaaTexOff(t, p, o, r) textureLodOffset(t, p, 0.0, o)
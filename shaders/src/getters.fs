@@ -25,6 +25,24 @@ vec2 getUV1() {
 
 #if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
 HIGHP vec3 getLightSpacePosition() {
-    return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+    // the cascade is the number of cascades ending in front of the fragment, unused
+    // cascades end at the same distance as the last one
+    HIGHP float z = -(frameUniforms.viewFromWorldMatrix * vec4(vertex_worldPosition, 1.0)).z;
+    uint cascade = uint(dot(vec4(greaterThan(vec4(z), frameUniforms.shadowCascadeSplits)), vec4(1.0)));
+    if (cascade > 3u) {
+        // beyond the last cascade, shadows are clipped
+        return vec3(0.0);
+    }
+
+    // the vertex shader computes the position in the first cascade
+    HIGHP vec4 p = vertex_lightSpacePosition;
+    if (cascade > 0u) {
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+        p = computeLightSpacePosition(vertex_worldPosition, normalize(vertex_worldNormal), cascade);
+#else
+        p = computeLightSpacePosition(vertex_worldPosition, vec3(0.0), cascade);
+#endif
+    }
+    return p.xyz * (1.0 / p.w);
 }
 #endif
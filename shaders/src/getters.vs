@@ -3,17 +3,61 @@
 //------------------------------------------------------------------------------
 
 mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
+    return frameUniforms.lightFromWorldMatrix[0];
+}
+
+// see FRenderableManager::SKINNING_ENABLED and MORPHING_ENABLED
+#define OBJECT_FLAGS_SKINNING_ENABLED   0x1u
+#define OBJECT_FLAGS_MORPHING_ENABLED   0x2u
+
+bool isSkinningEnabled() {
+    return (objectUniforms.flags & OBJECT_FLAGS_SKINNING_ENABLED) != 0u;
+}
+
+bool isMorphingEnabled() {
+    return (objectUniforms.flags & OBJECT_FLAGS_MORPHING_ENABLED) != 0u;
 }
 
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
-    return objectUniforms.worldFromModelMatrix;
+    // only the first 3 rows of the affine transform are stored
+    return transpose(mat4(
+            objectUniforms.worldFromModelRows[0],
+            objectUniforms.worldFromModelRows[1],
+            objectUniforms.worldFromModelRows[2],
+            vec4(0.0, 0.0, 0.0, 1.0)));
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
-    return objectUniforms.worldFromModelNormalMatrix;
+    // The inverse-transpose of the upper 3x3 of the transform is its cofactor matrix divided by
+    // its determinant. The columns of the cofactor matrix are the cross products of the columns
+    // of the transform.
+    mat3 m = transpose(mat3(
+            objectUniforms.worldFromModelRows[0].xyz,
+            objectUniforms.worldFromModelRows[1].xyz,
+            objectUniforms.worldFromModelRows[2].xyz));
+    vec3 c0 = cross(m[1], m[2]);
+    vec3 c1 = cross(m[2], m[0]);
+    vec3 c2 = cross(m[0], m[1]);
+    return mat3(c0, c1, c2) * (1.0 / dot(m[0], c0));
+}
+
+/** @public-api */
+float getTextureLayer() {
+    return float(objectUniforms.textureLayer);
+}
+
+/** @public-api */
+int getInstanceIndex() {
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    // VulkanDriver::draw() uses a firstInstance of 1, which is included in gl_InstanceIndex
+    return gl_InstanceIndex - 1;
+#elif defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+    return gl_InstanceIndex;
+#else
+    return gl_InstanceID;
+#endif
 }
 
 //------------------------------------------------------------------------------
@@ -21,7 +65,11 @@ mat3 getWorldFromModelNormalMatrix() {
 //------------------------------------------------------------------------------
 
 #if defined(HAS_SKINNING)
+// the skinning variant is shared by the skinned and the morphed renderables, which can be both
 void skinNormal(inout vec3 n, const uvec4 ids, const vec4 weights) {
+    if (!isSkinningEnabled()) {
+        return;
+    }
     // this assumes that the sum of the weight is 1.0
     n += (halfPartialTransformVertexUnitQ(n, bonesUniforms.bones[ids.x * 2u]) * weights.x
         + halfPartialTransformVertexUnitQ(n, bonesUniforms.bones[ids.y * 2u]) * weights.y
@@ -30,6 +78,9 @@ void skinNormal(inout vec3 n, const uvec4 ids, const vec4 weights) {
 }
 
 void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
+    if (!isSkinningEnabled()) {
+        return;
+    }
     // this assumes that the sum of the weight is 1.0
     p +=  partialTransformVertexUnitQT(p, bonesUniforms.bones[ids.x * 2u], bonesUniforms.bones[ids.x * 2u + 1u].xyz) * weights.x
         + partialTransformVertexUnitQT(p, bonesUniforms.bones[ids.y * 2u], bonesUniforms.bones[ids.y * 2u + 1u].xyz) * weights.y
@@ -38,6 +89,32 @@ void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
 }
 #endif
 
+#if defined(HAS_ATTRIBUTE_MORPH_POSITIONS)
+void morphPosition(inout vec3 p) {
+    if (!isMorphingEnabled()) {
+        return;
+    }
+    vec4 weights = objectUniforms.morphWeights;
+    p += weights.x * mesh_morph_position_0 + weights.y * mesh_morph_position_1
+       + weights.z * mesh_morph_position_2 + weights.w * mesh_morph_position_3;
+}
+#endif
+
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+// the tangent frame of the vertex, before skinning
+vec4 getMorphedTangents() {
+    vec4 t = mesh_tangents;
+#if defined(HAS_ATTRIBUTE_MORPH_TANGENTS)
+    if (isMorphingEnabled()) {
+        vec4 weights = objectUniforms.morphWeights;
+        t += weights.x * mesh_morph_tangents_0 + weights.y * mesh_morph_tangents_1
+           + weights.z * mesh_morph_tangents_2 + weights.w * mesh_morph_tangents_3;
+    }
+#endif
+    return t;
+}
+#endif
+
 /** @public-api */
 vec4 getPosition() {
     return mesh_position;
@@ -45,6 +122,9 @@ vec4 getPosition() {
 
 vec4 getSkinnedPosition() {
     vec4 pos = getPosition();
+#if defined(HAS_ATTRIBUTE_MORPH_POSITIONS)
+    morphPosition(pos.xyz);
+#endif
 #if defined(HAS_SKINNING)
     skinPosition(pos.xyz, mesh_bone_indices, mesh_bone_weights);
 #endif
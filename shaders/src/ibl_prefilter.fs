@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// IBL prefiltering configuration
+//------------------------------------------------------------------------------
+
+// Number of GGX samples per texel of the reflections, the samples are taken from the mip level
+// of the environment that matches their solid angle, which keeps the noise low
+#define IBL_PREFILTER_SAMPLE_COUNT          32u
+
+//------------------------------------------------------------------------------
+// Cubemap utilities
+//------------------------------------------------------------------------------
+
+/**
+ * Returns the (non normalized) direction of the given face, uv in [0, 1]. This follows the
+ * face selection rules of the cubemap sampling, so that sampling the result in this direction
+ * samples the texel at uv.
+ */
+HIGHP vec3 cubemapDirection(const int face, const HIGHP vec2 uv) {
+    HIGHP vec2 p = uv * 2.0 - 1.0;
+    if (face == 0) return vec3( 1.0, -p.y, -p.x);
+    if (face == 1) return vec3(-1.0, -p.y,  p.x);
+    if (face == 2) return vec3( p.x,  1.0,  p.y);
+    if (face == 3) return vec3( p.x, -1.0, -p.y);
+    if (face == 4) return vec3( p.x, -p.y,  1.0);
+    return vec3(-p.x, -p.y, -1.0);
+}
+
+/**
+ * Encodes the specified linear HDR RGB value to RGBM, see decodeRGBM().
+ */
+vec4 encodeRGBM(vec3 c) {
+    c = sqrt(c) * (1.0 / 16.0);
+    // don't let M go below 1 in the [0..16] range
+    float m = clamp(max(max(c.r, c.g), max(c.b, 1e-6)), 1.0 / 16.0, 1.0);
+    m = ceil(m * 255.0) / 255.0;
+    return vec4(saturate(c / m), m);
+}
+
+//------------------------------------------------------------------------------
+// Specular prefiltering
+//------------------------------------------------------------------------------
+
+HIGHP vec2 hammersley(const uint i) {
+    uint bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(i) / float(IBL_PREFILTER_SAMPLE_COUNT), float(bits) * 2.3283064365386963e-10);
+}
+
+/**
+ * GGX convolution of the environment around N, assuming N = V = R like cmgen does. The
+ * environment must have all its mip levels, each sample reads the level whose texels have the
+ * solid angle of the sample ("filtered importance sampling", GPU Gems 3, chapter 20).
+ */
+vec3 prefilterSpecular(const HIGHP vec3 N, const float linearRoughness, const float size) {
+    HIGHP float envSize = float(textureSize(postProcess_environment, 0).x);
+    if (linearRoughness == 0.0) {
+        // the first level is a mirror, it only needs to be resampled
+        return textureLod(postProcess_environment, N, max(0.0, log2(envSize / size))).rgb;
+    }
+
+    HIGHP vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    HIGHP vec3 T = normalize(cross(up, N));
+    HIGHP vec3 B = cross(N, T);
+
+    float a2 = linearRoughness * linearRoughness;
+    // solid angle of a texel of the environment's first level
+    float omegaP = (4.0 * PI) / (6.0 * envSize * envSize);
+    float maxLod = log2(envSize);
+
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+    for (uint i = 0u; i < IBL_PREFILTER_SAMPLE_COUNT; i++) {
+        HIGHP vec2 u = hammersley(i);
+        float cosTheta2 = (1.0 - u.y) / (1.0 + (a2 - 1.0) * u.y);
+        float cosTheta = sqrt(cosTheta2);
+        float sinTheta = sqrt(1.0 - cosTheta2);
+        float phi = 2.0 * PI * u.x;
+        HIGHP vec3 H = T * (sinTheta * cos(phi)) + B * (sinTheta * sin(phi)) + N * cosTheta;
+        HIGHP vec3 L = 2.0 * cosTheta * H - N;
+        float NoL = dot(N, L);
+        if (NoL > 0.0) {
+            // pdf(L) = D(H) * NoH / (4 * VoH), with NoH == VoH
+            float d = (a2 - 1.0) * cosTheta2 + 1.0;
+            float pdf = a2 / (4.0 * PI * d * d);
+            float omegaS = 1.0 / (float(IBL_PREFILTER_SAMPLE_COUNT) * pdf);
+            float lod = clamp(0.5 * log2(omegaS / omegaP) + 1.0, 0.0, maxLod);
+            color += textureLod(postProcess_environment, L, lod).rgb * NoL;
+            weight += NoL;
+        }
+    }
+    return color / weight;
+}
+
+//------------------------------------------------------------------------------
+// Irradiance spherical harmonics
+//------------------------------------------------------------------------------
+
+/**
+ * Returns the SH basis of the given index in direction s, pre-scaled like cmgen's
+ * computeIrradianceSH3Bands() does, i.e. with the cosine lobe and 1/PI of the Lambertian
+ * BRDF. This is what light_indirect.fs expects.
+ */
+float irradianceSHBasis(const int index, const HIGHP vec3 s) {
+    if (index == 0) return 1.0 / (4.0 * PI);
+    if (index == 1) return s.y / (2.0 * PI);
+    if (index == 2) return s.z / (2.0 * PI);
+    if (index == 3) return s.x / (2.0 * PI);
+    if (index == 4) return s.y * s.x * (15.0 / (16.0 * PI));
+    if (index == 5) return s.y * s.z * (15.0 / (16.0 * PI));
+    if (index == 6) return (3.0 * s.z * s.z - 1.0) * (5.0 / (64.0 * PI));
+    if (index == 7) return s.z * s.x * (15.0 / (16.0 * PI));
+    return (s.x * s.x - s.y * s.y) * (15.0 / (64.0 * PI));
+}
+
+/**
+ * Projects the mip level of the environment of the given size on the SH basis of the given
+ * index, every texel is weighted by its solid angle.
+ */
+vec3 projectIrradianceSH(const int index, const float size) {
+    HIGHP float envSize = float(textureSize(postProcess_environment, 0).x);
+    float lod = max(0.0, log2(envSize / size));
+    int dim = int(size);
+    // solid angle of a texel at the center of a face
+    HIGHP float omega0 = 4.0 / (size * size);
+    HIGHP vec3 sh = vec3(0.0);
+    for (int face = 0; face < 6; face++) {
+        for (int y = 0; y < dim; y++) {
+            for (int x = 0; x < dim; x++) {
+                HIGHP vec3 d = cubemapDirection(face, (vec2(x, y) + 0.5) / size);
+                HIGHP float invLength = inversesqrt(dot(d, d));
+                HIGHP vec3 s = d * invLength;
+                HIGHP float omega = omega0 * invLength * invLength * invLength;
+                vec3 c = textureLod(postProcess_environment, s, lod).rgb;
+                sh += c * (omega * irradianceSHBasis(index, s));
+            }
+        }
+    }
+    return sh;
+}
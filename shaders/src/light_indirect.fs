@@ -146,12 +146,51 @@ vec3 Irradiance_SphericalHarmonics(const vec3 n) {
         , 0.0);
 }
 
+/**
+ * Returns the coefficient k of the SH interpolated between the probes of the irradiance volume.
+ * The coefficients are stored one after the other along z, each in as many slices as there are
+ * probes along z. The z coordinate is clamped to the centers of the first and last slices of
+ * the coefficient, so that the filtering doesn't mix coefficients.
+ */
+vec3 irradianceVolumeCoefficient(const vec2 uv, float z, float k) {
+    float depth = frameUniforms.irradianceVolumeParams.y;
+    float w = (z + k * depth) * frameUniforms.irradianceVolumeParams.z;
+    return textureLod(light_irradianceVolume, vec3(uv, w), 0.0).rgb;
+}
+
+vec3 Irradiance_Volume(const vec3 n, const vec3 uvw) {
+    float depth = frameUniforms.irradianceVolumeParams.y;
+    float z = clamp(uvw.z * depth, 0.5, depth - 0.5);
+    return max(
+          irradianceVolumeCoefficient(uvw.xy, z, 0.0)
+#if SPHERICAL_HARMONICS_BANDS >= 2
+        + irradianceVolumeCoefficient(uvw.xy, z, 1.0) * (n.y)
+        + irradianceVolumeCoefficient(uvw.xy, z, 2.0) * (n.z)
+        + irradianceVolumeCoefficient(uvw.xy, z, 3.0) * (n.x)
+#endif
+#if SPHERICAL_HARMONICS_BANDS >= 3
+        + irradianceVolumeCoefficient(uvw.xy, z, 4.0) * (n.y * n.x)
+        + irradianceVolumeCoefficient(uvw.xy, z, 5.0) * (n.y * n.z)
+        + irradianceVolumeCoefficient(uvw.xy, z, 6.0) * (3.0 * n.z * n.z - 1.0)
+        + irradianceVolumeCoefficient(uvw.xy, z, 7.0) * (n.z * n.x)
+        + irradianceVolumeCoefficient(uvw.xy, z, 8.0) * (n.x * n.x - n.y * n.y)
+#endif
+        , 0.0);
+}
+
 //------------------------------------------------------------------------------
 // IBL irradiance dispatch
 //------------------------------------------------------------------------------
 
 vec3 diffuseIrradiance(const vec3 n) {
 #if IBL_IRRADIANCE == IBL_IRRADIANCE_SPHERICAL_HARMONICS
+    if (frameUniforms.irradianceVolumeParams.x > 0.0) {
+        vec4 position = vec4(shading_position, 1.0);
+        vec3 uvw = (frameUniforms.irradianceVolumeFromWorldMatrix * position).xyz;
+        if (all(greaterThanEqual(uvw, vec3(0.0))) && all(lessThanEqual(uvw, vec3(1.0)))) {
+            return Irradiance_Volume(n, uvw);
+        }
+    }
     return Irradiance_SphericalHarmonics(n);
 #endif
 }
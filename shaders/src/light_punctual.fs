@@ -113,6 +113,28 @@ void setupPunctualLight(inout Light light, const HIGHP vec4 positionFalloff) {
     light.NoL = saturate(dot(shading_normal, light.l));
 }
 
+/**
+ * Returns the visibility of a spot light casting shadows, from its tile of the
+ * shadow atlas. The normal bias is given at 1m from the light, where its texels
+ * are that large.
+ */
+float getSpotLightVisibility(const uint shadowIndex, const HIGHP vec3 lightPosition,
+        const float NoL) {
+    HIGHP vec3 p = vertex_worldPosition;
+    vec4 bias = frameUniforms.spotShadowBias[shadowIndex];
+#ifdef TARGET_MOBILE
+    float normalBias = 1.0 - NoL * NoL;
+#else
+    float normalBias = sqrt(1.0 - NoL * NoL);
+#endif
+    normalBias *= bias.y * length(lightPosition - p);
+
+    HIGHP vec4 lightSpacePosition = frameUniforms.spotLightFromWorldMatrix[shadowIndex] *
+            vec4(p + shading_normal * normalBias, 1.0);
+    lightSpacePosition.z -= bias.x * lightSpacePosition.w;
+    return shadow(light_shadowAtlas, lightSpacePosition.xyz * (1.0 / lightSpacePosition.w));
+}
+
 /**
  * Returns a Light structure (see common_lighting.fs) describing a spot light.
  * The colorIntensity field will store the *pre-exposed* intensity of the light
@@ -130,6 +152,8 @@ Light getSpotLight(uint index) {
     HIGHP vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
           vec4 directionIES    = lightsUniforms.lights[lightIndex][2];
           vec2 scaleOffset     = lightsUniforms.lights[lightIndex][3].xy;
+          // index of the light's tile in the shadow atlas plus one, 0 when it has none
+          uint shadowIndex     = uint(lightsUniforms.lights[lightIndex][3].z);
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
@@ -138,6 +162,11 @@ Light getSpotLight(uint index) {
 
     light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset);
 
+    if (shadowIndex > 0u && light.NoL > 0.0) {
+        light.attenuation *= getSpotLightVisibility(shadowIndex - 1u, positionFalloff.xyz,
+                light.NoL);
+    }
+
     return light;
 }
 
@@ -11,4 +11,18 @@ void main() {
     material(inputs);
 
     fragColor = evaluateMaterial(inputs);
+
+#if defined(BLEND_MODE_TRANSPARENT)
+    // Weighted, blended order-independent transparency (McGuire and Bavoil 2013): the color
+    // is accumulated with a weight that favors the closest fragments, and the revealage as
+    // -log2(1 - alpha), so that the product of the (1 - alpha) is also a sum. Both attachments
+    // are blended with ONE, ONE.
+    fragRevealage = vec4(0.0);
+    if (frameUniforms.orderIndependentTransparency > 0.0) {
+        float alpha = fragColor.a;
+        float z = 1.0 - gl_FragCoord.z;
+        fragColor *= clamp(alpha * max(1e-2, 3e3 * z * z * z), 1e-2, 3e3);
+        fragRevealage.r = -log2(1.0 - min(alpha, 0.999));
+    }
+#endif
 }
@@ -9,9 +9,10 @@ void main() {
     #if defined(MATERIAL_HAS_ANISOTROPY) || defined(MATERIAL_HAS_NORMAL) || defined(MATERIAL_HAS_CLEAR_COAT_NORMAL)
         // Extract the normal and tangent in world space from the input quaternion
         // We encode the orthonormal basis as a quaternion to save space in the attributes
-        toTangentFrame(normalize(mesh_tangents), material.worldNormal, vertex_worldTangent);
-        vertex_worldTangent = objectUniforms.worldFromModelNormalMatrix * vertex_worldTangent;
-        material.worldNormal = objectUniforms.worldFromModelNormalMatrix * material.worldNormal;
+        toTangentFrame(normalize(getMorphedTangents()), material.worldNormal, vertex_worldTangent);
+        mat3 worldFromModelNormalMatrix = getWorldFromModelNormalMatrix();
+        vertex_worldTangent = worldFromModelNormalMatrix * vertex_worldTangent;
+        material.worldNormal = worldFromModelNormalMatrix * material.worldNormal;
         #if defined(HAS_SKINNING)
             skinNormal(material.worldNormal, mesh_bone_indices, mesh_bone_weights);
             skinNormal(vertex_worldTangent, mesh_bone_indices, mesh_bone_weights);
@@ -21,8 +22,8 @@ void main() {
         vertex_worldBitangent = cross(material.worldNormal, vertex_worldTangent) * sign(mesh_tangents.w);
     #else // MATERIAL_HAS_ANISOTROPY || MATERIAL_HAS_NORMAL
         // Without anisotropy or normal mapping we only need the normal vector
-        toTangentFrame(normalize(mesh_tangents), material.worldNormal);
-        material.worldNormal = objectUniforms.worldFromModelNormalMatrix * material.worldNormal;
+        toTangentFrame(normalize(getMorphedTangents()), material.worldNormal);
+        material.worldNormal = getWorldFromModelNormalMatrix() * material.worldNormal;
         #if defined(HAS_SKINNING)
             skinNormal(material.worldNormal, mesh_bone_indices, mesh_bone_weights);
         #endif
@@ -1,27 +1,46 @@
 LAYOUT_LOCATION(0) in HIGHP vec2 vertex_uv;
 
+#if POST_PROCESS_TEMPORAL_UPSAMPLING
+LAYOUT_LOCATION(1) in HIGHP vec2 vertex_position;
+#endif
+
+#if POST_PROCESS_IN_PLACE && defined(GL_EXT_shader_framebuffer_fetch)
+#define POST_PROCESS_FRAMEBUFFER_FETCH
+#endif
+
+#if defined(POST_PROCESS_FRAMEBUFFER_FETCH)
+// the color attachment is both the input and the output
+LAYOUT_LOCATION(0) inout vec4 fragColor;
+#else
 LAYOUT_LOCATION(0) out vec4 fragColor;
+#endif
 
 #if POST_PROCESS_TONE_MAPPING
 vec3 resolveFragment(const ivec2 uv) {
+#if defined(POST_PROCESS_FRAMEBUFFER_FETCH)
+    return fragColor.rgb;
+#else
     return texelFetch(postProcess_colorBuffer, uv, 0).rgb;
+#endif
 }
 
 vec4 resolveAlphaFragment(const ivec2 uv) {
+#if defined(POST_PROCESS_FRAMEBUFFER_FETCH)
+    return fragColor;
+#else
     return texelFetch(postProcess_colorBuffer, uv, 0);
+#endif
 }
 
 vec4 resolve() {
 #if POST_PROCESS_OPAQUE
     vec4 color = vec4(resolveFragment(ivec2(vertex_uv)), 1.0);
-    color.rgb  = tonemap(color.rgb);
-    color.rgb  = OECF(color.rgb);
+    color.rgb  = colorGrade(color.rgb);
     color.a    = luminance(color.rgb);
 #else
     vec4 color = resolveAlphaFragment(ivec2(vertex_uv));
     color.rgb /= color.a + FLT_EPS;
-    color.rgb  = tonemap(color.rgb);
-    color.rgb  = OECF(color.rgb);
+    color.rgb  = colorGrade(color.rgb);
     color.rgb *= color.a + FLT_EPS;
 #endif
     return color;
@@ -60,11 +79,258 @@ vec4 PostProcess_AntiAliasing() {
 }
 #endif
 
+#if POST_PROCESS_TEMPORAL_UPSAMPLING
+vec4 PostProcess_TemporalUpsampling() {
+    // The input was rendered at a lower resolution, with a sub-pixel jitter that changes every
+    // frame. vertex_uv is in pixels of the input, the history is at the output's resolution.
+    HIGHP vec2 uv = vertex_uv + postProcessUniforms.jitter;
+    HIGHP vec2 inputSize = vec2(textureSize(postProcess_colorBuffer, 0));
+    vec4 current = texture(postProcess_colorBuffer, uv / inputSize);
+
+    // the history is clamped to the neighborhood of the current frame, this removes the
+    // ghosting where the reprojection is wrong
+    ivec2 texel = ivec2(uv);
+    vec4 minColor = current;
+    vec4 maxColor = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec4 c = texelFetch(postProcess_colorBuffer, texel + ivec2(x, y), 0);
+            minColor = min(minColor, c);
+            maxColor = max(maxColor, c);
+        }
+    }
+
+    // we don't have the depth, so the reprojection assumes the pixel is infinitely far, which
+    // handles the camera's rotations
+    HIGHP vec4 p = postProcessUniforms.reprojection * vec4(vertex_position, 1.0, 1.0);
+    HIGHP vec2 historySize = postProcessUniforms.historySize;
+    HIGHP vec2 historyUv = (p.xy / p.w * 0.5 + 0.5) * historySize;
+    float historyWeight = postProcessUniforms.historyWeight;
+    if (p.w <= 0.0 || any(lessThan(historyUv, vec2(0.0))) ||
+            any(greaterThanEqual(historyUv, historySize))) {
+        historyWeight = 0.0;
+    }
+    HIGHP vec2 historyTextureSize = vec2(textureSize(postProcess_historyBuffer, 0));
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    // see post_process.vs, the history is at the bottom of its texture
+    historyUv.y += historyTextureSize.y - historySize.y;
+#endif
+    vec4 history = texture(postProcess_historyBuffer, historyUv / historyTextureSize);
+    history = clamp(history, minColor, maxColor);
+
+    // the closer the current sample is to the center of this pixel, the more we trust it
+    HIGHP vec2 d = uv - (floor(uv) + 0.5);
+    float alpha = mix(1.0, 0.04 + 0.16 * exp(-2.29 * dot(d, d)), historyWeight);
+    return mix(history, current, alpha);
+}
+#endif
+
+#if POST_PROCESS_IBL_SPECULAR
+vec4 PostProcess_IblSpecular() {
+    // the viewport covers the level rendered, gl_FragCoord matches the texels of the face
+    HIGHP float size = postProcessUniforms.iblSize;
+    HIGHP vec3 N = normalize(cubemapDirection(postProcessUniforms.iblFace, gl_FragCoord.xy / size));
+    return encodeRGBM(prefilterSpecular(N, postProcessUniforms.iblRoughness, size));
+}
+#endif
+
+#if POST_PROCESS_IBL_SH
+vec4 PostProcess_IblSH() {
+    // one coefficient per pixel, in a 9x1 target
+    return vec4(projectIrradianceSH(int(gl_FragCoord.x), postProcessUniforms.iblSize), 1.0);
+}
+#endif
+
+#if POST_PROCESS_TRANSPARENCY_RESOLVE
+vec4 PostProcess_TransparencyResolve() {
+    // the accumulation is bound as the color buffer and the revealage as the history, both
+    // are at the bottom-left of textures of their own
+    ivec2 uv = ivec2(vertex_uv);
+    vec4 accumulation = texelFetch(postProcess_colorBuffer, uv, 0);
+    // the revealage is accumulated as -log2 of the product of the (1 - alpha)
+    float revealage = exp2(-texelFetch(postProcess_historyBuffer, uv, 0).r);
+    vec3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+    // blended with ONE, ONE_MINUS_SRC_ALPHA over the opaque objects
+    return vec4(average * (1.0 - revealage), 1.0 - revealage);
+}
+#endif
+
+#if POST_PROCESS_SHADOW_MOMENTS_BLUR
+HIGHP vec4 computeShadowMoments(const HIGHP float depth) {
+    // exponentially warped depth and its square, with a positive and a negative exponent, see
+    // ShadowSample_EVSM() in shadowing.fs
+    HIGHP float c = postProcessUniforms.vsmExponent;
+    HIGHP float d = depth * 2.0 - 1.0;
+    HIGHP vec2 w = vec2(exp(c * d), -exp(-c * d));
+    return vec4(w.x, w.x * w.x, w.y, w.y * w.y);
+}
+
+vec4 PostProcess_ShadowMomentsBlur() {
+    // One axis of a separable 9-tap binomial blur. The first pass converts the shadow map's
+    // depth into moments, the second one blurs them along the other axis. The taps are clamped
+    // to the tile of the cascade, so that the cascades don't bleed into each other.
+    const float weights[5] = float[5](70.0, 56.0, 28.0, 8.0, 1.0);
+    ivec4 bounds = ivec4(postProcessUniforms.shadowBlurBounds);
+    ivec2 direction = ivec2(postProcessUniforms.shadowBlurDirection);
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    HIGHP vec4 sum = vec4(0.0);
+    if (postProcessUniforms.shadowBlurFromDepth != 0) {
+        for (int i = -4; i <= 4; i++) {
+            ivec2 uv = clamp(texel + direction * i, bounds.xy, bounds.zw);
+            HIGHP float depth = texelFetch(postProcess_depthBuffer, uv, 0).r;
+            sum += weights[abs(i)] * computeShadowMoments(depth);
+        }
+    } else {
+        for (int i = -4; i <= 4; i++) {
+            ivec2 uv = clamp(texel + direction * i, bounds.xy, bounds.zw);
+            sum += weights[abs(i)] * texelFetch(postProcess_colorBuffer, uv, 0);
+        }
+    }
+    return sum * (1.0 / 256.0);
+}
+#endif
+
+#if POST_PROCESS_AUTO_EXPOSURE_LUMINANCE || POST_PROCESS_AUTO_EXPOSURE_ADAPTATION
+// range of the log2 luminance metered by the auto-exposure, which keeps the black pixels
+// from dominating the average
+#define AUTO_EXPOSURE_LOG2_MIN  -16.0
+#define AUTO_EXPOSURE_LOG2_MAX   16.0
+#define AUTO_EXPOSURE_MIDDLE_GRAY 0.18
+#endif
+
+#if POST_PROCESS_AUTO_EXPOSURE_LUMINANCE
+vec4 PostProcess_AutoExposureLuminance() {
+    // The log2 of the luminance of the input, at the lower resolution of the target: each
+    // texel averages 4 bilinear taps, spread over the pixels of the input it covers.
+    HIGHP vec2 inputSize = vec2(textureSize(postProcess_colorBuffer, 0));
+    HIGHP vec2 cell = abs(vec2(dFdx(vertex_uv.x), dFdy(vertex_uv.y))) * 0.25;
+    const vec2 offsets[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0),
+            vec2(-1.0, 1.0), vec2(1.0, 1.0));
+    float sum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec3 color = texture(postProcess_colorBuffer,
+                (vertex_uv + offsets[i] * cell) / inputSize).rgb;
+        sum += clamp(log2(max(luminance(color), 1e-10)),
+                AUTO_EXPOSURE_LOG2_MIN, AUTO_EXPOSURE_LOG2_MAX);
+    }
+    return vec4(sum * 0.25);
+}
+#endif
+
+#if POST_PROCESS_AUTO_EXPOSURE_REDUCE || POST_PROCESS_AUTO_EXPOSURE_ADAPTATION
+float reduceLuminance(const ivec2 texel) {
+    // average of the 4x4 texels of the input under the target's texel
+    ivec2 origin = texel * 4;
+    float sum = 0.0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            sum += texelFetch(postProcess_colorBuffer, origin + ivec2(x, y), 0).r;
+        }
+    }
+    return sum * (1.0 / 16.0);
+}
+#endif
+
+#if POST_PROCESS_AUTO_EXPOSURE_REDUCE
+vec4 PostProcess_AutoExposureReduce() {
+    return vec4(reduceLuminance(ivec2(gl_FragCoord.xy)));
+}
+#endif
+
+#if POST_PROCESS_AUTO_EXPOSURE_ADAPTATION
+vec4 PostProcess_AutoExposureAdaptation() {
+    // the input is the last 4x4 level of the reduction, the history is last frame's output,
+    // both in EV; adaptation is the rates up and down, the time step and the compensation
+    HIGHP vec4 adaptation = postProcessUniforms.autoExposureAdaptation;
+    vec2 range = postProcessUniforms.autoExposureRange;
+    float average = reduceLuminance(ivec2(0));
+    // the correction of the exposure that brings the geometric mean of the luminance to
+    // middle gray
+    float target = clamp(log2(AUTO_EXPOSURE_MIDDLE_GRAY) - average + adaptation.w,
+            range.x, range.y);
+    if (postProcessUniforms.autoExposureHistory == 0.0) {
+        return vec4(target);
+    }
+    float previous = texelFetch(postProcess_historyBuffer, ivec2(0), 0).r;
+    float rate = target > previous ? adaptation.x : adaptation.y;
+    return vec4(mix(target, previous, exp(-rate * adaptation.z)));
+}
+#endif
+
+#if POST_PROCESS_MIPMAP_DOWNSAMPLE
+vec4 PostProcess_MipmapDownsample() {
+    // The input is clamped to the level above the target, see MipmapGenerator. Each texel of
+    // the target is a [1 3 3 1] tent over the 4x4 texels of the input around it, which takes
+    // 4 bilinear taps at 3/4 of an input texel from its center. The target is floor(size / 2).
+    const vec2 offsets[4] = vec2[4](vec2(-0.75, -0.75), vec2(0.75, -0.75),
+            vec2(-0.75, 0.75), vec2(0.75, 0.75));
+    int face = postProcessUniforms.mipmapFace;
+    vec4 sum = vec4(0.0);
+    if (face < 0) {
+        HIGHP vec2 size = vec2(textureSize(postProcess_colorBuffer, 0));
+        HIGHP vec2 uv = gl_FragCoord.xy / max(floor(size * 0.5), vec2(1.0));
+        for (int i = 0; i < 4; i++) {
+            sum += textureLod(postProcess_colorBuffer, uv + offsets[i] / size, 0.0);
+        }
+    } else {
+        // the taps near the edges of the face are taken from the faces next to it
+        HIGHP float size = float(textureSize(postProcess_environment, 0).x);
+        HIGHP vec2 uv = gl_FragCoord.xy / max(floor(size * 0.5), 1.0);
+        for (int i = 0; i < 4; i++) {
+            sum += textureLod(postProcess_environment,
+                    cubemapDirection(face, uv + offsets[i] / size), 0.0);
+        }
+    }
+    return sum * 0.25;
+}
+#endif
+
+#if POST_PROCESS_DEBUG_HEATMAP
+vec4 PostProcess_DebugHeatmap() {
+    // the red channel holds the value of the visualization, see Engine::DebugVisualization,
+    // a negative value means it's unknown
+    float value = texelFetch(postProcess_colorBuffer, ivec2(vertex_uv), 0).r;
+    if (value < 0.0) {
+        return vec4(0.5, 0.5, 0.5, 1.0);
+    }
+    // blue, cyan, green, yellow, red from 0 to the range
+    float t = saturate(value / postProcessUniforms.heatmapRange) * 4.0;
+    vec3 color = vec3(
+            saturate(t - 2.0),
+            saturate(t) - saturate(t - 3.0),
+            1.0 - saturate(t - 1.0));
+    return vec4(color, 1.0);
+}
+#endif
+
 vec4 postProcess() {
-#if POST_PROCESS_TONE_MAPPING
+#if POST_PROCESS_TONE_MAPPING && POST_PROCESS_ANTI_ALIASING
+    // FXAA tone maps its taps, see fxaa.fs
+    return dither(PostProcess_AntiAliasing());
+#elif POST_PROCESS_TONE_MAPPING
     return PostProcess_ToneMapping();
 #elif POST_PROCESS_ANTI_ALIASING
     return PostProcess_AntiAliasing();
+#elif POST_PROCESS_TEMPORAL_UPSAMPLING
+    return PostProcess_TemporalUpsampling();
+#elif POST_PROCESS_IBL_SPECULAR
+    return PostProcess_IblSpecular();
+#elif POST_PROCESS_IBL_SH
+    return PostProcess_IblSH();
+#elif POST_PROCESS_TRANSPARENCY_RESOLVE
+    return PostProcess_TransparencyResolve();
+#elif POST_PROCESS_SHADOW_MOMENTS_BLUR
+    return PostProcess_ShadowMomentsBlur();
+#elif POST_PROCESS_AUTO_EXPOSURE_LUMINANCE
+    return PostProcess_AutoExposureLuminance();
+#elif POST_PROCESS_AUTO_EXPOSURE_REDUCE
+    return PostProcess_AutoExposureReduce();
+#elif POST_PROCESS_AUTO_EXPOSURE_ADAPTATION
+    return PostProcess_AutoExposureAdaptation();
+#elif POST_PROCESS_MIPMAP_DOWNSAMPLE
+    return PostProcess_MipmapDownsample();
+#elif POST_PROCESS_DEBUG_HEATMAP
+    return PostProcess_DebugHeatmap();
 #endif
 }
 
@@ -3,7 +3,18 @@ LAYOUT_LOCATION(LOCATION_POSITION) in vec4 position;
 
 LAYOUT_LOCATION(0) out vec2 vertex_uv;
 
+#if POST_PROCESS_TEMPORAL_UPSAMPLING
+LAYOUT_LOCATION(1) out vec2 vertex_position;
+#endif
+
 void main() {
+#if POST_PROCESS_IBL_SPECULAR || POST_PROCESS_IBL_SH || POST_PROCESS_SHADOW_MOMENTS_BLUR || \
+        POST_PROCESS_MIPMAP_DOWNSAMPLE
+    // the IBL prefilter runs outside of any view, without frame uniforms, and only needs
+    // gl_FragCoord, like the shadow blur which runs at the resolution of the shadow map and
+    // the mipmap generation
+    vertex_uv = vec2(0.0);
+#else
     vertex_uv = (position.xy * 0.5 + 0.5) * frameUniforms.resolution.xy;
 
 #if defined(TARGET_VULKAN_ENVIRONMENT)
@@ -15,12 +26,17 @@ void main() {
     // we need to sample the texture in the range [20,200) rather than [0,180).
     vertex_uv.y += postProcessUniforms.yOffset;
 #endif
+#endif
 
 #if POST_PROCESS_ANTI_ALIASING
     // Account for the texture actual size
     vertex_uv *= postProcessUniforms.uvScale;
     // Compute texel center
     vertex_uv = (floor(vertex_uv) + vec2(0.5, 0.5)) * frameUniforms.resolution.zw;
+#endif
+#if POST_PROCESS_TEMPORAL_UPSAMPLING
+    // clip space position, used to reproject into the history
+    vertex_position = position.xy;
 #endif
     gl_Position = position;
 }
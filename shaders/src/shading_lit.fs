@@ -143,6 +143,10 @@ vec4 evaluateLights(const MaterialInputs material) {
 
 #if defined(HAS_DYNAMIC_LIGHTING)
     evaluatePunctualLights(pixel, color);
+#elif defined(HAS_DYNAMIC_LIGHTING_SPECIALIZATION)
+    if (SPECIALIZATION_DYNAMIC_LIGHTING) {
+        evaluatePunctualLights(pixel, color);
+    }
 #endif
 
 #if defined(BLEND_MODE_FADE) && !defined(SHADING_MODEL_UNLIT)
@@ -223,6 +223,42 @@ float ShadowSample_PCF_High(const lowp sampler2DShadow map, const vec2 size, vec
 }
 #endif
 
+//------------------------------------------------------------------------------
+// Variance shadows
+//------------------------------------------------------------------------------
+
+// the part of the visibility under this threshold is removed, which hides most of the light
+// bleeding where the casters overlap, at the cost of slightly harder shadows
+#define VSM_LIGHT_BLEEDING_REDUCTION    0.2
+
+// minimum variance, in units of the warped depth's derivative, avoids the acne of flat receivers
+#define VSM_MIN_VARIANCE_SCALE          0.0001
+
+float chebyshevUpperBound(const HIGHP vec2 moments, const HIGHP float mean,
+        const HIGHP float minVariance) {
+    // Donnelly and Lauritzen, 2006, "Variance Shadow Maps"
+    HIGHP float variance = max(moments.y - moments.x * moments.x, minVariance);
+    HIGHP float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+    pMax = saturate((pMax - VSM_LIGHT_BLEEDING_REDUCTION) / (1.0 - VSM_LIGHT_BLEEDING_REDUCTION));
+    return mean <= moments.x ? 1.0 : pMax;
+}
+
+float ShadowSample_EVSM(const highp sampler2D moments, const HIGHP vec3 position,
+        const HIGHP float exponent) {
+    // Lauritzen, 2008, "Layered Variance Shadow Maps". The moments of the exponentially warped
+    // depth are prefiltered by the SHADOW_MOMENTS_BLUR post-process, a single filtered fetch
+    // gives the visibility.
+    HIGHP vec4 m = texture(moments, position.xy);
+    HIGHP float d = position.z * 2.0 - 1.0;
+    HIGHP vec2 w = vec2(exp(exponent * d), -exp(-exponent * d));
+    HIGHP vec2 minVariance = VSM_MIN_VARIANCE_SCALE * exponent * w;
+    minVariance *= minVariance;
+    float positive = chebyshevUpperBound(m.xy, w.x, minVariance.x);
+    float negative = chebyshevUpperBound(m.zw, w.y, minVariance.y);
+    return min(positive, negative);
+}
+
 //------------------------------------------------------------------------------
 // Shadow sampling dispatch
 //------------------------------------------------------------------------------
@@ -244,3 +280,15 @@ float shadow(const lowp sampler2DShadow shadowMap, const vec3 shadowPosition) {
     return ShadowSample_PCF_High(shadowMap, size, shadowPosition);
 #endif
 }
+
+/**
+ * Samples the visibility of the directional light at the specified position in
+ * light (shadow) space, from the shadow map or, when the view uses variance
+ * shadows, from their prefiltered moments.
+ */
+float shadowDirectional(const HIGHP vec3 shadowPosition) {
+    if (frameUniforms.vsmExponent > 0.0) {
+        return ShadowSample_EVSM(light_shadowMoments, shadowPosition, frameUniforms.vsmExponent);
+    }
+    return shadow(light_shadowMap, shadowPosition);
+}
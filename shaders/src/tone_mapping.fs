@@ -156,6 +156,43 @@ vec3 tonemap(const vec3 x) {
 #endif
 }
 
+//------------------------------------------------------------------------------
+// Color grading
+//------------------------------------------------------------------------------
+
+// Range of the log2 encoding of the color grading lookup table, must match
+// ColorGrading::LOG2_MIN and ColorGrading::LOG2_MAX
+#define COLOR_GRADING_LOG2_MIN       -12.0
+#define COLOR_GRADING_LOG2_MAX         4.0
+#define COLOR_GRADING_LUT_SIZE        32.0
+
+/**
+ * Returns the correction of the exposure computed by the auto-exposure, as a
+ * multiplier of the pre-exposed color, or 1 when the view doesn't use it.
+ */
+float getAutoExposure() {
+    if (postProcessUniforms.autoExposure == 0.0) {
+        return 1.0;
+    }
+    return exp2(texelFetch(postProcess_autoExposure, ivec2(0), 0).r);
+}
+
+/**
+ * Grades, tone-maps and encodes the specified RGB color with the view's 3D
+ * lookup table, which bakes the grading, tonemap() and OECF(), after applying
+ * the auto-exposure. The input color must be in linear HDR and pre-exposed,
+ * like for tonemap().
+ */
+vec3 colorGrade(const vec3 x) {
+    vec3 v = log2(max(x * getAutoExposure(), vec3(exp2(COLOR_GRADING_LOG2_MIN))));
+    vec3 uvw = saturate((v - COLOR_GRADING_LOG2_MIN) /
+            (COLOR_GRADING_LOG2_MAX - COLOR_GRADING_LOG2_MIN));
+    // samples the centers of the first and last texels at 0 and 1
+    uvw = uvw * ((COLOR_GRADING_LUT_SIZE - 1.0) / COLOR_GRADING_LUT_SIZE) +
+            0.5 / COLOR_GRADING_LUT_SIZE;
+    return textureLod(postProcess_colorGrading, uvw, 0.0).rgb;
+}
+
 //------------------------------------------------------------------------------
 // Processing tone-mappers
 //------------------------------------------------------------------------------
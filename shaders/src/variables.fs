@@ -32,3 +32,8 @@ LAYOUT_LOCATION(11) in HIGHP vec4 vertex_lightSpacePosition;
 #endif
 
 layout(location = 0) out vec4 fragColor;
+
+#if defined(BLEND_MODE_TRANSPARENT)
+// second attachment of the order-independent transparency, see main.fs
+layout(location = 1) out vec4 fragRevealage;
+#endif
@@ -207,3 +207,4 @@ Cubemap::Texel Cubemap::trilinearFilterAt(const Cubemap& l0, const Cubemap& l1,
     }
     return c0;
 }
+
@@ -68,6 +68,11 @@ public:
     static Texel trilinearFilterAt(const Cubemap& c0, const Cubemap& c1, double lerp,
             const math::double3& direction);
 
+    // Single precision version of trilinearFilterAt(), for the inner loops of the prefiltering
+    // kernels. The direction doesn't need to be normalized.
+    static inline Texel trilinearFilterAt(const Cubemap& c0, const Cubemap& c1, float lerp,
+            const math::float3& direction);
+
     inline static const Texel& sampleAt(void const* data) {
         return *static_cast<Texel const *>(data);
     }
@@ -91,6 +96,8 @@ public:
     static Address getAddressFor(const math::double3& direction);
 
 private:
+    static inline Texel bilinearFilterAt(const Image& image, size_t dim, float x, float y);
+
     size_t mDimensions = 0;
     double mScale = 1;
     double mUpperBound = 0;
@@ -147,4 +154,60 @@ inline Cubemap::Texel Cubemap::filterAt(const math::double3& direction) const {
     return filterAt(getImageForFace(addr.face), addr.s, addr.t);
 }
 
+// Bilinear filtering of a face at the given texel coordinates, in [0, dim].
+inline Cubemap::Texel Cubemap::bilinearFilterAt(const Image& image, size_t dim, float x, float y) {
+    // as in filterAt(), the texels past the width/height of the Image are the "seamless" data
+    const size_t x0 = std::min(size_t(x), dim - 1);
+    const size_t y0 = std::min(size_t(y), dim - 1);
+    const float u = x - x0;
+    const float v = y - y0;
+    uint8_t const* row0 = static_cast<uint8_t const*>(image.getPixelRef(x0, y0));
+    uint8_t const* row1 = row0 + image.getBytesPerRow();
+    const size_t bpp = image.getBytesPerPixel();
+    const Texel& c0 = sampleAt(row0);
+    const Texel& c1 = sampleAt(row0 + bpp);
+    const Texel& c2 = sampleAt(row1);
+    const Texel& c3 = sampleAt(row1 + bpp);
+    const Texel top = c0 + u * (c1 - c0);
+    const Texel bottom = c2 + u * (c3 - c2);
+    return top + v * (bottom - top);
+}
+
+inline Cubemap::Texel Cubemap::trilinearFilterAt(const Cubemap& l0, const Cubemap& l1,
+        float lerp, const math::float3& L) {
+    // this is getAddressFor() in single precision, with a single division
+    Face face;
+    float sc, tc, ma;
+    const float rx = std::abs(L.x);
+    const float ry = std::abs(L.y);
+    const float rz = std::abs(L.z);
+    if (rx >= ry && rx >= rz) {
+        ma = rx;
+        face = L.x >= 0 ? Face::PX : Face::NX;
+        sc = L.x >= 0 ? -L.z : L.z;
+        tc = -L.y;
+    } else if (ry >= rz) {
+        ma = ry;
+        face = L.y >= 0 ? Face::PY : Face::NY;
+        sc = L.x;
+        tc = L.y >= 0 ? L.z : -L.z;
+    } else {
+        ma = rz;
+        face = L.z >= 0 ? Face::PZ : Face::NZ;
+        sc = L.z >= 0 ? L.x : -L.x;
+        tc = -L.y;
+    }
+    const float scale = 0.5f / ma;
+    const float s = sc * scale + 0.5f;
+    const float t = tc * scale + 0.5f;
+
+    const size_t dim0 = l0.mDimensions;
+    Texel c0 = bilinearFilterAt(l0.getImageForFace(face), dim0, s * dim0, t * dim0);
+    if (&l0 != &l1) {
+        const size_t dim1 = l1.mDimensions;
+        c0 += lerp * (bilinearFilterAt(l1.getImageForFace(face), dim1, s * dim1, t * dim1) - c0);
+    }
+    return c0;
+}
+
 #endif /* SRC_CUBEMAP_H_ */
@@ -97,6 +97,17 @@ static double __UNUSED VisibilityAshikhmin(double NoV, double NoL, double a) {
     return 1 / (4 * (NoL + NoV - NoL * NoV));
 }
 
+// Rotation from tangent space (Z up) to the space of the normal, computed in double precision
+// but applied to the samples in single precision, which is enough for sampling the cubemap.
+static mat3 tangentFrame(const double3& N) {
+    const double3 up = std::abs(N.z) < 0.999 ? double3(0, 0, 1) : double3(1, 0, 0);
+    mat3 R;
+    R[0] = normalize(cross(up, N));
+    R[1] = cross(N, R[0]);
+    R[2] = N;
+    return R;
+}
+
 
 /*
  *
@@ -250,7 +261,7 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
 
     // be careful w/ the size of this structure, the smaller the better
     struct CacheEntry {
-        double3 L;
+        float3 L;
         float brdf_NoL;
         float lerp;
         uint8_t l0;
@@ -310,7 +321,7 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
             uint8_t l1 = uint8_t(std::min(maxLevel, size_t(l0 + 1)));
             float lerp = mipLevel - l0;
 
-            cache.push_back({ L, brdf_NoL, lerp, l0, l1 });
+            cache.push_back({ float3(L), brdf_NoL, lerp, l0, l1 });
         }
     }
 
@@ -336,22 +347,18 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
             updater.update(0, p, dim * 6);
         }
 
-        mat3 R;
         const size_t numSamples = cache.size();
         for (size_t x = 0; x < dim; ++x, ++data) {
             const double2 p(dst.center(x, y));
             const double3 N(dst.getDirectionFor(f, p.x, p.y));
 
             // center the cone around the normal (handle case of normal close to up)
-            const double3 up = std::abs(N.z) < 0.999 ? double3(0, 0, 1) : double3(1, 0, 0);
-            R[0] = normalize(cross(up, N));
-            R[1] = cross(N, R[0]);
-            R[2] = N;
+            const mat3f R(tangentFrame(N));
 
             float3 Li = 0;
             for (size_t sample = 0; sample < numSamples; sample++) {
                 const CacheEntry& e = cache[sample];
-                const double3 L(R * e.L);
+                const float3 L(R * e.L);
                 const Cubemap& cmBase = levels[e.l0];
                 const Cubemap& next = levels[e.l1];
                 const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
@@ -467,7 +474,7 @@ void CubemapIBL::diffuseIrradiance(Cubemap& dst, const std::vector<Cubemap>& lev
 
 
     struct CacheEntry {
-        double3 L;
+        float3 L;
         float lerp;
         uint8_t l0;
         uint8_t l1;
@@ -496,7 +503,7 @@ void CubemapIBL::diffuseIrradiance(Cubemap& dst, const std::vector<Cubemap>& lev
             uint8_t l1 = uint8_t(std::min(maxLevel, size_t(l0 + 1)));
             float lerp = mipLevel - l0;
 
-            cache.push_back({ L, lerp, l0, l1 });
+            cache.push_back({ float3(L), lerp, l0, l1 });
         }
     }
 
@@ -513,22 +520,18 @@ void CubemapIBL::diffuseIrradiance(Cubemap& dst, const std::vector<Cubemap>& lev
             updater.update(0, p, dim * 6);
         }
 
-        mat3 R;
         const size_t numSamples = cache.size();
         for (size_t x = 0; x < dim; ++x, ++data) {
             const double2 p(dst.center(x, y));
             const double3 N(dst.getDirectionFor(f, p.x, p.y));
 
             // center the cone around the normal (handle case of normal close to up)
-            const double3 up = std::abs(N.z) < 0.999 ? double3(0, 0, 1) : double3(1, 0, 0);
-            R[0] = normalize(cross(up, N));
-            R[1] = cross(N, R[0]);
-            R[2] = N;
+            const mat3f R(tangentFrame(N));
 
             float3 Li = 0;
             for (size_t sample = 0; sample < numSamples; sample++) {
                 const CacheEntry& e = cache[sample];
-                const double3 L(R * e.L);
+                const float3 L(R * e.L);
                 const Cubemap& cmBase = levels[e.l0];
                 const Cubemap& next = levels[e.l1];
                 const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
@@ -20,6 +20,7 @@
 #include <iostream>
 #include <sstream>
 
+#include <math/half.h>
 #include <math/scalar.h>
 #include <math/vec4.h>
 
@@ -29,6 +30,7 @@
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
@@ -74,6 +76,9 @@ static bool g_sh_irradiance = false;
 static ShFile g_sh_file = ShFile::SH_NONE;
 static utils::Path g_sh_filename;
 static std::unique_ptr<math::double3[]> g_coefficients;
+static bool g_sh_volume = false;
+static size_t g_sh_volume_size[3] = {};
+static utils::Path g_sh_volume_filename;
 
 static bool g_is_mipmap = false;
 static utils::Path g_is_mipmap_dir;
@@ -95,7 +100,10 @@ static bool g_mirror = false;
 
 // -----------------------------------------------------------------------------------------------
 
+static void loadCubemap(const utils::Path& iname, std::vector<Image>& images,
+        std::vector<Cubemap>& levels);
 static void generateMipmaps(std::vector<Cubemap>& levels, std::vector<Image>& images);
+static void shVolume(char* const* inames, size_t count);
 static void sphericalHarmonics(const utils::Path& iname, const Cubemap& inputCubemap);
 static void iblRoughnessPrefilter(const utils::Path& iname, const std::vector<Cubemap>& levels,
         const utils::Path& dir);
@@ -105,11 +113,62 @@ static void iblMipmapPrefilter(const utils::Path& iname, const std::vector<Image
         const std::vector<Cubemap>& levels, const utils::Path& dir);
 static void iblLutDfg(const utils::Path& filename, size_t size, bool multiscatter = false);
 static void extractCubemapFaces(const utils::Path& iname, const Cubemap& cm, const utils::Path& dir);
-static void outputSh(std::ostream& out, const std::unique_ptr<math::double3[]>& sh, size_t numBands);
+static void shVolume(char* const* inames, size_t count) {
+    const size_t w = g_sh_volume_size[0];
+    const size_t h = g_sh_volume_size[1];
+    const size_t d = g_sh_volume_size[2];
+    if (count != w * h * d) {
+        std::cerr << "--sh-volume=" << w << "x" << h << "x" << d << " needs " << w * h * d
+                  << " environments, got " << count << std::endl;
+        exit(1);
+    }
+    if (g_sh_volume_filename.isEmpty()) {
+        std::cerr << "--sh-volume needs --sh-volume-output" << std::endl;
+        exit(1);
+    }
+
+    // the coefficient k of the probe (x, y, z) is the texel (x, y, k * d + z)
+    std::unique_ptr<half4[]> texels(new half4[w * h * d * 9]);
+    for (size_t z = 0, i = 0; z < d; z++) {
+        for (size_t y = 0; y < h; y++) {
+            for (size_t x = 0; x < w; x++, i++) {
+                utils::Path iname(inames[i]);
+                if (!g_quiet) {
+                    std::cout << "Probe " << x << ", " << y << ", " << z << ": " << iname
+                              << std::endl;
+                }
+                std::vector<Image> images;
+                std::vector<Cubemap> levels;
+                loadCubemap(iname, images, levels);
+                std::unique_ptr<math::double3[]> sh =
+                        CubemapSH::computeIrradianceSH3Bands(levels[0]);
+                for (size_t k = 0; k < 9; k++) {
+                    half4& texel = texels[((k * d + z) * h + y) * w + x];
+                    texel = half4{ float3{ sh[k] }, 1.0f };
+                }
+            }
+        }
+    }
+
+    utils::Path outputDir(g_sh_volume_filename.getAbsolutePath().getParent());
+    if (!outputDir.exists()) {
+        outputDir.mkdirRecursive();
+    }
+    std::ofstream outputStream(g_sh_volume_filename, std::ios::binary | std::ios::trunc);
+    outputStream.write(reinterpret_cast<const char*>(texels.get()),
+            w * h * d * 9 * sizeof(half4));
+    if (!outputStream) {
+        std::cerr << "Unable to write " << g_sh_volume_filename << std::endl;
+        exit(1);
+    }
+}
+
+void outputSh(std::ostream& out, const std::unique_ptr<math::double3[]>& sh, size_t numBands);
 static void outputSpectrum(std::ostream& out, const std::unique_ptr<math::double3[]>& sh,
         size_t numBands);
 static void saveImage(const std::string& path, ImageEncoder::Format format, const Image& image,
         const std::string& compression);
+static void saveFaces(const utils::Path& dir, const std::string& prefix, const Cubemap& cm);
 static LinearImage toLinearImage(const Image& image);
 static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubemap& cm);
 
@@ -145,12 +204,14 @@ static void printUsage(char* name) {
             "       Specify output type (default: cubemap)\n\n"
             "   --format=[exr|hdr|psd|rgbm|png|dds|ktx], -f [exr|hdr|psd|rgbm|png|dds|ktx]\n"
             "       Specify output file format. ktx implies -type=ktx.\n"
-            "       KTX files are always encoded with 4-channel RGBM data\n\n"
+            "       KTX files are encoded with 4-channel RGBM data, unless they're compressed\n"
+            "       with an HDR format (astc_*_hdr_* or bptc_bc6h)\n\n"
             "   --compression=COMPRESSION, -c COMPRESSION\n"
             "       Format specific compression:\n"
             "           KTX:\n"
             "             astc_[fast|thorough]_[ldr|hdr]_WxH, where WxH is a valid block size\n"
             "             s3tc_rgba_dxt5\n"
+            "             bptc_[bc6h|bc7|bc7_srgb]\n"
             "             etc_FORMAT_METRIC_EFFORT\n"
             "               FORMAT is rgb8_alpha, srgb8_alpha, rgba8, or srgb8_alpha8\n"
             "               METRIC is rgba, rgbx, rec709, numeric, or normalxyz\n"
@@ -193,6 +254,11 @@ static void printUsage(char* name) {
             "       Irradiance SH coefficients\n\n"
             "   --sh-shader\n"
             "       Generate irradiance SH for shader code\n\n"
+            "   --sh-volume=WxHxD\n"
+            "       Irradiance volume of WxHxD probes, from one input environment per probe\n"
+            "       (x varies first, then y, then z). See IndirectLight::irradianceVolume()\n\n"
+            "   --sh-volume-output=filename\n"
+            "       Raw RGBA16F output of --sh-volume, a W x H x 9D texture\n\n"
             "   --debug, -d\n"
             "       Generate extra data for debugging\n\n"
     );
@@ -225,6 +291,8 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             { "sh-output",            required_argument, nullptr, 'o' },
             { "sh-irradiance",              no_argument, nullptr, 'i' },
             { "sh-shader",                  no_argument, nullptr, 'b' },
+            { "sh-volume",            required_argument, nullptr, 'v' },
+            { "sh-volume-output",     required_argument, nullptr, 'w' },
             { "ibl-is-mipmap",        required_argument, nullptr, 'y' },
             { "ibl-ld",               required_argument, nullptr, 'p' },
             { "ibl-irradiance",       required_argument, nullptr, 'P' },
@@ -342,6 +410,18 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
                 g_sh_irradiance = true;
                 g_sh_shader = true;
                 break;
+            case 'v':
+                if (sscanf(arg.c_str(), "%zux%zux%zu", &g_sh_volume_size[0],
+                        &g_sh_volume_size[1], &g_sh_volume_size[2]) != 3 ||
+                        !g_sh_volume_size[0] || !g_sh_volume_size[1] || !g_sh_volume_size[2]) {
+                    std::cerr << "--sh-volume must be WxHxD, e.g. 8x4x8" << std::endl;
+                    exit(1);
+                }
+                g_sh_volume = true;
+                break;
+            case 'w':
+                g_sh_volume_filename = arg;
+                break;
             case 'e':
                 g_extract_dir = arg;
                 g_extract_faces = true;
@@ -461,6 +541,76 @@ int main(int argc, char* argv[]) {
     // Cubemaps are just views on Images
     std::vector<Cubemap> levels;
 
+    // we mirror by default -- the mirror option in fact un-mirrors.
+    g_mirror = !g_mirror;
+
+    if (g_sh_volume) {
+        shVolume(argv + option_index, size_t(num_args));
+        return 0;
+    }
+
+    loadCubemap(iname, images, levels);
+
+    // Now generate all the mipmap levels
+    generateMipmaps(levels, images);
+
+    if (g_sh_compute) {
+        if (!g_quiet) {
+            std::cout << "Spherical harmonics..." << std::endl;
+        }
+        Cubemap const& cm(levels[0]);
+        sphericalHarmonics(iname, cm);
+    }
+
+    if (g_is_mipmap) {
+        if (!g_quiet) {
+            std::cout << "IBL mipmaps for prefiltered importance sampling..." << std::endl;
+        }
+        iblMipmapPrefilter(iname, images, levels, g_is_mipmap_dir);
+    }
+
+    if (g_prefilter) {
+        if (!g_quiet) {
+            std::cout << "IBL prefiltering..." << std::endl;
+        }
+        iblRoughnessPrefilter(iname, levels, g_prefilter_dir);
+    }
+
+    if (g_ibl_irradiance) {
+        if (!g_quiet) {
+            std::cout << "IBL diffuse irradiance..." << std::endl;
+        }
+        iblDiffuseIrradiance(iname, levels, g_ibl_irradiance_dir);
+    }
+
+    if (g_extract_faces) {
+        Cubemap const& cm(levels[0]);
+        if (g_extract_blur != 0) {
+            if (!g_quiet) {
+                std::cout << "Blurring..." << std::endl;
+            }
+            const double linear_roughness = g_extract_blur * g_extract_blur;
+            const size_t dim = g_output_size ? g_output_size : cm.getDimensions();
+            Image image;
+            Cubemap blurred = CubemapUtils::create(image, dim);
+            CubemapIBL::roughnessFilter(blurred, levels, linear_roughness, g_num_samples);
+            if (!g_quiet) {
+                std::cout << "Extract faces..." << std::endl;
+            }
+            extractCubemapFaces(iname, blurred, g_extract_dir);
+        } else {
+            if (!g_quiet) {
+                std::cout << "Extract faces..." << std::endl;
+            }
+            extractCubemapFaces(iname, cm, g_extract_dir);
+        }
+    }
+
+    return 0;
+}
+
+void loadCubemap(const utils::Path& iname, std::vector<Image>& images,
+        std::vector<Cubemap>& levels) {
     if (iname.exists()) {
         if (!g_quiet) {
             std::cout << "Decoding image..." << std::endl;
@@ -547,8 +697,6 @@ int main(int argc, char* argv[]) {
         levels.push_back(std::move(cml));
     }
 
-    // we mirror by default -- the mirror option in fact un-mirrors.
-    g_mirror = !g_mirror;
     if (g_mirror) {
         if (!g_quiet) {
             std::cout << "Mirroring..." << std::endl;
@@ -566,63 +714,6 @@ int main(int argc, char* argv[]) {
 
     // make the cubemap seamless
     levels[0].makeSeamless();
-
-    // Now generate all the mipmap levels
-    generateMipmaps(levels, images);
-
-    if (g_sh_compute) {
-        if (!g_quiet) {
-            std::cout << "Spherical harmonics..." << std::endl;
-        }
-        Cubemap const& cm(levels[0]);
-        sphericalHarmonics(iname, cm);
-    }
-
-    if (g_is_mipmap) {
-        if (!g_quiet) {
-            std::cout << "IBL mipmaps for prefiltered importance sampling..." << std::endl;
-        }
-        iblMipmapPrefilter(iname, images, levels, g_is_mipmap_dir);
-    }
-
-    if (g_prefilter) {
-        if (!g_quiet) {
-            std::cout << "IBL prefiltering..." << std::endl;
-        }
-        iblRoughnessPrefilter(iname, levels, g_prefilter_dir);
-    }
-
-    if (g_ibl_irradiance) {
-        if (!g_quiet) {
-            std::cout << "IBL diffuse irradiance..." << std::endl;
-        }
-        iblDiffuseIrradiance(iname, levels, g_ibl_irradiance_dir);
-    }
-
-    if (g_extract_faces) {
-        Cubemap const& cm(levels[0]);
-        if (g_extract_blur != 0) {
-            if (!g_quiet) {
-                std::cout << "Blurring..." << std::endl;
-            }
-            const double linear_roughness = g_extract_blur * g_extract_blur;
-            const size_t dim = g_output_size ? g_output_size : cm.getDimensions();
-            Image image;
-            Cubemap blurred = CubemapUtils::create(image, dim);
-            CubemapIBL::roughnessFilter(blurred, levels, linear_roughness, g_num_samples);
-            if (!g_quiet) {
-                std::cout << "Extract faces..." << std::endl;
-            }
-            extractCubemapFaces(iname, blurred, g_extract_dir);
-        } else {
-            if (!g_quiet) {
-                std::cout << "Extract faces..." << std::endl;
-            }
-            extractCubemapFaces(iname, cm, g_extract_dir);
-        }
-    }
-
-    return 0;
 }
 
 void generateMipmaps(std::vector<Cubemap>& levels, std::vector<Image>& images) {
@@ -781,12 +872,7 @@ void iblMipmapPrefilter(const utils::Path& iname,
             continue;
         }
 
-        for (size_t i = 0; i < 6; i++) {
-            Cubemap::Face face = (Cubemap::Face)i;
-            std::string filename = outputDir
-                    + ("is_m" + std::to_string(level) + "_" + CubemapUtils::getFaceName(face) + ext);
-            saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
-        }
+        saveFaces(outputDir, "is_m" + std::to_string(level) + "_", dst);
     }
 }
 
@@ -882,12 +968,7 @@ void iblRoughnessPrefilter(const utils::Path& iname,
             continue;
         }
 
-        for (size_t j = 0; j < 6; j++) {
-            Cubemap::Face face = (Cubemap::Face) j;
-            std::string filename = outputDir
-                    + ("m" + std::to_string(level) + "_" + CubemapUtils::getFaceName(face) + ext);
-            saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
-        }
+        saveFaces(outputDir, "m" + std::to_string(level) + "_", dst);
     }
 
     if (g_type == OutputType::KTX) {
@@ -925,12 +1006,7 @@ void iblDiffuseIrradiance(const utils::Path& iname,
     Cubemap dst = CubemapUtils::create(image, dim);
     CubemapIBL::diffuseIrradiance(dst, levels, numSamples);
 
-    std::string ext = ImageEncoder::chooseExtension(g_format);
-    for (size_t j = 0; j < 6; j++) {
-        Cubemap::Face face = (Cubemap::Face) j;
-        std::string filename = outputDir + ("i_" + CubemapUtils::getFaceName(face) + ext);
-        saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
-    }
+    saveFaces(outputDir, "i_", dst);
 
     if (g_debug) {
         ImageEncoder::Format debug_format = ImageEncoder::Format::HDR;
@@ -1058,11 +1134,7 @@ void extractCubemapFaces(const utils::Path& iname, const Cubemap& cm, const util
         return;
     }
 
-    for (size_t i = 0; i < 6; i++) {
-        Cubemap::Face face = (Cubemap::Face) i;
-        std::string filename(outputDir + (CubemapUtils::getFaceName(face) + ext));
-        saveImage(filename, g_format, cm.getImageForFace(face), g_compression);
-    }
+    saveFaces(outputDir, "", cm);
 }
 
 // Converts a cmgen Image into a libimage LinearImage
@@ -1088,6 +1160,23 @@ static void saveImage(const std::string& path, ImageEncoder::Format format, cons
     }
 }
 
+// Encodes and writes the 6 faces in parallel, as "<prefix><face name>.<ext>" in the given directory.
+static void saveFaces(const utils::Path& dir, const std::string& prefix, const Cubemap& cm) {
+    const std::string ext = ImageEncoder::chooseExtension(g_format);
+    auto parallelJobTask = [&](size_t first, size_t count) {
+        for (size_t i = first; i < first + count; i++) {
+            Cubemap::Face face = (Cubemap::Face) i;
+            std::string filename = dir + (prefix + CubemapUtils::getFaceName(face) + ext);
+            saveImage(filename, g_format, cm.getImageForFace(face), g_compression);
+        }
+    };
+    utils::JobSystem& js = CubemapUtils::getJobSystem();
+    auto job = utils::jobs::parallel_for(js, nullptr, 0, 6,
+            std::ref(parallelJobTask), utils::jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+    js.reset();
+}
+
 static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubemap& cm) {
     CompressionConfig compression {};
     auto& info = container.info();
@@ -1120,7 +1209,10 @@ static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubema
         LinearImage image = toLinearImage(cm.getImageForFace(face));
 
         if (compression.type != CompressionConfig::INVALID) {
-            CompressedTexture tex = compressTexture(compression, fromLinearToRGBM(image));
+            // HDR formats store the radiance as is, the others store it as RGBM
+            CompressedTexture tex = compressTexture(compression,
+                    isHdrConfig(compression) ? image : fromLinearToRGBM(image),
+                    &CubemapUtils::getJobSystem());
             container.setBlob(blobIndex, tex.data.get(), tex.size);
             info.glInternalFormat = (uint32_t) tex.format;
             continue;
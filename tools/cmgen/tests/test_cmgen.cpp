@@ -28,7 +28,9 @@
 #include <utils/Panic.h>
 #include <utils/Path.h>
 
+#include <math/half.h>
 #include <math/vec3.h>
+#include <math/vec4.h>
 
 #include <cstdlib>
 #include <fstream>
@@ -139,6 +141,25 @@ TEST_F(CmgenTest, SphericalHarmonics) { // NOLINT
     compareSh(content, vec3 + "L22",  float3{0.0f});
 }
 
+TEST_F(CmgenTest, SphericalHarmonicsVolume) { // NOLINT
+    const string inputPath = "assets/environments/white_furnace/white_furnace.exr";
+    const string resultPath = Path::getCurrentExecutable().getParent() + "white_furnace_sh.bin";
+    launchTool(inputPath, "--sh-volume=1x1x1 --sh-volume-output=" + resultPath);
+
+    // one probe, whose 9 coefficients are the ones of the SphericalHarmonics test
+    std::ifstream result(resultPath.c_str(), std::ios::binary);
+    half4 texels[9];
+    result.read(reinterpret_cast<char*>(texels), sizeof(texels));
+    ASSERT_TRUE(bool(result));
+    ASSERT_EQ(result.peek(), std::ifstream::traits_type::eof());
+
+    for (size_t k = 0; k < 9; k++) {
+        const float3 sh{ float(texels[k].x), float(texels[k].y), float(texels[k].z) };
+        const float3 expected{ k == 0 ? 1.0f : 0.0f };
+        EXPECT_TRUE(all(lessThan(abs(sh - expected), float3{ 1e-3f }))) << "coefficient " << k;
+    }
+}
+
 TEST_F(CmgenTest, HdrLatLong) { // NOLINT
     const string inputPath = "assets/environments/white_furnace/white_furnace.exr";
     const string resultPath = "white_furnace/nx.rgbm";
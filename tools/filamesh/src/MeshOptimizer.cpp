@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+using namespace math;
+
+namespace MeshOptimizer {
+
+CacheStats analyzeVertexCache(uint32_t const* indices, size_t indexCount, size_t vertexCount,
+        size_t cacheSize) {
+    CacheStats stats;
+    stats.triangles = indexCount / 3;
+
+    // a vertex is in the FIFO cache if it was one of the last 'cacheSize' vertices to be inserted
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t timestamp = cacheSize + 1;
+    for (size_t i = 0, c = stats.triangles * 3; i < c; i++) {
+        const uint32_t v = indices[i];
+        if (timestamp - cacheTime[v] > cacheSize) {
+            cacheTime[v] = timestamp++;
+            stats.transformed++;
+        }
+        if (!referenced[v]) {
+            referenced[v] = true;
+            stats.vertices++;
+        }
+    }
+    return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(uint32_t* indices, size_t indexCount,
+        size_t vertexCount, size_t cacheSize) {
+    const size_t triangleCount = indexCount / 3;
+    std::vector<uint32_t> clusters;
+    if (triangleCount == 0) {
+        return clusters;
+    }
+
+    // number of triangles not emitted yet, for each vertex
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        liveCount[indices[i]]++;
+    }
+
+    // triangles using each vertex
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + liveCount[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    size_t timestamp = cacheSize + 1;
+    size_t cursor = 0;
+
+    // when we can't continue from the triangles we just emitted, restart from a recently used
+    // vertex, or as a last resort, from the next vertex in index order that has triangles left.
+    auto skipDeadEnd = [&]() -> int64_t {
+        while (!deadEnd.empty()) {
+            const uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveCount[v] > 0) {
+                return v;
+            }
+        }
+        for (; cursor < vertexCount; cursor++) {
+            if (liveCount[cursor] > 0) {
+                return int64_t(cursor);
+            }
+        }
+        return -1;
+    };
+
+    int64_t fanning = skipDeadEnd();
+    bool restarted = true;
+    while (fanning >= 0) {
+        if (restarted) {
+            // the cache doesn't help across a restart, it's a good place to start a cluster
+            clusters.push_back(uint32_t(output.size()));
+        }
+
+        // emit all the remaining triangles around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = offsets[fanning], e = offsets[fanning + 1]; a < e; a++) {
+            const uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveCount[v]--;
+                if (timestamp - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+        }
+
+        // next, the oldest vertex that will still be in the cache after its triangles are
+        // emitted, or any vertex with triangles left.
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveCount[v] > 0) {
+                int64_t priority = 0;
+                if (timestamp - cacheTime[v] + 2 * liveCount[v] <= cacheSize) {
+                    priority = int64_t(timestamp - cacheTime[v]);
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    best = v;
+                }
+            }
+        }
+
+        restarted = best < 0 || bestPriority == 0;
+        fanning = best < 0 ? skipDeadEnd() : best;
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+    return clusters;
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, float3 const* positions,
+        std::vector<uint32_t> const& clusters) {
+    const size_t count = indexCount - indexCount % 3;
+    if (clusters.size() < 2) {
+        return;
+    }
+
+    struct Cluster {
+        uint32_t begin;
+        uint32_t end;
+        float3 center;      // area-weighted
+        float3 normal;      // area-weighted
+        float area;
+        float key;
+    };
+
+    std::vector<Cluster> list(clusters.size());
+    float3 center = {};
+    float area = 0;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = list[c];
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(count);
+        cluster.center = {};
+        cluster.normal = {};
+        cluster.area = 0;
+        for (uint32_t i = cluster.begin; i < cluster.end; i += 3) {
+            const float3 p0 = positions[indices[i    ]];
+            const float3 p1 = positions[indices[i + 1]];
+            const float3 p2 = positions[indices[i + 2]];
+            const float3 n = cross(p1 - p0, p2 - p0);
+            const float a = length(n);
+            cluster.center += (p0 + p1 + p2) * (a / 3.0f);
+            cluster.normal += n;
+            cluster.area += a;
+        }
+        center += cluster.center;
+        area += cluster.area;
+        if (cluster.area > 0) {
+            cluster.center /= cluster.area;
+        }
+    }
+    if (area > 0) {
+        center /= area;
+    }
+
+    // clusters facing away from the center are more likely to occlude the rest of the mesh
+    for (Cluster& cluster : list) {
+        const float l = length(cluster.normal);
+        cluster.key = l > 0 ? dot(cluster.center - center, cluster.normal / l) : 0.0f;
+    }
+    std::stable_sort(list.begin(), list.end(), [](Cluster const& lhs, Cluster const& rhs) {
+        return lhs.key > rhs.key;
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(count);
+    for (Cluster const& cluster : list) {
+        output.insert(output.end(), indices + cluster.begin, indices + cluster.end);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t indexCount,
+        size_t vertexCount) {
+    constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(vertexCount, UNUSED);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+    for (size_t i = 0; i < indexCount; i++) {
+        const uint32_t v = indices[i];
+        if (remap[v] == UNUSED) {
+            remap[v] = uint32_t(order.size());
+            order.push_back(v);
+        }
+        indices[i] = remap[v];
+    }
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        if (remap[v] == UNUSED) {
+            order.push_back(v);
+        }
+    }
+    return order;
+}
+
+std::vector<Cluster> buildClusters(uint32_t const* indices, size_t indexCount, uint32_t offset,
+        float3 const* positions, size_t vertexCount, size_t maxVertices, size_t maxTriangles) {
+    std::vector<Cluster> clusters;
+    const size_t count = indexCount - indexCount % 3;
+
+    auto computeBounds = [&](uint32_t begin, uint32_t end) {
+        Cluster cluster = {};
+        cluster.offset = offset + begin;
+        cluster.indexCount = end - begin;
+
+        float3 bmin(std::numeric_limits<float>::max());
+        float3 bmax(std::numeric_limits<float>::lowest());
+        float3 axis = {};
+        for (uint32_t i = begin; i < end; i++) {
+            bmin = min(bmin, positions[indices[i]]);
+            bmax = max(bmax, positions[indices[i]]);
+        }
+        cluster.center = (bmin + bmax) * 0.5f;
+        for (uint32_t i = begin; i < end; i++) {
+            cluster.radius = std::max(cluster.radius, length(positions[indices[i]] - cluster.center));
+        }
+
+        // the cone's axis is the average normal, its aperture given by the furthest normal
+        std::vector<float3> normals;
+        normals.reserve((end - begin) / 3);
+        for (uint32_t i = begin; i < end; i += 3) {
+            const float3 p0 = positions[indices[i    ]];
+            const float3 p1 = positions[indices[i + 1]];
+            const float3 p2 = positions[indices[i + 2]];
+            const float3 n = cross(p1 - p0, p2 - p0);
+            const float l = length(n);
+            if (l > 0) {
+                normals.push_back(n / l);
+                axis += n / l;
+            }
+        }
+        const float l = length(axis);
+        float minDot = -1.0f;
+        if (l > 0) {
+            axis /= l;
+            minDot = 1.0f;
+            for (float3 const& n : normals) {
+                minDot = std::min(minDot, dot(axis, n));
+            }
+        }
+        cluster.coneAxis = axis;
+        // a cone wider than a half-space can't be culled, a cutoff of 1 makes the test fail
+        cluster.coneCutoff = minDot > 0 ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+        return cluster;
+    };
+
+    // cluster in which each vertex was last seen
+    constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> seen(vertexCount, NONE);
+    uint32_t begin = 0;
+    size_t vertices = 0;
+    for (uint32_t i = 0; i < count; i += 3) {
+        const uint32_t id = uint32_t(clusters.size());
+        size_t added = 0;
+        for (size_t k = 0; k < 3; k++) {
+            added += (seen[indices[i + k]] != id) ? 1 : 0;
+        }
+        if (vertices + added > maxVertices || (i - begin) / 3 >= maxTriangles) {
+            clusters.push_back(computeBounds(begin, i));
+            begin = i;
+            vertices = 0;
+        }
+        const uint32_t current = uint32_t(clusters.size());
+        for (size_t k = 0; k < 3; k++) {
+            if (seen[indices[i + k]] != current) {
+                seen[indices[i + k]] = current;
+                vertices++;
+            }
+        }
+    }
+    if (begin < count) {
+        clusters.push_back(computeBounds(begin, uint32_t(count)));
+    }
+    return clusters;
+}
+
+// Sum of the squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+
+    // plane a.x + b.y + c.z + d = 0, with a unit normal
+    static Quadric fromPlane(double3 n, double d, double weight) noexcept {
+        Quadric q;
+        q.a2 = weight * n.x * n.x; q.ab = weight * n.x * n.y; q.ac = weight * n.x * n.z;
+        q.ad = weight * n.x * d;
+        q.b2 = weight * n.y * n.y; q.bc = weight * n.y * n.z; q.bd = weight * n.y * d;
+        q.c2 = weight * n.z * n.z; q.cd = weight * n.z * d;
+        q.d2 = weight * d * d;
+        return q;
+    }
+
+    Quadric& operator+=(Quadric const& rhs) noexcept {
+        a2 += rhs.a2; ab += rhs.ab; ac += rhs.ac; ad += rhs.ad;
+        b2 += rhs.b2; bc += rhs.bc; bd += rhs.bd;
+        c2 += rhs.c2; cd += rhs.cd;
+        d2 += rhs.d2;
+        return *this;
+    }
+
+    double error(float3 const& p) const noexcept {
+        const double x = p.x, y = p.y, z = p.z;
+        return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+             + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+             + c2 * z * z + 2 * cd * z
+             + d2;
+    }
+};
+
+std::vector<uint32_t> simplify(uint32_t const* indices, size_t indexCount,
+        float3 const* positions, size_t vertexCount, size_t targetIndexCount) {
+    std::vector<uint32_t> result(indices, indices + indexCount - indexCount % 3);
+
+    // each vertex starts with the planes of its triangles, weighted by their area
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const double3 p0(positions[result[i]]);
+        const double3 p1(positions[result[i + 1]]);
+        const double3 p2(positions[result[i + 2]]);
+        const double3 n = cross(p1 - p0, p2 - p0);
+        const double l = length(n);
+        if (l > 0) {
+            const Quadric q = Quadric::fromPlane(n / l, -dot(n / l, p0), l * 0.5);
+            for (size_t k = 0; k < 3; k++) {
+                quadrics[result[i + k]] += q;
+            }
+        }
+    }
+
+    // the vertices of the edges that don't have exactly 2 triangles never move
+    auto edgeKey = [](uint32_t a, uint32_t b) {
+        return (uint64_t(std::min(a, b)) << 32u) | std::max(a, b);
+    };
+    std::unordered_map<uint64_t, uint32_t> edges;
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t k = 0; k < 3; k++) {
+            edges[edgeKey(result[i + k], result[i + (k + 1) % 3])]++;
+        }
+    }
+    std::vector<bool> locked(vertexCount, false);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        for (size_t k = 0; k < 3; k++) {
+            const uint32_t a = result[i + k];
+            const uint32_t b = result[i + (k + 1) % 3];
+            if (edges[edgeKey(a, b)] != 2) {
+                locked[a] = locked[b] = true;
+            }
+        }
+    }
+    edges.clear();
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    // Each pass collapses the cheapest edges first. The collapses of a pass don't share any
+    // triangle, so that their costs and the flip tests stay valid.
+    const size_t targetTriangleCount = targetIndexCount / 3;
+    std::vector<uint32_t> offsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<Collapse> collapses;
+    while (result.size() / 3 > targetTriangleCount) {
+        const size_t triangleCount = result.size() / 3;
+
+        // triangles around each vertex
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (uint32_t v : result) {
+            offsets[v + 1]++;
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) {
+            adjacency[fill[result[i]]++] = uint32_t(i / 3);
+        }
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t a = result[i + k];
+                const uint32_t b = result[i + (k + 1) % 3];
+                Quadric q = quadrics[a];
+                q += quadrics[b];
+                if (!locked[a]) {
+                    collapses.push_back({ a, b, q.error(positions[b]) });
+                }
+                if (!locked[b]) {
+                    collapses.push_back({ b, a, q.error(positions[a]) });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                [](Collapse const& lhs, Collapse const& rhs) { return lhs.cost < rhs.cost; });
+
+        // the triangles around 'from' must not flip once it's moved onto 'to'
+        auto flips = [&](Collapse const& c) {
+            for (uint32_t j = offsets[c.from]; j < offsets[c.from + 1]; j++) {
+                uint32_t const* t = &result[adjacency[j] * 3];
+                if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+                    continue;
+                }
+                const float3 p0 = positions[t[0]];
+                const float3 p1 = positions[t[1]];
+                const float3 p2 = positions[t[2]];
+                const float3 q0 = positions[t[0] == c.from ? c.to : t[0]];
+                const float3 q1 = positions[t[1] == c.from ? c.to : t[1]];
+                const float3 q2 = positions[t[2] == c.from ? c.to : t[2]];
+                if (dot(cross(p1 - p0, p2 - p0), cross(q1 - q0, q2 - q0)) <= 0) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+        size_t remaining = triangleCount;
+        size_t collapsed = 0;
+        for (Collapse const& c : collapses) {
+            if (remaining <= targetTriangleCount) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to] || flips(c)) {
+                continue;
+            }
+            for (uint32_t j = offsets[c.from]; j < offsets[c.from + 1]; j++) {
+                uint32_t const* t = &result[adjacency[j] * 3];
+                if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+                    remaining--;
+                }
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+            }
+            remap[c.from] = c.to;
+            quadrics[c.to] += quadrics[c.from];
+            collapsed++;
+        }
+        if (!collapsed) {
+            break;
+        }
+
+        // drop the triangles that became degenerate
+        size_t count = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            const uint32_t a = remap[result[i]];
+            const uint32_t b = remap[result[i + 1]];
+            const uint32_t c = remap[result[i + 2]];
+            if (a != b && b != c && c != a) {
+                result[count++] = a;
+                result[count++] = b;
+                result[count++] = c;
+            }
+        }
+        result.resize(count);
+    }
+    return result;
+}
+
+} // namespace MeshOptimizer
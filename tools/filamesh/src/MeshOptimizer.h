@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMESH_MESHOPTIMIZER_H
+#define TNT_FILAMESH_MESHOPTIMIZER_H
+
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Offline optimizations of an indexed triangle list, see:
+// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+namespace MeshOptimizer {
+
+// Size of the post-transform vertex cache we optimize for, and simulate to compute the stats
+constexpr size_t CACHE_SIZE = 16;
+
+// Post-transform vertex cache efficiency of an index buffer, for a FIFO cache
+struct CacheStats {
+    size_t transformed = 0;     // number of vertices that missed the cache
+    size_t triangles = 0;
+    size_t vertices = 0;        // number of distinct vertices referenced
+
+    // average cache miss ratio: transformed vertices per triangle, 0.5 is the best case
+    float getACMR() const noexcept { return triangles ? float(transformed) / triangles : 0.0f; }
+
+    // average transform to vertex ratio: how many times each vertex is transformed, 1 is ideal
+    float getATVR() const noexcept { return vertices ? float(transformed) / vertices : 0.0f; }
+
+    CacheStats& operator+=(CacheStats const& rhs) noexcept {
+        transformed += rhs.transformed;
+        triangles += rhs.triangles;
+        vertices += rhs.vertices;
+        return *this;
+    }
+};
+
+CacheStats analyzeVertexCache(uint32_t const* indices, size_t indexCount, size_t vertexCount,
+        size_t cacheSize = CACHE_SIZE);
+
+// Reorders the triangles for the post-transform vertex cache (Tipsify), returns the offsets of
+// the clusters of triangles it produced, for optimizeOverdraw().
+std::vector<uint32_t> optimizeVertexCache(uint32_t* indices, size_t indexCount,
+        size_t vertexCount, size_t cacheSize = CACHE_SIZE);
+
+// Sorts the clusters of triangles so that those facing away from the center of the mesh, which
+// are likely to occlude the others, come first. This keeps the vertex cache locality within
+// each cluster.
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, math::float3 const* positions,
+        std::vector<uint32_t> const& clusters);
+
+// Renumbers the vertices in the order the index buffer first uses them, so that vertex fetches
+// are mostly sequential. Returns the old index of each new vertex, the vertices the index buffer
+// doesn't use come last.
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t indexCount,
+        size_t vertexCount);
+
+// Bounds of a cluster (meshlet) of triangles, used to cull clusters
+struct Cluster {
+    uint32_t offset;            // first index of the cluster in the index buffer
+    uint32_t indexCount;
+    math::float3 center;        // bounding sphere
+    float radius;
+    // normal cone: the cluster is back-facing as seen from 'eye' if
+    // dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius
+    math::float3 coneAxis;
+    float coneCutoff;
+};
+
+// Splits the triangles in contiguous clusters of at most 'maxVertices' vertices and
+// 'maxTriangles' triangles, and computes their bounds. 'offset' is added to the index offsets.
+std::vector<Cluster> buildClusters(uint32_t const* indices, size_t indexCount, uint32_t offset,
+        math::float3 const* positions, size_t vertexCount,
+        size_t maxVertices = 64, size_t maxTriangles = 126);
+
+// Simplifies the triangles down to about 'targetIndexCount' indices, with quadric error metrics,
+// see Garland, Heckbert, "Surface Simplification Using Quadric Error Metrics". Each collapse
+// moves a vertex onto a neighbor, so the result uses the same vertices as the source. The
+// vertices on the edges used by a single triangle are locked: this keeps the open borders, and
+// the seams where the attributes of the vertices differ (e.g. UVs), in place.
+std::vector<uint32_t> simplify(uint32_t const* indices, size_t indexCount,
+        math::float3 const* positions, size_t vertexCount, size_t targetIndexCount);
+
+} // namespace MeshOptimizer
+
+#endif // TNT_FILAMESH_MESHOPTIMIZER_H
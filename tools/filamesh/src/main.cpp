@@ -15,20 +15,29 @@
  */
 
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
 
 #include <math/half.h>
 #include <math/mat3.h>
 #include <math/norm.h>
 #include <math/quat.h>
+#include <math/vec2.h>
 #include <math/vec3.h>
+#include <math/vec4.h>
 
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
 
 #include "Box.h"
+#include "MeshOptimizer.h"
 
 using namespace math;
 using namespace utils;
@@ -40,6 +49,9 @@ using namespace utils;
 
 static const uint32_t VERSION = 1;
 
+// files using the quantized streams or the clusters
+static const uint32_t VERSION_EXTENDED = 2;
+
 using Assimp::Importer;
 
 struct Header {
@@ -64,6 +76,20 @@ struct Header {
     uint32_t indexSize;
 };
 
+// follows the header in version 2
+struct HeaderExtension {
+    enum Flags : uint32_t {
+        QUANTIZED       = 0x1,  // ushort4 positions and byte4 tangents quaternions
+        NORMALIZED_UV0  = 0x2,  // ushort2 UV0 instead of half2
+        CLUSTERS        = 0x4,  // the file ends with the clusters' bounds
+        LODS            = 0x8   // then with the levels of detail, see writeLevels()
+    };
+    uint32_t flags;
+    float3   positionOffset;    // position = positionOffset + positionScale * quantized position
+    float3   positionScale;
+    uint32_t clusterCount;
+};
+
 struct Vertex {
     Vertex(const float3& position, const quatf& tangents, const float4& color, const float3& uv0):
             position(position, 1.0_h),
@@ -97,8 +123,25 @@ struct Mesh {
     Box aabb;
 };
 
+// a simplified level of the mesh, used below a screen coverage
+struct LevelOfDetail {
+    float ratio;                // of the triangles of the source
+    float maxScreenCoverage;
+};
+
+// the levels of detail can't exceed RenderableManager::MAX_LEVEL_COUNT
+static constexpr size_t MAX_LEVEL_COUNT = 4;
+
 // configuration
 bool g_interleaved = false;
+bool g_optimize = false;
+bool g_quantize = false;
+bool g_clusters = false;
+std::vector<LevelOfDetail> g_levels;    // after level 0, the source mesh
+
+// vertex cache efficiency, before and after optimization
+MeshOptimizer::CacheStats g_statsBefore;
+MeshOptimizer::CacheStats g_statsAfter;
 
 uint32_t g_vertexCount = 0;
 std::vector<uint32_t> g_indices;
@@ -110,6 +153,13 @@ std::vector<decltype(Vertex::tangents)>  g_tangents;
 std::vector<decltype(Vertex::color)>     g_colors;
 std::vector<decltype(Vertex::uv0)>       g_uv0;
 std::vector<decltype(Vertex::uv0)>       g_uv1;
+// full precision attributes, for quantization and the clusters' bounds
+std::vector<float3> g_sourcePositions;
+std::vector<quatf>  g_sourceTangents;
+std::vector<float2> g_sourceUV0;
+bool g_hasColors = false;
+std::vector<MeshOptimizer::Cluster> g_clusterList;
+std::vector<Mesh> g_levelParts;         // the parts of each simplified level, in order
 
 template<typename T>
 void write(std::ofstream& out, const T& value) {
@@ -136,6 +186,52 @@ static Box computeAABB(VECTOR const* positions, INDEX const* indices,
     return Box().set(bmin, bmax);
 }
 
+// moves the vertices [offset, offset + order.size()[ so that the i-th is the order[i]-th one
+template<typename T>
+static void reorderVertices(std::vector<T>& vertices, size_t offset,
+        std::vector<uint32_t> const& order) {
+    std::vector<T> source(vertices.begin() + offset, vertices.begin() + offset + order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        vertices[offset + i] = source[order[i]];
+    }
+}
+
+// optimizes a part's triangles for the vertex cache and overdraw, and its vertices for fetching
+template<bool INTERLEAVED>
+static void optimizePart(uint32_t* indices, size_t indexCount, size_t vertexOffset,
+        size_t vertexCount, const float3* positions, bool hasUV1) {
+    using namespace MeshOptimizer;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        indices[i] -= vertexOffset;
+    }
+
+    g_statsBefore += analyzeVertexCache(indices, indexCount, vertexCount);
+    std::vector<uint32_t> clusters = optimizeVertexCache(indices, indexCount, vertexCount);
+    optimizeOverdraw(indices, indexCount, positions, clusters);
+    std::vector<uint32_t> order = optimizeVertexFetch(indices, indexCount, vertexCount);
+    g_statsAfter += analyzeVertexCache(indices, indexCount, vertexCount);
+
+    reorderVertices(g_sourcePositions, vertexOffset, order);
+    reorderVertices(g_sourceTangents, vertexOffset, order);
+    reorderVertices(g_sourceUV0, vertexOffset, order);
+    if (INTERLEAVED) {
+        reorderVertices(g_vertices, vertexOffset, order);
+    } else {
+        reorderVertices(g_positions, vertexOffset, order);
+        reorderVertices(g_tangents, vertexOffset, order);
+        reorderVertices(g_colors, vertexOffset, order);
+        reorderVertices(g_uv0, vertexOffset, order);
+        if (hasUV1) {
+            reorderVertices(g_uv1, vertexOffset, order);
+        }
+    }
+
+    for (size_t i = 0; i < indexCount; i++) {
+        indices[i] += vertexOffset;
+    }
+}
+
 template<bool INTERLEAVED>
 void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& meshes) {
     for (size_t i = 0; i < node->mNumMeshes; ++i) {
@@ -155,6 +251,8 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
 
         if (!mesh->HasVertexColors(0)) {
             colors = nullptr;
+        } else {
+            g_hasColors = true;
         }
         if (!mesh->HasTextureCoords(1)) {
             uv1 = nullptr;
@@ -182,6 +280,9 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
                     quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
 
                     color = colors ? colors[j] : float4(1.0f);
+                    g_sourcePositions.push_back(vertices[j]);
+                    g_sourceTangents.push_back(q);
+                    g_sourceUV0.push_back(uv0[j].xy);
                     if (INTERLEAVED) {
                         g_vertices.emplace_back(vertices[j], q, color, uv0[j]);
                     } else {
@@ -209,6 +310,18 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
                     }
                 }
 
+                if (g_optimize) {
+                    optimizePart<INTERLEAVED>(g_indices.data() + indexBufferOffset, indicesCount,
+                            indicesOffset, numVertices, vertices, uv1 != nullptr);
+                }
+
+                if (g_clusters) {
+                    std::vector<MeshOptimizer::Cluster> clusters = MeshOptimizer::buildClusters(
+                            g_indices.data() + indexBufferOffset, indicesCount,
+                            uint32_t(indexBufferOffset), g_sourcePositions.data(), g_vertexCount);
+                    g_clusterList.insert(g_clusterList.end(), clusters.begin(), clusters.end());
+                }
+
                 size_t stride = INTERLEAVED ? sizeof(Vertex) : sizeof(Vertex::position);
                 const decltype(Vertex::position)* positions =
                         INTERLEAVED ? &g_vertices.data()->position : g_positions.data();
@@ -226,6 +339,154 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
     }
 }
 
+// Simplifies the parts for each level of detail. The simplified levels use the same vertices,
+// their indices follow those of the source mesh.
+static void generateLevels(std::vector<Mesh> const& meshes) {
+    for (LevelOfDetail const& level : g_levels) {
+        size_t before = 0;
+        size_t after = 0;
+        for (Mesh const& mesh : meshes) {
+            std::vector<uint32_t> indices = MeshOptimizer::simplify(g_indices.data() + mesh.offset,
+                    mesh.count, g_sourcePositions.data(), g_vertexCount,
+                    size_t(mesh.count * level.ratio));
+            if (g_optimize) {
+                MeshOptimizer::optimizeVertexCache(indices.data(), indices.size(), g_vertexCount);
+            }
+            uint32_t minIndex = std::numeric_limits<uint32_t>::max();
+            uint32_t maxIndex = 0;
+            for (uint32_t index : indices) {
+                minIndex = std::min(minIndex, index);
+                maxIndex = std::max(maxIndex, index);
+            }
+            if (indices.empty()) {
+                minIndex = maxIndex = mesh.minIndex;
+            }
+            g_levelParts.emplace_back(uint32_t(g_indices.size()), uint32_t(indices.size()),
+                    minIndex, maxIndex, mesh.material, mesh.aabb);
+            g_indices.insert(g_indices.end(), indices.begin(), indices.end());
+            before += mesh.count / 3;
+            after += indices.size() / 3;
+        }
+        std::cout << "Level of detail below " << level.maxScreenCoverage << " coverage: "
+                << before << " -> " << after << " triangles" << std::endl;
+    }
+}
+
+// Writes the levels of detail: the number of levels including the source mesh, the minimum
+// screen coverage of each level (for RenderableManager::Builder::levelOfDetail()), then the
+// parts of the simplified levels.
+static void writeLevels(std::ofstream& out) {
+    write(out, uint32_t(g_levels.size() + 1));
+    for (LevelOfDetail const& level : g_levels) {
+        write(out, level.maxScreenCoverage);
+    }
+    write(out, 0.0f);
+    write(out, g_levelParts.data(), uint32_t(g_levelParts.size()));
+}
+
+// a vertex attribute of the quantized format
+struct Stream {
+    std::vector<uint8_t> data;
+    uint32_t elementSize = 0;
+
+    template<typename T>
+    void push(const T& value) {
+        elementSize = sizeof(T);
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+        data.insert(data.end(), p, p + sizeof(T));
+    }
+};
+
+// Builds the vertex data of the quantized format and fills the header's layout; the attributes
+// that are absent have an offset and stride of 0xffffffff.
+static std::vector<uint8_t> quantizeVertices(Header& header, HeaderExtension& extension) {
+    const size_t count = g_vertexCount;
+
+    float3 bmin(std::numeric_limits<float>::max());
+    float3 bmax(std::numeric_limits<float>::lowest());
+    bool uv0InRange = true;
+    for (size_t i = 0; i < count; i++) {
+        bmin = min(bmin, g_sourcePositions[i]);
+        bmax = max(bmax, g_sourcePositions[i]);
+        const float2 uv = g_sourceUV0[i];
+        uv0InRange = uv0InRange && uv.x >= 0 && uv.x <= 1 && uv.y >= 0 && uv.y <= 1;
+    }
+    // flat meshes still need an invertible decode
+    const float3 extent = bmax - bmin;
+    extension.positionOffset = bmin;
+    extension.positionScale = float3{
+            extent.x > 0 ? extent.x : 1.0f,
+            extent.y > 0 ? extent.y : 1.0f,
+            extent.z > 0 ? extent.z : 1.0f };
+    extension.flags |= HeaderExtension::QUANTIZED;
+    if (uv0InRange) {
+        extension.flags |= HeaderExtension::NORMALIZED_UV0;
+    }
+
+    Stream positions, tangents, colors, uv0, uv1;
+    for (size_t i = 0; i < count; i++) {
+        const float3 p = (g_sourcePositions[i] - extension.positionOffset) /
+                extension.positionScale;
+        positions.push(packUnorm16(float4{ clamp(p, 0.0f, 1.0f), 1.0f }));
+        tangents.push(packSnorm8(g_sourceTangents[i].xyzw));
+        if (g_hasColors) {
+            colors.push(g_interleaved ? g_vertices[i].color : g_colors[i]);
+        }
+        if (uv0InRange) {
+            uv0.push(ushort2{ packUnorm16(g_sourceUV0[i].x), packUnorm16(g_sourceUV0[i].y) });
+        } else {
+            uv0.push(half2(g_sourceUV0[i]));
+        }
+        if (!g_interleaved && !g_uv1.empty()) {
+            uv1.push(g_uv1[i]);
+        }
+    }
+
+    struct Attribute {
+        Stream const& stream;
+        uint32_t& offset;
+        uint32_t& stride;
+    } attributes[] = {
+            { positions, header.offsetPosition, header.stridePosition },
+            { tangents,  header.offsetTangents, header.strideTangents },
+            { colors,    header.offsetColor,    header.strideColor },
+            { uv0,       header.offsetUV0,      header.strideUV0 },
+            { uv1,       header.offsetUV1,      header.strideUV1 },
+    };
+
+    uint32_t vertexSize = 0;
+    for (Attribute& attribute : attributes) {
+        attribute.offset = std::numeric_limits<uint32_t>::max();
+        attribute.stride = std::numeric_limits<uint32_t>::max();
+        if (attribute.stream.elementSize) {
+            // interleaved: offset in the vertex, otherwise offset of the stream
+            attribute.offset = uint32_t(g_interleaved ? vertexSize : vertexSize * count);
+            vertexSize += attribute.stream.elementSize;
+        }
+    }
+
+    std::vector<uint8_t> data(vertexSize * count);
+    for (Attribute& attribute : attributes) {
+        const uint32_t size = attribute.stream.elementSize;
+        if (!size) {
+            continue;
+        }
+        if (g_interleaved) {
+            attribute.stride = vertexSize;
+            for (size_t i = 0; i < count; i++) {
+                memcpy(&data[i * vertexSize + attribute.offset],
+                        &attribute.stream.data[i * size], size);
+            }
+        } else {
+            attribute.stride = 0;
+            memcpy(&data[attribute.offset], attribute.stream.data.data(), size * count);
+        }
+    }
+
+    header.vertexSize = uint32_t(data.size());
+    return data;
+}
+
 static void printUsage(const char* name) {
     std::string execName(utils::Path(name).getName());
     std::string usage(
@@ -245,6 +506,19 @@ static void printUsage(const char* name) {
                     "       Print copyright and license information\n\n"
                     "   --interleaved, -i\n"
                     "       interleaves mesh attributes\n\n"
+                    "   --optimize, -o\n"
+                    "       reorders triangles and vertices for the vertex cache and overdraw,\n"
+                    "       and prints the vertex cache efficiency before and after\n\n"
+                    "   --quantize, -q\n"
+                    "       quantizes positions to ushort4 and tangents to byte4, UV0 to ushort2\n"
+                    "       when in [0, 1], and drops colors if the mesh has none (version 2)\n\n"
+                    "   --clusters, -c\n"
+                    "       writes the bounding sphere and normal cone of clusters of up to\n"
+                    "       64 vertices and 126 triangles (version 2)\n\n"
+                    "   --lod=<ratio>:<coverage>, -d <ratio>:<coverage>\n"
+                    "       adds a level of detail simplified to <ratio> of the triangles, used\n"
+                    "       below a screen <coverage> (fraction of the viewport's height), e.g.\n"
+                    "       --lod=0.5:0.3 --lod=0.1:0.1; up to 3 levels (version 2)\n\n"
     );
 
     const std::string from("FILAMESH");
@@ -261,11 +535,15 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hil";
+    static constexpr const char* OPTSTR = "hiloqcd:";
     static const struct option OPTIONS[] = {
             { "help",        no_argument, 0, 'h' },
             { "license",     no_argument, 0, 'l' },
             { "interleaved", no_argument, 0, 'i' },
+            { "optimize",    no_argument, 0, 'o' },
+            { "quantize",    no_argument, 0, 'q' },
+            { "clusters",    no_argument, 0, 'c' },
+            { "lod",   required_argument, 0, 'd' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -287,6 +565,32 @@ static int handleArguments(int argc, char* argv[]) {
             case 'i':
                 g_interleaved = true;
                 break;
+            case 'o':
+                g_optimize = true;
+                break;
+            case 'q':
+                g_quantize = true;
+                break;
+            case 'c':
+                g_clusters = true;
+                break;
+            case 'd': {
+                LevelOfDetail level;
+                if (sscanf(optarg, "%f:%f", &level.ratio, &level.maxScreenCoverage) != 2 ||
+                        level.ratio <= 0 || level.ratio > 1 ||
+                        (!g_levels.empty() &&
+                                level.maxScreenCoverage >= g_levels.back().maxScreenCoverage)) {
+                    std::cerr << "Invalid level of detail: " << optarg << ", the coverage must "
+                            "decrease with each level" << std::endl;
+                    exit(1);
+                }
+                if (g_levels.size() + 1 >= MAX_LEVEL_COUNT) {
+                    std::cerr << "Too many levels of detail" << std::endl;
+                    exit(1);
+                }
+                g_levels.push_back(level);
+                break;
+            }
         }
     }
 
@@ -344,6 +648,16 @@ int main(int argc, char* argv[]) {
         processNode<false>(scene, node, meshes);
     }
 
+    if (g_optimize) {
+        std::cout << "Vertex cache (" << MeshOptimizer::CACHE_SIZE << " entries)" << std::endl;
+        std::cout << "    ACMR: " << g_statsBefore.getACMR() << " -> "
+                << g_statsAfter.getACMR() << std::endl;
+        std::cout << "    ATVR: " << g_statsBefore.getATVR() << " -> "
+                << g_statsAfter.getATVR() << std::endl;
+    }
+
+    generateLevels(meshes);
+
     Path dst(argv[optionIndex + 1]);
     std::ofstream out(dst, std::ios::binary | std::ios::trunc);
     if (!out.good()) {
@@ -401,9 +715,32 @@ int main(int argc, char* argv[]) {
     header.indexCount = g_indices.size();
     header.indexSize = g_indices.size() * (hasIndex16 ? sizeof(uint16_t) : sizeof(uint32_t));
 
+    HeaderExtension extension = {};
+    std::vector<uint8_t> quantized;
+    if (g_quantize || g_clusters || !g_levels.empty()) {
+        header.version = VERSION_EXTENDED;
+        if (g_quantize) {
+            quantized = quantizeVertices(header, extension);
+        } else {
+            extension.positionScale = float3(1.0f);
+        }
+        if (g_clusters) {
+            extension.flags |= HeaderExtension::CLUSTERS;
+            extension.clusterCount = uint32_t(g_clusterList.size());
+        }
+        if (!g_levels.empty()) {
+            extension.flags |= HeaderExtension::LODS;
+        }
+    }
+
     write(out, header);
+    if (header.version == VERSION_EXTENDED) {
+        write(out, extension);
+    }
 
-    if (g_interleaved) {
+    if (g_quantize) {
+        write(out, quantized.data(), uint32_t(quantized.size()));
+    } else if (g_interleaved) {
         write(out, g_vertices.data(), uint32_t(g_vertices.size()));
     } else {
         write(out, g_positions.data(), uint32_t(g_positions.size()));
@@ -446,6 +783,14 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (g_clusters) {
+        write(out, g_clusterList.data(), uint32_t(g_clusterList.size()));
+    }
+
+    if (!g_levels.empty()) {
+        writeLevels(out);
+    }
+
     out.flush();
     out.close();
 
@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/ColorTransform.h>
+
+#include <imageio/ImageEncoder.h>
+
+#include <math/scalar.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <utils/Path.h>
+
+#include <getopt/getopt.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+using namespace image;
+using namespace math;
+using namespace utils;
+
+// configuration
+static uint32_t g_frames = 8;
+static uint32_t g_resolution = 128;
+static uint32_t g_supersampling = 2;
+static uint32_t g_dilation = 8;
+
+static const char* USAGE = R"TXT(
+IMPOSTOR bakes the octahedral impostor atlases of a mesh, see filament::Impostor.
+
+Frame (i, j) of the atlases is the mesh seen from the direction that the octahedral mapping
+maps to (i, j) / (frames - 1), orthographically, so that the frame covers the bounding sphere
+of the mesh. Two PNG files are written:
+    <output_prefix>_color.png    base color (sRGB) and coverage
+    <output_prefix>_normal.png   normal in the space of the frame (x right, y up, z towards
+                                 the viewer) and coverage
+The base color is the diffuse color of the materials times the vertex colors, textures are
+ignored. The center and radius of the bounding sphere, to pass to Impostor::Builder::sphere(),
+are printed.
+
+Usage:
+    IMPOSTOR [options] <source_mesh> <output_prefix>
+
+Options:
+   --help, -h
+       print this message
+   --license, -L
+       print copyright and license information
+   --frames=N, -f N
+       number of frames along each side of the atlases, 8 by default
+   --resolution=N, -r N
+       size of the frames in pixels, 128 by default
+   --supersampling=N, -s N
+       samples per pixel along each side, 2 by default
+   --dilation=N, -d N
+       pixels the colors and normals are extended by around the mesh, so that filtering
+       doesn't bring in the background, 8 by default
+
+Example:
+    IMPOSTOR --frames=12 --resolution=256 tree.obj tree_impostor
+)TXT";
+
+static void printUsage(const char* name) {
+    std::string execName(Path(name).getName());
+    const std::string from("IMPOSTOR");
+    std::string usage(USAGE);
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), execName);
+    }
+    puts(usage.c_str());
+}
+
+static void license() {
+    std::cout <<
+    #include "licenses/licenses.inc"
+    ;
+}
+
+static bool parseCount(const char* arg, uint32_t min, uint32_t max, uint32_t& value) {
+    const long v = strtol(arg, nullptr, 10);
+    if (v < long(min) || v > long(max)) {
+        std::cerr << "Invalid value " << arg << ", must be in [" << min << ", " << max << "]"
+                << std::endl;
+        return false;
+    }
+    value = uint32_t(v);
+    return true;
+}
+
+static int handleArguments(int argc, char* argv[]) {
+    static constexpr const char* OPTSTR = "hLf:r:s:d:";
+    static const struct option OPTIONS[] = {
+            { "help",                 no_argument, 0, 'h' },
+            { "license",              no_argument, 0, 'L' },
+            { "frames",         required_argument, 0, 'f' },
+            { "resolution",     required_argument, 0, 'r' },
+            { "supersampling",  required_argument, 0, 's' },
+            { "dilation",       required_argument, 0, 'd' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+
+    int opt;
+    int optionIndex = 0;
+
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'L':
+                license();
+                exit(0);
+            case 'f':
+                // Impostor::Builder::frames() takes a uint8_t
+                if (!parseCount(optarg, 2, 255, g_frames)) exit(1);
+                break;
+            case 'r':
+                if (!parseCount(optarg, 8, 4096, g_resolution)) exit(1);
+                break;
+            case 's':
+                if (!parseCount(optarg, 1, 8, g_supersampling)) exit(1);
+                break;
+            case 'd':
+                if (!parseCount(optarg, 0, 256, g_dilation)) exit(1);
+                break;
+        }
+    }
+
+    return optind;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+struct Triangle {
+    float3 positions[3];
+    float3 normals[3];
+    float4 colors[3];
+};
+
+static void processNode(const aiScene* scene, const aiNode* node,
+        std::vector<Triangle>& triangles) {
+    for (size_t i = 0; i < node->mNumMeshes; i++) {
+        const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        if (!mesh->HasNormals()) {
+            continue;
+        }
+        aiColor4D diffuse(1.0f, 1.0f, 1.0f, 1.0f);
+        scene->mMaterials[mesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+        const float4 color{ diffuse.r, diffuse.g, diffuse.b, 1.0f };
+        for (size_t f = 0; f < mesh->mNumFaces; f++) {
+            const aiFace& face = mesh->mFaces[f];
+            if (face.mNumIndices != 3) {
+                continue;
+            }
+            Triangle t;
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t v = face.mIndices[k];
+                const aiVector3D& p = mesh->mVertices[v];
+                const aiVector3D& n = mesh->mNormals[v];
+                t.positions[k] = { p.x, p.y, p.z };
+                t.normals[k] = { n.x, n.y, n.z };
+                t.colors[k] = color;
+                if (mesh->HasVertexColors(0)) {
+                    const aiColor4D& c = mesh->mColors[0][v];
+                    t.colors[k] *= float4{ c.r, c.g, c.b, 1.0f };
+                }
+            }
+            triangles.push_back(t);
+        }
+    }
+    for (size_t i = 0; i < node->mNumChildren; i++) {
+        processNode(scene, node->mChildren[i], triangles);
+    }
+}
+
+// must match the octahedral mapping of impostor.mat, y up
+static float3 octahedralDecode(float2 f) {
+    float3 n{ f.x, 1.0f - std::abs(f.x) - std::abs(f.y), f.y };
+    const float t = std::max(-n.y, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.z += n.z >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+// the basis of a frame, forward points towards the viewer
+struct Frame {
+    float3 right;
+    float3 up;
+    float3 forward;
+};
+
+static Frame getFrame(uint32_t i, uint32_t j) {
+    const float last = float(g_frames - 1);
+    Frame frame;
+    frame.forward = octahedralDecode(float2{ float(i), float(j) } / last * 2.0f - 1.0f);
+    const float3 reference = std::abs(frame.forward.y) > 0.999f ?
+            float3{ 0.0f, 0.0f, 1.0f } : float3{ 0.0f, 1.0f, 0.0f };
+    frame.right = normalize(cross(reference, frame.forward));
+    frame.up = cross(frame.forward, frame.right);
+    return frame;
+}
+
+struct Sample {
+    float depth = -std::numeric_limits<float>::infinity();
+    float3 normal;
+    float3 color;
+};
+
+// Rasterizes the triangles seen from 'frame' in size x size samples, both sides of the
+// triangles are drawn, with the normals facing the viewer.
+static void rasterize(std::vector<Triangle> const& triangles, Frame const& frame,
+        float3 center, float radius, uint32_t size, std::vector<Sample>& samples) {
+    samples.assign(size_t(size) * size, Sample{});
+    const float scale = 0.5f * float(size) / radius;
+    for (Triangle const& t : triangles) {
+        // in samples, y down, and the distance towards the viewer
+        float3 s[3];
+        float3 n[3];
+        for (size_t k = 0; k < 3; k++) {
+            const float3 p = t.positions[k] - center;
+            s[k] = { (dot(p, frame.right) + radius) * scale,
+                     (radius - dot(p, frame.up)) * scale,
+                     dot(p, frame.forward) };
+            n[k] = { dot(t.normals[k], frame.right), dot(t.normals[k], frame.up),
+                     dot(t.normals[k], frame.forward) };
+        }
+        const float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) -
+                           (s[2].x - s[0].x) * (s[1].y - s[0].y);
+        if (std::abs(area) < 1e-12f) {
+            continue;
+        }
+        // a triangle seen from its back has its normals flipped
+        const float facing = area < 0.0f ? 1.0f : -1.0f;
+        const int32_t x0 = std::max(0, int32_t(std::floor(std::min({ s[0].x, s[1].x, s[2].x }))));
+        const int32_t y0 = std::max(0, int32_t(std::floor(std::min({ s[0].y, s[1].y, s[2].y }))));
+        const int32_t x1 = std::min(int32_t(size) - 1,
+                int32_t(std::ceil(std::max({ s[0].x, s[1].x, s[2].x }))));
+        const int32_t y1 = std::min(int32_t(size) - 1,
+                int32_t(std::ceil(std::max({ s[0].y, s[1].y, s[2].y }))));
+        for (int32_t y = y0; y <= y1; y++) {
+            for (int32_t x = x0; x <= x1; x++) {
+                const float px = float(x) + 0.5f;
+                const float py = float(y) + 0.5f;
+                const float w0 = ((s[1].x - px) * (s[2].y - py) - (s[2].x - px) * (s[1].y - py));
+                const float w1 = ((s[2].x - px) * (s[0].y - py) - (s[0].x - px) * (s[2].y - py));
+                const float w2 = area - w0 - w1;
+                const float3 b = float3{ w0, w1, w2 } / area;
+                if (b.x < 0.0f || b.y < 0.0f || b.z < 0.0f) {
+                    continue;
+                }
+                Sample& sample = samples[size_t(y) * size + x];
+                const float depth = b.x * s[0].z + b.y * s[1].z + b.z * s[2].z;
+                if (depth <= sample.depth) {
+                    continue;
+                }
+                sample.depth = depth;
+                sample.normal = normalize(n[0] * b.x + n[1] * b.y + n[2] * b.z) * facing;
+                sample.color = (t.colors[0] * b.x + t.colors[1] * b.y + t.colors[2] * b.z).rgb;
+            }
+        }
+    }
+}
+
+// extends the covered texels of the frame at (x0, y0) into the texels around them, 4 channels
+// per texel with the coverage in the 4th
+static void dilate(std::vector<float4>& atlas, uint32_t width, uint32_t x0, uint32_t y0) {
+    const uint32_t size = g_resolution;
+    std::vector<float4> next;
+    for (uint32_t iteration = 0; iteration < g_dilation; iteration++) {
+        next.assign(size_t(size) * size, float4{});
+        bool changed = false;
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                float4 const& texel = atlas[size_t(y0 + y) * width + x0 + x];
+                if (texel.w != 0.0f) {
+                    next[size_t(y) * size + x] = texel;
+                    continue;
+                }
+                // the average of the covered neighbours, which are marked with a coverage of
+                // -1 once dilated, so that the coverage stays 0 in the atlas
+                float3 sum = {};
+                float count = 0.0f;
+                for (int32_t j = -1; j <= 1; j++) {
+                    for (int32_t i = -1; i <= 1; i++) {
+                        const int32_t nx = int32_t(x) + i;
+                        const int32_t ny = int32_t(y) + j;
+                        if (nx < 0 || ny < 0 || nx >= int32_t(size) || ny >= int32_t(size)) {
+                            continue;
+                        }
+                        float4 const& n = atlas[size_t(y0 + ny) * width + x0 + nx];
+                        if (n.w != 0.0f) {
+                            sum += n.xyz;
+                            count++;
+                        }
+                    }
+                }
+                if (count > 0.0f) {
+                    next[size_t(y) * size + x] = float4{ sum / count, -1.0f };
+                    changed = true;
+                }
+            }
+        }
+        for (uint32_t y = 0; y < size; y++) {
+            std::copy_n(&next[size_t(y) * size], size, &atlas[size_t(y0 + y) * width + x0]);
+        }
+        if (!changed) {
+            break;
+        }
+    }
+}
+
+static bool writeAtlas(std::vector<float4> const& atlas, uint32_t width, bool sRGB,
+        const std::string& name) {
+    std::vector<uint8_t> pixels(atlas.size() * 4);
+    for (size_t i = 0; i < atlas.size(); i++) {
+        float3 c = saturate(atlas[i].xyz);
+        if (sRGB) {
+            c = linearTosRGB(c);
+        }
+        const float4 p{ c, saturate(atlas[i].w) };
+        for (size_t k = 0; k < 4; k++) {
+            pixels[i * 4 + k] = uint8_t(std::round(p[k] * 255.0f));
+        }
+    }
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    if (!out.good() || !ImageEncoder::encodePNG8(out, pixels.data(), width, width, 4)) {
+        std::cerr << "Could not write to " << name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int optionIndex = handleArguments(argc, argv);
+
+    int numArgs = argc - optionIndex;
+    if (numArgs < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Path src(argv[optionIndex]);
+    if (!src.exists()) {
+        std::cerr << "The source mesh " << src << " does not exist." << std::endl;
+        return 1;
+    }
+
+    Assimp::Importer importer;
+    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,
+            aiPrimitiveType_LINE | aiPrimitiveType_POINT);
+    const aiScene* scene = importer.ReadFile(src,
+            aiProcess_GenSmoothNormals |
+            aiProcess_JoinIdenticalVertices |
+            aiProcess_PreTransformVertices |
+            aiProcess_SortByPType |
+            aiProcess_Triangulate);
+    if (!scene) {
+        std::cerr << "Unknown mesh format in " << src << std::endl;
+        return 1;
+    }
+
+    std::vector<Triangle> triangles;
+    processNode(scene, scene->mRootNode, triangles);
+    if (triangles.empty()) {
+        std::cerr << "The source mesh " << src << " has no triangles." << std::endl;
+        return 1;
+    }
+
+    // the bounding sphere around the center of the bounding box
+    float3 low{ std::numeric_limits<float>::max() };
+    float3 high{ std::numeric_limits<float>::lowest() };
+    for (Triangle const& t : triangles) {
+        for (float3 const& p : t.positions) {
+            low = min(low, p);
+            high = max(high, p);
+        }
+    }
+    const float3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (Triangle const& t : triangles) {
+        for (float3 const& p : t.positions) {
+            radius = std::max(radius, length(p - center));
+        }
+    }
+    if (radius <= 0.0f) {
+        std::cerr << "The source mesh " << src << " is empty." << std::endl;
+        return 1;
+    }
+
+    const uint32_t size = g_resolution;
+    const uint32_t ss = g_supersampling;
+    const uint32_t width = g_frames * size;
+    std::vector<float4> colors(size_t(width) * width, float4{});
+    std::vector<float4> normals(size_t(width) * width, float4{});
+    std::vector<Sample> samples;
+    for (uint32_t j = 0; j < g_frames; j++) {
+        for (uint32_t i = 0; i < g_frames; i++) {
+            rasterize(triangles, getFrame(i, j), center, radius, size * ss, samples);
+
+            // the coverage is the fraction of samples covered, the colors and normals are the
+            // average of the covered samples
+            const uint32_t x0 = i * size;
+            const uint32_t y0 = j * size;
+            for (uint32_t y = 0; y < size; y++) {
+                for (uint32_t x = 0; x < size; x++) {
+                    float3 color = {};
+                    float3 normal = {};
+                    float covered = 0.0f;
+                    for (uint32_t sy = 0; sy < ss; sy++) {
+                        for (uint32_t sx = 0; sx < ss; sx++) {
+                            Sample const& s = samples[size_t(y * ss + sy) * size * ss + x * ss + sx];
+                            if (s.depth != -std::numeric_limits<float>::infinity()) {
+                                color += s.color;
+                                normal += s.normal;
+                                covered++;
+                            }
+                        }
+                    }
+                    if (covered > 0.0f) {
+                        const float coverage = covered / float(ss * ss);
+                        const size_t index = size_t(y0 + y) * width + x0 + x;
+                        colors[index] = float4{ color / covered, coverage };
+                        const float3 n = length(normal) > 0.0f ?
+                                normalize(normal) : float3{ 0.0f, 0.0f, 1.0f };
+                        normals[index] = float4{ n * 0.5f + 0.5f, coverage };
+                    }
+                }
+            }
+            dilate(colors, width, x0, y0);
+            dilate(normals, width, x0, y0);
+        }
+    }
+
+    const std::string prefix(argv[optionIndex + 1]);
+    if (!writeAtlas(colors, width, true, prefix + "_color.png") ||
+            !writeAtlas(normals, width, false, prefix + "_normal.png")) {
+        return 1;
+    }
+
+    std::cout << "frames: " << g_frames << std::endl;
+    std::cout << "sphere: " << center.x << " " << center.y << " " << center.z << " "
+            << radius << std::endl;
+    return 0;
+}
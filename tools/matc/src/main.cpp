@@ -19,6 +19,7 @@
 #include <iostream>
 #include <memory>
 
+#include "matc/BatchCompiler.h"
 #include "matc/Compiler.h"
 #include "matc/CommandlineConfig.h"
 #include "matc/MaterialCompiler.h"
@@ -34,6 +35,11 @@ int main(int argc, char** argv) {
     }
 
     std::unique_ptr<Compiler> compiler = nullptr;
+    if (!parameters.getBatchManifest().empty()) {
+        compiler.reset(new BatchCompiler());
+        return compiler->start(parameters) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     switch (parameters.getMode()) {
         case CommandlineConfig::Mode::MATERIAL:
             compiler.reset(new MaterialCompiler());
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BatchCompiler.h"
+
+#include <iostream>
+#include <memory>
+
+#include <utils/JobSystem.h>
+
+#include "CommandlineConfig.h"
+#include "JsonishLexer.h"
+#include "JsonishParser.h"
+#include "MaterialCompiler.h"
+
+using namespace utils;
+
+namespace matc {
+
+namespace {
+
+// the options of the command line, with the input and output of one entry of the manifest
+class BatchConfig final : public Config {
+public:
+    BatchConfig(const Config& config, const BatchCompiler::Entry& entry)
+            : Config(config),
+              mParameters(config.toString()),
+              mInput(entry.input.c_str()),
+              mOutput(entry.output.c_str()) {
+    }
+
+    Output* getOutput() const noexcept override {
+        return &mOutput;
+    }
+
+    Input* getInput() const noexcept override {
+        return &mInput;
+    }
+
+    std::string toString() const noexcept override {
+        return mParameters + mInput.getName();
+    }
+
+private:
+    const std::string mParameters;
+    mutable FilesystemInput mInput;
+    mutable FilesystemOutput mOutput;
+};
+
+} // anonymous namespace
+
+bool BatchCompiler::parseManifest(const char* buffer, size_t size,
+        std::vector<Entry>& entries) noexcept {
+    JsonishLexer jlexer;
+    jlexer.lex(buffer, size, 1);
+
+    JsonishParser parser(jlexer.getLexemes());
+    std::unique_ptr<JsonishObject> json = parser.parse();
+    if (json == nullptr) {
+        std::cerr << "Could not parse the batch manifest" << std::endl;
+        return false;
+    }
+
+    const JsonishValue* materials = json->getValue("materials");
+    if (!materials || !materials->toJsonArray()) {
+        std::cerr << "The batch manifest must have a 'materials' array" << std::endl;
+        return false;
+    }
+
+    std::vector<const JsonishValue*> elements = materials->toJsonArray()->getElements();
+    for (size_t i = 0; i < elements.size(); i++) {
+        const JsonishObject* material = elements[i]->toJsonObject();
+        const JsonishValue* input = material ? material->getValue("input") : nullptr;
+        const JsonishValue* output = material ? material->getValue("output") : nullptr;
+        if (!input || !input->toJsonString() || !output || !output->toJsonString()) {
+            std::cerr << "Material " << i << " of the batch manifest must have an 'input' "
+                    "and an 'output' string" << std::endl;
+            return false;
+        }
+        entries.push_back({
+                input->toJsonString()->getString(), output->toJsonString()->getString() });
+    }
+    return true;
+}
+
+bool BatchCompiler::run(const Config& config) {
+    FilesystemInput manifest(config.getBatchManifest().c_str());
+    ssize_t size = manifest.open();
+    if (size <= 0) {
+        return false;
+    }
+    auto buffer = manifest.read();
+    if (!buffer) {
+        return false;
+    }
+
+    std::vector<Entry> entries;
+    if (!parseManifest(buffer.get(), size_t(size), entries)) {
+        return false;
+    }
+
+    std::vector<std::unique_ptr<BatchConfig>> configs;
+    for (const Entry& entry : entries) {
+        configs.emplace_back(new BatchConfig(config, entry));
+    }
+
+    // glslang is initialized once for all the materials
+    MaterialCompiler compiler;
+
+    // not a std::vector<bool>, the materials are compiled concurrently
+    std::vector<uint8_t> succeeded(configs.size(), 0);
+
+    const uint32_t jobCount = config.getJobCount();
+    if (jobCount == 1 || config.printShaders()) {
+        for (size_t i = 0; i < configs.size(); i++) {
+            succeeded[i] = uint8_t(compiler.start(*configs[i]));
+        }
+    } else {
+        // Each material is a job, which generates its shaders with nested jobs: the threads pick
+        // up the next material while the last shaders of the previous one are generated.
+        struct Batch {
+            MaterialCompiler& compiler;
+            std::vector<std::unique_ptr<BatchConfig>>& configs;
+            std::vector<uint8_t>& succeeded;
+        } batch{ compiler, configs, succeeded };
+
+        JobSystem js(jobCount ? jobCount - 1 : 0);
+        js.adopt();
+        compiler.setJobSystem(&js);
+        JobSystem::Job* root = js.createJob();
+        for (size_t i = 0; i < configs.size(); i++) {
+            Batch* const b = &batch;
+            js.run(js.createJob(root, [b, i](JobSystem&, JobSystem::Job*) {
+                b->succeeded[i] = uint8_t(b->compiler.start(*b->configs[i]));
+            }));
+        }
+        js.runAndWait(root);
+        compiler.setJobSystem(nullptr);
+        js.emancipate();
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < configs.size(); i++) {
+        if (!succeeded[i]) {
+            std::cerr << "Failed to compile " << entries[i].input << std::endl;
+            failed++;
+        }
+    }
+    if (failed) {
+        std::cerr << failed << " of " << configs.size() << " materials failed to compile"
+                << std::endl;
+    }
+    return failed == 0;
+}
+
+bool BatchCompiler::checkParameters(const Config& config) {
+    if (config.getMode() != Config::Mode::MATERIAL) {
+        std::cerr << "--batch only compiles materials (--mode=material)." << std::endl;
+        return false;
+    }
+    if (config.getReflectionTarget() != Config::Metadata::NONE) {
+        std::cerr << "--batch can't be used with --reflect." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace matc
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_BATCHCOMPILER_H
+#define TNT_BATCHCOMPILER_H
+
+#include <string>
+#include <vector>
+
+#include "Compiler.h"
+
+namespace matc {
+
+/*
+ * Compiles the materials listed in the manifest given with --batch, in a single process:
+ *
+ *  {
+ *      "materials" : [
+ *          { "input" : "path/to/a.mat", "output" : "path/to/a.filamat" },
+ *          { "input" : "path/to/b.mat", "output" : "path/to/b.filamat" }
+ *      ]
+ *  }
+ *
+ * Relative paths are relative to the current directory, and the options of the command line
+ * apply to all the materials. glslang is initialized once, and the materials and their shaders
+ * are all generated by the same JobSystem, so that the threads stay busy until the last
+ * material is done.
+ */
+class BatchCompiler final : public Compiler {
+public:
+    struct Entry {
+        std::string input;
+        std::string output;
+    };
+
+    // parses a manifest, returns false and prints an error if it's malformed
+    static bool parseManifest(const char* buffer, size_t size,
+            std::vector<Entry>& entries) noexcept;
+
+    bool run(const Config& config) override;
+    bool checkParameters(const Config& config) override;
+};
+
+} // namespace matc
+
+#endif // TNT_BATCHCOMPILER_H
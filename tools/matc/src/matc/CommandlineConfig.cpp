@@ -22,6 +22,8 @@
 
 #include <utils/Path.h>
 
+#include <stdlib.h>
+
 #include <istream>
 #include <sstream>
 #include <string>
@@ -51,6 +53,10 @@ static void usage(char* name) {
             "       Shader family to generate: desktop, mobile or all (default)\n\n"
             "   --optimize, -O, -x\n"
             "       Optimize generated shader code for performance\n\n"
+            "   --optimize-aggressive, -A\n"
+            "       Optimize generated shader code for performance, unrolling the loops with a\n"
+            "       known iteration count and folding specialization constants. This can\n"
+            "       increase the size of the shaders\n\n"
             "   --optimize-size, -S\n"
             "       Optimize generated shader code for performance and size\n\n"
             "   --preprocessor-only, -E\n"
@@ -63,6 +69,23 @@ static void usage(char* name) {
             "       Filter out specified comma-separated variants:\n"
             "           directionalLighting, dynamicLighting, shadowReceiver, skinning\n"
             "       This variant filter is merged the filter from the material, if any\n\n"
+            "   --jobs=<count>, -j <count>\n"
+            "       Number of threads used to generate shaders, 1 disables multi-threading\n"
+            "       (default: one per core)\n\n"
+            "   --cache=<directory>\n"
+            "       Reuse the shaders compiled by previous runs, caching them in the given\n"
+            "       directory. The cache is not used with --print\n\n"
+            "   --batch=<manifest>\n"
+            "       Compile all the materials listed in the given JSON manifest, sharing the\n"
+            "       compiler and the threads between them, instead of a single input file:\n"
+            "           { \"materials\" : [ { \"input\" : \"a.mat\", \"output\" : \"a.filamat\" },\n"
+            "                             { \"input\" : \"b.mat\", \"output\" : \"b.filamat\" } ] }\n"
+            "       The other options apply to all the materials\n\n"
+            "   --precision=<precision>\n"
+            "       Default precision of the fragment shaders: medium or high, used by the\n"
+            "       materials that don't specify one (default: medium on mobile, high on desktop)\n\n"
+            "   --compress, -z\n"
+            "       Compress the shader dictionaries (LZ4) to reduce the size of the package\n\n"
             "Internal use only:\n"
             "   --output-format, -f\n"
             "       Specify output format: blob (default) or header\n\n"
@@ -91,7 +114,7 @@ CommandlineConfig::CommandlineConfig(int argc, char** argv) : Config(), mArgc(ar
 }
 
 bool CommandlineConfig::parse() {
-    static constexpr const char* OPTSTR = "hxo:f:dm:a:p:OSEr:v:";
+    static constexpr const char* OPTSTR = "hxo:f:dm:a:p:OSAEr:v:zj:";
     static const struct option OPTIONS[] = {
             { "help",                    no_argument, nullptr, 'h' },
             { "license",                 no_argument, nullptr, 'l' },
@@ -104,10 +127,16 @@ bool CommandlineConfig::parse() {
             { "optimize",                no_argument, nullptr, 'x' },
             { "optimize",                no_argument, nullptr, 'O' },
             { "optimize-size",           no_argument, nullptr, 'S' },
+            { "optimize-aggressive",     no_argument, nullptr, 'A' },
             { "preprocessor-only",       no_argument, nullptr, 'E' },
             { "api",               required_argument, nullptr, 'a' },
             { "reflect",           required_argument, nullptr, 'r' },
             { "print",                   no_argument, nullptr, 't' },
+            { "compress",                no_argument, nullptr, 'z' },
+            { "jobs",              required_argument, nullptr, 'j' },
+            { "cache",             required_argument, nullptr, 'c' },
+            { "batch",             required_argument, nullptr, 'b' },
+            { "precision",         required_argument, nullptr, 'P' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -208,6 +237,9 @@ bool CommandlineConfig::parse() {
             case 'S':
                 mOptimizationLevel = Optimization::SIZE;
                 break;
+            case 'A':
+                mOptimizationLevel = Optimization::AGGRESSIVE;
+                break;
             case 'E':
                 mOptimizationLevel = Optimization::PREPROCESSOR;
                 break;
@@ -217,7 +249,40 @@ bool CommandlineConfig::parse() {
             case 't':
                 mPrintShaders = true;
                 break;
+            case 'z':
+                mCompressDictionaries = true;
+                break;
+            case 'c':
+                mCacheDirectory = arg;
+                break;
+            case 'b':
+                mBatchManifest = arg;
+                break;
+            case 'P':
+                if (arg == "medium") {
+                    mPrecision = Precision::MEDIUM;
+                } else if (arg == "high") {
+                    mPrecision = Precision::HIGH;
+                } else {
+                    std::cerr << "Unrecognized precision. Must be 'medium'|'high'." << std::endl;
+                    return false;
+                }
+                break;
+            case 'j': {
+                int count = atoi(arg.c_str());
+                mJobCount = count > 0 ? uint32_t(count) : 0;
+                break;
+            }
+        }
+    }
+
+    if (!mBatchManifest.empty()) {
+        if (mArgc - optind > 0 || mOutput) {
+            std::cerr << "The inputs and outputs of --batch are listed in its manifest."
+                    << std::endl;
+            return false;
         }
+        return true;
     }
 
     if (mArgc - optind > 1) {
@@ -24,6 +24,7 @@
 
 #include <memory>
 #include <ostream>
+#include <string>
 
 #include <utils/compiler.h>
 
@@ -44,12 +45,14 @@ public:
 
     using Platform = filamat::MaterialBuilder::Platform;
     using TargetApi = filamat::MaterialBuilder::TargetApi;
+    using Precision = filamat::MaterialBuilder::ShaderPrecision;
 
     enum class Optimization {
         NONE,
         PREPROCESSOR,
         SIZE,
-        PERFORMANCE
+        PERFORMANCE,
+        AGGRESSIVE      // PERFORMANCE, plus loop unrolling and spec. constants folding
     };
 
     enum class Metadata {
@@ -136,10 +139,36 @@ public:
         return mVariantFilter;
     }
 
+    bool compressDictionaries() const noexcept {
+        return mCompressDictionaries;
+    }
+
+    // directory of the shader cache, empty when the cache is disabled
+    const std::string& getCacheDirectory() const noexcept {
+        return mCacheDirectory;
+    }
+
+    // default precision of the fragment shaders of the materials that don't specify one
+    Precision getPrecision() const noexcept {
+        return mPrecision;
+    }
+
+    // number of threads used to generate shaders, 0 means one per core
+    uint32_t getJobCount() const noexcept {
+        return mJobCount;
+    }
+
+    // manifest of the materials to compile in one process, empty when compiling a single
+    // material, see BatchCompiler
+    const std::string& getBatchManifest() const noexcept {
+        return mBatchManifest;
+    }
+
 protected:
     bool mDebug = false;
     bool mIsValid = true;
     bool mPrintShaders = false;
+    bool mCompressDictionaries = false;
     Optimization mOptimizationLevel = Optimization::NONE;
     Metadata mReflectionTarget = Metadata::NONE;
     Mode mMode = Mode::MATERIAL;
@@ -147,6 +176,10 @@ protected:
     OutputFormat mOutputFormat = OutputFormat::BLOB;
     TargetApi mTargetApi = TargetApi::OPENGL;
     uint8_t mVariantFilter = 0;
+    Precision mPrecision = Precision::DEFAULT;
+    uint32_t mJobCount = 0;
+    std::string mCacheDirectory;
+    std::string mBatchManifest;
 };
 
 }
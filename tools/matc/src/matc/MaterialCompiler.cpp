@@ -22,12 +22,15 @@
 
 #include <filamat/MaterialBuilder.h>
 
+#include <utils/JobSystem.h>
+
 #include "Enums.h"
 #include "MaterialLexeme.h"
 #include "MaterialLexer.h"
 #include "JsonishLexer.h"
 #include "JsonishParser.h"
 #include "ParametersProcessor.h"
+#include "ShaderCache.h"
 #include "sca/GLSLTools.h"
 #include "sca/GLSLPostProcessor.h"
 
@@ -288,7 +291,11 @@ bool MaterialCompiler::run(const Config& config) {
         .platform(config.getPlatform())
         .targetApi(config.getTargetApi())
         .codeGenTargetApi(config.getCodeGenTargetApi())
-        .variantFilter(config.getVariantFilter() | builder.getVariantFilter());
+        .variantFilter(config.getVariantFilter() | builder.getVariantFilter())
+        .compressDictionaries(config.compressDictionaries());
+    if (builder.getPrecision() == Config::Precision::DEFAULT) {
+        builder.precision(config.getPrecision());
+    }
 
     // At this point the builder may be able to generate valid shaders if the user populated the
     // properties section in the config file properly. If she hasn't, guess them.
@@ -301,10 +308,38 @@ bool MaterialCompiler::run(const Config& config) {
     // Install postprocessor (to optimize/strip GLSL).
     GLSLPostProcessor postProcessor(config);
 
-    builder.postProcessor(std::bind(&GLSLPostProcessor::process, postProcessor, _1, _2, _3, _4, _5));
+    PostProcessCallBack postProcessorCallback =
+            std::bind(&GLSLPostProcessor::process, postProcessor, _1, _2, _3, _4, _5);
+
+    // Skip the post-processor for the shaders compiled by previous runs. Shaders must be printed
+    // as they're post-processed, so the cache is bypassed in that case.
+    std::unique_ptr<ShaderCache> shaderCache;
+    if (!config.getCacheDirectory().empty() && !config.printShaders()) {
+        // the generated shaders, shader model and output type are part of each key already
+        std::string configuration = "optimization=" +
+                std::to_string(int(config.getOptimizationLevel()));
+        shaderCache.reset(new ShaderCache(config.getCacheDirectory(), configuration));
+        postProcessorCallback = shaderCache->wrap(postProcessorCallback);
+    }
+    builder.postProcessor(postProcessorCallback);
+
+    // Generate the shaders in parallel, unless they're printed, which must happen in order.
+    std::unique_ptr<JobSystem> jobSystem;
+    const uint32_t jobCount = config.getJobCount();
+    if (mJobSystem) {
+        builder.jobSystem(mJobSystem);
+    } else if (jobCount != 1 && !config.printShaders()) {
+        // the current thread is adopted and does its share of the work
+        jobSystem.reset(new JobSystem(jobCount ? jobCount - 1 : 0));
+        jobSystem->adopt();
+        builder.jobSystem(jobSystem.get());
+    }
 
     // Write builder.build() to output.
     Package package = builder.build();
+    if (jobSystem) {
+        jobSystem->emancipate();
+    }
     if (!package.isValid()) {
         return false;
     }
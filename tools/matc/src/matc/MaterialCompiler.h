@@ -28,6 +28,9 @@
 namespace filamat {
 class MaterialBuilder;
 }
+namespace utils {
+class JobSystem;
+}
 class TestMaterialCompiler;
 
 namespace matc {
@@ -41,6 +44,12 @@ public:
     bool run(const Config& config) override;
     bool checkParameters(const Config& config) override;
 
+    // Generates the shaders with the given JobSystem, instead of one created by run() according
+    // to Config::getJobCount(). The calling thread must be owned or adopted by the JobSystem.
+    void setJobSystem(utils::JobSystem* jobSystem) noexcept {
+        mJobSystem = jobSystem;
+    }
+
 private:
     friend class ::TestMaterialCompiler;
 
@@ -76,6 +85,8 @@ private:
     using MaterialConfigProcessorJSON = bool (MaterialCompiler::*)
             (const JsonishValue*, filamat::MaterialBuilder& builder) const;
     std::unordered_map<std::string, MaterialConfigProcessorJSON> mConfigProcessorJSON;
+
+    utils::JobSystem* mJobSystem = nullptr;
 };
 
 } // namespace matc
@@ -47,6 +47,7 @@ static constexpr const char* PARAM_KEY_MASK_THRESHOLD    = "maskThreshold";
 static constexpr const char* PARAM_KEY_SHADOW_MULTIPLIER = "shadowMultiplier";
 static constexpr const char* PARAM_KEY_SHADING           = "shadingModel";
 static constexpr const char* PARAM_KEY_VARIANT_FILTER    = "variantFilter";
+static constexpr const char* PARAM_KEY_PRECISION         = "precision";
 
 ParametersProcessor::ParametersProcessor() {
     mConfigProcessor[PARAM_KEY_NAME]              = &ParametersProcessor::processName;
@@ -67,6 +68,7 @@ ParametersProcessor::ParametersProcessor() {
     mConfigProcessor[PARAM_KEY_SHADOW_MULTIPLIER] = &ParametersProcessor::processShadowMultiplier;
     mConfigProcessor[PARAM_KEY_SHADING]           = &ParametersProcessor::processShading;
     mConfigProcessor[PARAM_KEY_VARIANT_FILTER]    = &ParametersProcessor::processVariantFilter;
+    mConfigProcessor[PARAM_KEY_PRECISION]         = &ParametersProcessor::processPrecision;
 
     mRootAsserts[PARAM_KEY_NAME]              = JsonishValue::Type::STRING;
     mRootAsserts[PARAM_KEY_INTERPOLATION]     = JsonishValue::Type::STRING;
@@ -86,6 +88,7 @@ ParametersProcessor::ParametersProcessor() {
     mRootAsserts[PARAM_KEY_SHADOW_MULTIPLIER] = JsonishValue::Type::BOOL;
     mRootAsserts[PARAM_KEY_SHADING]           = JsonishValue::Type::STRING;
     mRootAsserts[PARAM_KEY_VARIANT_FILTER]    = JsonishValue::Type::ARRAY;
+    mRootAsserts[PARAM_KEY_PRECISION]         = JsonishValue::Type::STRING;
 
     mStringToInterpolation["smooth"] = MaterialBuilder::Interpolation::SMOOTH;
     mStringToInterpolation["flat"] = MaterialBuilder::Interpolation::FLAT;
@@ -121,6 +124,10 @@ ParametersProcessor::ParametersProcessor() {
     mStringToShading["subsurface"] = MaterialBuilder::Shading::SUBSURFACE;
     mStringToShading["unlit"] = MaterialBuilder::Shading::UNLIT;
 
+    mStringToPrecision["default"] = MaterialBuilder::ShaderPrecision::DEFAULT;
+    mStringToPrecision["medium"] = MaterialBuilder::ShaderPrecision::MEDIUM;
+    mStringToPrecision["high"] = MaterialBuilder::ShaderPrecision::HIGH;
+
     mStringToVariant["directionalLighting"] = filament::Variant::DIRECTIONAL_LIGHTING;
     mStringToVariant["dynamicLighting"] = filament::Variant::DYNAMIC_LIGHTING;
     mStringToVariant["shadowReceiver"] = filament::Variant::SHADOW_RECEIVER;
@@ -459,6 +466,16 @@ bool ParametersProcessor::processShading(filamat::MaterialBuilder& builder,
     return true;
 }
 
+bool ParametersProcessor::processPrecision(filamat::MaterialBuilder& builder,
+        const JsonishValue& value) {
+    auto jsonString = value.toJsonString();
+    if (!isStringValidEnum(mStringToPrecision, jsonString->getString())) {
+        return logEnumIssue(PARAM_KEY_PRECISION, *jsonString, mStringToPrecision);
+    }
+    builder.precision(stringToEnum(mStringToPrecision, jsonString->getString()));
+    return true;
+}
+
 bool ParametersProcessor::processVariantFilter(filamat::MaterialBuilder& builder,
         const JsonishValue& value) {
     uint8_t variantFilter = 0;
@@ -54,6 +54,7 @@ private:
     bool processShadowMultiplier(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processShading(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processVariantFilter(filamat::MaterialBuilder &builder, const JsonishValue &value);
+    bool processPrecision(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processParameter(filamat::MaterialBuilder& builder, const JsonishObject& value) const
     noexcept;
 
@@ -100,6 +101,8 @@ private:
     std::unordered_map<std::string, filament::VertexAttribute> mStringToAttributeIndex;
     std::unordered_map<std::string, filamat::MaterialBuilder::Shading> mStringToShading;
     std::unordered_map<std::string, uint8_t> mStringToVariant;
+    std::unordered_map<std::string, filamat::MaterialBuilder::ShaderPrecision>
+            mStringToPrecision;
 };
 
 } // namespace matc
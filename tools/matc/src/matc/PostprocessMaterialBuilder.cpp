@@ -109,7 +109,11 @@ Package PostprocessMaterialBuilder::build() {
             std::string fs = ShaderPostProcessGenerator::createPostProcessFragmentProgram(
                     shaderModel, targetApi, codeGenTargetApi,
                     filament::PostProcessStage(k), firstSampler);
-            if (mPostprocessorCallback != nullptr) {
+            // glslang doesn't know GL_EXT_shader_framebuffer_fetch and would only see the
+            // fallback path of the in-place stages, their GLSL is kept as generated
+            const bool inPlace = targetApi == TargetApi::OPENGL &&
+                    ShaderPostProcessGenerator::isInPlace(filament::PostProcessStage(k));
+            if (mPostprocessorCallback != nullptr && !inPlace) {
                 bool ok = mPostprocessorCallback(fs, filament::driver::ShaderType::FRAGMENT,
                         shaderModel, &fs, pSpirv);
                 if (!ok) {
@@ -136,7 +140,7 @@ Package PostprocessMaterialBuilder::build() {
     }
 
     // Emit GLSL chunks
-    DictionaryGlslChunk dicGlslChunk(glslDictionary);
+    DictionaryGlslChunk dicGlslChunk(glslDictionary, mCompressDictionaries);
     MaterialGlslChunk glslChunk(glslEntries, glslDictionary);
     if (!glslEntries.empty()) {
         container.addChild(&dicGlslChunk);
@@ -144,7 +148,7 @@ Package PostprocessMaterialBuilder::build() {
     }
 
     // Emit SPIRV chunks
-    DictionarySpirvChunk dicSpirvChunk(spirvDictionary);
+    DictionarySpirvChunk dicSpirvChunk(spirvDictionary, mCompressDictionaries);
     MaterialSpirvChunk spirvChunk(spirvEntries);
     if (!spirvEntries.empty()) {
         container.addChild(&dicSpirvChunk);
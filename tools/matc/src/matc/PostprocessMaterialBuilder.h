@@ -58,6 +58,12 @@ public:
         return *this;
     }
 
+    // compresses the shader dictionaries (LZ4).
+    PostprocessMaterialBuilder& compressDictionaries(bool enabled) noexcept {
+        mCompressDictionaries = enabled;
+        return *this;
+    }
+
 private:
     PostProcessCallBack mPostprocessorCallback = nullptr;
 };
@@ -38,7 +38,8 @@ bool PostprocessMaterialCompiler::run(const Config& config) {
     builder
         .platform(config.getPlatform())
         .targetApi(config.getTargetApi())
-        .codeGenTargetApi(config.getCodeGenTargetApi());
+        .codeGenTargetApi(config.getCodeGenTargetApi())
+        .compressDictionaries(config.compressDictionaries());
 
     // Install postprocessor (to clean GLSL from comments and dead code).
     GLSLPostProcessor postProcessor(config);
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ShaderCache.h"
+
+#include <utils/Path.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace utils;
+
+namespace matc {
+
+// Bump when the layout of the entries changes.
+static constexpr uint32_t CACHE_VERSION = 1;
+
+static constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+// FNV-1a, seeded to compute two independent-enough hashes of the same data
+static uint64_t hashBytes(uint64_t h, const void* data, size_t size) noexcept {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+template <typename T>
+static void write(std::ostream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool read(std::istream& in, T* value) {
+    return bool(in.read(reinterpret_cast<char*>(value), sizeof(*value)));
+}
+
+ShaderCache::ShaderCache(std::string directory, std::string configuration)
+        : mDirectory(std::move(directory)), mConfiguration(std::move(configuration)) {
+    Path(mDirectory).mkdirRecursive();
+}
+
+ShaderCache::Key ShaderCache::computeKey(const std::string& shader,
+        filament::driver::ShaderType type, filament::driver::ShaderModel model,
+        bool spirv) const noexcept {
+    const uint8_t header[] = { uint8_t(type), uint8_t(model), uint8_t(spirv) };
+    Key key{ 0xcbf29ce484222325ull, 0x84222325cbf29ce4ull, shader.size() };
+    for (uint64_t* h : { &key.hash, &key.check }) {
+        *h = hashBytes(*h, &CACHE_VERSION, sizeof(CACHE_VERSION));
+        *h = hashBytes(*h, mConfiguration.data(), mConfiguration.size());
+        *h = hashBytes(*h, header, sizeof(header));
+        *h = hashBytes(*h, shader.data(), shader.size());
+    }
+    return key;
+}
+
+std::string ShaderCache::getEntryPath(Key const& key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.shader", (unsigned long long) key.hash);
+    return Path::concat(mDirectory, name).getPath();
+}
+
+bool ShaderCache::load(Key const& key, std::string* glsl, SpirvBlob* spirv) const {
+    std::ifstream in(getEntryPath(key), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    uint32_t version;
+    uint64_t check, size;
+    if (!read(in, &version) || !read(in, &check) || !read(in, &size) ||
+            version != CACHE_VERSION || check != key.check || size != key.size) {
+        return false;
+    }
+
+    uint64_t glslSize;
+    if (!read(in, &glslSize)) {
+        return false;
+    }
+    std::string glslEntry(glslSize, '\0');
+    if (!in.read(&glslEntry[0], glslSize)) {
+        return false;
+    }
+
+    uint64_t spirvWordCount;
+    if (!read(in, &spirvWordCount)) {
+        return false;
+    }
+    SpirvBlob spirvEntry(spirvWordCount);
+    if (!in.read(reinterpret_cast<char*>(spirvEntry.data()), spirvWordCount * sizeof(uint32_t))) {
+        return false;
+    }
+
+    // an entry is only valid if it contains what we asked for
+    if (spirv ? spirvEntry.empty() : glslEntry.empty()) {
+        return false;
+    }
+    if (glsl) {
+        *glsl = std::move(glslEntry);
+    }
+    if (spirv) {
+        *spirv = std::move(spirvEntry);
+    }
+    return true;
+}
+
+void ShaderCache::store(Key const& key, std::string const* glsl, SpirvBlob const* spirv) const {
+    // Write to a temporary file first and rename it, so that concurrent matc processes sharing
+    // the cache never see a partial entry.
+    const std::string path = getEntryPath(key);
+    const std::string temporaryPath = path + "." + std::to_string(std::random_device()());
+    {
+        std::ofstream out(temporaryPath, std::ios::binary);
+        write(out, CACHE_VERSION);
+        write(out, key.check);
+        write(out, key.size);
+        write(out, uint64_t(glsl ? glsl->size() : 0));
+        if (glsl) {
+            out.write(glsl->data(), glsl->size());
+        }
+        write(out, uint64_t(spirv ? spirv->size() : 0));
+        if (spirv) {
+            out.write(reinterpret_cast<const char*>(spirv->data()),
+                    spirv->size() * sizeof(uint32_t));
+        }
+        if (!out) {
+            std::cerr << "Warning: could not write " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+    }
+}
+
+filamat::PostProcessCallBack ShaderCache::wrap(filamat::PostProcessCallBack postProcessor) {
+    return [this, postProcessor](const std::string& inputShader,
+            filament::driver::ShaderType type, filament::driver::ShaderModel model,
+            std::string* outputGlsl, SpirvBlob* outputSpirv) {
+        // inputShader and outputGlsl may be the same string
+        const Key key = computeKey(inputShader, type, model, outputSpirv != nullptr);
+        if (load(key, outputGlsl, outputSpirv)) {
+            mHits++;
+            return true;
+        }
+        mMisses++;
+        if (!postProcessor(inputShader, type, model, outputGlsl, outputSpirv)) {
+            return false;
+        }
+        store(key, outputGlsl, outputSpirv);
+        return true;
+    };
+}
+
+} // namespace matc
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef TNT_MATC_SHADERCACHE_H
+#define TNT_MATC_SHADERCACHE_H
+
+#include <filamat/MaterialBuilder.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace matc {
+
+// Content-addressed cache of post-processed shaders, stored as one file per shader in a directory.
+// The key of an entry is the generated shader itself, which already contains the material source
+// and all the included shader chunks, combined with everything else that affects the
+// post-processor's output. Entries are never invalidated, only added; the directory can be deleted
+// at any time.
+class ShaderCache {
+public:
+    // configuration must describe all the options that affect the post-processor's output
+    ShaderCache(std::string directory, std::string configuration);
+
+    // Returns a post-processor that first looks the shader up in the cache, and otherwise calls
+    // the given post-processor and stores its result. This is thread-safe as long as the given
+    // post-processor is. Failures are never cached.
+    filamat::PostProcessCallBack wrap(filamat::PostProcessCallBack postProcessor);
+
+    size_t getHitCount() const noexcept { return mHits; }
+    size_t getMissCount() const noexcept { return mMisses; }
+
+private:
+    using SpirvBlob = std::vector<uint32_t>;
+
+    struct Key {
+        uint64_t hash;
+        uint64_t check;     // a second hash, to detect collisions
+        uint64_t size;
+    };
+
+    Key computeKey(const std::string& shader, filament::driver::ShaderType type,
+            filament::driver::ShaderModel model, bool spirv) const noexcept;
+    std::string getEntryPath(Key const& key) const;
+    bool load(Key const& key, std::string* glsl, SpirvBlob* spirv) const;
+    void store(Key const& key, std::string const* glsl, SpirvBlob const* spirv) const;
+
+    std::string mDirectory;
+    std::string mConfiguration;
+    std::atomic<size_t> mHits{ 0 };
+    std::atomic<size_t> mMisses{ 0 };
+};
+
+} // namespace matc
+
+#endif // TNT_MATC_SHADERCACHE_H
@@ -126,7 +126,7 @@ static std::string shrinkString(const std::string& s) {
 
 bool GLSLPostProcessor::process(const std::string& inputShader,
         filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
-        std::string* outputGlsl, SpirvBlob* outputSpirv) {
+        std::string* outputGlsl, SpirvBlob* outputSpirv) const {
 
     // If TargetApi is Vulkan, then we need post-processing even if there's no optimization.
     using TargetApi = Config::TargetApi;
@@ -140,17 +140,18 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
         return true;
     }
 
-    mGlslOutput = outputGlsl;
-    mSpirvOutput = outputSpirv;
+    InternalConfig internalConfig;
+    internalConfig.glslOutput = outputGlsl;
+    internalConfig.spirvOutput = outputSpirv;
 
     if (shaderType == filament::driver::VERTEX) {
-        mShLang = EShLangVertex;
+        internalConfig.shLang = EShLangVertex;
     } else {
-        mShLang = EShLangFragment;
+        internalConfig.shLang = EShLangFragment;
     }
 
     TProgram program;
-    TShader tShader(mShLang);
+    TShader tShader(internalConfig.shLang);
 
     // The cleaner must be declared after the TShader to prevent ASAN failures.
     GLSLangCleaner cleaner;
@@ -158,10 +159,11 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
     const char* shaderCString = inputShader.c_str();
     tShader.setStrings(&shaderCString, 1);
 
-    mLangVersion = GLSLTools::glslangVersionFromShaderModel(shaderModel);
-    GLSLTools::prepareShaderParser(tShader, mShLang, mLangVersion, mConfig.getOptimizationLevel());
+    internalConfig.langVersion = GLSLTools::glslangVersionFromShaderModel(shaderModel);
+    GLSLTools::prepareShaderParser(tShader, internalConfig.shLang, internalConfig.langVersion,
+            mConfig.getOptimizationLevel());
     EShMessages msg = GLSLTools::glslangFlagsFromTargetApi(targetApi);
-    bool ok = tShader.parse(&DefaultTBuiltInResource, mLangVersion, false, msg);
+    bool ok = tShader.parse(&DefaultTBuiltInResource, internalConfig.langVersion, false, msg);
     if (!ok) {
         std::cerr << tShader.getInfoLog() << std::endl;
         return false;
@@ -178,40 +180,43 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
 
     switch (mConfig.getOptimizationLevel()) {
         case Config::Optimization::NONE:
-            if (mSpirvOutput) {
-                GlslangToSpv(*program.getIntermediate(mShLang), *mSpirvOutput);
+            if (internalConfig.spirvOutput) {
+                GlslangToSpv(*program.getIntermediate(internalConfig.shLang),
+                        *internalConfig.spirvOutput);
             } else {
                 std::cerr << "GLSL post-processor invoked with optimization level NONE"
                         << std::endl;
             }
             break;
         case Config::Optimization::PREPROCESSOR:
-            preprocessOptimization(tShader, shaderModel);
+            preprocessOptimization(tShader, shaderModel, internalConfig);
             break;
         case Config::Optimization::SIZE:
         case Config::Optimization::PERFORMANCE:
-            fullOptimization(tShader, shaderModel);
+        case Config::Optimization::AGGRESSIVE:
+            fullOptimization(tShader, shaderModel, internalConfig);
             break;
     }
 
-    if (mGlslOutput) {
-        *mGlslOutput = shrinkString(*mGlslOutput);
+    if (internalConfig.glslOutput) {
+        *internalConfig.glslOutput = shrinkString(*internalConfig.glslOutput);
         if (mConfig.printShaders()) {
-            std::cout << *mGlslOutput << std::endl;
+            std::cout << *internalConfig.glslOutput << std::endl;
         }
     }
     return true;
 }
 
 void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
-        const filament::driver::ShaderModel shaderModel) const {
+        const filament::driver::ShaderModel shaderModel,
+        InternalConfig const& internalConfig) const {
     using TargetApi = Config::TargetApi;
 
     std::string glsl;
     TShader::ForbidIncluder forbidIncluder;
 
     int version = GLSLTools::glslangVersionFromShaderModel(shaderModel);
-    const TargetApi targetApi = mSpirvOutput ? TargetApi::VULKAN : TargetApi::OPENGL;
+    const TargetApi targetApi = internalConfig.spirvOutput ? TargetApi::VULKAN : TargetApi::OPENGL;
     EShMessages msg = GLSLTools::glslangFlagsFromTargetApi(targetApi);
     bool ok = tShader.preprocess(&DefaultTBuiltInResource, version, ENoProfile, false, false,
             msg, &glsl, forbidIncluder);
@@ -220,14 +225,14 @@ void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
         std::cerr << tShader.getInfoLog() << std::endl;
     }
 
-    if (mSpirvOutput) {
+    if (internalConfig.spirvOutput) {
         TProgram program;
-        TShader spirvShader(mShLang);
+        TShader spirvShader(internalConfig.shLang);
         const char* shaderCString = glsl.c_str();
         spirvShader.setStrings(&shaderCString, 1);
-        GLSLTools::prepareShaderParser(spirvShader, mShLang, mLangVersion,
-                mConfig.getOptimizationLevel());
-        ok = spirvShader.parse(&DefaultTBuiltInResource, mLangVersion, false, msg);
+        GLSLTools::prepareShaderParser(spirvShader, internalConfig.shLang,
+                internalConfig.langVersion, mConfig.getOptimizationLevel());
+        ok = spirvShader.parse(&DefaultTBuiltInResource, internalConfig.langVersion, false, msg);
         program.addShader(&spirvShader);
         // Even though we only have a single shader stage, linking is still necessary to finalize
         // SPIR-V types
@@ -235,17 +240,19 @@ void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
         if (!ok || !linkOk) {
             std::cerr << spirvShader.getInfoLog() << std::endl;
         } else {
-            GlslangToSpv(*program.getIntermediate(mShLang), *mSpirvOutput);
+            GlslangToSpv(*program.getIntermediate(internalConfig.shLang),
+                    *internalConfig.spirvOutput);
         }
     }
 
-    if (mGlslOutput) {
-        *mGlslOutput = glsl;
+    if (internalConfig.glslOutput) {
+        *internalConfig.glslOutput = glsl;
     }
 }
 
 void GLSLPostProcessor::fullOptimization(const TShader& tShader,
-        const filament::driver::ShaderModel shaderModel) const {
+        const filament::driver::ShaderModel shaderModel,
+        InternalConfig const& internalConfig) const {
     SpirvBlob spirv;
 
     // Compile GLSL to to SPIR-V
@@ -263,6 +270,8 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
         registerSizePasses(optimizer);
     } else if (optimizationLevel == Config::Optimization::PERFORMANCE) {
         registerPerformancePasses(optimizer);
+    } else if (optimizationLevel == Config::Optimization::AGGRESSIVE) {
+        registerAggressivePasses(optimizer);
     }
 
     if (!optimizer.Run(spirv.data(), spirv.size(), &spirv)) {
@@ -275,12 +284,12 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
     remapper.registerErrorHandler(errorHandler);
     remapper.remap(spirv, spv::spirvbin_base_t::DCE_ALL);
 
-    if (mSpirvOutput) {
-        *mSpirvOutput = spirv;
+    if (internalConfig.spirvOutput) {
+        *internalConfig.spirvOutput = spirv;
     }
 
     // Transpile back to GLSL
-    if (mGlslOutput) {
+    if (internalConfig.glslOutput) {
         CompilerGLSL::Options glslOptions;
         glslOptions.es = shaderModel == filament::driver::ShaderModel::GL_ES_30;
         glslOptions.version = shaderVersionFromModel(shaderModel);
@@ -293,7 +302,7 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
         CompilerGLSL glslCompiler(move(spirv));
         glslCompiler.set_common_options(glslOptions);
 
-        *mGlslOutput = glslCompiler.compile();
+        *internalConfig.glslOutput = glslCompiler.compile();
     }
 }
 
@@ -333,6 +342,23 @@ void GLSLPostProcessor::registerPerformancePasses(Optimizer& optimizer) const {
             .RegisterPass(CreateSimplificationPass());
 }
 
+void GLSLPostProcessor::registerAggressivePasses(Optimizer& optimizer) const {
+    // specialization constants can only be folded before the passes that use their values
+    optimizer.RegisterPass(CreateFoldSpecConstantOpAndCompositePass());
+    registerPerformancePasses(optimizer);
+    // the loops with a constant iteration count are unrolled once their induction variables are
+    // in SSA form, the passes that follow clean up the unrolled bodies
+    optimizer
+            .RegisterPass(CreateLoopUnrollPass(true))
+            .RegisterPass(CreateCCPPass())
+            .RegisterPass(CreateSimplificationPass())
+            .RegisterPass(CreateDeadBranchElimPass())
+            .RegisterPass(CreateRedundancyEliminationPass())
+            .RegisterPass(CreateAggressiveDCEPass())
+            .RegisterPass(CreateBlockMergePass())
+            .RegisterPass(CreateEliminateDeadConstantPass());
+}
+
 void GLSLPostProcessor::registerSizePasses(Optimizer& optimizer) const {
     optimizer
             .RegisterPass(CreateMergeReturnPass())
@@ -330,7 +330,8 @@ void GLSLTools::prepareShaderParser(glslang::TShader& shader, EShLanguage langua
         int version, Config::Optimization optimization) {
     // We must only setup the SPIRV environment when we actually need to output SPIRV
     if (optimization == Config::Optimization::SIZE ||
-            optimization == Config::Optimization::PERFORMANCE) {
+            optimization == Config::Optimization::PERFORMANCE ||
+            optimization == Config::Optimization::AGGRESSIVE) {
         shader.setAutoMapBindings(true);
         shader.setEnvInput(EShSourceGlsl, language, EShClientVulkan, version);
         shader.setEnvClient(EShClientVulkan, EShTargetVulkan_1_1);
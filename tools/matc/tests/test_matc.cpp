@@ -19,7 +19,11 @@
 #include "MockConfig.h"
 
 #include <matc/sca/ASTHelpers.h>
+#include <matc/BatchCompiler.h>
 #include <matc/MaterialLexer.h>
+#include <matc/ShaderCache.h>
+
+#include <utils/Path.h>
 
 using namespace matc::ASTUtils;
 
@@ -486,6 +490,89 @@ TEST_F(MaterialCompiler, EmptyName) {
     builder.name("");
     filamat::Package result = builder.build();
 }
+
+TEST_F(MaterialCompiler, FragmentPrecision) {
+    std::string shaderCode(R"(
+        void material(inout MaterialInputs material) {
+            prepareMaterial(material);
+        }
+    )");
+
+    filament::driver::ShaderModel model;
+    filamat::MaterialBuilder builder = makeBuilder(shaderCode);
+    std::string shader = builder.peek(filament::driver::ShaderType::FRAGMENT, model);
+    EXPECT_NE(std::string::npos, shader.find("precision mediump float;"));
+
+    builder.precision(filamat::MaterialBuilder::ShaderPrecision::HIGH);
+    shader = builder.peek(filament::driver::ShaderType::FRAGMENT, model);
+    EXPECT_NE(std::string::npos, shader.find("precision highp float;"));
+
+    // the library's highp values must stay highp on desktop
+    builder.platform(filamat::MaterialBuilder::Platform::DESKTOP);
+    builder.precision(filamat::MaterialBuilder::ShaderPrecision::MEDIUM);
+    shader = builder.peek(filament::driver::ShaderType::FRAGMENT, model);
+    EXPECT_NE(std::string::npos, shader.find("precision mediump float;"));
+    EXPECT_NE(std::string::npos, shader.find("#define SHADER_HAS_PRECISION_QUALIFIERS"));
+}
+
+TEST(ShaderCache, ReusesPostProcessedShaders) {
+    utils::Path directory = utils::Path::getCurrentDirectory() + "test_matc_shader_cache";
+    for (utils::Path entry : directory.listContents()) {
+        entry.unlinkFile();
+    }
+
+    size_t calls = 0;
+    matc::ShaderCache cache(directory.getPath(), "test");
+    filamat::PostProcessCallBack postProcessor = cache.wrap(
+            [&calls](const std::string& input, filament::driver::ShaderType,
+                    filament::driver::ShaderModel, std::string* glsl,
+                    std::vector<uint32_t>* spirv) {
+                calls++;
+                *glsl = input + " processed";
+                return true;
+            });
+
+    const auto vertex = filament::driver::ShaderType::VERTEX;
+    const auto model = filament::driver::ShaderModel::GL_ES_30;
+    std::string glsl;
+    EXPECT_TRUE(postProcessor("void main() { }", vertex, model, &glsl, nullptr));
+    EXPECT_TRUE(postProcessor("void main() { }", vertex, model, &glsl, nullptr));
+    EXPECT_EQ(glsl, "void main() { } processed");
+    EXPECT_EQ(calls, 1);
+
+    EXPECT_TRUE(postProcessor("void main() { }", filament::driver::ShaderType::FRAGMENT,
+            model, &glsl, nullptr));
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(cache.getHitCount(), 1);
+    EXPECT_EQ(cache.getMissCount(), 2);
+
+    for (utils::Path entry : directory.listContents()) {
+        entry.unlinkFile();
+    }
+}
+
+TEST(BatchCompiler, ParseManifest) {
+    std::string manifest(R"({
+        "materials" : [
+            { "input" : "a.mat", "output" : "out/a.filamat" },
+            { "input" : "b.mat", "output" : "out/b.filamat" }
+        ]
+    })");
+    std::vector<matc::BatchCompiler::Entry> entries;
+    EXPECT_TRUE(matc::BatchCompiler::parseManifest(manifest.c_str(), manifest.size(), entries));
+    ASSERT_EQ(entries.size(), 2);
+    EXPECT_EQ(entries[0].input, "a.mat");
+    EXPECT_EQ(entries[0].output, "out/a.filamat");
+    EXPECT_EQ(entries[1].input, "b.mat");
+    EXPECT_EQ(entries[1].output, "out/b.filamat");
+
+    // each material needs an input and an output
+    std::string missingOutput(R"({ "materials" : [ { "input" : "a.mat" } ] })");
+    entries.clear();
+    EXPECT_FALSE(matc::BatchCompiler::parseManifest(
+            missingOutput.c_str(), missingOutput.size(), entries));
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -21,6 +21,7 @@
 #include <filaflat/MaterialParser.h>
 #include <filaflat/Unflattener.h>
 #include <filaflat/ShaderBuilder.h>
+#include <filaflat/ShaderCost.h>
 
 #include <filament/EngineEnums.h>
 #include <filament/MaterialEnums.h>
@@ -33,6 +34,7 @@
 #include <spirv_glsl.hpp>
 #include <spirv-tools/libspirv.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -47,6 +49,8 @@ struct Config {
     bool printSPIRV = false;
     bool transpile = false;
     bool binary = false;
+    bool printCost = false;
+    uint32_t maxInstructions = 0;
     uint64_t shaderIndex;
 };
 
@@ -63,6 +67,7 @@ static void printUsage(const char* name) {
             "MATINFO prints information about material files compiled with matc\n"
                     "Usage:\n"
                     "    MATINFO [options] <material file>\n"
+                    "    MATINFO --cost [--max-instructions=<count>] <material file or directory>...\n"
                     "\n"
                     "Options:\n"
                     "   --help, -h\n"
@@ -75,6 +80,11 @@ static void printUsage(const char* name) {
                     "       Print the nth Vulkan shader transpiled into GLSL\n\n"
                     "   --dump-binary=[index], -b\n"
                     "       Dump binary SPIRV for the nth Vulkan shader to 'out.spv'\n\n"
+                    "   --cost, -c\n"
+                    "       Print the estimated cost of every Vulkan shader of the given materials,\n"
+                    "       ranked by ALU instructions. Directories are searched for .filamat files\n\n"
+                    "   --max-instructions=<count>, -m\n"
+                    "       With --cost, fail if a shader has more than <count> instructions\n\n"
                     "   --license\n"
                     "       Print copyright and license information\n\n"
     );
@@ -93,7 +103,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[], Config* config) {
-    static constexpr const char* OPTSTR = "hlg:s:v:b:";
+    static constexpr const char* OPTSTR = "hlg:s:v:b:cm:";
     static const struct option OPTIONS[] = {
             { "help",         no_argument,       0, 'h' },
             { "license",      no_argument,       0, 'l' },
@@ -101,6 +111,8 @@ static int handleArguments(int argc, char* argv[], Config* config) {
             { "print-spirv",  required_argument, 0, 's' },
             { "print-vkglsl", required_argument, 0, 'v' },
             { "dump-binary",  required_argument, 0, 'b' },
+            { "cost",         no_argument,       0, 'c' },
+            { "max-instructions", required_argument, 0, 'm' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -135,6 +147,12 @@ static int handleArguments(int argc, char* argv[], Config* config) {
                 config->shaderIndex = static_cast<uint64_t>(std::stoi(arg));
                 config->binary = true;
                 break;
+            case 'c':
+                config->printCost = true;
+                break;
+            case 'm':
+                config->maxInstructions = static_cast<uint32_t>(std::stoul(arg));
+                break;
         }
     }
 
@@ -227,6 +245,14 @@ const char* toString(filament::VertexAttribute attribute) {
         case filament::UV1: return "uv1";
         case filament::BONE_INDICES: return "bone indices";
         case filament::BONE_WEIGHTS: return "bone weights";
+        case filament::MORPH_POSITION_0: return "morph position 0";
+        case filament::MORPH_POSITION_1: return "morph position 1";
+        case filament::MORPH_POSITION_2: return "morph position 2";
+        case filament::MORPH_POSITION_3: return "morph position 3";
+        case filament::MORPH_TANGENTS_0: return "morph tangents 0";
+        case filament::MORPH_TANGENTS_1: return "morph tangents 1";
+        case filament::MORPH_TANGENTS_2: return "morph tangents 2";
+        case filament::MORPH_TANGENTS_3: return "morph tangents 3";
     }
     return "--";
 }
@@ -285,6 +311,8 @@ const char* toString(filament::SamplerInterfaceBlock::Type type) {
         case filament::driver::SamplerType::SAMPLER_2D: return "sampler2D";
         case filament::driver::SamplerType::SAMPLER_CUBEMAP: return "samplerCubemap";
         case filament::driver::SamplerType::SAMPLER_EXTERNAL: return "samplerExternal";
+        case filament::driver::SamplerType::SAMPLER_2D_ARRAY: return "sampler2dArray";
+        case filament::driver::SamplerType::SAMPLER_3D: return "sampler3d";
     }
 }
 
@@ -371,6 +399,7 @@ static bool printMaterial(const ChunkContainer& container) {
     printChunk<filament::Interpolation, uint8_t>(container, filamat::MaterialInterpolation,
             "Interpolation: ");
     printChunk<bool, bool>(container, filamat::MaterialShadowMultiplier, "Shadow multiply: ");
+    printUint32Chunk(container, filamat::MaterialShaderCost, "Shader cost: ");
 
     std::cout << std::endl;
 
@@ -649,11 +678,16 @@ static bool printGlslInfo(ChunkContainer container) {
     return true;
 }
 
-static bool printVkInfo(ChunkContainer container) {
+static bool printVkInfo(ChunkContainer container, void* data, size_t size) {
     std::vector<ShaderInfo> info;
     if (!getVkShaderInfo(container, &info)) {
         return false;
     }
+
+    MaterialParser parser(filament::driver::Backend::VULKAN, data, size);
+    const bool hasShaders = !info.empty() && parser.parse() &&
+            (parser.isShadingMaterial() || parser.isPostProcessMaterial());
+
     std::cout << "Vulkan shaders:" << std::endl;
     for (uint64_t i = 0; i < info.size(); ++i) {
         const auto& item = info[i];
@@ -665,13 +699,22 @@ static bool printVkInfo(ChunkContainer container) {
         std::cout << " ";
         std::cout << "0x" << std::hex << std::setfill('0') << std::setw(2)
                   << std::right << (int) item.variant;
-        std::cout << std::setfill(' ') << std::dec << std::endl;
+        std::cout << std::setfill(' ') << std::dec;
+        if (hasShaders) {
+            filaflat::ShaderBuilder builder;
+            parser.getShader(item.shaderModel, item.variant, item.pipelineStage, builder);
+            uint32_t const* words = reinterpret_cast<uint32_t const*>(builder.getShader());
+            std::cout << "  " << std::setw(6) << std::right
+                      << computeSpirvCost(words, builder.size() / 4).instructions
+                      << " instructions";
+        }
+        std::cout << std::endl;
     }
     std::cout << std::endl;
     return true;
 }
 
-static bool printMaterialInfo(const ChunkContainer& container) {
+static bool printMaterialInfo(const ChunkContainer& container, void* data, size_t size) {
     if (!printMaterial(container)) {
         return false;
     }
@@ -684,7 +727,7 @@ static bool printMaterialInfo(const ChunkContainer& container) {
         return false;
     }
 
-    if (!printVkInfo(container)) {
+    if (!printVkInfo(container, data, size)) {
         return false;
     }
 
@@ -728,6 +771,86 @@ static void dumpSpirvBinary(const std::vector<uint32_t>& spirv, std::string file
     std::cout << "Binary SPIR-V dumped to " << filename << std::endl;
 }
 
+struct CostInfo {
+    std::string material;
+    ShaderInfo shader;
+    ShaderCost cost;
+};
+
+static bool getCostInfo(const std::string& material, void* data, size_t size,
+        std::vector<CostInfo>* costs) {
+    ChunkContainer container(data, size);
+    if (!container.parse()) {
+        return false;
+    }
+
+    std::vector<ShaderInfo> info;
+    if (!getVkShaderInfo(container, &info)) {
+        return false;
+    }
+    if (info.empty()) {
+        std::cerr << material << " has no Vulkan shaders, compile it with -a vulkan." << std::endl;
+        return true;
+    }
+
+    MaterialParser parser(filament::driver::Backend::VULKAN, data, size);
+    if (!parser.parse() || (!parser.isShadingMaterial() && !parser.isPostProcessMaterial())) {
+        return false;
+    }
+
+    for (const auto& item : info) {
+        filaflat::ShaderBuilder builder;
+        parser.getShader(item.shaderModel, item.variant, item.pipelineStage, builder);
+        uint32_t const* words = reinterpret_cast<uint32_t const*>(builder.getShader());
+        costs->push_back({ material, item, computeSpirvCost(words, builder.size() / 4) });
+    }
+    return true;
+}
+
+// Prints the costs from the most to the least expensive shader. Returns false if a shader
+// exceeds the instruction budget, if there is one.
+static bool printCostInfo(std::vector<CostInfo>& costs, uint32_t maxInstructions) {
+    std::stable_sort(costs.begin(), costs.end(), [](const CostInfo& lhs, const CostInfo& rhs) {
+        if (lhs.cost.alu != rhs.cost.alu) {
+            return lhs.cost.alu > rhs.cost.alu;
+        }
+        return lhs.cost.instructions > rhs.cost.instructions;
+    });
+
+    size_t nameWidth = 8;
+    for (const auto& item : costs) {
+        nameWidth = std::max(nameWidth, item.material.size());
+    }
+
+    std::cout << std::setw(int(nameWidth)) << std::left << "material";
+    std::cout << "  model  stage variant  instructions    alu texture branches" << std::endl;
+
+    bool withinBudget = true;
+    for (const auto& item : costs) {
+        const bool overBudget = maxInstructions && item.cost.instructions > maxInstructions;
+        std::cout << std::setw(int(nameWidth)) << std::left << item.material << "  ";
+        std::cout << std::setw(6) << std::left << toString(item.shader.shaderModel) << " ";
+        std::cout << std::setw(5) << std::left << toString(item.shader.pipelineStage) << " ";
+        std::cout << "0x" << std::hex << std::setfill('0') << std::setw(2) << std::right
+                  << (int) item.shader.variant << std::setfill(' ') << std::dec << "    ";
+        std::cout << std::setw(12) << std::right << item.cost.instructions << " ";
+        std::cout << std::setw(6) << std::right << item.cost.alu << " ";
+        std::cout << std::setw(7) << std::right << item.cost.texture << " ";
+        std::cout << std::setw(8) << std::right << item.cost.branches;
+        if (overBudget) {
+            std::cout << "  over budget";
+            withinBudget = false;
+        }
+        std::cout << std::endl;
+    }
+
+    if (!withinBudget) {
+        std::cerr << "Some shaders have more than " << maxInstructions << " instructions."
+                  << std::endl;
+    }
+    return withinBudget;
+}
+
 static bool parseChunks(Config config, void* data, size_t size) {
     ChunkContainer container(data, size);
     if (!container.parse()) {
@@ -798,7 +921,7 @@ static bool parseChunks(Config config, void* data, size_t size) {
         }
     }
 
-    if (!printMaterialInfo(container)) {
+    if (!printMaterialInfo(container, data, size)) {
         std::cerr << "The source material is invalid." << std::endl;
         return false;
     }
@@ -826,6 +949,55 @@ static bool parseBinary(Config config, std::istream& in, long fileSize) {
     return false;
 }
 
+static bool readMaterial(const Path& src, std::vector<char>* buffer) {
+    long fileSize = static_cast<long>(getFileSize(src.c_str()));
+    if (fileSize <= 0) {
+        std::cerr << "The source material " << src << " is invalid." << std::endl;
+        return false;
+    }
+    std::ifstream in(src.c_str(), std::ifstream::in | std::ifstream::binary);
+    buffer->resize(static_cast<unsigned long>(fileSize));
+    if (!in.read(buffer->data(), fileSize)) {
+        std::cerr << "Could not read the source material " << src << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int printCost(const Config& config, int argc, char* argv[], int optionIndex) {
+    std::vector<Path> materials;
+    for (int i = optionIndex; i < argc; i++) {
+        Path src(argv[i]);
+        if (!src.exists()) {
+            std::cerr << "The source material " << src << " does not exist." << std::endl;
+            return 1;
+        }
+        if (src.isDirectory()) {
+            for (const Path& file : src.listContents()) {
+                if (file.getExtension() == "filamat") {
+                    materials.push_back(file);
+                }
+            }
+        } else {
+            materials.push_back(src);
+        }
+    }
+
+    std::vector<CostInfo> costs;
+    for (const Path& material : materials) {
+        std::vector<char> buffer;
+        if (!readMaterial(material, &buffer)) {
+            return 1;
+        }
+        if (!getCostInfo(material.getName(), buffer.data(), buffer.size(), &costs)) {
+            std::cerr << "The source material " << material << " is invalid." << std::endl;
+            return 1;
+        }
+    }
+
+    return printCostInfo(costs, config.maxInstructions) ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
     Config config;
     int optionIndex = handleArguments(argc, argv, &config);
@@ -836,6 +1008,10 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (config.printCost) {
+        return printCost(config, argc, argv, optionIndex);
+    }
+
     Path src(argv[optionIndex]);
     if (!src.exists()) {
         std::cerr << "The source material " << src << " does not exist." << std::endl;
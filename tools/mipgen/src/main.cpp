@@ -24,12 +24,17 @@
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 using namespace image;
 using namespace std;
@@ -44,6 +49,8 @@ static bool g_stripAlpha = false;
 static bool g_grayscale = false;
 static bool g_ktxContainer = false;
 static bool g_linearized = false;
+static bool g_fastCompression = false;
+static string g_batchFile;
 
 static const char* USAGE = R"TXT(
 MIPGEN generates mipmaps for an image down to the 1x1 level.
@@ -57,6 +64,7 @@ If the output format is a container format like KTX, then
 
 Usage:
     MIPGEN [options] <input_file> <output_pattern>
+    MIPGEN [options] --batch=<manifest>
 
 Options:
    --help, -h
@@ -91,11 +99,18 @@ Options:
            Photoshop: 16 (default), 32
            OpenEXR: RAW, RLE, ZIPS, ZIP, PIZ (default)
            DDS: 8, 16 (default), 32
+   --fast-compression
+       use the fastest settings of the KTX compression scheme, e.g. for continuous integration
+   --batch=MANIFEST, -b MANIFEST
+       process all the images listed in MANIFEST in parallel, each line of the manifest is an
+       input file and an output KTX file separated by whitespace, lines starting with # are
+       ignored, the other options apply to all images
 
 Examples:
     MIPGEN -g --kernel=hermite grassland.png mip_%03d.png
     MIPGEN -f ktx --compression=astc_fast_ldr_4x4 grassland.png mips.ktx
     MIPGEN -f ktx --compression=etc_rgb_rgba_40 grassland.png mips.ktx
+    MIPGEN --compression=astc_fast_ldr_4x4 --batch=textures.txt
 )TXT";
 
 static const char* HTML_PREFIX = R"HTML(<!DOCTYPE html>
@@ -134,7 +149,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hLlgpf:c:k:s";
+    static constexpr const char* OPTSTR = "hLlgpf:c:k:sb:";
     static const struct option OPTIONS[] = {
             { "help",                 no_argument, 0, 'h' },
             { "license",              no_argument, 0, 'L' },
@@ -145,6 +160,8 @@ static int handleArguments(int argc, char* argv[]) {
             { "compression",    required_argument, 0, 'c' },
             { "kernel",         required_argument, 0, 'k' },
             { "strip-alpha",          no_argument, 0, 's' },
+            { "fast-compression",     no_argument, 0, 'F' },
+            { "batch",          required_argument, 0, 'b' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -180,6 +197,12 @@ static int handleArguments(int argc, char* argv[]) {
             case 's':
                 g_stripAlpha = true;
                 break;
+            case 'F':
+                g_fastCompression = true;
+                break;
+            case 'b':
+                g_batchFile = arg;
+                break;
             case 'f':
                 if (arg == "png") {
                     g_format = ImageEncoder::Format::PNG;
@@ -219,9 +242,204 @@ static int handleArguments(int argc, char* argv[]) {
     return optind;
 }
 
+static LinearImage readImage(const Path& inputPath) {
+    ifstream inputStream(inputPath.getPath(), ios::binary);
+    LinearImage sourceImage = ImageDecoder::decode(inputStream, inputPath.getPath(),
+            g_linearized ? ImageDecoder::ColorSpace::LINEAR : ImageDecoder::ColorSpace::SRGB);
+    if (!sourceImage.isValid()) {
+        cerr << "Unable to open image: " << inputPath.getPath() << endl;
+        return sourceImage;
+    }
+    if (g_stripAlpha && sourceImage.getChannels() == 4) {
+        auto r = extractChannel(sourceImage, 0);
+        auto g = extractChannel(sourceImage, 1);
+        auto b = extractChannel(sourceImage, 2);
+        sourceImage = combineChannels({r, g, b});
+    }
+    if (g_grayscale) {
+        sourceImage = extractChannel(sourceImage, 0);
+    }
+
+    if (g_filter == Filter::GAUSSIAN_NORMALS) {
+        sourceImage = colorsToVectors(sourceImage);
+    }
+    return sourceImage;
+}
+
+// The calling thread must be adopted by the JobSystem, which is used by the encoders.
+static bool writeKtx(const Path& inputPath, const string& outputPath,
+        const LinearImage& sourceImage, const vector<LinearImage>& miplevels, JobSystem& js) {
+    // The libimage API does not include the original image in the mip array,
+    // which might make sense when generating individual files, but for a KTX
+    // bundle, we want to include level 0, so add 1 to the KTX level count.
+    KtxBundle container(1 + miplevels.size(), 1, false);
+    auto& info = container.info();
+    info = {
+        .endianness = KtxBundle::ENDIAN_DEFAULT,
+        .glType = KtxBundle::UNSIGNED_BYTE,
+        .glTypeSize = 3,
+        .glFormat = KtxBundle::RGB,
+        .glInternalFormat = KtxBundle::RGB,
+        .glBaseInternalFormat = KtxBundle::RGB,
+        .pixelWidth = sourceImage.getWidth(),
+        .pixelHeight = sourceImage.getHeight(),
+        .pixelDepth = 0,
+    };
+    if (g_grayscale) {
+        info.glTypeSize = 1;
+        info.glFormat =
+        info.glInternalFormat =
+        info.glBaseInternalFormat = KtxBundle::LUMINANCE;
+    }
+    CompressionConfig config {};
+    if (!g_compression.empty()) {
+        bool valid = parseOptionString(g_compression, &config);
+        if (!valid) {
+            cerr << "Unrecognized compression: " << g_compression << endl;
+            return false;
+        }
+        if (g_fastCompression) {
+            config = getFastestConfig(config);
+        }
+        // The KTX spec says the following for compressed textures: glTypeSize should 1,
+        // glFormat should be 0, and glBaseInternalFormat should be RED, RG, RGB, or RGBA.
+        // The glInternalFormat field is the only field that specifies the actual format.
+        info.glTypeSize = 1;
+        info.glFormat = 0;
+        info.glBaseInternalFormat = KtxBundle::RGBA;
+    }
+    uint32_t mip = 0;
+    auto addLevel = [&](LinearImage image) {
+        if (g_filter == Filter::GAUSSIAN_NORMALS) {
+            image = vectorsToColors(image);
+        }
+        std::unique_ptr<uint8_t[]> data;
+        if (config.type != CompressionConfig::INVALID) {
+            // Some encoders call exit(1) upon failure, so it's very useful to print some
+            // source image information here for when this is invoked from a build script.
+            // Note that some encoders also have limitations in terms of image size.
+            printf("Starting compression for %s (%dx%d)\n", inputPath.getName().c_str(),
+                    image.getWidth(), image.getHeight());
+            CompressedTexture tex = compressTexture(config, image, &js);
+            // Add newline here because the ASTC encoder has a progress indicator that issues a
+            // carriage return without a line feed.
+            putc('\n', stdout);
+            container.setBlob({mip++}, tex.data.get(), tex.size);
+            info.glInternalFormat = (uint32_t) tex.format;
+            return;
+        }
+        if (g_grayscale && g_linearized) {
+            data = fromLinearToGrayscale<uint8_t>(image);
+        } else if (g_grayscale) {
+            data = fromLinearTosRGB<uint8_t, 1>(image);
+        } else if (g_linearized) {
+            data = fromLinearToRGB<uint8_t>(image);
+        } else {
+            data = fromLinearTosRGB<uint8_t>(image);
+        }
+        container.setBlob({mip++, 0, 0}, data.get(),
+                image.getWidth() * image.getHeight() * container.info().glTypeSize);
+    };
+    addLevel(sourceImage);
+    for (auto const& image : miplevels) {
+        addLevel(image);
+    }
+    vector<uint8_t> fileContents(container.getSerializedLength());
+    container.serialize(fileContents.data(), fileContents.size());
+    ofstream outputStream(outputPath, ios::out | ios::binary);
+    outputStream.write((const char*) fileContents.data(), fileContents.size());
+    outputStream.close();
+    if (!outputStream) {
+        cerr << "An error occurred while writing the output file: " << outputPath << endl;
+        return false;
+    }
+    return true;
+}
+
+// Each line of the manifest is an input image and an output KTX file, separated by whitespace.
+// Empty lines and lines starting with '#' are ignored.
+static int processBatch(const string& manifestPath) {
+    struct Entry {
+        Path input;
+        string output;
+        LinearImage image;
+        vector<LinearImage> miplevels;
+    };
+
+    ifstream manifest(manifestPath);
+    if (!manifest) {
+        cerr << "Unable to open manifest: " << manifestPath << endl;
+        return 1;
+    }
+    vector<Entry> entries;
+    string line;
+    for (size_t lineNumber = 1; getline(manifest, line); lineNumber++) {
+        istringstream fields(line);
+        string input, output;
+        if (!(fields >> input) || input[0] == '#') {
+            continue;
+        }
+        if (!(fields >> output) || Path(output).getExtension() != "ktx") {
+            cerr << manifestPath << ":" << lineNumber << ": expected an input image followed by "
+                    "an output KTX file" << endl;
+            return 1;
+        }
+        entries.push_back({ Path(input), output });
+    }
+
+    // Images are decoded and filtered in parallel, a few at a time to bound memory usage. The
+    // encoders use global state, so compression is done one image at a time, with each image
+    // compressed in parallel.
+    const size_t groupSize = std::max(1u, std::thread::hardware_concurrency());
+    JobSystem js;
+    js.adopt();
+    size_t failures = 0;
+    for (size_t first = 0; first < entries.size(); first += groupSize) {
+        Entry* group = entries.data() + first;
+        const size_t count = std::min(groupSize, entries.size() - first);
+        printf("Generating miplevels for images %zu to %zu of %zu...\n",
+                first + 1, first + count, entries.size());
+        auto generate = [group, &js](uint32_t start, uint32_t n) {
+            for (Entry* entry = group + start; entry != group + start + n; ++entry) {
+                entry->image = readImage(entry->input);
+                if (entry->image.isValid()) {
+                    uint32_t levels = getMipmapCount(entry->image);
+                    entry->miplevels.resize(levels);
+                    generateMipmaps(entry->image, g_filter, entry->miplevels.data(), levels,
+                            &js);
+                }
+            }
+        };
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+                std::cref(generate), jobs::CountSplitter<1, 8>());
+        js.runAndWait(job);
+
+        for (Entry* entry = group; entry != group + count; ++entry) {
+            if (!entry->image.isValid() ||
+                    !writeKtx(entry->input, entry->output, entry->image, entry->miplevels, js)) {
+                failures++;
+            }
+            entry->image = {};
+            entry->miplevels = {};
+        }
+    }
+    js.emancipate();
+
+    if (failures) {
+        cerr << failures << " of " << entries.size() << " images could not be processed."
+                << endl;
+        return 1;
+    }
+    puts("Done.");
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     int optionIndex = handleArguments(argc, argv);
     int numArgs = argc - optionIndex;
+    if (!g_batchFile.empty()) {
+        return processBatch(g_batchFile);
+    }
     if (numArgs < 2) {
         printUsage(argv[0]);
         return 1;
@@ -236,111 +454,25 @@ int main(int argc, char* argv[]) {
     }
 
     puts("Reading image...");
-    ifstream inputStream(inputPath.getPath(), ios::binary);
-    LinearImage sourceImage = ImageDecoder::decode(inputStream, inputPath.getPath(),
-            g_linearized ? ImageDecoder::ColorSpace::LINEAR : ImageDecoder::ColorSpace::SRGB);
+    LinearImage sourceImage = readImage(inputPath);
     if (!sourceImage.isValid()) {
-        cerr << "Unable to open image: " << inputPath.getPath() << endl;
         return 1;
     }
-    if (g_stripAlpha && sourceImage.getChannels() == 4) {
-        auto r = extractChannel(sourceImage, 0);
-        auto g = extractChannel(sourceImage, 1);
-        auto b = extractChannel(sourceImage, 2);
-        sourceImage = combineChannels({r, g, b});
-    }
-    if (g_grayscale) {
-        sourceImage = extractChannel(sourceImage, 0);
-    }
-
-    if (g_filter == Filter::GAUSSIAN_NORMALS) {
-        sourceImage = colorsToVectors(sourceImage);
-    }
 
     puts("Generating miplevels...");
     uint32_t count = getMipmapCount(sourceImage);
     vector<LinearImage> miplevels(count);
-    generateMipmaps(sourceImage, g_filter, miplevels.data(), count);
+    JobSystem js;
+    js.adopt();
+    generateMipmaps(sourceImage, g_filter, miplevels.data(), count, &js);
 
     if (g_ktxContainer) {
         puts("Writing KTX file to disk...");
-        // The libimage API does not include the original image in the mip array,
-        // which might make sense when generating individual files, but for a KTX
-        // bundle, we want to include level 0, so add 1 to the KTX level count.
-        KtxBundle container(1 + miplevels.size(), 1, false);
-        auto& info = container.info();
-        info = {
-            .endianness = KtxBundle::ENDIAN_DEFAULT,
-            .glType = KtxBundle::UNSIGNED_BYTE,
-            .glTypeSize = 3,
-            .glFormat = KtxBundle::RGB,
-            .glInternalFormat = KtxBundle::RGB,
-            .glBaseInternalFormat = KtxBundle::RGB,
-            .pixelWidth = sourceImage.getWidth(),
-            .pixelHeight = sourceImage.getHeight(),
-            .pixelDepth = 0,
-        };
-        if (g_grayscale) {
-            info.glTypeSize = 1;
-            info.glFormat =
-            info.glInternalFormat =
-            info.glBaseInternalFormat = KtxBundle::LUMINANCE;
-        }
-        CompressionConfig config {};
-        if (!g_compression.empty()) {
-            bool valid = parseOptionString(g_compression, &config);
-            if (!valid) {
-                cerr << "Unrecognized compression: " << g_compression << endl;
-                return 1;
-            }
-            // The KTX spec says the following for compressed textures: glTypeSize should 1,
-            // glFormat should be 0, and glBaseInternalFormat should be RED, RG, RGB, or RGBA.
-            // The glInternalFormat field is the only field that specifies the actual format.
-            info.glTypeSize = 1;
-            info.glFormat = 0;
-            info.glBaseInternalFormat = KtxBundle::RGBA;
-        }
-        uint32_t mip = 0;
-        auto addLevel = [&](LinearImage image) {
-            if (g_filter == Filter::GAUSSIAN_NORMALS) {
-                image = vectorsToColors(image);
-            }
-            std::unique_ptr<uint8_t[]> data;
-            if (config.type != CompressionConfig::INVALID) {
-                // Some encoders call exit(1) upon failure, so it's very useful to print some
-                // source image information here for when this is invoked from a build script.
-                // Note that some encoders also have limitations in terms of image size.
-                printf("Starting compression for %s (%dx%d)\n", inputPath.getName().c_str(),
-                        image.getWidth(), image.getHeight());
-                CompressedTexture tex = compressTexture(config, image);
-                // Add newline here because the ASTC encoder has a progress indicator that issues a
-                // carriage return without a line feed.
-                putc('\n', stdout);
-                container.setBlob({mip++}, tex.data.get(), tex.size);
-                info.glInternalFormat = (uint32_t) tex.format;
-                return;
-            }
-            if (g_grayscale && g_linearized) {
-                data = fromLinearToGrayscale<uint8_t>(image);
-            } else if (g_grayscale) {
-                data = fromLinearTosRGB<uint8_t, 1>(image);
-            } else if (g_linearized) {
-                data = fromLinearToRGB<uint8_t>(image);
-            } else {
-                data = fromLinearTosRGB<uint8_t>(image);
-            }
-            container.setBlob({mip++, 0, 0}, data.get(),
-                    image.getWidth() * image.getHeight() * container.info().glTypeSize);
-        };
-        addLevel(sourceImage);
-        for (auto image : miplevels) {
-            addLevel(image);
+        bool success = writeKtx(inputPath, outputPattern, sourceImage, miplevels, js);
+        js.emancipate();
+        if (!success) {
+            return 1;
         }
-        vector<uint8_t> fileContents(container.getSerializedLength());
-        container.serialize(fileContents.data(), fileContents.size());
-        ofstream outputStream(outputPattern, ios::out | ios::binary);
-        outputStream.write((const char*) fileContents.data(), fileContents.size());
-        outputStream.close();
         puts("Done.");
         return 0;
     }
@@ -348,26 +480,46 @@ int main(int argc, char* argv[]) {
     puts("Writing image files to disk...");
     char path[256];
     uint32_t mip = 1; // start at 1 because 0 is the original image
-    for (auto image: miplevels) {
+    vector<string> paths;
+    for (uint32_t index = 0; index < count; index++) {
         int result = snprintf(path, sizeof(path), outputPattern.c_str(), mip++);
         if (result < 0 || result >= sizeof(path)) {
             cerr << "Output pattern is too long." << endl;
+            js.emancipate();
             return 1;
         }
-        ofstream outputStream(path, ios::binary | ios::trunc);
-        if (!outputStream) {
-            cerr << "The output file cannot be opened: " << path << endl;
-        } else {
-            if (!ImageEncoder::encode(outputStream, g_format, image, g_compression, path)) {
+        paths.emplace_back(path);
+    }
+
+    // Each miplevel is encoded and written to its own file, in parallel.
+    std::atomic<bool> failed(false);
+    auto write = [&](uint32_t first, uint32_t n) {
+        for (uint32_t index = first; index < first + n; index++) {
+            const string& filename = paths[index];
+            ofstream outputStream(filename, ios::binary | ios::trunc);
+            if (!outputStream) {
+                cerr << "The output file cannot be opened: " << filename << endl;
+                continue;
+            }
+            if (!ImageEncoder::encode(outputStream, g_format, miplevels[index], g_compression,
+                    filename)) {
                 cerr << "An error occurred while encoding the image." << endl;
-                return 1;
+                failed = true;
+                continue;
             }
             outputStream.close();
             if (!outputStream) {
-                cerr << "An error occurred while writing the output file: " << path << endl;
-                return 1;
+                cerr << "An error occurred while writing the output file: " << filename << endl;
+                failed = true;
             }
         }
+    };
+    auto job = jobs::parallel_for(js, nullptr, 0, count,
+            std::cref(write), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+    js.emancipate();
+    if (failed) {
+        return 1;
     }
 
     if (g_createGallery) {
@@ -185,25 +185,62 @@ inline bool isPOT(size_t x) {
     return !(x & (x - 1));
 }
 
-float solveVMF(const float2& pos, const size_t sampleCount, const float roughness,
-        const LinearImage& normal) {
-
-    float3 averageNormal(0.0f);
-    float2 topLeft(-float(sampleCount) / 2.0f + 0.5f);
-
-    for (size_t y = 0; y < sampleCount; y++) {
-        for (size_t x = 0; x < sampleCount; x++) {
-            float2 offset(topLeft + float2(x, y));
-            float2 samplePos(floor(pos + offset) + 0.5f);
-            float3 sampleNormal = *normal.get<float3>(size_t(samplePos.x), size_t(samplePos.y));
-            sampleNormal = sampleNormal * 2.0f - 1.0f;
+// Rows are split in chunks of at least this many pixels between the threads
+static constexpr size_t ROW_CHUNK_PIXELS = 4096;
+
+template<typename F>
+static void parallelRows(JobSystem& js, size_t width, size_t height, F functor) {
+    // images with few rows go to a single job
+    const uint32_t rows = uint32_t(std::max(size_t(1), ROW_CHUNK_PIXELS / width));
+    struct Splitter {
+        uint32_t rows;
+        bool split(size_t splits, size_t count) const noexcept {
+            return splits < 12 && count >= rows * 2;
+        }
+    };
+    JobSystem::Job* job = jobs::parallel_for(js, nullptr, 0, uint32_t(height),
+            [&functor](uint32_t y0, uint32_t count) {
+                for (size_t y = y0; y < y0 + count; y++) {
+                    functor(y);
+                }
+            }, Splitter{ rows });
+    js.runAndWait(job);
+}
 
-            averageNormal += normalize(sampleNormal);
+// The unit normals of the normal map
+static LinearImage unitNormals(JobSystem& js, const LinearImage& normal) {
+    const size_t width = normal.getWidth();
+    const size_t height = normal.getHeight();
+    LinearImage result(uint32_t(width), uint32_t(height), 3);
+    parallelRows(js, width, height, [&normal, &result, width](size_t y) {
+        const float3* UTILS_RESTRICT in = normal.get<float3>(0, y);
+        float3* UTILS_RESTRICT out = result.get<float3>(0, y);
+        for (size_t x = 0; x < width; x++) {
+            out[x] = normalize(in[x] * 2.0f - 1.0f);
         }
-    }
+    });
+    return result;
+}
 
-    averageNormal /= (sampleCount * sampleCount);
+// The average of each 2x2 block of normals. Starting from the unit normals, level i of these
+// averages is the average of the unit normals of the 2^i x 2^i block of the normal map that
+// covers each pixel of mip level i, which solveVMF() needs.
+static LinearImage averageNormals(JobSystem& js, const LinearImage& source) {
+    const size_t width = source.getWidth() / 2;
+    const size_t height = source.getHeight() / 2;
+    LinearImage result(uint32_t(width), uint32_t(height), 3);
+    parallelRows(js, width, height, [&source, &result, width](size_t y) {
+        const float3* UTILS_RESTRICT in0 = source.get<float3>(0, y * 2);
+        const float3* UTILS_RESTRICT in1 = source.get<float3>(0, y * 2 + 1);
+        float3* UTILS_RESTRICT out = result.get<float3>(0, y);
+        for (size_t x = 0; x < width; x++) {
+            out[x] = (in0[x * 2] + in0[x * 2 + 1] + in1[x * 2] + in1[x * 2 + 1]) * 0.25f;
+        }
+    });
+    return result;
+}
 
+float solveVMF(const float3& averageNormal, const float roughness) {
     float r = length(averageNormal);
     float kappa = 10000.0f;
 
@@ -218,42 +255,21 @@ float solveVMF(const float2& pos, const size_t sampleCount, const float roughnes
     return std::sqrt(roughness * roughness + (2.0f / kappa));
 }
 
-void prefilter(const LinearImage& normal, const size_t mipLevel, LinearImage& output) {
-    const size_t width = output.getWidth();
-    const size_t height = output.getHeight();
-    const size_t sampleCount = 1u << mipLevel;
-
-    for (size_t y = 0; y < height; y++) {
-        auto outputRow = output.get<float>(0, y);
-        for (size_t x = 0; x < width; x++, outputRow++) {
-            const float2 uv = (float2(x, y) + 0.5f) / float2(width, height);
-            const float2 pos = uv * normal.getWidth();
-            const float roughness = g_roughness;
-            *outputRow = solveVMF(pos, sampleCount, roughness, normal);
-        }
-    }
-}
-
-template<bool FIRST_MIP>
-void prefilter(const LinearImage& normal, const LinearImage& roughness, const size_t mipLevel,
+// averageNormal must have the size of the output, roughness is either nullptr or of the same size
+void prefilter(JobSystem& js, const LinearImage& averageNormal, const LinearImage* roughness,
         LinearImage& output) {
     const size_t width = output.getWidth();
     const size_t height = output.getHeight();
-    const size_t sampleCount = 1u << mipLevel;
-
-    for (size_t y = 0; y < height; y++) {
-        auto outputRow = output.get<float>(0, y);
-        for (size_t x = 0; x < width; x++, outputRow++) {
-            auto data = roughness.get<float>(x, y);
-            if (FIRST_MIP) {
-                *outputRow = *data;
-            } else {
-                const float2 uv = (float2(x, y) + 0.5f) / float2(width, height);
-                const float2 pos = uv * normal.getWidth();
-                *outputRow = solveVMF(pos, sampleCount, *data, normal);
-            }
+
+    parallelRows(js, width, height, [&averageNormal, roughness, &output, width](size_t y) {
+        const float3* UTILS_RESTRICT normalRow = averageNormal.get<float3>(0, y);
+        const float* UTILS_RESTRICT roughnessRow = roughness ? roughness->get<float>(0, y) : nullptr;
+        float* UTILS_RESTRICT outputRow = output.get<float>(0, y);
+        for (size_t x = 0; x < width; x++) {
+            const float r = roughnessRow ? roughnessRow[x] : g_roughness;
+            outputRow[x] = solveVMF(normalRow[x], r);
         }
-    }
+    });
 }
 
 int main(int argc, char* argv[]) {
@@ -371,10 +387,19 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // the levels of averages are computed one after the other, each of them on all the threads
+    std::vector<LinearImage> normalImages(mipLevels);
+    normalImages[0] = unitNormals(js, normalImage);
+    for (size_t i = 1; i < mipLevels; i++) {
+        normalImages[i] = averageNormals(js, normalImages[i - 1]);
+    }
+
+    // each level is filtered and encoded by its own job, with nested jobs for its rows, so that
+    // levels are encoded while others are filtered
     JobSystem::Job* parent = js.createJob();
     for (size_t i = 0; i < mipLevels; i++) {
-        JobSystem::Job* mip = jobs::createJob(js, parent, [&bundle, &normalImage, &mipImages,
-                outputMap, i, width, height, hasRoughnessMap]() {
+        JobSystem::Job* mip = jobs::createJob(js, parent, [&js, &bundle, &normalImages,
+                &mipImages, outputMap, i, width, height, hasRoughnessMap]() {
             const size_t w = width >> i;
             const size_t h = height >> i;
 
@@ -382,21 +407,14 @@ int main(int argc, char* argv[]) {
 
             if (i == 0) {
                 if (hasRoughnessMap) {
-                    if (mipImages.at(0).getWidth() == image.getWidth()) {
-                        const size_t size = image.getWidth() * image.getHeight() * sizeof(float);
-                        memcpy(image.getPixelRef(), mipImages.at(0).getPixelRef(), size);
-                    } else {
-                        prefilter<true>(normalImage, mipImages.at(0), 0, image);
-                    }
+                    const size_t size = image.getWidth() * image.getHeight() * sizeof(float);
+                    memcpy(image.getPixelRef(), mipImages.at(0).getPixelRef(), size);
                 } else {
                     std::fill_n(image.get<float>(), w * h, g_roughness);
                 }
             } else {
-                if (hasRoughnessMap) {
-                    prefilter<false>(normalImage, mipImages.at(i), i, image);
-                } else {
-                    prefilter(normalImage, i, image);
-                }
+                prefilter(js, normalImages.at(i), hasRoughnessMap ? &mipImages.at(i) : nullptr,
+                        image);
             }
 
             if (g_ktxContainer) {
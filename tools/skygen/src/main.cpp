@@ -18,6 +18,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 #include <math/mat3.h>
 #include <math/scalar.h>
@@ -79,9 +81,45 @@ static inline float3 XYZ_to_sRGB(float3 const& v) {
     return XYZ_sRGB * v;
 }
 
-static float angleBetween(float thetav, float phiv, float theta, float phi) {
-    float cosGamma = sinf(thetav) * sinf(theta) * cosf(phi - phiv) + cosf(thetav) * cosf(theta);
-    return acosf(cosGamma);
+// The constants of ArHosekSkyModel_GetRadianceInternal() for one channel, in float
+struct Channel {
+    Channel() = default;
+    Channel(const ArHosekSkyModelConfiguration& config, double radiance) noexcept {
+        for (size_t i = 0; i < 9; i++) {
+            c[i] = float(config[i]);
+        }
+        // 1 + g^2 in the Mie term doesn't depend on the direction
+        mie = 1.0f + c[8] * c[8];
+        this->radiance = float(radiance);
+    }
+    float c[9];
+    float mie;
+    float radiance;
+};
+
+// The terms of the radiance that only depend on the zenith angle, constant along a row
+struct RowTerms {
+    float scale;
+    float bias;
+};
+
+static inline RowTerms rowTerms(const Channel& ch, float cosTheta) noexcept {
+    const float* c = ch.c;
+    return {
+            (1.0f + c[0] * std::exp(c[1] / (cosTheta + 0.01f))) * ch.radiance,
+            c[2] + c[7] * std::sqrt(cosTheta)
+    };
+}
+
+// arhosek_tristim_skymodel_radiance() with the row terms hoisted out
+static inline float radiance(const Channel& ch, const RowTerms& row,
+        float cosGamma, float gamma) noexcept {
+    const float* c = ch.c;
+    const float expM = std::exp(c[4] * gamma);
+    const float rayM = cosGamma * cosGamma;
+    const float m = ch.mie - 2.0f * c[8] * cosGamma;
+    const float mieM = (1.0f + rayM) / (m * std::sqrt(m));
+    return row.scale * (row.bias + c[3] * expM + c[5] * rayM + c[6] * mieM);
 }
 
 static void generateSky(LinearImage image) {
@@ -91,53 +129,91 @@ static void generateSky(LinearImage image) {
     printf("    Turbidity: %.2f\n", g_turbidity);
     printf("\n");
 
+    const float solarElevation = clamp(g_elevation, 0.0f, float(M_PI_2));
+    const float sunTheta = float(M_PI_2 - solarElevation);
+    const float sunPhi = 0.0f;
+
+    ArHosekSkyModelState* skyState[3] = {
+            arhosek_xyz_skymodelstate_alloc_init(g_turbidity, g_groundAlbedo.r, solarElevation),
+            arhosek_xyz_skymodelstate_alloc_init(g_turbidity, g_groundAlbedo.g, solarElevation),
+            arhosek_xyz_skymodelstate_alloc_init(g_turbidity, g_groundAlbedo.b, solarElevation)
+    };
+
+    const size_t w = image.getWidth();
+    const size_t h = image.getHeight();
+
     struct {
         std::vector<float> maximas;
         std::mutex maximasMutex;
 
-        float solarElevation = clamp(g_elevation, 0.0f, float(M_PI_2));
-        float sunTheta = float(M_PI_2 - solarElevation);
-        float sunPhi = 0.0f;
+        // the configuration of channel i of skyState[i], see arhosek_tristim_skymodel_radiance()
+        Channel channels[3];
 
-        ArHosekSkyModelState* skyState[3] = {
-                arhosek_xyz_skymodelstate_alloc_init(g_turbidity, g_groundAlbedo.r, solarElevation),
-                arhosek_xyz_skymodelstate_alloc_init(g_turbidity, g_groundAlbedo.g, solarElevation),
-                arhosek_xyz_skymodelstate_alloc_init(g_turbidity, g_groundAlbedo.b, solarElevation)
-        };
+        // cos(phi - sunPhi) of each column, the same in all the rows
+        std::vector<float> cosPhi;
+        float sinSunTheta;
+        float cosSunTheta;
     } jobData{};
 
     jobData.maximas.reserve(256);
+    for (size_t i = 0; i < 3; i++) {
+        jobData.channels[i] = Channel(skyState[i]->configs[i], skyState[i]->radiances[i]);
+    }
+    jobData.cosPhi.resize(w);
+    for (size_t x = 0; x < w; x++) {
+        float u = (x + 0.5f) / w;
+        float phi = float(-2.0 * M_PI * u + M_PI + g_azimuth);
+        jobData.cosPhi[x] = std::cos(phi - sunPhi);
+    }
+    jobData.sinSunTheta = std::sin(sunTheta);
+    jobData.cosSunTheta = std::cos(sunTheta);
 
     // init the job system for parallel_for
     static JobSystem js;
     js.adopt();
 
-    // generate the sky
-    auto job = jobs::parallel_for<char>(js, nullptr, nullptr, uint32_t(image.getHeight()),
-        [&image, &jobData](char* d, size_t c) {
+    // generate the sky, only the rows above the horizon (theta <= pi/2) are rendered
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t((h + 1) / 2),
+        [&image, &jobData](uint32_t y0, uint32_t c) {
             const size_t w = image.getWidth();
             const size_t h = image.getHeight();
+            const float* UTILS_RESTRICT cosPhi = jobData.cosPhi.data();
+
+            // the angles to the sun of a row are computed first, in a loop that vectorizes,
+            // then the radiance, which only needs one acosf() and three expf() per pixel
+            std::unique_ptr<float[]> rows(new float[w * 2]);
+            float* UTILS_RESTRICT cosGamma = rows.get();
+            float* UTILS_RESTRICT gamma = rows.get() + w;
 
             float maxSample = 0.00001f;
 
-            size_t y0 = size_t(d);
             for (size_t y = y0; y < y0 + c; y++) {
                 float3* UTILS_RESTRICT data = image.get<float3>(0, y);
 
                 float v = (y + 0.5f) / h;
                 float theta = float(M_PI * v);
-                if (theta > M_PI_2) return;
+                float cosTheta = std::cos(theta);
+                float sinTheta = std::sin(theta);
 
-                for (size_t x = 0; x < w; x++, data++) {
-                    float u = (x + 0.5f) / w;
-                    float phi = float(-2.0 * M_PI * u + M_PI + g_azimuth);
+                RowTerms terms[3];
+                for (size_t i = 0; i < 3; i++) {
+                    terms[i] = rowTerms(jobData.channels[i], cosTheta);
+                }
 
-                    float gamma = angleBetween(theta, phi, jobData.sunTheta, jobData.sunPhi);
+                const float a = sinTheta * jobData.sinSunTheta;
+                const float b = cosTheta * jobData.cosSunTheta;
+                for (size_t x = 0; x < w; x++) {
+                    cosGamma[x] = clamp(a * cosPhi[x] + b, -1.0f, 1.0f);
+                }
+                for (size_t x = 0; x < w; x++) {
+                    gamma[x] = std::acos(cosGamma[x]);
+                }
 
+                for (size_t x = 0; x < w; x++, data++) {
                     float3 sample{
-                        arhosek_tristim_skymodel_radiance(jobData.skyState[0], theta, gamma, 0),
-                        arhosek_tristim_skymodel_radiance(jobData.skyState[1], theta, gamma, 1),
-                        arhosek_tristim_skymodel_radiance(jobData.skyState[2], theta, gamma, 2)
+                        radiance(jobData.channels[0], terms[0], cosGamma[x], gamma[x]),
+                        radiance(jobData.channels[1], terms[1], cosGamma[x], gamma[x]),
+                        radiance(jobData.channels[2], terms[2], cosGamma[x], gamma[x])
                     };
 
                     if (g_normalize) {
@@ -156,12 +232,11 @@ static void generateSky(LinearImage image) {
     );
 
     js.runAndWait(job);
-    js.reset();
 
     // cleanup sky data
-    arhosekskymodelstate_free(jobData.skyState[0]);
-    arhosekskymodelstate_free(jobData.skyState[1]);
-    arhosekskymodelstate_free(jobData.skyState[2]);
+    arhosekskymodelstate_free(skyState[0]);
+    arhosekskymodelstate_free(skyState[1]);
+    arhosekskymodelstate_free(skyState[2]);
 
     float maxValue = *std::max_element(jobData.maximas.cbegin(), jobData.maximas.cend());
     // remap to the range 0..16 to fit in our RGBM format
@@ -190,21 +265,27 @@ static void generateSky(LinearImage image) {
     }
     if (g_normalize) maxValue /= float(4.0 * M_PI / 683.0);
 
-    const size_t w = image.getWidth();
-    const size_t h = image.getHeight();
-
-    for (size_t y = 0; y < h; y++) {
-        float3* UTILS_RESTRICT data = image.get<float3>(0, y);
-        for (size_t x = 0; x < w; x++, data++) {
-            *data *= hdrScale;
-            if (g_tonemap) {
-                *data = tonemapACES(*data);
-            }
-            if (g_gammaCorrect) {
-                *data = pow(*data, 1.0f / 2.2f);
+    job = jobs::parallel_for(js, nullptr, 0, uint32_t(h),
+        [&image, hdrScale](uint32_t y0, uint32_t c) {
+            const size_t w = image.getWidth();
+            for (size_t y = y0; y < y0 + c; y++) {
+                float3* UTILS_RESTRICT data = image.get<float3>(0, y);
+                for (size_t x = 0; x < w; x++, data++) {
+                    *data *= hdrScale;
+                    if (g_tonemap) {
+                        *data = tonemapACES(*data);
+                    }
+                    if (g_gammaCorrect) {
+                        *data = pow(*data, 1.0f / 2.2f);
+                    }
+                }
             }
-        }
-    }
+        },
+        jobs::CountSplitter<1, 8>()
+    );
+
+    js.runAndWait(job);
+    js.reset();
 
     printf("Information\n");
     printf("    Max radiance:    %.2f W/(m^2.sr.nm)\n", maxValue);